@@ -4,6 +4,12 @@
 
 #include "core/allocation_tracker.h"
 
+#include <absl/strings/str_cat.h>
+
+#include <cstdio>
+
+#include "absl/debugging/stacktrace.h"
+#include "absl/random/distributions.h"
 #include "absl/random/random.h"
 #include "base/logging.h"
 #include "util/fibers/stacktrace.h"
@@ -53,7 +59,95 @@ absl::Span<const AllocationTracker::TrackingInfo> AllocationTracker::GetRanges()
   return absl::MakeConstSpan(tracking_);
 }
 
+void AllocationTracker::StartProfiling(size_t sample_period) {
+  StopProfiling();
+  sample_period_ = sample_period;
+  ResetSampleDistance();
+}
+
+void AllocationTracker::StopProfiling() {
+  // Releasing the containers calls ProcessDelete.
+  inside_tracker_ = true;
+  sample_period_ = 0;
+  samples_ = {};
+  sample_index_ = {};
+  live_blocks_ = {};
+  inside_tracker_ = false;
+}
+
+std::vector<AllocationTracker::ProfileSample> AllocationTracker::GetProfile() {
+  // Copying allocates, which must not sample into the vector being copied.
+  inside_tracker_ = true;
+  std::vector<ProfileSample> res = samples_;
+  inside_tracker_ = false;
+  return res;
+}
+
+std::string AllocationTracker::FormatHeapProfile(const std::vector<ProfileSample>& samples,
+                                                 size_t sample_period) {
+  ProfileSample total;
+  std::string records;
+  for (const ProfileSample& sample : samples) {
+    total.inuse_count += sample.inuse_count;
+    total.inuse_bytes += sample.inuse_bytes;
+    total.alloc_count += sample.alloc_count;
+    total.alloc_bytes += sample.alloc_bytes;
+    absl::StrAppend(&records, sample.inuse_count, ": ", sample.inuse_bytes, " [",
+                    sample.alloc_count, ": ", sample.alloc_bytes, "] @");
+    for (void* frame : sample.stack)
+      absl::StrAppend(&records, " ", absl::Hex(frame));
+    records.push_back('\n');
+  }
+
+  std::string res = absl::StrCat("heap profile: ", total.inuse_count, ": ", total.inuse_bytes,
+                                 " [", total.alloc_count, ": ", total.alloc_bytes,
+                                 "] @ heap_v2/", sample_period, "\n", records);
+
+  // pprof symbolizes the addresses with the mappings of the process.
+  res.append("\nMAPPED_LIBRARIES:\n");
+  if (FILE* maps = fopen("/proc/self/maps", "r"); maps) {
+    char buf[4096];
+    while (size_t len = fread(buf, 1, sizeof(buf), maps))
+      res.append(buf, len);
+    fclose(maps);
+  }
+  return res;
+}
+
+void AllocationTracker::ResetSampleDistance() {
+  // Exponentially distributed distances make every allocated byte equally likely to be sampled.
+  bytes_until_sample_ = int64_t(absl::Exponential<double>(g_bitgen, 1.0 / sample_period_)) + 1;
+}
+
+void AllocationTracker::SampleAllocation(void* ptr, size_t size) {
+  inside_tracker_ = true;
+  ResetSampleDistance();
+
+  constexpr int kMaxFrames = 32;
+  void* frames[kMaxFrames];
+  int depth = absl::GetStackTrace(frames, kMaxFrames, 2 /* skip the tracker and operator new */);
+
+  auto [it, inserted] =
+      sample_index_.emplace(std::vector<void*>(frames, frames + depth), samples_.size());
+  if (inserted)
+    samples_.push_back({.stack = it->first});
+
+  ProfileSample& sample = samples_[it->second];
+  sample.inuse_count++;
+  sample.inuse_bytes += size;
+  sample.alloc_count++;
+  sample.alloc_bytes += size;
+  live_blocks_[ptr] = {it->second, size};
+  inside_tracker_ = false;
+}
+
 void AllocationTracker::ProcessNew(void* ptr, size_t size) {
+  if (sample_period_ > 0 && !inside_tracker_ && ptr) {
+    bytes_until_sample_ -= size;
+    if (bytes_until_sample_ <= 0)
+      SampleAllocation(ptr, size);
+  }
+
   if (size < abs_min_size_ || size > abs_max_size_) {
     return;
   }
@@ -88,6 +182,15 @@ void AllocationTracker::ProcessDelete(void* ptr) {
     return;
   }
 
+  if (!live_blocks_.empty()) {
+    if (auto it = live_blocks_.find(ptr); it != live_blocks_.end()) {
+      ProfileSample& sample = samples_[it->second.sample];
+      sample.inuse_count--;
+      sample.inuse_bytes -= it->second.size;
+      live_blocks_.erase(it);
+    }
+  }
+
   inside_tracker_ = true;
   // we partially handle deletes, specifically when specifying a single range with
   // 100% sampling rate.
@@ -3,10 +3,13 @@
 //
 #pragma once
 
+#include <absl/container/flat_hash_map.h>
 #include <absl/container/inlined_vector.h>
 #include <mimalloc.h>
 
 #include <cstddef>
+#include <string>
+#include <vector>
 
 namespace dfly {
 
@@ -14,6 +17,9 @@ namespace dfly {
 // the stack trace of the memory allocation, if matched by size & sampling criteria.
 // Supports up to 4 different bands in parallel.
 //
+// Independently, heap profiling samples allocations by the number of allocated bytes and
+// aggregates their stacks in memory, so it is cheap enough to be enabled in production.
+//
 // Thread-local. Must be configured in all relevant threads separately.
 //
 // #define INJECT_ALLOCATION_TRACKER before #include exactly once to override new/delete
@@ -42,16 +48,55 @@ class AllocationTracker {
 
   absl::Span<const TrackingInfo> GetRanges() const;
 
+  // Allocations with the same stack. The counters are of the sampled allocations only.
+  struct ProfileSample {
+    std::vector<void*> stack;
+    uint64_t inuse_count = 0;
+    uint64_t inuse_bytes = 0;
+    uint64_t alloc_count = 0;
+    uint64_t alloc_bytes = 0;
+  };
+
+  // Starts heap profiling that samples an allocation every sample_period bytes on average.
+  // Sampled blocks freed by the same thread are removed from the in-use counters. Restarting
+  // drops the collected samples.
+  void StartProfiling(size_t sample_period);
+  void StopProfiling();
+
+  size_t profile_sample_period() const {
+    return sample_period_;
+  }
+
+  std::vector<ProfileSample> GetProfile();
+
+  // Formats the samples, possibly of several threads, in the legacy heap profile format that
+  // pprof reads and unsamples.
+  static std::string FormatHeapProfile(const std::vector<ProfileSample>& samples,
+                                       size_t sample_period);
+
   void ProcessNew(void* ptr, size_t size);
   void ProcessDelete(void* ptr);
 
  private:
   void UpdateAbsSizes();
+  void SampleAllocation(void* ptr, size_t size);
+  void ResetSampleDistance();
 
   absl::InlinedVector<TrackingInfo, 4> tracking_;
   bool inside_tracker_ = false;
   size_t abs_min_size_ = 0;
   size_t abs_max_size_ = 0;
+
+  size_t sample_period_ = 0;  // 0 if heap profiling is disabled
+  int64_t bytes_until_sample_ = 0;
+  std::vector<ProfileSample> samples_;
+  absl::flat_hash_map<std::vector<void*>, uint32_t> sample_index_;  // stack -> samples_ index
+
+  struct LiveBlock {
+    uint32_t sample;
+    size_t size;
+  };
+  absl::flat_hash_map<void*, LiveBlock> live_blocks_;
 };
 
 }  // namespace dfly
@@ -162,5 +162,35 @@ TEST_F(AllocationTrackerTest, Sampling) {
   EXPECT_EQ(deallocations, 0);  // we only track deletions when sample_odds == 1.0
 }
 
+TEST_F(AllocationTrackerTest, HeapProfile) {
+  AllocationTracker::Get().StartProfiling(1'000);
+
+  // Every allocation is larger than the sampling period, so all are sampled.
+  Allocate(100'000);
+  auto profile = AllocationTracker::Get().GetProfile();
+  uint64_t inuse_bytes = 0, alloc_count = 0;
+  for (const auto& sample : profile) {
+    inuse_bytes += sample.inuse_bytes;
+    alloc_count += sample.alloc_count;
+  }
+  EXPECT_GE(inuse_bytes, 100'000u);
+  EXPECT_GE(alloc_count, 1u);
+
+  Deallocate();
+  profile = AllocationTracker::Get().GetProfile();
+  uint64_t inuse_after = 0;
+  for (const auto& sample : profile)
+    inuse_after += sample.inuse_bytes;
+  EXPECT_LE(inuse_after + 100'000, inuse_bytes);
+
+  string text = AllocationTracker::FormatHeapProfile(profile, 1'000);
+  EXPECT_THAT(text, StartsWith("heap profile: "));
+  EXPECT_THAT(text, HasSubstr("@ heap_v2/1000\n"));
+  EXPECT_THAT(text, HasSubstr("MAPPED_LIBRARIES:"));
+
+  AllocationTracker::Get().StopProfiling();
+  EXPECT_TRUE(AllocationTracker::Get().GetProfile().empty());
+}
+
 }  // namespace
 }  // namespace dfly
@@ -0,0 +1,143 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/bitops.h"
+
+#include <absl/numeric/bits.h>
+
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+inline uint64_t LoadWord(const uint8_t* src) {
+  uint64_t res;
+  memcpy(&res, src, sizeof(res));
+  return res;
+}
+
+inline void StoreWord(uint64_t val, uint8_t* dest) {
+  memcpy(dest, &val, sizeof(val));
+}
+
+template <BitOpType op> inline uint64_t Apply(uint64_t a, uint64_t b) {
+  if constexpr (op == BitOpType::AND)
+    return a & b;
+  else if constexpr (op == BitOpType::OR)
+    return a | b;
+  else
+    return a ^ b;
+}
+
+#if defined(__AVX2__)
+template <BitOpType op> inline __m256i Apply(__m256i a, __m256i b) {
+  if constexpr (op == BitOpType::AND)
+    return _mm256_and_si256(a, b);
+  else if constexpr (op == BitOpType::OR)
+    return _mm256_or_si256(a, b);
+  else
+    return _mm256_xor_si256(a, b);
+}
+#endif
+
+template <BitOpType op> void BitOpInPlaceT(const uint8_t* src, size_t len, uint8_t* dest) {
+  size_t i = 0;
+#if defined(__AVX2__)
+  for (; i + 32 <= len; i += 32) {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dest + i));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i), Apply<op>(a, b));
+  }
+#endif
+  for (; i + 8 <= len; i += 8) {
+    StoreWord(Apply<op>(LoadWord(dest + i), LoadWord(src + i)), dest + i);
+  }
+  for (; i < len; ++i) {
+    dest[i] = Apply<op>(dest[i], src[i]);
+  }
+}
+
+}  // namespace
+
+size_t CountBits(string_view data) {
+  const uint8_t* ptr = reinterpret_cast<const uint8_t*>(data.data());
+  const size_t len = data.size();
+  size_t i = 0;
+  uint64_t res = 0;
+
+#if defined(__AVX512F__) && defined(__AVX512VPOPCNTDQ__)
+  __m512i acc = _mm512_setzero_si512();
+  for (; i + 64 <= len; i += 64) {
+    __m512i val = _mm512_loadu_si512(ptr + i);
+    acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(val));
+  }
+  res = _mm512_reduce_add_epi64(acc);
+#endif
+
+  // Independent counters let the cpu run several popcounts per cycle.
+  uint64_t cnt[4] = {0, 0, 0, 0};
+  for (; i + 32 <= len; i += 32) {
+    cnt[0] += absl::popcount(LoadWord(ptr + i));
+    cnt[1] += absl::popcount(LoadWord(ptr + i + 8));
+    cnt[2] += absl::popcount(LoadWord(ptr + i + 16));
+    cnt[3] += absl::popcount(LoadWord(ptr + i + 24));
+  }
+  res += cnt[0] + cnt[1] + cnt[2] + cnt[3];
+
+  for (; i + 8 <= len; i += 8) {
+    res += absl::popcount(LoadWord(ptr + i));
+  }
+  for (; i < len; ++i) {
+    res += absl::popcount(ptr[i]);
+  }
+  return res;
+}
+
+void BitOpInPlace(BitOpType op, string_view src, uint8_t* dest) {
+  const uint8_t* ptr = reinterpret_cast<const uint8_t*>(src.data());
+  switch (op) {
+    case BitOpType::AND:
+      return BitOpInPlaceT<BitOpType::AND>(ptr, src.size(), dest);
+    case BitOpType::OR:
+      return BitOpInPlaceT<BitOpType::OR>(ptr, src.size(), dest);
+    case BitOpType::XOR:
+      return BitOpInPlaceT<BitOpType::XOR>(ptr, src.size(), dest);
+  }
+}
+
+size_t FindFirstByteNotEqual(string_view data, uint8_t byte) {
+  const uint8_t* ptr = reinterpret_cast<const uint8_t*>(data.data());
+  const size_t len = data.size();
+  size_t i = 0;
+
+#if defined(__AVX2__)
+  const __m256i pattern = _mm256_set1_epi8(byte);
+  for (; i + 32 <= len; i += 32) {
+    __m256i val = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr + i));
+    uint32_t eq_mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(val, pattern));
+    if (eq_mask != 0xFFFFFFFF)
+      return i + absl::countr_one(eq_mask);
+  }
+#endif
+
+  const uint64_t pattern64 = 0x0101010101010101ULL * byte;
+  for (; i + 8 <= len; i += 8) {
+    if (LoadWord(ptr + i) != pattern64)
+      break;
+  }
+  for (; i < len; ++i) {
+    if (ptr[i] != byte)
+      return i;
+  }
+  return len;
+}
+
+}  // namespace dfly
@@ -0,0 +1,30 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace dfly {
+
+// Kernels for the bitmap commands. They process a vector register or a 64-bit word at a time
+// instead of single bytes. The vector width is chosen at compile time, like the rest of the SIMD
+// code in core.
+
+enum class BitOpType : uint8_t { AND, OR, XOR };
+
+// Returns the number of set bits in `data`.
+size_t CountBits(std::string_view data);
+
+// Applies dest[i] = dest[i] <op> src[i] for all the bytes of `src`. `dest` must be at least as
+// long as `src`.
+void BitOpInPlace(BitOpType op, std::string_view src, uint8_t* dest);
+
+// Returns the index of the first byte in `data` that differs from `byte`, or data.size() if
+// there is none.
+size_t FindFirstByteNotEqual(std::string_view data, uint8_t byte);
+
+}  // namespace dfly
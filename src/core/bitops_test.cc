@@ -0,0 +1,112 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/bitops.h"
+
+#include <absl/numeric/bits.h>
+
+#include <random>
+
+#include "base/gtest.h"
+
+namespace dfly {
+
+using namespace std;
+
+class BitOpsTest : public ::testing::Test {
+ protected:
+  string RandomBytes(size_t len) {
+    string res(len, '\0');
+    for (char& c : res)
+      c = gen_();
+    return res;
+  }
+
+  mt19937 gen_{42};
+};
+
+TEST_F(BitOpsTest, CountBits) {
+  EXPECT_EQ(0u, CountBits(""));
+  EXPECT_EQ(8u, CountBits("\xff"));
+
+  // Lengths cover the vector loops, the word loop and the byte tail.
+  for (size_t len = 0; len < 300; ++len) {
+    string data = RandomBytes(len);
+    size_t expected = 0;
+    for (uint8_t c : data)
+      expected += absl::popcount(c);
+    ASSERT_EQ(expected, CountBits(data)) << len;
+  }
+}
+
+TEST_F(BitOpsTest, BitOpInPlace) {
+  for (size_t len = 0; len < 300; ++len) {
+    string a = RandomBytes(len), b = RandomBytes(len);
+    for (BitOpType op : {BitOpType::AND, BitOpType::OR, BitOpType::XOR}) {
+      string res = a;
+      BitOpInPlace(op, b, reinterpret_cast<uint8_t*>(res.data()));
+      for (size_t i = 0; i < len; ++i) {
+        uint8_t x = a[i], y = b[i];
+        uint8_t expected = op == BitOpType::AND ? (x & y) : op == BitOpType::OR ? (x | y) : (x ^ y);
+        ASSERT_EQ(expected, uint8_t(res[i])) << len << " " << i;
+      }
+    }
+  }
+
+  // Only the prefix covered by the source changes.
+  string dest(100, '\xff');
+  BitOpInPlace(BitOpType::AND, string(40, '\0'), reinterpret_cast<uint8_t*>(dest.data()));
+  EXPECT_EQ(string(40, '\0') + string(60, '\xff'), dest);
+}
+
+TEST_F(BitOpsTest, FindFirstByteNotEqual) {
+  EXPECT_EQ(0u, FindFirstByteNotEqual("", 0));
+
+  for (size_t len = 1; len < 300; ++len) {
+    string data(len, '\0');
+    ASSERT_EQ(len, FindFirstByteNotEqual(data, 0));
+    for (size_t pos : {size_t(0), len / 2, len - 1}) {
+      data.assign(len, '\xff');
+      data[pos] = '\x7f';
+      ASSERT_EQ(pos, FindFirstByteNotEqual(data, 0xff)) << len;
+    }
+  }
+}
+
+static void BM_CountBits(benchmark::State& state) {
+  string data(state.range(0), '\0');
+  mt19937 gen(1);
+  for (char& c : data)
+    c = gen();
+
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(CountBits(data));
+  }
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_CountBits)->Arg(1 << 10)->Arg(1 << 20)->Arg(1 << 26);
+
+static void BM_BitOpAnd(benchmark::State& state) {
+  string src(state.range(0), '\x5a'), dest(state.range(0), '\xff');
+
+  while (state.KeepRunning()) {
+    BitOpInPlace(BitOpType::AND, src, reinterpret_cast<uint8_t*>(dest.data()));
+    benchmark::DoNotOptimize(dest.data());
+  }
+  state.SetBytesProcessed(state.iterations() * src.size());
+}
+BENCHMARK(BM_BitOpAnd)->Arg(1 << 10)->Arg(1 << 20)->Arg(1 << 26);
+
+static void BM_FindFirstByteNotEqual(benchmark::State& state) {
+  string data(state.range(0), '\0');
+  data.back() = 1;
+
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(FindFirstByteNotEqual(data, 0));
+  }
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_FindFirstByteNotEqual)->Arg(1 << 10)->Arg(1 << 20)->Arg(1 << 26);
+
+}  // namespace dfly
@@ -34,8 +34,28 @@ inline uint64_t BitIndex(uint64_t low, uint64_t hi, unsigned i, uint64_t mask) {
 constexpr double kDenom = M_LN2 * M_LN2;
 constexpr double kSBFErrorFactor = 0.5;
 
-inline double BPE(double fp_prob) {
-  return -log(fp_prob) / kDenom;
+// Blocks are filled unevenly, blocked filters compensate for it with more bits per element.
+constexpr double kBlockedBitsFactor = 1.3;
+
+constexpr unsigned kBlockWords = Bloom::kBlockBits / 64;
+constexpr size_t kSBFBatchSize = 16;
+constexpr size_t kBlockAlign = Bloom::kBlockBits / 8;
+
+inline double BPE(double fp_prob, bool blocked) {
+  double bpe = -log(fp_prob) / kDenom;
+  return blocked ? bpe * kBlockedBitsFactor : bpe;
+}
+
+// Fills the mask of the bits that the item sets within its block. The bit positions are
+// derived from the fingerprint half that does not select the block.
+inline void BlockMask(const uint64_t fp[2], unsigned hash_cnt, uint64_t mask[kBlockWords]) {
+  memset(mask, 0, kBlockWords * sizeof(uint64_t));
+  uint32_t h1 = fp[0];
+  uint32_t h2 = (fp[0] >> 32) | 1;
+  for (unsigned i = 0; i < hash_cnt; ++i) {
+    uint32_t pos = (h1 + h2 * i) >> 23;  // top 9 bits, i.e. a bit within kBlockBits.
+    mask[pos / 64] |= 1ULL << (pos % 64);
+  }
 }
 
 }  // namespace
@@ -44,17 +64,18 @@ Bloom::~Bloom() {
   CHECK(bf_ == nullptr);
 }
 
-Bloom::Bloom(Bloom&& o) : hash_cnt_(o.hash_cnt_), bit_log_(o.bit_log_), bf_(o.bf_) {
+Bloom::Bloom(Bloom&& o)
+    : hash_cnt_(o.hash_cnt_), bit_log_(o.bit_log_), blocked_(o.blocked_), bf_(o.bf_) {
   o.bf_ = nullptr;
 }
 
-void Bloom::Init(uint64_t entries, double fp_prob, PMR_NS::memory_resource* heap) {
+void Bloom::Init(uint64_t entries, double fp_prob, PMR_NS::memory_resource* heap, bool blocked) {
   CHECK(bf_ == nullptr);
   CHECK(fp_prob > 0 && fp_prob < 1);
 
   if (fp_prob > 0.5)
     fp_prob = 0.5;
-  double bpe = BPE(fp_prob);
+  double bpe = BPE(fp_prob, blocked);
 
   hash_cnt_ = ceil(M_LN2 * bpe);
 
@@ -65,21 +86,32 @@ void Bloom::Init(uint64_t entries, double fp_prob, PMR_NS::memory_resource* heap
   bits = absl::bit_ceil(bits);  // make it power of 2.
 
   uint64_t length = bits / 8;
-  bf_ = (uint8_t*)heap->allocate(length);
+  if (blocked) {
+    bf_ = (uint8_t*)heap->allocate(length, kBlockAlign);
+  } else {
+    bf_ = (uint8_t*)heap->allocate(length);
+  }
   memset(bf_, 0, length);
   bit_log_ = absl::countr_zero(bits);
+  blocked_ = blocked;
 }
 
-void Bloom::Init(uint8_t* blob, size_t len, unsigned hash_cnt) {
+void Bloom::Init(uint8_t* blob, size_t len, unsigned hash_cnt, bool blocked) {
   DCHECK_EQ(len * 8, absl::bit_ceil(len * 8));  // must be power of two.
   CHECK(bf_ == nullptr);
+  DCHECK(!blocked || (len * 8 >= kBlockBits && uintptr_t(blob) % kBlockAlign == 0));
   hash_cnt_ = hash_cnt;
   bf_ = blob;
   bit_log_ = absl::countr_zero(len * 8);
+  blocked_ = blocked;
 }
 
 void Bloom::Destroy(PMR_NS::memory_resource* resource) {
-  resource->deallocate(CHECK_NOTNULL(bf_), bitlen() / 8);
+  if (blocked_) {
+    resource->deallocate(CHECK_NOTNULL(bf_), bitlen() / 8, kBlockAlign);
+  } else {
+    resource->deallocate(CHECK_NOTNULL(bf_), bitlen() / 8);
+  }
   bf_ = nullptr;
 }
 
@@ -91,6 +123,18 @@ bool Bloom::Exists(std::string_view str) const {
 }
 
 bool Bloom::Exists(const uint64_t fp[2]) const {
+  if (blocked_) {
+    uint64_t mask[kBlockWords];
+    BlockMask(fp, hash_cnt_, mask);
+    const uint64_t* block = Block(fp);
+
+    // Tests all the words without branching, compilers vectorize this loop.
+    uint64_t missing = 0;
+    for (unsigned i = 0; i < kBlockWords; ++i)
+      missing |= mask[i] & ~block[i];
+    return missing == 0;
+  }
+
   uint64_t mask = GetMask(bit_log_);
   for (unsigned i = 0; i < hash_cnt_; ++i) {
     uint64_t index = BitIndex(fp[0], fp[1], i, mask);
@@ -107,6 +151,19 @@ bool Bloom::Add(std::string_view str) {
 }
 
 bool Bloom::Add(const uint64_t fp[2]) {
+  if (blocked_) {
+    uint64_t mask[kBlockWords];
+    BlockMask(fp, hash_cnt_, mask);
+    uint64_t* block = Block(fp);
+
+    uint64_t added = 0;
+    for (unsigned i = 0; i < kBlockWords; ++i) {
+      added |= mask[i] & ~block[i];
+      block[i] |= mask[i];
+    }
+    return added != 0;
+  }
+
   uint64_t mask = GetMask(bit_log_);
 
   unsigned changes = 0;
@@ -118,13 +175,30 @@ bool Bloom::Add(const uint64_t fp[2]) {
   return changes != 0;
 }
 
+void Bloom::Prefetch(const uint64_t fp[2]) const {
+  if (blocked_) {
+    __builtin_prefetch(Block(fp), 0, 1);
+    return;
+  }
+
+  uint64_t mask = GetMask(bit_log_);
+  for (unsigned i = 0; i < hash_cnt_; ++i) {
+    __builtin_prefetch(bf_ + BitIndex(fp[0], fp[1], i, mask) / 8, 0, 1);
+  }
+}
+
 size_t Bloom::Capacity(double fp_prob) const {
   if (fp_prob > 0.5)
     fp_prob = 0.5;
-  double bpe = BPE(fp_prob);
+  double bpe = BPE(fp_prob, blocked_);
   return floor(bitlen() / bpe);
 }
 
+inline uint64_t* Bloom::Block(const uint64_t fp[2]) const {
+  uint64_t block_mask = GetMask(bit_log_ - absl::countr_zero(kBlockBits));
+  return reinterpret_cast<uint64_t*>(bf_) + (fp[1] & block_mask) * kBlockWords;
+}
+
 inline bool Bloom::IsSet(size_t bit_idx) const {
   uint64_t byte_idx = bit_idx / 8;
   bit_idx %= 8;  // index within the byte
@@ -144,20 +218,25 @@ inline bool Bloom::Set(size_t bit_idx) {
 ///////////////////////////////////////////////////////////////////////////////
 // SBF implementation
 ///////////////////////////////////////////////////////////////////////////////
-SBF::SBF(uint64_t initial_capacity, double fp_prob, double grow_factor, PMR_NS::memory_resource* mr)
-    : filters_(1, mr), grow_factor_(grow_factor), fp_prob_(fp_prob * kSBFErrorFactor) {
-  filters_.front().Init(initial_capacity, fp_prob_, mr);
+SBF::SBF(uint64_t initial_capacity, double fp_prob, double grow_factor, PMR_NS::memory_resource* mr,
+         bool blocked)
+    : filters_(1, mr),
+      grow_factor_(grow_factor),
+      fp_prob_(fp_prob * kSBFErrorFactor),
+      blocked_(blocked) {
+  filters_.front().Init(initial_capacity, fp_prob_, mr, blocked_);
   max_capacity_ = filters_.front().Capacity(fp_prob_);
 }
 
 SBF::SBF(double grow_factor, double fp_prob, size_t max_capacity, size_t prev_size,
-         size_t current_size, PMR_NS::memory_resource* mr)
+         size_t current_size, PMR_NS::memory_resource* mr, bool blocked)
     : filters_(mr),
       grow_factor_(grow_factor),
       fp_prob_(fp_prob),
       prev_size_(prev_size),
       current_size_(current_size),
-      max_capacity_(max_capacity) {
+      max_capacity_(max_capacity),
+      blocked_(blocked) {
 }
 
 SBF::~SBF() {
@@ -173,22 +252,69 @@ SBF& SBF::operator=(SBF&& src) {
   fp_prob_ = src.fp_prob_;
   current_size_ = src.current_size_;
   max_capacity_ = src.max_capacity_;
+  blocked_ = src.blocked_;
 
   return *this;
 }
 
 void SBF::AddFilter(const std::string& blob, unsigned hash_cnt) {
   PMR_NS::memory_resource* mr = filters_.get_allocator().resource();
-  uint8_t* ptr = (uint8_t*)mr->allocate(blob.size(), 1);
+  uint8_t* ptr = (uint8_t*)mr->allocate(blob.size(), blocked_ ? kBlockAlign : 1);
   memcpy(ptr, blob.data(), blob.size());
-  filters_.emplace_back().Init(ptr, blob.size(), hash_cnt);
+  filters_.emplace_back().Init(ptr, blob.size(), hash_cnt, blocked_);
 }
 
 bool SBF::Add(std::string_view str) {
-  DCHECK_LT(current_size_, max_capacity_);
+  XXH128_hash_t hash = Hash(str);
+  uint64_t fp[2] = {hash.low64, hash.high64};
+  return Add(fp);
+}
 
+bool SBF::Exists(std::string_view str) const {
   XXH128_hash_t hash = Hash(str);
   uint64_t fp[2] = {hash.low64, hash.high64};
+  return Exists(fp);
+}
+
+void SBF::Add(absl::Span<const std::string_view> items, bool* res) {
+  uint64_t fps[kSBFBatchSize][2];
+  for (size_t start = 0; start < items.size(); start += kSBFBatchSize) {
+    auto batch = items.subspan(start, kSBFBatchSize);
+    PrepareBatch(batch, fps);
+
+    // Adds must stay sequential, since an add may grow a new filter.
+    for (size_t i = 0; i < batch.size(); ++i)
+      res[start + i] = Add(fps[i]);
+  }
+}
+
+void SBF::Exists(absl::Span<const std::string_view> items, bool* res) const {
+  uint64_t fps[kSBFBatchSize][2];
+  for (size_t start = 0; start < items.size(); start += kSBFBatchSize) {
+    auto batch = items.subspan(start, kSBFBatchSize);
+    PrepareBatch(batch, fps);
+
+    for (size_t i = 0; i < batch.size(); ++i)
+      res[start + i] = Exists(fps[i]);
+  }
+}
+
+void SBF::PrepareBatch(absl::Span<const std::string_view> items, uint64_t (*fps)[2]) const {
+  DCHECK_LE(items.size(), kSBFBatchSize);
+  for (size_t i = 0; i < items.size(); ++i) {
+    XXH128_hash_t hash = Hash(items[i]);
+    fps[i][0] = hash.low64;
+    fps[i][1] = hash.high64;
+  }
+
+  for (const Bloom& b : filters_) {
+    for (size_t i = 0; i < items.size(); ++i)
+      b.Prefetch(fps[i]);
+  }
+}
+
+bool SBF::Add(const uint64_t fp[2]) {
+  DCHECK_LT(current_size_, max_capacity_);
 
   auto exists = [fp](const Bloom& b) { return b.Exists(fp); };
 
@@ -207,7 +333,7 @@ bool SBF::Add(std::string_view str) {
   if (current_size_ >= max_capacity_) {
     fp_prob_ *= kSBFErrorFactor;
     filters_.emplace_back().Init(max_capacity_ * grow_factor_, fp_prob_,
-                                 filters_.get_allocator().resource());
+                                 filters_.get_allocator().resource(), blocked_);
     current_size_ = 0;
     max_capacity_ = filters_.back().Capacity(fp_prob_);
   }
@@ -215,10 +341,7 @@ bool SBF::Add(std::string_view str) {
   return true;
 }
 
-bool SBF::Exists(std::string_view str) const {
-  XXH128_hash_t hash = Hash(str);
-  uint64_t fp[2] = {hash.low64, hash.high64};
-
+bool SBF::Exists(const uint64_t fp[2]) const {
   auto exists = [fp](const Bloom& b) { return b.Exists(fp); };
 
   return any_of(filters_.crbegin(), filters_.crend(), exists);
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <absl/types/span.h>
+
 #include <cstdint>
 #include <string_view>
 #include <vector>
@@ -13,11 +15,16 @@
 namespace dfly {
 
 /// Bloom filter based on the design of https://github.com/jvirkki/libbloom
+/// A blocked filter places all the bits of an item into a single cache line sized block,
+/// so that a lookup costs one cache miss. It needs more bits for the same fp probability.
 class Bloom {
   Bloom(const Bloom&) = delete;
   Bloom& operator=(const Bloom&) = delete;
 
  public:
+  // Size in bits of a block of the blocked filter.
+  static constexpr unsigned kBlockBits = 512;
+
   Bloom() = default;
 
   // Note, that Destroy() must be called before calling the d'tor
@@ -27,10 +34,13 @@ class Bloom {
   // entries - entries are silently rounded up to the minimum capacity.
   // fp_prob - False-positive probability of collision. Must be in (0, 1) range.
   // heap
-  void Init(uint64_t entries, double fp_prob, PMR_NS::memory_resource* resource);
+  // blocked - whether to use the blocked layout.
+  void Init(uint64_t entries, double fp_prob, PMR_NS::memory_resource* resource,
+            bool blocked = false);
 
-  // Direct initializer. len*8 must be power of 2.
-  void Init(uint8_t* blob, size_t len, unsigned hash_cnt);
+  // Direct initializer. len*8 must be power of 2. Blobs of blocked filters must be aligned
+  // to kBlockBits / 8.
+  void Init(uint8_t* blob, size_t len, unsigned hash_cnt, bool blocked = false);
 
   // Destroys the object, must be called before destructing the object.
   // resource - resource with which the object was initialized.
@@ -49,6 +59,9 @@ class Bloom {
   bool Add(std::string_view str);
   bool Add(const uint64_t fp[2]);
 
+  // Prefetches the memory that Exists and Add access for the fingerprint.
+  void Prefetch(const uint64_t fp[2]) const;
+
   size_t bitlen() const {
     return 1ULL << bit_log_;
   }
@@ -66,12 +79,20 @@ class Bloom {
     return hash_cnt_;
   }
 
+  bool blocked() const {
+    return blocked_;
+  }
+
  private:
   bool IsSet(size_t index) const;
   bool Set(size_t index);  // return true if bit was set (i.e was 0 before)
 
+  // Returns the words of the block that holds the bits of the item.
+  uint64_t* Block(const uint64_t fp[2]) const;
+
   uint8_t hash_cnt_ = 0;
   uint8_t bit_log_ = 0;    // log of bit length of the filter. bit length is always power of 2.
+  bool blocked_ = false;
   uint8_t* bf_ = nullptr;  // pointer to the blob.
 };
 
@@ -87,12 +108,14 @@ class SBF {
   SBF(const SBF&) = delete;
 
  public:
-  SBF(uint64_t initial_capacity, double fp_prob, double grow_factor, PMR_NS::memory_resource* mr);
+  // blocked - whether the filters use the blocked layout, see Bloom.
+  SBF(uint64_t initial_capacity, double fp_prob, double grow_factor, PMR_NS::memory_resource* mr,
+      bool blocked = false);
 
   // C'tor used for loading persisted filters into SBF.
   // Should be followed by AddFilter.
   SBF(double grow_factor, double fp_prob, size_t max_capacity, size_t prev_size,
-      size_t current_size, PMR_NS::memory_resource* mr);
+      size_t current_size, PMR_NS::memory_resource* mr, bool blocked = false);
   ~SBF();
 
   SBF& operator=(SBF&& src);
@@ -102,6 +125,12 @@ class SBF {
   bool Add(std::string_view str);
   bool Exists(std::string_view str) const;
 
+  // Batched versions of the above, res must have items.size() entries.
+  // Items are hashed in small batches and their memory is prefetched in every filter before
+  // they are tested, which hides the memory latency of large filters.
+  void Add(absl::Span<const std::string_view> items, bool* res);
+  void Exists(absl::Span<const std::string_view> items, bool* res) const;
+
   size_t current_size() const {
     return current_size_;
   }
@@ -114,6 +143,10 @@ class SBF {
     return grow_factor_;
   }
 
+  bool blocked() const {
+    return blocked_;
+  }
+
   // expected fp probability for the current filter.
   double fp_probability() const {
     return fp_prob_;
@@ -139,6 +172,12 @@ class SBF {
   size_t MallocUsed() const;
 
  private:
+  bool Add(const uint64_t fp[2]);
+  bool Exists(const uint64_t fp[2]) const;
+
+  // Hashes items into fps and prefetches them in all the filters.
+  void PrepareBatch(absl::Span<const std::string_view> items, uint64_t (*fps)[2]) const;
+
   // multiple filters from the smallest to the largest.
   std::vector<Bloom, PMR_NS::polymorphic_allocator<Bloom>> filters_;
   double grow_factor_;
@@ -146,6 +185,7 @@ class SBF {
   size_t prev_size_ = 0;
   size_t current_size_ = 0;
   size_t max_capacity_;
+  bool blocked_ = false;
 };
 
 }  // namespace dfly
@@ -88,6 +88,57 @@ TEST_F(BloomTest, SBF) {
   EXPECT_LE(collisions, kNumElems * 0.008);
 }
 
+TEST_F(BloomTest, Blocked) {
+  Bloom bloom;
+  bloom.Init(10000, 0.01, PMR_NS::get_default_resource(), true);
+  EXPECT_TRUE(bloom.blocked());
+
+  size_t max_capacity = bloom.Capacity(0.01);
+  for (unsigned i = 0; i < max_capacity; ++i) {
+    bloom.Add(absl::StrCat("item", i));
+    ASSERT_TRUE(bloom.Exists(absl::StrCat("item", i)));
+  }
+
+  unsigned false_positives = 0;
+  for (unsigned i = 0; i < 10000; ++i) {
+    false_positives += bloom.Exists(absl::StrCat("other", i));
+  }
+  EXPECT_LE(false_positives, 10000 * 0.02);
+  bloom.Destroy(PMR_NS::get_default_resource());
+
+  SBF sbf(10, 0.01, 2, PMR_NS::get_default_resource(), true);
+  for (unsigned i = 0; i < 10000; ++i) {
+    sbf.Add(absl::StrCat("item", i));
+  }
+  EXPECT_GT(sbf.num_filters(), 1u);
+  for (unsigned i = 0; i < 10000; ++i) {
+    ASSERT_TRUE(sbf.Exists(absl::StrCat("item", i)));
+  }
+}
+
+TEST_F(BloomTest, SBFBatch) {
+  SBF sbf(10, 0.01, 2, PMR_NS::get_default_resource());
+
+  vector<string> items;
+  for (unsigned i = 0; i < 1000; ++i) {
+    items.push_back(absl::StrCat("item", i % 700));
+  }
+  vector<string_view> views(items.begin(), items.end());
+
+  unique_ptr<bool[]> res(new bool[views.size()]);
+  sbf.Add(views, res.get());
+  EXPECT_GT(sbf.num_filters(), 1u);
+  for (unsigned i = 700; i < views.size(); ++i) {
+    EXPECT_FALSE(res[i]) << i;  // duplicates of the earlier items.
+  }
+
+  sbf.Exists(views, res.get());
+  for (unsigned i = 0; i < views.size(); ++i) {
+    ASSERT_TRUE(res[i]) << i;
+    ASSERT_TRUE(sbf.Exists(views[i]));
+  }
+}
+
 static void BM_BloomExist(benchmark::State& state) {
   constexpr size_t kCapacity = 1U << 22;
   Bloom bloom;
@@ -4,6 +4,10 @@
 
 #pragma once
 
+#include <absl/functional/function_ref.h>
+
+#include <algorithm>
+#include <cstring>
 #include <functional>
 #include <optional>
 
@@ -47,6 +51,12 @@ template <typename T, typename Policy = BPTreePolicy<T>> class BPTree {
   // true if inserted, false if skipped.
   bool Insert(KeyT item);
 
+  // Appends item if it is greater than all items in the tree, otherwise returns false and leaves
+  // the tree intact. Walks only the rightmost spine and splits full nodes by moving their last
+  // key up instead of splitting at the median and rebalancing into the left sibling, so building
+  // a tree from sorted input leaves every node but the rightmost ones one key short of full.
+  bool Append(KeyT item);
+
   bool Contains(KeyT item) const;
 
   bool Delete(KeyT item);
@@ -114,6 +124,12 @@ template <typename T, typename Policy = BPTreePolicy<T>> class BPTree {
   /// Replaces old with new_obj.
   void ForceUpdate(KeyT old, KeyT new_obj);
 
+  /// @brief Copies the nodes for which should_move returns true to new allocations. Visits the
+  /// leaves holding the items of ranks [rank, rank + count) together with their ancestors.
+  /// @return the rank the next step resumes from, or 0 after the last item.
+  uint32_t DefragStep(uint32_t rank, uint32_t count,
+                      absl::FunctionRef<bool(const void*)> should_move, bool* moved);
+
  private:
   BPTreeNode* CreateNode(bool leaf);
 
@@ -218,6 +234,84 @@ template <typename T, typename Policy> bool BPTree<T, Policy>::Insert(KeyT item)
   return true;
 }
 
+template <typename T, typename Policy> bool BPTree<T, Policy>::Append(KeyT item) {
+  using Layout = detail::BPNodeLayout<T>;
+
+  if (!root_)
+    return Insert(item);
+
+  BPTreePath path;
+  BPTreeNode* node = root_;
+  while (!node->IsLeaf()) {
+    path.Push(node, node->NumItems());
+    node = node->Child(node->NumItems());
+  }
+
+  typename Policy::KeyCompareTo cmp;
+  if (cmp(item, node->Key(node->NumItems() - 1)) <= 0)
+    return false;
+
+  path.Push(node, node->NumItems());
+  count_++;
+
+  if (node->NumItems() < Layout::kMaxLeafKeys) {
+    node->LeafInsert(node->NumItems(), item);
+    if (path.Depth() > 1)
+      IncreaseSubtreeCounts(path, path.Depth() - 2, 1);
+    return true;
+  }
+
+  // The leaf is full: its last key becomes the separator and item starts a new right leaf.
+  KeyT median = node->Key(node->NumItems() - 1);
+  node->LeafEraseRight();
+  BPTreeNode* right = CreateNode(true);
+  right->InitSingle(item);
+
+  unsigned level = path.Depth() - 1;
+  while (level > 0) {
+    --level;
+    node = path.Node(level);
+    unsigned num_items = node->NumItems();
+
+    if (num_items < Layout::kMaxInnerKeys) {
+      node->InnerInsert(num_items, median, right);
+      node->IncreaseTreeCount(1);
+      right = nullptr;
+      break;
+    }
+
+    // The inner node is full as well. Its last child moves under a new right sibling together
+    // with (median, right), and its last key becomes the separator one level up.
+    BPTreeNode* last_child = node->Child(num_items);
+    BPTreeNode* next_right = CreateNode(false);
+    next_right->InitSingle(median);
+    next_right->SetChild(0, last_child);
+    next_right->SetChild(1, right);
+    next_right->SetTreeCount(last_child->TreeCount() + right->TreeCount() + 1);
+
+    median = node->Key(num_items - 1);
+    node->ShiftLeft(num_items - 1, true);
+
+    // The subtree of node gained item and lost next_right together with the new separator.
+    node->IncreaseTreeCount(-int32_t(next_right->TreeCount()));
+    right = next_right;
+  }
+
+  if (right) {
+    assert(level == 0);
+    BPTreeNode* new_root = CreateNode(false);
+    new_root->InitSingle(median);
+    new_root->SetChild(0, root_);
+    new_root->SetChild(1, right);
+    new_root->SetTreeCount(root_->TreeCount() + right->TreeCount() + 1);
+    root_ = new_root;
+    height_++;
+  } else if (level > 0) {
+    IncreaseSubtreeCounts(path, level - 1, 1);
+  }
+  return true;
+}
+
 template <typename T, typename Policy> bool BPTree<T, Policy>::Delete(KeyT item) {
   if (!root_)
     return false;
@@ -604,6 +698,40 @@ template <typename T, typename Policy> void BPTree<T, Policy>::Delete(BPTreePath
   }
 }
 
+template <typename T, typename Policy>
+uint32_t BPTree<T, Policy>::DefragStep(uint32_t rank, uint32_t count,
+                                       absl::FunctionRef<bool(const void*)> should_move,
+                                       bool* moved) {
+  const uint64_t end = std::min<uint64_t>(count_, uint64_t(rank) + count);
+  BPTreePath path;
+  while (rank < end) {
+    path.Clear();
+    ToRank(rank, &path);
+
+    // The path holds the nodes that were replaced, so track the parent separately.
+    BPTreeNode* parent = nullptr;
+    for (unsigned i = 0; i < path.Depth(); ++i) {
+      BPTreeNode* node = path.Node(i);
+      if (should_move(node)) {
+        void* ptr = mr_->allocate(detail::kBPNodeSize, 8);
+        memcpy(ptr, node, detail::kBPNodeSize);
+        if (parent)
+          parent->SetChild(path.Position(i - 1), static_cast<BPTreeNode*>(ptr));
+        else
+          root_ = static_cast<BPTreeNode*>(ptr);
+        mr_->deallocate(node, detail::kBPNodeSize, 8);
+        node = static_cast<BPTreeNode*>(ptr);
+        *moved = true;
+      }
+      parent = node;
+    }
+
+    // Skip the rest of the leaf.
+    rank += parent->NumItems() - path.Last().second;
+  }
+  return rank < count_ ? rank : 0;
+}
+
 template <typename T, typename Policy> void BPTree<T, Policy>::DestroyNode(BPTreeNode* node) {
   void* ptr = node;
   mr_->deallocate(ptr, detail::kBPNodeSize, 8);
@@ -7,6 +7,7 @@
 #include <gmock/gmock.h>
 #include <mimalloc.h>
 
+#include <numeric>
 #include <random>
 
 extern "C" {
@@ -226,6 +227,52 @@ TEST_F(BPTreeSetTest, Delete) {
   }
 }
 
+TEST_F(BPTreeSetTest, Append) {
+  for (unsigned i = 0; i < kNumElems; ++i) {
+    ASSERT_TRUE(bptree_.Append(i * 2));
+    ASSERT_EQ(i + 1, bptree_.Size());
+  }
+  ASSERT_TRUE(Validate());
+  ASSERT_FALSE(bptree_.Append(0));
+  ASSERT_FALSE(bptree_.Append(kNumElems * 2 - 2));
+  ASSERT_EQ(kNumElems, bptree_.Size());
+
+  for (unsigned i = 0; i < kNumElems; ++i) {
+    ASSERT_EQ(i, bptree_.GetRank(i * 2));
+  }
+
+  // Regular inserts and deletes keep working on a tree built by appends.
+  for (unsigned i = 0; i < kNumElems; ++i) {
+    ASSERT_TRUE(bptree_.Insert(i * 2 + 1));
+  }
+  ASSERT_TRUE(Validate());
+
+  vector<uint64_t> keys(kNumElems * 2);
+  iota(keys.begin(), keys.end(), 0);
+  shuffle(keys.begin(), keys.end(), generator_);
+  for (unsigned i = 0; i < keys.size(); ++i) {
+    ASSERT_TRUE(bptree_.Delete(keys[i]));
+    if (i % 128 == 0) {
+      ASSERT_TRUE(Validate()) << i;
+    }
+  }
+  ASSERT_EQ(mi_alloc_.used(), 0u);
+  ASSERT_EQ(bptree_.NodeCount(), 0u);
+
+  // Pop from the back and append again.
+  for (unsigned i = 0; i < kNumElems; ++i) {
+    ASSERT_TRUE(bptree_.Append(i));
+  }
+  for (unsigned i = kNumElems; i > kNumElems / 2; --i) {
+    ASSERT_TRUE(bptree_.Delete(i - 1));
+  }
+  for (unsigned i = kNumElems / 2; i < kNumElems; ++i) {
+    ASSERT_TRUE(bptree_.Append(i));
+  }
+  ASSERT_TRUE(Validate());
+  ASSERT_EQ(kNumElems, bptree_.Size());
+}
+
 TEST_F(BPTreeSetTest, Iterate) {
   FillTree(2);
 
@@ -497,6 +544,31 @@ void RegisterBPTreeBench() {
 
 REGISTER_MODULE_INITIALIZER(Bptree, RegisterBPTreeBench());
 
+TEST_F(BPTreeSetTest, DefragStep) {
+  FillTree(2);
+  const Node* root = bptree_.DEBUG_root();
+  size_t num_nodes = bptree_.NodeCount();
+
+  unsigned steps = 0;
+  uint32_t rank = 0;
+  do {
+    bool moved = false;
+    rank = bptree_.DefragStep(rank, 100, [](const void*) { return true; }, &moved);
+    EXPECT_TRUE(moved);
+    ++steps;
+  } while (rank != 0);
+
+  // Steps finish the leaf they end in.
+  EXPECT_GT(steps, 1u);
+  EXPECT_LE(steps, kNumElems / 100);
+  EXPECT_NE(root, bptree_.DEBUG_root());
+  EXPECT_EQ(num_nodes, bptree_.NodeCount());
+  ASSERT_TRUE(Validate());
+  for (unsigned i = 0; i < kNumElems; ++i) {
+    ASSERT_EQ(i, bptree_.GetRank(i * 2));
+  }
+}
+
 TEST_F(BPTreeSetTest, ForceUpdate) {
   struct Policy {
     // Similar to how it's used in SortedMap just a little simpler.
@@ -6,6 +6,7 @@
 
 // #define XXH_INLINE_ALL
 #include <xxhash.h>
+#include <zstd.h>
 
 extern "C" {
 #include "redis/intset.h"
@@ -15,8 +16,14 @@ extern "C" {
 #include "redis/util.h"
 #include "redis/zmalloc.h"  // for non-string objects.
 }
+#include <absl/container/flat_hash_map.h>
+#include <absl/strings/ascii.h>
+#include <absl/strings/match.h>
+#include <absl/strings/numbers.h>
 #include <absl/strings/str_cat.h>
 #include <absl/strings/strip.h>
+#include <absl/synchronization/mutex.h>
+#include <double-conversion/double-to-string.h>
 
 #include "base/flags.h"
 #include "base/logging.h"
@@ -26,10 +33,16 @@ extern "C" {
 #include "core/huff_coder.h"
 #include "core/qlist.h"
 #include "core/sorted_map.h"
+#include "core/sparse_bitmap.h"
 #include "core/string_map.h"
 #include "core/string_set.h"
 
 ABSL_FLAG(bool, experimental_flat_json, false, "If true uses flat json implementation.");
+ABSL_FLAG(uint32_t, zstd_value_min_len, 128,
+          "Minimal length of strings that are compressed once a zstd dictionary is set.");
+ABSL_FLAG(double, stream_compact_deleted_ratio, 0.25,
+          "Stream nodes in which deleted entries exceed this share are rewritten without them "
+          "and merged with their neighbours during memory defragmentation. 0 to disable.");
 
 namespace dfly {
 using namespace std;
@@ -177,6 +190,7 @@ size_t MallocUsedStream(stream* s) {
       streamCG* cg = (streamCG*)ri.data;
       asize += sizeof(*cg);
       asize += streamRadixTreeMemoryUsage(cg->pel);
+      asize += streamRadixTreeMemoryUsage(cg->pel_by_time);
       asize += sizeof(streamNACK) * raxSize(cg->pel);
 
       /* For each consumer we also need to add the basic data
@@ -325,6 +339,29 @@ pair<void*, bool> DefragZSet(unsigned encoding, void* ptr, float ratio) {
   }
 }
 
+// Drops deleted entries from the stream nodes that have too many of them, then moves the node
+// listpacks that sit on underutilized pages.
+pair<void*, bool> DefragStream(stream* s, float ratio) {
+  bool realloced = false;
+  const double deleted_ratio = absl::GetFlag(FLAGS_stream_compact_deleted_ratio);
+  if (deleted_ratio > 0 && streamCompact(s, deleted_ratio) > 0)
+    realloced = true;
+
+  raxIterator ri;
+  raxStart(&ri, s->rax_tree);
+  raxSeek(&ri, "^", NULL, 0);
+  while (raxNext(&ri)) {
+    auto [lp, moved] = DefragListPack((uint8_t*)ri.data, ratio);
+    if (moved) {
+      raxInsert(s->rax_tree, ri.key, ri.key_len, lp, NULL);
+      raxSeek(&ri, ">", ri.key, ri.key_len);
+      realloced = true;
+    }
+  }
+  raxStop(&ri);
+  return {s, realloced};
+}
+
 inline void FreeObjStream(void* ptr) {
   freeStream((stream*)ptr);
 }
@@ -358,20 +395,214 @@ struct Huffman {
   HuffmanDecoder decoder;
 };
 
+struct ZstdDict {
+  ZSTD_CCtx* cctx = nullptr;
+  ZSTD_DCtx* dctx = nullptr;
+  ZSTD_CDict* cdict = nullptr;
+  ZSTD_DDict* ddict = nullptr;
+  uint32_t min_len = 0;
+
+  ~ZstdDict() {
+    Reset();
+  }
+
+  void Reset() {
+    ZSTD_freeCCtx(cctx);
+    ZSTD_freeDCtx(dctx);
+    ZSTD_freeCDict(cdict);
+    ZSTD_freeDDict(ddict);
+    cctx = nullptr;
+    dctx = nullptr;
+    cdict = nullptr;
+    ddict = nullptr;
+  }
+
+  bool valid() const {
+    return cdict != nullptr;
+  }
+};
+
 struct TL {
   MemoryResource* local_mr = PMR_NS::get_default_resource();
   base::PODArray<uint8_t> tmp_buf;
   string tmp_str;
   size_t small_str_bytes;
-  Huffman huff_keys, huff_string_values;
+  // The keys table has two slots, so that it can be replaced while the entries encoded with the
+  // old table still exist. The most significant bit of the delta byte holds the slot.
+  Huffman huff_keys[2], huff_string_values;
+  uint8_t huff_keys_slot = 0;        // slot used for new entries.
+  bool huff_keys_swapping = false;  // entries of the other slot may still exist.
   uint64_t huff_encode_total = 0, huff_encode_success = 0;  // success/total metrics.
+  ZstdDict zstd;
+  uint64_t zstd_encode_total = 0, zstd_encode_success = 0;
+  absl::flat_hash_map<string, uint32_t> key_prefix_ids;  // cache of KeyPrefixes lookups.
 };
 
 thread_local TL tl;
 
+constexpr uint8_t kHuffDeltaMask = 0x7F;
+
+const HuffmanDecoder& HuffKeysDecoder(uint8_t first_byte) {
+  return tl.huff_keys[first_byte >> 7].decoder;
+}
+
+// ZSTD_TAG blobs start with the decoded length followed by a zstd frame without the content
+// size, the checksum and the dictionary id.
+constexpr size_t kZstdHeaderLen = sizeof(uint32_t);
+constexpr int kZstdLevel = 3;
+
+uint32_t ZstdDecodedLen(const void* blob) {
+  uint32_t len;
+  memcpy(&len, blob, sizeof(len));
+  return len;
+}
+
+// Returns false if the blob is corrupt or the thread has no dictionary to decode it with.
+bool ZstdDecode(string_view blob, char* dest) {
+  if (!tl.zstd.valid() || blob.size() < kZstdHeaderLen)
+    return false;
+
+  uint32_t len = ZstdDecodedLen(blob.data());
+  size_t res = ZSTD_decompress_usingDDict(tl.zstd.dctx, dest, len, blob.data() + kZstdHeaderLen,
+                                          blob.size() - kZstdHeaderLen, tl.zstd.ddict);
+  return !ZSTD_isError(res) && res == len;
+}
+
+using double_conversion::DoubleToStringConverter;
+
+// Formats doubles exactly like RedisReplyBuilder::FormatDouble does.
+const DoubleToStringConverter kDoubleConv(DoubleToStringConverter::UNIQUE_ZERO |
+                                              DoubleToStringConverter::EMIT_POSITIVE_EXPONENT_SIGN,
+                                          "inf", "nan", 'e', -6, 21, 6, 0);
+
+// The length of the longest shortest representation, e.g. "-2.2250738585072014e-308".
+constexpr size_t kMaxDoubleLen = 24;
+constexpr size_t kDoubleBufLen = 32;
+
+string_view FormatDouble(double val, char* buf) {
+  double_conversion::StringBuilder sb(buf, kDoubleBufLen);
+  kDoubleConv.ToShortest(val, &sb);
+  size_t len = sb.position();
+  sb.Finalize();
+  return {buf, len};
+}
+
+// Returns true if str is exactly what FormatDouble produces for val, so that DOUBLE_TAG
+// can restore it.
+bool ParseCanonicalDouble(string_view str, double* val) {
+  if (str.size() > kMaxDoubleLen)
+    return false;
+
+  // Cheap rejection of regular strings before parsing.
+  for (char c : str) {
+    if (!absl::ascii_isdigit(c) && c != '.' && c != '-' && c != '+' && c != 'e')
+      return false;
+  }
+
+  char buf[kDoubleBufLen];
+  return absl::SimpleAtod(str, val) && isfinite(*val) && FormatDouble(*val, buf) == str;
+}
+
+// Prefixes of PREFIX_INT_TAG strings, shared by all threads so that any thread can decode them.
+// Prefixes are only appended, hence an id stays valid for the lifetime of the process.
+class KeyPrefixes {
+ public:
+  static constexpr uint32_t kCapacity = 1024;
+  static constexpr size_t kMaxLen = 32;
+
+  static KeyPrefixes& Get() {
+    static KeyPrefixes prefixes;
+    return prefixes;
+  }
+
+  // Returns the id of the prefix, registering it if there is room left.
+  std::optional<uint32_t> FindOrAdd(string_view prefix) {
+    DCHECK_LE(prefix.size(), kMaxLen);
+    absl::MutexLock lock(&mu_);
+    if (auto it = ids_.find(prefix); it != ids_.end())
+      return it->second;
+
+    uint32_t id = size_.load(memory_order_relaxed);
+    if (id == kCapacity)
+      return nullopt;
+
+    entries_[id].len = prefix.size();
+    memcpy(entries_[id].data, prefix.data(), prefix.size());
+    ids_.emplace(prefix, id);
+    size_.store(id + 1, memory_order_release);
+    return id;
+  }
+
+  string_view Prefix(uint32_t id) const {
+    return {entries_[id].data, entries_[id].len};
+  }
+
+  bool full() const {
+    return size_.load(memory_order_relaxed) == kCapacity;
+  }
+
+ private:
+  struct Entry {
+    uint8_t len;
+    char data[kMaxLen];
+  };
+
+  absl::Mutex mu_;
+  absl::flat_hash_map<string, uint32_t> ids_ ABSL_GUARDED_BY(mu_);
+  atomic_uint32_t size_{0};
+  Entry entries_[kCapacity];
+};
+
+// The longest string held by PREFIX_INT_TAG, i.e. the longest prefix followed by 19 digits.
+constexpr size_t kMaxPrefixIntLen = KeyPrefixes::kMaxLen + 19;
+
+string_view FormatPrefixInt(uint32_t prefix_id, uint64_t val, char* buf) {
+  string_view prefix = KeyPrefixes::Get().Prefix(prefix_id);
+  absl::AlphaNum an(val);
+  memcpy(buf, prefix.data(), prefix.size());
+  memcpy(buf + prefix.size(), an.data(), an.size());
+  return {buf, prefix.size() + an.size()};
+}
+
 constexpr bool kUseSmallStrings = true;
 constexpr bool kUseAsciiEncoding = true;
 
+// Returns true if str is a prefix, like "user:", followed by an integer, so that PREFIX_INT_TAG
+// can restore it. Prefixes are registered on first use while the table has room.
+bool ParsePrefixInt(string_view str, uint32_t* prefix_id, uint64_t* val) {
+  size_t digits = 0;
+  while (digits < str.size() && absl::ascii_isdigit(str[str.size() - digits - 1]))
+    ++digits;
+
+  size_t prefix_len = str.size() - digits;
+  if (digits == 0 || digits > 19 || prefix_len == 0 || prefix_len > KeyPrefixes::kMaxLen)
+    return false;
+
+  // Leading zeros would not survive the round trip.
+  if (digits > 1 && str[prefix_len] == '0')
+    return false;
+
+  // Prefixes shared by many keys end with a separator. Those with digits, like the ones of
+  // timestamps, are mostly unique and would only fill up the table.
+  string_view prefix = str.substr(0, prefix_len);
+  auto is_digit = [](char c) { return absl::ascii_isdigit(c); };
+  if (!absl::ascii_ispunct(prefix.back()) || any_of(prefix.begin(), prefix.end(), is_digit))
+    return false;
+
+  if (auto it = tl.key_prefix_ids.find(prefix); it != tl.key_prefix_ids.end()) {
+    *prefix_id = it->second;
+  } else {
+    KeyPrefixes& prefixes = KeyPrefixes::Get();
+    optional<uint32_t> id = prefixes.full() ? nullopt : prefixes.FindOrAdd(prefix);
+    if (!id)
+      return false;
+    tl.key_prefix_ids.emplace(prefix, *id);
+    *prefix_id = *id;
+  }
+
+  return absl::SimpleAtoi(str.substr(prefix_len), val);
+}
+
 }  // namespace
 
 static_assert(sizeof(CompactObj) == 18);
@@ -557,6 +788,29 @@ void RobjWrapper::AppendString(string_view s, MemoryResource* mr) {
   sz_ += s.size();
 }
 
+void RobjWrapper::GrowString(size_t size, MemoryResource* mr) {
+  DCHECK_EQ(type_, OBJ_STRING);
+  DCHECK_GE(size, sz_);
+
+  size_t cur_cap = InnerObjMallocUsed();
+  if (size > cur_cap) {
+    size_t new_cap = max<size_t>(size, cur_cap + cur_cap / 2);
+    void* newp = mr->allocate(new_cap, kAlignSize);
+    if (sz_) {
+      memcpy(newp, inner_obj_, sz_);
+    }
+    if (cur_cap) {
+      mr->deallocate(inner_obj_, cur_cap, kAlignSize);
+    }
+    inner_obj_ = newp;
+  }
+
+  if (size > sz_) {
+    memset(reinterpret_cast<uint8_t*>(inner_obj_) + sz_, 0, size - sz_);
+    sz_ = size;
+  }
+}
+
 void RobjWrapper::SetSize(uint64_t size) {
   sz_ = size;
 }
@@ -579,10 +833,37 @@ bool RobjWrapper::DefragIfNeeded(float ratio) {
     return do_defrag(DefragSet);
   } else if (type() == OBJ_ZSET) {
     return do_defrag(DefragZSet);
+  } else if (type() == OBJ_STREAM) {
+    // sz_ tracks the malloc usage of streams.
+    const size_t used_before = zmalloc_used_memory_tl;
+    auto [new_ptr, realloced] = DefragStream((stream*)inner_obj_, ratio);
+    inner_obj_ = new_ptr;
+    sz_ = UpdateSize(sz_, int64_t(zmalloc_used_memory_tl) - int64_t(used_before));
+    return realloced;
   }
   return false;
 }
 
+bool RobjWrapper::DefragStep(float ratio, uint64_t* cursor, uint32_t count) {
+  bool realloced = false;
+  if (type() == OBJ_HASH && encoding_ == kEncodingStrMap2) {
+    *cursor = ((StringMap*)inner_obj_)->DefragStep(*cursor, count, ratio, &realloced);
+  } else if (type() == OBJ_SET && encoding_ == kEncodingStrMap2) {
+    *cursor = ((StringSet*)inner_obj_)->DefragStep(*cursor, count, ratio, &realloced);
+  } else if (type() == OBJ_ZSET && encoding_ == OBJ_ENCODING_SKIPLIST) {
+    *cursor = ((detail::SortedMap*)inner_obj_)->DefragStep(*cursor, count, ratio, &realloced);
+  } else if (type() == OBJ_LIST) {
+    // List nodes hold listpacks of up to several KB, so fewer of them are visited.
+    bool done = ((QList*)inner_obj_)->DefragStep(ratio, max(1u, count / 16), *cursor == 0,
+                                                 &realloced);
+    *cursor = done ? 0 : 1;
+  } else {
+    *cursor = 0;
+    return DefragIfNeeded(ratio);
+  }
+  return realloced;
+}
+
 int RobjWrapper::ZsetAdd(double score, std::string_view ele, int in_flags, int* out_flags,
                          double* newscore) {
   *out_flags = 0; /* We'll return our response flags. */
@@ -721,6 +1002,8 @@ auto CompactObj::GetStatsThreadLocal() -> Stats {
   res.small_string_bytes = tl.small_str_bytes;
   res.huff_encode_total = tl.huff_encode_total;
   res.huff_encode_success = tl.huff_encode_success;
+  res.zstd_encode_total = tl.zstd_encode_total;
+  res.zstd_encode_success = tl.zstd_encode_success;
   return res;
 }
 
@@ -735,7 +1018,7 @@ bool CompactObj::InitHuffmanThreadLocal(HuffmanDomain domain, std::string_view h
   Huffman* huffman = nullptr;
   switch (domain) {
     case HUFF_KEYS:
-      huffman = &tl.huff_keys;
+      huffman = &tl.huff_keys[tl.huff_keys_slot];
       break;
     case HUFF_STRING_VALUES:
       huffman = &tl.huff_string_values;
@@ -759,6 +1042,58 @@ bool CompactObj::InitHuffmanThreadLocal(HuffmanDomain domain, std::string_view h
   return true;
 }
 
+bool CompactObj::SwapHuffmanThreadLocal(std::string_view hufftable) {
+  if (tl.huff_keys_swapping)
+    return false;
+
+  if (!tl.huff_keys[tl.huff_keys_slot].encoder.valid())
+    return InitHuffmanThreadLocal(HUFF_KEYS, hufftable);
+
+  Huffman huffman;
+  string err_msg;
+  if (!huffman.encoder.Load(hufftable, &err_msg) || !huffman.decoder.Load(hufftable, &err_msg)) {
+    LOG(WARNING) << "Failed to load huffman table: " << err_msg;
+    return false;
+  }
+
+  tl.huff_keys_slot ^= 1;
+  tl.huff_keys[tl.huff_keys_slot] = std::move(huffman);
+  tl.huff_keys_swapping = true;
+  return true;
+}
+
+void CompactObj::FinishHuffmanSwapThreadLocal() {
+  if (tl.huff_keys_swapping) {
+    tl.huff_keys[tl.huff_keys_slot ^ 1] = Huffman{};
+    tl.huff_keys_swapping = false;
+  }
+}
+
+bool CompactObj::InitZstdDictThreadLocal(std::string_view dict) {
+  // Strings compressed with the current dictionary can not be decoded with another one.
+  if (tl.zstd.valid() || dict.empty()) {
+    return false;
+  }
+
+  ZstdDict& zstd = tl.zstd;
+  zstd.cdict = ZSTD_createCDict(dict.data(), dict.size(), kZstdLevel);
+  zstd.ddict = ZSTD_createDDict(dict.data(), dict.size());
+  zstd.cctx = ZSTD_createCCtx();
+  zstd.dctx = ZSTD_createDCtx();
+  if (!zstd.cdict || !zstd.ddict || !zstd.cctx || !zstd.dctx) {
+    LOG(ERROR) << "Failed to create zstd dictionary";
+    zstd.Reset();
+    return false;
+  }
+
+  ZSTD_CCtx_refCDict(zstd.cctx, zstd.cdict);
+  ZSTD_CCtx_setParameter(zstd.cctx, ZSTD_c_contentSizeFlag, 0);
+  ZSTD_CCtx_setParameter(zstd.cctx, ZSTD_c_checksumFlag, 0);
+  ZSTD_CCtx_setParameter(zstd.cctx, ZSTD_c_dictIDFlag, 0);
+  zstd.min_len = std::max<uint32_t>(absl::GetFlag(FLAGS_zstd_value_min_len), kInlineLen + 1);
+  return true;
+}
+
 CompactObj::~CompactObj() {
   if (HasAllocated()) {
     Free();
@@ -795,6 +1130,15 @@ size_t CompactObj::Size() const {
         raw_size = an.size();
         break;
       }
+      case DOUBLE_TAG: {
+        char buf[kDoubleBufLen];
+        raw_size = FormatDouble(u_.dval, buf).size();
+        break;
+      }
+      case PREFIX_INT_TAG:
+        raw_size = KeyPrefixes::Get().Prefix(u_.prefix_int.prefix_id).size() +
+                   absl::AlphaNum(u_.prefix_int.val).size();
+        break;
       case EXTERNAL_TAG:
         raw_size = u_.ext_ptr.serialized_size;
         CHECK(mask_bits_.encoding != HUFFMAN_ENC);
@@ -803,6 +1147,9 @@ size_t CompactObj::Size() const {
         raw_size = u_.r_obj.Size();
         first_byte = *(uint8_t*)u_.r_obj.inner_obj();
         break;
+      case ZSTD_TAG:
+        raw_size = ZstdDecodedLen(u_.r_obj.inner_obj());
+        break;
       case JSON_TAG:
         DCHECK_EQ(mask_bits_.encoding, NONE_ENC);
         if (JsonEnconding() == kEncodingJsonFlat) {
@@ -815,6 +1162,10 @@ size_t CompactObj::Size() const {
         DCHECK_EQ(mask_bits_.encoding, NONE_ENC);
         raw_size = u_.sbf->current_size();
         break;
+      case BITMAP_TAG:
+        DCHECK_EQ(mask_bits_.encoding, NONE_ENC);
+        raw_size = u_.sparse_bitmap->size();
+        break;
       default:
         LOG(DFATAL) << "Should not reach " << int(taglen_);
     }
@@ -839,10 +1190,20 @@ uint64_t CompactObj::HashCode() const {
         absl::AlphaNum an(u_.ival);
         return XXH3_64bits_withSeed(an.data(), an.size(), kHashSeed);
       }
+      case DOUBLE_TAG: {
+        char buf[kDoubleBufLen];
+        string_view str = FormatDouble(u_.dval, buf);
+        return XXH3_64bits_withSeed(str.data(), str.size(), kHashSeed);
+      }
+      case PREFIX_INT_TAG: {
+        char buf[kMaxPrefixIntLen];
+        string_view str = FormatPrefixInt(u_.prefix_int.prefix_id, u_.prefix_int.val, buf);
+        return XXH3_64bits_withSeed(str.data(), str.size(), kHashSeed);
+      }
     }
   }
 
-  DCHECK(mask_bits_.encoding);
+  DCHECK(mask_bits_.encoding || taglen_ == ZSTD_TAG || taglen_ == BITMAP_TAG);
 
   if (IsInline()) {
     char buf[kInlineLen * 3];  // should suffice for most huffman decodings.
@@ -859,7 +1220,11 @@ uint64_t CompactObj::HashCode(string_view str) {
 }
 
 CompactObjType CompactObj::ObjType() const {
-  if (IsInline() || taglen_ == INT_TAG || taglen_ == SMALL_TAG || taglen_ == EXTERNAL_TAG)
+  if (taglen_ == EXTERNAL_TAG)
+    return u_.ext_ptr.obj_type;
+
+  if (IsInline() || taglen_ == INT_TAG || taglen_ == SMALL_TAG || taglen_ == ZSTD_TAG ||
+      taglen_ == DOUBLE_TAG || taglen_ == BITMAP_TAG || taglen_ == PREFIX_INT_TAG)
     return OBJ_STRING;
 
   if (taglen_ == ROBJ_TAG)
@@ -912,6 +1277,37 @@ std::optional<int64_t> CompactObj::TryGetInt() const {
   return val;
 }
 
+void CompactObj::SetDouble(double val) {
+  DCHECK(!IsExternal());
+
+  char buf[kDoubleBufLen];
+  string_view str = FormatDouble(val, buf);
+  long long ival;
+  if (str.size() <= kInlineLen || string2ll(str.data(), str.size(), &ival)) {
+    SetString(str);
+    return;
+  }
+
+  if (DOUBLE_TAG != taglen_) {
+    SetMeta(DOUBLE_TAG, mask_);
+    mask_bits_.encoding = NONE_ENC;
+  }
+
+  u_.dval = val;
+}
+
+bool CompactObj::IsRawString() const {
+  return taglen_ == ROBJ_TAG && mask_bits_.encoding == NONE_ENC &&
+         u_.r_obj.type() == OBJ_STRING && u_.r_obj.inner_obj() != nullptr;
+}
+
+std::optional<double> CompactObj::TryGetDouble() const {
+  if (taglen_ != DOUBLE_TAG)
+    return std::nullopt;
+  double val = u_.dval;
+  return val;
+}
+
 auto CompactObj::GetJson() const -> JsonType* {
   if (ObjType() == OBJ_JSON) {
     DCHECK_EQ(JsonEnconding(), kEncodingJsonCons);
@@ -920,6 +1316,12 @@ auto CompactObj::GetJson() const -> JsonType* {
   return nullptr;
 }
 
+absl::Span<uint8_t> CompactObj::GetFlatJson() const {
+  DCHECK_EQ(ObjType(), OBJ_JSON);
+  DCHECK_EQ(JsonEnconding(), kEncodingJsonFlat);
+  return {u_.json_obj.flat.flat_ptr, u_.json_obj.flat.json_len};
+}
+
 void CompactObj::SetJson(JsonType&& j) {
   if (taglen_ == JSON_TAG && JsonEnconding() == kEncodingJsonCons) {
     DCHECK(u_.json_obj.cons.json_ptr != nullptr);  // must be allocated
@@ -970,12 +1372,13 @@ void CompactObj::SetJson(const uint8_t* buf, size_t len) {
   u_.json_obj.flat.json_len = len;
 }
 
-void CompactObj::SetSBF(uint64_t initial_capacity, double fp_prob, double grow_factor) {
+void CompactObj::SetSBF(uint64_t initial_capacity, double fp_prob, double grow_factor,
+                        bool blocked) {
   if (taglen_ == SBF_TAG) {  // already json
-    *u_.sbf = SBF(initial_capacity, fp_prob, grow_factor, tl.local_mr);
+    *u_.sbf = SBF(initial_capacity, fp_prob, grow_factor, tl.local_mr, blocked);
   } else {
     SetMeta(SBF_TAG);
-    u_.sbf = AllocateMR<SBF>(initial_capacity, fp_prob, grow_factor, tl.local_mr);
+    u_.sbf = AllocateMR<SBF>(initial_capacity, fp_prob, grow_factor, tl.local_mr, blocked);
   }
 }
 
@@ -984,6 +1387,21 @@ SBF* CompactObj::GetSBF() const {
   return u_.sbf;
 }
 
+void CompactObj::SetSparseBitmap(string_view bytes) {
+  CHECK(!IsExternal());
+
+  // bytes may point to our own string, so we build the bitmap before releasing it.
+  SparseBitmap* bitmap = AllocateMR<SparseBitmap>(bytes, tl.local_mr);
+  mask_bits_.encoding = NONE_ENC;
+  SetMeta(BITMAP_TAG, mask_);
+  u_.sparse_bitmap = bitmap;
+}
+
+SparseBitmap* CompactObj::GetSparseBitmap() const {
+  DCHECK_EQ(BITMAP_TAG, taglen_);
+  return u_.sparse_bitmap;
+}
+
 void CompactObj::SetString(std::string_view str) {
   CHECK(!IsExternal());
   mask_bits_.encoding = NONE_ENC;
@@ -1009,6 +1427,24 @@ void CompactObj::SetString(std::string_view str) {
     }
   }
 
+  // Floats that do not fit into the inline buffer, i.e. INCRBYFLOAT results.
+  double dval;
+  if (ParseCanonicalDouble(str, &dval)) {
+    SetMeta(DOUBLE_TAG, mask_);
+    u_.dval = dval;
+    return;
+  }
+
+  // Keys like "user:12345678901234", which do not fit into the inline buffer.
+  uint32_t prefix_id;
+  uint64_t suffix;
+  if (str.size() <= kMaxPrefixIntLen && ParsePrefixInt(str, &prefix_id, &suffix)) {
+    SetMeta(PREFIX_INT_TAG, mask_);
+    u_.prefix_int.val = suffix;
+    u_.prefix_int.prefix_id = prefix_id;
+    return;
+  }
+
   EncodeString(str);
 }
 
@@ -1023,10 +1459,45 @@ void CompactObj::AppendString(std::string_view str) {
   u_.r_obj.AppendString(str, tl.local_mr);
 }
 
+void CompactObj::AppendRawString(std::string_view str) {
+  if (str.empty())
+    return;
+
+  size_t start = Size();
+  GrowRawString(start + str.size());
+  memcpy(reinterpret_cast<uint8_t*>(u_.r_obj.inner_obj()) + start, str.data(), str.size());
+}
+
+void CompactObj::SetRangeRawString(size_t start, std::string_view range) {
+  if (range.empty())
+    return;
+
+  GrowRawString(max(Size(), start + range.size()));
+  memcpy(reinterpret_cast<uint8_t*>(u_.r_obj.inner_obj()) + start, range.data(), range.size());
+}
+
+void CompactObj::GrowRawString(size_t size) {
+  DCHECK(!IsExternal());
+  if (IsRawString()) {
+    u_.r_obj.GrowString(size, tl.local_mr);
+    return;
+  }
+
+  string decoded;
+  GetString(&decoded);
+  DCHECK_GE(size, decoded.size());
+
+  mask_bits_.encoding = NONE_ENC;
+  SetMeta(ROBJ_TAG, mask_);
+  u_.r_obj.Init(OBJ_STRING, OBJ_ENCODING_RAW, nullptr);
+  u_.r_obj.GrowString(size, tl.local_mr);
+  memcpy(u_.r_obj.inner_obj(), decoded.data(), decoded.size());
+}
+
 string_view CompactObj::GetSlice(string* scratch) const {
   CHECK(!IsExternal());
 
-  if (mask_bits_.encoding) {
+  if (mask_bits_.encoding || taglen_ == ZSTD_TAG || taglen_ == BITMAP_TAG) {
     GetString(scratch);
     return *scratch;
   }
@@ -1042,6 +1513,20 @@ string_view CompactObj::GetSlice(string* scratch) const {
     return *scratch;
   }
 
+  if (taglen_ == DOUBLE_TAG) {
+    char buf[kDoubleBufLen];
+    scratch->assign(FormatDouble(u_.dval, buf));
+
+    return *scratch;
+  }
+
+  if (taglen_ == PREFIX_INT_TAG) {
+    char buf[kMaxPrefixIntLen];
+    scratch->assign(FormatPrefixInt(u_.prefix_int.prefix_id, u_.prefix_int.val, buf));
+
+    return *scratch;
+  }
+
   // no encoding.
   if (taglen_ == ROBJ_TAG) {
     CHECK_EQ(OBJ_STRING, u_.r_obj.type());
@@ -1059,6 +1544,14 @@ string_view CompactObj::GetSlice(string* scratch) const {
   return string_view{};
 }
 
+bool CompactObj::DefragStep(float ratio, uint64_t* cursor, uint32_t count) {
+  if (taglen_ == ROBJ_TAG && u_.r_obj.inner_obj() != nullptr)
+    return u_.r_obj.DefragStep(ratio, cursor, count);
+
+  *cursor = 0;
+  return DefragIfNeeded(ratio);
+}
+
 bool CompactObj::DefragIfNeeded(float ratio) {
   switch (taglen_) {
     case ROBJ_TAG:
@@ -1067,9 +1560,14 @@ bool CompactObj::DefragIfNeeded(float ratio) {
         return u_.r_obj.DefragIfNeeded(ratio);
       }
       return false;
+    case ZSTD_TAG:
+      return u_.r_obj.DefragIfNeeded(ratio);
     case SMALL_TAG:
       return u_.small_str.DefragIfNeeded(ratio);
     case INT_TAG:
+    case DOUBLE_TAG:
+    case PREFIX_INT_TAG:
+    case BITMAP_TAG:
       // this is not relevant in this case
       return false;
     case EXTERNAL_TAG:
@@ -1081,11 +1579,13 @@ bool CompactObj::DefragIfNeeded(float ratio) {
 }
 
 bool CompactObj::HasAllocated() const {
-  if (IsRef() || taglen_ == INT_TAG || IsInline() || taglen_ == EXTERNAL_TAG ||
+  if (IsRef() || taglen_ == INT_TAG || taglen_ == DOUBLE_TAG || taglen_ == PREFIX_INT_TAG ||
+      IsInline() || taglen_ == EXTERNAL_TAG ||
       (taglen_ == ROBJ_TAG && u_.r_obj.inner_obj() == nullptr))
     return false;
 
-  DCHECK(taglen_ == ROBJ_TAG || taglen_ == SMALL_TAG || taglen_ == JSON_TAG || taglen_ == SBF_TAG);
+  DCHECK(taglen_ == ROBJ_TAG || taglen_ == SMALL_TAG || taglen_ == JSON_TAG || taglen_ == SBF_TAG ||
+         taglen_ == ZSTD_TAG || taglen_ == BITMAP_TAG);
   return true;
 }
 
@@ -1100,6 +1600,29 @@ void __attribute__((noinline)) CompactObj::GetString(string* res) const {
   GetString(res->data());
 }
 
+bool CompactObj::HasStaleHuffman() const {
+  if (mask_bits_.encoding != HUFFMAN_ENC || !tl.huff_keys_swapping)
+    return false;
+
+  uint8_t first_byte = 0;
+  if (IsInline()) {
+    first_byte = u_.inline_str[0];
+  } else if (taglen_ == SMALL_TAG) {
+    first_byte = u_.small_str.first_byte();
+  } else if (taglen_ == ROBJ_TAG) {
+    first_byte = *(uint8_t*)u_.r_obj.inner_obj();
+  } else {
+    return false;
+  }
+  return (first_byte >> 7) != tl.huff_keys_slot;
+}
+
+void CompactObj::ReencodeString() {
+  string tmp;
+  GetString(&tmp);
+  SetString(tmp);
+}
+
 void CompactObj::GetString(char* dest) const {
   CHECK(!IsExternal());
 
@@ -1114,6 +1637,32 @@ void CompactObj::GetString(char* dest) const {
     return;
   }
 
+  if (taglen_ == DOUBLE_TAG) {
+    char buf[kDoubleBufLen];
+    string_view str = FormatDouble(u_.dval, buf);
+    memcpy(dest, str.data(), str.size());
+    return;
+  }
+
+  if (taglen_ == PREFIX_INT_TAG) {
+    FormatPrefixInt(u_.prefix_int.prefix_id, u_.prefix_int.val, dest);
+    return;
+  }
+
+  if (taglen_ == ZSTD_TAG) {
+    // The value is lost if it can not be decoded, but the server keeps serving the others.
+    if (!ZstdDecode(u_.r_obj.AsView(), dest)) {
+      LOG_EVERY_N(ERROR, 1000) << "Failed to decode zstd string of size " << Size();
+      memset(dest, 0, Size());
+    }
+    return;
+  }
+
+  if (taglen_ == BITMAP_TAG) {
+    u_.sparse_bitmap->GetString(dest);
+    return;
+  }
+
   if (mask_bits_.encoding) {
     if (taglen_ == ROBJ_TAG) {
       CHECK_EQ(OBJ_STRING, u_.r_obj.type());
@@ -1135,7 +1684,7 @@ void CompactObj::GetString(char* dest) const {
         next += slices[0].size() - 1;
         memcpy(next, slices[1].data(), slices[1].size());
         string_view src(reinterpret_cast<const char*>(tl.tmp_buf.data()), tl.tmp_buf.size());
-        CHECK(tl.huff_keys.decoder.Decode(src, decoded_len, dest));
+        CHECK(HuffKeysDecoder(slices[0][0]).Decode(src, decoded_len, dest));
         return;
       }
 
@@ -1172,10 +1721,11 @@ void CompactObj::GetString(char* dest) const {
   LOG(FATAL) << "Bad tag " << int(taglen_);
 }
 
-void CompactObj::SetExternal(size_t offset, uint32_t sz) {
+void CompactObj::SetExternal(size_t offset, uint32_t sz, CompactObjType obj_type) {
   SetMeta(EXTERNAL_TAG, mask_);
 
   u_.ext_ptr.is_cool = 0;
+  u_.ext_ptr.obj_type = obj_type;
   u_.ext_ptr.page_offset = offset % 4096;
   u_.ext_ptr.serialized_size = sz;
   u_.ext_ptr.offload.page_index = offset / 4096;
@@ -1186,6 +1736,7 @@ void CompactObj::SetCool(size_t offset, uint32_t sz, detail::TieredColdRecord* r
   SetMeta(EXTERNAL_TAG, record->value.mask_);
 
   u_.ext_ptr.is_cool = 1;
+  u_.ext_ptr.obj_type = record->value.ObjType();
   u_.ext_ptr.page_offset = offset % 4096;
   u_.ext_ptr.serialized_size = sz;
   u_.ext_ptr.cool_record = record;
@@ -1247,7 +1798,7 @@ void CompactObj::Reset() {
 void CompactObj::Free() {
   DCHECK(HasAllocated());
 
-  if (taglen_ == ROBJ_TAG) {
+  if (taglen_ == ROBJ_TAG || taglen_ == ZSTD_TAG) {
     u_.r_obj.Free(tl.local_mr);
   } else if (taglen_ == SMALL_TAG) {
     tl.small_str_bytes -= u_.small_str.MallocUsed();
@@ -1261,6 +1812,8 @@ void CompactObj::Free() {
     }
   } else if (taglen_ == SBF_TAG) {
     DeleteMR<SBF>(u_.sbf);
+  } else if (taglen_ == BITMAP_TAG) {
+    DeleteMR<SparseBitmap>(u_.sparse_bitmap);
   } else {
     LOG(FATAL) << "Unsupported tag " << int(taglen_);
   }
@@ -1272,7 +1825,7 @@ size_t CompactObj::MallocUsed(bool slow) const {
   if (!HasAllocated())
     return 0;
 
-  if (taglen_ == ROBJ_TAG) {
+  if (taglen_ == ROBJ_TAG || taglen_ == ZSTD_TAG) {
     return u_.r_obj.MallocUsed(slow);
   }
 
@@ -1293,6 +1846,10 @@ size_t CompactObj::MallocUsed(bool slow) const {
   if (taglen_ == SBF_TAG) {
     return u_.sbf->MallocUsed();
   }
+
+  if (taglen_ == BITMAP_TAG) {
+    return u_.sparse_bitmap->MallocUsed();
+  }
   LOG(DFATAL) << "should not reach";
   return 0;
 }
@@ -1308,15 +1865,29 @@ bool CompactObj::operator==(const CompactObj& o) const {
   if (taglen_ != o.taglen_)
     return false;
 
-  if (taglen_ == ROBJ_TAG)
+  // The encoding is deterministic, so equal strings have equal zstd blobs.
+  if (taglen_ == ROBJ_TAG || taglen_ == ZSTD_TAG)
     return u_.r_obj.Equal(o.u_.r_obj);
 
   if (taglen_ == INT_TAG)
     return u_.ival == o.u_.ival;
 
+  if (taglen_ == DOUBLE_TAG)
+    return u_.dval == o.u_.dval;
+
+  // Prefixes are registered once, so equal strings have equal ids.
+  if (taglen_ == PREFIX_INT_TAG)
+    return u_.prefix_int.prefix_id == o.u_.prefix_int.prefix_id &&
+           u_.prefix_int.val == o.u_.prefix_int.val;
+
   if (taglen_ == SMALL_TAG)
     return u_.small_str.Equal(o.u_.small_str);
 
+  if (taglen_ == BITMAP_TAG) {
+    string tmp;
+    return o.EqualNonInline(GetSlice(&tmp));
+  }
+
   DCHECK(IsInline() && o.IsInline());
 
   return memcmp(u_.inline_str, o.u_.inline_str, taglen_) == 0;
@@ -1328,11 +1899,23 @@ bool CompactObj::EqualNonInline(std::string_view sv) const {
       absl::AlphaNum an(u_.ival);
       return sv == an.Piece();
     }
+    case DOUBLE_TAG: {
+      char buf[kDoubleBufLen];
+      return sv == FormatDouble(u_.dval, buf);
+    }
+    case PREFIX_INT_TAG: {
+      string_view prefix = KeyPrefixes::Get().Prefix(u_.prefix_int.prefix_id);
+      return absl::StartsWith(sv, prefix) &&
+             sv.substr(prefix.size()) == absl::AlphaNum(u_.prefix_int.val).Piece();
+    }
 
     case ROBJ_TAG:
       return u_.r_obj.Equal(sv);
     case SMALL_TAG:
       return u_.small_str.Equal(sv);
+    case ZSTD_TAG:
+    case BITMAP_TAG:
+      return sv.size() == Size() && sv == GetSlice(&tl.tmp_str);
     default:
       break;
   }
@@ -1349,7 +1932,8 @@ bool CompactObj::CmpEncoded(string_view sv) const {
       constexpr size_t kMaxHuffLen = kInlineLen * 3;
       if (sz <= kMaxHuffLen) {
         char buf[kMaxHuffLen];
-        CHECK(tl.huff_keys.decoder.Decode({u_.inline_str + 1, size_t(taglen_ - 1)}, sz, buf));
+        CHECK(HuffKeysDecoder(u_.inline_str[0])
+                  .Decode({u_.inline_str + 1, size_t(taglen_ - 1)}, sz, buf));
         return sv == string_view(buf, sz);
       }
     }
@@ -1435,12 +2019,18 @@ void CompactObj::EncodeString(string_view str) {
   DCHECK_GT(str.size(), kInlineLen);
   DCHECK_EQ(NONE_ENC, mask_bits_.encoding);
 
+  if (tl.zstd.valid() && str.size() >= tl.zstd.min_len && str.size() <= UINT32_MAX &&
+      EncodeZstd(str)) {
+    return;
+  }
+
   string_view encoded = str;
   bool huff_encoded = false;
 
   // We chose such length that we can store the decoded length delta into 1 byte.
   // The maximum huffman compression is 1/8, so 288 / 8 = 36.
-  // 288 - 36 = 252, which is smaller than 256.
+  // 288 - 36 = 252, which is smaller than 256. Since the delta byte also holds the table slot,
+  // we skip huffman for strings whose delta does not fit into 7 bits.
   constexpr unsigned kMaxHuffLen = 288;
 
   // For sizes 17, 18 we would like to test ascii encoding first as it's more efficient.
@@ -1449,24 +2039,26 @@ void CompactObj::EncodeString(string_view str) {
       kUseAsciiEncoding && str.size() < 19 && detail::validate_ascii_fast(str.data(), str.size());
 
   // if !is_ascii, we try huffman encoding next.
-  if (!is_ascii && str.size() <= kMaxHuffLen && tl.huff_keys.encoder.valid()) {
-    unsigned dest_len = tl.huff_keys.encoder.CompressedBound(str.size());
+  const HuffmanEncoder& huff_enc = tl.huff_keys[tl.huff_keys_slot].encoder;
+  if (!is_ascii && str.size() <= kMaxHuffLen && huff_enc.valid()) {
+    unsigned dest_len = huff_enc.CompressedBound(str.size());
     // 1 byte for storing the size delta.
     tl.tmp_buf.resize(1 + dest_len);
     string err_msg;
     ++tl.huff_encode_total;
-    bool res = tl.huff_keys.encoder.Encode(str, tl.tmp_buf.data() + 1, &dest_len, &err_msg);
+    bool res = huff_enc.Encode(str, tl.tmp_buf.data() + 1, &dest_len, &err_msg);
     if (res) {
       // we accept huffman encoding only if it is:
       // 1. smaller than the original string by 20%
       // 2. allows us to store the encoded string in the inline buffer
-      if (dest_len && (dest_len < kInlineLen || (dest_len + dest_len / 5) < str.size())) {
+      // 3. its size delta fits into 7 bits, as the 8th bit holds the table slot.
+      unsigned delta = str.size() - dest_len;
+      if (dest_len && (dest_len < kInlineLen || (dest_len + dest_len / 5) < str.size()) &&
+          delta <= kHuffDeltaMask) {
         huff_encoded = true;
         tl.huff_encode_success++;
         encoded = string_view{reinterpret_cast<char*>(tl.tmp_buf.data()), dest_len + 1};
-        unsigned delta = str.size() - dest_len;
-        DCHECK_LT(delta, 256u);
-        tl.tmp_buf[0] = static_cast<uint8_t>(delta);
+        tl.tmp_buf[0] = static_cast<uint8_t>(delta | (tl.huff_keys_slot << 7));
         mask_bits_.encoding = HUFFMAN_ENC;
         if (encoded.size() <= kInlineLen) {
           SetMeta(encoded.size(), mask_);
@@ -1528,6 +2120,32 @@ void CompactObj::EncodeString(string_view str) {
   u_.r_obj.SetString(encoded, tl.local_mr);
 }
 
+bool CompactObj::EncodeZstd(string_view str) {
+  ++tl.zstd_encode_total;
+
+  size_t bound = kZstdHeaderLen + ZSTD_compressBound(str.size());
+  tl.tmp_buf.resize(bound);
+  size_t res = ZSTD_compress2(tl.zstd.cctx, tl.tmp_buf.data() + kZstdHeaderLen,
+                              bound - kZstdHeaderLen, str.data(), str.size());
+  if (ZSTD_isError(res)) {
+    LOG(DFATAL) << "Failed to encode string with zstd: " << ZSTD_getErrorName(res);
+    return false;
+  }
+
+  // Similarly to huffman, we require saving at least 1/8 of the original size.
+  size_t blob_len = kZstdHeaderLen + res;
+  if (blob_len + str.size() / 8 > str.size())
+    return false;
+
+  ++tl.zstd_encode_success;
+  uint32_t decoded_len = str.size();
+  memcpy(tl.tmp_buf.data(), &decoded_len, sizeof(decoded_len));
+
+  SetMeta(ZSTD_TAG, mask_);
+  u_.r_obj.SetString({reinterpret_cast<char*>(tl.tmp_buf.data()), blob_len}, tl.local_mr);
+  return true;
+}
+
 StringOrView CompactObj::GetRawString() const {
   DCHECK(!IsExternal());
 
@@ -1543,6 +2161,14 @@ StringOrView CompactObj::GetRawString() const {
     return StringOrView::FromString(std::move(tmp));
   }
 
+  // Neither the zstd dictionary, the bitmap layout nor the key prefixes are persisted, so we
+  // pass the decoded string.
+  if (taglen_ == ZSTD_TAG || taglen_ == BITMAP_TAG || taglen_ == PREFIX_INT_TAG) {
+    string tmp;
+    GetString(&tmp);
+    return StringOrView::FromString(std::move(tmp));
+  }
+
   LOG(FATAL) << "Unsupported tag for GetRawString(): " << taglen_;
   return {};
 }
@@ -1567,6 +2193,44 @@ std::string_view ObjTypeToString(CompactObjType type) {
   return "Invalid type"sv;
 }
 
+std::string_view ObjEncodingToString(CompactObjType obj_type, unsigned encoding) {
+  switch (obj_type) {
+    case OBJ_STRING:
+      return "raw"sv;
+    case OBJ_LIST:
+      return "quicklist"sv;
+    case OBJ_SET:
+      ABSL_FALLTHROUGH_INTENDED;
+    case OBJ_ZSET:
+      ABSL_FALLTHROUGH_INTENDED;
+    case OBJ_HASH:
+      switch (encoding) {
+        case kEncodingIntSet:
+          return "intset"sv;
+        case kEncodingStrMap2:
+          return "dense_set"sv;
+        case OBJ_ENCODING_SKIPLIST:  // we kept the old enum for zset
+          return "btree"sv;
+        case OBJ_ENCODING_LISTPACK:
+          ABSL_FALLTHROUGH_INTENDED;
+        case kEncodingListPack:
+          return "listpack"sv;
+      }
+      break;
+    case OBJ_JSON:
+      switch (encoding) {
+        case kEncodingJsonCons:
+          return "jsoncons"sv;
+        case kEncodingJsonFlat:
+          return "jsonflat"sv;
+      }
+      break;
+    case OBJ_STREAM:
+      return "stream"sv;
+  }
+  return "unknown"sv;
+}
+
 CompactObjType ObjTypeFromString(std::string_view sv) {
   for (auto& p : kObjTypeToString) {
     if (absl::EqualsIgnoreCase(sv, p.second)) {
@@ -1588,7 +2252,7 @@ size_t CompactObj::StrEncoding::DecodedSize(size_t blob_size, uint8_t first_byte
     case ASCII2_ENC:
       return ascii_len(blob_size) - (enc_ == ASCII1_ENC);
     case HUFFMAN_ENC:
-      return blob_size + int(first_byte) - 1;
+      return blob_size + int(first_byte & kHuffDeltaMask) - 1;
   };
   return 0;
 }
@@ -1604,7 +2268,7 @@ size_t CompactObj::StrEncoding::Decode(std::string_view blob, char* dest) const
       detail::ascii_unpack(reinterpret_cast<const uint8_t*>(blob.data()), decoded_len, dest);
       break;
     case HUFFMAN_ENC:
-      tl.huff_keys.decoder.Decode(blob.substr(1), decoded_len, dest);
+      HuffKeysDecoder(blob[0]).Decode(blob.substr(1), decoded_len, dest);
       break;
   };
   return decoded_len;
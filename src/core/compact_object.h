@@ -5,6 +5,7 @@
 #pragma once
 
 #include <absl/base/internal/endian.h>
+#include <absl/types/span.h>
 
 #include <boost/intrusive/list_hook.hpp>
 #include <optional>
@@ -26,6 +27,7 @@ constexpr unsigned kEncodingJsonCons = 0;
 constexpr unsigned kEncodingJsonFlat = 1;
 
 class SBF;
+class SparseBitmap;
 
 namespace detail {
 
@@ -48,6 +50,9 @@ class RobjWrapper {
   void SetString(std::string_view s, MemoryResource* mr);
   void ReserveString(size_t size, MemoryResource* mr);
   void AppendString(std::string_view s, MemoryResource* mr);
+  // Grows the string to size bytes, zero-filling the new tail. Unlike SetString, the capacity
+  // grows at least by half, so that repeated growth is amortized linear.
+  void GrowString(size_t size, MemoryResource* mr);
   // Used when sz_ is used to denote memory usage
   void SetSize(uint64_t size);
   void Init(unsigned type, unsigned encoding, void* inner);
@@ -74,6 +79,9 @@ class RobjWrapper {
   // Returns true if re-allocated.
   bool DefragIfNeeded(float ratio);
 
+  // Incremental variant of DefragIfNeeded for large containers, see CompactObj::DefragStep.
+  bool DefragStep(float ratio, uint64_t* cursor, uint32_t count);
+
   // as defined in zset.h
   int ZsetAdd(double score, std::string_view ele, int in_flags, int* out_flags, double* newscore);
 
@@ -123,6 +131,10 @@ class CompactObj {
     EXTERNAL_TAG = 20,
     JSON_TAG = 21,
     SBF_TAG = 22,
+    ZSTD_TAG = 23,        // string compressed with the zstd dict, see InitZstdDictThreadLocal.
+    DOUBLE_TAG = 24,      // string that is the shortest representation of a double.
+    BITMAP_TAG = 25,      // string that is stored as a SparseBitmap.
+    PREFIX_INT_TAG = 26,  // string that is a registered prefix followed by an integer.
   };
 
   // String encoding types.
@@ -246,6 +258,11 @@ class CompactObj {
 
   bool DefragIfNeeded(float ratio);
 
+  // Incremental variant of DefragIfNeeded that also moves the internal nodes of containers.
+  // Visits about count of their allocations starting at *cursor, which is 0 on the first call
+  // and is reset to 0 once the whole value was visited. Returns true if re-allocated.
+  bool DefragStep(float ratio, uint64_t* cursor, uint32_t count);
+
   void SetAsyncDelete() {
     mask_bits_.io_pending = 1;  // io_pending flag is used for async delete for keys.
   }
@@ -289,6 +306,18 @@ class CompactObj {
   void SetInt(int64_t val);
   std::optional<int64_t> TryGetInt() const;
 
+  // Sets the string representation of a finite val, as formatted by
+  // RedisReplyBuilder::FormatDouble. Keeps the double itself when the string does not fit
+  // into the inline buffer, so that both SetDouble and SetString produce the same encoding.
+  void SetDouble(double val);
+
+  // Returns the double if the object was encoded as one (see SetDouble).
+  std::optional<double> TryGetDouble() const;
+
+  // Returns true if GetSlice() returns a view into the object's own allocation. The view stays
+  // valid, and can be read from other threads, until the object is modified or freed.
+  bool IsRawString() const;
+
   // We temporary expose this function to avoid passing around robj objects.
   detail::RobjWrapper* GetRobjWrapper() {
     return &u_.r_obj;
@@ -302,9 +331,22 @@ class CompactObj {
   void SetString(std::string_view str);
   void GetString(std::string* res) const;
 
+  // Returns true if the string is huffman encoded with a table that is being replaced.
+  bool HasStaleHuffman() const;
+
+  // Decodes the string and encodes it again with the current tables.
+  void ReencodeString();
+
   void ReserveString(size_t size);
   void AppendString(std::string_view str);
 
+  // Append and overwrite the string in place, first converting it into a raw string (see
+  // IsRawString) if it is encoded. Used for large values that are modified many times, so that
+  // each call copies only the new bytes rather than the whole value.
+  void AppendRawString(std::string_view str);
+  // Overwrites the string at offset start with range, zero-padding it as needed.
+  void SetRangeRawString(size_t start, std::string_view range);
+
   // Will set this to hold OBJ_JSON, after that it is safe to call GetJson
   // NOTE: in order to avid copy which can be expensive in this case,
   // you need to move an object that created with the function JsonFromString
@@ -319,14 +361,31 @@ class CompactObj {
   // pre condition - the type here is OBJ_JSON and was set with SetJson
   JsonType* GetJson() const;
 
+  // pre condition - the type here is OBJ_JSON and was set with SetJson(buf, len).
+  // Scalars inside the flexbuffer may be updated in place as long as its length does not change.
+  absl::Span<uint8_t> GetFlatJson() const;
+
   void SetSBF(SBF* sbf) {
     SetMeta(SBF_TAG);
     u_.sbf = sbf;
   }
 
-  void SetSBF(uint64_t initial_capacity, double fp_prob, double grow_factor);
+  void SetSBF(uint64_t initial_capacity, double fp_prob, double grow_factor,
+              bool blocked = false);
   SBF* GetSBF() const;
 
+  // Stores the string `bytes` as a SparseBitmap. The value keeps the OBJ_STRING type and reads
+  // through the string accessors return the plain string.
+  void SetSparseBitmap(std::string_view bytes);
+
+  bool IsSparseBitmap() const {
+    return taglen_ == BITMAP_TAG;
+  }
+
+  // pre condition - IsSparseBitmap(). Updates through the returned object are reflected
+  // by Size(), MallocUsed() and the string accessors.
+  SparseBitmap* GetSparseBitmap() const;
+
   // dest must have at least Size() bytes available
   void GetString(char* dest) const;
 
@@ -341,7 +400,9 @@ class CompactObj {
     return u_.ext_ptr.is_cool;
   }
 
-  void SetExternal(size_t offset, uint32_t sz);
+  // obj_type is the type of the offloaded value. Non-string values are stored in their
+  // serialized (DUMP) form and must be loaded back before they can be accessed.
+  void SetExternal(size_t offset, uint32_t sz, CompactObjType obj_type = 0 /* OBJ_STRING */);
 
   // Switches to empty, non-external string.
   // Preserves all the attributes.
@@ -390,6 +451,7 @@ class CompactObj {
   struct Stats {
     size_t small_string_bytes = 0;
     uint64_t huff_encode_total = 0, huff_encode_success = 0;
+    uint64_t zstd_encode_total = 0, zstd_encode_success = 0;
   };
 
   static Stats GetStatsThreadLocal();
@@ -402,6 +464,17 @@ class CompactObj {
   };
 
   static bool InitHuffmanThreadLocal(HuffmanDomain domain, std::string_view hufftable);
+
+  // Replaces the huffman table of the keys domain for the new entries. The entries encoded with
+  // the previous table stay decodable until FinishHuffmanSwapThreadLocal() is called, which must
+  // happen only after they were re-encoded (see HasStaleHuffman). Returns false if the previous
+  // swap has not finished yet.
+  static bool SwapHuffmanThreadLocal(std::string_view hufftable);
+  static void FinishHuffmanSwapThreadLocal();
+
+  // Enables compression of strings longer than --zstd_value_min_len with the given zstd
+  // dictionary. Like the huffman tables, the dictionary can not be replaced once it is set.
+  static bool InitZstdDictThreadLocal(std::string_view dict);
   static MemoryResource* memory_resource();  // thread-local.
 
   template <typename T, typename... Args> static T* AllocateMR(Args&&... args) {
@@ -438,6 +511,13 @@ class CompactObj {
  private:
   void EncodeString(std::string_view str);
 
+  // Converts the string into a raw one if needed and grows it to size bytes.
+  // Requires: size >= Size().
+  void GrowRawString(size_t size);
+
+  // Returns false if the compressed string does not save enough memory.
+  bool EncodeZstd(std::string_view str);
+
   bool EqualNonInline(std::string_view sv) const;
 
   // Requires: HasAllocated() - true.
@@ -460,7 +540,8 @@ class CompactObj {
     uint32_t serialized_size;
     uint16_t page_offset;  // 0 for multi-page blobs. != 0 for small blobs.
     uint16_t is_cool : 1;
-    uint16_t is_reserved : 15;
+    uint16_t obj_type : 8;  // CompactObjType of the offloaded value.
+    uint16_t is_reserved : 7;
 
     // We do not have enough space in the common area to store page_index together with
     // cool_record pointer. Therefore, we moved this field into TieredColdRecord itself.
@@ -485,6 +566,11 @@ class CompactObj {
     uint8_t* flat_ptr;
   };
 
+  struct PrefixInt {
+    uint64_t val;
+    uint32_t prefix_id;
+  } __attribute__((packed));
+
   struct JsonWrapper {
     union {
       JsonConsT cons;
@@ -505,7 +591,10 @@ class CompactObj {
     // using 'packed' to reduce alignement of U to 1.
     JsonWrapper json_obj __attribute__((packed));
     SBF* sbf __attribute__((packed));
+    SparseBitmap* sparse_bitmap __attribute__((packed));
     int64_t ival __attribute__((packed));
+    double dval __attribute__((packed));
+    PrefixInt prefix_int;
     ExternalPtr ext_ptr;
 
     U() : r_obj() {
@@ -554,6 +643,9 @@ inline bool CompactObj::operator==(std::string_view sv) const {
 
 std::string_view ObjTypeToString(CompactObjType type);
 
+// Name of the encoding of an object of the given type, as reported by DEBUG OBJECT.
+std::string_view ObjEncodingToString(CompactObjType type, unsigned encoding);
+
 // Returns kInvalidCompactObjType if sv is not a valid type.
 CompactObjType ObjTypeFromString(std::string_view sv);
 
@@ -564,6 +656,7 @@ struct TieredColdRecord : public ::boost::intrusive::list_base_hook<
   uint64_t key_hash;  // Allows searching the entry in the dbslice.
   CompactObj value;
   uint16_t db_index;
+  bool is_protected = false;  // whether it belongs to the protected segment of the cool queue
   uint32_t page_index;
 };
 static_assert(sizeof(TieredColdRecord) == 48);
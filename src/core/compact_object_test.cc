@@ -10,6 +10,7 @@
 
 #include <cstddef>
 #include <random>
+#include <thread>
 
 #include "base/gtest.h"
 #include "base/logging.h"
@@ -17,6 +18,7 @@
 #include "core/flat_set.h"
 #include "core/huff_coder.h"
 #include "core/mi_memory_resource.h"
+#include "core/sparse_bitmap.h"
 #include "core/string_or_view.h"
 #include "core/string_set.h"
 
@@ -294,6 +296,82 @@ TEST_F(CompactObjectTest, Int) {
   EXPECT_TRUE(cobj_.HasExpire());
 }
 
+TEST_F(CompactObjectTest, Double) {
+  string_view str = "0.30000000000000004";
+  cobj_.SetString(str);
+  EXPECT_EQ(0.1 + 0.2, cobj_.TryGetDouble());
+  EXPECT_EQ(0, cobj_.MallocUsed());
+  EXPECT_EQ(str.size(), cobj_.Size());
+  EXPECT_EQ(cobj_, str);
+  EXPECT_NE(cobj_, "0.3");
+  EXPECT_EQ(str, cobj_.GetSlice(&tmp_));
+  EXPECT_EQ(str, cobj_.ToString());
+  EXPECT_EQ(CompactObj::HashCode(str), cobj_.HashCode());
+  EXPECT_EQ(OBJ_STRING, cobj_.ObjType());
+
+  CompactObj obj;
+  obj.SetDouble(0.1 + 0.2);
+  EXPECT_TRUE(obj == cobj_);
+
+  // Short and integral values keep their usual encodings.
+  obj.SetDouble(1.5);
+  EXPECT_FALSE(obj.TryGetDouble());
+  EXPECT_EQ(obj, "1.5");
+  obj.SetDouble(1e17);
+  EXPECT_EQ(100000000000000000, obj.TryGetInt());
+
+  // Strings that do not round-trip are kept as they are.
+  cobj_.SetString("0.300000000000000040");
+  EXPECT_FALSE(cobj_.TryGetDouble());
+  EXPECT_EQ(cobj_, "0.300000000000000040");
+  cobj_.SetString("1.2345678901234567e+300");
+  EXPECT_EQ(1.2345678901234567e+300, cobj_.TryGetDouble());
+}
+
+TEST_F(CompactObjectTest, PrefixInt) {
+  string_view str = "user:12345678901234";
+  cobj_.SetString(str);
+  EXPECT_EQ(0, cobj_.MallocUsed());
+  EXPECT_EQ(str.size(), cobj_.Size());
+  EXPECT_EQ(cobj_, str);
+  EXPECT_NE(cobj_, "user:12345678901235");
+  EXPECT_NE(cobj_, "users:12345678901234");
+  EXPECT_EQ(str, cobj_.GetSlice(&tmp_));
+  EXPECT_EQ(str, cobj_.ToString());
+  EXPECT_EQ(CompactObj::HashCode(str), cobj_.HashCode());
+  EXPECT_EQ(OBJ_STRING, cobj_.ObjType());
+
+  CompactObj obj{str};
+  EXPECT_TRUE(obj == cobj_);
+  obj.SetString("user:12345678901235");
+  EXPECT_FALSE(obj == cobj_);
+
+  // Leading zeros, digits in the prefix and prefixes without a separator are kept as they are.
+  for (string_view other : {"user:012345678901234", "user2:12345678901234",
+                            "user12345678901234567", "2024-01-01T10:00:00.123456"}) {
+    obj.SetString(other);
+    EXPECT_GT(obj.MallocUsed(), 0) << other;
+    EXPECT_EQ(obj, other);
+  }
+}
+
+TEST_F(CompactObjectTest, SmallStringOtherThread) {
+  // Not ascii, so that the string is stored as is.
+  string str(40, '\xc8');
+  cobj_.SetString(str);
+  uint64_t hc = cobj_.HashCode();
+
+  // Small strings can be read from threads that did not allocate them.
+  std::thread th([&] {
+    string tmp;
+    EXPECT_EQ(str, cobj_.GetSlice(&tmp));
+    EXPECT_EQ(cobj_, str);
+    EXPECT_EQ(hc, cobj_.HashCode());
+  });
+  th.join();
+  cobj_.Reset();
+}
+
 TEST_F(CompactObjectTest, MediumString) {
   string tmp(511, 'b');
 
@@ -379,6 +457,33 @@ TEST_F(CompactObjectTest, SBF) {
   EXPECT_GT(cobj_.MallocUsed(), 0);
 }
 
+TEST_F(CompactObjectTest, SparseBitmap) {
+  string plain(100'000, '\0');
+  plain[10] = '\x80';
+  plain.back() = '\x01';
+
+  cobj_.SetSparseBitmap(plain);
+  ASSERT_TRUE(cobj_.IsSparseBitmap());
+  EXPECT_EQ(OBJ_STRING, cobj_.ObjType());
+  EXPECT_EQ(plain.size(), cobj_.Size());
+  EXPECT_LT(cobj_.MallocUsed(), 200u);
+  EXPECT_EQ(plain, cobj_.ToString());
+  EXPECT_EQ(cobj_, plain);
+
+  SparseBitmap* bitmap = cobj_.GetSparseBitmap();
+  EXPECT_TRUE(bitmap->GetBit(80));
+  EXPECT_FALSE(bitmap->SetBit(1'000'000, true));
+  EXPECT_EQ(125'001u, cobj_.Size());
+
+  CompactObj other;
+  other.SetSparseBitmap(cobj_.ToString());
+  EXPECT_TRUE(cobj_ == other);
+
+  cobj_.SetString(plain);
+  EXPECT_FALSE(cobj_.IsSparseBitmap());
+  EXPECT_EQ(plain, cobj_.ToString());
+}
+
 TEST_F(CompactObjectTest, MimallocUnderutilzation) {
   // We are testing with the same object size allocation here
   // This test is for https://github.com/dragonflydb/dragonfly/issues/448
@@ -654,6 +759,23 @@ TEST_F(CompactObjectTest, lpGetInteger) {
   lpFree(lp);
 }
 
+TEST_F(CompactObjectTest, lpFindEncoded) {
+  vector<string> elems = {"", "a", "0", "-1", "127", "128", "-4096", "70000", "9223372036854775807",
+                          "0123", "1.5", string(100, 'x'), string(5000, 'y')};
+  uint8_t* lp = lpNew(0);
+  for (const auto& elem : elems)
+    lp = lpAppend(lp, reinterpret_cast<const uint8_t*>(elem.data()), elem.size());
+
+  elems.insert(elems.end(), {"b", "-2", "4096", string(100, 'z'), string(4999, 'y')});
+  for (const auto& elem : elems) {
+    auto* s = reinterpret_cast<const uint8_t*>(elem.data());
+    EXPECT_EQ(lpFind(lp, lpFirst(lp), const_cast<uint8_t*>(s), elem.size(), 0),
+              lpFindEncoded(lp, lpFirst(lp), s, elem.size(), 0))
+        << elem.substr(0, 16);
+  }
+  lpFree(lp);
+}
+
 static void BuildEncoderAB(HuffmanEncoder* encoder) {
   array<unsigned, 256> hist;
   hist.fill(1);
@@ -682,6 +804,93 @@ TEST_F(CompactObjectTest, HuffMan) {
   }
 }
 
+TEST_F(CompactObjectTest, HuffmanSwap) {
+  // Runs in a separate thread to keep the swapped tables away from other tests.
+  std::thread th([] {
+    InitThreadStructs();
+
+    HuffmanEncoder encoder;
+    BuildEncoderAB(&encoder);
+    ASSERT_TRUE(CompactObj::SwapHuffmanThreadLocal(encoder.Export()));
+
+    string data(100, 'a');
+    CompactObj obj{data};
+    ASSERT_LT(obj.MallocUsed(), data.size());
+    EXPECT_FALSE(obj.HasStaleHuffman());
+
+    array<unsigned, 256> hist;
+    hist.fill(1);
+    hist['a'] = 10;
+    hist['c'] = 100;
+    ASSERT_TRUE(encoder.Build(hist.data(), hist.size() - 1, nullptr));
+    ASSERT_TRUE(CompactObj::SwapHuffmanThreadLocal(encoder.Export()));
+    ASSERT_FALSE(CompactObj::SwapHuffmanThreadLocal(encoder.Export()));
+
+    // Objects encoded with the previous table are still decoded with it.
+    EXPECT_TRUE(obj.HasStaleHuffman());
+    EXPECT_EQ(data, obj.ToString());
+    EXPECT_EQ(obj, data);
+
+    obj.ReencodeString();
+    EXPECT_FALSE(obj.HasStaleHuffman());
+    EXPECT_EQ(data, obj.ToString());
+
+    CompactObj::FinishHuffmanSwapThreadLocal();
+    EXPECT_EQ(data, obj.ToString());
+    ASSERT_TRUE(CompactObj::SwapHuffmanThreadLocal(encoder.Export()));
+    CompactObj::FinishHuffmanSwapThreadLocal();
+  });
+  th.join();
+}
+
+TEST_F(CompactObjectTest, ZstdDict) {
+  // The dictionary can not be replaced once it is set, so we keep it away from other tests
+  // by running in a separate thread.
+  std::thread th([] {
+    InitThreadStructs();
+
+    string dict;
+    for (unsigned i = 0; i < 200; ++i) {
+      absl::StrAppend(&dict, R"({"id":)", i, R"(,"name":"user)", i * 31,
+                      R"(","tags":["alpha","beta"],"active":true,"score":)", i % 17, "}");
+    }
+    ASSERT_TRUE(CompactObj::InitZstdDictThreadLocal(dict));
+    ASSERT_FALSE(CompactObj::InitZstdDictThreadLocal(dict));
+
+    string data;
+    for (unsigned i = 0; i < 20; ++i) {
+      absl::StrAppend(&data, R"({"id":)", i * 7, R"(,"name":"user)", i * 13,
+                      R"(","tags":["alpha","beta"],"active":true,"score":)", i % 5, "}");
+    }
+
+    CompactObj obj;
+    obj.SetString(data);
+    EXPECT_LT(obj.MallocUsed(), data.size() / 2);
+    EXPECT_EQ(OBJ_STRING, obj.ObjType());
+    EXPECT_EQ(data.size(), obj.Size());
+    EXPECT_EQ(CompactObj::HashCode(data), obj.HashCode());
+    EXPECT_EQ(data, obj.ToString());
+    EXPECT_EQ(obj, data);
+    EXPECT_NE(obj, data.substr(1));
+
+    CompactObj obj2{data};
+    EXPECT_TRUE(obj == obj2);
+
+    // A thread without the dictionary can not decode the string, but does not crash either.
+    std::thread th2([&] {
+      InitThreadStructs();
+      EXPECT_EQ(string(data.size(), '\0'), obj.ToString());
+    });
+    th2.join();
+
+    // Short strings are not compressed.
+    string short_str = data.substr(0, 64);
+    obj.SetString(short_str);
+    EXPECT_EQ(short_str, obj.ToString());
+  });
+  th.join();
+}
+
 static void ascii_pack_naive(const char* ascii, size_t len, uint8_t* bin) {
   const char* end = ascii + len;
 
@@ -836,6 +1045,26 @@ static void BM_LpGet(benchmark::State& state) {
 }
 BENCHMARK(BM_LpGet)->Arg(1)->Arg(2);
 
+static void BM_LpFind(benchmark::State& state) {
+  unsigned version = state.range(0);
+  uint8_t* lp = lpNew(0);
+  for (unsigned i = 0; i < 64; ++i) {
+    string field = absl::StrCat("field:", i);
+    lp = lpAppend(lp, reinterpret_cast<const uint8_t*>(field.data()), field.size());
+    lp = lpAppendInteger(lp, i * 1000);
+  }
+
+  string needle = "field:63";
+  auto* s = reinterpret_cast<uint8_t*>(needle.data());
+  while (state.KeepRunning()) {
+    uint8_t* res = version == 1 ? lpFind(lp, lpFirst(lp), s, needle.size(), 1)
+                                : lpFindEncoded(lp, lpFirst(lp), s, needle.size(), 1);
+    benchmark::DoNotOptimize(res);
+  }
+  lpFree(lp);
+}
+BENCHMARK(BM_LpFind)->Arg(1)->Arg(2);
+
 extern "C" int lpStringToInt64(const char* s, unsigned long slen, int64_t* value);
 
 static void BM_LpString2Int(benchmark::State& state) {
@@ -3,6 +3,8 @@
 //
 #pragma once
 
+#include <absl/types/span.h>
+
 #include <vector>
 
 #include "absl/random/random.h"
@@ -39,6 +41,10 @@ class DashTable : public detail::DashTableBase {
   static constexpr size_t kSlotNum = SegmentType::kSlotNum;
   static constexpr size_t kBucketNum = SegmentType::kBucketNum;
 
+  // Per-slot extension declared by the policy (see detail::PolicySlotExt).
+  using SlotExt = typename SegmentType::SlotExt;
+  static constexpr bool kUseSlotExt = SegmentType::kUseSlotExt;
+
   // if IsSingleBucket is true - iterates only over a single bucket.
   template <bool IsConst, bool IsSingleBucket = false> class Iterator;
 
@@ -111,6 +117,8 @@ class DashTable : public detail::DashTableBase {
             PMR_NS::memory_resource* mr = PMR_NS::get_default_resource());
   ~DashTable();
 
+  // Grows the directory to hold at least size entries. Segments of an empty table are
+  // allocated upfront as well, so that filling it does not split them.
   void Reserve(size_t size);
 
   // false for duplicate, true if inserted.
@@ -144,6 +152,11 @@ class DashTable : public detail::DashTableBase {
   // Prefetches the memory where the key would resize into the cache.
   template <typename U> void Prefetch(U&& key) const;
 
+  // Batched version of Find. Hashes all the keys and prefetches their segments and home buckets
+  // before resolving them, so that cache misses of different keys overlap.
+  // Calls cb(index, iterator) for each key in keys, in order. cb may mutate the table.
+  template <typename U, typename Cb> void FindBatch(absl::Span<const U> keys, Cb&& cb);
+
   // Find first entry with given key hash that evaulates to true on pred.
   // Pred accepts either (const key&) or (const key&, const value&)
   template <typename Pred> iterator FindFirst(uint64_t key_hash, Pred&& pred);
@@ -198,7 +211,8 @@ class DashTable : public detail::DashTableBase {
   // Flat memory usage (allocated) of the table, not including the the memory allocated
   // by the hosted objects.
   size_t mem_usage() const {
-    return segment_.capacity() * sizeof(void*) + sizeof(SegmentType) * unique_segments_;
+    return (segment_.capacity() + next_segment_.capacity()) * sizeof(void*) +
+           sizeof(SegmentType) * unique_segments_;
   }
 
   // Returns the total number of buckets in the table, in contrast to capacity() which
@@ -248,6 +262,20 @@ class DashTable : public detail::DashTableBase {
   // when formal full coverage is not critically important.
   template <typename Cb> Cursor TraverseBySegmentOrder(Cursor curs, Cb&& cb);
 
+  // Returns the cursor of the logical bucket the key belongs to. The cursor is a hint, the key
+  // may move to another segment if the table grows.
+  template <typename U> Cursor BucketCursor(const U& key) const {
+    return HashCursor(DoHash(key));
+  }
+
+  Cursor HashCursor(uint64_t key_hash) const {
+    return Cursor{global_depth_, SegmentId(key_hash), SegmentType::BucketIndex(key_hash)};
+  }
+
+  // Calls cb(iterator) for each entry of the logical bucket pointed by curs. Unlike Traverse,
+  // does not continue to other buckets. Does nothing if the cursor is out of range.
+  template <typename Cb> void TraverseLogicalBucket(Cursor curs, Cb&& cb);
+
   // Discards slots information.
   static const_bucket_iterator BucketIt(const_iterator it) {
     return const_bucket_iterator{it.owner_, it.seg_id_, it.bucket_id_, 0};
@@ -294,11 +322,13 @@ class DashTable : public detail::DashTableBase {
   bool ShiftRight(bucket_iterator it);
 
   template <typename BumpPolicy> iterator BumpUp(iterator it, BumpPolicy& bp) {
-    SegmentIterator seg_it = segment_[it.seg_id_]->BumpUp(
+    SegmentType* seg = segment_[it.seg_id_];
+    SegmentIterator seg_it = seg->BumpUp(
         it.bucket_id_, it.slot_id_, DoHash(it->first), bp,
         [&](uint32_t segment_id, detail::PhysicalBid from, detail::PhysicalBid to) {
           // OnMove is used to notify policy about the items moves across buckets.
-          bp.OnMove(Cursor{global_depth_, segment_id, from}, Cursor{global_depth_, segment_id, to});
+          uint8_t depth = seg->local_depth();
+          bp.OnMove(Cursor{depth, segment_id, from}, Cursor{depth, segment_id, to});
         });
 
     return iterator{this, it.seg_id_, seg_it.index, seg_it.slot};
@@ -312,6 +342,13 @@ class DashTable : public detail::DashTableBase {
     return stash_unloaded_;
   }
 
+  // Prepares the next doubling of the segment directory ahead of time, copying at most
+  // max_entries directory entries per call. This way the directory growth, that would otherwise
+  // copy the whole directory during the insert that triggers it, becomes O(1).
+  // Does nothing unless there are segments that can not split without doubling the directory.
+  // Returns true if the next directory is fully prepared.
+  bool PrepareGrowth(size_t max_entries);
+
  private:
   enum class InsertMode {
     kInsertIfNotFound,
@@ -344,8 +381,14 @@ class DashTable : public detail::DashTableBase {
     return res;
   }
 
+  using SegmentDirectory = std::vector<SegmentType*, PMR_NS::polymorphic_allocator<SegmentType*>>;
+
   Policy policy_;
-  std::vector<SegmentType*, PMR_NS::polymorphic_allocator<SegmentType*>> segment_;
+  SegmentDirectory segment_;
+
+  // The directory of depth global_depth_ + 1 that is being prepared by PrepareGrowth.
+  // Entry i of segment_ is mirrored into entries 2i, 2i+1 for i < next_segment_.size() / 2.
+  SegmentDirectory next_segment_;
 
   uint64_t garbage_collected_ = 0;
   uint64_t stash_unloaded_ = 0;
@@ -460,6 +503,15 @@ class DashTable<_Key, _Value, Policy>::Iterator {
     return owner_->segment_[seg_id_]->SetVersion(bucket_id_, v);
   }
 
+  template <bool B = kUseSlotExt> std::enable_if_t<B, SlotExt> GetExt() const {
+    assert(owner_ && seg_id_ < owner_->segment_.size());
+    return owner_->segment_[seg_id_]->Ext(bucket_id_, slot_id_);
+  }
+
+  template <bool B = kUseSlotExt && !IsConst> std::enable_if_t<B> SetExt(SlotExt ext) {
+    owner_->segment_[seg_id_]->Ext(bucket_id_, slot_id_) = ext;
+  }
+
   friend bool operator==(const Iterator& lhs, const Iterator& rhs) {
     if (lhs.owner_ == nullptr && rhs.owner_ == nullptr)
       return true;
@@ -539,7 +591,7 @@ void DashTable<_Key, _Value, Policy>::Iterator<IsConst, IsSingleBucket>::Seek2Oc
 template <typename _Key, typename _Value, typename Policy>
 DashTable<_Key, _Value, Policy>::DashTable(size_t capacity_log, const Policy& policy,
                                            PMR_NS::memory_resource* mr)
-    : Base(capacity_log), policy_(policy), segment_(mr) {
+    : Base(capacity_log), policy_(policy), segment_(mr), next_segment_(mr) {
   segment_.resize(unique_segments_);
 
   // I assume we have enough memory to create the initial table and do not check allocations.
@@ -645,6 +697,7 @@ void DashTable<_Key, _Value, Policy>::Clear() {
       size_t next_src = NextSeg(src);  // must do before because NextSeg is dependent on seg.
       if (dest < new_size) {
         seg->set_local_depth(initial_depth_);
+        seg->set_segment_id(dest);
         bucket_count_ += seg->num_buckets();
         segment_[dest++] = seg;
       } else {
@@ -659,6 +712,7 @@ void DashTable<_Key, _Value, Policy>::Clear() {
     unique_segments_ = new_size;
     segment_.resize(new_size);
   }
+  SegmentDirectory(segment_.get_allocator()).swap(next_segment_);
 }
 
 template <typename _Key, typename _Value, typename Policy>
@@ -724,6 +778,32 @@ void DashTable<_Key, _Value, Policy>::Prefetch(U&& key) const {
   segment_[seg_id]->Prefetch(key_hash);
 }
 
+template <typename _Key, typename _Value, typename Policy>
+template <typename U, typename Cb>
+void DashTable<_Key, _Value, Policy>::FindBatch(absl::Span<const U> keys, Cb&& cb) {
+  constexpr size_t kMaxBatchLen = 32;
+  uint64_t hash[kMaxBatchLen];
+
+  for (size_t offs = 0; offs < keys.size(); offs += kMaxBatchLen) {
+    size_t count = std::min(kMaxBatchLen, keys.size() - offs);
+
+    // Segment directory is accessed first, so we prefetch its entries before the segments.
+    for (size_t i = 0; i < count; ++i) {
+      hash[i] = DoHash(keys[offs + i]);
+      __builtin_prefetch(&segment_[SegmentId(hash[i])], 0, 1);
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+      segment_[SegmentId(hash[i])]->Prefetch(hash[i]);
+    }
+
+    // FindFirst recomputes segment ids, hence it is safe if cb has grown the table.
+    for (size_t i = 0; i < count; ++i) {
+      cb(offs + i, FindFirst(hash[i], EqPred(keys[offs + i])));
+    }
+  }
+}
+
 template <typename _Key, typename _Value, typename Policy>
 template <typename Pred>
 auto DashTable<_Key, _Value, Policy>::FindFirst(uint64_t key_hash, Pred&& pred) -> iterator {
@@ -777,6 +857,15 @@ void DashTable<_Key, _Value, Policy>::Reserve(size_t size) {
   unsigned new_depth = 1 + (63 ^ __builtin_clzll(sg_floor));
 
   IncreaseDepth(new_depth);
+
+  // Splitting moves no entries when the table is empty.
+  if (size_ == 0) {
+    DefaultEvictionPolicy ev;
+    for (uint32_t sid = 0; sid < segment_.size(); ++sid) {
+      while (segment_[sid]->local_depth() < global_depth_)
+        Split(sid, ev);
+    }
+  }
 }
 
 template <typename _Key, typename _Value, typename Policy>
@@ -800,7 +889,8 @@ auto DashTable<_Key, _Value, Policy>::InsertInternal(U&& key, V&& value, Evictio
 
     auto move_cb = [&](uint32_t segment_id, detail::PhysicalBid from, detail::PhysicalBid to) {
       // OnMove is used to notify policy about the move of items across buckets.
-      ev.OnMove(Cursor{global_depth_, segment_id, from}, Cursor{global_depth_, segment_id, to});
+      uint8_t depth = target->local_depth();
+      ev.OnMove(Cursor{depth, segment_id, from}, Cursor{depth, segment_id, to});
     };
 
     if (mode == InsertMode::kForceInsert) {
@@ -909,17 +999,46 @@ void DashTable<_Key, _Value, Policy>::IncreaseDepth(unsigned new_depth) {
   assert(!segment_.empty());
   assert(new_depth > global_depth_);
   size_t prev_sz = segment_.size();
-  size_t repl_cnt = 1ul << (new_depth - global_depth_);
-  segment_.resize(1ul << new_depth);
 
-  for (int i = prev_sz - 1; i >= 0; --i) {
-    size_t offs = i * repl_cnt;
-    std::fill(segment_.begin() + offs, segment_.begin() + offs + repl_cnt, segment_[i]);
-    segment_[i]->set_segment_id(offs);  // update segment id.
+  if (new_depth == global_depth_ + 1u && next_segment_.size() == prev_sz * 2) {
+    // The next directory has been prepared by PrepareGrowth.
+    segment_.swap(next_segment_);
+  } else {
+    size_t repl_cnt = 1ul << (new_depth - global_depth_);
+    segment_.resize(1ul << new_depth);
+
+    for (int i = prev_sz - 1; i >= 0; --i) {
+      size_t offs = i * repl_cnt;
+      std::fill(segment_.begin() + offs, segment_.begin() + offs + repl_cnt, segment_[i]);
+    }
   }
+
+  // Release the old (or partially prepared) directory.
+  SegmentDirectory(segment_.get_allocator()).swap(next_segment_);
   global_depth_ = new_depth;
 }
 
+template <typename _Key, typename _Value, typename Policy>
+bool DashTable<_Key, _Value, Policy>::PrepareGrowth(size_t max_entries) {
+  // If all the segments have local depth smaller than global_depth_, the directory holds at least
+  // 2 entries per segment and none of the segments requires doubling it in order to split.
+  if (unique_segments_ * 2 <= segment_.size())
+    return false;
+
+  if (next_segment_.capacity() < segment_.size() * 2) {
+    next_segment_.reserve(segment_.size() * 2);
+  }
+
+  size_t filled = next_segment_.size() / 2;
+  size_t end = std::min(segment_.size(), filled + max_entries);
+  for (size_t i = filled; i < end; ++i) {
+    next_segment_.push_back(segment_[i]);
+    next_segment_.push_back(segment_[i]);
+  }
+
+  return next_segment_.size() == segment_.size() * 2;
+}
+
 template <typename _Key, typename _Value, typename Policy>
 template <typename EvictionPolicy>
 void DashTable<_Key, _Value, Policy>::Split(uint32_t seg_id, EvictionPolicy& ev) {
@@ -929,7 +1048,12 @@ void DashTable<_Key, _Value, Policy>::Split(uint32_t seg_id, EvictionPolicy& ev)
   uint32_t start_idx = seg_id & (~(chunk_size - 1));
   assert(segment_[start_idx] == source && segment_[start_idx + chunk_size - 1] == source);
   uint32_t target_id = start_idx + chunk_size / 2;
-  SegmentType* target = ConstructSegment(source->local_depth() + 1, target_id);
+  uint8_t new_depth = source->local_depth() + 1;
+
+  // Both halves extend the hash prefix of the source segment with an additional bit.
+  uint32_t source_prefix = source->segment_id() << 1;
+  SegmentType* target = ConstructSegment(new_depth, source_prefix | 1);
+  source->set_segment_id(source_prefix);
 
   auto hash_fn = [this](const auto& k) { return policy_.HashFn(k); };
 
@@ -942,7 +1066,7 @@ void DashTable<_Key, _Value, Policy>::Split(uint32_t seg_id, EvictionPolicy& ev)
           detail::PhysicalBid to) {
         // OnMove is used to notify eviction policy about the moves across
         // buckets/segments during the split.
-        ev.OnMove(Cursor{global_depth_, segment_from, from}, Cursor{global_depth_, segment_to, to});
+        ev.OnMove(Cursor{new_depth, segment_from, from}, Cursor{new_depth, segment_to, to});
       });
 
   // add back the updated bucket count.
@@ -952,6 +1076,12 @@ void DashTable<_Key, _Value, Policy>::Split(uint32_t seg_id, EvictionPolicy& ev)
   for (size_t i = target_id; i < start_idx + chunk_size; ++i) {
     segment_[i] = target;
   }
+
+  // Keep the directory prepared by PrepareGrowth in sync.
+  size_t mirrored = std::min<size_t>(start_idx + chunk_size, next_segment_.size() / 2);
+  for (size_t i = target_id; i < mirrored; ++i) {
+    next_segment_[2 * i] = next_segment_[2 * i + 1] = target;
+  }
 }
 
 template <typename _Key, typename _Value, typename Policy>
@@ -1021,6 +1151,20 @@ auto DashTable<_Key, _Value, Policy>::Traverse(Cursor curs, Cb&& cb) -> Cursor {
   return Cursor{global_depth_, sid, bid};
 }
 
+template <typename _Key, typename _Value, typename Policy>
+template <typename Cb>
+void DashTable<_Key, _Value, Policy>::TraverseLogicalBucket(Cursor curs, Cb&& cb) {
+  uint32_t sid = curs.segment_id(global_depth_);
+  uint8_t bid = curs.bucket_id();
+
+  if (bid >= Policy::kBucketNum || sid >= segment_.size())
+    return;
+
+  auto hash_fun = [this](const auto& k) { return policy_.HashFn(k); };
+  auto dt_cb = [&](const SegmentIterator& it) { cb(iterator{this, sid, it.index, it.slot}); };
+  segment_[sid]->TraverseLogicalBucket(bid, hash_fun, std::move(dt_cb));
+}
+
 template <typename _Key, typename _Value, typename Policy>
 auto DashTable<_Key, _Value, Policy>::AdvanceCursorBucketOrder(Cursor cursor) -> Cursor {
   // We fix bid and go over all segments. Once we reach the end we increase bid and repeat.
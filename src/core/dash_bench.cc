@@ -149,6 +149,25 @@ void BenchDash(uint64_t num) {
   }
 }
 
+// Measures lookup latency of present keys. With DASH_SIMD_PROBE defined, the home, neighbour
+// and stash buckets are probed with the vectorized fingerprint comparison.
+void BenchDashFind(uint64_t num) {
+  for (uint64_t i = 0; i < num; ++i) {
+    udt.Insert(i, 0);
+  }
+
+  uint64_t found = 0;
+  for (uint64_t i = 0; i < num; ++i) {
+    time_t start = GetNow();
+    found += !udt.Find(i).is_done();
+    LFENCE;
+
+    time_t end = GetNow();
+    Sample(start, end, &hist);
+  }
+  CHECK_EQ(found, num);
+}
+
 inline sds Prefix() {
   return sdsnew("xxxxxxxxxxxxxxxxxxxxxxx");
 }
@@ -222,6 +241,8 @@ int main(int argc, char* argv[]) {
     } else {
       BenchDash(num);
     }
+  } else if (table_type == "dash_find") {
+    BenchDashFind(num);
   } else if (table_type == "dict") {
     if (is_sds) {
       BenchDictSds();
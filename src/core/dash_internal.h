@@ -16,6 +16,13 @@
 #include "base/pmr/memory_resource.h"
 #include "core/sse_port.h"
 
+// The one pass probe is only used where CompareFp2x16 is vectorized. s390x and big-endian targets
+// keep probing bucket by bucket.
+#if defined(DASH_SIMD_PROBE) && !defined(__s390x__) && \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define DASH_USE_SIMD_PROBE
+#endif
+
 namespace dfly {
 namespace detail {
 
@@ -135,8 +142,17 @@ template <unsigned NUM_SLOTS> class BucketBase {
   }
 
   unsigned Find(uint8_t fp_hash, bool probe) const {
-    unsigned mask = CompareFP(fp_hash) & GetBusy();
-    return mask & GetProbe(probe);
+    return FilterMask(CompareFP(fp_hash), probe);
+  }
+
+  // Filters a raw fingerprint comparison mask, leaving only busy slots with the given probe state.
+  unsigned FilterMask(uint32_t fp_mask, bool probe) const {
+    return fp_mask & GetBusy() & GetProbe(probe);
+  }
+
+  // Fingerprint array that can be compared directly with CompareFp2x16.
+  const uint8_t* fp_data() const {
+    return finger_arr_.data();
   }
 
   uint8_t Fp(unsigned i) const {
@@ -281,6 +297,49 @@ static_assert(alignof(VersionedBB<14>) == 1);
 static_assert(sizeof(VersionedBB<12>) == 12 * 2 + 8);
 static_assert(sizeof(VersionedBB<14>) <= 14 * 2 + 8);
 
+// Policies may declare `using SlotExt = T;` to attach a small trivially copyable value to every
+// slot. The extension moves together with its slot and is reset to T{} on insertion.
+struct NoSlotExt {};
+
+template <typename Policy, typename = void> struct PolicySlotExt {
+  using type = NoSlotExt;
+};
+
+template <typename Policy>
+struct PolicySlotExt<Policy, std::void_t<typename Policy::SlotExt>> {
+  using type = typename Policy::SlotExt;
+};
+
+template <typename T, unsigned NUM_SLOTS> struct SlotExtArray {
+  static_assert(std::is_trivially_copyable_v<T>);
+
+  T ext[NUM_SLOTS];
+
+  void ResetExt(unsigned slot) {
+    ext[slot] = T{};
+  }
+
+  void SwapExt(unsigned slot_a, unsigned slot_b) {
+    std::swap(ext[slot_a], ext[slot_b]);
+  }
+
+  void ShiftExtRight() {
+    for (unsigned i = NUM_SLOTS - 1; i > 0; i--)
+      ext[i] = ext[i - 1];
+  }
+};
+
+template <unsigned NUM_SLOTS> struct SlotExtArray<NoSlotExt, NUM_SLOTS> {
+  void ResetExt(unsigned slot) {
+  }
+
+  void SwapExt(unsigned slot_a, unsigned slot_b) {
+  }
+
+  void ShiftExtRight() {
+  }
+};
+
 // Segment - static-hashtable of size kSlotNum*(kBucketNum + kStashBucketNum).
 struct DefaultSegmentPolicy {
   static constexpr unsigned kSlotNum = 12;
@@ -299,13 +358,16 @@ class Segment {
   static constexpr unsigned kStashBucketNum = 4;
   static constexpr bool kUseVersion = Policy::kUseVersion;
 
+  using SlotExt = typename PolicySlotExt<Policy>::type;
+  static constexpr bool kUseSlotExt = !std::is_same_v<SlotExt, NoSlotExt>;
+
  private:
   static_assert(kBucketNum + kStashBucketNum < 255);
   static constexpr unsigned kFingerBits = 8;
 
   using BucketType = std::conditional_t<kUseVersion, VersionedBB<kSlotNum>, BucketBase<kSlotNum>>;
 
-  struct Bucket : public BucketType {
+  struct Bucket : public BucketType, public SlotExtArray<SlotExt, kSlotNum> {
     using BucketType::kNanSlot;
     using typename BucketType::SlotId;
 
@@ -318,6 +380,7 @@ class Segment {
 
       key[slot] = std::forward<U>(u);
       value[slot] = std::forward<V>(v);
+      this->ResetExt(slot);
 
       this->SetHash(slot, meta_hash, probe);
     }
@@ -335,7 +398,12 @@ class Segment {
       return slot;
     }
 
-    template <typename Pred> SlotId FindByFp(uint8_t fp_hash, bool probe, Pred&& pred) const;
+    template <typename Pred> SlotId FindByFp(uint8_t fp_hash, bool probe, Pred&& pred) const {
+      return FindByMask(this->Find(fp_hash, probe), std::forward<Pred>(pred));
+    }
+
+    // Returns the first slot in mask for which pred is truthy, kNanSlot otherwise.
+    template <typename Pred> SlotId FindByMask(unsigned mask, Pred&& pred) const;
 
     bool ShiftRight();
 
@@ -343,6 +411,7 @@ class Segment {
       BucketType::Swap(slot_a, slot_b);
       std::swap(key[slot_a], key[slot_b]);
       std::swap(value[slot_a], value[slot_b]);
+      this->SwapExt(slot_a, slot_b);
     }
 
     template <typename This, typename Cb> void ForEachSlotImpl(This obj, Cb&& cb) const {
@@ -506,6 +575,18 @@ class Segment {
     return GetBucket(bid).value[slot];
   }
 
+  template <bool UE = kUseSlotExt> std::enable_if_t<UE, SlotExt&> Ext(PhysicalBid bid,
+                                                                      unsigned slot) {
+    assert(IsBusy(bid, slot));
+    return GetBucket(bid).ext[slot];
+  }
+
+  template <bool UE = kUseSlotExt>
+  std::enable_if_t<UE, const SlotExt&> Ext(PhysicalBid bid, unsigned slot) const {
+    assert(IsBusy(bid, slot));
+    return GetBucket(bid).ext[slot];
+  }
+
   // fill bucket ids that may be used probing for this key_hash.
   // The order is: exact, neighbour buckets.
   static void FillProbeArray(Hash_t key_hash, uint8_t dest[4]) {
@@ -574,11 +655,22 @@ class Segment {
     return kBucketNum + kStashBucketNum;
   }
 
-  // needed only when DashTable grows its segment table.
+  // Segment id is the prefix of local_depth bits shared by the hashes of all the segment keys.
+  // Unlike the index in the segment directory, it does not change when the directory grows.
+  uint32_t segment_id() const {
+    return segment_id_;
+  }
+
+  // needed only when DashTable splits or shrinks its segments.
   void set_segment_id(uint32_t new_id) {
     segment_id_ = new_id;
   }
 
+  // Returns the logical (home) bucket of the hash.
+  static LogicalBid BucketIndex(Hash_t hash) {
+    return HomeIndex(hash);
+  }
+
  private:
   static_assert(sizeof(Iterator) == 2);
 
@@ -605,6 +697,13 @@ class Segment {
   void RemoveStashReference(unsigned stash_pos, Hash_t key_hash);
 
   // returns a valid iterator if succeeded.
+  // Copies the slot extension of a moved entry. No-op if the policy has no extension.
+  static void CopyExt(const Bucket& src, unsigned src_slot, Bucket* dest, unsigned dest_slot) {
+    if constexpr (kUseSlotExt) {
+      dest->ext[dest_slot] = src.ext[src_slot];
+    }
+  }
+
   Iterator TryMoveFromStash(unsigned stash_id, unsigned stash_slot_id, Hash_t key_hash);
 
   const static unsigned kTotalBuckets = kBucketNum + kStashBucketNum;
@@ -612,7 +711,7 @@ class Segment {
 
   Bucket bucket_[kTotalBuckets];
   uint8_t local_depth_;
-  uint32_t segment_id_;  // segment id in the table.
+  uint32_t segment_id_;  // local_depth_ bits prefix of the segment hashes, see segment_id().
   PMR_NS::memory_resource* mr_ = nullptr;
 
  public:
@@ -1015,9 +1114,7 @@ ___] |___ |__] |  | |___ | \|  |
 
 template <typename Key, typename Value, typename Policy>
 template <typename Pred>
-auto Segment<Key, Value, Policy>::Bucket::FindByFp(uint8_t fp_hash, bool probe, Pred&& pred) const
-    -> SlotId {
-  unsigned mask = this->Find(fp_hash, probe);
+auto Segment<Key, Value, Policy>::Bucket::FindByMask(unsigned mask, Pred&& pred) const -> SlotId {
   if (!mask)
     return kNanSlot;
 
@@ -1049,6 +1146,7 @@ bool Segment<Key, Value, Policy>::Bucket::ShiftRight() {
     std::swap(key[i], key[i - 1]);
     std::swap(value[i], value[i - 1]);
   }
+  this->ShiftExtRight();
   return res;
 }
 
@@ -1082,6 +1180,7 @@ auto Segment<Key, Value, Policy>::TryMoveFromStash(unsigned stash_id, unsigned s
   }
 
   if (reg_slot >= 0) {
+    CopyExt(bucket_[stash_bid], stash_slot_id, &bucket_[bid], reg_slot);
     if constexpr (kUseVersion) {
       // We maintain the invariant for the physical bucket by updating the version when
       // the entries move between buckets.
@@ -1121,15 +1220,26 @@ auto Segment<Key, Value, Policy>::FindIt(Hash_t key_hash, Pred&& pred) const ->
   __builtin_prefetch(&target);
 
   uint8_t fp_hash = key_hash & kFpMask;
-  SlotId sid = target.FindByFp(fp_hash, false, pred);
+  LogicalBid nid = NextBid(bidx);
+  const Bucket& probe = GetBucket(nid);
+
+#ifdef DASH_USE_SIMD_PROBE
+  // Compare fingerprints of both the home and the neighbour buckets in one pass.
+  uint32_t fp_mask = CompareFp2x16(target.fp_data(), probe.fp_data(), fp_hash);
+  SlotId sid = target.FindByMask(target.FilterMask(fp_mask & 0xFFFF, false), pred);
   if (sid != BucketType::kNanSlot) {
     return Iterator{bidx, sid};
   }
 
-  LogicalBid nid = NextBid(bidx);
-  const Bucket& probe = GetBucket(nid);
+  sid = probe.FindByMask(probe.FilterMask(fp_mask >> 16, true), pred);
+#else
+  SlotId sid = target.FindByFp(fp_hash, false, pred);
+  if (sid != BucketType::kNanSlot) {
+    return Iterator{bidx, sid};
+  }
 
   sid = probe.FindByFp(fp_hash, true, pred);
+#endif
 
 #ifdef ENABLE_DASH_STATS
   stats.neighbour_probes++;
@@ -1156,12 +1266,31 @@ auto Segment<Key, Value, Policy>::FindIt(Hash_t key_hash, Pred&& pred) const ->
     stats.stash_overflow_probes++;
 #endif
 
+#ifdef DASH_USE_SIMD_PROBE
+    static_assert(kStashBucketNum % 2 == 0);
+
+    for (unsigned i = 0; i < kStashBucketNum; i += 2) {
+      const Bucket& first = bucket_[kBucketNum + i];
+      const Bucket& second = bucket_[kBucketNum + i + 1];
+      uint32_t fp_mask = CompareFp2x16(first.fp_data(), second.fp_data(), fp_hash);
+      auto sid = first.FindByMask(first.FilterMask(fp_mask & 0xFFFF, false), pred);
+      if (sid != BucketType::kNanSlot) {
+        return Iterator{PhysicalBid(kBucketNum + i), sid};
+      }
+
+      sid = second.FindByMask(second.FilterMask(fp_mask >> 16, false), pred);
+      if (sid != BucketType::kNanSlot) {
+        return Iterator{PhysicalBid(kBucketNum + i + 1), sid};
+      }
+    }
+#else
     for (unsigned i = 0; i < kStashBucketNum; ++i) {
       auto sid = stash_cb(0, i);
       if (sid != BucketType::kNanSlot) {
         return Iterator{PhysicalBid(kBucketNum + i), sid};
       }
     }
+#endif
 
     // We exit because we searched through all stash buckets anyway, no need to use overflow fps.
     return Iterator{};
@@ -1281,6 +1410,7 @@ void Segment<Key, Value, Policy>::Split(HFunc&& hfn, Segment* dest_right, MoveCb
       // for our dash hash function, thus avoiding the case where someone, on purpose or due to
       // selective bias will be able to hit our dashtable with items with the same bucket id.
       assert(it.found());
+      CopyExt(*bucket, slot, &dest_right->bucket_[it.index], it.slot);
       update_version(*bucket, it.index);
       on_move_cb(segment_id_, i, dest_right->segment_id_, it.index);
     };
@@ -1315,6 +1445,7 @@ void Segment<Key, Value, Policy>::Split(HFunc&& hfn, Segment* dest_right, MoveCb
                                        /* not interested in these movements */ [](auto&&...) {});
       (void)it;
       assert(it.index != kNanBid);
+      CopyExt(*bucket, slot, &dest_right->bucket_[it.index], it.slot);
       update_version(*bucket, it.index);
       on_move_cb(segment_id_, i, dest_right->segment_id_, it.index);
 
@@ -1343,6 +1474,8 @@ int Segment<Key, Value, Policy>::MoveToOther(bool own_items, unsigned from_bid,
   if (dst_slot < 0)
     return -1;
 
+  CopyExt(src, src_slot, &bucket_[to_bid], dst_slot);
+
   // We never decrease the version of the entry.
   if constexpr (kUseVersion) {
     auto& dst = bucket_[to_bid];
@@ -1685,6 +1818,9 @@ auto Segment<Key, Value, Policy>::BumpUp(uint8_t bid, SlotId slot, Hash_t key_ha
   // swap keys, values and fps. update slots meta.
   std::swap(from.key[slot], swapb.key[kLastSlot]);
   std::swap(from.value[slot], swapb.value[kLastSlot]);
+  if constexpr (kUseSlotExt) {
+    std::swap(from.ext[slot], swapb.ext[kLastSlot]);
+  }
   from.Delete(slot);
   from.SetHash(slot, swap_fp, false);
 
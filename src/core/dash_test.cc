@@ -213,6 +213,16 @@ TEST_F(DashTest, SlotBitmap) {
   EXPECT_EQ(2, slot.GetProbe(true));
 }
 
+TEST_F(DashTest, CompareFp2x16) {
+  uint8_t a[16] = {0}, b[16] = {0};
+  a[3] = 7;
+  a[15] = 7;
+  b[0] = 7;
+  b[11] = 7;
+  EXPECT_EQ((1u << 3) | (1u << 15) | (1u << 16) | (1u << 27), CompareFp2x16(a, b, 7));
+  EXPECT_EQ(0u, CompareFp2x16(a, b, 9));
+}
+
 TEST_F(DashTest, Basic) {
   Segment::Key_t key = 0;
   Segment::Value_t val = 0;
@@ -553,6 +563,69 @@ TEST_F(DashTest, Reserve) {
   }
 }
 
+TEST_F(DashTest, ReserveEmpty) {
+  constexpr size_t kNumItems = 100000;
+  dt_.Reserve(kNumItems);
+  EXPECT_GE(dt_.capacity(), kNumItems);
+  EXPECT_EQ(1u << dt_.depth(), dt_.unique_segments());
+
+  size_t segments = dt_.unique_segments();
+  for (size_t i = 0; i < kNumItems / 2; ++i) {
+    dt_.Insert(i, i);
+  }
+  EXPECT_EQ(segments, dt_.unique_segments());
+}
+
+TEST_F(DashTest, FindBatch) {
+  constexpr uint64_t kNumItems = 1000;
+  for (uint64_t i = 0; i < kNumItems; ++i) {
+    dt_.Insert(i * 2, i);
+  }
+
+  // Odd keys are missing, the batch spans more than a single prefetch window.
+  vector<uint64_t> keys;
+  for (uint64_t i = 0; i < 100; ++i) {
+    keys.push_back(i);
+  }
+
+  unsigned found = 0;
+  dt_.FindBatch(absl::MakeConstSpan(keys), [&](size_t index, Dash64::iterator it) {
+    ASSERT_EQ(index % 2 == 1, it.is_done()) << index;
+    if (!it.is_done()) {
+      EXPECT_EQ(keys[index], it->first);
+      EXPECT_EQ(keys[index] / 2, it->second);
+      ++found;
+    }
+  });
+  EXPECT_EQ(50, found);
+}
+
+TEST_F(DashTest, PrepareGrowth) {
+  EXPECT_FALSE(dt_.PrepareGrowth(1));
+
+  unsigned num_prepared = 0;
+  for (uint64_t i = 0; i < 100000; ++i) {
+    dt_.Insert(i, i);
+
+    // Prepare the directory in small steps, interleaved with splits.
+    if (i % 64 == 0 && dt_.PrepareGrowth(3))
+      ++num_prepared;
+  }
+  EXPECT_GT(num_prepared, 0u);
+
+  for (size_t sid = 0; sid < dt_.GetSegmentCount(); ++sid) {
+    auto* seg = dt_.GetSegment(sid);
+    size_t chunk = 1u << (dt_.depth() - seg->local_depth());
+    ASSERT_EQ(sid & ~(chunk - 1), size_t(seg->segment_id()) * chunk) << sid;
+  }
+
+  for (uint64_t i = 0; i < 100000; ++i) {
+    auto it = dt_.Find(i);
+    ASSERT_FALSE(it.is_done()) << i;
+    ASSERT_EQ(i, it->second);
+  }
+}
+
 TEST_F(DashTest, Insert) {
   constexpr size_t kNumItems = 10000;
   double sum = 0;
@@ -615,6 +688,21 @@ TEST_F(DashTest, Traverse) {
   EXPECT_EQ(kNumItems - 1, nums.back());
 }
 
+TEST_F(DashTest, TraverseLogicalBucket) {
+  constexpr uint64_t kNumItems = 5000;
+  for (uint64_t i = 0; i < kNumItems; ++i) {
+    dt_.Insert(i, i);
+  }
+
+  for (uint64_t i = 0; i < kNumItems; ++i) {
+    bool found = false;
+    dt_.TraverseLogicalBucket(dt_.BucketCursor(i), [&](Dash64::iterator it) {
+      found |= (it->first == i);
+    });
+    ASSERT_TRUE(found) << i;
+  }
+}
+
 TEST_F(DashTest, TraverseSegmentOrder) {
   constexpr auto kNumItems = 50;
   for (size_t i = 0; i < kNumItems; ++i) {
@@ -788,6 +876,43 @@ struct VersionPolicy : public BasicDashPolicy {
   }
 };
 
+struct SlotExtPolicy : public UInt64Policy {
+  using SlotExt = uint32_t;
+};
+
+using SlotExtDT = DashTable<uint64_t, uint64_t, SlotExtPolicy>;
+
+TEST_F(DashTest, SlotExt) {
+  static_assert(SlotExtDT::kSegBytes > Dash64::kSegBytes);
+
+  SlotExtDT dt;
+  constexpr uint64_t kNum = 100000;
+  for (uint64_t i = 0; i < kNum; ++i) {
+    auto it = dt.Insert(i, i).first;
+    EXPECT_EQ(0u, it.GetExt());
+    it.SetExt(uint32_t(i) + 1);
+  }
+
+  // Bumping entries up around the table moves them between buckets.
+  RelaxedBumpPolicy policy;
+  for (uint64_t i = 0; i < kNum; i += 7) {
+    dt.BumpUp(dt.Find(i), policy);
+  }
+
+  for (uint64_t i = 0; i < kNum; ++i) {
+    auto it = dt.Find(i);
+    ASSERT_FALSE(it.is_done());
+    ASSERT_EQ(uint32_t(i) + 1, it.GetExt()) << i;
+  }
+
+  for (uint64_t i = 0; i < kNum; i += 2) {
+    dt.Erase(i);
+  }
+  for (uint64_t i = 0; i < kNum; i += 2) {
+    EXPECT_EQ(0u, dt.Insert(i, i).first.GetExt());
+  }
+}
+
 using VersionDT = DashTable<int, int, VersionPolicy>;
 TEST_F(DashTest, Version) {
   VersionDT dt;
@@ -1342,4 +1467,237 @@ static void BM_RedisStringInsert(benchmark::State& state) {
 }
 BENCHMARK(BM_RedisStringInsert)->Arg(1000)->Arg(10000)->Arg(100000);
 
+// DashTable vs absl::flat_hash_map on string keys of application-like sizes. Every benchmark
+// thread builds its own table, so multi-threaded runs show how each table scales when threads
+// share only the allocator and the memory bandwidth.
+struct StrViewDashPolicy : public BasicDashPolicy {
+  static uint64_t HashFn(string_view u) {
+    return XXH3_64bits(u.data(), u.size());
+  }
+};
+
+using StrDash = DashTable<string_view, uint64_t, StrViewDashPolicy>;
+using StrFlat = absl::flat_hash_map<string_view, uint64_t>;
+
+template <typename T> struct TableOps;
+
+template <> struct TableOps<StrDash> {
+  static void Insert(StrDash* t, string_view k) {
+    t->Insert(k, 0);
+  }
+  static bool Find(StrDash* t, string_view k) {
+    return !t->Find(k).is_done();
+  }
+  static void Erase(StrDash* t, string_view k) {
+    t->Erase(k);
+  }
+  static size_t MemUsage(const StrDash& t) {
+    return t.mem_usage();
+  }
+  static double LoadFactor(const StrDash& t) {
+    return t.load_factor();
+  }
+};
+
+template <> struct TableOps<StrFlat> {
+  static void Insert(StrFlat* t, string_view k) {
+    t->emplace(k, 0);
+  }
+  static bool Find(StrFlat* t, string_view k) {
+    return t->contains(k);
+  }
+  static void Erase(StrFlat* t, string_view k) {
+    t->erase(k);
+  }
+  // A slot and a control byte per entry of the backing array.
+  static size_t MemUsage(const StrFlat& t) {
+    return t.capacity() * (sizeof(StrFlat::value_type) + 1);
+  }
+  static double LoadFactor(const StrFlat& t) {
+    return t.load_factor();
+  }
+};
+
+// Keys from 16 to 40 bytes in the shape of "session:<tid>:<id>". Different key spaces never
+// intersect, so keys of another key space serve as misses.
+static vector<string> MakeBenchKeys(size_t count, unsigned key_space) {
+  constexpr string_view kPrefixes[] = {"user:", "session:", "cache:page:", "ratelimit:api:"};
+  vector<string> keys(count);
+  for (size_t i = 0; i < count; ++i) {
+    keys[i] = absl::StrCat(kPrefixes[i % 4], key_space, ":", 1000000 + i * 7919,
+                           i % 3 ? "" : ":profile");
+  }
+  return keys;
+}
+
+static size_t DashStashEntries(StrDash* dt) {
+  using Segment_t = StrDash::Segment_t;
+  size_t res = 0;
+  for (size_t sid = 0; sid < dt->GetSegmentCount(); sid = dt->NextSeg(sid)) {
+    const Segment_t* seg = dt->GetSegment(sid);
+    for (unsigned i = 0; i < Segment_t::kStashBucketNum; ++i) {
+      res += seg->GetBucket(Segment_t::kBucketNum + i).Size();
+    }
+  }
+  return res;
+}
+
+// Fills a table outside of the timed region and reports its memory per entry, and the load
+// factor sampled along the growth. For DashTable also reports segment splits per 1000 inserts
+// and the share of entries that ended up in stash buckets.
+template <typename T>
+static void ReportGrowth(const vector<string>& keys, benchmark::State& state) {
+  using Ops = TableOps<T>;
+  T table;
+  size_t start_segments = 0;
+  if constexpr (is_same_v<T, StrDash>)
+    start_segments = table.unique_segments();
+
+  const size_t sample_every = max<size_t>(keys.size() / 64, 1);
+  double min_lf = 1, sum_lf = 0;
+  unsigned samples = 0;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    Ops::Insert(&table, keys[i]);
+    if ((i + 1) % sample_every == 0) {
+      double lf = Ops::LoadFactor(table);
+      min_lf = min(min_lf, lf);
+      sum_lf += lf;
+      ++samples;
+    }
+  }
+
+  state.counters["bytes_per_entry"] = double(Ops::MemUsage(table)) / keys.size();
+  state.counters["load_factor"] = Ops::LoadFactor(table);
+  state.counters["min_load_factor"] = min_lf;
+  state.counters["avg_load_factor"] = samples ? sum_lf / samples : 0;
+  if constexpr (is_same_v<T, StrDash>) {
+    state.counters["splits_per_1k"] =
+        1000.0 * (table.unique_segments() - start_segments) / keys.size();
+    state.counters["stash_share"] = double(DashStashEntries(&table)) / keys.size();
+  }
+}
+
+template <typename T> static void BM_TableInsert(benchmark::State& state) {
+  using Ops = TableOps<T>;
+  vector<string> keys = MakeBenchKeys(state.range(0), state.thread_index());
+
+  for (auto _ : state) {
+    T table;
+    for (const string& k : keys) {
+      Ops::Insert(&table, k);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+
+  if (state.thread_index() == 0)
+    ReportGrowth<T>(keys, state);
+}
+
+template <typename T> static void BM_TableFindHit(benchmark::State& state) {
+  using Ops = TableOps<T>;
+  vector<string> keys = MakeBenchKeys(state.range(0), state.thread_index());
+  T table;
+  for (const string& k : keys) {
+    Ops::Insert(&table, k);
+  }
+
+  size_t i = 0, found = 0;
+  for (auto _ : state) {
+    found += Ops::Find(&table, keys[i]);
+    if (++i == keys.size())
+      i = 0;
+  }
+  benchmark::DoNotOptimize(found);
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <typename T> static void BM_TableFindMiss(benchmark::State& state) {
+  using Ops = TableOps<T>;
+  vector<string> keys = MakeBenchKeys(state.range(0), state.thread_index());
+  vector<string> misses = MakeBenchKeys(keys.size(), state.thread_index() + 1000);
+  T table;
+  for (const string& k : keys) {
+    Ops::Insert(&table, k);
+  }
+
+  size_t i = 0, found = 0;
+  for (auto _ : state) {
+    found += Ops::Find(&table, misses[i]);
+    if (++i == misses.size())
+      i = 0;
+  }
+  CHECK_EQ(found, 0u);
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <typename T> static void BM_TableErase(benchmark::State& state) {
+  using Ops = TableOps<T>;
+  constexpr size_t kBatch = 1024;
+  vector<string> keys = MakeBenchKeys(state.range(0), state.thread_index());
+  T table;
+  for (const string& k : keys) {
+    Ops::Insert(&table, k);
+  }
+
+  size_t next = 0;
+  for (auto _ : state) {
+    size_t start = next;
+    for (size_t j = 0; j < kBatch; ++j) {
+      Ops::Erase(&table, keys[next]);
+      next = (next + 1) % keys.size();
+    }
+
+    state.PauseTiming();
+    for (size_t j = 0; j < kBatch; ++j) {
+      Ops::Insert(&table, keys[(start + j) % keys.size()]);
+    }
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * kBatch);
+}
+
+// 80% hits, 10% inserts and 10% erases over a sliding window of range(0) keys, so the table
+// size stays constant.
+template <typename T> static void BM_TableMixed(benchmark::State& state) {
+  using Ops = TableOps<T>;
+  const size_t window = state.range(0);
+  vector<string> keys = MakeBenchKeys(window * 2, state.thread_index());
+  T table;
+  for (size_t i = 0; i < window; ++i) {
+    Ops::Insert(&table, keys[i]);
+  }
+
+  size_t lo = 0, found = 0;
+  uint64_t rnd = state.thread_index() + 1;
+  unsigned op = 0;
+  for (auto _ : state) {
+    if (op < 8) {
+      rnd = rnd * 6364136223846793005ULL + 1442695040888963407ULL;
+      found += Ops::Find(&table, keys[(lo + (rnd >> 33) % window) % keys.size()]);
+    } else if (op == 8) {
+      Ops::Insert(&table, keys[(lo + window) % keys.size()]);
+    } else {
+      Ops::Erase(&table, keys[lo]);
+      lo = (lo + 1) % keys.size();
+    }
+    op = op == 9 ? 0 : op + 1;
+  }
+  benchmark::DoNotOptimize(found);
+  state.SetItemsProcessed(state.iterations());
+}
+
+#define TABLE_BENCHMARK(name, table) \
+  BENCHMARK_TEMPLATE(name, table)->Arg(100000)->Arg(1000000)->ThreadRange(1, 8)
+
+TABLE_BENCHMARK(BM_TableInsert, StrDash);
+TABLE_BENCHMARK(BM_TableInsert, StrFlat);
+TABLE_BENCHMARK(BM_TableFindHit, StrDash);
+TABLE_BENCHMARK(BM_TableFindHit, StrFlat);
+TABLE_BENCHMARK(BM_TableFindMiss, StrDash);
+TABLE_BENCHMARK(BM_TableFindMiss, StrFlat);
+TABLE_BENCHMARK(BM_TableErase, StrDash);
+TABLE_BENCHMARK(BM_TableErase, StrFlat);
+TABLE_BENCHMARK(BM_TableMixed, StrDash);
+TABLE_BENCHMARK(BM_TableMixed, StrFlat);
+
 }  // namespace dfly
@@ -116,14 +116,16 @@ DenseSet::~DenseSet() {
   CHECK(entries_.empty());
 }
 
-size_t DenseSet::PushFront(DenseSet::ChainVectorIterator it, void* data, bool has_ttl) {
+size_t DenseSet::PushFront(DenseSet::ChainVectorIterator it, void* data, bool has_ttl,
+                           uint8_t hash_tag) {
   // if this is an empty list assign the value to the empty placeholder pointer
   DCHECK(!it->IsDisplaced());
   if (it->IsEmpty()) {
     it->SetObject(data);
+    it->SetHashTag(hash_tag);
   } else {
     // otherwise make a new link and connect it to the front of the list
-    it->SetLink(NewLink(data, *it));
+    it->SetLink(NewLink(data, hash_tag, *it));
   }
 
   if (has_ttl) {
@@ -140,6 +142,7 @@ void DenseSet::PushFront(DenseSet::ChainVectorIterator it, DenseSet::DensePtr pt
 
   if (it->IsEmpty()) {
     it->SetObject(ptr.GetObject());
+    it->SetHashTag(ptr.ObjectHashTag());
     if (ptr.HasTtl()) {
       it->SetTtl(true);
       expiration_used_ = true;
@@ -156,7 +159,7 @@ void DenseSet::PushFront(DenseSet::ChainVectorIterator it, DenseSet::DensePtr pt
     DCHECK(ptr.IsObject());
 
     // allocate a new link if needed and copy the pointer to the new link
-    it->SetLink(NewLink(ptr.Raw(), *it));
+    it->SetLink(NewLink(ptr.Raw(), ptr.HashTag(), *it));
     if (ptr.HasTtl()) {
       it->SetTtl(true);
       expiration_used_ = true;
@@ -225,8 +228,61 @@ uint32_t DenseSet::ClearStep(uint32_t start, uint32_t count) {
   return end;
 }
 
-bool DenseSet::Equal(DensePtr dptr, const void* ptr, uint32_t cookie) const {
-  if (dptr.IsEmpty()) {
+uint32_t DenseSet::ExpireStep(uint32_t start, uint32_t count, uint32_t* min_expire) {
+  size_t end = min<size_t>(entries_.size(), start + count);
+  if (!expiration_used_)
+    return 0;
+
+  for (size_t i = start; i < end; ++i) {
+    DensePtr* curr = &entries_[i];
+    ExpireIfNeeded(nullptr, curr);
+
+    // Walks the chain similarly to IteratorBase::Advance.
+    while (!curr->IsEmpty()) {
+      if (curr->HasTtl())
+        *min_expire = std::min(*min_expire, ObjExpireTime(curr->GetObject()));
+      if (!curr->IsLink())
+        break;
+
+      DenseLinkKey* plink = curr->AsLink();
+      if (ExpireIfNeeded(curr, &plink->next) && !curr->IsLink())
+        break;  // the chain collapsed into curr, which was already visited.
+      curr = &plink->next;
+    }
+  }
+
+  return end < entries_.size() ? end : 0;
+}
+
+uint32_t DenseSet::DefragBuckets(uint32_t start, uint32_t count, float ratio,
+                                 absl::FunctionRef<bool(IteratorBase)> obj_cb, bool* realloced) {
+  size_t end = min<size_t>(entries_.size(), start + count);
+  for (size_t i = start; i < end; ++i) {
+    ChainVectorIterator list_it = entries_.begin() + i;
+    DensePtr* curr = &*list_it;
+    while (!curr->IsEmpty()) {
+      if (curr->IsLink() && zmalloc_page_is_underutilized(curr->AsLink(), ratio)) {
+        DenseLinkKey* old_link = curr->AsLink();
+        LinkAllocator la(mr());
+        DenseLinkKey* new_link = la.allocate(1);
+        la.construct(new_link, *old_link);
+        curr->ReplaceLink(new_link);
+        mr()->deallocate(old_link, sizeof(DenseLinkKey), alignof(DenseLinkKey));
+        *realloced = true;
+      }
+
+      *realloced |= obj_cb(IteratorBase(this, list_it, curr));
+      if (!curr->IsLink())
+        break;
+      curr = &curr->AsLink()->next;
+    }
+  }
+
+  return end < entries_.size() ? end : 0;
+}
+
+bool DenseSet::Equal(DensePtr dptr, const void* ptr, uint32_t cookie, uint8_t hash_tag) const {
+  if (dptr.IsEmpty() || dptr.ObjectHashTag() != hash_tag) {
     return false;
   }
 
@@ -525,7 +581,7 @@ void DenseSet::AddUnique(void* obj, bool has_ttl, uint64_t hashcode) {
   for (unsigned j = 0; j < 2; ++j) {
     ChainVectorIterator list = FindEmptyAround(bucket_id);
     if (list != entries_.end()) {
-      obj_malloc_used_ += PushFront(list, obj, has_ttl);
+      obj_malloc_used_ += PushFront(list, obj, has_ttl, HashTag(hashcode));
       if (std::distance(entries_.begin(), list) != bucket_id) {
         list->SetDisplaced(std::distance(entries_.begin() + bucket_id, list));
       }
@@ -559,6 +615,7 @@ void DenseSet::AddUnique(void* obj, bool has_ttl, uint64_t hashcode) {
    */
 
   DensePtr to_insert(obj);
+  to_insert.SetHashTag(HashTag(hashcode));
   if (has_ttl) {
     to_insert.SetTtl(true);
     expiration_used_ = true;
@@ -586,14 +643,16 @@ void DenseSet::Prefetch(uint64_t hash) {
   PREFETCH_READ(&entries_[bid]);
 }
 
-auto DenseSet::Find2(const void* ptr, uint32_t bid, uint32_t cookie)
+auto DenseSet::Find2(const void* ptr, uint64_t hash, uint32_t cookie)
     -> tuple<size_t, DensePtr*, DensePtr*> {
+  uint32_t bid = BucketId(hash);
+  uint8_t hash_tag = HashTag(hash);
   DCHECK_LT(bid, entries_.size());
 
   DensePtr* curr = &entries_[bid];
   ExpireIfNeeded(nullptr, curr);
 
-  if (Equal(*curr, ptr, cookie)) {
+  if (Equal(*curr, ptr, cookie, hash_tag)) {
     return {bid, nullptr, curr};
   }
 
@@ -603,7 +662,7 @@ auto DenseSet::Find2(const void* ptr, uint32_t bid, uint32_t cookie)
     if (curr->IsDisplaced() && curr->GetDisplacedDirection() == -1) {
       ExpireIfNeeded(nullptr, curr);
 
-      if (Equal(*curr, ptr, cookie)) {
+      if (Equal(*curr, ptr, cookie, hash_tag)) {
         return {bid - 1, nullptr, curr};
       }
     }
@@ -614,7 +673,7 @@ auto DenseSet::Find2(const void* ptr, uint32_t bid, uint32_t cookie)
     if (curr->IsDisplaced() && curr->GetDisplacedDirection() == 1) {
       ExpireIfNeeded(nullptr, curr);
 
-      if (Equal(*curr, ptr, cookie)) {
+      if (Equal(*curr, ptr, cookie, hash_tag)) {
         return {bid + 1, nullptr, curr};
       }
     }
@@ -626,7 +685,7 @@ auto DenseSet::Find2(const void* ptr, uint32_t bid, uint32_t cookie)
   while (curr != nullptr) {
     ExpireIfNeeded(prev, curr);
 
-    if (Equal(*curr, ptr, cookie)) {
+    if (Equal(*curr, ptr, cookie, hash_tag)) {
       return {bid, prev, curr};
     }
     prev = curr;
@@ -683,21 +742,59 @@ DenseSet::ChainVectorIterator DenseSet::GetRandomChain() {
   return entries_.end();
 }
 
+unsigned DenseSet::PurgeChain(ChainVectorIterator it) {
+  DensePtr* ptr = &*it;
+  ExpireIfNeeded(nullptr, ptr);
+  if (ptr->IsEmpty())
+    return 0;
+
+  unsigned len = 1;
+  while (ptr->IsLink()) {
+    DenseLinkKey* plink = ptr->AsLink();
+    if (!ExpireIfNeeded(ptr, &plink->next) || ptr->IsLink()) {
+      ptr = &plink->next;
+      ++len;
+    }
+  }
+  return len;
+}
+
 DenseSet::IteratorBase DenseSet::GetRandomIterator() {
-  ChainVectorIterator chain_it = GetRandomChain();
-  if (chain_it == entries_.end())
+  // Chains are rarely longer than this at the load factors the table grows at.
+  constexpr unsigned kSampleChainLen = 8;
+  constexpr unsigned kMaxSampleProbes = 256;
+
+  if (Empty())
     return IteratorBase{};
 
-  DensePtr* ptr = &*chain_it;
   absl::BitGen bg{};
-  while (ptr->IsLink() && absl::Bernoulli(bg, 0.5)) {
-    DensePtr* next = ptr->Next();
-    if (ExpireIfNeeded(ptr, next))  // stop if we break the chain with expiration
-      break;
-    ptr = next;
+  auto pick = [&](ChainVectorIterator chain_it, unsigned len) {
+    DensePtr* ptr = &*chain_it;
+    for (unsigned i = absl::Uniform(bg, 0u, len); i > 0; --i)
+      ptr = ptr->Next();
+    return IteratorBase{this, chain_it, ptr};
+  };
+
+  // Rejection sampling: a random chain of length len is accepted with probability
+  // min(len, kSampleChainLen) / kSampleChainLen and one of its objects is picked. Objects in
+  // chains of up to kSampleChainLen are equally likely, while the objects of a longer chain are
+  // picked with probability lower by kSampleChainLen / len, since a chain can not be accepted
+  // with probability above 1. Expected to take BucketCount() * kSampleChainLen / size_ probes.
+  for (unsigned i = 0; i < kMaxSampleProbes; ++i) {
+    auto chain_it = entries_.begin() + absl::Uniform(bg, 0u, entries_.size());
+    if (chain_it->IsEmpty())
+      continue;
+
+    unsigned len = PurgeChain(chain_it);
+    if (len > 0 && absl::Uniform(bg, 0u, kSampleChainLen) < len)
+      return pick(chain_it, len);
   }
 
-  return IteratorBase{(DenseSet*)this, chain_it, ptr};
+  // A sparse table, scan for a chain instead.
+  ChainVectorIterator chain_it = GetRandomChain();
+  if (chain_it == entries_.end())
+    return IteratorBase{};
+  return pick(chain_it, PurgeChain(chain_it));
 }
 
 void* DenseSet::PopInternal() {
@@ -726,7 +823,7 @@ void* DenseSet::PopInternal() {
 void* DenseSet::AddOrReplaceObj(void* obj, bool has_ttl) {
   uint64_t hc = Hash(obj, 0);
 
-  DensePtr* dptr = entries_.empty() ? nullptr : Find(obj, BucketId(hc), 0).second;
+  DensePtr* dptr = entries_.empty() ? nullptr : Find(obj, hc, 0).second;
   if (dptr) {  // replace existing object.
     // A bit confusing design: ttl bit is located on the wrapping pointer,
     // therefore we must set ttl bit before unrapping below.
@@ -834,13 +931,14 @@ uint32_t DenseSet::Scan(uint32_t cursor, const ItemCb& cb) const {
   return entries_idx << (32 - capacity_log_);
 }
 
-auto DenseSet::NewLink(void* data, DensePtr next) -> DenseLinkKey* {
+auto DenseSet::NewLink(void* data, uint8_t hash_tag, DensePtr next) -> DenseLinkKey* {
   LinkAllocator la(mr());
   DenseLinkKey* lk = la.allocate(1);
   la.construct(lk);
 
   lk->next = next;
   lk->SetObject(data);
+  lk->SetHashTag(hash_tag);
   ++num_links_;
 
   return lk;
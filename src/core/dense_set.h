@@ -3,6 +3,8 @@
 //
 #pragma once
 
+#include <absl/functional/function_ref.h>
+
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
@@ -47,8 +49,17 @@ class DenseSet {
   static constexpr size_t kDisplaceBit = 1ULL << 53;
   static constexpr size_t kDisplaceDirectionBit = 1ULL << 54;
   static constexpr size_t kTtlBit = 1ULL << 55;
+
+  // The low byte of the object hash is kept in the pointer that holds the object, so that lookups
+  // skip most of the non-matching objects without dereferencing them.
+  static constexpr unsigned kHashTagShift = 56;
+  static constexpr size_t kHashTagMask = 255ULL << kHashTagShift;
   static constexpr size_t kTagMask = 4095ULL << 52;  // we reserve 12 high bits.
 
+  static uint8_t HashTag(uint64_t hash) {
+    return uint8_t(hash);
+  }
+
   class DensePtr {
    public:
     explicit DensePtr(void* p = nullptr) : ptr_(p) {
@@ -89,10 +100,29 @@ class DenseSet {
       return (uptr() & kDisplaceBit) == kDisplaceBit;
     }
 
+    uint8_t HashTag() const {
+      return uptr() >> kHashTagShift;
+    }
+
+    void SetHashTag(uint8_t tag) {
+      ptr_ = (void*)((uptr() & ~kHashTagMask) | (uint64_t(tag) << kHashTagShift));
+    }
+
+    // Returns the hash tag of the object, which is kept on the link for chained objects.
+    uint8_t ObjectHashTag() const {
+      return IsObject() ? HashTag() : AsLink()->HashTag();
+    }
+
     void SetLink(DenseLinkKey* lk) {
       ptr_ = (void*)(uintptr_t(lk) | kLinkBit);
     }
 
+    // Points to another link but preserves tagging info.
+    void ReplaceLink(DenseLinkKey* lk) {
+      assert(IsLink());
+      ptr_ = (void*)((uptr() & kTagMask) | uintptr_t(lk));
+    }
+
     void SetDisplaced(int direction) {
       ptr_ = (void*)(uptr() | kDisplaceBit);
       if (direction == 1) {
@@ -222,6 +252,10 @@ class DenseSet {
   // Returns BucketCount when all objects are erased.
   uint32_t ClearStep(uint32_t start, uint32_t count);
 
+  // Deletes the expired entries of count buckets starting from start and lowers min_expire to the
+  // earliest expiry time of the remaining ones. Returns the next bucket, or 0 after the last one.
+  uint32_t ExpireStep(uint32_t start, uint32_t count, uint32_t* min_expire);
+
   // Returns the number of elements in the map. Note that it might be that some of these elements
   // have expired and can't be accessed.
   size_t UpperBoundSize() const {
@@ -284,7 +318,7 @@ class DenseSet {
   void CollectExpired();
 
   bool EraseInternal(void* obj, uint32_t cookie) {
-    auto [prev, found] = Find(obj, BucketId(obj, cookie), cookie);
+    auto [prev, found] = Find(obj, Hash(obj, cookie), cookie);
     if (found) {
       Delete(prev, found);
       return true;
@@ -298,7 +332,7 @@ class DenseSet {
     if (Empty())
       return IteratorBase{};
 
-    auto [bid, _, curr] = Find2(ptr, BucketId(ptr, cookie), cookie);
+    auto [bid, _, curr] = Find2(ptr, Hash(ptr, cookie), cookie);
     if (curr) {
       return IteratorBase(this, entries_.begin() + bid, curr);
     }
@@ -308,11 +342,20 @@ class DenseSet {
   // Get iterator to start of random non-empty chain (bucket)
   ChainVectorIterator GetRandomChain();
 
-  // Wrap RandomChain() into iterator and advance with reservoir sampling
+  // Returns an iterator to a randomly sampled object, or an empty iterator if the set is empty.
+  // The sample is uniform unless chains are longer than 8 objects, whose objects are
+  // under-sampled. Tables that became sparse after deletions fall back to GetRandomChain(),
+  // which is biased.
   IteratorBase GetRandomIterator();
 
   void* PopInternal();
 
+  // Moves the links of count buckets starting from start that sit on underutilized pages and
+  // passes every object to obj_cb, which moves it if needed. Returns the next bucket, or 0 after
+  // the last one.
+  uint32_t DefragBuckets(uint32_t start, uint32_t count, float ratio,
+                         absl::FunctionRef<bool(IteratorBase)> obj_cb, bool* realloced);
+
   void IncreaseMallocUsed(size_t delta) {
     obj_malloc_used_ += delta;
   }
@@ -334,7 +377,7 @@ class DenseSet {
   DenseSet(const DenseSet&) = delete;
   DenseSet& operator=(DenseSet&) = delete;
 
-  bool Equal(DensePtr dptr, const void* ptr, uint32_t cookie) const;
+  bool Equal(DensePtr dptr, const void* ptr, uint32_t cookie, uint8_t hash_tag) const;
 
   struct CloneItem {
     DensePtr ptr;
@@ -369,7 +412,7 @@ class DenseSet {
   void Grow(size_t prev_size);
 
   // ============ Pseudo Linked List Functions for interacting with Chains ==================
-  size_t PushFront(ChainVectorIterator, void* obj, bool has_ttl);
+  size_t PushFront(ChainVectorIterator, void* obj, bool has_ttl, uint8_t hash_tag);
   void PushFront(ChainVectorIterator, DensePtr);
 
   DensePtr PopPtrFront(ChainVectorIterator);
@@ -377,15 +420,15 @@ class DenseSet {
   // ============ Pseudo Linked List in DenseSet end ==================
 
   // returns (prev, item) pair. If item is root, then prev is null.
-  std::pair<DensePtr*, DensePtr*> Find(const void* ptr, uint32_t bid, uint32_t cookie) {
-    auto [_, p, c] = Find2(ptr, bid, cookie);
+  std::pair<DensePtr*, DensePtr*> Find(const void* ptr, uint64_t hash, uint32_t cookie) {
+    auto [_, p, c] = Find2(ptr, hash, cookie);
     return {p, c};
   }
 
   // returns bid and (prev, item) pair. If item is root, then prev is null.
-  std::tuple<size_t, DensePtr*, DensePtr*> Find2(const void* ptr, uint32_t bid, uint32_t cookie);
+  std::tuple<size_t, DensePtr*, DensePtr*> Find2(const void* ptr, uint64_t hash, uint32_t cookie);
 
-  DenseLinkKey* NewLink(void* data, DensePtr next);
+  DenseLinkKey* NewLink(void* data, uint8_t hash_tag, DensePtr next);
 
   inline void FreeLink(DenseLinkKey* plink) {
     // deallocate the link if it is no longer a link as it is now in an empty list
@@ -403,6 +446,9 @@ class DenseSet {
 
   bool ExpireIfNeededInternal(DensePtr* prev, DensePtr* node) const;
 
+  // Deletes the expired objects of the chain and returns the number of objects left in it.
+  unsigned PurgeChain(ChainVectorIterator it);
+
   // Deletes the object pointed by ptr and removes it from the set.
   // If ptr is a link then it will be deleted internally.
   void Delete(DensePtr* prev, DensePtr* ptr);
@@ -424,8 +470,7 @@ inline void* DenseSet::FindInternal(const void* obj, uint64_t hashcode, uint32_t
   if (entries_.empty())
     return nullptr;
 
-  uint32_t bid = BucketId(hashcode);
-  DensePtr* ptr = const_cast<DenseSet*>(this)->Find(obj, bid, cookie).second;
+  DensePtr* ptr = const_cast<DenseSet*>(this)->Find(obj, hashcode, cookie).second;
   return ptr ? ptr->GetObject() : nullptr;
 }
 
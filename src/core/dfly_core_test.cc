@@ -182,6 +182,34 @@ TEST_F(StringMatchTest, Basic) {
   EXPECT_EQ(MatchLen("abc?", "abc\n", 0), 1);
 }
 
+TEST_F(StringMatchTest, LiteralKinds) {
+  // Strings longer than 16 bytes, which used to go through the regex engine.
+  const string key = "user:1000:profile:settings";
+
+  EXPECT_TRUE(MatchLen(key, key, 0));
+  EXPECT_FALSE(MatchLen(key, key + "x", 0));
+  EXPECT_TRUE(MatchLen("USER:1000:profile:settings", key, 1));
+
+  EXPECT_TRUE(MatchLen("user:*", key, 0));
+  EXPECT_FALSE(MatchLen("order:*", key, 0));
+  EXPECT_TRUE(MatchLen("USER:*", key, 1));
+  EXPECT_FALSE(MatchLen("USER:*", key, 0));
+
+  EXPECT_TRUE(MatchLen("*:settings", key, 0));
+  EXPECT_FALSE(MatchLen("*:setting", key, 0));
+
+  EXPECT_TRUE(MatchLen("*:profile:*", key, 0));
+  EXPECT_FALSE(MatchLen("*:profiles:*", key, 0));
+  EXPECT_TRUE(MatchLen("*:PROFILE:*", key, 1));
+
+  // Escaped wildcards are part of the literal.
+  EXPECT_TRUE(MatchLen("\\*prefix*", "*prefix-and-a-long-tail", 0));
+  EXPECT_FALSE(MatchLen("\\*prefix*", "xprefix-and-a-long-tail", 0));
+  EXPECT_TRUE(MatchLen("**", "x", 0));
+  EXPECT_FALSE(MatchLen("**", "", 0));
+  EXPECT_FALSE(MatchLen("a*", "", 0));
+}
+
 #define TEST_STRINGMATCH(pattern, str, case_res, nocase_res) \
   {                                                          \
     EXPECT_EQ(int(MatchLen(pattern, str, 0)), case_res);     \
@@ -0,0 +1,92 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/expire_wheel.h"
+
+namespace dfly {
+
+using namespace std;
+
+ExpireWheel::ExpireWheel(uint64_t now_ms) : now_sec_(now_ms / 1000) {
+}
+
+bool ExpireWheel::Add(uint64_t deadline_ms, uint64_t token) {
+  uint64_t sec = deadline_ms / 1000;
+  vector<uint64_t>* slot;
+
+  if (sec < now_sec_) {
+    due_.push_back(token);
+    return true;
+  }
+
+  if (sec < now_sec_ + kSlots) {
+    slot = &sec_[sec % kSlots];
+  } else if (uint64_t min = sec / 60; min < now_sec_ / 60 + kSlots) {
+    // sec >= now_sec_ + kSlots, hence min is never the current minute that was already drained.
+    slot = &min_[min % kSlots];
+  } else {
+    return false;
+  }
+
+  // Entries with close deadlines often share the same bucket.
+  if (slot->empty() || slot->back() != token) {
+    slot->push_back(token);
+    ++size_;
+  }
+  return true;
+}
+
+void ExpireWheel::Advance(uint64_t now_ms) {
+  uint64_t target = now_ms / 1000;
+
+  // If we fell far behind, everything in the wheel is due.
+  if (target >= now_sec_ + kSlots * 60) {
+    for (unsigned i = 0; i < kSlots; ++i) {
+      Drain(&sec_[i], &due_);
+      Drain(&min_[i], &due_coarse_);
+    }
+    now_sec_ = target;
+    return;
+  }
+
+  // A slot of the second level becomes due once its second has passed, while a slot of the
+  // minute level is drained when its minute starts.
+  while (now_sec_ < target) {
+    Drain(&sec_[now_sec_ % kSlots], &due_);
+    ++now_sec_;
+    if (now_sec_ % 60 == 0) {
+      Drain(&min_[(now_sec_ / 60) % kSlots], &due_coarse_);
+    }
+  }
+}
+
+size_t ExpireWheel::MemoryUsage() const {
+  size_t res = (due_.capacity() + due_coarse_.capacity()) * sizeof(uint64_t);
+  for (unsigned i = 0; i < kSlots; ++i) {
+    res += (sec_[i].capacity() + min_[i].capacity()) * sizeof(uint64_t);
+  }
+  return res;
+}
+
+void ExpireWheel::Clear() {
+  for (unsigned i = 0; i < kSlots; ++i) {
+    vector<uint64_t>{}.swap(sec_[i]);
+    vector<uint64_t>{}.swap(min_[i]);
+  }
+  vector<uint64_t>{}.swap(due_);
+  vector<uint64_t>{}.swap(due_coarse_);
+  size_ = 0;
+}
+
+void ExpireWheel::Drain(vector<uint64_t>* slot, vector<uint64_t>* dest) {
+  size_ -= slot->size();
+  if (dest->empty()) {
+    dest->swap(*slot);
+  } else {
+    dest->insert(dest->end(), slot->begin(), slot->end());
+  }
+  slot->clear();
+}
+
+}  // namespace dfly
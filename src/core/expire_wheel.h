@@ -0,0 +1,62 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace dfly {
+
+// Two level timing wheel of opaque 64-bit tokens keyed by their deadline. Used by active expiry
+// as a hint to which expire table buckets have due entries, so it does not need to scan the whole
+// table to find them. The first level has a resolution of a second and covers the next
+// kSlots seconds, the second level has a resolution of a minute and covers the next kSlots
+// minutes. Later deadlines are not tracked.
+class ExpireWheel {
+ public:
+  static constexpr unsigned kSlots = 64;
+
+  explicit ExpireWheel(uint64_t now_ms);
+
+  // Adds a token that becomes due at deadline_ms.
+  // Returns false if the deadline is beyond the horizon of the wheel.
+  bool Add(uint64_t deadline_ms, uint64_t token);
+
+  // Advances the wheel to now_ms and moves the tokens of all the passed slots to the due lists.
+  void Advance(uint64_t now_ms);
+
+  // Tokens of the second level that became due.
+  std::vector<uint64_t>& due() {
+    return due_;
+  }
+
+  // Tokens of the minute level that became current, i.e. they are due within the next minute.
+  // The caller should Add() again those of them that have not expired yet.
+  std::vector<uint64_t>& due_coarse() {
+    return due_coarse_;
+  }
+
+  // Number of tokens in the wheel, not including the due ones.
+  size_t size() const {
+    return size_;
+  }
+
+  size_t MemoryUsage() const;
+
+  void Clear();
+
+ private:
+  void Drain(std::vector<uint64_t>* slot, std::vector<uint64_t>* dest);
+
+  uint64_t now_sec_;  // the current second, i.e. all earlier ones were already advanced past.
+  size_t size_ = 0;
+
+  std::vector<uint64_t> sec_[kSlots];
+  std::vector<uint64_t> min_[kSlots];
+  std::vector<uint64_t> due_, due_coarse_;
+};
+
+}  // namespace dfly
@@ -0,0 +1,83 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/expire_wheel.h"
+
+#include <gmock/gmock.h>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+using testing::ElementsAre;
+using testing::IsEmpty;
+using testing::UnorderedElementsAre;
+
+class ExpireWheelTest : public ::testing::Test {
+ protected:
+  static constexpr uint64_t kStartMs = 3600000;  // a minute boundary.
+
+  ExpireWheel wheel_{kStartMs};
+};
+
+TEST_F(ExpireWheelTest, Seconds) {
+  EXPECT_TRUE(wheel_.Add(kStartMs + 500, 1));
+  EXPECT_TRUE(wheel_.Add(kStartMs + 1500, 2));
+  EXPECT_TRUE(wheel_.Add(kStartMs + 1700, 2));  // deduplicated
+  EXPECT_EQ(2u, wheel_.size());
+
+  wheel_.Advance(kStartMs + 999);
+  EXPECT_THAT(wheel_.due(), IsEmpty());
+
+  wheel_.Advance(kStartMs + 1000);
+  EXPECT_THAT(wheel_.due(), ElementsAre(1));
+
+  wheel_.due().clear();
+  wheel_.Advance(kStartMs + 5000);
+  EXPECT_THAT(wheel_.due(), ElementsAre(2));
+  EXPECT_EQ(0u, wheel_.size());
+
+  // Deadlines in the past are due immediately.
+  EXPECT_TRUE(wheel_.Add(kStartMs, 3));
+  EXPECT_THAT(wheel_.due(), ElementsAre(2, 3));
+}
+
+TEST_F(ExpireWheelTest, Minutes) {
+  constexpr uint64_t kMin = 60000;
+
+  EXPECT_TRUE(wheel_.Add(kStartMs + 10 * kMin, 1));
+  EXPECT_TRUE(wheel_.Add(kStartMs + 10 * kMin + 30000, 2));
+  EXPECT_FALSE(wheel_.Add(kStartMs + ExpireWheel::kSlots * kMin, 3));
+  EXPECT_EQ(2u, wheel_.size());
+
+  wheel_.Advance(kStartMs + 10 * kMin - 1);
+  EXPECT_THAT(wheel_.due_coarse(), IsEmpty());
+
+  // The minute starts, its tokens are handed out to be re-added with second precision.
+  wheel_.Advance(kStartMs + 10 * kMin + 50);
+  EXPECT_THAT(wheel_.due_coarse(), UnorderedElementsAre(1, 2));
+  EXPECT_THAT(wheel_.due(), IsEmpty());
+
+  EXPECT_TRUE(wheel_.Add(kStartMs + 10 * kMin + 30000, 2));
+  wheel_.Advance(kStartMs + 10 * kMin + 31000);
+  EXPECT_THAT(wheel_.due(), ElementsAre(2));
+}
+
+TEST_F(ExpireWheelTest, FarBehind) {
+  for (uint64_t i = 0; i < 1000; ++i) {
+    wheel_.Add(kStartMs + i * 3000, i);
+  }
+  EXPECT_GT(wheel_.MemoryUsage(), 0u);
+
+  wheel_.Advance(kStartMs + 24 * 3600 * 1000);
+  EXPECT_EQ(0u, wheel_.size());
+  EXPECT_EQ(1000u, wheel_.due().size() + wheel_.due_coarse().size());
+
+  wheel_.Clear();
+  EXPECT_THAT(wheel_.due(), IsEmpty());
+}
+
+}  // namespace dfly
@@ -0,0 +1,75 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/frequency_sketch.h"
+
+#include <absl/numeric/bits.h>
+
+#include <algorithm>
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+constexpr uint64_t kSeeds[] = {0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL,
+                               0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL};
+
+}  // namespace
+
+FrequencySketch::FrequencySketch(size_t num_counters) {
+  size_t row = absl::bit_ceil(max<size_t>(num_counters, 64));
+  row_mask_ = row - 1;
+  table_.resize(row * kDepth / 16);
+  sample_size_ = row * 10;
+}
+
+size_t FrequencySketch::CounterIndex(uint64_t hash, unsigned i) const {
+  uint64_t h = (hash ^ (hash >> 29)) * kSeeds[i];
+  h ^= h >> 32;
+  return i * (row_mask_ + 1) + (h & row_mask_);
+}
+
+void FrequencySketch::Increment(uint64_t hash) {
+  size_t counters[kDepth];
+  unsigned min_count = kMaxCount;
+  for (unsigned i = 0; i < kDepth; ++i) {
+    counters[i] = CounterIndex(hash, i);
+    min_count = min(min_count, Get(counters[i]));
+  }
+
+  if (min_count == kMaxCount)
+    return;
+
+  // Conservative update: increment only the counters that hold the minimum.
+  for (unsigned i = 0; i < kDepth; ++i) {
+    if (Get(counters[i]) == min_count) {
+      table_[counters[i] / 16] += 1ULL << ((counters[i] % 16) * 4);
+    }
+  }
+
+  if (++additions_ >= sample_size_) {
+    Reset();
+  }
+}
+
+unsigned FrequencySketch::Estimate(uint64_t hash) const {
+  unsigned res = kMaxCount;
+  for (unsigned i = 0; i < kDepth; ++i) {
+    res = min(res, Get(CounterIndex(hash, i)));
+  }
+  return res;
+}
+
+void FrequencySketch::Reset() {
+  constexpr uint64_t kHalfMask = 0x7777777777777777ULL;
+  for (uint64_t& word : table_) {
+    word = (word >> 1) & kHalfMask;
+  }
+  additions_ /= 2;
+  ++resets_;
+}
+
+}  // namespace dfly
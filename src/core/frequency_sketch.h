@@ -0,0 +1,57 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace dfly {
+
+// Approximate frequency of items, used as an LFU oracle by cache eviction.
+// A count-min sketch with 4 rows of 4-bit saturating counters packed into 64-bit words,
+// similarly to TinyLFU. To follow changes in popularity, all the counters are halved once
+// the number of increments reaches 10 times the number of counters of a row.
+class FrequencySketch {
+ public:
+  static constexpr unsigned kMaxCount = 15;
+
+  // num_counters is rounded up to a power of 2, it should be close to the number of hot items.
+  explicit FrequencySketch(size_t num_counters);
+
+  void Increment(uint64_t hash);
+
+  // Returns the estimated frequency of the item in range [0, kMaxCount].
+  unsigned Estimate(uint64_t hash) const;
+
+  size_t MemoryUsage() const {
+    return table_.capacity() * sizeof(uint64_t);
+  }
+
+  // Number of times the counters were halved.
+  uint64_t resets() const {
+    return resets_;
+  }
+
+ private:
+  static constexpr unsigned kDepth = 4;
+
+  // Returns the index of the 4-bit counter of row i within the table.
+  size_t CounterIndex(uint64_t hash, unsigned i) const;
+
+  unsigned Get(size_t counter) const {
+    return (table_[counter / 16] >> ((counter % 16) * 4)) & 0xF;
+  }
+
+  void Reset();
+
+  std::vector<uint64_t> table_;
+  size_t row_mask_;  // number of counters in a row minus 1.
+  size_t additions_ = 0;
+  size_t sample_size_;
+  uint64_t resets_ = 0;
+};
+
+}  // namespace dfly
@@ -0,0 +1,68 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/frequency_sketch.h"
+
+#include <absl/hash/hash.h>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+class FrequencySketchTest : public ::testing::Test {
+ protected:
+  static uint64_t Hash(uint64_t v) {
+    return absl::Hash<uint64_t>{}(v);
+  }
+
+  FrequencySketch sketch_{1024};
+};
+
+TEST_F(FrequencySketchTest, Basic) {
+  EXPECT_EQ(0u, sketch_.Estimate(Hash(1)));
+
+  for (unsigned i = 0; i < 5; ++i)
+    sketch_.Increment(Hash(1));
+  EXPECT_EQ(5u, sketch_.Estimate(Hash(1)));
+
+  for (unsigned i = 0; i < 100; ++i)
+    sketch_.Increment(Hash(1));
+  EXPECT_EQ(FrequencySketch::kMaxCount, sketch_.Estimate(Hash(1)));
+}
+
+TEST_F(FrequencySketchTest, Skew) {
+  // Hot keys are touched 10 times more than the cold ones.
+  for (unsigned round = 0; round < 10; ++round) {
+    for (uint64_t i = 0; i < 100; ++i)
+      sketch_.Increment(Hash(i));
+    if (round == 0) {
+      for (uint64_t i = 100; i < 1100; ++i)
+        sketch_.Increment(Hash(i));
+    }
+  }
+
+  unsigned hot_sum = 0, cold_sum = 0;
+  for (uint64_t i = 0; i < 100; ++i)
+    hot_sum += sketch_.Estimate(Hash(i));
+  for (uint64_t i = 100; i < 200; ++i)
+    cold_sum += sketch_.Estimate(Hash(i));
+  EXPECT_GT(hot_sum, cold_sum * 3);
+}
+
+TEST_F(FrequencySketchTest, Aging) {
+  for (unsigned i = 0; i < 10; ++i)
+    sketch_.Increment(Hash(1));
+
+  // Enough unrelated increments to trigger halving of the counters.
+  for (uint64_t i = 0; sketch_.resets() == 0; ++i)
+    sketch_.Increment(Hash(i + 1000));
+
+  EXPECT_LE(sketch_.Estimate(Hash(1)), 6u);
+  EXPECT_GT(sketch_.MemoryUsage(), 0u);
+}
+
+}  // namespace dfly
@@ -5,6 +5,8 @@
 #include "core/glob_matcher.h"
 
 #include <absl/strings/ascii.h>
+#include <absl/strings/match.h>
+#include <string.h>
 
 #include "base/logging.h"
 
@@ -226,8 +228,69 @@ string GlobMatcher::Glob2Regex(string_view glob) {
   return regex;
 }
 
+GlobMatcher::Kind GlobMatcher::Classify(string_view pattern, string* literal) {
+  size_t i = 0;
+  while (i < pattern.size() && pattern[i] == '*')
+    ++i;
+  bool leading_star = i > 0;
+
+  for (; i < pattern.size() && pattern[i] != '*'; ++i) {
+    char c = pattern[i];
+    if (c == '?' || c == '[')
+      return Kind::GENERAL;
+    if (c == '\\') {
+      if (i + 1 == pattern.size())  // a trailing backslash is matched verbatim by stringmatchlen
+        return Kind::GENERAL;
+      c = pattern[++i];
+    }
+    literal->push_back(c);
+  }
+
+  bool trailing_star = i < pattern.size();
+  for (; i < pattern.size(); ++i) {
+    if (pattern[i] != '*')
+      return Kind::GENERAL;
+  }
+
+  if (leading_star)
+    return trailing_star ? Kind::CONTAINS : Kind::SUFFIX;
+  return trailing_star ? Kind::PREFIX : Kind::EXACT;
+}
+
+bool GlobMatcher::MatchesLiteral(string_view str) const {
+  // Like stringmatchlen, an empty string matches only the empty pattern.
+  if (str.empty())
+    return glob_.empty();
+
+  switch (kind_) {
+    case Kind::EXACT:
+      return case_sensitive_ ? str == literal_ : absl::EqualsIgnoreCase(str, literal_);
+    case Kind::PREFIX:
+      return case_sensitive_ ? absl::StartsWith(str, literal_)
+                             : absl::StartsWithIgnoreCase(str, literal_);
+    case Kind::SUFFIX:
+      return case_sensitive_ ? absl::EndsWith(str, literal_)
+                             : absl::EndsWithIgnoreCase(str, literal_);
+    case Kind::CONTAINS:
+      // glibc memmem is vectorized, which is faster than matching ".*literal.*".
+      return literal_.empty() ||
+             memmem(str.data(), str.size(), literal_.data(), literal_.size()) != nullptr;
+    case Kind::GENERAL:
+      break;
+  }
+  return false;
+}
+
 GlobMatcher::GlobMatcher(string_view pattern, bool case_sensitive)
     : glob_(pattern), case_sensitive_(case_sensitive) {
+  kind_ = Classify(pattern, &literal_);
+
+  // Case insensitive search for a substring is left to the general matcher.
+  if (kind_ == Kind::CONTAINS && !case_sensitive && !literal_.empty())
+    kind_ = Kind::GENERAL;
+  if (kind_ != Kind::GENERAL)
+    return;
+
 #ifdef REFLEX_PERFORMANCE
   if (!pattern.empty()) {
     starts_with_star_ = pattern.front() == '*';
@@ -270,6 +333,9 @@ GlobMatcher::GlobMatcher(string_view pattern, bool case_sensitive)
 }
 
 bool GlobMatcher::Matches(std::string_view str) const {
+  if (kind_ != Kind::GENERAL)
+    return MatchesLiteral(str);
+
 #ifdef REFLEX_PERFORMANCE
   if (str.size() < 16) {
     return stringmatchlen(glob_.data(), glob_.size(), str.data(), str.size(), !case_sensitive_);
@@ -22,6 +22,11 @@
 
 namespace dfly {
 
+// Glob matching without any preprocessing of the pattern, GlobMatcher follows its semantics.
+// Unlike GlobMatcher, it has no state and can be used concurrently.
+int stringmatchlen(const char* pattern, int patternLen, const char* string, int stringLen,
+                   int nocase);
+
 class GlobMatcher {
   GlobMatcher(const GlobMatcher&) = delete;
   GlobMatcher& operator=(const GlobMatcher&) = delete;
@@ -35,7 +40,19 @@ class GlobMatcher {
   // Exposed for testing purposes.
   static std::string Glob2Regex(std::string_view glob);
 
+  // Patterns whose only wildcards are a leading and/or a trailing '*' are matched by searching
+  // for their literal part, without running the regex engine.
+  enum class Kind : uint8_t { EXACT, PREFIX, SUFFIX, CONTAINS, GENERAL };
+
+  // Returns the kind of the pattern and appends the unescaped literal part of the simple kinds.
+  static Kind Classify(std::string_view pattern, std::string* literal);
+
  private:
+  bool MatchesLiteral(std::string_view str) const;
+
+  Kind kind_ = Kind::GENERAL;
+  std::string literal_;  // unescaped literal part of the simple kinds
+
  // TODO: we fix the problem of stringmatchlen being much
  // faster when the result is immediately known to be false, for example: "a*" vs "bxxxxx".
  // The goal is to demonstrate on-par performance for the following case:
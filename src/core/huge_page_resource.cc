@@ -0,0 +1,163 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/huge_page_resource.h"
+
+#include <linux/mman.h>
+#include <sys/mman.h>
+
+#include <cstring>
+
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+constexpr size_t k2MB = 1ULL << 21;
+constexpr size_t k1GB = 1ULL << 30;
+
+// Maps size bytes aligned to 2MB so that the kernel can back them by transparent huge pages.
+char* MapTransparent(size_t size) {
+  void* ptr = mmap(nullptr, size + k2MB, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                   -1, 0);
+  if (ptr == MAP_FAILED)
+    return nullptr;
+
+  // Trim the unaligned head and tail.
+  uintptr_t start = reinterpret_cast<uintptr_t>(ptr);
+  uintptr_t aligned = (start + k2MB - 1) & ~(k2MB - 1);
+  if (aligned > start)
+    munmap(ptr, aligned - start);
+  size_t tail = k2MB - (aligned - start);
+  if (tail > 0)
+    munmap(reinterpret_cast<char*>(aligned + size), tail);
+
+  char* res = reinterpret_cast<char*>(aligned);
+  if (madvise(res, size, MADV_HUGEPAGE) != 0) {
+    LOG_FIRST_N(WARNING, 1) << "madvise(MADV_HUGEPAGE) failed: " << strerror(errno);
+  }
+  return res;
+}
+
+char* MapExplicit(size_t size, int page_flag) {
+  void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | page_flag, -1, 0);
+  return ptr == MAP_FAILED ? nullptr : reinterpret_cast<char*>(ptr);
+}
+
+}  // namespace
+
+HugePageResource::HugePageResource(Mode mode, PMR_NS::memory_resource* upstream)
+    : mode_(mode), upstream_(upstream) {
+}
+
+HugePageResource::~HugePageResource() {
+  // Tables may outlive the resource during the shutdown, in which case we leave the arenas
+  // mapped rather than invalidating their memory.
+  if (used_ > 0) {
+    VLOG(1) << "Leaving " << arenas_.size() << " arenas mapped, used " << used_;
+    return;
+  }
+
+  for (auto [ptr, size] : arenas_) {
+    munmap(ptr, size);
+  }
+}
+
+bool HugePageResource::ParseMode(string_view name, Mode* mode) {
+  if (name == "thp") {
+    *mode = Mode::kTransparent;
+  } else if (name == "2mb") {
+    *mode = Mode::kExplicit2MB;
+  } else if (name == "1gb") {
+    *mode = Mode::kExplicit1GB;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void HugePageResource::AddBlockSize(size_t size) {
+  if (FindPool(size, alignof(max_align_t)))
+    return;
+
+  size_t block_size = (size + kBlockAlign - 1) & ~(kBlockAlign - 1);
+  pools_.push_back(Pool{.size = size, .block_size = block_size});
+}
+
+auto HugePageResource::FindPool(size_t size, size_t align) -> Pool* {
+  if (align > kBlockAlign)
+    return nullptr;
+
+  for (auto& pool : pools_) {
+    if (pool.size == size)
+      return &pool;
+  }
+  return nullptr;
+}
+
+void* HugePageResource::do_allocate(size_t size, size_t align) {
+  Pool* pool = FindPool(size, align);
+  if (!pool)
+    return upstream_->allocate(size, align);
+
+  void* res = pool->free_list;
+  if (res) {
+    pool->free_list = *reinterpret_cast<void**>(res);
+  } else {
+    if (size_t(end_ - next_) < pool->block_size) {
+      NewArena();
+    }
+    res = next_;
+    next_ += pool->block_size;
+  }
+
+  used_ += pool->block_size;
+  return res;
+}
+
+void HugePageResource::do_deallocate(void* ptr, size_t size, size_t align) {
+  Pool* pool = FindPool(size, align);
+  if (!pool)
+    return upstream_->deallocate(ptr, size, align);
+
+  DCHECK_GE(used_, pool->block_size);
+  used_ -= pool->block_size;
+
+  *reinterpret_cast<void**>(ptr) = pool->free_list;
+  pool->free_list = ptr;
+}
+
+void HugePageResource::NewArena() {
+  size_t size = mode_ == Mode::kExplicit1GB ? k1GB : k2MB;
+  char* ptr = nullptr;
+
+  if (mode_ == Mode::kExplicit2MB) {
+    ptr = MapExplicit(size, MAP_HUGE_2MB);
+  } else if (mode_ == Mode::kExplicit1GB) {
+    ptr = MapExplicit(size, MAP_HUGE_1GB);
+  }
+
+  if (!ptr && mode_ != Mode::kTransparent) {
+    LOG_FIRST_N(WARNING, 1) << "Could not allocate explicit huge pages, check "
+                               "/proc/sys/vm/nr_hugepages. Falling back to transparent huge pages";
+  }
+
+  if (!ptr) {
+    ptr = MapTransparent(size);
+  }
+
+  if (!ptr)
+    throw bad_alloc{};
+
+  arenas_.emplace_back(ptr, size);
+  arena_bytes_ += size;
+  next_ = ptr;
+  end_ = ptr + size;
+}
+
+}  // namespace dfly
@@ -0,0 +1,80 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "base/pmr/memory_resource.h"
+
+namespace dfly {
+
+// Memory resource that serves blocks of the registered sizes (i.e. dash table segments)
+// from arenas backed by huge pages, and forwards all other allocations to the upstream resource.
+// Packing the segments densely into huge pages reduces the TLB pressure of table lookups.
+// Not thread safe, should be used by a single shard thread.
+class HugePageResource : public PMR_NS::memory_resource {
+ public:
+  enum class Mode : uint8_t {
+    kTransparent,  // regular pages with madvise(MADV_HUGEPAGE).
+    kExplicit2MB,  // 2MB pages reserved via hugetlbfs.
+    kExplicit1GB,  // 1GB pages reserved via hugetlbfs.
+  };
+
+  HugePageResource(Mode mode, PMR_NS::memory_resource* upstream);
+  ~HugePageResource();
+
+  // Parses "thp", "2mb" or "1gb" into mode. Returns false for unknown values.
+  static bool ParseMode(std::string_view name, Mode* mode);
+
+  // Allocations of exactly this size are served from the arenas.
+  // Must be called before any allocation of this size.
+  void AddBlockSize(size_t size);
+
+  // Bytes of the blocks handed out by the arenas.
+  size_t used() const {
+    return used_;
+  }
+
+  // Total bytes mapped by the arenas.
+  size_t arena_bytes() const {
+    return arena_bytes_;
+  }
+
+ private:
+  struct Pool {
+    size_t size;          // requested size.
+    size_t block_size;    // size rounded up to a cache line.
+    void* free_list = nullptr;
+  };
+
+  static constexpr size_t kBlockAlign = 64;
+
+  void* do_allocate(std::size_t size, std::size_t align) final;
+  void do_deallocate(void* ptr, std::size_t size, std::size_t align) final;
+
+  bool do_is_equal(const PMR_NS::memory_resource& o) const noexcept final {
+    return this == &o;
+  }
+
+  Pool* FindPool(size_t size, size_t align);
+
+  // Maps a new arena and makes it current. Throws bad_alloc on failure.
+  void NewArena();
+
+  Mode mode_;
+  PMR_NS::memory_resource* upstream_;
+  std::vector<Pool> pools_;
+  std::vector<std::pair<char*, size_t>> arenas_;
+
+  char* next_ = nullptr;  // next free byte of the current arena.
+  char* end_ = nullptr;   // end of the current arena.
+
+  size_t used_ = 0;
+  size_t arena_bytes_ = 0;
+};
+
+}  // namespace dfly
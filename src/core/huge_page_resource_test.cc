@@ -0,0 +1,94 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/huge_page_resource.h"
+
+#include <cstring>
+#include <fstream>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+class HugePageResourceTest : public ::testing::Test {
+ protected:
+  static constexpr size_t k2MB = 1ULL << 21;
+  static constexpr size_t kBlockSize = 1000;  // rounded up to 1024 by the resource.
+
+  // Number of free 1GB huge pages reserved in the system, 0 if they are not supported.
+  static size_t Free1GBPages() {
+    ifstream file("/sys/kernel/mm/hugepages/hugepages-1048576kB/free_hugepages");
+    size_t res = 0;
+    file >> res;
+    return res;
+  }
+
+  HugePageResource resource_{HugePageResource::Mode::kTransparent,
+                             PMR_NS::get_default_resource()};
+};
+
+TEST_F(HugePageResourceTest, ParseMode) {
+  HugePageResource::Mode mode;
+  ASSERT_TRUE(HugePageResource::ParseMode("2mb", &mode));
+  EXPECT_EQ(HugePageResource::Mode::kExplicit2MB, mode);
+  ASSERT_TRUE(HugePageResource::ParseMode("1gb", &mode));
+  EXPECT_EQ(HugePageResource::Mode::kExplicit1GB, mode);
+  ASSERT_TRUE(HugePageResource::ParseMode("thp", &mode));
+  EXPECT_EQ(HugePageResource::Mode::kTransparent, mode);
+  EXPECT_FALSE(HugePageResource::ParseMode("4kb", &mode));
+}
+
+TEST_F(HugePageResourceTest, AllocateDeallocate) {
+  resource_.AddBlockSize(kBlockSize);
+
+  void* ptr = resource_.allocate(kBlockSize, 8);
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(ptr) % 64);
+  EXPECT_EQ(1024u, resource_.used());
+  EXPECT_EQ(k2MB, resource_.arena_bytes());
+  memset(ptr, 0xAB, kBlockSize);
+
+  // Freed blocks are reused before the arena is extended.
+  resource_.deallocate(ptr, kBlockSize, 8);
+  EXPECT_EQ(0u, resource_.used());
+  EXPECT_EQ(ptr, resource_.allocate(kBlockSize, 8));
+  resource_.deallocate(ptr, kBlockSize, 8);
+
+  // Other sizes are served by the upstream resource.
+  void* other = resource_.allocate(kBlockSize + 1, 8);
+  EXPECT_EQ(0u, resource_.used());
+  resource_.deallocate(other, kBlockSize + 1, 8);
+
+  // A new arena is mapped once the current one is exhausted.
+  vector<void*> blocks(k2MB / 1024 + 1);
+  for (auto& block : blocks)
+    block = resource_.allocate(kBlockSize, 8);
+  EXPECT_EQ(2 * k2MB, resource_.arena_bytes());
+  EXPECT_EQ(blocks.size() * 1024, resource_.used());
+
+  for (void* block : blocks)
+    resource_.deallocate(block, kBlockSize, 8);
+  EXPECT_EQ(0u, resource_.used());
+}
+
+TEST_F(HugePageResourceTest, ExplicitFallback) {
+  if (Free1GBPages() > 0)
+    GTEST_SKIP() << "1GB huge pages are reserved, the fallback is not taken";
+
+  HugePageResource resource{HugePageResource::Mode::kExplicit1GB, PMR_NS::get_default_resource()};
+  resource.AddBlockSize(kBlockSize);
+
+  // Without reserved pages the arena is mapped with transparent huge pages.
+  void* ptr = resource.allocate(kBlockSize, 8);
+  ASSERT_NE(nullptr, ptr);
+  memset(ptr, 0xAB, kBlockSize);
+  EXPECT_EQ(k2MB, resource.arena_bytes());
+
+  resource.deallocate(ptr, kBlockSize, 8);
+  EXPECT_EQ(0u, resource.used());
+}
+
+}  // namespace dfly
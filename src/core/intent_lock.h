@@ -34,6 +34,11 @@ class IntentLock {
     return (m == SHARED) ? true : cnt_[SHARED] == 0;
   }
 
+  // Returns true if a single holder with mode `m` has no other intents conflicting with it.
+  bool IsGranted(Mode m) const {
+    return m == SHARED ? cnt_[EXCLUSIVE] == 0 : (cnt_[EXCLUSIVE] == 1 && cnt_[SHARED] == 0);
+  }
+
   // Returns true if this lock would block transactions from running unless they are at the head
   // of the transaction queue (first ones)
   bool IsContended() const {
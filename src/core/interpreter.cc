@@ -60,6 +60,10 @@ ABSL_FLAG(uint64_t, lua_mem_gc_threshold, 10000000,
           "Specifies Lua interpreter's per thread memory limit in bytes after which the GC will be "
           "called forcefully.");
 
+ABSL_FLAG(uint64_t, lua_script_memory_limit, 0,
+          "Maximum memory in bytes a script may grow its interpreter by, after collecting its "
+          "garbage. Scripts above it fail. 0 means no limit.");
+
 static bool AbslParseFlag(std::string_view in, LuaGcFlag* flag, std::string* err) {
   if (in.empty()) {
     *flag = LuaGcFlag{};
@@ -560,23 +564,25 @@ int RedisLogCommand(lua_State* lua) {
   return 0;
 }
 
-// See https://www.lua.org/manual/5.3/manual.html#lua_Alloc
-void* mimalloc_glue(void* ud, void* ptr, size_t osize, size_t nsize) {
-  (void)ud;
-  if (nsize == 0) {
-    InterpreterManager::tl_stats().used_bytes -= mi_usable_size(ptr);
-    mi_free_size(ptr, osize);
-    return nullptr;
-  } else if (ptr == nullptr) {
-    ptr = mi_malloc(nsize);
-    InterpreterManager::tl_stats().used_bytes += mi_usable_size(ptr);
-    return ptr;
-  } else {
-    InterpreterManager::tl_stats().used_bytes -= mi_usable_size(ptr);
-    ptr = mi_realloc(ptr, nsize);
-    InterpreterManager::tl_stats().used_bytes += mi_usable_size(ptr);
-    return ptr;
+int BytecodeWriter(lua_State* lua, const void* p, size_t sz, void* ud) {
+  static_cast<string*>(ud)->append(static_cast<const char*>(p), sz);
+  return 0;
+}
+
+// Runs the chunk loaded with status `res` that defines a script function.
+bool RunFunctionDefinition(lua_State* lua, int res, string* error) {
+  if (res == 0) {
+    res = lua_pcall(lua, 0, 0, 0);  // run func definition code
   }
+
+  if (res) {
+    error->assign(lua_tostring(lua, -1));
+    lua_pop(lua, 1);  // Remove the error.
+
+    return false;
+  }
+
+  return true;
 }
 
 }  // namespace
@@ -584,7 +590,7 @@ void* mimalloc_glue(void* ud, void* ptr, size_t osize, size_t nsize) {
 Interpreter::Interpreter() {
   InterpreterManager::tl_stats().interpreter_cnt++;
 
-  lua_ = lua_newstate(mimalloc_glue, nullptr);
+  lua_ = lua_newstate(LuaAlloc, this);
   InitLua(lua_);
   void** ptr = static_cast<void**>(lua_getextraspace(lua_));
   *ptr = this;
@@ -674,7 +680,8 @@ void Interpreter::FuncSha1(string_view body, char* fp) {
   ToHex(digest, fp);
 }
 
-auto Interpreter::AddFunction(string_view sha, string_view body, string* result) -> AddResult {
+auto Interpreter::AddFunction(string_view sha, string_view body, string* result,
+                              string* bytecode) -> AddResult {
   char funcname[43];
   funcname[0] = 'f';
   funcname[1] = '_';
@@ -685,12 +692,22 @@ auto Interpreter::AddFunction(string_view sha, string_view body, string* result)
   int type = lua_getglobal(lua_, funcname);
   lua_pop(lua_, 1);
 
-  if (type == LUA_TNIL && !AddInternal(funcname, body, result))
+  if (type == LUA_TNIL && !AddInternal(funcname, body, result, bytecode))
     return COMPILE_ERR;
 
   return type == LUA_TNIL ? ADD_OK : ALREADY_EXISTS;
 }
 
+auto Interpreter::AddFunctionBytecode(string_view sha, string_view bytecode, string* error)
+    -> AddResult {
+  if (Exists(sha))
+    return ALREADY_EXISTS;
+
+  // Only bytecode produced by AddFunction is accepted, never user input.
+  int res = luaL_loadbufferx(lua_, bytecode.data(), bytecode.size(), "@user_script", "b");
+  return RunFunctionDefinition(lua_, res, error) ? ADD_OK : COMPILE_ERR;
+}
+
 bool Interpreter::Exists(string_view sha) const {
   DCHECK(lua_);
 
@@ -730,10 +747,21 @@ auto Interpreter::RunFunction(string_view sha, std::string* error) -> RunResult
 
   // At this point lua stack has 2 globals.
 
+  // The limit is checked by a count hook because hooks only run between Lua instructions, where
+  // raising an error is safe. Failing allocations would unwind our C++ callbacks with longjmp.
+  const uint64_t mem_limit = absl::GetFlag(FLAGS_lua_script_memory_limit);
+  if (mem_limit) {
+    script_mem_limit_ = used_bytes_ + mem_limit;
+    lua_sethook(lua_, MemoryLimitHook, LUA_MASKCOUNT, kMemoryCheckInterval);
+  }
+
   /* We have zero arguments and expect
    * a single return value. */
   int err = lua_pcall(lua_, 0, 1, -2);
 
+  if (mem_limit)
+    lua_sethook(lua_, nullptr, 0, 0);
+
   if (err) {
     *error = lua_tostring(lua_, -1);
   }
@@ -829,23 +857,18 @@ bool Interpreter::IsResultSafe() const {
   return res;
 }
 
-bool Interpreter::AddInternal(const char* f_id, string_view body, string* error) {
+bool Interpreter::AddInternal(const char* f_id, string_view body, string* error,
+                              string* bytecode) {
   string script = absl::StrCat("function ", f_id, "() \n");
   absl::StrAppend(&script, body, "\nend");
 
   int res = luaL_loadbuffer(lua_, script.data(), script.size(), "@user_script");
-  if (res == 0) {
-    res = lua_pcall(lua_, 0, 0, 0);  // run func definition code
+  if (res == 0 && bytecode) {
+    bytecode->clear();
+    lua_dump(lua_, BytecodeWriter, bytecode, 0);
   }
 
-  if (res) {
-    error->assign(lua_tostring(lua_, -1));
-    lua_pop(lua_, 1);  // Remove the error.
-
-    return false;
-  }
-
-  return true;
+  return RunFunctionDefinition(lua_, res, error);
 }
 
 // Stack is cleaned for us, we can leave it dirty
@@ -1174,6 +1197,41 @@ int Interpreter::RedisAPCallCommand(lua_State* lua) {
   return reinterpret_cast<Interpreter*>(*ptr)->RedisGenericCommand(false, true);
 }
 
+// See https://www.lua.org/manual/5.4/manual.html#lua_Alloc
+void* Interpreter::LuaAlloc(void* ud, void* ptr, size_t osize, size_t nsize) {
+  auto* self = static_cast<Interpreter*>(ud);
+  auto& stats = InterpreterManager::tl_stats();
+  size_t old_usable = ptr ? mi_usable_size(ptr) : 0;
+
+  if (nsize == 0) {
+    stats.used_bytes -= old_usable;
+    self->used_bytes_ -= old_usable;
+    mi_free_size(ptr, osize);
+    return nullptr;
+  }
+
+  ptr = ptr ? mi_realloc(ptr, nsize) : mi_malloc(nsize);
+  if (ptr) {
+    size_t new_usable = mi_usable_size(ptr);
+    stats.used_bytes += new_usable - old_usable;
+    self->used_bytes_ += new_usable - old_usable;
+  }
+  return ptr;
+}
+
+void Interpreter::MemoryLimitHook(lua_State* lua, lua_Debug* ar) {
+  void** ptr = static_cast<void**>(lua_getextraspace(lua));
+  auto* self = reinterpret_cast<Interpreter*>(*ptr);
+  if (self->used_bytes_ <= self->script_mem_limit_)
+    return;
+
+  lua_gc(lua, LUA_GCCOLLECT);
+  if (self->used_bytes_ > self->script_mem_limit_) {
+    ++InterpreterManager::tl_stats().script_mem_limit_errors;
+    luaL_error(lua, "script exceeded lua_script_memory_limit");
+  }
+}
+
 InterpreterManager::Stats& InterpreterManager::Stats::operator+=(const Stats& other) {
   this->used_bytes += other.used_bytes;
   this->interpreter_cnt += other.interpreter_cnt;
@@ -1183,6 +1241,7 @@ InterpreterManager::Stats& InterpreterManager::Stats::operator+=(const Stats& ot
   this->gc_duration_ns += other.gc_duration_ns;
   this->interpreter_return += other.interpreter_return;
   this->gc_freed_memory += other.gc_freed_memory;
+  this->script_mem_limit_errors += other.script_mem_limit_errors;
 
   return *this;
 }
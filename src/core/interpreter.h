@@ -14,6 +14,7 @@
 #include "util/fibers/synchronization.h"
 
 typedef struct lua_State lua_State;
+typedef struct lua_Debug lua_Debug;
 
 namespace dfly {
 
@@ -86,8 +87,14 @@ class Interpreter {
     COMPILE_ERR = 2,
   };
 
-  // Add function with sha and body to interpreter.
-  AddResult AddFunction(std::string_view sha, std::string_view body, std::string* error);
+  // Add function with sha and body to interpreter. If `bytecode` is set, it is filled with the
+  // compiled definition of the function, which can be passed to AddFunctionBytecode.
+  AddResult AddFunction(std::string_view sha, std::string_view body, std::string* error,
+                        std::string* bytecode = nullptr);
+
+  // Add function from bytecode produced by AddFunction, skipping the parsing of its body.
+  AddResult AddFunctionBytecode(std::string_view sha, std::string_view bytecode,
+                                std::string* error);
 
   bool Exists(std::string_view sha) const;
 
@@ -135,7 +142,8 @@ class Interpreter {
  private:
   // Returns true if function was successfully added,
   // otherwise returns false and sets the error.
-  bool AddInternal(const char* f_id, std::string_view body, std::string* error);
+  bool AddInternal(const char* f_id, std::string_view body, std::string* error,
+                   std::string* bytecode);
   bool IsTableSafe() const;
 
   static int RedisCallCommand(lua_State* lua);
@@ -146,7 +154,18 @@ class Interpreter {
   std::optional<absl::FixedArray<std::string_view, 4>> PrepareArgs();
   bool CallRedisFunction(bool raise_error, bool async, ObjectExplorer* explorer, SliceSpan args);
 
+  // Allocates from mimalloc and accounts the memory of this interpreter and of the thread.
+  static void* LuaAlloc(void* ud, void* ptr, size_t osize, size_t nsize);
+
+  // Fails the running script if it grew the interpreter above script_mem_limit_.
+  static void MemoryLimitHook(lua_State* lua, lua_Debug* ar);
+
+  // Number of Lua instructions between the checks of MemoryLimitHook.
+  static constexpr int kMemoryCheckInterval = 1000;
+
   lua_State* lua_;
+  size_t used_bytes_ = 0;
+  size_t script_mem_limit_ = 0;  // used_bytes_ allowed for the running script
   unsigned cmd_depth_ = 0;
   RedisFunc redis_func_;
   std::string buffer_;
@@ -167,6 +186,7 @@ class InterpreterManager {
     uint64_t gc_duration_ns = 0;
     uint64_t interpreter_return = 0;
     int64_t gc_freed_memory = 0;
+    uint64_t script_mem_limit_errors = 0;
   };
 
  public:
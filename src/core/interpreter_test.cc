@@ -9,6 +9,9 @@ extern "C" {
 #include <lua.h>
 }
 
+#include <absl/flags/declare.h>
+#include <absl/flags/flag.h>
+#include <absl/flags/reflection.h>
 #include <absl/strings/str_cat.h>
 #include <absl/strings/str_replace.h>
 #include <gmock/gmock.h>
@@ -16,6 +19,8 @@ extern "C" {
 #include "base/gtest.h"
 #include "base/logging.h"
 
+ABSL_DECLARE_FLAG(uint64_t, lua_script_memory_limit);
+
 namespace dfly {
 using namespace std;
 
@@ -237,6 +242,32 @@ TEST_F(InterpreterTest, Add) {
   EXPECT_TRUE(intptr_.Exists(sha1));
 }
 
+TEST_F(InterpreterTest, AddBytecode) {
+  const char* script = "return ARGV[1] .. 'bar'";
+  char sha_buf[64];
+  Interpreter::FuncSha1(script, sha_buf);
+  string_view sha{sha_buf, std::strlen(sha_buf)};
+
+  string err, bytecode;
+  EXPECT_EQ(Interpreter::ADD_OK, intptr_.AddFunction(sha, script, &err, &bytecode));
+  EXPECT_FALSE(bytecode.empty());
+
+  Interpreter other;
+  EXPECT_EQ(Interpreter::ADD_OK, other.AddFunctionBytecode(sha, bytecode, &err));
+  EXPECT_EQ(Interpreter::ALREADY_EXISTS, other.AddFunctionBytecode(sha, bytecode, &err));
+  EXPECT_EQ(0, lua_gettop(other.lua()));
+
+  vector<string_view> args{"foo"};
+  other.SetGlobalArray("ARGV", SliceSpan{args});
+  ASSERT_EQ(Interpreter::RUN_OK, other.RunFunction(sha, &err)) << err;
+  other.SerializeResult(&ser_);
+  EXPECT_EQ("str(foobar) ", ser_.res);
+
+  // Text chunks are rejected.
+  EXPECT_EQ(Interpreter::COMPILE_ERR,
+            other.AddFunctionBytecode(string(40, 'a'), "return 1", &err));
+}
+
 // Test cases taken from scripting.tcl
 TEST_F(InterpreterTest, Execute) {
   ASSERT_TRUE(Execute("return 42"));
@@ -517,6 +548,35 @@ end
   EXPECT_EQ("i(1)", ser_.res);
 }
 
+TEST_F(InterpreterTest, ScriptMemoryLimit) {
+  absl::FlagSaver saver;
+  absl::SetFlag(&FLAGS_lua_script_memory_limit, 1 << 20);
+
+  // Garbage is collected before the limit is enforced.
+  EXPECT_TRUE(Execute(R"(
+for i = 1, 100000 do
+  local t = {i, i + 1, i + 2}
+end
+return 1
+)")) << error_;
+
+  EXPECT_FALSE(Execute(R"(
+local t = {}
+for i = 1, 1000000 do
+  t[i] = {i}
+end
+return #t
+)"));
+  EXPECT_THAT(error_, testing::HasSubstr("script exceeded lua_script_memory_limit"));
+  EXPECT_EQ(InterpreterManager::tl_stats().script_mem_limit_errors, 1u);
+
+  // The memory of the failed script is reclaimed by the next collection.
+  intptr_.ResetStack();
+  intptr_.RunGC();
+  EXPECT_TRUE(Execute("local t = {} for i = 1, 1000 do t[i] = {i} end return #t")) << error_;
+  EXPECT_EQ("i(1000)", ser_.res);
+}
+
 TEST_F(InterpreterTest, AvoidIntOverflow) {
   EXPECT_TRUE(Execute("return bit.tohex(65535, -2147483648)"));
   EXPECT_EQ("str(0000FFFF)", ser_.res);
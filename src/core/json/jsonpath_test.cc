@@ -517,6 +517,50 @@ TYPED_TEST(JsonPathTest, Mutate) {
   }
 }
 
+TYPED_TEST(JsonPathTest, MutateInPlace) {
+  if (!std::is_same_v<TypeParam, FlatJson>)
+    GTEST_SKIP() << "Only flat json documents are mutated in place";
+
+  FlatJson json = ValidJson<FlatJson>(R"({"a":1,"b":true,"c":"abc","f":1.5,"arr":[1,2]})");
+  auto mutate = [&](string_view path_str, auto cb) {
+    auto path = ParsePath(path_str);
+    CHECK(path) << path.error();
+    return MutatePathInPlace(*path, cb, json);
+  };
+  auto set_to = [](JsonType new_val) {
+    return [new_val](optional<string_view>, JsonType* val) { *val = new_val; };
+  };
+
+  EXPECT_EQ(1, mutate("$.a", [](optional<string_view> key, JsonType* val) {
+              EXPECT_EQ("a", key);
+              *val = val->as<int>() + 1;
+            }));
+  EXPECT_EQ(1, mutate("$.b", set_to(JsonType(false))));
+  EXPECT_EQ(1, mutate("$.c", set_to(JsonType("xyz"))));
+  EXPECT_EQ(1, mutate("$.f", set_to(JsonType(2.5))));
+  EXPECT_EQ(2, mutate("$.arr[*]", set_to(JsonType(7))));
+
+  JsonType expected = ValidJson<JsonType>(R"({"a":2,"b":false,"c":"xyz","f":2.5,"arr":[7,7]})");
+  EXPECT_EQ(expected, FromFlat(json));
+
+  // None of these fit into the buffer.
+  EXPECT_FALSE(mutate("$.a", set_to(JsonType(int64_t(1) << 40))));
+  EXPECT_FALSE(mutate("$.a", set_to(JsonType(2.5))));
+  EXPECT_FALSE(mutate("$.c", set_to(JsonType("abcd"))));
+  EXPECT_FALSE(mutate("$.f", set_to(JsonType(1.1))));
+  EXPECT_FALSE(mutate("$.b", set_to(JsonType::null())));
+  unsigned calls = 0;
+  EXPECT_FALSE(mutate("$.*", [&](optional<string_view>, JsonType*) { ++calls; }));
+  EXPECT_EQ(0u, calls);
+
+  // The first element is rolled back when the second does not fit.
+  EXPECT_FALSE(mutate("$.arr[*]", [&](optional<string_view>, JsonType* val) {
+    *val = calls++ == 0 ? JsonType(8) : JsonType(int64_t(1) << 40);
+  }));
+  EXPECT_EQ(2u, calls);
+  EXPECT_EQ(expected, FromFlat(json));
+}
+
 TYPED_TEST(JsonPathTest, MutateRecursiveDescentKey) {
   ASSERT_EQ(0, this->Parse("$..value"));
   Path path = this->driver_.TakePath();
@@ -312,6 +312,82 @@ unsigned MutatePath(const Path& path, MutateCallback callback, FlatJson json,
   return res;
 }
 
+bool MutateFlatScalar(const JsonType& src, FlatJson dest) {
+  if (src.is_bool())
+    return dest.IsBool() && dest.MutateBool(src.as_bool());
+
+  if (src.is_int64())
+    return dest.IsInt() && dest.MutateInt(src.as<int64_t>());
+
+  if (src.is_double()) {
+    if (!dest.IsFloat())
+      return false;
+
+    double val = src.as_double(), prev = dest.AsDouble();
+    if (!dest.MutateFloat(val))
+      return false;
+
+    // Narrow floats accept any double and silently drop its precision.
+    if (dest.AsDouble() == val)
+      return true;
+    dest.MutateFloat(prev);
+    return false;
+  }
+
+  if (src.is_string()) {
+    string_view sv = src.as_string_view();
+    return dest.IsString() && dest.MutateString(sv.data(), sv.size());
+  }
+
+  return false;
+}
+
+optional<unsigned> MutatePathInPlace(const Path& path, MutateCallback callback, FlatJson json) {
+  // Aggregations produce values that do not live in the buffer.
+  if (!path.empty() && path.front().type() == SegmentType::FUNCTION)
+    return nullopt;
+
+  struct Match {
+    optional<string> key;
+    FlatJson ref;
+    JsonType prev, next;
+  };
+
+  // Collect all the matches first so that nothing is changed if one of them is not a scalar.
+  vector<Match> matches;
+  bool all_scalars = true;
+  EvaluatePath(path, json, [&](optional<string_view> key, FlatJson val) {
+    all_scalars &= val.IsBool() || val.IsInt() || val.IsFloat() || val.IsString();
+    if (all_scalars)
+      matches.push_back({key ? optional<string>{*key} : nullopt, val, {}, {}});
+  });
+
+  if (!all_scalars)
+    return nullopt;
+
+  for (Match& match : matches) {
+    match.prev = FromFlat(match.ref);
+    match.next = match.prev;
+    optional<string_view> key;
+    if (match.key)
+      key = *match.key;
+    callback(key, &match.next);
+  }
+
+  for (size_t i = 0; i < matches.size(); ++i) {
+    if (MutateFlatScalar(matches[i].next, matches[i].ref))
+      continue;
+
+    // Roll back the values written so far, they fit into their slots by definition.
+    while (i-- > 0) {
+      CHECK(MutateFlatScalar(matches[i].prev, matches[i].ref));
+    }
+    return nullopt;
+  }
+
+  return matches.size();
+}
+
 unsigned DeletePath(const Path& path, FlatJson json, flexbuffers::Builder* fbb) {
   JsonType mut_json = FromFlat(json);
   unsigned res = DeletePath(path, &mut_json);
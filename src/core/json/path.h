@@ -138,6 +138,19 @@ unsigned MutatePath(const Path& path, MutateCallback callback, JsonType* json);
 unsigned MutatePath(const Path& path, MutateCallback callback, FlatJson json,
                     flexbuffers::Builder* fbb);
 
+// Writes the scalar `src` over the flat scalar `dest` directly inside its buffer. Returns false
+// and leaves `dest` unchanged if the types differ or `src` does not fit into the encoding of
+// `dest`, for example a wider integer or a string of a different length.
+bool MutateFlatScalar(const JsonType& src, FlatJson dest);
+
+// In-place variant of MutatePath for flat json. The callback is applied to a JsonType copy of
+// every match and the result is written back into the buffer of `json`.
+// Returns the number of matches, or nullopt if some match is not a scalar or its new value does
+// not fit into the buffer. `json` is left unchanged in that case, though the callback may have
+// been called already, so the caller must discard its results before falling back to MutatePath.
+std::optional<unsigned> MutatePathInPlace(const Path& path, MutateCallback callback,
+                                          FlatJson json);
+
 // Simplified deletion operation without callback - more efficient for JSON.DEL operations
 unsigned DeletePath(const Path& path, JsonType* json);
 unsigned DeletePath(const Path& path, FlatJson json, flexbuffers::Builder* fbb);
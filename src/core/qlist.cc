@@ -12,12 +12,20 @@ extern "C" {
 
 #include <absl/base/macros.h>
 #include <absl/base/optimization.h>
+#include <absl/flags/flag.h>
 #include <absl/strings/escaping.h>
 #include <absl/strings/str_cat.h>
 #include <lz4frame.h>
 
+#include <algorithm>
+#include <deque>
+
 #include "base/logging.h"
 
+ABSL_FLAG(uint32_t, list_index_min_nodes, 128,
+          "Lists with at least this many nodes keep an index of node offsets so that access by "
+          "index takes logarithmic time. 0 disables the index.");
+
 using namespace std;
 
 /* Maximum size in bytes of any multi-element listpack.
@@ -64,7 +72,7 @@ namespace dfly {
 
 namespace {
 
-static_assert(sizeof(QList) == 32);
+static_assert(sizeof(QList) == 48);
 static_assert(sizeof(QList::Node) == 40);
 
 enum IterDir : uint8_t { FWD = 1, REV = 0 };
@@ -143,7 +151,9 @@ QList::Node* CreateRAW(int container, uint8_t* entry, size_t sz) {
   node->encoding = QUICKLIST_NODE_ENCODING_RAW;
   node->container = container;
   node->recompress = 0;
+  node->attempted_compress = 0;
   node->dont_compress = 0;
+  node->accessed = 1;
   return node;
 }
 
@@ -179,6 +189,7 @@ QList::Node* CreateFromSV(int container, string_view value) {
 // Returns the relative increase in size.
 inline ssize_t NodeSetEntry(QList::Node* node, uint8_t* entry) {
   node->entry = entry;
+  node->accessed = 1;
   size_t new_sz = lpBytes(node->entry);
   ssize_t diff = new_sz - node->sz;
   node->sz = new_sz;
@@ -296,6 +307,7 @@ bool DecompressNode(bool recompress, QList::Node* node) {
          node->encoding == QLIST_NODE_ENCODING_LZ4);
 
   node->recompress = int(recompress);
+  node->accessed = 1;
 
   void* decompressed = zmalloc(node->sz);
   quicklistLZF* lzf = GetLzf(node);
@@ -379,13 +391,21 @@ QList::Node* SplitNode(QList::Node* node, int offset, bool after, ssize_t* diff)
 
 }  // namespace
 
+// Nodes in list order together with the position of their first entry. Positions are stored
+// relative to base, so pushing or popping at the head shifts all of them at once.
+struct QList::NodeIndex {
+  deque<pair<Node*, int64_t>> nodes;
+  int64_t base = 0;
+};
+
 __thread QList::Stats QList::stats;
 
 void QList::SetPackedThreshold(unsigned threshold) {
   packed_threshold = threshold;
 }
 
-QList::QList(int fill, int compress) : fill_(fill), compress_(compress), bookmark_count_(0) {
+QList::QList(int fill, int compress)
+    : fill_(fill), compress_(compress), bookmark_count_(0), lazy_compress_(0) {
   compr_method_ = 0;
 }
 
@@ -395,7 +415,14 @@ QList::QList(QList&& other)
       len_(other.len_),
       fill_(other.fill_),
       compress_(other.compress_),
-      bookmark_count_(other.bookmark_count_) {
+      bookmark_count_(other.bookmark_count_),
+      lazy_compress_(other.lazy_compress_),
+      cold_cursor_(other.cold_cursor_),
+      defrag_cursor_(other.defrag_cursor_),
+      index_(std::move(other.index_)) {
+  compr_method_ = other.compr_method_;
+  other.cold_cursor_ = nullptr;
+  other.defrag_cursor_ = nullptr;
   other.head_ = nullptr;
   other.len_ = other.count_ = 0;
 }
@@ -413,7 +440,14 @@ QList& QList::operator=(QList&& other) {
     fill_ = other.fill_;
     compress_ = other.compress_;
     bookmark_count_ = other.bookmark_count_;
-
+    compr_method_ = other.compr_method_;
+    lazy_compress_ = other.lazy_compress_;
+    cold_cursor_ = other.cold_cursor_;
+    defrag_cursor_ = other.defrag_cursor_;
+    index_ = std::move(other.index_);
+
+    other.cold_cursor_ = nullptr;
+    other.defrag_cursor_ = nullptr;
     other.head_ = nullptr;
     other.len_ = other.count_ = 0;
   }
@@ -439,6 +473,9 @@ void QList::Clear() {
   head_ = nullptr;
   count_ = 0;
   malloc_size_ = 0;
+  cold_cursor_ = nullptr;
+  defrag_cursor_ = nullptr;
+  index_.reset();
 }
 
 void QList::Push(string_view value, Where where) {
@@ -459,7 +496,8 @@ void QList::Push(string_view value, Where where) {
 
   size_t sz = value.size();
   if (ABSL_PREDICT_FALSE(IsLargeElement(sz, fill_))) {
-    InsertPlainNode(orig, value, opt);
+    Node* node = InsertPlainNode(orig, value, opt);
+    IndexPush(node, where);
     return;
   }
 
@@ -473,12 +511,14 @@ void QList::Push(string_view value, Where where) {
       DCHECK_EQ(malloc_size_, orig->sz);
     }
     DCHECK(head_->prev->next == nullptr);
+    IndexPush(nullptr, where);
     return;
   }
 
   Node* node = CreateFromSV(QUICKLIST_NODE_CONTAINER_PACKED, value);
   InsertNode(orig, node, opt);
   DCHECK(head_->prev->next == nullptr);
+  IndexPush(node, where);
 }
 
 string QList::Pop(Where where) {
@@ -493,6 +533,7 @@ string QList::Pop(Where where) {
   DCHECK(head_->prev->next == nullptr);
 
   string res;
+  bool node_deleted = true;
   if (ABSL_PREDICT_FALSE(QL_NODE_IS_PLAIN(node))) {
     // TODO: We could avoid this copy by returning the pointer of the plain node.
     // But the higher level APIs should support this.
@@ -508,8 +549,9 @@ string QList::Pop(Where where) {
     } else {
       res = absl::StrCat(vlong);
     }
-    DelPackedIndex(node, pos);
+    node_deleted = DelPackedIndex(node, pos);
   }
+  IndexPop(node_deleted, where);
   DCHECK(head_ == nullptr || head_->prev->next == nullptr);
   return res;
 }
@@ -520,12 +562,14 @@ void QList::AppendListpack(unsigned char* zl) {
 
   InsertNode(_Tail(), node, AFTER);
   count_ += node->count;
+  IndexPush(node, TAIL);
 }
 
 void QList::AppendPlain(unsigned char* data, size_t sz) {
   Node* node = CreateRAW(QUICKLIST_NODE_CONTAINER_PLAIN, data, sz);
   InsertNode(_Tail(), node, AFTER);
   ++count_;
+  IndexPush(node, TAIL);
 }
 
 bool QList::Insert(std::string_view pivot, std::string_view elem, InsertOpt opt) {
@@ -553,10 +597,25 @@ bool QList::Replace(long index, std::string_view elem) {
 size_t QList::MallocUsed(bool slow) const {
   size_t node_size = len_ * sizeof(Node) + znallocx(sizeof(quicklist));
   if (slow) {
-    for (Node* node = head_; node; node = node->next) {
-      node_size += zmalloc_usable_size(node->entry);
+    if (index_)
+      node_size += sizeof(NodeIndex) + index_->nodes.size() * sizeof(index_->nodes[0]);
+
+    // Long lists have millions of nodes, so we measure the allocations of the first nodes
+    // and extrapolate their overhead over the rest of malloc_size_.
+    constexpr unsigned kMaxSampledNodes = 128;
+    size_t sampled_usable = 0, sampled_sz = 0;
+    unsigned sampled = 0;
+    for (Node* node = head_; node && sampled < kMaxSampledNodes; node = node->next, ++sampled) {
+      sampled_usable += zmalloc_usable_size(node->entry);
+      sampled_sz += node->encoding == QUICKLIST_NODE_ENCODING_RAW ? node->sz : GetLzf(node)->sz;
     }
-    return node_size;
+
+    node_size += sampled_usable;
+    if (sampled == len_ || sampled_sz == 0)
+      return node_size;
+
+    size_t rest_sz = malloc_size_ > sampled_sz ? malloc_size_ - sampled_sz : 0;
+    return node_size + size_t(double(rest_sz) * sampled_usable / sampled_sz);
   }
 
   return node_size + malloc_size_;
@@ -569,12 +628,21 @@ void QList::Iterate(IterateFunc cb, long start, long end) const {
 
   if (end < 0 || end >= long(Size()))
     end = Size() - 1;
-  Iterator it = GetIterator(start);
+  Iterator it = Seek(start, false);
   while (start <= end && it.Next()) {
     if (!cb(it.Get()))
       break;
     start++;
   }
+  RecompressAfterRead(it);
+}
+
+void QList::RecompressAfterRead(const Iterator& it) const {
+  Node* node = it.current_;
+  if (!lazy_compress_ || !node || !node->recompress)
+    return;
+
+  const_cast<QList*>(this)->malloc_size_ += RecompressOnly(node, compr_method_);
 }
 
 auto QList::InsertPlainNode(Node* old_node, string_view value, InsertOpt insert_opt) -> Node* {
@@ -628,6 +696,7 @@ void QList::InsertNode(Node* old_node, Node* new_node, InsertOpt insert_opt) {
 void QList::Insert(Iterator it, std::string_view elem, InsertOpt insert_opt) {
   DCHECK(it.current_);
   DCHECK(it.zi_);
+  index_.reset();
 
   int full = 0, at_tail = 0, at_head = 0, avail_next = 0, avail_prev = 0;
   Node* node = it.current_;
@@ -658,7 +727,7 @@ void QList::Insert(Iterator it, std::string_view elem, InsertOpt insert_opt) {
     if (QL_NODE_IS_PLAIN(node) || (at_tail && after) || (at_head && !after)) {
       InsertPlainNode(node, elem, insert_opt);
     } else {
-      malloc_size_ += DecompressNodeIfNeeded(true, node);
+      malloc_size_ += DecompressNodeIfNeeded(!lazy_compress_, node);
       ssize_t diff_existing = 0;
       Node* new_node = SplitNode(node, it.offset_, after, &diff_existing);
       Node* entry_node = InsertPlainNode(node, elem, insert_opt);
@@ -670,7 +739,7 @@ void QList::Insert(Iterator it, std::string_view elem, InsertOpt insert_opt) {
 
   /* Now determine where and how to insert the new element */
   if (!full) {
-    malloc_size_ += DecompressNodeIfNeeded(true, node);
+    malloc_size_ += DecompressNodeIfNeeded(!lazy_compress_, node);
     uint8_t* new_entry = LP_Insert(node->entry, elem, it.zi_, after ? LP_AFTER : LP_BEFORE);
     malloc_size_ += NodeSetEntry(node, new_entry);
     node->count++;
@@ -682,7 +751,7 @@ void QList::Insert(Iterator it, std::string_view elem, InsertOpt insert_opt) {
       /* If we are: at tail, next has free space, and inserting after:
        *   - insert entry at head of next node. */
       auto* new_node = node->next;
-      malloc_size_ += DecompressNodeIfNeeded(true, new_node);
+      malloc_size_ += DecompressNodeIfNeeded(!lazy_compress_, new_node);
       malloc_size_ += NodeSetEntry(new_node, LP_Prepend(new_node->entry, elem));
       new_node->count++;
       malloc_size_ += RecompressOnly(new_node, compr_method_);
@@ -691,7 +760,7 @@ void QList::Insert(Iterator it, std::string_view elem, InsertOpt insert_opt) {
       /* If we are: at head, previous has free space, and inserting before:
        *   - insert entry at tail of previous node. */
       auto* new_node = node->prev;
-      malloc_size_ += DecompressNodeIfNeeded(true, new_node);
+      malloc_size_ += DecompressNodeIfNeeded(!lazy_compress_, new_node);
       malloc_size_ += NodeSetEntry(new_node, LP_Append(new_node->entry, elem));
       new_node->count++;
       malloc_size_ += RecompressOnly(new_node, compr_method_);
@@ -704,7 +773,7 @@ void QList::Insert(Iterator it, std::string_view elem, InsertOpt insert_opt) {
     } else {
       /* else, node is full we need to split it. */
       /* covers both after and !after cases */
-      malloc_size_ += DecompressNodeIfNeeded(true, node);
+      malloc_size_ += DecompressNodeIfNeeded(!lazy_compress_, node);
       ssize_t diff_existing = 0;
       auto* new_node = SplitNode(node, it.offset_, after, &diff_existing);
       auto func = after ? LP_Prepend : LP_Append;
@@ -729,6 +798,7 @@ void QList::Replace(Iterator it, std::string_view elem) {
     /* quicklistNext() and quicklistGetIteratorEntryAtIdx() provide an uncompressed node */
     quicklistCompress(node);
   } else if (QL_NODE_IS_PLAIN(node)) {
+    index_.reset();
     if (IsLargeElement(sz, fill_)) {
       zfree(node->entry);
       uint8_t* new_entry = (uint8_t*)zmalloc(sz);
@@ -740,6 +810,7 @@ void QList::Replace(Iterator it, std::string_view elem) {
       DelNode(node);
     }
   } else { /* The node is full or data is a large element */
+    index_.reset();
     Node *split_node = NULL, *new_node;
     node->dont_compress = 1; /* Prevent compression in InsertNode() */
 
@@ -819,6 +890,14 @@ void QList::Compress(Node* node) {
     reverse = reverse->prev;
   }
 
+  // Lazy lists only keep the nodes within depth uncompressed, CompressColdNodes does the rest.
+  // Nodes that a read decompressed are compressed back since reads are not accounted.
+  if (lazy_compress_) {
+    if (!in_depth && node && node->recompress)
+      malloc_size_ += CompressNodeIfNeeded(node, this->compr_method_);
+    return;
+  }
+
   if (!in_depth && node) {
     malloc_size_ += CompressNodeIfNeeded(node, this->compr_method_);
   }
@@ -937,6 +1016,11 @@ void QList::DelNode(Node* node) {
       head_->prev = node->prev;
   }
 
+  if (cold_cursor_ == node)
+    cold_cursor_ = node->next;
+  if (defrag_cursor_ == node)
+    defrag_cursor_ = node->next;
+
   /* Update len first, so in Compress we know exactly len */
   len_--;
   count_ -= node->count;
@@ -991,6 +1075,10 @@ auto QList::GetIterator(Where where) const -> Iterator {
 }
 
 auto QList::GetIterator(long idx) const -> Iterator {
+  return Seek(idx, true);
+}
+
+auto QList::Seek(long idx, bool build_index) const -> Iterator {
   Node* n;
   unsigned long long accum = 0;
   int forward = idx < 0 ? 0 : 1; /* < 0 -> reverse, 0+ -> forward */
@@ -1000,6 +1088,20 @@ auto QList::GetIterator(long idx) const -> Iterator {
 
   DCHECK(head_);
 
+  uint64_t start;
+  if (Node* node = IndexSeek(forward ? index : count_ - 1 - index, build_index, &start)) {
+    Iterator iter;
+    iter.owner_ = this;
+    iter.direction_ = forward ? FWD : REV;
+    iter.current_ = node;
+    if (forward) {
+      iter.offset_ = index - start;
+    } else {
+      iter.offset_ = long(count_ - 1 - index - start) - node->count;
+    }
+    return iter;
+  }
+
   /* Seek in the other direction if that way is shorter. */
   int seek_forward = forward;
   unsigned long long seek_index = index;
@@ -1044,6 +1146,7 @@ auto QList::GetIterator(long idx) const -> Iterator {
 
 auto QList::Erase(Iterator it) -> Iterator {
   DCHECK(it.current_);
+  index_.reset();
 
   Node* node = it.current_;
   Node* prev = node->prev;
@@ -1102,9 +1205,11 @@ bool QList::Erase(const long start, unsigned count) {
     extent = -start; /* c.f. LREM -29 29; just delete until end. */
   }
 
-  Iterator it = GetIterator(start);
+  // The index is reset right after, so it is used only if it exists.
+  Iterator it = Seek(start, false);
   Node* node = it.current_;
   long offset = it.offset_;
+  index_.reset();
 
   /* iterate over next nodes until everything is deleted. */
   while (extent) {
@@ -1143,7 +1248,7 @@ bool QList::Erase(const long start, unsigned count) {
     if (delete_entire_node || QL_NODE_IS_PLAIN(node)) {
       DelNode(node);
     } else {
-      malloc_size_ += DecompressNodeIfNeeded(true, node);
+      malloc_size_ += DecompressNodeIfNeeded(!lazy_compress_, node);
       malloc_size_ += NodeSetEntry(node, lpDeleteRange(node->entry, offset, del));
       node->count -= del;
       count_ -= del;
@@ -1161,6 +1266,144 @@ bool QList::Erase(const long start, unsigned count) {
   return true;
 }
 
+unsigned QList::CompressColdNodes(unsigned max_nodes) {
+  DCHECK(lazy_compress_);
+  if (!AllowCompression() || len_ <= unsigned(compress_) * 2) {
+    cold_cursor_ = nullptr;
+    return 0;
+  }
+
+  // Find the bounds of the nodes we may compress; the cursor may have drifted into the ends.
+  Node* first = head_;
+  Node* last = head_->prev;
+  for (unsigned i = 0; i < compress_; ++i) {
+    if (first == cold_cursor_)
+      cold_cursor_ = nullptr;
+    first = first->next;
+    if (last == cold_cursor_)
+      cold_cursor_ = nullptr;
+    last = last->prev;
+  }
+
+  Node* node = cold_cursor_ ? cold_cursor_ : first;
+  unsigned visited = 0;
+  while (visited < max_nodes) {
+    ++visited;
+    if (node->encoding == QUICKLIST_NODE_ENCODING_RAW) {
+      // Give accessed nodes a second chance and retry nodes that did not compress only after
+      // they change.
+      if (node->accessed) {
+        node->accessed = 0;
+        node->attempted_compress = 0;
+      } else if (!node->attempted_compress) {
+        malloc_size_ += CompressNodeIfNeeded(node, compr_method_);
+      }
+    }
+
+    if (node == last) {
+      cold_cursor_ = nullptr;
+      return visited;
+    }
+    node = node->next;
+  }
+  cold_cursor_ = node;
+  return visited;
+}
+
+bool QList::DefragStep(float ratio, unsigned max_nodes, bool restart, bool* realloced) {
+  Node* node = (restart || !defrag_cursor_) ? head_ : defrag_cursor_;
+  for (unsigned visited = 0; node && visited < max_nodes; ++visited) {
+    // Only the entries are moved, the node headers are referenced from too many places.
+    if (zmalloc_page_is_underutilized(node->entry, ratio)) {
+      size_t sz = node->encoding == QUICKLIST_NODE_ENCODING_RAW
+                      ? node->sz
+                      : sizeof(quicklistLZF) + GetLzf(node)->sz;
+      uint8_t* entry = (uint8_t*)zmalloc(sz);
+      memcpy(entry, node->entry, sz);
+      zfree(node->entry);
+      node->entry = entry;
+      *realloced = true;
+    }
+    node = node->next;
+  }
+
+  defrag_cursor_ = node;
+  return node == nullptr;
+}
+
+void QList::IndexPush(Node* new_node, Where where) {
+  if (!index_)
+    return;
+
+  auto& nodes = index_->nodes;
+  if (where == HEAD) {
+    // Every node but the head moves one position further.
+    index_->base++;
+    if (new_node)
+      nodes.emplace_front(new_node, -index_->base);
+    else
+      nodes.front().second = -index_->base;
+  } else if (new_node) {
+    nodes.emplace_back(new_node, int64_t(count_ - new_node->count) - index_->base);
+  }
+  DCHECK_EQ(nodes.size(), len_);
+}
+
+void QList::IndexPop(bool node_deleted, Where where) {
+  if (!index_)
+    return;
+
+  auto& nodes = index_->nodes;
+  if (where == HEAD) {
+    index_->base--;
+    if (node_deleted)
+      nodes.pop_front();
+    else
+      nodes.front().second = -index_->base;
+  } else if (node_deleted) {
+    nodes.pop_back();
+  }
+  DCHECK_EQ(nodes.size(), len_);
+}
+
+auto QList::IndexSeek(uint64_t pos, bool build, uint64_t* start) const -> Node* {
+  if (!index_) {
+    if (!build)
+      return nullptr;
+
+    uint32_t min_nodes = absl::GetFlag(FLAGS_list_index_min_nodes);
+    if (min_nodes == 0 || len_ < min_nodes)
+      return nullptr;
+
+    // Building the index takes a walk over all the nodes, while positions near either end are
+    // reached by walking less than min_nodes of them.
+    uint64_t dist = min<uint64_t>(pos, count_ - 1 - pos);
+    if (dist * len_ < uint64_t(min_nodes) * count_)
+      return nullptr;
+
+    index_ = make_unique<NodeIndex>();
+    int64_t accum = 0;
+    for (Node* node = head_; node; node = node->next) {
+      index_->nodes.emplace_back(node, accum);
+      accum += node->count;
+    }
+  }
+
+  const auto& nodes = index_->nodes;
+  DCHECK_EQ(nodes.size(), len_);
+
+  // Find the last node that starts at or before pos.
+  int64_t rel_pos = int64_t(pos) - index_->base;
+  auto it = upper_bound(nodes.begin(), nodes.end(), rel_pos,
+                        [](int64_t val, const auto& entry) { return val < entry.second; });
+  DCHECK(it != nodes.begin());
+  --it;
+
+  *start = it->second + index_->base;
+  DCHECK_LT(pos - *start, it->first->count);
+  return it->first;
+}
+
 bool QList::Entry::operator==(std::string_view sv) const {
   if (std::holds_alternative<int64_t>(value_)) {
     char buf[absl::numbers_internal::kFastToBufferSize];
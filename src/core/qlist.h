@@ -10,6 +10,7 @@ extern "C" {
 
 #include <absl/functional/function_ref.h>
 
+#include <memory>
 #include <optional>
 #include <string>
 #include <variant>
@@ -29,7 +30,8 @@ class QList {
    * items). recompress: 1 bit, bool, true if node is temporary decompressed for usage.
    * attempted_compress: 1 bit, boolean, used for verifying during testing.
    * dont_compress: 1 bit, boolean, used for preventing compression of entry.
-   * extra: 9 bits, free for future use; pads out the remainder of 32 bits
+   * accessed: 1 bit, boolean, node was used since the last CompressColdNodes pass over it.
+   * extra: 24 bits, free for future use.
    * */
 
   typedef struct Node {
@@ -43,7 +45,8 @@ class QList {
     unsigned int recompress : 1;         /* was this node previous compressed? */
     unsigned int attempted_compress : 1; /* node can't compress; too small */
     unsigned int dont_compress : 1;      /* prevent compression of entry that will be used later */
-    unsigned int extra : 25;             /* more bits to steal for future usage */
+    unsigned int accessed : 1;           /* used since the last cold compression pass */
+    unsigned int extra : 24;             /* more bits to steal for future usage */
   } Node;
 
   // Provides wrapper around the references to the listpack entries.
@@ -166,10 +169,18 @@ class QList {
   // Returns true if item was replaced, false if index is out of range.
   bool Replace(long index, std::string_view elem);
 
+  // If slow is true, measures the allocations instead of relying on the tracked sizes. For long
+  // lists only the first nodes are measured, so the cost is bounded. Only the slow variant
+  // counts the node index: read-only commands build it and their memory changes are not
+  // accounted.
   size_t MallocUsed(bool slow) const;
 
   void Iterate(IterateFunc cb, long start, long end) const;
 
+  // Compresses back the node where a read through the iterator stopped if Next() decompressed
+  // it. Reads of lazy lists are not accounted, so they must leave the nodes as they found them.
+  void RecompressAfterRead(const Iterator& it) const;
+
   // Returns an iterator to tail or the head of the list.
   // To mirror the quicklist interface, the iterator is not valid until Next() is called.
   // TODO: to fix this.
@@ -212,6 +223,26 @@ class QList {
     compr_method_ = static_cast<unsigned>(cm);
   }
 
+  // If set, writes leave the nodes beyond compress depth uncompressed and CompressColdNodes()
+  // compresses them later. Must be set before the list is populated.
+  void set_lazy_compression(bool lazy) {
+    lazy_compress_ = lazy;
+  }
+
+  bool lazy_compression() const {
+    return lazy_compress_;
+  }
+
+  // Compresses the nodes beyond compress depth that were not accessed since the previous pass
+  // over them. Visits at most max_nodes nodes, resuming where the previous call stopped, and
+  // returns the number of visited nodes.
+  unsigned CompressColdNodes(unsigned max_nodes);
+
+  // Moves the node entries that sit on underutilized pages. Visits at most max_nodes nodes,
+  // resuming where the previous call stopped unless restart is set, and returns true once the
+  // tail was visited.
+  bool DefragStep(float ratio, unsigned max_nodes, bool restart, bool* realloced);
+
   static void SetPackedThreshold(unsigned threshold);
 
   struct Stats {
@@ -241,6 +272,22 @@ class QList {
     return head_ ? head_->prev : nullptr;
   }
 
+  struct NodeIndex;
+
+  // Maintains the node index after a push or pop at either end. new_node is the node created
+  // by the push, or nullptr if the end node grew in place.
+  void IndexPush(Node* new_node, Where where);
+  void IndexPop(bool node_deleted, Where where);
+
+  // Returns the node holding the entry at position pos counting from the head, and sets *start
+  // to the position of the node's first entry. Returns nullptr if there is no index and either
+  // build is false, the list is too short or pos is near one of its ends.
+  Node* IndexSeek(uint64_t pos, bool build, uint64_t* start) const;
+
+  // Like GetIterator(idx), but builds the node index only if build_index is true. Only random
+  // access by index builds it, callers that reset it or walk the list anyway do not.
+  Iterator Seek(long idx, bool build_index) const;
+
   void OnPreUpdate(Node* node);
   void OnPostUpdate(Node* node);
 
@@ -268,7 +315,14 @@ class QList {
   int reserved1_ : 14;
   unsigned compress_ : QL_COMP_BITS; /* depth of end nodes not to compress;0=off */
   unsigned bookmark_count_ : QL_BM_BITS;
-  unsigned reserved2_ : 12;
+  unsigned lazy_compress_ : 1;
+  unsigned reserved2_ : 11;
+
+  Node* cold_cursor_ = nullptr;    // where the next CompressColdNodes() pass resumes.
+  Node* defrag_cursor_ = nullptr;  // where the next DefragStep() resumes.
+
+  // Built lazily by indexed lookups on long lists, dropped by mutations in the middle.
+  mutable std::unique_ptr<NodeIndex> index_;
 };
 
 }  // namespace dfly
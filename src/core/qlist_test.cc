@@ -4,12 +4,17 @@
 
 #include "core/qlist.h"
 
+#include <absl/flags/declare.h>
+#include <absl/flags/flag.h>
+#include <absl/flags/reflection.h>
 #include <absl/strings/match.h>
 #include <absl/strings/str_cat.h>
 #include <absl/strings/str_format.h>
 #include <gmock/gmock.h>
 #include <mimalloc.h>
 
+#include <deque>
+
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "core/mi_memory_resource.h"
@@ -21,6 +26,8 @@ extern "C" {
 #include "redis/zmalloc.h"
 }
 
+ABSL_DECLARE_FLAG(uint32_t, list_index_min_nodes);
+
 namespace dfly {
 
 using namespace std;
@@ -208,6 +215,19 @@ TEST_F(QListTest, Basic) {
   EXPECT_GT(ql_.MallocUsed(false), ql_.MallocUsed(true) * 0.8);
 }
 
+TEST_F(QListTest, MallocUsedLongList) {
+  string val(512, 'a');
+  for (unsigned i = 0; i < 10000; ++i) {
+    ql_.Push(val, QList::TAIL);
+  }
+
+  ASSERT_GT(ql_.node_count(), 128u);
+  size_t fast = ql_.MallocUsed(false);
+  size_t slow = ql_.MallocUsed(true);
+  EXPECT_LE(fast, slow);
+  EXPECT_LT(slow, fast * 1.5);
+}
+
 TEST_F(QListTest, ListPack) {
   string_view sv = "abcded"sv;
   uint8_t* lp1 = lpPrepend(lpNew(0), (uint8_t*)sv.data(), sv.size());
@@ -868,6 +888,155 @@ TEST_P(OptionsTest, IndexFrom500) {
   ASSERT_FALSE(it.Next());
 }
 
+TEST_P(OptionsTest, IndexedSeek) {
+  auto [fill, compress, method] = GetParam();
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_list_index_min_nodes, 1);
+
+  ql_ = QList(fill, compress);
+  deque<string> expected;
+  auto check = [&] {
+    ASSERT_EQ(expected.size(), ql_.Size());
+    long size = expected.size();
+    for (long i = 0; i < size; ++i) {
+      QList::Iterator it = ql_.GetIterator(i);
+      ASSERT_TRUE(it.Next()) << i;
+      ASSERT_EQ(expected[i], it.Get()) << i;
+      it = ql_.GetIterator(-i - 1);
+      ASSERT_TRUE(it.Next()) << i;
+      ASSERT_EQ(expected[size - i - 1], it.Get()) << i;
+    }
+    ASSERT_FALSE(ql_.GetIterator(size).Next());
+  };
+
+  // The index is built by the first lookup and then kept up to date by pushes and pops.
+  for (unsigned i = 0; i < 300; ++i) {
+    ql_.Push(StrCat("t", i), QList::TAIL);
+    expected.push_back(StrCat("t", i));
+  }
+  check();
+
+  for (unsigned i = 0; i < 300; ++i) {
+    ql_.Push(StrCat("h", i), QList::HEAD);
+    expected.push_front(StrCat("h", i));
+    if (i % 3 == 0) {
+      ASSERT_EQ(expected.back(), ql_.Pop(QList::TAIL));
+      expected.pop_back();
+    }
+    if (i % 50 == 0)
+      check();
+  }
+  for (unsigned i = 0; i < 150; ++i) {
+    ASSERT_EQ(expected.front(), ql_.Pop(QList::HEAD));
+    expected.pop_front();
+  }
+  check();
+
+  // Mutations in the middle of the list drop the index.
+  ASSERT_TRUE(ql_.Erase(100, 50));
+  expected.erase(expected.begin() + 100, expected.begin() + 150);
+  check();
+
+  ASSERT_TRUE(ql_.Replace(70, string(1000, 'x')));
+  expected[70] = string(1000, 'x');
+  check();
+}
+
+TEST_F(QListTest, IndexOnlyForRandomAccess) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_list_index_min_nodes, 8);
+
+  ql_ = QList(4, 0);
+  for (unsigned i = 0; i < 400; ++i)
+    ql_.Push(StrCat(i), QList::TAIL);
+  ASSERT_EQ(100u, ql_.node_count());
+
+  // Erasing, iterating and seeking near the ends walk the list without building the index.
+  ASSERT_TRUE(ql_.Erase(0, 2));
+  ASSERT_TRUE(ql_.Erase(-2, 2));
+  size_t used = ql_.MallocUsed(true);
+
+  QList::Iterator it = ql_.GetIterator(3);
+  ASSERT_TRUE(it.Next());
+  EXPECT_EQ("5", it.Get());
+  it = ql_.GetIterator(-3);
+  ASSERT_TRUE(it.Next());
+  EXPECT_EQ("395", it.Get());
+  vector<string> items;
+  ql_.Iterate(
+      [&](const QList::Entry& e) {
+        items.push_back(e.to_string());
+        return true;
+      },
+      200, 201);
+  EXPECT_THAT(items, ElementsAre("202", "203"));
+  EXPECT_EQ(used, ql_.MallocUsed(true));
+
+  // Random access in the middle builds it. Only the slow measurement counts it, since reads
+  // are not accounted.
+  size_t fast_used = ql_.MallocUsed(false);
+  it = ql_.GetIterator(200);
+  ASSERT_TRUE(it.Next());
+  EXPECT_EQ("202", it.Get());
+  EXPECT_GT(ql_.MallocUsed(true), used);
+  EXPECT_EQ(fast_used, ql_.MallocUsed(false));
+}
+
+TEST_F(QListTest, LazyCompression) {
+  ql_ = QList(-2, 1);
+  ql_.set_lazy_compression(true);
+  string val(100, 'a');
+  for (unsigned i = 0; i < 2000; ++i) {
+    ql_.Push(StrCat(val, i), QList::TAIL);
+  }
+
+  auto compressed_nodes = [this] {
+    unsigned res = 0;
+    for (const QList::Node* node = ql_.Head(); node; node = node->next)
+      res += node->encoding != QUICKLIST_NODE_ENCODING_RAW;
+    return res;
+  };
+
+  // Writes leave the nodes uncompressed, the first pass only clears their access marks.
+  EXPECT_EQ(0u, compressed_nodes());
+  size_t orig_used = ql_.MallocUsed(false);
+  unsigned num_nodes = ql_.node_count();
+  ASSERT_GT(num_nodes, 4u);
+
+  EXPECT_EQ(num_nodes - 2, ql_.CompressColdNodes(1000));
+  EXPECT_EQ(0u, compressed_nodes());
+
+  // Resumes where the previous call stopped.
+  EXPECT_EQ(1u, ql_.CompressColdNodes(1));
+  EXPECT_EQ(num_nodes - 3, ql_.CompressColdNodes(1000));
+  EXPECT_EQ(num_nodes - 2, compressed_nodes());
+  EXPECT_LT(ql_.MallocUsed(false), orig_used / 2);
+
+  // Reads decompress nodes temporarily and leave the memory usage as it was.
+  size_t compressed_used = ql_.MallocUsed(false);
+  QList::Iterator it = ql_.GetIterator(1000);
+  ASSERT_TRUE(it.Next());
+  EXPECT_EQ(StrCat(val, 1000), it.Get());
+  EXPECT_EQ(num_nodes - 3, compressed_nodes());
+  ql_.RecompressAfterRead(it);
+  EXPECT_EQ(num_nodes - 2, compressed_nodes());
+  EXPECT_EQ(compressed_used, ql_.MallocUsed(false));
+
+  unsigned count = 0;
+  ql_.Iterate([&](const QList::Entry&) { return ++count < 1500; }, 0, -1);
+  EXPECT_EQ(1500u, count);
+  EXPECT_EQ(num_nodes - 2, compressed_nodes());
+  EXPECT_EQ(compressed_used, ql_.MallocUsed(false));
+
+  // The ends stay uncompressed while the list shrinks.
+  for (unsigned i = 0; i < 2000; ++i) {
+    ASSERT_EQ(StrCat(val, i), ql_.Pop(QList::HEAD));
+    if (ql_.Size() > 0) {
+      ASSERT_EQ(QUICKLIST_NODE_ENCODING_RAW, ql_.Head()->encoding) << i;
+    }
+  }
+}
+
 static void BM_QListCompress(benchmark::State& state) {
   SetupMalloc();
 
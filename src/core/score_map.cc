@@ -163,6 +163,13 @@ pair<sds, bool> DuplicateEntryIfFragmented(void* obj, float ratio) {
 
 }  // namespace
 
+uint32_t ScoreMap::DefragStep(uint32_t cursor, uint32_t count, float ratio,
+                              const std::function<void(sds, sds)>& cb, bool* realloced) {
+  return DefragBuckets(
+      cursor, count, ratio,
+      [ratio, &cb](IteratorBase it) { return iterator{it}.ReallocIfNeeded(ratio, cb); }, realloced);
+}
+
 bool ScoreMap::iterator::ReallocIfNeeded(float ratio, std::function<void(sds, sds)> cb) {
   auto* ptr = curr_entry_;
 
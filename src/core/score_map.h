@@ -53,6 +53,9 @@ class ScoreMap : public DenseSet {
     iterator(DenseSet* owner, bool is_end) : IteratorBase(owner, is_end) {
     }
 
+    explicit iterator(const IteratorBase& o) : IteratorBase(o) {
+    }
+
     detail::SdsScorePair operator->() const {
       void* ptr = curr_entry_->GetObject();
       return BreakToPair(ptr);
@@ -120,6 +123,11 @@ class ScoreMap : public DenseSet {
     return iterator{this, true};
   }
 
+  // Incremental variant of calling ReallocIfNeeded on every entry: moves the entries and the links
+  // of count buckets starting from cursor. Returns the next cursor, or 0 after the last bucket.
+  uint32_t DefragStep(uint32_t cursor, uint32_t count, float ratio,
+                      const std::function<void(sds, sds)>& cb, bool* realloced);
+
  private:
   uint64_t Hash(const void* obj, uint32_t cookie) const final;
   bool ObjEqual(const void* left, const void* right, uint32_t right_cookie) const final;
@@ -23,6 +23,9 @@ using DocId = uint32_t;
 
 enum class VectorSimilarity { L2, COSINE };
 
+// Storage format of indexed vectors. FLOAT16 and INT8 trade precision for 2x and 4x less memory.
+enum class VectorQuantization { NONE, FLOAT16, INT8 };
+
 using OwnedFtVector = std::pair<std::unique_ptr<float[]>, size_t /* dimension (size) */>;
 
 // Query params represent named parameters for queries supplied via PARAMS.
@@ -86,6 +89,9 @@ struct BaseIndex {
 // Base class for type-specific sorting indices.
 struct BaseSortIndex : BaseIndex {
   virtual SortableValue Lookup(DocId doc) const = 0;
+
+  // Move the first `limit` ids in sort order to the front and return their values. Ids past the
+  // limit may be dropped.
   virtual std::vector<SortableValue> Sort(std::vector<DocId>* ids, size_t limit,
                                           bool desc) const = 0;
 };
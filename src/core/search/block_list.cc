@@ -4,7 +4,7 @@ namespace dfly::search {
 
 using namespace std;
 
-SplitResult Split(BlockList<SortedVector<std::pair<DocId, double>>>&& block_list) {
+SplitResult Split(BlockList<CompressedSortedEntries>&& block_list) {
   using Entry = std::pair<DocId, double>;
 
   const size_t initial_size = block_list.Size();
@@ -28,10 +28,10 @@ SplitResult Split(BlockList<SortedVector<std::pair<DocId, double>>>&& block_list
 
   double median_value = all_entries[initial_size / 2].second;
 
-  BlockList<SortedVector<Entry>> left(block_list.blocks_.get_allocator().resource(),
-                                      block_list.block_size_);
-  BlockList<SortedVector<Entry>> right(block_list.blocks_.get_allocator().resource(),
-                                       block_list.block_size_);
+  BlockList<CompressedSortedEntries> left(block_list.blocks_.get_allocator().resource(),
+                                          block_list.block_size_);
+  BlockList<CompressedSortedEntries> right(block_list.blocks_.get_allocator().resource(),
+                                           block_list.block_size_);
   absl::InlinedVector<Entry, 1> median_entries;
 
   double min_value_in_right_part = std::numeric_limits<double>::infinity();
@@ -152,7 +152,29 @@ typename BlockList<C>::BlockListIterator& BlockList<C>::BlockListIterator::opera
   return *this;
 }
 
+template <typename C>
+typename BlockList<C>::BlockListIterator& BlockList<C>::BlockListIterator::SeekGE(
+    const ElementType& t) {
+  if (it == it_end || **this >= t)
+    return *this;
+
+  // Blocks are non-empty and sorted, so all blocks before the last one that starts not after t
+  // contain only smaller elements
+  auto starts_after = [](const ElementType& t, const C& block) { return *block.begin() > t; };
+  auto next = std::upper_bound(it + 1, it_end, t, starts_after);
+  if (--next != it) {
+    it = next;
+    block_it = it->begin();
+    block_end = it->end();
+  }
+
+  while (it != it_end && **this < t)
+    operator++();
+  return *this;
+}
+
 template class BlockList<CompressedSortedSet>;
+template class BlockList<CompressedSortedEntries>;
 template class BlockList<SortedVector<DocId>>;
 template class BlockList<SortedVector<std::pair<DocId, double>>>;
 
@@ -10,6 +10,7 @@
 #include <vector>
 
 #include "core/search/base.h"
+#include "core/search/compressed_sorted_entries.h"
 #include "core/search/compressed_sorted_set.h"
 
 namespace dfly::search {
@@ -23,9 +24,9 @@ template <typename T> class SortedVector;
    of elements. Returns median value of the split. Garantees that median present in the right
    block and not present in the left block. Does not work for empty BlockList. */
 // TODO: Move to RangeTree logic
-SplitResult Split(BlockList<SortedVector<std::pair<DocId, double>>>&& result);
+SplitResult Split(BlockList<CompressedSortedEntries>&& result);
 
-// BlockList is a container wrapper for CompressedSortedSet / vector<DocId>
+// BlockList is a container wrapper for CompressedSortedSet / CompressedSortedEntries / vector
 // to divide the full sorted id range into separate blocks. This reduces modification
 // complexity from O(N) to O(logN + K), where K is the max block size.
 //
@@ -45,12 +46,7 @@ template <typename Container /* underlying container */> class BlockList {
 
   BlockList(const BlockList& other) = default;
 
-  BlockList(BlockList&& other) noexcept {
-    // Consider not to do move if block_size_ is different
-    // DCHECK(block_size_ == other.block_size_);
-    // It seams there is bugs in BaseStringIndex
-    // because this check fails for it
-
+  BlockList(BlockList&& other) noexcept : block_size_{other.block_size_} {
     size_ = other.size_;
     blocks_ = std::move(other.blocks_);
     other.Clear();
@@ -98,6 +94,10 @@ template <typename Container /* underlying container */> class BlockList {
 
     BlockListIterator& operator++();
 
+    // Advance to the first element not less than t. Skips whole blocks by their first elements
+    // without decoding them, so it's much cheaper than stepping over the same range.
+    BlockListIterator& SeekGE(const ElementType& t);
+
     friend class BlockList;
 
     bool operator==(const BlockListIterator& other) const {
@@ -135,7 +135,7 @@ template <typename Container /* underlying container */> class BlockList {
   void TryMerge(BlockIt block);  // If needed, merge with previous block
   void TrySplit(BlockIt block);  // If needed, split into two blocks
 
-  friend SplitResult Split(BlockList<SortedVector<std::pair<DocId, double>>>&& block_list);
+  friend SplitResult Split(BlockList<CompressedSortedEntries>&& block_list);
 
  private:
   const size_t block_size_ = 1000;
@@ -190,12 +190,13 @@ extern template class SortedVector<DocId>;
 extern template class SortedVector<std::pair<DocId, double>>;
 
 extern template class BlockList<CompressedSortedSet>;
+extern template class BlockList<CompressedSortedEntries>;
 extern template class BlockList<SortedVector<DocId>>;
 extern template class BlockList<SortedVector<std::pair<DocId, double>>>;
 
 // Used by Split method
 struct SplitResult {
-  using Container = BlockList<SortedVector<std::pair<DocId, double>>>;
+  using Container = BlockList<CompressedSortedEntries>;
 
   Container left;
   Container right;
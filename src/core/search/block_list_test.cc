@@ -76,8 +76,9 @@ template <typename C> class TemplatedBlockListTest : public testing::Test {
                                               std::numeric_limits<NumericType>::max()};
 };
 
-using ContainerTypes = ::testing::Types<CompressedSortedSet, SortedVector<DocId>,
-                                        SortedVector<std::pair<DocId, double>>>;
+using ContainerTypes =
+    ::testing::Types<CompressedSortedSet, SortedVector<DocId>,
+                     SortedVector<std::pair<DocId, double>>, CompressedSortedEntries>;
 TYPED_TEST_SUITE(TemplatedBlockListTest, ContainerTypes);
 
 TYPED_TEST(TemplatedBlockListTest, LoopMidInsertErase) {
@@ -164,8 +165,28 @@ class BlockListTest : public testing::Test {
  protected:
 };
 
+TEST_F(BlockListTest, SeekGE) {
+  BlockList<CompressedSortedSet> bl{PMR_NS::get_default_resource(), 10};
+  for (DocId id = 0; id < 1000; id += 3)
+    bl.Insert(id);
+
+  auto it = bl.begin();
+  EXPECT_EQ(*it.SeekGE(0), 0u);
+  EXPECT_EQ(*it.SeekGE(1), 3u);
+  EXPECT_EQ(*it.SeekGE(500), 501u);
+  EXPECT_EQ(*it.SeekGE(400), 501u);  // never moves back
+  EXPECT_EQ(*it.SeekGE(999), 999u);
+  EXPECT_TRUE(it.SeekGE(1000) == bl.end());
+
+  vector<DocId> all(bl.begin(), bl.end());
+  for (DocId target = 0; target < 1000; target += 7) {
+    auto it = bl.begin();
+    EXPECT_EQ(*it.SeekGE(target), *lower_bound(all.begin(), all.end(), target)) << target;
+  }
+}
+
 TEST_F(BlockListTest, Split) {
-  BlockList<SortedVector<std::pair<DocId, double>>> bl{PMR_NS::get_default_resource(), 20};
+  BlockList<CompressedSortedEntries> bl{PMR_NS::get_default_resource(), 20};
 
   const size_t max_value = 100.0;
   const size_t step = 23.0;
@@ -223,7 +244,7 @@ TEST_F(BlockListTest, Split) {
 
 TEST_F(BlockListTest, SplitHard) {
   // First test 70 values on the left and 30 on the right
-  BlockList<SortedVector<std::pair<DocId, double>>> bl1{PMR_NS::get_default_resource(), 20};
+  BlockList<CompressedSortedEntries> bl1{PMR_NS::get_default_resource(), 20};
 
   for (size_t i = 0; i < 70; i++) {
     bl1.Insert({i, 1.0});
@@ -247,7 +268,7 @@ TEST_F(BlockListTest, SplitHard) {
   }
 
   // Now test 30 values on the left and 70 on the right
-  BlockList<SortedVector<std::pair<DocId, double>>> bl2{PMR_NS::get_default_resource(), 20};
+  BlockList<CompressedSortedEntries> bl2{PMR_NS::get_default_resource(), 20};
   for (size_t i = 0; i < 30; i++) {
     bl2.Insert({i, 1.0});
   }
@@ -270,7 +291,7 @@ TEST_F(BlockListTest, SplitHard) {
 }
 
 TEST_F(BlockListTest, SplitSingleDoubleValue) {
-  BlockList<SortedVector<std::pair<DocId, double>>> bl{PMR_NS::get_default_resource(), 20};
+  BlockList<CompressedSortedEntries> bl{PMR_NS::get_default_resource(), 20};
 
   for (size_t i = 0; i < 100; i++) {
     bl.Insert({i, 1.0});
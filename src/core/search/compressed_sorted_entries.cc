@@ -0,0 +1,288 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/search/compressed_sorted_entries.h"
+
+#include <array>
+#include <cmath>
+#include <cstring>
+
+namespace dfly::search {
+
+using namespace std;
+
+namespace {
+
+using Entry = CompressedSortedEntries::ElementType;
+
+// Enough for the largest header (33 bits) and value (8 raw bytes or 54 bit zigzag varint) of two
+// entries
+using EntryBuffer = array<uint8_t, 32>;
+
+constexpr uint64_t kRawValueFlag = 1;
+
+size_t WriteVarint(uint64_t value, uint8_t* out) {
+  size_t written = 0;
+  while (value >= 0x80) {
+    out[written++] = static_cast<uint8_t>(value) | 0x80;
+    value >>= 7;
+  }
+  out[written++] = static_cast<uint8_t>(value);
+  return written;
+}
+
+pair<uint64_t /*value*/, size_t /*read*/> ReadVarint(absl::Span<const uint8_t> source) {
+  uint64_t value = 0;
+  size_t read = 0;
+  for (unsigned shift = 0;; shift += 7) {
+    DCHECK_LT(read, source.size());
+    uint8_t byte = source[read++];
+    value |= uint64_t(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0)
+      break;
+  }
+  return {value, read};
+}
+
+// Numeric fields mostly hold integers, they are stored as varints if exactly representable
+bool AsInteger(double value, int64_t* out) {
+  constexpr double kMaxExact = double(1LL << 53);
+  if (!(std::abs(value) < kMaxExact))  // also filters out NaN
+    return false;
+
+  int64_t integer = static_cast<int64_t>(value);
+  if (static_cast<double>(integer) != value || (integer == 0 && std::signbit(value)))
+    return false;
+
+  *out = integer;
+  return true;
+}
+
+uint64_t ZigZag(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+int64_t UnZigZag(uint64_t value) {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+size_t WriteHeader(DocId id_diff, uint64_t flags, uint8_t* out) {
+  return WriteVarint((uint64_t(id_diff) << 1) | flags, out);
+}
+
+// Encode entry relative to preceding id and return number of written bytes
+size_t WriteEntry(const Entry& entry, DocId prev_id, uint8_t* out) {
+  int64_t integer = 0;
+  if (!AsInteger(entry.second, &integer)) {
+    size_t written = WriteHeader(entry.first - prev_id, kRawValueFlag, out);
+    memcpy(out + written, &entry.second, sizeof(double));
+    return written + sizeof(double);
+  }
+
+  size_t written = WriteHeader(entry.first - prev_id, 0, out);
+  return written + WriteVarint(ZigZag(integer), out + written);
+}
+
+}  // namespace
+
+CompressedSortedEntries::CompressedSortedEntries(PMR_NS::memory_resource* mr) : bytes_{mr} {
+}
+
+CompressedSortedEntries::ConstIterator::ConstIterator(const CompressedSortedEntries& list)
+    : stash_{}, bytes_{list.bytes_} {
+  ReadNext();
+}
+
+CompressedSortedEntries::ElementType CompressedSortedEntries::ConstIterator::operator*() const {
+  DCHECK(stash_);
+  return *stash_;
+}
+
+CompressedSortedEntries::ConstIterator& CompressedSortedEntries::ConstIterator::operator++() {
+  ReadNext();
+  return *this;
+}
+
+bool operator==(const CompressedSortedEntries::ConstIterator& l,
+                const CompressedSortedEntries::ConstIterator& r) {
+  return l.bytes_.data() == r.bytes_.data() && l.bytes_.size() == r.bytes_.size();
+}
+
+bool operator!=(const CompressedSortedEntries::ConstIterator& l,
+                const CompressedSortedEntries::ConstIterator& r) {
+  return !(l == r);
+}
+
+void CompressedSortedEntries::ConstIterator::ReadNext() {
+  if (bytes_.empty()) {
+    stash_ = nullopt;
+    last_read_ = {nullptr, 0};
+    last_header_size_ = 0;
+    bytes_ = {nullptr, 0};
+    return;
+  }
+
+  auto [header, header_read] = ReadVarint(bytes_);
+  DocId id = (stash_ ? stash_->first : 0) + DocId(header >> 1);
+
+  double value = 0;
+  size_t value_read = sizeof(double);
+  if (header & kRawValueFlag) {
+    DCHECK_GE(bytes_.size(), header_read + sizeof(double));
+    memcpy(&value, bytes_.data() + header_read, sizeof(double));
+  } else {
+    auto [zigzag, read] = ReadVarint(bytes_.subspan(header_read));
+    value = static_cast<double>(UnZigZag(zigzag));
+    value_read = read;
+  }
+
+  stash_ = Entry{id, value};
+  last_read_ = bytes_.subspan(0, header_read + value_read);
+  last_header_size_ = header_read;
+  bytes_.remove_prefix(last_read_.size());
+}
+
+CompressedSortedEntries::ConstIterator CompressedSortedEntries::begin() const {
+  return ConstIterator{*this};
+}
+
+CompressedSortedEntries::ConstIterator CompressedSortedEntries::end() const {
+  return ConstIterator{};
+}
+
+void CompressedSortedEntries::PushBack(const ElementType& entry, DocId prev_id) {
+  DCHECK_GE(entry.first, prev_id);
+  size_++;
+  tail_ = entry;
+
+  EntryBuffer buf;
+  size_t written = WriteEntry(entry, prev_id, buf.data());
+  bytes_.insert(bytes_.end(), buf.begin(), buf.begin() + written);
+}
+
+void CompressedSortedEntries::Splice(size_t offset, size_t len, absl::Span<const uint8_t> bytes) {
+  if (bytes.size() > len)
+    bytes_.insert(bytes_.begin() + offset + len, bytes.size() - len, 0u);
+  else
+    bytes_.erase(bytes_.begin() + offset + bytes.size(), bytes_.begin() + offset + len);
+
+  copy(bytes.begin(), bytes.end(), bytes_.begin() + offset);
+}
+
+// Do a linear scan by decoding all entries to find entry
+CompressedSortedEntries::EntryLocation CompressedSortedEntries::LowerBound(
+    const ElementType& entry) const {
+  EntryLocation location{};
+
+  auto it = begin();
+  for (; it != end() && *it < entry; ++it)
+    location.prev = *it;
+
+  if (it == end()) {
+    location.offset = bytes_.size();
+    return location;
+  }
+
+  location.entry = *it;
+  location.offset = it.last_read_.data() - bytes_.data();
+  location.size = it.last_read_.size();
+  location.header_size = it.last_header_size_;
+  return location;
+}
+
+// Insert has linear complexity. It finds between which two entries A and B the new entry V needs
+// to be inserted. V is encoded relative to A and the header of B is rewritten relative to V, the
+// value of B stays untouched
+bool CompressedSortedEntries::Insert(ElementType entry) {
+  if (tail_ && *tail_ == entry)
+    return false;
+
+  if (tail_ && entry > *tail_) {
+    PushBack(entry, tail_->first);
+    return true;
+  }
+
+  auto bound = LowerBound(entry);
+  DocId prev_id = bound.prev ? bound.prev->first : 0;
+
+  if (bound.entry && *bound.entry == entry)
+    return false;
+
+  // Entry is bigger than any other (or list is empty)
+  if (!bound.entry) {
+    PushBack(entry, prev_id);
+    return true;
+  }
+
+  size_++;
+
+  EntryBuffer buf;
+  size_t written = WriteEntry(entry, prev_id, buf.data());
+
+  auto [header, _] = ReadVarint(absl::MakeConstSpan(bytes_).subspan(bound.offset));
+  written += WriteHeader(bound.entry->first - entry.first, header & kRawValueFlag,
+                         buf.data() + written);
+
+  Splice(bound.offset, bound.header_size, absl::MakeConstSpan(buf.data(), written));
+  return true;
+}
+
+// Remove has linear complexity. It finds the entry V and its neighbors A and B, drops V and
+// rewrites the header of B relative to A
+bool CompressedSortedEntries::Remove(ElementType entry) {
+  auto bound = LowerBound(entry);
+  if (!bound.entry || *bound.entry != entry)
+    return false;
+
+  size_--;
+
+  // If it's stored at the end, simply truncate it away
+  size_t next_offset = bound.offset + bound.size;
+  if (next_offset == bytes_.size()) {
+    bytes_.resize(bound.offset);
+    tail_ = bound.prev;
+    return true;
+  }
+
+  auto [header, header_read] = ReadVarint(absl::MakeConstSpan(bytes_).subspan(next_offset));
+  DocId prev_id = bound.prev ? bound.prev->first : 0;
+  DocId diff = DocId(header >> 1) + (entry.first - prev_id);
+
+  EntryBuffer buf;
+  size_t written = WriteHeader(diff, header & kRawValueFlag, buf.data());
+  Splice(bound.offset, bound.size + header_read, absl::MakeConstSpan(buf.data(), written));
+  return true;
+}
+
+void CompressedSortedEntries::Merge(CompressedSortedEntries&& other) {
+  // Quadratic compexity in theory, but in practice used only to merge with larger values.
+  // Tail insert optimization makes it linear
+  for (const ElementType& entry : other)
+    Insert(entry);
+}
+
+std::pair<CompressedSortedEntries, CompressedSortedEntries> CompressedSortedEntries::Split() && {
+  DCHECK_GT(Size(), 1u);
+
+  CompressedSortedEntries second(bytes_.get_allocator().resource());
+
+  // Move iterator to middle position and remember the new tail
+  auto it = begin();
+  optional<ElementType> last;
+  for (size_t i = 0; i < size_ / 2; ++i, ++it)
+    last = *it;
+  size_t keep_bytes = it.last_read_.data() - bytes_.data();
+
+  // Copy second half into second list, the first entry is re-encoded relative to zero
+  for (; it != end(); ++it)
+    second.Insert(*it);
+
+  bytes_.resize(keep_bytes);
+  tail_ = last;
+  size_ -= second.Size();
+
+  return std::make_pair(std::move(*this), std::move(second));
+}
+
+}  // namespace dfly::search
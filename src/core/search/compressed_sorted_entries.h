@@ -0,0 +1,120 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/types/span.h>
+
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "base/logging.h"
+#include "base/pmr/memory_resource.h"
+#include "core/search/base.h"
+
+namespace dfly::search {
+
+// A list of sorted unique (DocId, double) entries with reduced memory usage, used as leaf storage
+// of the RangeTree. Every entry is stored as a variable length header with the difference to the
+// preceding id and a flag for the value encoding, followed by the value. Integral values are
+// encoded as zigzag varints, all others are stored as raw 8 bytes. Typical entries take 2-4 bytes
+// instead of 16 for a plain vector of pairs.
+class CompressedSortedEntries {
+ public:
+  using ElementType = std::pair<DocId, double>;
+
+  // Const access iterator that decodes the compressed list on traversal
+  struct ConstIterator {
+    friend class CompressedSortedEntries;
+
+    // To make it work with std container contructors
+    using iterator_category = std::forward_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = ElementType;
+    using pointer = ElementType*;
+    using reference = ElementType&;
+
+    ElementType operator*() const;
+    ConstIterator& operator++();
+
+    friend bool operator==(const ConstIterator& l, const ConstIterator& r);
+    friend bool operator!=(const ConstIterator& l, const ConstIterator& r);
+
+   private:
+    explicit ConstIterator(const CompressedSortedEntries& list);
+    ConstIterator() = default;
+
+    void ReadNext();  // Decode next entry to stash
+
+    std::optional<ElementType> stash_{};
+    absl::Span<const uint8_t> last_read_{};  // Whole encoded stash entry
+    size_t last_header_size_ = 0;            // Size of stash entry header
+    absl::Span<const uint8_t> bytes_{};
+  };
+
+  using iterator = ConstIterator;
+
+ public:
+  explicit CompressedSortedEntries(PMR_NS::memory_resource* mr);
+
+  ConstIterator begin() const;
+  ConstIterator end() const;
+
+  bool Insert(ElementType entry);  // Insert arbitrary entry, needs to scan whole list
+  bool Remove(ElementType entry);  // Remove arbitrary entry, needs to scan whole list
+
+  size_t Size() const {
+    return size_;
+  }
+
+  size_t ByteSize() const {
+    return bytes_.size();
+  }
+
+  bool Empty() const {
+    return size_ == 0;
+  }
+
+  void Clear() {
+    size_ = 0;
+    tail_.reset();
+    bytes_.clear();
+  }
+
+  // Add all entries from other
+  void Merge(CompressedSortedEntries&& other);
+
+  // Split into two equally sized halves
+  std::pair<CompressedSortedEntries, CompressedSortedEntries> Split() &&;
+
+ private:
+  struct EntryLocation {
+    std::optional<ElementType> entry;  // First entry not less than searched, none if not found
+    std::optional<ElementType> prev;   // Preceding entry, none if first
+    size_t offset = 0;                 // Offset of entry or end of list
+    size_t size = 0;                   // Size of encoded entry or 0
+    size_t header_size = 0;            // Size of entry header or 0
+  };
+
+ private:
+  // Find EntryLocation of first entry that is not less than value (std::lower_bound)
+  EntryLocation LowerBound(const ElementType& entry) const;
+
+  // Push back entry without any decoding
+  void PushBack(const ElementType& entry, DocId prev_id);
+
+  // Replace len bytes at offset with the given bytes
+  void Splice(size_t offset, size_t len, absl::Span<const uint8_t> bytes);
+
+ private:
+  uint32_t size_{0};
+
+  std::optional<ElementType> tail_{};
+  std::vector<uint8_t, PMR_NS::polymorphic_allocator<uint8_t>> bytes_;
+};
+
+}  // namespace dfly::search
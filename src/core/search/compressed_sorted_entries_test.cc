@@ -0,0 +1,136 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/search/compressed_sorted_entries.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <set>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+namespace dfly::search {
+
+using namespace std;
+
+class CompressedSortedEntriesTest : public ::testing::Test {
+ protected:
+};
+
+using Entry = CompressedSortedEntries::ElementType;
+using EntryVec = vector<Entry>;
+
+TEST_F(CompressedSortedEntriesTest, BasicInsertRemove) {
+  CompressedSortedEntries list{PMR_NS::get_default_resource()};
+  auto current = [&list]() { return EntryVec{list.begin(), list.end()}; };
+
+  EXPECT_TRUE(list.Insert({10, 5.0}));
+  EXPECT_TRUE(list.Insert({3, -2.5}));
+  EXPECT_TRUE(list.Insert({10, 1.0}));  // same id with another value
+  EXPECT_TRUE(list.Insert({7, 1e100}));
+  EXPECT_FALSE(list.Insert({7, 1e100}));
+  EXPECT_EQ(current(), (EntryVec{{3, -2.5}, {7, 1e100}, {10, 1.0}, {10, 5.0}}));
+  EXPECT_EQ(list.Size(), 4u);
+
+  EXPECT_FALSE(list.Remove({7, 1.0}));
+  EXPECT_TRUE(list.Remove({3, -2.5}));
+  EXPECT_TRUE(list.Remove({10, 5.0}));
+  EXPECT_EQ(current(), (EntryVec{{7, 1e100}, {10, 1.0}}));
+
+  // Tail was removed, appending must still be relative to the new tail
+  EXPECT_TRUE(list.Insert({11, 2.0}));
+  EXPECT_EQ(current(), (EntryVec{{7, 1e100}, {10, 1.0}, {11, 2.0}}));
+
+  EXPECT_TRUE(list.Remove({7, 1e100}));
+  EXPECT_TRUE(list.Remove({10, 1.0}));
+  EXPECT_TRUE(list.Remove({11, 2.0}));
+  EXPECT_TRUE(list.Empty());
+  EXPECT_EQ(list.ByteSize(), 0u);
+}
+
+TEST_F(CompressedSortedEntriesTest, SpecialValues) {
+  CompressedSortedEntries list{PMR_NS::get_default_resource()};
+
+  const double kMaxExact = double(1LL << 53);
+  EntryVec values = {{1, -0.0},
+                     {2, 0.0},
+                     {3, kMaxExact},
+                     {4, -kMaxExact + 1},
+                     {5, 0.1},
+                     {6, numeric_limits<double>::max()},
+                     {7, numeric_limits<double>::lowest()},
+                     {8, numeric_limits<double>::denorm_min()},
+                     {numeric_limits<DocId>::max(), -1.0}};
+
+  // Insert in reverse order to exercise the mid insertion path
+  for (auto it = values.rbegin(); it != values.rend(); ++it)
+    EXPECT_TRUE(list.Insert(*it));
+
+  EntryVec out{list.begin(), list.end()};
+  ASSERT_EQ(out, values);
+  EXPECT_TRUE(signbit(out[0].second));
+  EXPECT_FALSE(signbit(out[1].second));
+}
+
+TEST_F(CompressedSortedEntriesTest, RandomOperations) {
+  CompressedSortedEntries list{PMR_NS::get_default_resource()};
+  set<Entry> expected;
+
+  default_random_engine rnd{42};
+  uniform_int_distribution<DocId> id_dist{0, 2000};
+  uniform_int_distribution<int> value_dist{-100, 100};
+
+  for (size_t i = 0; i < 10000; i++) {
+    Entry entry{id_dist(rnd), value_dist(rnd) / (i % 3 == 0 ? 4.0 : 1.0)};
+    if (i % 3 == 2)
+      EXPECT_EQ(list.Remove(entry), expected.erase(entry) > 0);
+    else
+      EXPECT_EQ(list.Insert(entry), expected.insert(entry).second);
+  }
+
+  EXPECT_EQ(list.Size(), expected.size());
+  EXPECT_EQ((EntryVec{list.begin(), list.end()}), (EntryVec{expected.begin(), expected.end()}));
+}
+
+TEST_F(CompressedSortedEntriesTest, MergeSplit) {
+  CompressedSortedEntries list{PMR_NS::get_default_resource()};
+  CompressedSortedEntries other{PMR_NS::get_default_resource()};
+
+  EntryVec all;
+  for (DocId id = 0; id < 100; id++) {
+    all.emplace_back(id, id * 1.5);
+    (id % 2 ? list : other).Insert(all.back());
+  }
+
+  list.Merge(std::move(other));
+  ASSERT_EQ((EntryVec{list.begin(), list.end()}), all);
+
+  auto [left, right] = std::move(list).Split();
+  EXPECT_EQ(left.Size(), 50u);
+  EXPECT_EQ(right.Size(), 50u);
+  EXPECT_EQ((EntryVec{left.begin(), left.end()}), EntryVec(all.begin(), all.begin() + 50));
+  EXPECT_EQ((EntryVec{right.begin(), right.end()}), EntryVec(all.begin() + 50, all.end()));
+
+  // Both halves remain fully functional after the split
+  EXPECT_TRUE(left.Insert({50, 0.0}));
+  EXPECT_TRUE(right.Insert({0, 0.0}));
+  EXPECT_EQ(*left.begin(), Entry(0, 0.0));
+  EXPECT_EQ(*right.begin(), Entry(0, 0.0));
+}
+
+TEST_F(CompressedSortedEntriesTest, Compression) {
+  CompressedSortedEntries list{PMR_NS::get_default_resource()};
+
+  // Dense ids with small integral values take two bytes per entry
+  for (DocId id = 0; id < 1000; id++)
+    list.Insert({id, double(id % 50)});
+
+  EXPECT_EQ(list.ByteSize(), list.Size() * 2);
+  EXPECT_LE(list.ByteSize() * 8, list.Size() * sizeof(Entry));
+}
+
+}  // namespace dfly::search
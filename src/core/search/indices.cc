@@ -21,8 +21,10 @@
 
 #include <algorithm>
 #include <cctype>
+#include <cstring>
 
 #include "base/flags.h"
+#include "core/search/vector_utils.h"
 
 ABSL_FLAG(bool, use_numeric_range_tree, true,
           "Use range tree for numeric index. "
@@ -451,19 +453,30 @@ bool BaseVectorIndex::Add(DocId id, const DocumentAccessor& doc, std::string_vie
 
 FlatVectorIndex::FlatVectorIndex(const SchemaField::VectorParams& params,
                                  PMR_NS::memory_resource* mr)
-    : BaseVectorIndex{params.dim, params.sim}, entries_{mr} {
+    : BaseVectorIndex{params.dim, params.sim},
+      quantization_{params.quantization},
+      stride_{(QuantizedVectorSize(params.dim, params.quantization) + sizeof(float) - 1) /
+              sizeof(float)},
+      entries_{mr},
+      norms_{mr} {
   DCHECK(!params.use_hnsw);
-  entries_.reserve(params.capacity * params.dim);
+  entries_.reserve(params.capacity * stride_);
 }
 
 void FlatVectorIndex::AddVector(DocId id, const VectorPtr& vector) {
-  DCHECK_LE(id * dim_, entries_.size());
-  if (id * dim_ == entries_.size())
-    entries_.resize((id + 1) * dim_);
+  DCHECK_LE(id * stride_, entries_.size());
+  if (id * stride_ == entries_.size())
+    entries_.resize((id + 1) * stride_);
+
+  bool with_norms = sim_ == VectorSimilarity::COSINE && quantization_ == VectorQuantization::NONE;
+  if (with_norms && norms_.size() <= id)
+    norms_.resize(id + 1);
 
   // TODO: Let get vector write to buf itself
   if (vector) {
-    memcpy(&entries_[id * dim_], vector.get(), dim_ * sizeof(float));
+    QuantizeVector(vector.get(), dim_, quantization_, &entries_[id * stride_]);
+    if (with_norms)
+      norms_[id] = VectorNorm(vector.get(), dim_);
   }
 }
 
@@ -471,28 +484,61 @@ void FlatVectorIndex::Remove(DocId id, const DocumentAccessor& doc, string_view
   // noop
 }
 
-const float* FlatVectorIndex::Get(DocId doc) const {
-  return &entries_[doc * dim_];
+const void* FlatVectorIndex::Get(DocId doc) const {
+  return &entries_[doc * stride_];
+}
+
+void FlatVectorIndex::Distances(const float* target, absl::Span<const DocId> docs,
+                                float* out) const {
+  if (quantization_ != VectorQuantization::NONE) {
+    for (size_t i = 0; i < docs.size(); ++i)
+      out[i] = VectorDistance(target, Get(docs[i]), dim_, sim_, quantization_);
+    return;
+  }
+
+  // Gather the vectors in small batches for the batched kernel.
+  constexpr size_t kBatch = 64;
+  const float* vectors[kBatch];
+  float norms[kBatch];
+  bool with_norms = !norms_.empty();
+
+  for (size_t start = 0; start < docs.size(); start += kBatch) {
+    size_t n = min(kBatch, docs.size() - start);
+    for (size_t i = 0; i < n; ++i) {
+      DocId doc = docs[start + i];
+      vectors[i] = &entries_[doc * stride_];
+      if (with_norms)
+        norms[i] = norms_[doc];
+    }
+    VectorDistances(target, vectors, with_norms ? norms : nullptr, n, dim_, sim_, out + start);
+  }
 }
 
 std::vector<DocId> FlatVectorIndex::GetAllDocsWithNonNullValues() const {
   std::vector<DocId> result;
 
-  size_t num_vectors = entries_.size() / dim_;
+  size_t num_vectors = entries_.size() / stride_;
   result.reserve(num_vectors);
 
   for (DocId id = 0; id < num_vectors; ++id) {
     // Check if the vector is not zero (all elements are 0)
     // TODO: Valid vector can contain 0s, we should use a better approach
-    const float* vec = Get(id);
     bool is_zero_vector = true;
 
     // TODO: Consider don't use check for zero vector
-    for (size_t i = 0; i < dim_; ++i) {
-      if (vec[i] != 0.0f) {  // TODO: Consider using a threshold for float comparison
-        is_zero_vector = false;
-        break;
+    if (quantization_ == VectorQuantization::NONE) {
+      const float* vec = static_cast<const float*>(Get(id));
+      for (size_t i = 0; i < dim_; ++i) {
+        if (vec[i] != 0.0f) {  // TODO: Consider using a threshold for float comparison
+          is_zero_vector = false;
+          break;
+        }
       }
+    } else {
+      // Quantized zero vectors consist of zero bytes only.
+      const uint8_t* vec = static_cast<const uint8_t*>(Get(id));
+      size_t size = QuantizedVectorSize(dim_, quantization_);
+      is_zero_vector = all_of(vec, vec + size, [](uint8_t b) { return b == 0; });
     }
 
     if (!is_zero_vector) {
@@ -505,12 +551,26 @@ std::vector<DocId> FlatVectorIndex::GetAllDocsWithNonNullValues() const {
   return result;
 }
 
+template <typename T> void AppendPod(const T& value, string* out) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T> bool ReadPod(string_view* in, T* value) {
+  if (in->size() < sizeof(T))
+    return false;
+  memcpy(value, in->data(), sizeof(T));
+  in->remove_prefix(sizeof(T));
+  return true;
+}
+
 struct HnswlibAdapter {
   // Default setting of hnswlib/hnswalg
   constexpr static size_t kDefaultEfRuntime = 10;
 
   HnswlibAdapter(const SchemaField::VectorParams& params)
-      : space_{MakeSpace(params.dim, params.sim)},
+      : dim_{params.dim},
+        quantization_{params.quantization},
+        space_{MakeSpace(params.dim, params.sim, params.quantization)},
         world_{GetSpacePtr(), params.capacity, params.hnsw_m, params.hnsw_ef_construction,
                100 /* seed*/} {
   }
@@ -518,7 +578,7 @@ struct HnswlibAdapter {
   void Add(const float* data, DocId id) {
     if (world_.cur_element_count + 1 >= world_.max_elements_)
       world_.resizeIndex(world_.cur_element_count * 2);
-    world_.addPoint(data, id);
+    world_.addPoint(Quantize(data).data(), id);
   }
 
   void Remove(DocId id) {
@@ -530,40 +590,204 @@ struct HnswlibAdapter {
 
   vector<pair<float, DocId>> Knn(float* target, size_t k, std::optional<size_t> ef) {
     world_.setEf(ef.value_or(kDefaultEfRuntime));
-    return QueueToVec(world_.searchKnn(target, k));
+    return QueueToVec(world_.searchKnn(Quantize(target).data(), k));
   }
 
+  // Knn among the allowed documents only, allowed must be sorted.
   vector<pair<float, DocId>> Knn(float* target, size_t k, std::optional<size_t> ef,
                                  const vector<DocId>& allowed) {
-    struct BinsearchFilter : hnswlib::BaseFilterFunctor {
+    size_t ef_runtime = ef.value_or(kDefaultEfRuntime);
+    if (PreferExactScan(allowed.size(), k, ef_runtime))
+      return ExactKnn(target, k, allowed);
+
+    // Skip disallowed nodes during the traversal with constant time lookups
+    struct BitmapFilter : hnswlib::BaseFilterFunctor {
       virtual bool operator()(hnswlib::labeltype id) {
-        return binary_search(allowed->begin(), allowed->end(), id);
+        return id < bits.size() && bits[id];
       }
 
-      BinsearchFilter(const vector<DocId>* allowed) : allowed{allowed} {
+      explicit BitmapFilter(const vector<DocId>& allowed) {
+        bits.resize(allowed.empty() ? 0 : allowed.back() + 1);
+        for (DocId id : allowed)
+          bits[id] = true;
       }
-      const vector<DocId>* allowed;
+      vector<bool> bits;
     };
 
-    world_.setEf(ef.value_or(kDefaultEfRuntime));
-    BinsearchFilter filter{&allowed};
-    return QueueToVec(world_.searchKnn(target, k, &filter));
+    world_.setEf(ef_runtime);
+    BitmapFilter filter{allowed};
+    return QueueToVec(world_.searchKnn(Quantize(target).data(), k, &filter));
+  }
+
+  bool Contains(DocId id) const {
+    auto it = world_.label_lookup_.find(id);
+    return it != world_.label_lookup_.end() && !world_.isMarkedDeleted(it->second);
+  }
+
+  // Returns true if the graph holds the same vector for the document
+  bool HasVector(DocId id, const float* data) {
+    if (!Contains(id))
+      return false;
+    auto it = world_.label_lookup_.find(id);
+    string_view vec = Quantize(data);
+    return memcmp(world_.getDataByInternalId(it->second), vec.data(), vec.size()) == 0;
+  }
+
+  // Level 0 of all elements is stored in a single block with the vectors and labels, upper levels
+  // are stored per element. Both are copied as is, like hnswlib's own saveIndex.
+  string Serialize() const {
+    size_t count = world_.cur_element_count;
+    string out;
+    AppendPod(world_.size_data_per_element_, &out);
+    AppendPod(world_.size_links_per_element_, &out);
+    AppendPod(count, &out);
+    AppendPod(world_.maxlevel_, &out);
+    AppendPod(world_.enterpoint_node_, &out);
+    out.append(world_.data_level0_memory_, count * world_.size_data_per_element_);
+    for (size_t i = 0; i < count; i++) {
+      int level = world_.element_levels_[i];
+      AppendPod(level, &out);
+      if (level > 0)
+        out.append(world_.linkLists_[i], level * world_.size_links_per_element_);
+    }
+    return out;
+  }
+
+  // Restores the graph into an empty index. Returns the labels of the restored elements.
+  optional<vector<DocId>> Restore(string_view data) {
+    size_t data_size, links_size, count;
+    int maxlevel;
+    hnswlib::tableint enterpoint;
+    if (!ReadPod(&data, &data_size) || !ReadPod(&data, &links_size) || !ReadPod(&data, &count) ||
+        !ReadPod(&data, &maxlevel) || !ReadPod(&data, &enterpoint))
+      return nullopt;
+
+    if (world_.cur_element_count != 0 || data_size != world_.size_data_per_element_ ||
+        links_size != world_.size_links_per_element_ || data.size() < count * data_size ||
+        (count > 0 && enterpoint >= count))
+      return nullopt;
+
+    if (count >= world_.max_elements_)
+      world_.resizeIndex(count + 1);
+
+    memcpy(world_.data_level0_memory_, data.data(), count * data_size);
+    data.remove_prefix(count * data_size);
+
+    // Elements become owned by the graph one by one, so that it can free a partial restore
+    vector<DocId> labels(count);
+    for (size_t i = 0; i < count; i++) {
+      int level;
+      if (!ReadPod(&data, &level) || level < 0 || data.size() < level * links_size)
+        return nullopt;
+
+      world_.element_levels_[i] = level;
+      world_.linkLists_[i] = nullptr;
+      if (level > 0) {
+        world_.linkLists_[i] = static_cast<char*>(malloc(level * links_size));
+        memcpy(world_.linkLists_[i], data.data(), level * links_size);
+        data.remove_prefix(level * links_size);
+      }
+      world_.cur_element_count = i + 1;
+
+      labels[i] = world_.getExternalLabel(i);
+      world_.label_lookup_[labels[i]] = i;
+      if (world_.isMarkedDeleted(i))
+        world_.num_deleted_ += 1;
+    }
+
+    world_.maxlevel_ = maxlevel;
+    world_.enterpoint_node_ = enterpoint;
+    return labels;
   }
 
  private:
-  using SpaceUnion = std::variant<hnswlib::L2Space, hnswlib::InnerProductSpace>;
+  // Space of quantized vectors, distances are computed on the quantized form directly.
+  class QuantizedSpace : public hnswlib::SpaceInterface<float> {
+   public:
+    QuantizedSpace(size_t dim, VectorSimilarity sim, VectorQuantization quantization)
+        : params_{dim, sim, quantization} {
+    }
+
+    size_t get_data_size() override {
+      return QuantizedVectorSize(params_.dim, params_.quantization);
+    }
+
+    hnswlib::DISTFUNC<float> get_dist_func() override {
+      return &Distance;
+    }
 
-  static SpaceUnion MakeSpace(size_t dim, VectorSimilarity sim) {
+    void* get_dist_func_param() override {
+      return &params_;
+    }
+
+   private:
+    struct Params {
+      size_t dim;
+      VectorSimilarity sim;
+      VectorQuantization quantization;
+    };
+
+    static float Distance(const void* u, const void* v, const void* param) {
+      const Params* p = static_cast<const Params*>(param);
+      return QuantizedSpaceDistance(u, v, p->dim, p->sim, p->quantization);
+    }
+
+    Params params_;
+  };
+
+  using SpaceUnion = std::variant<hnswlib::L2Space, hnswlib::InnerProductSpace, QuantizedSpace>;
+
+  static SpaceUnion MakeSpace(size_t dim, VectorSimilarity sim, VectorQuantization quantization) {
+    if (quantization != VectorQuantization::NONE)
+      return QuantizedSpace{dim, sim, quantization};
     if (sim == VectorSimilarity::L2)
       return hnswlib::L2Space{dim};
     else
       return hnswlib::InnerProductSpace{dim};
   }
 
+  // Returns the vector in the layout of the space. Non quantized vectors are referenced as is.
+  string_view Quantize(const float* data) {
+    if (quantization_ == VectorQuantization::NONE)
+      return {reinterpret_cast<const char*>(data), dim_ * sizeof(float)};
+
+    quantized_buf_.resize(QuantizedVectorSize(dim_, quantization_));
+    QuantizeVector(data, dim_, quantization_, quantized_buf_.data());
+    return quantized_buf_;
+  }
+
   hnswlib::SpaceInterface<float>* GetSpacePtr() {
     return visit([](auto& space) -> hnswlib::SpaceInterface<float>* { return &space; }, space_);
   }
 
+  // Graph traversal with a selective filter visits mostly disallowed nodes and can miss allowed
+  // ones entirely, so few allowed documents are cheaper and more precise to scan exactly.
+  bool PreferExactScan(size_t num_allowed, size_t k, size_t ef) const {
+    constexpr size_t kExactScanFactor = 16;       // of max(k, ef)
+    constexpr size_t kExactScanSelectivity = 50;  // 2% of all elements
+    return num_allowed <= max(k, ef) * kExactScanFactor ||
+           num_allowed * kExactScanSelectivity <= world_.cur_element_count;
+  }
+
+  // Computes the distances to all allowed documents that have vectors in the graph
+  vector<pair<float, DocId>> ExactKnn(float* target, size_t k, const vector<DocId>& allowed) {
+    const char* query = Quantize(target).data();
+    vector<pair<float, DocId>> out;
+    out.reserve(allowed.size());
+    for (DocId id : allowed) {
+      auto it = world_.label_lookup_.find(id);
+      if (it == world_.label_lookup_.end() || world_.isMarkedDeleted(it->second))
+        continue;
+      const char* data = world_.getDataByInternalId(it->second);
+      out.emplace_back(world_.fstdistfunc_(query, data, world_.dist_func_param_), id);
+    }
+
+    size_t prefix_size = min(k, out.size());
+    partial_sort(out.begin(), out.begin() + prefix_size, out.end());
+    out.resize(prefix_size);
+    return out;
+  }
+
   template <typename Q> static vector<pair<float, DocId>> QueueToVec(Q queue) {
     vector<pair<float, DocId>> out(queue.size());
     size_t idx = out.size();
@@ -574,6 +798,9 @@ struct HnswlibAdapter {
     return out;
   }
 
+  size_t dim_;
+  VectorQuantization quantization_;
+  std::string quantized_buf_;
   SpaceUnion space_;
   hnswlib::HierarchicalNSW<float> world_;
 };
@@ -588,9 +815,39 @@ HnswVectorIndex::~HnswVectorIndex() {
 }
 
 void HnswVectorIndex::AddVector(DocId id, const VectorPtr& vector) {
-  if (vector) {
-    adapter_->Add(vector.get(), id);
+  if (!vector)
+    return;
+
+  if (readded_ && id < readded_->size()) {
+    (*readded_)[id] = true;
+    if (adapter_->HasVector(id, vector.get()))
+      return;
+  }
+  adapter_->Add(vector.get(), id);
+}
+
+string HnswVectorIndex::Serialize() const {
+  return adapter_->Serialize();
+}
+
+bool HnswVectorIndex::Restore(string_view data) {
+  auto labels = adapter_->Restore(data);
+  if (!labels)
+    return false;
+
+  readded_.emplace(labels->empty() ? 0 : *max_element(labels->begin(), labels->end()) + 1);
+  return true;
+}
+
+void HnswVectorIndex::FinishRestore() {
+  if (!readded_)
+    return;
+
+  for (DocId id = 0; id < readded_->size(); id++) {
+    if (!(*readded_)[id] && adapter_->Contains(id))
+      adapter_->Remove(id);
   }
+  readded_.reset();
 }
 
 std::vector<std::pair<float, DocId>> HnswVectorIndex::Knn(float* target, size_t k,
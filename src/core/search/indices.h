@@ -7,6 +7,7 @@
 #include <absl/container/btree_set.h>
 #include <absl/container/flat_hash_map.h>
 #include <absl/container/flat_hash_set.h>
+#include <absl/types/span.h>
 
 #include <map>
 #include <memory>
@@ -165,7 +166,15 @@ struct FlatVectorIndex : public BaseVectorIndex {
 
   void Remove(DocId id, const DocumentAccessor& doc, std::string_view field) override;
 
-  const float* Get(DocId doc) const;
+  // Returns the vector of the document in the layout of quantization().
+  const void* Get(DocId doc) const;
+
+  VectorQuantization quantization() const {
+    return quantization_;
+  }
+
+  // Computes the distances from target to the vectors of docs into out.
+  void Distances(const float* target, absl::Span<const DocId> docs, float* out) const;
 
   // Return all documents that have vectors in this index
   std::vector<DocId> GetAllDocsWithNonNullValues() const override;
@@ -174,7 +183,10 @@ struct FlatVectorIndex : public BaseVectorIndex {
   void AddVector(DocId id, const VectorPtr& vector) override;
 
  private:
+  VectorQuantization quantization_;
+  size_t stride_;  // number of floats reserved per vector in entries_.
   PMR_NS::vector<float> entries_;
+  PMR_NS::vector<float> norms_;  // vector norms, maintained for non quantized COSINE indices.
 };
 
 struct HnswlibAdapter;
@@ -189,6 +201,17 @@ struct HnswVectorIndex : public BaseVectorIndex {
   std::vector<std::pair<float, DocId>> Knn(float* target, size_t k, std::optional<size_t> ef,
                                            const std::vector<DocId>& allowed) const;
 
+  // Serializes the graph, so that it can be restored without inserting all vectors again.
+  std::string Serialize() const;
+
+  // Restores a graph serialized by an index with the same params into an empty index. Returns
+  // false if the data is malformed or doesn't match. Until FinishRestore is called, adding a
+  // document with the same vector as in the restored graph doesn't change the graph.
+  bool Restore(std::string_view data);
+
+  // Removes the restored documents that were not added again since Restore.
+  void FinishRestore();
+
   // TODO: Implement if needed
   std::vector<DocId> GetAllDocsWithNonNullValues() const override {
     return std::vector<DocId>{};
@@ -199,6 +222,7 @@ struct HnswVectorIndex : public BaseVectorIndex {
 
  private:
   std::unique_ptr<HnswlibAdapter> adapter_;
+  std::optional<std::vector<bool>> readded_;  // restored documents that were added again
 };
 
 }  // namespace dfly::search
@@ -0,0 +1,51 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/search/intersect.h"
+
+#include <absl/numeric/bits.h>
+
+#include "core/sse_port.h"
+
+namespace dfly::search {
+
+size_t IntersectSortedIds(const DocId* a, size_t na, const DocId* b, size_t nb, DocId* out) {
+  size_t i = 0, j = 0, k = 0;
+
+#ifndef __s390x__
+  // Compare 4 ids of a with all 4 rotations of 4 ids of b and advance the block that ends
+  // first, both if they end with the same id. Ids are unique, so every match is found once.
+  while (i + 4 <= na && j + 4 <= nb) {
+    __m128i va = mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+    __m128i vb = mm_loadu_si128(reinterpret_cast<const __m128i*>(b + j));
+
+    __m128i eq = _mm_cmpeq_epi32(va, vb);
+    eq = _mm_or_si128(eq, _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1))));
+    eq = _mm_or_si128(eq, _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))));
+    eq = _mm_or_si128(eq, _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3))));
+
+    for (unsigned mask = _mm_movemask_ps(_mm_castsi128_ps(eq)); mask; mask &= mask - 1)
+      out[k++] = a[i + absl::countr_zero(mask)];
+
+    DocId a_last = a[i + 3], b_last = b[j + 3];
+    i += a_last <= b_last ? 4 : 0;
+    j += b_last <= a_last ? 4 : 0;
+  }
+#endif
+
+  while (i < na && j < nb) {
+    if (a[i] < b[j]) {
+      i++;
+    } else if (b[j] < a[i]) {
+      j++;
+    } else {
+      out[k++] = a[i];
+      i++;
+      j++;
+    }
+  }
+  return k;
+}
+
+}  // namespace dfly::search
@@ -0,0 +1,18 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <cstddef>
+
+#include "core/search/base.h"
+
+namespace dfly::search {
+
+// Writes the ids present in both sorted unique arrays to out, which must have room for
+// min(na, nb) ids, and returns their number. Compares blocks of 4 ids against each other with
+// SIMD instead of branching on every id.
+size_t IntersectSortedIds(const DocId* a, size_t na, const DocId* b, size_t nb, DocId* out);
+
+}  // namespace dfly::search
@@ -77,7 +77,7 @@ RangeTree::RangeTree(PMR_NS::memory_resource* mr, size_t max_range_block_size)
     : max_range_block_size_(max_range_block_size), entries_(mr) {
   // TODO: at the beggining create more blocks
   entries_.insert({{-std::numeric_limits<RangeNumber>::infinity()},
-                   RangeBlock{entries_.get_allocator().resource(), max_range_block_size_}});
+                   RangeBlock{entries_.get_allocator().resource(), kBlockSize}});
 }
 
 void RangeTree::Add(DocId id, double value) {
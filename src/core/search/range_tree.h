@@ -23,7 +23,8 @@ class RangeResult;
 
    Internally, it uses absl::btree_map<std::pair<double, double>, RangeBlock>, where each key
    represents a numeric value range, and the corresponding RangeBlock (similar to std::vector)
-   stores (DocId, value) pairs, sorted by DocId.
+   stores (DocId, value) pairs, sorted by DocId. The pairs are kept compressed in small blocks of
+   kBlockSize entries and are decoded on the fly during range scans.
 
    The parameter `max_range_block_size_` defines the maximum number of entries in a single
    RangeBlock. When a block exceeds this limit, it is split into two to maintain balanced
@@ -36,7 +37,7 @@ class RangeTree {
   using RangeNumber = double;
   using Key = RangeNumber;
   using Entry = std::pair<DocId, double>;
-  using RangeBlock = BlockList<SortedVector<Entry>>;
+  using RangeBlock = BlockList<CompressedSortedEntries>;
   using Map = absl::btree_map<Key, RangeBlock, std::less<Key>,
                               PMR_NS::polymorphic_allocator<std::pair<const Key, RangeBlock>>>;
 
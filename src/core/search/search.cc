@@ -9,6 +9,7 @@
 #include <absl/strings/str_cat.h>
 #include <absl/strings/str_join.h>
 
+#include <array>
 #include <chrono>
 #include <type_traits>
 #include <variant>
@@ -19,6 +20,7 @@
 #include "core/search/ast_expr.h"
 #include "core/search/compressed_sorted_set.h"
 #include "core/search/indices.h"
+#include "core/search/intersect.h"
 #include "core/search/query_driver.h"
 #include "core/search/sort_indices.h"
 #include "core/search/tag_types.h"
@@ -186,6 +188,91 @@ struct ProfileBuilder {
   AlgorithmProfile profile_;
 };
 
+// Intersections switch from a linear merge to seeking when one set is that many times smaller
+constexpr size_t kSeekIntersectRatio = 16;
+
+// Advance it to the first id not less than id. Block lists skip whole blocks, vectors are
+// searched with binary search, other sets are stepped over.
+template <typename C, typename It> void SeekGE(const C& set, It* it, const It& end, DocId id) {
+  if constexpr (is_same_v<C, BlockList<CompressedSortedSet>> ||
+                is_same_v<C, BlockList<SortedVector<DocId>>>) {
+    it->SeekGE(id);
+  } else if constexpr (is_same_v<C, vector<DocId>>) {
+    *it = lower_bound(*it, end, id);
+  } else {
+    while (*it != end && **it < id)
+      ++*it;
+  }
+}
+
+template <typename S1, typename S2>
+void IntersectBySeek(const S1& small, const S2& large, vector<DocId>* out) {
+  auto it = large.begin();
+  const auto end = large.end();
+  for (DocId id : small) {
+    SeekGE(large, &it, end, id);
+    if (it == end)
+      break;
+    if (*it == id)
+      out->push_back(id);
+  }
+}
+
+// Sorted set of ids, decoded block by block into contiguous memory to be intersected with
+// IntersectSortedIds. Vectors are already contiguous and are not copied.
+template <typename S> class BlockCursor {
+ public:
+  static constexpr size_t kBlockSize = 128;
+
+  explicit BlockCursor(const S& set) : it_{set.begin()}, end_{set.end()} {
+    Next();
+  }
+
+  absl::Span<const DocId> Block() const {
+    return block_;
+  }
+
+  // Move to the next block, it's empty once the set is exhausted
+  void Next() {
+    if constexpr (is_same_v<S, vector<DocId>>) {
+      size_t len = min<size_t>(kBlockSize, end_ - it_);
+      block_ = {len ? &*it_ : nullptr, len};
+      it_ += len;
+    } else {
+      size_t len = 0;
+      for (; len < kBlockSize && it_ != end_; ++it_)
+        decoded_[len++] = *it_;
+      block_ = {decoded_.data(), len};
+    }
+  }
+
+ private:
+  decltype(declval<const S&>().begin()) it_, end_;
+  absl::Span<const DocId> block_;
+  array<DocId, kBlockSize> decoded_;
+};
+
+// Intersect the current blocks of both sets and advance the one that ends first, both if they
+// end with the same id
+template <typename S1, typename S2>
+void IntersectByBlocks(const S1& s1, const S2& s2, vector<DocId>* out) {
+  BlockCursor<S1> c1{s1};
+  BlockCursor<S2> c2{s2};
+  while (!c1.Block().empty() && !c2.Block().empty()) {
+    auto b1 = c1.Block(), b2 = c2.Block();
+    size_t pos = out->size();
+    out->resize(pos + min(b1.size(), b2.size()));
+    out->resize(pos + IntersectSortedIds(b1.data(), b1.size(), b2.data(), b2.size(),
+                                         out->data() + pos));
+
+    DocId last1 = b1.back(), last2 = b2.back();
+    if (last1 <= last2)
+      c1.Next();
+    if (last2 <= last1)
+      c2.Next();
+  }
+}
+
 struct BasicSearch {
   using LogicOp = AstLogicalNode::LogicOp;
 
@@ -249,7 +336,13 @@ struct BasicSearch {
     if (op == LogicOp::AND) {
       tmp_vec_.reserve(min(matched.Size(), current.Size()));
       auto cb = [this](auto* s1, auto* s2) {
-        set_intersection(s1->begin(), s1->end(), s2->begin(), s2->end(), back_inserter(tmp_vec_));
+        // Seek the ids of a much smaller set in the larger one instead of scanning all of it
+        if (s1->size() * kSeekIntersectRatio < s2->size())
+          IntersectBySeek(*s1, *s2, &tmp_vec_);
+        else if (s2->size() * kSeekIntersectRatio < s1->size())
+          IntersectBySeek(*s2, *s1, &tmp_vec_);
+        else
+          IntersectByBlocks(*s1, *s2, &tmp_vec_);
       };
       visit(cb, matched.Borrowed(), current.Borrowed());
     } else {
@@ -419,14 +512,29 @@ struct BasicSearch {
 
   void SearchKnnFlat(FlatVectorIndex* vec_index, const AstKnnNode& knn, IndexResult&& sub_results) {
     knn_distances_.reserve(sub_results.Size());
+
+    // Distances are computed in batches of matched documents.
+    constexpr size_t kBatch = 256;
+    DocId docs[kBatch];
+    float distances[kBatch];
+    size_t num_docs = 0;
+
+    auto flush = [&] {
+      vec_index->Distances(knn.vec.first.get(), {docs, num_docs}, distances);
+      for (size_t i = 0; i < num_docs; i++)
+        knn_distances_.emplace_back(distances[i], docs[i]);
+      num_docs = 0;
+    };
+
     auto cb = [&](auto* set) {
-      auto [dim, sim] = vec_index->Info();
       for (DocId matched_doc : *set) {
-        float dist = VectorDistance(knn.vec.first.get(), vec_index->Get(matched_doc), dim, sim);
-        knn_distances_.emplace_back(dist, matched_doc);
+        docs[num_docs++] = matched_doc;
+        if (num_docs == kBatch)
+          flush();
       }
     };
     visit(cb, sub_results.Borrowed());
+    flush();
 
     size_t prefix_size = min(knn.limit, knn_distances_.size());
     partial_sort(knn_distances_.begin(), knn_distances_.begin() + prefix_size,
@@ -660,6 +768,55 @@ void FieldIndices::Remove(DocId doc, const DocumentAccessor& access) {
   all_ids_.erase(it);
 }
 
+bool FieldIndices::Update(DocId doc, const DocumentAccessor& old_access,
+                          const DocumentAccessor& new_access,
+                          absl::Span<const std::string_view> fields) {
+  std::vector<std::pair<std::string_view, BaseIndex*>> field_indices;
+  field_indices.reserve(fields.size() * 2);
+  for (string_view field : fields) {
+    if (auto it = indices_.find(field); it != indices_.end())
+      field_indices.emplace_back(it->first, it->second.get());
+    if (auto it = sort_indices_.find(field); it != sort_indices_.end())
+      field_indices.emplace_back(it->first, it->second.get());
+  }
+
+  // Remove all old values first, so that on failure indices hold only new values
+  for (auto& [field, index] : field_indices)
+    index->Remove(doc, old_access, field);
+
+  size_t added = 0;
+  while (added < field_indices.size()) {
+    auto& [field, index] = field_indices[added];
+    if (!index->Add(doc, new_access, field))
+      break;
+    added++;
+  }
+
+  if (added == field_indices.size())
+    return true;
+
+  // Unchanged fields have the same values in both accessors, so everything but the fields that
+  // were not added yet is removed with the new values
+  auto is_pending = [&](BaseIndex* index) {
+    return find_if(field_indices.begin() + added, field_indices.end(),
+                   [index](const auto& entry) { return entry.second == index; }) !=
+           field_indices.end();
+  };
+  for (auto& [field, index] : indices_) {
+    if (!is_pending(index.get()))
+      index->Remove(doc, new_access, field);
+  }
+  for (auto& [field, sort_index] : sort_indices_) {
+    if (!is_pending(sort_index.get()))
+      sort_index->Remove(doc, new_access, field);
+  }
+
+  auto it = lower_bound(all_ids_.begin(), all_ids_.end(), doc);
+  DCHECK(it != all_ids_.end() && *it == doc);
+  all_ids_.erase(it);
+  return false;
+}
+
 BaseIndex* FieldIndices::GetIndex(string_view field) const {
   auto it = indices_.find(schema_.LookupAlias(field));
   return it != indices_.end() ? it->second.get() : nullptr;
@@ -6,6 +6,7 @@
 
 #include <absl/container/flat_hash_map.h>
 #include <absl/container/flat_hash_set.h>
+#include <absl/types/span.h>
 
 #include <functional>
 #include <memory>
@@ -37,6 +38,7 @@ struct SchemaField {
     size_t capacity = 1000;                       // initial capacity
     size_t hnsw_ef_construction = 200;
     size_t hnsw_m = 16;
+    VectorQuantization quantization = VectorQuantization::NONE;
   };
 
   struct TagParams {
@@ -100,6 +102,11 @@ class FieldIndices {
   bool Add(DocId doc, const DocumentAccessor& access);
   void Remove(DocId doc, const DocumentAccessor& access);
 
+  // Reindexes only the given fields of an added document, old_access provides their previous
+  // values. Returns false and removes the document if the new values can't be indexed.
+  bool Update(DocId doc, const DocumentAccessor& old_access, const DocumentAccessor& new_access,
+              absl::Span<const std::string_view> fields);
+
   BaseIndex* GetIndex(std::string_view field) const;
   BaseSortIndex* GetSortIndex(std::string_view field) const;
   std::vector<TextIndex*> GetAllTextIndices() const;
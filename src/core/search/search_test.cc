@@ -21,6 +21,7 @@
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "core/search/base.h"
+#include "core/search/intersect.h"
 #include "core/search/query_driver.h"
 #include "core/search/vector_utils.h"
 
@@ -506,6 +507,66 @@ TEST_F(SearchTest, StopWords) {
   EXPECT_THAT(algo.Search(&indices).ids, testing::UnorderedElementsAre(1, 3));
 }
 
+TEST_F(SearchTest, IntersectSkewedSets) {
+  auto schema = MakeSimpleSchema(
+      {{"title", SchemaField::TEXT}, {"tag", SchemaField::TAG}, {"num", SchemaField::NUMERIC}});
+  FieldIndices indices{schema, kEmptyOptions, PMR_NS::get_default_resource(), nullptr};
+
+  // Rare terms are intersected with common ones by seeking into them
+  vector<DocId> rare, rare_even, rare_low;
+  for (DocId i = 0; i < 20000; i++) {
+    bool is_rare = i % 97 == 0;
+    MockedDocument doc{{{"title", is_rare ? "common rare" : "common"},
+                        {"tag", i % 2 ? "odd" : "even"},
+                        {"num", absl::StrCat(i)}}};
+    indices.Add(i, doc);
+    if (is_rare) {
+      rare.push_back(i);
+      if (i % 2 == 0)
+        rare_even.push_back(i);
+      if (i < 5000)
+        rare_low.push_back(i);
+    }
+  }
+
+  SearchAlgorithm algo{};
+  QueryParams params;
+
+  algo.Init("common rare", &params);
+  EXPECT_THAT(algo.Search(&indices).ids, testing::UnorderedElementsAreArray(rare));
+
+  algo.Init("rare @tag:{even}", &params);
+  EXPECT_THAT(algo.Search(&indices).ids, testing::UnorderedElementsAreArray(rare_even));
+
+  algo.Init("@num:[0 4999] rare", &params);
+  EXPECT_THAT(algo.Search(&indices).ids, testing::UnorderedElementsAreArray(rare_low));
+
+  algo.Init("@tag:{even} @num:[0 4999] rare", &params);
+  EXPECT_THAT(algo.Search(&indices).ids,
+              testing::UnorderedElementsAre(0, 194, 388, 582, 776, 970, 1164, 1358, 1552, 1746,
+                                            1940, 2134, 2328, 2522, 2716, 2910, 3104, 3298, 3492,
+                                            3686, 3880, 4074, 4268, 4462, 4656, 4850));
+}
+
+TEST_F(SearchTest, IntersectSortedIds) {
+  default_random_engine rnd{42};
+  for (unsigned i = 0; i < 1000; i++) {
+    vector<DocId> a, b;
+    DocId range = rnd() % 500;
+    for (DocId id = 0; id < range; id++) {
+      if (rnd() % 3 == 0)
+        a.push_back(id);
+      if (rnd() % (1 + i % 5) == 0)
+        b.push_back(id);
+    }
+
+    vector<DocId> expected, out(min(a.size(), b.size()));
+    set_intersection(a.begin(), a.end(), b.begin(), b.end(), back_inserter(expected));
+    out.resize(IntersectSortedIds(a.data(), a.size(), b.data(), b.size(), out.data()));
+    EXPECT_EQ(out, expected) << i;
+  }
+}
+
 class SearchRaxTest
     : public SearchTest,
       public testing::WithParamInterface<pair<bool /* build suffix trie */, bool /* tag index */>> {
@@ -703,6 +764,37 @@ TEST_P(KnnTest, Simple1D) {
   }
 }
 
+TEST_P(KnnTest, SelectiveFilters) {
+  auto schema = MakeSimpleSchema({{"tag", SchemaField::TAG}, {"pos", SchemaField::VECTOR}});
+  schema.fields["pos"].special_params = SchemaField::VectorParams{GetParam(), 1};
+  FieldIndices indices{schema, kEmptyOptions, PMR_NS::get_default_resource(), nullptr};
+
+  for (size_t i = 0; i < 3000; i++) {
+    string tags = i % 3 == 0 ? "third" : "other";
+    if (i % 500 == 0)
+      tags += ",rare";
+    MockedDocument doc{Map{{"tag", tags}, {"pos", ToBytes({float(i)})}}};
+    indices.Add(i, doc);
+  }
+
+  SearchAlgorithm algo{};
+  QueryParams params;
+
+  // Every third document is allowed, searched with the filtered graph traversal
+  {
+    params["vec"] = ToBytes({1500.5});
+    algo.Init("@tag:{third} =>[KNN 4 @pos $vec]", &params);
+    EXPECT_THAT(algo.Search(&indices).ids, testing::UnorderedElementsAre(1497, 1500, 1503, 1506));
+  }
+
+  // Only six documents are allowed, they are scanned exactly
+  {
+    params["vec"] = ToBytes({1200.0});
+    algo.Init("@tag:{rare} =>[KNN 2 @pos $vec]", &params);
+    EXPECT_THAT(algo.Search(&indices).ids, testing::UnorderedElementsAre(1000, 1500));
+  }
+}
+
 TEST_P(KnnTest, Simple2D) {
   // Square:
   // 3      2
@@ -876,6 +968,31 @@ TEST_P(KnnTest, AutoResize) {
   EXPECT_EQ(indices.GetAllDocs().size(), 100);
 }
 
+TEST_P(KnnTest, Quantized) {
+  for (auto quantization : {VectorQuantization::FLOAT16, VectorQuantization::INT8}) {
+    auto schema = MakeSimpleSchema({{"pos", SchemaField::VECTOR}});
+    SchemaField::VectorParams vparams{GetParam(), 4};
+    vparams.quantization = quantization;
+    schema.fields["pos"].special_params = vparams;
+    FieldIndices indices{schema, kEmptyOptions, PMR_NS::get_default_resource(), nullptr};
+
+    for (size_t i = 0; i < 20; i++) {
+      MockedDocument doc{Map{{"pos", ToBytes({i * 10.0f, 0, 0, 5})}}};
+      indices.Add(i, doc);
+    }
+
+    SearchAlgorithm algo{};
+    QueryParams params;
+    for (size_t i = 1; i < 19; i++) {
+      params["vec"] = ToBytes({i * 10.0f + 1, 0, 0, 5});
+      algo.Init("* =>[KNN 3 @pos $vec]", &params);
+      auto ids = algo.Search(&indices).ids;
+      ASSERT_THAT(ids, testing::UnorderedElementsAre(i - 1, i, i + 1)) << int(quantization);
+      EXPECT_EQ(ids.front(), i);
+    }
+  }
+}
+
 INSTANTIATE_TEST_SUITE_P(KnnFlat, KnnTest, testing::Values(false));
 INSTANTIATE_TEST_SUITE_P(KnnHnsw, KnnTest, testing::Values(true));
 
@@ -1212,6 +1329,50 @@ static std::vector<float> GenerateRandomVector(size_t dims, unsigned seed = 42)
   return vec;
 }
 
+TEST_F(SearchTest, QuantizedVectorDistance) {
+  std::vector<float> vec1 = GenerateRandomVector(100, 1);
+  std::vector<float> vec2 = GenerateRandomVector(100, 2);
+
+  for (auto quantization : {VectorQuantization::FLOAT16, VectorQuantization::INT8}) {
+    std::string quantized(QuantizedVectorSize(100, quantization), '\0');
+    QuantizeVector(vec2.data(), 100, quantization, quantized.data());
+
+    std::vector<float> restored(100);
+    DequantizeVector(quantized.data(), 100, quantization, restored.data());
+    for (size_t i = 0; i < 100; i++)
+      EXPECT_NEAR(vec2[i], restored[i], 0.01) << i;
+
+    for (auto sim : {VectorSimilarity::L2, VectorSimilarity::COSINE}) {
+      float exact = VectorDistance(vec1.data(), vec2.data(), 100, sim);
+      float dist = VectorDistance(vec1.data(), quantized.data(), 100, sim, quantization);
+      EXPECT_NEAR(exact, dist, exact * 0.01);
+    }
+  }
+}
+
+TEST_F(SearchTest, VectorDistancesBatch) {
+  constexpr size_t kDims = 37;
+  std::vector<float> query = GenerateRandomVector(kDims, 1);
+
+  std::vector<std::vector<float>> vectors;
+  std::vector<const float*> ptrs;
+  std::vector<float> norms;
+  for (unsigned i = 0; i < 10; i++) {
+    vectors.push_back(GenerateRandomVector(kDims, i + 2));
+    ptrs.push_back(vectors.back().data());
+    norms.push_back(VectorNorm(ptrs.back(), kDims));
+  }
+
+  std::vector<float> out(vectors.size());
+  for (auto sim : {VectorSimilarity::L2, VectorSimilarity::COSINE}) {
+    for (const float* v_norms : {static_cast<const float*>(nullptr), norms.data()}) {
+      VectorDistances(query.data(), ptrs.data(), v_norms, ptrs.size(), kDims, sim, out.data());
+      for (size_t i = 0; i < vectors.size(); i++)
+        EXPECT_NEAR(out[i], VectorDistance(query.data(), ptrs[i], kDims, sim), 1e-5) << i;
+    }
+  }
+}
+
 // Benchmark vector distance calculation (parametrized by similarity type)
 static void BM_VectorDistance(benchmark::State& state) {
   size_t dims = state.range(0);
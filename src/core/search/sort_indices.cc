@@ -18,7 +18,13 @@ namespace dfly::search {
 
 using namespace std;
 
-namespace {}  // namespace
+namespace {
+
+// Walking the sorted docs is preferred if it's expected to take that many times less steps than
+// the number of ids to sort
+constexpr size_t kWalkInOrderFactor = 8;
+
+}  // namespace
 
 template <typename T> bool SimpleValueSortIndex<T>::ParsedSortValue::HasValue() const {
   return !std::holds_alternative<std::monostate>(value);
@@ -30,7 +36,15 @@ template <typename T> bool SimpleValueSortIndex<T>::ParsedSortValue::IsNullValue
 
 template <typename T>
 SimpleValueSortIndex<T>::SimpleValueSortIndex(PMR_NS::memory_resource* mr)
-    : values_{mr}, null_values_(mr) {
+    : values_{mr}, has_value_(mr), ordered_{ValueOrder{&values_}, mr}, null_values_(mr) {
+}
+
+template <typename T> bool SimpleValueSortIndex<T>::ValueOrder::operator()(DocId l, DocId r) const {
+  const T& lv = (*values)[l];
+  const T& rv = (*values)[r];
+  if (lv != rv)
+    return lv < rv;
+  return l < r;
 }
 
 template <typename T> SortableValue SimpleValueSortIndex<T>::Lookup(DocId doc) const {
@@ -49,16 +63,64 @@ template <typename T> SortableValue SimpleValueSortIndex<T>::Lookup(DocId doc) c
 template <typename T>
 std::vector<SortableValue> SimpleValueSortIndex<T>::Sort(std::vector<DocId>* ids, size_t limit,
                                                          bool desc) const {
+  if (auto top = WalkInOrder(*ids, limit, desc); top) {
+    *ids = std::move(*top);
+    return GetValues(*ids);
+  }
+
   auto cb = [this, desc](const auto& lhs, const auto& rhs) {
     return desc ? (values_[lhs] > values_[rhs]) : (values_[lhs] < values_[rhs]);
   };
   std::partial_sort(ids->begin(), ids->begin() + std::min(ids->size(), limit), ids->end(), cb);
+  return GetValues(absl::MakeSpan(*ids).first(min(ids->size(), limit)));
+}
 
+// If the ids match most of the documents, the first few of them in value order are likely to be
+// matches, so finding the top ones that way scales with the limit instead of the number of matches
+template <typename T>
+std::optional<std::vector<DocId>> SimpleValueSortIndex<T>::WalkInOrder(
+    const std::vector<DocId>& ids, size_t limit, bool desc) const {
+  if (limit >= ids.size() || limit * ordered_.size() * kWalkInOrderFactor > ids.size() * ids.size())
+    return std::nullopt;
+
+  // Docs without value are ordered as T{} by the partial sort, so leave them to it
+  vector<bool> matched(values_.size());
+  for (DocId id : ids) {
+    if (id >= has_value_.size() || !has_value_[id])
+      return std::nullopt;
+    matched[id] = true;
+  }
+
+  // Stop if the matches are concentrated at the other end and fall back to the partial sort
+  vector<DocId> top;
+  top.reserve(limit);
+  auto walk = [&](auto begin, auto end) {
+    size_t steps = 0;
+    for (auto it = begin; it != end && top.size() < limit; ++it) {
+      if (++steps > ids.size())
+        return false;
+      if (matched[*it])
+        top.push_back(*it);
+    }
+    return true;
+  };
+
+  bool finished =
+      desc ? walk(ordered_.rbegin(), ordered_.rend()) : walk(ordered_.begin(), ordered_.end());
+  if (!finished)
+    return std::nullopt;
+
+  DCHECK_EQ(top.size(), limit);
+  return top;
+}
+
+template <typename T>
+std::vector<SortableValue> SimpleValueSortIndex<T>::GetValues(absl::Span<const DocId> ids) const {
   // Turn PMR string into std::string
   using ScoreT = std::conditional_t<is_same_v<T, PMR_NS::string>, std::string, T>;
-  vector<SortableValue> out(min(ids->size(), limit));
+  vector<SortableValue> out(ids.size());
   for (size_t i = 0; i < out.size(); i++)
-    out[i] = ScoreT{values_[(*ids)[i]]};
+    out[i] = ScoreT{values_[ids[i]]};
   return out;
 }
 
@@ -74,10 +136,18 @@ bool SimpleValueSortIndex<T>::Add(DocId id, const DocumentAccessor& doc, std::st
     return true;
   }
 
-  if (id >= values_.size())
+  if (id >= values_.size()) {
     values_.resize(id + 1);
+    has_value_.resize(id + 1);
+  }
+
+  // The position in ordered_ depends on the value, so it has to be removed before any update
+  if (has_value_[id])
+    ordered_.erase(id);
 
   values_[id] = std::move(std::get<T>(field_value.value));
+  has_value_[id] = true;
+  ordered_.insert(id);
   return true;
 }
 
@@ -90,6 +160,10 @@ void SimpleValueSortIndex<T>::Remove(DocId id, const DocumentAccessor& doc,
   }
 
   DCHECK_LT(id, values_.size());
+  if (has_value_[id]) {
+    ordered_.erase(id);
+    has_value_[id] = false;
+  }
   values_[id] = T{};
 }
 
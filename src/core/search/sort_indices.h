@@ -36,6 +36,8 @@ template <typename T> struct SimpleValueSortIndex : public BaseSortIndex {
   SimpleValueSortIndex(PMR_NS::memory_resource* mr);
 
   SortableValue Lookup(DocId doc) const override;
+
+  // Uses partial sort, or walks docs in value order if the ids cover most of them
   std::vector<SortableValue> Sort(std::vector<DocId>* ids, size_t limit, bool desc) const override;
 
   bool Add(DocId id, const DocumentAccessor& doc, std::string_view field) override;
@@ -50,7 +52,21 @@ template <typename T> struct SimpleValueSortIndex : public BaseSortIndex {
   PMR_NS::memory_resource* GetMemRes() const;
 
  private:
+  // Orders docs by (value, id), values are looked up in values_
+  struct ValueOrder {
+    bool operator()(DocId l, DocId r) const;
+    const PMR_NS::vector<T>* values;
+  };
+
+  // Collect top ids by walking ordered_, nullopt if it's not applicable or takes too long
+  std::optional<std::vector<DocId>> WalkInOrder(const std::vector<DocId>& ids, size_t limit,
+                                                bool desc) const;
+
+  std::vector<SortableValue> GetValues(absl::Span<const DocId> ids) const;
+
   PMR_NS::vector<T> values_;
+  std::vector<bool, PMR_NS::polymorphic_allocator<bool>> has_value_;
+  absl::btree_set<DocId, ValueOrder, PMR_NS::polymorphic_allocator<DocId>> ordered_;
   UniqueDocsList<PMR_NS::polymorphic_allocator<DocId>> null_values_;
 };
 
@@ -4,7 +4,13 @@
 
 #include "core/search/vector_utils.h"
 
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <memory>
 
 #include "base/logging.h"
@@ -21,8 +27,16 @@ namespace {
 #define FAST_MATH
 #endif
 
+// The kernels are compiled for AVX-512 and AVX2 as well and the best version for the running
+// CPU is picked by the dynamic loader. On arm, NEON is already part of the baseline.
+#if defined(__x86_64__) && defined(__linux__)
+#define SIMD_KERNEL __attribute__((target_clones("arch=skylake-avx512", "arch=haswell", "default")))
+#else
+#define SIMD_KERNEL
+#endif
+
 // Euclidean vector distance: sqrt( sum: (u[i] - v[i])^2  )
-FAST_MATH float L2Distance(const float* u, const float* v, size_t dims) {
+FAST_MATH SIMD_KERNEL float L2Distance(const float* u, const float* v, size_t dims) {
   float sum = 0;
   for (size_t i = 0; i < dims; i++)
     sum += (u[i] - v[i]) * (u[i] - v[i]);
@@ -30,7 +44,7 @@ FAST_MATH float L2Distance(const float* u, const float* v, size_t dims) {
 }
 
 // TODO: Normalize vectors ahead if cosine distance is used
-FAST_MATH float CosineDistance(const float* u, const float* v, size_t dims) {
+FAST_MATH SIMD_KERNEL float CosineDistance(const float* u, const float* v, size_t dims) {
   float sum_uv = 0, sum_uu = 0, sum_vv = 0;
   for (size_t i = 0; i < dims; i++) {
     sum_uv += u[i] * v[i];
@@ -43,6 +57,137 @@ FAST_MATH float CosineDistance(const float* u, const float* v, size_t dims) {
   return 0.0f;
 }
 
+// Values are decoded and compared in blocks of this size, so that the inner loops work on
+// plain floats and get vectorized.
+constexpr size_t kDecodeBlock = 64;
+
+// IEEE 754 binary16 conversions with round to nearest even.
+uint16_t FloatToHalf(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  uint16_t sign = (bits >> 16) & 0x8000;
+  uint32_t magnitude = bits & 0x7fffffff;
+
+  if (magnitude > 0x7f800000)  // NaN
+    return sign | 0x7e00;
+  if (magnitude >= 0x477ff000)  // rounds to infinity
+    return sign | 0x7c00;
+  if (magnitude < 0x38800000) {  // subnormal half, the unit is 2^-24
+    float abs_value;
+    memcpy(&abs_value, &magnitude, sizeof(magnitude));
+    return sign | uint16_t(lrintf(abs_value * 0x1p24f));
+  }
+
+  // Rebias the exponent from 127 to 15 and round the 13 dropped mantissa bits.
+  magnitude += 0xc8000fff + ((magnitude >> 13) & 1);
+  return sign | uint16_t(magnitude >> 13);
+}
+
+float HalfToFloat(uint16_t half) {
+  uint32_t sign = uint32_t(half & 0x8000) << 16;
+  uint32_t exp = (half >> 10) & 0x1f;
+  uint32_t mant = half & 0x3ff;
+
+  uint32_t bits;
+  if (exp == 0) {
+    float value = mant * 0x1p-24f;
+    memcpy(&bits, &value, sizeof(bits));
+  } else if (exp == 0x1f) {
+    bits = 0x7f800000 | (mant << 13);
+  } else {
+    bits = ((exp + 112) << 23) | (mant << 13);
+  }
+  bits |= sign;
+
+  float res;
+  memcpy(&res, &bits, sizeof(res));
+  return res;
+}
+
+void HalfsToFloats(const uint16_t* src, size_t n, float* dest) {
+  size_t i = 0;
+#if defined(__F16C__)
+  for (; i + 8 <= n; i += 8) {
+    __m128i halfs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm256_storeu_ps(dest + i, _mm256_cvtph_ps(halfs));
+  }
+#endif
+  for (; i < n; ++i) {
+    uint16_t half;
+    memcpy(&half, src + i, sizeof(half));
+    dest[i] = HalfToFloat(half);
+  }
+}
+
+FAST_MATH SIMD_KERNEL void BytesToFloats(const int8_t* src, size_t n, float scale, float* dest) {
+  for (size_t i = 0; i < n; ++i)
+    dest[i] = scale * src[i];
+}
+
+// Returns values [offset, offset + n) of the quantized vector v, decoding them to buf if needed.
+const float* DecodeBlock(const void* v, size_t offset, size_t n, VectorQuantization quantization,
+                         float* buf) {
+  switch (quantization) {
+    case VectorQuantization::NONE:
+      return static_cast<const float*>(v) + offset;
+    case VectorQuantization::FLOAT16:
+      HalfsToFloats(static_cast<const uint16_t*>(v) + offset, n, buf);
+      return buf;
+    case VectorQuantization::INT8: {
+      float scale;
+      memcpy(&scale, v, sizeof(scale));
+      BytesToFloats(static_cast<const int8_t*>(v) + sizeof(float) + offset, n, scale, buf);
+      return buf;
+    }
+  }
+  return buf;
+}
+
+struct DistanceSums {
+  float l2 = 0;  // sum: (u[i] - v[i])^2
+  float uv = 0, uu = 0, vv = 0;
+};
+
+FAST_MATH SIMD_KERNEL void AccumulateSums(const float* u, const float* v, size_t n, VectorSimilarity sim,
+                              DistanceSums* sums) {
+  if (sim == VectorSimilarity::L2) {
+    float l2 = 0;
+    for (size_t i = 0; i < n; i++)
+      l2 += (u[i] - v[i]) * (u[i] - v[i]);
+    sums->l2 += l2;
+  } else {
+    float uv = 0, uu = 0, vv = 0;
+    for (size_t i = 0; i < n; i++) {
+      uv += u[i] * v[i];
+      uu += u[i] * u[i];
+      vv += v[i] * v[i];
+    }
+    sums->uv += uv;
+    sums->uu += uu;
+    sums->vv += vv;
+  }
+}
+
+DistanceSums QuantizedSums(const void* u, VectorQuantization u_quantization, const void* v,
+                           VectorQuantization v_quantization, size_t dims, VectorSimilarity sim) {
+  float u_buf[kDecodeBlock], v_buf[kDecodeBlock];
+  DistanceSums sums;
+  for (size_t offset = 0; offset < dims; offset += kDecodeBlock) {
+    size_t n = min(kDecodeBlock, dims - offset);
+    const float* u_block = DecodeBlock(u, offset, n, u_quantization, u_buf);
+    const float* v_block = DecodeBlock(v, offset, n, v_quantization, v_buf);
+    AccumulateSums(u_block, v_block, n, sim, &sums);
+  }
+  return sums;
+}
+
+FAST_MATH SIMD_KERNEL float DotProduct(const float* u, const float* v, size_t dims) {
+  float sum = 0;
+  for (size_t i = 0; i < dims; i++)
+    sum += u[i] * v[i];
+  return sum;
+}
+
 OwnedFtVector ConvertToFtVector(string_view value) {
   // Value cannot be casted directly as it might be not aligned as a float (4 bytes).
   // Misaligned memory access is UB.
@@ -77,4 +222,95 @@ float VectorDistance(const float* u, const float* v, size_t dims, VectorSimilari
   return 0.0f;
 }
 
+float VectorNorm(const float* v, size_t dims) {
+  return sqrt(DotProduct(v, v, dims));
+}
+
+void VectorDistances(const float* u, const float* const* vs, const float* v_norms, size_t n,
+                     size_t dims, VectorSimilarity sim, float* out) {
+  float u_norm = sim == VectorSimilarity::COSINE && v_norms ? VectorNorm(u, dims) : 0;
+  for (size_t i = 0; i < n; ++i) {
+    if (i + 2 < n)
+      __builtin_prefetch(vs[i + 2], 0, 1);
+
+    if (sim == VectorSimilarity::COSINE && v_norms) {
+      float denom = u_norm * v_norms[i];
+      out[i] = denom != 0.0f ? 1 - DotProduct(u, vs[i], dims) / denom : 0.0f;
+    } else {
+      out[i] = VectorDistance(u, vs[i], dims, sim);
+    }
+  }
+}
+
+size_t QuantizedVectorSize(size_t dims, VectorQuantization quantization) {
+  switch (quantization) {
+    case VectorQuantization::NONE:
+      return dims * sizeof(float);
+    case VectorQuantization::FLOAT16:
+      return dims * sizeof(uint16_t);
+    case VectorQuantization::INT8:
+      return sizeof(float) + dims;
+  }
+  return 0;
+}
+
+void QuantizeVector(const float* src, size_t dims, VectorQuantization quantization, void* dest) {
+  switch (quantization) {
+    case VectorQuantization::NONE:
+      memcpy(dest, src, dims * sizeof(float));
+      break;
+    case VectorQuantization::FLOAT16: {
+      uint8_t* out = static_cast<uint8_t*>(dest);
+      for (size_t i = 0; i < dims; ++i) {
+        uint16_t half = FloatToHalf(src[i]);
+        memcpy(out + i * sizeof(half), &half, sizeof(half));
+      }
+      break;
+    }
+    case VectorQuantization::INT8: {
+      float max_abs = 0;
+      for (size_t i = 0; i < dims; ++i)
+        max_abs = max(max_abs, fabsf(src[i]));
+
+      float scale = max_abs / 127;
+      float inv_scale = scale > 0 ? 1 / scale : 0;
+      memcpy(dest, &scale, sizeof(scale));
+
+      int8_t* out = static_cast<int8_t*>(dest) + sizeof(float);
+      for (size_t i = 0; i < dims; ++i)
+        out[i] = clamp<long>(lrintf(src[i] * inv_scale), -127, 127);
+      break;
+    }
+  }
+}
+
+void DequantizeVector(const void* src, size_t dims, VectorQuantization quantization, float* dest) {
+  for (size_t offset = 0; offset < dims; offset += kDecodeBlock) {
+    size_t n = min(kDecodeBlock, dims - offset);
+    const float* block = DecodeBlock(src, offset, n, quantization, dest + offset);
+    if (block != dest + offset)
+      memcpy(dest + offset, block, n * sizeof(float));
+  }
+}
+
+float VectorDistance(const float* u, const void* v, size_t dims, VectorSimilarity sim,
+                     VectorQuantization quantization) {
+  if (quantization == VectorQuantization::NONE)
+    return VectorDistance(u, static_cast<const float*>(v), dims, sim);
+
+  DistanceSums sums = QuantizedSums(u, VectorQuantization::NONE, v, quantization, dims, sim);
+  if (sim == VectorSimilarity::L2)
+    return sqrt(sums.l2);
+
+  if (float denom = sums.uu * sums.vv; denom != 0.0f)
+    return 1 - sums.uv / sqrt(denom);
+  return 0.0f;
+}
+
+float QuantizedSpaceDistance(const void* u, const void* v, size_t dims, VectorSimilarity sim,
+                             VectorQuantization quantization) {
+  DistanceSums sums = QuantizedSums(u, quantization, v, quantization, dims, sim);
+  return sim == VectorSimilarity::L2 ? sums.l2 : 1 - sums.uv;
+}
+
 }  // namespace dfly::search
@@ -16,4 +16,29 @@ std::optional<OwnedFtVector> BytesToFtVectorSafe(std::string_view value);
 
 float VectorDistance(const float* u, const float* v, size_t dims, VectorSimilarity sim);
 
+float VectorNorm(const float* v, size_t dims);
+
+// Computes the distances from u to the n vectors vs into out. v_norms, if not null, holds the
+// precomputed norms of the vectors, so that COSINE needs a single dot product per vector.
+void VectorDistances(const float* u, const float* const* vs, const float* v_norms, size_t n,
+                     size_t dims, VectorSimilarity sim, float* out);
+
+// Quantized vectors are stored as dims half floats for FLOAT16 and as a float scale followed by
+// dims signed bytes for INT8, the i-th value being scale * byte[i]. NONE keeps dims floats.
+size_t QuantizedVectorSize(size_t dims, VectorQuantization quantization);
+
+// Writes QuantizedVectorSize(dims, quantization) bytes to dest.
+void QuantizeVector(const float* src, size_t dims, VectorQuantization quantization, void* dest);
+
+void DequantizeVector(const void* src, size_t dims, VectorQuantization quantization, float* dest);
+
+// Distance between the vector u and the quantized vector v.
+float VectorDistance(const float* u, const void* v, size_t dims, VectorSimilarity sim,
+                     VectorQuantization quantization);
+
+// Distance between two quantized vectors as computed by the hnswlib spaces:
+// squared euclidean distance for L2 and 1 - inner product for COSINE.
+float QuantizedSpaceDistance(const void* u, const void* v, size_t dims, VectorSimilarity sim,
+                             VectorQuantization quantization);
+
 }  // namespace dfly::search
@@ -5,29 +5,44 @@
 
 #include <mimalloc/types.h>
 
+#include <atomic>
+
 #include "base/logging.h"
 
 namespace dfly {
 
+namespace {
+
+std::atomic_uint32_t next_segment_id{0};
+
+}  // namespace
+
+uint8_t* SegmentAllocator::address_table_[1u << kSegmentIdBits];
+
 SegmentAllocator::SegmentAllocator(mi_heap_t* heap) : heap_(heap) {
-  // 256GB
-  constexpr size_t limit = 1ULL << 35;
+  // 8TB
+  constexpr size_t limit = 1ULL << 43;
   static_assert((1ULL << (kSegmentIdBits + kSegmentShift)) == limit);
   // mimalloc uses 32MiB segments and we might need change this code if it changes.
   static_assert(kSegmentShift == MI_SEGMENT_SHIFT);
   static_assert((~kSegmentAlignMask) == (MI_SEGMENT_MASK));
 }
 
-void SegmentAllocator::ValidateMapSize() {
-  if (address_table_.size() > (1u << kSegmentIdBits)) {
-    // This can happen if we restrict dragonfly to small number of threads on high-memory machine,
-    // for example.
-    LOG(WARNING) << "address_table_ map is growing too large: " << address_table_.size();
-  }
+uint32_t SegmentAllocator::RegisterSegment(uint8_t* seg_ptr) {
+  uint32_t id = next_segment_id.fetch_add(1, std::memory_order_relaxed);
+
+  // CanAllocate() keeps a margin for the threads that may race past it.
+  CHECK_LE(id, kSegmentIdMask) << "Too many segments";
+
+  // Readers on other threads learn about the pointers of the segment only through the
+  // synchronization that publishes the objects allocated in it.
+  address_table_[id] = seg_ptr;
+  return id;
 }
 
 bool SegmentAllocator::CanAllocate() {
-  return address_table_.size() < (1u << kSegmentIdBits);
+  constexpr uint32_t kMargin = 1024;
+  return next_segment_id.load(std::memory_order_relaxed) < (1u << kSegmentIdBits) - kMargin;
 }
 
 }  // namespace dfly
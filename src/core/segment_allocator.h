@@ -8,8 +8,8 @@
 
 /***
  * This class is tightly coupled with mimalloc segment allocation logic and is designed to provide
- * a compact pointer representation (4bytes ptr) over 64bit address space that gives you
- * 32GB of allocations with option to extend it to 32*256GB if needed.
+ * a compact pointer representation (5 bytes ptr) over 64bit address space that gives you
+ * 8TB of allocations.
  *
  */
 
@@ -19,11 +19,13 @@ namespace dfly {
  * @brief Tightly coupled with mi_malloc 2.x implementation.
  *        Fetches 32MiB segment pointers from the allocated pointers.
  *        Provides own indexing of small pointers to real address space using the segment ptrs/
+ *        The index is shared by all the allocators, so that pointers allocated on one thread
+ *        can be translated on any other. Only allocation and freeing are thread local.
  */
 
 class SegmentAllocator {
-  // (2 ^ 10) total segments
-  static constexpr uint32_t kSegmentIdBits = 10;
+  // (2 ^ 18) total segments
+  static constexpr uint32_t kSegmentIdBits = 18;
   static constexpr uint32_t kSegmentIdMask = (1u << kSegmentIdBits) - 1;
   // (2 ^ 25) total bytes per segment = 32MiB
   static constexpr uint32_t kSegmentShift = 25;
@@ -32,12 +34,15 @@ class SegmentAllocator {
   static constexpr uint64_t kSegmentAlignMask = ~((1ULL << kSegmentShift) - 1);
 
  public:
-  using Ptr = uint32_t;
+  // Only the lower kPtrBits are used.
+  using Ptr = uint64_t;
+  static constexpr unsigned kPtrBits = kSegmentIdBits + kSegmentShift - 3;
 
   SegmentAllocator(mi_heap_t* heap);
-  bool CanAllocate();
+  static bool CanAllocate();
 
-  uint8_t* Translate(Ptr p) const {
+  // Thread-safe, as long as the allocation is not freed concurrently.
+  static uint8_t* Translate(Ptr p) {
     return address_table_[p & kSegmentIdMask] + Offset(p);
   }
 
@@ -62,10 +67,13 @@ class SegmentAllocator {
     return (p >> kSegmentIdBits) * 8;
   }
 
-  void ValidateMapSize();
+  static uint32_t RegisterSegment(uint8_t* seg_ptr);
 
-  std::vector<uint8_t*> address_table_;
-  absl::flat_hash_map<uint64_t, uint16_t> rev_indx_;
+  // Segment ids are global and are never reused, so a segment that moves to another heap may
+  // have ids in several allocators, which all translate to the same address.
+  static uint8_t* address_table_[1u << kSegmentIdBits];
+
+  absl::flat_hash_map<uint64_t, uint32_t> rev_indx_;
   mi_heap_t* heap_;
   size_t used_ = 0;
 };
@@ -79,13 +87,12 @@ inline auto SegmentAllocator::Allocate(uint32_t size) -> std::pair<Ptr, uint8_t*
   uint64_t seg_ptr = iptr & kSegmentAlignMask;
 
   // could be speed up using last used seg_ptr.
-  auto [it, inserted] = rev_indx_.emplace(seg_ptr, address_table_.size());
+  auto [it, inserted] = rev_indx_.emplace(seg_ptr, 0);
   if (inserted) {
-    ValidateMapSize();
-    address_table_.push_back((uint8_t*)seg_ptr);
+    it->second = RegisterSegment((uint8_t*)seg_ptr);
   }
 
-  uint32_t seg_offset = (iptr - seg_ptr) / 8;
+  uint64_t seg_offset = (iptr - seg_ptr) / 8;
   Ptr res = (seg_offset << kSegmentIdBits) | it->second;
   used_ += mi_good_size(size);
 
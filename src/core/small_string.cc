@@ -19,15 +19,7 @@ using namespace std;
 
 namespace {
 
-class XXH3_Deleter {
- public:
-  void operator()(XXH3_state_t* ptr) const {
-    XXH3_freeState(ptr);
-  }
-};
-
 struct TL {
-  unique_ptr<XXH3_state_t, XXH3_Deleter> xxh_state;
   unique_ptr<SegmentAllocator> seg_alloc;
 };
 
@@ -41,8 +33,6 @@ void SmallString::InitThreadLocal(void* heap) {
   SegmentAllocator* ns = new SegmentAllocator((mi_heap_t*)heap);
 
   tl.seg_alloc.reset(ns);
-  tl.xxh_state.reset(XXH3_createState());
-  XXH3_64bits_reset_withSeed(tl.xxh_state.get(), kHashSeed);
 }
 
 bool SmallString::CanAllocate(size_t size) {
@@ -54,6 +44,7 @@ size_t SmallString::UsedThreadLocal() {
 }
 
 static_assert(sizeof(SmallString) == 16);
+static_assert(SegmentAllocator::kPtrBits <= 40);
 
 // we should use only for sizes greater than kPrefLen
 size_t SmallString::Assign(std::string_view s) {
@@ -64,18 +55,18 @@ size_t SmallString::Assign(std::string_view s) {
   if (size_ == 0) {
     // packed structs can not be tied here.
     auto [sp, rp] = tl.seg_alloc->Allocate(s.size() - kPrefLen);
-    small_ptr_ = sp;
+    set_small_ptr(sp);
     realptr = rp;
     size_ = s.size();
   } else if (s.size() <= size_) {
-    realptr = tl.seg_alloc->Translate(small_ptr_);
+    realptr = SegmentAllocator::Translate(small_ptr());
 
     if (s.size() < size_) {
       size_t capacity = mi_usable_size(realptr);
       if (s.size() * 2 < capacity) {
-        tl.seg_alloc->Free(small_ptr_);
+        tl.seg_alloc->Free(small_ptr());
         auto [sp, rp] = tl.seg_alloc->Allocate(s.size() - kPrefLen);
-        small_ptr_ = sp;
+        set_small_ptr(sp);
         realptr = rp;
       }
       size_ = s.size();
@@ -94,14 +85,14 @@ void SmallString::Free() {
   if (size_ <= kPrefLen)
     return;
 
-  tl.seg_alloc->Free(small_ptr_);
+  tl.seg_alloc->Free(small_ptr());
   size_ = 0;
 }
 
 uint16_t SmallString::MallocUsed() const {
   if (size_ <= kPrefLen)
     return 0;
-  auto* realptr = tl.seg_alloc->Translate(small_ptr_);
+  auto* realptr = SegmentAllocator::Translate(small_ptr());
 
   return mi_malloc_usable_size(realptr);
 }
@@ -118,7 +109,7 @@ bool SmallString::Equal(std::string_view o) const {
   if (memcmp(prefix_, o.data(), kPrefLen) != 0)
     return false;
 
-  uint8_t* realp = tl.seg_alloc->Translate(small_ptr_);
+  uint8_t* realp = SegmentAllocator::Translate(small_ptr());
 
   return memcmp(realp, o.data() + kPrefLen, size_ - kPrefLen) == 0;
 }
@@ -140,15 +131,11 @@ bool SmallString::Equal(const SmallString& os) const {
 uint64_t SmallString::HashCode() const {
   DCHECK_GT(size_, kPrefLen);
 
-  string_view slice[2];
-
-  GetV(slice);
-  XXH3_state_t* state = tl.xxh_state.get();
-  XXH3_64bits_reset_withSeed(state, kHashSeed);
-  XXH3_64bits_update(state, slice[0].data(), slice[0].size());
-  XXH3_64bits_update(state, slice[1].data(), slice[1].size());
+  char buf[kMaxSize];
+  memcpy(buf, prefix_, kPrefLen);
+  memcpy(buf + kPrefLen, SegmentAllocator::Translate(small_ptr()), size_ - kPrefLen);
 
-  return XXH3_64bits_digest(state);
+  return XXH3_64bits_withSeed(buf, size_, kHashSeed);
 }
 
 void SmallString::Get(std::string* dest) const {
@@ -156,7 +143,7 @@ void SmallString::Get(std::string* dest) const {
   if (size_) {
     DCHECK_GT(size_, kPrefLen);
     memcpy(dest->data(), prefix_, kPrefLen);
-    uint8_t* ptr = tl.seg_alloc->Translate(small_ptr_);
+    uint8_t* ptr = SegmentAllocator::Translate(small_ptr());
     memcpy(dest->data() + kPrefLen, ptr, size_ - kPrefLen);
   }
 }
@@ -169,7 +156,7 @@ unsigned SmallString::GetV(string_view dest[2]) const {
   }
 
   dest[0] = string_view{prefix_, kPrefLen};
-  uint8_t* ptr = tl.seg_alloc->Translate(small_ptr_);
+  uint8_t* ptr = SegmentAllocator::Translate(small_ptr());
   dest[1] = string_view{reinterpret_cast<char*>(ptr), size_ - kPrefLen};
   return 2;
 }
@@ -180,15 +167,15 @@ bool SmallString::DefragIfNeeded(float ratio) {
     return false;
   }
 
-  uint8_t* cur_real_ptr = tl.seg_alloc->Translate(small_ptr_);
+  uint8_t* cur_real_ptr = SegmentAllocator::Translate(small_ptr());
   if (!mi_heap_page_is_underutilized(tl.seg_alloc->heap(), cur_real_ptr, ratio))
     return false;
 
   auto [sp, rp] = tl.seg_alloc->Allocate(size_ - kPrefLen);
 
   memcpy(rp, cur_real_ptr, size_ - kPrefLen);
-  tl.seg_alloc->Free(small_ptr_);
-  small_ptr_ = sp;
+  tl.seg_alloc->Free(small_ptr());
+  set_small_ptr(sp);
 
   return true;
 }
@@ -12,6 +12,8 @@ namespace dfly {
 // for in-memory workloads, especially for keys.
 // Please note that this class does not have automatic constructors and destructors, therefore
 // it requires explicit management.
+// Strings are allocated and freed on the thread of their heap but can be read from any thread,
+// as long as they are not modified concurrently.
 class SmallString {
   static constexpr unsigned kPrefLen = 10;
   static constexpr unsigned kMaxSize = (1 << 8) - 1;
@@ -55,11 +57,22 @@ class SmallString {
   }
 
  private:
+  uint64_t small_ptr() const {
+    return uint64_t(small_ptr_hi_) << 32 | small_ptr_;
+  }
+
+  void set_small_ptr(uint64_t ptr) {
+    small_ptr_ = ptr;
+    small_ptr_hi_ = ptr >> 32;
+  }
+
   // prefix of the string that is broken down into 2 parts.
   char prefix_[kPrefLen];
 
-  uint32_t small_ptr_;  // 32GB capacity because we ignore 3 lsb bits (i.e. x8).
-  uint16_t size_;       // uint16_t - total size (including prefix)
+  // SegmentAllocator pointer, split into the lower 32 bits and the upper 8 bits.
+  uint32_t small_ptr_;
+  uint8_t small_ptr_hi_;
+  uint8_t size_;  // total size (including prefix)
 
 } __attribute__((packed));
 
@@ -559,7 +559,7 @@ unsigned char* ZzlFind(unsigned char* lp, std::string_view ele, double* score) {
 
   if (eptr == nullptr)
     return nullptr;
-  eptr = lpFind(lp, eptr, (unsigned char*)ele.data(), ele.size(), 1);
+  eptr = lpFindEncoded(lp, eptr, (unsigned char*)ele.data(), ele.size(), 1);
   if (eptr) {
     sptr = lpNext(lp, eptr);
     serverAssert(sptr != NULL);
@@ -683,6 +683,18 @@ bool SortedMap::InsertNew(double score, std::string_view member) {
   return true;
 }
 
+bool SortedMap::AppendNew(double score, std::string_view member) {
+  DVLOG(2) << "AppendNew " << score << " " << member;
+
+  auto [newk, added] = score_map->AddOrSkip(member, score);
+  if (!added)
+    return false;
+
+  added = score_tree->Append(newk) || score_tree->Insert(newk);
+  CHECK(added);
+  return true;
+}
+
 optional<unsigned> SortedMap::GetRank(std::string_view ele, bool reverse) const {
   ScoreSds obj = score_map->FindObj(ele);
   if (obj == nullptr)
@@ -1136,9 +1148,9 @@ SortedMap* SortedMap::FromListPack(PMR_NS::memory_resource* res, const uint8_t*
     double score = ZzlGetScore(sptr);
     vstr = lpGetValue(eptr, &vlen, &vlong);
     if (vstr == NULL) {
-      CHECK(zs->InsertNew(score, absl::StrCat(vlong)));
+      CHECK(zs->AppendNew(score, absl::StrCat(vlong)));
     } else {
-      CHECK(zs->InsertNew(score, string_view{reinterpret_cast<const char*>(vstr), vlen}));
+      CHECK(zs->AppendNew(score, string_view{reinterpret_cast<const char*>(vstr), vlen}));
     }
 
     ZzlNext(zl, &eptr, &sptr);
@@ -1158,6 +1170,23 @@ bool SortedMap::DefragIfNeeded(float ratio) {
   return reallocated;
 }
 
+// The high half of the cursor is set once the buckets of the score map were visited and the
+// low half holds the position in the current phase: the bucket or the tree rank.
+uint64_t SortedMap::DefragStep(uint64_t cursor, uint32_t count, float ratio, bool* realloced) {
+  constexpr uint64_t kTreePhase = 1ULL << 32;
+  if (cursor < kTreePhase) {
+    auto cb = [this](sds old_obj, sds new_obj) { score_tree->ForceUpdate(old_obj, new_obj); };
+    uint32_t next = score_map->DefragStep(cursor, count, ratio, cb, realloced);
+    return next ? next : kTreePhase;
+  }
+
+  auto should_move = [ratio](const void* node) {
+    return zmalloc_page_is_underutilized(const_cast<void*>(node), ratio) != 0;
+  };
+  uint32_t next = score_tree->DefragStep(uint32_t(cursor), count, should_move, realloced);
+  return next ? kTreePhase | next : 0;
+}
+
 std::optional<SortedMap::RankAndScore> SortedMap::GetRankAndScore(std::string_view ele,
                                                                   bool reverse) const {
   ScoreSds obj = score_map->FindObj(ele);
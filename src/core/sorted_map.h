@@ -80,6 +80,10 @@ class SortedMap {
   // No score update is performed in this case.
   bool InsertNew(double score, std::string_view member);
 
+  // Same as InsertNew, but optimized for members that come in score order, as loaders and
+  // listpack conversions feed them. Out of order members cost an additional tree descent.
+  bool AppendNew(double score, std::string_view member);
+
   bool Delete(std::string_view ele) const;
 
   // Upper bound size of the set.
@@ -118,6 +122,10 @@ class SortedMap {
 
   bool DefragIfNeeded(float ratio);
 
+  // Incremental variant of DefragIfNeeded that moves the entries and the tree nodes in steps of
+  // about count allocations. Starts with a zero cursor and returns 0 when done.
+  uint64_t DefragStep(uint64_t cursor, uint32_t count, float ratio, bool* realloced);
+
  private:
   struct Query {
     ScoreSds item;
@@ -62,6 +62,20 @@ TEST_F(SortedMapTest, Add) {
   sdsfree(ele);
 }
 
+TEST_F(SortedMapTest, AppendNew) {
+  for (unsigned i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(sm_.AppendNew(i * 2, StrCat("a", i)));
+  }
+  // Out of order members fall back to a regular insert.
+  ASSERT_TRUE(sm_.AppendNew(1, "b"));
+  ASSERT_FALSE(sm_.AppendNew(5, "a3"));
+
+  EXPECT_EQ(1001u, sm_.Size());
+  EXPECT_EQ(1u, sm_.GetRank("b", false));
+  EXPECT_EQ(1000u, sm_.GetRank("a999", false));
+  EXPECT_EQ(6, sm_.GetScore("a3"));
+}
+
 TEST_F(SortedMapTest, Scan) {
   for (unsigned i = 0; i < 972; ++i) {
     sm_.InsertNew(i, StrCat(i));
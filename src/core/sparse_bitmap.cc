@@ -0,0 +1,239 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/sparse_bitmap.h"
+
+#include <absl/numeric/bits.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "base/logging.h"
+#include "core/bitops.h"
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+inline uint8_t BitMask(uint64_t offset) {
+  return 0x80 >> (offset % 8);
+}
+
+// Counts the set bits of a raw chunk with offsets in [from, to).
+size_t CountRawBits(const uint8_t* raw, uint32_t from, uint32_t to) {
+  size_t res = 0;
+  for (; from < to && from % 8; ++from)
+    res += (raw[from / 8] & BitMask(from)) != 0;
+  for (; to > from && to % 8; --to)
+    res += (raw[(to - 1) / 8] & BitMask(to - 1)) != 0;
+
+  string_view bytes{reinterpret_cast<const char*>(raw) + from / 8, (to - from) / 8};
+  return res + CountBits(bytes);
+}
+
+}  // namespace
+
+SparseBitmap::SparseBitmap(PMR_NS::memory_resource* mr) : chunks_(mr) {
+}
+
+SparseBitmap::SparseBitmap(string_view bytes, PMR_NS::memory_resource* mr)
+    : chunks_(mr), size_(bytes.size()) {
+  for (size_t start = 0; start < bytes.size(); start += kChunkBytes) {
+    string_view part = bytes.substr(start, kChunkBytes);
+    size_t cardinality = dfly::CountBits(part);
+    if (cardinality == 0)
+      continue;
+
+    Chunk chunk{uint32_t(start / kChunkBytes), uint32_t(cardinality), 0, nullptr, nullptr};
+    if (cardinality > kMaxArrayLen) {
+      chunk.raw = static_cast<uint8_t*>(Allocate(kChunkBytes));
+      memcpy(chunk.raw, part.data(), part.size());
+      memset(chunk.raw + part.size(), 0, kChunkBytes - part.size());
+    } else {
+      chunk.capacity = cardinality;
+      chunk.array = static_cast<uint16_t*>(Allocate(cardinality * sizeof(uint16_t)));
+      uint32_t len = 0;
+      for (size_t i = 0; i < part.size(); ++i) {
+        uint8_t byte = part[i];
+        while (byte) {
+          unsigned bit = absl::countl_zero(byte);
+          chunk.array[len++] = i * 8 + bit;
+          byte &= ~BitMask(bit);
+        }
+      }
+      DCHECK_EQ(len, cardinality);
+    }
+    chunks_.push_back(chunk);
+  }
+}
+
+SparseBitmap::~SparseBitmap() {
+  for (const Chunk& chunk : chunks_)
+    FreeChunk(chunk);
+}
+
+size_t SparseBitmap::LowerBound(uint32_t index) const {
+  auto it = lower_bound(chunks_.begin(), chunks_.end(), index,
+                        [](const Chunk& chunk, uint32_t val) { return chunk.index < val; });
+  return it - chunks_.begin();
+}
+
+bool SparseBitmap::GetBit(uint64_t offset) const {
+  if (offset >= size_ * 8)
+    return false;
+
+  uint32_t index = offset / kChunkBits;
+  uint32_t pos = offset % kChunkBits;
+  size_t i = LowerBound(index);
+  if (i == chunks_.size() || chunks_[i].index != index)
+    return false;
+
+  const Chunk& chunk = chunks_[i];
+  if (chunk.raw)
+    return chunk.raw[pos / 8] & BitMask(pos);
+  return binary_search(chunk.array, chunk.array + chunk.cardinality, pos);
+}
+
+bool SparseBitmap::SetBit(uint64_t offset, bool value) {
+  size_ = max<size_t>(size_, offset / 8 + 1);
+
+  uint32_t index = offset / kChunkBits;
+  uint32_t pos = offset % kChunkBits;
+  size_t i = LowerBound(index);
+  if (i == chunks_.size() || chunks_[i].index != index) {
+    if (!value)
+      return false;
+    chunks_.insert(chunks_.begin() + i, Chunk{index, 0, 0, nullptr, nullptr});
+  }
+
+  Chunk& chunk = chunks_[i];
+  if (chunk.raw) {
+    uint8_t& byte = chunk.raw[pos / 8];
+    bool prev = byte & BitMask(pos);
+    if (prev == value)
+      return prev;
+    byte ^= BitMask(pos);
+  } else {
+    uint16_t* end = chunk.array + chunk.cardinality;
+    uint16_t* it = lower_bound(chunk.array, end, pos);
+    bool prev = it != end && *it == pos;
+    if (prev == value)
+      return prev;
+
+    if (!value) {
+      memmove(it, it + 1, (end - it - 1) * sizeof(uint16_t));
+    } else if (chunk.cardinality == kMaxArrayLen) {
+      ConvertToRaw(&chunk);
+      chunk.raw[pos / 8] |= BitMask(pos);
+    } else {
+      if (chunk.cardinality == chunk.capacity) {
+        uint32_t capacity = min(max(chunk.capacity * 2, 4u), kMaxArrayLen);
+        auto* array = static_cast<uint16_t*>(Allocate(capacity * sizeof(uint16_t)));
+        if (chunk.array) {
+          memcpy(array, chunk.array, chunk.cardinality * sizeof(uint16_t));
+          FreeChunk(chunk);
+        }
+        it = array + (it - chunk.array);
+        end = array + chunk.cardinality;
+        chunk.array = array;
+        chunk.capacity = capacity;
+      }
+      memmove(it + 1, it, (end - it) * sizeof(uint16_t));
+      *it = pos;
+    }
+  }
+
+  if (value) {
+    ++chunk.cardinality;
+  } else if (--chunk.cardinality == 0) {
+    FreeChunk(chunk);
+    chunks_.erase(chunks_.begin() + i);
+  }
+  return !value;
+}
+
+size_t SparseBitmap::CountBits(uint64_t start, uint64_t end) const {
+  end = min<uint64_t>(end, size_ * 8);
+  if (start >= end)
+    return 0;
+
+  size_t res = 0;
+  for (size_t i = LowerBound(start / kChunkBits); i < chunks_.size(); ++i) {
+    const Chunk& chunk = chunks_[i];
+    uint64_t base = uint64_t(chunk.index) * kChunkBits;
+    if (base >= end)
+      break;
+
+    uint32_t from = start > base ? start - base : 0;
+    uint32_t to = min<uint64_t>(end - base, kChunkBits);
+    if (from == 0 && to == kChunkBits) {
+      res += chunk.cardinality;
+    } else if (chunk.raw) {
+      res += CountRawBits(chunk.raw, from, to);
+    } else {
+      const uint16_t* array = chunk.array;
+      const uint16_t* array_end = array + chunk.cardinality;
+      res += lower_bound(array, array_end, to) - lower_bound(array, array_end, from);
+    }
+  }
+  return res;
+}
+
+void SparseBitmap::GetString(char* dest) const {
+  memset(dest, 0, size_);
+  for (const Chunk& chunk : chunks_) {
+    size_t base = size_t(chunk.index) * kChunkBytes;
+    DCHECK_LT(base, size_);
+    if (chunk.raw) {
+      memcpy(dest + base, chunk.raw, min<size_t>(kChunkBytes, size_ - base));
+    } else {
+      for (uint32_t j = 0; j < chunk.cardinality; ++j) {
+        uint16_t pos = chunk.array[j];
+        dest[base + pos / 8] |= BitMask(pos);
+      }
+    }
+  }
+}
+
+size_t SparseBitmap::MallocUsed() const {
+  return sizeof(SparseBitmap) + chunks_.capacity() * sizeof(Chunk) + allocated_;
+}
+
+void SparseBitmap::ConvertToRaw(Chunk* chunk) {
+  DCHECK(chunk->array);
+
+  uint8_t* raw = static_cast<uint8_t*>(Allocate(kChunkBytes));
+  memset(raw, 0, kChunkBytes);
+  for (uint32_t j = 0; j < chunk->cardinality; ++j) {
+    uint16_t pos = chunk->array[j];
+    raw[pos / 8] |= BitMask(pos);
+  }
+  FreeChunk(*chunk);
+  chunk->array = nullptr;
+  chunk->capacity = 0;
+  chunk->raw = raw;
+}
+
+void SparseBitmap::FreeChunk(const Chunk& chunk) {
+  if (chunk.raw) {
+    Deallocate(chunk.raw, kChunkBytes);
+  } else if (chunk.array) {
+    Deallocate(chunk.array, chunk.capacity * sizeof(uint16_t));
+  }
+}
+
+void* SparseBitmap::Allocate(size_t bytes) {
+  allocated_ += bytes;
+  return chunks_.get_allocator().resource()->allocate(bytes, alignof(uint64_t));
+}
+
+void SparseBitmap::Deallocate(void* ptr, size_t bytes) {
+  DCHECK_GE(allocated_, bytes);
+  allocated_ -= bytes;
+  chunks_.get_allocator().resource()->deallocate(ptr, bytes, alignof(uint64_t));
+}
+
+}  // namespace dfly
@@ -0,0 +1,81 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "base/pmr/memory_resource.h"
+
+namespace dfly {
+
+// Roaring-style representation of a string that is used as a bitmap and is mostly zeros.
+// The bit space is split into chunks of 64K bits. Only chunks with set bits are stored: as a
+// sorted array of the 16-bit offsets of their set bits or, once the array would outgrow it, as
+// the 8KB chunk itself in the layout of the plain string. Bit offsets follow the SETBIT
+// convention, i.e. bit 0 is the most significant bit of the first byte.
+class SparseBitmap {
+  SparseBitmap(const SparseBitmap&) = delete;
+  SparseBitmap& operator=(const SparseBitmap&) = delete;
+
+ public:
+  static constexpr uint32_t kChunkBits = 1u << 16;
+  static constexpr uint32_t kChunkBytes = kChunkBits / 8;
+
+  // Array chunks are converted to raw chunks when they would take more space.
+  static constexpr uint32_t kMaxArrayLen = kChunkBytes / sizeof(uint16_t);
+
+  explicit SparseBitmap(PMR_NS::memory_resource* mr);
+
+  // Builds the bitmap from the plain string representation.
+  SparseBitmap(std::string_view bytes, PMR_NS::memory_resource* mr);
+
+  ~SparseBitmap();
+
+  // Length in bytes of the string that this bitmap represents.
+  size_t size() const {
+    return size_;
+  }
+
+  // Returns false for offsets past the end of the string.
+  bool GetBit(uint64_t offset) const;
+
+  // Sets the bit at offset and returns its previous value. Extends the string with zeros if
+  // offset is past its end.
+  bool SetBit(uint64_t offset, bool value);
+
+  // Returns the number of set bits with offsets in [start, end).
+  size_t CountBits(uint64_t start, uint64_t end) const;
+
+  // Writes the plain string representation, dest must have size() bytes available.
+  void GetString(char* dest) const;
+
+  size_t MallocUsed() const;
+
+ private:
+  struct Chunk {
+    uint32_t index;        // offset / kChunkBits of the first bit in the chunk.
+    uint32_t cardinality;  // number of set bits.
+    uint32_t capacity;     // allocated length of array.
+    uint16_t* array;       // sorted offsets within the chunk, nullptr for raw chunks.
+    uint8_t* raw;          // kChunkBytes of the plain string, nullptr for array chunks.
+  };
+
+  // Returns the position of the first chunk with index not less than `index`.
+  size_t LowerBound(uint32_t index) const;
+
+  void ConvertToRaw(Chunk* chunk);
+  void FreeChunk(const Chunk& chunk);
+
+  void* Allocate(size_t bytes);
+  void Deallocate(void* ptr, size_t bytes);
+
+  std::vector<Chunk, PMR_NS::polymorphic_allocator<Chunk>> chunks_;
+  size_t size_ = 0;
+  size_t allocated_ = 0;  // bytes allocated for the chunk contents.
+};
+
+}  // namespace dfly
@@ -0,0 +1,99 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/sparse_bitmap.h"
+
+#include <absl/numeric/bits.h>
+
+#include <random>
+
+#include "base/gtest.h"
+
+namespace dfly {
+
+using namespace std;
+
+class SparseBitmapTest : public ::testing::Test {
+ protected:
+  static void SetPlainBit(uint64_t offset, bool value, string* str) {
+    if (str->size() <= offset / 8)
+      str->resize(offset / 8 + 1, '\0');
+    uint8_t mask = 0x80 >> (offset % 8);
+    char& byte = (*str)[offset / 8];
+    byte = value ? (byte | mask) : (byte & ~mask);
+  }
+
+  static size_t PlainCount(const string& str, uint64_t start, uint64_t end) {
+    size_t res = 0;
+    for (uint64_t i = start; i < min<uint64_t>(end, str.size() * 8); ++i)
+      res += (uint8_t(str[i / 8]) >> (7 - i % 8)) & 1;
+    return res;
+  }
+
+  static string ToString(const SparseBitmap& bitmap) {
+    string res(bitmap.size(), '\0');
+    bitmap.GetString(res.data());
+    return res;
+  }
+
+  PMR_NS::memory_resource* mr_ = PMR_NS::get_default_resource();
+};
+
+TEST_F(SparseBitmapTest, Basic) {
+  SparseBitmap bitmap(mr_);
+  EXPECT_EQ(0u, bitmap.size());
+  EXPECT_FALSE(bitmap.GetBit(0));
+
+  EXPECT_FALSE(bitmap.SetBit(1'000'000, true));
+  EXPECT_EQ(125'001u, bitmap.size());
+  EXPECT_TRUE(bitmap.GetBit(1'000'000));
+  EXPECT_FALSE(bitmap.GetBit(999'999));
+  EXPECT_TRUE(bitmap.SetBit(1'000'000, true));
+  EXPECT_LT(bitmap.MallocUsed(), 200u);
+
+  // Clearing a bit past the end still extends the string.
+  EXPECT_FALSE(bitmap.SetBit(2'000'000, false));
+  EXPECT_EQ(250'001u, bitmap.size());
+  EXPECT_EQ(1u, bitmap.CountBits(0, UINT64_MAX));
+
+  EXPECT_TRUE(bitmap.SetBit(1'000'000, false));
+  EXPECT_EQ(0u, bitmap.CountBits(0, UINT64_MAX));
+  EXPECT_EQ(string(250'001, '\0'), ToString(bitmap));
+}
+
+TEST_F(SparseBitmapTest, MatchesPlainString) {
+  mt19937 gen(42);
+  SparseBitmap bitmap(mr_);
+  string plain;
+
+  // The first chunk gets dense enough to become raw, the rest stay as arrays.
+  for (unsigned i = 0; i < 20000; ++i) {
+    uint64_t offset = i % 2 ? gen() % SparseBitmap::kChunkBits : gen() % (1u << 22);
+    bool value = gen() % 4 != 0;
+    bool prev = offset < plain.size() * 8 && ((uint8_t(plain[offset / 8]) >> (7 - offset % 8)) & 1);
+    ASSERT_EQ(prev, bitmap.SetBit(offset, value)) << i;
+    SetPlainBit(offset, value, &plain);
+  }
+
+  ASSERT_EQ(plain.size(), bitmap.size());
+  ASSERT_EQ(plain, ToString(bitmap));
+  EXPECT_LT(bitmap.MallocUsed(), plain.size());
+
+  for (unsigned i = 0; i < 1000; ++i) {
+    uint64_t offset = gen() % (plain.size() * 8 + 100);
+    ASSERT_EQ(PlainCount(plain, offset, offset + 1) == 1, bitmap.GetBit(offset));
+  }
+
+  for (unsigned i = 0; i < 200; ++i) {
+    uint64_t start = gen() % (plain.size() * 8);
+    uint64_t end = start + gen() % (3 * SparseBitmap::kChunkBits);
+    ASSERT_EQ(PlainCount(plain, start, end), bitmap.CountBits(start, end)) << start << " " << end;
+  }
+
+  SparseBitmap copy(plain, mr_);
+  EXPECT_EQ(plain, ToString(copy));
+  EXPECT_EQ(bitmap.CountBits(0, UINT64_MAX), copy.CountBits(0, UINT64_MAX));
+}
+
+}  // namespace dfly
@@ -13,7 +13,13 @@
 #else
 #include <emmintrin.h>
 #include <tmmintrin.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
 #endif
+#endif
+
+#include <cstdint>
+#include <cstring>
 
 namespace dfly {
 
@@ -30,4 +36,26 @@ inline __m128i mm_loadu_si128(const __m128i* ptr) {
 }
 #endif
 
+// Compares the first 16 bytes of both a and b with fp in a single pass.
+// Returns a 32-bit mask where the low 16 bits correspond to a and the high 16 bits to b.
+inline uint32_t CompareFp2x16(const uint8_t* a, const uint8_t* b, uint8_t fp) {
+#if defined(__s390x__)
+  uint32_t res = 0;
+  for (unsigned i = 0; i < 16; ++i) {
+    res |= (uint32_t(a[i] == fp) << i) | (uint32_t(b[i] == fp) << (i + 16));
+  }
+  return res;
+#elif defined(__AVX2__)
+  __m256i data = _mm256_castsi128_si256(mm_loadu_si128(reinterpret_cast<const __m128i*>(a)));
+  data = _mm256_inserti128_si256(data, mm_loadu_si128(reinterpret_cast<const __m128i*>(b)), 1);
+  __m256i rv_mask = _mm256_cmpeq_epi8(data, _mm256_set1_epi8(fp));
+  return uint32_t(_mm256_movemask_epi8(rv_mask));
+#else
+  const __m128i key_data = _mm_set1_epi8(fp);
+  __m128i mask_a = _mm_cmpeq_epi8(mm_loadu_si128(reinterpret_cast<const __m128i*>(a)), key_data);
+  __m128i mask_b = _mm_cmpeq_epi8(mm_loadu_si128(reinterpret_cast<const __m128i*>(b)), key_data);
+  return uint32_t(_mm_movemask_epi8(mask_a)) | (uint32_t(_mm_movemask_epi8(mask_b)) << 16);
+#endif
+}
+
 }  // namespace dfly
@@ -4,6 +4,8 @@
 
 #include "core/string_map.h"
 
+#include <absl/container/flat_hash_set.h>
+
 #include "base/endian.h"
 #include "base/logging.h"
 #include "core/compact_object.h"
@@ -22,6 +24,10 @@ namespace {
 constexpr uint64_t kValTtlBit = 1ULL << 63;
 constexpr uint64_t kValMask = ~kValTtlBit;
 
+// Random picks are sampled one by one while they are a small part of the map, otherwise they are
+// collected with a single scan.
+constexpr size_t kSampleRatio = 5;
+
 // Returns key, tagged value pair
 pair<sds, uint64_t> CreateEntry(string_view field, string_view value, uint32_t time_now,
                                 uint32_t ttl_sec) {
@@ -101,25 +107,37 @@ bool StringMap::Contains(string_view field) const {
 }
 
 optional<pair<sds, sds>> StringMap::RandomPair() {
-  // Iteration may remove elements, and so we need to loop if we happen to reach the end
-  while (true) {
-    auto it = begin();
+  iterator it{GetRandomIterator()};
+  if (it == end())
+    return nullopt;
+  return std::make_pair(it->first, it->second);
+}
 
-    // It may be that begin() will invalidate all elements, getting us to an Empty() state
-    if (Empty()) {
-      break;
+void StringMap::RandomPairsUnique(unsigned int count, std::vector<sds>& keys,
+                                  std::vector<sds>& vals, bool with_value) {
+  if (size_t(count) * kSampleRatio < UpperBoundSize()) {
+    // Few repeated picks are expected, but expiry during sampling can shrink the map, so the
+    // number of tries is bounded and the scan below takes over if they run out.
+    absl::flat_hash_set<sds> picked;
+    picked.reserve(count);
+    for (size_t tries = 0; picked.size() < count && tries < size_t(count) * 4; ++tries) {
+      iterator it{GetRandomIterator()};
+      if (it == end())
+        break;
+
+      if (picked.insert(it->first).second) {
+        keys.push_back(it->first);
+        if (with_value)
+          vals.push_back(it->second);
+      }
     }
 
-    it += rand() % UpperBoundSize();
-    if (it != end()) {
-      return std::make_pair(it->first, it->second);
-    }
+    if (keys.size() == count)
+      return;
+    keys.clear();
+    vals.clear();
   }
-  return nullopt;
-}
 
-void StringMap::RandomPairsUnique(unsigned int count, std::vector<sds>& keys,
-                                  std::vector<sds>& vals, bool with_value) {
   unsigned int total_size = SizeSlow();
   unsigned int index = 0;
   if (count > total_size)
@@ -149,9 +167,28 @@ void StringMap::RandomPairsUnique(unsigned int count, std::vector<sds>& keys,
 
 void StringMap::RandomPairs(unsigned int count, std::vector<sds>& keys, std::vector<sds>& vals,
                             bool with_value) {
+  if (size_t(count) * kSampleRatio < UpperBoundSize()) {
+    keys.reserve(count);
+    if (with_value)
+      vals.reserve(count);
+
+    for (unsigned int i = 0; i < count; ++i) {
+      iterator it{GetRandomIterator()};
+      if (it == end())
+        break;
+
+      keys.push_back(it->first);
+      if (with_value)
+        vals.push_back(it->second);
+    }
+    return;
+  }
+
   using RandomPick = std::pair<unsigned int, unsigned int>;
   std::vector<RandomPick> picks;
   unsigned int total_size = SizeSlow();
+  if (total_size == 0)
+    return;
 
   for (unsigned int i = 0; i < count; ++i) {
     RandomPick pick{rand() % total_size, i};
@@ -165,9 +202,9 @@ void StringMap::RandomPairs(unsigned int count, std::vector<sds>& keys, std::vec
   for (unsigned int i = 0; i < index; ++i)
     ++itr;
 
-  keys.reserve(count);
+  keys.resize(count);
   if (with_value)
-    vals.reserve(count);
+    vals.resize(count);
 
   while (itr != end() && pick_index < count) {
     auto [key, val] = *itr;
@@ -302,6 +339,12 @@ detail::SdsPair StringMap::iterator::BreakToPair(void* obj) {
   return detail::SdsPair(f, GetValue(f));
 }
 
+uint32_t StringMap::DefragStep(uint32_t cursor, uint32_t count, float ratio, bool* realloced) {
+  return DefragBuckets(
+      cursor, count, ratio,
+      [ratio](IteratorBase it) { return iterator{it}.ReallocIfNeeded(ratio); }, realloced);
+}
+
 bool StringMap::iterator::ReallocIfNeeded(float ratio) {
   auto* ptr = curr_entry_;
   if (ptr->IsLink()) {
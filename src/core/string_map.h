@@ -137,18 +137,22 @@ class StringMap : public DenseSet {
   // Randomly selects count of key value pairs. The selections are unique.
   // if count is larger than the total number of key value pairs, returns
   // every pair.
-  // Executes at O(n) (i.e. slow for large sets).
+  // Executes at O(count) if count is small compared to the map size, O(n) otherwise.
   void RandomPairsUnique(unsigned int count, std::vector<sds>& keys, std::vector<sds>& vals,
                          bool with_value);
 
   // Randomly selects count of key value pairs. The select key value pairs
-  // are allowed to have duplications.
-  // Executes at O(n) (i.e. slow for large sets).
+  // are allowed to have duplications. May select fewer pairs if members expire.
+  // Executes at O(count) if count is small compared to the map size, O(n) otherwise.
   void RandomPairs(unsigned int count, std::vector<sds>& keys, std::vector<sds>& vals,
                    bool with_value);
 
   static sds GetValue(sds key);
 
+  // Incremental variant of calling ReallocIfNeeded on every entry: moves the entries and the links
+  // of count buckets starting from cursor. Returns the next cursor, or 0 after the last bucket.
+  uint32_t DefragStep(uint32_t cursor, uint32_t count, float ratio, bool* realloced);
+
  private:
   // Reallocate key and/or value if their pages are underutilized.
   // Returns new pointer (stays same if key utilization is enough) and if reallocation happened.
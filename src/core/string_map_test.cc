@@ -127,6 +127,31 @@ TEST_F(StringMapTest, IterateExpired) {
   EXPECT_EQ(it, sm_->end());
 }
 
+TEST_F(StringMapTest, RandomPairs) {
+  for (unsigned i = 0; i < 1000; ++i)
+    EXPECT_TRUE(sm_->AddOrUpdate(StrCat("k", i), StrCat("v", i), i % 2 ? 1 : UINT32_MAX));
+  sm_->set_time(1);
+
+  // The sampled path is used for the small counts and the scan for the large one.
+  for (unsigned count : {10u, 100u, 400u}) {
+    vector<sds> keys, vals;
+    sm_->RandomPairsUnique(count, keys, vals, true);
+    ASSERT_EQ(keys.size(), count);
+    ASSERT_EQ(vals.size(), count);
+    unordered_set<string> unique;
+    for (unsigned i = 0; i < count; ++i) {
+      EXPECT_TRUE(unique.emplace(keys[i], sdslen(keys[i])).second);
+      EXPECT_EQ(keys[i][sdslen(keys[i]) - 1] % 2, 0);
+      EXPECT_EQ(string_view(keys[i] + 1, sdslen(keys[i]) - 1),
+                string_view(vals[i] + 1, sdslen(vals[i]) - 1));
+    }
+
+    keys.clear();
+    sm_->RandomPairs(count, keys, vals, false);
+    EXPECT_EQ(keys.size(), count);
+  }
+}
+
 TEST_F(StringMapTest, SetFieldExpireHasExpiry) {
   EXPECT_TRUE(sm_->AddOrUpdate("k1", "v1", 5));
   auto k = sm_->Find("k1");
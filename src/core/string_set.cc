@@ -224,6 +224,12 @@ pair<sds, bool> StringSet::DuplicateEntryIfFragmented(void* obj, float ratio) {
   return {sdsnewlen(key, key_len), true};
 }
 
+uint32_t StringSet::DefragStep(uint32_t cursor, uint32_t count, float ratio, bool* realloced) {
+  return DefragBuckets(
+      cursor, count, ratio,
+      [ratio](IteratorBase it) { return iterator{it}.ReallocIfNeeded(ratio); }, realloced);
+}
+
 bool StringSet::iterator::ReallocIfNeeded(float ratio) {
   auto* ptr = curr_entry_;
   if (ptr->IsLink()) {
@@ -104,6 +104,10 @@ class StringSet : public DenseSet {
 
   uint32_t Scan(uint32_t, const std::function<void(sds)>&) const;
 
+  // Incremental variant of calling ReallocIfNeeded on every entry: moves the entries and the links
+  // of count buckets starting from cursor. Returns the next cursor, or 0 after the last bucket.
+  uint32_t DefragStep(uint32_t cursor, uint32_t count, float ratio, bool* realloced);
+
   iterator Find(std::string_view member) {
     return iterator{FindIt(&member, 1)};
   }
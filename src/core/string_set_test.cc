@@ -13,6 +13,7 @@
 #include <random>
 #include <string>
 #include <string_view>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -404,6 +405,33 @@ TEST_F(StringSetTest, Pop) {
   DCHECK(to_insert.empty());
 }
 
+TEST_F(StringSetTest, RandomMember) {
+  constexpr size_t num_items = 64;
+  for (size_t i = 0; i < num_items; ++i)
+    EXPECT_TRUE(ss_->Add(absl::StrCat("m", i)));
+
+  unordered_map<string, unsigned> hits;
+  for (size_t i = 0; i < num_items * 1000; ++i)
+    ++hits[string{*ss_->GetRandomMember()}];
+
+  EXPECT_EQ(hits.size(), num_items);
+  for (const auto& [member, count] : hits) {
+    EXPECT_GT(count, 700u) << member;
+    EXPECT_LT(count, 1300u) << member;
+  }
+
+  // Expired members are never returned.
+  ss_->Clear();
+  for (size_t i = 0; i < num_items; ++i)
+    EXPECT_TRUE(ss_->Add(absl::StrCat("m", i), i % 2 ? 1 : UINT32_MAX));
+  ss_->set_time(1);
+  for (size_t i = 0; i < num_items * 10; ++i) {
+    string member{*ss_->GetRandomMember()};
+    EXPECT_EQ(member.back() % 2, 0) << member;
+  }
+  EXPECT_EQ(ss_->UpperBoundSize(), num_items / 2);
+}
+
 TEST_F(StringSetTest, Iteration) {
   ss_->Add("foo");
   for (const sds ptr : *ss_) {
@@ -483,6 +511,29 @@ TEST_F(StringSetTest, Ttl) {
   }
 }
 
+TEST_F(StringSetTest, ExpireStep) {
+  for (unsigned i = 0; i < 100; ++i) {
+    EXPECT_TRUE(ss_->Add(StrCat("short", i), 1));
+    EXPECT_TRUE(ss_->Add(StrCat("long", i), 10));
+    EXPECT_TRUE(ss_->Add(StrCat("none", i)));
+  }
+
+  ss_->set_time(5);
+  uint32_t min_expire = UINT32_MAX;
+  uint32_t cursor = 0;
+  unsigned steps = 0;
+  do {
+    cursor = ss_->ExpireStep(cursor, 4, &min_expire);
+    ++steps;
+  } while (cursor);
+
+  EXPECT_GT(steps, 1u);
+  EXPECT_EQ(200u, ss_->UpperBoundSize());
+  EXPECT_EQ(10u, min_expire);
+  EXPECT_FALSE(ss_->Contains("short50"));
+  EXPECT_TRUE(ss_->Contains("long50"));
+}
+
 TEST_F(StringSetTest, Grow) {
   for (size_t j = 0; j < 10; ++j) {
     for (size_t i = 0; i < 4098; ++i) {
@@ -5,12 +5,56 @@
 #include "core/task_queue.h"
 
 #include <absl/strings/str_cat.h>
+#include <absl/synchronization/mutex.h>
+
+#include <deque>
 
 #include "base/logging.h"
+#include "util/fibers/proactor_base.h"
+#include "util/fibers/synchronization.h"
 
 using namespace std;
 namespace dfly {
 
+namespace {
+
+// How long the submitter waits for an idle thread before running the task itself.
+constexpr auto kStealWindow = chrono::microseconds(200);
+
+}  // namespace
+
+struct OffloadQueue::Task {
+  explicit Task(absl::FunctionRef<void()> fn) : f(fn) {
+  }
+
+  // Returns true if the caller won the right to run the task.
+  bool Claim() {
+    bool expected = false;
+    return claimed.compare_exchange_strong(expected, true, memory_order_acq_rel);
+  }
+
+  absl::FunctionRef<void()> f;
+  atomic_bool claimed{false};
+  util::fb2::Done done;
+};
+
+namespace {
+
+struct OffloadState {
+  absl::Mutex mu;
+  deque<shared_ptr<OffloadQueue::Task>> tasks ABSL_GUARDED_BY(mu);
+  atomic_uint32_t pending{0};
+  atomic_uint32_t generation{0};
+  atomic_uint64_t stolen{0};
+};
+
+OffloadState& offload_state() {
+  static OffloadState state;
+  return state;
+}
+
+}  // namespace
+
 __thread unsigned TaskQueue::blocked_submitters_ = 0;
 
 TaskQueue::TaskQueue(unsigned queue_size, unsigned start_size, unsigned pool_max_size)
@@ -35,4 +79,80 @@ void TaskQueue::Shutdown() {
     fb.JoinIfNeeded();
 }
 
+void OffloadQueue::RegisterThread(util::ProactorBase* pb) {
+  uint32_t generation = offload_state().generation.load(memory_order_relaxed);
+  pb->AddOnIdleTask([generation] { return IdleCb(generation); });
+}
+
+void OffloadQueue::Shutdown() {
+  auto& state = offload_state();
+  state.generation.fetch_add(1, memory_order_relaxed);
+
+  absl::MutexLock lk(&state.mu);
+  state.tasks.clear();
+  state.pending.store(0, memory_order_relaxed);
+}
+
+void OffloadQueue::Run(absl::FunctionRef<void()> f) {
+  auto& state = offload_state();
+  auto task = make_shared<Task>(f);
+  {
+    absl::MutexLock lk(&state.mu);
+    state.tasks.push_back(task);
+    state.pending.fetch_add(1, memory_order_release);
+  }
+
+  if (task->done.WaitFor(kStealWindow))
+    return;
+
+  if (task->Claim()) {
+    {
+      // Remove it so that busy periods do not accumulate stale entries.
+      absl::MutexLock lk(&state.mu);
+      auto it = find(state.tasks.rbegin(), state.tasks.rend(), task);
+      if (it != state.tasks.rend()) {
+        state.tasks.erase(next(it).base());
+        state.pending.fetch_sub(1, memory_order_relaxed);
+      }
+    }
+    task->f();
+    return;
+  }
+
+  // An idle thread is running it right now.
+  task->done.Wait();
+}
+
+uint64_t OffloadQueue::stolen_tasks() {
+  return offload_state().stolen.load(memory_order_relaxed);
+}
+
+int32_t OffloadQueue::IdleCb(uint32_t generation) {
+  auto& state = offload_state();
+  if (state.generation.load(memory_order_relaxed) != generation)
+    return -1;  // unregister itself.
+
+  if (state.pending.load(memory_order_acquire) == 0)
+    return 0;  // lowest priority, nothing to do.
+
+  shared_ptr<Task> task;
+  {
+    absl::MutexLock lk(&state.mu);
+    if (state.tasks.empty())
+      return 0;
+    task = std::move(state.tasks.front());
+    state.tasks.pop_front();
+    state.pending.fetch_sub(1, memory_order_relaxed);
+  }
+
+  // The submitter might have run it inline already.
+  if (task->Claim()) {
+    task->f();
+    state.stolen.fetch_add(1, memory_order_relaxed);
+    task->done.Notify();
+  }
+
+  return util::ProactorBase::kOnIdleMaxLevel;
+}
+
 }  // namespace dfly
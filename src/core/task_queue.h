@@ -4,9 +4,15 @@
 
 #pragma once
 
+#include <absl/functional/function_ref.h>
+
 #include "util/fibers/fiberqueue_threadpool.h"
 #include "util/fibers/fibers.h"
 
+namespace util {
+class ProactorBase;
+}  // namespace util
+
 namespace dfly {
 
 /**
@@ -70,4 +76,30 @@ class TaskQueue {
   static __thread unsigned blocked_submitters_;
 };
 
+/**
+ *  Process-wide queue for work that does not access shard-local data, for example compression
+ *  of already copied buffers. Tasks are stolen by idle proactors. The submitting fiber waits for
+ *  its task and runs it inline if nobody claimed it within a short window, so progress never
+ *  depends on other threads being idle.
+ */
+class OffloadQueue {
+ public:
+  // Registers the idle-time consumer on the calling proactor.
+  static void RegisterThread(util::ProactorBase* pb);
+
+  // Unregisters the consumers lazily and drops the pending tasks' claims.
+  static void Shutdown();
+
+  // Runs `f` on an idle proactor or inline, blocking the calling fiber until it finishes.
+  static void Run(absl::FunctionRef<void()> f);
+
+  // Number of tasks that were run by a thread other than the submitter.
+  static uint64_t stolen_tasks();
+
+ private:
+  struct Task;
+
+  static int32_t IdleCb(uint32_t generation);
+};
+
 }  // namespace dfly
@@ -76,6 +76,14 @@ absl::flat_hash_map<std::string, uint64_t> TopKeys::GetTopKeys() const {
   return results;
 }
 
+void TopKeys::Decay() {
+  for (Cell& cell : fingerprints_) {
+    cell.count /= 2;
+    if (cell.count < options_.min_key_count_to_record)
+      cell.key.clear();
+  }
+}
+
 TopKeys::Cell& TopKeys::GetCell(uint32_t d, uint32_t bucket) {
   DCHECK(d < options_.depth);
   DCHECK(bucket < options_.buckets);
@@ -52,6 +52,10 @@ class TopKeys {
   void Touch(std::string_view key);
   absl::flat_hash_map<std::string, uint64_t> GetTopKeys() const;
 
+  // Halves all counts, so that keys that stop being used eventually fall out of GetTopKeys().
+  // Keys whose count drops below min_key_count_to_record are forgotten.
+  void Decay();
+
  private:
   // Each cell consists of a key-fingerprint, a count, and potentially the key itself, when it's
   // above options_.min_key_count_to_record.
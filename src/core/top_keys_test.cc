@@ -10,6 +10,7 @@
 #include "base/gtest.h"
 #include "base/logging.h"
 
+using ::testing::IsEmpty;
 using ::testing::Pair;
 using ::testing::UnorderedElementsAre;
 
@@ -152,4 +153,22 @@ TEST(TopKeysTest, SavedByMultipleArrays) {
   }
 }
 
+TEST(TopKeysTest, Decay) {
+  TopKeys top_keys({.min_key_count_to_record = 4});
+  for (int i = 0; i < 10; ++i) {
+    top_keys.Touch("key");
+  }
+  EXPECT_THAT(top_keys.GetTopKeys(), UnorderedElementsAre(Pair("key", 10)));
+
+  top_keys.Decay();
+  EXPECT_THAT(top_keys.GetTopKeys(), UnorderedElementsAre(Pair("key", 5)));
+
+  // Below min_key_count_to_record the key is forgotten until it is recorded again.
+  top_keys.Decay();
+  EXPECT_THAT(top_keys.GetTopKeys(), IsEmpty());
+  top_keys.Touch("key");
+  top_keys.Touch("key");
+  EXPECT_THAT(top_keys.GetTopKeys(), UnorderedElementsAre(Pair("key", 4)));
+}
+
 }  // end of namespace dfly
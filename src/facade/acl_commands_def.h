@@ -6,6 +6,7 @@
 
 #include <cstdint>
 #include <limits>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
@@ -19,11 +20,15 @@ enum class KeyOp : int8_t { READ, WRITE, READ_WRITE };
 
 using GlobType = std::pair<std::string, KeyOp>;
 
+class KeyGlobMatcher;
+
 struct AclKeys {
   std::vector<GlobType> key_globs;
   // The user is allowed to "touch" any key. No glob matching required.
   // Alias for ~*
   bool all_keys = false;
+  // key_globs compiled when they change, shared by the copies of the user's keys.
+  std::shared_ptr<const KeyGlobMatcher> matcher;
 };
 
 // The second bool denotes if the pattern contains an asterisk and it's
@@ -44,6 +49,7 @@ struct UserCredentials {
   AclPubSub pub_sub;
   std::string ns;
   size_t db;
+  uint64_t rate_limit = 0;  // command cost per second, 0 means no limit
 };
 
 }  // namespace dfly::acl
@@ -4,6 +4,8 @@
 
 #include "facade/conn_context.h"
 
+#include <algorithm>
+
 #include "absl/flags/internal/flag.h"
 #include "base/flags.h"
 #include "base/logging.h"
@@ -29,6 +31,31 @@ ConnectionContext::ConnectionContext(Connection* owner) : owner_(owner) {
   subscriptions = 0;
 }
 
+void RateLimiter::SetRate(uint64_t cost_per_sec) {
+  if (rate_ != cost_per_sec) {
+    rate_ = cost_per_sec;
+    tokens_ = cost_per_sec;
+    refill_ns_ = 0;
+  }
+}
+
+bool RateLimiter::TryAcquire(uint64_t cost, uint64_t now_ns) {
+  if (rate_ == 0)
+    return true;
+
+  if (refill_ns_ != 0 && now_ns > refill_ns_)
+    tokens_ = std::min<double>(rate_, tokens_ + double(now_ns - refill_ns_) * rate_ / 1e9);
+  refill_ns_ = now_ns;
+
+  // A command costlier than the whole bucket passes when the bucket is full, so it is not
+  // rejected forever.
+  double needed = std::min<double>(cost, rate_);
+  if (tokens_ < needed)
+    return false;
+  tokens_ -= needed;
+  return true;
+}
+
 size_t ConnectionContext::UsedMemory() const {
   return dfly::HeapSize(authed_username) + dfly::HeapSize(acl_commands);
 }
@@ -18,6 +18,26 @@ namespace facade {
 
 class Connection;
 
+// Token bucket limiting the command cost a connection can spend per second. The bucket holds
+// up to one second worth of cost, so short bursts are allowed.
+class RateLimiter {
+ public:
+  // 0 disables the limit.
+  void SetRate(uint64_t cost_per_sec);
+
+  bool enabled() const {
+    return rate_ > 0;
+  }
+
+  // Takes cost from the bucket. Returns false, without taking anything, if the bucket holds less.
+  bool TryAcquire(uint64_t cost, uint64_t now_ns);
+
+ private:
+  uint64_t rate_ = 0;
+  double tokens_ = 0;
+  uint64_t refill_ns_ = 0;
+};
+
 class ConnectionContext {
  public:
   explicit ConnectionContext(Connection* owner);
@@ -67,6 +87,8 @@ class ConnectionContext {
   dfly::acl::AclPubSub pub_sub{{}, true};
   // db index, std::numeric_limits<size_t>::max for ALL db's
   size_t acl_db_idx = 0;
+  // rate limit of the user
+  RateLimiter rate_limiter;
 
  private:
   Connection* owner_;
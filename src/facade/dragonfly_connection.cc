@@ -75,6 +75,18 @@ ABSL_FLAG(uint32_t, pipeline_queue_limit, 10000,
 ABSL_FLAG(facade::MemoryBytesFlag, publish_buffer_limit, 128_MB,
           "Amount of memory to use for storing pub commands in bytes - per IO thread");
 
+ABSL_FLAG(facade::MemoryBytesFlag, subscriber_output_buffer_limit, 0,
+          "Hard limit on the memory of pub/sub messages queued for a single subscriber connection. "
+          "The connection is closed once the limit is crossed. 0 means no limit.");
+
+ABSL_FLAG(facade::MemoryBytesFlag, subscriber_output_buffer_soft_limit, 0,
+          "Soft limit on the memory of pub/sub messages queued for a single subscriber connection. "
+          "The connection is closed if it stays above the limit for "
+          "subscriber_output_buffer_soft_seconds. 0 means no limit.");
+
+ABSL_FLAG(uint32_t, subscriber_output_buffer_soft_seconds, 60,
+          "How long a subscriber connection may stay above subscriber_output_buffer_soft_limit.");
+
 ABSL_FLAG(uint32_t, pipeline_squash, 1,
           "Number of queued pipelined commands above which squashing is enabled, 0 means disabled");
 
@@ -107,6 +119,10 @@ ABSL_FLAG(bool, always_flush_pipeline, false,
           "if true will flush pipeline response after each pipeline squashing");
 
 ABSL_FLAG(uint32_t, pipeline_squash_limit, 1 << 30, "Limit on the size of a squashed pipeline. ");
+ABSL_FLAG(uint32_t, pipeline_squash_latency_usec, 0,
+          "If non-zero, each connection adapts the size of its squashed pipeline batches so that "
+          "dispatching a batch stays within this budget, in microseconds. The batch size is still "
+          "bounded by pipeline_squash_limit. 0 disables adaptation.");
 ABSL_FLAG(uint32_t, pipeline_low_bound_stats, 0,
           "If set, will not track pipeline stats below this threshold. ");
 
@@ -149,44 +165,73 @@ void UpdateIoBufCapacity(const io::IoBuf& io_buf, ConnectionStats* stats,
   }
 }
 
+// Records are serialized into a buffer by the connection fibers and written to the file by a
+// dedicated fiber, so that recording does not block the connections on disk io.
 struct TrafficLogger {
-  // protects agains closing the file while writing or data races when opening the file.
-  // Also, makes sure that LogTraffic are executed atomically.
-  fb2::Mutex mutex;
+  static constexpr size_t kFlushSize = 1 << 16;
+  static constexpr size_t kMaxPendingSize = 64 << 20;  // records are dropped beyond this size.
+
   unique_ptr<io::WriteFile> log_file;
+  string buf;
+  uint64_t dropped = 0;
+  bool stopping = false;
+  fb2::CondVarAny cv;
+  fb2::Fiber flush_fb;
+
+  bool active() const {
+    return log_file && !stopping;
+  }
+
+  void Start(unique_ptr<io::WriteFile> file);
+  void Stop();
 
-  void ResetLocked();
-  // Returns true if Write succeeded, false if it failed and the recording should be aborted.
-  bool Write(string_view blob);
-  bool Write(iovec* blobs, size_t len);
+ private:
+  void FlushFb();
 };
 
-void TrafficLogger::ResetLocked() {
-  if (log_file) {
-    std::ignore = log_file->Close();
-    log_file.reset();
-  }
+void TrafficLogger::Start(unique_ptr<io::WriteFile> file) {
+  log_file = std::move(file);
+
+  // Write version, incremental numbering :)
+  buf.push_back(2);
+  flush_fb = fb2::Fiber("traffic_logger", [this] { FlushFb(); });
 }
 
-// Returns true if Write succeeded, false if it failed and the recording should be aborted.
-bool TrafficLogger::Write(string_view blob) {
-  auto ec = log_file->Write(io::Buffer(blob));
-  if (ec) {
-    LOG(ERROR) << "Error writing to traffic log: " << ec;
-    ResetLocked();
-    return false;
-  }
-  return true;
+void TrafficLogger::Stop() {
+  if (!flush_fb.IsJoinable())
+    return;
+
+  stopping = true;
+  cv.notify_one();
+  flush_fb.Join();
+
+  LOG_IF(WARNING, dropped) << "Dropped " << dropped
+                           << " traffic log records because the disk was too slow";
+  buf.clear();
+  dropped = 0;
+  stopping = false;
 }
 
-bool TrafficLogger::Write(iovec* blobs, size_t len) {
-  auto ec = log_file->Write(blobs, len);
-  if (ec) {
-    LOG(ERROR) << "Error writing to traffic log: " << ec;
-    ResetLocked();
-    return false;
+void TrafficLogger::FlushFb() {
+  string out;
+  while (log_file) {
+    fb2::NoOpLock noop;
+    cv.wait_for(noop, 100ms, [this] { return stopping || buf.size() >= kFlushSize; });
+
+    out.clear();
+    out.swap(buf);
+    if (!out.empty()) {
+      if (auto ec = log_file->Write(io::Buffer(out)); ec) {
+        LOG(ERROR) << "Error writing to traffic log: " << ec;
+        break;
+      }
+    }
+    if (stopping)
+      break;
   }
-  return true;
+
+  std::ignore = log_file->Close();
+  log_file.reset();
 }
 
 thread_local TrafficLogger tl_traffic_logger{};
@@ -195,9 +240,9 @@ thread_local base::Histogram* io_req_size_hist = nullptr;
 thread_local const size_t reply_size_limit = absl::GetFlag(FLAGS_squashed_reply_size_limit);
 
 void OpenTrafficLogger(string_view base_path) {
-  unique_lock lk{tl_traffic_logger.mutex};
   if (tl_traffic_logger.log_file)
     return;
+  tl_traffic_logger.Stop();  // joins the flushing fiber if it stopped on a write error.
 
 #ifdef __linux__
   // Open file with append mode, without it concurrent fiber writes seem to conflict
@@ -208,14 +253,10 @@ void OpenTrafficLogger(string_view base_path) {
     LOG(ERROR) << "Error opening a file " << path << " for traffic logging: " << file.error();
     return;
   }
-  tl_traffic_logger.log_file = unique_ptr<io::WriteFile>{file.value()};
+  tl_traffic_logger.Start(unique_ptr<io::WriteFile>{file.value()});
 #else
   LOG(WARNING) << "Traffic logger is only supported on Linux";
 #endif
-
-  // Write version, incremental numbering :)
-  uint8_t version[1] = {2};
-  std::ignore = tl_traffic_logger.log_file->Write(version);
 }
 
 void LogTraffic(uint32_t id, bool has_more, absl::Span<RespExpr> resp,
@@ -226,11 +267,19 @@ void LogTraffic(uint32_t id, bool has_more, absl::Span<RespExpr> resp,
 
   DVLOG(2) << "Recording " << cmd;
 
-  char stack_buf[1024];
-  char* next = stack_buf;
+  string& buf = tl_traffic_logger.buf;
+  if (buf.size() >= TrafficLogger::kMaxPendingSize) {
+    ++tl_traffic_logger.dropped;
+    return;
+  }
 
   // We write id, timestamp, db_index, has_more, num_parts, part_len, part_len, part_len, ...
   // And then all the part blobs concatenated together.
+  size_t header_size = 24 + 4 * resp.size();
+  size_t start = buf.size();
+  buf.resize(start + header_size);
+  char* next = buf.data() + start;
+
   auto write_u32 = [&next](uint32_t i) {
     absl::little_endian::Store32(next, i);
     next += 4;
@@ -250,46 +299,16 @@ void LogTraffic(uint32_t id, bool has_more, absl::Span<RespExpr> resp,
   write_u32(has_more ? 1 : 0);
   write_u32(uint32_t(resp.size()));
 
-  // Grab the lock and check if the file is still open.
-  lock_guard lk{tl_traffic_logger.mutex};
-  if (!tl_traffic_logger.log_file)
-    return;
-
   // part_len, ...
-  for (auto part : resp) {
-    if (size_t(next - stack_buf + 4) > sizeof(stack_buf)) {
-      if (!tl_traffic_logger.Write(string_view{stack_buf, size_t(next - stack_buf)})) {
-        return;
-      }
-      next = stack_buf;
-    }
+  for (auto part : resp)
     write_u32(part.GetView().size());
-  }
 
   // Write the data itself.
-  array<iovec, 16> blobs;
-  unsigned index = 0;
-  if (next != stack_buf) {
-    blobs[index++] = iovec{.iov_base = stack_buf, .iov_len = size_t(next - stack_buf)};
-  }
-
-  for (auto part : resp) {
-    if (auto blob_len = part.GetView().size(); blob_len > 0) {
-      blobs[index++] =
-          iovec{.iov_base = const_cast<char*>(part.GetView().data()), .iov_len = blob_len};
-
-      if (index >= blobs.size()) {
-        if (!tl_traffic_logger.Write(blobs.data(), blobs.size())) {
-          return;
-        }
-        index = 0;
-      }
-    }
-  }
+  for (auto part : resp)
+    buf.append(part.GetView());
 
-  if (index) {
-    tl_traffic_logger.Write(blobs.data(), index);
-  }
+  if (buf.size() >= TrafficLogger::kFlushSize)
+    tl_traffic_logger.cv.notify_one();
 }
 
 constexpr size_t kMinReadSize = 256;
@@ -322,6 +341,9 @@ struct QueueBackpressure {
   size_t publish_buffer_limit = 0;        // cached flag publish_buffer_limit
   size_t pipeline_cache_limit = 0;        // cached flag pipeline_cache_limit
   size_t pipeline_buffer_limit = 0;       // cached flag for buffer size in bytes
+  size_t subscriber_output_hard_limit = 0;  // cached flag subscriber_output_buffer_limit
+  size_t subscriber_output_soft_limit = 0;  // cached flag subscriber_output_buffer_soft_limit
+  uint64_t subscriber_output_soft_ns = 0;   // cached flag subscriber_output_buffer_soft_seconds
   uint32_t pipeline_queue_max_len = 256;  // cached flag for pipeline queue max length.
 };
 
@@ -342,6 +364,8 @@ QueueBackpressure& GetQueueBackpressure() {
 thread_local uint64_t max_busy_read_cycles_cached = 1ULL << 32;
 thread_local bool always_flush_pipeline_cached = absl::GetFlag(FLAGS_always_flush_pipeline);
 thread_local uint32_t pipeline_squash_limit_cached = absl::GetFlag(FLAGS_pipeline_squash_limit);
+thread_local uint64_t pipeline_squash_latency_ns_cached =
+    uint64_t(absl::GetFlag(FLAGS_pipeline_squash_latency_usec)) * 1000;
 thread_local uint32_t pipeline_low_bound_stats_cached =
     absl::GetFlag(FLAGS_pipeline_low_bound_stats);
 
@@ -459,7 +483,10 @@ size_t Connection::MessageHandle::UsedMemory() const {
       return 0;  // no access to internal type, memory usage negligible
     }
     size_t operator()(const InvalidationMessage& msg) {
-      return 0;
+      size_t res = msg.keys.capacity() * sizeof(string);
+      for (const auto& key : msg.keys)
+        res += key.capacity();
+      return res;
     }
     size_t operator()(const MCPipelineMessagePtr& msg) {
       return sizeof(MCPipelineMessage) + msg->backing_size +
@@ -512,6 +539,7 @@ void Connection::AsyncOperations::operator()(const AclUpdateMessage& msg) {
       self->cntx()->keys = msg.keys;
       self->cntx()->pub_sub = msg.pub_sub;
       self->cntx()->acl_db_idx = msg.db_indx;
+      self->cntx()->rate_limiter.SetRate(msg.rate_limit);
     }
   }
 }
@@ -537,6 +565,11 @@ void Connection::AsyncOperations::operator()(const PubMessage& pub_msg) {
     return;
   }
 
+  if (pub_msg.pattern.empty() && !pub_msg.header.empty()) {
+    rbuilder->SendPubMessage(pub_msg.header, pub_msg.message);
+    return;
+  }
+
   unsigned i = 0;
   array<string_view, 4> arr;
   if (pub_msg.pattern.empty()) {
@@ -588,8 +621,7 @@ void Connection::AsyncOperations::operator()(const InvalidationMessage& msg) {
   if (msg.invalidate_due_to_flush) {
     rbuilder->SendNull();
   } else {
-    string_view keys[] = {msg.key};
-    rbuilder->SendBulkStrArr(keys);
+    rbuilder->SendBulkStrArr(OwnedArgSlice{msg.keys});
   }
 }
 
@@ -616,6 +648,10 @@ void Connection::Init(unsigned io_threads) {
     qbp.pipeline_cache_limit = GetFlag(FLAGS_request_cache_limit);
     qbp.pipeline_buffer_limit = GetFlag(FLAGS_pipeline_buffer_limit);
     qbp.pipeline_queue_max_len = GetFlag(FLAGS_pipeline_queue_limit);
+    qbp.subscriber_output_hard_limit = GetFlag(FLAGS_subscriber_output_buffer_limit);
+    qbp.subscriber_output_soft_limit = GetFlag(FLAGS_subscriber_output_buffer_soft_limit);
+    qbp.subscriber_output_soft_ns =
+        uint64_t(GetFlag(FLAGS_subscriber_output_buffer_soft_seconds)) * 1'000'000'000;
 
     if (qbp.publish_buffer_limit == 0 || qbp.pipeline_cache_limit == 0 ||
         qbp.pipeline_buffer_limit == 0 || qbp.pipeline_queue_max_len == 0) {
@@ -1225,7 +1261,7 @@ Connection::ParserStatus Connection::ParseRedis(unsigned max_busy_cycles) {
       request_consumed_bytes_ = 0;
       bool has_more = consumed < read_buffer.available_bytes;
 
-      if (tl_traffic_logger.log_file && IsMain() /* log only on the main interface */) {
+      if (tl_traffic_logger.active() && IsMain() /* log only on the main interface */) {
         LogTraffic(id_, has_more, absl::MakeSpan(tmp_parse_args_),
                    service_->GetContextInfo(cc_.get()));
       }
@@ -1243,6 +1279,7 @@ Connection::ParserStatus Connection::ParseRedis(unsigned max_busy_cycles) {
     // Specifically, if a client sends a huge chunk of data resulting in a very long pipeline,
     // we want to yield to allow AsyncFiber to actually execute on the pending pipeline.
     if (ThisFiber::GetRunningTimeCycles() > max_busy_cycles) {
+      stats_->busy_read_yields++;
       ThisFiber::Yield();
     }
   } while (RedisParser::OK == result && read_buffer.available_bytes > 0 &&
@@ -1447,6 +1484,10 @@ auto Connection::IoLoop() -> variant<error_code, ParserStatus> {
     phase_ = PROCESS;
     bool is_iobuf_full = io_buf_.AppendLen() == 0;
 
+    // Data received into provided buffers is parsed in place and partial requests are kept by the
+    // parser, so io_buf_ doesn't need to grow for them.
+    bool is_provided = recv_provided_ && recv_buf_.res_len > 0;
+
     if (redis_parser_) {
       parse_status = ParseRedis(max_busy_read_cycles_cached);
     } else {
@@ -1462,7 +1503,7 @@ auto Connection::IoLoop() -> variant<error_code, ParserStatus> {
       parse_status = OK;
 
       size_t capacity = io_buf_.Capacity();
-      if (capacity < max_iobfuf_len) {
+      if (!is_provided && capacity < max_iobfuf_len) {
         size_t parser_hint = 0;
         if (redis_parser_)
           parser_hint = redis_parser_->parselen_hint();  // Could be done for MC as well.
@@ -1530,8 +1571,12 @@ void Connection::SquashPipeline() {
   DCHECK_EQ(dispatch_q_.size(), pending_pipeline_cmd_cnt_);
   DCHECK_EQ(reply_builder_->GetProtocol(), Protocol::REDIS);  // Only Redis is supported.
 
+  const uint32_t squash_limit = pipeline_squash_latency_ns_cached
+                                    ? min(squash_batch_limit_, pipeline_squash_limit_cached)
+                                    : pipeline_squash_limit_cached;
+
   vector<ArgSlice> squash_cmds;
-  squash_cmds.reserve(dispatch_q_.size());
+  squash_cmds.reserve(min<size_t>(dispatch_q_.size(), squash_limit));
 
   bool include_pipeline_for_stats = dispatch_q_.size() >= pipeline_low_bound_stats_cached;
   for (auto& msg : dispatch_q_) {
@@ -1543,7 +1588,7 @@ void Connection::SquashPipeline() {
     }
     auto& pmsg = get<PipelineMessagePtr>(msg.handle);
     squash_cmds.push_back(absl::MakeSpan(pmsg->args));
-    if (squash_cmds.size() >= pipeline_squash_limit_cached) {
+    if (squash_cmds.size() >= squash_limit) {
       // We reached the limit of commands to squash, so we dispatch them.
       break;
     }
@@ -1556,8 +1601,13 @@ void Connection::SquashPipeline() {
   } else {
     stats_->pipeline_stats_ignored++;
   }
+  uint64_t start_ns = ProactorBase::GetMonotonicTimeNs();
   size_t dispatched =
       service_->DispatchManyCommands(absl::MakeSpan(squash_cmds), reply_builder_.get(), cc_.get());
+  if (pipeline_squash_latency_ns_cached) {
+    AdaptSquashBatchLimit(ProactorBase::GetMonotonicTimeNs() - start_ns,
+                          squash_cmds.size() >= squash_limit);
+  }
 
   // async_dispatch is a guard to prevent concurrent writes into reply_builder_, hence
   // it must guard the Flush() as well.
@@ -1585,6 +1635,21 @@ void Connection::SquashPipeline() {
   skip_next_squashing_ = dispatched != squash_cmds.size();
 }
 
+// AIMD controller over the squashed batch size: halve the window when a batch exceeds the
+// latency budget, and grow it gradually while batches fill the window within budget.
+// Dispatch latency already includes the time spent waiting in the shard queues, so a backlog
+// on the shards shrinks the window as well.
+void Connection::AdaptSquashBatchLimit(uint64_t dispatch_ns, bool batch_was_capped) {
+  constexpr uint32_t kMinSquashBatch = 8;
+
+  if (dispatch_ns > pipeline_squash_latency_ns_cached) {
+    squash_batch_limit_ = max(kMinSquashBatch, squash_batch_limit_ / 2);
+  } else if (batch_was_capped && squash_batch_limit_ < pipeline_squash_limit_cached) {
+    uint32_t step = max(1u, squash_batch_limit_ / 8);
+    squash_batch_limit_ = min(pipeline_squash_limit_cached, squash_batch_limit_ + step);
+  }
+}
+
 void Connection::ClearPipelinedMessages() {
   AsyncOperations async_op{reply_builder_.get(), this};
 
@@ -1744,7 +1809,7 @@ Connection::PipelineMessagePtr Connection::FromArgs(const RespVec& args) {
   static_assert(alignof(PipelineMessage) == 8);
 
   PipelineMessagePtr ptr;
-  if (ptr = GetFromPipelinePool(); ptr) {
+  if (ptr = GetFromPipelinePool(args.size(), backed_sz); ptr) {
     ptr->Reset(args.size(), backed_sz);
   } else {
     // We must construct in place here, since there is a slice that uses memory locations
@@ -1765,10 +1830,23 @@ void Connection::ShrinkPipelinePool() {
   }
 }
 
-Connection::PipelineMessagePtr Connection::GetFromPipelinePool() {
+Connection::PipelineMessagePtr Connection::GetFromPipelinePool(size_t nargs,
+                                                               size_t storage_sz) {
   if (pipeline_req_pool_.empty())
     return nullptr;
 
+  // Pipelines of similar commands recycle messages of similar size, so looking at a few of the
+  // most recently recycled entries is usually enough to find one that won't have to reallocate.
+  constexpr size_t kMaxLookup = 4;
+  size_t lookup = std::min(pipeline_req_pool_.size(), kMaxLookup);
+  for (size_t i = 1; i <= lookup; ++i) {
+    auto& candidate = pipeline_req_pool_[pipeline_req_pool_.size() - i];
+    if (candidate->storage.capacity() >= storage_sz && candidate->args.capacity() >= nargs) {
+      std::swap(candidate, pipeline_req_pool_.back());
+      break;
+    }
+  }
+
   auto ptr = std::move(pipeline_req_pool_.back());
   stats_->pipeline_cmd_cache_bytes -= ptr->StorageCapacity();
   pipeline_req_pool_.pop_back();
@@ -1879,9 +1957,19 @@ void Connection::SendAsync(MessageHandle msg) {
 
   QueueBackpressure& qbp = GetQueueBackpressure();
 
-  // Close MONITOR connection if we overflow pipeline limits
-  if (msg.IsMonitor() &&
-      qbp.IsPipelineBufferOverLimit(stats_->dispatch_queue_bytes, dispatch_q_.size())) {
+  size_t used_mem = msg.UsedMemory();
+
+  // Close MONITOR connection if we overflow pipeline limits, and subscribers that do not keep
+  // up with their pub/sub messages.
+  bool over_limit =
+      msg.IsMonitor() &&
+      qbp.IsPipelineBufferOverLimit(stats_->dispatch_queue_bytes, dispatch_q_.size());
+  if (msg.IsPubMsg() && IsSubscriberOutputOverLimit(used_mem)) {
+    ++stats_->output_buffer_limit_disconnects;
+    over_limit = true;
+  }
+
+  if (over_limit) {
     cc_->conn_closing = true;
     request_shutdown_ = true;
     // We don't shutdown here. The reason is that TLS socket is preemptive
@@ -1890,7 +1978,6 @@ void Connection::SendAsync(MessageHandle msg) {
     return;
   }
 
-  size_t used_mem = msg.UsedMemory();
   stats_->dispatch_queue_entries++;
   stats_->dispatch_queue_bytes += used_mem;
 
@@ -1898,6 +1985,7 @@ void Connection::SendAsync(MessageHandle msg) {
   if (msg.IsPubMsg()) {
     qbp.subscriber_bytes.fetch_add(used_mem, memory_order_relaxed);
     stats_->dispatch_queue_subscriber_bytes += used_mem;
+    pending_pubsub_bytes_ += used_mem;
   }
 
   // Squashing is only applied to redis commands
@@ -1921,6 +2009,28 @@ void Connection::SendAsync(MessageHandle msg) {
   }
 }
 
+// Mirrors the pubsub class of Redis client-output-buffer-limit: crossing the hard limit or
+// staying above the soft limit for too long marks the subscriber for disconnection.
+bool Connection::IsSubscriberOutputOverLimit(size_t msg_bytes) {
+  const QueueBackpressure& qbp = GetQueueBackpressure();
+  size_t pending = pending_pubsub_bytes_ + msg_bytes;
+
+  if (qbp.subscriber_output_hard_limit && pending > qbp.subscriber_output_hard_limit)
+    return true;
+
+  if (qbp.subscriber_output_soft_limit == 0 || pending <= qbp.subscriber_output_soft_limit) {
+    pubsub_soft_limit_since_ns_ = 0;
+    return false;
+  }
+
+  uint64_t now = ProactorBase::GetMonotonicTimeNs();
+  if (pubsub_soft_limit_since_ns_ == 0) {
+    pubsub_soft_limit_since_ns_ = now;
+    return false;
+  }
+  return now - pubsub_soft_limit_since_ns_ >= qbp.subscriber_output_soft_ns;
+}
+
 void Connection::RecycleMessage(MessageHandle msg) {
   size_t used_mem = msg.UsedMemory();
 
@@ -1931,6 +2041,8 @@ void Connection::RecycleMessage(MessageHandle msg) {
   if (msg.IsPubMsg()) {
     qbp.subscriber_bytes.fetch_sub(used_mem, memory_order_relaxed);
     stats_->dispatch_queue_subscriber_bytes -= used_mem;
+    DCHECK_GE(pending_pubsub_bytes_, used_mem);
+    pending_pubsub_bytes_ -= used_mem;
   }
 
   if (msg.IsPipelineMsg() && msg.dispatch_ts) {
@@ -2002,8 +2114,7 @@ void Connection::StartTrafficLogging(string_view path) {
 }
 
 void Connection::StopTrafficLogging() {
-  lock_guard lk(tl_traffic_logger.mutex);
-  tl_traffic_logger.ResetLocked();
+  tl_traffic_logger.Stop();
 }
 
 bool Connection::IsHttp() const {
@@ -2043,8 +2154,9 @@ void Connection::BreakOnce(uint32_t ev_mask) {
 
 void Connection::ConfigureProvidedBuffer() {
   // Provided buffers are supported by IOURING.
-  // We currently support them for TCP sockets only.
-  if (socket_->proactor()->GetKind() == ProactorBase::IOURING && !is_tls_) {
+  // We currently support them for TCP sockets and the redis protocol only, because the memcache
+  // parser reads directly from io_buf_.
+  if (socket_->proactor()->GetKind() == ProactorBase::IOURING && !is_tls_ && redis_parser_) {
 #ifdef __linux__
     auto* up = static_cast<fb2::UringProactor*>(socket_->proactor());
 
@@ -2167,6 +2279,10 @@ void Connection::SetPipelineSquashLimitThreadLocal(unsigned limit) {
   pipeline_squash_limit_cached = limit;
 }
 
+void Connection::SetPipelineSquashLatencyThreadLocal(unsigned usec) {
+  pipeline_squash_latency_ns_cached = uint64_t(usec) * 1000;
+}
+
 void Connection::SetPipelineLowBoundStats(unsigned limit) {
   pipeline_low_bound_stats_cached = limit;
 }
@@ -73,6 +73,7 @@ class Connection : public util::Connection {
     std::string pattern{};              // non-empty for pattern subscriber
     std::shared_ptr<char[]> buf;        // stores channel name and message
     std::string_view channel, message;  // channel and message parts from buf
+    std::string_view header;            // pre-rendered push header from buf, see SendPubMessage
     bool should_unsubscribe = false;    // unsubscribe from channel after sending the message
   };
 
@@ -115,6 +116,7 @@ class Connection : public util::Connection {
     dfly::acl::AclKeys keys;
     dfly::acl::AclPubSub pub_sub;
     size_t db_indx;
+    uint64_t rate_limit;
   };
 
   // Migration request message, the async fiber stops to give way for thread migration.
@@ -125,8 +127,10 @@ class Connection : public util::Connection {
     util::fb2::BlockingCounter bc;  // Decremented counter when processed
   };
 
+  // Invalidation push for client tracking. Holds a single key in the default tracking mode and
+  // all keys coalesced on the thread for BCAST mode connections.
   struct InvalidationMessage {
-    std::string key;
+    std::vector<std::string> keys;
     bool invalidate_due_to_flush = false;
   };
 
@@ -313,6 +317,7 @@ class Connection : public util::Connection {
   static void SetMaxBusyReadUsecThreadLocal(unsigned usec);
   static void SetAlwaysFlushPipelineThreadLocal(bool flush);
   static void SetPipelineSquashLimitThreadLocal(unsigned limit);
+  static void SetPipelineSquashLatencyThreadLocal(unsigned usec);
   static void SetPipelineLowBoundStats(unsigned limit);
 
   unsigned idle_time() const {
@@ -378,7 +383,8 @@ class Connection : public util::Connection {
   void ShrinkPipelinePool();
 
   // Returns non-null request ptr if pool has vacant entries.
-  PipelineMessagePtr GetFromPipelinePool();
+  // Prefers an entry that can hold the requested sizes without reallocating.
+  PipelineMessagePtr GetFromPipelinePool(size_t nargs, size_t storage_sz);
 
   void HandleMigrateRequest();
   std::error_code HandleRecvSocket();
@@ -389,6 +395,7 @@ class Connection : public util::Connection {
 
   // Squashes pipelined commands from the dispatch queue to spread load over all threads
   void SquashPipeline();
+  void AdaptSquashBatchLimit(uint64_t dispatch_ns, bool batch_was_capped);
 
   // Clear pipelined messages, disaptching only intrusive ones.
   void ClearPipelinedMessages();
@@ -426,12 +433,22 @@ class Connection : public util::Connection {
 
   bool IsReplySizeOverLimit() const;
 
+  // Checks the per-connection pub/sub output limits before queueing a message of msg_bytes.
+  bool IsSubscriberOutputOverLimit(size_t msg_bytes);
+
   std::deque<MessageHandle> dispatch_q_;  // dispatch queue
   util::fb2::CondVarAny cnd_;             // dispatch queue waker
   util::fb2::Fiber async_fb_;             // async fiber (if started)
 
+  // Adaptive limit on the squashed batch size, used when pipeline_squash_latency_usec is set.
+  uint32_t squash_batch_limit_ = 64;
+
   uint64_t pending_pipeline_cmd_cnt_ = 0;  // how many queued Redis async commands in dispatch_q
   size_t pending_pipeline_bytes_ = 0;      // how many bytes of the queued Redis async commands
+  size_t pending_pubsub_bytes_ = 0;        // how many bytes of queued pub/sub messages
+
+  // When the queued pub/sub messages crossed the soft output limit, 0 if below it.
+  uint64_t pubsub_soft_limit_since_ns_ = 0;
 
   // how many bytes of the current request have been consumed
   size_t request_consumed_bytes_ = 0;
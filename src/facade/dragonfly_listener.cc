@@ -18,6 +18,7 @@
 #include "base/flags.h"
 #include "base/logging.h"
 #include "facade/dragonfly_connection.h"
+#include "facade/numa.h"
 #include "facade/service_interface.h"
 #include "util/proactor_pool.h"
 
@@ -31,6 +32,9 @@ ABSL_FLAG(bool, no_tls_on_admin_port, false, "Allow non-tls connections on admin
 ABSL_FLAG(bool, conn_use_incoming_cpu, false,
           "If true uses incoming cpu of a socket in order to distribute"
           " incoming connections");
+ABSL_FLAG(std::string, numa_nic, "",
+          "Network interface of the clients. If set on a NUMA host, connections are accepted on "
+          "the threads running on the NUMA node of the interface");
 
 ABSL_DECLARE_FLAG(std::string, tls_cert_file);
 ABSL_DECLARE_FLAG(std::string, tls_key_file);
@@ -236,6 +240,34 @@ uint64_t Listener::RefusedConnectionMaxClientsCount() {
 }
 
 void Listener::PreAcceptLoop(util::ProactorBase* pb) {
+  string nic = GetFlag(FLAGS_numa_nic);
+  if (nic.empty() || IsPrivilegedInterface())
+    return;
+
+  optional<unsigned> node = NumaTopology::NodeOfInterface(nic);
+  if (!node || *node >= NumaTopology::Get().num_nodes()) {
+    LOG(WARNING) << "NUMA node of " << nic << " is unknown, accepting connections on all threads";
+    return;
+  }
+
+  for (unsigned cpu : NumaTopology::Get().CpusOfNode(*node)) {
+    for (unsigned id : pool()->MapCpuToThreads(cpu)) {
+      if (IsConnectionThread(id))
+        numa_threads_.push_back(id);
+    }
+  }
+  LOG(INFO) << "Accepting connections on the " << numa_threads_.size() << " threads of NUMA node "
+            << *node << " of " << nic;
+}
+
+void Listener::SetConnectionThreads(unsigned start, unsigned count) {
+  conn_thread_start_ = start;
+  conn_thread_cnt_ = count;
+}
+
+bool Listener::IsConnectionThread(unsigned id) const {
+  return conn_thread_cnt_ == 0 ||
+         (id >= conn_thread_start_ && id < conn_thread_start_ + conn_thread_cnt_);
 }
 
 bool Listener::IsPrivilegedInterface() const {
@@ -319,13 +351,22 @@ ProactorBase* Listener::PickConnectionProactor(util::FiberSocketBase* sock) {
         // on the CPUs that handle the softirqs for the incoming packets.
         // To avoid imbalance in CPU load, RPS tuning is strongly advised.
         const vector<unsigned>& ids = pool()->MapCpuToThreads(cpu);
-        if (!ids.empty()) {
+        if (!ids.empty() && IsConnectionThread(ids[0])) {
           res_id = ids[0];
         }
       }
     }
   }
 
+  if (res_id == kuint32max && !numa_threads_.empty()) {
+    res_id = numa_threads_[next_id_.fetch_add(1, std::memory_order_relaxed) % numa_threads_.size()];
+  }
+
+  if (res_id == kuint32max && conn_thread_cnt_ > 0) {
+    uint32_t next = next_id_.fetch_add(1, std::memory_order_relaxed);
+    res_id = conn_thread_start_ + next % conn_thread_cnt_;
+  }
+
   if (res_id == kuint32max) {
     uint32_t total = GetFlag(FLAGS_conn_io_threads);
     uint32_t start = GetFlag(FLAGS_conn_io_thread_start) % pp->size();
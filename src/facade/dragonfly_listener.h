@@ -50,6 +50,10 @@ class Listener : public util::ListenerInterface {
   bool IsPrivilegedInterface() const;
   bool IsMainInterface() const;
 
+  // Restricts new connections to the threads [start, start + count), overriding
+  // --conn_io_threads and --conn_io_thread_start. Must be called before the accept loop starts.
+  void SetConnectionThreads(unsigned start, unsigned count);
+
   Protocol protocol() const {
     return protocol_;
   }
@@ -63,6 +67,8 @@ class Listener : public util::ListenerInterface {
   void OnMaxConnectionsReached(util::FiberSocketBase* sock) final;
   void PreAcceptLoop(ProactorBase* pb) final;
 
+  bool IsConnectionThread(unsigned id) const;
+
   void PreShutdown() final;
   void PostShutdown() final;
 
@@ -72,6 +78,13 @@ class Listener : public util::ListenerInterface {
 
   std::atomic_uint32_t next_id_{0};
 
+  // Threads on the NUMA node of --numa_nic, preferred for new connections.
+  std::vector<unsigned> numa_threads_;
+
+  // Set by SetConnectionThreads, conn_thread_cnt_ is 0 if connections are not restricted.
+  unsigned conn_thread_start_ = 0;
+  unsigned conn_thread_cnt_ = 0;
+
   Role role_;
 
   uint32_t conn_cnt_{0};
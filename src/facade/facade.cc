@@ -20,7 +20,7 @@ using namespace std;
 constexpr size_t kSizeConnStats = sizeof(ConnectionStats);
 
 ConnectionStats& ConnectionStats::operator+=(const ConnectionStats& o) {
-  static_assert(kSizeConnStats == 184u);
+  static_assert(kSizeConnStats == 200u);
 
   ADD(read_buf_capacity);
   ADD(dispatch_queue_entries);
@@ -40,12 +40,14 @@ ConnectionStats& ConnectionStats::operator+=(const ConnectionStats& o) {
   ADD(num_migrations);
   ADD(num_recv_provided_calls);
   ADD(pipeline_throttle_count);
+  ADD(output_buffer_limit_disconnects);
   ADD(tls_accept_disconnects);
   ADD(handshakes_started);
   ADD(handshakes_completed);
   ADD(pipeline_dispatch_calls);
   ADD(pipeline_dispatch_commands);
   ADD(pipeline_stats_ignored);
+  ADD(busy_read_yields);
 
   return *this;
 }
@@ -120,9 +120,15 @@ struct ConnectionStats {
 
   // Number of events when the pipeline queue was over the limit and was throttled.
   uint64_t pipeline_throttle_count = 0;
+
+  // Number of subscribers disconnected for crossing their output buffer limits.
+  uint64_t output_buffer_limit_disconnects = 0;
   uint64_t pipeline_dispatch_calls = 0;
   uint64_t pipeline_dispatch_commands = 0;
   uint64_t pipeline_stats_ignored = 0;
+
+  // Yields of the connection parser after running for more than max_busy_read_usec.
+  uint64_t busy_read_yields = 0;
   ConnectionStats& operator+=(const ConnectionStats& o);
 };
 
@@ -79,6 +79,9 @@ class MemcacheParser {
 
     // Used internally by meta parsing.
     std::string blob;
+
+    // Clears the state left from a previously parsed command, keeps the allocated capacity.
+    void Reset();
   };
 
   enum Result {
@@ -149,6 +149,26 @@ TEST_F(MCParserTest, Meta) {
   EXPECT_TRUE(cmd_.return_hit);
 }
 
+TEST_F(MCParserTest, ResetBetweenCommands) {
+  // The same command object is reused for a stream of requests, nothing may leak between them.
+  ASSERT_EQ(MemcacheParser::OK, parser_.Parse("mg a v f q\r\n", &consumed_, &cmd_));
+  EXPECT_TRUE(cmd_.meta);
+  EXPECT_TRUE(cmd_.return_value);
+
+  ASSERT_EQ(MemcacheParser::OK, parser_.Parse("get  b   c\r\n", &consumed_, &cmd_));
+  EXPECT_EQ(MemcacheParser::GET, cmd_.type);
+  EXPECT_EQ("b", cmd_.key);
+  EXPECT_THAT(cmd_.keys_ext, ElementsAre("c"));
+  EXPECT_FALSE(cmd_.meta);
+  EXPECT_FALSE(cmd_.return_value);
+  EXPECT_FALSE(cmd_.return_flags);
+  EXPECT_FALSE(cmd_.no_reply);
+
+  ASSERT_EQ(MemcacheParser::OK, parser_.Parse("get d\r\n", &consumed_, &cmd_));
+  EXPECT_EQ("d", cmd_.key);
+  EXPECT_THAT(cmd_.keys_ext, IsEmpty());
+}
+
 TEST_F(MCParserTest, Gat) {
   auto res = parser_.Parse("gat 1000 foo bar baz\r\n", &consumed_, &cmd_);
   EXPECT_EQ(MemcacheParser::OK, res);
@@ -0,0 +1,108 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "facade/numa.h"
+
+#include <absl/strings/numbers.h>
+#include <absl/strings/str_cat.h>
+#include <absl/strings/str_split.h>
+#include <absl/strings/strip.h>
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+#include <unistd.h>
+
+#include "base/logging.h"
+#include "io/file_util.h"
+
+namespace facade {
+
+using namespace std;
+
+vector<unsigned> NumaTopology::ParseCpuList(string_view list) {
+  vector<unsigned> res;
+  for (string_view range : absl::StrSplit(absl::StripAsciiWhitespace(list), ',')) {
+    if (range.empty())
+      continue;
+
+    vector<string_view> bounds = absl::StrSplit(range, absl::MaxSplits('-', 1));
+    unsigned from = 0, to = 0;
+    if (!absl::SimpleAtoi(bounds[0], &from))
+      continue;
+    to = from;
+    if (bounds.size() == 2 && !absl::SimpleAtoi(bounds[1], &to))
+      continue;
+
+    for (unsigned cpu = from; cpu <= to; ++cpu)
+      res.push_back(cpu);
+  }
+  return res;
+}
+
+NumaTopology::NumaTopology() {
+  for (unsigned node = 0;; ++node) {
+    auto cpulist =
+        io::ReadFileToString(absl::StrCat("/sys/devices/system/node/node", node, "/cpulist"));
+    if (!cpulist)
+      break;
+
+    vector<unsigned> cpus = ParseCpuList(*cpulist);
+    for (unsigned cpu : cpus) {
+      if (cpu >= cpu_node_.size())
+        cpu_node_.resize(cpu + 1, 0);
+      cpu_node_[cpu] = node;
+    }
+    node_cpus_.push_back(std::move(cpus));
+  }
+
+  if (node_cpus_.empty()) {
+    unsigned num_cpus = sysconf(_SC_NPROCESSORS_CONF);
+    node_cpus_.emplace_back(num_cpus);
+    for (unsigned cpu = 0; cpu < num_cpus; ++cpu)
+      node_cpus_[0][cpu] = cpu;
+    cpu_node_.assign(num_cpus, 0);
+  }
+}
+
+const NumaTopology& NumaTopology::Get() {
+  static NumaTopology topology;
+  return topology;
+}
+
+optional<unsigned> NumaTopology::NodeOfInterface(string_view ifname) {
+  auto node = io::ReadFileToString(absl::StrCat("/sys/class/net/", ifname, "/device/numa_node"));
+  int res = -1;
+  if (!node || !absl::SimpleAtoi(absl::StripAsciiWhitespace(*node), &res) || res < 0)
+    return nullopt;
+  return res;
+}
+
+optional<unsigned> PreferLocalNumaNode() {
+#ifdef __linux__
+  const NumaTopology& topology = NumaTopology::Get();
+  int cpu = sched_getcpu();
+  if (cpu < 0 || topology.num_nodes() < 2)
+    return nullopt;
+
+  unsigned node = topology.NodeOfCpu(cpu);
+  constexpr unsigned kMaxNodes = sizeof(unsigned long) * 8;
+  if (node >= kMaxNodes)
+    return nullopt;
+
+  unsigned long mask = 1UL << node;
+  if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, kMaxNodes) != 0) {
+    LOG(WARNING) << "Could not prefer NUMA node " << node << ": " << strerror(errno);
+    return nullopt;
+  }
+  return node;
+#else
+  return nullopt;
+#endif
+}
+
+}  // namespace facade
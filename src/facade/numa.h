@@ -0,0 +1,51 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace facade {
+
+// NUMA topology of the host as reported by /sys/devices/system/node. Hosts without NUMA support
+// are reported as a single node holding all CPUs.
+class NumaTopology {
+ public:
+  // Loaded once on first use.
+  static const NumaTopology& Get();
+
+  unsigned num_nodes() const {
+    return node_cpus_.size();
+  }
+
+  // Returns 0 for unknown CPUs.
+  unsigned NodeOfCpu(unsigned cpu) const {
+    return cpu < cpu_node_.size() ? cpu_node_[cpu] : 0;
+  }
+
+  const std::vector<unsigned>& CpusOfNode(unsigned node) const {
+    return node_cpus_[node];
+  }
+
+  // Returns the node the network interface is attached to, if it is known.
+  static std::optional<unsigned> NodeOfInterface(std::string_view ifname);
+
+  // Parses a sysfs CPU list, like "0-3,8,10-11".
+  static std::vector<unsigned> ParseCpuList(std::string_view list);
+
+ private:
+  NumaTopology();
+
+  std::vector<std::vector<unsigned>> node_cpus_;
+  std::vector<unsigned> cpu_node_;
+};
+
+// Makes the node of the CPU the calling thread runs on the preferred node for the memory the
+// thread faults in, so it only falls back to remote nodes when the local one is full. The thread
+// should be pinned. Returns the node or nullopt if the policy could not be set.
+std::optional<unsigned> PreferLocalNumaNode();
+
+}  // namespace facade
@@ -0,0 +1,45 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "facade/numa.h"
+
+#include <gmock/gmock.h>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+using namespace testing;
+using namespace std;
+
+namespace facade {
+
+class NumaTest : public testing::Test {};
+
+TEST_F(NumaTest, ParseCpuListRanges) {
+  EXPECT_THAT(NumaTopology::ParseCpuList("0-3"), ElementsAre(0, 1, 2, 3));
+  EXPECT_THAT(NumaTopology::ParseCpuList("5"), ElementsAre(5));
+  EXPECT_THAT(NumaTopology::ParseCpuList("7-7"), ElementsAre(7));
+}
+
+TEST_F(NumaTest, ParseCpuListCommaList) {
+  EXPECT_THAT(NumaTopology::ParseCpuList("0-3,8,10-11"), ElementsAre(0, 1, 2, 3, 8, 10, 11));
+  EXPECT_THAT(NumaTopology::ParseCpuList("1,,4"), ElementsAre(1, 4));
+}
+
+TEST_F(NumaTest, ParseCpuListWhitespace) {
+  // sysfs terminates the list with a newline.
+  EXPECT_THAT(NumaTopology::ParseCpuList("0-1,4\n"), ElementsAre(0, 1, 4));
+  EXPECT_THAT(NumaTopology::ParseCpuList(" 1 , 3 - 4 "), ElementsAre(1, 3, 4));
+  EXPECT_THAT(NumaTopology::ParseCpuList(""), IsEmpty());
+  EXPECT_THAT(NumaTopology::ParseCpuList("\n"), IsEmpty());
+}
+
+TEST_F(NumaTest, ParseCpuListMalformed) {
+  // Malformed ranges are skipped, the valid ones are still parsed.
+  EXPECT_THAT(NumaTopology::ParseCpuList("x,2,3-,-1,5-4,7"), ElementsAre(2, 7));
+  EXPECT_THAT(NumaTopology::ParseCpuList("0-a"), IsEmpty());
+  EXPECT_THAT(NumaTopology::ParseCpuList("1-2-3"), IsEmpty());
+}
+
+}  // namespace facade
@@ -23,6 +23,9 @@ auto RedisParser::Parse(Buffer str, uint32_t* consumed, RespExpr::Vec* res) -> R
            << absl::CHexEscape(string_view{reinterpret_cast<const char*>(str.data()), str.size()});
 
   if (state_ == CMD_COMPLETE_S) {
+    if (server_mode_ && str[0] == '*' && ParseCompleteCommand(str, consumed, res))
+      return OK;
+
     if (InitStart(str[0], res)) {
       // We recognized a non-INLINE state, starting with a special char.
       str.remove_prefix(1);
@@ -152,6 +155,65 @@ bool RedisParser::InitStart(char prefix_b, RespExpr::Vec* res) {
   return false;
 }
 
+// Pipelined requests mostly consist of complete commands, so the lengths are parsed in place and
+// bulk strings are skipped by their length instead of going through the state machine.
+bool RedisParser::ParseCompleteCommand(Buffer str, uint32_t* consumed, RespExpr::Vec* res) {
+  const uint8_t* ptr = str.data();
+  const uint8_t* end = ptr + str.size();
+
+  // Parse "<prefix><digits>\r\n", limit to 18 digits to avoid overflows
+  auto parse_len = [end](uint8_t prefix, const uint8_t** p, uint64_t* len) {
+    const uint8_t* s = *p;
+    if (s == end || *s++ != prefix)
+      return false;
+
+    const uint8_t* digits = s;
+    uint64_t val = 0;
+    for (; s != end && *s >= '0' && *s <= '9'; ++s)
+      val = val * 10 + (*s - '0');
+
+    if (s == digits || s - digits > 18 || end - s < 2 || s[0] != '\r' || s[1] != '\n')
+      return false;
+
+    *p = s + 2;
+    *len = val;
+    return true;
+  };
+
+  uint64_t arr_len = 0;
+  if (!parse_len('*', &ptr, &arr_len) || arr_len == 0 || arr_len > max_arr_len_)
+    return false;
+
+  // Every argument takes at least 6 bytes ("$0\r\n\r\n")
+  if (arr_len > size_t(end - ptr) / 6)
+    return false;
+
+  res->reserve(arr_len);
+  for (uint64_t i = 0; i < arr_len; ++i) {
+    uint64_t len = 0;
+    if (!parse_len('$', &ptr, &len) || len > max_bulk_len_ || size_t(end - ptr) < len + 2 ||
+        ptr[len] != '\r' || ptr[len + 1] != '\n') {
+      res->clear();
+      return false;
+    }
+
+    res->emplace_back(RespExpr::STRING);
+    res->back().u = len > 0 ? Buffer{ptr, len} : Buffer{};
+    ptr += len + 2;
+  }
+
+  // Reset the state the same way InitStart does for a new command
+  buf_stash_.clear();
+  stash_.clear();
+  cached_expr_ = res;
+  parse_stack_.clear();
+  last_stashed_level_ = 0;
+  last_stashed_index_ = 0;
+
+  *consumed = ptr - str.data();
+  return true;
+}
+
 void RedisParser::StashState(RespExpr::Vec* res) {
   if (cached_expr_->empty() && stash_.empty()) {
     cached_expr_ = nullptr;
@@ -74,6 +74,10 @@ class RedisParser {
 
   // Returns true if this is a RESP message, false if INLINE.
   bool InitStart(char prefix_b, RespVec* res);
+
+  // Server mode fast path for a complete array of bulk strings. Returns false without changing the
+  // parser state if the command is incomplete or needs to be handled by the state machine.
+  bool ParseCompleteCommand(Buffer str, uint32_t* consumed, RespVec* res);
   void StashState(RespVec* res);
 
   // Skips the first character (*).
@@ -295,6 +295,30 @@ TEST_F(RedisParserTest, UsedMemory) {
   EXPECT_GT(dfly::HeapSize(stash), 30000);
 }
 
+TEST_F(RedisParserTest, Pipeline) {
+  const char kCmds[] = "*2\r\n$3\r\nGET\r\n$1\r\na\r\n*3\r\n$3\r\nSET\r\n$0\r\n\r\n$2\r\nxy";
+  string_view cmds = kCmds;
+
+  ASSERT_EQ(RedisParser::OK, Parse(cmds));
+  EXPECT_EQ(20, consumed_);
+  EXPECT_THAT(args_, ElementsAre("GET", "a"));
+
+  // The second command is incomplete and continues in the next read
+  cmds.remove_prefix(consumed_);
+  ASSERT_EQ(RedisParser::INPUT_PENDING, Parse(cmds));
+  EXPECT_EQ(cmds.size(), consumed_);
+  ASSERT_EQ(RedisParser::OK, Parse("\r\n*1\r\n$4\r\nPING\r\n"));
+  EXPECT_EQ(2, consumed_);
+  EXPECT_THAT(args_, ElementsAre("SET", "", "xy"));
+
+  ASSERT_EQ(RedisParser::OK, Parse("*1\r\n$4\r\nPING\r\n"));
+  EXPECT_EQ(14, consumed_);
+  EXPECT_THAT(args_, ElementsAre("PING"));
+
+  // Malformed commands are still rejected by the state machine
+  EXPECT_EQ(RedisParser::BAD_STRING, Parse("*1\r\n$4\r\nPINGXX\r\n"));
+}
+
 TEST_F(RedisParserTest, Eol) {
   ASSERT_EQ(RedisParser::INPUT_PENDING, Parse("*1\r"));
   EXPECT_EQ(3, consumed_);
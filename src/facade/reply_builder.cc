@@ -126,6 +126,7 @@ template <typename... Ts> void SinkReplyBuilder::WritePieces(Ts&&... pieces) {
   buffer_.CommitWrite(written);
   vecs_.back().iov_len += written;
   total_size_ += written;
+  bytes_recorded_ += written;
 }
 
 void SinkReplyBuilder::WriteRef(std::string_view str) {
@@ -133,6 +134,7 @@ void SinkReplyBuilder::WriteRef(std::string_view str) {
     Flush();
   vecs_.push_back(iovec{const_cast<char*>(str.data()), str.size()});
   total_size_ += str.size();
+  bytes_recorded_ += str.size();
 }
 
 void SinkReplyBuilder::Flush(size_t expected_buffer_cap) {
@@ -161,6 +163,12 @@ uint64_t SinkReplyBuilder::GetLastSendTimeNs() const {
 void SinkReplyBuilder::Send() {
   DCHECK(sink_ != nullptr);
   DCHECK(!vecs_.empty());
+  if (!count_io_) {
+    if (auto ec = sink_->Write(vecs_.data(), vecs_.size()); ec)
+      ec_ = ec;
+    return;
+  }
+
   auto& reply_stats = tl_facade_stats->reply_stats;
 
   send_time_ns_ = util::fb2::ProactorBase::GetMonotonicTimeNs();
@@ -425,6 +433,31 @@ void RedisReplyBuilder::SendBulkStrArr(const facade::ArgRange& strs, CollectionT
     SendBulkString(str);
 }
 
+std::string RedisReplyBuilder::SerializePubMessageHeader(std::string_view channel,
+                                                         size_t message_len) {
+  return absl::StrCat("3", kCRLF, kLengthPrefix, "7", kCRLF, "message", kCRLF, kLengthPrefix,
+                      channel.size(), kCRLF, channel, kCRLF, kLengthPrefix, message_len, kCRLF);
+}
+
+void RedisReplyBuilder::SendPubMessage(std::string_view header, std::string_view message) {
+  ReplyScope scope(this);
+  WritePieces(START_SYMBOLS2[IsResp3() ? PUSH : ARRAY]);
+  if (header.size() + message.size() <= kMaxInlineSize * 2)
+    return WritePieces(header, message, kCRLF);
+
+  WriteRef(header);
+  WriteRef(message);
+  WritePieces(kCRLF);
+}
+
+void RedisReplyBuilder::SendRaw(std::string_view str) {
+  ReplyScope scope(this);
+  if (str.size() <= kMaxInlineSize)
+    WritePieces(str);
+  else
+    WriteRef(str);
+}
+
 void RedisReplyBuilder::SendScoredArray(ScoredArray arr, bool with_scores) {
   ReplyScope scope(this);
   StartArray((with_scores && !IsResp3()) ? arr.size() * 2 : arr.size());
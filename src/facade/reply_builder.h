@@ -89,6 +89,11 @@ class SinkReplyBuilder {
     return replies_recorded_;
   }
 
+  // Total number of reply bytes written by this builder.
+  uint64_t BytesRecorded() const {
+    return bytes_recorded_;
+  }
+
   bool IsSendActive() const {
     return send_time_ns_ > 0;
   }
@@ -97,6 +102,11 @@ class SinkReplyBuilder {
     batched_ = b;
   }
 
+  // False for builders that capture or interpret replies instead of writing RESP.
+  bool HasSink() const {
+    return sink_ != nullptr;
+  }
+
   void CloseConnection();
 
   static const ReplyStats& GetThreadLocalStats() {
@@ -136,7 +146,9 @@ class SinkReplyBuilder {
 
  protected:
   size_t replies_recorded_ = 0;
+  uint64_t bytes_recorded_ = 0;
   std::string last_error_;
+  bool count_io_ = true;  // Whether writes to the sink are counted as socket writes in stats
 
  private:
   io::Sink* sink_;
@@ -306,6 +318,16 @@ class RedisReplyBuilder : public RedisReplyBuilderBase {
 
   void StartArray(unsigned len);
   void SendEmptyArray();
+
+  // Pub/sub "message" pushes are identical for RESP2 and RESP3 except for the first byte, so
+  // publishers render the common part once for all subscribers.
+  static std::string SerializePubMessageHeader(std::string_view channel, size_t message_len);
+
+  // Send a pub/sub push with a header produced by SerializePubMessageHeader.
+  void SendPubMessage(std::string_view header, std::string_view message);
+
+  // Send already serialized RESP, for example produced by SerializingReplyBuilder, as is.
+  void SendRaw(std::string_view str);
 };
 
 }  // namespace facade
@@ -875,6 +875,84 @@ TEST_F(RedisReplyBuilderTest, BasicCapture) {
   builder_->SetRespVersion(RespVersion::kResp2);
 }
 
+TEST_F(RedisReplyBuilderTest, CaptureApplyInScope) {
+  // Replies applied under a single scope reference the captured values and go out in one write.
+  CapturingReplyBuilder crb{};
+  vector<CapturingReplyBuilder::Payload> payloads;
+  string expected;
+  for (unsigned i = 0; i < 4; ++i) {
+    string val(1000, 'a' + i);
+    crb.SendBulkString(val);
+    payloads.push_back(crb.Take());
+    absl::StrAppend(&expected, "$1000\r\n", val, "\r\n");
+  }
+  string err(100, 'e');
+  crb.SendError(err, "");
+  payloads.push_back(crb.Take());
+  absl::StrAppend(&expected, "-ERR ", err, "\r\n");
+
+  {
+    SinkReplyBuilder::ReplyScope scope{builder_.get()};
+    for (auto& pl : payloads)
+      CapturingReplyBuilder::Apply(std::move(pl), builder_.get());
+    ASSERT_EQ(SinkSize(), 0);
+  }
+
+  EXPECT_EQ(GetReplyStats().io_write_cnt, 1);
+  EXPECT_EQ(TakePayload(), expected);
+}
+
+TEST_F(RedisReplyBuilderTest, SerializeSendRaw) {
+  SerializingReplyBuilder srb{RespVersion::kResp3};
+  builder_->SetRespVersion(RespVersion::kResp3);
+
+  vector<string> replies(3);
+  string big(10000, 'b');
+  const vector<string_view> arr{"a", big, "c"};
+  srb.SetDestination(&replies[0]);
+  srb.SendLong(42);
+  srb.Finish();
+  srb.SetDestination(&replies[1]);
+  srb.SendBulkStrArr(arr);
+  srb.Finish();
+  srb.SetDestination(&replies[2]);
+  srb.SendError("e1", "e2");
+  srb.Finish();
+  EXPECT_EQ(GetReplyStats().io_write_cnt, 0);
+
+  builder_->SendLong(42);
+  builder_->SendBulkStrArr(arr);
+  builder_->SendError("e1", "e2");
+  string expected = TakePayload();
+
+  {
+    SinkReplyBuilder::ReplyScope scope{builder_.get()};
+    for (const string& reply : replies)
+      builder_->SendRaw(reply);
+  }
+  EXPECT_EQ(TakePayload(), expected);
+
+  builder_->SetRespVersion(RespVersion::kResp2);
+}
+
+TEST_F(RedisReplyBuilderTest, PubMessage) {
+  using RRB = RedisReplyBuilder;
+  for (size_t len : {5u, 1000u}) {
+    string msg(len, 'm');
+    string header = RRB::SerializePubMessageHeader("chan", msg.size());
+    for (auto resp : {RespVersion::kResp2, RespVersion::kResp3}) {
+      builder_->SetRespVersion(resp);
+      string_view arr[] = {"message", "chan", msg};
+      builder_->SendBulkStrArr(arr, RRB::PUSH);
+      auto expected = TakePayload();
+
+      builder_->SendPubMessage(header, msg);
+      EXPECT_EQ(TakePayload(), expected);
+    }
+  }
+  builder_->SetRespVersion(RespVersion::kResp2);
+}
+
 TEST_F(RedisReplyBuilderTest, FormatDouble) {
   char buf[64];
 
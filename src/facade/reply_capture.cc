@@ -131,7 +131,7 @@ struct CaptureVisitor {
     rb->SendNull();
   }
 
-  void operator()(CapturingReplyBuilder::Error err) {
+  void operator()(const CapturingReplyBuilder::Error& err) {
     rb->SendError(err.first, err.second);
   }
 
@@ -181,4 +181,35 @@ optional<CapturingReplyBuilder::ErrorRef> CapturingReplyBuilder::TryExtractError
   return nullopt;
 }
 
+SerializingReplyBuilder::SerializingReplyBuilder(RespVersion resp_v) : RedisReplyBuilder{&out_} {
+  SetRespVersion(resp_v);
+  // Replies are buffered until Finish, which moves them to the destination with a single append.
+  SetBatchMode(true);
+  count_io_ = false;
+}
+
+void SerializingReplyBuilder::SetDestination(std::string* dest) {
+  DCHECK(out_.dest == nullptr);
+  out_.dest = dest;
+}
+
+void SerializingReplyBuilder::Finish() {
+  DCHECK(out_.dest != nullptr);
+  Flush();
+  out_.dest = nullptr;
+  ConsumeLastError();
+}
+
+io::Result<size_t> SerializingReplyBuilder::AppendSink::WriteSome(const iovec* v, uint32_t len) {
+  size_t total = 0;
+  for (uint32_t i = 0; i < len; ++i)
+    total += v[i].iov_len;
+
+  if (dest->empty())
+    dest->reserve(total);
+  for (uint32_t i = 0; i < len; ++i)
+    dest->append(static_cast<const char*>(v[i].iov_base), v[i].iov_len);
+  return total;
+}
+
 }  // namespace facade
@@ -93,4 +93,27 @@ class CapturingReplyBuilder : public RedisReplyBuilder {
   Payload current_;
 };
 
+// SerializingReplyBuilder renders replies as RESP into strings owned by the caller. Unlike
+// captured replies, they need no re-encoding and are sent as is with RedisReplyBuilder::SendRaw.
+class SerializingReplyBuilder : public RedisReplyBuilder {
+ public:
+  explicit SerializingReplyBuilder(RespVersion resp_v = RespVersion::kResp2);
+
+  // Appends the replies that follow to dest, until Finish() is called.
+  void SetDestination(std::string* dest);
+
+  // Completes the replies of the current destination and resets it.
+  void Finish();
+
+ private:
+  class AppendSink : public io::Sink {
+   public:
+    io::Result<size_t> WriteSome(const iovec* v, uint32_t len) final;
+
+    std::string* dest = nullptr;
+  };
+
+  AppendSink out_;
+};
+
 }  // namespace facade
@@ -34,6 +34,10 @@
 #include <math.h>
 #include <string.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 #include "redis/redis_aux.h"
 #include "redis/util.h"
 
@@ -1369,39 +1373,123 @@ int64_t pfcountSingle(struct HllBufferPtr hll_ptr) {
   return card;
 }
 
-/* Merge dense-encoded HLL */
+/* Merge dense-encoded HLL into an array of HLL_REGISTERS uint8_t registers
+ * by computing MAX(registers[i], hll[i]). */
 static void hllMergeDense(uint8_t* registers, struct HllBufferPtr to) {
-  uint8_t val;
   struct hllhdr* hll_hdr = (struct hllhdr*)to.hll;
 
-  for (int i = 0; i < HLL_REGISTERS; i++) {
-    HLL_DENSE_GET_REGISTER(val, hll_hdr->registers, i);
-    if (val > registers[i]) {
-      registers[i] = val;
+  if (HLL_REGISTERS == 16384 && HLL_BITS == 6) {
+    /* Every 3 bytes hold 4 registers. */
+    const uint8_t* r = hll_hdr->registers;
+    for (int i = 0; i < HLL_REGISTERS; i += 4, r += 3) {
+      uint8_t v[4] = {r[0] & 63, (r[0] >> 6 | r[1] << 2) & 63, (r[1] >> 4 | r[2] << 4) & 63,
+                      (r[2] >> 2) & 63};
+      for (int k = 0; k < 4; k++) {
+        if (v[k] > registers[i + k])
+          registers[i + k] = v[k];
+      }
+    }
+  } else {
+    uint8_t val;
+    for (int i = 0; i < HLL_REGISTERS; i++) {
+      HLL_DENSE_GET_REGISTER(val, hll_hdr->registers, i);
+      if (val > registers[i]) {
+        registers[i] = val;
+      }
     }
   }
 }
 
+/* Computes max[i] = MAX(max[i], other[i]) for HLL_REGISTERS uint8_t registers. */
+static void hllMergeRaw(uint8_t* max, const uint8_t* other) {
+  int i = 0;
+#if defined(__AVX2__)
+  for (; i + 32 <= HLL_REGISTERS; i += 32) {
+    __m256i a = _mm256_loadu_si256((const __m256i*)(max + i));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(other + i));
+    _mm256_storeu_si256((__m256i*)(max + i), _mm256_max_epu8(a, b));
+  }
+#endif
+  for (; i < HLL_REGISTERS; i++) {
+    if (other[i] > max[i])
+      max[i] = other[i];
+  }
+}
+
+/* Writes HLL_REGISTERS uint8_t registers into a dense-encoded HLL. */
+static void hllDenseStoreRaw(uint8_t* dense, const uint8_t* registers) {
+  if (HLL_REGISTERS == 16384 && HLL_BITS == 6) {
+    const uint8_t* v = registers;
+    for (int i = 0; i < HLL_REGISTERS; i += 4, v += 4, dense += 3) {
+      dense[0] = v[0] | v[1] << 6;
+      dense[1] = v[1] >> 2 | v[2] << 4;
+      dense[2] = v[2] >> 4 | v[3] << 2;
+    }
+  } else {
+    for (long j = 0; j < HLL_REGISTERS; j++) {
+      hllDenseSet(dense, j, registers[j]);
+    }
+  }
+}
+
+size_t getRawHllSize() {
+  return HLL_HDR_SIZE + HLL_REGISTERS;
+}
+
+int createRawHll(struct HllBufferPtr hll_ptr) {
+  if (hll_ptr.size != getRawHllSize()) {
+    return C_ERR;
+  }
+
+  memset(hll_ptr.hll, 0, hll_ptr.size);
+  struct hllhdr* hdr = (struct hllhdr*)hll_ptr.hll;
+  hdr->encoding = HLL_RAW; /* Special internal-only encoding. */
+  return C_OK;
+}
+
+int pfmergeToRaw(struct HllBufferPtr in_hll, struct HllBufferPtr raw_hll) {
+  if (isValidHLL(in_hll) != HLL_VALID_DENSE) {
+    return C_ERR;
+  }
+
+  hllMergeDense(((struct hllhdr*)raw_hll.hll)->registers, in_hll);
+  return C_OK;
+}
+
+void pfmergeRaw(struct HllBufferPtr in_raw, struct HllBufferPtr out_raw) {
+  hllMergeRaw(((struct hllhdr*)out_raw.hll)->registers, ((struct hllhdr*)in_raw.hll)->registers);
+}
+
+int64_t pfcountRaw(struct HllBufferPtr raw_hll) {
+  return hllCount((struct hllhdr*)raw_hll.hll, NULL);
+}
+
+int pfstoreRaw(struct HllBufferPtr raw_hll, struct HllBufferPtr out_hll) {
+  if (isValidHLL(out_hll) != HLL_VALID_DENSE) {
+    return C_ERR;
+  }
+
+  struct hllhdr* hdr = (struct hllhdr*)out_hll.hll;
+  hllDenseStoreRaw(hdr->registers, ((struct hllhdr*)raw_hll.hll)->registers);
+  HLL_INVALIDATE_CACHE(hdr);
+
+  return C_OK;
+}
+
 int64_t pfcountMulti(struct HllBufferPtr* hlls, size_t hlls_count) {
-  struct hllhdr* hdr;
   uint8_t max[HLL_HDR_SIZE + HLL_REGISTERS];
+  struct HllBufferPtr raw = {.hll = max, .size = sizeof(max)};
 
   /* Compute an HLL with M[i] = MAX(M[i]_j). */
-  memset(max, 0, sizeof(max));
-  hdr = (struct hllhdr*)max;
-  hdr->encoding = HLL_RAW; /* Special internal-only encoding. */
+  createRawHll(raw);
   for (size_t j = 0; j < hlls_count; j++) {
-    /* Check type and size. */
-    struct HllBufferPtr hll = hlls[j];
-    if (isValidHLL(hll) != HLL_VALID_DENSE) {
+    if (pfmergeToRaw(hlls[j], raw) != C_OK) {
       return C_ERR;
     }
-
-    hllMergeDense(max, hll);
   }
 
   /* Compute cardinality of the resulting set. */
-  return hllCount(hdr, NULL);
+  return pfcountRaw(raw);
 }
 
 int pfmerge(struct HllBufferPtr* in_hlls, size_t in_hlls_count, struct HllBufferPtr out_hll) {
@@ -1409,27 +1497,18 @@ int pfmerge(struct HllBufferPtr* in_hlls, size_t in_hlls_count, struct HllBuffer
     return C_ERR;
   }
 
-  uint8_t max[HLL_REGISTERS];
+  uint8_t max[HLL_HDR_SIZE + HLL_REGISTERS];
+  struct HllBufferPtr raw = {.hll = max, .size = sizeof(max)};
 
   /* Compute an HLL with M[i] = MAX(M[i]_j).
    * We store the maximum into the max array of registers. We'll write
    * it to the target variable later. */
-  memset(max, 0, sizeof(max));
-
+  createRawHll(raw);
   for (size_t j = 0; j < in_hlls_count; j++) {
-    struct HllBufferPtr hll = in_hlls[j];
-    if (isValidHLL(hll) != HLL_VALID_DENSE) {
+    if (pfmergeToRaw(in_hlls[j], raw) != C_OK) {
       return C_ERR;
     }
-
-    hllMergeDense(max, hll);
   }
 
-  struct hllhdr* hdr = (struct hllhdr*)out_hll.hll;
-  for (size_t j = 0; j < HLL_REGISTERS; j++) {
-    hllDenseSet(hdr->registers, j, max[j]);
-  }
-  HLL_INVALIDATE_CACHE(hdr);
-
-  return C_OK;
+  return pfstoreRaw(raw, out_hll);
 }
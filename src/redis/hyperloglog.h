@@ -61,4 +61,27 @@ int64_t pfcountMulti(struct HllBufferPtr* hlls, size_t hlls_count);
  * `out_hll` *can* be one of the elements in `in_hlls`. */
 int pfmerge(struct HllBufferPtr* in_hlls, size_t in_hlls_count, struct HllBufferPtr out_hll);
 
+/* Raw HLLs hold one uint8_t per register. They are an internal representation for merging
+ * many HLLs, e.g. locally in each shard, and are never stored as values. */
+size_t getRawHllSize();
+
+/* Writes into `hll_ptr` an empty raw HLL.
+ * Returns 0 upon success, or a negative number when `hll_ptr.size` is different from
+ * getRawHllSize() */
+int createRawHll(struct HllBufferPtr hll_ptr);
+
+/* Merges the dense-encoded `in_hll` into the raw `raw_hll`.
+ * Returns 0 upon success, or a negative number when `in_hll` is not a dense-encoded HLL. */
+int pfmergeToRaw(struct HllBufferPtr in_hll, struct HllBufferPtr raw_hll);
+
+/* Merges the raw `in_raw` into the raw `out_raw`. */
+void pfmergeRaw(struct HllBufferPtr in_raw, struct HllBufferPtr out_raw);
+
+/* Returns the estimated count of elements for the raw `raw_hll`. */
+int64_t pfcountRaw(struct HllBufferPtr raw_hll);
+
+/* Stores the registers of the raw `raw_hll` into the dense-encoded `out_hll`.
+ * Returns 0 upon success, or a negative number when `out_hll` is not a dense-encoded HLL. */
+int pfstoreRaw(struct HllBufferPtr raw_hll, struct HllBufferPtr out_hll);
+
 #endif
@@ -817,6 +817,60 @@ unsigned char *lpFind(unsigned char *lp, unsigned char *p, unsigned char *s, uin
     return NULL;
 }
 
+/* Same as lpFind() but compares the encoded form of 's' with the raw bytes of the entries.
+ * Elements always get their canonical encoding, so an entry is equal to 's' iff its encoded
+ * bytes are. Most entries are rejected by their first byte, which holds the encoding and the
+ * length of short strings, without decoding them, and the rest by a single memcmp. */
+unsigned char *lpFindEncoded(unsigned char *lp, unsigned char *p, const unsigned char *s,
+                             uint32_t slen, unsigned int skip) {
+    unsigned char intenc[LP_MAX_INT_ENCODING_LEN];
+    unsigned char strhdr[5];
+    const unsigned char *hdr;
+    uint32_t hdrlen;
+    uint64_t enclen;
+    uint32_t lp_bytes = lpBytes(lp);
+    unsigned int skipcnt = 0;
+
+    if (lpEncodeGetType(s, slen, intenc, &enclen) == LP_ENCODING_INT) {
+        hdr = intenc;
+        hdrlen = enclen;
+        slen = 0;
+    } else {
+        hdr = strhdr;
+        hdrlen = enclen - slen;
+        if (slen < 64) {
+            strhdr[0] = slen | LP_ENCODING_6BIT_STR;
+        } else if (slen < 4096) {
+            strhdr[0] = (slen >> 8) | LP_ENCODING_12BIT_STR;
+            strhdr[1] = slen & 0xff;
+        } else {
+            strhdr[0] = LP_ENCODING_32BIT_STR;
+            strhdr[1] = slen & 0xff;
+            strhdr[2] = (slen >> 8) & 0xff;
+            strhdr[3] = (slen >> 16) & 0xff;
+            strhdr[4] = (slen >> 24) & 0xff;
+        }
+    }
+
+    assert(p);
+    while (p[0] != LP_EOF) {
+        assert(p >= lp + LP_HDR_SIZE && p < lp + lp_bytes);
+        if (skipcnt == 0) {
+            /* Equal first bytes mean equal encodings, so the entry is at least as long. */
+            if (p[0] == hdr[0] && memcmp(p + 1, hdr + 1, hdrlen - 1) == 0 &&
+                (slen == 0 || memcmp(p + hdrlen, s, slen) == 0)) {
+                return p;
+            }
+            skipcnt = skip;
+        } else {
+            skipcnt--;
+        }
+        p = lpSkip(p);
+    }
+
+    return NULL;
+}
+
 /* Insert, delete or replace the specified string element 'elestr' of length
  * 'size' or integer element 'eleint' at the specified position 'p', with 'p'
  * being a listpack element pointer obtained with lpFirst(), lpLast(), lpNext(),
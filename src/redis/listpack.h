@@ -80,6 +80,10 @@ int lpStringToInt64(const char *s, unsigned long slen, int64_t *value);
 
 unsigned char *lpGetValue(unsigned char *p, unsigned int *slen, long long *lval);
 unsigned char *lpFind(unsigned char *lp, unsigned char *p, unsigned char *s, uint32_t slen, unsigned int skip);
+
+// Faster lpFind that compares encoded entries without decoding them.
+unsigned char *lpFindEncoded(unsigned char *lp, unsigned char *p, const unsigned char *s,
+                             uint32_t slen, unsigned int skip);
 unsigned char *lpFirst(unsigned char *lp);
 unsigned char *lpLast(unsigned char *lp);
 unsigned char *lpNext(unsigned char *lp, unsigned char *p);
@@ -75,6 +75,11 @@ typedef struct streamCG {
     rax *consumers;         /* A radix tree representing the consumers by name
                                and their associated representation in the form
                                of streamConsumer structures. */
+    rax *pel_by_time;       /* Index of the pending entries list by delivery
+                               time. The keys are the delivery time as a 64 bit
+                               big endian number followed by the entry ID, and
+                               there are no values. Kept in sync by the
+                               streamPelIndex*() functions. */
 } streamCG;
 
 /* A specific consumer in a consumer group.  */
@@ -153,6 +158,9 @@ void streamDecodeID(void *buf, streamID *id);
 int streamCompareID(streamID *a, streamID *b);
 int streamEntryExists(stream *s, streamID *id);
 void streamFreeNACK(streamNACK *na);
+void streamPelIndexAdd(streamCG *cg, unsigned char *rawid, streamNACK *nack);
+void streamPelIndexRemove(streamCG *cg, unsigned char *rawid, streamNACK *nack);
+void streamNACKSetDeliveryTime(streamCG *cg, unsigned char *rawid, streamNACK *nack, mstime_t time);
 int streamIncrID(streamID *id);
 int streamDecrID(streamID *id);
 
@@ -166,6 +174,7 @@ long long streamEstimateDistanceFromFirstEverEntry(stream *s, streamID *id);
 int64_t streamTrim(stream *s, streamAddTrimArgs *args);
 int64_t streamTrimByLength(stream *s, long long maxlen, int approx);
 int64_t streamTrimByID(stream *s, streamID minid, int approx);
+int64_t streamCompact(stream *s, double deleted_ratio);
 void streamFreeCG(streamCG *cg);
 void streamDelConsumer(streamCG *cg, streamConsumer *consumer);
 void streamLastValidID(stream *s, streamID *maxid);
@@ -483,6 +483,194 @@ int64_t streamTrimByID(stream *s, streamID minid, int approx) {
     return streamTrim(s, &args);
 }
 
+/* Appends the element 'ele' of another listpack to 'lp'. */
+static unsigned char *lpAppendElement(unsigned char *lp, unsigned char *ele) {
+    unsigned int slen;
+    long long lval;
+    unsigned char *s = lpGetValue(ele,&slen,&lval);
+    return s ? lpAppend(lp,s,slen) : lpAppendInteger(lp,lval);
+}
+
+/* Returns non-zero if the listpack elements 'a' and 'b' hold the same value. */
+static int lpElementsEqual(unsigned char *a, unsigned char *b) {
+    unsigned int alen, blen;
+    long long aval, bval;
+    unsigned char *as = lpGetValue(a,&alen,&aval);
+    unsigned char *bs = lpGetValue(b,&blen,&bval);
+    if (as == NULL || bs == NULL)
+        return as == NULL && bs == NULL && aval == bval;
+    return alen == blen && memcmp(as,bs,alen) == 0;
+}
+
+/* Returns the first master field of the stream node 'lp', and sets 'count'
+ * to the number of master fields. */
+static unsigned char *streamNodeMasterFields(unsigned char *lp, int64_t *count) {
+    unsigned char *p = lpFirst(lp); /* Seek items count. */
+    p = lpNext(lp,p);               /* Seek deleted count. */
+    p = lpNext(lp,p);               /* Seek num fields. */
+    *count = lpGetInteger(p);
+    return lpNext(lp,p);
+}
+
+/* Appends the valid entries of the node 'src' with master ID 'src_id' to the
+ * node 'dst' with master ID 'dst_id', which must be smaller than the IDs of
+ * all these entries. The IDs are encoded again as deltas from 'dst_id', and
+ * entries flagged SAMEFIELDS keep the flag only if both nodes have the same
+ * master fields. The counters in the master entry of 'dst' are not updated.
+ * Returns the new 'dst' listpack pointer. */
+static unsigned char *streamAppendNodeEntries(unsigned char *dst, streamID *dst_id,
+                                              unsigned char *src, streamID *src_id) {
+    int64_t dst_fields_count, src_fields_count;
+    unsigned char *dst_field = streamNodeMasterFields(dst,&dst_fields_count);
+    unsigned char *src_fields = streamNodeMasterFields(src,&src_fields_count);
+
+    int same_fields = dst_fields_count == src_fields_count;
+    unsigned char *p = src_fields;
+    for (int64_t j = 0; j < src_fields_count; j++) {
+        if (same_fields) {
+            same_fields = lpElementsEqual(p,dst_field);
+            dst_field = lpNext(dst,dst_field);
+        }
+        p = lpNext(src,p);
+    }
+    p = lpNext(src,p); /* Skip the zero master entry terminator. */
+
+    while (p) {
+        int64_t flags = lpGetInteger(p);
+        p = lpNext(src,p);
+        int64_t ms_delta = lpGetInteger(p);
+        p = lpNext(src,p);
+        int64_t seq_delta = lpGetInteger(p);
+        p = lpNext(src,p);
+
+        int src_samefields = (flags & STREAM_ITEM_FLAG_SAMEFIELDS) != 0;
+        int64_t numfields = src_fields_count;
+        if (!src_samefields) {
+            numfields = lpGetInteger(p);
+            p = lpNext(src,p);
+        }
+
+        if (flags & STREAM_ITEM_FLAG_DELETED) {
+            int64_t to_skip = src_samefields ? numfields : numfields*2;
+            while(to_skip--) p = lpNext(src,p);
+            p = lpNext(src,p); /* Skip the lp-count field. */
+            continue;
+        }
+
+        if (!same_fields) flags &= ~STREAM_ITEM_FLAG_SAMEFIELDS;
+        int dst_samefields = (flags & STREAM_ITEM_FLAG_SAMEFIELDS) != 0;
+
+        dst = lpAppendInteger(dst,flags);
+        dst = lpAppendInteger(dst,src_id->ms + ms_delta - dst_id->ms);
+        dst = lpAppendInteger(dst,src_id->seq + seq_delta - dst_id->seq);
+        if (!dst_samefields)
+            dst = lpAppendInteger(dst,numfields);
+
+        unsigned char *master_field = src_fields;
+        for (int64_t j = 0; j < numfields; j++) {
+            if (!src_samefields) {
+                dst = lpAppendElement(dst,p);
+                p = lpNext(src,p);
+            } else if (!dst_samefields) {
+                dst = lpAppendElement(dst,master_field);
+                master_field = lpNext(src,master_field);
+            }
+            dst = lpAppendElement(dst,p); /* The value. */
+            p = lpNext(src,p);
+        }
+
+        int64_t lp_count = numfields + 3;
+        if (!dst_samefields) lp_count += numfields + 1;
+        dst = lpAppendInteger(dst,lp_count);
+        p = lpNext(src,p); /* Skip the lp-count field. */
+    }
+    return dst;
+}
+
+/* Garbage collects the deleted entries of the stream. Every node in which
+ * deleted entries make up more than 'deleted_ratio' of the entries is
+ * rewritten without them, and the nodes that follow it are merged into the
+ * rewritten node while the result stays within the node size limits.
+ * Returns the number of deleted entries that were dropped. */
+int64_t streamCompact(stream *s, double deleted_ratio) {
+    size_t max_bytes = server.stream_node_max_bytes;
+    if (max_bytes == 0 || max_bytes > STREAM_LISTPACK_MAX_SIZE)
+        max_bytes = STREAM_LISTPACK_MAX_SIZE;
+    long long max_entries = server.stream_node_max_entries;
+
+    int64_t dropped = 0;
+    raxIterator ri;
+    raxStart(&ri,s->rax_tree);
+    raxSeek(&ri,"^",NULL,0);
+
+    int more = raxNext(&ri);
+    while (more) {
+        unsigned char *lp = ri.data, *p = lpFirst(lp);
+        int64_t entries = lpGetInteger(p);
+        int64_t deleted = lpGetInteger(lpNext(lp,p));
+        if (deleted == 0 || deleted <= deleted_ratio * (entries + deleted)) {
+            more = raxNext(&ri);
+            continue;
+        }
+
+        unsigned char key[sizeof(streamID)];
+        memcpy(key,ri.key,sizeof(key));
+        streamID master_id;
+        streamDecodeID(key,&master_id);
+
+        /* Start the new node with a copy of the master entry. */
+        int64_t master_fields_count;
+        unsigned char *field = streamNodeMasterFields(lp,&master_fields_count);
+        unsigned char *compact = lpNew(lpBytes(lp));
+        compact = lpAppendInteger(compact,entries);
+        compact = lpAppendInteger(compact,0);
+        compact = lpAppendInteger(compact,master_fields_count);
+        for (int64_t j = 0; j < master_fields_count; j++) {
+            compact = lpAppendElement(compact,field);
+            field = lpNext(lp,field);
+        }
+        compact = lpAppendInteger(compact,0); /* Master entry terminator. */
+        compact = streamAppendNodeEntries(compact,&master_id,lp,&master_id);
+        dropped += deleted;
+        lpFree(lp);
+        raxInsert(s->rax_tree,key,sizeof(key),compact,NULL);
+
+        /* Merge the following nodes while they fit. */
+        raxSeek(&ri,">",key,sizeof(key));
+        while ((more = raxNext(&ri))) {
+            unsigned char *next = ri.data;
+            p = lpFirst(next);
+            int64_t next_entries = lpGetInteger(p);
+            int64_t next_deleted = lpGetInteger(lpNext(next,p));
+            if (lpBytes(compact) + lpBytes(next) > max_bytes ||
+                (max_entries && entries + next_entries > max_entries))
+                break;
+
+            streamID next_id;
+            streamDecodeID(ri.key,&next_id);
+            compact = streamAppendNodeEntries(compact,&master_id,next,&next_id);
+            entries += next_entries;
+            dropped += next_deleted;
+            lpFree(next);
+            raxRemove(s->rax_tree,ri.key,ri.key_len,NULL);
+            raxSeek(&ri,">",key,sizeof(key));
+        }
+
+        p = lpFirst(compact);
+        compact = lpReplaceInteger(compact,&p,entries);
+        compact = lpShrinkToFit(compact);
+        raxInsert(s->rax_tree,key,sizeof(key),compact,NULL);
+
+        /* Re-seek since the tree was modified. */
+        if (more) {
+            raxSeek(&ri,">",key,sizeof(key));
+            more = raxNext(&ri);
+        }
+    }
+    raxStop(&ri);
+    return dropped;
+}
+
 /* Initialize the stream iterator, so that we can call iterating functions
  * to get the next items. This requires a corresponding streamIteratorStop()
  * at the end. The 'rev' parameter controls the direction. If it's zero the
@@ -1022,6 +1210,39 @@ void streamFreeNACK(streamNACK *na) {
     zfree(na);
 }
 
+/* Builds the key of the PEL entry with the big endian ID 'rawid' in the
+ * delivery time index of its group. Negative delivery times sort first. */
+static void streamPelIndexKey(unsigned char *buf, unsigned char *rawid, streamNACK *nack) {
+    uint64_t time = nack->delivery_time < 0 ? 0 : (uint64_t)nack->delivery_time;
+    time = htonu64(time);
+    memcpy(buf,&time,sizeof(time));
+    memcpy(buf+sizeof(time),rawid,sizeof(streamID));
+}
+
+/* Adds the NACK of the group PEL entry 'rawid' to the delivery time index.
+ * Must be called whenever a NACK is added to the group PEL. */
+void streamPelIndexAdd(streamCG *cg, unsigned char *rawid, streamNACK *nack) {
+    unsigned char key[sizeof(uint64_t)+sizeof(streamID)];
+    streamPelIndexKey(key,rawid,nack);
+    raxInsert(cg->pel_by_time,key,sizeof(key),NULL,NULL);
+}
+
+/* Removes the NACK of the group PEL entry 'rawid' from the delivery time
+ * index. Must be called before a NACK is removed from the group PEL. */
+void streamPelIndexRemove(streamCG *cg, unsigned char *rawid, streamNACK *nack) {
+    unsigned char key[sizeof(uint64_t)+sizeof(streamID)];
+    streamPelIndexKey(key,rawid,nack);
+    raxRemove(cg->pel_by_time,key,sizeof(key),NULL);
+}
+
+/* Sets the delivery time of the NACK of the group PEL entry 'rawid'. */
+void streamNACKSetDeliveryTime(streamCG *cg, unsigned char *rawid, streamNACK *nack, mstime_t time) {
+    if (nack->delivery_time == time) return;
+    streamPelIndexRemove(cg,rawid,nack);
+    nack->delivery_time = time;
+    streamPelIndexAdd(cg,rawid,nack);
+}
+
 /* Free a consumer and associated data structures. Note that this function
  * will not reassign the pending messages associated with this consumer
  * nor will delete them from the stream, so when this function is called
@@ -1046,6 +1267,7 @@ streamCG *streamCreateCG(stream *s, const char *name, size_t namelen, streamID *
     streamCG *cg = zmalloc(sizeof(*cg));
     cg->pel = raxNew();
     cg->consumers = raxNew();
+    cg->pel_by_time = raxNew();
     cg->last_id = *id;
     cg->entries_read = entries_read;
     raxInsert(s->cgroups,(unsigned char*)name,namelen,cg,NULL);
@@ -1056,6 +1278,7 @@ streamCG *streamCreateCG(stream *s, const char *name, size_t namelen, streamID *
 void streamFreeCG(streamCG *cg) {
     raxFreeWithCallback(cg->pel,(void(*)(void*))streamFreeNACK);
     raxFreeWithCallback(cg->consumers,(void(*)(void*))streamFreeConsumer);
+    raxFree(cg->pel_by_time);
     zfree(cg);
 }
 
@@ -1086,6 +1309,7 @@ void streamDelConsumer(streamCG *cg, streamConsumer *consumer) {
     raxSeek(&ri,"^",NULL,0);
     while(raxNext(&ri)) {
         streamNACK *nack = ri.data;
+        streamPelIndexRemove(cg,ri.key,nack);
         raxRemove(cg->pel,ri.key,ri.key_len,NULL);
         streamFreeNACK(nack);
     }
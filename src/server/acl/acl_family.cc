@@ -64,6 +64,8 @@ void SendAclSecurityEvents(const AclLog::LogEntry& entry, facade::RedisReplyBuil
 
 string AclDbToString(size_t db);
 
+string AclRateLimitToString(uint64_t rate_limit);
+
 }  // namespace
 
 AclFamily::AclFamily(UserRegistry* registry, util::ProactorPool* pool)
@@ -100,7 +102,7 @@ void AclFamily::List(CmdArgList args, const CommandContext& cmd_cntx) {
 
     absl::StrAppend(&buffer, username, " ", user.IsActive() ? "on "sv : "off "sv, password,
                     acl_keys, maybe_space_com, acl_pub_sub, " ", acl_cat_and_commands, " $",
-                    db_index);
+                    db_index, AclRateLimitToString(user.RateLimit()));
 
     rb->SendSimpleString(buffer);
   }
@@ -109,13 +111,14 @@ void AclFamily::List(CmdArgList args, const CommandContext& cmd_cntx) {
 void AclFamily::StreamUpdatesToAllProactorConnections(const std::string& user,
                                                       const Commands& update_commands,
                                                       const AclKeys& update_keys,
-                                                      const AclPubSub& update_pub_sub, size_t db) {
+                                                      const AclPubSub& update_pub_sub, size_t db,
+                                                      uint64_t rate_limit) {
   auto update_cb = [&]([[maybe_unused]] size_t id, util::Connection* conn) {
     DCHECK(conn);
     auto connection = static_cast<facade::Connection*>(conn);
     if (!connection->IsHttp() && connection->cntx()) {
       connection->SendAclUpdateAsync(facade::Connection::AclUpdateMessage{
-          user, update_commands, update_keys, update_pub_sub, db});
+          user, update_commands, update_keys, update_pub_sub, db, rate_limit});
     }
   };
 
@@ -151,7 +154,7 @@ void AclFamily::SetUser(CmdArgList args, const CommandContext& cmd_cntx) {
     if (exists) {
       if (!reset_channels) {
         StreamUpdatesToAllProactorConnections(string(username), user.AclCommands(), user.Keys(),
-                                              user.PubSub(), user.Db());
+                                              user.PubSub(), user.Db(), user.RateLimit());
       }
       // We evict connections that had their channels reseted
       else {
@@ -248,7 +251,7 @@ string AclFamily::RegistryToString() const {
 
     absl::StrAppend(&result, command, username, " ", user.IsActive() ? "ON "sv : "OFF "sv, password,
                     acl_keys, maybe_space, acl_pub_sub, " ", acl_cat_and_commands, " $", db_index,
-                    "\n");
+                    AclRateLimitToString(user.RateLimit()), "\n");
   }
 
   return result;
@@ -933,6 +936,10 @@ std::string AclDbToString(size_t db) {
   return std::numeric_limits<size_t>::max() == db ? "all" : absl::StrCat(db);
 }
 
+std::string AclRateLimitToString(uint64_t rate_limit) {
+  return rate_limit ? absl::StrCat(" ratelimit:", rate_limit) : "";
+}
+
 }  // namespace
 
 std::string AclFamily::AclCatAndCommandToString(const User::CategoryChanges& cat,
@@ -1005,6 +1012,18 @@ std::optional<std::string> AclFamily::MaybeParseNamespace(std::string_view comma
   return std::nullopt;
 }
 
+std::optional<uint64_t> AclFamily::MaybeParseRateLimit(
+    std::string_view command, std::optional<facade::ErrorReply>* err) const {
+  constexpr std::string_view kPrefix = "RATELIMIT:";
+  if (!absl::StartsWith(command, kPrefix))
+    return std::nullopt;
+
+  uint64_t res = 0;
+  if (!absl::SimpleAtoi(command.substr(kPrefix.size()), &res))
+    *err = facade::ErrorReply(absl::StrCat("ERR Invalid rate limit ", command));
+  return res;
+}
+
 std::pair<AclFamily::OptCommand, bool> AclFamily::MaybeParseAclCommand(
     std::string_view command) const {
   if (absl::StartsWith(command, "+")) {
@@ -1117,6 +1136,14 @@ std::variant<User::UpdateRequest, ErrorReply> AclFamily::ParseAclSetUser(
       continue;
     }
 
+    std::optional<ErrorReply> err;
+    if (auto rate_limit = MaybeParseRateLimit(command, &err); rate_limit) {
+      if (err)
+        return std::move(*err);
+      req.rate_limit = rate_limit;
+      continue;
+    }
+
     auto [cmd, sign] = MaybeParseAclCommand(command);
     if (!cmd) {
       return ErrorReply(absl::StrCat("Unrecognized parameter ", command));
@@ -60,7 +60,8 @@ class AclFamily final {
   void StreamUpdatesToAllProactorConnections(const std::string& user,
                                              const Commands& update_commands,
                                              const AclKeys& update_keys,
-                                             const AclPubSub& update_pub_sub, size_t db);
+                                             const AclPubSub& update_pub_sub, size_t db,
+                                             uint64_t rate_limit);
 
   // Helper function that closes all open connection from the deleted user
   void EvictOpenConnectionsOnAllProactors(const absl::flat_hash_set<std::string_view>& user);
@@ -90,6 +91,10 @@ class AclFamily final {
 
   std::optional<std::string> MaybeParseNamespace(std::string_view command) const;
 
+  // Parses RATELIMIT:<cost per second>, the error is set for invalid numbers.
+  std::optional<uint64_t> MaybeParseRateLimit(std::string_view command,
+                                              std::optional<facade::ErrorReply>* err) const;
+
   std::variant<User::UpdateRequest, facade::ErrorReply> ParseAclSetUser(
       const facade::ArgRange& args, bool hashed = false, bool has_all_keys = false,
       bool has_all_channels = false) const;
@@ -6,6 +6,7 @@
 
 #include <absl/container/flat_hash_map.h>
 #include <absl/strings/ascii.h>
+#include <absl/strings/match.h>
 #include <absl/strings/str_cat.h>
 
 #include "base/flags.h"
@@ -13,6 +14,7 @@
 #include "base/logging.h"
 #include "facade/facade_test.h"
 #include "server/acl/acl_commands_def.h"
+#include "server/acl/key_glob_matcher.h"
 #include "server/command_registry.h"
 #include "server/test_utils.h"
 
@@ -506,6 +508,37 @@ TEST_F(AclFamilyTest, TestKeys) {
   EXPECT_THAT(resp, ErrArg("ERR Unrecognized parameter %RFOO"));
 }
 
+TEST(KeyGlobMatcherTest, Access) {
+  using acl::KeyGlobMatcher;
+  using acl::KeyOp;
+  constexpr uint8_t kRead = KeyGlobMatcher::kRead;
+  constexpr uint8_t kWrite = KeyGlobMatcher::kWrite;
+
+  KeyGlobMatcher matcher({{"foo", KeyOp::READ},
+                          {"foo", KeyOp::WRITE},
+                          {"bar", KeyOp::READ},
+                          {"user:*", KeyOp::READ},
+                          {"user:admin*", KeyOp::WRITE},
+                          {"*:log", KeyOp::WRITE},
+                          {"k?y", KeyOp::READ_WRITE},
+                          {"lit\\*", KeyOp::READ}});
+
+  EXPECT_EQ(matcher.Access("foo"), kRead | kWrite);
+  EXPECT_EQ(matcher.Access("bar"), kRead);
+  EXPECT_EQ(matcher.Access("barx"), 0);
+  EXPECT_EQ(matcher.Access("user:1"), kRead);
+  EXPECT_EQ(matcher.Access("user:admin:1"), kRead | kWrite);
+  EXPECT_EQ(matcher.Access("user:log"), kRead | kWrite);
+  EXPECT_EQ(matcher.Access("app:log"), kWrite);
+  EXPECT_EQ(matcher.Access("key"), kRead | kWrite);
+  EXPECT_EQ(matcher.Access("keey"), 0);
+  EXPECT_EQ(matcher.Access("lit*"), kRead);
+  EXPECT_EQ(matcher.Access("litx"), 0);
+  EXPECT_TRUE(matcher.HasWildcards());
+
+  EXPECT_FALSE(KeyGlobMatcher({{"a", KeyOp::READ}, {"b*", KeyOp::READ}}).HasWildcards());
+}
+
 TEST_F(AclFamilyTest, TestPubSub) {
   TestInitAclFam();
 
@@ -540,6 +573,27 @@ TEST_F(AclFamilyTest, TestPubSub) {
   EXPECT_THAT(vec[9], "resetchannels &foo");
 }
 
+TEST_F(AclFamilyTest, TestRateLimit) {
+  auto resp = Run({"ACL", "SETUSER", "rl", "ON", ">pass", "+@all", "~*", "RATELIMIT:x"});
+  EXPECT_THAT(resp, ErrArg("Invalid rate limit"));
+  resp = Run({"ACL", "SETUSER", "rl", "ON", ">pass", "+@all", "~*", "RATELIMIT:3"});
+  EXPECT_THAT(resp, "OK");
+
+  resp = Run({"ACL", "LIST"});
+  bool listed = false;
+  for (const auto& user : resp.GetVec())
+    listed |= absl::StrContains(user.GetString(), "ratelimit:3");
+  EXPECT_TRUE(listed);
+
+  resp = Run({"AUTH", "rl", "pass"});
+  EXPECT_THAT(resp, "OK");
+
+  // MGET of two keys costs 2, so the SET exhausts the bucket.
+  EXPECT_THAT(Run({"MGET", "a", "b"}), ArrLen(2));
+  EXPECT_THAT(Run({"SET", "a", "b"}), "OK");
+  EXPECT_THAT(Run({"GET", "a"}), ErrArg("Rate limit exceeded"));
+}
+
 TEST_F(AclFamilyTest, TestAlias) {
   auto resp = Run({"ACL", "SETUSER", "luke", "+___SET"});
   EXPECT_THAT(resp, ErrArg("ERR Unrecognized parameter +___SET"));
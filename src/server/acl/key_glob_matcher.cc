@@ -0,0 +1,74 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/acl/key_glob_matcher.h"
+
+#include <absl/strings/match.h>
+
+#include "core/glob_matcher.h"
+
+namespace dfly::acl {
+
+namespace {
+
+uint8_t ToAccess(KeyOp op) {
+  switch (op) {
+    case KeyOp::READ:
+      return KeyGlobMatcher::kRead;
+    case KeyOp::WRITE:
+      return KeyGlobMatcher::kWrite;
+    case KeyOp::READ_WRITE:
+      break;
+  }
+  return KeyGlobMatcher::kRead | KeyGlobMatcher::kWrite;
+}
+
+}  // namespace
+
+KeyGlobMatcher::KeyGlobMatcher(const std::vector<GlobType>& globs) {
+  absl::flat_hash_map<std::string, uint8_t> prefixes, wildcards;
+  for (const auto& [glob, op] : globs) {
+    std::string literal;
+    switch (GlobMatcher::Classify(glob, &literal)) {
+      case GlobMatcher::Kind::EXACT:
+        exact_[literal] |= ToAccess(op);
+        break;
+      case GlobMatcher::Kind::PREFIX:
+        prefixes[literal] |= ToAccess(op);
+        break;
+      default:
+        wildcards[glob] |= ToAccess(op);
+    }
+  }
+
+  prefixes_.assign(prefixes.begin(), prefixes.end());
+  wildcards_.assign(wildcards.begin(), wildcards.end());
+}
+
+uint8_t KeyGlobMatcher::Access(std::string_view key) const {
+  constexpr uint8_t kAll = kRead | kWrite;
+
+  uint8_t res = 0;
+  if (auto it = exact_.find(key); it != exact_.end())
+    res = it->second;
+
+  for (const auto& [prefix, access] : prefixes_) {
+    if (res == kAll)
+      return res;
+    if ((res | access) != res && absl::StartsWith(key, prefix))
+      res |= access;
+  }
+
+  for (const auto& [glob, access] : wildcards_) {
+    if (res == kAll)
+      return res;
+    if ((res | access) == res)
+      continue;
+    if (stringmatchlen(glob.data(), glob.size(), key.data(), key.size(), 0))
+      res |= access;
+  }
+  return res;
+}
+
+}  // namespace dfly::acl
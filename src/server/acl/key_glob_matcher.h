@@ -0,0 +1,41 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/container/flat_hash_map.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "facade/acl_commands_def.h"
+
+namespace dfly::acl {
+
+// The key patterns of a user compiled into a single matcher. Literal patterns are looked up in a
+// hash table and prefix patterns are compared directly, only the remaining ones run the glob
+// matcher. It is immutable and therefore shared by all the connections of the user.
+class KeyGlobMatcher {
+ public:
+  static constexpr uint8_t kRead = 1;
+  static constexpr uint8_t kWrite = 2;
+
+  explicit KeyGlobMatcher(const std::vector<GlobType>& globs);
+
+  // Returns the access the patterns grant to the key, a combination of kRead and kWrite.
+  uint8_t Access(std::string_view key) const;
+
+  // Whether matching may be expensive enough to cache its results.
+  bool HasWildcards() const {
+    return !wildcards_.empty();
+  }
+
+ private:
+  absl::flat_hash_map<std::string, uint8_t> exact_;
+  std::vector<std::pair<std::string, uint8_t>> prefixes_;
+  std::vector<std::pair<std::string, uint8_t>> wildcards_;
+};
+
+}  // namespace dfly::acl
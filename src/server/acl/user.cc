@@ -11,6 +11,7 @@
 #include "absl/container/flat_hash_set.h"
 #include "absl/strings/escaping.h"
 #include "core/overloaded.h"
+#include "server/acl/key_glob_matcher.h"
 
 namespace dfly::acl {
 
@@ -87,6 +88,9 @@ void User::Update(UpdateRequest&& req, const CategoryToIdxStore& cat_to_id,
   SetSelectDb(req.select_db);
 
   SetNamespace(req.ns);
+
+  if (req.rate_limit)
+    rate_limit_ = *req.rate_limit;
 }
 
 void User::SetPasswordHash(std::string_view password, bool is_hashed) {
@@ -259,6 +263,10 @@ void User::SetKeyGlobs(std::vector<UpdateKey> keys) {
       keys_.key_globs.push_back({std::move(key.key), key.op});
     }
   }
+
+  keys_.matcher = keys_.all_keys || keys_.key_globs.empty()
+                      ? nullptr
+                      : std::make_shared<KeyGlobMatcher>(keys_.key_globs);
 }
 
 void User::SetPubSub(std::vector<UpdatePubSub> pub_sub) {
@@ -77,6 +77,7 @@ class User final {
     // DFLY specific
     std::optional<size_t> select_db;
     std::string ns;
+    std::optional<uint64_t> rate_limit;
   };
 
   using CategoryChange = uint32_t;
@@ -127,6 +128,11 @@ class User final {
 
   size_t Db() const;
 
+  // Command cost per second the connections of the user can spend, 0 means no limit.
+  uint64_t RateLimit() const {
+    return rate_limit_;
+  }
+
   using CategoryChanges = absl::flat_hash_map<CategoryChange, ChangeMetadata>;
   using CommandChanges = absl::flat_hash_map<CommandChange, ChangeMetadata>;
 
@@ -202,6 +208,8 @@ class User final {
 
   std::string namespace_;
 
+  uint64_t rate_limit_ = 0;
+
   // if db == std::numeric_limits<size_t>::max() then all db's.
   // Otherwise user restricted to the value of db_
   size_t db_{std::numeric_limits<size_t>::max()};
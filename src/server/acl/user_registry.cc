@@ -36,8 +36,8 @@ UserCredentials UserRegistry::GetCredentials(std::string_view username) const {
     return {};
   }
   auto& user = it->second;
-  return {user.AclCategory(), user.AclCommands(), user.Keys(),
-          user.PubSub(),      user.Namespace(),   user.Db()};
+  return {user.AclCategory(), user.AclCommands(), user.Keys(),     user.PubSub(),
+          user.Namespace(),   user.Db(),          user.RateLimit()};
 }
 
 bool UserRegistry::IsUserActive(std::string_view username) const {
@@ -8,6 +8,7 @@
 #include "core/glob_matcher.h"
 #include "facade/dragonfly_connection.h"
 #include "server/acl/acl_commands_def.h"
+#include "server/acl/key_glob_matcher.h"
 #include "server/command_registry.h"
 #include "server/server_state.h"
 #include "server/transaction.h"
@@ -16,11 +17,38 @@ namespace dfly::acl {
 
 namespace {
 
+// Compiling a GlobMatcher for a single match costs more than matching without it.
 bool Matches(std::string_view pattern, std::string_view target) {
-  GlobMatcher matcher(pattern, true);
-  return matcher.Matches(target);
+  return stringmatchlen(pattern.data(), pattern.size(), target.data(), target.size(), 0);
 };
 
+// Access of recently checked keys on this thread, for users with wildcard key patterns.
+// The connections of a user share the matcher, which is replaced on every change of its keys.
+struct KeyAccessCache {
+  static constexpr size_t kMaxSize = 4096;
+
+  std::shared_ptr<const KeyGlobMatcher> matcher;
+  absl::flat_hash_map<std::string, uint8_t> access;
+};
+
+thread_local KeyAccessCache tl_key_access_cache;
+
+uint8_t KeyAccess(const std::shared_ptr<const KeyGlobMatcher>& matcher, std::string_view key) {
+  if (!matcher->HasWildcards())
+    return matcher->Access(key);
+
+  auto& cache = tl_key_access_cache;
+  if (cache.matcher != matcher || cache.access.size() >= KeyAccessCache::kMaxSize) {
+    cache.matcher = matcher;
+    cache.access.clear();
+  }
+
+  auto [it, inserted] = cache.access.try_emplace(key);
+  if (inserted)
+    it->second = matcher->Access(key);
+  return it->second;
+}
+
 bool ValidateCommand(const std::vector<uint64_t>& acl_commands, const CommandId& id) {
   const size_t index = id.GetFamily();
   const uint64_t command_mask = id.GetBitIndex();
@@ -115,27 +143,18 @@ bool ValidateCommand(const std::vector<uint64_t>& acl_commands, const CommandId&
   const bool is_read_command = id.IsReadOnly();
   const bool is_write_command = id.IsWriteOnly();
 
-  auto iterate_globs = [&](auto target) {
-    for (auto& [elem, op] : keys.key_globs) {
-      if (Matches(elem, target)) {
-        if (is_read_command && (op == KeyOp::READ || op == KeyOp::READ_WRITE)) {
-          return true;
-        }
-        if (is_write_command && (op == KeyOp::WRITE || op == KeyOp::READ_WRITE)) {
-          return true;
-        }
-      }
-    }
-    return false;
-  };
-
   bool keys_allowed = true;
   if (!keys.all_keys && id.first_key_pos() != 0 && (is_read_command || is_write_command)) {
     auto keys_index = DetermineKeys(&id, tail_args);
     DCHECK(keys_index);
 
-    for (std::string_view key : keys_index->Range(tail_args))
-      keys_allowed &= iterate_globs(key);
+    DCHECK(keys.matcher || keys.key_globs.empty());
+    const uint8_t required = (is_read_command ? KeyGlobMatcher::kRead : 0) |
+                             (is_write_command ? KeyGlobMatcher::kWrite : 0);
+    for (std::string_view key : keys_index->Range(tail_args)) {
+      uint8_t access = keys.matcher ? KeyAccess(keys.matcher, key) : 0;
+      keys_allowed &= (access & required) != 0;
+    }
   }
 
   return {keys_allowed, AclLog::Reason::KEY};
@@ -8,7 +8,10 @@
 
 #include "absl/strings/match.h"
 #include "base/expected.hpp"
+#include "base/flags.h"
 #include "base/logging.h"
+#include "core/bitops.h"
+#include "core/sparse_bitmap.h"
 #include "facade/cmd_arg_parser.h"
 #include "facade/op_status.h"
 #include "facade/reply_builder.h"
@@ -23,9 +26,15 @@
 #include "src/core/overloaded.h"
 #include "util/varz.h"
 
+ABSL_FLAG(uint32_t, sparse_bitmap_min_size, 0,
+          "SETBIT keeps bitmaps of at least this many bytes that are mostly zeros in a sparse, "
+          "roaring-like encoding. 0 disables the encoding. Snapshots and replication transfer "
+          "the plain string, so loaded bitmaps are sparse again only after they grow by SETBIT.");
+
 namespace dfly {
 using namespace facade;
 using namespace std;
+using absl::GetFlag;
 
 namespace {
 
@@ -63,61 +72,23 @@ string RunBitOperationOnValues(string_view op, const BitsStrVec& values);
 
 // ------------------------------------------------------------------------- //
 
-// This function can be used for any case where we allowing out of bound
-// access where the default in this case would be 0 -such as bitop
-uint8_t GetByteAt(string_view s, std::size_t at) {
-  return at >= s.size() ? 0 : s[at];
-}
-
-// For XOR, OR, AND operations on a collection of bytes
-template <typename BitOp, typename SkipOp>
-string BitOpString(BitOp operation_f, SkipOp skip_f, const BitsStrVec& values, string new_value) {
+// For XOR, OR, AND operations on a collection of values. Shorter values are padded with zeros
+// up to `max_len`. Each value is applied to the result as a whole, so the kernel runs over
+// contiguous memory.
+string BitOpString(BitOpType op, const BitsStrVec& values, std::size_t max_len) {
   // at this point, values are not empty
-  std::size_t max_size = new_value.size();
-
-  if (values.size() > 1) {
-    for (std::size_t i = 0; i < max_size; i++) {
-      std::uint8_t new_entry = operation_f(GetByteAt(values[0], i), GetByteAt(values[1], i));
-      for (std::size_t j = 2; j < values.size(); ++j) {
-        new_entry = operation_f(new_entry, GetByteAt(values[j], i));
-        if (skip_f(new_entry)) {
-          break;
-        }
-      }
-      new_value[i] = new_entry;
+  string new_value = values[0];
+  new_value.resize(max_len, 0);
+
+  for (std::size_t i = 1; i < values.size(); ++i) {
+    const string& value = values[i];
+    BitOpInPlace(op, value, reinterpret_cast<uint8_t*>(new_value.data()));
+    if (op == BitOpType::AND) {
+      // The missing bytes of a shorter value are zero.
+      memset(new_value.data() + value.size(), 0, max_len - value.size());
     }
-    return new_value;
-  } else {
-    return values[0];
   }
-}
-
-// Helper functions to support operations
-// so we would not need to check which
-// operations to run in the look (unlike
-// https://github.com/redis/redis/blob/c2b0c13d5c0fab49131f6f5e844f80bfa43f6219/src/bitops.c#L607)
-constexpr bool SkipAnd(uint8_t byte) {
-  return byte == 0x0;
-}
-
-constexpr bool SkipOr(uint8_t byte) {
-  return byte == 0xff;
-}
-
-constexpr bool SkipXor(uint8_t) {
-  return false;
-}
-
-constexpr uint8_t AndOp(uint8_t left, uint8_t right) {
-  return left & right;
-}
-
-constexpr uint8_t OrOp(uint8_t left, uint8_t right) {
-  return left | right;
-}
-
-constexpr uint8_t XorOp(uint8_t left, uint8_t right) {
-  return left ^ right;
+  return new_value;
 }
 
 string BitOpNotString(string from) {
@@ -157,14 +128,11 @@ constexpr std::uint8_t CountBitsRange(std::uint8_t byte, std::uint8_t from, uint
 // Count the number of bits that are on, on bytes boundaries: i.e. Start and end are the indices for
 // bytes locations inside str CountBitSetByByteIndices
 std::size_t CountBitSetByByteIndices(string_view at, std::size_t start, std::size_t end) {
+  end = std::min(end, at.size());  // don't overflow
   if (start >= end) {
     return 0;
   }
-  end = std::min(end, at.size());  // don't overflow
-  std::uint32_t count =
-      std::accumulate(std::next(at.begin(), start), std::next(at.begin(), end), 0,
-                      [](auto counter, uint8_t ch) { return counter + absl::popcount(ch); });
-  return count;
+  return CountBits(at.substr(start, end - start));
 }
 
 // Count the number of bits that are on, on bits boundaries: i.e. Start and end are the indices for
@@ -198,13 +166,9 @@ int64_t NormalizedOffset(int64_t size, int64_t offset) {
   return std::min(std::max(offset, int64_t{0}), size);
 }
 
-// General purpose function to count the number of bits that are on.
-// The parameters for start, end and bits are defaulted to the start of the string,
-// end of the string and bits are false.
-// Note that when bits is false, it means that we are looking on byte boundaries.
-std::size_t CountBitSet(string_view str, int64_t start, int64_t end, bool bits) {
-  const int64_t strlen = bits ? str.size() * OFFSET_FACTOR : str.size();
-
+// Translates the inclusive range of BITCOUNT, which may use negative indices, to a half-open
+// range over a value of strlen bits or bytes. Returns an empty range if nothing is covered.
+pair<int64_t, int64_t> CountRange(int64_t strlen, int64_t start, int64_t end) {
   if (start < 0)
     start = strlen + start;
   if (end < 0)
@@ -213,24 +177,45 @@ std::size_t CountBitSet(string_view str, int64_t start, int64_t end, bool bits)
   end = min(end, strlen);
 
   if (strlen == 0 || start > end)
-    return 0;
+    return {0, 0};
 
   start = max(start, int64_t(0));
   end = max(end, int64_t(0));
 
-  ++end;
-  return bits ? CountBitSetByBitIndices(str, start, end)
-              : CountBitSetByByteIndices(str, start, end);
+  return {start, end + 1};
+}
+
+// General purpose function to count the number of bits that are on.
+// The parameters for start, end and bits are defaulted to the start of the string,
+// end of the string and bits are false.
+// Note that when bits is false, it means that we are looking on byte boundaries.
+std::size_t CountBitSet(string_view str, int64_t start, int64_t end, bool bits) {
+  const int64_t strlen = bits ? str.size() * OFFSET_FACTOR : str.size();
+  auto [from, to] = CountRange(strlen, start, end);
+  if (from >= to)
+    return 0;
+
+  return bits ? CountBitSetByBitIndices(str, from, to) : CountBitSetByByteIndices(str, from, to);
+}
+
+std::size_t CountBitSet(const SparseBitmap& bitmap, int64_t start, int64_t end, bool bits) {
+  const int64_t strlen = bits ? bitmap.size() * OFFSET_FACTOR : bitmap.size();
+  auto [from, to] = CountRange(strlen, start, end);
+  if (from >= to)
+    return 0;
+
+  const int64_t factor = bits ? 1 : OFFSET_FACTOR;
+  return bitmap.CountBits(from * factor, to * factor);
 }
 
 // return true if bit is on
-bool GetBitValue(const string& entry, uint32_t offset) {
+bool GetBitValue(string_view entry, uint32_t offset) {
   const auto byte_val{GetByteValue(entry, offset)};
   const auto index{GetNormalizedBitIndex(offset)};
   return CheckBitStatus(byte_val, index);
 }
 
-bool GetBitValueSafe(const string& entry, uint32_t offset) {
+bool GetBitValueSafe(string_view entry, uint32_t offset) {
   return ((entry.size() * OFFSET_FACTOR) > offset) ? GetBitValue(entry, offset) : false;
 }
 
@@ -286,6 +271,14 @@ class ElementAccess {
 
   void Commit(string_view new_value) const;
 
+  // Returns the sparse bitmap of the entry or nullptr if it is stored as a plain string. An entry
+  // that is new or grows mostly with zeros by setting the bit at `offset` is converted first.
+  // Changes to the bitmap must be followed by CommitSparse().
+  SparseBitmap* SparseValue(uint32_t offset) const;
+
+  // Stores the value back as a plain string if the bitmap became dense.
+  void CommitSparse() const;
+
   // return nullopt when key exists but it's not encoded as string
   // return true if key exists and false if it doesn't
   std::optional<bool> Exists(EngineShard* shard);
@@ -345,6 +338,32 @@ void ElementAccess::Commit(string_view new_value) const {
   }
 }
 
+SparseBitmap* ElementAccess::SparseValue(uint32_t offset) const {
+  CHECK_NOTNULL(shard_);
+  PrimeValue& pv = element_iter_->second;
+  if (!added_ && pv.IsSparseBitmap())
+    return pv.GetSparseBitmap();
+
+  // We only switch when at least 7/8 of the resulting string are zeros added by this call.
+  const size_t min_size = GetFlag(FLAGS_sparse_bitmap_min_size);
+  const size_t new_size = GetByteIndex(offset) + 1;
+  const size_t cur_size = added_ ? 0 : pv.Size();
+  if (min_size == 0 || new_size < min_size || new_size < cur_size * 8)
+    return nullptr;
+
+  pv.SetSparseBitmap(Value());
+  return pv.GetSparseBitmap();
+}
+
+void ElementAccess::CommitSparse() const {
+  PrimeValue& pv = element_iter_->second;
+  const SparseBitmap* bitmap = pv.GetSparseBitmap();
+  if (bitmap->MallocUsed() >= bitmap->size()) {
+    pv.SetString(GetString(pv));
+  }
+  post_updater_.Run();
+}
+
 // =============================================
 // Set a new value to a given bit
 
@@ -361,6 +380,12 @@ OpResult<bool> BitNewValue(const OpArgs& args, string_view key, uint32_t offset,
     return find_res;
   }
 
+  if (SparseBitmap* bitmap = element_access.SparseValue(offset); bitmap) {
+    old_value = bitmap->SetBit(offset, bit_value);
+    element_access.CommitSparse();
+    return old_value;
+  }
+
   if (element_access.IsNewEntry()) {
     string new_entry(GetByteIndex(offset) + 1, 0);
     old_value = SetBitValue(offset, bit_value, &new_entry);
@@ -388,16 +413,14 @@ string RunBitOperationOnValues(string_view op, const BitsStrVec& values) {
   // is shorter than the other it would return a 0 and the operation would continue
   // until we ran the longest value. The function will return the resulting new value
   std::size_t max_len = 0;
-  std::size_t max_len_index = 0;
 
   const auto BitOperation = [&]() {
     if (op == OR_OP_NAME) {
-      string default_str{values[max_len_index]};
-      return BitOpString(OrOp, SkipOr, std::move(values), std::move(default_str));
+      return BitOpString(BitOpType::OR, values, max_len);
     } else if (op == XOR_OP_NAME) {
-      return BitOpString(XorOp, SkipXor, std::move(values), string(max_len, 0));
+      return BitOpString(BitOpType::XOR, values, max_len);
     } else if (op == AND_OP_NAME) {
-      return BitOpString(AndOp, SkipAnd, std::move(values), string(max_len, 0));
+      return BitOpString(BitOpType::AND, values, max_len);
     } else if (op == NOT_OP_NAME) {
       return BitOpNotString(values[0]);
     } else {
@@ -414,7 +437,6 @@ string RunBitOperationOnValues(string_view op, const BitsStrVec& values) {
   for (std::size_t i = 1; i < values.size(); ++i) {
     if (values[i].size() > max_len) {
       max_len = values[i].size();
-      max_len_index = i;
     }
   }
   return BitOperation();
@@ -1260,12 +1282,18 @@ string GetString(const PrimeValue& pv) {
 }
 
 OpResult<bool> ReadValueBitsetAt(const OpArgs& op_args, string_view key, uint32_t offset) {
-  OpResult<string> result = ReadValue(op_args.db_cntx, key, op_args.shard);
-  if (result) {
-    return GetBitValueSafe(result.value(), offset);
-  } else {
-    return result.status();
+  auto it_res = op_args.GetDbSlice().FindReadOnly(op_args.db_cntx, key, OBJ_STRING);
+  if (!it_res.ok()) {
+    return it_res.status();
+  }
+
+  const PrimeValue& pv = it_res.value()->second;
+  if (pv.IsSparseBitmap()) {
+    return pv.GetSparseBitmap()->GetBit(offset);
   }
+
+  string tmp;
+  return GetBitValueSafe(pv.GetSlice(&tmp), offset);
 }
 
 OpResult<string> ReadValue(const DbContext& context, string_view key, EngineShard* shard) {
@@ -1282,13 +1310,18 @@ OpResult<string> ReadValue(const DbContext& context, string_view key, EngineShar
 
 OpResult<std::size_t> CountBitsForValue(const OpArgs& op_args, string_view key, int64_t start,
                                         int64_t end, bool bit_value) {
-  OpResult<string> result = ReadValue(op_args.db_cntx, key, op_args.shard);
+  auto it_res = op_args.GetDbSlice().FindReadOnly(op_args.db_cntx, key, OBJ_STRING);
+  if (!it_res.ok()) {  // if this is not found, just return 0 - per Redis
+    return it_res.status();
+  }
 
-  if (result) {  // if this is not found, just return 0 - per Redis
-    return CountBitSet(result.value(), start, end, bit_value);
-  } else {
-    return result.status();
+  const PrimeValue& pv = it_res.value()->second;
+  if (pv.IsSparseBitmap()) {
+    return CountBitSet(*pv.GetSparseBitmap(), start, end, bit_value);
   }
+
+  string tmp;
+  return CountBitSet(pv.GetSlice(&tmp), start, end, bit_value);
 }
 
 // Returns the bit position (where MSB is 0, LSB is 7) of the leftmost bit that
@@ -1321,20 +1354,18 @@ int64_t FindFirstBitWithValueAsBit(string_view value_str, bool bit_value, int64_
 
 int64_t FindFirstBitWithValueAsByte(string_view value_str, bool bit_value, int64_t start,
                                     int64_t end) {
-  for (int64_t i = start; i <= end; ++i) {
-    if (static_cast<size_t>(i) >= value_str.size()) {
-      break;
-    }
-    const uint8_t current_byte = value_str[i];
-    const uint8_t kNotFoundByte = bit_value ? 0 : std::numeric_limits<uint8_t>::max();
-    if (current_byte == kNotFoundByte) {
-      continue;
-    }
+  if (static_cast<size_t>(start) >= value_str.size() || start > end) {
+    return -1;
+  }
 
-    return i * OFFSET_FACTOR + GetFirstBitWithValueInByte(current_byte, bit_value);
+  const size_t stop = std::min<size_t>(end + 1, value_str.size());
+  const uint8_t kNotFoundByte = bit_value ? 0 : std::numeric_limits<uint8_t>::max();
+  size_t i = start + FindFirstByteNotEqual(value_str.substr(start, stop - start), kNotFoundByte);
+  if (i == stop) {
+    return -1;
   }
 
-  return -1;
+  return i * OFFSET_FACTOR + GetFirstBitWithValueInByte(value_str[i], bit_value);
 }
 
 OpResult<int64_t> FindFirstBitWithValue(const OpArgs& op_args, string_view key, bool bit_value,
@@ -880,4 +880,74 @@ TEST_F(BitOpsFamilyTest, BitFieldAdditionalWrongArguments) {
   ASSERT_THAT(Run({"bitfield", "foo", "incrby", "i16", "0", "bar"}), syntax_error);
 }
 
+TEST_F(BitOpsFamilyTest, SparseBitmap) {
+  absl::FlagSaver fs;
+  SetTestFlag("sparse_bitmap_min_size", "65536");
+
+  // A bit far from the start of a new key creates a sparse bitmap.
+  EXPECT_EQ(0, CheckedInt({"setbit", "sparse", "8000000", "1"}));
+  EXPECT_EQ(0, CheckedInt({"setbit", "sparse", "17", "1"}));
+  EXPECT_EQ(1, CheckedInt({"setbit", "sparse", "17", "1"}));
+  EXPECT_LT(CheckedInt({"memory", "usage", "sparse", "WITHOUTKEY"}), 1000);
+
+  EXPECT_EQ(1, CheckedInt({"getbit", "sparse", "17"}));
+  EXPECT_EQ(0, CheckedInt({"getbit", "sparse", "18"}));
+  EXPECT_EQ(1, CheckedInt({"getbit", "sparse", "8000000"}));
+  EXPECT_EQ(0, CheckedInt({"getbit", "sparse", "9000000"}));
+  EXPECT_EQ(1000001, CheckedInt({"strlen", "sparse"}));
+
+  EXPECT_EQ(2, CheckedInt({"bitcount", "sparse"}));
+  EXPECT_EQ(1, CheckedInt({"bitcount", "sparse", "0", "2"}));
+  EXPECT_EQ(1, CheckedInt({"bitcount", "sparse", "-1", "-1"}));
+  EXPECT_EQ(1, CheckedInt({"bitcount", "sparse", "17", "40", "BIT"}));
+  EXPECT_EQ(17, CheckedInt({"bitpos", "sparse", "1"}));
+
+  // Other commands see the plain string.
+  string plain(1000001, '\0');
+  plain[2] = '\x40';
+  plain.back() = '\x80';
+  EXPECT_EQ(Run({"get", "sparse"}), plain);
+  EXPECT_THAT(Run({"bitfield_ro", "sparse", "get", "u8", "16"}), IntArg(64));
+
+  EXPECT_EQ(1000001, CheckedInt({"bitop", "or", "dest", "sparse", "missing"}));
+  EXPECT_EQ(Run({"get", "dest"}), plain);
+
+  // Clearing the bits keeps the length.
+  EXPECT_EQ(1, CheckedInt({"setbit", "sparse", "17", "0"}));
+  EXPECT_EQ(1, CheckedInt({"setbit", "sparse", "8000000", "0"}));
+  EXPECT_EQ(0, CheckedInt({"bitcount", "sparse"}));
+  EXPECT_EQ(1000001, CheckedInt({"strlen", "sparse"}));
+
+  // Large growth of a short plain string converts it as well.
+  Run({"set", "plain", "abc"});
+  EXPECT_EQ(0, CheckedInt({"setbit", "plain", "800000", "1"}));
+  EXPECT_LT(CheckedInt({"memory", "usage", "plain", "WITHOUTKEY"}), 1000);
+  EXPECT_EQ(11, CheckedInt({"bitcount", "plain"}));
+  EXPECT_EQ(3, CheckedInt({"bitcount", "plain", "0", "0"}));
+}
+
+TEST_F(BitOpsFamilyTest, SparseBitmapSaveLoad) {
+  absl::FlagSaver fs;
+  SetTestFlag("sparse_bitmap_min_size", "65536");
+
+  EXPECT_EQ(0, CheckedInt({"setbit", "sparse", "8000000", "1"}));
+  EXPECT_EQ(0, CheckedInt({"setbit", "sparse", "17", "1"}));
+  EXPECT_LT(CheckedInt({"memory", "usage", "sparse", "WITHOUTKEY"}), 1000);
+
+  // Snapshots contain the plain string, which is loaded as a plain string.
+  ASSERT_EQ(Run({"debug", "reload"}), "OK");
+  EXPECT_GT(CheckedInt({"memory", "usage", "sparse", "WITHOUTKEY"}), 1000000);
+
+  EXPECT_EQ(1000001, CheckedInt({"strlen", "sparse"}));
+  EXPECT_EQ(2, CheckedInt({"bitcount", "sparse"}));
+  EXPECT_EQ(1, CheckedInt({"getbit", "sparse", "17"}));
+  EXPECT_EQ(1, CheckedInt({"getbit", "sparse", "8000000"}));
+
+  // Growing it far enough by SETBIT switches it back to the sparse encoding.
+  EXPECT_EQ(0, CheckedInt({"setbit", "sparse", "80000000", "1"}));
+  EXPECT_LT(CheckedInt({"memory", "usage", "sparse", "WITHOUTKEY"}), 100000);
+  EXPECT_EQ(3, CheckedInt({"bitcount", "sparse"}));
+  EXPECT_EQ(1, CheckedInt({"getbit", "sparse", "17"}));
+}
+
 }  // end of namespace dfly
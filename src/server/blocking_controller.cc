@@ -4,15 +4,23 @@
 
 #include "server/blocking_controller.h"
 
-#include <absl/container/inlined_vector.h>
-
 #include <boost/smart_ptr/intrusive_ptr.hpp>
+#include <list>
 
+#include "base/flags.h"
 #include "base/logging.h"
 #include "server/engine_shard_set.h"
 #include "server/namespaces.h"
 #include "server/transaction.h"
 
+extern "C" {
+#include "redis/redis_aux.h"
+}
+
+ABSL_FLAG(uint32_t, blocking_notify_batch, 256,
+          "Maximal number of waiters of a list or a sorted set woken in a single notify pass, as "
+          "long as the key holds enough elements for all of them. 1 wakes one waiter at a time.");
+
 namespace dfly {
 
 using namespace std;
@@ -20,30 +28,47 @@ using namespace std;
 struct WatchItem {
   Transaction* trans;
   KeyReadyChecker key_ready_checker;
+  unsigned demand;        // max number of elements consumed once awakened, 0 if unknown.
+  bool notified = false;  // awakened by this queue and not finished yet.
 
   Transaction* get() const {
     return trans;
   }
 
-  WatchItem(Transaction* t, KeyReadyChecker krc) : trans(t), key_ready_checker(std::move(krc)) {
+  WatchItem(Transaction* t, KeyReadyChecker krc, unsigned demand)
+      : trans(t), key_ready_checker(std::move(krc)), demand(demand) {
   }
 };
 
 struct BlockingController::WatchQueue {
-  deque<WatchItem> items;
+  using Items = list<WatchItem>;
+
+  Items items;
+
+  // Position of every transaction in items, so that waiters that time out or finish are
+  // removed in O(1) regardless of the queue length.
+  absl::flat_hash_map<Transaction*, Items::iterator> index;
+
   TxId notify_txid = UINT64_MAX;
 
-  // Updated  by both coordinator and shard threads but at different times.
-  enum State { SUSPENDED, ACTIVE } state = SUSPENDED;
+  // Notified transactions are kept at the front of the queue until they finish, so that we know
+  // which queues must be handled when they do. The queue is suspended when there are none.
+  unsigned notified = 0;
+
+  bool IsSuspended() const {
+    return notified == 0;
+  }
 
-  void Suspend() {
-    state = SUSPENDED;
-    notify_txid = UINT64_MAX;
+  bool Add(Transaction* tx, KeyReadyChecker krc, unsigned demand) {
+    auto [it, inserted] = index.emplace(tx, items.end());
+    if (inserted)
+      it->second = items.emplace(items.end(), tx, std::move(krc), demand);
+    return inserted;
   }
 
-  auto Find(Transaction* tx) const {
-    return find_if(items.begin(), items.end(),
-                   [tx](const WatchItem& wi) { return wi.get() == tx; });
+  Items::iterator Erase(Items::iterator it) {
+    index.erase(it->get());
+    return items.erase(it);
   }
 };
 
@@ -73,26 +98,21 @@ bool BlockingController::DbWatchTable::UnwatchTx(string_view key, Transaction* t
   WatchQueue* wq = wq_it->second.get();
   DCHECK(!wq->items.empty());
 
-  bool res = false;
-  if (wq->state == WatchQueue::ACTIVE && wq->items.front().get() == tx) {
-    wq->items.pop_front();
+  // tx can be is_awakened == true because of some other key, and then it is not notified
+  // by this queue, but we still need to clean it up.
+  auto idx_it = wq->index.find(tx);
+  if (idx_it == wq->index.end())
+    return false;
 
-    // We suspend the queue and add keys to re-verification.
-    // If they are still present, this queue will be reactivated below.
-    wq->state = WatchQueue::SUSPENDED;
+  bool res = idx_it->second->notified;
+  wq->Erase(idx_it->second);
 
+  // Once all the notified transactions finished, we add the key to re-verification.
+  // If it's still present, this queue will be reactivated for the next waiters.
+  if (res && --wq->notified == 0) {
+    wq->notify_txid = UINT64_MAX;
     if (!wq->items.empty())
       awakened_keys.insert(wq_it->first);  // send for further validation.
-    res = true;
-  } else {
-    // tx can be is_awakened == true because of some other key and this queue would be
-    // in suspended and we still need to clean it up.
-    // the suspended item does not have to be the first one in the queue.
-    // This shard has not been awakened and in case this transaction in the queue
-    // we must clean it up.
-    if (auto it = wq->Find(tx); it != wq->items.end()) {
-      wq->items.erase(it);
-    }
   }
 
   if (wq->items.empty()) {
@@ -103,7 +123,8 @@ bool BlockingController::DbWatchTable::UnwatchTx(string_view key, Transaction* t
   return res;
 }
 
-BlockingController::BlockingController(EngineShard* owner, Namespace* ns) : owner_(owner), ns_(ns) {
+BlockingController::BlockingController(EngineShard* owner, Namespace* ns)
+    : owner_(owner), ns_(ns), notify_batch_(max(1u, absl::GetFlag(FLAGS_blocking_notify_batch))) {
 }
 
 BlockingController::~BlockingController() {
@@ -112,7 +133,7 @@ BlockingController::~BlockingController() {
 bool BlockingController::DbWatchTable::AddAwakeEvent(string_view key) {
   auto it = queue_map.find(key);
 
-  if (it == queue_map.end() || it->second->state != WatchQueue::SUSPENDED)
+  if (it == queue_map.end() || !it->second->IsSuspended())
     return false;  /// nobody watches this key or state does not match.
 
   return awakened_keys.insert(it->first).second;
@@ -199,7 +220,8 @@ void BlockingController::NotifyPending() {
   awakened_indices_.clear();
 }
 
-void BlockingController::AddWatched(Keys watch_keys, KeyReadyChecker krc, Transaction* trans) {
+void BlockingController::AddWatched(Keys watch_keys, KeyReadyChecker krc, unsigned demand,
+                                    Transaction* trans) {
   auto [dbit, added] = watched_dbs_.emplace(trans->GetDbIndex(), nullptr);
   if (added) {
     dbit->second.reset(new DbWatchTable);
@@ -213,16 +235,10 @@ void BlockingController::AddWatched(Keys watch_keys, KeyReadyChecker krc, Transa
       res->second.reset(new WatchQueue);
     }
 
-    if (!res->second->items.empty()) {
-      Transaction* last = res->second->items.back().get();
-      DCHECK_GT(last->GetUseCount(), 0u);
-
-      // Duplicate keys case. We push only once per key.
-      if (last == trans)
-        continue;
+    // Duplicate keys case. We push only once per key.
+    if (res->second->Add(trans, krc, demand)) {
+      DVLOG(2) << "Emplace " << trans->DebugId() << " to watch " << key;
     }
-    DVLOG(2) << "Emplace " << trans->DebugId() << " to watch " << key;
-    res->second->items.emplace_back(trans, krc);
   }
 }
 
@@ -242,38 +258,64 @@ void BlockingController::AwakeWatched(DbIndex db_index, string_view db_key) {
   }
 }
 
-// Marks the queue as active and notifies the first transaction in the queue.
+size_t BlockingController::ReadyCapacity(string_view key, const DbContext& context) const {
+  auto res = context.GetDbSlice(owner_->shard_id()).FindReadOnly(context, key);
+  if (!IsValid(res.it))
+    return 0;
+
+  unsigned obj_type = res.it->second.ObjType();
+  return (obj_type == OBJ_LIST || obj_type == OBJ_ZSET) ? res.it->second.Size() : 0;
+}
+
+// Marks the queue as active and notifies the first transactions in the queue. The first ready
+// transaction is always notified, the following ones only as long as the elements of the key
+// suffice for all of them. This way a push of many elements is handed out in a single pass instead
+// of one waiter per finished transaction.
 void BlockingController::NotifyWatchQueue(std::string_view key, WatchQueue* wq,
                                           const DbContext& context) {
-  DCHECK_EQ(wq->state, WatchQueue::SUSPENDED);
+  DCHECK(wq->IsSuspended());
 
   auto& queue = wq->items;
   ShardId sid = owner_->shard_id();
+  size_t capacity = notify_batch_ > 1 ? ReadyCapacity(key, context) : 0;
 
   // In the most cases we shouldn't have skipped elements at all
-  absl::InlinedVector<dfly::WatchItem, 4> skipped;
-  while (!queue.empty()) {
-    auto& wi = queue.front();
+  WatchQueue::Items skipped;
+  auto it = queue.begin();
+  while (it != queue.end()) {
+    WatchItem& wi = *it;
+    if (wq->notified > 0 &&
+        (wq->notified >= notify_batch_ || wi.demand == 0 || wi.demand > capacity))
+      break;
+
     Transaction* head = wi.get();
     // We check may the transaction be notified otherwise move it to the end of the queue
-    if (wi.key_ready_checker(owner_, context, head, key)) {
-      DVLOG(2) << "WQ-Pop " << head->DebugId() << " from key " << key << " committed txid "
-               << owner_->committed_txid();
-      if (head->NotifySuspended(sid, key)) {
-        wq->state = WatchQueue::ACTIVE;
-        // We deliberately keep the notified transaction in the queue to know which queue
-        // must handled when this transaction finished.
-        wq->notify_txid = owner_->committed_txid();
-        awakened_transactions_.insert(head);
-        break;
-      }
-    } else {
-      skipped.push_back(std::move(wi));
+    if (!wi.key_ready_checker(owner_, context, head, key)) {
+      skipped.splice(skipped.end(), queue, it++);
+      continue;
+    }
+
+    DVLOG(2) << "WQ-Pop " << head->DebugId() << " from key " << key << " committed txid "
+             << owner_->committed_txid();
+    if (!head->NotifySuspended(sid, key)) {
+      it = wq->Erase(it);
+      continue;
     }
 
-    queue.pop_front();
+    // We deliberately keep the notified transaction in the queue to know which queue
+    // must handled when this transaction finished.
+    wi.notified = true;
+    ++wq->notified;
+    wq->notify_txid = owner_->committed_txid();
+    awakened_transactions_.insert(head);
+
+    // A transaction that may consume an unknown number of elements is served alone.
+    if (wi.demand == 0)
+      break;
+    capacity -= min<size_t>(capacity, wi.demand);
+    ++it;
   }
-  std::move(skipped.begin(), skipped.end(), std::back_inserter(queue));
+  queue.splice(queue.end(), skipped);
 }
 
 size_t BlockingController::NumWatched(DbIndex db_indx) const {
@@ -42,7 +42,9 @@ class BlockingController {
   // TODO: consider moving all watched functions to
   // EngineShard with separate per db map.
   //! AddWatched adds a transaction to the blocking queue.
-  void AddWatched(Keys watch_keys, KeyReadyChecker krc, Transaction* me);
+  //! demand is the max number of elements the transaction consumes from the key once awakened,
+  //! or 0 if it is unknown. It allows waking several waiters of a key at once.
+  void AddWatched(Keys watch_keys, KeyReadyChecker krc, unsigned demand, Transaction* me);
 
   // Called from operations that create keys like lpush, rename etc.
   void AwakeWatched(DbIndex db_index, std::string_view db_key);
@@ -59,10 +61,14 @@ class BlockingController {
 
   void NotifyWatchQueue(std::string_view key, WatchQueue* wqm, const DbContext& context);
 
+  // Returns the number of elements of the key that can be handed to its waiters in one pass.
+  size_t ReadyCapacity(std::string_view key, const DbContext& context) const;
+
   // void NotifyConvergence(Transaction* tx);
 
   EngineShard* owner_;
   Namespace* ns_;
+  unsigned notify_batch_;  // see blocking_notify_batch flag
 
   absl::flat_hash_map<DbIndex, std::unique_ptr<DbWatchTable>> watched_dbs_;
 
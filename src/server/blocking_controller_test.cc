@@ -84,7 +84,7 @@ TEST_F(BlockingControllerTest, Basic) {
     BlockingController bc(shard, &namespaces->GetDefaultNamespace());
     auto keys = t->GetShardArgs(shard->shard_id());
     bc.AddWatched(
-        keys, [](auto...) { return true; }, t);
+        keys, [](auto...) { return true; }, 1, t);
     EXPECT_EQ(1, bc.NumWatched(0));
 
     bc.RemovedWatched(keys, t);
@@ -99,7 +99,7 @@ TEST_F(BlockingControllerTest, Timeout) {
   bool paused;
 
   facade::OpStatus status = trans_->WaitOnWatch(
-      tp, Transaction::kShardArgs, [](auto...) { return true; }, &blocked, &paused);
+      tp, Transaction::kShardArgs, [](auto...) { return true; }, 1, &blocked, &paused);
 
   EXPECT_EQ(status, facade::OpStatus::TIMED_OUT);
   unsigned num_watched = shard_set->Await(
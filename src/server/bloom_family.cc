@@ -26,6 +26,7 @@ struct SbfParams {
   uint32_t init_capacity;
   double error;
   double grow_factor = kDefaultGrowFactor;
+  bool blocked = false;
 
   bool ok() const {
     return error > 0 and error < 0.5;
@@ -44,7 +45,7 @@ OpStatus OpReserve(const SbfParams& params, const OpArgs& op_args, string_view k
     return OpStatus::KEY_EXISTS;
 
   PrimeValue& pv = op_res->it->second;
-  pv.SetSBF(params.init_capacity, params.error, params.grow_factor);
+  pv.SetSBF(params.init_capacity, params.error, params.grow_factor, params.blocked);
 
   return OpStatus::OK;
 }
@@ -63,10 +64,10 @@ OpResult<AddResult> OpAdd(const OpArgs& op_args, string_view key, CmdArgList ite
   }
 
   SBF* sbf = pv.GetSBF();
-  AddResult result(items.size());
-  for (size_t i = 0; i < items.size(); ++i) {
-    result[i] = sbf->Add(ToSV(items[i]));
-  }
+  absl::InlinedVector<bool, 4> added(items.size());
+  sbf->Add(items, added.data());
+
+  AddResult result(added.begin(), added.end());
   return result;
 }
 
@@ -79,10 +80,7 @@ OpResult<ExistsResult> OpExists(const OpArgs& op_args, string_view key, CmdArgLi
 
   const SBF* sbf = it->second.GetSBF();
   ExistsResult result(items.size());
-
-  for (size_t i = 0; i < items.size(); ++i) {
-    result[i] = sbf->Exists(ToSV(items[i]));
-  }
+  sbf->Exists(items, result.data());
 
   return result;
 }
@@ -95,6 +93,13 @@ void BloomFamily::Reserve(CmdArgList args, const CommandContext& cmd_cntx) {
   SbfParams params;
 
   tie(params.error, params.init_capacity) = parser.Next<double, uint32_t>();
+  while (parser.HasNext()) {
+    if (parser.Check("BLOCKED")) {
+      params.blocked = true;
+    } else {
+      return cmd_cntx.rb->SendError(kSyntaxErr);
+    }
+  }
 
   if (parser.Error())
     return cmd_cntx.rb->SendError(kSyntaxErr);
@@ -51,4 +51,14 @@ TEST_F(BloomFamilyTest, Multiple) {
   EXPECT_THAT(resp, RespArray(ElementsAre(IntArg(1), IntArg(1), IntArg(1))));
 }
 
+TEST_F(BloomFamilyTest, Blocked) {
+  EXPECT_EQ(Run({"bf.reserve", "b1", "0.01", "1000", "blocked"}), "OK");
+  EXPECT_THAT(Run({"bf.reserve", "b2", "0.01", "1000", "foo"}), ErrArg("syntax error"));
+
+  EXPECT_THAT(Run({"bf.madd", "b1", "a", "b", "c"}),
+              RespArray(ElementsAre(IntArg(1), IntArg(1), IntArg(1))));
+  EXPECT_THAT(Run({"bf.mexists", "b1", "a", "b", "d"}),
+              RespArray(ElementsAre(IntArg(1), IntArg(1), IntArg(0))));
+}
+
 }  // namespace dfly
@@ -5,9 +5,12 @@
 //
 
 #include <absl/container/fixed_array.h>
+#include <absl/strings/match.h>
+#include <xxhash.h>
 
 #include "base/logging.h"
 #include "core/glob_matcher.h"
+#include "facade/reply_builder.h"
 #include "server/cluster/slot_set.h"
 #include "server/cluster_support.h"
 #include "server/engine_shard_set.h"
@@ -18,31 +21,73 @@ using namespace std;
 
 namespace {
 
-// Build functor for sending messages to connection
-auto BuildSender(string_view channel, facade::ArgRange messages, bool unsubscribe = false) {
-  absl::FixedArray<string_view, 1> views(messages.Size());
-  size_t messages_size = accumulate(messages.begin(), messages.end(), 0,
-                                    [](int sum, string_view str) { return sum + str.size(); });
-  auto buf = shared_ptr<char[]>{new char[channel.size() + messages_size]};
-  {
-    memcpy(buf.get(), channel.data(), channel.size());
-    char* ptr = buf.get() + channel.size();
-
-    size_t i = 0;
-    for (string_view message : messages) {
-      memcpy(ptr, message.data(), message.size());
-      views[i++] = {ptr, message.size()};
-      ptr += message.size();
+// Sends messages to connections. The channel, the messages and their pre-rendered push headers
+// are stored in a single buffer shared by all subscribers.
+class PubSender {
+ public:
+  PubSender(string_view channel, facade::ArgRange messages, bool unsubscribe = false);
+
+  // Handle to the shared buffer with its own reference count. Each thread takes one, so that
+  // queueing a message for a subscriber doesn't touch a reference count shared by all threads.
+  shared_ptr<char[]> LocalHandle() const {
+    return shared_ptr<char[]>{make_shared<shared_ptr<char[]>>(buf_), buf_.get()};
+  }
+
+  void Send(facade::Connection* conn, const string& pattern,
+            const shared_ptr<char[]>& handle) const;
+
+ private:
+  struct View {
+    string_view message, header;
+  };
+
+  size_t channel_size_;
+  shared_ptr<char[]> buf_;
+  absl::FixedArray<View, 1> views_;
+  bool unsubscribe_;
+};
+
+PubSender::PubSender(string_view channel, facade::ArgRange messages, bool unsubscribe)
+    : channel_size_{channel.size()}, views_(messages.Size()), unsubscribe_{unsubscribe} {
+  absl::FixedArray<string, 1> headers(unsubscribe ? 0 : messages.Size());
+
+  size_t buf_size = channel.size();
+  size_t i = 0;
+  for (string_view message : messages) {
+    buf_size += message.size();
+    if (!unsubscribe) {
+      headers[i] = facade::RedisReplyBuilder::SerializePubMessageHeader(channel, message.size());
+      buf_size += headers[i].size();
     }
+    ++i;
   }
 
-  return [channel, buf = std::move(buf), views = std::move(views), unsubscribe](
-             facade::Connection* conn, string pattern) {
-    string_view channel_view{buf.get(), channel.size()};
-    for (std::string_view message_view : views) {
-      conn->SendPubMessageAsync({std::move(pattern), buf, channel_view, message_view, unsubscribe});
+  buf_.reset(new char[buf_size]);
+  memcpy(buf_.get(), channel.data(), channel.size());
+  char* ptr = buf_.get() + channel.size();
+
+  i = 0;
+  for (string_view message : messages) {
+    memcpy(ptr, message.data(), message.size());
+    views_[i].message = {ptr, message.size()};
+    ptr += message.size();
+    if (!unsubscribe) {
+      memcpy(ptr, headers[i].data(), headers[i].size());
+      views_[i].header = {ptr, headers[i].size()};
+      ptr += headers[i].size();
     }
-  };
+    ++i;
+  }
+}
+
+void PubSender::Send(facade::Connection* conn, const string& pattern,
+                     const shared_ptr<char[]>& handle) const {
+  DCHECK_EQ(handle.get(), buf_.get());
+  string_view channel_view{buf_.get(), channel_size_};
+  for (const View& view : views_) {
+    conn->SendPubMessageAsync(
+        {pattern, handle, channel_view, view.message, view.header, unsubscribe_});
+  }
 }
 
 }  // namespace
@@ -95,12 +140,84 @@ void ChannelStore::ChannelMap::DeleteAll() {
     delete ptr.Get();
 }
 
-ChannelStore::ChannelStore() : channels_{new ChannelMap{}}, patterns_{new ChannelMap{}} {
-  control_block.most_recent = this;
+string ChannelStore::PatternIndex::LiteralPrefix(string_view pattern) {
+  string prefix;
+  for (size_t i = 0; i < pattern.size(); ++i) {
+    char c = pattern[i];
+    if (c == '*' || c == '?' || c == '[')
+      break;
+    if (c == '\\' && i + 1 < pattern.size())
+      c = pattern[++i];
+    prefix.push_back(c);
+  }
+  return prefix;
+}
+
+void ChannelStore::PatternIndex::Add(string_view pattern) {
+  string prefix = LiteralPrefix(pattern);
+  size_t len = prefix.size();
+  by_prefix_[std::move(prefix)].emplace_back(pattern);
+
+  auto it = lower_bound(prefix_lens_.begin(), prefix_lens_.end(), make_pair(len, 0u));
+  if (it == prefix_lens_.end() || it->first != len)
+    it = prefix_lens_.emplace(it, len, 0);
+  ++it->second;
+}
+
+void ChannelStore::PatternIndex::Remove(string_view pattern) {
+  string prefix = LiteralPrefix(pattern);
+  auto bucket = by_prefix_.find(prefix);
+  if (bucket == by_prefix_.end())
+    return;
+
+  auto& patterns = bucket->second;
+  auto pos = find(patterns.begin(), patterns.end(), pattern);
+  if (pos == patterns.end())
+    return;
+  patterns.erase(pos);
+  if (patterns.empty())
+    by_prefix_.erase(bucket);
+
+  auto it = lower_bound(prefix_lens_.begin(), prefix_lens_.end(), make_pair(prefix.size(), 0u));
+  DCHECK(it != prefix_lens_.end() && it->first == prefix.size());
+  if (--it->second == 0)
+    prefix_lens_.erase(it);
+}
+
+ChannelStore::PartitionedChannelMap::PartitionedChannelMap() {
+  for (auto& partition : partitions_)
+    partition.store(new ChannelMap{}, memory_order_relaxed);
 }
 
-ChannelStore::ChannelStore(ChannelMap* channels, ChannelMap* patterns)
-    : channels_{channels}, patterns_{patterns} {
+unsigned ChannelStore::PartitionedChannelMap::PartitionOf(string_view key) {
+  return XXH64(key.data(), key.size(), 0x9E3779B97F4A7C15ULL) % kNumPartitions;
+}
+
+ChannelStore::ChannelMap* ChannelStore::PartitionedChannelMap::Get(unsigned idx) const {
+  return partitions_[idx].load(memory_order_acquire);  // sync pointed memory
+}
+
+void ChannelStore::PartitionedChannelMap::Set(unsigned idx, ChannelMap* map) {
+  partitions_[idx].store(map, memory_order_release);  // sync pointed memory
+}
+
+size_t ChannelStore::PartitionedChannelMap::Size() const {
+  size_t res = 0;
+  for (unsigned i = 0; i < kNumPartitions; ++i)
+    res += Get(i)->size();
+  return res;
+}
+
+void ChannelStore::PartitionedChannelMap::DeleteAll() {
+  for (auto& partition : partitions_) {
+    auto* map = partition.exchange(nullptr, memory_order_relaxed);
+    map->DeleteAll();
+    delete map;
+  }
+}
+
+ChannelStore::ChannelStore() {
+  control_block.most_recent = this;
 }
 
 void ChannelStore::Destroy() {
@@ -108,17 +225,20 @@ void ChannelStore::Destroy() {
   control_block.update_mu.unlock();
 
   auto* store = control_block.most_recent.load(memory_order_relaxed);
-  for (auto* chan_map : {store->channels_, store->patterns_}) {
-    chan_map->DeleteAll();
-    delete chan_map;
-  }
-  delete control_block.most_recent;
+  store->channels_.DeleteAll();
+  store->patterns_.DeleteAll();
+  delete store;
+  control_block.keyspace_slots.store(0, memory_order_relaxed);
 }
 
 ChannelStore::ControlBlock ChannelStore::control_block;
 
 unsigned ChannelStore::SendMessages(std::string_view channel, facade::ArgRange messages) const {
-  vector<Subscriber> subscribers = FetchSubscribers(channel);
+  return SendToSubscribers(FetchSubscribers(channel), channel, messages);
+}
+
+unsigned ChannelStore::SendToSubscribers(vector<Subscriber> subscribers, string_view channel,
+                                         facade::ArgRange messages, bool unsubscribe) {
   if (subscribers.empty())
     return 0;
 
@@ -130,7 +250,7 @@ unsigned ChannelStore::SendMessages(std::string_view channel, facade::ArgRange m
   for (auto& sub : subscribers) {
     int sub_thread = sub.Thread();
     DCHECK_LE(last_thread, sub_thread);
-    if (last_thread == sub_thread)  // skip same thread
+    if (unsubscribe || last_thread == sub_thread)  // skip same thread
       continue;
 
     if (sub.IsExpired())
@@ -144,12 +264,17 @@ unsigned ChannelStore::SendMessages(std::string_view channel, facade::ArgRange m
   }
 
   auto subscribers_ptr = make_shared<decltype(subscribers)>(std::move(subscribers));
-  auto cb = [subscribers_ptr, send = BuildSender(channel, messages)](unsigned idx, auto*) {
+  auto sender = make_shared<PubSender>(channel, messages, unsubscribe);
+  auto cb = [subscribers_ptr, sender](unsigned idx, auto*) {
     auto it = lower_bound(subscribers_ptr->begin(), subscribers_ptr->end(), idx,
                           ChannelStore::Subscriber::ByThreadId);
+    if (it == subscribers_ptr->end() || it->Thread() != idx)
+      return;
+
+    auto handle = sender->LocalHandle();
     while (it != subscribers_ptr->end() && it->Thread() == idx) {
       if (auto* ptr = it->Get(); ptr && ptr->cntx() != nullptr)
-        send(ptr, it->pattern);
+        sender->Send(ptr, it->pattern, handle);
       it++;
     }
   };
@@ -161,19 +286,35 @@ unsigned ChannelStore::SendMessages(std::string_view channel, facade::ArgRange m
 vector<ChannelStore::Subscriber> ChannelStore::FetchSubscribers(string_view channel) const {
   vector<Subscriber> res;
 
-  if (auto it = channels_->find(channel); it != channels_->end())
+  const ChannelMap* chans = channels_.Get(PartitionedChannelMap::PartitionOf(channel));
+  if (auto it = chans->find(channel); it != chans->end())
     Fill(*it->second, string{}, &res);
 
-  for (const auto& [pat, subs] : *patterns_) {
-    GlobMatcher matcher{pat, true};
-    if (matcher.Matches(channel))
-      Fill(*subs, pat, &res);
+  for (unsigned i = 0; i < PartitionedChannelMap::kNumPartitions; ++i) {
+    const ChannelMap* pats = patterns_.Get(i);
+    pats->pattern_index.ForEachCandidate(channel, [&](const string& pat) {
+      GlobMatcher matcher{pat, true};
+      if (!matcher.Matches(channel))
+        return;
+      if (auto it = pats->find(pat); it != pats->end())
+        Fill(*it->second, it->first, &res);
+    });
   }
 
   sort(res.begin(), res.end(), Subscriber::ByThread);
   return res;
 }
 
+bool ChannelStore::MayMatchKeyspaceChannel(string_view key, bool pattern) {
+  // Common prefix of the __keyspace@ and __keyevent@ channels.
+  constexpr string_view kPrefix = "__key";
+  if (!pattern)
+    return absl::StartsWith(key, kPrefix);
+
+  string prefix = PatternIndex::LiteralPrefix(key);
+  return absl::StartsWith(prefix, kPrefix) || absl::StartsWith(kPrefix, prefix);
+}
+
 void ChannelStore::Fill(const SubscribeMap& src, const string& pattern, vector<Subscriber>* out) {
   out->reserve(out->size() + src.size());
   for (const auto [cntx, thread_id] : src) {
@@ -188,54 +329,15 @@ void ChannelStore::Fill(const SubscribeMap& src, const string& pattern, vector<S
 std::vector<string> ChannelStore::ListChannels(const string_view pattern) const {
   vector<string> res;
   GlobMatcher matcher{pattern, true};
-  for (const auto& [channel, _] : *channels_) {
+  channels_.ForEach([&](const string& channel, const UpdatablePointer&) {
     if (pattern.empty() || matcher.Matches(channel))
       res.push_back(channel);
-  }
+  });
   return res;
 }
 
 size_t ChannelStore::PatternCount() const {
-  return patterns_->size();
-}
-
-void ChannelStore::UnsubscribeAfterClusterSlotMigration(const cluster::SlotSet& deleted_slots) {
-  if (deleted_slots.Empty()) {
-    return;
-  }
-
-  const uint32_t tid = util::ProactorBase::me()->GetPoolIndex();
-  ChannelStoreUpdater csu(false, false, nullptr, tid);
-
-  for (const auto& [channel, _] : *channels_) {
-    auto channel_slot = KeySlot(channel);
-    if (deleted_slots.Contains(channel_slot)) {
-      csu.Record(channel);
-    }
-  }
-
-  csu.ApplyAndUnsubscribe();
-}
-
-void ChannelStore::UnsubscribeConnectionsFromDeletedSlots(const ChannelsSubMap& sub_map,
-                                                          uint32_t idx) {
-  const bool should_unsubscribe = true;
-  for (const auto& [channel, subscribers] : sub_map) {
-    // ignored by pub sub handler because should_unsubscribe is true
-    std::string msg = "__ignore__";
-    auto send = BuildSender(channel, {facade::ArgSlice{msg}}, should_unsubscribe);
-
-    auto it = lower_bound(subscribers.begin(), subscribers.end(), idx,
-                          ChannelStore::Subscriber::ByThreadId);
-    while (it != subscribers.end() && it->Thread() == idx) {
-      // if ptr->cntx() is null, a connection might have closed or be in the process of closing
-      if (auto* ptr = it->Get(); ptr && ptr->cntx() != nullptr) {
-        DCHECK(it->pattern.empty());
-        send(ptr, it->pattern);
-      }
-      ++it;
-    }
-  }
+  return patterns_.Size();
 }
 
 ChannelStoreUpdater::ChannelStoreUpdater(bool pattern, bool to_add, ConnectionContext* cntx,
@@ -247,18 +349,29 @@ void ChannelStoreUpdater::Record(string_view key) {
   ops_.emplace_back(key);
 }
 
-pair<ChannelStore::ChannelMap*, bool> ChannelStoreUpdater::GetTargetMap(ChannelStore* store) {
-  auto* target = pattern_ ? store->patterns_ : store->channels_;
+ChannelStore::ChannelMap* ChannelStoreUpdater::CopyPartition(const PartitionedChannelMap& src,
+                                                           unsigned idx) {
+  auto [it, inserted] = copies_.emplace(idx, nullptr);
+  if (inserted)
+    it->second = new ChannelMap{*src.Get(idx)};
+  return it->second;
+}
+
+ChannelStore::ChannelMap* ChannelStoreUpdater::GetTargetMap(const PartitionedChannelMap& src,
+                                                          string_view key) {
+  unsigned idx = PartitionedChannelMap::PartitionOf(key);
+  if (auto it = copies_.find(idx); it != copies_.end())
+    return it->second;
 
-  for (auto key : ops_) {
-    auto it = target->find(key);
-    DCHECK(it != target->end() || to_add_);
-    // We need to make a copy, if we are going to add or delete new map slot.
-    if ((to_add_ && it == target->end()) || (!to_add_ && it->second->size() == 1))
-      return {new ChannelStore::ChannelMap{*target}, true};
-  }
+  ChannelMap* target = src.Get(idx);
+  auto it = target->find(key);
+  DCHECK(it != target->end() || to_add_);
+
+  // We need to make a copy, if we are going to add or delete new map slot.
+  if ((to_add_ && it == target->end()) || (!to_add_ && it->second->size() == 1))
+    return CopyPartition(src, idx);
 
-  return {target, false};
+  return target;
 }
 
 void ChannelStoreUpdater::Modify(ChannelMap* target, string_view key) {
@@ -269,6 +382,10 @@ void ChannelStoreUpdater::Modify(ChannelMap* target, string_view key) {
   // New key, add new slot.
   if (to_add_ && it == target->end()) {
     target->emplace(key, new SubscribeMap{{cntx_, thread_id_}});
+    if (pattern_)
+      target->pattern_index.Add(key);
+    if (ChannelStore::MayMatchKeyspaceChannel(key, pattern_))
+      ChannelStore::control_block.keyspace_slots.fetch_add(1, memory_order_relaxed);
     return;
   }
 
@@ -277,6 +394,10 @@ void ChannelStoreUpdater::Modify(ChannelMap* target, string_view key) {
     DCHECK(it->second->begin()->first == cntx_);
     freelist_.push_back(it->second.Get());
     target->erase(it);
+    if (pattern_)
+      target->pattern_index.Remove(key);
+    if (ChannelStore::MayMatchKeyspaceChannel(key, pattern_))
+      ChannelStore::control_block.keyspace_slots.fetch_sub(1, memory_order_relaxed);
     return;
   }
 
@@ -294,106 +415,140 @@ void ChannelStoreUpdater::Modify(ChannelMap* target, string_view key) {
   it->second.Set(replacement);
 }
 
+void ChannelStoreUpdater::PublishCopies(PartitionedChannelMap* dst) {
+  for (auto [idx, copy] : copies_) {
+    replaced_partitions_.push_back(dst->Get(idx));
+    dst->Set(idx, copy);
+  }
+  copies_.clear();
+}
+
+void ChannelStoreUpdater::FreeReplaced() {
+  // Partition copies share SubscribeMaps with the replaced partitions, so only the
+  // partitions themselves are deleted here.
+  for (auto* partition : replaced_partitions_)
+    delete partition;
+
+  for (auto ptr : freelist_)
+    delete ptr;
+}
+
 void ChannelStoreUpdater::Apply() {
-  // Wait for other updates to finish, lock the control block and update store pointer.
+  // Wait for other updates to finish and lock the control block.
   auto& cb = ChannelStore::control_block;
   cb.update_mu.lock();
   auto* store = cb.most_recent.load(memory_order_relaxed);
+  auto& target = pattern_ ? store->patterns_ : store->channels_;
 
-  // Get target map (copied if needed) and apply operations.
-  auto [target, copied] = GetTargetMap(store);
+  // Apply operations, copying only the partitions that gain or lose slots.
   for (auto key : ops_)
-    Modify(target, key);
-
-  // Prepare replacement.
-  auto* replacement = store;
-  if (copied) {
-    auto* new_chans = pattern_ ? store->channels_ : target;
-    auto* new_patterns = pattern_ ? target : store->patterns_;
-    replacement = new ChannelStore{new_chans, new_patterns};
-  }
+    Modify(GetTargetMap(target, key), key);
 
-  // Update control block and unlock it.
-  cb.most_recent.store(replacement, memory_order_relaxed);
+  PublishCopies(&target);
   cb.update_mu.unlock();
 
-  // Update thread local references. Readers fetch subscribers via FetchSubscribers,
-  // which runs without preemption, and store references to them in self container Subscriber
-  // structs. This means that any point on the other thread is safe to update the channel store.
-  // Regardless of whether we need to replace, we dispatch to make sure all
-  // queued SubscribeMaps in the freelist are no longer in use.
-  shard_set->pool()->AwaitBrief([](unsigned idx, util::ProactorBase*) {
-    ServerState::tlocal()->UpdateChannelStore(
-        // Do not use memory_order_relaxed, we need to fetch the latest value of
-        // the control block
-        ChannelStore::control_block.most_recent.load(std::memory_order_seq_cst));
-  });
+  // Readers fetch subscribers via FetchSubscribers, which runs without preemption, and store
+  // references to them in self container Subscriber structs. Once every thread ran a brief
+  // callback, none of them can reference the replaced partitions and SubscribeMaps anymore.
+  shard_set->pool()->AwaitBrief([](unsigned, util::ProactorBase*) {});
 
-  // Delete previous map and channel store.
-  if (copied) {
-    delete (pattern_ ? store->patterns_ : store->channels_);
-    delete store;
-  }
-
-  for (auto ptr : freelist_)
-    delete ptr;
+  FreeReplaced();
 }
 
-void ChannelStoreUpdater::ApplyAndUnsubscribe() {
-  DCHECK(to_add_ == false);
-  DCHECK(pattern_ == false);
-  DCHECK(cntx_ == nullptr);
+ShardChannelStore* ShardChannelStore::tlocal() {
+  static thread_local ShardChannelStore store;
+  return &store;
+}
 
-  if (ops_.empty()) {
+void ShardChannelStore::Change(bool to_add, absl::Span<const string_view> channels,
+                               ConnectionContext* cntx, uint32_t thread_id) {
+  if (channels.empty())
     return;
-  }
 
-  // Wait for other updates to finish, lock the control block and update store pointer.
-  auto& cb = ChannelStore::control_block;
-  cb.update_mu.lock();
-  auto* store = cb.most_recent.load(memory_order_relaxed);
-
-  // Deep copy, we will remove channels
-  auto* target = new ChannelStore::ChannelMap{*store->channels_};
+  vector<vector<string_view>> by_shard(shard_set->size());
+  for (string_view channel : channels)
+    by_shard[Shard(channel, shard_set->size())].push_back(channel);
+
+  auto cb = [&](EngineShard* es) {
+    auto& store = tlocal()->channels_;
+    for (string_view channel : by_shard[es->shard_id()]) {
+      if (to_add) {
+        store[channel].emplace(cntx, thread_id);
+      } else if (auto it = store.find(channel); it != store.end()) {
+        it->second.erase(cntx);
+        if (it->second.empty())
+          store.erase(it);
+      }
+    }
+  };
+  shard_set->RunBriefInParallel(cb, [&](ShardId sid) { return !by_shard[sid].empty(); });
+}
 
-  for (auto key : ops_) {
-    auto it = target->find(key);
-    freelist_.push_back(it->second.Get());
-    target->erase(it);
-    continue;
-  }
+vector<ShardChannelStore::Subscriber> ShardChannelStore::FetchSubscribers(string_view channel) {
+  ShardId target = Shard(channel, shard_set->size());
+  vector<Subscriber> res;
+  shard_set->RunBriefInParallel(
+      [&](EngineShard*) {
+        auto& store = tlocal()->channels_;
+        if (auto it = store.find(channel); it != store.end())
+          ChannelStore::Fill(it->second, string{}, &res);
+      },
+      [&](ShardId sid) { return sid == target; });
 
-  // Prepare replacement.
-  auto* replacement = new ChannelStore{target, store->patterns_};
+  sort(res.begin(), res.end(), Subscriber::ByThread);
+  return res;
+}
 
-  // Update control block and unlock it.
-  cb.most_recent.store(replacement, memory_order_relaxed);
-  cb.update_mu.unlock();
+unsigned ShardChannelStore::SendMessages(string_view channel, facade::ArgRange messages) {
+  return ChannelStore::SendToSubscribers(FetchSubscribers(channel), channel, messages);
+}
 
-  // FetchSubscribers is not thead safe so we need to fetch here before we do the hop below.
-  // Bonus points because now we compute subscribers only once.
-  absl::flat_hash_map<std::string_view, std::vector<ChannelStore::Subscriber>> subs;
-  for (auto channel : ops_) {
-    auto channel_subs = ServerState::tlocal()->channel_store()->FetchSubscribers(channel);
-    DCHECK(!subs.contains(channel));
-    subs[channel] = std::move(channel_subs);
-  }
-  // Update thread local references. Readers fetch subscribers via FetchSubscribers,
-  // which runs without preemption, and store references to them in self container Subscriber
-  // structs. This means that any point on the other thread is safe to update the channel store.
-  // Regardless of whether we need to replace, we dispatch to make sure all
-  // queued SubscribeMaps in the freelist are no longer in use.
-  shard_set->pool()->AwaitFiberOnAll([&subs](unsigned idx, util::ProactorBase*) {
-    ServerState::tlocal()->UnsubscribeSlotsAndUpdateChannelStore(
-        subs, ChannelStore::control_block.most_recent.load(memory_order_relaxed));
+vector<string> ShardChannelStore::ListChannels(string_view pattern) {
+  vector<vector<string>> per_shard(shard_set->size());
+  shard_set->RunBriefInParallel([&](EngineShard* es) {
+    GlobMatcher matcher{pattern, true};
+    for (const auto& [channel, _] : tlocal()->channels_) {
+      if (pattern.empty() || matcher.Matches(channel))
+        per_shard[es->shard_id()].push_back(channel);
+    }
   });
 
-  // Delete previous map and channel store.
-  delete store->channels_;
-  delete store;
+  vector<string> res;
+  for (auto& channels : per_shard)
+    move(channels.begin(), channels.end(), back_inserter(res));
+  return res;
+}
 
-  for (auto ptr : freelist_)
-    delete ptr;
+void ShardChannelStore::UnsubscribeSlots(const cluster::SlotSet& deleted_slots) {
+  if (deleted_slots.Empty())
+    return;
+
+  using ChannelSubscribers = vector<pair<string, vector<Subscriber>>>;
+  vector<ChannelSubscribers> per_shard(shard_set->size());
+  shard_set->RunBriefInParallel([&](EngineShard* es) {
+    auto& store = tlocal()->channels_;
+    for (auto it = store.begin(); it != store.end();) {
+      if (!deleted_slots.Contains(KeySlot(it->first))) {
+        ++it;
+        continue;
+      }
+
+      vector<Subscriber> subs;
+      ChannelStore::Fill(it->second, string{}, &subs);
+      per_shard[es->shard_id()].emplace_back(it->first, std::move(subs));
+      store.erase(it++);
+    }
+  });
+
+  // The connections unsubscribe themselves when they handle the message, which is ignored
+  // by the pub/sub handler because it unsubscribes.
+  string msg = "__ignore__";
+  for (auto& channels : per_shard) {
+    for (auto& [channel, subs] : channels) {
+      sort(subs.begin(), subs.end(), Subscriber::ByThread);
+      ChannelStore::SendToSubscribers(std::move(subs), channel, {facade::ArgSlice{msg}}, true);
+    }
+  }
 }
 
 }  // namespace dfly
@@ -4,7 +4,9 @@
 #pragma once
 
 #include <absl/container/flat_hash_map.h>
+#include <absl/types/span.h>
 
+#include <array>
 #include <string_view>
 
 #include "facade/dragonfly_connection.h"
@@ -21,17 +23,18 @@ class SlotSet;
 // ChannelStore manages PUB/SUB subscriptions.
 //
 // Updates are carried out via RCU (read-copy-update). Each thread stores a pointer to ChannelStore
-// in its local ServerState and uses it for reads. Whenever an update needs to be performed,
-// a new ChannelStore is constructed with the requested modifications and broadcasted to all
-// threads.
+// in its local ServerState and uses it for reads.
 //
-// ServerState ChannelStore* -> ChannelMap* -> atomic<SubscribeMap*> (cntx -> thread)
+// ServerState ChannelStore* -> PartitionedChannelMap -> atomic<ChannelMap*>
+//                                                    -> atomic<SubscribeMap*> (cntx -> thread)
 //
-// Specifically, whenever a new channel is registered or a channel is removed fully,
-// a new ChannelMap for the specified type (channel/pattern) needs to be constructed. However, if
-// only a single SubscribeMap is modified (no map ChannelMap slots are added or removed),
-// we can update only it with a simpler version of RCU, as SubscribeMap is stored as an atomic
-// pointer inside ChannelMap.
+// Channels and patterns are hash-partitioned into ChannelMaps. Whenever a new channel is
+// registered or a channel is removed fully, a new copy of the ChannelMap partition holding it
+// is constructed and swapped in atomically, so subscription churn copies only a small part of
+// all channels. If only a single SubscribeMap is modified (no ChannelMap slots are added or
+// removed), only it is replaced, as SubscribeMap is stored as an atomic pointer inside ChannelMap.
+// Pattern partitions also index their patterns by literal prefix, and the index is updated
+// together with the partition copy, so publishing evaluates only the candidate patterns.
 //
 // To prevent parallel (and thus overlapping) updates, a centralized ControlBlock is used.
 // Update operations are carried out by the ChannelStoreUpdater.
@@ -42,6 +45,7 @@ class SlotSet;
 // fact that no hop is required to fetch the subscribers.
 class ChannelStore {
   friend class ChannelStoreUpdater;
+  friend class ShardChannelStore;
 
  public:
   struct Subscriber : public facade::Connection::WeakRef {
@@ -61,6 +65,11 @@ class ChannelStore {
   // Send messages to channel, block on connection backpressure
   unsigned SendMessages(std::string_view channel, facade::ArgRange messages) const;
 
+  // Send messages to subscribers sorted by thread. Blocks on connection backpressure unless
+  // the messages unsubscribe the connections from channel.
+  static unsigned SendToSubscribers(std::vector<Subscriber> subscribers, std::string_view channel,
+                                    facade::ArgRange messages, bool unsubscribe = false);
+
   // Fetch all subscribers for channel, including matching patterns.
   std::vector<Subscriber> FetchSubscribers(std::string_view channel) const;
 
@@ -68,11 +77,11 @@ class ChannelStore {
 
   size_t PatternCount() const;
 
-  void UnsubscribeAfterClusterSlotMigration(const cluster::SlotSet& deleted_slots);
-
-  using ChannelsSubMap =
-      absl::flat_hash_map<std::string_view, std::vector<ChannelStore::Subscriber>>;
-  void UnsubscribeConnectionsFromDeletedSlots(const ChannelsSubMap& sub_map, uint32_t idx);
+  // Whether some channel or pattern may match keyspace notification channels. Lets the shards
+  // skip generating notifications nobody listens to.
+  static bool HasKeyspaceSubscribers() {
+    return control_block.keyspace_slots.load(std::memory_order_relaxed) > 0;
+  }
 
   // Destroy current instance and delete it.
   static void Destroy();
@@ -102,6 +111,32 @@ class ChannelStore {
     std::atomic<SubscribeMap*> ptr;
   };
 
+  // Patterns grouped by their literal prefix, the part before the first wildcard. A channel
+  // can only match the patterns whose prefix it starts with, so only those are evaluated.
+  class PatternIndex {
+   public:
+    void Add(std::string_view pattern);
+    void Remove(std::string_view pattern);
+
+    // Calls f(const std::string& pattern) for every pattern that may match channel.
+    template <typename F> void ForEachCandidate(std::string_view channel, F&& f) const {
+      for (auto [len, _] : prefix_lens_) {
+        if (len > channel.size())
+          break;
+        if (auto it = by_prefix_.find(channel.substr(0, len)); it != by_prefix_.end()) {
+          for (const std::string& pattern : it->second)
+            f(pattern);
+        }
+      }
+    }
+
+    static std::string LiteralPrefix(std::string_view pattern);
+
+   private:
+    absl::flat_hash_map<std::string, std::vector<std::string>> by_prefix_;
+    std::vector<std::pair<size_t, unsigned>> prefix_lens_;  // sorted lengths with their counts
+  };
+
   // SubscriberMaps for channels/patterns.
   struct ChannelMap : absl::flat_hash_map<std::string, UpdatablePointer> {
     void Add(std::string_view key, ConnectionContext* me, uint32_t thread_id);
@@ -109,24 +144,58 @@ class ChannelStore {
 
     // Delete all stored SubscribeMap pointers.
     void DeleteAll();
+
+    PatternIndex pattern_index;  // maintained only for the pattern partitions
+  };
+
+  // ChannelMaps partitioned by the hash of their keys. Each partition is replaced via RCU.
+  class PartitionedChannelMap {
+   public:
+    static constexpr unsigned kNumPartitions = 32;
+
+    PartitionedChannelMap();
+
+    static unsigned PartitionOf(std::string_view key);
+
+    ChannelMap* Get(unsigned idx) const;
+    void Set(unsigned idx, ChannelMap* map);
+
+    size_t Size() const;
+
+    // Delete all partitions together with their SubscribeMaps.
+    void DeleteAll();
+
+    // Calls f(key, const UpdatablePointer&) for every entry in all partitions.
+    template <typename F> void ForEach(F&& f) const {
+      for (unsigned i = 0; i < kNumPartitions; ++i) {
+        for (const auto& [key, subs] : *Get(i))
+          f(key, subs);
+      }
+    }
+
+   private:
+    std::array<std::atomic<ChannelMap*>, kNumPartitions> partitions_;
   };
 
   // Centralized controller to prevent overlaping updates.
   struct ControlBlock {
     std::atomic<ChannelStore*> most_recent;
     util::fb2::Mutex update_mu;  // locked during updates.
+
+    // Number of channel and pattern slots that may match keyspace notification channels.
+    std::atomic<uint32_t> keyspace_slots{0};
   };
 
  private:
   static ControlBlock control_block;
 
-  ChannelStore(ChannelMap* channels, ChannelMap* patterns);
-
   static void Fill(const SubscribeMap& src, const std::string& pattern,
                    std::vector<Subscriber>* out);
 
-  ChannelMap* channels_;
-  ChannelMap* patterns_;
+  static bool MayMatchKeyspaceChannel(std::string_view key, bool pattern);
+
+  PartitionedChannelMap channels_;
+  PartitionedChannelMap patterns_;
 };
 
 // Performs RCU (read-copy-update) updates to the channel store.
@@ -139,22 +208,26 @@ class ChannelStoreUpdater {
   void Record(std::string_view key);
   void Apply();
 
-  // Used for cluster when slots migrate. We need to:
-  // 1. Remove the channel from the copy.
-  // 2. Unsuscribe all the connections from each channel.
-  // 3. Update the control block pointer.
-  void ApplyAndUnsubscribe();
-
  private:
   using ChannelMap = ChannelStore::ChannelMap;
+  using PartitionedChannelMap = ChannelStore::PartitionedChannelMap;
 
-  // Get target map and flag whether it was copied.
+  // Get the partition of key to modify, copying it if a slot will be added or removed.
   // Must be called with locked control block.
-  std::pair<ChannelMap*, bool> GetTargetMap(ChannelStore* store);
+  ChannelMap* GetTargetMap(const PartitionedChannelMap& src, std::string_view key);
+
+  // Get the private copy of partition idx, creating it on first use.
+  ChannelMap* CopyPartition(const PartitionedChannelMap& src, unsigned idx);
 
   // Apply modify operation to target map.
   void Modify(ChannelMap* target, std::string_view key);
 
+  // Swap copied partitions into dst. Must be called with locked control block.
+  void PublishCopies(PartitionedChannelMap* dst);
+
+  // Delete replaced partitions and SubscribeMaps once no thread can reference them anymore.
+  void FreeReplaced();
+
  private:
   bool pattern_;
   bool to_add_;
@@ -164,8 +237,42 @@ class ChannelStoreUpdater {
   // Pending operations.
   std::vector<std::string_view> ops_;
 
-  // Replaced SubscribeMaps that need to be deleted safely.
+  // Partitions copied by this update, keyed by partition index.
+  absl::flat_hash_map<unsigned, ChannelMap*> copies_;
+
+  // Replaced partitions and SubscribeMaps that need to be deleted safely.
+  std::vector<ChannelMap*> replaced_partitions_;
   std::vector<ChannelStore::SubscribeMap*> freelist_;
 };
 
+// ShardChannelStore manages sharded PUB/SUB subscriptions (SSUBSCRIBE/SPUBLISH).
+//
+// Each shard thread keeps the subscribers of the shard channels it owns, so publishing and
+// subscribing touch only the shard owning the channel instead of the global ChannelStore.
+// The store is accessed only from its shard thread and needs no synchronization.
+class ShardChannelStore {
+ public:
+  using Subscriber = ChannelStore::Subscriber;
+
+  // (Un)subscribe cntx to channels on their owning shards. Waits for the shards to apply it.
+  static void Change(bool to_add, absl::Span<const std::string_view> channels,
+                     ConnectionContext* cntx, uint32_t thread_id);
+
+  // Send messages to the subscribers registered on the shard owning channel.
+  static unsigned SendMessages(std::string_view channel, facade::ArgRange messages);
+
+  static std::vector<Subscriber> FetchSubscribers(std::string_view channel);
+
+  static std::vector<std::string> ListChannels(std::string_view pattern);
+
+  // Remove channels of deleted slots from all shards and unsubscribe their subscribers.
+  static void UnsubscribeSlots(const cluster::SlotSet& deleted_slots);
+
+ private:
+  // Store of the calling shard thread.
+  static ShardChannelStore* tlocal();
+
+  absl::flat_hash_map<std::string, ChannelStore::SubscribeMap> channels_;
+};
+
 }  // namespace dfly
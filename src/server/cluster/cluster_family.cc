@@ -4,8 +4,10 @@
 
 #include "server/cluster/cluster_family.h"
 
+#include <algorithm>
 #include <memory>
 #include <mutex>
+#include <numeric>
 #include <string>
 
 #include "absl/cleanup/cleanup.h"
@@ -16,6 +18,8 @@
 #include "facade/error.h"
 #include "server/acl/acl_commands_def.h"
 #include "server/channel_store.h"
+#include "server/cluster/cluster_utility.h"
+#include "server/cluster/multi_key_proxy.h"
 #include "server/command_registry.h"
 #include "server/conn_context.h"
 #include "server/dflycmd.h"
@@ -97,6 +101,8 @@ void ClusterFamily::Shutdown() {
       DCHECK(incoming_migrations_jobs_.empty());
     }
   });
+
+  shard_set->pool()->AwaitFiberOnAll([](auto*) { CloseProxyConnections(); });
 }
 
 std::optional<ClusterShardInfos> ClusterFamily::GetShardInfos(ConnectionContext* cntx) const {
@@ -472,6 +478,8 @@ void ClusterFamily::DflyCluster(CmdArgList args, const CommandContext& cmd_cntx)
     return DflyClusterFlushSlots(args, builder);
   } else if (sub_cmd == "SLOT-MIGRATION-STATUS") {
     return DflySlotMigrationStatus(args, builder);
+  } else if (sub_cmd == "SLOT-STATS") {
+    return DflyClusterSlotStats(args, builder);
   }
 
   return builder->SendError(UnknownSubCmd(sub_cmd, "DFLYCLUSTER"), kSyntaxErrType);
@@ -497,9 +505,7 @@ void DeleteSlots(const SlotRanges& slots_ranges) {
   };
   shard_set->pool()->AwaitFiberOnAll(std::move(cb));
 
-  auto* channel_store = ServerState::tlocal()->channel_store();
-  auto deleted = SlotSet(slots_ranges);
-  channel_store->UnsubscribeAfterClusterSlotMigration(deleted);
+  ShardChannelStore::UnsubscribeSlots(SlotSet(slots_ranges));
 }
 
 void WriteFlushSlotsToJournal(const SlotRanges& slot_ranges) {
@@ -674,11 +680,97 @@ void ClusterFamily::DflyClusterGetSlotInfo(CmdArgList args, SinkReplyBuilder* bu
     rb->SendLong(slot_data.second.total_writes);
 
     // Account for both the values and the table space of the entries.
-    // Each entry is comprised from CompactObj for key and CompactObj for value.
-    // Sometimes the values are very small and table space becomes significant.
     rb->SendBulkString("memory_bytes");
-    rb->SendLong(slot_data.second.memory_bytes +
-                 slot_data.second.key_count * sizeof(CompactObj) * 2);
+    rb->SendLong(SlotMemoryUsage(slot_data.second));
+  }
+}
+
+// DFLYCLUSTER SLOT-STATS SLOTSRANGE <start> <end>
+// DFLYCLUSTER SLOT-STATS ORDERBY <metric> [LIMIT <n>] [ASC|DESC]
+void ClusterFamily::DflyClusterSlotStats(CmdArgList args, SinkReplyBuilder* builder) {
+  enum class Metric { kKeyCount, kMemory, kOps, kReads, kWrites, kBytesIn, kBytesOut };
+  auto metric_of = [](const SlotStats& stats, Metric metric) -> uint64_t {
+    switch (metric) {
+      case Metric::kKeyCount:
+        return stats.key_count;
+      case Metric::kMemory:
+        return SlotMemoryUsage(stats);
+      case Metric::kOps:
+        return stats.ops_per_sec;
+      case Metric::kReads:
+        return stats.total_reads;
+      case Metric::kWrites:
+        return stats.total_writes;
+      case Metric::kBytesIn:
+        return stats.bytes_in;
+      case Metric::kBytesOut:
+        return stats.bytes_out;
+    }
+    return 0;
+  };
+
+  CmdArgParser parser(args);
+  SlotId start = 0, end = 0;
+  optional<Metric> order_by;
+  uint32_t limit = 16;
+  bool desc = true;
+
+  if (parser.Check("SLOTSRANGE")) {
+    std::tie(start, end) = parser.Next<SlotId, SlotId>();
+    if (!parser.HasError() && (start > end || end > kMaxSlotNum))
+      return builder->SendError("Invalid slot range");
+  } else {
+    parser.ExpectTag("ORDERBY");
+    order_by = parser.MapNext("KEY_COUNT", Metric::kKeyCount, "MEMORY_BYTES", Metric::kMemory,
+                              "OPS_PER_SEC", Metric::kOps, "TOTAL_READS", Metric::kReads,
+                              "TOTAL_WRITES", Metric::kWrites, "BYTES_IN", Metric::kBytesIn,
+                              "BYTES_OUT", Metric::kBytesOut);
+    while (parser.HasNext()) {
+      if (parser.Check("LIMIT", &limit))
+        continue;
+      desc = parser.MapNext("DESC", true, "ASC", false);
+    }
+  }
+
+  if (!parser.Finalize())
+    return builder->SendError(parser.Error()->MakeReply());
+
+  vector<SlotStats> stats = GetAllSlotStats();
+  vector<SlotId> slots;
+  if (order_by) {
+    slots.resize(stats.size());
+    std::iota(slots.begin(), slots.end(), 0);
+    // Ties are ordered by slot id.
+    std::stable_sort(slots.begin(), slots.end(), [&](SlotId a, SlotId b) {
+      uint64_t va = metric_of(stats[a], *order_by), vb = metric_of(stats[b], *order_by);
+      return desc ? va > vb : va < vb;
+    });
+    slots.resize(std::min<size_t>(slots.size(), limit));
+  } else {
+    for (size_t sid = start; sid <= end; ++sid)
+      slots.push_back(sid);
+  }
+
+  auto* rb = static_cast<RedisReplyBuilder*>(builder);
+  rb->StartArray(slots.size());
+  for (SlotId sid : slots) {
+    const SlotStats& slot_stats = stats[sid];
+    rb->StartArray(15);
+    rb->SendLong(sid);
+    rb->SendBulkString("key_count");
+    rb->SendLong(slot_stats.key_count);
+    rb->SendBulkString("total_reads");
+    rb->SendLong(slot_stats.total_reads);
+    rb->SendBulkString("total_writes");
+    rb->SendLong(slot_stats.total_writes);
+    rb->SendBulkString("memory_bytes");
+    rb->SendLong(SlotMemoryUsage(slot_stats));
+    rb->SendBulkString("ops_per_sec");
+    rb->SendLong(slot_stats.ops_per_sec);
+    rb->SendBulkString("bytes_in");
+    rb->SendLong(slot_stats.bytes_in);
+    rb->SendBulkString("bytes_out");
+    rb->SendLong(slot_stats.bytes_out);
   }
 }
 
@@ -1018,7 +1110,8 @@ void ClusterFamily::ApplyMigrationSlotRangeToConfig(std::string_view node_id,
     return moved ? OpStatus::KEY_MOVED : OpStatus::OK;
   };
   // we don't need to use DispatchTracker here because for IncomingMingration we don't have
-  // connectionas that should be tracked and for Outgoing migration we do it under Pause
+  // connectionas that should be tracked and for Outgoing migration commands on the migrated slots
+  // are fenced by OutgoingMigration::FinalizeMigration
   server_family_->service().proactor_pool().AwaitFiberOnAll(
       [this, &new_config, &blocking_filter](util::ProactorBase*) {
         server_family_->CancelBlockingOnThread(blocking_filter);
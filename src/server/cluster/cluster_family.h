@@ -68,6 +68,7 @@ class ClusterFamily {
   void DflyClusterGetSlotInfo(CmdArgList args, SinkReplyBuilder* builder)
       ABSL_LOCKS_EXCLUDED(migration_mu_);
   void DflyClusterFlushSlots(CmdArgList args, SinkReplyBuilder* builder);
+  void DflyClusterSlotStats(CmdArgList args, SinkReplyBuilder* builder);
 
  private:  // Slots migration section
   void DflySlotMigrationStatus(CmdArgList args, SinkReplyBuilder* builder)
@@ -507,6 +507,35 @@ TEST_F(ClusterFamilyTest, ClusterGetSlotInfo) {
                                 "total_writes", IntArg(2), "memory_bytes", IntArg(36))))));
 }
 
+TEST_F(ClusterFamilyTest, ClusterSlotStats) {
+  ConfigSingleNodeCluster(GetMyId());
+
+  constexpr string_view kKey = "some-key";
+  const SlotId slot = KeySlot(kKey);
+  const string value(1'000, '#');
+  EXPECT_EQ(Run({"SET", kKey, value}), "OK");
+  EXPECT_EQ(Run({"GET", kKey}), value);
+
+  EXPECT_THAT(RunPrivileged({"dflycluster", "slot-stats", "slotsrange", absl::StrCat(slot),
+                             absl::StrCat(slot)}),
+              RespArray(ElementsAre(IntArg(slot), "key_count", IntArg(1), "total_reads", IntArg(1),
+                                    "total_writes", IntArg(1), "memory_bytes", Not(IntArg(0)),
+                                    "ops_per_sec", _, "bytes_in", Not(IntArg(0)), "bytes_out",
+                                    Not(IntArg(0)))));
+
+  auto resp = RunPrivileged({"dflycluster", "slot-stats", "orderby", "bytes_out", "limit", "2"});
+  ASSERT_THAT(resp, RespArray(ElementsAre(RespArray(ElementsAre(IntArg(slot), _, _, _, _, _, _, _,
+                                                                _, _, _, _, _, _, _)),
+                                          RespArray(ElementsAre(Not(IntArg(slot)), _, _, _, _, _,
+                                                                _, _, _, _, _, _, _, "bytes_out",
+                                                                IntArg(0)))))));
+
+  EXPECT_THAT(RunPrivileged({"dflycluster", "slot-stats", "orderby", "bytes"}),
+              ErrArg("syntax error"));
+  EXPECT_THAT(RunPrivileged({"dflycluster", "slot-stats", "slotsrange", "2", "1"}),
+              ErrArg("Invalid slot range"));
+}
+
 TEST_F(ClusterFamilyTest, ClusterSlotsPopulate) {
   ConfigSingleNodeCluster(GetMyId());
 
@@ -741,6 +770,22 @@ TEST_F(ClusterFamilyTest, FlushSlots) {
                                                   _, "total_writes", _, "memory_bytes", _)))));
 }
 
+TEST_F(ClusterFamilyTest, FlushSlotsWithSlotIndex) {
+  SetTestFlag("cluster_slot_index", "true");
+  ResetService();
+
+  EXPECT_EQ(Run({"debug", "populate", "1000", "key", "4", "slots", "0", "1"}), "OK");
+  EXPECT_EQ(RunPrivileged({"dflycluster", "flushslots", "0", "0"}), "OK");
+
+  auto slot_keys = [&](string_view slot) {
+    auto resp = RunPrivileged({"dflycluster", "getslotinfo", "slots", slot});
+    return resp.GetVec()[2].GetInt().value_or(-1);
+  };
+  ExpectConditionWithinTimeout([&] { return slot_keys("0") == 0; });
+  EXPECT_GT(slot_keys("1"), 0);
+  EXPECT_EQ(CheckedInt({"dbsize"}), slot_keys("1"));
+}
+
 TEST_F(ClusterFamilyTest, FlushSlotsAndImmediatelySetValue) {
   for (int count : {1, 10, 100, 1000, 10000, 100000}) {
     ConfigSingleNodeCluster(GetMyId());
@@ -785,6 +830,18 @@ TEST_F(ClusterFamilyTest, ClusterCrossSlot) {
   EXPECT_THAT(Run({"MGET", "key{tag}", "key2{tag}"}), RespArray(ElementsAre("value", "value2")));
 }
 
+TEST_F(ClusterFamilyTest, ClusterProxyMultiKeyLocal) {
+  SetTestFlag("cluster_proxy_multi_key", "true");
+  ConfigSingleNodeCluster(GetMyId());
+
+  EXPECT_EQ(Run({"MSET", "key", "value", "key2", "value2"}), "OK");
+  EXPECT_THAT(Run({"MGET", "key", "missing", "key2"}),
+              RespArray(ElementsAre("value", ArgType(RespExpr::NIL), "value2")));
+
+  // Only MGET and MSET are proxied.
+  EXPECT_THAT(Run({"DEL", "key", "key2"}), ErrArg("CROSSSLOT"));
+}
+
 class ClusterFamilyEmulatedTest : public ClusterFamilyTest {
  public:
   ClusterFamilyEmulatedTest() {
@@ -4,9 +4,12 @@
 
 #include "server/cluster/cluster_utility.h"
 
+#include <algorithm>
+
 #include "server/cluster/cluster_defs.h"
 #include "server/engine_shard_set.h"
 #include "server/namespaces.h"
+#include "server/server_state.h"
 
 using namespace std;
 
@@ -35,4 +38,54 @@ uint64_t GetKeyCount(const SlotRanges& slots) {
   return keys.load();
 }
 
+vector<SlotStats> GetAllSlotStats() {
+  vector<SlotStats> res(kMaxSlotNum + 1);
+  util::fb2::Mutex mu;
+
+  shard_set->pool()->AwaitFiberOnAll([&](auto*) {
+    EngineShard* shard = EngineShard::tlocal();
+    DbSlice* db_slice =
+        shard ? &namespaces->GetDefaultNamespace().GetDbSlice(shard->shard_id()) : nullptr;
+    const ServerState::SlotTraffic* traffic = ServerState::tlocal()->slot_traffic();
+
+    util::fb2::LockGuard lk(mu);
+    for (size_t sid = 0; sid <= kMaxSlotNum; ++sid) {
+      if (db_slice)
+        res[sid] += db_slice->GetSlotStats(sid);
+      if (traffic) {
+        res[sid].bytes_in += traffic[sid].bytes_in;
+        res[sid].bytes_out += traffic[sid].bytes_out;
+      }
+    }
+  });
+
+  return res;
+}
+
+uint64_t SlotMemoryUsage(const SlotStats& stats) {
+  // Each entry is comprised from CompactObj for key and CompactObj for value.
+  // Sometimes the values are very small and table space becomes significant.
+  return stats.memory_bytes + stats.key_count * sizeof(CompactObj) * 2;
+}
+
+vector<pair<SlotId, SlotStats>> GetBusiestSlots(size_t limit) {
+  vector<SlotStats> stats = GetAllSlotStats();
+  vector<pair<SlotId, SlotStats>> res;
+  for (size_t sid = 0; sid <= kMaxSlotNum; ++sid) {
+    if (stats[sid].ops_per_sec > 0)
+      res.emplace_back(sid, stats[sid]);
+  }
+
+  auto busier = [](const auto& a, const auto& b) {
+    return a.second.ops_per_sec > b.second.ops_per_sec;
+  };
+  if (res.size() > limit) {
+    partial_sort(res.begin(), res.begin() + limit, res.end(), busier);
+    res.resize(limit);
+  } else {
+    sort(res.begin(), res.end(), busier);
+  }
+  return res;
+}
+
 }  // namespace dfly::cluster
@@ -4,10 +4,25 @@
 
 #pragma once
 
+#include <utility>
+#include <vector>
+
 #include "server/cluster/cluster_defs.h"
+#include "server/table.h"
 
 namespace dfly::cluster {
 
 uint64_t GetKeyCount(const SlotRanges& slots);
 
+// Returns the stats of all slots, aggregated over the shards and the traffic counted by all
+// threads. Indexed by slot id.
+std::vector<SlotStats> GetAllSlotStats();
+
+// Estimated memory of the slot, including the table space of its entries.
+uint64_t SlotMemoryUsage(const SlotStats& stats);
+
+// Returns up to `limit` slots with the highest rate of operations, busiest first. Slots
+// without operations are omitted.
+std::vector<std::pair<SlotId, SlotStats>> GetBusiestSlots(size_t limit);
+
 }  // namespace dfly::cluster
@@ -149,6 +149,13 @@ class ClusterShardMigration {
       return {};
     }
 
+    for (auto& cmd : tx_data.batch) {
+      if (executor_.Execute(tx_data.dbid, cmd) == facade::DispatchResult::OOM)
+        return make_error_code(errc::not_enough_memory);
+    }
+    if (!tx_data.batch.empty())
+      return {};
+
     if (!tx_data.IsGlobalCmd()) {
       facade::DispatchResult res = executor_.Execute(tx_data.dbid, tx_data.command);
       return res == facade::DispatchResult::OOM ? make_error_code(errc::not_enough_memory)
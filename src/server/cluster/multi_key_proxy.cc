@@ -0,0 +1,277 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/cluster/multi_key_proxy.h"
+
+#include <absl/container/btree_map.h>
+#include <absl/container/flat_hash_map.h>
+#include <absl/strings/str_cat.h>
+
+#include "base/flags.h"
+#include "base/logging.h"
+#include "facade/error.h"
+#include "server/cluster/cluster_config.h"
+#include "server/command_registry.h"
+#include "server/protocol_client.h"
+#include "util/fibers/fibers.h"
+
+ABSL_FLAG(bool, cluster_proxy_multi_key, false,
+          "In cluster mode, serve MGET and MSET whose keys belong to slots of several nodes by "
+          "forwarding the keys of every slot to its owner, instead of failing with CROSSSLOT or "
+          "MOVED. The parts are not atomic together. Peers are accessed with --masteruser and "
+          "--masterauth.");
+
+namespace dfly::cluster {
+
+using namespace std;
+using namespace facade;
+using namespace util;
+
+namespace {
+
+constexpr chrono::milliseconds kConnectTimeout{2000};
+
+// Reply to the part of the command with the keys of a single slot.
+struct PartReply {
+  optional<string> error;
+  vector<optional<string>> values;  // MGET only
+};
+
+// Connection to another node of the cluster that forwards parts of commands to it.
+class PeerConnection : public ProtocolClient {
+ public:
+  PeerConnection(string host, uint16_t port) : ProtocolClient(std::move(host), port) {
+  }
+
+  // Pipelines the commands and returns their replies.
+  io::Result<vector<PartReply>> Execute(const vector<CmdArgVec>& cmds);
+
+  string Description() const {
+    return server().Description();
+  }
+
+ private:
+  error_code Connect();
+
+  bool connected_ = false;
+  base::IoBuf buf_{1024};
+};
+
+error_code PeerConnection::Connect() {
+  if (connected_)
+    return {};
+
+  if (error_code ec = ResolveHostDns(); ec)
+    return ec;
+  if (error_code ec = ConnectAndAuth(kConnectTimeout, &exec_st_); ec)
+    return ec;
+  connected_ = true;
+  return {};
+}
+
+io::Result<vector<PartReply>> PeerConnection::Execute(const vector<CmdArgVec>& cmds) {
+  if (error_code ec = Connect(); ec)
+    return nonstd::make_unexpected(ec);
+
+  // Commands are sent as RESP arrays, so that keys and values may hold any bytes.
+  string out;
+  for (const CmdArgVec& cmd : cmds) {
+    absl::StrAppend(&out, "*", cmd.size(), "\r\n");
+    for (string_view arg : cmd)
+      absl::StrAppend(&out, "$", arg.size(), "\r\n", arg, "\r\n");
+  }
+  if (error_code ec = Sock()->Write(io::Buffer(out)); ec)
+    return nonstd::make_unexpected(ec);
+  TouchIoTime();
+
+  vector<PartReply> replies(cmds.size());
+  for (PartReply& reply : replies) {
+    io::Result<ReadRespRes> res = ReadRespReply(&buf_, false);
+    if (!res)
+      return nonstd::make_unexpected(res.error());
+
+    const RespVec& args = LastResponseArgs();
+    if (!args.empty() && args.front().type == RespExpr::ERROR) {
+      reply.error = absl::StrCat("-", args.front().GetView());
+    } else {
+      // Arrays are flattened by the parser, MSET replies with a single status.
+      for (const RespExpr& arg : args) {
+        if (arg.type == RespExpr::NIL)
+          reply.values.emplace_back();
+        else if (arg.type == RespExpr::STRING)
+          reply.values.emplace_back(arg.GetString());
+      }
+    }
+    buf_.ConsumeInput(res->left_in_buffer);
+  }
+  return replies;
+}
+
+// Idle connections of this thread by node address.
+thread_local absl::flat_hash_map<string, vector<unique_ptr<PeerConnection>>> tl_peer_pool;
+
+unique_ptr<PeerConnection> AcquireConnection(const ClusterNodeInfo& node) {
+  auto& idle = tl_peer_pool[absl::StrCat(node.ip, ":", node.port)];
+  if (idle.empty())
+    return make_unique<PeerConnection>(node.ip, node.port);
+
+  unique_ptr<PeerConnection> conn = std::move(idle.back());
+  idle.pop_back();
+  return conn;
+}
+
+void ReleaseConnection(const ClusterNodeInfo& node, unique_ptr<PeerConnection> conn) {
+  tl_peer_pool[absl::StrCat(node.ip, ":", node.port)].push_back(std::move(conn));
+}
+
+PartReply ToPartReply(CapturingReplyBuilder::Payload&& payload) {
+  PartReply reply;
+  if (auto err = CapturingReplyBuilder::TryExtractError(payload); err) {
+    reply.error = string{err->first};
+    return reply;
+  }
+
+  if (auto* arr = get_if<unique_ptr<CapturingReplyBuilder::CollectionPayload>>(&payload); arr) {
+    for (auto& elem : (*arr)->arr) {
+      if (auto* str = get_if<CapturingReplyBuilder::BulkString>(&elem); str)
+        reply.values.emplace_back(std::move(*str));
+      else
+        reply.values.emplace_back();
+    }
+  } else if (auto* str = get_if<CapturingReplyBuilder::BulkString>(&payload); str) {
+    // MGET of a single key.
+    reply.values.emplace_back(std::move(*str));
+  } else if (holds_alternative<CapturingReplyBuilder::Null>(payload)) {
+    reply.values.emplace_back();
+  }
+  return reply;
+}
+
+}  // namespace
+
+bool ShouldProxyMultiKey(const CommandId* cid, const ErrorReply& ownership_error) {
+  if (!absl::GetFlag(FLAGS_cluster_proxy_multi_key) || !ClusterConfig::Current())
+    return false;
+  if (cid->name() != "MGET" && cid->name() != "MSET")
+    return false;
+  return ownership_error.kind == "MOVED" || ownership_error.ToSv() == kCrossSlotError;
+}
+
+void ProxyMultiKey(const CommandId* cid, CmdArgList args, LocalDispatch local,
+                   RedisReplyBuilder* rb) {
+  const bool is_mget = cid->name() == "MGET";
+  const size_t step = is_mget ? 1 : 2;
+  auto config = ClusterConfig::Current();
+  DCHECK(config);
+
+  // Keys of each slot, in the order of the command.
+  absl::btree_map<SlotId, vector<size_t>> slot_keys;
+  for (size_t i = 0; i < args.size(); i += step)
+    slot_keys[KeySlot(args[i])].push_back(i);
+
+  struct Part {
+    SlotId slot;
+    CmdArgVec cmd;
+    PartReply reply;
+  };
+
+  auto make_part = [&](SlotId slot, const vector<size_t>& keys) {
+    Part part{slot, {cid->name()}, {}};
+    for (size_t i : keys)
+      part.cmd.insert(part.cmd.end(), args.begin() + i, args.begin() + i + step);
+    return part;
+  };
+
+  vector<Part> local_parts;
+  absl::btree_map<string, pair<ClusterNodeInfo, vector<Part>>> remote_parts;
+  for (const auto& [slot, keys] : slot_keys) {
+    if (config->IsMySlot(slot)) {
+      local_parts.push_back(make_part(slot, keys));
+    } else {
+      ClusterNodeInfo node = config->GetMasterNodeForSlot(slot);
+      auto& [info, parts] = remote_parts[node.id];
+      info = node;
+      parts.push_back(make_part(slot, keys));
+    }
+  }
+
+  // Forward to every node in parallel while the local parts run.
+  vector<fb2::Fiber> fibers;
+  for (auto& [id, node_parts] : remote_parts) {
+    fibers.emplace_back("proxy_multi_key", [&node_parts = node_parts] {
+      auto& [node, parts] = node_parts;
+      vector<CmdArgVec> cmds;
+      for (const Part& part : parts)
+        cmds.push_back(part.cmd);
+
+      unique_ptr<PeerConnection> conn = AcquireConnection(node);
+      io::Result<vector<PartReply>> replies = conn->Execute(cmds);
+      if (!replies) {
+        LOG_EVERY_T(WARNING, 1) << "Could not forward keys to " << conn->Description() << ": "
+                                << replies.error().message();
+        string error = absl::StrCat("Could not forward keys to ", node.ip, ":", node.port);
+        for (Part& part : parts)
+          part.reply.error = error;
+        return;  // the connection is dropped
+      }
+
+      for (size_t i = 0; i < parts.size(); ++i)
+        parts[i].reply = std::move((*replies)[i]);
+      ReleaseConnection(node, std::move(conn));
+    });
+  }
+
+  for (Part& part : local_parts)
+    part.reply = ToPartReply(local(part.cmd));
+
+  for (fb2::Fiber& fiber : fibers)
+    fiber.Join();
+
+  // Assemble the reply in the order of the keys.
+  vector<optional<string>> values(is_mget ? args.size() : 0);
+  auto collect = [&](Part& part) -> optional<string> {
+    if (part.reply.error)
+      return std::move(part.reply.error);
+    if (!is_mget)
+      return nullopt;
+
+    const vector<size_t>& keys = slot_keys[part.slot];
+    if (part.reply.values.size() != keys.size())
+      return string{"Unexpected reply from a cluster node"};
+    for (size_t i = 0; i < keys.size(); ++i)
+      values[keys[i]] = std::move(part.reply.values[i]);
+    return nullopt;
+  };
+
+  optional<string> error;
+  for (Part& part : local_parts) {
+    if (auto err = collect(part); err && !error)
+      error = std::move(err);
+  }
+  for (auto& [id, node_parts] : remote_parts) {
+    for (Part& part : node_parts.second) {
+      if (auto err = collect(part); err && !error)
+        error = std::move(err);
+    }
+  }
+
+  if (error)
+    return rb->SendError(*error);
+  if (!is_mget)
+    return rb->SendOk();
+
+  RedisReplyBuilder::ArrayScope scope{rb, values.size()};
+  for (const optional<string>& value : values) {
+    if (value)
+      rb->SendBulkString(*value);
+    else
+      rb->SendNull();
+  }
+}
+
+void CloseProxyConnections() {
+  tl_peer_pool.clear();
+}
+
+}  // namespace dfly::cluster
@@ -0,0 +1,35 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/functional/function_ref.h>
+
+#include "facade/facade_types.h"
+#include "facade/reply_capture.h"
+
+namespace dfly {
+class CommandId;
+}  // namespace dfly
+
+namespace dfly::cluster {
+
+// Serves MGET and MSET whose keys belong to slots of several nodes (--cluster_proxy_multi_key).
+// The command is split into parts with the keys of a single slot. Parts of the local slots are
+// executed by `local`, the others are pipelined to the nodes that own them over pooled
+// connections, and the replies are assembled into a single reply. The parts are not atomic
+// together.
+
+// Whether the command must be proxied once it failed the keys ownership check.
+bool ShouldProxyMultiKey(const CommandId* cid, const facade::ErrorReply& ownership_error);
+
+using LocalDispatch = absl::FunctionRef<facade::CapturingReplyBuilder::Payload(facade::ArgSlice)>;
+
+void ProxyMultiKey(const CommandId* cid, facade::CmdArgList args, LocalDispatch local,
+                   facade::RedisReplyBuilder* rb);
+
+// Closes the pooled connections of the calling thread, must be called on shutdown.
+void CloseProxyConnections();
+
+}  // namespace dfly::cluster
@@ -12,6 +12,7 @@
 #include "base/logging.h"
 #include "cluster_family.h"
 #include "cluster_utility.h"
+#include "facade/dragonfly_listener.h"
 #include "facade/socket_utils.h"
 #include "server/db_slice.h"
 #include "server/engine_shard_set.h"
@@ -19,6 +20,7 @@
 #include "server/journal/streamer.h"
 #include "server/main_service.h"
 #include "server/server_family.h"
+#include "server/server_state.h"
 #include "util/fibers/synchronization.h"
 
 ABSL_FLAG(int, slot_migration_connection_timeout_ms, 2000,
@@ -26,6 +28,8 @@ ABSL_FLAG(int, slot_migration_connection_timeout_ms, 2000,
 ABSL_FLAG(int, migration_finalization_timeout_ms, 30000,
           "Timeout for migration finalization operation");
 
+ABSL_DECLARE_FLAG(uint32_t, pause_wait_timeout);
+
 using namespace std;
 using namespace facade;
 using namespace util;
@@ -328,17 +332,30 @@ bool OutgoingMigration::FinalizeMigration(long attempt) {
     }
   }
 
-  // Migration finalization has to be done via client pause because commands need to
-  // be blocked on coordinator level to avoid intializing transactions with stale cluster slot info
-  // TODO implement blocking on migrated slots only
-  bool is_block_active = true;
-  auto is_pause_in_progress = [&is_block_active] { return is_block_active; };
-  auto pause_fb_opt =
-      dfly::Pause(server_family_->GetNonPriviligedListeners(), &namespaces->GetDefaultNamespace(),
-                  nullptr, ClientPause::ALL, is_pause_in_progress);
-
-  DCHECK(pause_fb_opt);
-  if (!pause_fb_opt) {
+  // Commands on the migrated slots need to be blocked on coordinator level to avoid initializing
+  // transactions with stale cluster slot info, so they wait until the target acknowledges the
+  // final data and the slots are removed from our config. Commands on other slots keep running.
+  // Exclude commands already waiting on the slots and blocked ones, as in client pause.
+  auto finalizing_slots = make_shared<const SlotSet>(migration_info_.slot_ranges);
+  facade::DispatchTracker tracker{server_family_->GetNonPriviligedListeners(), nullptr,
+                                  true /* ignore paused commands */, true /*ignore blocking*/};
+  shard_set->pool()->AwaitFiberOnAll([&tracker, &finalizing_slots](unsigned, ProactorBase*) {
+    tracker.TrackOnThread();
+    ServerState::tlocal()->StartSlotsFinalization(finalizing_slots);
+  });
+
+  auto* ns = &namespaces->GetDefaultNamespace();
+  absl::Cleanup cleanup([&finalizing_slots, ns]() {
+    shard_set->pool()->AwaitFiberOnAll([&finalizing_slots](unsigned, ProactorBase*) {
+      ServerState::tlocal()->EndSlotsFinalization(finalizing_slots);
+    });
+    shard_set->RunBriefInParallel(
+        [ns](EngineShard* shard) { ns->GetDbSlice(shard->shard_id()).SetExpireAllowed(true); });
+  });
+
+  // Wait for the commands that started before the fence to finish.
+  const absl::Duration dispatch_timeout = absl::Seconds(absl::GetFlag(FLAGS_pause_wait_timeout));
+  if (!tracker.Wait(dispatch_timeout)) {
     auto err = absl::StrCat("Migration finalization time out ", cf_->MyID(), " : ",
                             migration_info_.node_info.id, " attempt ", attempt);
 
@@ -346,12 +363,9 @@ bool OutgoingMigration::FinalizeMigration(long attempt) {
     SetLastError(std::move(err));
   }
 
-  absl::Cleanup cleanup([&is_block_active, &pause_fb_opt]() {
-    if (pause_fb_opt) {
-      is_block_active = false;
-      pause_fb_opt->JoinIfNeeded();
-    }
-  });
+  // Keys of the migrated slots must not expire while their final state is sent.
+  shard_set->RunBriefInParallel(
+      [ns](EngineShard* shard) { ns->GetDbSlice(shard->shard_id()).SetExpireAllowed(false); });
 
   LOG(INFO) << "FINALIZE flows for " << cf_->MyID() << " : " << migration_info_.node_info.id;
   OnAllShards([attempt](auto& migration) { migration->Finalize(attempt); });
@@ -0,0 +1,180 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+// In-process benchmarks of the full command path: dispatch, transaction scheduling, execution
+// in the shards and the reply. Run with --bench, the tests only check that the benchmarked
+// commands succeed.
+
+#include "absl/strings/str_cat.h"
+#include "base/gtest.h"
+#include "base/logging.h"
+#include "facade/facade_test.h"
+#include "server/test_utils.h"
+
+ABSL_DECLARE_FLAG(uint32_t, num_shards);
+
+using namespace testing;
+using namespace std;
+using namespace util;
+
+namespace dfly {
+
+namespace {
+
+constexpr unsigned kNumKeys = 10000;
+constexpr string_view kScript = "return redis.call('GET', KEYS[1])";
+
+string Key(unsigned i) {
+  return absl::StrCat("key:", i % kNumKeys);
+}
+
+// Builds the arguments of the i-th command of a benchmark.
+using CmdBuilder = std::function<vector<string>(unsigned i)>;
+
+CmdBuilder GetCmd() {
+  return [](unsigned i) { return vector<string>{"GET", Key(i)}; };
+}
+
+CmdBuilder SetCmd() {
+  return [](unsigned i) { return vector<string>{"SET", Key(i), string(32, 'v')}; };
+}
+
+CmdBuilder HSetCmd() {
+  return [](unsigned i) {
+    return vector<string>{"HSET", Key(i % 100), absl::StrCat("field", i), "value"};
+  };
+}
+
+CmdBuilder ZAddCmd() {
+  return [](unsigned i) {
+    return vector<string>{"ZADD", Key(i % 100), absl::StrCat(i), absl::StrCat("member", i)};
+  };
+}
+
+CmdBuilder LPushCmd() {
+  return [](unsigned i) { return vector<string>{"LPUSH", Key(i % 100), "value"}; };
+}
+
+CmdBuilder EvalShaCmd(string sha) {
+  return [sha = std::move(sha)](unsigned i) {
+    return vector<string>{"EVALSHA", sha, "1", Key(i)};
+  };
+}
+
+CmdBuilder MGetCmd() {
+  return [](unsigned i) {
+    vector<string> args{"MGET"};
+    for (unsigned j = 0; j < 100; ++j)
+      args.push_back(Key(i + j * 97));
+    return args;
+  };
+}
+
+}  // namespace
+
+class CommandBenchTest : public BaseFamilyTest {
+ public:
+  CommandBenchTest() = default;
+
+  // Starts a service with the given number of shards for a benchmark.
+  explicit CommandBenchTest(unsigned num_shards) {
+    num_threads_ = num_shards + 1;
+    absl::SetFlag(&FLAGS_num_shards, num_shards);
+    SetUpTestSuite();
+    SetUp();
+  }
+
+  void Stop() {
+    TearDown();
+  }
+
+  // Fills the keys read by GET, MGET and EVALSHA.
+  void Populate() {
+    Run({"DEBUG", "POPULATE", absl::StrCat(kNumKeys), "key", "32"});
+  }
+
+  string LoadScript() {
+    return Run({"SCRIPT", "LOAD", kScript}).GetString();
+  }
+
+  void RunCmd(const CmdBuilder& builder, unsigned i) {
+    vector<string> args = builder(i);
+    Run(absl::MakeSpan(args));
+  }
+
+  void TestBody() override {
+  }
+
+  using BaseFamilyTest::Run;
+};
+
+TEST_F(CommandBenchTest, Commands) {
+  Populate();
+  for (const CmdBuilder& builder : {GetCmd(), SetCmd(), HSetCmd(), ZAddCmd(), LPushCmd(),
+                                    EvalShaCmd(LoadScript())}) {
+    vector<string> args = builder(1);
+    EXPECT_THAT(Run(absl::MakeSpan(args)), Not(ArgType(RespExpr::ERROR))) << args[0];
+  }
+
+  vector<string> args = MGetCmd()(1);
+  EXPECT_THAT(Run(absl::MakeSpan(args)), ArrLen(100));
+}
+
+static void RunBench(benchmark::State& state, const CmdBuilder& builder) {
+  CommandBenchTest bench(state.range(0));
+  bench.Populate();
+
+  unsigned i = 0;
+  for (auto _ : state) {
+    bench.RunCmd(builder, i++);
+  }
+  state.SetItemsProcessed(state.iterations());
+  bench.Stop();
+}
+
+static void BM_Get(benchmark::State& state) {
+  RunBench(state, GetCmd());
+}
+BENCHMARK(BM_Get)->Arg(1)->Arg(4);
+
+static void BM_Set(benchmark::State& state) {
+  RunBench(state, SetCmd());
+}
+BENCHMARK(BM_Set)->Arg(1)->Arg(4);
+
+static void BM_HSet(benchmark::State& state) {
+  RunBench(state, HSetCmd());
+}
+BENCHMARK(BM_HSet)->Arg(1)->Arg(4);
+
+static void BM_ZAdd(benchmark::State& state) {
+  RunBench(state, ZAddCmd());
+}
+BENCHMARK(BM_ZAdd)->Arg(1)->Arg(4);
+
+static void BM_LPush(benchmark::State& state) {
+  RunBench(state, LPushCmd());
+}
+BENCHMARK(BM_LPush)->Arg(1)->Arg(4);
+
+static void BM_EvalSha(benchmark::State& state) {
+  CommandBenchTest bench(state.range(0));
+  bench.Populate();
+  CmdBuilder builder = EvalShaCmd(bench.LoadScript());
+
+  unsigned i = 0;
+  for (auto _ : state) {
+    bench.RunCmd(builder, i++);
+  }
+  state.SetItemsProcessed(state.iterations());
+  bench.Stop();
+}
+BENCHMARK(BM_EvalSha)->Arg(1)->Arg(4);
+
+static void BM_MGet100(benchmark::State& state) {
+  RunBench(state, MGetCmd());
+}
+BENCHMARK(BM_MGet100)->Arg(1)->Arg(4);
+
+}  // namespace dfly
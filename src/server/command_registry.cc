@@ -4,6 +4,7 @@
 
 #include "server/command_registry.h"
 
+#include <absl/numeric/bits.h>
 #include <absl/strings/str_split.h>
 #include <absl/time/clock.h>
 
@@ -16,6 +17,7 @@
 #include "facade/dragonfly_connection.h"
 #include "facade/error.h"
 #include "server/acl/acl_commands_def.h"
+#include "server/cpu_profiler.h"
 #include "server/server_state.h"
 
 using namespace std;
@@ -139,6 +141,54 @@ CommandId::CommandId(const char* name, uint32_t mask, int8_t arity, int8_t first
   latency_histogram_ = hist;
 }
 
+void TxPhaseStats::Hist::Add(uint64_t val) {
+  unsigned bucket = std::min<unsigned>(absl::bit_width(val), kNumBuckets - 1);
+  ++buckets[bucket];
+  ++count;
+  sum += val;
+}
+
+uint64_t TxPhaseStats::Hist::Percentile(double percentile) const {
+  uint64_t rank = static_cast<uint64_t>(count * percentile / 100);
+  uint64_t seen = 0;
+  for (unsigned i = 0; i < kNumBuckets; ++i) {
+    seen += buckets[i];
+    if (seen > rank)
+      return 1ULL << i;
+  }
+  return 1ULL << (kNumBuckets - 1);
+}
+
+auto TxPhaseStats::Hist::operator+=(const Hist& o) -> Hist& {
+  for (unsigned i = 0; i < kNumBuckets; ++i)
+    buckets[i] += o.buckets[i];
+  count += o.count;
+  sum += o.sum;
+  return *this;
+}
+
+const char* TxPhaseStats::PhaseName(Phase phase) {
+  switch (phase) {
+    case SCHEDULE:
+      return "schedule";
+    case QUEUE_WAIT:
+      return "queue_wait";
+    case EXECUTION:
+      return "execution";
+    case HOPS:
+      return "hops";
+    case NUM_PHASES:
+      break;
+  }
+  return "";
+}
+
+TxPhaseStats& TxPhaseStats::operator+=(const TxPhaseStats& o) {
+  for (unsigned i = 0; i < NUM_PHASES; ++i)
+    phases[i] += o.phases[i];
+  return *this;
+}
+
 CommandId::~CommandId() {
   // Aliases share the same latency histogram, so we only close it if this is not an alias.
   if (latency_histogram_ && !is_alias_) {
@@ -162,6 +212,34 @@ CommandId CommandId::Clone(const std::string_view name) const {
   return cloned;
 }
 
+void CommandId::Init(unsigned thread_count) {
+  command_stats_ = std::make_unique<CmdCallStats[]>(thread_count);
+  resource_stats_ = std::make_unique<CmdResourceStats[]>(thread_count);
+  if (GetFlag(FLAGS_latency_tracking) && IsTransactional())
+    tx_phase_stats_ = std::make_unique<TxPhaseStats[]>(thread_count);
+}
+
+void CommandId::RecordTxPhase(TxPhaseStats::Phase phase, uint64_t val) const {
+  DCHECK(tx_phase_stats_);
+  tx_phase_stats_[ServerState::tlocal()->thread_index()].phases[phase].Add(val);
+}
+
+void CommandId::RecordShardRun(uint64_t cycles) const {
+  resource_stats_[ServerState::tlocal()->thread_index()].shard_cycles += cycles;
+}
+
+void CommandId::RecordHops(uint32_t hops) const {
+  resource_stats_[ServerState::tlocal()->thread_index()].hops += hops;
+}
+
+CmdResourceStats& CmdResourceStats::operator+=(const CmdResourceStats& o) {
+  input_bytes += o.input_bytes;
+  output_bytes += o.output_bytes;
+  shard_cycles += o.shard_cycles;
+  hops += o.hops;
+  return *this;
+}
+
 bool CommandId::IsTransactional() const {
   if (first_key_ > 0 || (opt_mask_ & CO::GLOBAL_TRANS) || (opt_mask_ & CO::NO_KEY_TRANSACTIONAL))
     return true;
@@ -180,13 +258,27 @@ bool CommandId::IsMultiTransactional() const {
 uint64_t CommandId::Invoke(CmdArgList args, const CommandContext& cmd_cntx) const {
   uint64_t before = cmd_cntx.conn_cntx->conn_state.cmd_start_time_ns;
   DCHECK_GT(before, 0u);
-  handler_(args, cmd_cntx);
+  uint64_t reply_bytes = cmd_cntx.rb->BytesRecorded();
+  {
+    CpuProfileCmdScope profile_scope{this};
+    handler_(args, cmd_cntx);
+  }
   int64_t after = absl::GetCurrentTimeNanos();
 
-  ServerState* ss = ServerState::tlocal();  // Might have migrated thread, read after invocation
   int64_t execution_time_usec = (after - before) / 1000;
 
-  auto& ent = command_stats_[ss->thread_index()];
+  // Might have migrated thread, so the stats are picked after invocation.
+  RecordInvocation(execution_time_usec);
+
+  auto& res = resource_stats_[ServerState::tlocal()->thread_index()];
+  for (string_view arg : args)
+    res.input_bytes += arg.size();
+  res.output_bytes += cmd_cntx.rb->BytesRecorded() - reply_bytes;
+  return execution_time_usec;
+}
+
+void CommandId::RecordInvocation(uint64_t execution_time_usec) const {
+  auto& ent = command_stats_[ServerState::tlocal()->thread_index()];
 
   ++ent.first;
   ent.second += execution_time_usec;
@@ -196,7 +288,6 @@ uint64_t CommandId::Invoke(CmdArgList args, const CommandContext& cmd_cntx) cons
       hdr_record_value(cmd_histogram, execution_time_usec);
     }
   }
-  return execution_time_usec;
 }
 
 optional<facade::ErrorReply> CommandId::Validate(CmdArgList tail_args) const {
@@ -221,6 +312,9 @@ optional<facade::ErrorReply> CommandId::Validate(CmdArgList tail_args) const {
 
 void CommandId::ResetStats(unsigned thread_index) {
   command_stats_[thread_index] = {0, 0};
+  resource_stats_[thread_index] = {};
+  if (tx_phase_stats_)
+    tx_phase_stats_[thread_index] = {};
   if (hdr_histogram* h = latency_histogram_; h != nullptr) {
     hdr_reset(h);
   }
@@ -9,6 +9,7 @@
 #include <absl/types/span.h>
 #include <hdr/hdr_histogram.h>
 
+#include <array>
 #include <functional>
 #include <optional>
 
@@ -75,6 +76,49 @@ static_assert(!IsEvalKind(""));
 // Per thread vector of command stats. Each entry is {cmd_calls, cmd_latency_agg in usec}.
 using CmdCallStats = std::pair<uint64_t, uint64_t>;
 
+// Per thread resources used by a command. Shard time is accounted on the shard threads.
+struct CmdResourceStats {
+  uint64_t input_bytes = 0;   // bytes of the arguments
+  uint64_t output_bytes = 0;  // bytes of the replies
+  uint64_t shard_cycles = 0;  // running hop callbacks in the shards
+  uint64_t hops = 0;          // hops of the concluded transactions
+
+  CmdResourceStats& operator+=(const CmdResourceStats& o);
+};
+
+// Per thread histograms of the transaction phases of a command. Durations are in usec.
+// Bucket i counts the values below 2^i that do not fit into bucket i - 1.
+struct TxPhaseStats {
+  enum Phase : uint8_t {
+    SCHEDULE,    // scheduling on all shards, measured by the coordinator
+    QUEUE_WAIT,  // time a hop spent armed in the shard until it started running
+    EXECUTION,   // running a hop callback in the shard
+    HOPS,        // number of hops per transaction, not a duration
+    NUM_PHASES
+  };
+
+  static constexpr unsigned kNumBuckets = 21;  // up to ~1s
+
+  struct Hist {
+    std::array<uint64_t, kNumBuckets> buckets{};
+    uint64_t count = 0;
+    uint64_t sum = 0;
+
+    void Add(uint64_t val);
+
+    // Returns the upper bound of the bucket that holds the given percentile.
+    uint64_t Percentile(double percentile) const;
+
+    Hist& operator+=(const Hist& o);
+  };
+
+  static const char* PhaseName(Phase phase);
+
+  TxPhaseStats& operator+=(const TxPhaseStats& o);
+
+  Hist phases[NUM_PHASES];
+};
+
 struct CommandContext {
   CommandContext(Transaction* _tx, facade::SinkReplyBuilder* _rb, ConnectionContext* cntx)
       : tx(_tx), rb(_rb), conn_cntx(cntx) {
@@ -123,9 +167,7 @@ class CommandId : public facade::CommandId {
 
   [[nodiscard]] CommandId Clone(std::string_view name) const;
 
-  void Init(unsigned thread_count) {
-    command_stats_ = std::make_unique<CmdCallStats[]>(thread_count);
-  }
+  void Init(unsigned thread_count);
 
   using Handler3 = fu2::function_base<true, true, fu2::capacity_default, false, false,
                                       void(CmdArgList, const CommandContext&) const>;
@@ -135,6 +177,9 @@ class CommandId : public facade::CommandId {
   // Returns the invoke time in usec.
   uint64_t Invoke(CmdArgList args, const CommandContext& cmd_cntx) const;
 
+  // Accounts an invocation that bypassed Invoke() in the stats of the current thread.
+  void RecordInvocation(uint64_t execution_time_usec) const;
+
   // Returns error if validation failed, otherwise nullopt
   std::optional<facade::ErrorReply> Validate(CmdArgList tail_args) const;
 
@@ -176,6 +221,28 @@ class CommandId : public facade::CommandId {
     return command_stats_[thread_index];
   }
 
+  // Transaction phase stats are kept only with --latency_tracking.
+  bool TracksTxPhases() const {
+    return bool(tx_phase_stats_);
+  }
+
+  // Records a transaction phase of this command on the calling thread.
+  void RecordTxPhase(TxPhaseStats::Phase phase, uint64_t val) const;
+
+  // Records a hop callback of this command that ran on the calling shard thread.
+  void RecordShardRun(uint64_t cycles) const;
+
+  // Records the hops of a concluded transaction of this command.
+  void RecordHops(uint32_t hops) const;
+
+  const CmdResourceStats& GetResourceStats(unsigned thread_index) const {
+    return resource_stats_[thread_index];
+  }
+
+  const TxPhaseStats* GetTxPhaseStats(unsigned thread_index) const {
+    return tx_phase_stats_ ? &tx_phase_stats_[thread_index] : nullptr;
+  }
+
   void SetAclCategory(uint32_t mask) {
     if (implicit_acl_)
       acl_categories_ |= mask;
@@ -192,6 +259,8 @@ class CommandId : public facade::CommandId {
   bool implicit_acl_;
   bool is_alias_{false};
   std::unique_ptr<CmdCallStats[]> command_stats_;
+  std::unique_ptr<CmdResourceStats[]> resource_stats_;
+  std::unique_ptr<TxPhaseStats[]> tx_phase_stats_;
   Handler3 handler_;
   ArgValidator validator_;
   MoveOnly<hdr_histogram*> latency_histogram_;  // Histogram for command latency in usec
@@ -239,6 +308,26 @@ class CommandRegistry {
     }
   }
 
+  void MergeResourceStats(unsigned thread_index,
+                          std::function<void(std::string_view, const CmdResourceStats&)> cb) const {
+    for (const auto& k_v : cmd_map_) {
+      if (k_v.second.GetStats(thread_index).first == 0 &&
+          k_v.second.GetResourceStats(thread_index).shard_cycles == 0)
+        continue;
+      cb(k_v.second.name(), k_v.second.GetResourceStats(thread_index));
+    }
+  }
+
+  void MergeTxPhaseStats(unsigned thread_index,
+                         std::function<void(std::string_view, const TxPhaseStats&)> cb) const {
+    for (const auto& k_v : cmd_map_) {
+      const TxPhaseStats* src = k_v.second.GetTxPhaseStats(thread_index);
+      if (!src || src->phases[TxPhaseStats::HOPS].count == 0)
+        continue;
+      cb(k_v.second.name(), *src);
+    }
+  }
+
   void StartFamily(std::optional<uint32_t> acl_category = std::nullopt);
 
   std::string_view RenamedOrOriginal(std::string_view orig) const;
@@ -175,7 +175,7 @@ bool ParseDouble(string_view src, double* value) {
 #define ADD(x) (x) += o.x
 
 TieredStats& TieredStats::operator+=(const TieredStats& o) {
-  static_assert(sizeof(TieredStats) == 144);
+  static_assert(sizeof(TieredStats) == 200);
 
   ADD(total_stashes);
   ADD(total_fetches);
@@ -188,6 +188,7 @@ TieredStats& TieredStats::operator+=(const TieredStats& o) {
 
   ADD(allocated_bytes);
   ADD(capacity_bytes);
+  ADD(punched_bytes);
 
   ADD(pending_read_cnt);
   ADD(pending_stash_cnt);
@@ -199,6 +200,12 @@ TieredStats& TieredStats::operator+=(const TieredStats& o) {
   ADD(cold_storage_bytes);
   ADD(total_offloading_steps);
   ADD(total_offloading_stashes);
+  ADD(total_offloading_rereads);
+  ADD(cool_entries);
+  ADD(cool_protected_entries);
+  ADD(total_cool_reclaims);
+  ADD(total_cool_reclaimed_entries);
+  ADD(cool_reclaim_usec);
   return *this;
 }
 
@@ -234,9 +241,7 @@ OpResult<ScanOpts> ScanOpts::TryFrom(CmdArgList args) {
       else if (scan_opts.limit > 4096)
         scan_opts.limit = 4096;
     } else if (opt == "MATCH") {
-      string_view pattern = ArgS(args, i + 1);
-      if (pattern != "*")
-        scan_opts.matcher.reset(new GlobMatcher{pattern, true});
+      scan_opts.SetPattern(ArgS(args, i + 1));
     } else if (opt == "TYPE") {
       CompactObjType obj_type = ObjTypeFromString(ArgS(args, i + 1));
       if (obj_type == kInvalidCompactObjType) {
@@ -260,6 +265,11 @@ OpResult<ScanOpts> ScanOpts::TryFrom(CmdArgList args) {
       } else {
         return facade::OpStatus::SYNTAX_ERR;
       }
+    } else if (opt == "BUDGET") {
+      if (!absl::SimpleAtoi(ArgS(args, i + 1), &scan_opts.budget_ms)) {
+        return facade::OpStatus::INVALID_INT;
+      }
+      scan_opts.budget_ms = std::clamp(scan_opts.budget_ms, 1u, 1000u);
     } else if (opt == "MINMSZ") {
       if (!absl::SimpleAtoi(ArgS(args, i + 1), &scan_opts.min_malloc_size)) {
         return facade::OpStatus::INVALID_INT;
@@ -271,7 +281,19 @@ OpResult<ScanOpts> ScanOpts::TryFrom(CmdArgList args) {
   return scan_opts;
 }
 
+void ScanOpts::SetPattern(std::string_view pattern) {
+  size_t special = pattern.find_first_of("*?[\\");
+  match_prefix = pattern.substr(0, special);
+  if (special != std::string_view::npos && special + 1 == pattern.size() &&
+      pattern[special] == '*')
+    matcher.reset();
+  else
+    matcher.reset(new GlobMatcher{pattern, true});
+}
+
 bool ScanOpts::Matches(std::string_view val_name) const {
+  if (!absl::StartsWith(val_name, match_prefix))
+    return false;
   return !matcher || matcher->Matches(val_name);
 }
 
@@ -81,9 +81,12 @@ struct TieredStats {
   uint64_t total_stash_overflows = 0;
   uint64_t total_offloading_steps = 0;
   uint64_t total_offloading_stashes = 0;
+  // Offloaded values that were accessed within one sweep after being stashed.
+  uint64_t total_offloading_rereads = 0;
 
   size_t allocated_bytes = 0;
   size_t capacity_bytes = 0;
+  uint64_t punched_bytes = 0;  // disk space released from the backing files
 
   uint32_t pending_read_cnt = 0;
   uint32_t pending_stash_cnt = 0;
@@ -92,6 +95,11 @@ struct TieredStats {
   uint64_t small_bins_entries_cnt = 0;
   size_t small_bins_filling_bytes = 0;
   size_t cold_storage_bytes = 0;
+  size_t cool_entries = 0;
+  size_t cool_protected_entries = 0;  // cool values that were warmed up before
+  uint64_t total_cool_reclaims = 0;   // ReclaimMemory calls
+  uint64_t total_cool_reclaimed_entries = 0;
+  uint64_t cool_reclaim_usec = 0;  // total time spent reclaiming cool memory
 
   TieredStats& operator+=(const TieredStats&);
 };
@@ -309,7 +317,15 @@ class ExecutionState {
 
 struct ScanOpts {
   std::unique_ptr<GlobMatcher> matcher;
+
+  // Literal prefix of the MATCH pattern, checked before running the matcher. Patterns of the
+  // form "<prefix>*" are matched by the prefix alone and have no matcher.
+  std::string match_prefix;
+
   size_t limit = 10;
+
+  // Time budget of a single SCAN call, it returns fewer than limit keys once it is exhausted.
+  uint32_t budget_ms = 25;
   std::optional<CompactObjType> type_filter;
   unsigned bucket_id = UINT_MAX;
   enum class Mask {
@@ -321,6 +337,7 @@ struct ScanOpts {
   };
   std::optional<Mask> mask;
   size_t min_malloc_size = 0;
+  void SetPattern(std::string_view pattern);
   bool Matches(std::string_view val_name) const;
   static OpResult<ScanOpts> TryFrom(CmdArgList args);
 };
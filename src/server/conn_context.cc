@@ -12,6 +12,7 @@
 #include "server/channel_store.h"
 #include "server/command_registry.h"
 #include "server/engine_shard_set.h"
+#include "server/namespaces.h"
 #include "server/server_family.h"
 #include "server/server_state.h"
 #include "server/transaction.h"
@@ -132,6 +133,7 @@ ConnectionContext::ConnectionContext(facade::Connection* owner, acl::UserCredent
     acl_commands = std::move(cred.acl_commands);
   }
   acl_db_idx = cred.db;
+  rate_limiter.SetRate(cred.rate_limit);
 }
 
 ConnectionContext::ConnectionContext(const ConnectionContext* owner, Transaction* tx)
@@ -204,6 +206,19 @@ void ConnectionContext::ChangePSubscription(bool to_add, bool to_reply, CmdArgLi
   }
 }
 
+void ConnectionContext::ChangeShardSubscription(bool to_add, bool to_reply, CmdArgList args,
+                                                facade::RedisReplyBuilder* rb) {
+  vector<unsigned> result = ChangeShardSubscriptions(args, to_add, to_reply);
+
+  if (to_reply) {
+    SinkReplyBuilder::ReplyScope scope{rb};
+    for (size_t i = 0; i < result.size(); ++i) {
+      const char* action[2] = {"unsubscribe", "subscribe"};
+      SendSubscriptionChangedResponse(action[to_add], ArgS(args, i), result[i], rb);
+    }
+  }
+}
+
 void ConnectionContext::UnsubscribeAll(bool to_reply, facade::RedisReplyBuilder* rb) {
   if (to_reply && (!conn_state.subscribe_info || conn_state.subscribe_info->channels.empty())) {
     return SendSubscriptionChangedResponse("unsubscribe", std::nullopt, 0, rb);
@@ -225,8 +240,36 @@ void ConnectionContext::PUnsubscribeAll(bool to_reply, facade::RedisReplyBuilder
   ChangePSubscription(false, to_reply, CmdArgList{arg_vec}, rb);
 }
 
+void ConnectionContext::SUnsubscribeAll(bool to_reply, facade::RedisReplyBuilder* rb) {
+  if (to_reply &&
+      (!conn_state.subscribe_info || conn_state.subscribe_info->shard_channels.empty())) {
+    return SendSubscriptionChangedResponse("unsubscribe", std::nullopt, 0, rb);
+  }
+  StringVec channels(conn_state.subscribe_info->shard_channels.begin(),
+                     conn_state.subscribe_info->shard_channels.end());
+  CmdArgVec arg_vec(channels.begin(), channels.end());
+  ChangeShardSubscription(false, to_reply, CmdArgList{arg_vec}, rb);
+}
+
+void ConnectionContext::ChangeBcastTracking(bool to_add) {
+  const auto& prefixes = conn_state.tracking_info_.BcastPrefixes();
+  if (prefixes.empty() || !ns)
+    return;
+
+  auto conn_ref = conn()->Borrow();
+  shard_set->RunBriefInParallel([&](EngineShard* shard) {
+    DbSlice& db_slice = ns->GetDbSlice(shard->shard_id());
+    for (const auto& prefix : prefixes) {
+      if (to_add)
+        db_slice.TrackPrefix(conn_ref, prefix);
+      else
+        db_slice.UntrackPrefix(conn_ref, prefix);
+    }
+  });
+}
+
 size_t ConnectionState::ExecInfo::UsedMemory() const {
-  return dfly::HeapSize(body) + dfly::HeapSize(watched_keys);
+  return dfly::HeapSize(body) + dfly::HeapSize(watched_keys) + dfly::HeapSize(watched_versions);
 }
 
 size_t ConnectionState::ScriptInfo::UsedMemory() const {
@@ -234,7 +277,7 @@ size_t ConnectionState::ScriptInfo::UsedMemory() const {
 }
 
 size_t ConnectionState::SubscribeInfo::UsedMemory() const {
-  return dfly::HeapSize(channels) + dfly::HeapSize(patterns);
+  return dfly::HeapSize(channels) + dfly::HeapSize(patterns) + dfly::HeapSize(shard_channels);
 }
 
 size_t ConnectionState::UsedMemory() const {
@@ -245,10 +288,11 @@ size_t ConnectionContext::UsedMemory() const {
   return facade::ConnectionContext::UsedMemory() + dfly::HeapSize(conn_state);
 }
 
+// Called when the channel was removed from the ShardChannelStore after a slot migration.
 void ConnectionContext::Unsubscribe(std::string_view channel) {
   auto* sinfo = conn_state.subscribe_info.get();
   DCHECK(sinfo);
-  auto erased = sinfo->channels.erase(channel);
+  auto erased = sinfo->shard_channels.erase(channel);
   DCHECK(erased);
   if (sinfo->IsEmpty()) {
     conn_state.subscribe_info.reset();
@@ -304,6 +348,50 @@ vector<unsigned> ConnectionContext::ChangeSubscriptions(CmdArgList channels, boo
   return result;
 }
 
+vector<unsigned> ConnectionContext::ChangeShardSubscriptions(CmdArgList channels, bool to_add,
+                                                             bool to_reply) {
+  vector<unsigned> result(to_reply ? channels.size() : 0, 0);
+
+  if (!to_add && !conn_state.subscribe_info)
+    return result;
+
+  if (!conn_state.subscribe_info) {
+    DCHECK(to_add);
+
+    conn_state.subscribe_info.reset(new ConnectionState::SubscribeInfo);
+    subscriptions++;
+  }
+
+  auto& sinfo = *conn_state.subscribe_info.get();
+
+  int32_t tid = util::ProactorBase::me()->GetPoolIndex();
+  DCHECK_GE(tid, 0);
+
+  // Gather all the channels we need to subscribe to / remove.
+  vector<string_view> changed;
+  size_t i = 0;
+  for (string_view channel : channels) {
+    if (to_add ? sinfo.shard_channels.emplace(channel).second
+               : sinfo.shard_channels.erase(channel) > 0)
+      changed.push_back(channel);
+
+    if (to_reply)
+      result[i++] = sinfo.SubscriptionCount();
+  }
+
+  ShardChannelStore::Change(to_add, changed, this, uint32_t(tid));
+
+  // Important to reset conn_state.subscribe_info only after all references to it were
+  // removed.
+  if (!to_add && conn_state.subscribe_info->IsEmpty()) {
+    conn_state.subscribe_info.reset();
+    DCHECK_GE(subscriptions, 1u);
+    subscriptions--;
+  }
+
+  return result;
+}
+
 void ConnectionState::ExecInfo::Clear() {
   DCHECK(!preborrowed_interpreter);  // Must have been released properly
   state = EXEC_INACTIVE;
@@ -314,6 +402,7 @@ void ConnectionState::ExecInfo::Clear() {
 
 void ConnectionState::ExecInfo::ClearWatched() {
   watched_keys.clear();
+  watched_versions.clear();
   watched_dirty.store(false, memory_order_relaxed);
   watched_existed = 0;
 }
@@ -323,6 +412,11 @@ bool ConnectionState::ClientTracking::ShouldTrackKeys() const {
     return false;
   }
 
+  // BCAST connections are notified by prefix, not by the keys they read.
+  if (IsBcast()) {
+    return false;
+  }
+
   if (noloop_ == true) {
     // Once we implement REDIRECT this should return true since noloop
     // without it only affects the current connection
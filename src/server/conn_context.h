@@ -91,6 +91,9 @@ struct ConnectionState {
     bool is_write = false;
 
     std::vector<std::pair<DbIndex, std::string>> watched_keys;  // List of keys registered by WATCH
+    // Bucket versions of watched_keys seen by WATCH with watch_by_version, validated at EXEC.
+    // 0 for keys that were registered in DbSlice instead.
+    std::vector<uint64_t> watched_versions;
     std::atomic_bool watched_dirty = false;  // Set if a watched key was changed before EXEC
     uint32_t watched_existed = 0;            // Number of times watch was called on an existing key
 
@@ -116,11 +119,11 @@ struct ConnectionState {
   // PUB-SUB messaging related data.
   struct SubscribeInfo {
     bool IsEmpty() const {
-      return channels.empty() && patterns.empty();
+      return channels.empty() && patterns.empty() && shard_channels.empty();
     }
 
     unsigned SubscriptionCount() const {
-      return channels.size() + patterns.size();
+      return channels.size() + patterns.size() + shard_channels.size();
     }
 
     size_t UsedMemory() const;
@@ -128,6 +131,7 @@ struct ConnectionState {
     // TODO: to provide unique_strings across service. This will allow us to use string_view here.
     absl::flat_hash_set<std::string> channels;
     absl::flat_hash_set<std::string> patterns;
+    absl::flat_hash_set<std::string> shard_channels;  // SSUBSCRIBE, see ShardChannelStore
   };
 
   struct ReplicationInfo {
@@ -183,6 +187,11 @@ struct ConnectionState {
   // 1. If TRACKING is ON and OPTIN
   // 2. Stickiness of CACHING as described above
   //
+  // 3. CLIENT TRACKING ON BCAST [PREFIX p]... switches to broadcasting mode. Keys are not
+  //    tracked per read; instead every change to a key matching one of the prefixes (all keys
+  //    if none were given) is reported. Invalidations are coalesced per thread, so a client
+  //    gets one push with all keys changed by a batch. OPTIN/OPTOUT do not apply to BCAST.
+  //
   // We introduce a monotonic counter called sequence number which we increment only:
   // * On InvokeCmd when we are not Collecting (multi)
   // We introduce another counter called caching_seq_num which is set to seq_num
@@ -240,7 +249,22 @@ struct ConnectionState {
       return option_ == option;
     }
 
+    // Sets the BCAST prefixes. An empty vector disables BCAST mode.
+    void SetBcastPrefixes(std::vector<std::string> prefixes) {
+      bcast_prefixes_ = std::move(prefixes);
+    }
+
+    const std::vector<std::string>& BcastPrefixes() const {
+      return bcast_prefixes_;
+    }
+
+    bool IsBcast() const {
+      return !bcast_prefixes_.empty();
+    }
+
    private:
+    // Prefixes registered in BCAST mode, kept to unregister them from the shards.
+    std::vector<std::string> bcast_prefixes_;
     // a flag indicating whether the client has turned on client tracking.
     bool tracking_enabled_ = false;
     bool noloop_ = false;
@@ -299,10 +323,16 @@ class ConnectionContext : public facade::ConnectionContext {
 
   void ChangePSubscription(bool to_add, bool to_reply, CmdArgList args,
                            facade::RedisReplyBuilder* rb);
+  void ChangeShardSubscription(bool to_add, bool to_reply, CmdArgList args,
+                               facade::RedisReplyBuilder* rb);
   void UnsubscribeAll(bool to_reply, facade::RedisReplyBuilder* rb);
   void PUnsubscribeAll(bool to_reply, facade::RedisReplyBuilder* rb);
+  void SUnsubscribeAll(bool to_reply, facade::RedisReplyBuilder* rb);
   void ChangeMonitor(bool start);  // either start or stop monitor on a given connection
 
+  // Registers or unregisters the BCAST tracking prefixes of this connection on all shards.
+  void ChangeBcastTracking(bool to_add);
+
   size_t UsedMemory() const override;
 
   virtual void Unsubscribe(std::string_view channel) override;
@@ -321,6 +351,14 @@ class ConnectionContext : public facade::ConnectionContext {
   // The related connection is bound to main listener or serves the memcached protocol
   bool has_main_or_memcache_listener = false;
 
+  // Shard hit by the first single shard command of the current affinity window and how many
+  // commands of the window hit it, see Service::UpdateShardAffinity.
+  struct ShardAffinity {
+    ShardId shard = kInvalidSid;
+    uint32_t hits = 0;
+    uint32_t total = 0;
+  } shard_affinity;
+
  private:
   void EnableMonitoring(bool enable) {
     subscriptions++;  // required to support the monitoring
@@ -329,6 +367,7 @@ class ConnectionContext : public facade::ConnectionContext {
 
   std::vector<unsigned> ChangeSubscriptions(CmdArgList channels, bool pattern, bool to_add,
                                             bool to_reply);
+  std::vector<unsigned> ChangeShardSubscriptions(CmdArgList channels, bool to_add, bool to_reply);
 };
 
 }  // namespace dfly
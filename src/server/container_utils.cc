@@ -21,10 +21,32 @@ extern "C" {
 #include "redis/util.h"
 }
 
+ABSL_FLAG(uint32_t, read_offload_min_len, 0,
+          "If positive, SMEMBERS, HGETALL, HKEYS, HVALS and LRANGE read containers with at least "
+          "this many elements on the connection thread while the key stays read-locked, "
+          "at the cost of an additional hop for every such command.");
+
 namespace dfly::container_utils {
 using namespace std;
 namespace {
 
+// Returns true if reading the value does not modify it, i.e. it can be read from other threads.
+bool IsReadOnlySafe(const PrimeValue& pv) {
+  switch (pv.ObjType()) {
+    case OBJ_SET:
+      return pv.Encoding() == kEncodingIntSet ||
+             !static_cast<StringSet*>(pv.RObjPtr())->ExpirationUsed();
+    case OBJ_HASH:
+      return pv.Encoding() == kEncodingListPack ||
+             !static_cast<StringMap*>(pv.RObjPtr())->ExpirationUsed();
+    case OBJ_LIST:
+      // Compressed nodes are decompressed in place when they are read.
+      return static_cast<QList*>(pv.RObjPtr())->compress_param() == 0;
+    default:
+      return false;
+  }
+}
+
 struct ShardFFResult {
   PrimeKey key;
   ShardId sid = kInvalidSid;
@@ -281,7 +303,7 @@ optional<string_view> LpFind(uint8_t* lp, string_view key, uint8_t int_buf[]) {
   uint8_t* fptr = lpFirst(lp);
   DCHECK(fptr);
 
-  fptr = lpFind(lp, fptr, (unsigned char*)key.data(), key.size(), 1);
+  fptr = lpFindEncoded(lp, fptr, (unsigned char*)key.data(), key.size(), 1);
   if (!fptr)
     return std::nullopt;
   uint8_t* vptr = lpNext(lp, fptr);
@@ -296,7 +318,8 @@ string_view LpGetView(uint8_t* lp_it, uint8_t int_buf[]) {
 }
 
 OpResult<string> RunCbOnFirstNonEmptyBlocking(Transaction* trans, int req_obj_type,
-                                              BlockingResultCb func, unsigned limit_ms,
+                                              BlockingResultCb func, unsigned demand,
+                                              unsigned limit_ms,
                                               bool* block_flag, bool* pause_flag,
                                               std::string* info) {
   string result_key;
@@ -361,8 +384,8 @@ OpResult<string> RunCbOnFirstNonEmptyBlocking(Transaction* trans, int req_obj_ty
     return ns->GetDbSlice(owner->shard_id()).FindReadOnly(context, key, req_obj_type).ok();
   };
 
-  auto status =
-      trans->WaitOnWatch(limit_tp, Transaction::kShardArgs, key_checker, block_flag, pause_flag);
+  auto status = trans->WaitOnWatch(limit_tp, Transaction::kShardArgs, key_checker, demand,
+                                   block_flag, pause_flag);
 
   if (status != OpStatus::OK)
     return status;
@@ -390,4 +413,47 @@ OpResult<string> RunCbOnFirstNonEmptyBlocking(Transaction* trans, int req_obj_ty
   return result_key;
 }
 
+OffloadedRead::OffloadedRead(const Transaction* tx) {
+  if (!tx->IsMulti())
+    min_len_ = absl::GetFlag(FLAGS_read_offload_min_len);
+}
+
+bool OffloadedRead::TryPin(DbSlice* db_slice, DbIndex dbid, string_view key,
+                           const PrimeValue& pv, size_t len) {
+  if (min_len_ == 0 || len < min_len_ || !IsReadOnlySafe(pv))
+    return false;
+
+  // The entry may move inside the table between the hops, but not the object it references.
+  value_ = pv.AsRef();
+  pinned_ = true;
+  key_ = key;
+  db_slice->PinRead(dbid, key);
+  return true;
+}
+
+void OffloadedRead::Run(Transaction* tx, absl::FunctionRef<void(Transaction*, EngineShard*)> op,
+                        absl::FunctionRef<void(const PrimeValue&)> read) {
+  auto cb = [op](Transaction* t, EngineShard* es) {
+    op(t, es);
+    return OpStatus::OK;
+  };
+
+  if (min_len_ == 0) {
+    tx->ScheduleSingleHop(cb);
+    return;
+  }
+
+  tx->Execute(cb, false);
+  if (!pinned_)
+    return tx->Conclude();
+
+  read(value_);
+  tx->Execute(
+      [this](Transaction* t, EngineShard* es) {
+        t->GetDbSlice(es->shard_id()).UnpinRead(t->GetDbIndex(), key_);
+        return OpStatus::OK;
+      },
+      true);
+}
+
 }  // namespace dfly::container_utils
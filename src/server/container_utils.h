@@ -3,6 +3,8 @@
 //
 #pragma once
 
+#include <absl/functional/function_ref.h>
+
 #include "base/logging.h"
 #include "core/compact_object.h"
 #include "server/table.h"
@@ -16,6 +18,7 @@ extern "C" {
 namespace dfly {
 
 class StringMap;
+class DbSlice;
 
 namespace container_utils {
 
@@ -86,11 +89,40 @@ using BlockingResultCb =
 // Block until a any key of the transaction becomes non-empty and executes the callback.
 // If multiple keys are non-empty when this function is called, the callback is executed
 // immediately with the first key listed in the tx arguments.
+// demand is the max number of elements the callback consumes from the key, 0 if unknown.
 OpResult<std::string> RunCbOnFirstNonEmptyBlocking(Transaction* trans, int req_obj_type,
-                                                   BlockingResultCb cb, unsigned limit_ms,
+                                                   BlockingResultCb cb, unsigned demand,
+                                                   unsigned limit_ms,
                                                    bool* block_flag, bool* pause_flag,
                                                    std::string* info = nullptr);
 
+// Offloads reads of large containers (see the read_offload_min_len flag) to the connection thread.
+// The first hop finds the value and pins it instead of reading it, then the value is read on the
+// calling thread while the transaction keeps the key read-locked, and the second hop unpins it.
+class OffloadedRead {
+ public:
+  // Disabled for multi transactions, which may run in shard threads.
+  explicit OffloadedRead(const Transaction* tx);
+
+  // Called by the read operation in the shard thread with the value it found and the number of
+  // elements it reads. Returns true if the value was pinned, in which case the operation should
+  // return without reading it.
+  // The key must stay valid until Run returns.
+  bool TryPin(DbSlice* db_slice, DbIndex dbid, std::string_view key, const PrimeValue& pv,
+              size_t len);
+
+  // Runs `op` as the first hop. If it pinned the value, `read` reads it on the calling thread
+  // and a second hop releases it. Otherwise the transaction concludes after the first hop.
+  void Run(Transaction* tx, absl::FunctionRef<void(Transaction*, EngineShard*)> op,
+           absl::FunctionRef<void(const PrimeValue&)> read);
+
+ private:
+  uint32_t min_len_ = 0;  // 0 if disabled
+  bool pinned_ = false;
+  std::string_view key_;  // the pinned key
+  PrimeValue value_;  // a reference to the pinned value
+};
+
 };  // namespace container_utils
 
 }  // namespace dfly
@@ -0,0 +1,194 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/cpu_profiler.h"
+
+#include <absl/container/flat_hash_map.h>
+#include <absl/debugging/stacktrace.h>
+#include <absl/debugging/symbolize.h>
+#include <absl/strings/str_cat.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+
+#include "base/logging.h"
+#include "server/command_registry.h"
+#include "util/fibers/fibers.h"
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+namespace dfly {
+
+using namespace std;
+using namespace util;
+
+namespace {
+
+struct ThreadProfile {
+  timer_t timer;
+  vector<CpuProfiler::Sample> samples;
+  size_t size = 0;
+};
+
+// Accessed by the signal handler of the thread, so only trivially initialized variables.
+thread_local ThreadProfile* tl_profile = nullptr;
+thread_local const CommandId* tl_running_cid = nullptr;
+thread_local const void* tl_running_fiber = nullptr;
+
+const void* CurrentFiber() {
+  return ThisFiber::GetName().data();
+}
+
+void OnProfSignal(int, siginfo_t*, void* ucontext) {
+  ThreadProfile* profile = tl_profile;
+  if (profile == nullptr || profile->size >= profile->samples.size())
+    return;
+
+  CpuProfiler::Sample& sample = profile->samples[profile->size++];
+  sample.depth = absl::GetStackTraceWithContext(sample.stack, CpuProfiler::Sample::kMaxDepth, 1,
+                                                ucontext, nullptr);
+
+  string_view fiber = ThisFiber::GetName();
+  size_t len = min(fiber.size(), sizeof(sample.fiber) - 1);
+  memcpy(sample.fiber, fiber.data(), len);
+  sample.fiber[len] = '\0';
+
+  // The command is attributed only to the fiber that runs it.
+  sample.cid = tl_running_fiber == fiber.data() ? tl_running_cid : nullptr;
+}
+
+void InstallSignalHandler() {
+  static once_flag installed;
+  call_once(installed, [] {
+    struct sigaction act = {};
+    act.sa_sigaction = OnProfSignal;
+    act.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&act.sa_mask);
+    CHECK_EQ(0, sigaction(SIGPROF, &act, nullptr));
+  });
+}
+
+}  // namespace
+
+bool CpuProfiler::StartThread(unsigned hz, size_t max_samples) {
+  if (tl_profile)
+    return false;
+
+  InstallSignalHandler();
+
+  auto profile = make_unique<ThreadProfile>();
+  profile->samples.resize(max_samples);
+
+  // Samples the CPU time of this thread only, with the signal delivered to this thread.
+  struct sigevent sev = {};
+  sev.sigev_notify = SIGEV_THREAD_ID;
+  sev.sigev_signo = SIGPROF;
+  sev.sigev_notify_thread_id = syscall(SYS_gettid);
+  if (timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &profile->timer) != 0) {
+    LOG(ERROR) << "Could not create a profiling timer: " << strerror(errno);
+    return false;
+  }
+
+  tl_profile = profile.release();
+  atomic_signal_fence(memory_order_seq_cst);
+
+  long interval_ns = 1'000'000'000L / max(hz, 1u);
+  struct itimerspec spec = {};
+  spec.it_interval.tv_sec = interval_ns / 1'000'000'000L;
+  spec.it_interval.tv_nsec = interval_ns % 1'000'000'000L;
+  spec.it_value = spec.it_interval;
+  CHECK_EQ(0, timer_settime(tl_profile->timer, 0, &spec, nullptr));
+  return true;
+}
+
+vector<CpuProfiler::Sample> CpuProfiler::StopThread() {
+  unique_ptr<ThreadProfile> profile{tl_profile};
+  if (!profile)
+    return {};
+
+  tl_profile = nullptr;
+  atomic_signal_fence(memory_order_seq_cst);
+  timer_delete(profile->timer);
+
+  profile->samples.resize(profile->size);
+  return std::move(profile->samples);
+}
+
+string CpuProfiler::FormatPprof(const vector<Sample>& samples, unsigned hz) {
+  // Unique stacks with their counts, the format is a sequence of machine words.
+  absl::flat_hash_map<vector<uintptr_t>, uintptr_t> stacks;
+  for (const Sample& sample : samples) {
+    vector<uintptr_t> stack(sample.depth);
+    for (int i = 0; i < sample.depth; ++i)
+      stack[i] = reinterpret_cast<uintptr_t>(sample.stack[i]);
+    ++stacks[stack];
+  }
+
+  vector<uintptr_t> words = {0, 3, 0, 1'000'000 / max(hz, 1u), 0};  // header
+  for (const auto& [stack, count] : stacks) {
+    words.push_back(count);
+    words.push_back(stack.size());
+    words.insert(words.end(), stack.begin(), stack.end());
+  }
+  words.insert(words.end(), {0, 1, 0});  // trailer
+
+  string res(reinterpret_cast<const char*>(words.data()), words.size() * sizeof(uintptr_t));
+  if (FILE* maps = fopen("/proc/self/maps", "r"); maps) {
+    char buf[4096];
+    while (size_t len = fread(buf, 1, sizeof(buf), maps))
+      res.append(buf, len);
+    fclose(maps);
+  }
+  return res;
+}
+
+string CpuProfiler::FormatFolded(const vector<Sample>& samples) {
+  absl::flat_hash_map<void*, string> symbols;
+  auto symbolize = [&symbols](void* pc) -> const string& {
+    auto [it, inserted] = symbols.try_emplace(pc);
+    if (inserted) {
+      char buf[1024];
+      // Return addresses point after the call instruction.
+      if (absl::Symbolize(static_cast<char*>(pc) - 1, buf, sizeof(buf)))
+        it->second = buf;
+      else
+        it->second = absl::StrCat("0x", absl::Hex(reinterpret_cast<uintptr_t>(pc)));
+    }
+    return it->second;
+  };
+
+  absl::flat_hash_map<string, size_t> folded;
+  for (const Sample& sample : samples) {
+    string line = absl::StrCat(sample.fiber[0] ? sample.fiber : "unknown", ";",
+                               sample.cid ? sample.cid->name() : "none");
+    for (int i = sample.depth - 1; i >= 0; --i)
+      absl::StrAppend(&line, ";", symbolize(sample.stack[i]));
+    ++folded[line];
+  }
+
+  string res;
+  for (const auto& [line, count] : folded)
+    absl::StrAppend(&res, line, " ", count, "\n");
+  return res;
+}
+
+CpuProfileCmdScope::CpuProfileCmdScope(const CommandId* cid)
+    : prev_cid_(tl_running_cid), prev_fiber_(tl_running_fiber) {
+  tl_running_cid = cid;
+  tl_running_fiber = CurrentFiber();
+}
+
+CpuProfileCmdScope::~CpuProfileCmdScope() {
+  tl_running_cid = prev_cid_;
+  tl_running_fiber = prev_fiber_;
+}
+
+}  // namespace dfly
@@ -0,0 +1,57 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace dfly {
+
+class CommandId;
+
+// Sampling CPU profiler of the proactor threads, served at /profilez. Every thread samples itself
+// with a SIGPROF timer on its own CPU time, so that the samples can be attributed to the fiber and
+// the command that were running on the thread.
+class CpuProfiler {
+ public:
+  struct Sample {
+    static constexpr int kMaxDepth = 48;
+
+    void* stack[kMaxDepth];
+    int depth = 0;
+    const CommandId* cid = nullptr;
+    char fiber[24] = {};
+  };
+
+  // Starts sampling the calling thread at the given frequency, keeping up to max_samples.
+  // Returns false if sampling could not be started.
+  static bool StartThread(unsigned hz, size_t max_samples);
+
+  // Stops sampling the calling thread and returns its samples.
+  static std::vector<Sample> StopThread();
+
+  // Formats the samples as a legacy gperftools CPU profile, which pprof reads.
+  static std::string FormatPprof(const std::vector<Sample>& samples, unsigned hz);
+
+  // Formats the samples as folded stacks for flame graphs, one line per unique stack:
+  // "<fiber>;<command>;<outermost frame>;...;<innermost frame> <count>".
+  static std::string FormatFolded(const std::vector<Sample>& samples);
+};
+
+// Attributes the CPU samples of the current fiber to the command while in scope.
+class CpuProfileCmdScope {
+ public:
+  explicit CpuProfileCmdScope(const CommandId* cid);
+  ~CpuProfileCmdScope();
+
+  CpuProfileCmdScope(const CpuProfileCmdScope&) = delete;
+  CpuProfileCmdScope& operator=(const CpuProfileCmdScope&) = delete;
+
+ private:
+  const CommandId* prev_cid_;
+  const void* prev_fiber_;
+};
+
+}  // namespace dfly
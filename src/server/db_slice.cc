@@ -6,19 +6,30 @@
 
 extern "C" {
 #include "redis/hyperloglog.h"
+#include "redis/redis_aux.h"
 }
 
 #include <absl/cleanup/cleanup.h>
+#include <absl/container/node_hash_map.h>
+#include <absl/strings/ascii.h>
+#include <absl/strings/match.h>
 
 #include "base/flags.h"
 #include "base/logging.h"
+#include "core/qlist.h"
+#include "core/sorted_map.h"
+#include "core/string_map.h"
+#include "core/string_set.h"
 #include "core/top_keys.h"
 #include "search/doc_index.h"
+#include "server/acl/acl_commands_def.h"
 #include "server/channel_store.h"
 #include "server/cluster/slot_set.h"
+#include "server/detail/lazy_key_fetcher.h"
 #include "server/engine_shard_set.h"
 #include "server/error.h"
 #include "server/journal/journal.h"
+#include "server/keyspace_events.h"
 #include "server/server_state.h"
 #include "server/tiered_storage.h"
 #include "strings/human_readable.h"
@@ -37,8 +48,51 @@ ABSL_FLAG(double, table_growth_margin, 0.4,
           "Prevents table from growing if number of free slots x average object size x this ratio "
           "is larger than memory budget.");
 
+ABSL_FLAG(bool, expire_wheel, false,
+          "If true, tracks the expiry deadlines in a timing wheel so that active expiry visits "
+          "the due keys directly instead of only scanning the expire table.");
+
+ABSL_FLAG(std::string, cache_eviction_policy, "dash",
+          "Which entries are evicted in cache mode. 'dash' evicts the entries that were not bumped "
+          "up from the stash buckets, 'lfu' evicts the least frequently used entries of the "
+          "candidate buckets based on an approximate access counter.");
+
+ABSL_FLAG(uint32_t, lfu_sketch_counters, 1 << 20,
+          "Number of access counters per shard used by the lfu eviction policy. Should be close "
+          "to the number of hot keys of the shard.");
+
+ABSL_FLAG(uint32_t, eviction_pool_size, 0,
+          "If positive, the heartbeat samples up to this many eviction candidates per database "
+          "ahead of time. Both the heartbeat and the writes that go over the memory budget evict "
+          "them before falling back to scanning the table.");
+
+ABSL_FLAG(uint32_t, hash_write_sketch_counters, 0,
+          "If positive, counts the writes of hashes with that many counters per shard. Hashes "
+          "that are written often are converted from listpacks to hash tables early, and the "
+          "heartbeat converts hash tables that are not written and shrank back to listpacks.");
+
+ABSL_FLAG(uint32_t, hotkeys_sample_rate, 64,
+          "Tracks the hot keys of every shard for HOTKEYS and the metrics by sampling one of every "
+          "N key accesses. 0 disables the tracking.");
+
+ABSL_FLAG(uint32_t, field_expire_reap_min_size, 0,
+          "If positive, hashes and sets with at least that many fields and field expiries are "
+          "queued by their earliest expiry, and the heartbeat deletes their expired fields. "
+          "Otherwise expired fields are only deleted when they are accessed.");
+
+ABSL_FLAG(uint64_t, async_free_threshold, 1ULL << 20,
+          "Sets, hashes, sorted sets and lists that use more than this many bytes are released "
+          "incrementally in the background when they are deleted, expired, evicted, overwritten "
+          "or flushed. 0 disables it, in which case only UNLINK releases values asynchronously.");
+
+ABSL_FLAG(uint64_t, async_free_max_pending, 256ULL << 20,
+          "Upper bound on the bytes a thread keeps queued for incremental release. Containers "
+          "deleted while the backlog is above it are released synchronously. 0 means no bound.");
+
 ABSL_FLAG(std::string, notify_keyspace_events, "",
-          "notify-keyspace-events. Only Ex is supported for now");
+          "notify-keyspace-events. Characters of K, E, g, $, l, s, h, z, x, e, t, m, n, d and A "
+          "as in Redis. The notifications of a hop are published in one batch after it and are "
+          "not generated while no channel or pattern may match them.");
 
 namespace dfly {
 
@@ -61,6 +115,9 @@ static_assert(kPrimeSegmentSize <= 32304);
 static_assert(kExpireSegmentSize <= 23544);
 static_assert(double(kExpireRegularSize) / kExpireSegmentSize > 0.9);
 
+// Max deletions tracked between delta snapshots. Beyond it the next snapshot is a full one.
+constexpr size_t kMaxDeltaDeletes = 1u << 18;
+
 void AccountObjectMemory(string_view key, unsigned type, int64_t size, DbTable* db) {
   DCHECK_NE(db, nullptr);
   if (size == 0)
@@ -106,6 +163,7 @@ class PrimeEvictionPolicy {
 
   unsigned GarbageCollect(const PrimeTable::HotBuckets& eb, PrimeTable* me);
   unsigned Evict(const PrimeTable::HotBuckets& eb, PrimeTable* me);
+  unsigned EvictLfu(const PrimeTable::HotBuckets& eb, const FrequencySketch& sketch);
 
   unsigned evicted() const {
     return evicted_;
@@ -204,6 +262,10 @@ unsigned PrimeEvictionPolicy::Evict(const PrimeTable::HotBuckets& eb, PrimeTable
   // Disable flush journal changes to prevent preemtion in evict.
   journal::JournalFlushGuard journal_flush_guard(db_slice_->shard_owner()->journal());
 
+  if (const FrequencySketch* sketch = db_slice_->freq_sketch(); sketch) {
+    return EvictLfu(eb, *sketch);
+  }
+
   constexpr size_t kNumStashBuckets = ABSL_ARRAYSIZE(eb.probes.by_type.stash_buckets);
 
   // choose "randomly" a stash bucket to evict an item.
@@ -237,43 +299,146 @@ unsigned PrimeEvictionPolicy::Evict(const PrimeTable::HotBuckets& eb, PrimeTable
   return 1;
 }
 
+// Evicts the least frequently used entry among the buckets that can host the inserted key,
+// i.e. its home bucket, its neighbour and the stash buckets.
+unsigned PrimeEvictionPolicy::EvictLfu(const PrimeTable::HotBuckets& eb,
+                                       const FrequencySketch& sketch) {
+  const auto& probes = eb.probes.by_type;
+  PrimeTable::bucket_iterator candidates[2 + ABSL_ARRAYSIZE(probes.stash_buckets)] = {
+      probes.regular_buckets[1], probes.regular_buckets[2]};
+  std::copy(std::begin(probes.stash_buckets), std::end(probes.stash_buckets), candidates + 2);
+
+  DbTable* table = db_slice_->GetDBTable(cntx_.db_index);
+  auto& lt = table->trans_locks;
+  string scratch;
+
+  PrimeTable::bucket_iterator victim;
+  unsigned victim_freq = FrequencySketch::kMaxCount + 1;
+  for (auto bucket_it : candidates) {
+    bucket_it.AdvanceIfNotOccupied();  // stash iterators point to the first slot.
+    for (; !bucket_it.is_done() && victim_freq > 0; ++bucket_it) {
+      if (bucket_it->first.IsSticky())
+        continue;
+
+      unsigned freq = sketch.Estimate(bucket_it->first.HashCode());
+      if (freq >= victim_freq)
+        continue;
+
+      // do not evict locked keys
+      if (lt.Find(LockTag(bucket_it->first.GetSlice(&scratch))).has_value())
+        continue;
+
+      victim = bucket_it;
+      victim_freq = freq;
+    }
+  }
+
+  if (victim.is_done())
+    return 0;
+
+  string_view key = victim->first.GetSlice(&scratch);
+  if (auto journal = db_slice_->shard_owner()->journal(); journal) {
+    RecordExpiryBlocking(cntx_.db_index, key);
+  }
+  db_slice_->PerformDeletion(DbSlice::Iterator(victim, StringOrView::FromView(key)), table);
+  ++evicted_;
+
+  return 1;
+}
+
 class AsyncDeleter {
  public:
-  static void EnqueDeletion(uint32_t next, DenseSet* ds);
+  // Detaches the container of `pv` and releases it in steps during the cpu-idle time.
+  // Returns false if the value is not a container that can be released incrementally.
+  static bool EnqueDeletion(PrimeValue* pv);
   static void Shutdown();
 
+  // Bytes of the containers queued on this thread that were not released yet.
+  static size_t PendingBytes() {
+    return pending_bytes_;
+  }
+
  private:
   static constexpr uint32_t kClearStepSize = 1024;
+
+  enum class Kind : uint8_t { kDenseSet, kSortedMap, kQList };
+
   struct ClearNode {
-    DenseSet* ds;
+    void* obj;
+    Kind kind;
     uint32_t cursor;
+    size_t bytes;
     ClearNode* next;
 
-    ClearNode(DenseSet* d, uint32_t c, ClearNode* n) : ds(d), cursor(c), next(n) {
+    ClearNode(void* o, Kind k, uint32_t c, size_t b, ClearNode* n)
+        : obj(o), kind(k), cursor(c), bytes(b), next(n) {
     }
   };
 
+  // Releases up to kClearStepSize items of the node's container. Returns true and frees the
+  // container once it is empty.
+  static bool ClearStep(ClearNode* node);
+
   // Asynchronously deletes entries during the cpu-idle time.
   static int32_t IdleCb();
 
   // We add async deletion requests to a linked list and process them asynchronously
   // in each thread.
   static __thread ClearNode* head_;
+  static __thread size_t pending_bytes_;
 };
 
 __thread AsyncDeleter::ClearNode* AsyncDeleter::head_ = nullptr;
+__thread size_t AsyncDeleter::pending_bytes_ = 0;
+
+bool AsyncDeleter::EnqueDeletion(PrimeValue* pv) {
+  Kind kind;
+  switch (pv->ObjType()) {
+    case OBJ_SET:
+    case OBJ_HASH:
+      if (pv->Encoding() != kEncodingStrMap2)
+        return false;
+      kind = Kind::kDenseSet;
+      break;
+    case OBJ_ZSET:
+      if (pv->Encoding() != OBJ_ENCODING_SKIPLIST)
+        return false;
+      kind = Kind::kSortedMap;
+      break;
+    case OBJ_LIST:
+      kind = Kind::kQList;
+      break;
+    default:
+      return false;
+  }
+
+  ClearNode node{pv->RObjPtr(), kind, 0, pv->MallocUsed(), nullptr};
+  pv->SetRObjPtr(nullptr);
+
+  // Small containers are released right away without scheduling.
+  if (ClearStep(&node))
+    return true;
+
+  // Do not let the backlog outgrow the idle time, release the container inline instead.
+  size_t max_pending = GetFlag(FLAGS_async_free_max_pending);
+  if (max_pending > 0 && pending_bytes_ + node.bytes > max_pending) {
+    while (!ClearStep(&node)) {
+    }
+    return true;
+  }
 
-void AsyncDeleter::EnqueDeletion(uint32_t next, DenseSet* ds) {
   bool launch_task = (head_ == nullptr);
 
-  // register ds
-  head_ = new ClearNode{ds, next, head_};
+  // register the container
+  pending_bytes_ += node.bytes;
+  head_ = new ClearNode{node.obj, node.kind, node.cursor, node.bytes, head_};
   ProactorBase* pb = ProactorBase::me();
   DCHECK(pb);
   DVLOG(2) << "Adding async deletion task, thread " << pb->GetPoolIndex() << " " << launch_task;
   if (launch_task) {
     pb->AddOnIdleTask(&IdleCb);
   }
+  return true;
 }
 
 void AsyncDeleter::Shutdown() {
@@ -284,6 +449,41 @@ void AsyncDeleter::Shutdown() {
     delete head_;
     head_ = next;
   }
+  pending_bytes_ = 0;
+}
+
+bool AsyncDeleter::ClearStep(ClearNode* node) {
+  switch (node->kind) {
+    case Kind::kDenseSet: {
+      DenseSet* ds = static_cast<DenseSet*>(node->obj);
+      node->cursor = ds->ClearStep(node->cursor, kClearStepSize);
+      if (node->cursor < ds->BucketCount())
+        return false;
+      CompactObj::DeleteMR<DenseSet>(ds);
+      return true;
+    }
+    case Kind::kSortedMap: {
+      auto* sm = static_cast<detail::SortedMap*>(node->obj);
+      size_t sz = sm->Size();
+      if (sz > 0) {
+        sm->DeleteRangeByRank(0, min<size_t>(sz, kClearStepSize) - 1);
+        if (sz > kClearStepSize)
+          return false;
+      }
+      CompactObj::DeleteMR<detail::SortedMap>(sm);
+      return true;
+    }
+    case Kind::kQList: {
+      QList* ql = static_cast<QList*>(node->obj);
+      if (ql->Size() > kClearStepSize) {
+        ql->Erase(0, kClearStepSize);
+        return false;
+      }
+      CompactObj::DeleteMR<QList>(ql);
+      return true;
+    }
+  }
+  return true;
 }
 
 int32_t AsyncDeleter::IdleCb() {
@@ -293,13 +493,10 @@ int32_t AsyncDeleter::IdleCb() {
   auto* current = head_;
 
   DVLOG(2) << "IdleCb " << current->cursor;
-  uint32_t next = current->ds->ClearStep(current->cursor, kClearStepSize);
-  if (next == current->ds->BucketCount()) {  // reached the end.
-    CompactObj::DeleteMR<DenseSet>(current->ds);
+  if (ClearStep(current)) {  // reached the end.
+    pending_bytes_ -= current->bytes;
     head_ = current->next;
     delete current;
-  } else {
-    current->cursor = next;
   }
   return ProactorBase::kOnIdleMaxLevel;
 };
@@ -310,6 +507,14 @@ inline void TouchTopKeysIfNeeded(string_view key, TopKeys* top_keys) {
   }
 }
 
+inline void SampleHotKey(string_view key, TopKeys* hot_keys, uint32_t sample_rate,
+                         uint32_t* countdown) {
+  if (hot_keys && --*countdown == 0) {
+    *countdown = sample_rate;
+    hot_keys->Touch(key);
+  }
+}
+
 inline void TouchHllIfNeeded(string_view key, uint8_t* hll) {
   if (hll) {
     HllBufferPtr hll_buf;
@@ -325,7 +530,7 @@ inline void TouchHllIfNeeded(string_view key, uint8_t* hll) {
 
 DbStats& DbStats::operator+=(const DbStats& o) {
   constexpr size_t kDbSz = sizeof(DbStats) - sizeof(DbTableStats);
-  static_assert(kDbSz == 40);
+  static_assert(kDbSz == 48);
 
   DbTableStats::operator+=(o);
 
@@ -334,12 +539,13 @@ DbStats& DbStats::operator+=(const DbStats& o) {
   ADD(prime_capacity);
   ADD(expire_capacity);
   ADD(table_mem_usage);
+  ADD(expire_wheel_mem_usage);
 
   return *this;
 }
 
 SliceEvents& SliceEvents::operator+=(const SliceEvents& o) {
-  static_assert(sizeof(SliceEvents) == 136, "You should update this function with new fields");
+  static_assert(sizeof(SliceEvents) == 152, "You should update this function with new fields");
 
   ADD(evicted_keys);
   ADD(hard_evictions);
@@ -358,6 +564,8 @@ SliceEvents& SliceEvents::operator+=(const SliceEvents& o) {
   ADD(ram_misses);
   ADD(huff_encode_total);
   ADD(huff_encode_success);
+  ADD(zstd_encode_total);
+  ADD(zstd_encode_success);
   return *this;
 }
 
@@ -391,11 +599,32 @@ DbSlice::DbSlice(uint32_t index, bool cache_mode, EngineShard* owner)
   soft_budget_limit_ = (0.3 * max_memory_limit / shard_set->size());
 
   std::string keyspace_events = GetFlag(FLAGS_notify_keyspace_events);
-  if (!keyspace_events.empty() && keyspace_events != "Ex") {
-    LOG(ERROR) << "Only Ex is currently supported";
+  auto keyspace_flags = keyspace_events::Parse(keyspace_events);
+  if (!keyspace_flags) {
+    LOG(ERROR) << "Invalid notify_keyspace_events " << keyspace_events;
     exit(0);
   }
-  expired_keys_events_recording_ = !keyspace_events.empty();
+  SetNotifyKeyspaceEvents(*keyspace_flags);
+
+  string eviction_policy = GetFlag(FLAGS_cache_eviction_policy);
+  if (eviction_policy == "lfu") {
+    freq_sketch_ = make_unique<FrequencySketch>(GetFlag(FLAGS_lfu_sketch_counters));
+  } else if (eviction_policy != "dash") {
+    LOG(ERROR) << "Unknown cache_eviction_policy " << eviction_policy;
+    exit(1);
+  }
+
+  if (uint32_t counters = GetFlag(FLAGS_hash_write_sketch_counters); counters > 0) {
+    hash_write_sketch_ = make_unique<FrequencySketch>(counters);
+  }
+  if (uint32_t sample_rate = GetFlag(FLAGS_hotkeys_sample_rate); sample_rate > 0) {
+    // A small table is enough to find the heaviest keys, and keeps the tracking always-on.
+    hot_keys_ = make_unique<TopKeys>(
+        TopKeys::Options{.buckets = 1024, .depth = 4, .min_key_count_to_record = 8});
+    hot_keys_sample_rate_ = hot_keys_countdown_ = sample_rate;
+  }
+  field_expire_reap_min_size_ = GetFlag(FLAGS_field_expire_reap_min_size);
+  async_free_threshold_ = GetFlag(FLAGS_async_free_threshold);
 }
 
 DbSlice::~DbSlice() {
@@ -411,6 +640,15 @@ DbSlice::~DbSlice() {
   AsyncDeleter::Shutdown();
 }
 
+size_t DbSlice::QuotaUsage() const {
+  size_t res = table_memory_;
+  for (const auto& db : db_arr_) {
+    if (db)
+      res += db->stats.obj_memory_usage;
+  }
+  return res;
+}
+
 auto DbSlice::GetStats() const -> Stats {
   Stats s;
   s.events = events_;
@@ -427,11 +665,16 @@ auto DbSlice::GetStats() const -> Stats {
     stats.expire_capacity = db_wrap.expire.capacity();
     stats.expire_count = db_wrap.expire.size();
     stats.table_mem_usage = db_wrap.table_memory();
+    if (db_wrap.expire_wheel)
+      stats.expire_wheel_mem_usage = db_wrap.expire_wheel->MemoryUsage();
   }
   auto co_stats = CompactObj::GetStatsThreadLocal();
   s.small_string_bytes = co_stats.small_string_bytes;
+  s.async_free_pending_bytes = AsyncDeleter::PendingBytes();
   s.events.huff_encode_total = co_stats.huff_encode_total;
   s.events.huff_encode_success = co_stats.huff_encode_success;
+  s.events.zstd_encode_total = co_stats.zstd_encode_total;
+  s.events.zstd_encode_success = co_stats.zstd_encode_success;
 
   return s;
 }
@@ -441,13 +684,56 @@ SlotStats DbSlice::GetSlotStats(SlotId sid) const {
   return db_arr_[0]->slots_stats[sid];
 }
 
+void DbSlice::UpdateSlotRates(uint64_t now_ms) {
+  if (!IsDbValid(0) || !db_arr_[0]->slots_stats)
+    return;
+
+  SlotStats* stats = db_arr_[0]->slots_stats.get();
+  bool first = !slot_ops_prev_;
+  if (first)
+    slot_ops_prev_.reset(new uint64_t[kMaxSlotNum + 1]);
+  else if (now_ms < slot_rates_ms_ + 1000)
+    return;
+
+  uint64_t elapsed_ms = now_ms - slot_rates_ms_;
+  for (size_t sid = 0; sid <= kMaxSlotNum; ++sid) {
+    uint64_t ops = stats[sid].total_reads + stats[sid].total_writes;
+    // Counters restart when the table is flushed.
+    if (!first)
+      stats[sid].ops_per_sec = (ops >= slot_ops_prev_[sid] ? ops - slot_ops_prev_[sid] : ops) *
+                               1000 / elapsed_ms;
+    slot_ops_prev_[sid] = ops;
+  }
+  slot_rates_ms_ = now_ms;
+}
+
+void DbSlice::DecayHotKeys(uint64_t now_ms) {
+  if (!hot_keys_ || now_ms < hot_keys_decay_ms_ + kHotKeysDecayMs)
+    return;
+  hot_keys_->Decay();
+  hot_keys_decay_ms_ = now_ms;
+}
+
+vector<pair<string, uint64_t>> DbSlice::GetHotKeys() const {
+  vector<pair<string, uint64_t>> res;
+  if (!hot_keys_)
+    return res;
+  for (auto& [key, count] : hot_keys_->GetTopKeys())
+    res.emplace_back(key, count * hot_keys_sample_rate_);
+  return res;
+}
+
 void DbSlice::Reserve(DbIndex db_ind, size_t key_size) {
   ActivateDb(db_ind);
 
   auto& db = db_arr_[db_ind];
   DCHECK(db);
 
+  ssize_t table_before = db->prime.mem_usage();
   db->prime.Reserve(key_size);
+  ssize_t table_increase = db->prime.mem_usage() - table_before;
+  memory_budget_ -= table_increase;
+  table_memory_ += table_increase;
 }
 
 DbSlice::AutoUpdater::AutoUpdater() {
@@ -490,7 +776,7 @@ void DbSlice::AutoUpdater::Run() {
                   static_cast<int64_t>(fields_.orig_heap_size);
   AccountObjectMemory(fields_.key, fields_.it->second.ObjType(), delta,
                       fields_.db_slice->GetDBTable(fields_.db_ind));
-  fields_.db_slice->PostUpdate(fields_.db_ind, fields_.key);
+  fields_.db_slice->PostUpdate(fields_.db_ind, fields_.key, fields_.it->second.ObjType());
   Cancel();  // Reset to not run again
 }
 
@@ -545,39 +831,87 @@ DbSlice::ItAndExpConst DbSlice::FindReadOnly(const Context& cntx, std::string_vi
 
 OpResult<DbSlice::ConstIterator> DbSlice::FindReadOnly(const Context& cntx, string_view key,
                                                        unsigned req_obj_type) const {
-  auto res = FindInternal(cntx, key, req_obj_type, UpdateStatsMode::kReadStats);
+  auto res = FindInternal(cntx, key, req_obj_type, UpdateStatsMode::kReadStats, false);
   if (res.ok()) {
     return ConstIterator(res->it, StringOrView::FromView(key));
   }
   return res.status();
 }
 
+void DbSlice::FindReadOnlyBatch(const Context& cntx, absl::Span<const string_view> keys,
+                                optional<unsigned> req_obj_type,
+                                absl::FunctionRef<void(size_t, OpResult<ConstIterator>)> cb) const {
+  if (!IsDbValid(cntx.db_index)) {
+    LOG(DFATAL) << "Invalid db index " << cntx.db_index;
+    for (size_t i = 0; i < keys.size(); ++i)
+      cb(i, OpStatus::KEY_NOTFOUND);
+    return;
+  }
+
+  auto& db = *db_arr_[cntx.db_index];
+  db.prime.FindBatch(keys, [&](size_t index, PrimeIterator it) {
+    string_view key = keys[index];
+    auto res = ResolveFind(cntx, key, it, req_obj_type, UpdateStatsMode::kReadStats, false);
+    if (res.ok()) {
+      cb(index, ConstIterator(res->it, StringOrView::FromView(key)));
+    } else {
+      cb(index, res.status());
+    }
+  });
+}
+
+void DbSlice::PrefetchKeys(DbIndex db_ind, absl::Span<const string_view> keys) const {
+  if (!IsDbValid(db_ind))
+    return;
+
+  const auto& prime = db_arr_[db_ind]->prime;
+  for (string_view key : keys) {
+    prime.Prefetch(key);
+  }
+}
+
 auto DbSlice::FindInternal(const Context& cntx, string_view key, optional<unsigned> req_obj_type,
-                           UpdateStatsMode stats_mode) const -> OpResult<PrimeItAndExp> {
+                           UpdateStatsMode stats_mode, bool need_exp_it) const
+    -> OpResult<PrimeItAndExp> {
   if (!IsDbValid(cntx.db_index)) {  // Can it even happen?
     LOG(DFATAL) << "Invalid db index " << cntx.db_index;
     return OpStatus::KEY_NOTFOUND;
   }
 
+  auto& db = *db_arr_[cntx.db_index];
+  return ResolveFind(cntx, key, db.prime.Find(key), req_obj_type, stats_mode, need_exp_it);
+}
+
+auto DbSlice::ResolveFind(const Context& cntx, string_view key, PrimeIterator it,
+                          optional<unsigned> req_obj_type, UpdateStatsMode stats_mode,
+                          bool need_exp_it) const -> OpResult<PrimeItAndExp> {
   auto& db = *db_arr_[cntx.db_index];
   PrimeItAndExp res;
-  res.it = db.prime.Find(key);
+  res.it = it;
   int miss_weight = (stats_mode == UpdateStatsMode::kReadStats);
 
   if (!IsValid(res.it)) {
+    // Keys of a snapshot that is loaded lazily are fetched on their first miss. Fetching
+    // preempts, so the entry is looked up again afterwards.
+    if (auto fetcher = lazy_fetcher_; fetcher && fetcher->Fetch(cntx.db_index, key)) {
+      if (PrimeIterator fetched = db_arr_[cntx.db_index]->prime.Find(key); IsValid(fetched))
+        return ResolveFind(cntx, key, fetched, req_obj_type, stats_mode, need_exp_it);
+    }
     events_.misses += miss_weight;
     return OpStatus::KEY_NOTFOUND;
   }
 
   TouchTopKeysIfNeeded(key, db.top_keys);
   TouchHllIfNeeded(key, db.dense_hll);
+  SampleHotKey(key, hot_keys_.get(), hot_keys_sample_rate_, &hot_keys_countdown_);
 
   if (req_obj_type.has_value() && res.it->second.ObjType() != req_obj_type.value()) {
     events_.misses += miss_weight;
     return OpStatus::WRONG_TYPE;
   }
 
-  if (res.it->second.HasExpire()) {  // check expiry state
+  // check expiry state, the expire table lookup is skipped if the inline deadline is enough.
+  if (res.it->second.HasExpire() && (need_exp_it || !IsAliveByInlineExpire(cntx, res.it))) {
     res = ExpireIfNeeded(cntx, res.it);
     if (!IsValid(res.it)) {
       events_.misses += miss_weight;
@@ -587,8 +921,19 @@ auto DbSlice::FindInternal(const Context& cntx, string_view key, optional<unsign
 
   DCHECK(IsValid(res.it));
 
+  // Offloaded containers are loaded back before they are accessed. Loading preempts,
+  // so the entry is looked up again afterwards.
+  if (const PrimeValue& pv = res.it->second;
+      pv.IsExternal() && !pv.IsCool() && pv.ObjType() != OBJ_STRING) {
+    owner_->tiered_storage()->LoadContainer(cntx.db_index, key, pv);
+    return ResolveFind(cntx, key, db.prime.Find(key), req_obj_type, stats_mode, need_exp_it);
+  }
+
   if (IsCacheMode()) {
-    fetched_items_.insert({res.it->first.HashCode(), cntx.db_index});
+    uint64_t key_hash = res.it->first.HashCode();
+    fetched_items_.insert({key_hash, cntx.db_index});
+    if (freq_sketch_)
+      freq_sketch_->Increment(key_hash);
   }
 
   switch (stats_mode) {
@@ -694,6 +1039,19 @@ OpResult<DbSlice::ItAndUpdater> DbSlice::AddOrFindInternal(const Context& cntx,
   bool apply_memory_limit =
       !owner_->IsReplica() && !(ServerState::tlocal()->gstate() == GlobalState::LOADING);
 
+  // With a quota the budget is what is left of it, and in cache mode only the entries of this
+  // slice are evicted to make room.
+  if (memory_quota_) {
+    memory_budget_ = ssize_t(memory_quota_) - ssize_t(QuotaUsage());
+    if (apply_memory_limit && IsCacheMode() && memory_budget_ + memory_offset < 0) {
+      size_t goal = -(memory_budget_ + memory_offset);
+      uint32_t starting_segment_id = rand() % db.prime.GetSegmentCount();
+      auto [items, bytes] = FreeMemWithEvictionStepAtomic(cntx.db_index, starting_segment_id, goal);
+      events_.hard_evictions += items;
+      memory_budget_ += bytes;
+    }
+  }
+
   // If we are over limit in non-cache scenario, just be conservative and throw.
   if (apply_memory_limit && !IsCacheMode() && memory_budget_ + memory_offset < 0) {
     LOG_EVERY_T(WARNING, 1) << "AddOrFind: over limit, budget: " << memory_budget_
@@ -728,6 +1086,14 @@ OpResult<DbSlice::ItAndUpdater> DbSlice::AddOrFindInternal(const Context& cntx,
   memory_budget_ -= table_increase;
 
   if (memory_budget_ < 0 && apply_memory_limit) {
+    // Evicting the candidates sampled by the heartbeat is cheap enough to do inline.
+    if (!db.eviction_pool.empty() && IsCacheMode() && !WillBlockOnJournalWrite()) {
+      constexpr size_t kMaxInlineEvictions = 4;
+      size_t evict_goal = std::max<ssize_t>(512, (-memory_budget_) / 32);
+      auto [items, bytes] = EvictFromPool(cntx.db_index, evict_goal, kMaxInlineEvictions);
+      events_.hard_evictions += items;
+    }
+
     // We may reach the state when our memory usage is below the limit even if we
     // do not add new segments. For example, we have half full segments
     // and we add new objects or update the existing ones and our memory usage grows.
@@ -757,6 +1123,7 @@ OpResult<DbSlice::ItAndUpdater> DbSlice::AddOrFindInternal(const Context& cntx,
 
   TouchTopKeysIfNeeded(key, db.top_keys);
   TouchHllIfNeeded(key, db.dense_hll);
+  SampleHotKey(key, hot_keys_.get(), hot_keys_sample_rate_, &hot_keys_countdown_);
 
   events_.garbage_collected = db.prime.garbage_collected();
   events_.stash_unloaded = db.prime.stash_unloaded();
@@ -765,6 +1132,8 @@ OpResult<DbSlice::ItAndUpdater> DbSlice::AddOrFindInternal(const Context& cntx,
   if (db.slots_stats) {
     SlotId sid = KeySlot(key);
     db.slots_stats[sid].key_count += 1;
+    if (db.slot_key_index)
+      ++db.slot_key_index[sid][CompactObj::HashCode(key)];
   }
 
   return ItAndUpdater{
@@ -791,6 +1160,7 @@ void DbSlice::Del(Context cntx, Iterator it) {
     string_view key = it->first.GetSlice(&tmp);
     doc_del_cb_(key, cntx, it->second);
   }
+  QueueKeyspaceEvent(cntx.db_index, keyspace_events::GENERIC, "del", it.key());
   PerformDeletion(it, db.get());
 }
 
@@ -836,20 +1206,60 @@ void DbSlice::FlushSlotsFb(const cluster::SlotSet& slot_ids) {
   next_version = RegisterOnChange(std::move(on_change));
 
   ServerState& etl = *ServerState::tlocal();
+  bool indexed = TraverseSlotBuckets(slot_ids, [&](PrimeTable::bucket_iterator it) {
+    iterate_bucket(it);
+    ThisFiber::Yield();
+    return etl.gstate() != GlobalState::SHUTTING_DOWN;
+  });
+
   PrimeTable* pt = &db_arr_[0]->prime;
   PrimeTable::Cursor cursor;
-
-  do {
+  while (!indexed) {
     PrimeTable::Cursor next = pt->TraverseBuckets(cursor, iterate_bucket);
     cursor = next;
     ThisFiber::Yield();
-  } while (cursor && etl.gstate() != GlobalState::SHUTTING_DOWN);
+    if (!cursor || etl.gstate() == GlobalState::SHUTTING_DOWN)
+      break;
+  }
   VLOG(1) << "FlushSlotsFb del count is: " << del_count;
   UnregisterOnChange(next_version);
 
   etl.DecommitMemory(ServerState::kDataHeap);
 }
 
+bool DbSlice::TraverseSlotBuckets(const cluster::SlotSet& slots,
+                                  absl::FunctionRef<bool(PrimeTable::bucket_iterator)> cb) {
+  if (db_arr_.empty() || !db_arr_[0] || !db_arr_[0]->slot_key_index)
+    return false;
+
+  boost::intrusive_ptr<DbTable> db = db_arr_[0];  // keeps the table alive while cb preempts
+  PrimeTable& pt = db->prime;
+  vector<uint64_t> hashes;
+  vector<pair<unsigned, unsigned>> buckets;
+  for (SlotId slot = 0; slot <= kMaxSlotNum; ++slot) {
+    if (!slots.Contains(slot))
+      continue;
+
+    // The index changes while cb preempts.
+    hashes.clear();
+    for (const auto& [hash, count] : db->slot_key_index[slot])
+      hashes.push_back(hash);
+
+    for (uint64_t hash : hashes) {
+      buckets.clear();
+      pt.TraverseLogicalBucket(pt.HashCursor(hash), [&](PrimeIterator it) {
+        if (it->first.HashCode() == hash)
+          buckets.emplace_back(it.segment_id(), it.bucket_id());
+      });
+      for (auto [segment_id, bucket_id] : buckets) {
+        if (!cb(pt.BucketIt(segment_id, bucket_id)))
+          return true;
+      }
+    }
+  }
+  return true;
+}
+
 void DbSlice::FlushSlots(const cluster::SlotRanges& slot_ranges) {
   cluster::SlotSet slot_set(slot_ranges);
   InvalidateSlotWatches(slot_set);
@@ -859,6 +1269,14 @@ void DbSlice::FlushSlots(const cluster::SlotRanges& slot_ranges) {
 }
 
 void DbSlice::FlushDbIndexes(const std::vector<DbIndex>& indexes) {
+  InvalidateDeltaTracking();
+
+  // Entries of flushed dbs that were not loaded yet must not appear afterwards.
+  if (lazy_fetcher_) {
+    for (DbIndex index : indexes)
+      lazy_fetcher_->Cancel(index);
+  }
+
   bool clear_tiered = owner_->tiered_storage() != nullptr;
 
   if (clear_tiered)
@@ -884,7 +1302,25 @@ void DbSlice::FlushDbIndexes(const std::vector<DbIndex>& indexes) {
   LOG_IF(DFATAL, !fetched_items_.empty())
       << "Some operation might bumped up items outside of a transaction";
 
-  auto cb = [indexes, flush_db_arr = std::move(flush_db_arr)]() mutable {
+  auto cb = [indexes, threshold = async_free_threshold_,
+             flush_db_arr = std::move(flush_db_arr)]() mutable {
+    // Hand large containers over to the incremental deleter, so that destroying the tables
+    // below does not stall the thread on them.
+    if (threshold > 0) {
+      for (DbIndex index : indexes) {
+        PrimeTable& prime = flush_db_arr[index]->prime;
+        PrimeTable::Cursor cursor;
+        unsigned steps = 0;
+        do {
+          cursor = prime.Traverse(cursor, [threshold](PrimeIterator it) {
+            if (it->second.MallocUsed() > threshold)
+              AsyncDeleter::EnqueDeletion(&it->second);
+          });
+          if (++steps % 1024 == 0)
+            ThisFiber::Yield();
+        } while (cursor);
+      }
+    }
     flush_db_arr.clear();
     ServerState::tlocal()->DecommitMemory(ServerState::kDataHeap | ServerState::kBackingHeap |
                                           ServerState::kGlibcmalloc);
@@ -923,6 +1359,40 @@ void DbSlice::AddExpire(DbIndex db_ind, Iterator main_it, uint64_t at) {
   CHECK(db.expire.Insert(main_it->first.AsRef(), ExpirePeriod(delta)).second);
   table_memory_ += (db.expire.mem_usage() - table_before);
   main_it->second.SetExpire(true);
+  SetInlineExpire(main_it.GetInnerIt(), delta);
+  TrackExpiry(&db, main_it->first, at);
+}
+
+void DbSlice::SetExpireTime(DbIndex db_ind, Iterator main_it, ExpIterator exp_it, uint64_t at) {
+  DCHECK(IsValid(exp_it));
+  exp_it->second = FromAbsoluteTime(at);
+  SetInlineExpire(main_it.GetInnerIt(), at - expire_base_[0]);
+  TrackExpiry(db_arr_[db_ind].get(), main_it->first, at);
+}
+
+void DbSlice::TrackExpiry(DbTable* db, const PrimeKey& key, uint64_t at_ms) const {
+  if (db->expire_wheel) {
+    db->expire_wheel->Add(at_ms, db->expire.BucketCursor(key).token());
+  }
+
+  // Cached search results don't expect their documents to expire
+  if (owner_ && owner_->search_indices() && db->index == 0)
+    owner_->search_indices()->OnExpireSet(key);
+}
+
+void DbSlice::SetInlineExpire(PrimeIterator it, uint64_t delta_ms) const {
+#ifdef DFLY_INLINE_EXPIRE
+  it.SetExt(detail::InlineExpire::Encode(delta_ms));
+#endif
+}
+
+bool DbSlice::IsAliveByInlineExpire(const Context& cntx, PrimeIterator it) const {
+#ifdef DFLY_INLINE_EXPIRE
+  int64_t now_ms = int64_t(cntx.time_now_ms) - expire_base_[0];
+  return detail::InlineExpire::IsAlive(it.GetExt(), now_ms);
+#else
+  return false;
+#endif
 }
 
 bool DbSlice::RemoveExpire(DbIndex db_ind, Iterator main_it) {
@@ -1034,7 +1504,7 @@ OpResult<int64_t> DbSlice::UpdateExpire(const Context& cntx, Iterator prime_it,
       return OpStatus::SKIPPED;
     }
 
-    expire_it->second = FromAbsoluteTime(abs_msec);
+    SetExpireTime(cntx.db_index, prime_it, expire_it, abs_msec);
     return abs_msec;
   } else {
     if (params.expire_options & ExpireFlags::EXPIRE_XX) {
@@ -1074,11 +1544,18 @@ OpResult<DbSlice::ItAndUpdater> DbSlice::AddOrUpdateInternal(const Context& cntx
       res.exp_it = ExpIterator(exp_it, StringOrView::FromView(key));
       table_memory_ += (db.expire.mem_usage() - table_before);
     }
+    SetInlineExpire(it.GetInnerIt(), delta);
+    TrackExpiry(&db, it->first, expire_at_ms);
   }
 
   return op_result;
 }
 
+OpResult<DbSlice::ItAndUpdater> DbSlice::AddOrSkip(const Context& cntx, string_view key,
+                                                   PrimeValue obj, uint64_t expire_at_ms) {
+  return AddOrUpdateInternal(cntx, key, std::move(obj), expire_at_ms, false);
+}
+
 OpResult<DbSlice::ItAndUpdater> DbSlice::AddOrUpdate(const Context& cntx, string_view key,
                                                      PrimeValue obj, uint64_t expire_at_ms) {
   return AddOrUpdateInternal(cntx, key, std::move(obj), expire_at_ms, true);
@@ -1151,12 +1628,42 @@ bool DbSlice::CheckLock(IntentLock::Mode mode, DbIndex dbid, uint64_t fp) const
   return true;
 }
 
+bool DbSlice::IsLockGranted(IntentLock::Mode mode, const KeyLockArgs& lock_args) const {
+  const auto& lt = db_arr_[lock_args.db_index]->trans_locks;
+  for (LockFp fp : lock_args.fps) {
+    auto lock = lt.Find(fp);
+    DCHECK(lock);
+    if (lock && !lock->IsGranted(mode))
+      return false;
+  }
+  return true;
+}
+
+void DbSlice::PinRead(DbIndex dbid, string_view key) {
+  ++pinned_fps_[{dbid, LockTag(key).Fingerprint()}];
+}
+
+void DbSlice::UnpinRead(DbIndex dbid, string_view key) {
+  auto it = pinned_fps_.find({dbid, LockTag(key).Fingerprint()});
+  DCHECK(it != pinned_fps_.end());
+  if (it != pinned_fps_.end() && --it->second == 0)
+    pinned_fps_.erase(it);
+}
+
+bool DbSlice::IsPinned(DbIndex dbid, const PrimeKey& key) const {
+  if (pinned_fps_.empty())
+    return false;
+
+  string scratch;
+  return pinned_fps_.contains({dbid, LockTag(key.GetSlice(&scratch)).Fingerprint()});
+}
+
 void DbSlice::PreUpdateBlocking(DbIndex db_ind, Iterator it) {
   CallChangeCallbacks(db_ind, ChangeReq{it.GetInnerIt()});
   it.GetInnerIt().SetVersion(NextVersion());
 }
 
-void DbSlice::PostUpdate(DbIndex db_ind, std::string_view key) {
+void DbSlice::PostUpdate(DbIndex db_ind, std::string_view key, unsigned obj_type) {
   auto& db = *db_arr_[db_ind];
   auto& watched_keys = db.watched_keys;
   if (!watched_keys.empty()) {
@@ -1176,9 +1683,16 @@ void DbSlice::PostUpdate(DbIndex db_ind, std::string_view key) {
     db.slots_stats[KeySlot(key)].total_writes += 1;
   }
 
-  if (!client_tracking_map_.empty()) {
+  if (HasTrackedKeys()) {
     QueueInvalidationTrackingMessageAtomic(key);
   }
+
+  if (notify_keyspace_events_ && keyspace_event_cmd_) {
+    uint32_t cls = (keyspace_event_cmd_->acl_categories() & acl::KEYSPACE)
+                       ? keyspace_events::GENERIC
+                       : keyspace_events::ClassOfType(obj_type);
+    QueueKeyspaceEvent(db_ind, cls, keyspace_event_cmd_->name(), key);
+  }
 }
 
 DbSlice::ItAndExp DbSlice::ExpireIfNeeded(const Context& cntx, Iterator it) const {
@@ -1207,8 +1721,10 @@ DbSlice::PrimeItAndExp DbSlice::ExpireIfNeeded(const Context& cntx, PrimeIterato
   time_t expire_time = ExpireTime(expire_it);
 
   // Never do expiration on replica or if expiration is disabled or global lock was taken.
+  // Pinned values are still read by other threads, so they expire later.
   if (time_t(cntx.time_now_ms) < expire_time || owner_->IsReplica() || !expire_allowed_ ||
-      !shard_owner()->shard_lock()->Check(IntentLock::Mode::EXCLUSIVE)) {
+      !shard_owner()->shard_lock()->Check(IntentLock::Mode::EXCLUSIVE) ||
+      IsPinned(cntx.db_index, it->first)) {
     return {it, expire_it};
   }
 
@@ -1220,8 +1736,7 @@ DbSlice::PrimeItAndExp DbSlice::ExpireIfNeeded(const Context& cntx, PrimeIterato
     RecordExpiryBlocking(cntx.db_index, key);
   }
 
-  if (expired_keys_events_recording_)
-    db->expired_keys_events_.emplace_back(key);
+  QueueKeyspaceEvent(cntx.db_index, keyspace_events::EXPIRED, "expired", key);
 
   auto obj_type = it->second.ObjType();
   if (doc_del_cb_ && (obj_type == OBJ_JSON || obj_type == OBJ_HASH)) {
@@ -1307,6 +1822,30 @@ void DbSlice::UnregisterOnChange(uint64_t id) {
   change_cb_.erase(it);
 }
 
+optional<DbSlice::DeletedKeys> DbSlice::RestartDeltaTracking(uint64_t version) {
+  optional<DeletedKeys> res;
+  if (delta_state_ == DeltaState::kTracking || delta_state_ == DeltaState::kPinned)
+    res = std::move(delta_deleted_);
+
+  delta_state_ = DeltaState::kTracking;
+  delta_deleted_ = DeletedKeys{version, {}};
+  return res;
+}
+
+bool DbSlice::PinDeltaTracking() {
+  if (delta_state_ != DeltaState::kTracking && delta_state_ != DeltaState::kPinned)
+    return false;
+  delta_state_ = DeltaState::kPinned;
+  return true;
+}
+
+void DbSlice::InvalidateDeltaTracking() {
+  if (delta_state_ == DeltaState::kOff)
+    return;
+  delta_state_ = DeltaState::kInvalid;
+  delta_deleted_ = DeletedKeys{};
+}
+
 void DbSlice::UnregisterOnMoved(uint64_t id) {
   serialization_latch_.Wait();
   auto it =
@@ -1315,7 +1854,9 @@ void DbSlice::UnregisterOnMoved(uint64_t id) {
   moved_cb_.erase(it);
 }
 
-auto DbSlice::DeleteExpiredStep(const Context& cntx, unsigned count) -> DeleteExpiredStats {
+auto DbSlice::DeleteExpiredStep(const Context& cntx, unsigned count, uint64_t deadline_ns)
+    -> DeleteExpiredStats {
+  LatencyScope latency("expire-cycle");
   auto& db = *db_arr_[cntx.db_index];
   DeleteExpiredStats result;
 
@@ -1346,24 +1887,54 @@ auto DbSlice::DeleteExpiredStep(const Context& cntx, unsigned count) -> DeleteEx
     }
   };
 
+  // Checking the clock is not free, so we do it once in a few buckets.
+  auto out_of_time = [&](unsigned i) {
+    if (deadline_ns == 0 || i % 8 != 7)
+      return false;
+    result.throttled = ProactorBase::GetMonotonicTimeNs() > deadline_ns;
+    return result.throttled;
+  };
+
+  // Visit first the buckets that the expire wheel knows to have due entries. Entries of the
+  // minute slots that are not due yet are added back with second precision.
+  if (ExpireWheel* wheel = db.expire_wheel.get(); wheel) {
+    wheel->Advance(cntx.time_now_ms);
+    uint64_t minute_end = (cntx.time_now_ms / 60000 + 1) * 60000;
+    unsigned steps = 0;
+
+    auto visit = [&](vector<uint64_t>& tokens, bool coarse) {
+      while (!tokens.empty() && steps < count && !out_of_time(steps)) {
+        ExpireTable::Cursor curs{tokens.back()};
+        tokens.pop_back();
+        ++steps;
+        db.expire.TraverseLogicalBucket(curs, [&](ExpireIterator it) {
+          cb(it);
+          if (coarse && it.IsOccupied()) {
+            if (uint64_t at = ExpireTime(it); at < minute_end)
+              wheel->Add(at, curs.token());
+          }
+        });
+      }
+    };
+    visit(wheel->due_coarse(), true);
+    visit(wheel->due(), false);
+    count -= std::min(count, steps);
+  }
+
   unsigned i = 0;
-  for (; i < count / 3; ++i) {
+  for (; i < count / 3 && !result.throttled && !out_of_time(i); ++i) {
     db.expire_cursor = db.expire.Traverse(db.expire_cursor, cb);
   }
 
   // continue traversing only if we had strong deletion rate based on the first sample.
   if (result.deleted * 4 > result.traversed) {
-    for (; i < count; ++i) {
+    for (; i < count && !result.throttled && !out_of_time(i); ++i) {
       db.expire_cursor = db.expire.Traverse(db.expire_cursor, cb);
     }
   }
 
-  // Send and clear accumulated expired key events
-  if (auto& events = db_arr_[cntx.db_index]->expired_keys_events_; !events.empty()) {
-    ChannelStore* store = ServerState::tlocal()->channel_store();
-    store->SendMessages(absl::StrCat("__keyevent@", cntx.db_index, "__:expired"), events);
-    events.clear();
-  }
+  // Send the notifications of the expired keys
+  SendKeyspaceEvents();
 
   return result;
 }
@@ -1377,6 +1948,7 @@ int32_t DbSlice::GetNextSegmentForEviction(int32_t segment_id, DbIndex db_ind) c
 pair<uint64_t, size_t> DbSlice::FreeMemWithEvictionStepAtomic(DbIndex db_ind,
                                                               size_t starting_segment_id,
                                                               size_t increase_goal_bytes) {
+  LatencyScope latency("eviction-cycle");
   // Disable flush journal changes to prevent preemtion
   journal::JournalFlushGuard journal_flush_guard(shard_owner()->journal());
   FiberAtomicGuard guard;
@@ -1402,9 +1974,58 @@ pair<uint64_t, size_t> DbSlice::FreeMemWithEvictionStepAtomic(DbIndex db_ind,
 
   string tmp;
 
-  bool record_keys = owner_->journal() != nullptr || expired_keys_events_recording_;
+  bool record_keys =
+      owner_->journal() != nullptr || (notify_keyspace_events_ & keyspace_events::EVICTED);
   vector<string> keys_to_journal;
 
+  // With LFU we evict the least frequently used entry of each visited bucket instead.
+  if (freq_sketch_) {
+    for (int32_t bucket_id = PrimeTable::LargestBucketId(); bucket_id >= 0; --bucket_id) {
+      int32_t segment_id = starting_segment_id;
+      for (size_t num_seg_visited = 0; num_seg_visited < max_segment_to_consider;
+           ++num_seg_visited, segment_id = GetNextSegmentForEviction(segment_id, db_ind)) {
+        const auto& segment = db_table->prime.GetSegment(segment_id);
+        if (unsigned(bucket_id) >= segment->num_buckets())
+          bucket_id = segment->num_buckets() - 1;
+
+        PrimeTable::bucket_iterator evict_it;
+        unsigned min_freq = FrequencySketch::kMaxCount + 1;
+        auto bucket_it = db_table->prime.BucketIt(segment_id, bucket_id);
+        for (; !bucket_it.is_done(); ++bucket_it) {
+          bool has_allocated = bucket_it->second.HasAllocated() || bucket_it->first.HasAllocated();
+          if (bucket_it->first.IsSticky() || !has_allocated)
+            continue;
+
+          unsigned freq = freq_sketch_->Estimate(bucket_it->first.HashCode());
+          if (freq >= min_freq)
+            continue;
+
+          const auto& lt = db_table->trans_locks;
+          if (lt.Find(LockTag(bucket_it->first.GetSlice(&tmp))).has_value())
+            continue;
+
+          evict_it = bucket_it;
+          min_freq = freq;
+        }
+
+        if (evict_it.is_done())
+          continue;
+
+        string_view key = evict_it->first.GetSlice(&tmp);
+        if (record_keys)
+          keys_to_journal.emplace_back(key);
+
+        evicted_bytes += evict_it->first.MallocUsed() + evict_it->second.MallocUsed();
+        ++evicted_items;
+        PerformDeletion(Iterator(evict_it, StringOrView::FromView(key)), db_table.get());
+
+        if ((evicted_items == max_eviction_per_hb) || (evicted_bytes >= increase_goal_bytes))
+          goto finish;
+      }
+    }
+    goto finish;
+  }
+
   for (int32_t slot_id = num_slots - 1; slot_id >= 0; --slot_id) {
     for (int32_t bucket_id = PrimeTable::LargestBucketId(); bucket_id >= 0; --bucket_id) {
       // pick a random segment to start with in each eviction,
@@ -1453,8 +2074,7 @@ finish:
       // Won't block because we disabled journal flushing. See first line of this function.
       RecordExpiryBlocking(db_ind, key);
 
-    if (expired_keys_events_recording_)
-      db_table->expired_keys_events_.emplace_back(key);
+    QueueKeyspaceEvent(db_ind, keyspace_events::EVICTED, "evicted", key);
   }
 
   // This might not always be atomic on exceptional cases -- see comments on the function
@@ -1466,10 +2086,256 @@ finish:
   return pair<uint64_t, size_t>{evicted_items, evicted_bytes};
 }
 
+void DbSlice::OnValueReencoded(DbIndex db_ind, PrimeIterator it, string_view key,
+                               size_t orig_heap_size) {
+  ssize_t delta = ssize_t(it->second.MallocUsed()) - ssize_t(orig_heap_size);
+  AccountObjectMemory(key, it->second.ObjType(), delta, db_arr_[db_ind].get());
+}
+
+void DbSlice::OnFieldExpiry(DbIndex db_ind, string_view key, size_t size, uint32_t expire_time) {
+  if (field_expire_reap_min_size_ == 0 || size < field_expire_reap_min_size_)
+    return;
+
+  FieldExpiryQueue& queue = db_arr_[db_ind]->field_expiry_queue;
+  size_t queue_before = queue.mem_usage();
+  queue.Add(key, expire_time);
+  table_memory_ += (queue.mem_usage() - queue_before);
+}
+
+void DbSlice::ReapExpiredFields(const Context& cntx, unsigned max_buckets) {
+  constexpr unsigned kBucketsPerStep = 32;
+
+  // Like ExpireIfNeeded, leave the deletions to the master.
+  if (owner_->IsReplica() || !expire_allowed_)
+    return;
+
+  DbTable* db = db_arr_[cntx.db_index].get();
+  uint32_t now = MemberTimeSeconds(cntx.time_now_ms);
+  size_t queue_before = db->field_expiry_queue.mem_usage();
+  absl::Cleanup account_queue = [&] {
+    table_memory_ += (db->field_expiry_queue.mem_usage() - queue_before);
+  };
+
+  while (max_buckets > 0) {
+    if (db->field_reap_key.empty()) {
+      auto key = db->field_expiry_queue.PopDue(now);
+      if (!key)
+        return;
+      db->field_reap_key = std::move(*key);
+      db->field_reap_cursor = 0;
+      db->field_reap_min_expire = UINT32_MAX;
+    }
+
+    const string& key = db->field_reap_key;
+    PrimeIterator it = db->prime.Find(key);
+    DenseSet* ds = nullptr;
+    if (IsValid(it) && it->second.Encoding() == kEncodingStrMap2) {
+      if (it->second.ObjType() == OBJ_HASH)
+        ds = static_cast<StringMap*>(it->second.RObjPtr());
+      else if (it->second.ObjType() == OBJ_SET)
+        ds = static_cast<StringSet*>(it->second.RObjPtr());
+    }
+
+    // The key was deleted or converted, any new field expiry queues it again.
+    if (ds == nullptr) {
+      db->field_reap_key.clear();
+      continue;
+    }
+
+    // Retry on the next heartbeat, a transaction holds the key.
+    if (!CheckLock(IntentLock::EXCLUSIVE, cntx.db_index, key))
+      return;
+
+    unsigned step = std::min(max_buckets, kBucketsPerStep);
+    max_buckets -= step;
+
+    // Like HDEL, the hash is removed from the search indices and added back without the fields.
+    ShardDocIndices* indices =
+        it->second.ObjType() == OBJ_HASH ? owner_->search_indices() : nullptr;
+    if (indices)
+      indices->RemoveDoc(key, cntx, it->second);
+
+    size_t orig_heap_size = it->second.MallocUsed();
+    ds->set_time(now);
+    db->field_reap_cursor = ds->ExpireStep(db->field_reap_cursor, step, &db->field_reap_min_expire);
+    OnValueReencoded(cntx.db_index, it, key, orig_heap_size);
+
+    if (indices && !ds->Empty())
+      indices->AddDoc(key, cntx, it->second);
+
+    if (ds->Empty()) {
+      if (auto journal = owner_->journal(); journal)
+        RecordExpiryBlocking(cntx.db_index, key);
+      PerformDeletion(Iterator(it, StringOrView::FromView(key)), db);
+      db->field_reap_key.clear();
+    } else if (db->field_reap_cursor == 0) {
+      if (db->field_reap_min_expire != UINT32_MAX)
+        db->field_expiry_queue.Add(key, db->field_reap_min_expire);
+      db->field_reap_key.clear();
+    }
+  }
+}
+
+bool DbSlice::ReencodeStaleHuffman(DbIndex db_ind, PrimeIterator it) {
+  bool stale_key = it->first.HasStaleHuffman();
+  bool stale_value = it->second.HasStaleHuffman();
+  if (!stale_key && !stale_value)
+    return false;
+
+  DbTable* table = db_arr_[db_ind].get();
+  string key = it->first.ToString();
+  if (stale_key) {
+    // The expire and mcflag tables hold references to the bytes of the key, so their entries
+    // are removed before it is re-encoded and inserted again with the new key.
+    size_t table_before = table->expire.mem_usage();
+    optional<ExpirePeriod> period;
+    if (it->second.HasExpire()) {
+      auto exp_it = table->expire.Find(it->first);
+      CHECK(!exp_it.is_done());
+      period = exp_it->second;
+      table->expire.Erase(exp_it);
+    }
+    optional<uint32_t> mc_flag;
+    if (it->second.HasFlag()) {
+      auto flag_it = table->mcflag.Find(it->first);
+      CHECK(!flag_it.is_done());
+      mc_flag = flag_it->second;
+      table->mcflag.Erase(flag_it);
+    }
+
+    bool was_inline = it->first.IsInline();
+    ssize_t before = was_inline ? 0 : it->first.MallocUsed();
+    it->first.ReencodeString();
+
+    if (period)
+      table->expire.InsertNew(it->first.AsRef(), *period);
+    if (mc_flag)
+      table->mcflag.InsertNew(it->first.AsRef(), *mc_flag);
+    table_memory_ += (table->expire.mem_usage() - table_before);
+
+    bool is_inline = it->first.IsInline();
+    ssize_t delta = (is_inline ? 0 : ssize_t(it->first.MallocUsed())) - before;
+    if (was_inline != is_inline) {
+      if (is_inline)
+        ++table->stats.inline_keys;
+      else
+        --table->stats.inline_keys;
+    }
+    AccountObjectMemory(key, OBJ_STRING, delta, table);
+    memory_budget_ -= delta;
+  }
+
+  // The stashed value will be replaced once the stash finishes.
+  if (stale_value && !it->second.HasStashPending()) {
+    ssize_t before = it->second.MallocUsed();
+    it->second.ReencodeString();
+    ssize_t delta = ssize_t(it->second.MallocUsed()) - before;
+    AccountObjectMemory(key, OBJ_STRING, delta, table);
+    memory_budget_ -= delta;
+  }
+  return true;
+}
+
+void DbSlice::RefillEvictionPool(DbIndex db_ind) {
+  size_t pool_size = GetFlag(FLAGS_eviction_pool_size);
+  auto& db_table = db_arr_[db_ind];
+  auto& pool = db_table->eviction_pool;
+  if (pool.size() >= pool_size || db_table->prime.size() == 0)
+    return;
+
+  // Bound the work per call, each bucket contributes at most one candidate.
+  unsigned steps = 2 * (pool_size - pool.size());
+  auto cb = [&](PrimeTable::bucket_iterator bucket_it) {
+    uint64_t victim = 0;
+    unsigned min_freq = FrequencySketch::kMaxCount + 1;
+    for (; !bucket_it.is_done(); ++bucket_it) {
+      bool has_allocated = bucket_it->second.HasAllocated() || bucket_it->first.HasAllocated();
+      if (bucket_it->first.IsSticky() || !has_allocated)
+        continue;
+
+      // Without LFU we prefer the last slots of the bucket, like the eviction scan does.
+      unsigned freq = freq_sketch_ ? freq_sketch_->Estimate(bucket_it->first.HashCode()) : 0;
+      if (freq_sketch_ && freq >= min_freq)
+        continue;
+
+      victim = bucket_it->first.HashCode();
+      min_freq = freq;
+    }
+    if (victim)
+      pool.push_back(victim);
+  };
+
+  auto& cursor = db_table->eviction_cursor;
+  do {
+    cursor = db_table->prime.TraverseBuckets(cursor, cb);
+  } while (--steps > 0 && pool.size() < pool_size && cursor);
+}
+
+pair<uint64_t, size_t> DbSlice::EvictFromPool(DbIndex db_ind, size_t goal_bytes,
+                                              size_t max_items) {
+  // Disable flush journal changes to prevent preemtion, like FreeMemWithEvictionStepAtomic.
+  journal::JournalFlushGuard journal_flush_guard(shard_owner()->journal());
+  FiberAtomicGuard guard;
+  DCHECK(!owner_->IsReplica());
+
+  if (!expire_allowed_)
+    return {0, 0};
+
+  auto& db_table = db_arr_[db_ind];
+  auto& pool = db_table->eviction_pool;
+  size_t evicted_items = 0, evicted_bytes = 0;
+  string tmp;
+
+  bool record_keys =
+      owner_->journal() != nullptr || (notify_keyspace_events_ & keyspace_events::EVICTED);
+  vector<string> keys_to_journal;
+
+  while (!pool.empty() && evicted_items < max_items && evicted_bytes < goal_bytes) {
+    uint64_t key_hash = pool.back();
+    pool.pop_back();
+
+    // The candidate may have been deleted or moved since it was sampled.
+    PrimeIterator evict_it;
+    db_table->prime.TraverseLogicalBucket(db_table->prime.HashCursor(key_hash),
+                                          [&](PrimeIterator it) {
+                                            if (it->first.HashCode() == key_hash)
+                                              evict_it = it;
+                                          });
+    if (evict_it.is_done() || evict_it->first.IsSticky())
+      continue;
+
+    string_view key = evict_it->first.GetSlice(&tmp);
+    if (db_table->trans_locks.Find(LockTag(key)).has_value())
+      continue;
+
+    if (record_keys)
+      keys_to_journal.emplace_back(key);
+
+    evicted_bytes += evict_it->first.MallocUsed() + evict_it->second.MallocUsed();
+    ++evicted_items;
+    PerformDeletion(Iterator(evict_it, StringOrView::FromView(key)), db_table.get());
+  }
+
+  // send the deletion to the replicas.
+  for (string_view key : keys_to_journal) {
+    if (auto journal = owner_->journal(); journal)
+      // Won't block because we disabled journal flushing. See first line of this function.
+      RecordExpiryBlocking(db_ind, key);
+
+    QueueKeyspaceEvent(db_ind, keyspace_events::EVICTED, "evicted", key);
+  }
+
+  SendQueuedInvalidationMessagesAsync();
+  events_.evicted_keys += evicted_items;
+  return {evicted_items, evicted_bytes};
+}
+
 void DbSlice::CreateDb(DbIndex db_ind) {
   auto& db = db_arr_[db_ind];
   if (!db) {
-    db.reset(new DbTable{owner_->memory_resource(), db_ind});
+    db.reset(new DbTable{owner_->table_memory_resource(), db_ind});
+    if (GetFlag(FLAGS_expire_wheel))
+      db->expire_wheel = make_unique<ExpireWheel>(GetCurrentTimeMs());
     table_memory_ += db->table_memory();
   }
 }
@@ -1552,12 +2418,55 @@ void DbSlice::ResetEvents() {
   events_ = {};
 }
 
-void DbSlice::SetNotifyKeyspaceEvents(std::string_view notify_keyspace_events) {
-  expired_keys_events_recording_ = !notify_keyspace_events.empty();
+void DbSlice::SetNotifyKeyspaceEvents(uint32_t flags) {
+  // Without a channel nothing is published.
+  bool has_channel = flags & (keyspace_events::KEYSPACE | keyspace_events::KEYEVENT);
+  notify_keyspace_events_ = has_channel ? flags : 0;
+}
+
+void DbSlice::QueueKeyspaceEvent(DbIndex db_ind, uint32_t cls, string_view event,
+                                 string_view key) const {
+  if ((notify_keyspace_events_ & cls) == 0 || !ChannelStore::HasKeyspaceSubscribers())
+    return;
+  pending_keyspace_events_.push_back({db_ind, cls, event, string{key}});
+}
+
+void DbSlice::SendKeyspaceEvents() {
+  // Notifications can be queued while we block on sending, so we loop until none are left.
+  while (!pending_keyspace_events_.empty()) {
+    auto events = std::move(pending_keyspace_events_);
+    pending_keyspace_events_.clear();
+
+    // Group the messages by channel, so that every channel fetches its subscribers once.
+    absl::flat_hash_map<string, vector<string_view>> messages;
+    absl::node_hash_map<string_view, string> lower_names;  // stable storage of event names
+    for (const KeyspaceEvent& ev : events) {
+      auto [it, inserted] = lower_names.try_emplace(ev.event);
+      if (inserted)
+        it->second = absl::AsciiStrToLower(ev.event);
+      string_view event = it->second;
+
+      if (notify_keyspace_events_ & keyspace_events::KEYSPACE)
+        messages[absl::StrCat("__keyspace@", ev.db_ind, "__:", ev.key)].push_back(event);
+      if (notify_keyspace_events_ & keyspace_events::KEYEVENT)
+        messages[absl::StrCat("__keyevent@", ev.db_ind, "__:", event)].push_back(ev.key);
+    }
+
+    const ChannelStore* store = ServerState::tlocal()->channel_store();
+    for (const auto& [channel, msgs] : messages)
+      store->SendMessages(channel, msgs);
+  }
 }
 
 void DbSlice::QueueInvalidationTrackingMessageAtomic(std::string_view key) {
   FiberAtomicGuard guard;
+  for (const auto& [prefix, conns] : bcast_prefixes_) {
+    if (absl::StartsWith(key, prefix)) {
+      for (const auto& conn : conns)
+        pending_bcast_map_[conn].emplace(key);
+    }
+  }
+
   auto it = client_tracking_map_.find(key);
   if (it == client_tracking_map_.end()) {
     return;
@@ -1575,30 +2484,56 @@ void DbSlice::QueueInvalidationTrackingMessageAtomic(std::string_view key) {
   }
 }
 
-void DbSlice::SendQueuedInvalidationMessagesCb(const TrackingMap& track_map, unsigned idx) const {
+void DbSlice::UntrackPrefix(const facade::Connection::WeakRef& conn_ref, std::string_view prefix) {
+  auto it = bcast_prefixes_.find(prefix);
+  if (it == bcast_prefixes_.end())
+    return;
+
+  it->second.erase(conn_ref);
+  if (it->second.empty())
+    bcast_prefixes_.erase(it);
+}
+
+void DbSlice::SendQueuedInvalidationMessagesCb(const TrackingMap& track_map,
+                                               const BcastPendingMap& bcast_map,
+                                               unsigned idx) const {
+  auto is_tracking = [idx](const facade::Connection::WeakRef& client) {
+    if (client.IsExpired() || (client.Thread() != idx)) {
+      return false;
+    }
+    auto* cntx = static_cast<ConnectionContext*>(client.Get()->cntx());
+    return cntx && cntx->conn_state.tracking_info_.IsTrackingOn();
+  };
+
   for (auto& [key, client_list] : track_map) {
     for (auto& client : client_list) {
-      if (client.IsExpired() || (client.Thread() != idx)) {
-        continue;
-      }
-      auto* conn = client.Get();
-      auto* cntx = static_cast<ConnectionContext*>(conn->cntx());
-      if (cntx && cntx->conn_state.tracking_info_.IsTrackingOn()) {
-        conn->SendInvalidationMessageAsync({key});
+      if (is_tracking(client)) {
+        facade::Connection::InvalidationMessage msg;
+        msg.keys.push_back(key);
+        client.Get()->SendInvalidationMessageAsync(std::move(msg));
       }
     }
   }
+
+  for (auto& [client, keys] : bcast_map) {
+    if (is_tracking(client)) {
+      facade::Connection::InvalidationMessage msg;
+      msg.keys.assign(keys.begin(), keys.end());
+      client.Get()->SendInvalidationMessageAsync(std::move(msg));
+    }
+  }
 }
 
 void DbSlice::SendQueuedInvalidationMessages() {
   // We run while loop because when we block below, we might have new items added to
-  // pending_send_map_.
-  while (!pending_send_map_.empty()) {
+  // the pending maps.
+  while (HasPendingInvalidations()) {
     // Notify all the clients. this function is not efficient,
     // because it broadcasts to all threads unrelated to the subscribers for the key.
     auto local_map = std::move(pending_send_map_);
+    auto local_bcast = std::move(pending_bcast_map_);
     auto cb = [&](unsigned idx, util::ProactorBase*) {
-      SendQueuedInvalidationMessagesCb(local_map, idx);
+      SendQueuedInvalidationMessagesCb(local_map, local_bcast, idx);
     };
 
     shard_set->pool()->AwaitBrief(std::move(cb));
@@ -1608,12 +2543,13 @@ void DbSlice::SendQueuedInvalidationMessages() {
 // This function might preempt if the task queue within DispatchBrief is full and we can't
 // enqueue the callback. Although a rare case, this code might not be atomic.
 void DbSlice::SendQueuedInvalidationMessagesAsync() {
-  if (pending_send_map_.empty()) {
+  if (!HasPendingInvalidations()) {
     return;
   }
-  // DispatchBrief will copy local_map
-  auto cb = [lm = std::move(pending_send_map_), this](unsigned idx, util::ProactorBase*) {
-    SendQueuedInvalidationMessagesCb(lm, idx);
+  // DispatchBrief will copy the maps
+  auto cb = [lm = std::move(pending_send_map_), bm = std::move(pending_bcast_map_), this](
+                unsigned idx, util::ProactorBase*) {
+    SendQueuedInvalidationMessagesCb(lm, bm, idx);
   };
 
   shard_set->pool()->DispatchBrief(std::move(cb));
@@ -1683,6 +2619,14 @@ size_t DbSlice::StopSampleKeys(DbIndex db_ind) {
 
 void DbSlice::PerformDeletionAtomic(Iterator del_it, ExpIterator exp_it, DbTable* table) {
   FiberAtomicGuard guard;
+  // Pinned values are written to sockets by other threads, see PinRead.
+  DCHECK(!IsPinned(table->index, del_it->first)) << del_it.key();
+  if (delta_state_ == DeltaState::kTracking || delta_state_ == DeltaState::kPinned) {
+    if (delta_state_ == DeltaState::kTracking && delta_deleted_.keys.size() >= kMaxDeltaDeletes)
+      InvalidateDeltaTracking();
+    else
+      delta_deleted_.keys.emplace_back(table->index, del_it.key());
+  }
   size_t table_before = table->table_memory();
   if (!exp_it.is_done()) {
     table->expire.Erase(exp_it.GetInnerIt());
@@ -1715,23 +2659,25 @@ void DbSlice::PerformDeletionAtomic(Iterator del_it, ExpIterator exp_it, DbTable
   }
   AccountObjectMemory(del_it.key(), pv.ObjType(), -value_heap_size, table);  // Value
 
-  if (del_it->first.IsAsyncDelete() && pv.ObjType() == OBJ_SET &&
-      pv.Encoding() == kEncodingStrMap2) {
-    DenseSet* ds = (DenseSet*)pv.RObjPtr();
-    pv.SetRObjPtr(nullptr);
-    const size_t kClearStepSize = 512;
-
-    uint32_t next = ds->ClearStep(0, kClearStepSize);
-    if (next < ds->BucketCount()) {
-      AsyncDeleter::EnqueDeletion(next, ds);
-    } else {
-      CompactObj::DeleteMR<DenseSet>(ds);
-    }
-  }  // del_it->first.IsAsyncDelete()
+  // Queued containers still occupy memory, so they are credited back to the budget only when
+  // it is refreshed after they were released.
+  ssize_t queued_bytes = 0;
+  if (del_it->first.IsAsyncDelete() || IsLargeValue(value_heap_size)) {
+    size_t pending = AsyncDeleter::PendingBytes();
+    AsyncDeleter::EnqueDeletion(&pv);
+    queued_bytes = AsyncDeleter::PendingBytes() - pending;
+  }
 
   if (table->slots_stats) {
     SlotId sid = KeySlot(del_it.key());
     table->slots_stats[sid].key_count -= 1;
+    if (table->slot_key_index) {
+      auto& hashes = table->slot_key_index[sid];
+      auto it = hashes.find(del_it->first.HashCode());
+      DCHECK(it != hashes.end());
+      if (it != hashes.end() && --it->second == 0)
+        hashes.erase(it);
+    }
   }
 
   table->prime.Erase(del_it.GetInnerIt());
@@ -1742,13 +2688,18 @@ void DbSlice::PerformDeletionAtomic(Iterator del_it, ExpIterator exp_it, DbTable
   DCHECK_EQ(table->table_memory(), table_before);
 
   --entries_count_;
-  memory_budget_ += (value_heap_size + key_size_used);
+  memory_budget_ += (value_heap_size + key_size_used - queued_bytes);
 
-  if (!client_tracking_map_.empty()) {
+  if (HasTrackedKeys()) {
     QueueInvalidationTrackingMessageAtomic(del_it.key());
   }
 }
 
+void DbSlice::ReleaseIfLarge(PrimeValue* pv) {
+  if (IsLargeValue(pv->MallocUsed()))
+    AsyncDeleter::EnqueDeletion(pv);
+}
+
 void DbSlice::PerformDeletion(Iterator del_it, DbTable* table) {
   ExpIterator exp_it;
   if (del_it->second.HasExpire()) {
@@ -1795,8 +2746,9 @@ void DbSlice::OnCbFinishBlocking() {
     }
   }
 
-  // Sends only if !pending_send_map_.empty()
+  // Sends only if there are pending invalidations
   SendQueuedInvalidationMessages();
+  SendKeyspaceEvents();
 }
 
 void DbSlice::CallChangeCallbacks(DbIndex id, const ChangeReq& cr) const {
@@ -4,6 +4,9 @@
 
 #pragma once
 
+#include <absl/functional/function_ref.h>
+
+#include "core/frequency_sketch.h"
 #include "core/mi_memory_resource.h"
 #include "core/string_or_view.h"
 #include "facade/dragonfly_connection.h"
@@ -14,6 +17,10 @@
 #include "util/fibers/fibers.h"
 #include "util/fibers/synchronization.h"
 
+namespace facade {
+class CommandId;
+}  // namespace facade
+
 namespace dfly {
 
 namespace cluster {
@@ -21,6 +28,10 @@ class SlotRanges;
 class SlotSet;
 }  // namespace cluster
 
+namespace detail {
+class LazyKeyFetcher;
+}  // namespace detail
+
 using facade::OpResult;
 
 struct DbStats : public DbTableStats {
@@ -39,6 +50,9 @@ struct DbStats : public DbTableStats {
   // Memory used by dictionaries.
   size_t table_mem_usage = 0;
 
+  // Memory used by the expiry timing wheel, if --expire_wheel is enabled.
+  size_t expire_wheel_mem_usage = 0;
+
   using DbTableStats::operator+=;
   using DbTableStats::operator=;
 
@@ -74,6 +88,7 @@ struct SliceEvents {
   size_t update = 0;
 
   uint64_t huff_encode_total = 0, huff_encode_success = 0;
+  uint64_t zstd_encode_total = 0, zstd_encode_success = 0;
 
   SliceEvents& operator+=(const SliceEvents& o);
 };
@@ -189,6 +204,7 @@ class DbSlice {
     std::vector<DbStats> db_stats;
     SliceEvents events;
     size_t small_string_bytes = 0;
+    size_t async_free_pending_bytes = 0;  // deleted containers not released yet.
   };
 
   using Context = DbContext;
@@ -240,6 +256,7 @@ class DbSlice {
   DbSlice(uint32_t index, bool cache_mode, EngineShard* owner);
   ~DbSlice();
 
+  // Pre-sizes the prime table of `db_ind` to hold key_size keys.
   // Activates `db_ind` database if it does not exist (see ActivateDb below).
   void Reserve(DbIndex db_ind, size_t key_size);
 
@@ -249,6 +266,20 @@ class DbSlice {
   // Returns slot statistics for db 0.
   SlotStats GetSlotStats(SlotId sid) const;
 
+  // Recomputes the operation rates of the slots of db 0 once a second has passed since the
+  // previous computation. Called periodically in cluster mode.
+  void UpdateSlotRates(uint64_t now_ms);
+
+  // Halves the access counts of the hot keys every kHotKeysDecayMs, so that they reflect the
+  // recent load. Called periodically.
+  void DecayHotKeys(uint64_t now_ms);
+
+  // Hottest keys of the shard across all databases, with the estimated number of their accesses
+  // in the last decay periods. Empty if --hotkeys_sample_rate is 0.
+  std::vector<std::pair<std::string, uint64_t>> GetHotKeys() const;
+
+  static constexpr uint64_t kHotKeysDecayMs = 10'000;
+
   void UpdateExpireBase(uint64_t now, unsigned generation) {
     expire_base_[generation & 1] = now;
   }
@@ -268,6 +299,17 @@ class DbSlice {
     return bytes_per_object_;
   }
 
+  // Limits the memory of the slice to bytes, 0 means no quota. Slices of namespaces with a
+  // memory quota reject or, in cache mode, evict on their own usage instead of the global budget.
+  void SetMemoryQuota(size_t bytes) {
+    memory_quota_ = bytes;
+    if (bytes == 0)  // refreshed by SetCachedParams for slices with a global budget
+      memory_budget_ = SSIZE_MAX / 2;
+  }
+
+  // Memory of the tables and objects of all databases, as accounted against the quota.
+  size_t QuotaUsage() const;
+
   // returns absolute time of the expiration.
   time_t ExpireTime(const ExpConstIterator& it) const {
     return ExpireTime(it.GetInnerIt());
@@ -305,6 +347,17 @@ class DbSlice {
   OpResult<ConstIterator> FindReadOnly(const Context& cntx, std::string_view key,
                                        unsigned req_obj_type) const;
 
+  // Batched version of FindReadOnly. Prefetches the table buckets of all the keys before
+  // resolving them one by one. Calls cb(index, result) for each key in keys, in order.
+  // Keys of any type are accepted if req_obj_type is not set.
+  void FindReadOnlyBatch(const Context& cntx, absl::Span<const std::string_view> keys,
+                         std::optional<unsigned> req_obj_type,
+                         absl::FunctionRef<void(size_t, OpResult<ConstIterator>)> cb) const;
+
+  // Prefetches the prime table buckets of the keys, so that the subsequent lookups would not
+  // stall on cache misses.
+  void PrefetchKeys(DbIndex db_ind, absl::Span<const std::string_view> keys) const;
+
   // Consider using req_obj_type to specify the type of object you expect.
   // Because it can evaluate to bugs like this:
   // - We already have a key but with another type you expect.
@@ -316,6 +369,11 @@ class DbSlice {
   OpResult<ItAndUpdater> AddOrFind(const Context& cntx, std::string_view key,
                                    std::optional<unsigned> req_obj_type);
 
+  // Adds the entry if the key does not exist, otherwise keeps the existing entry and drops obj.
+  // is_new of the result tells which of the two happened.
+  OpResult<ItAndUpdater> AddOrSkip(const Context& cntx, std::string_view key, PrimeValue obj,
+                                   uint64_t expire_at_ms);
+
   // Same as AddOrSkip, but overwrites in case entry exists.
   OpResult<ItAndUpdater> AddOrUpdate(const Context& cntx, std::string_view key, PrimeValue obj,
                                      uint64_t expire_at_ms);
@@ -334,6 +392,9 @@ class DbSlice {
   // Adds expiry information.
   void AddExpire(DbIndex db_ind, Iterator main_it, uint64_t at);
 
+  // Overrides the existing expiry of main_it, exp_it must be valid.
+  void SetExpireTime(DbIndex db_ind, Iterator main_it, ExpIterator exp_it, uint64_t at);
+
   // Removes the corresponing expiry information if exists.
   // Returns true if expiry existed (and removed).
   bool RemoveExpire(DbIndex db_ind, Iterator main_it);
@@ -351,6 +412,28 @@ class DbSlice {
   // Delete a key referred by its iterator.
   void PerformDeletion(Iterator del_it, DbTable* table);
 
+  // If `pv` is a container larger than --async_free_threshold, detaches it and releases it
+  // incrementally in the background. Used before overwriting values in place.
+  void ReleaseIfLarge(PrimeValue* pv);
+
+  // Re-encodes the key and the string value of it if they use a huffman table that is being
+  // replaced. Returns true if either of them did.
+  bool ReencodeStaleHuffman(DbIndex db_ind, PrimeIterator it);
+
+  // Accounts the memory of a value that a background task re-encoded in place, i.e. without
+  // FindMutable. orig_heap_size is the MallocUsed() of the value before.
+  void OnValueReencoded(DbIndex db_ind, PrimeIterator it, std::string_view key,
+                        size_t orig_heap_size);
+
+  // Queues a hash or a set with size elements for background deletion of its expired fields
+  // if it is large enough, see --field_expire_reap_min_size. expire_time is in
+  // MemberTimeSeconds units.
+  void OnFieldExpiry(DbIndex db_ind, std::string_view key, size_t size, uint32_t expire_time);
+
+  // Deletes the expired fields of the queued hashes and sets that are due, traversing up to
+  // max_buckets buckets of them. Deletes the keys that become empty.
+  void ReapExpiredFields(const Context& cntx, unsigned max_buckets);
+
   // Deletes the iterator. The iterator must be valid.
   void Del(Context cntx, Iterator it);
 
@@ -362,6 +445,12 @@ class DbSlice {
   // Flushes the data of given slot ranges.
   void FlushSlots(const cluster::SlotRanges& slot_ranges);
 
+  // Calls cb for the buckets of db 0 that hold keys of the slots, using the slot key index.
+  // Returns false if the index is disabled. cb may preempt and return false to stop. Buckets may
+  // be visited more than once, and keys added during the traversal may be missed.
+  bool TraverseSlotBuckets(const cluster::SlotSet& slots,
+                           absl::FunctionRef<bool(PrimeTable::bucket_iterator)> cb);
+
   EngineShard* shard_owner() const {
     return owner_;
   }
@@ -377,10 +466,24 @@ class DbSlice {
 
   // Returns true if the key can be locked under m. Does not lock.
   bool CheckLock(IntentLock::Mode mode, DbIndex dbid, uint64_t fp) const;
+
+  // Returns true if the locks acquired with `lock_args` have no intents from other transactions
+  // conflicting with them, i.e. their holder could run regardless of its position in the queue.
+  bool IsLockGranted(IntentLock::Mode mode, const KeyLockArgs& lock_args) const;
   bool CheckLock(IntentLock::Mode mode, DbIndex dbid, std::string_view key) const {
     return CheckLock(mode, dbid, LockTag(key).Fingerprint());
   }
 
+  // Pinned reads write values to sockets from other threads directly from the table memory,
+  // while their keys stay read-locked. Background tasks that move or release values without
+  // taking locks (defragmentation, tiered offloading) and lazy expiry must skip pinned keys.
+  void PinRead(DbIndex dbid, std::string_view key);
+  void UnpinRead(DbIndex dbid, std::string_view key);
+
+  // Returns true if the key has pinned reads in flight. Keys with the same lock fingerprint are
+  // conservatively reported as pinned as well.
+  bool IsPinned(DbIndex dbid, const PrimeKey& key) const;
+
   size_t db_array_size() const {
     return db_arr_.size();
   }
@@ -460,15 +563,35 @@ class DbSlice {
 
   void UnregisterOnMoved(uint64_t id);
 
+  // Keys deleted since the start of the snapshot with the given version.
+  struct DeletedKeys {
+    uint64_t version = 0;
+    std::vector<std::pair<DbIndex, std::string>> keys;
+  };
+
+  // Starts tracking deletions for the snapshot with the given version and returns the ones
+  // tracked for the previous snapshot. Returns nullopt if they were not tracked completely.
+  std::optional<DeletedKeys> RestartDeltaTracking(uint64_t version);
+
+  // Returns true if all deletions since the last RestartDeltaTracking were tracked. If so, keeps
+  // tracking them without a limit until the next restart, so the result stays valid.
+  bool PinDeltaTracking();
+
+  // Stops tracking until the next restart, for example when the db is flushed.
+  void InvalidateDeltaTracking();
+
   struct DeleteExpiredStats {
     uint32_t deleted = 0;         // number of deleted items due to expiry (less than traversed).
     uint32_t deleted_bytes = 0;   // total bytes of deleted items.
     uint32_t traversed = 0;       // number of traversed items that have ttl bit
     size_t survivor_ttl_sum = 0;  // total sum of ttl of survivors (traversed - deleted).
+    bool throttled = false;       // stopped early because deadline_ns was reached.
   };
 
-  // Deletes some amount of possible expired items.
-  DeleteExpiredStats DeleteExpiredStep(const Context& cntx, unsigned count);
+  // Deletes some amount of possible expired items by traversing up to count buckets of the
+  // expire table. If deadline_ns is set, stops the traversal once the monotonic clock passes it.
+  DeleteExpiredStats DeleteExpiredStep(const Context& cntx, unsigned count,
+                                       uint64_t deadline_ns = 0);
 
   // Evicts items with dynamically allocated data from the primary table.
   // Does not shrink tables.
@@ -479,6 +602,14 @@ class DbSlice {
 
   int32_t GetNextSegmentForEviction(int32_t segment_id, DbIndex db_ind) const;
 
+  // Samples eviction candidates of db_ind into its eviction pool, continuing from where the
+  // previous call stopped, until the pool holds --eviction_pool_size entries.
+  void RefillEvictionPool(DbIndex db_ind);
+
+  // Evicts the pooled candidates of db_ind until goal_bytes are freed or max_items are evicted.
+  // Returns number of (elements,bytes) freed.
+  std::pair<uint64_t, size_t> EvictFromPool(DbIndex db_ind, size_t goal_bytes, size_t max_items);
+
   const DbTableArray& databases() const {
     return db_arr_;
   }
@@ -492,6 +623,16 @@ class DbSlice {
     return cache_mode_ && (load_ref_count_ == 0);
   }
 
+  // Access frequency estimator of the keys, set if LFU eviction is enabled.
+  const FrequencySketch* freq_sketch() const {
+    return freq_sketch_.get();
+  }
+
+  // Write frequency estimator of hashes, set if hash_write_sketch_counters is positive.
+  FrequencySketch* hash_write_sketch() {
+    return hash_write_sketch_.get();
+  }
+
   void IncrLoadInProgress() {
     ++load_ref_count_;
   }
@@ -504,6 +645,15 @@ class DbSlice {
     return load_ref_count_ == 0;
   }
 
+  // Set while a snapshot is loaded lazily, lookups that miss fetch the keys through it.
+  void SetLazyFetcher(std::shared_ptr<detail::LazyKeyFetcher> fetcher) {
+    lazy_fetcher_ = std::move(fetcher);
+  }
+
+  const std::shared_ptr<detail::LazyKeyFetcher>& lazy_fetcher() const {
+    return lazy_fetcher_;
+  }
+
   // Test hook to inspect last locked keys.
   const auto& TEST_GetLastLockedFps() const {
     return uniq_fps_;
@@ -534,9 +684,22 @@ class DbSlice {
     client_tracking_map_[key].insert(conn_ref);
   }
 
-  // Does not check for non supported events. Callers must parse the string and reject it
-  // if it's not empty and not EX.
-  void SetNotifyKeyspaceEvents(std::string_view notify_keyspace_events);
+  // BCAST tracking mode: the connection is notified about every change to keys starting with
+  // `prefix` without per-key bookkeeping. An empty prefix matches all keys.
+  void TrackPrefix(const facade::Connection::WeakRef& conn_ref, std::string_view prefix) {
+    bcast_prefixes_[prefix].insert(conn_ref);
+  }
+
+  void UntrackPrefix(const facade::Connection::WeakRef& conn_ref, std::string_view prefix);
+
+  // Sets the keyspace notification flags, see keyspace_events::Flag.
+  void SetNotifyKeyspaceEvents(uint32_t flags);
+
+  // Sets the command whose writes are reported as keyspace notifications, while its callback
+  // runs. Writes without a command, like DEBUG POPULATE, are not reported.
+  void SetKeyspaceEventCmd(const facade::CommandId* cid) {
+    keyspace_event_cmd_ = cid;
+  }
 
   bool WillBlockOnJournalWrite() const {
     return serialization_latch_.IsBlocked();
@@ -560,7 +723,16 @@ class DbSlice {
 
  private:
   void PreUpdateBlocking(DbIndex db_ind, Iterator it);
-  void PostUpdate(DbIndex db_ind, std::string_view key);
+  void PostUpdate(DbIndex db_ind, std::string_view key, unsigned obj_type);
+
+  // Queues a keyspace notification of the class, if the class is enabled and the notification
+  // may have subscribers. Queued notifications are published in batches by SendKeyspaceEvents.
+  void QueueKeyspaceEvent(DbIndex db_ind, uint32_t cls, std::string_view event,
+                          std::string_view key) const;
+
+  // Publishes the queued keyspace notifications, one message batch per channel.
+  // Blocks on subscriber backpressure.
+  void SendKeyspaceEvents();
 
   bool DelEmptyPrimeValue(const Context& cntx, Iterator it);
 
@@ -582,6 +754,10 @@ class DbSlice {
 
   void PerformDeletionAtomic(Iterator del_it, ExpIterator exp_it, DbTable* table);
 
+  bool IsLargeValue(size_t heap_size) const {
+    return async_free_threshold_ > 0 && heap_size > async_free_threshold_;
+  }
+
   // Queues invalidation message to the clients that are tracking the change to a key.
   void QueueInvalidationTrackingMessageAtomic(std::string_view key);
   void SendQueuedInvalidationMessages();
@@ -604,9 +780,25 @@ class DbSlice {
   OpResult<ItAndUpdater> AddOrFindInternal(const Context& cntx, std::string_view key,
                                            std::optional<unsigned> req_obj_type);
 
+  // If need_exp_it is false, the returned exp_it may be invalid even if the entry has expiry.
   OpResult<PrimeItAndExp> FindInternal(const Context& cntx, std::string_view key,
                                        std::optional<unsigned> req_obj_type,
-                                       UpdateStatsMode stats_mode) const;
+                                       UpdateStatsMode stats_mode, bool need_exp_it = true) const;
+
+  // Second part of FindInternal, that runs after the key has been looked up in the prime table.
+  OpResult<PrimeItAndExp> ResolveFind(const Context& cntx, std::string_view key, PrimeIterator it,
+                                      std::optional<unsigned> req_obj_type,
+                                      UpdateStatsMode stats_mode, bool need_exp_it = true) const;
+
+  // Caches the expiry deadline inside the prime table slot. No-op without DFLY_INLINE_EXPIRE.
+  void SetInlineExpire(PrimeIterator it, uint64_t delta_ms) const;
+
+  // Registers the expire table bucket of key in the expire wheel of db, if it has one.
+  void TrackExpiry(DbTable* db, const PrimeKey& key, uint64_t at_ms) const;
+
+  // Returns true if the inline deadline proves that the entry has not expired yet.
+  // Returns false if the entry has expired or it is not known.
+  bool IsAliveByInlineExpire(const Context& cntx, PrimeIterator it) const;
   OpResult<ItAndUpdater> FindMutableInternal(const Context& cntx, std::string_view key,
                                              std::optional<unsigned> req_obj_type);
 
@@ -629,15 +821,20 @@ class DbSlice {
 
   time_t expire_base_[2];  // Used for expire logic, represents a real clock.
   bool expire_allowed_ = true;
+  uint32_t field_expire_reap_min_size_ = 0;
+  uint64_t async_free_threshold_ = 0;
 
   uint64_t version_ = 1;  // Used to version entries in the PrimeTable.
   uint64_t next_moved_id_ = 1;
   ssize_t memory_budget_ = SSIZE_MAX / 2;
   size_t bytes_per_object_ = 0;
   size_t soft_budget_limit_ = 0;
+  size_t memory_quota_ = 0;
   size_t table_memory_ = 0;
   uint64_t entries_count_ = 0;
   unsigned load_ref_count_ = 0;
+  // Lock fingerprints of the pinned keys, with the number of pinned reads of each.
+  absl::flat_hash_map<std::pair<DbIndex, LockFp>, unsigned> pinned_fps_;
 
   mutable SliceEvents events_;  // we may change this even for const operations.
 
@@ -673,11 +870,43 @@ class DbSlice {
   // cleared or changed.
   mutable absl::flat_hash_set<FetchedItemKey, FpHasher> fetched_items_;
 
+  // Counts key accesses in cache mode when --cache_eviction_policy=lfu.
+  std::unique_ptr<FrequencySketch> freq_sketch_;
+  std::unique_ptr<FrequencySketch> hash_write_sketch_;
+
+  // Samples one of every hot_keys_sample_rate_ key accesses, set if --hotkeys_sample_rate > 0.
+  std::unique_ptr<TopKeys> hot_keys_;
+  uint32_t hot_keys_sample_rate_ = 0;
+  mutable uint32_t hot_keys_countdown_ = 0;
+  uint64_t hot_keys_decay_ms_ = 0;
+
+  // Reads and writes of the slots of db 0 at the last UpdateSlotRates computation.
+  std::unique_ptr<uint64_t[]> slot_ops_prev_;
+  uint64_t slot_rates_ms_ = 0;
+
   // Registered by shard indices on when first document index is created.
   DocDeletionCallback doc_del_cb_;
 
-  // Record whenever a key expired to DbTable::expired_keys_events_ for keyspace notifications
-  bool expired_keys_events_recording_ = true;
+  // Keyspace notifications, see keyspace_events::Flag. 0 if no channel is enabled.
+  uint32_t notify_keyspace_events_ = 0;
+  const facade::CommandId* keyspace_event_cmd_ = nullptr;
+
+  struct KeyspaceEvent {
+    DbIndex db_ind;
+    uint32_t cls;
+    std::string_view event;  // static string or command name, lower cased when published
+    std::string key;
+  };
+
+  // Notifications generated since the last batch was published.
+  mutable std::vector<KeyspaceEvent> pending_keyspace_events_;
+
+  std::shared_ptr<detail::LazyKeyFetcher> lazy_fetcher_;
+
+  // Deletions tracked for delta snapshots, see RestartDeltaTracking.
+  enum class DeltaState : uint8_t { kOff, kTracking, kPinned, kInvalid };
+  DeltaState delta_state_ = DeltaState::kOff;
+  DeletedKeys delta_deleted_;
 
   struct Hash {
     size_t operator()(const facade::Connection::WeakRef& c) const {
@@ -707,7 +936,27 @@ class DbSlice {
                           absl::container_internal::hash_default_eq<std::string>, AllocatorType>;
   TrackingMap client_tracking_map_, pending_send_map_;
 
-  void SendQueuedInvalidationMessagesCb(const TrackingMap& track_map, unsigned idx) const;
+  // BCAST mode subscriptions. The number of distinct prefixes is expected to be small,
+  // so every modified key is matched against all of them.
+  using BcastSet = absl::flat_hash_set<facade::Connection::WeakRef, Hash>;
+  absl::flat_hash_map<std::string, BcastSet> bcast_prefixes_;
+
+  // Keys pending invalidation for BCAST connections, grouped by connection so that each one
+  // receives a single push per batch instead of one per key.
+  using BcastPendingMap =
+      absl::flat_hash_map<facade::Connection::WeakRef, absl::flat_hash_set<std::string>, Hash>;
+  BcastPendingMap pending_bcast_map_;
+
+  bool HasTrackedKeys() const {
+    return !client_tracking_map_.empty() || !bcast_prefixes_.empty();
+  }
+
+  bool HasPendingInvalidations() const {
+    return !pending_send_map_.empty() || !pending_bcast_map_.empty();
+  }
+
+  void SendQueuedInvalidationMessagesCb(const TrackingMap& track_map,
+                                        const BcastPendingMap& bcast_map, unsigned idx) const;
 
   class PrimeBumpPolicy;
 };
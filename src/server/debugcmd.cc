@@ -45,6 +45,7 @@ using namespace std;
 ABSL_DECLARE_FLAG(string, dir);
 ABSL_DECLARE_FLAG(string, dbfilename);
 ABSL_DECLARE_FLAG(bool, df_snapshot_format);
+ABSL_DECLARE_FLAG(uint32_t, zstd_value_min_len);
 
 namespace dfly {
 
@@ -390,6 +391,70 @@ void DoComputeHist(CompactObjType type, EngineShard* shard, ConnectionContext* c
     --dest->max_symbol;
 }
 
+// Re-encodes the keys that still use the previous huffman table until a full pass over the
+// shard finds none, then releases the previous table.
+void DoReencodeStaleKeys(EngineShard* shard, ConnectionContext* cntx) {
+  auto& db_slice = cntx->ns->GetDbSlice(shard->shard_id());
+  unsigned steps = 0;
+  size_t stale = 0;
+
+  do {
+    stale = 0;
+    for (DbIndex i = 0; i < db_slice.db_array_size(); ++i) {
+      DbTable* dbt = db_slice.GetDBTable(i);
+      if (dbt == nullptr)
+        continue;
+      PrimeTable::Cursor cursor;
+      do {
+        cursor = dbt->prime.Traverse(cursor, [&](PrimeIterator it) {
+          ++steps;
+          stale += db_slice.ReencodeStaleHuffman(i, it);
+        });
+
+        if (steps >= 40000) {
+          steps = 0;
+          ThisFiber::Yield();
+        }
+      } while (cursor);
+    }
+  } while (stale > 0);
+
+  CompactObj::FinishHuffmanSwapThreadLocal();
+}
+
+// Appends string values of at least min_len bytes to samples until it holds max_bytes.
+void DoSampleStrings(EngineShard* shard, ConnectionContext* cntx, size_t min_len,
+                     size_t max_bytes, string* samples, vector<size_t>* sample_sizes) {
+  auto& db_slice = cntx->ns->GetDbSlice(shard->shard_id());
+  DbTable* dbt = db_slice.GetDBTable(cntx->db_index());
+  CHECK(dbt);
+
+  PrimeTable::Cursor cursor;
+  unsigned steps = 0;
+  string scratch;
+  constexpr size_t kMaxLen = 4096;
+
+  do {
+    cursor = dbt->prime.Traverse(cursor, [&](PrimeIterator it) {
+      ++steps;
+      const PrimeValue& pv = it->second;
+      if (pv.ObjType() != OBJ_STRING || pv.IsExternal() || pv.Size() < min_len ||
+          samples->size() >= max_bytes)
+        return;
+
+      string_view value = pv.GetSlice(&scratch);
+      value = value.substr(0, kMaxLen);
+      samples->append(value);
+      sample_sizes->push_back(value.size());
+    });
+
+    if (steps >= 40000) {
+      steps = 0;
+      ThisFiber::Yield();
+    }
+  } while (cursor && samples->size() < max_bytes);
+}
+
 ObjInfo InspectOp(ConnectionContext* cntx, string_view key) {
   auto& db_slice = cntx->ns->GetCurrentDbSlice();
   auto db_index = cntx->db_index();
@@ -490,45 +555,6 @@ OpResult<ValueCompressInfo> EstimateCompression(ConnectionContext* cntx, string_
   return info;
 };
 
-const char* EncodingName(unsigned obj_type, unsigned encoding) {
-  switch (obj_type) {
-    case OBJ_STRING:
-      return "raw";
-    case OBJ_LIST:
-      return "quicklist";
-      break;
-    case OBJ_SET:
-      ABSL_FALLTHROUGH_INTENDED;
-    case OBJ_ZSET:
-      ABSL_FALLTHROUGH_INTENDED;
-    case OBJ_HASH:
-      switch (encoding) {
-        case kEncodingIntSet:
-          return "intset";
-        case kEncodingStrMap2:
-          return "dense_set";
-        case OBJ_ENCODING_SKIPLIST:  // we kept the old enum for zset
-          return "btree";
-        case OBJ_ENCODING_LISTPACK:
-          ABSL_FALLTHROUGH_INTENDED;
-        case kEncodingListPack:
-          return "listpack";
-      }
-      break;
-    case OBJ_JSON:
-      switch (encoding) {
-        case kEncodingJsonCons:
-          return "jsoncons";
-        case kEncodingJsonFlat:
-          return "jsonflat";
-      }
-      break;
-    case OBJ_STREAM:
-      return "stream";
-  }
-  return "unknown";
-}
-
 struct IOStat {
   uint64_t conn_received = 0;
   uint64_t curr_conn_count = 0;
@@ -642,16 +668,24 @@ void DebugCmd::Run(CmdArgList args, facade::SinkReplyBuilder* builder) {
         "    traffic logging is stopped.",
         "RECVSIZE [<tid> | ENABLE | DISABLE]",
         "    Prints the histogram of the received request sizes on the given thread",
-        "COMPRESSION [IMPORT <bintable> | EXPORT | SET <bintable>] [type]",
+        "COMPRESSION [IMPORT <bintable> | EXPORT | SET <bintable> | APPLY] [type]",
         "    Estimate the compressibility of values of the given type. if no type is given, ",
         "    checks compressibility of keys. If IN is specified, then the provided ",
         "    bintable is used to check compressibility. If OUT is specified, then ",
-        "    the serialized table is printed as well",
+        "    the serialized table is printed as well. APPLY trains a table on the current ",
+        "    keys and switches key encoding to it online, re-encoding the existing keys.",
+        "ZSTD-DICT [TRAIN [<dict_size>] | SET <dict>]",
+        "    Trains a zstd dictionary on the string values of the current database, or sets",
+        "    the base64 encoded dictionary previously returned by TRAIN. Strings that are set",
+        "    from now on are compressed with it. The dictionary can be set only once.",
         "IOSTATS [PS]",
         "    Prints IO stats per thread. If PS is specified, prints thread-level stats ",
         "    per second.",
         "SEGMENTS",
         "    Prints segment info for the current database.",
+        "RESERVE <keys>",
+        "    Pre-sizes the tables of the current database for <keys> more keys, spread evenly",
+        "    over the shards.",
         "HELP",
         "    Prints this help.",
     };
@@ -727,12 +761,19 @@ void DebugCmd::Run(CmdArgList args, facade::SinkReplyBuilder* builder) {
     return Compression(args.subspan(1), builder);
   }
 
+  if (subcmd == "ZSTD-DICT" && args.size() >= 2) {
+    return ZstdDict(args.subspan(1), builder);
+  }
+
   if (subcmd == "IOSTATS") {
     return IOStats(args.subspan(1), builder);
   }
   if (subcmd == "SEGMENTS") {
     return Segments(args.subspan(1), builder);
   }
+  if (subcmd == "RESERVE" && args.size() == 2) {
+    return Reserve(ArgS(args, 1), builder);
+  }
   string reply = UnknownSubCmd(subcmd, "DEBUG");
   return builder->SendError(reply, kSyntaxErrType);
 }
@@ -1052,7 +1093,7 @@ void DebugCmd::Inspect(string_view key, CmdArgList args, facade::SinkReplyBuilde
       return;
     }
 
-    StrAppend(&resp, "encoding:", EncodingName(res.type, res.encoding),
+    StrAppend(&resp, "encoding:", ObjEncodingToString(res.type, res.encoding),
               " bucket_id:", res.bucket_id);
     StrAppend(&resp, " slot:", res.slot_id, " shard:", sid);
 
@@ -1401,8 +1442,11 @@ void DebugCmd::Compression(CmdArgList args, facade::SinkReplyBuilder* builder) {
     return succeed ? builder->SendOk() : builder->SendError("Failed to set bintable");
   }
 
+  bool apply = false;
   if (parser.Check("EXPORT")) {
     print_bintable = true;
+  } else if (parser.Check("APPLY")) {
+    apply = true;
   } else if (parser.Check("IMPORT", &bintable)) {
     string raw;
     bool succeed = absl::Base64Unescape(bintable, &raw);
@@ -1414,7 +1458,7 @@ void DebugCmd::Compression(CmdArgList args, facade::SinkReplyBuilder* builder) {
   if (parser.HasNext()) {
     string_view type_str = parser.Next();
     type = ObjTypeFromString(type_str);
-    if (type == kInvalidCompactObjType) {
+    if (type == kInvalidCompactObjType || apply) {  // Only keys can be re-encoded online.
       return builder->SendError(kSyntaxErr);
     }
   }
@@ -1454,6 +1498,22 @@ void DebugCmd::Compression(CmdArgList args, facade::SinkReplyBuilder* builder) {
     num_bits = huff_enc.num_bits();
     compressed_size = huff_enc.EstimateCompressedSize(hist.hist.data(), HufHist::kMaxSymbol);
 
+    if (apply) {
+      string table = huff_enc.Export();
+      atomic_bool swapped = true;
+      shard_set->RunBriefInParallel([&](EngineShard* shard) {
+        if (!CompactObj::SwapHuffmanThreadLocal(table)) {
+          swapped = false;
+        }
+      });
+      // Drain anyway, so that shards which did swap do not stay with two tables.
+      shard_set->RunBlockingInParallel(
+          [&](EngineShard* shard) { DoReencodeStaleKeys(shard, cntx_); });
+      if (!swapped) {
+        return rb->SendError("previous huffman table swap is still in progress");
+      }
+    }
+
     if (print_bintable) {
       bintable = huff_enc.Export();
     } else {
@@ -1482,6 +1542,80 @@ void DebugCmd::Compression(CmdArgList args, facade::SinkReplyBuilder* builder) {
   }
 }
 
+void DebugCmd::ZstdDict(CmdArgList args, facade::SinkReplyBuilder* builder) {
+  CmdArgParser parser(args);
+  string dict;
+
+  if (parser.Check("SET", &dict)) {
+    string raw;
+    atomic_bool succeed = absl::Base64Unescape(dict, &raw);
+    if (succeed) {
+      shard_set->pool()->AwaitBrief([&](unsigned, auto*) {
+        if (!CompactObj::InitZstdDictThreadLocal(raw)) {
+          succeed = false;
+        }
+      });
+    }
+    return succeed ? builder->SendOk() : builder->SendError("Failed to set zstd dictionary");
+  }
+
+  if (!parser.Check("TRAIN")) {
+    return builder->SendError(kSyntaxErr);
+  }
+
+  size_t dict_size = parser.NextOrDefault<size_t>(16_KB);
+  if (parser.HasError()) {
+    return builder->SendError(parser.Error()->MakeReply());
+  }
+  if (dict_size < 1_KB || dict_size > 1_MB) {
+    return builder->SendError(kInvalidIntErr);
+  }
+
+  // zstd recommends training on ~100 times the size of the dictionary.
+  size_t max_bytes = dict_size * 100 / shard_set->size();
+  size_t min_len = absl::GetFlag(FLAGS_zstd_value_min_len);
+
+  fb2::Mutex mu;
+  string samples;
+  vector<size_t> sample_sizes;
+  shard_set->RunBlockingInParallel([&](EngineShard* shard) {
+    string local;
+    vector<size_t> local_sizes;
+    DoSampleStrings(shard, cntx_, min_len, max_bytes, &local, &local_sizes);
+    std::unique_lock lk(mu);
+    samples.append(local);
+    sample_sizes.insert(sample_sizes.end(), local_sizes.begin(), local_sizes.end());
+  });
+
+  dict.resize(dict_size);
+  size_t res = ZDICT_trainFromBuffer(dict.data(), dict.size(), samples.data(), sample_sizes.data(),
+                                     sample_sizes.size());
+  if (ZDICT_isError(res)) {
+    return builder->SendError(StrCat("Failed to train zstd dictionary: ",
+                                     ZDICT_getErrorName(res), ", samples: ", sample_sizes.size()));
+  }
+  dict.resize(res);
+
+  atomic_bool succeed = true;
+  shard_set->pool()->AwaitBrief([&](unsigned, auto*) {
+    if (!CompactObj::InitZstdDictThreadLocal(dict)) {
+      succeed = false;
+    }
+  });
+  if (!succeed) {
+    return builder->SendError("Failed to set zstd dictionary");
+  }
+
+  auto* rb = static_cast<RedisReplyBuilder*>(builder);
+  rb->StartCollection(3, RedisReplyBuilder::CollectionType::MAP);
+  rb->SendSimpleString("samples");
+  rb->SendLong(sample_sizes.size());
+  rb->SendSimpleString("samples_size");
+  rb->SendLong(samples.size());
+  rb->SendSimpleString("dict");
+  rb->SendBulkString(absl::Base64Escape(dict));
+}
+
 void DebugCmd::IOStats(CmdArgList args, facade::SinkReplyBuilder* builder) {
   auto* rb = static_cast<RedisReplyBuilder*>(builder);
 
@@ -1530,6 +1664,15 @@ void DebugCmd::Segments(CmdArgList args, facade::SinkReplyBuilder* builder) {
   rb->SendVerbatimString(result);
 }
 
+void DebugCmd::Reserve(string_view keys_str, facade::SinkReplyBuilder* builder) {
+  uint64_t keys;
+  if (!absl::SimpleAtoi(keys_str, &keys))
+    return builder->SendError(kUintErr);
+
+  shard_set->ReserveKeys(cntx_->db_index(), keys);
+  builder->SendOk();
+}
+
 void DebugCmd::DoPopulateBatch(const PopulateOptions& options, const PopulateBatch& batch) {
   boost::intrusive_ptr<Transaction> local_tx =
       new Transaction{sf_.service().mutable_registry()->Find("EXEC")};
@@ -59,8 +59,10 @@ class DebugCmd {
   void Topk(CmdArgList args, facade::SinkReplyBuilder* builder);
   void Keys(CmdArgList args, facade::SinkReplyBuilder* builder);
   void Compression(CmdArgList args, facade::SinkReplyBuilder* builder);
+  void ZstdDict(CmdArgList args, facade::SinkReplyBuilder* builder);
   void IOStats(CmdArgList args, facade::SinkReplyBuilder* builder);
   void Segments(CmdArgList args, facade::SinkReplyBuilder* builder);
+  void Reserve(std::string_view keys, facade::SinkReplyBuilder* builder);
   struct PopulateBatch {
     DbIndex dbid;
     uint64_t index[32];
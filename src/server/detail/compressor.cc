@@ -6,6 +6,7 @@
 
 #include <absl/flags/flag.h>
 #include <lz4frame.h>
+#include <zdict.h>
 #include <zstd.h>
 
 #include "base/logging.h"
@@ -37,8 +38,11 @@ io::Result<io::Bytes> ZstdCompressor::Compress(io::Bytes data) {
   if (compr_buf_.capacity() < buf_size) {
     compr_buf_.reserve(buf_size);
   }
-  size_t compressed_size = ZSTD_compressCCtx(cctx_, compr_buf_.data(), compr_buf_.capacity(),
-                                             data.data(), data.size(), compression_level_);
+  size_t compressed_size =
+      dict_ ? ZSTD_compress_usingCDict(cctx_, compr_buf_.data(), compr_buf_.capacity(),
+                                       data.data(), data.size(), dict_->cdict_)
+            : ZSTD_compressCCtx(cctx_, compr_buf_.data(), compr_buf_.capacity(), data.data(),
+                                data.size(), compression_level_);
 
   if (ZSTD_isError(compressed_size)) {
     LOG(ERROR) << "ZSTD_compressCCtx failed with error " << ZSTD_getErrorName(compressed_size);
@@ -91,6 +95,31 @@ io::Result<io::Bytes> Lz4Compressor::Compress(io::Bytes data) {
   return io::Bytes(compr_buf_.data(), frame_size);
 }
 
+shared_ptr<const ZstdDict> ZstdDict::Train(string_view samples, const vector<size_t>& sample_sizes,
+                                           size_t max_size) {
+  shared_ptr<ZstdDict> dict{new ZstdDict};
+  dict->data_.resize(max_size);
+  size_t dict_size = ZDICT_trainFromBuffer(dict->data_.data(), max_size, samples.data(),
+                                           sample_sizes.data(), sample_sizes.size());
+  if (ZDICT_isError(dict_size)) {
+    VLOG(1) << "ZDICT_trainFromBuffer failed with error " << ZDICT_getErrorName(dict_size);
+    return nullptr;
+  }
+  dict->data_.resize(dict_size);
+
+  dict->cdict_ = ZSTD_createCDict(dict->data_.data(), dict_size,
+                                  absl::GetFlag(FLAGS_compression_level));
+  if (!dict->cdict_) {
+    LOG(ERROR) << "ZSTD_createCDict failed";
+    return nullptr;
+  }
+  return dict;
+}
+
+ZstdDict::~ZstdDict() {
+  ZSTD_freeCDict(cdict_);
+}
+
 CompressorImpl::CompressorImpl() {
   compression_level_ = absl::GetFlag(FLAGS_compression_level);
 }
@@ -5,12 +5,43 @@
 #pragma once
 
 #include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include "base/pod_array.h"
 #include "io/io.h"
 
+struct ZSTD_CDict_s;
+
 namespace dfly::detail {
 
+// Zstd dictionary trained on samples of the data being compressed. It is immutable once created,
+// so compressors on different threads can share it.
+class ZstdDict {
+ public:
+  // Trains a dictionary of at most max_size bytes on samples, which holds the concatenated
+  // samples with sizes given by sample_sizes. Returns null if training failed, for example
+  // because the samples were too few or too uniform.
+  static std::shared_ptr<const ZstdDict> Train(std::string_view samples,
+                                               const std::vector<size_t>& sample_sizes,
+                                               size_t max_size);
+
+  ~ZstdDict();
+
+  std::string_view data() const {
+    return data_;
+  }
+
+ private:
+  friend class ZstdCompressor;
+
+  ZstdDict() = default;
+
+  std::string data_;
+  ZSTD_CDict_s* cdict_ = nullptr;
+};
+
 class CompressorImpl {
  public:
   static std::unique_ptr<CompressorImpl> CreateZstd();
@@ -20,7 +51,13 @@ class CompressorImpl {
   virtual ~CompressorImpl();
   virtual io::Result<io::Bytes> Compress(io::Bytes data) = 0;
 
+  // Dictionary for the following Compress calls, ignored by lz4. Must outlive its use.
+  void set_dict(const ZstdDict* dict) {
+    dict_ = dict;
+  }
+
  protected:
+  const ZstdDict* dict_ = nullptr;
   int compression_level_ = 1;
   size_t compressed_size_total_ = 0;
   size_t uncompressed_size_total_ = 0;
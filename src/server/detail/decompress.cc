@@ -29,15 +29,28 @@ class ZstdDecompress : public DecompressImpl {
     dctx_ = ZSTD_createDCtx();
   }
   ~ZstdDecompress() {
+    ZSTD_freeDDict(ddict_);
     ZSTD_freeDCtx(dctx_);
   }
 
   io::Result<io::IoBuf*> Decompress(std::string_view str);
+  std::error_code SetDict(std::string_view dict) override;
 
  private:
   ZSTD_DCtx* dctx_;
+  ZSTD_DDict* ddict_ = nullptr;
 };
 
+std::error_code ZstdDecompress::SetDict(std::string_view dict) {
+  ZSTD_freeDDict(ddict_);
+  ddict_ = ZSTD_createDDict(dict.data(), dict.size());
+  if (!ddict_) {
+    LOG(ERROR) << "Invalid ZSTD dictionary";
+    return RdbError(errc::rdb_file_corrupted);
+  }
+  return {};
+}
+
 io::Result<io::IoBuf*> ZstdDecompress::Decompress(std::string_view str) {
   // Prepare membuf memory to uncompressed string.
   auto uncomp_size = ZSTD_getFrameContentSize(str.data(), str.size());
@@ -57,8 +70,13 @@ io::Result<io::IoBuf*> ZstdDecompress::Decompress(std::string_view str) {
   if (dest.size() < uncomp_size) {
     return Unexpected(errc::out_of_memory);
   }
+  // Blobs that were flushed before the dictionary was trained have no dictionary id.
+  bool use_dict = ddict_ && ZSTD_getDictID_fromFrame(str.data(), str.size()) != 0;
   size_t const d_size =
-      ZSTD_decompressDCtx(dctx_, dest.data(), dest.size(), str.data(), str.size());
+      use_dict
+          ? ZSTD_decompress_usingDDict(dctx_, dest.data(), dest.size(), str.data(), str.size(),
+                                       ddict_)
+          : ZSTD_decompressDCtx(dctx_, dest.data(), dest.size(), str.data(), str.size());
   if (d_size == 0 || d_size != uncomp_size) {
     LOG(ERROR) << "Invalid ZSTD compressed string";
     return Unexpected(errc::rdb_file_corrupted);
@@ -161,6 +179,11 @@ io::Result<base::IoBuf*> Lz4Decompress::Decompress(std::string_view data) {
   return &uncompressed_mem_buf_;
 }
 
+std::error_code DecompressImpl::SetDict(std::string_view dict) {
+  LOG(ERROR) << "Compression dictionary is not supported";
+  return RdbError(errc::invalid_encoding);
+}
+
 unique_ptr<DecompressImpl> DecompressImpl::CreateLZ4() {
   return make_unique<Lz4Decompress>();
 }
@@ -4,6 +4,7 @@
 #pragma once
 
 #include <memory>
+#include <system_error>
 
 #include "io/io.h"
 #include "io/io_buf.h"
@@ -24,6 +25,9 @@ class DecompressImpl {
 
   virtual io::Result<io::IoBuf*> Decompress(std::string_view str) = 0;
 
+  // Sets dictionary for the following blobs that were compressed with one. Only zstd supports it.
+  virtual std::error_code SetDict(std::string_view dict);
+
  protected:
   io::IoBuf uncompressed_mem_buf_;
 };
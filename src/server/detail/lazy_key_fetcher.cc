@@ -0,0 +1,191 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/detail/lazy_key_fetcher.h"
+
+#include "base/logging.h"
+#include "core/compact_object.h"
+#include "facade/facade_types.h"
+#include "server/detail/snapshot_storage.h"
+#include "server/rdb_load.h"
+
+namespace dfly::detail {
+
+using namespace std;
+using facade::operator""_MB;
+
+namespace {
+
+// Every chain is followed by at least the end of file opcode and the checksum. The loader reads
+// ahead that many bytes, so they are read together with the chain.
+constexpr size_t kTailSize = 9;
+
+// Larger chains hold huge values, which are rather awaited than read twice.
+constexpr size_t kMaxFetchSize = 64_MB;
+
+bool ReadAt(io::ReadonlyFile* file, size_t offset, size_t len, string* dest) {
+  dest->resize(len);
+  io::Result<size_t> res =
+      file->Read(offset, io::MutableBytes{reinterpret_cast<uint8_t*>(dest->data()), len});
+  return res && *res == len;
+}
+
+}  // namespace
+
+LazyKeyFetcher::LazyKeyFetcher(unique_ptr<io::ReadonlyFile> file, SnapshotKeyIndex index)
+    : file_(std::move(file)), index_(std::move(index)), loader_(make_unique<RdbLoader>(nullptr)) {
+}
+
+LazyKeyFetcher::~LazyKeyFetcher() {
+  if (error_code ec = file_->Close(); ec)
+    LOG(WARNING) << "Error closing lazily loaded snapshot file: " << ec.message();
+}
+
+shared_ptr<LazyKeyFetcher> LazyKeyFetcher::Open(SnapshotStorage* storage,
+                                                const string& shard_file, string_view snapshot_id) {
+  optional<SnapshotKeyIndex> index = SnapshotKeyIndex::Open(storage, shard_file);
+  if (!index || index->snapshot_id() != snapshot_id) {
+    LOG(INFO) << "No key index of snapshot " << snapshot_id << " for " << shard_file;
+    return nullptr;
+  }
+
+  io::ReadonlyFileOrError file = storage->OpenReadFile(shard_file);
+  if (!file) {
+    LOG(WARNING) << "Could not open " << shard_file << ": " << file.error().message();
+    return nullptr;
+  }
+
+  VLOG(1) << "Loading " << shard_file << " lazily, " << index->num_keys() << " keys indexed";
+  return make_shared<LazyKeyFetcher>(unique_ptr<io::ReadonlyFile>{*file}, std::move(*index));
+}
+
+bool LazyKeyFetcher::Fetch(DbIndex db, string_view key) {
+  if (finished_ || (loading_ && loading_->first == db && loading_->second == key))
+    return false;
+
+  if (auto it = dbs_.find(db); it != dbs_.end()) {
+    if (it->second.cancelled)
+      return false;
+
+    if (it->second.fetched.contains(key)) {
+      // Another fiber may still be reading the key.
+      if (!it->second.fetching.contains(key))
+        return false;
+      ec_.await([&] { return !dbs_[db].fetching.contains(key); });
+      return true;
+    }
+  }
+
+  bool lookup_again = false;
+  for (const SnapshotKeyIndex::Chain& chain : index_.Find(CompactObj::HashCode(key))) {
+    // Chains are sorted by offset, the background load might pass them while we wait.
+    if (finished_ || chain.end <= loaded_offset_)
+      continue;
+
+    lookup_again = true;
+    if (chain.offset < loaded_offset_ || chain.end - chain.offset > kMaxFetchSize) {
+      ec_.await([&] { return finished_ || loaded_offset_ >= chain.end; });
+      continue;
+    }
+
+    if (LoadFromChain(db, key, chain))
+      break;
+  }
+  return lookup_again;
+}
+
+bool LazyKeyFetcher::LoadFromChain(DbIndex db, string_view key,
+                                   const SnapshotKeyIndex::Chain& chain) {
+  {
+    DbKeys& db_keys = dbs_[db];
+    if (db_keys.cancelled)
+      return true;
+    if (db_keys.fetched.contains(key)) {
+      ec_.await([&] { return !dbs_[db].fetching.contains(key); });
+      return true;
+    }
+
+    // The background load skips the key from now on.
+    db_keys.fetched.emplace(key);
+    db_keys.fetching.emplace(key);
+  }
+
+  bool found = false;
+  string data;
+  optional<SnapshotKeyIndex::Chain> dict = index_.dict_chain();
+  if (dict && !dict_data_) {
+    dict_data_.emplace();
+    if (!ReadAt(file_.get(), dict->offset, dict->end - dict->offset + kTailSize, &*dict_data_)) {
+      LOG(ERROR) << "Failed to read the compression dictionary of a lazily loaded snapshot";
+      dict_data_.reset();
+    }
+  }
+
+  if ((!dict || dict_data_) &&
+      ReadAt(file_.get(), chain.offset, chain.end - chain.offset + kTailSize, &data)) {
+    // Loading does not preempt, so loader_ is not used concurrently.
+    auto prev_loading = std::exchange(loading_, pair{db, key});
+    error_code ec;
+    if (dict && !dict_loaded_) {
+      bool ignored;
+      ec = loader_->LoadKey(*dict_data_, dict->end - dict->offset, db, {}, &ignored);
+      dict_loaded_ = !ec;
+    }
+    if (!ec && !dbs_[db].cancelled)
+      ec = loader_->LoadKey(data, chain.end - chain.offset, db, key, &found);
+    loading_ = prev_loading;
+
+    LOG_IF(ERROR, ec) << "Failed to fetch key from a lazily loaded snapshot: " << ec.message();
+  } else {
+    LOG(ERROR) << "Failed to read entries at offset " << chain.offset
+               << " of a lazily loaded snapshot";
+  }
+
+  // Keys that were not found are left to the background load.
+  DbKeys& db_keys = dbs_[db];
+  db_keys.fetching.erase(key);
+  if (!found)
+    db_keys.fetched.erase(key);
+  ec_.notifyAll();
+  return found;
+}
+
+bool LazyKeyFetcher::StartLoad(DbIndex db, string_view key) {
+  if (auto it = dbs_.find(db); it != dbs_.end()) {
+    // A fetch that is in progress decides whether the key is left to us.
+    if (it->second.fetching.contains(key))
+      ec_.await([&] { return !dbs_[db].fetching.contains(key); });
+
+    const DbKeys& db_keys = dbs_[db];
+    if (db_keys.cancelled || db_keys.fetched.contains(key))
+      return false;
+  }
+
+  loading_.emplace(db, key);
+  return true;
+}
+
+void LazyKeyFetcher::EndLoad() {
+  loading_.reset();
+}
+
+void LazyKeyFetcher::SetLoadedOffset(size_t offset) {
+  loaded_offset_ = offset;
+  ec_.notifyAll();
+}
+
+void LazyKeyFetcher::Cancel(DbIndex db) {
+  DbKeys& db_keys = dbs_[db];
+  db_keys.cancelled = true;
+  db_keys.fetched.clear();
+  db_keys.fetching.clear();
+  ec_.notifyAll();
+}
+
+void LazyKeyFetcher::Finish() {
+  finished_ = true;
+  ec_.notifyAll();
+}
+
+}  // namespace dfly::detail
@@ -0,0 +1,92 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/container/flat_hash_map.h>
+#include <absl/container/flat_hash_set.h>
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "io/file.h"
+#include "server/detail/snapshot_key_index.h"
+#include "server/tx_base.h"
+#include "util/fibers/synchronization.h"
+
+namespace dfly {
+
+class RdbLoader;
+
+namespace detail {
+
+class SnapshotStorage;
+
+// Serves the keys of a DF shard file that is loaded in the background while the server is
+// already active. Lookups that miss a key which was not loaded yet fetch it from the file with the
+// help of its key index. The background load skips keys that were fetched before, so that their
+// later changes are not overridden.
+//
+// Used only from the thread of the shard of the file.
+class LazyKeyFetcher {
+ public:
+  LazyKeyFetcher(std::unique_ptr<io::ReadonlyFile> file, SnapshotKeyIndex index);
+  ~LazyKeyFetcher();
+
+  // Opens the shard file together with its key index. Returns null if the index is missing or
+  // does not belong to the snapshot.
+  static std::shared_ptr<LazyKeyFetcher> Open(SnapshotStorage* storage,
+                                              const std::string& shard_file,
+                                              std::string_view snapshot_id);
+
+  // Called after a lookup missed the key. Loads it if it is stored only in the file or waits
+  // until the background load inserts it. Can preempt. Returns true if the key must be looked
+  // up again.
+  bool Fetch(DbIndex db, std::string_view key);
+
+  // Called by the background load before it inserts the key. Returns false if the key must be
+  // skipped, otherwise EndLoad must be called once it is inserted.
+  bool StartLoad(DbIndex db, std::string_view key);
+  void EndLoad();
+
+  // Entries before the offset of the file were inserted by the background load.
+  void SetLoadedOffset(size_t offset);
+
+  // Stops loading the keys of the db, called when it is flushed.
+  void Cancel(DbIndex db);
+
+  // Called once the background load finished.
+  void Finish();
+
+ private:
+  struct DbKeys {
+    absl::flat_hash_set<std::string> fetched;   // keys that are not loaded in the background
+    absl::flat_hash_set<std::string> fetching;  // keys that are read from the file right now
+    bool cancelled = false;
+  };
+
+  // Loads the key from the chain if it holds it. Returns whether the key was found.
+  bool LoadFromChain(DbIndex db, std::string_view key, const SnapshotKeyIndex::Chain& chain);
+
+  std::unique_ptr<io::ReadonlyFile> file_;
+  SnapshotKeyIndex index_;
+  std::unique_ptr<RdbLoader> loader_;
+  std::optional<std::string> dict_data_;  // read on the first fetch if the file has a dictionary
+  bool dict_loaded_ = false;
+
+  absl::flat_hash_map<DbIndex, DbKeys> dbs_;
+  size_t loaded_offset_ = 0;
+  bool finished_ = false;
+
+  // Key that is being inserted, its lookups must not fetch it.
+  std::optional<std::pair<DbIndex, std::string_view>> loading_;
+
+  util::fb2::EventCount ec_;
+};
+
+}  // namespace detail
+}  // namespace dfly
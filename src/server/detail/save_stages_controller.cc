@@ -6,6 +6,7 @@
 #include "server/detail/save_stages_controller.h"
 
 #include <absl/strings/match.h>
+#include <absl/strings/str_join.h>
 
 #include <numeric>
 
@@ -23,6 +24,11 @@ using namespace std;
 ABSL_DECLARE_FLAG(string, dir);
 ABSL_DECLARE_FLAG(string, dbfilename);
 
+ABSL_FLAG(uint32_t, snapshot_delta_max_chain, 0,
+          "If positive, DF snapshots saved to local files contain only the changes since the "
+          "previous save, until that many delta snapshots were built upon a full one. "
+          "0 means that every snapshot is a full one.");
+
 namespace dfly {
 namespace detail {
 
@@ -47,6 +53,34 @@ error_code CreateDirs(fs::path dir_path) {
   return ec;
 }
 
+// Returns the path of the key index of a shard file, which keeps its temporary extension.
+string KeyIndexPath(const fs::path& path) {
+  if (path.extension() == ".tmp") {
+    return StrCat(SnapshotKeyIndex::IndexPath(fs::path{path}.replace_extension("").string()),
+                  ".tmp");
+  }
+  return SnapshotKeyIndex::IndexPath(path.string());
+}
+
+// Closes a file opened with SnapshotStorage::OpenWriteFile.
+error_code CloseWriteFile(io::Sink* sink, bool is_linux_file) {
+#ifdef __linux__
+  if (is_linux_file) {
+    return static_cast<LinuxWriteWrapper*>(sink)->Close();
+  }
+#endif
+
+  error_code ec;
+
+  // S3 implementation is stack hungry. We use a fiber to close the file to
+  // avoid wasting stack space.
+  auto fb = ProactorBase::me()->LaunchFiber(
+      fb2::Launch::post, boost::context::fixedsize_stack{40 * 1024}, "write_file_close",
+      [&] { ec = static_cast<io::WriteFile*>(sink)->Close(); });
+  fb.Join();
+  return ec;
+}
+
 // modifies 'filename' to be "filename-postfix.extension"
 void SetExtension(absl::AlphaNum postfix, string_view extension, fs::path* filename) {
   filename->replace_extension();  // clear if exists
@@ -112,6 +146,8 @@ GenericError RdbSnapshot::Start(SaveMode save_mode, const std::string& path,
 
   auto [file, file_type] = *res;
   io_sink_.reset(file);
+  path_ = path;
+  snapshot_id_ = snapshot_id;
 
   is_linux_file_ = file_type & FileType::IO_URING;
   bool align_writes = (file_type & FileType::DIRECT) != 0;
@@ -125,7 +161,10 @@ error_code RdbSnapshot::SaveBody() {
 }
 
 error_code RdbSnapshot::WaitSnapshotInShard(EngineShard* shard) {
-  return saver_->WaitSnapshotInShard(shard);
+  error_code ec = saver_->WaitSnapshotInShard(shard);
+  if (!ec)
+    key_index_ = saver_->TakeKeyIndex(shard);
+  return ec;
 }
 
 size_t RdbSnapshot::GetSaveBuffersSize() {
@@ -143,21 +182,37 @@ RdbSaver::SnapshotStats RdbSnapshot::GetCurrentSnapshotProgress() const {
 }
 
 error_code RdbSnapshot::Close() {
-#ifdef __linux__
-  if (is_linux_file_) {
-    return static_cast<LinuxWriteWrapper*>(io_sink_.get())->Close();
-  }
-#endif
+  error_code ec = CloseWriteFile(io_sink_.get(), is_linux_file_);
+  if (!ec && key_index_)
+    ec = WriteKeyIndex();
+  return ec;
+}
 
+error_code RdbSnapshot::WriteKeyIndex() {
+  key_index_->set_snapshot_id(snapshot_id_);
+  string data = key_index_->Serialize();
+  key_index_.reset();
+
+  string path = KeyIndexPath(path_);
+  auto res = snapshot_storage_->OpenWriteFile(path);
+  if (!res)
+    return res.error();
+
+  auto [file, file_type] = *res;
+  unique_ptr<io::Sink> sink{file};
   error_code ec;
+  if (file_type & FileType::DIRECT) {
+    AlignedBuffer aligned_buf(64 * 1024, sink.get());
+    ec = aligned_buf.Write(data);
+    if (!ec)
+      ec = aligned_buf.Flush();
+  } else {
+    ec = sink->Write(io::Buffer(data));
+  }
 
-  // S3 implementation is stack hungry. We use a fiber to close the file to
-  // avoid wasting stack space.
-  auto fb = ProactorBase::me()->LaunchFiber(
-      fb2::Launch::post, boost::context::fixedsize_stack{40 * 1024}, "write_file_close",
-      [&] { ec = static_cast<io::WriteFile*>(io_sink_.get())->Close(); });
-  fb.Join();
-  return ec;
+  error_code close_ec = CloseWriteFile(sink.get(), file_type & FileType::IO_URING);
+  VLOG(1) << "Wrote key index " << path << " of " << data.size() << " bytes";
+  return ec ? ec : close_ec;
 }
 
 void RdbSnapshot::StartInShard(EngineShard* shard) {
@@ -258,6 +313,20 @@ RdbSaver::SnapshotStats SaveStagesController::GetCurrentSnapshotProgress() const
 // In the new version (.dfs) we store a file for every shard and one more summary file.
 // Summary file is always last in snapshots array.
 void SaveStagesController::SaveDfs() {
+  // Delta snapshots are loaded together with the snapshots they build upon, so a chain is
+  // limited to local files in a single directory.
+  uint32_t max_chain = GetFlag(FLAGS_snapshot_delta_max_chain);
+  if (max_chain > 0 && !snapshot_storage_->IsCloud()) {
+    bool extend = !delta_chain_.empty() && delta_chain_.size() <= max_chain &&
+                  fs::path{delta_chain_.front().path}.parent_path() == full_path_.parent_path();
+    delta_mode_ = extend && PinDeltaTracking() ? DeltaMode::DELTA : DeltaMode::TRACK;
+  }
+
+  if (delta_mode_ == DeltaMode::DELTA)
+    full_path_ += StrCat("-delta", delta_chain_.size());
+  else
+    delta_chain_.clear();
+
   // Extend all filenames with -{sid} or -summary and append .dfs.tmp
   const string_view ext = snapshot_storage_->IsCloud() ? ".dfs" : ".dfs.tmp";
   ShardId sid = 0;
@@ -270,18 +339,35 @@ void SaveStagesController::SaveDfs() {
   }
 
   absl::InsecureBitGen gen;
-  std::string snapshot_id = GetRandomHex(gen, 32);
+  snapshot_id_ = GetRandomHex(gen, 32);
   // Save summary file.
-  SaveDfsSingle(nullptr, snapshot_id);
+  SaveDfsSingle(nullptr, snapshot_id_);
 
   // Save shard files.
-  auto cb = [this, &snapshot_id](Transaction* t, EngineShard* shard) {
-    SaveDfsSingle(shard, snapshot_id);
+  auto cb = [this](Transaction* t, EngineShard* shard) {
+    SaveDfsSingle(shard, snapshot_id_);
     return OpStatus::OK;
   };
   trans_->ScheduleSingleHop(std::move(cb));
 }
 
+bool SaveStagesController::PinDeltaTracking() {
+  atomic_bool pinned = true;
+  auto cb = [&pinned](Transaction* t, EngineShard* shard) {
+    if (!t->GetDbSlice(shard->shard_id()).PinDeltaTracking())
+      pinned.store(false, memory_order_relaxed);
+    return OpStatus::OK;
+  };
+  trans_->Execute(std::move(cb), false);
+  return pinned.load(memory_order_relaxed);
+}
+
+string SaveStagesController::FormatDeltaChain() const {
+  return absl::StrJoin(delta_chain_, ",", [](string* out, const DeltaLink& link) {
+    absl::StrAppend(out, fs::path{link.path}.filename().string(), ":", link.snapshot_id);
+  });
+}
+
 // Start saving a dfs file on shard
 void SaveStagesController::SaveDfsSingle(EngineShard* shard, const std::string& snapshot_id) {
   // for summary file, shard=null and index=shard_set->size(), see SaveDfs() above
@@ -289,15 +375,27 @@ void SaveStagesController::SaveDfsSingle(EngineShard* shard, const std::string&
 
   SaveMode mode = shard == nullptr ? SaveMode::SUMMARY : SaveMode::SINGLE_SHARD;
   auto glob_data = shard == nullptr ? RdbSaver::GetGlobalData(service_) : RdbSaver::GlobalData{};
+  if (shard == nullptr) {
+    glob_data.repl_id = service_->server_family().master_replid();
+    if (delta_mode_ == DeltaMode::DELTA)
+      glob_data.delta_chain = FormatDeltaChain();
+  }
 
   if (auto err = snapshot->Start(mode, filename, glob_data, snapshot_id); err) {
     shared_err_ = err;
     snapshot.reset();
+    // The changes of this shard are not saved, so the next snapshot must be a full one.
+    if (shard)
+      namespaces->GetDefaultNamespace().GetDbSlice(shard->shard_id()).InvalidateDeltaTracking();
     return;
   }
 
-  if (mode == SaveMode::SINGLE_SHARD)
+  if (mode == SaveMode::SINGLE_SHARD) {
+    if (delta_mode_ == DeltaMode::NONE)
+      namespaces->GetDefaultNamespace().GetDbSlice(shard->shard_id()).InvalidateDeltaTracking();
+    snapshot->SetDeltaMode(delta_mode_);
     snapshot->StartInShard(shard);
+  }
 }
 
 // Save a single rdb file
@@ -353,6 +451,11 @@ SaveInfo SaveStagesController::GetSaveInfo() {
 
   info.file_name = resulting_path.generic_string();
 
+  if (delta_mode_ != DeltaMode::NONE) {
+    info.delta_chain = std::move(delta_chain_);
+    info.delta_chain.push_back({info.file_name, snapshot_id_});
+  }
+
   return info;
 }
 
@@ -373,10 +476,18 @@ GenericError SaveStagesController::FinalizeFileMovement() {
 
   std::error_code ec;
   for (const auto& [_, filename] : snapshots_) {
-    if (has_error) {
-      filesystem::remove(filename, ec);
-    } else {
-      filesystem::rename(filename, fs::path{filename}.replace_extension(""), ec);
+    // Shard files may be accompanied by their key index.
+    fs::path index_path = KeyIndexPath(filename);
+    for (const fs::path& path : {fs::path{filename}, index_path}) {
+      if (path == index_path && !filesystem::exists(path, ec))
+        continue;
+      if (has_error) {
+        filesystem::remove(path, ec);
+      } else {
+        filesystem::rename(path, fs::path{path}.replace_extension(""), ec);
+      }
+      if (ec)
+        break;
     }
     if (ec)
       break;
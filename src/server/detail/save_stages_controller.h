@@ -19,12 +19,22 @@ namespace detail {
 
 class SnapshotStorage;
 
+// Snapshot that a delta snapshot builds upon.
+struct DeltaLink {
+  std::string path;  // path of the summary file
+  std::string snapshot_id;
+};
+
+// Full snapshot followed by the delta snapshots built upon it, in order.
+using DeltaChain = std::vector<DeltaLink>;
+
 struct SaveInfo {
   time_t save_time = 0;  // epoch time in seconds.
   uint32_t duration_sec = 0;
   std::string file_name;
   std::vector<std::pair<std::string_view, size_t>> freq_map;  // RDB_TYPE_xxx -> count mapping.
   GenericError error;
+  DeltaChain delta_chain;  // chain the next save can extend, empty if it must be a full one.
 };
 
 struct SaveStagesInputs {
@@ -37,6 +47,8 @@ struct SaveStagesInputs {
   std::shared_ptr<SnapshotStorage> snapshot_storage_;
   // true if the command that triggered this flow is bgsave. false otherwise.
   bool is_bg_save_;
+  // chain of the previous save, a delta snapshot is saved if it can be extended.
+  DeltaChain delta_chain_;
 };
 
 class RdbSnapshot {
@@ -49,6 +61,10 @@ class RdbSnapshot {
                      const std::string& snapshot_id);
   void StartInShard(EngineShard* shard);
 
+  void SetDeltaMode(DeltaMode mode) {
+    saver_->SetDeltaMode(mode);
+  }
+
   error_code SaveBody();
   error_code WaitSnapshotInShard(EngineShard* shard);
   void FillFreqMap();
@@ -67,8 +83,13 @@ class RdbSnapshot {
   }
 
  private:
+  // Writes the key index of the shard file next to it.
+  error_code WriteKeyIndex();
+
   bool is_linux_file_ = false;
   SnapshotStorage* snapshot_storage_ = nullptr;
+  std::string path_, snapshot_id_;
+  std::optional<SnapshotKeyIndex> key_index_;
 
   std::atomic_uint32_t started_shards_ = 0;
 
@@ -111,6 +132,13 @@ struct SaveStagesController : public SaveStagesInputs {
 
   // Start saving a dfs file on shard
   void SaveDfsSingle(EngineShard* shard, const std::string& snapshot_id);
+
+  // Returns true if all shards still track the changes since the last snapshot of delta_chain_,
+  // and keeps them tracking until the shard snapshots start. Must be followed by another hop.
+  bool PinDeltaTracking();
+
+  // Summary aux field that lists delta_chain_ relative to the snapshot directory.
+  std::string FormatDeltaChain() const;
   void SaveSnashot(EngineShard* shard);
   void WaitSnapshotInShard(EngineShard* shard);
 
@@ -135,6 +163,8 @@ struct SaveStagesController : public SaveStagesInputs {
 
   time_t start_time_;
   std::filesystem::path full_path_;
+  std::string snapshot_id_;
+  DeltaMode delta_mode_ = DeltaMode::NONE;
 
   AggregateGenericError shared_err_;
   std::vector<std::pair<std::unique_ptr<RdbSnapshot>, std::filesystem::path>> snapshots_;
@@ -0,0 +1,234 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/detail/snapshot_key_index.h"
+
+#include <absl/strings/match.h>
+#include <absl/strings/str_cat.h>
+
+#include <algorithm>
+
+#include "absl/base/internal/endian.h"
+#include "base/logging.h"
+#include "server/cluster/slot_set.h"
+#include "server/detail/snapshot_storage.h"
+
+namespace dfly::detail {
+
+using namespace std;
+
+namespace {
+
+// Layout: magic, dict chain (4 bytes), number of chains and keys (8 bytes each), snapshot id
+// length (4 bytes), followed by the snapshot id, the chains and the keys sorted by hash.
+// A key is stored as its hash, chain id and slot. Files written with direct I/O are padded, so
+// trailing bytes are ignored.
+constexpr string_view kMagic = "DFKI0002";
+constexpr size_t kHeaderSize = kMagic.size() + 4 + 8 + 8 + 4;
+constexpr size_t kChainSize = 8 + 8;
+constexpr size_t kKeySize = 8 + 4 + 2;
+
+bool ReadAll(io::ReadonlyFile* file, string* dest) {
+  dest->resize(file->Size());
+  io::Result<size_t> res =
+      file->Read(0, io::MutableBytes{reinterpret_cast<uint8_t*>(dest->data()), dest->size()});
+  return res && *res == dest->size();
+}
+
+}  // namespace
+
+string SnapshotKeyIndex::IndexPath(string_view shard_file) {
+  if (absl::EndsWith(shard_file, ".dfs"))
+    shard_file.remove_suffix(4);
+  return absl::StrCat(shard_file, ".dfi");
+}
+
+optional<SnapshotKeyIndex> SnapshotKeyIndex::Open(SnapshotStorage* storage,
+                                                  const string& shard_file) {
+  string index_path = IndexPath(shard_file);
+  io::ReadonlyFileOrError file = storage->OpenReadFile(index_path);
+  if (!file) {
+    LOG(INFO) << "Could not open key index " << index_path << ": " << file.error().message();
+    return nullopt;
+  }
+
+  string data;
+  bool read = ReadAll(*file, &data);
+  std::ignore = (*file)->Close();
+  delete *file;
+
+  optional<SnapshotKeyIndex> index;
+  if (read)
+    index = Parse(data);
+  LOG_IF(WARNING, !index) << "Key index " << index_path << " is invalid";
+  return index;
+}
+
+uint32_t SnapshotKeyIndex::AddChain(Chain chain) {
+  chains_.push_back(chain);
+  return chains_.size() - 1;
+}
+
+void SnapshotKeyIndex::AddKey(uint64_t hash, SlotId slot, uint32_t chain_id) {
+  DCHECK_LT(chain_id, chains_.size());
+  keys_.push_back({hash, chain_id, slot});
+}
+
+void SnapshotKeyIndex::Sort() {
+  sort(keys_.begin(), keys_.end());
+}
+
+string SnapshotKeyIndex::Serialize() {
+  Sort();
+
+  string out(kHeaderSize + snapshot_id_.size() + chains_.size() * kChainSize +
+                 keys_.size() * kKeySize,
+             '\0');
+  char* next = out.data();
+  memcpy(next, kMagic.data(), kMagic.size());
+  next += kMagic.size();
+  absl::little_endian::Store32(next, dict_chain_);
+  absl::little_endian::Store64(next + 4, chains_.size());
+  absl::little_endian::Store64(next + 12, keys_.size());
+  absl::little_endian::Store32(next + 20, snapshot_id_.size());
+  next += 24;
+  memcpy(next, snapshot_id_.data(), snapshot_id_.size());
+  next += snapshot_id_.size();
+
+  for (const Chain& chain : chains_) {
+    absl::little_endian::Store64(next, chain.offset);
+    absl::little_endian::Store64(next + 8, chain.end);
+    next += kChainSize;
+  }
+  for (const Key& key : keys_) {
+    absl::little_endian::Store64(next, key.hash);
+    absl::little_endian::Store32(next + 8, key.chain_id);
+    absl::little_endian::Store16(next + 12, key.slot);
+    next += kKeySize;
+  }
+  return out;
+}
+
+optional<SnapshotKeyIndex> SnapshotKeyIndex::Parse(string_view data) {
+  if (data.size() < kHeaderSize || !absl::StartsWith(data, kMagic))
+    return nullopt;
+
+  const char* next = data.data() + kMagic.size();
+  SnapshotKeyIndex index;
+  index.dict_chain_ = absl::little_endian::Load32(next);
+  uint64_t num_chains = absl::little_endian::Load64(next + 4);
+  uint64_t num_keys = absl::little_endian::Load64(next + 12);
+  uint32_t id_len = absl::little_endian::Load32(next + 20);
+  next += 24;
+
+  // Counts are validated before they are multiplied, so that corrupted ones can not overflow.
+  size_t avail = data.size() - kHeaderSize;
+  if (id_len > avail || num_chains > (avail - id_len) / kChainSize ||
+      num_keys > (avail - id_len - num_chains * kChainSize) / kKeySize) {
+    return nullopt;
+  }
+  index.snapshot_id_.assign(next, id_len);
+  next += id_len;
+  if (index.dict_chain_ != kNoChain && index.dict_chain_ >= num_chains)
+    return nullopt;
+
+  index.chains_.resize(num_chains);
+  for (Chain& chain : index.chains_) {
+    chain.offset = absl::little_endian::Load64(next);
+    chain.end = absl::little_endian::Load64(next + 8);
+    if (chain.end < chain.offset)
+      return nullopt;
+    next += kChainSize;
+  }
+
+  index.keys_.resize(num_keys);
+  for (Key& key : index.keys_) {
+    key.hash = absl::little_endian::Load64(next);
+    key.chain_id = absl::little_endian::Load32(next + 8);
+    key.slot = absl::little_endian::Load16(next + 12);
+    if (key.chain_id >= num_chains || key.slot > kMaxSlotNum)
+      return nullopt;
+    next += kKeySize;
+  }
+
+  if (!is_sorted(index.keys_.begin(), index.keys_.end()))
+    return nullopt;
+  return index;
+}
+
+vector<SnapshotKeyIndex::Chain> SnapshotKeyIndex::Find(uint64_t hash) const {
+  vector<Chain> res;
+  auto it = lower_bound(keys_.begin(), keys_.end(), Key{hash, 0, 0});
+  for (; it != keys_.end() && it->hash == hash; ++it) {
+    res.push_back(chains_[it->chain_id]);
+  }
+  return res;
+}
+
+optional<SnapshotKeyIndex::Chain> SnapshotKeyIndex::dict_chain() const {
+  if (dict_chain_ == kNoChain)
+    return nullopt;
+  return chains_[dict_chain_];
+}
+
+vector<SnapshotKeyIndex::Chain> SnapshotKeyIndex::RangesOfSlots(const cluster::SlotSet& slots,
+                                                               uint64_t file_size) const {
+  if (chains_.empty())
+    return {{0, file_size}};
+
+  // Chains are added in file order.
+  vector<bool> selected(chains_.size());
+  for (const Key& key : keys_) {
+    if (slots.Contains(key.slot))
+      selected[key.chain_id] = true;
+  }
+  if (dict_chain_ != kNoChain)
+    selected[dict_chain_] = true;
+
+  vector<Chain> res{{0, chains_.front().offset}};
+  for (size_t i = 0; i < chains_.size(); ++i) {
+    if (!selected[i])
+      continue;
+    if (res.back().end == chains_[i].offset)
+      res.back().end = chains_[i].end;
+    else
+      res.push_back(chains_[i]);
+  }
+
+  Chain trailer{chains_.back().end, file_size};
+  if (res.back().end == trailer.offset)
+    res.back().end = trailer.end;
+  else
+    res.push_back(trailer);
+  return res;
+}
+
+FileRangesSource::FileRangesSource(unique_ptr<io::ReadonlyFile> file,
+                                   vector<SnapshotKeyIndex::Chain> ranges)
+    : file_(std::move(file)), ranges_(std::move(ranges)) {
+}
+
+FileRangesSource::~FileRangesSource() {
+  std::ignore = file_->Close();
+}
+
+io::Result<size_t> FileRangesSource::ReadSome(const iovec* v, uint32_t len) {
+  while (next_range_ < ranges_.size() &&
+         ranges_[next_range_].offset + offset_ == ranges_[next_range_].end) {
+    ++next_range_;
+    offset_ = 0;
+  }
+  if (next_range_ == ranges_.size() || len == 0)
+    return 0;
+
+  const SnapshotKeyIndex::Chain& range = ranges_[next_range_];
+  size_t read_len = min<uint64_t>(v->iov_len, range.end - range.offset - offset_);
+  io::Result<size_t> res = file_->Read(
+      range.offset + offset_, io::MutableBytes{static_cast<uint8_t*>(v->iov_base), read_len});
+  if (res)
+    offset_ += *res;
+  return res;
+}
+
+}  // namespace dfly::detail
@@ -0,0 +1,119 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "io/file.h"
+#include "server/cluster_support.h"
+
+namespace dfly {
+
+namespace cluster {
+class SlotSet;
+}  // namespace cluster
+
+namespace detail {
+
+class SnapshotStorage;
+
+// Index of the entries of a DF shard file, saved next to it. The snapshot writes entries in
+// chains of consecutive records that start at an entry boundary and select their db anew, so any
+// chain can be parsed on its own. The index maps key hashes to the chains holding their entries,
+// which allows loading a single key without reading the file up to it. Keys also carry their
+// slot, so that the entries of a subset of slots can be restored.
+class SnapshotKeyIndex {
+ public:
+  struct Chain {
+    uint64_t offset = 0;  // file offset of the first record
+    uint64_t end = 0;     // file offset following the last record
+  };
+
+  static constexpr uint32_t kNoChain = UINT32_MAX;
+
+  // Path of the index of a shard file.
+  static std::string IndexPath(std::string_view shard_file);
+
+  // Reads the index of the shard file. Returns nullopt if it is missing or invalid.
+  static std::optional<SnapshotKeyIndex> Open(SnapshotStorage* storage,
+                                              const std::string& shard_file);
+
+  // Returns id of the added chain.
+  uint32_t AddChain(Chain chain);
+  void AddKey(uint64_t hash, SlotId slot, uint32_t chain_id);
+
+  // Chain that holds the compression dictionary of the file, if any.
+  void SetDictChain(uint32_t chain_id) {
+    dict_chain_ = chain_id;
+  }
+
+  std::string Serialize();
+  static std::optional<SnapshotKeyIndex> Parse(std::string_view data);
+
+  // Returns chains that may hold the key with the given hash, in file order.
+  std::vector<Chain> Find(uint64_t hash) const;
+
+  std::optional<Chain> dict_chain() const;
+
+  // Returns the ranges of the indexed file of the given size that must be read to load the keys
+  // of the slots: the header, the chains that hold the keys and the dictionary, and the trailer.
+  // Adjacent ranges are merged.
+  std::vector<Chain> RangesOfSlots(const cluster::SlotSet& slots, uint64_t file_size) const;
+
+  // Id of the snapshot of the indexed file, protects from using an index of another save.
+  void set_snapshot_id(std::string id) {
+    snapshot_id_ = std::move(id);
+  }
+
+  const std::string& snapshot_id() const {
+    return snapshot_id_;
+  }
+
+  size_t num_keys() const {
+    return keys_.size();
+  }
+
+ private:
+  struct Key {
+    uint64_t hash;
+    uint32_t chain_id;
+    SlotId slot;
+
+    bool operator<(const Key& other) const {
+      return std::pair{hash, chain_id} < std::pair{other.hash, other.chain_id};
+    }
+  };
+
+  void Sort();
+
+  std::vector<Chain> chains_;
+  std::vector<Key> keys_;
+  uint32_t dict_chain_ = kNoChain;
+  std::string snapshot_id_;
+};
+
+// Source that reads the given ranges of a file one after another.
+class FileRangesSource : public io::Source {
+ public:
+  FileRangesSource(std::unique_ptr<io::ReadonlyFile> file,
+                   std::vector<SnapshotKeyIndex::Chain> ranges);
+  ~FileRangesSource();
+
+  io::Result<size_t> ReadSome(const iovec* v, uint32_t len) final;
+
+ private:
+  std::unique_ptr<io::ReadonlyFile> file_;
+  std::vector<SnapshotKeyIndex::Chain> ranges_;
+  size_t next_range_ = 0;
+  uint64_t offset_ = 0;  // in the current range
+};
+
+}  // namespace detail
+}  // namespace dfly
@@ -5,12 +5,19 @@
 
 #include <absl/strings/str_replace.h>
 #include <absl/strings/strip.h>
+#include <mimalloc.h>
 
 #ifdef WITH_AWS
 #include <aws/core/auth/AWSCredentialsProvider.h>
 #include <aws/s3/S3Client.h>
+#include <aws/s3/model/AbortMultipartUploadRequest.h>
+#include <aws/s3/model/CompleteMultipartUploadRequest.h>
+#include <aws/s3/model/CreateMultipartUploadRequest.h>
+#include <aws/s3/model/GetObjectRequest.h>
+#include <aws/s3/model/HeadObjectRequest.h>
 #include <aws/s3/model/ListObjectsV2Request.h>
 #include <aws/s3/model/PutObjectRequest.h>
+#include <aws/s3/model/UploadPartRequest.h>
 
 #include "util/aws/aws.h"
 #include "util/aws/credentials_provider_chain.h"
@@ -21,13 +28,25 @@
 
 #include <regex>
 
+#include "base/flags.h"
 #include "base/logging.h"
+#include "io/file.h"
 #include "io/file_util.h"
 #include "server/engine_shard_set.h"
 #include "util/cloud/azure/creds_provider.h"
 #include "util/cloud/azure/storage.h"
 #include "util/cloud/gcp/gcs_file.h"
 #include "util/fibers/fiber_file.h"
+ABSL_FLAG(uint32_t, snapshot_load_readahead_mb, 0,
+          "If positive, local snapshot files are loaded with direct I/O, reading that many "
+          "megabytes ahead of the parser. Requires io_uring.");
+
+ABSL_FLAG(uint32_t, s3_transfer_concurrency, 1,
+          "Number of parts of an S3 snapshot file that are uploaded or downloaded in parallel. "
+          "1 streams every file sequentially.");
+ABSL_FLAG(uint32_t, s3_part_size_mb, 16,
+          "Size of the parts of S3 snapshot files that are transferred in parallel, at least 5.");
+
 namespace dfly {
 namespace detail {
 
@@ -116,6 +135,13 @@ io::Result<SnapshotStorage::ExpandResult, GenericError> SnapshotStorage::ExpandS
   return result;
 }
 
+io::Result<unique_ptr<io::Source>> SnapshotStorage::OpenReadSource(const string& path) {
+  io::ReadonlyFileOrError res = OpenReadFile(path);
+  if (!res)
+    return nonstd::make_unexpected(res.error());
+  return make_unique<io::FileSource>(*res);
+}
+
 FileSnapshotStorage::FileSnapshotStorage(fb2::FiberQueueThreadPool* fq_threadpool)
     : fq_threadpool_{fq_threadpool} {
 }
@@ -164,6 +190,19 @@ io::ReadonlyFileOrError FileSnapshotStorage::OpenReadFile(const std::string& pat
 #endif
 }
 
+io::Result<unique_ptr<io::Source>> FileSnapshotStorage::OpenReadSource(const string& path) {
+#ifdef __linux__
+  unsigned depth = absl::GetFlag(FLAGS_snapshot_load_readahead_mb);
+  if (depth > 0 && fb2::ProactorBase::me()->GetKind() == fb2::ProactorBase::IOURING) {
+    auto res = LinuxReadAheadSource::Open(path, depth);
+    if (!res)
+      return nonstd::make_unexpected(res.error());
+    return unique_ptr<io::Source>{std::move(*res)};
+  }
+#endif
+  return SnapshotStorage::OpenReadSource(path);
+}
+
 io::Result<std::string, GenericError> FileSnapshotStorage::LoadPath(std::string_view dir,
                                                                     std::string_view dbfilename) {
   if (dbfilename.empty())
@@ -493,6 +532,260 @@ error_code AzureSnapshotStorage::CheckPath(const std::string& path) {
 }
 
 #ifdef WITH_AWS
+namespace {
+
+// The AWS SDK is stack hungry, so its calls run in fibers with a large stack.
+constexpr size_t kS3FiberStack = 40 * 1024;
+
+error_code S3Error(string_view op, const Aws::S3::S3Error& error) {
+  LOG(ERROR) << "S3 " << op << " failed: " << error.GetExceptionName() << " "
+             << error.GetMessage();
+  return make_error_code(errc::io_error);
+}
+
+// Multipart upload that keeps up to `concurrency` parts in flight.
+class S3ParallelWriteFile : public io::WriteFile {
+ public:
+  S3ParallelWriteFile(string bucket, string key, string upload_id,
+                      shared_ptr<Aws::S3::S3Client> client, size_t part_size, unsigned concurrency)
+      : io::WriteFile(key),
+        bucket_(std::move(bucket)),
+        key_(std::move(key)),
+        upload_id_(std::move(upload_id)),
+        client_(std::move(client)),
+        part_size_(part_size),
+        concurrency_(concurrency) {
+  }
+
+  ~S3ParallelWriteFile() {
+    waker_.await([this] { return inflight_ == 0; });
+  }
+
+  io::Result<size_t> WriteSome(const iovec* v, uint32_t len) final {
+    size_t written = 0;
+    for (uint32_t i = 0; i < len; ++i) {
+      buf_.append(static_cast<const char*>(v[i].iov_base), v[i].iov_len);
+      written += v[i].iov_len;
+    }
+    if (buf_.size() >= part_size_)
+      UploadPart();
+
+    if (ec_)
+      return nonstd::make_unexpected(ec_);
+    return written;
+  }
+
+  error_code Close() final {
+    // S3 requires at least one part, even if it's empty.
+    if (!buf_.empty() || parts_.empty())
+      UploadPart();
+    waker_.await([this] { return inflight_ == 0; });
+
+    Aws::S3::Model::CompletedMultipartUpload upload;
+    for (Aws::S3::Model::CompletedPart& part : parts_)
+      upload.AddParts(std::move(part));
+
+    RunS3Call("s3_complete", [&] {
+      if (ec_) {
+        Aws::S3::Model::AbortMultipartUploadRequest request;
+        request.SetBucket(bucket_);
+        request.SetKey(key_);
+        request.SetUploadId(upload_id_);
+        client_->AbortMultipartUpload(request);
+        return;
+      }
+
+      Aws::S3::Model::CompleteMultipartUploadRequest request;
+      request.SetBucket(bucket_);
+      request.SetKey(key_);
+      request.SetUploadId(upload_id_);
+      request.SetMultipartUpload(std::move(upload));
+      auto outcome = client_->CompleteMultipartUpload(request);
+      if (!outcome.IsSuccess())
+        ec_ = S3Error("CompleteMultipartUpload", outcome.GetError());
+    });
+    return ec_;
+  }
+
+ private:
+  template <typename F> static void RunS3Call(string_view name, F&& f) {
+    fb2::ProactorBase::me()
+        ->LaunchFiber(fb2::Launch::post, boost::context::fixedsize_stack{kS3FiberStack}, name,
+                      std::forward<F>(f))
+        .Join();
+  }
+
+  void UploadPart() {
+    waker_.await([this] { return inflight_ < concurrency_; });
+
+    int part_number = parts_.size() + 1;
+    parts_.emplace_back().SetPartNumber(part_number);
+    inflight_++;
+
+    auto upload = [this, part_number, data = std::move(buf_)] {
+      Aws::S3::Model::UploadPartRequest request;
+      request.SetBucket(bucket_);
+      request.SetKey(key_);
+      request.SetUploadId(upload_id_);
+      request.SetPartNumber(part_number);
+      request.SetContentLength(data.size());
+      auto body = Aws::MakeShared<Aws::StringStream>("dragonfly");
+      body->write(data.data(), data.size());
+      request.SetBody(body);
+
+      auto outcome = client_->UploadPart(request);
+      if (outcome.IsSuccess())
+        parts_[part_number - 1].SetETag(outcome.GetResult().GetETag());
+      else if (!ec_)
+        ec_ = S3Error("UploadPart", outcome.GetError());
+
+      inflight_--;
+      waker_.notify();
+    };
+    buf_.clear();
+    fb2::ProactorBase::me()
+        ->LaunchFiber(fb2::Launch::post, boost::context::fixedsize_stack{kS3FiberStack},
+                      "s3_upload_part", std::move(upload))
+        .Detach();
+  }
+
+  string bucket_, key_, upload_id_;
+  shared_ptr<Aws::S3::S3Client> client_;
+  size_t part_size_;
+  unsigned concurrency_;
+
+  string buf_;  // data of the next part
+  vector<Aws::S3::Model::CompletedPart> parts_;
+  unsigned inflight_ = 0;
+  error_code ec_;
+  fb2::EventCount waker_;
+};
+
+// Reads an S3 object sequentially with ranged GETs, keeping up to `concurrency` parts in flight.
+class S3ParallelReadSource : public io::Source {
+ public:
+  S3ParallelReadSource(string bucket, string key, shared_ptr<Aws::S3::S3Client> client,
+                       size_t size, size_t part_size, unsigned concurrency)
+      : bucket_(std::move(bucket)),
+        key_(std::move(key)),
+        client_(std::move(client)),
+        size_(size),
+        part_size_(part_size),
+        parts_(concurrency) {
+    for (size_t i = 0; i < parts_.size(); ++i)
+      FetchPart(i);
+  }
+
+  ~S3ParallelReadSource() {
+    waker_.await([this] { return inflight_ == 0; });
+  }
+
+  io::Result<size_t> ReadSome(const iovec* v, uint32_t len) final {
+    size_t read_total = 0;
+    size_t iov_offset = 0;
+    while (len > 0 && consumed_ < size_) {
+      Part& part = parts_[head_];
+      if (!part.ready) {
+        if (read_total > 0)
+          break;
+        waker_.await([&part] { return part.ready; });
+      }
+      if (part.ec)
+        return nonstd::make_unexpected(part.ec);
+
+      if (part.consumed == part.data.size()) {
+        FetchPart(head_);
+        head_ = (head_ + 1) % parts_.size();
+        continue;
+      }
+
+      size_t read_sz = min(part.data.size() - part.consumed, v->iov_len - iov_offset);
+      memcpy(static_cast<char*>(v->iov_base) + iov_offset, part.data.data() + part.consumed,
+             read_sz);
+      part.consumed += read_sz;
+      consumed_ += read_sz;
+      read_total += read_sz;
+      iov_offset += read_sz;
+      if (iov_offset == v->iov_len) {
+        ++v;
+        --len;
+        iov_offset = 0;
+      }
+    }
+    return read_total;
+  }
+
+ private:
+  struct Part {
+    string data;
+    size_t consumed = 0;
+    error_code ec;
+    bool ready = false;
+  };
+
+  // Start fetching the next range of the object into parts_[index].
+  void FetchPart(size_t index) {
+    Part& part = parts_[index];
+    part.data.clear();
+    part.consumed = 0;
+    if (next_offset_ >= size_) {  // past the end, never read
+      part.ready = false;
+      return;
+    }
+
+    size_t start = next_offset_;
+    size_t end = min(start + part_size_, size_);
+    next_offset_ = end;
+    part.ready = false;
+    inflight_++;
+
+    auto fetch = [this, index, start, end] {
+      Aws::S3::Model::GetObjectRequest request;
+      request.SetBucket(bucket_);
+      request.SetKey(key_);
+      request.SetRange(absl::StrCat("bytes=", start, "-", end - 1));
+
+      Part& part = parts_[index];
+      auto outcome = client_->GetObject(request);
+      if (outcome.IsSuccess()) {
+        part.data.resize(end - start);
+        auto& body = outcome.GetResult().GetBody();
+        body.read(part.data.data(), part.data.size());
+        if (size_t(body.gcount()) != part.data.size())
+          part.ec = make_error_code(errc::io_error);
+      } else {
+        part.ec = S3Error("GetObject", outcome.GetError());
+      }
+
+      part.ready = true;
+      inflight_--;
+      waker_.notify();
+    };
+    fb2::ProactorBase::me()
+        ->LaunchFiber(fb2::Launch::post, boost::context::fixedsize_stack{kS3FiberStack},
+                      "s3_get_part", std::move(fetch))
+        .Detach();
+  }
+
+  string bucket_, key_;
+  shared_ptr<Aws::S3::S3Client> client_;
+  size_t size_, part_size_;
+
+  vector<Part> parts_;  // ring of parts in object order starting from head_
+  size_t head_ = 0;
+  size_t next_offset_ = 0;  // offset of the next range to fetch
+  size_t consumed_ = 0;
+  unsigned inflight_ = 0;
+  fb2::EventCount waker_;
+};
+
+size_t S3PartSize() {
+  // S3 rejects parts smaller than 5MB, except for the last one.
+  return max(absl::GetFlag(FLAGS_s3_part_size_mb), 5u) << 20;
+}
+
+}  // namespace
+
 AwsS3SnapshotStorage::AwsS3SnapshotStorage(const std::string& endpoint, bool https,
                                            bool ec2_metadata, bool sign_payload) {
   shard_set->pool()->GetNextProactor()->Await([&] {
@@ -528,8 +821,26 @@ io::Result<std::pair<io::Sink*, uint8_t>, GenericError> AwsS3SnapshotStorage::Op
 
   // We run S3 operations via a temporary fiber to avoid agressive stack consumption.
   io::Result<std::pair<io::Sink*, uint8_t>, GenericError> result;
+  unsigned concurrency = absl::GetFlag(FLAGS_s3_transfer_concurrency);
   auto fb = proactor->LaunchFiber(
       fb2::Launch::post, boost::context::fixedsize_stack{40 * 1024}, "open_s3_write", [&] {
+        if (concurrency > 1) {
+          Aws::S3::Model::CreateMultipartUploadRequest request;
+          request.SetBucket(bucket);
+          request.SetKey(key);
+          auto outcome = s3_->CreateMultipartUpload(request);
+          if (!outcome.IsSuccess()) {
+            result = nonstd::make_unexpected(
+                GenericError(S3Error("CreateMultipartUpload", outcome.GetError()),
+                             "Failed to open write file"));
+            return;
+          }
+          io::Sink* f = new S3ParallelWriteFile(bucket, key, outcome.GetResult().GetUploadId(),
+                                                s3_, S3PartSize(), concurrency);
+          result = std::pair<io::Sink*, uint8_t>(f, FileType::CLOUD);
+          return;
+        }
+
         io::Result<aws::S3WriteFile> file = aws::S3WriteFile::Open(bucket, key, s3_);
         if (!file) {
           result = nonstd::make_unexpected(GenericError(file.error(), "Failed to open write file"));
@@ -552,6 +863,32 @@ io::ReadonlyFileOrError AwsS3SnapshotStorage::OpenReadFile(const std::string& pa
   return new aws::S3ReadFile(bucket, key, s3_);
 }
 
+io::Result<unique_ptr<io::Source>> AwsS3SnapshotStorage::OpenReadSource(const string& path) {
+  unsigned concurrency = absl::GetFlag(FLAGS_s3_transfer_concurrency);
+  if (concurrency <= 1)
+    return SnapshotStorage::OpenReadSource(path);
+
+  optional<pair<string, string>> bucket_path = GetBucketPath(path);
+  if (!bucket_path)
+    return nonstd::make_unexpected(make_error_code(errc::invalid_argument));
+  auto [bucket, key] = *bucket_path;
+
+  Aws::S3::Model::HeadObjectOutcome outcome;
+  auto fb = fb2::ProactorBase::me()->LaunchFiber(
+      fb2::Launch::post, boost::context::fixedsize_stack{40 * 1024}, "s3_head", [&] {
+        Aws::S3::Model::HeadObjectRequest request;
+        request.SetBucket(bucket);
+        request.SetKey(key);
+        outcome = s3_->HeadObject(request);
+      });
+  fb.Join();
+  if (!outcome.IsSuccess())
+    return nonstd::make_unexpected(S3Error("HeadObject", outcome.GetError()));
+
+  return unique_ptr<io::Source>{new S3ParallelReadSource(
+      bucket, key, s3_, outcome.GetResult().GetContentLength(), S3PartSize(), concurrency)};
+}
+
 io::Result<std::string, GenericError> AwsS3SnapshotStorage::LoadPath(std::string_view dir,
                                                                      std::string_view dbfilename) {
   if (dbfilename.empty())
@@ -682,6 +1019,105 @@ io::Result<size_t> LinuxWriteWrapper::WriteSome(const iovec* v, uint32_t len) {
 
   return res;
 }
+
+io::Result<unique_ptr<LinuxReadAheadSource>> LinuxReadAheadSource::Open(const string& path,
+                                                                        unsigned depth) {
+  const int kFlags = O_RDONLY | O_CLOEXEC;
+  bool direct = true;
+  auto res = fb2::OpenLinux(path, kFlags | O_DIRECT, 0);
+  if (!res && res.error() == errc::invalid_argument) {  // direct I/O is not supported
+    direct = false;
+    res = fb2::OpenLinux(path, kFlags, 0);
+  }
+  if (!res)
+    return nonstd::make_unexpected(res.error());
+
+  if (!direct)
+    posix_fadvise((*res)->fd(), 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  return unique_ptr<LinuxReadAheadSource>{
+      new LinuxReadAheadSource(std::move(*res), direct, max(depth, 2u))};
+}
+
+LinuxReadAheadSource::LinuxReadAheadSource(unique_ptr<fb2::LinuxFile> lf, bool direct,
+                                           unsigned depth)
+    : lf_(std::move(lf)), direct_(direct), blocks_(depth) {
+  for (size_t i = 0; i < blocks_.size(); ++i) {
+    // Direct I/O requires aligned buffers.
+    blocks_[i].data = static_cast<uint8_t*>(mi_malloc_aligned(kBlockSize, 4096));
+    IssueRead(i);
+  }
+}
+
+LinuxReadAheadSource::~LinuxReadAheadSource() {
+  // Completions write into the blocks, so wait for them before releasing.
+  waker_.await([this] { return pending_ == 0; });
+  for (Block& block : blocks_)
+    mi_free(block.data);
+  lf_->Close();
+}
+
+void LinuxReadAheadSource::IssueRead(size_t index) {
+  Block& block = blocks_[index];
+  block.offset = next_offset_;
+  block.size = block.consumed = 0;
+  block.error = 0;
+  block.ready = false;
+  next_offset_ += kBlockSize;
+
+  pending_++;
+  auto cb = [this, index](int io_res) {
+    Block& block = blocks_[index];
+    if (io_res < 0)
+      block.error = -io_res;
+    else
+      block.size = io_res;
+    block.ready = true;
+    pending_--;
+    waker_.notify();
+  };
+  lf_->ReadAsync({block.data, kBlockSize}, block.offset, std::move(cb));
+}
+
+io::Result<size_t> LinuxReadAheadSource::ReadSome(const iovec* v, uint32_t len) {
+  size_t read_total = 0;
+  size_t iov_offset = 0;
+  while (len > 0) {
+    Block& block = blocks_[head_];
+    if (!block.ready) {
+      if (read_total > 0)
+        break;
+      waker_.await([&block] { return block.ready; });
+    }
+
+    if (block.error)
+      return nonstd::make_unexpected(error_code{block.error, system_category()});
+
+    if (block.consumed == block.size) {
+      if (block.size < kBlockSize)  // end of file
+        break;
+
+      if (!direct_)
+        posix_fadvise(lf_->fd(), block.offset, kBlockSize, POSIX_FADV_DONTNEED);
+      IssueRead(head_);
+      head_ = (head_ + 1) % blocks_.size();
+      continue;
+    }
+
+    size_t read_sz = min(block.size - block.consumed, v->iov_len - iov_offset);
+    memcpy(static_cast<char*>(v->iov_base) + iov_offset, block.data + block.consumed, read_sz);
+    block.consumed += read_sz;
+    read_total += read_sz;
+    iov_offset += read_sz;
+    if (iov_offset == v->iov_len) {
+      ++v;
+      --len;
+      iov_offset = 0;
+    }
+  }
+
+  return read_total;
+}
 #endif
 
 void SubstituteFilenamePlaceholders(fs::path* filename, const FilenameSubstitutions& fns) {
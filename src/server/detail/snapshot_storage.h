@@ -19,6 +19,7 @@
 #include "util/cloud/gcp/gcp_creds_provider.h"
 #include "util/cloud/gcp/gcs.h"
 #include "util/fibers/fiberqueue_threadpool.h"
+#include "util/fibers/synchronization.h"
 #include "util/fibers/uring_file.h"
 
 namespace dfly {
@@ -50,6 +51,9 @@ class SnapshotStorage {
 
   virtual io::ReadonlyFileOrError OpenReadFile(const std::string& path) = 0;
 
+  // Opens the file for reading it sequentially from the start.
+  virtual io::Result<std::unique_ptr<io::Source>> OpenReadSource(const std::string& path);
+
   // Returns the path of the RDB file or DFS summary file to load.
   virtual io::Result<std::string, GenericError> LoadPath(std::string_view dir,
                                                          std::string_view dbfilename) = 0;
@@ -90,6 +94,8 @@ class FileSnapshotStorage : public SnapshotStorage {
 
   io::ReadonlyFileOrError OpenReadFile(const std::string& path) override;
 
+  io::Result<std::unique_ptr<io::Source>> OpenReadSource(const std::string& path) override;
+
   io::Result<std::string, GenericError> LoadPath(std::string_view dir,
                                                  std::string_view dbfilename) override;
 
@@ -166,6 +172,9 @@ class AwsS3SnapshotStorage : public SnapshotStorage {
 
   io::ReadonlyFileOrError OpenReadFile(const std::string& path) override;
 
+  // Downloads parts in parallel if s3_transfer_concurrency is above 1.
+  io::Result<std::unique_ptr<io::Source>> OpenReadSource(const std::string& path) override;
+
   io::Result<std::string, GenericError> LoadPath(std::string_view dir,
                                                  std::string_view dbfilename) override;
 
@@ -205,6 +214,47 @@ class LinuxWriteWrapper : public io::Sink {
   std::unique_ptr<util::fb2::LinuxFile> lf_;
   off_t offset_ = 0;
 };
+
+// Reads a local file sequentially in large blocks with direct I/O, keeping several blocks in
+// flight ahead of the reader. Bypassing the page cache keeps loads from evicting the data of
+// other processes. If the file system does not support direct I/O, consumed blocks are dropped
+// from the page cache instead. Must be used on the io_uring proactor that opened it.
+class LinuxReadAheadSource : public io::Source {
+ public:
+  static constexpr size_t kBlockSize = 1 << 20;
+
+  // depth - number of blocks read ahead.
+  static io::Result<std::unique_ptr<LinuxReadAheadSource>> Open(const std::string& path,
+                                                                unsigned depth);
+
+  ~LinuxReadAheadSource();
+
+  io::Result<size_t> ReadSome(const iovec* v, uint32_t len) final;
+
+ private:
+  struct Block {
+    uint8_t* data = nullptr;
+    off_t offset = 0;
+    size_t size = 0;  // bytes read, less than kBlockSize at the end of the file
+    size_t consumed = 0;
+    int error = 0;
+    bool ready = false;
+  };
+
+  LinuxReadAheadSource(std::unique_ptr<util::fb2::LinuxFile> lf, bool direct, unsigned depth);
+
+  // Start reading the next block of the file into blocks_[index].
+  void IssueRead(size_t index);
+
+  std::unique_ptr<util::fb2::LinuxFile> lf_;
+  bool direct_;
+
+  std::vector<Block> blocks_;  // ring of blocks in file order starting from head_
+  size_t head_ = 0;
+  off_t next_offset_ = 0;  // offset of the next block to read
+  unsigned pending_ = 0;
+  util::fb2::EventCount waker_;
+};
 #endif
 
 struct FilenameSubstitutions {
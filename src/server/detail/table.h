@@ -15,11 +15,41 @@ namespace detail {
 using PrimeKey = CompactObj;
 using PrimeValue = CompactObj;
 
+// Expiry deadline cached inside the prime table slot in addition to the expire table entry,
+// so that lookups which do not need the expire iterator can skip the expire table.
+// Encodes the deadline relative to the expire base: in milliseconds for the first ~24 days and
+// in seconds after that. 0 means unknown, i.e. the expire table must be consulted.
+class InlineExpire {
+ public:
+  static constexpr uint32_t kSecBit = 1u << 31;
+
+  static uint32_t Encode(uint64_t delta_ms) {
+    if (delta_ms < kSecBit - 1)
+      return delta_ms + 1;
+    uint64_t sec = delta_ms / 1000;
+    return sec < kSecBit ? kSecBit | sec : 0;
+  }
+
+  // Returns true if the encoded deadline is known to be later than now_ms (relative to the base).
+  static bool IsAlive(uint32_t val, int64_t now_ms) {
+    if (val == 0)
+      return false;
+    if (val & kSecBit)
+      return now_ms < int64_t(val & ~kSecBit) * 1000;
+    return now_ms < int64_t(val) - 1;
+  }
+};
+
 struct PrimeTablePolicy {
   enum { kSlotNum = 14, kBucketNum = 56 };
 
   static constexpr bool kUseVersion = true;
 
+#ifdef DFLY_INLINE_EXPIRE
+  // Encoded InlineExpire deadline of the entry.
+  using SlotExt = uint32_t;
+#endif
+
   static uint64_t HashFn(const PrimeKey& s) {
     return s.HashCode();
   }
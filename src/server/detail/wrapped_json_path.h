@@ -108,6 +108,13 @@ class WrappedJsonPath {
   OpResult<JsonCallbackResult<std::optional<T>>> ExecuteMutateCallback(
       JsonType* json_entry, JsonPathMutateCallback<T> cb, CallbackResultOptions options) const;
 
+  // Runs the mutation directly on the buffer of a flat json, see json::MutatePathInPlace.
+  // Returns nullopt if it is not possible, in that case nothing is changed but `cb` may have been
+  // called already. `cb` must not delete values.
+  template <typename T>
+  std::optional<JsonCallbackResult<std::optional<T>>> ExecuteMutateCallbackInPlace(
+      FlatJson json_entry, JsonPathMutateCallback<T> cb, CallbackResultOptions options) const;
+
   bool IsLegacyModePath() const;
 
   bool RefersToRootElement() const;
@@ -292,6 +299,30 @@ OpResult<JsonCallbackResult<std::optional<T>>> WrappedJsonPath::ExecuteMutateCal
   return mutate_result;
 }
 
+template <typename T>
+std::optional<JsonCallbackResult<std::optional<T>>> WrappedJsonPath::ExecuteMutateCallbackInPlace(
+    FlatJson json_entry, JsonPathMutateCallback<T> cb, CallbackResultOptions options) const {
+  if (!HoldsJsonPath())
+    return std::nullopt;
+
+  JsonCallbackResult<std::optional<T>> mutate_result{InitializePathType(options)};
+
+  auto mutate_callback = [&cb, &mutate_result](std::optional<std::string_view> path,
+                                               JsonType* val) {
+    auto res = cb(path, val);
+    DCHECK(!res.should_be_deleted);
+    if (res.value.has_value()) {
+      mutate_result.AddValue(std::move(res.value).value());
+    } else if (!mutate_result.IsV1()) {
+      mutate_result.AddValue(std::nullopt);
+    }
+  };
+
+  if (!json::MutatePathInPlace(AsJsonPath(), mutate_callback, json_entry))
+    return std::nullopt;
+  return mutate_result;
+}
+
 inline bool WrappedJsonPath::IsLegacyModePath() const {
   return path_type_ == JsonPathType::kLegacy;
 }
@@ -6,24 +6,34 @@ extern "C" {
 #include "redis/crc16.h"
 }
 
+#include <hdr/hdr_histogram.h>
+
+#include <absl/container/flat_hash_map.h>
 #include <absl/container/flat_hash_set.h>
 #include <absl/random/random.h>
+#include <absl/strings/ascii.h>
 #include <absl/strings/match.h>
 #include <absl/strings/str_cat.h>
 #include <absl/strings/str_format.h>
+#include <absl/strings/str_join.h>
+#include <absl/strings/str_replace.h>
 #include <absl/strings/str_split.h>
+#include <absl/strings/strip.h>
 
 #include <boost/icl/interval_set.hpp>
+#include <fstream>
+#include <iostream>
 #include <queue>
 #include <tuple>
 
+#include "absl/base/internal/endian.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
-#include "base/histogram.h"
 #include "base/init.h"
 #include "base/random.h"
 #include "base/zipf_gen.h"
 #include "facade/redis_parser.h"
+#include "io/file_util.h"
 #include "io/io.h"
 #include "io/io_buf.h"
 #include "util/fibers/dns_resolve.h"
@@ -61,6 +71,17 @@ ABSL_FLAG(string, ratio, "1:10", "Set:Get ratio");
 ABSL_FLAG(string, command, "",
           "custom command with __key__ placeholder for keys, "
           "__data__ for values, __score__ for doubles");
+ABSL_FLAG(string, workload, "",
+          "path to a workload file with weighted command templates, one per line: "
+          "<weight> [key_dist=U|N|Z|S] [d=<size>|d=<min>-<max>] [pipeline=<depth>] <command>, "
+          "where the command uses the same placeholders as --command. Overrides --command and "
+          "--ratio");
+ABSL_FLAG(string, replay, "",
+          "replays the traffic recorded with DEBUG TRAFFIC <path>, given the same path. Every "
+          "recorded connection is replayed on its own connection");
+ABSL_FLAG(double, replay_speed, 1.0,
+          "speed factor of the replay relative to the recorded timing, 0 replays as fast as "
+          "possible with up to --pipeline pending requests per connection");
 ABSL_FLAG(string, P, "", "protocol can be empty (for RESP) or memcache_text");
 
 ABSL_FLAG(bool, tcp_nodelay, false, "If true, set nodelay option on tcp socket");
@@ -68,6 +89,9 @@ ABSL_FLAG(bool, noreply, false, "If true, does not wait for replies. Relevant on
 
 ABSL_FLAG(bool, probe_cluster, true,
           "If false, skips cluster-mode probing and works only in single node mode");
+ABSL_FLAG(bool, replica_reads, false,
+          "In cluster mode, also connects to the replicas of every shard and sends them the read "
+          "commands of the workload");
 
 ABSL_FLAG(bool, greet, true,
           "If true, sends a greeting command on each connection, "
@@ -80,6 +104,11 @@ ABSL_FLAG(bool, connect_only, false,
           "If true, will only connect to the server, without sending "
           "loadtest commands");
 ABSL_FLAG(string, password, "", "password to authenticate the client");
+ABSL_FLAG(uint32_t, report_interval, 5, "Interval in seconds between progress reports");
+ABSL_FLAG(string, output_format, "",
+          "machine-readable report format: empty for none, json for JSON lines or csv. "
+          "Interval snapshots and the final summary are written to --output_file");
+ABSL_FLAG(string, output_file, "", "file for the machine-readable report, stdout if empty");
 
 using namespace std;
 using namespace util;
@@ -102,6 +131,163 @@ enum Protocol { RESP, MC_TEXT } protocol;
 enum DistType { UNIFORM, NORMAL, ZIPFIAN, SEQUENTIAL } dist_type{UNIFORM};
 constexpr uint16_t kNumSlots = 16384;
 
+// A command template of the workload file.
+struct WorkloadTemplate {
+  uint32_t weight = 1;
+  DistType key_dist = UNIFORM;
+  uint32_t value_min = 0, value_max = 0;  // value size range in bytes, inclusive.
+  uint32_t pipeline = 1;                  // number of commands sent back to back.
+  string command;
+};
+
+vector<WorkloadTemplate> workload;
+
+// A command recorded with DEBUG TRAFFIC.
+struct TrafficRecord {
+  uint64_t ts_ns;
+  uint32_t db_index;
+  vector<string> args;
+};
+
+// Commands of a recorded connection, in order.
+using TrafficStream = vector<TrafficRecord>;
+
+vector<TrafficStream> replay_streams;
+uint64_t replay_first_ts = UINT64_MAX;
+
+// Parses a traffic file of a single thread into the streams of its connections.
+// Returns the number of skipped commands.
+static size_t ParseTrafficFile(string_view data,
+                               absl::flat_hash_map<uint32_t, TrafficStream>* res) {
+  // Commands that do not follow the request-reply model or change the connection protocol.
+  static const absl::flat_hash_set<string_view> kSkipped = {
+      "SUBSCRIBE",   "PSUBSCRIBE", "SSUBSCRIBE", "UNSUBSCRIBE", "PUNSUBSCRIBE",
+      "SUNSUBSCRIBE", "MONITOR",   "HELLO",      "AUTH",        "QUIT",
+      "RESET"};
+
+  CHECK(!data.empty() && data[0] == 2) << "Unsupported traffic file version";
+  data.remove_prefix(1);
+
+  size_t skipped = 0;
+  while (!data.empty()) {
+    // id, timestamp, db_index, has_more, num_parts, part_len, part_len, ..., parts
+    CHECK_GE(data.size(), 24u) << "Truncated traffic record";
+    uint32_t id = absl::little_endian::Load32(data.data());
+    TrafficRecord rec;
+    rec.ts_ns = absl::little_endian::Load64(data.data() + 4);
+    rec.db_index = absl::little_endian::Load32(data.data() + 12);
+    uint32_t num_parts = absl::little_endian::Load32(data.data() + 20);
+    data.remove_prefix(24);
+
+    CHECK_GE(data.size(), num_parts * 4u) << "Truncated traffic record";
+    vector<uint32_t> lens(num_parts);
+    for (uint32_t i = 0; i < num_parts; ++i)
+      lens[i] = absl::little_endian::Load32(data.data() + i * 4);
+    data.remove_prefix(num_parts * 4);
+
+    for (uint32_t len : lens) {
+      CHECK_GE(data.size(), len) << "Truncated traffic record";
+      rec.args.emplace_back(data.substr(0, len));
+      data.remove_prefix(len);
+    }
+
+    if (rec.args.empty() || kSkipped.contains(absl::AsciiStrToUpper(rec.args[0]))) {
+      ++skipped;
+      continue;
+    }
+    replay_first_ts = min(replay_first_ts, rec.ts_ns);
+    (*res)[id].push_back(std::move(rec));
+  }
+  return skipped;
+}
+
+// Loads the files <path>-000.bin, <path>-001.bin, ... written by DEBUG TRAFFIC <path>.
+static void LoadTraffic(string_view path) {
+  size_t num_records = 0, skipped = 0;
+  unsigned num_files = 0;
+  for (;; ++num_files) {
+    string file = absl::StrCat(path, "-", absl::Dec(num_files, absl::kZeroPad3), ".bin");
+    io::Result<string> contents = io::ReadFileToString(file);
+    if (!contents)
+      break;
+
+    absl::flat_hash_map<uint32_t, TrafficStream> streams;
+    skipped += ParseTrafficFile(*contents, &streams);
+    for (auto& [id, stream] : streams) {
+      num_records += stream.size();
+      replay_streams.push_back(std::move(stream));
+    }
+  }
+
+  CHECK_GT(num_files, 0u) << "Could not read traffic files " << path << "-000.bin";
+  CONSOLE_INFO << "Loaded " << num_records << " commands of " << replay_streams.size()
+               << " connections from " << num_files << " files, skipped " << skipped
+               << " commands";
+}
+
+static optional<DistType> ParseDistType(string_view dist) {
+  if (dist == "U")
+    return UNIFORM;
+  if (dist == "N")
+    return NORMAL;
+  if (dist == "Z")
+    return ZIPFIAN;
+  if (dist == "S")
+    return SEQUENTIAL;
+  return nullopt;
+}
+
+// Parses the workload file. Empty lines and lines starting with '#' are ignored.
+static vector<WorkloadTemplate> ParseWorkload(string_view contents) {
+  vector<WorkloadTemplate> res;
+  uint32_t value_size = GetFlag(FLAGS_d);
+
+  for (string_view line : absl::StrSplit(contents, '\n')) {
+    line = absl::StripAsciiWhitespace(line);
+    if (line.empty() || line.front() == '#')
+      continue;
+
+    vector<string_view> tokens = absl::StrSplit(line, ' ', absl::SkipEmpty());
+    WorkloadTemplate tmpl;
+    tmpl.key_dist = dist_type;
+    tmpl.value_min = tmpl.value_max = value_size;
+    CHECK(absl::SimpleAtoi(tokens[0], &tmpl.weight) && tmpl.weight > 0)
+        << "Invalid weight in workload line: " << line;
+
+    size_t i = 1;
+    for (; i < tokens.size(); ++i) {
+      pair<string_view, string_view> kv = absl::StrSplit(tokens[i], absl::MaxSplits('=', 1));
+      if (kv.first == "key_dist") {
+        optional<DistType> dist = ParseDistType(kv.second);
+        CHECK(dist) << "Unknown distribution type in workload line: " << line;
+        tmpl.key_dist = *dist;
+      } else if (kv.first == "d") {
+        pair<string_view, string_view> range = absl::StrSplit(kv.second, '-');
+        CHECK(absl::SimpleAtoi(range.first, &tmpl.value_min))
+            << "Invalid value size in workload line: " << line;
+        tmpl.value_max = tmpl.value_min;
+        if (!range.second.empty()) {
+          CHECK(absl::SimpleAtoi(range.second, &tmpl.value_max))
+              << "Invalid value size in workload line: " << line;
+        }
+        CHECK_LE(tmpl.value_min, tmpl.value_max) << line;
+      } else if (kv.first == "pipeline") {
+        CHECK(absl::SimpleAtoi(kv.second, &tmpl.pipeline) && tmpl.pipeline > 0)
+            << "Invalid pipeline depth in workload line: " << line;
+      } else {
+        break;
+      }
+    }
+
+    CHECK_LT(i, tokens.size()) << "Missing command in workload line: " << line;
+    tmpl.command = absl::StrJoin(tokens.begin() + i, tokens.end(), " ");
+    res.push_back(std::move(tmpl));
+  }
+
+  CHECK(!res.empty()) << "Workload file has no command templates";
+  return res;
+}
+
 static string GetRandomHex(size_t len, bool ascii) {
   std::string res(len, '\0');
   size_t indx = 0;
@@ -138,10 +324,23 @@ using SlotRange = pair<uint16_t, uint16_t>;
 struct ShardInfo {
   vector<SlotRange> slots;  // list of [start, end] pairs. inclusive.
   tcp::endpoint endpoint;
+  vector<tcp::endpoint> replicas;
 };
 
 using ClusterShards = vector<ShardInfo>;
 
+// A node the benchmark connects to.
+struct NodeInfo {
+  tcp::endpoint endpoint;
+  tcp::endpoint master;  // the node whose slots are served, the node itself for masters.
+  bool replica = false;
+
+  string Name() const {
+    return absl::StrCat(endpoint.address().to_string(), ":", endpoint.port(),
+                        replica ? " (replica)" : "");
+  }
+};
+
 class ShardSlots {
  private:
   using IntervalSet = boost::icl::interval_set<uint16_t>;
@@ -149,6 +348,8 @@ class ShardSlots {
 
  public:
   void SetClusterSlotRanges(const ClusterShards& cluster_shards) {
+    unique_lock<fb2::SharedMutex> lock(mu_);
+    shards_slots_.clear();
     for (auto shard : cluster_shards) {
       IntervalSet shard_slots_;
       for (auto& slot : shard.slots) {
@@ -160,21 +361,29 @@ class ShardSlots {
 
   SlotRange NextSlotRange(const tcp::endpoint& ep, size_t i) {
     shared_lock<fb2::SharedMutex> lock(mu_);
-    const auto& shard_slot_interval = shards_slots_[ep];
+    auto it = shards_slots_.find(ep);
+    // The node lost all its slots, its requests will be redirected.
+    if (it == shards_slots_.end() || it->second.empty())
+      return SlotRange{0, kNumSlots - 1};
+
+    const auto& shard_slot_interval = it->second;
     unsigned index = i % shard_slot_interval.iterative_size();
     const auto& interval = next(shard_slot_interval.begin(), index);
     return SlotRange{boost::icl::first(*interval), boost::icl::last(*interval)};
   }
 
   bool Empty() const {
+    shared_lock<fb2::SharedMutex> lock(mu_);
     return shards_slots_.empty();
   }
 
   size_t Size() const {
+    shared_lock<fb2::SharedMutex> lock(mu_);
     return shards_slots_.size();
   }
 
   vector<tcp::endpoint> Endpoints() const {
+    shared_lock<fb2::SharedMutex> lock(mu_);
     vector<tcp::endpoint> endpoints;
     for (const auto& shard : shards_slots_) {
       endpoints.push_back(shard.first);
@@ -194,6 +403,13 @@ class ShardSlots {
     // Add slot to dest ep
     auto& dst_shard_slots = shards_slots_[dst_ep];
     dst_shard_slots.insert(slot_id);
+    stale_ = true;
+  }
+
+  // Returns whether slots moved since the last call, in which case the slot map should be
+  // refreshed from the cluster.
+  bool TakeStale() {
+    return stale_.exchange(false);
   }
 
  private:
@@ -214,13 +430,14 @@ class ShardSlots {
   };
 
  private:
-  fb2::SharedMutex mu_;
+  mutable fb2::SharedMutex mu_;
   absl::flat_hash_map<tcp::endpoint, IntervalSet, Hasher, Eq> shards_slots_;
+  atomic_bool stale_{false};
 };
 
 class KeyGenerator {
  public:
-  KeyGenerator(uint32_t min, uint32_t max);
+  KeyGenerator(uint32_t min, uint32_t max, DistType dist = dist_type);
 
   string operator()(uint16_t from, uint16_t to) const;
   void EnableClusterMode();
@@ -229,8 +446,17 @@ class KeyGenerator {
     return !hash_slots_.empty();
   }
 
+  uint64_t min() const {
+    return min_;
+  }
+
+  uint64_t max() const {
+    return max_;
+  }
+
  private:
   string prefix_;
+  DistType dist_;
   uint64_t min_, max_, range_;
   mutable uint64_t seq_cursor_;
   double stddev_ = 1.0 / 6;
@@ -242,7 +468,9 @@ class CommandGenerator {
  public:
   explicit CommandGenerator(KeyGenerator* keygen);
 
-  string Next(SlotRange range);
+  // Returns batch_size() commands that originate from the same template.
+  // With reads_only, only read commands are generated, for replicas.
+  string Next(SlotRange range, bool reads_only = false);
 
   bool might_hit() const {
     return might_hit_;
@@ -252,65 +480,151 @@ class CommandGenerator {
     return noreply_;
   }
 
+  unsigned batch_size() const {
+    return batch_size_;
+  }
+
+  // Index of the workload template of the last batch.
+  unsigned template_index() const {
+    return template_index_;
+  }
+
  private:
   enum TemplateType { KEY, VALUE, SCORE };
+  using CmdPart = variant<string, TemplateType>;
+
+  struct Template {
+    vector<CmdPart> parts;
+    KeyGenerator* keygen;
+    uint32_t value_min, value_max;
+    uint32_t pipeline = 1;
+    bool might_hit = false;
+    bool read_only = false;
+  };
 
+  // Cumulative weights of templates for choosing them by weight.
+  struct WeightedTemplates {
+    vector<uint64_t> cumulative_weights;
+    vector<unsigned> indices;
+
+    void Add(unsigned index, uint32_t weight) {
+      uint64_t total = cumulative_weights.empty() ? 0 : cumulative_weights.back();
+      cumulative_weights.push_back(total + weight);
+      indices.push_back(index);
+    }
+
+    unsigned Pick() const;
+  };
+
+  void AddTemplate(string_view command, KeyGenerator* keygen, uint32_t value_min,
+                   uint32_t value_max, uint32_t pipeline, uint32_t weight);
+  string FillTemplate(const Template& tmpl, SlotRange range);
   string FillSet(string_view key);
   string FillGet(string_view key);
 
   KeyGenerator* keygen_;
   uint32_t ratio_set_ = 0, ratio_get_ = 0;
-  string command_;
 
-  using CmdPart = variant<string_view, TemplateType>;
-  vector<CmdPart> cmd_parts_;
+  vector<Template> templates_;
+  WeightedTemplates all_templates_, read_templates_;
+  vector<unique_ptr<KeyGenerator>> tmpl_keygens_;  // key generators of workload templates.
 
   string value_;
+  unsigned batch_size_ = 1;
+  unsigned template_index_ = 0;
   bool might_hit_ = false;
   bool noreply_ = false;
   bool is_ascii_ = true;
 };
 
 CommandGenerator::CommandGenerator(KeyGenerator* keygen) : keygen_(keygen) {
-  command_ = GetFlag(FLAGS_command);
   is_ascii_ = GetFlag(FLAGS_ascii);
   value_ = string(GetFlag(FLAGS_d), is_ascii_ ? 'a' : char(130));
 
-  if (command_.empty()) {
+  if (!workload.empty()) {
+    for (const WorkloadTemplate& wt : workload) {
+      auto& tmpl_keygen = tmpl_keygens_.emplace_back(
+          make_unique<KeyGenerator>(keygen->min(), keygen->max(), wt.key_dist));
+      if (keygen->IsClusterEnabled())
+        tmpl_keygen->EnableClusterMode();
+      AddTemplate(wt.command, tmpl_keygen.get(), wt.value_min, wt.value_max, wt.pipeline,
+                  wt.weight);
+    }
+    return;
+  }
+
+  string command = GetFlag(FLAGS_command);
+  if (command.empty()) {
     pair<string, string> ratio_str = absl::StrSplit(GetFlag(FLAGS_ratio), ':');
     CHECK(absl::SimpleAtoi(ratio_str.first, &ratio_set_));
     CHECK(absl::SimpleAtoi(ratio_str.second, &ratio_get_));
     return;
   }
 
-  vector<string_view> parts = absl::StrSplit(command_, ' ', absl::SkipEmpty());
+  AddTemplate(command, keygen_, value_.size(), value_.size(), 1, 1);
+}
+
+// Commands that replicas serve with READONLY.
+static bool IsReadCommand(string_view cmd) {
+  static const absl::flat_hash_set<string_view> kReadCommands = {
+      "GET",       "MGET",     "STRLEN",  "GETRANGE", "EXISTS",        "TTL",
+      "PTTL",      "TYPE",     "HGET",    "HMGET",    "HGETALL",       "HEXISTS",
+      "HLEN",      "HKEYS",    "HVALS",   "LRANGE",   "LLEN",          "LINDEX",
+      "SMEMBERS",  "SISMEMBER", "SCARD",  "ZRANGE",   "ZRANGEBYSCORE", "ZREVRANGE",
+      "ZSCORE",    "ZCARD",    "ZRANK",   "ZCOUNT",   "EVALSHA_RO",    "EVAL_RO"};
+  return kReadCommands.contains(absl::AsciiStrToUpper(cmd));
+}
+
+unsigned CommandGenerator::WeightedTemplates::Pick() const {
+  if (indices.size() == 1)
+    return indices.front();
+
+  uint64_t pick = absl::Uniform(bit_gen, uint64_t{0}, cumulative_weights.back());
+  return indices[upper_bound(cumulative_weights.begin(), cumulative_weights.end(), pick) -
+                 cumulative_weights.begin()];
+}
+
+void CommandGenerator::AddTemplate(string_view command, KeyGenerator* keygen, uint32_t value_min,
+                                   uint32_t value_max, uint32_t pipeline, uint32_t weight) {
+  Template tmpl{{}, keygen, value_min, value_max, pipeline};
+
+  vector<string_view> parts = absl::StrSplit(command, ' ', absl::SkipEmpty());
   for (string_view p : parts) {
     if (p == "__key__"sv) {
-      cmd_parts_.emplace_back(KEY);
+      tmpl.parts.emplace_back(KEY);
     } else if (p == "__data__"sv) {
-      cmd_parts_.emplace_back(VALUE);
+      tmpl.parts.emplace_back(VALUE);
     } else if (p == "__score__"sv) {
-      cmd_parts_.emplace_back(SCORE);
+      tmpl.parts.emplace_back(SCORE);
     } else {
-      cmd_parts_.emplace_back(p);
+      tmpl.parts.emplace_back(string{p});
     }
   }
 
-  if (!cmd_parts_.empty()) {
-    const string_view* cmd = get_if<string_view>(&cmd_parts_.front());
+  if (!tmpl.parts.empty()) {
+    const string* cmd = get_if<string>(&tmpl.parts.front());
     if (cmd) {
-      might_hit_ = absl::EqualsIgnoreCase(*cmd, "get") || absl::StartsWithIgnoreCase(*cmd, "mget");
+      tmpl.might_hit =
+          absl::EqualsIgnoreCase(*cmd, "get") || absl::StartsWithIgnoreCase(*cmd, "mget");
+      tmpl.read_only = IsReadCommand(*cmd);
     }
   }
+
+  unsigned index = templates_.size();
+  all_templates_.Add(index, weight);
+  if (tmpl.read_only)
+    read_templates_.Add(index, weight);
+  templates_.push_back(std::move(tmpl));
 }
 
-string CommandGenerator::Next(SlotRange range) {
+string CommandGenerator::Next(SlotRange range, bool reads_only) {
   noreply_ = false;
+  batch_size_ = 1;
 
-  if (command_.empty()) {
+  if (templates_.empty()) {
     string key = (*keygen_)(range.first, range.second);
 
-    if (absl::Uniform(bit_gen, 0U, ratio_get_ + ratio_set_) < ratio_set_) {
+    if (!reads_only && absl::Uniform(bit_gen, 0U, ratio_get_ + ratio_set_) < ratio_set_) {
       might_hit_ = false;
       return FillSet(key);
     }
@@ -318,26 +632,49 @@ string CommandGenerator::Next(SlotRange range) {
     return FillGet(key);
   }
 
+  if (reads_only) {
+    CHECK(!read_templates_.indices.empty()) << "No read commands to send to replicas";
+    template_index_ = read_templates_.Pick();
+  } else {
+    template_index_ = all_templates_.Pick();
+  }
+
+  const Template& tmpl = templates_[template_index_];
+  might_hit_ = tmpl.might_hit;
+  batch_size_ = tmpl.pipeline;
+
+  string gen_cmd;
+  for (unsigned i = 0; i < tmpl.pipeline; ++i)
+    gen_cmd.append(FillTemplate(tmpl, range));
+  return gen_cmd;
+}
+
+string CommandGenerator::FillTemplate(const Template& tmpl, SlotRange range) {
   // For custom commands, we select a random slot and then use it for key generation.
   uint16_t slot_id = 0;
 
-  if (keygen_->IsClusterEnabled()) {
+  if (tmpl.keygen->IsClusterEnabled()) {
     slot_id = absl::Uniform(absl::IntervalClosedClosed, bit_gen, range.first, range.second);
   }
 
   string str, gen_cmd;
-  absl::StrAppend(&gen_cmd, "*", cmd_parts_.size(), "\r\n");
-  for (const CmdPart& part : cmd_parts_) {
-    if (auto p = get_if<string_view>(&part)) {
+  absl::StrAppend(&gen_cmd, "*", tmpl.parts.size(), "\r\n");
+  for (const CmdPart& part : tmpl.parts) {
+    if (auto p = get_if<string>(&part)) {
       absl::StrAppend(&gen_cmd, "$", p->size(), "\r\n", *p, "\r\n");
     } else {
       switch (get<TemplateType>(part)) {
         case KEY:
-          str = (*keygen_)(slot_id, slot_id);
+          str = (*tmpl.keygen)(slot_id, slot_id);
           break;
-        case VALUE:
-          str = GetRandomHex(value_.size(), is_ascii_);
+        case VALUE: {
+          uint32_t len = tmpl.value_min;
+          if (tmpl.value_max > tmpl.value_min)
+            len = absl::Uniform(absl::IntervalClosedClosed, bit_gen, tmpl.value_min,
+                                tmpl.value_max);
+          str = GetRandomHex(len, is_ascii_);
           break;
+        }
         case SCORE: {
           uniform_real_distribution<double> uniform(0, 1);
           str = absl::StrCat(uniform(bit_gen));
@@ -373,23 +710,121 @@ string CommandGenerator::FillGet(string_view key) {
   return absl::StrCat("get ", key, "\r\n");
 }
 
+// Latency histogram in usec with 3 significant digits.
+class LatencyHist {
+ public:
+  static constexpr int64_t kMaxUsec = 60'000'000;
+
+  LatencyHist() {
+    CHECK_EQ(0, hdr_init(1, kMaxUsec, 3, &hist_));
+  }
+
+  LatencyHist(const LatencyHist& o) : LatencyHist() {
+    Merge(o);
+  }
+
+  LatencyHist(LatencyHist&& o) noexcept : hist_(exchange(o.hist_, nullptr)) {
+  }
+
+  LatencyHist& operator=(const LatencyHist&) = delete;
+
+  ~LatencyHist() {
+    if (hist_)
+      hdr_close(hist_);
+  }
+
+  void Add(uint64_t usec) {
+    hdr_record_value(hist_, std::clamp<int64_t>(usec, 1, kMaxUsec));
+  }
+
+  void Merge(const LatencyHist& o) {
+    hdr_add(hist_, o.hist_);
+  }
+
+  void Clear() {
+    hdr_reset(hist_);
+  }
+
+  uint64_t count() const {
+    return hist_->total_count;
+  }
+
+  double mean() const {
+    return count() ? hdr_mean(hist_) : 0;
+  }
+
+  int64_t max() const {
+    return count() ? hdr_max(hist_) : 0;
+  }
+
+  int64_t Percentile(double p) const {
+    return count() ? hdr_value_at_percentile(hist_, p) : 0;
+  }
+
+  string ToString() const;
+
+ private:
+  hdr_histogram* hist_ = nullptr;
+};
+
+constexpr double kReportPercentiles[] = {50, 90, 99, 99.9, 99.99, 99.999};
+
+static string PercentileName(double p) {
+  return absl::StrCat("p", p);
+}
+
+string LatencyHist::ToString() const {
+  string res = StrFormat("count: %u, mean: %.1f", count(), mean());
+  for (double p : kReportPercentiles)
+    absl::StrAppend(&res, ", ", PercentileName(p), ": ", Percentile(p));
+  absl::StrAppend(&res, ", max: ", max());
+  return res;
+}
+
+struct NodeStats {
+  LatencyHist hist;
+  uint64_t num_errors = 0;
+  uint64_t num_moved = 0;
+  uint64_t num_ask = 0;
+
+  NodeStats& operator+=(const NodeStats& o) {
+    hist.Merge(o.hist);
+    num_errors += o.num_errors;
+    num_moved += o.num_moved;
+    num_ask += o.num_ask;
+    return *this;
+  }
+};
+
 struct ClientStats {
-  base::Histogram total_hist, online_hist;
+  LatencyHist total_hist, online_hist;
+  vector<LatencyHist> template_hist;  // per workload template.
+  vector<NodeStats> node_stats;       // per node, in the order of the nodes list.
 
   uint64_t num_responses = 0;
   uint64_t hit_count = 0;
   uint64_t hit_opportunities = 0;
   uint64_t num_errors = 0;
+  uint64_t num_redirects = 0;  // MOVED and ASK replies, not counted as errors.
   unsigned num_clients = 0;
 
   ClientStats& operator+=(const ClientStats& o) {
     total_hist.Merge(o.total_hist);
     online_hist.Merge(o.online_hist);
+    if (template_hist.size() < o.template_hist.size())
+      template_hist.resize(o.template_hist.size());
+    for (size_t i = 0; i < o.template_hist.size(); ++i)
+      template_hist[i].Merge(o.template_hist[i]);
+    if (node_stats.size() < o.node_stats.size())
+      node_stats.resize(o.node_stats.size());
+    for (size_t i = 0; i < o.node_stats.size(); ++i)
+      node_stats[i] += o.node_stats[i];
 
     num_responses += o.num_responses;
     hit_count += o.hit_count;
     hit_opportunities += o.hit_opportunities;
     num_errors += o.num_errors;
+    num_redirects += o.num_redirects;
     num_clients += o.num_clients;
     return *this;
   }
@@ -410,8 +845,11 @@ class Driver {
   Driver(Driver&&) = delete;
   Driver& operator=(Driver&&) = delete;
 
-  void Connect(unsigned index, const tcp::endpoint& ep);
+  void Connect(unsigned index, const NodeInfo& node, unsigned node_index);
   void Run(uint64_t* cycle_ns, CommandGenerator* cmd_gen);
+
+  // Replays the recorded stream with the timing relative to start_ns, scaled by --replay_speed.
+  void Replay(const TrafficStream& stream, int64_t start_ns);
   void Shutdown();
 
   float done() const {
@@ -433,6 +871,7 @@ class Driver {
 
   struct Req {
     uint64_t start;
+    uint32_t template_index;
     bool might_hit;
   };
 
@@ -440,6 +879,8 @@ class Driver {
   int64_t start_ns_ = 0;
 
   tcp::endpoint ep_;
+  NodeInfo node_;
+  unsigned node_index_ = 0;
   ShardSlots& shard_slots_;
   ClientStats& stats_;
   unique_ptr<FiberSocketBase> socket_;
@@ -459,10 +900,13 @@ class TLocalClient {
 
   TLocalClient(const TLocalClient&) = delete;
 
-  void Connect(const tcp::endpoint& ep, const vector<tcp::endpoint>& shard_endpoints);
+  void Connect(const vector<NodeInfo>& nodes);
+  // Connects a driver to the node for every stream to replay.
+  void ConnectReplay(const NodeInfo& node, vector<const TrafficStream*> streams);
   void Disconnect();
 
   void Start(uint32_t key_min, uint32_t key_max, uint64_t cycle_ns);
+  void StartReplay(int64_t start_ns);
   void Join();
 
   ClientStats stats;
@@ -501,6 +945,7 @@ class TLocalClient {
   vector<unique_ptr<Driver>> drivers_;
   optional<KeyGenerator> key_gen_;
   optional<CommandGenerator> cmd_gen_;
+  vector<const TrafficStream*> replay_streams_;  // per driver
 
   vector<fb2::Fiber> driver_fbs_;
   uint64_t cur_cycle_ns_;
@@ -508,13 +953,13 @@ class TLocalClient {
   int64_t start_time_;
 };
 
-KeyGenerator::KeyGenerator(uint32_t min, uint32_t max)
-    : min_(min), max_(max), range_(max - min + 1) {
+KeyGenerator::KeyGenerator(uint32_t min, uint32_t max, DistType dist)
+    : dist_(dist), min_(min), max_(max), range_(max - min + 1) {
   prefix_ = GetFlag(FLAGS_key_prefix);
   CHECK_GT(range_, 0u);
 
   seq_cursor_ = min_;
-  switch (dist_type) {
+  switch (dist_) {
     case NORMAL: {
       uint64_t stddev = GetFlag(FLAGS_key_stddev);
       if (stddev != 0) {
@@ -536,7 +981,7 @@ string KeyGenerator::operator()(uint16_t from, uint16_t to) const {
   string res;
 
   do {
-    switch (dist_type) {
+    switch (dist_) {
       case UNIFORM:
         key_suffix = absl::Uniform(bit_gen, min_, max_);
         break;
@@ -612,7 +1057,8 @@ void Driver::RunCommandAndCheckResultIs(std::string_view cmd, std::string_view e
   ::RunCommandAndCheckResultIs(cmd, expected_res, socket_.get());
 }
 
-void Driver::Connect(unsigned index, const tcp::endpoint& ep) {
+void Driver::Connect(unsigned index, const NodeInfo& node, unsigned node_index) {
+  const tcp::endpoint& ep = node.endpoint;
   VLOG(2) << "Connecting " << index << " to " << ep;
   error_code ec = socket_->Connect(ep);
   CHECK(!ec) << "Could not connect to " << ep << " " << ec;
@@ -631,7 +1077,13 @@ void Driver::Connect(unsigned index, const tcp::endpoint& ep) {
     // Therefore, we send a ping command to ensure that every connection got connected.
     RunCommandAndCheckResultIs("PING\r\n", "+PONG\r\n");
   }
+  if (node.replica) {
+    // Allows the replica to serve reads of the slots of its master.
+    RunCommandAndCheckResultIs("READONLY\r\n", "+OK\r\n");
+  }
   ep_ = ep;
+  node_ = node;
+  node_index_ = node_index;
   receive_fb_ = MakeFiber(fb2::Launch::dispatch, [this] { ReceiveFb(); });
 }
 
@@ -654,21 +1106,24 @@ void Driver::Run(uint64_t* cycle_ns, CommandGenerator* cmd_gen) {
       pipeline = num_reqs_ - i * pipeline;
     }
 
-    for (unsigned j = 0; j < pipeline; ++j) {
+    for (unsigned j = 0; j < pipeline;) {
       // TODO: this skews the distribution if slot ranges are uneven.
       // Ideally we would like to pick randomly a single slot from all the ranges we have
       // and pass it to cmd_gen->Next below.
       if (!shard_slots_.Empty()) {
-        slot_range = shard_slots_.NextSlotRange(ep_, i);
+        slot_range = shard_slots_.NextSlotRange(node_.master, i);
       }
 
-      string cmd = cmd_gen->Next(slot_range);
+      string cmd = cmd_gen->Next(slot_range, node_.replica);
 
       Req req;
       req.start = absl::GetCurrentTimeNanos();
+      req.template_index = cmd_gen->template_index();
       req.might_hit = cmd_gen->might_hit();
 
-      reqs_.push(req);
+      for (unsigned k = 0; k < cmd_gen->batch_size(); ++k)
+        reqs_.push(req);
+      j += cmd_gen->batch_size();
 
       error_code ec = socket_->Write(io::Buffer(cmd));
       if (ec && FiberSocketBase::IsConnClosed(ec)) {
@@ -678,7 +1133,8 @@ void Driver::Run(uint64_t* cycle_ns, CommandGenerator* cmd_gen) {
       }
       CHECK(!ec) << ec.message();
       if (cmd_gen->noreply()) {
-        PopRequest();
+        for (unsigned k = 0; k < cmd_gen->batch_size(); ++k)
+          PopRequest();
       }
     }
 
@@ -720,6 +1176,59 @@ void Driver::Run(uint64_t* cycle_ns, CommandGenerator* cmd_gen) {
   Shutdown();
 }
 
+static void AppendRespCommand(absl::Span<const string> args, string* out) {
+  absl::StrAppend(out, "*", args.size(), "\r\n");
+  for (const string& arg : args)
+    absl::StrAppend(out, "$", arg.size(), "\r\n", arg, "\r\n");
+}
+
+void Driver::Replay(const TrafficStream& stream, int64_t start_ns) {
+  start_ns_ = absl::GetCurrentTimeNanos();
+  double speed = GetFlag(FLAGS_replay_speed);
+  uint32_t pipeline = std::max<uint32_t>(GetFlag(FLAGS_pipeline), 1u);
+  uint32_t db_index = 0;
+
+  stats_.num_clients++;
+  for (const TrafficRecord& rec : stream) {
+    if (terminate_requested)
+      break;
+
+    if (speed > 0) {
+      int64_t target_ns = start_ns + int64_t((rec.ts_ns - replay_first_ts) / speed);
+      int64_t sleep_ns = target_ns - absl::GetCurrentTimeNanos();
+      if (sleep_ns > 0)
+        ThisFiber::SleepFor(chrono::nanoseconds(sleep_ns));
+    }
+
+    if (reqs_.size() >= pipeline) {
+      fb2::NoOpLock lk;
+      cnd_.wait(lk, [this] { return reqs_.empty(); });
+    }
+
+    string cmd;
+    // The recording starts in the middle of connections, so their db may differ from the default.
+    if (rec.db_index != db_index && !absl::EqualsIgnoreCase(rec.args[0], "select")) {
+      AppendRespCommand(vector<string>{"SELECT", absl::StrCat(rec.db_index)}, &cmd);
+      reqs_.push(Req{uint64_t(absl::GetCurrentTimeNanos()), 0, false});
+    }
+    db_index = rec.db_index;
+    AppendRespCommand(rec.args, &cmd);
+    reqs_.push(Req{uint64_t(absl::GetCurrentTimeNanos()), 0, false});
+
+    error_code ec = socket_->Write(io::Buffer(cmd));
+    if (ec && FiberSocketBase::IsConnClosed(ec)) {
+      VLOG(1) << "Connection closed";
+      break;
+    }
+    CHECK(!ec) << ec.message();
+  }
+
+  while (!reqs_.empty()) {
+    ThisFiber::SleepFor(1ms);
+  }
+  Shutdown();
+}
+
 void Driver::Shutdown() {
   std::ignore = socket_->Shutdown(SHUT_RDWR);  // breaks the receive fiber.
   receive_fb_.Join();
@@ -743,6 +1252,9 @@ void Driver::PopRequest() {
   uint64_t usec = (now - reqs_.front().start) / 1000;
   stats_.online_hist.Add(usec);
   stats_.total_hist.Add(usec);
+  stats_.node_stats[node_index_].hist.Add(usec);
+  if (!stats_.template_hist.empty())
+    stats_.template_hist[reqs_.front().template_index].Add(usec);
   stats_.hit_opportunities += reqs_.front().might_hit;
   ++received_;
   reqs_.pop();
@@ -785,6 +1297,7 @@ void Driver::ParseRESP() {
   RedisParser::Result result = RedisParser::OK;
   RespVec parse_args;
   constexpr string_view kMovedErrorKey = "MOVED"sv;
+  constexpr string_view kAskErrorKey = "ASK "sv;
 
   do {
     result = parser_.Parse(io_buf_.InputBuffer(), &consumed, &parse_args);
@@ -810,9 +1323,18 @@ void Driver::ParseRESP() {
           CHECK(absl::SimpleAtoi(addr_parts[1], &port));
           CHECK_LT(port, 65536u);
 
-          shard_slots_.MoveSlot(ep_, tcp::endpoint(host, port), slot_id);
+          // The request is not retried, but the next ones are routed by the updated map.
+          shard_slots_.MoveSlot(node_.master, tcp::endpoint(host, port), slot_id);
+          ++stats_.num_redirects;
+          ++stats_.node_stats[node_index_].num_moved;
+        } else if (absl::StartsWith(error, kAskErrorKey)) {
+          // The slot is being migrated, the slot map stays until the migration finishes.
+          ++stats_.num_redirects;
+          ++stats_.node_stats[node_index_].num_ask;
+        } else {
+          ++stats_.num_errors;
+          ++stats_.node_stats[node_index_].num_errors;
         }
-        ++stats_.num_errors;
       } else if (reqs_.front().might_hit && parse_args[0].type != RespExpr::NIL) {
         ++stats_.hit_count;
       }
@@ -849,6 +1371,7 @@ void Driver::ParseMC() {
       ++stats_.hit_count;
     } else if (absl::StartsWith(line, "SERVER_ERROR")) {
       ++stats_.num_errors;
+      ++stats_.node_stats[node_index_].num_errors;
       PopRequest();
       blob_len = 0;
     } else {
@@ -861,15 +1384,12 @@ void Driver::ParseMC() {
   }
 }
 
-void TLocalClient::Connect(const tcp::endpoint& ep, const vector<tcp::endpoint>& endpoints) {
-  VLOG(2) << "Connecting client..." << ep;
+void TLocalClient::Connect(const vector<NodeInfo>& nodes) {
+  VLOG(2) << "Connecting client to " << nodes.size() << " nodes";
 
-  unsigned conn_per_shard = GetFlag(FLAGS_c);
-  if (shard_slots_->Empty()) {
-    drivers_.resize(conn_per_shard);
-  } else {
-    drivers_.resize(shard_slots_->Size() * conn_per_shard);
-  }
+  unsigned conn_per_node = GetFlag(FLAGS_c);
+  drivers_.resize(nodes.size() * conn_per_node);
+  stats.node_stats.resize(nodes.size());
 
   for (auto& driver : drivers_) {
     driver.reset(new Driver{GetFlag(FLAGS_n), GetFlag(FLAGS_test_time), &stats, p_, shard_slots_});
@@ -877,20 +1397,45 @@ void TLocalClient::Connect(const tcp::endpoint& ep, const vector<tcp::endpoint>&
   vector<fb2::Fiber> fbs(drivers_.size());
 
   for (size_t i = 0; i < fbs.size(); ++i) {
-    vector<SlotRange> slots;
-    tcp::endpoint shard_ep = ep;
-    if (!shard_slots_->Empty()) {
-      size_t shard = i / conn_per_shard;
-      shard_ep = endpoints[shard];
-    }
-    fbs[i] =
-        fb2::Fiber(StrCat("connect/", i), [&, shard_ep, i] { drivers_[i]->Connect(i, shard_ep); });
+    unsigned node_index = i / conn_per_node;
+    fbs[i] = fb2::Fiber(StrCat("connect/", i), [&, node_index, i] {
+      drivers_[i]->Connect(i, nodes[node_index], node_index);
+    });
   }
 
   for (auto& fb : fbs)
     fb.Join();
 }
 
+void TLocalClient::ConnectReplay(const NodeInfo& node, vector<const TrafficStream*> streams) {
+  replay_streams_ = std::move(streams);
+  drivers_.resize(replay_streams_.size());
+  stats.node_stats.resize(1);
+
+  for (size_t i = 0; i < drivers_.size(); ++i) {
+    uint32_t num_reqs = replay_streams_[i]->size();
+    drivers_[i].reset(new Driver{num_reqs, 0, &stats, p_, shard_slots_});
+  }
+  vector<fb2::Fiber> fbs(drivers_.size());
+  for (size_t i = 0; i < fbs.size(); ++i) {
+    fbs[i] = fb2::Fiber(StrCat("connect/", i), [&, i] { drivers_[i]->Connect(i, node, 0); });
+  }
+
+  for (auto& fb : fbs)
+    fb.Join();
+}
+
+void TLocalClient::StartReplay(int64_t start_ns) {
+  cur_cycle_ns_ = target_cycle_ = 0;
+  start_time_ = absl::GetCurrentTimeNanos();
+  driver_fbs_.resize(drivers_.size());
+  for (size_t i = 0; i < driver_fbs_.size(); ++i) {
+    driver_fbs_[i] = fb2::Fiber(StrCat("replay/", i), [this, i, start_ns] {
+      drivers_[i]->Replay(*replay_streams_[i], start_ns);
+    });
+  }
+}
+
 void TLocalClient::Disconnect() {
   for (size_t i = 0; i < drivers_.size(); ++i) {
     drivers_[i]->Shutdown();
@@ -899,12 +1444,13 @@ void TLocalClient::Disconnect() {
 
 void TLocalClient::Start(uint32_t key_min, uint32_t key_max, uint64_t cycle_ns) {
   key_gen_.emplace(key_min, key_max);
-  cmd_gen_.emplace(&key_gen_.value());
-
-  driver_fbs_.resize(drivers_.size());
   if (!shard_slots_->Empty()) {
     key_gen_->EnableClusterMode();
   }
+  cmd_gen_.emplace(&key_gen_.value());
+  stats.template_hist.resize(workload.size());
+
+  driver_fbs_.resize(drivers_.size());
   cur_cycle_ns_ = cycle_ns;
   target_cycle_ = cycle_ns;
   start_time_ = absl::GetCurrentTimeNanos();
@@ -944,7 +1490,105 @@ void TLocalClient::AdjustCycle() {
 
 thread_local unique_ptr<TLocalClient> client;
 
-void WatchFiber(size_t num_shards, atomic_bool* finish_signal, ProactorPool* pp) {
+// A row of the machine-readable report.
+struct ReportRecord {
+  string_view type;  // interval, summary, template or node
+  string_view name;  // command of a template or address of a node
+  double elapsed_sec = 0;
+  uint64_t requests = 0;
+  double rps = 0;
+  uint64_t errors = 0;
+  const LatencyHist* hist = nullptr;
+};
+
+// Writes the report of --output_format.
+class Reporter {
+ public:
+  Reporter();
+
+  bool enabled() const {
+    return format_ != NONE;
+  }
+
+  void Write(const ReportRecord& rec);
+
+ private:
+  enum Format { NONE, JSON, CSV } format_ = NONE;
+
+  ofstream file_;
+  ostream* out_ = &cout;
+  bool header_written_ = false;
+};
+
+Reporter::Reporter() {
+  string format = GetFlag(FLAGS_output_format);
+  if (format.empty())
+    return;
+
+  if (format == "json") {
+    format_ = JSON;
+  } else if (format == "csv") {
+    format_ = CSV;
+  } else {
+    LOG(FATAL) << "Unknown output format: " << format;
+  }
+
+  if (string path = GetFlag(FLAGS_output_file); !path.empty()) {
+    file_.open(path, ios::out | ios::trunc);
+    CHECK(file_) << "Could not open " << path;
+    out_ = &file_;
+  }
+}
+
+static string EscapeJson(string_view str) {
+  string res;
+  for (char c : str) {
+    if (c == '"' || c == '\\')
+      res.push_back('\\');
+    if (static_cast<unsigned char>(c) >= 0x20)
+      res.push_back(c);
+  }
+  return res;
+}
+
+void Reporter::Write(const ReportRecord& rec) {
+  const LatencyHist& hist = *rec.hist;
+  string line;
+
+  if (format_ == JSON) {
+    line = StrFormat(
+        R"({"type":"%s","name":"%s","elapsed_sec":%.3f,"requests":%u,"rps":%.1f,"errors":%u,)"
+        R"("mean_usec":%.1f)",
+        rec.type, EscapeJson(rec.name), rec.elapsed_sec, rec.requests, rec.rps, rec.errors,
+        hist.mean());
+    for (double p : kReportPercentiles)
+      absl::StrAppend(&line, ",\"", PercentileName(p), "_usec\":", hist.Percentile(p));
+    absl::StrAppend(&line, ",\"max_usec\":", hist.max(), "}\n");
+  } else {
+    if (!header_written_) {
+      string header = "type,name,elapsed_sec,requests,rps,errors,mean_usec";
+      for (double p : kReportPercentiles)
+        absl::StrAppend(&header, ",", PercentileName(p), "_usec");
+      *out_ << header << ",max_usec\n";
+      header_written_ = true;
+    }
+    line = StrFormat("%s,\"%s\",%.3f,%u,%.1f,%u,%.1f", rec.type,
+                     absl::StrReplaceAll(rec.name, {{"\"", "\"\""}}), rec.elapsed_sec,
+                     rec.requests, rec.rps, rec.errors, hist.mean());
+    for (double p : kReportPercentiles)
+      absl::StrAppend(&line, ",", hist.Percentile(p));
+    absl::StrAppend(&line, ",", hist.max(), "\n");
+  }
+
+  *out_ << line << flush;
+}
+
+unique_ptr<Reporter> reporter;
+
+ClusterShards FetchClusterInfo(const tcp::endpoint& ep, ProactorBase* proactor);
+
+void WatchFiber(uint64_t resp_goal, const tcp::endpoint& seed_ep, ShardSlots* shard_slots,
+                atomic_bool* finish_signal, ProactorPool* pp) {
   fb2::Mutex mutex;
 
   int64_t start_time = absl::GetCurrentTimeNanos();
@@ -952,21 +1596,32 @@ void WatchFiber(size_t num_shards, atomic_bool* finish_signal, ProactorPool* pp)
 
   int64_t last_print = start_time;
   uint64_t num_last_resp_cnt = 0;
-  num_shards = max<size_t>(num_shards, 1u);
-  uint64_t resp_goal = GetFlag(FLAGS_c) * pp->size() * GetFlag(FLAGS_n) * num_shards;
+  uint64_t num_last_err_cnt = 0;
+  const int64_t report_interval_ns =
+      int64_t(max(GetFlag(FLAGS_report_interval), 1u)) * 1'000'000'000;
   uint32_t time_limit = GetFlag(FLAGS_test_time);
   bool should_throttle = GetFlag(FLAGS_qps) > 0;
 
   while (*finish_signal == false) {
-    // we sleep with resolution of 1s but print with lower frequency to be more responsive
+    // we sleep with resolution of 1s but print every --report_interval to be more responsive
     // when benchmark finishes.
     ThisFiber::SleepFor(1s);
     if (should_throttle) {
       pp->AwaitBrief([](auto, auto*) { client->AdjustCycle(); });
     }
 
+    // Slots moved, e.g. during resharding. Refresh the whole map, MOVED replies only tell about
+    // a single slot.
+    if (shard_slots->TakeStale()) {
+      ClusterShards shards = FetchClusterInfo(seed_ep, ProactorBase::me());
+      if (!shards.empty()) {
+        shard_slots->SetClusterSlotRanges(shards);
+        VLOG(1) << "Refreshed the slot map";
+      }
+    }
+
     int64_t now = absl::GetCurrentTimeNanos();
-    if (now - last_print < 5000'000'000LL)  // 5s
+    if (now - last_print < report_interval_ns)
       continue;
 
     ClientStats stats;
@@ -994,7 +1649,7 @@ void WatchFiber(size_t num_shards, atomic_bool* finish_signal, ProactorPool* pp)
     double hitrate = stats.hit_opportunities > 0
                          ? 100 * double(stats.hit_count) / double(stats.hit_opportunities)
                          : 0;
-    unsigned latency = stats.online_hist.Percentile(99);
+    int64_t latency = stats.online_hist.Percentile(99);
 
     CONSOLE_INFO << total_ms / 1000 << "s: " << StrFormat("%.1f", done_perc)
                  << "% done, RPS(now/agg): " << period_resp_cnt * 1000 / period_ms << "/"
@@ -1005,8 +1660,18 @@ void WatchFiber(size_t num_shards, atomic_bool* finish_signal, ProactorPool* pp)
                  << ", done_max: " << StrFormat("%.2f%%", done_max * 100)
                  << ", p99_lat(us): " << latency << ", max_pending: " << max_pending;
 
+    if (reporter->enabled()) {
+      reporter->Write({.type = "interval",
+                       .elapsed_sec = double(total_ms) / 1000,
+                       .requests = period_resp_cnt,
+                       .rps = double(period_resp_cnt) * 1000 / period_ms,
+                       .errors = stats.num_errors - num_last_err_cnt,
+                       .hist = &stats.online_hist});
+    }
+
     last_print = now;
     num_last_resp_cnt = stats.num_responses;
+    num_last_err_cnt = stats.num_errors;
   }
 }
 
@@ -1045,11 +1710,13 @@ ClusterShards FetchClusterInfo(const tcp::endpoint& ep, ProactorBase* proactor)
   LOG(INFO) << "Cluster spec: " << cluster_spec;
   vector<string_view> lines = absl::StrSplit(cluster_spec, '\n', absl::SkipEmpty());
   ClusterShards res;
+  absl::flat_hash_map<string_view, size_t> master_index;  // master id -> index in res
+  vector<pair<string_view, tcp::endpoint>> replicas;      // master id, replica endpoint
   for (string_view line : lines) {
     vector<string_view> parts = absl::StrSplit(line, ' ');
     // <id> <ip:port@cport[,hostname]> <flags> <master> <ping-sent> <pong-recv>
     // <config-epoch> <link-state> <slot> <slot> ... <slot>
-    if (parts.size() < 9) {
+    if (parts.size() < 8) {
       LOG(WARNING) << "Skipping line: " << line;
       continue;
     }
@@ -1072,8 +1739,12 @@ ClusterShards FetchClusterInfo(const tcp::endpoint& ep, ProactorBase* proactor)
 
     string_view flags = parts[2];
     absl::flat_hash_set<string_view> flags_set(absl::StrSplit(flags, ','));
-    if (!flags_set.contains("master")) {
-      LOG(INFO) << "Skipping non-master node " << shard.endpoint << " " << flags;
+    if (flags_set.contains("slave") || flags_set.contains("replica")) {
+      replicas.emplace_back(parts[3], shard.endpoint);
+      continue;
+    }
+    if (!flags_set.contains("master") || parts.size() < 9) {
+      LOG(INFO) << "Skipping node " << shard.endpoint << " " << flags;
       continue;
     }
 
@@ -1090,9 +1761,15 @@ ClusterShards FetchClusterInfo(const tcp::endpoint& ep, ProactorBase* proactor)
       }
       shard.slots.push_back(slot_range);
     }
+    master_index[parts[0]] = res.size();
     res.push_back(shard);
   }
 
+  for (const auto& [master_id, endpoint] : replicas) {
+    if (auto it = master_index.find(master_id); it != master_index.end())
+      res[it->second].replicas.push_back(endpoint);
+  }
+
   return res;
 }
 
@@ -1118,18 +1795,25 @@ int main(int argc, char* argv[]) {
   }
 
   string dist = GetFlag(FLAGS_key_dist);
-
-  if (dist == "U") {
-    dist_type = UNIFORM;
-  } else if (dist == "N") {
-    dist_type = NORMAL;
-  } else if (dist == "Z") {
-    dist_type = ZIPFIAN;
-  } else if (dist == "S") {
-    dist_type = SEQUENTIAL;
-  } else {
+  optional<DistType> parsed_dist = ParseDistType(dist);
+  if (!parsed_dist) {
     LOG(FATAL) << "Unknown distribution type: " << dist;
   }
+  dist_type = *parsed_dist;
+  reporter = make_unique<Reporter>();
+
+  const bool replay = !GetFlag(FLAGS_replay).empty();
+  if (replay) {
+    LoadTraffic(GetFlag(FLAGS_replay));
+  }
+
+  if (string path = GetFlag(FLAGS_workload); !path.empty()) {
+    io::Result<string> contents = io::ReadFileToString(path);
+    CHECK(contents) << "Could not read workload file " << path << ": "
+                    << contents.error().message();
+    workload = ParseWorkload(*contents);
+    CONSOLE_INFO << "Running a workload of " << workload.size() << " command templates";
+  }
 
   auto* proactor = pp->GetNextProactor();
   char ip_addr[128];
@@ -1142,14 +1826,15 @@ int main(int argc, char* argv[]) {
   tcp::endpoint ep{address, GetFlag(FLAGS_p)};
 
   ClusterShards shards;
-  if (protocol == RESP && GetFlag(FLAGS_probe_cluster)) {
+  if (protocol == RESP && GetFlag(FLAGS_probe_cluster) && !replay) {
     shards = proactor->Await([&] { return FetchClusterInfo(ep, proactor); });
   }
   CONSOLE_INFO << "Connecting to "
                << (shards.empty() ? string("single node ")
                                   : absl::StrCat(shards.size(), " shard cluster"));
 
-  if (!shards.empty() && !GetFlag(FLAGS_command).empty() && GetFlag(FLAGS_cluster_skip_tags)) {
+  if (!shards.empty() && (!GetFlag(FLAGS_command).empty() || !workload.empty()) &&
+      GetFlag(FLAGS_cluster_skip_tags)) {
     // For custom commands we may need to use the same hashtag for multiple keys.
     LOG(WARNING) << "Enforcing hash tags for custom commands";
     absl::SetFlag(&FLAGS_cluster_skip_tags, false);
@@ -1157,7 +1842,18 @@ int main(int argc, char* argv[]) {
 
   ShardSlots shard_slots;
   shard_slots.SetClusterSlotRanges(shards);
-  std::vector<tcp::endpoint> shard_endpoints = shard_slots.Endpoints();
+
+  vector<NodeInfo> nodes;
+  if (shards.empty()) {
+    nodes.push_back({ep, ep, false});
+  }
+  for (const ShardInfo& shard : shards) {
+    nodes.push_back({shard.endpoint, shard.endpoint, false});
+    if (GetFlag(FLAGS_replica_reads)) {
+      for (const tcp::endpoint& replica : shard.replicas)
+        nodes.push_back({replica, shard.endpoint, true});
+    }
+  }
   pp->AwaitBrief([&](unsigned index, auto* p) {
     base::SplitMix64 seed_mix(GetFlag(FLAGS_seed) + index * 0x6a45554a264d72bULL);
     auto seed = seed_mix();
@@ -1167,12 +1863,38 @@ int main(int argc, char* argv[]) {
 
   pp->AwaitFiberOnAll([&](unsigned index, auto* p) {
     client = make_unique<TLocalClient>(p, &shard_slots);
-    client->Connect(ep, shard_endpoints);
+    if (replay) {
+      vector<const TrafficStream*> streams;
+      for (size_t i = index; i < replay_streams.size(); i += pp->size())
+        streams.push_back(&replay_streams[i]);
+      client->ConnectReplay(nodes.front(), std::move(streams));
+    } else {
+      client->Connect(nodes);
+    }
   });
 
   absl::Duration duration;
+  uint64_t resp_goal = GetFlag(FLAGS_c) * pp->size() * GetFlag(FLAGS_n) * nodes.size();
   if (absl::GetFlag(FLAGS_connect_only)) {
     pp->AwaitFiberOnAll([&](unsigned index, auto* p) { client->Disconnect(); });
+  } else if (replay) {
+    resp_goal = 0;
+    for (const TrafficStream& stream : replay_streams)
+      resp_goal += stream.size();
+
+    CONSOLE_INFO << "Replaying at " << GetFlag(FLAGS_replay_speed) << "x of the recorded speed";
+    atomic_bool finish{false};
+    const int64_t start_ns = absl::GetCurrentTimeNanos();
+    pp->AwaitBrief([&](unsigned index, auto* p) { client->StartReplay(start_ns); });
+
+    auto watch_fb = pp->GetNextProactor()->LaunchFiber(
+        [&] { WatchFiber(resp_goal, ep, &shard_slots, &finish, pp.get()); });
+    const absl::Time start_time = absl::Now();
+    pp->AwaitFiberOnAll([&](unsigned index, auto* p) { client->Join(); });
+
+    duration = absl::Now() - start_time;
+    finish.store(true);
+    watch_fb.Join();
   } else {
     const uint32_t key_minimum = GetFlag(FLAGS_key_minimum);
     const uint32_t key_maximum = GetFlag(FLAGS_key_maximum);
@@ -1218,8 +1940,8 @@ int main(int argc, char* argv[]) {
       client->Start(key_minimum + index * thread_key_step, key_max, interval);
     });
 
-    auto watch_fb =
-        pp->GetNextProactor()->LaunchFiber([&] { WatchFiber(shards.size(), &finish, pp.get()); });
+    auto watch_fb = pp->GetNextProactor()->LaunchFiber(
+        [&] { WatchFiber(resp_goal, ep, &shard_slots, &finish, pp.get()); });
     const absl::Time start_time = absl::Now();
 
     // The actual run.
@@ -1252,12 +1974,63 @@ int main(int argc, char* argv[]) {
   if (summary.num_errors) {
     CONSOLE_INFO << "Got " << summary.num_errors << " error responses!";
   }
+  if (summary.num_redirects) {
+    CONSOLE_INFO << "Got " << summary.num_redirects << " MOVED/ASK redirections";
+  }
 
   CONSOLE_INFO << "Latency summary, all times are in usec:\n" << summary.total_hist.ToString();
+  double elapsed_sec = absl::ToDoubleSeconds(duration);
+  if (reporter->enabled()) {
+    reporter->Write({.type = "summary",
+                     .elapsed_sec = elapsed_sec,
+                     .requests = summary.num_responses,
+                     .rps = elapsed_sec > 0 ? summary.num_responses / elapsed_sec : 0,
+                     .errors = summary.num_errors,
+                     .hist = &summary.total_hist});
+  }
   if (summary.hit_opportunities) {
     CONSOLE_INFO << "----------------------------------\nHit rate: "
                  << 100 * double(summary.hit_count) / double(summary.hit_opportunities) << "%\n";
   }
+
+  for (size_t i = 0; i < summary.template_hist.size(); ++i) {
+    const LatencyHist& hist = summary.template_hist[i];
+    CONSOLE_INFO << "----------------------------------\nTemplate " << i << ": "
+                 << workload[i].command << "\nRequests: " << hist.count()
+                 << ", P50 lat: " << hist.Percentile(50) << "us, P99 lat: " << hist.Percentile(99)
+                 << "us\nLatency summary, all times are in usec:\n"
+                 << hist.ToString();
+    if (reporter->enabled()) {
+      reporter->Write({.type = "template",
+                       .name = workload[i].command,
+                       .elapsed_sec = elapsed_sec,
+                       .requests = hist.count(),
+                       .rps = elapsed_sec > 0 ? hist.count() / elapsed_sec : 0,
+                       .hist = &hist});
+    }
+  }
+
+  if (nodes.size() > 1) {
+    for (size_t i = 0; i < summary.node_stats.size(); ++i) {
+      const NodeStats& node = summary.node_stats[i];
+      string name = nodes[i].Name();
+      CONSOLE_INFO << "----------------------------------\nNode " << name
+                   << "\nRequests: " << node.hist.count() << ", errors: " << node.num_errors
+                   << ", moved: " << node.num_moved << ", ask: " << node.num_ask
+                   << "\nLatency summary, all times are in usec:\n"
+                   << node.hist.ToString();
+      if (reporter->enabled()) {
+        reporter->Write({.type = "node",
+                         .name = name,
+                         .elapsed_sec = elapsed_sec,
+                         .requests = node.hist.count(),
+                         .rps = elapsed_sec > 0 ? node.hist.count() / elapsed_sec : 0,
+                         .errors = node.num_errors,
+                         .hist = &node.hist});
+      }
+    }
+  }
+  reporter.reset();
   pp->Stop();
 
   return 0;
@@ -34,6 +34,7 @@
 #include "base/init.h"
 #include "base/proc_util.h"  // for GetKernelVersion
 #include "facade/dragonfly_listener.h"
+#include "facade/numa.h"
 #include "io/file.h"
 #include "io/file_util.h"
 #include "io/proc_reader.h"
@@ -85,6 +86,9 @@ ABSL_FLAG(uint16_t, uring_recv_buffer_cnt, 0,
           "Relevant only for modern kernels with io_uring enabled");
 
 ABSL_FLAG(bool, omit_basic_usage, false, "Omit printing basic usage info.");
+ABSL_FLAG(bool, numa_local_memory, false,
+          "On NUMA hosts, prefer allocating the memory of each thread, including the data of its "
+          "shard, on the NUMA node of the thread's CPU");
 
 using namespace util;
 using namespace facade;
@@ -609,6 +613,21 @@ void SetupAllocationTracker(ProactorPool* pool) {
 #endif
 }
 
+void SetupNumaMemory(ProactorPool* pool) {
+  const NumaTopology& topology = NumaTopology::Get();
+  if (!GetFlag(FLAGS_numa_local_memory) || topology.num_nodes() < 2)
+    return;
+
+  // The proactor threads are pinned to CPUs, so their local nodes are stable.
+  vector<optional<unsigned>> nodes(pool->size());
+  pool->AwaitBrief([&](unsigned index, ProactorBase*) { nodes[index] = PreferLocalNumaNode(); });
+
+  string summary;
+  for (unsigned i = 0; i < nodes.size(); ++i)
+    absl::StrAppend(&summary, i == 0 ? "" : ",", nodes[i] ? absl::StrCat(*nodes[i]) : "-");
+  LOG(INFO) << "NUMA nodes of threads: " << summary;
+}
+
 void RegisterBufRings(ProactorPool* pool) {
 #ifdef __linux__
   auto bufcnt = absl::GetFlag(FLAGS_uring_recv_buffer_cnt);
@@ -823,6 +842,10 @@ Usage: dragonfly [FLAGS]
   // via the environment variables, they will not be overridden.
   mi_option_set_enabled_default(mi_option_show_errors, true);
   mi_option_set_default(mi_option_purge_delay, 0);
+  if (GetFlag(FLAGS_numa_local_memory)) {
+    // Lets mimalloc keep the segments it reuses across threads on their NUMA nodes.
+    mi_option_set_default(mi_option_use_numa_nodes, NumaTopology::Get().num_nodes());
+  }
 
   // To see the options after the override, use:
   // mi_options_print();
@@ -853,6 +876,7 @@ Usage: dragonfly [FLAGS]
     pool->Run();
 
     SetupAllocationTracker(pool.get());
+    SetupNumaMemory(pool.get());
     RegisterBufRings(pool.get());
 
     AcceptServer acceptor(pool.get(), &fb2::std_malloc_resource, true);
@@ -20,12 +20,14 @@
 #include "facade/cmd_arg_parser.h"
 #include "facade/dragonfly_connection.h"
 #include "facade/dragonfly_listener.h"
+#include "server/cluster/slot_set.h"
 #include "server/debugcmd.h"
 #include "server/engine_shard_set.h"
 #include "server/error.h"
 #include "server/journal/journal.h"
 #include "server/journal/streamer.h"
 #include "server/main_service.h"
+#include "server/rdb_load.h"
 #include "server/rdb_save.h"
 #include "server/script_mgr.h"
 #include "server/server_family.h"
@@ -36,6 +38,7 @@ using namespace std;
 
 ABSL_FLAG(uint32_t, allow_partial_sync_with_lsn_diff, 0,
           "Do partial sync in case lsn diff is less than the given threshold");
+ABSL_DECLARE_FLAG(bool, cache_mode);
 ABSL_DECLARE_FLAG(bool, info_replication_valkey_compatible);
 ABSL_DECLARE_FLAG(uint32_t, replication_timeout);
 
@@ -185,6 +188,10 @@ void DflyCmd::Run(CmdArgList args, Transaction* tx, facade::RedisReplyBuilder* r
     return Load(args, rb, cntx);
   }
 
+  if (sub_cmd == "INGEST") {
+    return Ingest(args, rb);
+  }
+
   if (sub_cmd == "HELP") {
     string_view help_arr[] = {
         "DFLY <subcommand> [<arg> [value] [opt] ...]. Subcommands are:",
@@ -197,10 +204,16 @@ void DflyCmd::Run(CmdArgList args, Transaction* tx, facade::RedisReplyBuilder* r
         "REPLICAOFFSET",
         "    Returns LSN (log sequence number) per shard. These are the sequential ids of the ",
         "    journal entry.",
-        "LOAD <filename> [APPEND]",
+        "LOAD <filename> [APPEND] [SLOTS <start> <end> [<start> <end> ...]]",
         "    Loads <filename> RDB/DFS file into the data store.",
         "    * APPEND: Existing keys are NOT removed before loading the file, conflicting ",
         "      keys (that exist in both data store and in file) are overridden.",
+        "    * SLOTS: Loads only the keys of the slot ranges, implies APPEND. Reads only their",
+        "      entries if the DFS file was saved with --snapshot_key_index.",
+        "INGEST <payload> [REPLACE]",
+        "    Loads the keys of the RDB encoded <payload> without blocking the data store.",
+        "    Returns the number of keys read.",
+        "    * REPLACE: Existing keys are overridden, otherwise they are kept.",
         "HELP",
         "    Prints this help.",
     };
@@ -300,6 +313,7 @@ void DflyCmd::Flow(CmdArgList args, RedisReplyBuilder* rb, ConnectionContext* cn
     flow.conn = cntx->conn();
     flow.eof_token = eof_token;
     flow.version = replica_ptr->version;
+    flow.journal_compression = replica_ptr->journal_compression;
 
     if (!cntx->conn()->Migrate(shard_set->pool()->at(flow_id))) {
       // Listener::PreShutdown() triggered
@@ -367,6 +381,10 @@ void DflyCmd::Sync(CmdArgList args, Transaction* tx, RedisReplyBuilder* rb) {
   if (!sync_id)
     return;
 
+  // A full sync would miss the keys that were not loaded yet.
+  if (sf_->IsLazyLoading())
+    return rb->SendError(kLoadingErr);
+
   util::fb2::LockGuard lk{replica_ptr->shared_mu};
   if (!CheckReplicaStateOrReply(*replica_ptr, SyncState::PREPARATION, rb))
     return;
@@ -456,6 +474,10 @@ void DflyCmd::TakeOver(CmdArgList args, RedisReplyBuilder* rb, ConnectionContext
 
   VLOG(1) << "Got DFLY TAKEOVER " << sync_id_str << " time out:" << timeout;
 
+  // A relaying replica keeps applying the stream of its own master.
+  if (!ServerState::tlocal()->is_master)
+    return rb->SendError("Can't take over from a replica");
+
   auto [sync_id, replica_ptr] = GetReplicaInfoOrReply(sync_id_str, rb);
   if (!sync_id)
     return;
@@ -565,10 +587,23 @@ void DflyCmd::Load(CmdArgList args, RedisReplyBuilder* rb, ConnectionContext* cn
   parser.ExpectTag("LOAD");
   string filename = parser.Next<string>();
   ServerFamily::LoadExistingKeys existing_keys = ServerFamily::LoadExistingKeys::kFail;
+  if (parser.Check("APPEND"))
+    existing_keys = ServerFamily::LoadExistingKeys::kOverride;
 
-  if (parser.HasNext()) {
-    parser.ExpectTag("APPEND");
+  // Restoring slots keeps the rest of the data.
+  shared_ptr<cluster::SlotSet> slots;
+  if (parser.Check("SLOTS")) {
     existing_keys = ServerFamily::LoadExistingKeys::kOverride;
+    vector<cluster::SlotRange> ranges;
+    do {
+      auto [start, end] = parser.Next<SlotId, SlotId>();
+      ranges.push_back({start, end});
+    } while (parser.HasNext() && !parser.Error());
+
+    bool valid = all_of(ranges.begin(), ranges.end(), [](const auto& r) { return r.IsValid(); });
+    if (parser.Error() || !valid)
+      return rb->SendError(kSyntaxErr);
+    slots = make_shared<cluster::SlotSet>(cluster::SlotRanges{std::move(ranges)});
   }
 
   if (parser.Error() || parser.HasNext() || filename.empty()) {
@@ -579,7 +614,7 @@ void DflyCmd::Load(CmdArgList args, RedisReplyBuilder* rb, ConnectionContext* cn
     sf_->FlushAll(cntx->ns);
   }
 
-  if (auto fut_ec = sf_->Load(filename, existing_keys); fut_ec) {
+  if (auto fut_ec = sf_->Load(filename, existing_keys, false, std::move(slots)); fut_ec) {
     GenericError ec = fut_ec->Get();
     if (ec) {
       string msg = ec.Format();
@@ -591,6 +626,35 @@ void DflyCmd::Load(CmdArgList args, RedisReplyBuilder* rb, ConnectionContext* cn
   rb->SendOk();
 }
 
+void DflyCmd::Ingest(CmdArgList args, RedisReplyBuilder* rb) {
+  CmdArgParser parser{args};
+  parser.ExpectTag("INGEST");
+  string_view payload = parser.Next<string_view>();
+  bool replace = parser.Check("REPLACE");
+
+  if (parser.Error() || parser.HasNext())
+    return rb->SendError(kSyntaxErr);
+
+  if (!ServerState::tlocal()->is_master)
+    return rb->SendError("Replica can't ingest keys");
+
+  // The loader never evicts, see RdbLoader::LoadItemsBuffer.
+  if (absl::GetFlag(FLAGS_cache_mode))
+    return rb->SendError("INGEST is not supported in cache mode");
+
+  io::BytesSource src{io::Buffer(payload)};
+  RdbLoader loader{&sf_->service()};
+  loader.SetIngest(true);
+  loader.SetOverrideExistingKeys(replace);
+
+  if (error_code ec = loader.Load(&src); ec) {
+    LOG(WARNING) << "Could not ingest payload: " << ec.message();
+    return rb->SendError(ec.message());
+  }
+
+  rb->SendLong(loader.keys_loaded());
+}
+
 OpStatus DflyCmd::StartFullSyncInThread(FlowInfo* flow, ExecutionState* exec_st,
                                         EngineShard* shard) {
   DCHECK(shard);
@@ -662,6 +726,7 @@ void DflyCmd::StartStableSyncInThread(FlowInfo* flow, ExecutionState* exec_st, E
 
   flow->streamer.reset(
       new JournalStreamer(sf_->journal(), exec_st, JournalStreamer::SendLsn::YES, true));
+  flow->streamer->SetCompression(flow->journal_compression);
   flow->streamer->Start(flow->conn->socket());
 
   // Register cleanup.
@@ -833,6 +898,56 @@ void DflyCmd::GetReplicationMemoryStats(ReplicationMemoryStats* stats) const {
   stats->full_sync_buf_bytes += full_sync_bytes.load(memory_order_relaxed);
 }
 
+vector<vector<ReplicaFlowStats>> DflyCmd::GetReplicaFlowStats() const {
+  util::fb2::LockGuard lk{mu_};  // prevent state changes
+
+  vector<vector<ReplicaFlowStats>> stats(replica_infos_.size());
+  vector<const ReplicaInfo*> replicas;
+  for (const auto& [_, info] : replica_infos_)
+    replicas.push_back(info.get());
+
+  util::fb2::Mutex stats_mu;
+  shard_set->RunBlockingInParallel([&](EngineShard* shard) ABSL_NO_THREAD_SAFETY_ANALYSIS {
+    for (size_t i = 0; i < replicas.size(); i++) {
+      const ReplicaInfo* info = replicas[i];
+      dfly::SharedLock repl_lk{info->shared_mu};
+      if (info->replica_state != SyncState::STABLE_SYNC || info->flows.empty())
+        continue;
+
+      const FlowInfo& flow = info->flows[shard->shard_id()];
+      if (!flow.streamer || !shard->journal())
+        continue;
+
+      JournalStreamer::Stats streamer_stats = flow.streamer->GetStats();
+      ReplicaFlowStats flow_stats;
+      flow_stats.flow_id = shard->shard_id();
+      flow_stats.acked_lsn = flow.last_acked_lsn;
+      flow_stats.lsn_lag = shard->journal()->GetLsn() - flow.last_acked_lsn;
+      flow_stats.inflight_bytes = streamer_stats.inflight_bytes;
+      flow_stats.pending_bytes = streamer_stats.pending_bytes;
+      flow_stats.sent_bytes = streamer_stats.sent_bytes;
+      flow_stats.writes = streamer_stats.writes;
+      flow_stats.forced_writes = streamer_stats.forced_writes;
+      flow_stats.throttle_count = streamer_stats.throttle_count;
+      flow_stats.throttle_usec = streamer_stats.throttle_usec;
+      flow_stats.acks = streamer_stats.ack_latency_usec.count();
+      if (flow_stats.acks > 0) {
+        flow_stats.ack_latency_p50_usec = streamer_stats.ack_latency_usec.Percentile(50);
+        flow_stats.ack_latency_p99_usec = streamer_stats.ack_latency_usec.Percentile(99);
+      }
+
+      util::fb2::LockGuard stats_lk{stats_mu};
+      stats[i].push_back(flow_stats);
+    }
+  });
+
+  for (auto& flows : stats) {
+    sort(flows.begin(), flows.end(),
+         [](const auto& l, const auto& r) { return l.flow_id < r.flow_id; });
+  }
+  return stats;
+}
+
 pair<uint32_t, shared_ptr<DflyCmd::ReplicaInfo>> DflyCmd::GetReplicaInfoOrReply(
     std::string_view id_str, RedisReplyBuilder* rb) {
   uint32_t sync_id;
@@ -887,6 +1002,15 @@ void DflyCmd::SetDflyClientVersion(ConnectionState* state, DflyVersion version)
   replica_ptr->version = version;
 }
 
+void DflyCmd::SetJournalCompression(ConnectionState* state,
+                                    journal::StreamCompression compression) {
+  auto replica_ptr = GetReplicaInfo(state->replication_info.repl_session_id);
+  VLOG(1) << "Journal compression for session_id=" << state->replication_info.repl_session_id
+          << " is " << int(compression);
+
+  replica_ptr->journal_compression = compression;
+}
+
 // Must run under locked replica_info.mu.
 // TODO: it's a bad design that we enforce replies under a lock because Send can potentially
 // block, leading to high contention in some case. Split it and avoid replying under a lock.
@@ -910,6 +1034,10 @@ bool DflyCmd::CheckReplicaStateOrReply(const ReplicaInfo& repl_info, SyncState e
 }
 
 void DflyCmd::Shutdown() {
+  CancelReplicas();
+}
+
+void DflyCmd::CancelReplicas() {
   ReplicaInfoMap pending;
   {
     util::fb2::LockGuard lk(mu_);
@@ -928,6 +1056,12 @@ void FlowInfo::TryShutdownSocket() {
   }
 }
 
+void FlowInfo::OnAck(LSN lsn) {
+  last_acked_lsn = lsn;
+  if (streamer)
+    streamer->RecordAck(lsn);
+}
+
 FlowInfo::~FlowInfo() {
 }
 
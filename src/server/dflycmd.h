@@ -10,6 +10,7 @@
 #include <memory>
 
 #include "server/conn_context.h"
+#include "server/journal/types.h"
 #include "util/fibers/synchronization.h"
 
 namespace facade {
@@ -37,6 +38,9 @@ struct FlowInfo {
   // Shutdown associated socket if its still open.
   void TryShutdownSocket();
 
+  // Handle REPLCONF ACK of the replica.
+  void OnAck(LSN lsn);
+
   facade::Connection* conn = nullptr;
 
   std::unique_ptr<RdbSaver> saver;            // Saver for full sync phase.
@@ -44,6 +48,7 @@ struct FlowInfo {
   std::string eof_token;
 
   DflyVersion version = DflyVersion::VER1;
+  journal::StreamCompression journal_compression = journal::StreamCompression::NONE;
 
   std::optional<LSN> start_partial_sync_at;
   uint64_t last_acked_lsn = 0;
@@ -51,6 +56,23 @@ struct FlowInfo {
   std::function<void()> cleanup;  // Optional cleanup for cancellation.
 };
 
+// Stable sync state of a single flow, see INFO REPLICATION_FLOWS.
+struct ReplicaFlowStats {
+  uint32_t flow_id = 0;
+  LSN lsn_lag = 0;
+  LSN acked_lsn = 0;
+  size_t inflight_bytes = 0;
+  size_t pending_bytes = 0;
+  uint64_t sent_bytes = 0;
+  uint64_t writes = 0;
+  uint64_t forced_writes = 0;
+  uint64_t throttle_count = 0;
+  uint64_t throttle_usec = 0;
+  uint64_t acks = 0;
+  uint64_t ack_latency_p50_usec = 0;
+  uint64_t ack_latency_p99_usec = 0;
+};
+
 // DflyCmd is responsible for managing replication. A master instance can be connected
 // to many replica instances, what is more, each of them can open multiple connections.
 // This is why its important to understand replica lifecycle management before making
@@ -121,6 +143,7 @@ class DflyCmd {
     std::string address;
     uint32_t listening_port;
     DflyVersion version = DflyVersion::VER1;
+    journal::StreamCompression journal_compression = journal::StreamCompression::NONE;
 
     // Flows describe the state of shard-local flow.
     // They are always indexed by the shard index on the master.
@@ -140,6 +163,10 @@ class DflyCmd {
   // Stop all background processes so we can exit in orderly manner.
   void Shutdown();
 
+  // Cancels the sessions of all replicas. Used by a relaying replica before it resyncs from its
+  // own master, since the loaded snapshot is not journaled.
+  void CancelReplicas() ABSL_LOCKS_EXCLUDED(mu_);
+
   // Create new sync session. Returns (session_id, number of flows)
   std::pair<uint32_t, unsigned> CreateSyncSession(ConnectionState* state) ABSL_LOCKS_EXCLUDED(mu_);
 
@@ -151,9 +178,17 @@ class DflyCmd {
 
   void GetReplicationMemoryStats(ReplicationMemoryStats* out) const ABSL_NO_THREAD_SAFETY_ANALYSIS;
 
+  // Master-side. Returns the flows of each replica in stable sync, in the order of
+  // GetReplicasRoleInfo.
+  std::vector<std::vector<ReplicaFlowStats>> GetReplicaFlowStats() const
+      ABSL_NO_THREAD_SAFETY_ANALYSIS;
+
   // Sets metadata.
   void SetDflyClientVersion(ConnectionState* state, DflyVersion version);
 
+  // Sets compression of the stable sync stream requested by the replica.
+  void SetJournalCompression(ConnectionState* state, journal::StreamCompression compression);
+
   // Tries to break those flows that stuck on socket write for too long time.
   void BreakStalledFlowsInShard() ABSL_NO_THREAD_SAFETY_ANALYSIS;
 
@@ -197,6 +232,10 @@ class DflyCmd {
 
   void Load(CmdArgList args, RedisReplyBuilder* rb, ConnectionContext* cntx);
 
+  // INGEST <payload> [REPLACE]
+  // Load the keys of an RDB payload into the running data store.
+  void Ingest(CmdArgList args, RedisReplyBuilder* rb);
+
   // Start full sync in thread. Start FullSyncFb. Called for each flow.
   facade::OpStatus StartFullSyncInThread(FlowInfo* flow, ExecutionState* cntx, EngineShard* shard);
 
@@ -8,6 +8,7 @@ extern "C" {
 }
 
 #include <absl/strings/ascii.h>
+#include <absl/strings/str_cat.h>
 #include <absl/strings/str_join.h>
 #include <absl/strings/strip.h>
 #include <gmock/gmock.h>
@@ -19,6 +20,7 @@ extern "C" {
 #include "facade/facade_test.h"
 #include "server/conn_context.h"
 #include "server/main_service.h"
+#include "server/server_state.h"
 #include "server/test_utils.h"
 
 ABSL_DECLARE_FLAG(float, mem_defrag_threshold);
@@ -27,8 +29,10 @@ ABSL_DECLARE_FLAG(uint32_t, mem_defrag_check_sec_interval);
 ABSL_DECLARE_FLAG(std::vector<std::string>, rename_command);
 ABSL_DECLARE_FLAG(bool, lua_resp2_legacy_float);
 ABSL_DECLARE_FLAG(double, eviction_memory_budget_threshold);
+ABSL_DECLARE_FLAG(uint32_t, eviction_pool_size);
 ABSL_DECLARE_FLAG(std::vector<std::string>, command_alias);
 ABSL_DECLARE_FLAG(bool, latency_tracking);
+ABSL_DECLARE_FLAG(uint32_t, tx_schedule_coalesce_usec);
 
 namespace dfly {
 
@@ -252,6 +256,44 @@ TEST_F(DflyEngineTest, EvalBug713b) {
   }
 }
 
+TEST_F(DflyEngineTest, ScheduleCoalesce) {
+  absl::FlagSaver fs;
+  SetFlag(&FLAGS_tx_schedule_coalesce_usec, 2000);
+
+  const uint32_t kNumFibers = 20;
+  Fiber fibers[kNumFibers];
+  for (unsigned j = 0; j < kNumFibers; ++j) {
+    fibers[j] = pp_->at(1)->LaunchFiber([j, this] {
+      for (unsigned i = 0; i < 10; ++i)
+        Run(StrCat("fb", j), {"set", kKeySid0, "val"});
+    });
+  }
+  for (unsigned j = 0; j < kNumFibers; ++j)
+    fibers[j].Join();
+
+  // Connections on the same thread share the scheduling hops.
+  auto metrics = GetMetrics();
+  EXPECT_LT(metrics.shard_stats.tx_batch_schedule_calls_total * 2,
+            metrics.shard_stats.tx_batch_scheduled_items_total);
+}
+
+TEST_F(DflyEngineTest, ScheduleCoalesceMultiShard) {
+  absl::FlagSaver fs;
+  SetFlag(&FLAGS_tx_schedule_coalesce_usec, 500'000);
+
+  // The set arms the queue of its shard and delays the hop.
+  Fiber fb = pp_->at(1)->LaunchFiber([this] { Run("fb", {"set", kKeySid0, "1"}); });
+  ThisFiber::SleepFor(20ms);
+
+  // Multi shard transactions are not delayed by the sleeping coordinator.
+  absl::Time start = absl::Now();
+  Run({"mset", kKeySid0, "2", kKeySid1, "2"});
+  EXPECT_LT(absl::Now() - start, absl::Milliseconds(250));
+
+  fb.Join();
+  EXPECT_EQ(Run({"get", kKeySid0}), "2");
+}
+
 TEST_F(DflyEngineTest, EvalSha) {
   auto resp = Run({"script", "load", "return 5"});
   EXPECT_THAT(resp, ArgType(RespExpr::STRING));
@@ -552,6 +594,37 @@ TEST_F(DflyEngineTest, StickyEviction) {
 
 #endif
 
+TEST_F(DflyEngineTest, EvictFromPool) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_eviction_pool_size, 16);
+  shard_set->TEST_EnableCacheMode();
+
+  string value(1000, '.');
+  for (unsigned i = 0; i < 500; ++i) {
+    ASSERT_EQ(Run({"set", StrCat("key", i), value}), "OK");
+  }
+
+  atomic_uint pooled = 0, evicted = 0;
+  shard_set->RunBriefInParallel([&](EngineShard* shard) {
+    auto& db_slice = namespaces->GetDefaultNamespace().GetDbSlice(shard->shard_id());
+    db_slice.RefillEvictionPool(0);
+    pooled += db_slice.GetDBTable(0)->eviction_pool.size();
+  });
+  ASSERT_GT(pooled.load(), 0u);
+
+  shard_set->RunBriefInParallel([&](EngineShard* shard) {
+    auto& db_slice = namespaces->GetDefaultNamespace().GetDbSlice(shard->shard_id());
+    auto [items, bytes] = db_slice.EvictFromPool(0, SIZE_MAX, 4);
+    EXPECT_LE(items, 4u);
+    EXPECT_GE(bytes, items * value.size());
+    evicted += items;
+  });
+  ASSERT_GT(evicted.load(), 0u);
+
+  EXPECT_THAT(Run({"dbsize"}), IntArg(500 - evicted.load()));
+  EXPECT_EQ(GetMetrics().events.evicted_keys, evicted.load());
+}
+
 TEST_F(DflyEngineTest, ZeroAllocationEviction) {
   max_memory_limit = 500000;  // 0.5mb
   shard_set->TEST_EnableCacheMode();
@@ -629,6 +702,60 @@ TEST_F(DflyEngineTest, PSubscribeMatchOnlyStar) {
   EXPECT_EQ("*", msg.pattern);
 }
 
+TEST_F(DflyEngineTest, PSubscribeManyPatterns) {
+  single_response_ = false;
+  // Patterns with different literal prefixes, a general pattern and one without a prefix.
+  pp_->at(1)->Await([&] {
+    for (unsigned i = 0; i < 100; ++i)
+      Run({"psubscribe", absl::StrCat("news.", i, ".*")});
+    return Run({"psubscribe", "news.[0-9].sports", "*.sports", "news.1"});
+  });
+
+  auto resp = pp_->at(0)->Await([&] { return Run({"publish", "news.1.sports", "a"}); });
+  EXPECT_THAT(resp, IntArg(3));  // news.1.*, news.[0-9].sports and *.sports
+
+  resp = pp_->at(0)->Await([&] { return Run({"publish", "news.1", "b"}); });
+  EXPECT_THAT(resp, IntArg(1));
+
+  pp_->at(1)->Await([&] { return Run({"punsubscribe", "news.1.*"}); });
+  resp = pp_->at(0)->Await([&] { return Run({"publish", "news.1.sports", "c"}); });
+  EXPECT_THAT(resp, IntArg(2));
+
+  resp = pp_->at(0)->Await([&] { return Run({"publish", "weather", "d"}); });
+  EXPECT_THAT(resp, IntArg(0));
+}
+
+TEST_F(DflyEngineTest, KeyspaceEvents) {
+  EXPECT_THAT(Run({"config", "set", "notify_keyspace_events", "Kq"}), ArgType(RespExpr::ERROR));
+  Run({"config", "set", "notify_keyspace_events", "KEA"});
+
+  single_response_ = false;
+  pp_->at(1)->Await([&] { return Run({"subscribe", "__keyevent@0__:hset"}); });
+  pp_->at(1)->Await([&] { return Run({"psubscribe", "__keyspace@0__:*"}); });
+
+  Run({"hset", "h", "f", "v"});
+  Run({"del", "h"});
+  pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
+
+  ASSERT_EQ(3, SubscriberMessagesLen("IO1"));
+  vector<pair<string, string>> events;
+  for (unsigned i = 0; i < 3; ++i) {
+    const auto& msg = GetPublishedMessage("IO1", i);
+    events.emplace_back(msg.channel, msg.message);
+  }
+  EXPECT_THAT(events, UnorderedElementsAre(Pair("__keyevent@0__:hset", "h"),
+                                           Pair("__keyspace@0__:h", "hset"),
+                                           Pair("__keyspace@0__:h", "del")));
+
+  // Only hash events are generated.
+  Run({"config", "set", "notify_keyspace_events", "Kh"});
+  Run({"set", "s", "v"});
+  pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
+  EXPECT_EQ(3, SubscriberMessagesLen("IO1"));
+
+  Run({"config", "set", "notify_keyspace_events", ""});
+}
+
 TEST_F(DflyEngineTest, Unsubscribe) {
   auto resp = Run({"unsubscribe", "a"});
   EXPECT_THAT(resp.GetVec(), ElementsAre("unsubscribe", "a", IntArg(0)));
@@ -664,6 +791,37 @@ TEST_F(DflyEngineTest, PUnsubscribe) {
   EXPECT_THAT(resp.GetVec(), ElementsAre("punsubscribe", "b*", IntArg(0)));
 }
 
+TEST_F(DflyEngineTest, SubscribeManyChannels) {
+  // Channels spread over all partitions of the channel store.
+  for (unsigned i = 0; i < 100; ++i) {
+    pp_->at(1)->Await([&] { return Run({"subscribe", absl::StrCat("chan", i)}); });
+  }
+
+  auto resp = Run({"pubsub", "channels"});
+  EXPECT_THAT(resp, ArrLen(100));
+
+  for (unsigned i = 0; i < 100; i += 2) {
+    pp_->at(1)->Await([&] { return Run({"unsubscribe", absl::StrCat("chan", i)}); });
+  }
+
+  resp = Run({"pubsub", "channels"});
+  EXPECT_THAT(resp, ArrLen(50));
+  EXPECT_THAT(Run({"publish", "chan0", "msg"}), IntArg(0));
+  EXPECT_THAT(Run({"publish", "chan1", "msg"}), IntArg(1));
+}
+
+TEST_F(DflyEngineTest, ShardedPubSub) {
+  auto resp = pp_->at(1)->Await([&] { return Run({"ssubscribe", "foo"}); });
+  EXPECT_THAT(resp, ArrLen(3));
+
+  // Shard channels are separate from regular channels.
+  EXPECT_THAT(Run({"publish", "foo", "bar"}), IntArg(0));
+  EXPECT_THAT(Run({"spublish", "foo", "bar"}), IntArg(1));
+
+  pp_->at(1)->Await([&] { return Run({"sunsubscribe", "foo"}); });
+  EXPECT_THAT(Run({"spublish", "foo", "bar"}), IntArg(0));
+}
+
 TEST_F(DflyEngineTest, Bug468) {
   RespExpr resp = Run({"multi"});
   ASSERT_EQ(resp, "OK");
@@ -681,6 +839,29 @@ TEST_F(DflyEngineTest, Bug468) {
   ASSERT_FALSE(IsLocked(0, "foo"));
 }
 
+TEST_F(DflyEngineTest, MemoryQuota) {
+  shard_set->RunBriefInParallel([](EngineShard* shard) {
+    namespaces->GetDefaultNamespace().GetDbSlice(shard->shard_id()).SetMemoryQuota(256 << 10);
+  });
+
+  // New keys are rejected once the slice of their shard uses up its quota.
+  string rejected;
+  for (unsigned i = 0; i < 5000 && rejected.empty(); ++i) {
+    string key = absl::StrCat("key", i);
+    auto resp = Run({"set", key, string(1024, 'x')});
+    if (resp.type == RespExpr::ERROR) {
+      EXPECT_THAT(resp, ErrArg("Out of memory"));
+      rejected = key;
+    }
+  }
+  ASSERT_FALSE(rejected.empty());
+
+  shard_set->RunBriefInParallel([](EngineShard* shard) {
+    namespaces->GetDefaultNamespace().GetDbSlice(shard->shard_id()).SetMemoryQuota(0);
+  });
+  EXPECT_EQ(Run({"set", rejected, "x"}), "OK");
+}
+
 TEST_F(DflyEngineTest, Bug496) {
   shard_set->RunBlockingInParallel([](EngineShard* shard) {
     auto& db = namespaces->GetDefaultNamespace().GetDbSlice(shard->shard_id());
@@ -866,6 +1047,52 @@ TEST_F(DflyEngineTest, MemoryUsage) {
   EXPECT_GT(*resp.GetInt(), 100000);
 }
 
+TEST_F(DflyEngineTest, MemoryAnalyze) {
+  for (unsigned i = 0; i < 50; ++i) {
+    Run({"set", StrCat("user:", i), string(100, 'a')});
+  }
+  for (unsigned i = 0; i < 20; ++i) {
+    Run({"hset", StrCat("session:", i), "a", "1"});
+    Run({"expire", StrCat("session:", i), "100"});
+  }
+
+  auto resp = Run({"memory", "analyze"});
+  ASSERT_THAT(resp, ArrLen(6));
+  const auto& top = resp.GetVec();
+  EXPECT_THAT(top[1], IntArg(70));
+  EXPECT_THAT(top[3], IntArg(70));
+  ASSERT_THAT(top[5], ArrLen(2));
+
+  const auto& users = top[5].GetVec()[0].GetVec();
+  EXPECT_EQ(users[1], "user:");
+  EXPECT_EQ(users[3], "string");
+  EXPECT_THAT(users[5], IntArg(50));
+  const auto& sessions = top[5].GetVec()[1].GetVec();
+  EXPECT_EQ(sessions[1], "session:");
+  EXPECT_EQ(sessions[3], "hash");
+  EXPECT_THAT(sessions[9].GetVec()[5], IntArg(20));  // all keys expire in under an hour
+
+  resp = Run({"memory", "analyze", "match", "u*", "count", "1"});
+  ASSERT_THAT(resp, ArrLen(6));
+  ASSERT_THAT(resp.GetVec()[5], ArrLen(1));
+  EXPECT_EQ(resp.GetVec()[5].GetVec()[0].GetVec()[1], "u*");
+}
+
+TEST_F(DflyEngineTest, HotKeys) {
+  Run({"set", "hot", "1"});
+  Run({"set", "cold", "1"});
+  for (unsigned i = 0; i < 64 * 100; ++i) {
+    Run({"get", "hot"});
+  }
+
+  auto resp = Run({"hotkeys", "1"});
+  ASSERT_THAT(resp, ArrLen(2));
+  EXPECT_EQ(resp.GetVec()[0], "hot");
+  EXPECT_GT(*resp.GetVec()[1].GetInt(), 64 * 50);
+
+  EXPECT_THAT(Run({"hotkeys", "1", "2"}), ErrArg("syntax error"));
+}
+
 TEST_F(DflyEngineTest, DebugObject) {
   Run({"set", "key", "value"});
   Run({"lpush", "l1", "a", "b"});
@@ -904,6 +1131,14 @@ TEST_F(DflyEngineTest, StreamMemInfo) {
   EXPECT_GT(stream_mem_second, 0);
 }
 
+TEST_F(DflyEngineTest, DebugReserve) {
+  size_t table_mem = GetMetrics().db_stats[0].table_mem_usage;
+  EXPECT_EQ(Run({"debug", "reserve", "100000"}), "OK");
+  EXPECT_GT(GetMetrics().db_stats[0].table_mem_usage, table_mem);
+
+  EXPECT_THAT(Run({"debug", "reserve", "-1"}), ErrArg("out of range"));
+}
+
 TEST_F(DflyEngineTest, ReplicaofRejectOnLoad) {
   service_->SwitchState(GlobalState::ACTIVE, GlobalState::LOADING);
 
@@ -928,6 +1163,40 @@ TEST_F(DflyEngineTest, CommandMetricLabels) {
   EXPECT_EQ(metrics.facade_stats.conn_stats.num_conns_other, 0);
 }
 
+TEST_F(DflyEngineTest, LockTableSpill) {
+  LockTable lt;
+  // a and b share a stripe, c does not.
+  LockFp a = 1, b = 2, c = 1ULL << 63;
+
+  EXPECT_TRUE(lt.Acquire(a, IntentLock::EXCLUSIVE));
+  EXPECT_TRUE(lt.Acquire(b, IntentLock::SHARED));
+  EXPECT_TRUE(lt.Acquire(c, IntentLock::SHARED));
+  EXPECT_FALSE(lt.Acquire(a, IntentLock::SHARED));
+  EXPECT_TRUE(lt.Acquire(b, IntentLock::SHARED));
+  EXPECT_EQ(3u, lt.Size());
+  EXPECT_FALSE(lt.Find(3).has_value());
+
+  // b stays in the map after the stripe is released.
+  lt.Release(a, IntentLock::EXCLUSIVE);
+  lt.Release(a, IntentLock::SHARED);
+  EXPECT_FALSE(lt.Find(a).has_value());
+  EXPECT_FALSE(lt.Acquire(b, IntentLock::EXCLUSIVE));
+  EXPECT_EQ(2u, lt.Size());
+
+  unsigned count = 0;
+  lt.ForEach([&](LockFp fp, const IntentLock& lock) {
+    ++count;
+    EXPECT_EQ(fp == b, lock.IsContended());
+  });
+  EXPECT_EQ(2u, count);
+
+  lt.Release(b, IntentLock::EXCLUSIVE);
+  lt.Release(b, IntentLock::SHARED);
+  lt.Release(b, IntentLock::SHARED);
+  lt.Release(c, IntentLock::SHARED);
+  EXPECT_EQ(0u, lt.Size());
+}
+
 class DflyCommandAliasTest : public DflyEngineTest {
  protected:
   DflyCommandAliasTest() {
@@ -965,6 +1234,82 @@ TEST_F(DflyCommandAliasTest, Aliasing) {
   EXPECT_THAT(metrics.cmd_stats_map, Contains(Pair("exec", Key(1))));
 }
 
+TEST_F(DflyEngineTest, CommandResourceStats) {
+  EXPECT_EQ(Run({"SET", "foo", "bar"}), "OK");
+  EXPECT_EQ(Run({"GET", "foo"}), "bar");
+
+  auto stats = GetMetrics().cmd_resource_stats_map;
+  EXPECT_EQ(stats["set"].input_bytes, 6u);
+  EXPECT_EQ(stats["set"].output_bytes, 5u);  // +OK\r\n
+  EXPECT_EQ(stats["set"].hops, 1u);
+  EXPECT_GT(stats["set"].shard_cycles, 0u);
+  EXPECT_EQ(stats["get"].output_bytes, 9u);  // $3\r\nbar\r\n
+
+  string info = Run({"INFO", "COMMANDSTATS"}).GetString();
+  EXPECT_THAT(info, HasSubstr("input_bytes=6,output_bytes=5"));
+}
+
+TEST_F(DflyEngineTest, HuffmanApplyKeepsExpiry) {
+  EXPECT_EQ(Run({"debug", "populate", "100", "key:with:a:long:common:prefix"}), "OK");
+  Run({"debug", "compression", "apply"});
+
+  // These keys are encoded with the first table and re-encoded by the second swap.
+  for (unsigned i = 0; i < 100; ++i) {
+    Run({"set", StrCat("expiring:key:with:a:long:common:prefix:", i), "v", "EX", "100"});
+  }
+  Run({"debug", "compression", "apply"});
+
+  for (unsigned i = 0; i < 100; ++i) {
+    string key = StrCat("expiring:key:with:a:long:common:prefix:", i);
+    EXPECT_EQ(100, CheckedInt({"ttl", key}));
+    EXPECT_EQ(Run({"get", key}), "v");
+  }
+
+  AdvanceTime(101'000);
+  for (unsigned i = 0; i < 100; ++i) {
+    EXPECT_EQ(0, CheckedInt({"exists", StrCat("expiring:key:with:a:long:common:prefix:", i)}));
+  }
+  EXPECT_EQ(100, CheckedInt({"dbsize"}));
+}
+
+TEST_F(DflyEngineTest, ScratchArenaCap) {
+  pp_->at(0)->Await([] {
+    ServerState* ss = ServerState::tlocal();
+    {
+      ScratchScope outer;  // keeps the arena alive, as interleaved hops would.
+      for (unsigned i = 0; i < 1024; ++i) {
+        ScratchScope scope;
+        PMR_NS::memory_resource* mr = ss->scratch_resource();
+        void* ptr = mr->allocate(4096, 8);
+        mr->deallocate(ptr, 4096, 8);
+      }
+
+      // 4MB were allocated, but the arena stopped growing after reaching its cap.
+      EXPECT_GE(ss->scratch_arena_bytes(), ServerState::kScratchMaxSize);
+      EXPECT_LT(ss->scratch_arena_bytes(), 3 * ServerState::kScratchMaxSize);
+    }
+    EXPECT_EQ(0u, ss->scratch_arena_bytes());
+  });
+}
+
+TEST_F(DflyCommandAliasTest, TxPhaseStats) {
+  EXPECT_EQ(Run({"SET", "foo", "bar"}), "OK");
+  EXPECT_EQ(Run({"SET", "foo", "baz"}), "OK");
+  Run({"MGET", "foo", "a", "b", "c"});
+
+  auto tx_stats = GetMetrics().tx_phase_stats_map;
+  ASSERT_TRUE(tx_stats.contains("set"));
+  EXPECT_EQ(tx_stats["set"].phases[TxPhaseStats::HOPS].count, 2);
+  EXPECT_EQ(tx_stats["set"].phases[TxPhaseStats::HOPS].sum, 2);
+  EXPECT_GE(tx_stats["mget"].phases[TxPhaseStats::SCHEDULE].count, 1);
+  EXPECT_GE(tx_stats["mget"].phases[TxPhaseStats::EXECUTION].count, 1);
+  EXPECT_FALSE(tx_stats.contains("ping"));
+
+  string info = Run({"INFO", "LATENCYSTATS"}).GetString();
+  EXPECT_THAT(info, HasSubstr("tx_hops_set:p50=2"));
+  EXPECT_THAT(info, HasSubstr("tx_execution_mget:"));
+}
+
 TEST_F(DflyCommandAliasTest, AliasesShareHistogramPtr) {
   EXPECT_EQ(Run({"SET", "foo", "bar"}), "OK");
   EXPECT_EQ(Run({"___SET", "a", "b"}), "OK");
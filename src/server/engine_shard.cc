@@ -14,7 +14,9 @@ extern "C" {
 #include "redis/zmalloc.h"
 }
 #include "server/engine_shard_set.h"
+#include "server/hset_family.h"
 #include "server/journal/journal.h"
+#include "server/list_family.h"
 #include "server/namespaces.h"
 #include "server/search/doc_index.h"
 #include "server/server_state.h"
@@ -51,13 +53,27 @@ ABSL_FLAG(string, shard_round_robin_prefix, "",
 ABSL_FLAG(string, tiered_prefix, "",
           "Enables tiered storage if set. "
           "The string denotes the path and prefix of the files "
-          " associated with tiered storage. Stronly advised to use "
+          " associated with tiered storage. A comma separated list of prefixes, i.e. one per "
+          "device, spreads the shard files across them round robin. Stronly advised to use "
           "high performance NVME ssd disks for this. Also, seems that pipeline_squash does "
           "not work well with tiered storage, so it's advised to set it to 0.");
 
 ABSL_FLAG(float, tiered_offload_threshold, 0.5,
           "The ratio of used/max memory above which we start offloading values to disk");
 
+ABSL_FLAG(uint32_t, table_growth_step, 1 << 14,
+          "Number of directory entries of the prime and expire tables to prepare on each heartbeat "
+          "ahead of their next doubling. 0 disables the incremental growth.");
+
+ABSL_FLAG(string, table_hugepages, "",
+          "If set, allocates prime and expire table segments from huge page backed arenas. "
+          "Can be 'thp' for transparent huge pages, or '2mb' and '1gb' for explicit huge pages "
+          "that must be reserved via /proc/sys/vm/nr_hugepages.");
+
+ABSL_FLAG(uint32_t, active_expire_cpu_usec, 1000,
+          "Maximal cpu time in microseconds that each shard spends on active expiry "
+          "per heartbeat.");
+
 ABSL_FLAG(bool, enable_heartbeat_eviction, true,
           "Enable eviction during heartbeat when memory is under pressure.");
 
@@ -66,6 +82,7 @@ ABSL_FLAG(double, eviction_memory_budget_threshold, 0.1,
           "eviction_memory_budget_threshold * max_memory_limit.");
 
 ABSL_DECLARE_FLAG(uint32_t, max_eviction_per_heartbeat);
+ABSL_DECLARE_FLAG(bool, list_compress_in_background);
 
 namespace dfly {
 
@@ -76,6 +93,9 @@ namespace {
 
 constexpr uint64_t kCursorDoneState = 0u;
 
+// Buckets of hashes and sets with field expiries that the heartbeat traverses per db.
+constexpr unsigned kFieldReapBuckets = 256;
+
 struct ShardMemUsage {
   std::size_t commited = 0;
   std::size_t used = 0;
@@ -308,7 +328,7 @@ string EngineShard::TxQueueInfo::Format() const {
 }
 
 EngineShard::Stats& EngineShard::Stats::operator+=(const EngineShard::Stats& o) {
-  static_assert(sizeof(Stats) == 96);
+  static_assert(sizeof(Stats) == 136);
 
 #define ADD(x) x += o.x
 
@@ -317,15 +337,22 @@ EngineShard::Stats& EngineShard::Stats::operator+=(const EngineShard::Stats& o)
   ADD(defrag_task_invocation_total);
   ADD(poll_execution_total);
   ADD(tx_ooo_total);
+  ADD(tx_ooo_promoted_total);
   ADD(tx_optimistic_total);
+  ADD(tx_optimistic_read_total);
+  ADD(tx_optimistic_read_retries);
   ADD(tx_batch_schedule_calls_total);
   ADD(tx_batch_scheduled_items_total);
   ADD(total_heartbeat_expired_keys);
   ADD(total_heartbeat_expired_bytes);
   ADD(total_heartbeat_expired_calls);
+  ADD(active_expire_throttled_total);
   ADD(total_migrated_keys);
 
 #undef ADD
+
+  // A gauge, report the largest per-shard budget.
+  active_expire_budget = std::max(active_expire_budget, o.active_expire_budget);
   return *this;
 }
 
@@ -348,7 +375,7 @@ void EngineShard::DefragTaskState::ResetScanState() {
 // 3. in case the above is OK, make sure that we have a "gap" between usage and commited memory
 // (control by mem_defrag_waste_threshold flag)
 bool EngineShard::DefragTaskState::CheckRequired() {
-  if (cursor > kCursorDoneState) {
+  if (cursor > kCursorDoneState || !pending_values.empty()) {
     VLOG(2) << "cursor: " << cursor;
     return true;
   }
@@ -392,10 +419,47 @@ bool EngineShard::DoDefrag(const float threshold) {
   // --------------------------------------------------------------------------
 
   constexpr size_t kMaxTraverses = 40;
+  // Internal allocations of a container that are visited in a single step.
+  constexpr uint32_t kValueStepBudget = 1024;
 
   // TODO: enable tiered storage on non-default db slice
   DbSlice& slice = namespaces->GetDefaultNamespace().GetDbSlice(shard_->shard_id());
 
+  uint64_t reallocations = 0;
+  uint64_t attempts = 0;
+  auto defrag_value = [&](DbIndex dbid, PrimeIterator it, uint64_t* value_cursor) {
+    // for each value check whether we should move it because it
+    // seats on underutilized page of memory, and if so, do it.
+    size_t orig_heap_size = it->second.MallocUsed();
+    bool did = it->second.DefragStep(threshold, value_cursor, kValueStepBudget);
+    attempts++;
+    if (did) {
+      reallocations++;
+      // Compacting streams may shrink them considerably.
+      string tmp;
+      slice.OnValueReencoded(dbid, it, it->first.GetSlice(&tmp), orig_heap_size);
+    }
+  };
+
+  // Finish the large values of the previous runs first, one step per run.
+  if (auto& pending_values = defrag_state_.pending_values; !pending_values.empty()) {
+    auto& pending = pending_values.back();
+    PrimeIterator it;
+    if (slice.IsDbValid(pending.dbid))
+      it = slice.GetTables(pending.dbid).first->Find(pending.key);
+    if (IsValid(it) && !slice.IsPinned(pending.dbid, it->first))
+      defrag_value(pending.dbid, it, &pending.cursor);
+    else
+      pending.cursor = 0;  // the key is gone
+    if (pending.cursor == 0)
+      pending_values.pop_back();
+
+    stats_.defrag_realloc_total += reallocations;
+    stats_.defrag_task_invocation_total++;
+    stats_.defrag_attempt_total += attempts;
+    return true;
+  }
+
   // If we moved to an invalid db, skip as long as it's not the last one
   while (!slice.IsDbValid(defrag_state_.dbid) && defrag_state_.dbid + 1 < slice.db_array_size())
     defrag_state_.dbid++;
@@ -409,22 +473,24 @@ bool EngineShard::DoDefrag(const float threshold) {
   DCHECK(slice.IsDbValid(defrag_state_.dbid));
   auto [prime_table, expire_table] = slice.GetTables(defrag_state_.dbid);
   PrimeTable::Cursor cur{defrag_state_.cursor};
-  uint64_t reallocations = 0;
   unsigned traverses_count = 0;
-  uint64_t attempts = 0;
 
   do {
     cur = prime_table->Traverse(cur, [&](PrimeIterator it) {
-      // for each value check whether we should move it because it
-      // seats on underutilized page of memory, and if so, do it.
-      bool did = it->second.DefragIfNeeded(threshold);
-      attempts++;
-      if (did) {
-        reallocations++;
+      if (slice.IsPinned(defrag_state_.dbid, it->first))
+        return;
+
+      uint64_t value_cursor = 0;
+      defrag_value(defrag_state_.dbid, it, &value_cursor);
+      if (value_cursor != 0) {
+        string tmp;
+        defrag_state_.pending_values.push_back(
+            {DbIndex(defrag_state_.dbid), string{it->first.GetSlice(&tmp)}, value_cursor});
       }
     });
     traverses_count++;
-  } while (traverses_count < kMaxTraverses && cur && namespaces);
+  } while (traverses_count < kMaxTraverses && cur && namespaces &&
+           defrag_state_.pending_values.empty());
 
   defrag_state_.UpdateScanState(cur.token());
 
@@ -463,6 +529,7 @@ uint32_t EngineShard::DefragTask() {
   if (defrag_state_.CheckRequired()) {
     VLOG(2) << shard_id_ << ": need to run defrag memory cursor state: " << defrag_state_.cursor;
     static const float threshold = GetFlag(FLAGS_mem_defrag_page_utilization_threshold);
+    LatencyScope latency("active-defrag-cycle");
     if (DoDefrag(threshold)) {
       // we didn't finish the scan
       return util::ProactorBase::kOnIdleMaxLevel;
@@ -479,6 +546,15 @@ EngineShard::EngineShard(util::ProactorBase* pb, mi_heap_t* heap)
       shard_id_(pb->GetPoolIndex()) {
   queue_.Start(absl::StrCat("shard_queue_", shard_id()));
   queue2_.Start(absl::StrCat("l2_queue_", shard_id()));
+
+  if (string hugepages = GetFlag(FLAGS_table_hugepages); !hugepages.empty()) {
+    HugePageResource::Mode mode;
+    CHECK(HugePageResource::ParseMode(hugepages, &mode))
+        << "Unknown table_hugepages value " << hugepages;
+    table_resource_ = make_unique<HugePageResource>(mode, &mi_resource_);
+    table_resource_->AddBlockSize(PrimeTable::kSegBytes);
+    table_resource_->AddBlockSize(ExpireTable::kSegBytes);
+  }
 }
 
 void EngineShard::Shutdown() {
@@ -611,6 +687,12 @@ void EngineShard::PollExecution(const char* context, Transaction* trans) {
   ShardId sid = shard_id();
   stats_.poll_execution_total++;
 
+  // A single hop transaction that was queued because its keys were contended can bypass a
+  // stalled queue head (i.e. a long multi-hop transaction) once those keys were released.
+  if (trans && trans->PromoteOutOfOrder(this)) {
+    stats_.tx_ooo_promoted_total++;
+  }
+
   // If any of the following flags are present, we are guaranteed to run in this function:
   // 1. AWAKED_Q -> Blocking transactions are executed immediately after waking up, they don't
   // occupy a place in txq and have highest priority
@@ -742,14 +824,60 @@ void EngineShard::RemoveContTx(Transaction* tx) {
   }
 }
 
+void EngineShard::DemoteColdHashes(DbSlice* db_slice) {
+  constexpr unsigned kBucketsPerHeartbeat = 16;
+
+  for (unsigned i = 0; i < kBucketsPerHeartbeat && db_slice->db_array_size() > 0; ++i) {
+    if (!db_slice->IsDbValid(hash_demotion_db_)) {
+      hash_demotion_db_ = (hash_demotion_db_ + 1) % db_slice->db_array_size();
+      hash_demotion_cursor_ = 0;
+      continue;
+    }
+
+    PrimeTable::Cursor cursor = HSetFamily::DemoteColdHashes(
+        hash_demotion_db_, PrimeTable::Cursor{hash_demotion_cursor_}, db_slice);
+    hash_demotion_cursor_ = cursor.token();
+    if (!cursor) {
+      hash_demotion_db_ = (hash_demotion_db_ + 1) % db_slice->db_array_size();
+    }
+  }
+}
+
+void EngineShard::CompressColdLists(DbSlice* db_slice) {
+  constexpr unsigned kBucketsPerHeartbeat = 16;
+  constexpr unsigned kNodesPerHeartbeat = 64;  // each visited node may get compressed.
+
+  unsigned budget = kNodesPerHeartbeat;
+  for (unsigned i = 0; i < kBucketsPerHeartbeat && budget > 0 && db_slice->db_array_size() > 0;
+       ++i) {
+    if (!db_slice->IsDbValid(cold_list_db_)) {
+      cold_list_db_ = (cold_list_db_ + 1) % db_slice->db_array_size();
+      cold_list_cursor_ = 0;
+      continue;
+    }
+
+    PrimeTable::Cursor cursor = ListFamily::CompressColdLists(
+        cold_list_db_, PrimeTable::Cursor{cold_list_cursor_}, db_slice, &budget);
+    cold_list_cursor_ = cursor.token();
+    if (!cursor) {
+      cold_list_db_ = (cold_list_db_ + 1) % db_slice->db_array_size();
+    }
+  }
+}
+
 void EngineShard::Heartbeat() {
   DVLOG(3) << " Hearbeat";
   DCHECK(namespaces);
+  LatencyScope latency("heartbeat");
 
   CacheStats();
 
   // TODO: iterate over all namespaces
   DbSlice& db_slice = namespaces->GetDefaultNamespace().GetDbSlice(shard_id());
+  if (IsClusterEnabled())
+    db_slice.UpdateSlotRates(fb2::ProactorBase::GetMonotonicTimeNs() / 1000000);
+  db_slice.DecayHotKeys(fb2::ProactorBase::GetMonotonicTimeNs() / 1000000);
+
   // Skip heartbeat if we are serializing a big value
   static auto start = std::chrono::system_clock::now();
   // Skip heartbeat if global transaction is in process.
@@ -771,6 +899,26 @@ void EngineShard::Heartbeat() {
     RetireExpiredAndEvict();
   }
 
+  // Prepare directory doubling of the tables in the background, so that the insert that
+  // triggers it does not have to copy the whole directory.
+  if (uint32_t growth_step = GetFlag(FLAGS_table_growth_step); growth_step > 0) {
+    for (unsigned i = 0; i < db_slice.db_array_size(); ++i) {
+      if (!db_slice.IsDbValid(i))
+        continue;
+      auto [pt, expt] = db_slice.GetTables(i);
+      pt->PrepareGrowth(growth_step);
+      expt->PrepareGrowth(growth_step);
+    }
+  }
+
+  if (db_slice.hash_write_sketch()) {
+    DemoteColdHashes(&db_slice);
+  }
+
+  if (GetFlag(FLAGS_list_compress_in_background)) {
+    CompressColdLists(&db_slice);
+  }
+
   // Offset CoolMemoryUsage when consider background offloading.
   // TODO: Another approach could be is to align the approach  similarly to how we do with
   // FreeMemWithEvictionStep, i.e. if memory_budget is below the limit.
@@ -799,34 +947,36 @@ void EngineShard::RetireExpiredAndEvict() {
 
   // TODO: iterate over all namespaces
   DbSlice& db_slice = namespaces->GetDefaultNamespace().GetDbSlice(shard_id());
-  constexpr double kTtlDeleteLimit = 200;
-
-  uint32_t traversed = GetMovingSum6(TTL_TRAVERSE);
-  uint32_t deleted = GetMovingSum6(TTL_DELETE);
-  unsigned ttl_delete_target = 5;
-
-  if (deleted > 10) {
-    // deleted should be <= traversed.
-    // hence we map our delete/traversed ratio into a range [0, kTtlDeleteLimit).
-    // The higher ttl_delete_target the more likely we have lots of expired items that need
-    // to be deleted.
-    ttl_delete_target = kTtlDeleteLimit * double(deleted) / (double(traversed) + 10);
-  }
 
   DbContext db_cntx;
   db_cntx.time_now_ms = GetCurrentTimeMs();
 
   size_t eviction_goal = GetFlag(FLAGS_enable_heartbeat_eviction) ? CalculateEvictionBytes() : 0;
 
+  bool run_expiry = ++expire_schedule_.ticks >= expire_schedule_.period;
+  uint64_t expire_deadline_ns = 0;
+  uint32_t step_traversed = 0, step_deleted = 0;
+  bool throttled = false;
+
+  if (run_expiry) {
+    expire_schedule_.ticks = 0;
+    expire_deadline_ns = fb2::ProactorBase::GetMonotonicTimeNs() +
+                         uint64_t(GetFlag(FLAGS_active_expire_cpu_usec)) * 1000;
+  }
+
   for (unsigned i = 0; i < db_slice.db_array_size(); ++i) {
     if (!db_slice.IsDbValid(i))
       continue;
 
     db_cntx.db_index = i;
     auto [pt, expt] = db_slice.GetTables(i);
-    if (!expt->Empty()) {
-      DbSlice::DeleteExpiredStats stats = db_slice.DeleteExpiredStep(db_cntx, ttl_delete_target);
+    if (run_expiry && !expt->Empty()) {
+      DbSlice::DeleteExpiredStats stats =
+          db_slice.DeleteExpiredStep(db_cntx, expire_schedule_.budget, expire_deadline_ns);
 
+      step_traversed += stats.traversed;
+      step_deleted += stats.deleted;
+      throttled |= stats.throttled;
       eviction_goal -= std::min(eviction_goal, size_t(stats.deleted_bytes));
       counter_[TTL_TRAVERSE].IncBy(stats.traversed);
       counter_[TTL_DELETE].IncBy(stats.deleted);
@@ -838,6 +988,12 @@ void EngineShard::RetireExpiredAndEvict() {
               << stats_.total_heartbeat_expired_calls;
     }
 
+    if (eviction_goal && db_slice.IsCacheMode() && !pt->Empty()) {
+      auto [evicted_items, evicted_bytes] = db_slice.EvictFromPool(
+          i, eviction_goal, GetFlag(FLAGS_max_eviction_per_heartbeat));
+      eviction_goal -= std::min(eviction_goal, evicted_bytes);
+    }
+
     if (eviction_goal) {
       uint32_t starting_segment_id = rand() % pt->GetSegmentCount();
       auto [evicted_items, evicted_bytes] =
@@ -850,7 +1006,37 @@ void EngineShard::RetireExpiredAndEvict() {
 
       eviction_goal -= std::min(eviction_goal, evicted_bytes);
     }
+
+    if (db_slice.IsCacheMode())
+      db_slice.RefillEvictionPool(i);
+
+    db_slice.ReapExpiredFields(db_cntx, kFieldReapBuckets);
   }
+
+  if (run_expiry) {
+    expire_schedule_.Update(step_traversed, step_deleted, throttled);
+    stats_.active_expire_budget = expire_schedule_.budget;
+    stats_.active_expire_throttled_total += throttled;
+  }
+}
+
+void EngineShard::ExpireSchedule::Update(uint32_t traversed, uint32_t deleted, bool throttled) {
+  // deleted <= traversed. A quarter of expired entries means there is plenty to reclaim,
+  // while less than 1/20 means that we mostly scan live entries.
+  if (deleted * 4 >= traversed && deleted > 0) {
+    period = 1;
+    if (!throttled)
+      budget = std::min(budget * 2, kMaxBudget);
+  } else if (deleted * 20 < traversed || traversed == 0) {
+    if (budget > kMinBudget)
+      budget = std::max(budget / 2, kMinBudget);
+    else
+      period = std::min(period * 2, kMaxPeriod);
+  }
+
+  // Running out of cpu time means we can not sustain the current budget.
+  if (throttled)
+    budget = std::max(budget / 2, kMinBudget);
 }
 
 void EngineShard::CacheStats() {
@@ -882,8 +1068,9 @@ void EngineShard::CacheStats() {
 }
 
 size_t EngineShard::UsedMemory() const {
-  return mi_resource_.used() + zmalloc_used_memory_tl + SmallString::UsedThreadLocal() +
-         search_indices()->GetUsedMemory();
+  size_t table_hugepage_bytes = table_resource_ ? table_resource_->used() : 0;
+  return mi_resource_.used() + table_hugepage_bytes + zmalloc_used_memory_tl +
+         SmallString::UsedThreadLocal() + search_indices()->GetUsedMemory();
 }
 
 bool EngineShard::ShouldThrottleForTiering() const {  // see header for formula justification
@@ -965,15 +1152,15 @@ EngineShard::TxQueueInfo EngineShard::AnalyzeTxQueue() const {
       continue;
 
     info.total_locks += table->trans_locks.Size();
-    for (const auto& [key, lock] : table->trans_locks) {
+    table->trans_locks.ForEach([&info](LockFp fp, const IntentLock& lock) {
       if (lock.IsContended()) {
         info.contended_locks++;
         if (lock.ContentionScore() > info.max_contention_score) {
           info.max_contention_score = lock.ContentionScore();
-          info.max_contention_lock = key;
+          info.max_contention_lock = fp;
         }
       }
-    }
+    });
   }
 
   return info;
@@ -5,6 +5,7 @@
 #pragma once
 
 #include "core/intent_lock.h"
+#include "core/huge_page_resource.h"
 #include "core/mi_memory_resource.h"
 #include "core/task_queue.h"
 #include "core/tx_queue.h"
@@ -36,8 +37,17 @@ class EngineShard {
 
     // number of optimistic executions - that were run as part of the scheduling.
     uint64_t tx_optimistic_total = 0;
+
+    // number of reads that ran during scheduling despite contended key locks and the number of
+    // those that had to be retried via the queue because a write ran concurrently.
+    uint64_t tx_optimistic_read_total = 0;
+    uint64_t tx_optimistic_read_retries = 0;
     uint64_t tx_ooo_total = 0;
 
+    // number of queued transactions that became out of order after the locks they waited for
+    // were released, bypassing a stalled queue head.
+    uint64_t tx_ooo_promoted_total = 0;
+
     // Number of ScheduleBatchInShard calls.
     uint64_t tx_batch_schedule_calls_total = 0;
 
@@ -48,6 +58,13 @@ class EngineShard {
     uint64_t total_heartbeat_expired_bytes = 0;
     uint64_t total_heartbeat_expired_calls = 0;
 
+    // Current number of expire table buckets that active expiry traverses per heartbeat.
+    // Aggregated over shards with max.
+    uint64_t active_expire_budget = 0;
+
+    // Number of heartbeats in which active expiry was cut short by its cpu budget.
+    uint64_t active_expire_throttled_total = 0;
+
     // cluster stats
     uint64_t total_migrated_keys = 0;
 
@@ -79,6 +96,18 @@ class EngineShard {
     return &mi_resource_;
   }
 
+  // Memory resource for the prime and expire tables. Backed by huge pages if enabled.
+  PMR_NS::memory_resource* table_memory_resource() {
+    if (table_resource_)
+      return table_resource_.get();
+    return &mi_resource_;
+  }
+
+  // Returns nullptr if huge page backed tables are disabled.
+  const HugePageResource* huge_page_resource() const {
+    return table_resource_.get();
+  }
+
   TaskQueue* GetFiberQueue() {
     return &queue_;
   }
@@ -110,6 +139,43 @@ class EngineShard {
     return &shard_lock_;
   }
 
+  // Number of transactions holding exclusive key locks on this shard that started running and
+  // thus may have modified data. Optimistic reads bypass contended locks only when it's zero.
+  unsigned dirty_lock_holders() const {
+    return dirty_lock_holders_;
+  }
+
+  // Number of multi shard (or multi) transactions holding exclusive key locks on this shard.
+  // Such a transaction may have already written on other shards, so reading its keys here before
+  // it runs would expose a partially applied transaction. Optimistic reads require it to be zero.
+  unsigned multi_shard_lock_holders() const {
+    return multi_shard_lock_holders_;
+  }
+
+  void OnMultiShardLocksAcquired() {
+    ++multi_shard_lock_holders_;
+  }
+
+  void OnMultiShardLocksReleased() {
+    DCHECK_GT(multi_shard_lock_holders_, 0u);
+    --multi_shard_lock_holders_;
+  }
+
+  // Bumped every time a write callback starts running on this shard.
+  uint64_t write_epoch() const {
+    return write_epoch_;
+  }
+
+  void OnWriteStarted(bool first_hop) {
+    ++write_epoch_;
+    dirty_lock_holders_ += first_hop;
+  }
+
+  void OnDirtyLocksReleased() {
+    DCHECK_GT(dirty_lock_holders_, 0u);
+    --dirty_lock_holders_;
+  }
+
   // Remove current continuation trans if its equal to tx.
   void RemoveContTx(Transaction* tx);
 
@@ -213,6 +279,15 @@ class EngineShard {
     uint64_t cursor = 0u;
     time_t last_check_time = 0;
 
+    // Large containers are defragmented in steps. The ones that did not finish are resumed by
+    // the next runs before the scan continues.
+    struct PendingValue {
+      DbIndex dbid;
+      std::string key;
+      uint64_t cursor;
+    };
+    std::vector<PendingValue> pending_values;
+
     // check the current threshold and return true if
     // we need to do the defragmentation
     bool CheckRequired();
@@ -233,6 +308,12 @@ class EngineShard {
   void Heartbeat();
   void RetireExpiredAndEvict();
 
+  // Converts cold hash tables back to listpacks, a few buckets per heartbeat.
+  void DemoteColdHashes(DbSlice* db_slice);
+
+  // Compresses untouched nodes of lazily compressed lists, a few buckets per heartbeat.
+  void CompressColdLists(DbSlice* db_slice);
+
   void CacheStats();
 
   // We are running a task that checks whether we need to
@@ -246,10 +327,26 @@ class EngineShard {
   // --------------------------------------------------------------------------
   uint32_t DefragTask();
 
+  // Scales the active expiry scan with the density of expired keys found by previous runs.
+  // Dense runs double the budget, sparse runs halve it and then spread the runs over more
+  // heartbeats.
+  struct ExpireSchedule {
+    static constexpr uint32_t kMinBudget = 5;
+    static constexpr uint32_t kMaxBudget = 2048;
+    static constexpr uint32_t kMaxPeriod = 16;
+
+    uint32_t budget = kMinBudget;  // expire table buckets to traverse per heartbeat.
+    uint32_t period = 1;           // run active expiry every `period` heartbeats.
+    uint32_t ticks = 0;
+
+    void Update(uint32_t traversed, uint32_t deleted, bool throttled);
+  };
+
   TaskQueue queue_, queue2_;
 
   TxQueue txq_;
   MiMemoryResource mi_resource_;
+  std::unique_ptr<HugePageResource> table_resource_;
   ShardId shard_id_;
 
   Stats stats_;
@@ -267,6 +364,9 @@ class EngineShard {
   unsigned poll_concurrent_factor_ = 0;
   journal::Journal* journal_ = nullptr;
   IntentLock shard_lock_;
+  unsigned dirty_lock_holders_ = 0;
+  unsigned multi_shard_lock_holders_ = 0;
+  uint64_t write_epoch_ = 0;
 
   uint32_t defrag_task_ = 0;
   util::fb2::Fiber fiber_heartbeat_periodic_;
@@ -276,6 +376,16 @@ class EngineShard {
   util::fb2::Done fiber_shard_handler_periodic_done_;
 
   DefragTaskState defrag_state_;
+  ExpireSchedule expire_schedule_;
+
+  // Position of DemoteColdHashes.
+  DbIndex hash_demotion_db_ = 0;
+  uint64_t hash_demotion_cursor_ = 0;
+
+  // Position of CompressColdLists.
+  DbIndex cold_list_db_ = 0;
+  uint64_t cold_list_cursor_ = 0;
+
   std::unique_ptr<TieredStorage> tiered_storage_;
   // TODO: Move indices to Namespace
   std::unique_ptr<ShardDocIndices> shard_search_indices_;
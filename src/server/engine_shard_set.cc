@@ -8,6 +8,7 @@
 
 #include <filesystem>
 
+#include "absl/strings/str_split.h"
 #include "base/flags.h"
 #include "base/logging.h"
 #include "server/namespaces.h"
@@ -20,6 +21,10 @@ ABSL_FLAG(bool, cache_mode, false,
           "If true, the backend behaves like a cache, "
           "by evicting entries when getting close to maxmemory limit");
 
+ABSL_FLAG(uint64_t, reserve_keys, 0,
+          "Number of keys to pre-size the tables of db 0 for, spread evenly over the shards. "
+          "Applied at startup and whenever it is set with CONFIG SET");
+
 ABSL_FLAG(facade::MemoryBytesFlag, tiered_max_file_size, facade::MemoryBytesFlag{},
           "Limit on maximum file size that is used by the database for tiered storage. "
           "0 - means the program will automatically determine its maximum file size. "
@@ -37,8 +42,8 @@ using strings::HumanReadableNumBytes;
 
 namespace {
 
-uint64_t GetFsLimit() {
-  std::filesystem::path file_path(GetFlag(FLAGS_tiered_prefix));
+uint64_t GetFsLimit(std::string_view file_prefix) {
+  std::filesystem::path file_path(file_prefix);
   std::string dir_name_str = file_path.parent_path().string();
 
   if (dir_name_str.empty())
@@ -53,6 +58,21 @@ uint64_t GetFsLimit() {
   return 0;
 }
 
+// Shards are assigned to the prefixes round robin, so each file system holds up to ceil(T/P) shard
+// files and the smallest one bounds the file size of every shard.
+uint64_t GetShardFsLimit(size_t threads) {
+  std::string tiered_prefix = GetFlag(FLAGS_tiered_prefix);
+  std::vector<std::string_view> prefixes = absl::StrSplit(tiered_prefix, ',', absl::SkipEmpty());
+  if (prefixes.empty() || threads == 0)
+    return 0;
+
+  uint64_t min_limit = std::numeric_limits<uint64_t>::max();
+  for (std::string_view prefix : prefixes)
+    min_limit = std::min(min_limit, GetFsLimit(prefix));
+  size_t shards_per_fs = (threads + prefixes.size() - 1) / prefixes.size();
+  return min_limit / shards_per_fs;
+}
+
 size_t GetTieredFileLimit(size_t threads) {
   string file_prefix = GetFlag(FLAGS_tiered_prefix);
   if (file_prefix.empty())
@@ -61,19 +81,20 @@ size_t GetTieredFileLimit(size_t threads) {
   size_t max_shard_file_size = 0;
 
   size_t max_file_size = absl::GetFlag(FLAGS_tiered_max_file_size).value;
-  size_t max_file_size_limit = GetFsLimit();
+  size_t shard_fs_limit = GetShardFsLimit(threads);
   if (max_file_size == 0) {
     LOG(INFO) << "max_file_size has not been specified. Deciding myself....";
-    max_file_size = (max_file_size_limit * 0.8);
+    max_shard_file_size = (shard_fs_limit * 0.8);
+    max_file_size = max_shard_file_size * threads;
   } else {
-    if (max_file_size_limit < max_file_size) {
+    max_shard_file_size = max_file_size / threads;
+    if (shard_fs_limit < max_shard_file_size) {
       LOG(WARNING) << "Got max file size " << HumanReadableNumBytes(max_file_size)
-                   << ", however only " << HumanReadableNumBytes(max_file_size_limit)
-                   << " disk space was found.";
+                   << ", however only " << HumanReadableNumBytes(shard_fs_limit)
+                   << " disk space per shard was found.";
     }
   }
 
-  max_shard_file_size = max_file_size / threads;
   if (max_shard_file_size < 256_MB) {
     LOG(ERROR) << "Max tiering file size is too small. Setting: "
                << HumanReadableNumBytes(max_file_size) << " Required at least "
@@ -117,6 +138,7 @@ void EngineShardSet::Init(uint32_t sz, std::function<void()> shard_handler) {
 
   // The order is important here. We must initialize namespaces after shards_.
   namespaces = new Namespaces();
+  ReserveKeys(0, GetFlag(FLAGS_reserve_keys));
 
   pp_->AwaitFiberOnAll([&](uint32_t index, ProactorBase* pb) {
     if (index < size_) {
@@ -158,6 +180,18 @@ void EngineShardSet::InitThreadLocal(ProactorBase* pb) {
   shards_[es->shard_id()] = es;
 }
 
+void EngineShardSet::ReserveKeys(DbIndex db_ind, size_t keys) {
+  if (keys == 0)
+    return;
+
+  size_t per_shard = keys / size_ + 1;
+  RunBriefInParallel([&](EngineShard* shard) {
+    DbSlice& db_slice = namespaces->GetDefaultNamespace().GetDbSlice(shard->shard_id());
+    size_t existing = db_slice.IsDbValid(db_ind) ? db_slice.DbSize(db_ind) : 0;
+    db_slice.Reserve(db_ind, existing + per_shard);
+  });
+}
+
 void EngineShardSet::TEST_EnableCacheMode() {
   RunBlockingInParallel([](EngineShard* shard) {
     namespaces->GetDefaultNamespace().GetCurrentDbSlice().TEST_EnableCacheMode();
@@ -109,6 +109,10 @@ class EngineShardSet {
     bc->Wait();
   }
 
+  // Pre-sizes the prime tables of the db in the default namespace for `keys` more keys,
+  // spread evenly over the shards.
+  void ReserveKeys(DbIndex db_ind, size_t keys);
+
   // Used in tests
   void TEST_EnableCacheMode();
 
@@ -12,6 +12,7 @@
 #include "facade/facade_types.h"
 #include "server/engine_shard.h"
 #include "server/search/doc_index.h"
+#include "server/server_state.h"
 #include "server/table.h"
 
 extern "C" {
@@ -29,6 +30,13 @@ std::vector<long> ExpireElements(DenseSet* owner, facade::CmdArgList values, uin
 // Copy str to thread local sds instance. Valid until next WrapSds call on thread
 sds WrapSds(std::string_view str);
 
+// Temporary data of a hop, allocated from the scratch arena of the thread.
+template <typename T> using ScratchVector = std::vector<T, PMR_NS::polymorphic_allocator<T>>;
+
+template <typename T> ScratchVector<T> MakeScratchVector(size_t size) {
+  return ScratchVector<T>(size, ServerState::tlocal()->scratch_resource());
+}
+
 using RandomPick = uint32_t;
 
 class PicksGenerator {
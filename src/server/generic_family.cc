@@ -18,6 +18,7 @@ extern "C" {
 #include "base/flags.h"
 #include "base/logging.h"
 #include "core/qlist.h"
+#include "core/string_map.h"
 #include "redis/rdb.h"
 #include "server/acl/acl_commands_def.h"
 #include "server/blocking_controller.h"
@@ -84,33 +85,6 @@ std::optional<RdbVersion> GetRdbVersion(std::string_view msg) {
   return version;
 }
 
-class InMemSource : public ::io::Source {
- public:
-  InMemSource(std::string_view buf) : buf_(buf) {
-  }
-
-  ::io::Result<size_t> ReadSome(const iovec* v, uint32_t len) final;
-
- protected:
-  std::string_view buf_;
-  off_t offs_ = 0;
-};
-
-::io::Result<size_t> InMemSource::ReadSome(const iovec* v, uint32_t len) {
-  ssize_t read_total = 0;
-  while (size_t(offs_) < buf_.size() && len > 0) {
-    size_t read_sz = min<size_t>(buf_.size() - offs_, v->iov_len);
-    memcpy(v->iov_base, buf_.data() + offs_, read_sz);
-    read_total += read_sz;
-    offs_ += read_sz;
-
-    ++v;
-    --len;
-  }
-
-  return read_total;
-}
-
 class RestoreArgs {
  private:
   static constexpr int64_t NO_EXPIRATION = 0;
@@ -157,73 +131,25 @@ class RestoreArgs {
   static OpResult<RestoreArgs> TryFrom(const CmdArgList& args);
 };
 
-class RdbRestoreValue : protected RdbLoaderBase {
+class RdbRestoreValue {
  public:
-  RdbRestoreValue(RdbVersion rdb_version) {
-    rdb_version_ = rdb_version;
+  RdbRestoreValue(RdbVersion rdb_version) : loader_(rdb_version) {
   }
 
   OpResult<DbSlice::ItAndUpdater> Add(string_view key, string_view payload, const DbContext& cntx,
                                       const RestoreArgs& args, DbSlice* db_slice);
 
  private:
-  std::optional<OpaqueObj> Parse(io::Source* source);
-  int rdb_type_ = -1;
+  RdbValueLoader loader_;
 };
 
-std::optional<RdbLoaderBase::OpaqueObj> RdbRestoreValue::Parse(io::Source* source) {
-  src_ = source;
-  if (pending_read_.remaining == 0) {
-    io::Result<uint8_t> type_id = FetchType();
-    if (type_id && rdbIsObjectTypeDF(type_id.value())) {
-      rdb_type_ = *type_id;
-    }
-  }
-
-  if (rdb_type_ == -1) {
-    LOG(ERROR) << "failed to load type id from the input stream or type id is invalid";
-    return std::nullopt;
-  }
-
-  OpaqueObj obj;
-  error_code ec = ReadObj(rdb_type_, &obj);  // load the type from the input stream
-  if (ec) {
-    LOG(ERROR) << "failed to load data for type id " << rdb_type_;
-    return std::nullopt;
-  }
-
-  return std::optional<OpaqueObj>(std::move(obj));
-}
-
 OpResult<DbSlice::ItAndUpdater> RdbRestoreValue::Add(string_view key, string_view data,
                                                      const DbContext& cntx, const RestoreArgs& args,
                                                      DbSlice* db_slice) {
-  InMemSource data_src(data);
   PrimeValue pv;
-  bool first_parse = true;
-  do {
-    auto opaque_res = Parse(&data_src);
-    if (!opaque_res) {
-      return OpStatus::INVALID_VALUE;
-    }
-
-    LoadConfig config;
-    if (first_parse) {
-      first_parse = false;
-    } else {
-      config.append = true;
-    }
-    if (pending_read_.remaining > 0) {
-      config.streamed = true;
-    }
-    config.reserve = pending_read_.reserve;
-
-    if (auto ec = FromOpaque(*opaque_res, config, &pv); ec) {
-      // we failed - report and exit
-      LOG(WARNING) << "error while trying to read data: " << ec;
-      return OpStatus::INVALID_VALUE;
-    }
-  } while (pending_read_.remaining > 0);
+  if (auto ec = loader_.Load(data, &pv); ec) {
+    return OpStatus::INVALID_VALUE;
+  }
 
   auto res = db_slice->AddOrUpdate(cntx, key, std::move(pv), args.ExpirationTime());
   if (res) {
@@ -331,6 +257,7 @@ class Renamer {
     std::optional<RdbVersion> version;
     int64_t expire_ts;
     bool sticky;
+    bool raw_string = false;  // value holds the bytes of a string instead of a DUMP payload
   };
 
  private:
@@ -356,7 +283,7 @@ ErrorReply Renamer::Rename(bool destination_should_not_exist) {
     return OpStatus::KEY_NOTFOUND;
   }
 
-  if (!serialized_value_.version) {
+  if (!serialized_value_.raw_string && !serialized_value_.version) {
     transaction_->Conclude();
     return ErrorReply{kInvalidDumpValueErr};
   }
@@ -429,14 +356,30 @@ void Renamer::SerializeSrc(Transaction* t, EngineShard* shard) {
     return;
   }
 
+  const PrimeValue& pv = it->second;
+  bool sticky = it->first.IsSticky();
+
+  // Strings are transferred as they are, skipping the RDB encoding, compression and checksum of
+  // DUMP and the parsing on the destination. Sticky keys are rare and keep the RESTORE path, so
+  // that the destination is journaled by a single command.
+  if (pv.ObjType() == OBJ_STRING && !sticky) {
+    string value;
+    if (pv.IsExternal() && !pv.IsCool()) {
+      value = shard->tiered_storage()->Read(t->GetDbIndex(), src_key_, pv).Get();
+    } else {
+      pv.GetString(&value);
+    }
+    serialized_value_ = {std::move(value), std::nullopt, db_slice.ExpireTime(exp_it), false, true};
+    return;
+  }
+
   DVLOG(1) << "Rename: key '" << src_key_ << "' successfully found, going to dump it";
 
   io::StringSink sink;
-  SerializerBase::DumpObject(it->second, &sink);
+  SerializerBase::DumpObject(pv, &sink);
 
   auto rdb_version = GetRdbVersion(sink.str());
-  serialized_value_ = {std::move(sink).str(), rdb_version, db_slice.ExpireTime(exp_it),
-                       it->first.IsSticky()};
+  serialized_value_ = {std::move(sink).str(), rdb_version, db_slice.ExpireTime(exp_it), sticky};
 }
 
 OpStatus Renamer::DelSrc(Transaction* t, EngineShard* shard) {
@@ -486,9 +429,19 @@ OpStatus Renamer::DeserializeDest(Transaction* t, EngineShard* shard) {
 
   restore_args.SetSticky(serialized_value_.sticky);
 
-  RdbRestoreValue loader(serialized_value_.version.value());
-  auto add_res =
-      loader.Add(dest_key_, serialized_value_.value, op_args.db_cntx, restore_args, &db_slice);
+  OpResult<DbSlice::ItAndUpdater> add_res;
+  if (serialized_value_.raw_string) {
+    PrimeValue pv;
+    pv.SetString(serialized_value_.value);
+    add_res = db_slice.AddOrUpdate(op_args.db_cntx, dest_key_, std::move(pv),
+                                   restore_args.ExpirationTime());
+    if (add_res)
+      AddKeyToIndexesIfNeeded(dest_key_, op_args.db_cntx, add_res->it->second, shard);
+  } else {
+    RdbRestoreValue loader(serialized_value_.version.value());
+    add_res =
+        loader.Add(dest_key_, serialized_value_.value, op_args.db_cntx, restore_args, &db_slice);
+  }
 
   if (!add_res)
     return add_res.status();
@@ -500,7 +453,14 @@ OpStatus Renamer::DeserializeDest(Transaction* t, EngineShard* shard) {
     bc->AwakeWatched(t->GetDbIndex(), dest_key_);
   }
 
-  if (shard->journal()) {
+  if (shard->journal() && serialized_value_.raw_string) {
+    auto expire_str = absl::StrCat(restore_args.ExpirationTime());
+    absl::InlinedVector<std::string_view, 4> args({dest_key_, serialized_value_.value});
+    if (restore_args.HasExpiration()) {
+      args.insert(args.end(), {"PXAT"sv, expire_str});
+    }
+    RecordJournal(op_args, "SET"sv, args, 2);
+  } else if (shard->journal()) {
     auto expire_str = absl::StrCat(serialized_value_.expire_ts);
 
     absl::InlinedVector<std::string_view, 6> args(
@@ -600,9 +560,21 @@ OpStatus OpRestore(const OpArgs& op_args, std::string_view key, std::string_view
   return add_res.status();
 }
 
-bool ScanCb(const OpArgs& op_args, PrimeIterator prime_it, const ScanOpts& opts, StringVec* res) {
-  auto& db_slice = op_args.GetDbSlice();
+bool ScanCb(const OpArgs& op_args, PrimeIterator prime_it, const ScanOpts& opts, string* scratch,
+            StringVec* res) {
+  // Filter by the bucket entry first, so that keys that do not match are not looked up in
+  // the expire table.
+  if (opts.type_filter && prime_it->second.ObjType() != opts.type_filter)
+    return false;
+
+  if (opts.bucket_id != UINT_MAX && opts.bucket_id != prime_it.bucket_id())
+    return false;
+
+  string_view key = prime_it->first.GetSlice(scratch);
+  if (!opts.Matches(key))
+    return false;
 
+  auto& db_slice = op_args.GetDbSlice();
   DbSlice::Iterator it = DbSlice::Iterator::FromPrime(prime_it);
   if (prime_it->second.HasExpire()) {
     it = db_slice.ExpireIfNeeded(op_args.db_cntx, it).it;
@@ -610,7 +582,7 @@ bool ScanCb(const OpArgs& op_args, PrimeIterator prime_it, const ScanOpts& opts,
       return false;
   }
 
-  bool matches = !opts.type_filter || it->second.ObjType() == opts.type_filter;
+  bool matches = true;
   if (opts.mask.has_value()) {
     if (opts.mask == ScanOpts::Mask::Volatile) {
       matches &= it->second.HasExpire();
@@ -629,14 +601,7 @@ bool ScanCb(const OpArgs& op_args, PrimeIterator prime_it, const ScanOpts& opts,
     return false;
   }
 
-  if (opts.bucket_id != UINT_MAX && opts.bucket_id != it.GetInnerIt().bucket_id()) {
-    return false;
-  }
-
-  if (!opts.Matches(it.key())) {
-    return false;
-  }
-  res->emplace_back(it.key());
+  res->emplace_back(key);
 
   return true;
 }
@@ -665,9 +630,10 @@ void OpScan(const OpArgs& op_args, const ScanOpts& scan_opts, uint64_t* cursor,
   // Approximately 15 microseconds.
   const uint64_t timeout_cycles = base::CycleClock::Frequency() >> 16;
 
+  string scratch;
   do {
     cur = prime_table->Traverse(
-        cur, [&](PrimeIterator it) { cnt += ScanCb(op_args, it, scan_opts, vec); });
+        cur, [&](PrimeIterator it) { cnt += ScanCb(op_args, it, scan_opts, &scratch, vec); });
   } while (cur && cnt < scan_opts.limit &&
            (base::CycleClock::Now() - start_cycles) < timeout_cycles);
 
@@ -681,7 +647,6 @@ uint64_t ScanGeneric(uint64_t cursor, const ScanOpts& scan_opts, StringVec* keys
 
   EngineShardSet* ess = shard_set;
   unsigned shard_count = ess->size();
-  constexpr uint64_t kMaxScanTimeMs = 25;
 
   // Dash table returns a cursor with its right byte empty. We will use it
   // for encoding shard index. For now scan has a limitation of 255 shards.
@@ -714,9 +679,9 @@ uint64_t ScanGeneric(uint64_t cursor, const ScanOpts& scan_opts, StringVec* keys
         break;
     }
 
-    // Break after kMaxScanTimeMs.
+    // Break after the time budget.
     uint64_t time_now_ms = GetCurrentTimeMs();
-    if (time_now_ms > db_cntx.time_now_ms + kMaxScanTimeMs) {
+    if (time_now_ms > db_cntx.time_now_ms + scan_opts.budget_ms) {
       break;
     }
   } while (keys->size() < scan_opts.limit);
@@ -767,7 +732,7 @@ OpResult<vector<long>> OpFieldExpire(const OpArgs& op_args, string_view key, uin
 
   PrimeValue* pv = &it->second;
   if (pv->ObjType() == OBJ_SET) {
-    return SetFamily::SetFieldsExpireTime(op_args, ttl_sec, values, pv);
+    return SetFamily::SetFieldsExpireTime(op_args, ttl_sec, key, values, pv);
   } else {
     return HSetFamily::SetFieldsExpireTime(op_args, ttl_sec, key, values, pv);
   }
@@ -1230,9 +1195,7 @@ void GenericFamily::Keys(CmdArgList args, const CommandContext& cmd_cntx) {
   StringVec keys;
 
   ScanOpts scan_opts;
-  if (pattern != "*") {
-    scan_opts.matcher.reset(new GlobMatcher{pattern, true});
-  }
+  scan_opts.SetPattern(pattern);
 
   scan_opts.limit = 512;
   auto output_limit = absl::GetFlag(FLAGS_keys_output_limit);
@@ -1384,12 +1347,30 @@ struct SortEntry
   }
 };
 
+// Used when sorting by string weights of other keys, missing weights sort first
+struct SortEntryByAlpha {
+  std::string key;
+  std::optional<std::string> weight;
+
+  static bool less(const SortEntryByAlpha& l, const SortEntryByAlpha& r) {
+    if (l.weight != r.weight)
+      return l.weight < r.weight;
+    return l.key < r.key;
+  }
+
+  static bool greater(const SortEntryByAlpha& l, const SortEntryByAlpha& r) {
+    return less(r, l);
+  }
+};
+
 // std::variant of all possible vectors of SortEntries
 using SortEntryList = std::variant<
     // Used when sorting by double values
     std::vector<SortEntry<false>>,
     // Used when sorting by string values
-    std::vector<SortEntry<true>>>;
+    std::vector<SortEntry<true>>,
+    // Used when sorting by string values of other keys
+    std::vector<SortEntryByAlpha>>;
 
 // Create SortEntryList based on runtime arguments
 SortEntryList MakeSortEntryList(bool alpha) {
@@ -1449,15 +1430,186 @@ OpResultTyped<SortEntryList> OpFetchSortEntries(const OpArgs& op_args, std::stri
   return success ? res : OpStatus::INVALID_NUMERIC_RESULT;
 }
 
-template <typename IteratorBegin, typename IteratorEnd>
-OpResult<uint32_t> OpStore(const OpArgs& op_args, std::string_view key, IteratorBegin&& start_it,
-                           IteratorEnd&& end_it) {
+// Pattern of the SORT BY and GET options, like weight_* or object_*->field. The first * is
+// replaced by the element and the optional ->field selects a field of the hash stored there.
+struct SortPattern {
+  std::string_view prefix, suffix, field;
+  bool is_self = false;  // "#" refers to the element itself
+  bool has_key = false;  // patterns without * refer to no key
+
+  explicit SortPattern(std::string_view pattern);
+};
+
+SortPattern::SortPattern(std::string_view pattern) {
+  if (pattern == "#") {
+    is_self = true;
+    return;
+  }
+
+  size_t star = pattern.find('*');
+  if (star == std::string_view::npos)
+    return;
+
+  has_key = true;
+  prefix = pattern.substr(0, star);
+  suffix = pattern.substr(star + 1);
+  if (size_t arrow = suffix.find("->"); arrow != std::string_view::npos && arrow + 2 < suffix.size()) {
+    field = suffix.substr(arrow + 2);
+    suffix = suffix.substr(0, arrow);
+  }
+}
+
+// Key referenced by a SORT pattern for an element and its value.
+struct SortLookup {
+  std::string key;
+  std::string_view field;            // hash field, if the pattern has one
+  std::optional<std::string> value;  // unset if the key or the field is missing
+  std::optional<int64_t> int_value;  // set instead of value for integer strings, if requested
+
+  SortLookup(const SortPattern& pattern, std::string_view elem)
+      : key(absl::StrCat(pattern.prefix, elem, pattern.suffix)), field(pattern.field) {
+  }
+};
+
+std::optional<std::string> GetHashField(const PrimeValue& pv, std::string_view field,
+                                        const DbContext& db_cntx) {
+  if (pv.Encoding() == kEncodingListPack) {
+    uint8_t intbuf[LP_INTBUF_SIZE];
+    auto res = container_utils::LpFind((uint8_t*)pv.RObjPtr(), field, intbuf);
+    if (!res)
+      return std::nullopt;
+    return std::string{*res};
+  }
+
+  StringMap* sm = container_utils::GetStringMap(pv, db_cntx);
+  auto it = sm->Find(field);
+  if (it == sm->end())
+    return std::nullopt;
+  return std::string(it->second, sdslen(it->second));
+}
+
+// Resolves the values of the keys referenced by SORT patterns. The referenced keys are not
+// known when the command is scheduled, so they are read outside of its locks, with a single
+// batched lookup on every shard that owns any of them. Keys of other types count as missing.
+void FetchSortLookups(const Transaction& tx, bool want_int, std::vector<SortLookup>* lookups) {
+  if (lookups->empty())
+    return;
+
+  unsigned shard_num = shard_set->size();
+  std::vector<std::vector<size_t>> by_shard(shard_num);
+  for (size_t i = 0; i < lookups->size(); ++i)
+    by_shard[Shard((*lookups)[i].key, shard_num)].push_back(i);
+
+  DbContext db_cntx = tx.GetDbContext();
+  auto cb = [&](EngineShard* shard) {
+    const std::vector<size_t>& indices = by_shard[shard->shard_id()];
+    std::vector<std::string_view> keys(indices.size());
+    for (size_t j = 0; j < indices.size(); ++j)
+      keys[j] = (*lookups)[indices[j]].key;
+
+    std::vector<std::pair<size_t, util::fb2::Future<std::string>>> external;
+    auto on_found = [&](size_t j, OpResult<DbSlice::ConstIterator> res) {
+      if (!res)
+        return;
+
+      SortLookup& lookup = (*lookups)[indices[j]];
+      const PrimeValue& pv = (*res)->second;
+      if (!lookup.field.empty()) {
+        if (pv.ObjType() == OBJ_HASH)
+          lookup.value = GetHashField(pv, lookup.field, db_cntx);
+        return;
+      }
+
+      if (pv.ObjType() != OBJ_STRING)
+        return;
+      if (pv.IsExternal() && !pv.IsCool()) {
+        external.emplace_back(
+            indices[j], shard->tiered_storage()->Read(db_cntx.db_index, lookup.key, pv));
+      } else if (auto ival = want_int ? pv.TryGetInt() : std::optional<int64_t>{}; ival) {
+        lookup.int_value = *ival;
+      } else {
+        lookup.value = pv.ToString();
+      }
+    };
+    tx.GetDbSlice(shard->shard_id()).FindReadOnlyBatch(db_cntx, keys, std::nullopt, on_found);
+
+    for (auto& [index, future] : external)
+      (*lookups)[index].value = future.Get();
+  };
+  shard_set->RunBlockingInParallel(cb, [&](ShardId sid) { return !by_shard[sid].empty(); });
+}
+
+// Replaces the elements by entries weighted by the values of the keys the BY pattern refers to.
+// Numeric weights are kept as doubles, integer encoded values are used without formatting them.
+OpResult<SortEntryList> WeightSortEntries(const Transaction& tx, const SortPattern& by, bool alpha,
+                                          std::vector<SortEntry<true>> elems) {
+  std::vector<SortLookup> lookups;
+  lookups.reserve(elems.size());
+  for (const auto& elem : elems)
+    lookups.emplace_back(by, elem.key);
+  FetchSortLookups(tx, !alpha, &lookups);
+
+  if (alpha) {
+    std::vector<SortEntryByAlpha> res(elems.size());
+    for (size_t i = 0; i < elems.size(); ++i) {
+      res[i].key = std::move(elems[i].key);
+      res[i].weight = std::move(lookups[i].value);
+    }
+    return SortEntryList{std::move(res)};
+  }
+
+  std::vector<SortEntry<false>> res(elems.size());
+  for (size_t i = 0; i < elems.size(); ++i) {
+    double score = 0;  // missing weights count as 0
+    if (lookups[i].int_value) {
+      score = *lookups[i].int_value;
+    } else if (lookups[i].value && !lookups[i].value->empty()) {
+      if (!absl::SimpleAtod(*lookups[i].value, &score) || std::isnan(score))
+        return OpStatus::INVALID_NUMERIC_RESULT;
+    }
+    res[i].score = score;
+    res[i].key = std::move(elems[i].key);
+  }
+  return SortEntryList{std::move(res)};
+}
+
+// Resolves the GET patterns for the elements in [start_it, end_it), one value per element and
+// pattern, with a single lookup hop for all of them.
+template <typename Iterator>
+std::vector<std::optional<std::string>> FetchSortGets(const Transaction& tx,
+                                                      const std::vector<SortPattern>& gets,
+                                                      Iterator start_it, Iterator end_it) {
+  std::vector<std::optional<std::string>> res;
+  std::vector<SortLookup> lookups;
+  std::vector<size_t> lookup_pos;
+  for (auto it = start_it; it != end_it; ++it) {
+    for (const SortPattern& get : gets) {
+      if (get.is_self) {
+        res.emplace_back(it->key);
+        continue;
+      }
+      if (get.has_key) {
+        lookup_pos.push_back(res.size());
+        lookups.emplace_back(get, it->key);
+      }
+      res.emplace_back();
+    }
+  }
+
+  FetchSortLookups(tx, false, &lookups);
+  for (size_t i = 0; i < lookups.size(); ++i)
+    res[lookup_pos[i]] = std::move(lookups[i].value);
+  return res;
+}
+
+OpResult<uint32_t> OpStore(const OpArgs& op_args, std::string_view key,
+                           const std::vector<std::string_view>& values) {
   uint32_t len = 0;
 
   QList* ql_v2 = CompactObj::AllocateMR<QList>();
   QList::Where where = QList::TAIL;
-  for (auto it = start_it; it != end_it; ++it) {
-    ql_v2->Push(it->key, where);
+  for (std::string_view value : values) {
+    ql_v2->Push(value, where);
   }
   len = ql_v2->Size();
 
@@ -1477,10 +1629,24 @@ void SortGeneric(CmdArgList args, const CommandContext& cmd_cntx, bool is_read_o
   bool reversed = false;
   std::optional<std::string_view> store_key;
   std::optional<std::pair<size_t, size_t>> bounds;
+  std::optional<SortPattern> by;
+  std::vector<SortPattern> gets;
   auto* builder = cmd_cntx.rb;
   for (size_t i = 1; i < args.size(); i++) {
     string arg = absl::AsciiStrToUpper(ArgS(args, i));
-    if (arg == "ALPHA") {
+    if (arg == "BY" || arg == "GET") {
+      if (i + 1 >= args.size()) {
+        return builder->SendError(kSyntaxErr);
+      }
+      SortPattern pattern{ArgS(args, ++i)};
+      if (pattern.has_key && IsClusterEnabled()) {
+        return builder->SendError(absl::StrCat(arg, " option of SORT denied in Cluster mode."));
+      }
+      if (arg == "BY")
+        by = pattern;
+      else
+        gets.push_back(pattern);
+    } else if (arg == "ALPHA") {
       alpha = true;
     } else if (arg == "DESC") {
       reversed = true;
@@ -1514,13 +1680,17 @@ void SortGeneric(CmdArgList args, const CommandContext& cmd_cntx, bool is_read_o
              << " and store_key parameter: " << bool(store_key);
   assert(((is_read_only && !bool(store_key)) || !is_read_only));
 
+  // BY without * keeps the order of the container.
+  bool nosort = by && !by->has_key;
+
   ShardId source_sid = Shard(key, shard_set->size());
   OpResultTyped<SortEntryList> fetch_result;
   auto fetch_cb = [&](Transaction* t, EngineShard* shard) {
     ShardId shard_id = shard->shard_id();
     // in case of SORT option, we fetch only on the source shard
     if (shard_id == source_sid) {
-      fetch_result = OpFetchSortEntries(t->GetOpArgs(shard), key, alpha);
+      // Weights come from other keys, so the elements themselves are not parsed.
+      fetch_result = OpFetchSortEntries(t->GetOpArgs(shard), key, alpha || by);
     }
     return OpStatus::OK;
   };
@@ -1539,11 +1709,25 @@ void SortGeneric(CmdArgList args, const CommandContext& cmd_cntx, bool is_read_o
 
   auto result_type = fetch_result.type();
 
-  auto sort_call = [result_type, bounds, reversed, is_read_only, &rb, &store_key,
+  if (by && !nosort) {
+    auto& elems = std::get<std::vector<SortEntry<true>>>(fetch_result.value());
+    auto weighted = WeightSortEntries(*cmd_cntx.tx, *by, alpha, std::move(elems));
+    if (!weighted) {
+      cmd_cntx.tx->Conclude();
+      return builder->SendError("One or more scores can't be converted into double");
+    }
+    fetch_result.value() = std::move(*weighted);
+  }
+
+  auto sort_call = [result_type, bounds, reversed, nosort, &gets, &rb, &store_key,
                     &cmd_cntx](auto& entries) {
     using value_t = typename std::decay_t<decltype(entries)>::value_type;
     auto cmp = reversed ? &value_t::greater : &value_t::less;
-    if (bounds) {
+    if (nosort) {
+      // Sorted sets are kept in the order of their scores, which DESC reverses.
+      if (reversed && result_type == OBJ_ZSET)
+        std::reverse(entries.begin(), entries.end());
+    } else if (bounds) {
       auto sort_it = entries.begin() + std::min(bounds->first + bounds->second, entries.size());
       std::partial_sort(entries.begin(), sort_it, entries.end(), cmp);
     } else {
@@ -1557,7 +1741,22 @@ void SortGeneric(CmdArgList args, const CommandContext& cmd_cntx, bool is_read_o
       end_it = entries.begin() + std::min(bounds->first + bounds->second, entries.size());
     }
 
+    std::vector<std::optional<std::string>> get_values;
+    if (!gets.empty())
+      get_values = FetchSortGets(*cmd_cntx.tx, gets, start_it, end_it);
+
     if (!bool(store_key)) {
+      if (!gets.empty()) {
+        rb->StartArray(get_values.size());
+        for (const auto& value : get_values) {
+          if (value)
+            rb->SendBulkString(*value);
+          else
+            rb->SendNull();
+        }
+        return;
+      }
+
       bool is_set = (result_type == OBJ_SET || result_type == OBJ_ZSET);
       rb->StartCollection(std::distance(start_it, end_it),
                           is_set ? RedisReplyBuilder::SET : RedisReplyBuilder::ARRAY);
@@ -1566,12 +1765,22 @@ void SortGeneric(CmdArgList args, const CommandContext& cmd_cntx, bool is_read_o
         rb->SendBulkString(it->key);
       }
     } else {
+      // Missing GET values are stored as empty strings.
+      std::vector<std::string_view> values;
+      if (!gets.empty()) {
+        for (const auto& value : get_values)
+          values.push_back(value ? std::string_view{*value} : std::string_view{});
+      } else {
+        for (auto it = start_it; it != end_it; ++it)
+          values.push_back(it->key);
+      }
+
       ShardId dest_sid = Shard(store_key.value(), shard_set->size());
       OpResult<uint32_t> store_len;
       auto store_callback = [&](Transaction* t, EngineShard* shard) {
         ShardId shard_id = shard->shard_id();
         if (shard_id == dest_sid) {
-          store_len = OpStore(t->GetOpArgs(shard), store_key.value(), start_it, end_it);
+          store_len = OpStore(t->GetOpArgs(shard), store_key.value(), values);
         }
         return OpStatus::OK;
       };
@@ -1887,7 +2096,7 @@ void GenericFamily::Echo(CmdArgList args, const CommandContext& cmd_cntx) {
 }
 
 // SCAN cursor [MATCH <glob>] [TYPE <type>] [COUNT <count>] [BUCKET <bucket_id>]
-// [ATTR <mask>] [MLCGE <len>]
+// [ATTR <mask>] [MLCGE <len>] [BUDGET <ms>]
 void GenericFamily::Scan(CmdArgList args, const CommandContext& cmd_cntx) {
   string_view token = ArgS(args, 0);
   uint64_t cursor = 0;
@@ -1896,6 +2105,7 @@ void GenericFamily::Scan(CmdArgList args, const CommandContext& cmd_cntx) {
     if (absl::EqualsIgnoreCase(token, "HELP")) {
       string_view help_arr[] = {
           "SCAN cursor [MATCH <glob>] [TYPE <type>] [COUNT <count>] [ATTR <mask>] [MINMSZ <len>]",
+          "    [BUDGET <ms>]",
           "    MATCH <glob> - pattern to match keys against",
           "    TYPE <type> - type of values to match",
           "    COUNT <count> - number of keys to return",
@@ -1903,6 +2113,8 @@ void GenericFamily::Scan(CmdArgList args, const CommandContext& cmd_cntx) {
           "    p - persistent (no ttl), a - accessed since creation, u - untouched",
           "    MINMSZ <len> - keeps keys with values, whose allocated size is greater or equal to",
           "        the specified length",
+          "    BUDGET <ms> - scans until COUNT keys match or the time budget of up to 1000ms",
+          "        is exhausted, 25ms by default",
       };
       return builder->SendSimpleStrArr(help_arr);
     }
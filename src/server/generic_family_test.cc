@@ -8,6 +8,7 @@ extern "C" {
 #include "redis/rdb.h"
 }
 
+#include "base/flags.h"
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "facade/facade_test.h"
@@ -74,6 +75,43 @@ TEST_F(GenericFamilyTest, Expire) {
   EXPECT_THAT(resp, ArgType(RespExpr::NIL));
 }
 
+TEST_F(GenericFamilyTest, ActiveExpirySchedule) {
+  // The keys are never accessed again, so only the heartbeat deletes them.
+  for (unsigned i = 0; i < 1000; ++i) {
+    Run({"set", StrCat("short", i), "v", "PX", "1000"});
+    Run({"set", StrCat("long", i), "v", "PX", "5000"});
+  }
+
+  // Nothing is due, so the schedule backs off to its longest period meanwhile.
+  ThisFiber::SleepFor(300ms);
+  EXPECT_EQ(2000, CheckedInt({"dbsize"}));
+  EXPECT_EQ(0u, GetMetrics().events.expired_keys);
+
+  // Every shard is at the minimal budget, the gauge is not summed over shards.
+  EXPECT_EQ(5u, GetMetrics().shard_stats.active_expire_budget);
+
+  AdvanceTime(1000);
+  ExpectConditionWithinTimeout([&] { return CheckedInt({"dbsize"}) == 1000; });
+  EXPECT_EQ(1000u, GetMetrics().events.expired_keys);
+  EXPECT_EQ(1, CheckedInt({"exists", "long0"}));
+
+  AdvanceTime(4000);
+  ExpectConditionWithinTimeout([&] { return CheckedInt({"dbsize"}) == 0; });
+  EXPECT_EQ(2000u, GetMetrics().events.expired_keys);
+}
+
+TEST_F(GenericFamilyTest, ExpireWheelMemory) {
+  absl::FlagSaver fs;
+  SetTestFlag("expire_wheel", "true");
+  ResetService();
+
+  for (unsigned i = 0; i < 1000; ++i)
+    Run({"set", StrCat("key", i), "v", "EX", StrCat(1 + i % 100)});
+
+  EXPECT_GT(GetMetrics().db_stats[0].expire_wheel_mem_usage, 0u);
+  EXPECT_THAT(Run({"info", "memory"}).GetString(), HasSubstr("expire_wheel_used_memory:"));
+}
+
 TEST_F(GenericFamilyTest, ExpireOptions) {
   // NX and XX are mutually exclusive
   Run({"set", "key", "val"});
@@ -452,6 +490,22 @@ TEST_F(GenericFamilyTest, Rename) {
   ren_fb.Join();
 }
 
+TEST_F(GenericFamilyTest, RenameStringAcrossShards) {
+  string big_val(100000, 'v');
+  Run({"set", "x", big_val, "PX", "100000"});
+  Run({"set", "b", "12345"});
+
+  ASSERT_EQ(Run({"rename", "x", "b"}), "OK");
+  EXPECT_EQ(Run({"get", "b"}), big_val);
+  EXPECT_GT(CheckedInt({"pttl", "b"}), 0);
+
+  Run({"set", "x", "-42"});
+  EXPECT_THAT(Run({"copy", "x", "b", "REPLACE"}), IntArg(1));
+  EXPECT_EQ(Run({"get", "b"}), "-42");
+  EXPECT_EQ(Run({"get", "x"}), "-42");
+  EXPECT_EQ(CheckedInt({"pttl", "b"}), -1);
+}
+
 TEST_F(GenericFamilyTest, RenameList) {
   for (string_view dest : {"b", "y", "z"}) {
     EXPECT_EQ(1, CheckedInt({"lpush", "x", "elem"}));
@@ -694,6 +748,22 @@ TEST_F(GenericFamilyTest, ScanMallocSize) {
   EXPECT_THAT(resp.GetVec()[1], RespArray(UnorderedElementsAre("k1")));
 }
 
+TEST_F(GenericFamilyTest, ScanSparseMatch) {
+  Run({"debug", "populate", "10000", "key", "8"});
+  Run({"set", "user:1", "a"});
+  Run({"set", "user:2", "b"});
+  Run({"sadd", "user:3", "c"});
+
+  // A single call with a budget finds all the sparse matches.
+  auto resp = Run({"scan", "0", "match", "user:*", "count", "10", "budget", "1000"});
+  EXPECT_THAT(resp.GetVec()[1], RespArray(UnorderedElementsAre("user:1", "user:2", "user:3")));
+
+  resp = Run({"scan", "0", "match", "user:[12]", "type", "string", "budget", "1000"});
+  EXPECT_THAT(resp.GetVec()[1], RespArray(UnorderedElementsAre("user:1", "user:2")));
+
+  EXPECT_THAT(Run({"scan", "0", "budget", "x"}), ErrArg("not an integer"));
+}
+
 TEST_F(GenericFamilyTest, Sort) {
   // Test list sort with params
   Run({"del", "list-1"});
@@ -773,6 +843,34 @@ TEST_F(GenericFamilyTest, Sort) {
               ErrArg("One or more scores can't be converted into double"));
 }
 
+TEST_F(GenericFamilyTest, SortByGet) {
+  Run({"rpush", "ids", "1", "2", "3"});
+  Run({"mset", "w_1", "30", "w_2", "10", "w_3", "20.5"});
+  Run({"hset", "obj_1", "name", "one"});
+  Run({"hset", "obj_2", "name", "two"});
+  Run({"set", "val_3", "three"});
+
+  EXPECT_THAT(Run({"sort", "ids", "BY", "w_*"}).GetVec(), ElementsAre("2", "3", "1"));
+  EXPECT_THAT(Run({"sort", "ids", "BY", "w_*", "DESC", "LIMIT", "0", "2"}).GetVec(),
+              ElementsAre("1", "3"));
+  EXPECT_THAT(Run({"sort", "ids", "BY", "w_*", "ALPHA"}).GetVec(), ElementsAre("2", "3", "1"));
+  EXPECT_THAT(Run({"sort", "ids", "BY", "missing_*"}).GetVec(), ElementsAre("1", "2", "3"));
+  EXPECT_THAT(Run({"sort", "ids", "BY", "nosort", "DESC"}).GetVec(), ElementsAre("1", "2", "3"));
+
+  auto resp = Run({"sort", "ids", "BY", "w_*", "GET", "#", "GET", "obj_*->name", "GET", "val_*"});
+  EXPECT_THAT(resp.GetVec(), ElementsAre("2", "two", ArgType(RespExpr::NIL), "3",
+                                         ArgType(RespExpr::NIL), "three", "1", "one",
+                                         ArgType(RespExpr::NIL)));
+
+  EXPECT_THAT(Run({"sort", "ids", "GET", "obj_*->name", "STORE", "dest"}), IntArg(3));
+  EXPECT_THAT(Run({"lrange", "dest", "0", "-1"}).GetVec(), ElementsAre("one", "two", ""));
+
+  Run({"set", "w_2", "heavy"});
+  EXPECT_THAT(Run({"sort", "ids", "BY", "w_*"}),
+              ErrArg("One or more scores can't be converted into double"));
+  EXPECT_THAT(Run({"sort", "ids", "BY"}), ErrArg("syntax error"));
+}
+
 TEST_F(GenericFamilyTest, SortBug3636) {
   Run({"RPUSH", "foo", "1.100000023841858", "1.100000023841858", "1.100000023841858", "-15710",
        "1.100000023841858", "1.100000023841858", "1.100000023841858", "-15710", "-15710",
@@ -1360,6 +1458,50 @@ TEST_F(GenericFamilyTest, Unlink) {
   EXPECT_THAT(resp, IntArg(2));
 }
 
+TEST_F(GenericFamilyTest, AsyncFreeLargeValues) {
+  absl::FlagSaver fs;
+  SetTestFlag("async_free_threshold", "1024");
+  ResetService();
+
+  for (string_view type : {"list", "set", "hash", "zset"}) {
+    Run({"debug", "populate", "4", type, "10", "TYPE", type, "ELEMENTS", "5000"});
+  }
+  ASSERT_EQ(16, CheckedInt({"dbsize"}));
+
+  EXPECT_THAT(Run({"del", "list:0", "set:0", "hash:0", "zset:0"}), IntArg(4));
+  EXPECT_GT(GetMetrics().async_free_pending_bytes, 0u);
+
+  // The queued containers are released during the idle time of the shard threads.
+  ExpectConditionWithinTimeout([&] { return GetMetrics().async_free_pending_bytes == 0; });
+
+  EXPECT_EQ(Run({"set", "list:1", "v"}), "OK");
+  EXPECT_EQ(Run({"set", "zset:1", "v"}), "OK");
+  EXPECT_EQ(Run({"get", "zset:1"}), "v");
+
+  Run({"pexpire", "set:1", "10"});
+  Run({"pexpire", "hash:1", "10"});
+  AdvanceTime(20);
+  EXPECT_THAT(Run({"exists", "set:1", "hash:1"}), IntArg(0));
+  EXPECT_EQ(10, CheckedInt({"dbsize"}));
+
+  EXPECT_EQ(Run({"flushall"}), "OK");
+  EXPECT_EQ(0, CheckedInt({"dbsize"}));
+}
+
+TEST_F(GenericFamilyTest, AsyncFreeBacklogLimit) {
+  absl::FlagSaver fs;
+  SetTestFlag("async_free_threshold", "1024");
+  SetTestFlag("async_free_max_pending", "1");
+  ResetService();
+
+  Run({"debug", "populate", "4", "set", "10", "TYPE", "set", "ELEMENTS", "5000"});
+  EXPECT_THAT(Run({"del", "set:0", "set:1", "set:2", "set:3"}), IntArg(4));
+
+  // Every container exceeds the backlog bound, so all of them were released inline.
+  EXPECT_EQ(0u, GetMetrics().async_free_pending_bytes);
+  EXPECT_EQ(0, CheckedInt({"dbsize"}));
+}
+
 TEST_F(GenericFamilyTest, Copy) {
   RespExpr resp;
   string b_val(32, 'b');
@@ -344,9 +344,34 @@ void GeoFamily::GeoDist(CmdArgList args, const CommandContext& cmd_cntx) {
 }
 
 namespace {
-std::vector<ZSetFamily::ZRangeSpec> GetGeoRangeSpec(const GeoHashRadius& n) {
+
+// Upper bound on the number of geohash cells used to cover the search area.
+constexpr size_t kMaxGeoCells = 64;
+
+// Whether the bounding box of the shape can be used for pruning. Boxes that wrap around the
+// antimeridian or reach the poles are not representable as a single lon/lat rectangle.
+bool HasUsableBounds(const GeoShape& shape) {
+  const double* b = shape.bounds;
+  return b[0] >= GEO_LONG_MIN && b[2] <= GEO_LONG_MAX && b[0] <= b[2] && b[1] > -90 &&
+         b[3] < 90 && b[1] <= b[3];
+}
+
+bool CellIntersectsBounds(const GeoHashRange& long_range, const GeoHashRange& lat_range,
+                          GeoHashBits cell, const double* bounds) {
+  GeoHashArea area;
+  geohashDecode(long_range, lat_range, cell, &area);
+  return area.longitude.min <= bounds[2] && area.longitude.max >= bounds[0] &&
+         area.latitude.min <= bounds[3] && area.latitude.max >= bounds[1];
+}
+
+// Covers the search area with geohash cells and returns the score ranges that hold them.
+// Starts from the 9 cells computed by geohashCalculateAreasByShapeWGS84 and, as long as the
+// cell budget allows, replaces every cell with those of its 4 children that intersect the
+// bounding box of the shape. Finally adjacent ranges are merged so that the number of range
+// lookups stays small while far fewer non-matching members are scanned.
+std::vector<ZSetFamily::ZRangeSpec> GetGeoRangeSpec(const GeoHashRadius& n,
+                                                    const GeoShape& shape) {
   array<GeoHashBits, 9> neighbors;
-  unsigned int last_processed = 0;
 
   neighbors[0] = n.hash;
   neighbors[1] = n.neighbors.north;
@@ -358,24 +383,48 @@ std::vector<ZSetFamily::ZRangeSpec> GetGeoRangeSpec(const GeoHashRadius& n) {
   neighbors[7] = n.neighbors.south_east;
   neighbors[8] = n.neighbors.south_west;
 
-  // Get range_specs for neighbors (*and* our own hashbox)
-  std::vector<ZSetFamily::ZRangeSpec> range_specs;
-  for (unsigned int i = 0; i < neighbors.size(); i++) {
-    if (HASHISZERO(neighbors[i])) {
-      continue;
-    }
+  vector<GeoHashBits> cells;
+  for (const GeoHashBits& cell : neighbors) {
+    if (!HASHISZERO(cell))
+      cells.push_back(cell);
+  }
 
-    // When a huge Radius (in the 5000 km range or more) is used,
-    // adjacent neighbors can be the same, leading to duplicated
-    // elements. Skip every range which is the same as the one
-    // processed previously.
-    if (last_processed && neighbors[i].bits == neighbors[last_processed].bits &&
-        neighbors[i].step == neighbors[last_processed].step) {
-      continue;
+  if (HasUsableBounds(shape)) {
+    GeoHashRange long_range, lat_range;
+    geohashGetCoordRange(&long_range, &lat_range);
+
+    vector<GeoHashBits> children;
+    while (!cells.empty() && cells.front().step < GEO_STEP_MAX) {
+      children.clear();
+      for (const GeoHashBits& cell : cells) {
+        for (uint64_t quad = 0; quad < 4; ++quad) {
+          GeoHashBits child{(cell.bits << 2) | quad, uint8_t(cell.step + 1)};
+          if (CellIntersectsBounds(long_range, lat_range, child, shape.bounds))
+            children.push_back(child);
+        }
+      }
+      if (children.size() > kMaxGeoCells)
+        break;
+      cells.swap(children);
     }
+  }
 
+  // When a huge Radius (in the 5000 km range or more) is used, adjacent neighbors can be
+  // the same. Merging the sorted ranges removes such duplicates as well.
+  vector<pair<GeoHashFix52Bits, GeoHashFix52Bits>> ranges;
+  ranges.reserve(cells.size());
+  for (const GeoHashBits& cell : cells) {
     GeoHashFix52Bits min, max;
-    scoresOfGeoHashBox(neighbors[i], &min, &max);
+    scoresOfGeoHashBox(cell, &min, &max);
+    ranges.emplace_back(min, max);
+  }
+  sort(ranges.begin(), ranges.end());
+
+  std::vector<ZSetFamily::ZRangeSpec> range_specs;
+  for (size_t i = 0; i < ranges.size();) {
+    auto [min, max] = ranges[i];
+    for (++i; i < ranges.size() && ranges[i].first <= max; ++i)
+      max = std::max(max, ranges[i].second);
 
     ZSetFamily::ScoreInterval si;
     si.first = ZSetFamily::Bound{static_cast<double>(min), false};
@@ -385,12 +434,45 @@ std::vector<ZSetFamily::ZRangeSpec> GetGeoRangeSpec(const GeoHashRadius& n) {
     range_params.interval_type = ZSetFamily::RangeParams::IntervalType::SCORE;
     range_params.with_scores = true;
     range_specs.emplace_back(si, range_params);
-
-    last_processed = i;
   }
   return range_specs;
 }
 
+// Appends the members of arr that lie within the shape to ga, stopping once ga holds limit
+// points if limit is set. Coordinates are decoded for the whole batch first, so that members
+// outside the bounding box are rejected by a branch-free loop before the exact distance check.
+void FilterCandidates(const ZSetFamily::ScoredArray& arr, GeoShape* shape, unsigned long limit,
+                      GeoArray* ga) {
+  size_t num = arr.size();
+  vector<double> lon(num), lat(num);
+  vector<uint8_t> inside(num);
+
+  for (size_t i = 0; i < num; ++i) {
+    double xy[2] = {0, 0};
+    GeoHashBits hash = {.bits = (uint64_t)arr[i].second, .step = GEO_STEP_MAX};
+    inside[i] = geohashDecodeToLongLatType(hash, xy);
+    lon[i] = xy[0];
+    lat[i] = xy[1];
+  }
+
+  if (HasUsableBounds(*shape)) {
+    const double* b = shape->bounds;
+    for (size_t i = 0; i < num; ++i) {
+      inside[i] &= (lon[i] >= b[0]) & (lon[i] <= b[2]) & (lat[i] >= b[1]) & (lat[i] <= b[3]);
+    }
+  }
+
+  double xy[2];
+  double distance;
+  for (size_t i = 0; i < num; ++i) {
+    if (inside[i] && geoWithinShape(shape, arr[i].second, xy, &distance) == 0) {
+      ga->emplace_back(xy[0], xy[1], distance, arr[i].second, arr[i].first);
+      if (limit > 0 && ga->size() >= limit)
+        break;
+    }
+  }
+}
+
 void SortIfNeeded(GeoArray* ga, Sorting sorting, uint64_t count) {
   if (sorting == Sorting::kUnsorted)
     return;
@@ -474,35 +556,26 @@ void GeoSearchStoreGeneric(Transaction* tx, facade::SinkReplyBuilder* builder,
   // query
   GeoHashRadius georadius = geohashCalculateAreasByShapeWGS84(shape);
   GeoArray ga;
-  auto range_specs = GetGeoRangeSpec(georadius);
-  // get all the matching members and add them to the potential result list
-  vector<OpResult<vector<ScoredArray>>> result_arrays;
+  auto range_specs = GetGeoRangeSpec(georadius, *shape);
+  // get all the matching members, the candidates are filtered on the shard thread
+  // so that only members within the shape are handed back
+  unsigned long limit = geo_ops.any ? geo_ops.count : 0;
   auto cb = [&](Transaction* t, EngineShard* shard) {
+    if (shard->shard_id() != from_shard)
+      return OpStatus::OK;
     auto res_it = ZSetFamily::OpRanges(range_specs, t->GetOpArgs(shard), key);
     if (res_it) {
-      result_arrays.emplace_back(res_it);
+      for (const auto& arr : *res_it) {
+        FilterCandidates(arr, shape, limit, &ga);
+        if (limit > 0 && ga.size() >= limit)
+          break;
+      }
     }
     return OpStatus::OK;
   };
 
   tx->Execute(std::move(cb), geo_ops.store == GeoStoreType::kNoStore);
 
-  // filter potential result list
-  double xy[2];
-  double distance;
-  unsigned long limit = geo_ops.any ? geo_ops.count : 0;
-  for (auto& result_array : result_arrays) {
-    for (auto& arr : *result_array) {
-      for (auto& p : arr) {
-        if (geoWithinShape(shape, p.second, xy, &distance) == 0) {
-          ga.emplace_back(xy[0], xy[1], distance, p.second, p.first);
-          if (limit > 0 && ga.size() >= limit)
-            break;
-        }
-      }
-    }
-  }
-
   // sort and trim by count
   SortIfNeeded(&ga, geo_ops.sorting, geo_ops.count);
 
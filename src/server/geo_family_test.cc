@@ -4,6 +4,9 @@
 
 #include "server/geo_family.h"
 
+#include <absl/strings/numbers.h>
+#include <absl/strings/str_cat.h>
+
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "facade/facade_test.h"
@@ -188,6 +191,41 @@ TEST_F(GeoFamilyTest, GeoSearch) {
   EXPECT_THAT(resp, RespArray(ElementsAre("Madrid", "Lisbon")));
 }
 
+TEST_F(GeoFamilyTest, GeoSearchManyPoints) {
+  // 30x30 grid with a spacing of about 1km around Berlin.
+  for (unsigned i = 0; i < 30; ++i) {
+    for (unsigned j = 0; j < 30; ++j) {
+      string lon = absl::StrCat(13.2 + i * 0.015), lat = absl::StrCat(52.4 + j * 0.009);
+      Run({"geoadd", "grid", lon, lat, absl::StrCat("p", i, "_", j)});
+    }
+  }
+
+  // The center of the grid and the members within 5km of it according to GEODIST.
+  unsigned expected = 0;
+  for (unsigned i = 0; i < 30; ++i) {
+    for (unsigned j = 0; j < 30; ++j) {
+      auto resp = Run({"geodist", "grid", "p15_15", absl::StrCat("p", i, "_", j), "km"});
+      double dist = 0;
+      ASSERT_TRUE(absl::SimpleAtod(resp.GetString(), &dist));
+      expected += dist <= 5;
+    }
+  }
+  ASSERT_GT(expected, 50u);
+  ASSERT_LT(expected, 900u);
+
+  auto resp = Run({"GEOSEARCH", "grid", "FROMMEMBER", "p15_15", "BYRADIUS", "5", "KM", "ASC"});
+  ASSERT_THAT(resp, ArrLen(expected));
+  EXPECT_EQ(resp.GetVec()[0], "p15_15");
+
+  resp = Run({"GEOSEARCH", "grid", "FROMMEMBER", "p15_15", "BYBOX", "3", "3", "KM"});
+  EXPECT_THAT(resp, ArrLen(9));
+
+  resp = Run({"GEOSEARCH", "grid", "FROMMEMBER", "p15_15", "BYRADIUS", "5", "KM", "COUNT", "10",
+              "ANY"});
+  EXPECT_THAT(resp, ArrLen(10));
+}
+
+
 TEST_F(GeoFamilyTest, GeoRadiusByMember) {
   EXPECT_EQ(10, CheckedInt({"geoadd",  "Europe",    "13.4050", "52.5200", "Berlin",   "3.7038",
                             "40.4168", "Madrid",    "9.1427",  "38.7369", "Lisbon",   "2.3522",
@@ -178,73 +178,80 @@ OpResult<int64_t> CountHllsSingle(const OpArgs& op_args, string_view key) {
   }
 }
 
-OpResult<vector<string>> ReadValues(const OpArgs& op_args, const ShardArgs& keys) {
+// Merges the HLLs of the shard keys into `raw`, a raw HLL that holds one byte per register.
+// This way each shard sends a single buffer to the coordinator regardless of its number of keys.
+OpStatus MergeShardHlls(const OpArgs& op_args, const ShardArgs& keys, string* raw) {
   try {
-    vector<string> values;
+    raw->resize(getRawHllSize());
+    createRawHll(StringToHllPtr(*raw));
+
+    string tmp, dense;
     for (string_view key : keys) {
       auto it = op_args.GetDbSlice().FindReadOnly(op_args.db_cntx, key, OBJ_STRING);
-      if (it.ok()) {
-        string hll;
-        it.value()->second.GetString(&hll);
-        if (!ConvertToDenseIfNeeded(&hll)) {
+      if (it.status() == OpStatus::WRONG_TYPE) {
+        return OpStatus::WRONG_TYPE;
+      }
+      if (!it.ok()) {
+        continue;
+      }
+
+      string_view hll = it.value()->second.GetSlice(&tmp);
+      if (isValidHLL(StringToHllPtr(hll)) != HLL_VALID_DENSE) {
+        dense = hll;
+        if (!ConvertToDenseIfNeeded(&dense)) {
           return OpStatus::CORRUPTED_HLL;
         }
-        values.push_back(std::move(hll));
-      } else if (it.status() == OpStatus::WRONG_TYPE) {
-        return OpStatus::WRONG_TYPE;
+        hll = dense;
       }
+      pfmergeToRaw(StringToHllPtr(hll), StringToHllPtr(*raw));
     }
-    return values;
+    return OpStatus::OK;
   } catch (const std::bad_alloc&) {
     return OpStatus::OUT_OF_MEMORY;
   }
 }
 
-vector<HllBufferPtr> ConvertShardVector(const vector<vector<string>>& hlls) {
-  vector<HllBufferPtr> ptrs;
-  ptrs.reserve(hlls.size());
-  for (auto& shard_hlls : hlls) {
-    for (auto& hll : shard_hlls) {
-      ptrs.push_back(StringToHllPtr(hll));
-    }
-  }
-  return ptrs;
-}
-
-OpResult<int64_t> PFCountMulti(CmdArgList args, const CommandContext& cmd_cntx) {
-  vector<vector<string>> hlls;
-  hlls.resize(shard_set->size());
+// Runs MergeShardHlls on all the shards of the transaction and merges their results.
+OpResult<string> MergeHlls(Transaction* tx, bool conclude) {
+  vector<string> raws(shard_set->size());
 
   atomic<OpStatus> error_status{OpStatus::OK};
   auto cb = [&](Transaction* t, EngineShard* shard) {
     ShardId sid = shard->shard_id();
-    ShardArgs shard_args = t->GetShardArgs(shard->shard_id());
-    auto result = ReadValues(t->GetOpArgs(shard), shard_args);
-    if (result.ok()) {
-      hlls[sid] = std::move(result.value());
-    } else {
-      error_status.store(result.status(), memory_order_relaxed);
+    OpStatus status = MergeShardHlls(t->GetOpArgs(shard), t->GetShardArgs(sid), &raws[sid]);
+    if (status != OpStatus::OK) {
+      error_status.store(status, memory_order_relaxed);
     }
     return OpStatus::OK;
   };
 
-  OpStatus cb_status = cmd_cntx.tx->ScheduleSingleHop(std::move(cb));
-  if (cb_status != OpStatus::OK) {
-    return cb_status;
-  }
+  tx->Execute(std::move(cb), conclude);
 
   OpStatus stored_error = error_status.load(memory_order_relaxed);
   if (stored_error != OpStatus::OK) {
     return stored_error;
   }
 
-  vector<HllBufferPtr> ptrs = ConvertShardVector(hlls);
-  int64_t pf_count = pfcountMulti(ptrs.data(), ptrs.size());
-  if (pf_count < 0) {
-    return OpStatus::INVALID_VALUE;
-  } else {
-    return pf_count;
+  string* res = nullptr;
+  for (string& raw : raws) {
+    if (raw.empty()) {
+      continue;
+    }
+    if (res) {
+      pfmergeRaw(StringToHllPtr(raw), StringToHllPtr(*res));
+    } else {
+      res = &raw;
+    }
   }
+  DCHECK(res);
+  return std::move(*res);
+}
+
+OpResult<int64_t> PFCountMulti(CmdArgList args, const CommandContext& cmd_cntx) {
+  OpResult<string> raw = MergeHlls(cmd_cntx.tx, true);
+  RETURN_ON_BAD_STATUS(raw);
+
+  return pfcountRaw(StringToHllPtr(*raw));
 }
 
 void PFCount(CmdArgList args, const CommandContext& cmd_cntx) {
@@ -262,36 +269,16 @@ void PFCount(CmdArgList args, const CommandContext& cmd_cntx) {
 }
 
 OpResult<int> PFMergeInternal(CmdArgList args, Transaction* tx, SinkReplyBuilder* builder) {
-  vector<vector<string>> hlls;
-  hlls.resize(shard_set->size());
-
-  atomic<OpStatus> error_status{OpStatus::OK};
-  auto cb = [&](Transaction* t, EngineShard* shard) {
-    ShardId sid = shard->shard_id();
-    ShardArgs shard_args = t->GetShardArgs(shard->shard_id());
-    auto result = ReadValues(t->GetOpArgs(shard), shard_args);
-    if (result.ok()) {
-      hlls[sid] = std::move(result.value());
-    } else {
-      error_status.store(result.status(), memory_order_relaxed);
-    }
-    return OpStatus::OK;
-  };
-
-  tx->Execute(std::move(cb), false);
-
-  OpStatus stored_error = error_status.load(memory_order_relaxed);
-  if (stored_error != OpStatus::OK) {
+  OpResult<string> raw = MergeHlls(tx, false);
+  if (!raw) {
     tx->Conclude();
-    return stored_error;
+    return raw.status();
   }
 
-  vector<HllBufferPtr> ptrs = ConvertShardVector(hlls);
-
   string hll;
   hll.resize(getDenseHllSize());
   createDenseHll(StringToHllPtr(hll));
-  int result = pfmerge(ptrs.data(), ptrs.size(), StringToHllPtr(hll));
+  int result = pfstoreRaw(StringToHllPtr(*raw), StringToHllPtr(hll));
 
   auto set_cb = [&](Transaction* t, EngineShard* shard) {
     string_view key = ArgS(args, 0);
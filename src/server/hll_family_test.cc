@@ -4,6 +4,7 @@
 
 #include "server/hll_family.h"
 
+#include "absl/strings/str_cat.h"
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "facade/facade_test.h"
@@ -229,4 +230,29 @@ TEST_F(HllFamilyTest, MergeWithInvalidHllFormat) {
               ErrArg("INVALIDOBJ Corrupted HLL object detected."));
 }
 
+TEST_F(HllFamilyTest, CountAndMergeManyKeys) {
+  // Keys spread over all the shards, each with 100 elements of which 50 overlap with the next key.
+  vector<string> keys;
+  for (unsigned i = 0; i < 40; ++i) {
+    keys.push_back(absl::StrCat("hll", i));
+    vector<string> cmd = {"pfadd", keys.back()};
+    for (unsigned j = 0; j < 100; ++j)
+      cmd.push_back(absl::StrCat(i * 50 + j));
+    Run(absl::MakeSpan(cmd));
+  }
+
+  vector<string_view> count_cmd = {"pfcount"};
+  vector<string_view> merge_cmd = {"pfmerge", "dest"};
+  for (const auto& key : keys) {
+    count_cmd.push_back(key);
+    merge_cmd.push_back(key);
+  }
+
+  int64_t count = CheckedInt(count_cmd);
+  EXPECT_NEAR(count, 40 * 50 + 50, 60);
+
+  EXPECT_EQ(Run(merge_cmd), "OK");
+  EXPECT_EQ(CheckedInt({"pfcount", "dest"}), count);
+}
+
 }  // namespace dfly
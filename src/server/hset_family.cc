@@ -14,6 +14,7 @@ extern "C" {
 }
 
 #include "base/logging.h"
+#include "core/frequency_sketch.h"
 #include "core/string_map.h"
 #include "facade/cmd_arg_parser.h"
 #include "server/acl/acl_commands_def.h"
@@ -38,6 +39,26 @@ using IncrByParam = std::variant<double, int64_t>;
 using OptStr = std::optional<std::string>;
 enum GetAllMode : uint8_t { FIELDS = 1, VALUES = 2 };
 
+// Write frequency from which listpacks are converted to hash tables at a quarter of
+// max_listpack_map_bytes, as every listpack write moves its tail.
+constexpr unsigned kHotWriteFreq = 8;
+
+// Counts the write if the hash write sketch is enabled and returns the estimated write frequency
+// of the hash.
+unsigned RecordWrite(const OpArgs& op_args, string_view key) {
+  FrequencySketch* sketch = op_args.GetDbSlice().hash_write_sketch();
+  if (sketch == nullptr)
+    return 0;
+
+  uint64_t hash = CompactObj::HashCode(key);
+  sketch->Increment(hash);
+  return sketch->Estimate(hash);
+}
+
+bool IsWriteHot(unsigned write_freq, size_t lp_bytes) {
+  return write_freq >= kHotWriteFreq && lp_bytes >= server.max_listpack_map_bytes / 4;
+}
+
 bool IsGoodForListpack(CmdArgList args, const uint8_t* lp) {
   size_t sum = 0;
   for (auto s : args) {
@@ -56,7 +77,7 @@ using container_utils::LpGetView;
 pair<uint8_t*, bool> LpDelete(uint8_t* lp, string_view field) {
   uint8_t* fptr = lpFirst(lp);
   DCHECK(fptr);
-  fptr = lpFind(lp, fptr, (unsigned char*)field.data(), field.size(), 1);
+  fptr = lpFindEncoded(lp, fptr, (unsigned char*)field.data(), field.size(), 1);
   if (fptr == NULL) {
     return make_pair(lp, false);
   }
@@ -84,7 +105,7 @@ pair<uint8_t*, bool> LpInsert(uint8_t* lp, string_view field, string_view val, b
   bool updated = false;
 
   if (fptr) {
-    fptr = lpFind(lp, fptr, fsrc, field.size(), 1);
+    fptr = lpFindEncoded(lp, fptr, fsrc, field.size(), 1);
     if (fptr) {
       if (skip_exists) {
         return make_pair(lp, false);
@@ -183,11 +204,12 @@ OpStatus OpIncrBy(const OpArgs& op_args, string_view key, string_view field, Inc
   } else {
     op_args.shard->search_indices()->RemoveDoc(key, op_args.db_cntx, add_res.it->second);
 
+    unsigned write_freq = RecordWrite(op_args, key);
     if (pv.Encoding() == kEncodingListPack) {
       uint8_t* lp = (uint8_t*)pv.RObjPtr();
       size_t lpb = lpBytes(lp);
 
-      if (lpb >= server.max_listpack_map_bytes) {
+      if (lpb >= server.max_listpack_map_bytes || IsWriteHot(write_freq, lpb)) {
         StringMap* sm = HSetFamily::ConvertToStrMap(lp);
         pv.InitRobj(OBJ_HASH, kEncodingStrMap2, sm);
       }
@@ -402,6 +424,7 @@ OpResult<uint32_t> OpDel(const OpArgs& op_args, string_view key, CmdArgList valu
 
   PrimeValue& pv = it_res->it->second;
   op_args.shard->search_indices()->RemoveDoc(key, op_args.db_cntx, pv);
+  RecordWrite(op_args, key);
 
   unsigned deleted = 0;
   bool key_remove = false;
@@ -467,7 +490,10 @@ OpResult<vector<OptStr>> OpHMGet(const OpArgs& op_args, std::string_view key, Cm
   if (pv.Encoding() == kEncodingListPack) {
     uint8_t* lp = (uint8_t*)pv.RObjPtr();
 
-    absl::flat_hash_map<string_view, absl::InlinedVector<size_t, 3>> reverse;
+    using Reverse = absl::flat_hash_map<string_view, absl::InlinedVector<size_t, 3>>;
+    absl::flat_hash_map<string_view, Reverse::mapped_type, Reverse::hasher, Reverse::key_equal,
+                        PMR_NS::polymorphic_allocator<Reverse::value_type>>
+        reverse(ServerState::tlocal()->scratch_resource());
     reverse.reserve(fields.size() + 1);
     for (size_t i = 0; i < fields.size(); ++i) {
       reverse[ArgS(fields, i)].push_back(i);  // map fields to their index.
@@ -576,17 +602,8 @@ OpResult<string> OpGet(const OpArgs& op_args, string_view key, string_view field
   return OpStatus::KEY_NOTFOUND;
 }
 
-OpResult<vector<string>> OpGetAll(const OpArgs& op_args, string_view key, uint8_t mask) {
-  auto& db_slice = op_args.GetDbSlice();
-  auto it_res = db_slice.FindReadOnly(op_args.db_cntx, key, OBJ_HASH);
-  if (!it_res) {
-    if (it_res.status() == OpStatus::KEY_NOTFOUND)
-      return vector<string>{};
-    return it_res.status();
-  }
-
-  const PrimeValue& pv = (*it_res)->second;
-
+// Returns the fields and/or values of the hash. StringMap expiry time must be set by the caller.
+vector<string> ReadAll(const PrimeValue& pv, uint8_t mask) {
   vector<string> res;
   bool keyval = (mask == (FIELDS | VALUES));
 
@@ -610,7 +627,7 @@ OpResult<vector<string>> OpGetAll(const OpArgs& op_args, string_view key, uint8_
     }
   } else {
     DCHECK_EQ(pv.Encoding(), kEncodingStrMap2);
-    StringMap* sm = GetStringMap(pv, op_args.db_cntx);
+    StringMap* sm = static_cast<StringMap*>(pv.RObjPtr());
 
     res.reserve(sm->UpperBoundSize() * (keyval ? 2 : 1));
     for (const auto& k_v : *sm) {
@@ -624,6 +641,29 @@ OpResult<vector<string>> OpGetAll(const OpArgs& op_args, string_view key, uint8_
     }
   }
 
+  return res;
+}
+
+// offload - the hash may be pinned instead of read, see OffloadedRead.
+OpResult<vector<string>> OpGetAll(const OpArgs& op_args, string_view key, uint8_t mask,
+                                  container_utils::OffloadedRead* offload) {
+  auto& db_slice = op_args.GetDbSlice();
+  auto it_res = db_slice.FindReadOnly(op_args.db_cntx, key, OBJ_HASH);
+  if (!it_res) {
+    if (it_res.status() == OpStatus::KEY_NOTFOUND)
+      return vector<string>{};
+    return it_res.status();
+  }
+
+  const PrimeValue& pv = (*it_res)->second;
+  if (offload && offload->TryPin(&db_slice, op_args.db_cntx.db_index, key, pv, pv.Size()))
+    return vector<string>{};
+
+  if (pv.Encoding() == kEncodingStrMap2)
+    GetStringMap(pv, op_args.db_cntx);  // sets the expiry time
+
+  vector<string> res = ReadAll(pv, mask);
+
   // Empty hashmaps must be deleted, this case only triggers for expired values
   // and the enconding is guaranteed to be a DenseSet since we only support expiring
   // value with that enconding.
@@ -691,10 +731,12 @@ OpResult<uint32_t> OpSet(const OpArgs& op_args, string_view key, CmdArgList valu
     op_args.shard->search_indices()->RemoveDoc(key, op_args.db_cntx, it->second);
   }
 
+  unsigned write_freq = add_res.is_new ? 0 : RecordWrite(op_args, key);
   if (pv.Encoding() == kEncodingListPack) {
     lp = (uint8_t*)pv.RObjPtr();
 
-    if (op_sp.ttl != UINT32_MAX || !IsGoodForListpack(values, lp)) {
+    if (op_sp.ttl != UINT32_MAX || !IsGoodForListpack(values, lp) ||
+        IsWriteHot(write_freq, lpBytes(lp))) {
       StringMap* sm = HSetFamily::ConvertToStrMap(lp);
       pv.InitRobj(OBJ_HASH, kEncodingStrMap2, sm);
       lp = nullptr;
@@ -731,6 +773,11 @@ OpResult<uint32_t> OpSet(const OpArgs& op_args, string_view key, CmdArgList valu
 
       created += unsigned(added);
     }
+
+    if (op_sp.ttl != UINT32_MAX) {
+      db_slice.OnFieldExpiry(op_args.db_cntx.db_index, key, sm->UpperBoundSize(),
+                             MemberTimeSeconds(op_args.db_cntx.time_now_ms) + op_sp.ttl);
+    }
   }
 
   op_args.shard->search_indices()->AddDoc(key, op_args.db_cntx, pv);
@@ -741,11 +788,14 @@ OpResult<uint32_t> OpSet(const OpArgs& op_args, string_view key, CmdArgList valu
 void HGetGeneric(CmdArgList args, uint8_t getall_mask, Transaction* tx, SinkReplyBuilder* builder) {
   string_view key = ArgS(args, 0);
 
-  auto cb = [&](Transaction* t, EngineShard* shard) {
-    return OpGetAll(t->GetOpArgs(shard), key, getall_mask);
-  };
-
-  OpResult<vector<string>> result = tx->ScheduleSingleHopT(std::move(cb));
+  container_utils::OffloadedRead offload{tx};
+  OpResult<vector<string>> result;
+  offload.Run(
+      tx,
+      [&](Transaction* t, EngineShard* shard) {
+        result = OpGetAll(t->GetOpArgs(shard), key, getall_mask, &offload);
+      },
+      [&](const PrimeValue& pv) { result = ReadAll(pv, getall_mask); });
 
   auto* rb = static_cast<RedisReplyBuilder*>(builder);
   if (result) {
@@ -1199,7 +1249,8 @@ void HSetFamily::HRandField(CmdArgList args, const CommandContext& cmd_cntx) {
         } else {
           string_map->RandomPairs(actual_count, keys, vals, with_values);
         }
-        for (size_t i = 0; i < actual_count; ++i) {
+        // May hold fewer than actual_count picks if fields expired.
+        for (size_t i = 0; i < keys.size(); ++i) {
           str_vec.emplace_back(keys[i], sdslen(keys[i]));
           if (with_values) {
             str_vec.emplace_back(vals[i], sdslen(vals[i]));
@@ -1370,6 +1421,60 @@ StringMap* HSetFamily::ConvertToStrMap(uint8_t* lp) {
   return sm;
 }
 
+uint8_t* HSetFamily::ConvertToListPack(StringMap* sm, size_t max_bytes) {
+  uint8_t* lp = lpNew(0);
+  for (const auto& [field, value] : *sm) {
+    size_t field_len = sdslen(field), value_len = sdslen(value);
+    if (field_len > server.max_map_field_len || value_len > server.max_map_field_len) {
+      lpFree(lp);
+      return nullptr;
+    }
+
+    lp = lpAppend(lp, reinterpret_cast<uint8_t*>(field), field_len);
+    lp = lpAppend(lp, reinterpret_cast<uint8_t*>(value), value_len);
+    if (lpBytes(lp) > max_bytes) {
+      lpFree(lp);
+      return nullptr;
+    }
+  }
+  return lp;
+}
+
+PrimeTable::Cursor HSetFamily::DemoteColdHashes(DbIndex db_ind, PrimeTable::Cursor cursor,
+                                                DbSlice* db_slice) {
+  const FrequencySketch* sketch = db_slice->hash_write_sketch();
+  DCHECK(sketch);
+  size_t max_bytes = server.max_listpack_map_bytes / 2;
+  string scratch;
+
+  auto cb = [&](PrimeIterator it) {
+    PrimeValue& pv = it->second;
+    if (pv.ObjType() != OBJ_HASH || pv.Encoding() != kEncodingStrMap2)
+      return;
+
+    // Listpacks can not hold field expiries.
+    StringMap* sm = static_cast<StringMap*>(pv.RObjPtr());
+    if (sm->ExpirationUsed() || sm->ObjMallocUsed() > max_bytes ||
+        sketch->Estimate(it->first.HashCode()) > 0) {
+      return;
+    }
+
+    string_view key = it->first.GetSlice(&scratch);
+    if (!db_slice->CheckLock(IntentLock::EXCLUSIVE, db_ind, key))
+      return;
+
+    uint8_t* lp = ConvertToListPack(sm, max_bytes);
+    if (lp == nullptr)
+      return;
+
+    size_t orig_heap_size = pv.MallocUsed();
+    pv.InitRobj(OBJ_HASH, kEncodingListPack, lp);
+    db_slice->OnValueReencoded(db_ind, it, key, orig_heap_size);
+  };
+
+  return db_slice->GetDBTable(db_ind)->prime.Traverse(cursor, cb);
+}
+
 // returns -1 if no expiry is associated with the field, -3 if no field is found.
 int32_t HSetFamily::FieldExpireTime(const DbContext& db_context, const PrimeValue& pv,
                                     std::string_view field) {
@@ -1405,6 +1510,8 @@ vector<long> HSetFamily::SetFieldsExpireTime(const OpArgs& op_args, uint32_t ttl
   // This needs to be explicitly fetched again since the pv might have changed.
   StringMap* sm = container_utils::GetStringMap(*pv, op_args.db_cntx);
   vector<long> res = ExpireElements(sm, values, ttl_sec);
+  op_args.GetDbSlice().OnFieldExpiry(op_args.db_cntx.db_index, key, sm->UpperBoundSize(),
+                                     MemberTimeSeconds(op_args.db_cntx.time_now_ms) + ttl_sec);
   op_args.shard->search_indices()->AddDoc(key, op_args.db_cntx, *pv);
   return res;
 }
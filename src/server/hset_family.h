@@ -24,6 +24,16 @@ class HSetFamily {
   // Does not free lp.
   static StringMap* ConvertToStrMap(uint8_t* lp);
 
+  // Does not free sm. Returns nullptr if sm has a field or a value longer than max_map_field_len
+  // or if the listpack would exceed max_bytes.
+  static uint8_t* ConvertToListPack(StringMap* sm, size_t max_bytes);
+
+  // Converts the hash tables of hashes that were not written recently, according to the hash
+  // write sketch of db_slice, and that shrank to half of max_listpack_map_bytes back to
+  // listpacks. Traverses a single bucket of the table and returns the next cursor.
+  static PrimeTable::Cursor DemoteColdHashes(DbIndex db_ind, PrimeTable::Cursor cursor,
+                                             DbSlice* db_slice);
+
   static int32_t FieldExpireTime(const DbContext& db_context, const PrimeValue& pv,
                                  std::string_view field);
 
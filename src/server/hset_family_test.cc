@@ -11,6 +11,7 @@ extern "C" {
 
 #include "base/gtest.h"
 #include "base/logging.h"
+#include "core/string_map.h"
 #include "facade/facade_test.h"
 #include "server/test_utils.h"
 
@@ -57,6 +58,29 @@ TEST_F(HSetFamilyTest, Basic) {
   EXPECT_THAT(Run({"hdel", "nokey", "a"}), IntArg(0));
 }
 
+TEST_F(HSetFamilyTest, ConvertToListPack) {
+  StringMap sm;
+  for (unsigned i = 0; i < 10; ++i) {
+    sm.AddOrUpdate(absl::StrCat("field", i), absl::StrCat("value", i));
+  }
+
+  uint8_t* lp = HSetFamily::ConvertToListPack(&sm, 1024);
+  ASSERT_TRUE(lp != nullptr);
+  EXPECT_EQ(20, lpLength(lp));
+
+  uint8_t* fptr = lpFind(lp, lpFirst(lp), (unsigned char*)"field3", 6, 1);
+  ASSERT_TRUE(fptr != nullptr);
+  int64_t vlen;
+  uint8_t intbuf[LP_INTBUF_SIZE];
+  uint8_t* vptr = lpGet(lpNext(lp, fptr), &vlen, intbuf);
+  EXPECT_EQ("value3", string_view(reinterpret_cast<char*>(vptr), vlen));
+  lpFree(lp);
+
+  EXPECT_TRUE(HSetFamily::ConvertToListPack(&sm, 32) == nullptr);
+  sm.AddOrUpdate("long", string(100, 'x'));
+  EXPECT_TRUE(HSetFamily::ConvertToListPack(&sm, 1024) == nullptr);
+}
+
 TEST_F(HSetFamilyTest, HSet) {
   string val(1024, 'b');
 
@@ -67,6 +91,23 @@ TEST_F(HSetFamilyTest, HSet) {
   EXPECT_EQ(1, CheckedInt({"hset", "small", "", "565323349817"}));
 }
 
+TEST_F(HSetFamilyTest, HGetAllOffload) {
+  absl::FlagSaver fs;
+  SetTestFlag("read_offload_min_len", "2");
+
+  Run({"hset", "x", "a", "1", "b", "2", "c", "3"});
+  EXPECT_THAT(Run({"hgetall", "x"}).GetVec(), ElementsAre("a", "1", "b", "2", "c", "3"));
+  EXPECT_THAT(Run({"hkeys", "x"}).GetVec(), ElementsAre("a", "b", "c"));
+  EXPECT_THAT(Run({"hvals", "x"}).GetVec(), ElementsAre("1", "2", "3"));
+
+  string val(500, 'v');  // converts the hash to a string map
+  Run({"hset", "y", "a", val, "b", "2"});
+  EXPECT_THAT(Run({"hgetall", "y"}).GetVec(), UnorderedElementsAre("a", val, "b", "2"));
+
+  EXPECT_EQ(1, CheckedInt({"hdel", "x", "a"}));
+  EXPECT_THAT(Run({"hkeys", "x"}).GetVec(), ElementsAre("b", "c"));
+}
+
 TEST_P(HestFamilyTestProtocolVersioned, Get) {
   auto resp = Run({"hello", GetParam()});
   EXPECT_THAT(resp.GetVec()[6], "proto");
@@ -478,6 +519,89 @@ TEST_F(HSetFamilyTest, HExpireNoAddNew) {
   EXPECT_THAT(Run({"HGETALL", "key"}), RespArray(ElementsAre()));
 }
 
+TEST_F(HSetFamilyTest, ReapExpiredFields) {
+  absl::FlagSaver fs;
+  SetTestFlag("field_expire_reap_min_size", "4");
+  ResetService();
+
+  for (int i = 0; i < 8; ++i) {
+    EXPECT_EQ(CheckedInt({"HSETEX", "key", "10", absl::StrCat("k", i), "v"}), 1);
+    EXPECT_EQ(CheckedInt({"HSETEX", "gone", "10", absl::StrCat("k", i), "v"}), 1);
+  }
+  EXPECT_EQ(CheckedInt({"HSET", "key", "keep", "v"}), 1);
+  EXPECT_EQ(CheckedInt({"HSETEX", "key", "100", "later", "v"}), 1);
+
+  // The queue is accounted in the table memory, and the tables never shrink.
+  size_t table_mem = GetMetrics().db_stats[0].table_mem_usage;
+
+  AdvanceTime(10'000);
+  shard_set->RunBlockingInParallel([](EngineShard* shard) {
+    DbContext cntx{&namespaces->GetDefaultNamespace(), 0, GetCurrentTimeMs()};
+    cntx.GetDbSlice(shard->shard_id()).ReapExpiredFields(cntx, 1024);
+  });
+
+  EXPECT_LT(GetMetrics().db_stats[0].table_mem_usage, table_mem);
+  EXPECT_EQ(CheckedInt({"EXISTS", "gone"}), 0);
+  EXPECT_THAT(Run({"HGETALL", "key"}),
+              RespArray(UnorderedElementsAre("keep", "v", "later", "v")));
+
+  // The hash was queued again for the expiry of "later".
+  AdvanceTime(90'000);
+  shard_set->RunBlockingInParallel([](EngineShard* shard) {
+    DbContext cntx{&namespaces->GetDefaultNamespace(), 0, GetCurrentTimeMs()};
+    cntx.GetDbSlice(shard->shard_id()).ReapExpiredFields(cntx, 1024);
+  });
+  EXPECT_THAT(Run({"HGETALL", "key"}), RespArray(ElementsAre("keep", "v")));
+}
+
+TEST_F(HSetFamilyTest, WriteSketchEncodings) {
+  absl::FlagSaver fs;
+  SetTestFlag("hash_write_sketch_counters", "1024");
+  SetTestFlag("lock_on_hashtags", "true");  // keeps RENAME on a single shard.
+  ResetService();
+
+  // The listpacks are larger than a quarter of max_listpack_map_bytes, but far from the limit.
+  vector<string> cmd = {"HSET", "{t}hot"};
+  for (int i = 0; i < 20; ++i) {
+    cmd.push_back(absl::StrCat("field", i));
+    cmd.push_back(string(8, 'v'));
+  }
+  EXPECT_THAT(Run(absl::MakeSpan(cmd)), IntArg(20));
+  cmd[1] = "{t}cold";
+  EXPECT_THAT(Run(absl::MakeSpan(cmd)), IntArg(20));
+
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(CheckedInt({"HSET", "{t}hot", "field0", absl::StrCat(i)}), 0);
+  }
+  EXPECT_EQ(CheckedInt({"HSET", "{t}cold", "field0", "a"}), 0);
+
+  // Only the hash that is written often is promoted.
+  EXPECT_THAT(Run({"debug", "object", "{t}hot"}).GetString(), HasSubstr("encoding:dense_set"));
+  EXPECT_THAT(Run({"debug", "object", "{t}cold"}).GetString(), HasSubstr("encoding:listpack"));
+
+  // Shrink it and move it under a key without recorded writes, so that it is no longer hot.
+  for (int i = 4; i < 20; ++i) {
+    EXPECT_EQ(CheckedInt({"HDEL", "{t}hot", absl::StrCat("field", i)}), 1);
+  }
+  EXPECT_EQ(Run({"RENAME", "{t}hot", "{t}renamed"}), "OK");
+  EXPECT_THAT(Run({"debug", "object", "{t}renamed"}).GetString(),
+              HasSubstr("encoding:dense_set"));
+
+  shard_set->RunBriefInParallel([](EngineShard* shard) {
+    DbSlice& db_slice = namespaces->GetDefaultNamespace().GetDbSlice(shard->shard_id());
+    PrimeTable::Cursor cursor;
+    do {
+      cursor = HSetFamily::DemoteColdHashes(0, cursor, &db_slice);
+    } while (cursor);
+  });
+
+  EXPECT_THAT(Run({"debug", "object", "{t}renamed"}).GetString(),
+              HasSubstr("encoding:listpack"));
+  EXPECT_THAT(Run({"HGETALL", "{t}renamed"}),
+              RespArray(UnorderedElementsAre("field0", "9", "field1", "vvvvvvvv", "field2",
+                                             "vvvvvvvv", "field3", "vvvvvvvv")));
+}
+
 TEST_F(HSetFamilyTest, RandomFieldAllExpired) {
   for (int i = 0; i < 10; ++i) {
     EXPECT_EQ(CheckedInt({"HSETEX", "key", "10", absl::StrCat("k", i), "v"}), 1);
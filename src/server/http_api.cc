@@ -95,6 +95,41 @@ std::string JsonEscape(string_view input) {
   return out;
 }
 
+bool IsVectorOfCommands(flexbuffers::Reference req) {
+  if (!req.IsVector()) {
+    return false;
+  }
+
+  auto vec = req.AsVector();
+  if (vec.size() == 0) {
+    return false;
+  }
+
+  for (size_t i = 0; i < vec.size(); ++i) {
+    if (!IsVectorOfStrings(vec[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Parses the json body into fbb, returns nullopt if it's not valid json.
+optional<flexbuffers::Reference> ParseBody(const string& body, flexbuffers::Builder* fbb) {
+  flatbuffers::Parser parser;
+  if (!parser.ParseFlexBuffer(body.c_str(), nullptr, fbb))
+    return nullopt;
+  fbb->Finish();
+  return flexbuffers::GetRoot(fbb->GetBuffer());
+}
+
+void ReplyBadRequest(const string& body, HttpContext* http_cntx) {
+  VLOG(1) << "Invalid body " << body;
+  auto response = http::MakeStringResponse(h2::status::bad_request);
+  http::SetMime(http::kTextMime, &response);
+  response.body() = "Failed to parse json\r\n";
+  http_cntx->Invoke(std::move(response));
+}
+
 struct CaptureVisitor {
   CaptureVisitor() {
     str = R"({"result":)";
@@ -154,6 +189,115 @@ struct CaptureVisitor {
   string str;
 };
 
+// Renders replies as json while they are sent, without capturing them first. Every top level
+// reply becomes an element of the batch array, {"result":<value>} or {"error": "<message>"}.
+// Collections are rendered as arrays, maps as flat arrays of keys and values.
+class JsonReplyBuilder : public facade::RedisReplyBuilder {
+ public:
+  JsonReplyBuilder() : RedisReplyBuilder{nullptr} {
+    out_.push_back('[');
+  }
+
+  using RedisReplyBuilder::SendError;
+  void SendError(string_view str, string_view type) override {
+    string error = absl::StrCat(R"({"error": )", JsonEscape(str), "}");
+    if (!collections_.empty())
+      return SendValue(error);
+
+    if (replies_++ > 0)
+      out_.push_back(',');
+    out_.append(error);
+  }
+
+  void SendProtocolError(string_view str) override {
+    SendError(str, "");
+  }
+
+  void SendLong(long val) override {
+    SendValue(absl::StrCat(val));
+  }
+
+  void SendDouble(double val) override {
+    SendValue(absl::StrCat(val));
+  }
+
+  void SendSimpleString(string_view str) override {
+    SendValue(JsonEscape(str));
+  }
+
+  void SendBulkString(string_view str) override {
+    SendValue(JsonEscape(str));
+  }
+
+  void SendVerbatimString(string_view str, VerbatimFormat format) override {
+    SendValue(JsonEscape(str));
+  }
+
+  void SendNull() override {
+    SendValue("null");
+  }
+
+  void SendNullArray() override {
+    SendValue("null");
+  }
+
+  void StartCollection(unsigned len, CollectionType type) override {
+    StartValue();
+    out_.push_back('[');
+    unsigned elements = type == CollectionType::MAP ? len * 2 : len;
+    if (elements > 0) {
+      collections_.push_back({elements, 0});
+      return;
+    }
+    out_.push_back(']');
+    FinishValue();
+  }
+
+  // Returns the rendered batch
+  string Take() {
+    DCHECK(collections_.empty());
+    out_.append("]\r\n");
+    return std::move(out_);
+  }
+
+ private:
+  struct Collection {
+    unsigned len;
+    unsigned sent;
+  };
+
+  void SendValue(string_view json) {
+    StartValue();
+    out_.append(json);
+    FinishValue();
+  }
+
+  void StartValue() {
+    if (collections_.empty()) {
+      if (replies_++ > 0)
+        out_.push_back(',');
+      out_.append(R"({"result":)");
+    } else if (collections_.back().sent > 0) {
+      out_.push_back(',');
+    }
+  }
+
+  // Closes the collections completed by the value and the reply once the top level one is done
+  void FinishValue() {
+    while (!collections_.empty()) {
+      if (++collections_.back().sent < collections_.back().len)
+        return;
+      collections_.pop_back();
+      out_.push_back(']');
+    }
+    out_.push_back('}');
+  }
+
+  string out_;
+  vector<Collection> collections_;  // open collections, innermost last
+  size_t replies_ = 0;
+};
+
 }  // namespace
 
 void HttpAPI(const http::QueryArgs& args, HttpRequest&& req, Service* service,
@@ -161,29 +305,16 @@ void HttpAPI(const http::QueryArgs& args, HttpRequest&& req, Service* service,
   auto& body = req.body();
 
   flexbuffers::Builder fbb;
-  flatbuffers::Parser parser;
-  flexbuffers::Reference doc;
-  bool success = parser.ParseFlexBuffer(body.c_str(), nullptr, &fbb);
-  if (success) {
-    fbb.Finish();
-    doc = flexbuffers::GetRoot(fbb.GetBuffer());
-    if (!IsVectorOfStrings(doc)) {
-      success = false;
-    }
-  }
+  auto doc = ParseBody(body, &fbb);
 
   // TODO: to add a content-type/json check.
-  if (!success) {
-    VLOG(1) << "Invalid body " << body;
-    auto response = http::MakeStringResponse(h2::status::bad_request);
-    http::SetMime(http::kTextMime, &response);
-    response.body() = "Failed to parse json\r\n";
-    http_cntx->Invoke(std::move(response));
+  if (!doc || !IsVectorOfStrings(*doc)) {
+    ReplyBadRequest(body, http_cntx);
     return;
   }
 
   vector<string> cmd_args;
-  flexbuffers::Vector vec = doc.AsVector();
+  flexbuffers::Vector vec = doc->AsVector();
   for (size_t i = 0; i < vec.size(); ++i) {
     cmd_args.push_back(vec[i].AsString().c_str());
   }
@@ -211,4 +342,56 @@ void HttpAPI(const http::QueryArgs& args, HttpRequest&& req, Service* service,
   http_cntx->Invoke(std::move(response));
 }
 
+void HttpBatchAPI(const http::QueryArgs& args, HttpRequest&& req, Service* service,
+                  HttpContext* http_cntx) {
+  auto& body = req.body();
+
+  flexbuffers::Builder fbb;
+  auto doc = ParseBody(body, &fbb);
+  if (!doc || !IsVectorOfCommands(*doc)) {
+    ReplyBadRequest(body, http_cntx);
+    return;
+  }
+
+  // Arguments reference the strings of the parsed buffer
+  flexbuffers::Vector cmds = doc->AsVector();
+  size_t total_args = 0;
+  for (size_t i = 0; i < cmds.size(); ++i) {
+    total_args += cmds[i].AsVector().size();
+  }
+
+  vector<string_view> arg_slices;
+  arg_slices.reserve(total_args);
+  vector<facade::CmdArgList> cmd_args(cmds.size());
+  for (size_t i = 0; i < cmds.size(); ++i) {
+    flexbuffers::Vector vec = cmds[i].AsVector();
+    size_t start = arg_slices.size();
+    for (size_t j = 0; j < vec.size(); ++j) {
+      flexbuffers::String str = vec[j].AsString();
+      arg_slices.emplace_back(str.c_str(), str.size());
+    }
+    cmd_args[i] = facade::CmdArgList{arg_slices.data() + start, vec.size()};
+  }
+
+  facade::ConnectionContext* context = (facade::ConnectionContext*)http_cntx->user_data();
+  DCHECK(context);
+
+  JsonReplyBuilder reply_builder;
+  absl::Span<facade::CmdArgList> pending = absl::MakeSpan(cmd_args);
+  while (!pending.empty()) {
+    // Like pipelines, dispatch commands one by one while squashing is not possible
+    size_t dispatched = service->DispatchManyCommands(pending, &reply_builder, context);
+    if (dispatched == 0) {
+      service->DispatchCommand(pending.front(), &reply_builder, context);
+      dispatched = 1;
+    }
+    pending.remove_prefix(dispatched);
+  }
+
+  auto response = http::MakeStringResponse();
+  http::SetMime(http::kJsonMime, &response);
+  response.body() = reply_builder.Take();
+  http_cntx->Invoke(std::move(response));
+}
+
 }  // namespace dfly
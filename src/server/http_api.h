@@ -23,4 +23,16 @@ using HttpRequest = util::HttpListenerBase::RequestType;
 void HttpAPI(const util::http::QueryArgs& args, HttpRequest&& req, Service* service,
              util::HttpContext* http_cntxt);
 
+/**
+ * @brief Dispatches a batch of commands with pipeline semantics, squashing them when possible.
+ *
+ * @param req  - http request with a body that should consist of a json array of commands,
+ *               aka `[["set", "foo", "bar"], ["get", "foo"]]`. The reply is an array with
+ *               `{"result": ...}` or `{"error": ...}` for every command, in order.
+ *
+ * See HttpAPI for the other parameters.
+ */
+void HttpBatchAPI(const util::http::QueryArgs& args, HttpRequest&& req, Service* service,
+                  util::HttpContext* http_cntxt);
+
 }  // namespace dfly
@@ -94,6 +94,11 @@ size_t CmdSerializer::SerializeEntry(string_view key, const PrimeValue& pk, cons
         use_restore_serialization = false;
         break;
       case OBJ_STRING:
+        if (!pv.IsExternal()) {
+          commands = SerializeString(key, pv);
+          use_restore_serialization = false;
+        }
+        break;
       case OBJ_STREAM:
       case OBJ_JSON:
       case OBJ_SBF:
@@ -204,6 +209,20 @@ size_t CmdSerializer::SerializeList(string_view key, const PrimeValue& pv) {
   return commands;
 }
 
+size_t CmdSerializer::SerializeString(string_view key, const PrimeValue& pv) {
+  string tmp;
+  string_view value = pv.GetSlice(&tmp);
+
+  // The first chunk replaces the value, the rest are appended to it.
+  size_t commands = 0;
+  for (size_t pos = 0; pos < value.size(); pos += max_serialization_buffer_size_) {
+    string_view chunk = value.substr(pos, max_serialization_buffer_size_);
+    SerializeCommand(pos == 0 ? "SET" : "APPEND", {key, chunk});
+    ++commands;
+  }
+  return commands;
+}
+
 void CmdSerializer::SerializeRestore(string_view key, const PrimeValue& pk, const PrimeValue& pv,
                                      uint64_t expire_ms) {
   absl::InlinedVector<string_view, 5> args;
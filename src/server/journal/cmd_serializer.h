@@ -15,7 +15,7 @@ namespace dfly {
 
 // CmdSerializer serializes DB entries (key+value) into command(s) in RESP format string.
 // Small entries are serialized as RESTORE commands, while bigger ones (see
-// serialization_max_chunk_size) are split into multiple commands (like rpush, hset, etc).
+// serialization_max_chunk_size) are split into multiple commands (like rpush, hset, append etc).
 // Expiration and stickiness are also serialized into commands.
 class CmdSerializer {
  public:
@@ -36,6 +36,7 @@ class CmdSerializer {
   size_t SerializeZSet(std::string_view key, const PrimeValue& pv);
   size_t SerializeHash(std::string_view key, const PrimeValue& pv);
   size_t SerializeList(std::string_view key, const PrimeValue& pv);
+  size_t SerializeString(std::string_view key, const PrimeValue& pv);
   void SerializeRestore(std::string_view key, const PrimeValue& pk, const PrimeValue& pv,
                         uint64_t expire_ms);
 
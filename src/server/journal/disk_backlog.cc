@@ -0,0 +1,218 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/journal/disk_backlog.h"
+
+#include <absl/strings/str_cat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "absl/base/internal/endian.h"
+#include "base/logging.h"
+
+namespace dfly {
+namespace journal {
+using namespace std;
+
+namespace {
+
+// Record layout: entry size (4 bytes) followed by the serialized entry.
+constexpr size_t kRecordHeaderSize = 4;
+constexpr size_t kIndexStride = 64;
+constexpr size_t kWriteBufSize = 64 * 1024;
+constexpr size_t kReadAheadSize = 64 * 1024;
+
+}  // namespace
+
+DiskBacklog::DiskBacklog(string dir, string name, size_t segment_bytes, size_t max_bytes)
+    : dir_(std::move(dir)),
+      name_(std::move(name)),
+      segment_bytes_(segment_bytes),
+      max_bytes_(max_bytes) {
+}
+
+DiskBacklog::~DiskBacklog() {
+  Reset();
+}
+
+error_code DiskBacklog::Append(LSN lsn, string_view data) {
+  if (!segments_.empty() && segments_.back().end_lsn != lsn)
+    Reset();
+
+  if (segments_.empty() || segments_.back().size >= segment_bytes_) {
+    if (error_code ec = FlushWrites(); ec)
+      return ec;
+    if (error_code ec = OpenSegment(lsn); ec)
+      return ec;
+  }
+
+  Segment& segment = segments_.back();
+  if ((lsn - segment.first_lsn) % kIndexStride == 0)
+    segment.index.push_back(segment.size);
+
+  char header[kRecordHeaderSize];
+  absl::little_endian::Store32(header, data.size());
+  write_buf_.append(header, kRecordHeaderSize);
+  write_buf_.append(data);
+
+  segment.size += kRecordHeaderSize + data.size();
+  segment.end_lsn = lsn + 1;
+  bytes_ += kRecordHeaderSize + data.size();
+
+  if (write_buf_.size() >= kWriteBufSize) {
+    if (error_code ec = FlushWrites(); ec)
+      return ec;
+  }
+
+  while (bytes_ > max_bytes_ && segments_.size() > 1)
+    DropFront();
+
+  return {};
+}
+
+bool DiskBacklog::Contains(LSN lsn) const {
+  return !segments_.empty() && segments_.front().first_lsn <= lsn &&
+         lsn < segments_.back().end_lsn;
+}
+
+string_view DiskBacklog::Get(LSN lsn) const {
+  DCHECK(Contains(lsn));
+
+  auto it = upper_bound(segments_.begin(), segments_.end(), lsn,
+                        [](LSN lsn, const Segment& s) { return lsn < s.first_lsn; });
+  DCHECK(it != segments_.begin());
+  const Segment& segment = *--it;
+
+  // Partial sync reads entries one after another, so continue from the previous one if possible.
+  size_t offset, skip;
+  if (lsn == cursor_lsn_ && lsn < segment.end_lsn && cursor_offset_ < segment.size &&
+      lsn > segment.first_lsn) {
+    offset = cursor_offset_;
+    skip = 0;
+  } else {
+    size_t pos = lsn - segment.first_lsn;
+    offset = segment.index[pos / kIndexStride];
+    skip = pos % kIndexStride;
+  }
+
+  char header[kRecordHeaderSize];
+  while (true) {
+    if (!ReadAt(segment, offset, kRecordHeaderSize, header))
+      return {};
+
+    size_t len = absl::little_endian::Load32(header);
+    offset += kRecordHeaderSize;
+    if (skip == 0) {
+      entry_.resize(len);
+      if (!ReadAt(segment, offset, len, entry_.data()))
+        return {};
+
+      cursor_lsn_ = lsn + 1;
+      cursor_offset_ = offset + len;
+      return entry_;
+    }
+    offset += len;
+    --skip;
+  }
+}
+
+void DiskBacklog::Reset() {
+  for (const Segment& segment : segments_) {
+    close(segment.fd);
+    unlink(segment.path.c_str());
+  }
+  segments_.clear();
+  write_buf_.clear();
+  bytes_ = 0;
+
+  read_fd_ = -1;
+  read_buf_.clear();
+  cursor_lsn_ = 0;
+}
+
+error_code DiskBacklog::OpenSegment(LSN first_lsn) {
+  Segment segment;
+  segment.first_lsn = segment.end_lsn = first_lsn;
+  segment.path = absl::StrCat(dir_, "/", name_, "-", next_segment_id_++, ".log");
+  segment.fd = open(segment.path.c_str(), O_CREAT | O_TRUNC | O_RDWR | O_CLOEXEC, 0644);
+  if (segment.fd < 0)
+    return error_code{errno, system_category()};
+
+  segments_.push_back(std::move(segment));
+  return {};
+}
+
+error_code DiskBacklog::FlushWrites() {
+  if (write_buf_.empty())
+    return {};
+
+  Segment& segment = segments_.back();
+  size_t written = 0;
+  while (written < write_buf_.size()) {
+    ssize_t res = pwrite(segment.fd, write_buf_.data() + written, write_buf_.size() - written,
+                         segment.flushed + written);
+    if (res < 0) {
+      if (errno == EINTR)
+        continue;
+      return error_code{errno, system_category()};
+    }
+    written += res;
+  }
+
+  segment.flushed += written;
+  write_buf_.clear();
+  return {};
+}
+
+void DiskBacklog::DropFront() {
+  const Segment& segment = segments_.front();
+  if (read_fd_ == segment.fd)
+    read_fd_ = -1;
+
+  bytes_ -= segment.size;
+  close(segment.fd);
+  unlink(segment.path.c_str());
+  segments_.pop_front();
+}
+
+bool DiskBacklog::ReadAt(const Segment& segment, size_t offset, size_t len, char* dest) const {
+  DCHECK_LE(offset + len, segment.size);
+
+  // Records are flushed whole, so a record is either in the file or in the write buffer.
+  if (offset >= segment.flushed) {
+    DCHECK(&segment == &segments_.back());
+    memcpy(dest, write_buf_.data() + offset - segment.flushed, len);
+    return true;
+  }
+
+  bool cached = read_fd_ == segment.fd && offset >= read_offset_ &&
+                offset + len <= read_offset_ + read_buf_.size();
+  if (!cached) {
+    read_buf_.resize(min(max(len, kReadAheadSize), segment.flushed - offset));
+    size_t read = 0;
+    while (read < read_buf_.size()) {
+      ssize_t res = pread(segment.fd, read_buf_.data() + read, read_buf_.size() - read,
+                          offset + read);
+      if (res < 0 && errno == EINTR)
+        continue;
+      if (res <= 0) {
+        LOG(ERROR) << "Failed to read replication backlog " << segment.path << ": "
+                   << error_code{errno, system_category()}.message();
+        read_fd_ = -1;
+        return false;
+      }
+      read += res;
+    }
+    read_fd_ = segment.fd;
+    read_offset_ = offset;
+  }
+
+  memcpy(dest, read_buf_.data() + offset - read_offset_, len);
+  return true;
+}
+
+}  // namespace journal
+}  // namespace dfly
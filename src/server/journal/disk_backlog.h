@@ -0,0 +1,82 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <deque>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "server/journal/types.h"
+
+namespace dfly {
+namespace journal {
+
+// Append-only continuation of the in-memory replication backlog. Serialized journal entries that
+// fall out of the ring buffer are appended to segment files, so partial sync can be served after
+// the ring buffer wrapped around. The oldest segments are removed once max_bytes is exceeded.
+//
+// Appends are buffered and written with blocking syscalls, since the journal can not preempt
+// while it adds records. Lookups are served with positional reads through a small read-ahead
+// window, which makes the sequential access of partial sync cheap.
+class DiskBacklog {
+ public:
+  DiskBacklog(std::string dir, std::string name, size_t segment_bytes, size_t max_bytes);
+  ~DiskBacklog();
+
+  // Append entry with the given lsn. Entries must be appended in order, a gap resets the backlog.
+  std::error_code Append(LSN lsn, std::string_view data);
+
+  bool Contains(LSN lsn) const;
+
+  // Returns entry with lsn, which must be contained. The view is valid until the next call.
+  std::string_view Get(LSN lsn) const;
+
+  // Remove all entries and their files.
+  void Reset();
+
+  size_t Bytes() const {
+    return bytes_;
+  }
+
+ private:
+  struct Segment {
+    LSN first_lsn = 0;
+    LSN end_lsn = 0;  // lsn following the last entry
+    int fd = -1;
+    size_t size = 0;     // total size including bytes in write_buf_
+    size_t flushed = 0;  // bytes written to the file
+    std::vector<uint64_t> index;  // offset of every kIndexStride-th entry
+    std::string path;
+  };
+
+  std::error_code OpenSegment(LSN first_lsn);
+  std::error_code FlushWrites();
+  void DropFront();
+
+  // Read len bytes at offset of the segment, either from the file or from the write buffer.
+  bool ReadAt(const Segment& segment, size_t offset, size_t len, char* dest) const;
+
+  std::string dir_, name_;
+  size_t segment_bytes_, max_bytes_;
+
+  std::deque<Segment> segments_;
+  uint64_t next_segment_id_ = 0;
+  size_t bytes_ = 0;
+
+  std::string write_buf_;  // tail of the last segment that was not written yet
+
+  // Read-ahead window of the last read and the position following the last returned entry.
+  mutable std::string read_buf_;
+  mutable int read_fd_ = -1;
+  mutable size_t read_offset_ = 0;
+  mutable LSN cursor_lsn_ = 0;
+  mutable size_t cursor_offset_ = 0;
+  mutable std::string entry_;
+};
+
+}  // namespace journal
+}  // namespace dfly
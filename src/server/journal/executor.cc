@@ -4,6 +4,7 @@
 
 #include "server/journal/executor.h"
 
+#include <absl/container/inlined_vector.h>
 #include <absl/strings/str_cat.h>
 #include <absl/strings/str_split.h>
 
@@ -54,6 +55,18 @@ facade::DispatchResult JournalExecutor::Execute(DbIndex dbid, journal::ParsedEnt
   return Execute(cmd);
 }
 
+size_t JournalExecutor::ExecuteMany(DbIndex dbid,
+                                    absl::Span<journal::ParsedEntry::CmdData* const> cmds) {
+  SelectDb(dbid);
+
+  absl::InlinedVector<CmdArgList, 32> args_list;
+  for (auto* cmd : cmds)
+    args_list.emplace_back(cmd->cmd_args.data(), cmd->cmd_args.size());
+
+  return service_->DispatchManyCommands(absl::MakeSpan(args_list), &reply_builder_,
+                                        &conn_context_);
+}
+
 void JournalExecutor::FlushAll() {
   auto cmd = BuildFromParts("FLUSHALL");
   std::ignore = Execute(cmd);
@@ -26,6 +26,11 @@ class JournalExecutor {
   // Returns the result of Service::DispatchCommand
   facade::DispatchResult Execute(DbIndex dbid, journal::ParsedEntry::CmdData& cmd);
 
+  // Execute a run of commands through Service::DispatchManyCommands, which squashes them into
+  // multi-shard hops. Returns the number of commands that were dispatched, the rest must be
+  // executed separately.
+  size_t ExecuteMany(DbIndex dbid, absl::Span<journal::ParsedEntry::CmdData* const> cmds);
+
   void FlushAll();  // Execute FLUSHALL.
   void FlushSlots(const cluster::SlotRange& slot_range);
 
@@ -81,6 +81,10 @@ LSN Journal::GetLsn() const {
   return journal_slice.cur_lsn();
 }
 
+bool Journal::SetStartLsn(LSN lsn) {
+  return journal_slice.SetStartLsn(lsn);
+}
+
 void Journal::RecordEntry(TxId txid, Op opcode, DbIndex dbid, unsigned shard_cnt,
                           std::optional<SlotId> slot, Entry::Payload payload) {
   journal_slice.AddLogRecord(Entry{txid, opcode, dbid, shard_cnt, slot, std::move(payload)});
@@ -90,6 +94,14 @@ void Journal::SetFlushMode(bool allow_flush) {
   journal_slice.SetFlushMode(allow_flush);
 }
 
+bool Journal::OpenBatch() {
+  return journal_slice.OpenBatch();
+}
+
+void Journal::CloseBatch() {
+  journal_slice.CloseBatch();
+}
+
 size_t Journal::LsnBufferSize() const {
   return journal_slice.GetRingBufferSize();
 }
@@ -98,6 +110,10 @@ size_t Journal::LsnBufferBytes() const {
   return journal_slice.GetRingBufferBytes();
 }
 
+size_t Journal::LsnDiskBytes() const {
+  return journal_slice.GetDiskBacklogBytes();
+}
+
 size_t thread_local JournalFlushGuard::counter_ = 0;
 
 }  // namespace journal
@@ -34,13 +34,22 @@ class Journal {
 
   LSN GetLsn() const;
 
+  // Continues the lsns of this thread from lsn, used by a master restarted from its snapshot.
+  // Returns false if entries were already recorded.
+  bool SetStartLsn(LSN lsn);
+
   void RecordEntry(TxId txid, Op opcode, DbIndex dbid, unsigned shard_cnt,
                    std::optional<SlotId> slot, Entry::Payload payload);
 
   void SetFlushMode(bool allow_flush);
 
+  // See JournalSlice::OpenBatch.
+  bool OpenBatch();
+  void CloseBatch();
+
   size_t LsnBufferSize() const;
   size_t LsnBufferBytes() const;
+  size_t LsnDiskBytes() const;
 
  private:
   mutable util::fb2::Mutex state_mu_;
@@ -72,5 +81,25 @@ class JournalFlushGuard {
   static size_t thread_local counter_;
 };
 
+// Groups the commands recorded during its lifetime into batched entries. Does nothing if the
+// journal is not active or batching is disabled.
+class JournalBatchGuard {
+ public:
+  explicit JournalBatchGuard(Journal* journal)
+      : journal_(journal && journal->OpenBatch() ? journal : nullptr) {
+  }
+
+  ~JournalBatchGuard() {
+    if (journal_)
+      journal_->CloseBatch();
+  }
+
+  JournalBatchGuard(const JournalBatchGuard&) = delete;
+  JournalBatchGuard& operator=(const JournalBatchGuard&) = delete;
+
+ private:
+  Journal* journal_;
+};
+
 }  // namespace journal
 }  // namespace dfly
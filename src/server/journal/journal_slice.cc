@@ -7,6 +7,7 @@
 #include <absl/container/inlined_vector.h>
 #include <absl/flags/flag.h>
 #include <absl/strings/escaping.h>
+#include <absl/strings/match.h>
 #include <absl/strings/str_cat.h>
 #include <fcntl.h>
 
@@ -15,15 +16,31 @@
 #include "base/function2.hpp"
 #include "base/logging.h"
 #include "server/journal/serializer.h"
+#include "util/fibers/proactor_base.h"
 
 ABSL_FLAG(uint32_t, shard_repl_backlog_len, 1 << 10,
           "The length of the circular replication log per shard");
+ABSL_FLAG(std::string, shard_repl_backlog_dir, "",
+          "If set, entries evicted from the replication log are kept in files in this directory, "
+          "so that replicas can partially sync after longer disconnects");
+ABSL_FLAG(uint64_t, shard_repl_backlog_disk_bytes, 1ULL << 30,
+          "Maximum size of the on-disk replication log per shard");
+ABSL_FLAG(bool, journal_batch_commands, false,
+          "Record the commands that a squashed pipeline or transaction executes in one hop on a "
+          "shard as a single journal entry. Replicas must support batched entries");
 
 namespace dfly {
 namespace journal {
 using namespace std;
 using namespace util;
 
+namespace {
+
+constexpr size_t kBacklogSegmentBytes = 64 << 20;
+constexpr uint32_t kMaxBatchCommands = 256;
+
+}  // namespace
+
 JournalSlice::JournalSlice() {
 }
 
@@ -36,11 +53,44 @@ void JournalSlice::Init() {
     return;
 
   ring_buffer_.set_capacity(absl::GetFlag(FLAGS_shard_repl_backlog_len));
+  batch_commands_ = absl::GetFlag(FLAGS_journal_batch_commands);
+
+  if (string dir = absl::GetFlag(FLAGS_shard_repl_backlog_dir); !dir.empty()) {
+    error_code ec;
+    filesystem::create_directories(dir, ec);
+    if (ec) {
+      LOG(ERROR) << "Failed to create replication backlog directory " << dir << ": "
+                 << ec.message();
+      return;
+    }
+
+    // Segments of a previous run can not be used since lsns restart from 1.
+    string name = absl::StrCat("backlog-", fb2::ProactorBase::me()->GetPoolIndex());
+    for (const auto& file : filesystem::directory_iterator(dir, ec)) {
+      if (absl::StartsWith(file.path().filename().string(), name + "-"))
+        filesystem::remove(file.path(), ec);
+    }
+
+    size_t max_bytes = absl::GetFlag(FLAGS_shard_repl_backlog_disk_bytes);
+    disk_backlog_ = make_unique<DiskBacklog>(std::move(dir), std::move(name),
+                                             min(kBacklogSegmentBytes, max_bytes / 4), max_bytes);
+  }
+}
+
+bool JournalSlice::SetStartLsn(LSN lsn) {
+  if (lsn_ != start_lsn_ || batch_cnt_ > 0)
+    return false;
+  lsn_ = start_lsn_ = lsn;
+  return true;
 }
 
 bool JournalSlice::IsLSNInBuffer(LSN lsn) const {
   DCHECK(ring_buffer_.capacity() > 0);
 
+  if (disk_backlog_ && disk_backlog_->Contains(lsn)) {
+    return true;
+  }
+
   if (ring_buffer_.empty()) {
     return false;
   }
@@ -55,6 +105,10 @@ bool JournalSlice::IsLSNInBuffer(LSN lsn) const {
 std::string_view JournalSlice::GetEntry(LSN lsn) const {
   DCHECK(ring_buffer_.capacity() > 0 && IsLSNInBuffer(lsn));
 
+  if (disk_backlog_ && disk_backlog_->Contains(lsn)) {
+    return disk_backlog_->Get(lsn);
+  }
+
   auto start = ring_buffer_.front().lsn;
   DCHECK(ring_buffer_[lsn - start].lsn == lsn);
   return ring_buffer_[lsn - start].data;
@@ -77,6 +131,24 @@ void JournalSlice::SetFlushMode(bool allow_flush) {
 void JournalSlice::AddLogRecord(const Entry& entry) {
   DCHECK(ring_buffer_.capacity() > 0);
 
+  if (batch_open_ && entry.opcode == Op::COMMAND && entry.HasPayload()) {
+    const EntryBase& header = batch_header_;
+    if (batch_cnt_ > 0 && (header.txid != entry.txid || header.dbid != entry.dbid ||
+                           header.slot != entry.slot || batch_cnt_ == kMaxBatchCommands)) {
+      FlushBatch();
+    }
+    if (batch_cnt_ == 0)
+      batch_header_ = entry;
+
+    io::BufSink buf_sink{&batch_buf_};
+    JournalWriter{&buf_sink}.Write(entry.payload);
+    batch_cnt_++;
+    return;
+  }
+
+  // Keep the order of entries.
+  FlushBatch();
+
   JournalItem item;
 
   {
@@ -99,6 +171,44 @@ void JournalSlice::AddLogRecord(const Entry& entry) {
   CallOnChange(&item);
 }
 
+bool JournalSlice::OpenBatch() {
+  if (!batch_commands_ || batch_open_)
+    return false;
+  batch_open_ = true;
+  return true;
+}
+
+void JournalSlice::CloseBatch() {
+  DCHECK(batch_open_);
+  batch_open_ = false;
+  FlushBatch();
+}
+
+void JournalSlice::FlushBatch() {
+  if (batch_cnt_ == 0)
+    return;
+
+  JournalItem item;
+  {
+    FiberAtomicGuard fg;
+    item.opcode = batch_cnt_ > 1 ? Op::COMMAND_BATCH : Op::COMMAND;
+    item.lsn = lsn_++;
+    item.slot = batch_header_.slot;
+
+    io::BufSink buf_sink{&ring_serialize_buf_};
+    JournalWriter writer{&buf_sink};
+    writer.WriteBatch(batch_header_, batch_cnt_, io::View(batch_buf_.InputBuffer()));
+
+    item.data = io::View(ring_serialize_buf_.InputBuffer());
+    ring_serialize_buf_.Clear();
+    batch_buf_.Clear();
+    batch_cnt_ = 0;
+    VLOG(2) << "Writing batch item [" << item.lsn << "]";
+  }
+
+  CallOnChange(&item);
+}
+
 void JournalSlice::CallOnChange(JournalItem* item) {
   // This lock is never blocking because it contends with UnregisterOnChange, which is cpu only.
   // Hence this lock prevents the UnregisterOnChange to start running in the middle of CallOnChange.
@@ -113,6 +223,7 @@ void JournalSlice::CallOnChange(JournalItem* item) {
     const size_t bytes_removed = ring_buffer_.front().data.size() + sizeof(*item);
     DCHECK_GE(ring_buffer_bytes, bytes_removed);
     ring_buffer_bytes -= bytes_removed;
+    SpillToDisk(ring_buffer_.front());
   }
   if (!ring_buffer_.empty()) {
     DCHECK(item->lsn == ring_buffer_.back().lsn + 1);
@@ -151,8 +262,26 @@ size_t JournalSlice::GetRingBufferBytes() const {
   return ring_buffer_bytes;
 }
 
+size_t JournalSlice::GetDiskBacklogBytes() const {
+  return disk_backlog_ ? disk_backlog_->Bytes() : 0;
+}
+
 void JournalSlice::ResetRingBuffer() {
   ring_buffer_.clear();
+  if (disk_backlog_) {
+    disk_backlog_->Reset();
+  }
+}
+
+void JournalSlice::SpillToDisk(const JournalItem& item) {
+  if (!disk_backlog_)
+    return;
+
+  if (error_code ec = disk_backlog_->Append(item.lsn, item.data); ec) {
+    // Partial syncs that need older entries fall back to full sync.
+    LOG(ERROR) << "Disabling the replication backlog on disk: " << ec.message();
+    disk_backlog_.reset();
+  }
 }
 
 }  // namespace journal
@@ -10,6 +10,7 @@
 #include <string_view>
 
 #include "server/common.h"
+#include "server/journal/disk_backlog.h"
 #include "server/journal/types.h"
 
 namespace dfly {
@@ -32,8 +33,18 @@ class JournalSlice {
     return status_ec_;
   }
 
+  // Continues the lsns from lsn. Can be called again to move the start, e.g. back to 1, as long
+  // as no entries were recorded. Returns false otherwise.
+  bool SetStartLsn(LSN lsn);
+
   void AddLogRecord(const Entry& entry);
 
+  // While a batch is open, consecutive commands of one transaction are grouped into a single
+  // COMMAND_BATCH entry, which is added when a different entry is recorded or the batch is
+  // closed. Returns false if batching is disabled or a batch is already open.
+  bool OpenBatch();
+  void CloseBatch();
+
   // Register a callback that will be called every time a new entry is
   // added to the journal.
   // The callback receives the entry and a boolean that indicates whether
@@ -46,7 +57,7 @@ class JournalSlice {
   }
 
   /// Returns whether the journal entry with this LSN is available
-  /// from the buffer.
+  /// from the buffer or the disk backlog.
   bool IsLSNInBuffer(LSN lsn) const;
   std::string_view GetEntry(LSN lsn) const;
   // SetFlushMode with allow_flush=false is used to disable preemptions during
@@ -59,10 +70,15 @@ class JournalSlice {
 
   size_t GetRingBufferSize() const;
   size_t GetRingBufferBytes() const;
+  size_t GetDiskBacklogBytes() const;
   void ResetRingBuffer();
 
  private:
   void CallOnChange(JournalItem* item);
+  void FlushBatch();
+
+  // Move the entry that is about to be evicted from the ring buffer to the disk backlog.
+  void SpillToDisk(const JournalItem& item);
   boost::circular_buffer<JournalItem> ring_buffer_;
   base::IoBuf ring_serialize_buf_;
 
@@ -70,12 +86,22 @@ class JournalSlice {
   std::list<std::pair<uint32_t, JournalConsumerInterface*>> journal_consumers_arr_;
 
   LSN lsn_ = 1;
+  LSN start_lsn_ = 1;  // lsn_ before any entries were recorded.
 
   uint32_t next_cb_id_ = 1;
   std::error_code status_ec_;
   bool enable_journal_flush_ = true;
 
   size_t ring_buffer_bytes = 0;
+
+  // Entries evicted from the ring buffer, if shard_repl_backlog_dir is set.
+  std::unique_ptr<DiskBacklog> disk_backlog_;
+
+  bool batch_commands_ = false;
+  bool batch_open_ = false;
+  uint32_t batch_cnt_ = 0;
+  EntryBase batch_header_{};
+  base::IoBuf batch_buf_;  // serialized commands of the current batch
 };
 
 }  // namespace journal
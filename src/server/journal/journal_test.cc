@@ -1,8 +1,12 @@
+#include <absl/strings/str_cat.h>
+
 #include <random>
 #include <string>
 
 #include "base/gtest.h"
 #include "base/logging.h"
+#include "server/journal/disk_backlog.h"
+#include "server/journal/journal_slice.h"
 #include "server/journal/pending_buf.h"
 #include "server/journal/serializer.h"
 #include "server/journal/types.h"
@@ -127,6 +131,124 @@ TEST(Journal, WriteRead) {
   }
 }
 
+TEST(Journal, CompressedFrames) {
+  StoredSlices slices{};
+  vector<string> values;
+  for (unsigned i = 0; i < 100; i++)
+    values.emplace_back(100, 'a' + i % 26);
+
+  std::vector<Entry> test_entries;
+  for (unsigned i = 0; i < values.size(); i++) {
+    string_view value = values[i];
+    test_entries.emplace_back(i, Op::COMMAND, 0, 1, nullopt,
+                              Entry::Payload("SET", StoreSlice(&slices, "key", value)));
+  }
+
+  // Serialize entries in batches and wrap each batch in a frame.
+  base::IoBuf frames;
+  io::BufSink frames_sink{&frames};
+  JournalFrameEncoder encoder{StreamCompression::LZ4};
+  for (size_t start = 0; start < test_entries.size(); start += 30) {
+    base::IoBuf batch;
+    io::BufSink sink{&batch};
+    JournalWriter writer{&sink};
+    for (size_t i = start; i < min(start + 30, test_entries.size()); i++)
+      writer.Write(test_entries[i]);
+
+    string frame = encoder.Encode(io::View(batch.InputBuffer()));
+    EXPECT_LT(frame.size(), batch.InputLen());
+    ASSERT_FALSE(frames_sink.Write(io::Buffer(frame)));
+  }
+
+  io::BufSource source{&frames};
+  JournalFrameSource frame_source{&source, StreamCompression::LZ4};
+  JournalReader reader{&frame_source, 0};
+  for (auto& expected : test_entries) {
+    auto res = reader.ReadEntry();
+    ASSERT_TRUE(res.has_value());
+    ASSERT_EQ(expected.txid, res->txid);
+    ASSERT_EQ(ExtractPayload(expected), ExtractPayload(*res));
+  }
+}
+
+TEST(Journal, BatchedEntries) {
+  StoredSlices slices{};
+  vector<Entry::Payload> payloads = {Entry::Payload("SET", StoreSlice(&slices, "a", "1")),
+                                     Entry::Payload("INCR", StoreSlice(&slices, "b")),
+                                     Entry::Payload("DEL", StoreSlice(&slices, "c", "d"))};
+
+  base::IoBuf cmds;
+  io::BufSink cmds_sink{&cmds};
+  JournalWriter cmds_writer{&cmds_sink};
+  for (const auto& payload : payloads)
+    cmds_writer.Write(payload);
+
+  // A batch of several commands and a batch of one, which is written as a plain command.
+  base::IoBuf buf;
+  io::BufSink sink{&buf};
+  JournalWriter writer{&sink};
+  EntryBase header{7, Op::COMMAND, 2, 1, nullopt};
+  writer.WriteBatch(header, payloads.size(), io::View(cmds.InputBuffer()));
+  writer.Write(Entry{8, Op::COMMAND, 2, 1, nullopt, payloads[0]});
+
+  io::BufSource source{&buf};
+  JournalReader reader{&source, 0};
+
+  auto res = reader.ReadEntry();
+  ASSERT_TRUE(res.has_value());
+  EXPECT_EQ(res->opcode, Op::COMMAND_BATCH);
+  EXPECT_EQ(res->txid, 7u);
+  EXPECT_EQ(res->dbid, 2u);
+  ASSERT_EQ(res->batch.size(), payloads.size());
+  EXPECT_EQ(ConCat(res->batch[0].cmd_args), "SET a 1 ");
+  EXPECT_EQ(ConCat(res->batch[1].cmd_args), "INCR b ");
+  EXPECT_EQ(ConCat(res->batch[2].cmd_args), "DEL c d ");
+
+  res = reader.ReadEntry();
+  ASSERT_TRUE(res.has_value());
+  EXPECT_EQ(res->opcode, Op::COMMAND);
+  EXPECT_EQ(res->txid, 8u);
+  EXPECT_EQ(ExtractPayload(*res), "SET a 1");
+}
+
+TEST(Journal, DiskBacklog) {
+  string dir = ::testing::TempDir();
+  DiskBacklog backlog{dir, "journal_test", 4096, 16384};
+
+  auto entry = [](LSN lsn) { return absl::StrCat("entry-", lsn, "-", string(lsn % 100, 'x')); };
+  for (LSN lsn = 1; lsn < 2000; lsn++)
+    ASSERT_FALSE(backlog.Append(lsn, entry(lsn)));
+
+  // Old segments were dropped, recent entries are available in order and out of order.
+  EXPECT_FALSE(backlog.Contains(1));
+  EXPECT_FALSE(backlog.Contains(2000));
+  EXPECT_LE(backlog.Bytes(), 16384u + 4096u);
+
+  LSN first = 1999;
+  while (backlog.Contains(first - 1))
+    first--;
+  EXPECT_LT(first, 1900u);
+  for (LSN lsn = first; lsn < 2000; lsn++)
+    EXPECT_EQ(backlog.Get(lsn), entry(lsn));
+  for (LSN lsn = 1999; lsn >= first; lsn -= 7)
+    EXPECT_EQ(backlog.Get(lsn), entry(lsn));
+
+  // A gap in lsns resets the backlog.
+  ASSERT_FALSE(backlog.Append(3000, entry(3000)));
+  EXPECT_FALSE(backlog.Contains(1999));
+  EXPECT_EQ(backlog.Get(3000), entry(3000));
+}
+
+TEST(Journal, StartLsn) {
+  JournalSlice slice;
+  ASSERT_TRUE(slice.SetStartLsn(100));
+  EXPECT_EQ(100u, slice.cur_lsn());
+
+  // The start can be moved back as long as nothing was recorded.
+  ASSERT_TRUE(slice.SetStartLsn(1));
+  EXPECT_EQ(1u, slice.cur_lsn());
+}
+
 TEST(Journal, PendingBuf) {
   PendingBuf pbuf;
 
@@ -6,11 +6,14 @@
 
 #include <system_error>
 
+#include "absl/base/internal/endian.h"
 #include "base/logging.h"
 #include "glog/logging.h"
 #include "io/io.h"
 #include "io/io_buf.h"
 #include "server/common.h"
+#include "server/detail/compressor.h"
+#include "server/detail/decompress.h"
 #include "server/error.h"
 #include "server/journal/types.h"
 #include "server/main_service.h"
@@ -55,13 +58,17 @@ void JournalWriter::Write(const journal::Entry::Payload& payload) {
     this->Write(str);
 }
 
-void JournalWriter::Write(const journal::Entry& entry) {
+void JournalWriter::WriteSelectIfNeeded(const journal::EntryBase& entry) {
   // Check if entry has a new db index and we need to emit a SELECT entry.
   if (entry.opcode != journal::Op::SELECT && entry.opcode != journal::Op::LSN &&
       entry.opcode != journal::Op::PING && (!cur_dbid_ || entry.dbid != *cur_dbid_)) {
     Write(journal::Entry{journal::Op::SELECT, entry.dbid, entry.slot});
     cur_dbid_ = entry.dbid;
   }
+}
+
+void JournalWriter::Write(const journal::Entry& entry) {
+  WriteSelectIfNeeded(entry);
 
   VLOG(1) << "Writing entry " << entry.ToString();
 
@@ -85,6 +92,19 @@ void JournalWriter::Write(const journal::Entry& entry) {
   };
 }
 
+void JournalWriter::WriteBatch(const journal::EntryBase& header, uint32_t cnt,
+                               std::string_view cmds) {
+  DCHECK_GT(cnt, 0u);
+  WriteSelectIfNeeded(header);
+
+  Write(uint8_t(cnt > 1 ? journal::Op::COMMAND_BATCH : journal::Op::COMMAND));
+  Write(header.txid);
+  Write(header.shard_cnt);
+  if (cnt > 1)
+    Write(cnt);
+  sink_->Write(io::Buffer(cmds));
+}
+
 JournalReader::JournalReader(io::Source* source, DbIndex dbid)
     : source_{source}, buf_{4096}, dbid_{dbid} {
 }
@@ -207,6 +227,18 @@ io::Result<journal::ParsedEntry> JournalReader::ReadEntry() {
   SET_OR_UNEXPECT(ReadUInt<uint64_t>(), entry.txid);
   SET_OR_UNEXPECT(ReadUInt<uint32_t>(), entry.shard_cnt);
 
+  if (opcode == journal::Op::COMMAND_BATCH) {
+    uint32_t cnt = 0;
+    SET_OR_UNEXPECT(ReadUInt<uint32_t>(), cnt);
+    entry.batch.resize(cnt);
+    for (auto& cmd : entry.batch) {
+      if (auto ec = ReadCommand(&cmd); ec)
+        return make_unexpected(ec);
+    }
+    VLOG(1) << "Read entry " << entry.ToString();
+    return entry;
+  }
+
   VLOG(1) << "Read entry " << entry.ToString();
 
   auto ec = ReadCommand(&entry.cmd);
@@ -216,4 +248,108 @@ io::Result<journal::ParsedEntry> JournalReader::ReadEntry() {
   return entry;
 }
 
+namespace {
+
+constexpr size_t kFrameHeaderSize = 1 + 4;
+
+}  // namespace
+
+JournalFrameEncoder::JournalFrameEncoder(journal::StreamCompression compression)
+    : compression_(compression) {
+  if (compression == journal::StreamCompression::LZ4)
+    compressor_ = detail::CompressorImpl::CreateLZ4();
+  else if (compression == journal::StreamCompression::ZSTD)
+    compressor_ = detail::CompressorImpl::CreateZstd();
+}
+
+JournalFrameEncoder::~JournalFrameEncoder() = default;
+
+std::string JournalFrameEncoder::Encode(std::string_view batch) {
+  string out(kFrameHeaderSize, '\0');
+  journal::StreamCompression codec = journal::StreamCompression::NONE;
+
+  if (compressor_) {
+    auto res = compressor_->Compress(io::Buffer(batch));
+    if (res && res->size() < batch.size()) {
+      codec = compression_;
+      out.append(reinterpret_cast<const char*>(res->data()), res->size());
+    }
+  }
+  if (codec == journal::StreamCompression::NONE)
+    out.append(batch);
+
+  out[0] = char(codec);
+  absl::little_endian::Store32(out.data() + 1, out.size() - kFrameHeaderSize);
+  return out;
+}
+
+JournalFrameSource::JournalFrameSource(io::Source* upstream,
+                                       journal::StreamCompression compression)
+    : upstream_(upstream) {
+  if (compression == journal::StreamCompression::LZ4)
+    decompressor_ = detail::DecompressImpl::CreateLZ4();
+  else if (compression == journal::StreamCompression::ZSTD)
+    decompressor_ = detail::DecompressImpl::CreateZstd();
+}
+
+JournalFrameSource::~JournalFrameSource() = default;
+
+io::Result<size_t> JournalFrameSource::ReadSome(const iovec* v, uint32_t len) {
+  while (frame_pos_ == frame_.size()) {
+    io::Result<bool> res = ReadFrame();
+    if (!res)
+      return make_unexpected(res.error());
+    if (!*res)
+      return 0;
+  }
+
+  size_t read_total = 0;
+  for (; len > 0 && frame_pos_ < frame_.size(); ++v, --len) {
+    size_t read_sz = min(frame_.size() - frame_pos_, v->iov_len);
+    memcpy(v->iov_base, frame_.data() + frame_pos_, read_sz);
+    frame_pos_ += read_sz;
+    read_total += read_sz;
+  }
+  return read_total;
+}
+
+io::Result<bool> JournalFrameSource::ReadFrame() {
+  uint8_t header[kFrameHeaderSize];
+  io::Result<size_t> res = upstream_->ReadAtLeast(io::MutableBytes{header}, kFrameHeaderSize);
+  if (!res)
+    return make_unexpected(res.error());
+  if (*res == 0)
+    return false;
+  if (*res < kFrameHeaderSize)
+    return make_unexpected(make_error_code(errc::protocol_error));
+
+  auto codec = journal::StreamCompression(header[0]);
+  uint32_t payload_size = absl::little_endian::Load32(header + 1);
+
+  frame_.resize(payload_size);
+  frame_pos_ = 0;
+  auto* dest = reinterpret_cast<uint8_t*>(frame_.data());
+  res = upstream_->ReadAtLeast(io::MutableBytes{dest, payload_size}, payload_size);
+  if (!res)
+    return make_unexpected(res.error());
+  if (*res < payload_size)
+    return make_unexpected(make_error_code(errc::protocol_error));
+
+  if (codec == journal::StreamCompression::NONE)
+    return true;
+
+  if (!decompressor_)
+    return make_unexpected(make_error_code(errc::protocol_error));
+
+  auto unpacked = decompressor_->Decompress(frame_);
+  if (!unpacked)
+    return make_unexpected(unpacked.error());
+
+  // The decompressor appends an rdb opcode after the payload.
+  io::Bytes bytes = (*unpacked)->InputBuffer();
+  frame_.assign(reinterpret_cast<const char*>(bytes.data()), bytes.size() - 1);
+  (*unpacked)->ConsumeInput(bytes.size());
+  return true;
+}
+
 }  // namespace dfly
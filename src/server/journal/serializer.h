@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <memory>
 #include <optional>
 #include <string>
 
@@ -14,6 +15,11 @@
 
 namespace dfly {
 
+namespace detail {
+class CompressorImpl;
+class DecompressImpl;
+}  // namespace detail
+
 // JournalWriter serializes journal entries to a sink.
 // It automatically keeps track of the current database index.
 class JournalWriter {
@@ -24,9 +30,16 @@ class JournalWriter {
   void Write(const journal::Entry& entry);
   void Write(uint64_t v);  // Write packed unsigned integer.
 
+  // Write command of the payload without an entry header, used to build batches.
+  void Write(const journal::Entry::Payload& payload);
+
+  // Write an entry of cnt commands, serialized by the payload overload, under a single header.
+  // A single command is written as a plain COMMAND entry.
+  void WriteBatch(const journal::EntryBase& header, uint32_t cnt, std::string_view cmds);
+
  private:
   void Write(std::string_view sv);  // Write string.
-  void Write(const journal::Entry::Payload& payload);
+  void WriteSelectIfNeeded(const journal::EntryBase& entry);
 
  private:
   io::Sink* sink_;
@@ -65,4 +78,37 @@ struct JournalReader {
   DbIndex dbid_;
 };
 
+// Compressed journal streams consist of frames, each holding a batch of serialized entries:
+// codec (1 byte), payload length (4 bytes) and the payload.
+class JournalFrameEncoder {
+ public:
+  explicit JournalFrameEncoder(journal::StreamCompression compression);
+  ~JournalFrameEncoder();
+
+  // Returns a frame holding the batch. The batch is kept raw if it doesn't compress.
+  std::string Encode(std::string_view batch);
+
+ private:
+  journal::StreamCompression compression_;
+  std::unique_ptr<detail::CompressorImpl> compressor_;
+};
+
+// Source that unpacks frames written by JournalFrameEncoder from the underlying source.
+class JournalFrameSource : public io::Source {
+ public:
+  JournalFrameSource(io::Source* upstream, journal::StreamCompression compression);
+  ~JournalFrameSource();
+
+  io::Result<size_t> ReadSome(const iovec* v, uint32_t len) final;
+
+ private:
+  // Reads and unpacks the next frame. Returns false on a clean end of stream.
+  io::Result<bool> ReadFrame();
+
+  io::Source* upstream_;
+  std::unique_ptr<detail::DecompressImpl> decompressor_;
+  std::string frame_;  // unpacked contents of the current frame
+  size_t frame_pos_ = 0;
+};
+
 }  // namespace dfly
@@ -5,6 +5,7 @@
 #include "server/journal/streamer.h"
 
 #include <absl/functional/bind_front.h>
+#include <absl/functional/function_ref.h>
 
 #include "base/flags.h"
 #include "base/logging.h"
@@ -26,6 +27,14 @@ ABSL_FLAG(uint32_t, migration_buckets_serialization_threshold, 100,
 ABSL_FLAG(uint32_t, migration_buckets_sleep_usec, 100,
           "Sleep time in microseconds after each time we reach "
           "migration_buckets_serialization_threshold");
+ABSL_FLAG(bool, migration_adaptive_pacing, false,
+          "Adapt the number of buckets a slot migration serializes between yields and the sleep "
+          "after them to the load of the shard and to the rate the target applies the stream. "
+          "The migration flags above set the initial values.");
+ABSL_FLAG(uint32_t, migration_pacing_latency_usec, 1000,
+          "Latency budget of adaptive migration pacing: the longest time a migration may hold "
+          "the shard thread between yields, and the wake-up delay above which the shard is "
+          "considered busy with foreground commands.");
 
 ABSL_FLAG(uint32_t, replication_dispatch_threshold, 1500,
           "Number of bytes to aggregate before replication");
@@ -46,6 +55,19 @@ uint32_t migration_buckets_sleep_usec_cached = 100;
 uint32_t replication_dispatch_threshold = 1500;
 uint32_t stalled_writer_base_period_ms = 10;
 
+// Bounds of adaptive migration pacing.
+constexpr uint32_t kMaxPacingBuckets = 100'000;
+constexpr uint32_t kMinPacingSleepUsec = 50;
+constexpr uint32_t kMaxPacingSleepUsec = 10'000;
+
+uint64_t NowUsec() {
+  return fb2::ProactorBase::GetMonotonicTimeNs() / 1000;
+}
+
+// Ack latency is measured for one entry per sampling period.
+constexpr uint64_t kAckSamplePeriodUsec = 1000;
+constexpr size_t kMaxAckSamples = 1024;
+
 }  // namespace
 
 JournalStreamer::JournalStreamer(journal::Journal* journal, ExecutionState* cntx, SendLsn send_lsn,
@@ -74,6 +96,14 @@ void JournalStreamer::ConsumeJournalChange(const JournalItem& item) {
   Write(item.data);
   time_t now = time(nullptr);
   last_lsn_writen_ = item.lsn;
+
+  if (uint64_t now_usec = fb2::ProactorBase::GetMonotonicTimeNs() / 1000;
+      unacked_samples_.empty() || unacked_samples_.back().second + kAckSamplePeriodUsec < now_usec) {
+    if (unacked_samples_.size() == kMaxAckSamples)
+      unacked_samples_.pop_front();
+    unacked_samples_.emplace_back(item.lsn, now_usec);
+  }
+
   // TODO: to chain it to the previous Write call.
   if (send_lsn_ == SendLsn::YES && now - last_lsn_time_ > 3) {
     last_lsn_time_ = now;
@@ -103,6 +133,27 @@ size_t JournalStreamer::UsedBytes() const {
   return pending_buf_.Size();
 }
 
+void JournalStreamer::RecordAck(LSN lsn) {
+  uint64_t now_usec = fb2::ProactorBase::GetMonotonicTimeNs() / 1000;
+  while (!unacked_samples_.empty() && unacked_samples_.front().first < lsn) {
+    ack_latency_usec_.Add(now_usec - unacked_samples_.front().second);
+    unacked_samples_.pop_front();
+  }
+}
+
+auto JournalStreamer::GetStats() const -> Stats {
+  Stats stats;
+  stats.inflight_bytes = in_flight_bytes_;
+  stats.pending_bytes = pending_buf_.Size();
+  stats.sent_bytes = total_sent_;
+  stats.writes = write_count_;
+  stats.forced_writes = forced_write_count_;
+  stats.throttle_count = throttle_count_;
+  stats.throttle_usec = total_throttle_wait_usec_;
+  stats.ack_latency_usec = ack_latency_usec_;
+  return stats;
+}
+
 void JournalStreamer::Write(std::string str) {
   DCHECK(!str.empty());
   DVLOG(3) << "Writing " << str.size() << " bytes";
@@ -143,6 +194,12 @@ void JournalStreamer::StalledDataWriterFiber(std::chrono::milliseconds period_ms
   }
 }
 
+void JournalStreamer::SetCompression(journal::StreamCompression compression) {
+  DCHECK(dest_ == nullptr);
+  if (compression != journal::StreamCompression::NONE)
+    frame_encoder_ = std::make_unique<JournalFrameEncoder>(compression);
+}
+
 void JournalStreamer::AsyncWrite(bool force_send) {
   // Stable sync or RestoreStreamer replication can't write data until
   // previous AsyncWriter finished.
@@ -161,8 +218,24 @@ void JournalStreamer::AsyncWrite(bool force_send) {
 
   in_flight_bytes_ = cur_buf.mem_size;
   total_sent_ += in_flight_bytes_;
+  write_count_++;
+  forced_write_count_ += force_send;
   last_async_write_time_ = fb2::ProactorBase::GetMonotonicTimeNs() / 1000000;
 
+  // The completion length stays the raw batch size, as in_flight_bytes_ accounts for it.
+  if (frame_encoder_) {
+    std::string batch;
+    batch.reserve(cur_buf.mem_size);
+    for (const auto& str : cur_buf.buf)
+      batch.append(str);
+    sending_frame_ = frame_encoder_->Encode(batch);
+
+    iovec v = IoVec(io::Buffer(sending_frame_));
+    dest_->AsyncWrite(&v, 1,
+                      [this, len = in_flight_bytes_](std::error_code ec) { OnCompletion(ec, len); });
+    return;
+  }
+
   const auto v_size = cur_buf.buf.size();
   absl::InlinedVector<iovec, 8> v(v_size);
 
@@ -275,6 +348,10 @@ RestoreStreamer::RestoreStreamer(DbSlice* slice, cluster::SlotSet slots, journal
   DCHECK(slice != nullptr);
   migration_buckets_serialization_threshold_cached =
       absl::GetFlag(FLAGS_migration_buckets_serialization_threshold);
+  pacing_.adaptive = absl::GetFlag(FLAGS_migration_adaptive_pacing);
+  pacing_.latency_usec = absl::GetFlag(FLAGS_migration_pacing_latency_usec);
+  pacing_.buckets = max(migration_buckets_serialization_threshold_cached, 1u);
+  pacing_.sleep_usec = migration_buckets_sleep_usec_cached;
   db_array_ = slice->databases();  // Inc ref to make sure DB isn't deleted while we use it
 }
 
@@ -292,55 +369,90 @@ void RestoreStreamer::Start(util::FiberSocketBase* dest) {
 void RestoreStreamer::Run() {
   VLOG(1) << "RestoreStreamer run";
 
+  auto write_bucket = [this](PrimeTable::bucket_iterator it) {
+    if (!cntx_->IsRunning())  // Could be cancelled any time as Traverse may preempt
+      return;
+
+    db_slice_->FlushChangeToEarlierCallbacks(0 /*db_id always 0 for cluster*/,
+                                             DbSlice::Iterator::FromPrime(it), snapshot_version_);
+
+    if (!cntx_->IsRunning())  // Could have been cancelled in above call too
+      return;
+
+    // Do not progress if we are stalled.
+    ThrottleIfNeeded();
+
+    std::lock_guard guard(big_value_mu_);
+
+    // Locking this never preempts. See snapshot.cc for why we need it.
+    auto* blocking_counter = db_slice_->GetLatch();
+    lock_guard blocking_counter_guard(*blocking_counter);
+
+    stats_.buckets_loop += WriteBucket(it);
+  };
+
+  // If someone else is waiting for the inflight bytes to complete, give it priority.
+  auto output_busy = [this] {
+    return throttle_waiters_ > 0 || inflight_bytes() > replication_stream_output_limit_cached / 3;
+  };
+
+  // With the slot index only the buckets that hold keys of the migrated slots are visited.
+  bool indexed = db_slice_->TraverseSlotBuckets(my_slots_, [&](PrimeTable::bucket_iterator it) {
+    while (cntx_->IsRunning() && output_busy()) {
+      ThisFiber::SleepFor(300us);
+      stats_.iter_skips++;
+    }
+    if (!cntx_->IsRunning())
+      return false;
+
+    PacedStep([&] { write_bucket(it); });
+    return true;
+  });
+
   PrimeTable::Cursor cursor;
-  uint64_t last_yield = 0;
   PrimeTable* pt = &db_array_[0]->prime;
-
   do {
     if (!cntx_->IsRunning())
       return;
+    if (indexed)
+      break;
 
-    // If someone else is waiting for the inflight bytes to complete, give it priority.
     // Apparently, continue goes through the loop by checking the condition below, so we check
     // cursor here as well.
-    if (cursor &&
-        (throttle_waiters_ > 0 || inflight_bytes() > replication_stream_output_limit_cached / 3)) {
+    if (cursor && output_busy()) {
       ThisFiber::SleepFor(300us);
       stats_.iter_skips++;
       continue;
     }
 
-    cursor = pt->TraverseBuckets(cursor, [this](PrimeTable::bucket_iterator it) {
-      if (!cntx_->IsRunning())  // Could be cancelled any time as Traverse may preempt
-        return;
-
-      db_slice_->FlushChangeToEarlierCallbacks(0 /*db_id always 0 for cluster*/,
-                                               DbSlice::Iterator::FromPrime(it), snapshot_version_);
-
-      if (!cntx_->IsRunning())  // Could have been cancelled in above call too
-        return;
-
-      // Do not progress if we are stalled.
-      ThrottleIfNeeded();
-
-      std::lock_guard guard(big_value_mu_);
+    PacedStep([&] { cursor = pt->TraverseBuckets(cursor, write_bucket); });
+  } while (cursor);
 
-      // Locking this never preempts. See snapshot.cc for why we need it.
-      auto* blocking_counter = db_slice_->GetLatch();
-      lock_guard blocking_counter_guard(*blocking_counter);
+  VLOG(1) << "RestoreStreamer finished loop of " << my_slots_.ToSlotRanges().ToString()
+          << ", shard " << db_slice_->shard_id() << ". Buckets looped " << stats_.buckets_loop
+          << (indexed ? " using the slot index" : "");
+}
 
-      stats_.buckets_loop += WriteBucket(it);
-    });
+void RestoreStreamer::PacedStep(absl::FunctionRef<void()> step) {
+  uint64_t start = NowUsec(), throttle_usec_start = total_throttle_wait_usec_;
+  step();
+  // Waiting for the output buffer does not hold the thread.
+  pacing_.busy_usec += NowUsec() - start - (total_throttle_wait_usec_ - throttle_usec_start);
+  if (++pacing_.steps < pacing_.buckets)
+    return;
 
-    if (++last_yield >= migration_buckets_serialization_threshold_cached) {
-      // TODO: to align this with how we sleep in SliceSnapshot::FlushSerialized.
-      ThisFiber::SleepFor(chrono::microseconds(migration_buckets_sleep_usec_cached));
-      last_yield = 0;
-    }
-  } while (cursor);
+  // TODO: to align this with how we sleep in SliceSnapshot::FlushSerialized.
+  uint64_t sleep_start = NowUsec();
+  ThisFiber::SleepFor(chrono::microseconds(pacing_.sleep_usec));
+  uint64_t slept_usec = NowUsec() - sleep_start;
 
-  VLOG(1) << "RestoreStreamer finished loop of " << my_slots_.ToSlotRanges().ToString()
-          << ", shard " << db_slice_->shard_id() << ". Buckets looped " << stats_.buckets_loop;
+  if (pacing_.adaptive) {
+    pacing_.Adapt(pacing_.busy_usec, slept_usec - min<uint64_t>(slept_usec, pacing_.sleep_usec),
+                  throttle_count_ != pacing_.batch_throttles);
+  }
+  pacing_.steps = 0;
+  pacing_.busy_usec = 0;
+  pacing_.batch_throttles = throttle_count_;
 }
 
 void RestoreStreamer::SendFinalize(long attempt) {
@@ -353,7 +465,8 @@ void RestoreStreamer::SendFinalize(long attempt) {
           << " throttle count: " << throttle_count_
           << ", throttle on db update: " << stats_.throttle_on_db_update
           << ", throttle usec on db update: " << stats_.throttle_usec_on_db_update
-          << ", iter_skips: " << stats_.iter_skips;
+          << ", iter_skips: " << stats_.iter_skips << ", pacing buckets: " << pacing_.buckets
+          << ", pacing sleep usec: " << pacing_.sleep_usec;
 
   journal::Entry entry(journal::Op::LSN, attempt);
 
@@ -438,6 +551,22 @@ bool RestoreStreamer::WriteBucket(PrimeTable::bucket_iterator it) {
   return written;
 }
 
+void RestoreStreamer::Pacing::Adapt(uint64_t busy_usec, uint64_t wake_delay_usec,
+                                    bool throttled) {
+  // Serializing more buckets between yields delays foreground commands for longer. A stream that
+  // was throttled is limited by the rate the target applies it, so larger batches do not help.
+  if (busy_usec > latency_usec)
+    buckets = max(buckets / 2, 1u);
+  else if (busy_usec < latency_usec / 2 && !throttled)
+    buckets = min(buckets + buckets / 2 + 1, kMaxPacingBuckets);
+
+  // Other fibers kept the thread busy while we slept, so we back off for longer.
+  if (wake_delay_usec > latency_usec)
+    sleep_usec = clamp(sleep_usec * 2, kMinPacingSleepUsec, kMaxPacingSleepUsec);
+  else
+    sleep_usec /= 2;
+}
+
 void RestoreStreamer::OnDbChange(DbIndex db_index, const DbSlice::ChangeReq& req) {
   std::lock_guard guard(big_value_mu_);
   DCHECK_EQ(db_index, 0) << "Restore migration only allowed in cluster mode in db0";
@@ -6,6 +6,7 @@
 
 #include <deque>
 
+#include "base/histogram.h"
 #include "server/cluster/slot_set.h"
 #include "server/common.h"
 #include "server/db_slice.h"
@@ -21,6 +22,18 @@ namespace dfly {
 class JournalStreamer : public journal::JournalConsumerInterface {
  public:
   enum class SendLsn { NO = 0, YES = 1 };
+
+  struct Stats {
+    size_t inflight_bytes = 0;       // bytes of the socket write in progress
+    size_t pending_bytes = 0;        // bytes waiting to be written
+    uint64_t sent_bytes = 0;         // total bytes passed to socket writes
+    uint64_t writes = 0;             // socket writes
+    uint64_t forced_writes = 0;      // writes of data stalled below the dispatch threshold
+    uint64_t throttle_count = 0;     // times producers waited for the output buffer
+    uint64_t throttle_usec = 0;      // total time producers waited
+    base::Histogram ack_latency_usec;  // time from journaling an entry until it was acked
+  };
+
   JournalStreamer(journal::Journal* journal, ExecutionState* cntx, SendLsn send_lsn,
                   bool is_stable_sync);
   virtual ~JournalStreamer();
@@ -32,6 +45,9 @@ class JournalStreamer : public journal::JournalConsumerInterface {
   // Register journal listener and start writer in fiber.
   virtual void Start(util::FiberSocketBase* dest);
 
+  // Send batches as compressed frames, must be called before Start.
+  void SetCompression(journal::StreamCompression compression);
+
   void ConsumeJournalChange(const journal::JournalItem& item);
 
   // Must be called on context cancellation for unblocking
@@ -40,6 +56,11 @@ class JournalStreamer : public journal::JournalConsumerInterface {
 
   size_t UsedBytes() const;
 
+  // Called when the consumer acknowledged all entries below lsn.
+  void RecordAck(LSN lsn);
+
+  Stats GetStats() const;
+
  protected:
   // TODO: we copy the string on each write because JournalItem may be passed to multiple
   // streamers so we can not move it. However, if we would either wrap JournalItem in shared_ptr
@@ -83,9 +104,18 @@ class JournalStreamer : public journal::JournalConsumerInterface {
 
   PendingBuf pending_buf_;
 
+  // Set if the stream is compressed, sending_frame_ holds the frame of the in-flight batch.
+  std::unique_ptr<JournalFrameEncoder> frame_encoder_;
+  std::string sending_frame_;
+
   // If we are replication in stable sync we can aggregate data before sending
   bool is_stable_sync_;
   size_t in_flight_bytes_ = 0, total_sent_ = 0;
+  uint64_t write_count_ = 0, forced_write_count_ = 0;
+
+  // Sampled lsns with the time they were journaled in usec, removed once acked.
+  std::deque<std::pair<LSN, uint64_t>> unacked_samples_;
+  base::Histogram ack_latency_usec_;
   // Last time that send data in milliseconds
   uint64_t last_async_write_time_ = 0;
   time_t last_lsn_time_ = 0;
@@ -137,6 +167,26 @@ class RestoreStreamer : public JournalStreamer {
     uint64_t iter_skips = 0;
   };
 
+  // Number of buckets serialized between yields of the traversal and the sleep after them.
+  struct Pacing {
+    // Adjusts the values after a batch that held the thread for busy_usec. wake_delay_usec is how
+    // much longer the sleep took, throttled is set if the output buffer was full.
+    void Adapt(uint64_t busy_usec, uint64_t wake_delay_usec, bool throttled);
+
+    bool adaptive = false;
+    uint32_t latency_usec = 0;
+    uint32_t buckets = 0;
+    uint32_t sleep_usec = 0;
+
+    // State of the current batch.
+    uint32_t steps = 0;
+    uint64_t busy_usec = 0;
+    uint64_t batch_throttles = 0;
+  };
+
+  // Runs a step of the traversal and sleeps once a batch of steps has run.
+  void PacedStep(absl::FunctionRef<void()> step);
+
   DbSlice* db_slice_;
   DbTableArray db_array_;
   uint64_t snapshot_version_ = 0;
@@ -144,6 +194,7 @@ class RestoreStreamer : public JournalStreamer {
 
   ThreadLocalMutex big_value_mu_;
   Stats stats_;
+  Pacing pacing_;
 };
 
 }  // namespace dfly
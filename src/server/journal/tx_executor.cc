@@ -62,6 +62,11 @@ void TransactionData::AddEntry(journal::ParsedEntry&& entry) {
       dbid = entry.dbid;
       txid = entry.txid;
       return;
+    case journal::Op::COMMAND_BATCH:
+      batch = std::move(entry.batch);
+      dbid = entry.dbid;
+      txid = entry.txid;
+      return;
     default:
       DCHECK(false) << "Unsupported opcode";
   }
@@ -48,6 +48,7 @@ struct TransactionData {
   TxId txid{0};
   DbIndex dbid{0};
   journal::ParsedEntry::CmdData command;
+  std::vector<journal::ParsedEntry::CmdData> batch;  // commands of a COMMAND_BATCH entry
 
   journal::Op opcode;
   uint64_t lsn = 0;
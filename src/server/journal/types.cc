@@ -4,6 +4,8 @@
 
 #include "server/journal/types.h"
 
+#include <absl/strings/match.h>
+
 namespace dfly::journal {
 
 using namespace std;
@@ -37,6 +39,9 @@ string Entry::ToString() const {
 }
 
 string ParsedEntry::ToString() const {
+  if (!batch.empty())
+    return absl::StrCat("{op=", opcode, ", dbid=", dbid, ", batch=", batch.size(), "}");
+
   string rv = absl::StrCat("{op=", opcode, ", dbid=", dbid, ", cmd='");
   for (auto& arg : cmd.cmd_args) {
     absl::StrAppend(&rv, facade::ToSV(arg));
@@ -47,4 +52,14 @@ string ParsedEntry::ToString() const {
   return rv;
 }
 
+optional<StreamCompression> ParseStreamCompression(string_view name) {
+  if (absl::EqualsIgnoreCase(name, "none"))
+    return StreamCompression::NONE;
+  if (absl::EqualsIgnoreCase(name, "lz4"))
+    return StreamCompression::LZ4;
+  if (absl::EqualsIgnoreCase(name, "zstd"))
+    return StreamCompression::ZSTD;
+  return nullopt;
+}
+
 }  // namespace dfly::journal
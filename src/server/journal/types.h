@@ -13,7 +13,20 @@
 namespace dfly {
 namespace journal {
 
-enum class Op : uint8_t { SELECT = 6, EXPIRED = 9, COMMAND = 10, PING = 13, LSN = 15 };
+// COMMAND_BATCH holds several commands of one transaction under a single header and lsn.
+enum class Op : uint8_t {
+  SELECT = 6,
+  EXPIRED = 9,
+  COMMAND = 10,
+  PING = 13,
+  LSN = 15,
+  COMMAND_BATCH = 16
+};
+
+// Compression of the stable sync stream, negotiated with REPLCONF JOURNAL-COMPRESSION.
+enum class StreamCompression : uint8_t { NONE = 0, LZ4 = 1, ZSTD = 2 };
+
+std::optional<StreamCompression> ParseStreamCompression(std::string_view name);
 
 struct EntryBase {
   TxId txid;
@@ -76,6 +89,7 @@ struct ParsedEntry : public EntryBase {
     size_t cmd_len{0};
   };
   CmdData cmd;
+  std::vector<CmdData> batch;  // commands of a COMMAND_BATCH entry
 
   std::string ToString() const;
 };
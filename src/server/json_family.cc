@@ -4,6 +4,10 @@
 
 #include "server/json_family.h"
 
+#include <list>
+#include <numeric>
+
+#include <absl/container/flat_hash_map.h>
 #include <absl/strings/match.h>
 #include <absl/strings/str_cat.h>
 #include <absl/strings/str_join.h>
@@ -27,6 +31,7 @@
 #include "server/error.h"
 #include "server/journal/journal.h"
 #include "server/search/doc_index.h"
+#include "server/server_state.h"
 #include "server/string_family.h"
 #include "server/tiered_storage.h"
 #include "server/transaction.h"
@@ -40,6 +45,8 @@
 ABSL_FLAG(bool, jsonpathv2, true,
           "If true uses Dragonfly jsonpath implementation, "
           "otherwise uses legacy jsoncons implementation.");
+ABSL_FLAG(uint32_t, json_path_cache_size, 256,
+          "Number of parsed json paths cached per thread, 0 disables the cache.");
 
 namespace dfly {
 
@@ -69,10 +76,10 @@ class JsonAutoUpdater {
                   JsonAutoUpdaterOptions options = {})
       : op_args_(op_args), key_(key), it_(std::move(it)), options_(options) {
     if (!options_.disable_indexing) {
-      op_args.shard->search_indices()->RemoveDoc(key, op_args.db_cntx, it.it->second);
+      doc_snapshot_ = op_args.shard->search_indices()->SnapshotDoc(key, it.it->second);
     }
 
-    /* We need to initialize start memory usage after RemoveDoc because internally RemoveDoc has
+    /* We need to initialize start memory usage after SnapshotDoc because internally it has
     static cache that can allocate/deallocate memory. Because of this, we will
     overestimate/underestimate memory usage for json object. */
     start_size_ = GetMemoryUsage();
@@ -87,6 +94,11 @@ class JsonAutoUpdater {
   void SetJsonSize() {
     set_size_was_called_ = true;
 
+    if (JsonEnconding() == kEncodingJsonFlat) {
+      StoreFlatCopy();
+      return;  // The memory of flat json is not tracked, see CompactObj::MallocUsed.
+    }
+
     ShrinkJsonIfNeeded();
 
     const size_t current = GetMemoryUsage();
@@ -99,7 +111,8 @@ class JsonAutoUpdater {
   }
 
   void AddDocToIndexes() {
-    op_args_.shard->search_indices()->AddDoc(key_, op_args_.db_cntx, GetPrimeValue());
+    op_args_.shard->search_indices()->UpdateDoc(key_, op_args_.db_cntx, GetPrimeValue(),
+                                                doc_snapshot_);
   }
 
   ~JsonAutoUpdater() {
@@ -112,7 +125,7 @@ class JsonAutoUpdater {
 
     it_.post_updater.Run();
 
-    /* We need to call AddDoc after SetJsonSize because internally AddDoc has static cache that can
+    /* We need to call UpdateDoc after SetJsonSize because internally it has static cache that can
     allocate/deallocate memory. Because of this, we will overestimate/underestimate memory usage for
     json object. */
     if (!options_.disable_indexing) {
@@ -124,11 +137,36 @@ class JsonAutoUpdater {
     return it_.it->second;
   }
 
+  // Flat documents are decoded into a copy on the first call, which replaces them in
+  // SetJsonSize().
   JsonType* GetJson() {
-    return GetPrimeValue().GetJson();
+    if (JsonEnconding() == kEncodingJsonCons)
+      return GetPrimeValue().GetJson();
+
+    if (!flat_copy_)
+      flat_copy_ = json::FromFlat(GetFlatJson());
+    return &*flat_copy_;
+  }
+
+  // Flat documents only. Scalars can be updated directly inside the returned buffer.
+  FlatJson GetFlatJson() {
+    auto buf = GetPrimeValue().GetFlatJson();
+    return flexbuffers::GetRoot(buf.data(), buf.size());
   }
 
  private:
+  void StoreFlatCopy() {
+    if (!flat_copy_)
+      return;
+
+    flexbuffers::Builder fbb;
+    json::FromJsonType(*flat_copy_, &fbb);
+    fbb.Finish();
+    const auto& buf = fbb.GetBuffer();
+    GetPrimeValue().SetJson(buf.data(), buf.size());
+    flat_copy_.reset();
+  }
+
   size_t GetMemoryUsage() const {
     return static_cast<MiMemoryResource*>(CompactObj::memory_resource())->used();
   }
@@ -148,10 +186,13 @@ class JsonAutoUpdater {
   string_view key_;
   DbSlice::ItAndUpdater it_;
   JsonAutoUpdaterOptions options_;
+  DocSnapshot doc_snapshot_;  // indexed fields before the update
 
   // Used to track the memory usage of the json object
   size_t start_size_{0};
   bool set_size_was_called_{false};
+
+  std::optional<JsonType> flat_copy_;
 };
 
 template <typename T> using ParseResult = io::Result<T, std::string>;
@@ -164,13 +205,85 @@ ParseResult<JsonExpression> ParseJsonPathAsExpression(std::string_view path) {
   return res;
 }
 
+// LRU cache of parsed json paths. Clients tend to use the same few paths over and over again,
+// so we copy the cached path instead of running the parser.
+class JsonPathCache {
+ public:
+  // Returns nullptr if the path is not cached. Bumps the path up otherwise.
+  const json::Path* Find(std::string_view path, JsonPathType path_type);
+
+  void Insert(std::string_view path, JsonPathType path_type, const json::Path& parsed,
+              size_t capacity);
+
+ private:
+  struct Entry {
+    JsonPathType path_type;
+    std::string path;
+    json::Path parsed;
+  };
+
+  using EntryList = std::list<Entry>;
+
+  // Keys point into the entries they refer to.
+  absl::flat_hash_map<std::string_view, EntryList::iterator> index_[2];
+  EntryList entries_;  // most recently used first.
+};
+
+const json::Path* JsonPathCache::Find(std::string_view path, JsonPathType path_type) {
+  auto& index = index_[unsigned(path_type)];
+  auto it = index.find(path);
+  if (it == index.end())
+    return nullptr;
+
+  entries_.splice(entries_.begin(), entries_, it->second);
+  return &it->second->parsed;
+}
+
+void JsonPathCache::Insert(std::string_view path, JsonPathType path_type, const json::Path& parsed,
+                           size_t capacity) {
+  auto& index = index_[unsigned(path_type)];
+  if (capacity == 0 || index.contains(path))
+    return;
+
+  while (entries_.size() >= capacity) {
+    const Entry& last = entries_.back();
+    index_[unsigned(last.path_type)].erase(last.path);
+    entries_.pop_back();
+  }
+
+  entries_.push_front(Entry{path_type, std::string{path}, parsed});
+  index.emplace(entries_.front().path, entries_.begin());
+}
+
+thread_local JsonPathCache json_path_cache;
+
+// Paths with aggregate functions keep the aggregation state inside their segments and can not be
+// shared.
+bool IsCacheablePath(const json::Path& path) {
+  return std::none_of(path.begin(), path.end(), [](const json::PathSegment& segment) {
+    return segment.type() == json::SegmentType::FUNCTION;
+  });
+}
+
 ParseResult<WrappedJsonPath> ParseJsonPath(StringOrView path, JsonPathType path_type) {
   if (absl::GetFlag(FLAGS_jsonpathv2)) {
+    auto* stats = &ServerState::tlocal()->stats;
+    if (const json::Path* cached = json_path_cache.Find(path.view(), path_type); cached) {
+      ++stats->json_path_cache_hits;
+      return WrappedJsonPath{*cached, std::move(path), path_type};
+    }
+    ++stats->json_path_cache_misses;
+
     auto path_result = json::ParsePath(path.view());
     if (!path_result) {
       VLOG(1) << "Invalid Json path: " << path << ' ' << path_result.error();
       return nonstd::make_unexpected(kSyntaxErr);
     }
+
+    if (IsCacheablePath(*path_result)) {
+      json_path_cache.Insert(path.view(), path_type, *path_result,
+                             absl::GetFlag(FLAGS_json_path_cache_size));
+    }
     return WrappedJsonPath{std::move(path_result).value(), std::move(path), path_type};
   }
 
@@ -450,9 +563,10 @@ OpStatus SetFullJson(const OpArgs& op_args, string_view key, string_view json_st
   RETURN_ON_BAD_STATUS(it_res);
 
   auto type = it_res->it->second.ObjType();
+  DocSnapshot doc_snapshot;
   if (type == OBJ_JSON) {
-    // If it json we need to remove the old json object from the indexes
-    op_args.shard->search_indices()->RemoveDoc(key, op_args.db_cntx, it_res->it->second);
+    // Keep the indexed fields of the old json object to reindex only the changed ones
+    doc_snapshot = op_args.shard->search_indices()->SnapshotDoc(key, it_res->it->second);
   } else if (type != OBJ_STRING) {
     // The object is not a JSON object and not a string, so we cannot set a full JSON value
     return OpStatus::WRONG_TYPE;
@@ -464,10 +578,6 @@ OpStatus SetFullJson(const OpArgs& op_args, string_view key, string_view json_st
   std::optional<JsonType> parsed_json = ShardJsonFromString(json_str);
   if (!parsed_json) {
     VLOG(1) << "got invalid JSON string '" << json_str << "' cannot be saved";
-    if (type == OBJ_JSON) {
-      // We need to add the document to the indexes, because we removed it before
-      op_args.shard->search_indices()->AddDoc(key, op_args.db_cntx, it_res->it->second);
-    }
     return OpStatus::INVALID_JSON;
   }
 
@@ -486,8 +596,9 @@ OpStatus SetFullJson(const OpArgs& op_args, string_view key, string_view json_st
   parsed_json.reset();
   updater.SetJsonSize();
 
-  // We need to manually run add document here
-  op_args.shard->search_indices()->AddDoc(key, op_args.db_cntx, it_res->it->second);
+  // We need to manually update the document here
+  op_args.shard->search_indices()->UpdateDoc(key, op_args.db_cntx, it_res->it->second,
+                                             doc_snapshot);
 
   return OpStatus::OK;
 }
@@ -526,6 +637,19 @@ OpResult<bool> SetPartialJson(const OpArgs& op_args, string_view key,
     return {};
   };
 
+  // Existing scalars of flat documents are replaced in place if the new value fits.
+  if (JsonEnconding() == kEncodingJsonFlat && !parsed_json->is_object() &&
+      !parsed_json->is_array()) {
+    auto in_place_res = json_path.ExecuteMutateCallbackInPlace<Nothing>(
+        updater.GetFlatJson(), mutate_cb, CallbackResultOptions::DefaultMutateOptions());
+    if (in_place_res && path_exists) {
+      parsed_json.reset();
+      updater.SetJsonSize();
+      return value_was_set;
+    }
+    path_exists = value_was_set = false;
+  }
+
   auto mutate_res = json_path.ExecuteMutateCallback<Nothing>(
       updater.GetJson(), mutate_cb, CallbackResultOptions::DefaultMutateOptions());
 
@@ -744,6 +868,16 @@ struct ReadOnlyOperationOptions {
   CallbackResultOptions cb_result_options = CallbackResultOptions::DefaultReadOnlyOptions();
 };
 
+// Returns the document of a json value. Flat documents are decoded into `tmp`.
+const JsonType* GetReadOnlyJson(const PrimeValue& pv, JsonType* tmp) {
+  if (JsonEnconding() == kEncodingJsonCons)
+    return pv.GetJson();
+
+  auto buf = pv.GetFlatJson();
+  *tmp = json::FromFlat(flexbuffers::GetRoot(buf.data(), buf.size()));
+  return tmp;
+}
+
 template <typename T>
 OpResult<JsonCallbackResult<T>> JsonReadOnlyOperation(const OpArgs& op_args, std::string_view key,
                                                       const WrappedJsonPath& json_path,
@@ -760,22 +894,40 @@ OpResult<JsonCallbackResult<T>> JsonReadOnlyOperation(const OpArgs& op_args, std
     return it_res.status();
   }
 
-  JsonType* json_val = it_res.value()->second.GetJson();
+  JsonType tmp;
+  const JsonType* json_val = GetReadOnlyJson(it_res.value()->second, &tmp);
   DCHECK(json_val) << "should have a valid JSON object for key " << key;
 
   return json_path.ExecuteReadOnlyCallback<T>(json_val, cb, options.cb_result_options);
 }
 
+// Mutations that can run in place on flat json pass a callback that drops everything recorded
+// by their mutate callback. It is called if the in-place attempt fails and is replayed on the
+// decoded document.
+using DiscardCallback = absl::FunctionRef<void()>;
+
 template <typename T>
 OpResult<JsonCallbackResult<optional<T>>> JsonMutateOperation(
     const OpArgs& op_args, std::string_view key, const WrappedJsonPath& json_path,
     JsonPathMutateCallback<T> cb,
-    CallbackResultOptions cb_result_options = CallbackResultOptions::DefaultMutateOptions()) {
+    CallbackResultOptions cb_result_options = CallbackResultOptions::DefaultMutateOptions(),
+    std::optional<DiscardCallback> discard_in_place = std::nullopt) {
   auto it_res = op_args.GetDbSlice().FindMutable(op_args.db_cntx, key, OBJ_JSON);
   RETURN_ON_BAD_STATUS(it_res);
 
   JsonAutoUpdater updater(op_args, key, *std::move(it_res));
 
+  // Flat documents are updated in place when possible and decoded otherwise.
+  if (discard_in_place && JsonEnconding() == kEncodingJsonFlat) {
+    auto in_place_res =
+        json_path.ExecuteMutateCallbackInPlace(updater.GetFlatJson(), cb, cb_result_options);
+    if (in_place_res) {
+      updater.SetJsonSize();
+      return *std::move(in_place_res);
+    }
+    (*discard_in_place)();
+  }
+
   auto mutate_res = json_path.ExecuteMutateCallback(updater.GetJson(), cb, cb_result_options);
 
   updater.SetJsonSize();
@@ -799,7 +951,7 @@ OpResult<std::string> OpJsonGet(const OpArgs& op_args, string_view key,
   const JsonType* json_ptr = nullptr;
   JsonType json;
   if (it->second.ObjType() == OBJ_JSON) {
-    json_ptr = it->second.GetJson();
+    json_ptr = GetReadOnlyJson(it->second, &json);
   } else if (it->second.ObjType() == OBJ_STRING) {
     string tmp;
     it->second.GetString(&tmp);
@@ -816,10 +968,16 @@ OpResult<std::string> OpJsonGet(const OpArgs& op_args, string_view key,
   const auto& paths = params.paths;
   const JsonType& json_entry = *json_ptr;
 
+  // The result is serialized straight into the reply string, so matched values are not copied
+  // into a temporary document first.
+  string res;
+
   if (paths.empty()) {
     // this implicitly means that we're using . which
-    // means we just brings all values
-    return json_entry.to_string();
+    // means we just brings all values. The object size is a good guess for the reply length.
+    res.reserve(it->second.MallocUsed());
+    json_entry.dump(res);
+    return res;
   }
 
   json_options options;
@@ -842,48 +1000,72 @@ OpResult<std::string> OpJsonGet(const OpArgs& op_args, string_view key,
     options.after_key_chars(params.space.value());
   }
 
-  auto cb = [](std::string_view, const JsonType& val) { return val; };
+  json_string_encoder encoder(res, options);
 
   const bool legacy_mode_is_enabled = LegacyModeIsEnabled(paths);
   CallbackResultOptions cb_options = CallbackResultOptions::DefaultReadOnlyOptions();
   cb_options.path_type = legacy_mode_is_enabled ? JsonPathType::kLegacy : JsonPathType::kV2;
 
-  auto eval_wrapped = [&](const WrappedJsonPath& json_path) -> std::optional<JsonType> {
-    auto eval_result = json_path.ExecuteReadOnlyCallback<JsonType>(&json_entry, cb, cb_options);
-
-    DCHECK(legacy_mode_is_enabled == eval_result.IsV1());
+  // Writes the result of a single path into the encoder. Returns false if a legacy path does not
+  // match anything.
+  auto dump_wrapped = [&](const WrappedJsonPath& json_path) -> bool {
+    if (legacy_mode_is_enabled) {
+      // Legacy paths return only the last match, so we can not write the values as we find them.
+      if (json_path.RefersToRootElement()) {
+        json_entry.dump(encoder);
+        return true;
+      }
 
-    if (eval_result.IsV1()) {
+      auto cb = [](std::string_view, const JsonType& val) { return val; };
+      auto eval_result = json_path.ExecuteReadOnlyCallback<JsonType>(&json_entry, cb, cb_options);
+      DCHECK(eval_result.IsV1());
       if (eval_result.Empty())
-        return nullopt;
-      return eval_result.AsV1();
+        return false;
+      eval_result.AsV1().dump(encoder);
+      return true;
     }
 
-    return JsonType{eval_result.AsV2()};
+    // Matched values may be temporaries, so they are written while the callback runs.
+    auto cb = [&encoder](std::string_view, const JsonType& val) {
+      val.dump(encoder);
+      return Nothing{};
+    };
+
+    encoder.begin_array();
+    auto eval_result = json_path.ExecuteReadOnlyCallback<Nothing>(&json_entry, cb, cb_options);
+    DCHECK(!eval_result.IsV1());
+    encoder.end_array();
+    return true;
   };
 
-  JsonType out{
-      jsoncons::json_object_arg};  // see https://github.com/danielaparker/jsoncons/issues/482
   if (paths.size() == 1) {
-    auto eval_result = eval_wrapped(paths[0].second);
-    if (!eval_result) {
+    if (!dump_wrapped(paths[0].second)) {
       return OpStatus::INVALID_JSON_PATH;
     }
-    out = std::move(eval_result).value();  // TODO(Print not existing path to the user)
   } else {
-    for (const auto& [path_str, path] : paths) {
-      auto eval_result = eval_wrapped(path);
-      if (legacy_mode_is_enabled && !eval_result) {
+    // Keep the reply identical to a sorted json object keyed by the paths: the keys are ordered
+    // and a repeated path keeps only its last occurrence.
+    vector<size_t> order(paths.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](size_t a, size_t b) { return paths[a].first < paths[b].first; });
+
+    encoder.begin_object();
+    for (size_t i = 0; i < order.size(); ++i) {
+      const auto& [path_str, path] = paths[order[i]];
+      if (i + 1 < order.size() && paths[order[i + 1]].first == path_str)
+        continue;  // the same path follows and produces the same result.
+
+      encoder.key(path_str);
+      if (!dump_wrapped(path)) {
         return OpStatus::INVALID_JSON_PATH;
       }
-      out[path_str] = std::move(eval_result).value();  // TODO(Print not existing path to the user)
     }
+    encoder.end_object();
   }
 
-  jsoncons::json_printable jp(out, options, jsoncons::indenting::indent);
-  std::stringstream ss;
-  jp.dump(ss);
-  return ss.str();
+  encoder.flush();
+  return res;
 }
 
 auto OpType(const OpArgs& op_args, string_view key, const WrappedJsonPath& json_path) {
@@ -949,7 +1131,9 @@ auto OpToggle(const OpArgs& op_args, string_view key,
     }
     return {};
   };
-  return JsonMutateOperation<std::optional<T>>(op_args, key, json_path, std::move(cb));
+  return JsonMutateOperation<std::optional<T>>(op_args, key, json_path, std::move(cb),
+                                               CallbackResultOptions::DefaultMutateOptions(),
+                                               [] {});
 }
 
 template <typename T>
@@ -1048,7 +1232,13 @@ OpResult<string> OpDoubleArithmetic(const OpArgs& op_args, string_view key,
     return {};
   };
 
-  auto res = JsonMutateOperation<Nothing>(op_args, key, json_path, std::move(cb));
+  auto discard = [&] {
+    result = DoubleArithmeticCallbackResult{json_path.IsLegacyModePath()};
+    is_result_overflow = false;
+  };
+
+  auto res = JsonMutateOperation<Nothing>(op_args, key, json_path, std::move(cb),
+                                          CallbackResultOptions::DefaultMutateOptions(), discard);
 
   if (is_result_overflow)
     return OpStatus::INVALID_NUMERIC_RESULT;
@@ -144,6 +144,9 @@ TEST_F(JsonFamilyTest, GetLegacy) {
   resp = Run({"JSON.GET", "json", "$.name", "$.lastSeen"});  // V2 Response
   ASSERT_THAT(resp, "{\"$.lastSeen\":[1478476800],\"$.name\":[\"Leonard Cohen\"]}");
 
+  resp = Run({"JSON.GET", "json", "$.name", "$.lastSeen", "$.name"});  // V2 Response
+  ASSERT_THAT(resp, "{\"$.lastSeen\":[1478476800],\"$.name\":[\"Leonard Cohen\"]}");
+
   json = R"(
     {"a":"first","b":{"field":"second"},"c":{"field":"third"}}
   )";
@@ -3172,4 +3175,29 @@ TEST_F(JsonFamilyTest, DelNonExistingKey) {
   EXPECT_THAT(resp, IntArg(0));
 }
 
+TEST_F(JsonFamilyTest, PathCache) {
+  if (!absl::GetFlag(FLAGS_jsonpathv2)) {
+    GTEST_SKIP() << "The cache is used only by the Dragonfly jsonpath implementation";
+  }
+
+  auto resp = Run({"JSON.SET", "json", "$", R"({"cached_field":[1,2,3]})"});
+  ASSERT_THAT(resp, "OK");
+
+  auto before = GetMetrics().coordinator_stats;
+  for (unsigned i = 0; i < 3; ++i) {
+    resp = Run({"JSON.GET", "json", "$.cached_field"});
+    EXPECT_EQ(resp, "[[1,2,3]]");
+  }
+
+  // Legacy paths are converted to the same v2 path but are cached separately.
+  for (unsigned i = 0; i < 2; ++i) {
+    resp = Run({"JSON.GET", "json", ".cached_field"});
+    EXPECT_EQ(resp, "[1,2,3]");
+  }
+
+  auto after = GetMetrics().coordinator_stats;
+  EXPECT_EQ(after.json_path_cache_misses - before.json_path_cache_misses, 2u);
+  EXPECT_EQ(after.json_path_cache_hits - before.json_path_cache_hits, 3u);
+}
+
 }  // namespace dfly
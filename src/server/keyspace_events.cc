@@ -0,0 +1,95 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/keyspace_events.h"
+
+#include <absl/strings/match.h>
+
+extern "C" {
+#include "redis/redis_aux.h"
+}
+
+namespace dfly::keyspace_events {
+
+using namespace std;
+
+optional<uint32_t> Parse(string_view spec) {
+  if (absl::EqualsIgnoreCase(spec, "ex"))
+    return KEYEVENT | EXPIRED;
+
+  uint32_t flags = 0;
+  for (char c : spec) {
+    switch (c) {
+      case 'K':
+        flags |= KEYSPACE;
+        break;
+      case 'E':
+        flags |= KEYEVENT;
+        break;
+      case 'g':
+        flags |= GENERIC;
+        break;
+      case '$':
+        flags |= STRING;
+        break;
+      case 'l':
+        flags |= LIST;
+        break;
+      case 's':
+        flags |= SET;
+        break;
+      case 'h':
+        flags |= HASH;
+        break;
+      case 'z':
+        flags |= ZSET;
+        break;
+      case 'x':
+        flags |= EXPIRED;
+        break;
+      case 'e':
+        flags |= EVICTED;
+        break;
+      case 't':
+        flags |= STREAM;
+        break;
+      case 'm':
+        flags |= KEY_MISS;
+        break;
+      case 'n':
+        flags |= NEW;
+        break;
+      case 'd':
+        flags |= MODULE;
+        break;
+      case 'A':
+        flags |= ALL;
+        break;
+      default:
+        return nullopt;
+    }
+  }
+  return flags;
+}
+
+uint32_t ClassOfType(unsigned obj_type) {
+  switch (obj_type) {
+    case OBJ_STRING:
+      return STRING;
+    case OBJ_LIST:
+      return LIST;
+    case OBJ_SET:
+      return SET;
+    case OBJ_ZSET:
+      return ZSET;
+    case OBJ_HASH:
+      return HASH;
+    case OBJ_STREAM:
+      return STREAM;
+    default:  // json, bloom filters and other module-like types
+      return MODULE;
+  }
+}
+
+}  // namespace dfly::keyspace_events
@@ -0,0 +1,41 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace dfly::keyspace_events {
+
+// Keyspace notification flags, configured by notify_keyspace_events with the characters of
+// Redis notify-keyspace-events. K and E select the channels, the rest select the event classes.
+enum Flag : uint32_t {
+  KEYSPACE = 1U << 0,   // K: __keyspace@<db>__:<key> carries the events of the key
+  KEYEVENT = 1U << 1,   // E: __keyevent@<db>__:<event> carries the keys of the event
+  GENERIC = 1U << 2,    // g: type independent commands, like DEL, EXPIRE and RENAME
+  STRING = 1U << 3,     // $
+  LIST = 1U << 4,       // l
+  SET = 1U << 5,        // s
+  HASH = 1U << 6,       // h
+  ZSET = 1U << 7,       // z
+  EXPIRED = 1U << 8,    // x
+  EVICTED = 1U << 9,    // e
+  STREAM = 1U << 10,    // t
+  KEY_MISS = 1U << 11,  // m
+  NEW = 1U << 12,       // n
+  MODULE = 1U << 13,    // d
+
+  ALL = GENERIC | STRING | LIST | SET | HASH | ZSET | EXPIRED | EVICTED | STREAM | MODULE,  // A
+};
+
+// Parses the flags, returns nullopt on unknown characters. "ex" is accepted in any case for
+// compatibility and means expiry events on the keyevent channel.
+std::optional<uint32_t> Parse(std::string_view spec);
+
+// Returns the class of write events on values of the given type.
+uint32_t ClassOfType(unsigned obj_type);
+
+}  // namespace dfly::keyspace_events
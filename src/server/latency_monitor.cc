@@ -0,0 +1,44 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/latency_monitor.h"
+
+#include <ctime>
+
+#include "base/cycle_clock.h"
+#include "server/server_state.h"
+
+namespace dfly {
+
+using namespace std;
+
+void LatencyMonitor::Add(string_view event, uint64_t latency_ms, uint64_t unix_sec) {
+  if (threshold_ms_ == 0 || latency_ms < threshold_ms_)
+    return;
+
+  uint32_t ms = min<uint64_t>(latency_ms, UINT32_MAX);
+  Event& ev = events_[event];
+  ev.max_ms = max(ev.max_ms, ms);
+  if (!ev.history.empty() && ev.history.back().unix_sec == unix_sec) {
+    ev.history.back().latency_ms = max(ev.history.back().latency_ms, ms);
+    return;
+  }
+  ev.history.push_back({unix_sec, ms});
+}
+
+LatencyScope::LatencyScope(string_view event) : event_(event) {
+  if (ServerState::tlocal()->latency_monitor().threshold_ms() > 0)
+    start_cycles_ = base::CycleClock::Now();
+}
+
+LatencyScope::~LatencyScope() {
+  if (start_cycles_ == 0)
+    return;
+
+  uint64_t elapsed_ms =
+      (base::CycleClock::Now() - start_cycles_) * 1000 / base::CycleClock::Frequency();
+  ServerState::tlocal()->latency_monitor().Add(event_, elapsed_ms, time(nullptr));
+}
+
+}  // namespace dfly
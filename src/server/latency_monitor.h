@@ -0,0 +1,77 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/container/flat_hash_map.h>
+
+#include <boost/circular_buffer.hpp>
+#include <string>
+#include <string_view>
+
+namespace dfly {
+
+// Records the latency of internal events that may stall a thread, like the heartbeat or
+// eviction steps, for the LATENCY command. Every thread has its own monitor and LATENCY merges
+// them. Only events that take at least threshold_ms are recorded.
+class LatencyMonitor {
+ public:
+  static constexpr size_t kHistoryLen = 160;
+
+  struct Sample {
+    uint64_t unix_sec;
+    uint32_t latency_ms;
+  };
+
+  struct Event {
+    boost::circular_buffer<Sample> history{kHistoryLen};
+    uint32_t max_ms = 0;
+  };
+
+  // Samples of the same second are merged into their maximum.
+  void Add(std::string_view event, uint64_t latency_ms, uint64_t unix_sec);
+
+  // Returns whether the event was recorded.
+  bool Reset(std::string_view event) {
+    return events_.erase(event) > 0;
+  }
+
+  void ResetAll() {
+    events_.clear();
+  }
+
+  const absl::flat_hash_map<std::string, Event>& events() const {
+    return events_;
+  }
+
+  // 0 disables the monitor.
+  uint32_t threshold_ms() const {
+    return threshold_ms_;
+  }
+
+  void set_threshold_ms(uint32_t threshold_ms) {
+    threshold_ms_ = threshold_ms;
+  }
+
+ private:
+  uint32_t threshold_ms_ = 0;
+  absl::flat_hash_map<std::string, Event> events_;
+};
+
+// Measures its lifetime and records it as the event in the monitor of the calling thread.
+class LatencyScope {
+ public:
+  // event must be a literal.
+  explicit LatencyScope(std::string_view event);
+  ~LatencyScope();
+
+  LatencyScope(const LatencyScope&) = delete;
+  LatencyScope& operator=(const LatencyScope&) = delete;
+
+ private:
+  std::string_view event_;
+  uint64_t start_cycles_ = 0;  // 0 if the monitor is disabled
+};
+
+}  // namespace dfly
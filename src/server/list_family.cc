@@ -61,6 +61,9 @@ ABSL_FLAG(int32_t, list_max_listpack_size, -2, "Maximum listpack size, default i
  */
 
 ABSL_FLAG(int32_t, list_compress_depth, 0, "Compress depth of the list. Default is no compression");
+ABSL_FLAG(bool, list_compress_in_background, false,
+          "If true, list nodes beyond list_compress_depth are compressed by a background task once "
+          "they stay untouched for a while, instead of on every write");
 ABSL_RETIRED_FLAG(bool, list_experimental_v2, true,
                   "Enables dragonfly specific implementation of quicklist");
 
@@ -182,8 +185,7 @@ OpResult<string> OpMoveSingleShard(const OpArgs& op_args, string_view src, strin
   src_it = src_res->it;
 
   if (dest_res.is_new) {
-    destql_v2 = CompactObj::AllocateMR<QList>(GetFlag(FLAGS_list_max_listpack_size),
-                                              GetFlag(FLAGS_list_compress_depth));
+    destql_v2 = ListFamily::NewQList();
     dest_res.it->second.InitRobj(OBJ_LIST, kEncodingQL2, destql_v2);
     auto blocking_controller = op_args.db_cntx.ns->GetBlockingController(op_args.shard->shard_id());
     if (blocking_controller) {
@@ -250,8 +252,7 @@ OpResult<uint32_t> OpPush(const OpArgs& op_args, std::string_view key, ListDir d
   QList* ql_v2 = nullptr;
 
   if (res.is_new) {
-    ql_v2 = CompactObj::AllocateMR<QList>(GetFlag(FLAGS_list_max_listpack_size),
-                                          GetFlag(FLAGS_list_compress_depth));
+    ql_v2 = ListFamily::NewQList();
     res.it->second.InitRobj(OBJ_LIST, kEncodingQL2, ql_v2);
   } else {
     DCHECK(res.it->second.ObjType() == OBJ_LIST && res.it->second.Encoding() == kEncodingQL2);
@@ -273,7 +274,7 @@ OpResult<uint32_t> OpPush(const OpArgs& op_args, std::string_view key, ListDir d
 
   if (journal_rewrite && op_args.shard->journal()) {
     string command = dir == ListDir::LEFT ? "LPUSH" : "RPUSH";
-    vector<string_view> mapped(vals.Size() + 1);
+    auto mapped = MakeScratchVector<string_view>(vals.Size() + 1);
     mapped[0] = key;
     std::copy(vals.begin(), vals.end(), mapped.begin() + 1);
     RecordJournal(op_args, command, mapped, 2);
@@ -412,7 +413,9 @@ OpResult<string> OpIndex(const OpArgs& op_args, std::string_view key, long index
   auto it = ql->GetIterator(index);
   if (!it.Next())
     return OpStatus::KEY_NOTFOUND;
-  return it.Get().to_string();
+  string res = it.Get().to_string();
+  ql->RecompressAfterRead(it);
+  return res;
 }
 
 OpResult<vector<uint32_t>> OpPos(const OpArgs& op_args, string_view key, string_view element,
@@ -449,6 +452,7 @@ OpResult<vector<uint32_t>> OpPos(const OpArgs& op_args, string_view key, string_
     }
     index++;
   }
+  ql->RecompressAfterRead(it);
   return matches;
 }
 
@@ -580,29 +584,25 @@ OpStatus OpTrim(const OpArgs& op_args, string_view key, long start, long end) {
   return OpStatus::OK;
 }
 
-OpResult<StringVec> OpRange(const OpArgs& op_args, std::string_view key, long start, long end) {
-  auto res = op_args.GetDbSlice().FindReadOnly(op_args.db_cntx, key, OBJ_LIST);
-  if (!res)
-    return res.status();
-
-  const PrimeValue& pv = (*res)->second;
-  long llen = pv.Size();
-
+// Converts negative indexes and clamps the range to the list. Returns false if it is empty.
+bool NormalizeRange(long llen, long* start, long* end) {
   /* convert negative indexes */
-  if (start < 0)
-    start = llen + start;
-  if (end < 0)
-    end = llen + end;
-  if (start < 0)
-    start = 0;
+  if (*start < 0)
+    *start = llen + *start;
+  if (*end < 0)
+    *end = llen + *end;
+  if (*start < 0)
+    *start = 0;
+  if (*end >= llen)
+    *end = llen - 1;
 
   /* Invariant: start >= 0, so this test will be true when end < 0.
    * The range is empty when start > end or start >= length. */
-  if (start > end || start >= llen) {
-    /* Out of range start or start > end result in empty list */
-    return StringVec{};
-  }
+  return *start <= *end && *start < llen;
+}
 
+// Returns the elements in the normalized range.
+StringVec ReadRange(const PrimeValue& pv, long start, long end) {
   StringVec str_vec;
   container_utils::IterateList(
       pv,
@@ -614,6 +614,26 @@ OpResult<StringVec> OpRange(const OpArgs& op_args, std::string_view key, long st
   return str_vec;
 }
 
+// offload - the list may be pinned instead of read, see OffloadedRead.
+OpResult<StringVec> OpRange(const OpArgs& op_args, std::string_view key, long start, long end,
+                            container_utils::OffloadedRead* offload) {
+  auto& db_slice = op_args.GetDbSlice();
+  auto res = db_slice.FindReadOnly(op_args.db_cntx, key, OBJ_LIST);
+  if (!res)
+    return res.status();
+
+  const PrimeValue& pv = (*res)->second;
+  if (!NormalizeRange(pv.Size(), &start, &end)) {
+    /* Out of range start or start > end result in empty list */
+    return StringVec{};
+  }
+
+  if (offload->TryPin(&db_slice, op_args.db_cntx.db_index, key, pv, end - start + 1))
+    return StringVec{};
+
+  return ReadRange(pv, start, end);
+}
+
 void MoveGeneric(string_view src, string_view dest, ListDir src_dir, ListDir dest_dir,
                  Transaction* tx, SinkReplyBuilder* builder) {
   OpResult<string> result;
@@ -760,7 +780,7 @@ OpResult<string> BPopPusher::RunSingle(time_point tp, Transaction* tx, Connectio
   };
 
   // Block
-  auto status = tx->WaitOnWatch(tp, pop_key_, key_checker, &(cntx->blocked), &(cntx->paused));
+  auto status = tx->WaitOnWatch(tp, pop_key_, key_checker, 1, &(cntx->blocked), &(cntx->paused));
   if (status != OpStatus::OK)
     return status;
 
@@ -789,7 +809,7 @@ OpResult<string> BPopPusher::RunPair(time_point tp, Transaction* tx, ConnectionC
   // Therefore we follow the regular flow of watching the key but for the destination shard it
   // will never be triggerred.
   // This allows us to run Transaction::Execute on watched transactions in both shards.
-  if (auto status = tx->WaitOnWatch(tp, pop_key_, key_checker, &cntx->blocked, &cntx->paused);
+  if (auto status = tx->WaitOnWatch(tp, pop_key_, key_checker, 1, &cntx->blocked, &cntx->paused);
       status != OpStatus::OK)
     return status;
 
@@ -868,7 +888,7 @@ void BPopGeneric(ListDir dir, CmdArgList args, Transaction* tx, SinkReplyBuilder
   };
 
   OpResult<string> popped_key = container_utils::RunCbOnFirstNonEmptyBlocking(
-      tx, OBJ_LIST, std::move(cb), unsigned(timeout * 1000), &cntx->blocked, &cntx->paused);
+      tx, OBJ_LIST, std::move(cb), 1, unsigned(timeout * 1000), &cntx->blocked, &cntx->paused);
 
   auto* rb = static_cast<RedisReplyBuilder*>(builder);
   if (popped_key) {
@@ -1037,8 +1057,8 @@ void ListFamily::BLMPop(CmdArgList args, const CommandContext& cmd_cntx) {
 
   ConnectionContext* conn_cntx = cmd_cntx.conn_cntx;
   OpResult<string> popped_key = container_utils::RunCbOnFirstNonEmptyBlocking(
-      cmd_cntx.tx, OBJ_LIST, std::move(cb), unsigned(timeout * 1000), &conn_cntx->blocked,
-      &conn_cntx->paused);
+      cmd_cntx.tx, OBJ_LIST, std::move(cb), unsigned(min<size_t>(pop_count, UINT32_MAX)),
+      unsigned(timeout * 1000), &conn_cntx->blocked, &conn_cntx->paused);
 
   if (popped_key.ok()) {
     response_builder->StartArray(2);
@@ -1227,11 +1247,18 @@ void ListFamily::LRange(CmdArgList args, const CommandContext& cmd_cntx) {
     return;
   }
 
-  auto cb = [&](Transaction* t, EngineShard* shard) {
-    return OpRange(t->GetOpArgs(shard), key, start, end);
-  };
-
-  auto res = cmd_cntx.tx->ScheduleSingleHopT(std::move(cb));
+  container_utils::OffloadedRead offload{cmd_cntx.tx};
+  OpResult<StringVec> res;
+  offload.Run(
+      cmd_cntx.tx,
+      [&](Transaction* t, EngineShard* shard) {
+        res = OpRange(t->GetOpArgs(shard), key, start, end, &offload);
+      },
+      [&](const PrimeValue& pv) {
+        long s = start, e = end;
+        NormalizeRange(pv.Size(), &s, &e);
+        res = ReadRange(pv, s, e);
+      });
   if (!res && res.status() != OpStatus::KEY_NOTFOUND) {
     return rb->SendError(res.status());
   }
@@ -1332,6 +1359,38 @@ constexpr uint32_t kLMove = WRITE | LIST | SLOW;
 constexpr uint32_t kBLMove = READ | LIST | SLOW | BLOCKING;
 }  // namespace acl
 
+QList* ListFamily::NewQList() {
+  QList* ql = CompactObj::AllocateMR<QList>(GetFlag(FLAGS_list_max_listpack_size),
+                                            GetFlag(FLAGS_list_compress_depth));
+  ql->set_lazy_compression(GetFlag(FLAGS_list_compress_in_background));
+  return ql;
+}
+
+PrimeTable::Cursor ListFamily::CompressColdLists(DbIndex db_ind, PrimeTable::Cursor cursor,
+                                                 DbSlice* db_slice, unsigned* budget) {
+  string scratch;
+
+  auto cb = [&](PrimeIterator it) {
+    PrimeValue& pv = it->second;
+    if (*budget == 0 || pv.ObjType() != OBJ_LIST)
+      return;
+
+    QList* ql = GetQLV2(pv);
+    if (!ql->lazy_compression() || ql->compress_param() == 0)
+      return;
+
+    string_view key = it->first.GetSlice(&scratch);
+    if (!db_slice->CheckLock(IntentLock::EXCLUSIVE, db_ind, key))
+      return;
+
+    size_t orig_heap_size = pv.MallocUsed();
+    *budget -= min(*budget, ql->CompressColdNodes(*budget));
+    db_slice->OnValueReencoded(db_ind, it, key, orig_heap_size);
+  };
+
+  return db_slice->GetDBTable(db_ind)->prime.Traverse(cursor, cb);
+}
+
 void ListFamily::Register(CommandRegistry* registry) {
   registry->StartFamily();
   *registry
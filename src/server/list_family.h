@@ -6,6 +6,7 @@
 
 #include "facade/op_status.h"
 #include "server/common.h"
+#include "server/table.h"
 
 namespace facade {
 class SinkReplyBuilder;
@@ -17,11 +18,21 @@ using facade::OpResult;
 
 class CommandRegistry;
 struct CommandContext;
+class DbSlice;
+class QList;
 
 class ListFamily {
  public:
   static void Register(CommandRegistry* registry);
 
+  // Allocates an empty list with the node size and compression settings of the list_* flags.
+  static QList* NewQList();
+
+  // Compresses the cold nodes of the lazily compressed lists in a single bucket of the table,
+  // visiting at most *budget list nodes and decreasing it accordingly. Returns the next cursor.
+  static PrimeTable::Cursor CompressColdLists(DbIndex db_ind, PrimeTable::Cursor cursor,
+                                              DbSlice* db_slice, unsigned* budget);
+
  private:
   using SinkReplyBuilder = facade::SinkReplyBuilder;
 
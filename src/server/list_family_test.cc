@@ -349,6 +349,41 @@ TEST_F(ListFamilyTest, BLPopMultiPush) {
   ASSERT_EQ(0, NumWatched());
 }
 
+TEST_F(ListFamilyTest, BLPopBatchWakeup) {
+  constexpr unsigned kPoppers = 6;
+  vector<RespExpr> resps(kPoppers + 1);
+  vector<fb2::Fiber> fibers;
+  for (unsigned i = 0; i < kPoppers; ++i) {
+    fibers.push_back(pp_->at(i % pp_->size())->LaunchFiber([&, i] {
+      resps[i] = Run(absl::StrCat("popper", i), {"blpop", kKey1, "0"});
+    }));
+  }
+  fibers.push_back(pp_->at(0)->LaunchFiber([&] {
+    resps[kPoppers] = Run("mpopper", {"blmpop", "0", "1", kKey1, "LEFT", "COUNT", "3"});
+  }));
+
+  ASSERT_TRUE(WaitUntilCondition(
+      [&] { return GetMetrics().facade_stats.conn_stats.num_blocked_clients == kPoppers + 1; },
+      1000ms));
+
+  // A single push serves all the waiters.
+  Run({"rpush", kKey1, "a", "b", "c", "d", "e", "f", "g", "h", "i"});
+  for (auto& fb : fibers)
+    fb.Join();
+
+  unsigned popped = 0;
+  for (unsigned i = 0; i < kPoppers; ++i) {
+    ASSERT_THAT(resps[i], ArrLen(2));
+    popped++;
+  }
+  ASSERT_THAT(resps[kPoppers], ArrLen(2));
+  popped += resps[kPoppers].GetVec()[1].GetVec().size();
+
+  EXPECT_EQ(popped, 9u);
+  EXPECT_THAT(Run({"exists", kKey1}), IntArg(0));
+  ASSERT_EQ(0, NumWatched());
+}
+
 TEST_F(ListFamilyTest, WrongTypeDoesNotWake) {
   RespExpr blpop_resp;
 
@@ -489,6 +524,20 @@ TEST_F(ListFamilyTest, LRem) {
   ASSERT_EQ(resp, "foo");
 }
 
+TEST_F(ListFamilyTest, LRangeOffload) {
+  absl::FlagSaver fs;
+  SetTestFlag("read_offload_min_len", "3");
+
+  Run({"rpush", kKey1, "a", "b", "c", "d", "e"});
+  EXPECT_THAT(Run({"lrange", kKey1, "0", "1"}).GetVec(), ElementsAre("a", "b"));
+  EXPECT_THAT(Run({"lrange", kKey1, "1", "-2"}).GetVec(), ElementsAre("b", "c", "d"));
+  EXPECT_THAT(Run({"lrange", kKey1, "-10", "10"}).GetVec(), ElementsAre("a", "b", "c", "d", "e"));
+  EXPECT_THAT(Run({"lrange", kKey1, "4", "2"}), ArrLen(0));
+
+  EXPECT_EQ(Run({"lpop", kKey1}), "a");
+  EXPECT_THAT(Run({"lrange", kKey1, "0", "-1"}).GetVec(), ElementsAre("b", "c", "d", "e"));
+}
+
 TEST_F(ListFamilyTest, DumpRestorePlain) {
   const string kValue(10'000, '#');
   EXPECT_EQ(CheckedInt({"LPUSH", kKey1, kValue}), 1);
@@ -1497,5 +1546,43 @@ TEST_F(ListFamilyTest, AwakeDb1) {
   f1.Join();
 }
 
+TEST_F(ListFamilyTest, CompressColdLists) {
+  absl::FlagSaver fs;
+  SetTestFlag("list_compress_depth", "1");
+  SetTestFlag("list_compress_in_background", "true");
+  ResetService();
+
+  string val(100, 'a');
+  for (unsigned i = 0; i < 2000; ++i) {
+    Run({"rpush", "list", absl::StrCat(val, i)});
+  }
+  int64_t orig_usage = CheckedInt({"memory", "usage", "list"});
+
+  // The first pass clears the access marks of the new nodes, the second compresses them.
+  for (unsigned pass = 0; pass < 2; ++pass) {
+    shard_set->RunBlockingInParallel([](EngineShard* shard) {
+      DbSlice* db_slice = &namespaces->GetDefaultNamespace().GetDbSlice(shard->shard_id());
+      unsigned budget = 1024;
+      PrimeTable::Cursor cursor;
+      do {
+        cursor = ListFamily::CompressColdLists(0, cursor, db_slice, &budget);
+      } while (cursor);
+    });
+  }
+  int64_t compressed_usage = CheckedInt({"memory", "usage", "list"});
+  EXPECT_LT(compressed_usage, orig_usage / 2);
+
+  // Reads are not accounted, so they must not leave decompressed nodes behind.
+  EXPECT_EQ(absl::StrCat(val, 1000), Run({"lindex", "list", "1000"}));
+  EXPECT_THAT(Run({"lpos", "list", absl::StrCat(val, 1500)}), IntArg(1500));
+  EXPECT_THAT(Run({"lrange", "list", "0", "1200"}), ArrLen(1201));
+  EXPECT_EQ(compressed_usage, CheckedInt({"memory", "usage", "list"}));
+
+  EXPECT_EQ(absl::StrCat(val, 1000), Run({"lindex", "list", "1000"}));
+  EXPECT_EQ(absl::StrCat(val, 0), Run({"lpop", "list"}));
+  EXPECT_EQ(absl::StrCat(val, 1999), Run({"rpop", "list"}));
+  EXPECT_EQ(1998, CheckedInt({"llen", "list"}));
+}
+
 #pragma GCC diagnostic pop
 }  // namespace dfly
@@ -28,7 +28,10 @@ extern "C" {
 
 #include "base/flags.h"
 #include "base/logging.h"
+#include "core/allocation_tracker.h"
+#include "core/task_queue.h"
 #include "facade/dragonfly_connection.h"
+#include "facade/dragonfly_listener.h"
 #include "facade/error.h"
 #include "facade/reply_builder.h"
 #include "facade/reply_capture.h"
@@ -40,7 +43,9 @@ extern "C" {
 #include "server/bloom_family.h"
 #include "server/channel_store.h"
 #include "server/cluster/cluster_family.h"
+#include "server/cluster/multi_key_proxy.h"
 #include "server/conn_context.h"
+#include "server/cpu_profiler.h"
 #include "server/error.h"
 #include "server/generic_family.h"
 #include "server/geo_family.h"
@@ -48,6 +53,7 @@ extern "C" {
 #include "server/hset_family.h"
 #include "server/http_api.h"
 #include "server/json_family.h"
+#include "server/keyspace_events.h"
 #include "server/list_family.h"
 #include "server/multi_command_squasher.h"
 #include "server/namespaces.h"
@@ -77,18 +83,46 @@ ABSL_FLAG(uint16_t, announce_port, 0,
 ABSL_FLAG(uint32_t, memcached_port, 0, "Memcached port");
 
 ABSL_FLAG(uint32_t, num_shards, 0, "Number of database shards, 0 - to choose automatically");
+ABSL_FLAG(uint32_t, dedicated_io_threads, 0,
+          "If positive, splits the threads into shard threads and this many dedicated I/O threads. "
+          "Shards run on the first threads and handle no connections, the last threads parse "
+          "commands, handle TLS and build replies, and hand the work to the shards over the "
+          "shard queues. Connections do not migrate to the shard threads. Overrides num_shards, "
+          "0 - connections and shards share all threads");
 
 ABSL_RETIRED_FLAG(uint32_t, multi_exec_mode, 2, "DEPRECATED. Sets multi exec atomicity mode");
 
 ABSL_FLAG(bool, multi_exec_squash, true,
           "Whether multi exec will squash single shard commands to optimize performance");
 
+ABSL_FLAG(bool, multi_exec_snapshot_reads, true,
+          "Whether multi exec of read-only commands on a single shard runs them in one hop "
+          "without locking their keys ahead, falling back to locking if a write interferes");
+
+ABSL_FLAG(bool, watch_by_version, false,
+          "Whether WATCH records the bucket versions of existing keys and validates them at EXEC "
+          "instead of registering the keys for invalidation by writes");
+
 ABSL_RETIRED_FLAG(bool, track_exec_frequencies, true,
                   "DEPRECATED. Whether to track exec frequencies for multi exec");
 ABSL_FLAG(bool, lua_resp2_legacy_float, false,
           "Return rounded down integers instead of floats for lua scripts with RESP2");
 ABSL_FLAG(uint32_t, multi_eval_squash_buffer, 4096, "Max buffer for squashed commands per script");
 
+ABSL_FLAG(bool, lua_call_fast_path, true,
+          "If true, GET calls of single shard scripts read the value directly from the shard "
+          "instead of going through the full command dispatch");
+
+ABSL_FLAG(bool, lua_shard_fibers, true,
+          "If true, single shard scripts of connections from other threads run in their own fiber "
+          "on the shard thread, so that scripts with disjoint keys do not wait for each other in "
+          "the shard queue. Conflicting scripts are still ordered by their key locks.");
+
+ABSL_FLAG(uint32_t, migrate_connections_affinity_window, 1024,
+          "Number of single shard commands, after which a connection checks whether at least 90% "
+          "of them hit a shard owned by another thread, and if so migrates to that thread. "
+          "0 disables the check. Requires --migrate_connections");
+
 ABSL_DECLARE_FLAG(bool, primary_port_http_enabled);
 ABSL_FLAG(bool, admin_nopass, false,
           "If set, would enable open admin access to console on the assigned port, without "
@@ -127,6 +161,16 @@ ABSL_FLAG(string, huffman_table, "",
           "domain can currently be only KEYS, code is base64 encoded huffman table exported via "
           "DEBUG COMPRESSION EXPORT. if empty no huffman compression is appplied.");
 
+ABSL_FLAG(string, zstd_value_dict, "",
+          "base64 encoded zstd dictionary returned by DEBUG ZSTD-DICT TRAIN. If set, strings "
+          "longer than zstd_value_min_len are compressed with it.");
+
+ABSL_FLAG(std::vector<std::string>, command_costs,
+          std::vector<std::string>({"KEYS:100", "SCAN:10", "SMEMBERS:10", "HGETALL:10",
+                                    "LRANGE:10", "ZRANGE:10", "SORT:10", "SINTER:10", "SUNION:10"}),
+          "Costs of commands as NAME:COST, charged against the ACL ratelimit of the user. Other "
+          "commands cost 1, and commands with several keys are charged per key.");
+
 namespace dfly {
 
 #if defined(__linux__)
@@ -510,6 +554,82 @@ void TxTable(const http::QueryArgs& args, HttpContext* send) {
   send->Invoke(std::move(resp));
 }
 
+// Serves the heap profile sampled by MEMORY TRACK PROFILE START, in the format of pprof.
+void HeapProfile(const http::QueryArgs& args, HttpContext* send) {
+#ifndef DFLY_ENABLE_MEMORY_TRACKING
+  http::StringResponse resp = http::MakeStringResponse(h2::status::not_found);
+  resp.body() = "Memory tracking must be enabled at build time\n";
+  return send->Invoke(std::move(resp));
+#endif
+
+  vector<vector<AllocationTracker::ProfileSample>> thread_samples(shard_set->pool()->size());
+  atomic_size_t sample_period{0};
+  shard_set->pool()->AwaitBrief([&](unsigned index, auto*) {
+    thread_samples[index] = AllocationTracker::Get().GetProfile();
+    if (size_t period = AllocationTracker::Get().profile_sample_period(); period > 0)
+      sample_period.store(period, memory_order_relaxed);
+  });
+
+  if (sample_period.load(memory_order_relaxed) == 0) {
+    http::StringResponse resp = http::MakeStringResponse(h2::status::not_found);
+    resp.body() = "Heap profiling is off, start it with MEMORY TRACK PROFILE START\n";
+    return send->Invoke(std::move(resp));
+  }
+
+  vector<AllocationTracker::ProfileSample> samples;
+  for (auto& thread : thread_samples) {
+    samples.insert(samples.end(), make_move_iterator(thread.begin()),
+                   make_move_iterator(thread.end()));
+  }
+
+  http::StringResponse resp = http::MakeStringResponse(h2::status::ok);
+  resp.body() = AllocationTracker::FormatHeapProfile(samples, sample_period.load());
+  http::SetMime(http::kTextMime, &resp);
+  send->Invoke(std::move(resp));
+}
+
+// Samples the CPU of the proactor threads for ?seconds=N at ?hz=N and serves the profile in the
+// format of pprof, or as folded stacks for flame graphs with ?format=folded.
+void CpuProfile(const http::QueryArgs& args, HttpContext* send) {
+  static atomic_bool running{false};
+
+  unsigned seconds = 10, hz = 100;
+  bool folded = false;
+  for (const auto& [key, value] : args) {
+    if (key == "seconds" && absl::SimpleAtoi(value, &seconds))
+      seconds = clamp(seconds, 1u, 300u);
+    else if (key == "hz" && absl::SimpleAtoi(value, &hz))
+      hz = clamp(hz, 1u, 1000u);
+    else if (key == "format")
+      folded = value == "folded";
+  }
+
+  if (running.exchange(true)) {
+    http::StringResponse resp = http::MakeStringResponse(h2::status::bad_request);
+    resp.body() = "A CPU profile is already running\n";
+    return send->Invoke(std::move(resp));
+  }
+
+  size_t max_samples = size_t(seconds) * hz * 2;
+  shard_set->pool()->AwaitBrief(
+      [&](unsigned, auto*) { CpuProfiler::StartThread(hz, max_samples); });
+  ThisFiber::SleepFor(chrono::seconds(seconds));
+
+  vector<vector<CpuProfiler::Sample>> thread_samples(shard_set->pool()->size());
+  shard_set->pool()->AwaitBrief(
+      [&](unsigned index, auto*) { thread_samples[index] = CpuProfiler::StopThread(); });
+  running.store(false);
+
+  vector<CpuProfiler::Sample> samples;
+  for (const auto& thread : thread_samples)
+    samples.insert(samples.end(), thread.begin(), thread.end());
+
+  http::StringResponse resp = http::MakeStringResponse(h2::status::ok);
+  resp.body() = folded ? CpuProfiler::FormatFolded(samples) : CpuProfiler::FormatPprof(samples, hz);
+  http::SetMime(http::kTextMime, &resp);
+  send->Invoke(std::move(resp));
+}
+
 void ClusterHtmlPage(const http::QueryArgs& args, HttpContext* send,
                      cluster::ClusterFamily* cluster_family) {
   http::StringResponse resp = http::MakeStringResponse(h2::status::ok);
@@ -765,6 +885,26 @@ void SetHuffmanTable(const std::string& huffman_table) {
   }
 }
 
+void SetZstdDict(const std::string& zstd_dict) {
+  if (zstd_dict.empty())
+    return;
+
+  string unescaped;
+  if (!absl::Base64Unescape(zstd_dict, &unescaped)) {
+    LOG(ERROR) << "Failed to decode base64 zstd dictionary";
+    return;
+  }
+
+  // Values may be decoded outside of the shard threads, so every thread gets the dictionary.
+  atomic_bool success = true;
+  shard_set->pool()->AwaitBrief([&](unsigned, auto*) {
+    if (!CompactObj::InitZstdDictThreadLocal(unescaped)) {
+      success = false;
+    }
+  });
+  LOG_IF(ERROR, !success) << "Failed to set zstd dictionary";
+}
+
 }  // namespace
 
 Service::Service(ProactorPool* pp)
@@ -798,6 +938,18 @@ Service::Service(ProactorPool* pp)
   RegisterCommands();
 
   exec_cid_ = FindCmd("EXEC");
+  get_cid_ = FindCmd("GET");
+
+  for (string_view entry : GetFlag(FLAGS_command_costs)) {
+    pair<string_view, string_view> parts = absl::StrSplit(entry, absl::MaxSplits(':', 1));
+    const CommandId* cid = FindCmd(absl::AsciiStrToUpper(parts.first));
+    uint32_t cost = 0;
+    if (!cid || !absl::SimpleAtoi(parts.second, &cost)) {
+      LOG(ERROR) << "Invalid command_costs entry " << entry;
+      exit(1);
+    }
+    command_costs_[cid] = cost;
+  }
 
   engine_varz.emplace("engine", [this] { return GetVarzStats(); });
 }
@@ -861,6 +1013,11 @@ void Service::Init(util::AcceptServer* acceptor, std::vector<facade::Listener*>
         [=](unsigned, auto*) { facade::Connection::SetPipelineSquashLimitThreadLocal(val); });
   });
 
+  config_registry.RegisterSetter<uint32_t>("pipeline_squash_latency_usec", [](uint32_t val) {
+    shard_set->pool()->AwaitBrief(
+        [=](unsigned, auto*) { facade::Connection::SetPipelineSquashLatencyThreadLocal(val); });
+  });
+
   config_registry.RegisterSetter<uint32_t>("pipeline_low_bound_stats", [](uint32_t val) {
     shard_set->pool()->AwaitBrief(
         [=](unsigned, auto*) { facade::Connection::SetPipelineLowBoundStats(val); });
@@ -875,6 +1032,8 @@ void Service::Init(util::AcceptServer* acceptor, std::vector<facade::Listener*>
   config_registry.RegisterMutable("replication_timeout");
   config_registry.RegisterMutable("migration_finalization_timeout_ms");
   config_registry.RegisterMutable("table_growth_margin");
+  config_registry.RegisterSetter<uint64_t>("reserve_keys",
+                                           [](uint64_t val) { shard_set->ReserveKeys(0, val); });
   config_registry.RegisterMutable("tcp_keepalive");
   config_registry.RegisterMutable("timeout");
   config_registry.RegisterMutable("send_timeout");
@@ -883,16 +1042,17 @@ void Service::Init(util::AcceptServer* acceptor, std::vector<facade::Listener*>
   config_registry.RegisterMutable(
       "notify_keyspace_events", [pool = &pp_](const absl::CommandLineFlag& flag) {
         auto res = flag.TryGet<std::string>();
-        if (!res.has_value() || (!res->empty() && !absl::EqualsIgnoreCase(*res, "EX"))) {
+        optional<uint32_t> flags = res ? keyspace_events::Parse(*res) : nullopt;
+        if (!flags.has_value()) {
           return false;
         }
 
-        pool->AwaitBrief([&res](unsigned, auto*) {
+        pool->AwaitBrief([flags = *flags](unsigned, auto*) {
           auto* shard = EngineShard::tlocal();
           if (shard) {
             auto shard_id = shard->shard_id();
             auto& db_slice = namespaces->GetDefaultNamespace().GetDbSlice(shard_id);
-            db_slice.SetNotifyKeyspaceEvents(*res);
+            db_slice.SetNotifyKeyspaceEvents(flags);
           }
         });
 
@@ -913,6 +1073,23 @@ void Service::Init(util::AcceptServer* acceptor, std::vector<facade::Listener*>
     shard_num = pp_.size();
   }
 
+  uint32_t io_threads = GetFlag(FLAGS_dedicated_io_threads);
+  if (io_threads > 0) {
+    if (io_threads >= pp_.size()) {
+      LOG(WARNING) << "dedicated_io_threads (" << io_threads << ") must be smaller than thread "
+                   << "count (" << pp_.size() << "), ignoring it";
+    } else {
+      LOG_IF(WARNING, GetFlag(FLAGS_num_shards) > 0)
+          << "num_shards is ignored because dedicated_io_threads is set";
+      shard_num = pp_.size() - io_threads;
+      for (facade::Listener* listener : listeners)
+        listener->SetConnectionThreads(shard_num, io_threads);
+      dedicated_io_threads_ = true;
+      LOG(INFO) << "Running " << shard_num << " shard threads and " << io_threads
+                << " dedicated I/O threads";
+    }
+  }
+
   // We assume that listeners.front() is the main_listener
   // see dfly_main RunEngine. In unit tests, listeners are empty.
   facade::Listener* main_listener = listeners.empty() ? nullptr : listeners.front();
@@ -923,6 +1100,8 @@ void Service::Init(util::AcceptServer* acceptor, std::vector<facade::Listener*>
     tl_facade_stats = new FacadeStats;
     ServerState::Init(index, shard_num, main_listener, &user_registry_);
     ServerState::tlocal()->UpdateChannelStore(cs);
+    ServerState::tlocal()->StartSchedProbe();
+    OffloadQueue::RegisterThread(pb);
   });
 
   const auto tcp_disabled = GetFlag(FLAGS_port) == 0u;
@@ -943,7 +1122,11 @@ void Service::Init(util::AcceptServer* acceptor, std::vector<facade::Listener*>
   SetSerializationMaxChunkSize(absl::GetFlag(FLAGS_serialization_max_chunk_size));
   SetMaxSquashedCmdNum(absl::GetFlag(FLAGS_max_squashed_cmd_num));
   SetHuffmanTable(absl::GetFlag(FLAGS_huffman_table));
+  SetZstdDict(absl::GetFlag(FLAGS_zstd_value_dict));
   SetMaxBusySquashUsec(absl::GetFlag(FLAGS_max_busy_squash_usec));
+  // Connections must stay on the I/O threads.
+  affinity_window_ =
+      dedicated_io_threads_ ? 0 : absl::GetFlag(FLAGS_migrate_connections_affinity_window);
 
   // Requires that shard_set will be initialized before because server_family_.Init might
   // load the snapshot.
@@ -977,6 +1160,7 @@ void Service::Shutdown() {
   shard_set->PreShutdown();
   shard_set->Shutdown();
   Transaction::Shutdown();
+  OffloadQueue::Shutdown();
 
   pp_.AwaitFiberOnAll([](ProactorBase* pb) { ServerState::tlocal()->Destroy(); });
 
@@ -985,6 +1169,16 @@ void Service::Shutdown() {
   facade::Connection::Shutdown();
 }
 
+uint64_t Service::CommandCost(const CommandId* cid, CmdArgList args) {
+  auto it = command_costs_.find(cid);
+  uint64_t cost = it != command_costs_.end() ? it->second : 1;
+  if (cid->first_key_pos() > 0) {
+    if (OpResult<KeyIndex> key_index = FindKeys(cid, args); key_index)
+      cost *= max(1u, key_index->NumArgs() / key_index->step);
+  }
+  return cost;
+}
+
 OpResult<KeyIndex> Service::FindKeys(const CommandId* cid, CmdArgList args) {
   if (!cid->IsShardedPSub()) {
     return DetermineKeys(cid, args);
@@ -1125,6 +1319,12 @@ std::optional<ErrorReply> Service::VerifyCommandState(const CommandId* cid, CmdA
   if (auto err = cid->Validate(tail_args); err)
     return err;
 
+  if (dfly_cntx.conn() != nullptr && dfly_cntx.ns != nullptr) {
+    uint64_t now_sec = fb2::ProactorBase::GetMonotonicTimeNs() / 1'000'000'000;
+    if (!dfly_cntx.ns->TryAcquireOp(now_sec))
+      return ErrorReply{"Namespace ops per second limit reached"};
+  }
+
   bool is_trans_cmd = CO::IsTransKind(cid->name());
   bool under_script = dfly_cntx.conn_state.script_info != nullptr;
   bool is_write_cmd = cid->IsWriteOnly();
@@ -1217,6 +1417,29 @@ std::optional<ErrorReply> Service::VerifyCommandState(const CommandId* cid, CmdA
   return VerifyConnectionAclStatus(cid, &dfly_cntx, "has no ACL permissions", tail_args);
 }
 
+bool Service::ProxyMultiKeyCmd(const CommandId* cid, CmdArgList args, const ErrorReply& err,
+                               SinkReplyBuilder* builder, ConnectionContext* cntx) {
+  if (builder->GetProtocol() != Protocol::REDIS || cntx->conn_state.exec_info.IsCollecting() ||
+      !cluster::ShouldProxyMultiKey(cid, err)) {
+    return false;
+  }
+
+  // The ownership check preceded the ACL check, which still applies to the whole command.
+  if (auto acl_err = VerifyConnectionAclStatus(cid, cntx, "has no ACL permissions", args);
+      acl_err) {
+    builder->SendError(std::move(*acl_err));
+    return true;
+  }
+
+  auto local = [&](ArgSlice part) {
+    facade::CapturingReplyBuilder crb;
+    DispatchCommand(part, &crb, cntx);
+    return crb.Take();
+  };
+  cluster::ProxyMultiKey(cid, args, local, static_cast<RedisReplyBuilder*>(builder));
+  return true;
+}
+
 DispatchResult Service::DispatchCommand(ArgSlice args, SinkReplyBuilder* builder,
                                         facade::ConnectionContext* cntx) {
   DCHECK(!args.empty());
@@ -1254,7 +1477,36 @@ DispatchResult Service::DispatchCommand(ArgSlice args, SinkReplyBuilder* builder
     cntx->paused = false;
   }
 
+  // Outgoing migrations being finalized block only the commands on their slots. Commands that
+  // run other commands (EXEC, scripts) can touch any slot, and keyless writes like FLUSHALL
+  // change all of them, so they wait for all the migrations.
+  if (etl.HasFinalizingSlots() && !dispatching_in_multi && cntx->conn() &&
+      !cntx->conn()->IsPrivileged() && !dfly_cntx->is_replicating) {
+    optional<SlotId> slot;
+    bool has_keys = false;
+    if (cid->first_key_pos() > 0 || cid->IsShardedPSub()) {
+      if (OpResult<KeyIndex> key_index = FindKeys(cid, args_no_cmd); key_index) {
+        UniqueSlotChecker slot_checker;
+        for (string_view key : key_index->Range(args_no_cmd))
+          slot_checker.Add(key);
+        slot = slot_checker.GetUniqueSlotId();
+        has_keys = slot || slot_checker.IsCrossSlot();
+      }
+    }
+    bool runs_commands = cid->IsMultiTransactional() || cid->name() == "EXEC";
+    if (slot || ((runs_commands || cid->IsWriteOnly()) && !has_keys)) {
+      cntx->paused = true;
+      etl.AwaitSlotsFinalization(slot);
+      cntx->paused = false;
+    }
+  }
+
   if (auto err = VerifyCommandState(cid, args_no_cmd, *dfly_cntx); err) {
+    if (IsClusterEnabled() && !dispatching_in_multi &&
+        ProxyMultiKeyCmd(cid, args_no_cmd, *err, builder, dfly_cntx)) {
+      return DispatchResult::OK;
+    }
+
     LOG_IF(WARNING, cntx->replica_conn) << "VerifyCommandState error: " << err->ToSv();
     if (auto& exec_info = dfly_cntx->conn_state.exec_info; exec_info.IsCollecting())
       exec_info.state = ConnectionState::ExecInfo::EXEC_ERROR;
@@ -1270,6 +1522,18 @@ DispatchResult Service::DispatchCommand(ArgSlice args, SinkReplyBuilder* builder
     return DispatchResult::ERROR;
   }
 
+  // Commands of a transaction are charged when they are queued.
+  if (!dispatching_in_multi && dfly_cntx->rate_limiter.enabled()) {
+    uint64_t cost = CommandCost(cid, args_no_cmd);
+    if (!dfly_cntx->rate_limiter.TryAcquire(cost, ProactorBase::GetMonotonicTimeNs())) {
+      etl.stats.rate_limited_cmd_cnt++;
+      if (auto& exec_info = dfly_cntx->conn_state.exec_info; exec_info.IsCollecting())
+        exec_info.state = ConnectionState::ExecInfo::EXEC_ERROR;
+      builder->SendError("Rate limit exceeded");
+      return DispatchResult::ERROR;
+    }
+  }
+
   VLOG_IF(1, cid->opt_mask() & CO::CommandOpt::DANGEROUS)
       << "Executing dangerous command " << cid->name() << " "
       << ConnectionLogContext(dfly_cntx->conn());
@@ -1447,6 +1711,7 @@ DispatchResult Service::InvokeCmd(const CommandId* cid, CmdArgList tail_args,
   ReplyGuard reply_guard(cid->name(), builder, cntx);
 #endif
   uint64_t invoke_time_usec = 0;
+  uint64_t reply_bytes_before = builder->BytesRecorded();
   auto last_error = builder->ConsumeLastError();
   DCHECK(last_error.empty());
   try {
@@ -1456,6 +1721,16 @@ DispatchResult Service::InvokeCmd(const CommandId* cid, CmdArgList tail_args,
     return DispatchResult::ERROR;
   }
 
+  if (IsClusterEnabled() && tx) {
+    if (optional<SlotId> sid = tx->GetUniqueSlotId(); sid) {
+      size_t bytes_in = cid->name().size();
+      for (string_view arg : tail_args)
+        bytes_in += arg.size();
+      ServerState::SafeTLocal()->RecordSlotTraffic(
+          *sid, bytes_in, builder->BytesRecorded() - reply_bytes_before);
+    }
+  }
+
   DispatchResult res = DispatchResult::OK;
   if (std::string reason = builder->ConsumeLastError(); !reason.empty()) {
     // Set flag if OOM reported
@@ -1466,6 +1741,11 @@ DispatchResult Service::InvokeCmd(const CommandId* cid, CmdArgList tail_args,
     LOG_EVERY_T(WARNING, 1) << FailedCommandToString(cid->name(), tail_args, reason);
   }
 
+  if (tx && affinity_window_ && !tx->IsMulti() && tx->GetUniqueShardCnt() == 1 &&
+      !cntx->conn_state.squashing_info && cntx->conn() != nullptr) {
+    UpdateShardAffinity(tx->GetUniqueShard(), cntx);
+  }
+
   auto cid_name = cid->name();
   if ((!tx && cid_name != "MULTI") || (tx && !tx->IsMulti())) {
     // Each time we execute a command we need to increase the sequence number in
@@ -1507,6 +1787,26 @@ DispatchResult Service::InvokeCmd(const CommandId* cid, CmdArgList tail_args,
   return res;
 }
 
+void Service::UpdateShardAffinity(ShardId sid, ConnectionContext* cntx) {
+  auto& affinity = cntx->shard_affinity;
+  if (affinity.total == 0)
+    affinity.shard = sid;
+
+  affinity.hits += (sid == affinity.shard);
+  if (++affinity.total < affinity_window_)
+    return;
+
+  // Only the shard that started the window is considered, it is the dominant one with high
+  // probability if there is one at all.
+  bool dominant = affinity.hits >= affinity.total - affinity.total / 10;
+  if (dominant && affinity.shard != ServerState::tlocal()->thread_index()) {
+    VLOG(1) << "Migrating connection " << cntx->conn() << " from "
+            << ProactorBase::me()->GetPoolIndex() << " to " << affinity.shard;
+    cntx->conn()->RequestAsyncMigration(shard_set->pool()->at(affinity.shard));
+  }
+  affinity = {};
+}
+
 size_t Service::DispatchManyCommands(absl::Span<CmdArgList> args_list, SinkReplyBuilder* builder,
                                      facade::ConnectionContext* cntx) {
   ConnectionContext* dfly_cntx = static_cast<ConnectionContext*>(cntx);
@@ -1514,8 +1814,9 @@ size_t Service::DispatchManyCommands(absl::Span<CmdArgList> args_list, SinkReply
   DCHECK_EQ(builder->GetProtocol(), Protocol::REDIS);
 
   auto* ss = dfly::ServerState::tlocal();
-  // Don't even start when paused. We can only continue if DispatchTracker is aware of us running.
-  if (ss->IsPaused())
+  // Don't even start when paused or when slots are being finalized, DispatchCommand applies the
+  // slot fence per command. We can only continue if DispatchTracker is aware of us running.
+  if (ss->IsPaused() || ss->HasFinalizingSlots())
     return 0;
 
   vector<StoredCmd> stored_cmds;
@@ -1523,7 +1824,9 @@ size_t Service::DispatchManyCommands(absl::Span<CmdArgList> args_list, SinkReply
   size_t dispatched = 0;
 
   auto perform_squash = [&] {
-    if (stored_cmds.empty())
+    // Finalization may start while we yield, the remaining commands are then left to
+    // DispatchCommand and its slot fence.
+    if (stored_cmds.empty() || ss->HasFinalizingSlots())
       return;
 
     if (!dist_trans) {
@@ -1566,7 +1869,10 @@ size_t Service::DispatchManyCommands(absl::Span<CmdArgList> args_list, SinkReply
 
     const bool is_blocking = cid != nullptr && cid->IsBlocking();
 
-    if (!is_multi && !is_eval && !is_blocking && cid != nullptr) {
+    // Rate limited commands are charged in DispatchCommand.
+    const bool is_rate_limited = dfly_cntx->rate_limiter.enabled();
+
+    if (!is_multi && !is_eval && !is_blocking && !is_rate_limited && cid != nullptr) {
       stored_cmds.reserve(args_list.size());
       stored_cmds.emplace_back(cid, false /* do not deep-copy commands*/, tail_args);
       continue;
@@ -1575,8 +1881,9 @@ size_t Service::DispatchManyCommands(absl::Span<CmdArgList> args_list, SinkReply
     // Squash accumulated commands
     perform_squash();
 
-    // Stop accumulating when a pause is requested, fall back to regular dispatch
-    if (ss->IsPaused())
+    // Stop accumulating when a pause or a slot finalization is requested, fall back to regular
+    // dispatch
+    if (ss->IsPaused() || ss->HasFinalizingSlots())
       break;
 
     // Dispatch non squashed command only after all squshed commands were executed and replied
@@ -1818,16 +2125,40 @@ void Service::Watch(CmdArgList args, const CommandContext& cmd_cntx) {
     return cmd_cntx.rb->SendOk();
   }
 
+  // Versions of this call's keys are written to their argument positions by the shard callbacks.
+  bool by_version = absl::GetFlag(FLAGS_watch_by_version);
+  size_t versions_offset = exec_info.watched_keys.size();
+  exec_info.watched_versions.resize(versions_offset + args.size());
+
   atomic_uint32_t keys_existed = 0;
   auto cb = [&](Transaction* t, EngineShard* shard) {
     ShardId shard_id = shard->shard_id();
     ShardArgs largs = t->GetShardArgs(shard_id);
-    for (auto k : largs) {
-      t->GetDbSlice(shard_id).RegisterWatchedKey(cmd_cntx.conn_cntx->db_index(), k, &exec_info);
+    auto& db_slice = t->GetDbSlice(shard_id);
+    if (!by_version) {
+      for (auto k : largs) {
+        db_slice.RegisterWatchedKey(cmd_cntx.conn_cntx->db_index(), k, &exec_info);
+      }
+
+      auto res = GenericFamily::OpExists(t->GetOpArgs(shard), largs);
+      keys_existed.fetch_add(res.value_or(0), memory_order_relaxed);
+      return OpStatus::OK;
     }
 
-    auto res = GenericFamily::OpExists(t->GetOpArgs(shard), largs);
-    keys_existed.fetch_add(res.value_or(0), memory_order_relaxed);
+    // Writes set the version of the bucket to a fresh one and entries carry the largest version
+    // when they move between buckets or segments, so an unchanged version at EXEC proves that
+    // the key was not written. Missing keys have no bucket to track and are registered.
+    DbContext db_cntx = t->GetDbContext();
+    uint32_t existed = 0;
+    for (auto it = largs.cbegin(); it != largs.cend(); ++it) {
+      auto find_res = db_slice.FindReadOnly(db_cntx, *it);
+      uint64_t version = IsValid(find_res.it) ? find_res.it.GetVersion() : 0;
+      existed += IsValid(find_res.it);
+      if (version == 0)
+        db_slice.RegisterWatchedKey(db_cntx.db_index, *it, &exec_info);
+      exec_info.watched_versions[versions_offset + it.index()] = version;
+    }
+    keys_existed.fetch_add(existed, memory_order_relaxed);
     return OpStatus::OK;
   };
   cmd_cntx.tx->ScheduleSingleHop(std::move(cb));
@@ -1910,9 +2241,47 @@ void Service::CallFromScript(ConnectionContext* cntx, Interpreter::CallArgs& ca)
   if (ca.async)
     return;
 
+  if (TryFastCallFromScript(ca.args, &replier, cntx))
+    return;
+
   DispatchCommand(ca.args, &replier, cntx);
 }
 
+bool Service::TryFastCallFromScript(ArgSlice args, RedisReplyBuilder* builder,
+                                    ConnectionContext* cntx) {
+  static const bool enabled = GetFlag(FLAGS_lua_call_fast_path);
+  if (!enabled || args.size() != 2 || !absl::EqualsIgnoreCase(args[0], "GET"))
+    return false;
+
+  // Only the stubs of single shard scripts run on the shard thread with all the declared keys
+  // already locked, see EvalInternal.
+  Transaction* tx = cntx->transaction;
+  EngineShard* shard = EngineShard::tlocal();
+  if (!tx->IsMulti() || tx->IsActiveMulti() || tx->GetMultiMode() != Transaction::LOCK_AHEAD ||
+      shard == nullptr || shard->shard_id() != tx->GetUniqueShard()) {
+    return false;
+  }
+
+  // Everything that needs the regular checks or side effects of dispatching takes the slow path,
+  // which also reports the errors.
+  ServerState& etl = *ServerState::tlocal();
+  string_view key = args[1];
+  if (etl.gstate() != GlobalState::ACTIVE || !etl.Monitors().Empty() || IsClusterEnabled() ||
+      cntx->conn_state.tracking_info_.ShouldTrackKeys() ||
+      !cntx->conn_state.script_info->lock_tags.contains(LockTag{key}) ||
+      !acl::IsUserAllowedToInvokeCommand(*cntx, *get_cid_, args.subspan(1))) {
+    return false;
+  }
+
+  uint64_t start_ns = absl::GetCurrentTimeNanos();
+  StringFamily::GetLocal(key, DbContext{cntx->ns, cntx->db_index(), GetCurrentTimeMs()}, shard,
+                         builder);
+
+  etl.RecordCmd(cntx->has_main_or_memcache_listener);
+  get_cid_->RecordInvocation((absl::GetCurrentTimeNanos() - start_ns) / 1000);
+  return true;
+}
+
 void Service::Eval(CmdArgList args, const CommandContext& cmd_cntx, bool read_only) {
   string_view body = ArgS(args, 0);
 
@@ -1973,7 +2342,10 @@ optional<ScriptMgr::ScriptParams> LoadScript(string_view sha, ScriptMgr* script_
       return std::nullopt;
 
     string err;
-    Interpreter::AddResult add_res = interpreter->AddFunction(sha, script_data->body, &err);
+    Interpreter::AddResult add_res =
+        script_data->bytecode
+            ? interpreter->AddFunctionBytecode(sha, *script_data->bytecode, &err)
+            : interpreter->AddFunction(sha, script_data->body, &err);
     if (add_res != Interpreter::ADD_OK) {
       LOG(ERROR) << "Error adding " << sha << " to database, err " << err;
       return std::nullopt;
@@ -2107,18 +2479,29 @@ void Service::EvalInternal(CmdArgList args, const EvalArgs& eval_args, Interpret
 
     ++ServerState::tlocal()->stats.eval_shardlocal_coordination_cnt;
     tx->PrepareMultiForScheduleSingleHop(cntx->ns, *sid, cntx->db_index(), args);
-    tx->ScheduleSingleHop([&](Transaction*, EngineShard*) {
-      boost::intrusive_ptr<Transaction> stub_tx =
-          new Transaction{tx, *sid, slot_checker.GetUniqueSlotId()};
-      cntx->transaction = stub_tx.get();
+    auto run_script = [&] {
+      tx->ScheduleSingleHop([&](Transaction*, EngineShard*) {
+        boost::intrusive_ptr<Transaction> stub_tx =
+            new Transaction{tx, *sid, slot_checker.GetUniqueSlotId()};
+        cntx->transaction = stub_tx.get();
 
-      result = interpreter->RunFunction(eval_args.sha, &error);
+        result = interpreter->RunFunction(eval_args.sha, &error);
 
-      cntx->transaction = tx;
-      return OpStatus::OK;
-    });
+        cntx->transaction = tx;
+        return OpStatus::OK;
+      });
+    };
+
+    // Scheduling from the shard thread runs the script inline in the calling fiber, instead of
+    // occupying the shard queue until it finishes. Scripts with free locks run right away,
+    // conflicting ones wait in the tx queue as usual.
+    if (*sid != ServerState::tlocal()->thread_index() && GetFlag(FLAGS_lua_shard_fibers)) {
+      shard_set->pool()->at(*sid)->LaunchFiber(run_script).Join();
+    } else {
+      run_script();
+    }
 
-    if (*sid != ServerState::tlocal()->thread_index()) {
+    if (*sid != ServerState::tlocal()->thread_index() && !dedicated_io_threads_) {
       VLOG(2) << "Migrating connection " << cntx->conn() << " from "
               << ProactorBase::me()->GetPoolIndex() << " to " << *sid;
       cntx->conn()->RequestAsyncMigration(shard_set->pool()->at(*sid));
@@ -2200,10 +2583,21 @@ bool CheckWatchedKeyExpiry(ConnectionContext* cntx, const CommandId* exists_cid,
   }
 
   atomic_uint32_t watch_exist_count{0};
-  auto cb = [&watch_exist_count](Transaction* t, EngineShard* shard) {
+  atomic_bool version_changed{false};
+  auto cb = [&](Transaction* t, EngineShard* shard) {
     ShardArgs args = t->GetShardArgs(shard->shard_id());
-    auto res = GenericFamily::OpExists(t->GetOpArgs(shard), args);
-    watch_exist_count.fetch_add(res.value_or(0), memory_order_relaxed);
+    auto& db_slice = t->GetDbSlice(shard->shard_id());
+    uint32_t existed = 0;
+    for (auto it = args.cbegin(); it != args.cend(); ++it) {
+      auto find_res = db_slice.FindReadOnly(t->GetDbContext(), *it);
+      existed += IsValid(find_res.it);
+
+      // Keys watched by version, see Service::Watch.
+      uint64_t version = exec_info.watched_versions[it.index()];
+      if (version != 0 && (!IsValid(find_res.it) || find_res.it.GetVersion() != version))
+        version_changed.store(true, memory_order_relaxed);
+    }
+    watch_exist_count.fetch_add(existed, memory_order_relaxed);
 
     return OpStatus::OK;
   };
@@ -2219,7 +2613,8 @@ bool CheckWatchedKeyExpiry(ConnectionContext* cntx, const CommandId* exists_cid,
   // The comparison can still be true even if a key expired due to another one being created.
   // So we have to check the watched_dirty flag, which is set if a key expired.
   return watch_exist_count.load() == exec_info.watched_existed &&
-         !exec_info.watched_dirty.load(memory_order_relaxed);
+         !exec_info.watched_dirty.load(memory_order_relaxed) &&
+         !version_changed.load(memory_order_relaxed);
 }
 
 // Check if exec_info watches keys on dbs other than db_indx.
@@ -2248,6 +2643,20 @@ template <typename F> void IterateAllKeys(const ConnectionState::ExecInfo* exec_
   }
 }
 
+// Returns true if the body can be executed by MultiCommandSquasher::ExecuteSnapshot.
+bool CanExecSnapshot(const ConnectionState::ExecInfo& exec_info) {
+  if (!exec_info.watched_keys.empty())
+    return false;
+
+  constexpr uint32_t kExcluded = CO::BLOCKING | CO::GLOBAL_TRANS | CO::NO_KEY_TRANSACTIONAL;
+  for (const auto& scmd : exec_info.body) {
+    const CommandId* cid = scmd.Cid();
+    if (!cid->IsReadOnly() || !cid->IsTransactional() || (cid->opt_mask() & kExcluded))
+      return false;
+  }
+  return true;
+}
+
 CmdArgVec CollectAllKeys(ConnectionState::ExecInfo* exec_info) {
   CmdArgVec out;
   out.reserve(exec_info->watched_keys.size() + exec_info->body.size());
@@ -2310,8 +2719,15 @@ void Service::Exec(CmdArgList args, const CommandContext& cmd_cntx) {
   // and scripts
   Transaction::MultiMode multi_mode = DeduceExecMode(state, exec_info, *script_mgr());
 
+  bool squash = absl::GetFlag(FLAGS_multi_exec_squash) && state != ExecScriptUse::SCRIPT_RUN &&
+                !cntx->conn_state.tracking_info_.IsTrackingOn();
+
+  // Read-only bodies first try to run without scheduling, see ExecuteSnapshot.
+  bool snapshot = squash && multi_mode == Transaction::LOCK_AHEAD && state == ExecScriptUse::NONE &&
+                  absl::GetFlag(FLAGS_multi_exec_snapshot_reads) && CanExecSnapshot(exec_info);
+
   bool scheduled = false;
-  if (multi_mode != Transaction::NOT_DETERMINED) {
+  if (multi_mode != Transaction::NOT_DETERMINED && !snapshot) {
     scheduled = StartMulti(cntx, multi_mode, keys);
   }
 
@@ -2334,8 +2750,17 @@ void Service::Exec(CmdArgList args, const CommandContext& cmd_cntx) {
     string descr = CreateExecDescriptor(exec_info.body, cmd_cntx.tx->GetUniqueShardCnt());
     ServerState::tlocal()->exec_freq_count[descr]++;
 
-    if (absl::GetFlag(FLAGS_multi_exec_squash) && state != ExecScriptUse::SCRIPT_RUN &&
-        !cntx->conn_state.tracking_info_.IsTrackingOn()) {
+    bool replied = false;
+    if (snapshot) {
+      replied =
+          MultiCommandSquasher::ExecuteSnapshot(absl::MakeSpan(exec_info.body), rb, cntx, this);
+      if (!replied)  // fall back to locking ahead
+        scheduled = StartMulti(cntx, multi_mode, keys);
+    }
+
+    if (replied) {
+      VLOG(2) << "Exec ran without locking ahead";
+    } else if (squash) {
       MultiCommandSquasher::Opts opts;
       opts.max_squash_size = ServerState::tlocal()->max_squash_cmd_num;
       MultiCommandSquasher::Execute(absl::MakeSpan(exec_info.body), rb, cntx, this, opts);
@@ -2370,9 +2795,8 @@ void Service::Exec(CmdArgList args, const CommandContext& cmd_cntx) {
   VLOG(2) << "Exec completed";
 }
 
-namespace {
-void PublishImpl(bool reject_cluster, CmdArgList args, const CommandContext& cmd_cntx) {
-  if (reject_cluster && IsClusterEnabled()) {
+void Service::Publish(CmdArgList args, const CommandContext& cmd_cntx) {
+  if (IsClusterEnabled()) {
     return cmd_cntx.rb->SendError("PUBLISH is not supported in cluster mode yet");
   }
   string_view channel = ArgS(args, 0);
@@ -2382,17 +2806,28 @@ void PublishImpl(bool reject_cluster, CmdArgList args, const CommandContext& cmd
   cmd_cntx.rb->SendLong(cs->SendMessages(channel, messages));
 }
 
-void SubscribeImpl(bool reject_cluster, CmdArgList args, const CommandContext& cmd_cntx) {
-  if (reject_cluster && IsClusterEnabled()) {
+void Service::SPublish(CmdArgList args, const CommandContext& cmd_cntx) {
+  string_view channel = ArgS(args, 0);
+  string_view messages[] = {ArgS(args, 1)};
+  cmd_cntx.rb->SendLong(ShardChannelStore::SendMessages(channel, messages));
+}
+
+void Service::Subscribe(CmdArgList args, const CommandContext& cmd_cntx) {
+  if (IsClusterEnabled()) {
     return cmd_cntx.rb->SendError("SUBSCRIBE is not supported in cluster mode yet");
   }
   cmd_cntx.conn_cntx->ChangeSubscription(true /*add*/, true /* reply*/, args,
                                          static_cast<RedisReplyBuilder*>(cmd_cntx.rb));
 }
 
-void UnSubscribeImpl(bool reject_cluster, CmdArgList args, const CommandContext& cmd_cntx) {
+void Service::SSubscribe(CmdArgList args, const CommandContext& cmd_cntx) {
+  cmd_cntx.conn_cntx->ChangeShardSubscription(true /*add*/, true /* reply*/, args,
+                                              static_cast<RedisReplyBuilder*>(cmd_cntx.rb));
+}
+
+void Service::Unsubscribe(CmdArgList args, const CommandContext& cmd_cntx) {
   auto* rb = static_cast<RedisReplyBuilder*>(cmd_cntx.rb);
-  if (reject_cluster && IsClusterEnabled()) {
+  if (IsClusterEnabled()) {
     return cmd_cntx.rb->SendError("UNSUBSCRIBE is not supported in cluster mode yet");
   }
 
@@ -2403,30 +2838,13 @@ void UnSubscribeImpl(bool reject_cluster, CmdArgList args, const CommandContext&
   }
 }
 
-}  // namespace
-
-void Service::Publish(CmdArgList args, const CommandContext& cmd_cntx) {
-  PublishImpl(true, args, cmd_cntx);
-}
-
-void Service::SPublish(CmdArgList args, const CommandContext& cmd_cntx) {
-  PublishImpl(false, args, cmd_cntx);
-}
-
-void Service::Subscribe(CmdArgList args, const CommandContext& cmd_cntx) {
-  SubscribeImpl(true, args, cmd_cntx);
-}
-
-void Service::SSubscribe(CmdArgList args, const CommandContext& cmd_cntx) {
-  SubscribeImpl(false, args, cmd_cntx);
-}
-
-void Service::Unsubscribe(CmdArgList args, const CommandContext& cmd_cntx) {
-  UnSubscribeImpl(true, args, cmd_cntx);
-}
-
 void Service::SUnsubscribe(CmdArgList args, const CommandContext& cmd_cntx) {
-  UnSubscribeImpl(false, args, cmd_cntx);
+  auto* rb = static_cast<RedisReplyBuilder*>(cmd_cntx.rb);
+  if (args.size() == 0) {
+    cmd_cntx.conn_cntx->SUnsubscribeAll(true, rb);
+  } else {
+    cmd_cntx.conn_cntx->ChangeShardSubscription(false, true, args, rb);
+  }
 }
 
 void Service::PSubscribe(CmdArgList args, const CommandContext& cmd_cntx) {
@@ -2464,9 +2882,10 @@ void Service::Function(CmdArgList args, const CommandContext& cmd_cntx) {
   return cmd_cntx.rb->SendError(err, kSyntaxErrType);
 }
 
-void Service::PubsubChannels(string_view pattern, SinkReplyBuilder* builder) {
+void Service::PubsubChannels(string_view pattern, bool sharded, SinkReplyBuilder* builder) {
   auto* rb = static_cast<RedisReplyBuilder*>(builder);
-  rb->SendBulkStrArr(ServerState::tlocal()->channel_store()->ListChannels(pattern));
+  rb->SendBulkStrArr(sharded ? ShardChannelStore::ListChannels(pattern)
+                             : ServerState::tlocal()->channel_store()->ListChannels(pattern));
 }
 
 void Service::PubsubPatterns(SinkReplyBuilder* builder) {
@@ -2474,12 +2893,13 @@ void Service::PubsubPatterns(SinkReplyBuilder* builder) {
   builder->SendLong(pattern_count);
 }
 
-void Service::PubsubNumSub(CmdArgList args, SinkReplyBuilder* builder) {
+void Service::PubsubNumSub(CmdArgList args, bool sharded, SinkReplyBuilder* builder) {
   auto* rb = static_cast<RedisReplyBuilder*>(builder);
   rb->StartArray(args.size() * 2);
   for (string_view channel : args) {
     rb->SendBulkString(channel);
-    rb->SendLong(ServerState::tlocal()->channel_store()->FetchSubscribers(channel).size());
+    rb->SendLong(sharded ? ShardChannelStore::FetchSubscribers(channel).size()
+                         : ServerState::tlocal()->channel_store()->FetchSubscribers(channel).size());
   }
 }
 
@@ -2535,12 +2955,12 @@ void Service::Pubsub(CmdArgList args, const CommandContext& cmd_cntx) {
     if (args.size() > 1) {
       pattern = ArgS(args, 1);
     }
-    PubsubChannels(pattern, rb);
+    PubsubChannels(pattern, subcmd == "SHARDCHANNELS", rb);
   } else if (subcmd == "NUMPAT") {
     PubsubPatterns(rb);
   } else if (subcmd == "NUMSUB" || subcmd == "SHARDNUMSUB") {
     args.remove_prefix(1);
-    PubsubNumSub(args, rb);
+    PubsubNumSub(args, subcmd == "SHARDNUMSUB", rb);
   } else {
     rb->SendError(UnknownSubCmd(subcmd, "PUBSUB"));
   }
@@ -2704,6 +3124,8 @@ void Service::ConfigureHttpHandlers(util::HttpListenerBase* base, bool is_privil
   }
   server_family_.ConfigureMetrics(base);
   base->RegisterCb("/txz", TxTable);
+  base->RegisterCb("/heapz", HeapProfile);
+  base->RegisterCb("/profilez", CpuProfile);
   base->RegisterCb("/clusterz", [this](const http::QueryArgs& args, HttpContext* send) {
     return ClusterHtmlPage(args, send, &cluster_family_);
   });
@@ -2713,6 +3135,10 @@ void Service::ConfigureHttpHandlers(util::HttpListenerBase* base, bool is_privil
                      [this](const http::QueryArgs& args, HttpRequest&& req, HttpContext* send) {
                        HttpAPI(args, std::move(req), this, send);
                      });
+    base->RegisterCb("/api/batch",
+                     [this](const http::QueryArgs& args, HttpRequest&& req, HttpContext* send) {
+                       HttpBatchAPI(args, std::move(req), this, send);
+                     });
   }
 }
 
@@ -2728,6 +3154,10 @@ void Service::OnConnectionClose(facade::ConnectionContext* cntx) {
       server_cntx->UnsubscribeAll(false, nullptr);
     }
 
+    if (conn_state.subscribe_info && !conn_state.subscribe_info->shard_channels.empty()) {
+      server_cntx->SUnsubscribeAll(false, nullptr);
+    }
+
     if (conn_state.subscribe_info) {
       DCHECK(!conn_state.subscribe_info->patterns.empty());
       server_cntx->PUnsubscribeAll(false, nullptr);
@@ -2742,6 +3172,7 @@ void Service::OnConnectionClose(facade::ConnectionContext* cntx) {
 
   server_family_.OnClose(server_cntx);
 
+  server_cntx->ChangeBcastTracking(false);
   conn_state.tracking_info_.SetClientTracking(false);
 }
 
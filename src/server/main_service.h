@@ -147,9 +147,9 @@ class Service : public facade::ServiceInterface {
   void Pubsub(CmdArgList args, const CommandContext& cmd_cntx);
   void Command(CmdArgList args, const CommandContext& cmd_cntx);
 
-  void PubsubChannels(std::string_view pattern, SinkReplyBuilder* builder);
+  void PubsubChannels(std::string_view pattern, bool sharded, SinkReplyBuilder* builder);
   void PubsubPatterns(SinkReplyBuilder* builder);
-  void PubsubNumSub(CmdArgList channels, SinkReplyBuilder* builder);
+  void PubsubNumSub(CmdArgList channels, bool sharded, SinkReplyBuilder* builder);
 
   struct EvalArgs {
     std::string_view sha;  // only one of them is defined.
@@ -160,6 +160,11 @@ class Service : public facade::ServiceInterface {
   std::optional<facade::ErrorReply> CheckKeysOwnership(const CommandId* cid, CmdArgList args,
                                                        const ConnectionContext& dfly_cntx);
 
+  // Serves MGET and MSET whose keys are owned by several cluster nodes instead of failing with
+  // the ownership error, see cluster::ProxyMultiKey. Returns false if the command is not proxied.
+  bool ProxyMultiKeyCmd(const CommandId* cid, CmdArgList args, const facade::ErrorReply& err,
+                        SinkReplyBuilder* builder, ConnectionContext* cntx);
+
   void EvalInternal(CmdArgList args, const EvalArgs& eval_args, Interpreter* interpreter,
                     SinkReplyBuilder* builder, ConnectionContext* cntx, bool read_only);
   void CallSHA(CmdArgList args, std::string_view sha, Interpreter* interpreter,
@@ -171,8 +176,20 @@ class Service : public facade::ServiceInterface {
 
   void CallFromScript(ConnectionContext* cntx, Interpreter::CallArgs& args);
 
+  // Serves simple calls of single shard scripts directly from the shard, bypassing the command
+  // dispatch. Returns false if the call must be dispatched regularly.
+  bool TryFastCallFromScript(ArgSlice args, facade::RedisReplyBuilder* builder,
+                             ConnectionContext* cntx);
+
   OpResult<KeyIndex> FindKeys(const CommandId* cid, CmdArgList args);
 
+  // Cost charged against the rate limit of the connection, see command_costs flag.
+  uint64_t CommandCost(const CommandId* cid, CmdArgList args);
+
+  // Tracks the shards hit by single shard commands of the connection and requests its
+  // migration to the thread owning the dominant one.
+  void UpdateShardAffinity(ShardId sid, ConnectionContext* cntx);
+
   void RegisterCommands();
   void Register(CommandRegistry* registry);
 
@@ -186,8 +203,12 @@ class Service : public facade::ServiceInterface {
   cluster::ClusterFamily cluster_family_;
   CommandRegistry registry_;
   absl::flat_hash_map<std::string, unsigned> unknown_cmds_;
+  absl::flat_hash_map<const CommandId*, uint32_t> command_costs_;
 
   const CommandId* exec_cid_;  // command id of EXEC command for pipeline squashing
+  const CommandId* get_cid_;   // command id of GET for the script fast path
+  uint32_t affinity_window_ = 0;  // see migrate_connections_affinity_window flag
+  bool dedicated_io_threads_ = false;  // see dedicated_io_threads flag
 
   mutable util::fb2::Mutex mu_;
   GlobalState global_state_ ABSL_GUARDED_BY(mu_) = GlobalState::ACTIVE;
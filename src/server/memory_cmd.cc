@@ -14,6 +14,7 @@
 
 #include "base/flags.h"
 #include "core/allocation_tracker.h"
+#include "core/glob_matcher.h"
 #include "facade/cmd_arg_parser.h"
 #include "facade/dragonfly_connection.h"
 #include "facade/dragonfly_listener.h"
@@ -87,6 +88,108 @@ size_t MemoryUsage(PrimeIterator it, bool account_key_memory_usage) {
   return key_size + it->second.MallocUsed(true);
 }
 
+constexpr string_view kTtlBuckets[] = {"none", "<1m", "<1h", "<1d", "<7d", ">=7d"};
+
+unsigned TtlBucket(int64_t ttl_ms) {
+  constexpr int64_t kMinute = 60'000, kHour = 60 * kMinute, kDay = 24 * kHour;
+  if (ttl_ms < kMinute)
+    return 1;
+  if (ttl_ms < kHour)
+    return 2;
+  if (ttl_ms < kDay)
+    return 3;
+  return ttl_ms < 7 * kDay ? 4 : 5;
+}
+
+struct KeyGroupStats {
+  uint64_t keys = 0;
+  uint64_t memory = 0;
+  array<uint64_t, ABSL_ARRAYSIZE(kTtlBuckets)> ttl{};
+  absl::flat_hash_map<string_view, uint64_t> encodings;
+
+  void Merge(const KeyGroupStats& other) {
+    keys += other.keys;
+    memory += other.memory;
+    for (size_t i = 0; i < ttl.size(); ++i)
+      ttl[i] += other.ttl[i];
+    for (const auto& [encoding, count] : other.encodings)
+      encodings[encoding] += count;
+  }
+};
+
+// Keys are grouped by their pattern or prefix, and by their type.
+using KeyGroups = absl::flat_hash_map<pair<string, CompactObjType>, KeyGroupStats>;
+
+struct AnalyzeOptions {
+  vector<string> patterns;
+  string delimiter = ":";
+  size_t samples = 100'000;
+  size_t count = 32;
+};
+
+struct ShardAnalysis {
+  KeyGroups groups;
+  size_t scanned = 0;
+  size_t total = 0;
+};
+
+void DoAnalyzeKeys(EngineShard* shard, ConnectionContext* cntx, const AnalyzeOptions& opts,
+                   size_t budget, ShardAnalysis* res) {
+  auto& db_slice = cntx->ns->GetDbSlice(shard->shard_id());
+  DbTable* dbt = db_slice.GetDBTable(cntx->db_index());
+  if (dbt == nullptr)
+    return;
+  res->total = dbt->prime.size();
+
+  vector<unique_ptr<GlobMatcher>> matchers;
+  for (const string& pattern : opts.patterns)
+    matchers.push_back(make_unique<GlobMatcher>(pattern, true));
+
+  const int64_t now_ms = GetCurrentTimeMs();
+  string scratch;
+  unsigned steps = 0;
+  PrimeTable::Cursor cursor;
+  do {
+    cursor = dbt->prime.Traverse(cursor, [&](PrimeIterator it) {
+      ++steps;
+      ++res->scanned;
+
+      // Keys that match no pattern or have no prefix are grouped under "*".
+      string_view key = it->first.GetSlice(&scratch);
+      string_view group = "*";
+      if (matchers.empty()) {
+        if (size_t pos = key.find(opts.delimiter); pos != string_view::npos)
+          group = key.substr(0, pos + opts.delimiter.size());
+      } else {
+        for (size_t i = 0; i < matchers.size(); ++i) {
+          if (matchers[i]->Matches(key)) {
+            group = opts.patterns[i];
+            break;
+          }
+        }
+      }
+
+      const PrimeValue& pv = it->second;
+      KeyGroupStats& stats = res->groups[{string{group}, pv.ObjType()}];
+      stats.keys++;
+      stats.memory += MemoryUsage(it, true);
+      stats.encodings[ObjEncodingToString(pv.ObjType(), pv.Encoding())]++;
+
+      unsigned ttl_bucket = 0;
+      if (pv.HasExpire()) {
+        if (auto exp_it = dbt->expire.Find(it->first); IsValid(exp_it))
+          ttl_bucket = TtlBucket(db_slice.ExpireTime(exp_it) - now_ms);
+      }
+      stats.ttl[ttl_bucket]++;
+    });
+
+    if (steps >= 20000) {
+      steps = 0;
+      util::ThisFiber::Yield();
+    }
+  } while (cursor && (budget == 0 || res->scanned < budget));
+}
+
 }  // namespace
 
 MemoryCmd::MemoryCmd(ServerFamily* owner, facade::SinkReplyBuilder* builder,
@@ -133,6 +236,14 @@ void MemoryCmd::Run(CmdArgList args) {
         "    ADDRESS <address>",
         "        Returns whether <address> is known to be allocated internally by any of the "
         "backing heaps",
+        "    PROFILE START <sample-period> | STOP",
+        "        Starts or stops sampling allocation stacks every <sample-period> allocated bytes",
+        "        on average. The heap profile is served in pprof format at /heapz",
+        "ANALYZE [MATCH <pattern>]... [DELIMITER <delimiter>] [SAMPLES <count>] [COUNT <count>]",
+        "    Samples keys of the current database and groups them by type and by the first",
+        "    pattern they match, or by their prefix up to the delimiter (':' by default).",
+        "    Reports the memory, TTL distribution and encodings of the <count> (32 by default)",
+        "    largest groups. Scans at most <count> keys (100000 by default, 0 for all keys).",
         "DEFRAGMENT [threshold]",
         "    Tries to free memory by moving allocations around from sparsely used memory pages.",
         "    If a threshold is supplied, it is used to determine if data will be moved from the "
@@ -173,6 +284,11 @@ void MemoryCmd::Run(CmdArgList args) {
     return Track(args);
   }
 
+  if (parser.Check("ANALYZE")) {
+    args.remove_prefix(1);
+    return Analyze(args);
+  }
+
   if (parser.Check("DEFRAGMENT")) {
     static const float default_threshold =
         absl::GetFlag(FLAGS_mem_defrag_page_utilization_threshold);
@@ -377,6 +493,89 @@ void MemoryCmd::Usage(std::string_view key, bool account_key_memory_usage) {
   rb->SendLong(memory_usage);
 }
 
+void MemoryCmd::Analyze(CmdArgList args) {
+  CmdArgParser parser(args);
+  AnalyzeOptions opts;
+  while (parser.HasNext()) {
+    if (parser.Check("MATCH")) {
+      opts.patterns.emplace_back(parser.Next());
+    } else if (parser.Check("DELIMITER")) {
+      opts.delimiter = parser.Next();
+    } else if (parser.Check("SAMPLES")) {
+      opts.samples = parser.Next<size_t>();
+    } else if (parser.Check("COUNT")) {
+      opts.count = parser.Next<size_t>();
+    } else {
+      return builder_->SendError(kSyntaxErr);
+    }
+  }
+  if (parser.HasError()) {
+    return builder_->SendError(parser.Error()->MakeReply());
+  }
+  if (opts.delimiter.empty()) {
+    return builder_->SendError("delimiter must not be empty");
+  }
+
+  // The budget is split evenly between the shards, which yield while they scan.
+  size_t budget = opts.samples == 0 ? 0 : max<size_t>(1, opts.samples / shard_set->size());
+  vector<ShardAnalysis> shard_results(shard_set->size());
+  shard_set->RunBlockingInParallel([&](EngineShard* shard) {
+    DoAnalyzeKeys(shard, cntx_, opts, budget, &shard_results[shard->shard_id()]);
+  });
+
+  ShardAnalysis total;
+  for (ShardAnalysis& shard_res : shard_results) {
+    total.scanned += shard_res.scanned;
+    total.total += shard_res.total;
+    for (auto& [group, stats] : shard_res.groups) {
+      if (auto [it, inserted] = total.groups.try_emplace(group, std::move(stats)); !inserted)
+        it->second.Merge(stats);
+    }
+  }
+
+  vector<pair<const pair<string, CompactObjType>*, const KeyGroupStats*>> groups;
+  for (const auto& [group, stats] : total.groups)
+    groups.emplace_back(&group, &stats);
+  size_t count = min(opts.count, groups.size());
+  partial_sort(groups.begin(), groups.begin() + count, groups.end(),
+               [](const auto& l, const auto& r) { return l.second->memory > r.second->memory; });
+
+  auto* rb = static_cast<RedisReplyBuilder*>(builder_);
+  rb->StartCollection(3, RedisReplyBuilder::MAP);
+  rb->SendBulkString("scanned_keys");
+  rb->SendLong(total.scanned);
+  rb->SendBulkString("total_keys");
+  rb->SendLong(total.total);
+  rb->SendBulkString("groups");
+  rb->StartArray(count);
+  for (size_t i = 0; i < count; ++i) {
+    const auto& [group, stats] = groups[i];
+    rb->StartCollection(6, RedisReplyBuilder::MAP);
+    rb->SendBulkString("group");
+    rb->SendBulkString(group->first);
+    rb->SendBulkString("type");
+    rb->SendBulkString(ObjTypeToString(group->second));
+    rb->SendBulkString("keys");
+    rb->SendLong(stats->keys);
+    rb->SendBulkString("memory");
+    rb->SendLong(stats->memory);
+
+    rb->SendBulkString("ttl");
+    rb->StartCollection(stats->ttl.size(), RedisReplyBuilder::MAP);
+    for (size_t j = 0; j < stats->ttl.size(); ++j) {
+      rb->SendBulkString(kTtlBuckets[j]);
+      rb->SendLong(stats->ttl[j]);
+    }
+
+    rb->SendBulkString("encodings");
+    rb->StartCollection(stats->encodings.size(), RedisReplyBuilder::MAP);
+    for (const auto& [encoding, encoding_count] : stats->encodings) {
+      rb->SendBulkString(encoding);
+      rb->SendLong(encoding_count);
+    }
+  }
+}
+
 void MemoryCmd::Track(CmdArgList args) {
 #ifndef DFLY_ENABLE_MEMORY_TRACKING
   return builder_->SendError("MEMORY TRACK must be enabled at build time.");
@@ -463,6 +662,28 @@ void MemoryCmd::Track(CmdArgList args) {
     return builder_->SendSimpleString(found.load() ? "FOUND" : "NOT-FOUND");
   }
 
+  if (parser.Check("PROFILE")) {
+    size_t sample_period = 0;
+    if (parser.Check("START")) {
+      sample_period = parser.Next<size_t>();
+      if (!parser.HasError() && sample_period == 0)
+        return builder_->SendError(kInvalidIntErr);
+    } else if (!parser.Check("STOP")) {
+      return builder_->SendError(kSyntaxErrType);
+    }
+    if (parser.HasError()) {
+      return builder_->SendError(parser.Error()->MakeReply());
+    }
+
+    shard_set->pool()->AwaitBrief([&](unsigned index, auto*) {
+      if (sample_period > 0)
+        AllocationTracker::Get().StartProfiling(sample_period);
+      else
+        AllocationTracker::Get().StopProfiling();
+    });
+    return builder_->SendOk();
+  }
+
   return builder_->SendError(kSyntaxErrType);
 }
 
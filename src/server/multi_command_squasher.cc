@@ -4,6 +4,7 @@
 
 #include "server/multi_command_squasher.h"
 
+#include <absl/cleanup/cleanup.h>
 #include <absl/container/inlined_vector.h>
 
 #include "base/cycle_clock.h"
@@ -14,6 +15,7 @@
 #include "server/command_registry.h"
 #include "server/conn_context.h"
 #include "server/engine_shard_set.h"
+#include "server/journal/journal.h"
 #include "server/transaction.h"
 #include "server/tx_base.h"
 
@@ -71,7 +73,7 @@ MultiCommandSquasher::MultiCommandSquasher(absl::Span<StoredCmd> cmds, Connectio
     : cmds_{cmds}, cntx_{cntx}, service_{service}, base_cid_{nullptr}, opts_{opts} {
   auto mode = cntx->transaction->GetMultiMode();
   base_cid_ = cntx->transaction->GetCId();
-  atomic_ = mode != Transaction::NON_ATOMIC;
+  atomic_ = mode != Transaction::NON_ATOMIC && !opts.snapshot;
 }
 
 MultiCommandSquasher::ShardExecInfo& MultiCommandSquasher::PrepareShardInfo(ShardId sid) {
@@ -168,12 +170,27 @@ bool MultiCommandSquasher::ExecuteStandalone(RedisReplyBuilder* rb, const Stored
   return true;
 }
 
-OpStatus MultiCommandSquasher::SquashedHopCb(EngineShard* es, RespVersion resp_v) {
+OpStatus MultiCommandSquasher::SquashedHopCb(EngineShard* es, RespVersion resp_v,
+                                             bool serialize) {
   auto& sinfo = sharded_[es->shard_id()];
   DCHECK(!sinfo.dispatched.empty());
 
+  // Writers that started running may have changed only some of their keys. Queued multi-shard
+  // writers may have already run on other shards.
+  uint64_t write_epoch = es->write_epoch();
+  if (opts_.snapshot && (es->dirty_lock_holders() > 0 || es->multi_shard_lock_holders() > 0 ||
+                         !es->shard_lock()->Check(IntentLock::SHARED))) {
+    snapshot_conflict_ = true;
+    return OpStatus::OK;
+  }
+  absl::Cleanup verify_snapshot = [&] {
+    if (opts_.snapshot && es->write_epoch() != write_epoch)
+      snapshot_conflict_ = true;
+  };
+
   auto* local_tx = sinfo.local_tx.get();
   CapturingReplyBuilder crb(ReplyMode::FULL, resp_v);
+  SerializingReplyBuilder srb(resp_v);
   ConnectionContext local_cntx{cntx_, local_tx};
   if (cntx_->conn()) {
     local_cntx.skip_acl_validation = cntx_->conn()->IsPrivileged();
@@ -181,36 +198,70 @@ OpStatus MultiCommandSquasher::SquashedHopCb(EngineShard* es, RespVersion resp_v
 
   CmdArgVec arg_vec;
 
-  auto move_reply = [&sinfo](CapturingReplyBuilder::Payload&& src,
-                             CapturingReplyBuilder::Payload* dst) {
-    *dst = std::move(src);
-    size_t sz = Size(*dst);
+  // Warm up the table buckets of read-only commands, so that their lookups that follow one by one
+  // do not stall on cache misses.
+  if (sinfo.dispatched.size() > 1) {
+    absl::InlinedVector<string_view, 32> read_keys;
+    for (const auto& dispatched : sinfo.dispatched) {
+      if (!dispatched.cmd->Cid()->IsReadOnly())
+        continue;
+      auto args = dispatched.cmd->ArgList(&arg_vec);
+      if (auto keys = DetermineKeys(dispatched.cmd->Cid(), args); keys.ok()) {
+        for (string_view key : keys->Range(args))
+          read_keys.push_back(key);
+      }
+    }
+    cntx_->ns->GetDbSlice(es->shard_id()).PrefetchKeys(local_cntx.conn_state.db_index, read_keys);
+  }
+
+  auto account_reply = [&sinfo](size_t sz) {
     sinfo.reply_size_delta += sz;
     sinfo.reply_size_total_ptr->fetch_add(sz, std::memory_order_relaxed);
   };
 
+  // Serialized replies are written by the connection as is, filtered reply modes need captures.
+  auto finish_reply = [&](ShardExecInfo::Command* dispatched) {
+    if (dispatched->serialized) {
+      srb.Finish();
+      account_reply(dispatched->serialized_reply.size());
+    } else {
+      dispatched->reply = crb.Take();
+      account_reply(Size(dispatched->reply));
+    }
+  };
+
+  // The commands of the hop share a transaction, so they are journaled as one entry.
+  journal::JournalBatchGuard journal_batch(es->journal());
+
   for (auto& dispatched : sinfo.dispatched) {
+    RedisReplyBuilder* rb = &crb;
+    dispatched.serialized = serialize && dispatched.cmd->ReplyMode() == ReplyMode::FULL;
+    if (dispatched.serialized) {
+      srb.SetDestination(&dispatched.serialized_reply);
+      rb = &srb;
+    } else {
+      crb.SetReplyMode(dispatched.cmd->ReplyMode());
+    }
+
     auto args = dispatched.cmd->ArgList(&arg_vec);
     if (opts_.verify_commands) {
       // The shared context is used for state verification, the local one is only for replies
       if (auto err = service_->VerifyCommandState(dispatched.cmd->Cid(), args, *cntx_); err) {
-        crb.SendError(std::move(*err));
-        move_reply(crb.Take(), &dispatched.reply);
+        rb->SendError(std::move(*err));
+        finish_reply(&dispatched);
         continue;
       }
     }
 
-    crb.SetReplyMode(dispatched.cmd->ReplyMode());
-
     local_tx->MultiSwitchCmd(dispatched.cmd->Cid());
     auto status = local_tx->InitByArgs(cntx_->ns, local_cntx.conn_state.db_index, args);
     if (status != OpStatus::OK) {
-      crb.SendError(status);
+      rb->SendError(status);
     } else {
       service_->InvokeCmd(dispatched.cmd->Cid(), args,
-                          CommandContext{local_cntx.transaction, &crb, &local_cntx});
+                          CommandContext{local_cntx.transaction, rb, &local_cntx});
     }
-    move_reply(crb.Take(), &dispatched.reply);
+    finish_reply(&dispatched);
 
     // Assert commands made no persistent state changes to stub context state
     const auto& local_state = local_cntx.conn_state;
@@ -233,6 +284,9 @@ bool MultiCommandSquasher::ExecuteSquashed(facade::RedisReplyBuilder* rb) {
       ++num_shards;
   }
 
+  // Replies to builders that capture or interpret them must go through the capture path.
+  bool serialize = rb->HasSink();
+
   Transaction* tx = cntx_->transaction;
   ServerState::tlocal()->stats.multi_squash_executions++;
   ServerState::tlocal()->stats.squash_width_freq_arr[num_shards - 1]++;
@@ -245,17 +299,19 @@ bool MultiCommandSquasher::ExecuteSquashed(facade::RedisReplyBuilder* rb) {
     cntx_->cid = base_cid_;
     auto cb = [this](ShardId sid) { return !sharded_[sid].dispatched.empty(); };
     tx->PrepareSquashedMultiHop(base_cid_, cb);
-    tx->ScheduleSingleHop(
-        [this, rb](auto* tx, auto* es) { return SquashedHopCb(es, rb->GetRespVersion()); });
+    tx->ScheduleSingleHop([this, rb, serialize](auto* tx, auto* es) {
+      return SquashedHopCb(es, rb->GetRespVersion(), serialize);
+    });
   } else {
     fb2::BlockingCounter bc(num_shards);
     DVLOG(1) << "Squashing " << num_shards << " " << tx->DebugId();
 
-    auto cb = [this, bc, rb]() mutable {
+    auto cb = [this, bc, rb, serialize]() mutable {
       if (ThisFiber::GetRunningTimeCycles() > max_busy_squash_cycles_cached) {
+        ServerState::tlocal()->stats.busy_squash_yields++;
         ThisFiber::Yield();
       }
-      this->SquashedHopCb(EngineShard::tlocal(), rb->GetRespVersion());
+      this->SquashedHopCb(EngineShard::tlocal(), rb->GetRespVersion(), serialize);
       bc->Dec();
     };
 
@@ -267,7 +323,7 @@ bool MultiCommandSquasher::ExecuteSquashed(facade::RedisReplyBuilder* rb) {
   }
 
   uint64_t after_hop = proactor->GetMonotonicTimeNs();
-  bool aborted = false;
+  bool aborted = snapshot_conflict_;
 
   ServerState* fresh_ss = ServerState::SafeTLocal();
 
@@ -276,16 +332,30 @@ bool MultiCommandSquasher::ExecuteSquashed(facade::RedisReplyBuilder* rb) {
     total_reply_size += sinfo.reply_size_delta;
   }
 
-  for (auto idx : order_) {
-    auto& sinfo = sharded_[idx];
-    DCHECK_LT(sinfo.reply_id, sinfo.dispatched.size());
-
-    auto& reply = sinfo.dispatched[sinfo.reply_id++].reply;
-    aborted |= opts_.error_abort && CapturingReplyBuilder::TryExtractError(reply);
+  {
+    // The replies stay alive until the dispatched lists are cleared below, so a single
+    // scope over the whole batch lets the builder reference large strings directly and write
+    // the batch with as few writev calls as possible, copying only what is cheap to copy.
+    SinkReplyBuilder::ReplyScope scope{rb};
+    for (auto idx : order_) {
+      if (aborted)  // the replies of conflicting snapshot reads are dropped
+        break;
 
-    CapturingReplyBuilder::Apply(std::move(reply), rb);
-    if (aborted)
-      break;
+      auto& sinfo = sharded_[idx];
+      DCHECK_LT(sinfo.reply_id, sinfo.dispatched.size());
+
+      auto& dispatched = sinfo.dispatched[sinfo.reply_id++];
+      if (dispatched.serialized) {
+        const string& reply = dispatched.serialized_reply;
+        aborted |= opts_.error_abort && !reply.empty() && reply[0] == '-';
+        rb->SendRaw(reply);
+      } else {
+        aborted |= opts_.error_abort && CapturingReplyBuilder::TryExtractError(dispatched.reply);
+        CapturingReplyBuilder::Apply(std::move(dispatched.reply), rb);
+      }
+      if (aborted)
+        break;
+    }
   }
   uint64_t after_reply = proactor->GetMonotonicTimeNs();
   fresh_ss->stats.multi_squash_exec_hop_usec += (after_hop - start) / 1000;
@@ -330,6 +400,40 @@ size_t MultiCommandSquasher::Run(RedisReplyBuilder* rb) {
   // Set last txid.
   cntx_->last_command_debug.clock = cntx_->transaction->txid();
 
+  UnlockLocalTxs();
+
+  VLOG(1) << "Squashed " << num_squashed_ << " of " << cmds_.size()
+          << " commands, max fanout: " << num_shards_ << ", atomic: " << atomic_;
+  return num_squashed_;
+}
+
+bool MultiCommandSquasher::ExecuteSnapshot(absl::Span<StoredCmd> cmds, RedisReplyBuilder* rb,
+                                           ConnectionContext* cntx, Service* service) {
+  Opts opts;
+  opts.max_squash_size = cmds.size();
+  opts.snapshot = true;
+
+  MultiCommandSquasher squasher{cmds, cntx, service, opts};
+  absl::Cleanup unlock = [&squasher] { squasher.UnlockLocalTxs(); };
+
+  for (auto& cmd : cmds) {
+    auto res = squasher.TrySquash(&cmd);
+    if (res == SquashResult::NOT_SQUASHED || res == SquashResult::ERROR ||
+        squasher.num_shards_ > 1)
+      return false;
+  }
+
+  if (!squasher.ExecuteSquashed(rb) && squasher.snapshot_conflict_) {
+    ServerState::SafeTLocal()->stats.multi_snapshot_conflicts++;
+    return false;
+  }
+
+  ServerState::SafeTLocal()->stats.multi_snapshot_executions++;
+  cntx->last_command_debug.clock = cntx->transaction->txid();
+  return true;
+}
+
+void MultiCommandSquasher::UnlockLocalTxs() {
   // UnlockMulti is a no-op for non-atomic multi transactions,
   // still called for correctness and future changes
   if (!IsAtomic()) {
@@ -338,10 +442,6 @@ size_t MultiCommandSquasher::Run(RedisReplyBuilder* rb) {
         sd.local_tx->UnlockMulti();
     }
   }
-
-  VLOG(1) << "Squashed " << num_squashed_ << " of " << cmds_.size()
-          << " commands, max fanout: " << num_shards_ << ", atomic: " << atomic_;
-  return num_squashed_;
 }
 
 bool MultiCommandSquasher::IsAtomic() const {
@@ -26,6 +26,7 @@ class MultiCommandSquasher {
     bool verify_commands = false;   // Whether commands need to be verified before execution
     bool error_abort = false;       // Abort upon receiving error
     unsigned max_squash_size = 32;  // How many commands to squash at once
+    bool snapshot = false;          // Non-atomic reads verified by ExecuteSnapshot
   };
 
   // Returns number of processed commands.
@@ -34,6 +35,14 @@ class MultiCommandSquasher {
     return MultiCommandSquasher{cmds, cntx, service, opts}.Run(rb);
   }
 
+  // Runs read-only commands of a single shard in one hop without locking their keys ahead.
+  // The hop reads only if no started writer holds locks on the shard and verifies that no write
+  // ran on the shard while the commands were running. Returns false without replying if the
+  // commands span several shards or a write interfered, the caller should then run them
+  // under a regular multi transaction.
+  static bool ExecuteSnapshot(absl::Span<StoredCmd> cmds, facade::RedisReplyBuilder* rb,
+                              ConnectionContext* cntx, Service* service);
+
   static void SetMaxBusySquashUsec(uint32_t usec);
 
  private:
@@ -45,6 +54,8 @@ class MultiCommandSquasher {
     struct Command {
       const StoredCmd* cmd;
       facade::CapturingReplyBuilder::Payload reply;
+      std::string serialized_reply;  // Used instead of reply if serialized is set
+      bool serialized = false;
     };
     std::vector<Command> dispatched;  // Dispatched commands
     unsigned reply_id = 0;
@@ -68,8 +79,9 @@ class MultiCommandSquasher {
   // Execute separate non-squashed cmd. Return false if aborting on error.
   bool ExecuteStandalone(facade::RedisReplyBuilder* rb, const StoredCmd* cmd);
 
-  // Callback that runs on shards during squashed hop.
-  facade::OpStatus SquashedHopCb(EngineShard* es, facade::RespVersion resp_v);
+  // Callback that runs on shards during squashed hop. If serialize is set, replies of commands
+  // with full reply mode are serialized to RESP on the shard instead of being captured.
+  facade::OpStatus SquashedHopCb(EngineShard* es, facade::RespVersion resp_v, bool serialize);
 
   // Execute all currently squashed commands. Return false if aborting on error.
   bool ExecuteSquashed(facade::RedisReplyBuilder* rb);
@@ -79,6 +91,8 @@ class MultiCommandSquasher {
 
   bool IsAtomic() const;
 
+  void UnlockLocalTxs();
+
   absl::Span<StoredCmd> cmds_;  // Input range of stored commands
   ConnectionContext* cntx_;     // Underlying context
   Service* service_;
@@ -93,6 +107,7 @@ class MultiCommandSquasher {
 
   size_t num_squashed_ = 0;
   size_t num_shards_ = 0;
+  bool snapshot_conflict_ = false;  // Set by the hop if a write interfered with snapshot reads
 
   std::vector<MutableSlice> tmp_keylist_;
 };
@@ -17,6 +17,7 @@
 #include "server/transaction.h"
 
 ABSL_DECLARE_FLAG(bool, multi_exec_squash);
+ABSL_DECLARE_FLAG(bool, watch_by_version);
 ABSL_DECLARE_FLAG(bool, lua_auto_async);
 ABSL_DECLARE_FLAG(bool, lua_allow_undeclared_auto_correct);
 ABSL_DECLARE_FLAG(std::string, default_lua_flags);
@@ -353,6 +354,74 @@ TEST_F(MultiTest, MultiCommandsWithBonusKeys) {
   EXPECT_THAT(resp, ErrArg("syntax error"));
 }
 
+TEST_F(MultiTest, ReadOnlySnapshot) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_multi_exec_squash, true);
+
+  EXPECT_EQ(Shard("za", shard_set->size()), Shard("zb", shard_set->size()));
+  Run({"set", "za", "1"});
+  Run({"lpush", "zb", "a", "b"});
+
+  // Single shard read-only bodies run without locking ahead.
+  Run({"multi"});
+  Run({"get", "za"});
+  Run({"lrange", "zb", "0", "-1"});
+  Run({"exists", "za", "zb"});
+  auto resp = Run({"exec"});
+  ASSERT_THAT(resp, ArrLen(3));
+  EXPECT_EQ(resp.GetVec()[0], "1");
+  EXPECT_THAT(resp.GetVec()[1].GetVec(), ElementsAre("b", "a"));
+  EXPECT_THAT(resp.GetVec()[2], IntArg(2));
+  EXPECT_EQ(1u, GetMetrics().coordinator_stats.multi_snapshot_executions);
+  EXPECT_EQ(0u, NumLocked());
+
+  // Bodies with writes or keys on several shards lock ahead.
+  Run({"multi"});
+  Run({"get", "za"});
+  Run({"set", "zb", "2"});
+  EXPECT_THAT(Run({"exec"}), ArrLen(2));
+
+  Run({"multi"});
+  Run({"get", kKeySid0});
+  Run({"get", kKeySid1});
+  EXPECT_THAT(Run({"exec"}), ArrLen(2));
+  EXPECT_EQ(1u, GetMetrics().coordinator_stats.multi_snapshot_executions);
+}
+
+TEST_F(MultiTest, ReadOnlySnapshotConflict) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_multi_exec_squash, true);
+
+  Run({"set", "za", "1"});
+  Run({"set", "zb", "2"});
+
+  // A queued multi-shard writer may have already run on the other shards, so the body falls back
+  // to locking ahead.
+  ShardId sid = Shard("za", shard_set->size());
+  shard_set->Await(sid, [] { EngineShard::tlocal()->OnMultiShardLocksAcquired(); });
+
+  Run({"multi"});
+  Run({"get", "za"});
+  Run({"get", "zb"});
+  auto resp = Run({"exec"});
+
+  shard_set->Await(sid, [] { EngineShard::tlocal()->OnMultiShardLocksReleased(); });
+
+  ASSERT_THAT(resp, ArrLen(2));
+  EXPECT_EQ(resp.GetVec()[0], "1");
+  EXPECT_EQ(resp.GetVec()[1], "2");
+  EXPECT_EQ(1u, GetMetrics().coordinator_stats.multi_snapshot_conflicts);
+  EXPECT_EQ(0u, GetMetrics().coordinator_stats.multi_snapshot_executions);
+  EXPECT_EQ(0u, NumLocked());
+
+  // Without it the body runs in one hop again.
+  Run({"multi"});
+  Run({"get", "za"});
+  Run({"get", "zb"});
+  EXPECT_THAT(Run({"exec"}), ArrLen(2));
+  EXPECT_EQ(1u, GetMetrics().coordinator_stats.multi_snapshot_executions);
+}
+
 TEST_F(MultiTest, MultiHop) {
   Run({"set", kKey1, "1"});
 
@@ -600,6 +669,53 @@ TEST_F(MultiTest, Watch) {
   ASSERT_THAT(Run({"exec"}), kExecSuccess);
 }
 
+TEST_F(MultiTest, WatchByVersion) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_watch_by_version, true);
+
+  auto kExecFail = ArgType(RespExpr::NIL);
+  auto kExecSuccess = ArgType(RespExpr::ARRAY);
+
+  // Unchanged key.
+  Run({"set", "a", "1"});
+  EXPECT_EQ(Run({"watch", "a"}), "OK");
+  Run({"multi"});
+  Run({"get", "a"});
+  ASSERT_THAT(Run({"exec"}), kExecSuccess);
+
+  // Write from another connection.
+  EXPECT_EQ(Run({"watch", "a"}), "OK");
+  pp_->at(1)->Await([&] { return Run({"set", "a", "2"}); });
+  Run({"multi"});
+  ASSERT_THAT(Run({"exec"}), kExecFail);
+
+  // Key recreated with the same value.
+  EXPECT_EQ(Run({"watch", "a"}), "OK");
+  Run({"del", "a"});
+  Run({"set", "a", "2"});
+  Run({"multi"});
+  ASSERT_THAT(Run({"exec"}), kExecFail);
+
+  // Expiry changes are writes.
+  EXPECT_EQ(Run({"watch", "a"}), "OK");
+  Run({"expire", "a", "100"});
+  Run({"multi"});
+  ASSERT_THAT(Run({"exec"}), kExecFail);
+
+  // Missing keys fall back to registration, also when mixed with versioned ones.
+  Run({"del", "b"});
+  EXPECT_EQ(Run({"watch", "a", "b"}), "OK");
+  Run({"set", "b", "1"});
+  Run({"multi"});
+  ASSERT_THAT(Run({"exec"}), kExecFail);
+
+  // Flush removes the watched keys.
+  EXPECT_EQ(Run({"watch", "a", "b"}), "OK");
+  Run({"flushdb"});
+  Run({"multi"});
+  ASSERT_THAT(Run({"exec"}), kExecFail);
+}
+
 TEST_F(MultiTest, MultiOOO) {
   GTEST_SKIP() << "Command squashing breaks stats";
 
@@ -663,6 +779,58 @@ TEST_F(MultiTest, EvalOOO) {
   EXPECT_EQ(1 + 2 * kTimes, sum);
 }
 
+TEST_F(MultiTest, EvalSameShardDisjointKeys) {
+  if (auto config = absl::GetFlag(FLAGS_default_lua_flags); config != "") {
+    GTEST_SKIP() << "Skipped EvalSameShardDisjointKeys test because default_lua_flags is set";
+    return;
+  }
+
+  // Find two keys owned by shard 0.
+  vector<string> keys;
+  for (unsigned i = 0; keys.size() < 2; ++i) {
+    string key = absl::StrCat("counter", i);
+    if (Shard(key, shard_set->size()) == 0)
+      keys.push_back(key);
+  }
+
+  const char* kScript = "return redis.call('INCR', KEYS[1])";
+  const int kTimes = 20;
+  auto run = [this, kScript](string key) {
+    for (int i = 0; i < kTimes; i++)
+      Run({"eval", kScript, "1", key});
+  };
+
+  // Both connections live on other threads, so the scripts run remotely on shard 0.
+  auto f1 = pp_->at(1)->LaunchFiber([&] { run(keys[0]); });
+  auto f2 = pp_->at(2)->LaunchFiber([&] { run(keys[1]); });
+  f1.Join();
+  f2.Join();
+
+  EXPECT_EQ(Run({"get", keys[0]}), absl::StrCat(kTimes));
+  EXPECT_EQ(Run({"get", keys[1]}), absl::StrCat(kTimes));
+}
+
+TEST_F(MultiTest, EvalFastGet) {
+  if (auto config = absl::GetFlag(FLAGS_default_lua_flags); config != "") {
+    GTEST_SKIP() << "Skipped EvalFastGet test because default_lua_flags is set";
+    return;
+  }
+
+  Run({"set", "str", "value"});
+  Run({"lpush", "list", "a"});
+
+  // Single key scripts run on the shard, where GET calls take the fast path.
+  EXPECT_EQ(Run({"eval", "return redis.call('GET', KEYS[1])", "1", "str"}), "value");
+  EXPECT_THAT(Run({"eval", "return redis.call('get', KEYS[1])", "1", "missing"}),
+              ArgType(RespExpr::NIL));
+  EXPECT_THAT(Run({"eval", "return redis.call('GET', KEYS[1])", "1", "list"}),
+              ErrArg("WRONGTYPE"));
+
+  // Undeclared keys are still rejected by the regular dispatch.
+  EXPECT_THAT(Run({"eval", "return redis.call('GET', 'str')", "1", "list"}),
+              ErrArg("undeclared"));
+}
+
 // Run MULTI/EXEC commands in parallel, where each command is:
 //        MULTI - SET k1 v - SET k2 v - SET k3 v - EXEC
 // but the order of the commands inside appears in any permutation.
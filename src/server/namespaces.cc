@@ -4,18 +4,27 @@
 
 #include "server/namespaces.h"
 
+#include <absl/strings/numbers.h>
+#include <absl/strings/str_split.h>
+
 #include "base/flags.h"
 #include "base/logging.h"
+#include "facade/facade_types.h"
 #include "server/common.h"
 #include "server/engine_shard_set.h"
 
+ABSL_FLAG(std::vector<std::string>, namespace_limits, {},
+          "Comma separated limits of namespaces, each as name:maxmemory:ops_per_sec, for example "
+          "tenant1:1G:10000. maxmemory is split evenly between the shards and a namespace over it "
+          "rejects new keys or, in cache mode, evicts its own keys. 0 disables a limit.");
+
 ABSL_DECLARE_FLAG(bool, cache_mode);
 
 namespace dfly {
 
 using namespace std;
 
-Namespace::Namespace() {
+Namespace::Namespace(Limits limits) : limits_(limits) {
   shard_db_slices_.resize(shard_set->size());
   shard_blocking_controller_.resize(shard_set->size());
   shard_set->RunBriefInParallel([&](EngineShard* es) {
@@ -23,9 +32,22 @@ Namespace::Namespace() {
     ShardId sid = es->shard_id();
     shard_db_slices_[sid] = make_unique<DbSlice>(sid, absl::GetFlag(FLAGS_cache_mode), es);
     shard_db_slices_[sid]->UpdateExpireBase(absl::GetCurrentTimeNanos() / 1000000, 0);
+    shard_db_slices_[sid]->SetMemoryQuota(limits_.max_memory / shard_set->size());
   });
 }
 
+bool Namespace::TryAcquireOp(uint64_t now_sec) {
+  if (limits_.max_ops_per_sec == 0)
+    return true;
+
+  uint64_t window = ops_window_sec_.load(memory_order_relaxed);
+  if (window != now_sec && ops_window_sec_.compare_exchange_strong(window, now_sec,
+                                                                   memory_order_relaxed)) {
+    ops_in_window_.store(0, memory_order_relaxed);
+  }
+  return ops_in_window_.fetch_add(1, memory_order_relaxed) < limits_.max_ops_per_sec;
+}
+
 DbSlice& Namespace::GetCurrentDbSlice() {
   EngineShard* es = EngineShard::tlocal();
   CHECK(es != nullptr);
@@ -50,6 +72,20 @@ BlockingController* Namespace::GetBlockingController(ShardId sid) {
 }
 
 Namespaces::Namespaces() {
+  for (string_view entry : absl::GetFlag(FLAGS_namespace_limits)) {
+    vector<string_view> parts = absl::StrSplit(entry, ':');
+    Namespace::Limits limits;
+    facade::MemoryBytesFlag max_memory;
+    string err;
+    if (parts.size() != 3 || parts[0].empty() || !AbslParseFlag(parts[1], &max_memory, &err) ||
+        !absl::SimpleAtoi(parts[2], &limits.max_ops_per_sec)) {
+      LOG(ERROR) << "Invalid namespace_limits entry " << entry << " " << err;
+      exit(1);
+    }
+    limits.max_memory = max_memory.value;
+    limits_[parts[0]] = limits;
+  }
+
   default_namespace_ = &GetOrInsert("");
 }
 
@@ -94,7 +130,9 @@ Namespace& Namespaces::GetOrInsert(std::string_view ns) {
   {
     // Key was not found, so we create create it under unique lock
     util::fb2::LockGuard guard(mu_);
-    return namespaces_[ns];
+    auto it = limits_.find(ns);
+    return namespaces_.try_emplace(ns, it != limits_.end() ? it->second : Namespace::Limits{})
+        .first->second;
   }
 }
 
@@ -6,6 +6,7 @@
 
 #include <absl/container/node_hash_map.h>
 
+#include <atomic>
 #include <memory>
 #include <string>
 #include <vector>
@@ -21,9 +22,16 @@ namespace dfly {
 // It can be used to allow multiple tenants to use the same server without hacks of using a common
 // prefix, or SELECT-ing a different database.
 // Each Namespace contains per-shard DbSlice, as well as a BlockingController.
+// Namespaces can be limited in memory and operations per second, see the namespace_limits flag,
+// so that a tenant can not evict or starve the others.
 class Namespace {
  public:
-  Namespace();
+  struct Limits {
+    size_t max_memory = 0;        // split evenly between the shards, 0 means no limit
+    uint64_t max_ops_per_sec = 0;  // 0 means no limit
+  };
+
+  explicit Namespace(Limits limits = {});
 
   DbSlice& GetCurrentDbSlice();
 
@@ -31,7 +39,19 @@ class Namespace {
   BlockingController* GetOrAddBlockingController(EngineShard* shard);
   BlockingController* GetBlockingController(ShardId sid);
 
+  const Limits& limits() const {
+    return limits_;
+  }
+
+  // Counts a command against the ops limit of the current second. Returns false if the limit
+  // is reached. The window is shared by all threads, so the limit is approximate.
+  bool TryAcquireOp(uint64_t now_sec);
+
  private:
+  Limits limits_;
+  std::atomic<uint64_t> ops_window_sec_{0};
+  std::atomic<uint64_t> ops_in_window_{0};
+
   std::vector<std::unique_ptr<DbSlice>> shard_db_slices_;
   std::vector<std::unique_ptr<BlockingController>> shard_blocking_controller_;
 
@@ -60,6 +80,7 @@ class Namespaces {
  private:
   util::fb2::SharedMutex mu_{};
   absl::node_hash_map<std::string, Namespace> namespaces_ ABSL_GUARDED_BY(mu_);
+  absl::flat_hash_map<std::string, Namespace::Limits> limits_;  // parsed namespace_limits
   Namespace* default_namespace_ = nullptr;
 };
 
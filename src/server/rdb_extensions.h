@@ -14,6 +14,9 @@ constexpr uint8_t RDB_TYPE_HASH_WITH_EXPIRY = 31;
 constexpr uint8_t RDB_TYPE_SET_WITH_EXPIRY = 32;
 constexpr uint8_t RDB_TYPE_SBF = 33;
 
+// Option flags of RDB_TYPE_SBF objects.
+constexpr uint8_t RDB_SBF_BLOCKED = 1;
+
 constexpr bool rdbIsObjectTypeDF(uint8_t type) {
   return __rdbIsObjectType(type) || (type == RDB_TYPE_JSON) ||
          (type == RDB_TYPE_HASH_WITH_EXPIRY) || (type == RDB_TYPE_SET_WITH_EXPIRY) ||
@@ -39,6 +42,15 @@ constexpr uint8_t RDB_OPCODE_JOURNAL_BLOB = 210;
 // so it is always sent at the end of the RDB stream.
 constexpr uint8_t RDB_OPCODE_JOURNAL_OFFSET = 211;
 
+// Key that was deleted since the snapshot a delta snapshot builds upon. Followed by the key.
+// Delta snapshots write them before any entry, so a key that was deleted and re-added is
+// loaded correctly.
+constexpr uint8_t RDB_OPCODE_DELETED_KEY = 212;
+
+// Zstd dictionary for the compressed blobs that follow it in the same stream. Followed by the
+// dictionary string.
+constexpr uint8_t RDB_OPCODE_COMPRESSION_DICT = 213;
+
 constexpr uint8_t RDB_OPCODE_DF_MASK = 220; /* Mask for key properties */
 
 // RDB_OPCODE_DF_MASK define 4byte field with next flags
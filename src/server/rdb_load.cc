@@ -34,12 +34,14 @@ extern "C" {
 #include "core/string_set.h"
 #include "server/cluster/cluster_config.h"
 #include "server/container_utils.h"
+#include "server/detail/lazy_key_fetcher.h"
 #include "server/engine_shard_set.h"
 #include "server/error.h"
 #include "server/family_utils.h"
 #include "server/hset_family.h"
 #include "server/journal/executor.h"
 #include "server/journal/serializer.h"
+#include "server/list_family.h"
 #include "server/main_service.h"
 #include "server/rdb_extensions.h"
 #include "server/script_mgr.h"
@@ -51,8 +53,6 @@ extern "C" {
 #include "server/transaction.h"
 #include "strings/human_readable.h"
 
-ABSL_DECLARE_FLAG(int32_t, list_max_listpack_size);
-ABSL_DECLARE_FLAG(int32_t, list_compress_depth);
 ABSL_DECLARE_FLAG(uint32_t, dbnum);
 ABSL_FLAG(bool, rdb_load_dry_run, false, "Dry run RDB load without applying changes");
 ABSL_FLAG(bool, rdb_ignore_expiry, false, "Ignore Key Expiry when loding from RDB snapshot");
@@ -195,6 +195,42 @@ DbSlice& GetCurrentDbSlice() {
   return namespaces->GetDefaultNamespace().GetCurrentDbSlice();
 }
 
+class InMemSource : public ::io::Source {
+ public:
+  InMemSource(std::string_view buf) : buf_(buf) {
+  }
+
+  ::io::Result<size_t> ReadSome(const iovec* v, uint32_t len) final;
+
+ protected:
+  std::string_view buf_;
+  off_t offs_ = 0;
+};
+
+::io::Result<size_t> InMemSource::ReadSome(const iovec* v, uint32_t len) {
+  ssize_t read_total = 0;
+  while (size_t(offs_) < buf_.size() && len > 0) {
+    size_t read_sz = min<size_t>(buf_.size() - offs_, v->iov_len);
+    memcpy(v->iov_base, buf_.data() + offs_, read_sz);
+    read_total += read_sz;
+    offs_ += read_sz;
+
+    ++v;
+    --len;
+  }
+
+  return read_total;
+}
+
+// Removes key if it exists, used to apply deletions recorded in delta snapshots.
+void DeleteOnShard(const DbContext& db_cntx, string_view key, DbSlice* db_slice) {
+  auto res = db_slice->FindMutable(db_cntx, key);
+  if (IsValid(res.it)) {
+    res.post_updater.Run();
+    db_slice->Del(db_cntx, res.it);
+  }
+}
+
 }  // namespace
 
 class RdbLoaderBase::OpaqueObjLoader {
@@ -300,7 +336,7 @@ void RdbLoaderBase::OpaqueObjLoader::operator()(const unique_ptr<LoadTrace>& ptr
 void RdbLoaderBase::OpaqueObjLoader::operator()(const RdbSBF& src) {
   SBF* sbf =
       CompactObj::AllocateMR<SBF>(src.grow_factor, src.fp_prob, src.max_capacity, src.prev_size,
-                                  src.current_size, CompactObj::memory_resource());
+                                  src.current_size, CompactObj::memory_resource(), src.blocked);
   for (unsigned i = 0; i < src.filters.size(); ++i) {
     sbf->AddFilter(src.filters[i].blob, src.filters[i].hash_cnt);
   }
@@ -548,8 +584,7 @@ void RdbLoaderBase::OpaqueObjLoader::CreateList(const LoadTrace* ltrace) {
     DCHECK_EQ(pv_->Encoding(), kEncodingQL2);
     qlv2 = static_cast<QList*>(pv_->RObjPtr());
   } else {
-    qlv2 = CompactObj::AllocateMR<QList>(GetFlag(FLAGS_list_max_listpack_size),
-                                         GetFlag(FLAGS_list_compress_depth));
+    qlv2 = ListFamily::NewQList();
   }
 
   auto cleanup = absl::Cleanup([&] {
@@ -666,7 +701,8 @@ void RdbLoaderBase::OpaqueObjLoader::CreateZSet(const LoadTrace* ltrace) {
       maxelelen = sv.size();
     totelelen += sv.size();
 
-    if (!zs->InsertNew(score, sv)) {
+    // Members are saved in score order.
+    if (!zs->AppendNew(score, sv)) {
       LOG(ERROR) << "Duplicate zset fields detected";
       ec_ = RdbError(errc::rdb_file_corrupted);
       return false;
@@ -800,6 +836,7 @@ void RdbLoaderBase::OpaqueObjLoader::CreateStream(const LoadTrace* ltrace) {
         streamFreeNACK(nack);
         return;
       }
+      streamPelIndexAdd(cgroup, const_cast<uint8_t*>(pel.rawid.data()), nack);
     }
 
     for (const auto& cons : cg.cons_arr) {
@@ -1855,8 +1892,9 @@ auto RdbLoaderBase::ReadSBF() -> io::Result<OpaqueObj> {
   RdbSBF res;
   uint64_t options;
   SET_OR_UNEXPECT(LoadLen(nullptr), options);
-  if (options != 0)
+  if (options & ~uint64_t(RDB_SBF_BLOCKED))
     return Unexpected(errc::rdb_file_corrupted);
+  res.blocked = options & RDB_SBF_BLOCKED;
   SET_OR_UNEXPECT(FetchBinaryDouble(), res.grow_factor);
   SET_OR_UNEXPECT(FetchBinaryDouble(), res.fp_prob);
   if (res.fp_prob <= 0 || res.fp_prob > 0.5) {
@@ -1879,6 +1917,9 @@ auto RdbLoaderBase::ReadSBF() -> io::Result<OpaqueObj> {
     if (!is_power2(bit_len)) {  // must be power of two
       return Unexpected(errc::rdb_file_corrupted);
     }
+    if (res.blocked && bit_len < Bloom::kBlockBits) {
+      return Unexpected(errc::rdb_file_corrupted);
+    }
     res.filters.emplace_back(hash_cnt, std::move(filter_data));
   }
   return OpaqueObj{std::move(res), RDB_TYPE_SBF};
@@ -1899,6 +1940,57 @@ io::Result<uint8_t> RdbLoaderBase::FetchType() {
   return FetchInt<uint8_t>();
 }
 
+// -------------- RdbValueLoader   ----------------------------
+
+error_code RdbValueLoader::Parse(io::Source* source, OpaqueObj* dest) {
+  src_ = source;
+  if (pending_read_.remaining == 0) {
+    io::Result<uint8_t> type_id = FetchType();
+    if (type_id && rdbIsObjectTypeDF(type_id.value())) {
+      rdb_type_ = *type_id;
+    }
+  }
+
+  if (rdb_type_ == -1) {
+    LOG(ERROR) << "failed to load type id from the input stream or type id is invalid";
+    return RdbError(errc::invalid_rdb_type);
+  }
+
+  error_code ec = ReadObj(rdb_type_, dest);  // load the type from the input stream
+  if (ec) {
+    LOG(ERROR) << "failed to load data for type id " << rdb_type_;
+  }
+  return ec;
+}
+
+error_code RdbValueLoader::Load(string_view payload, CompactObj* pv) {
+  InMemSource data_src(payload);
+  bool first_parse = true;
+  do {
+    OpaqueObj obj;
+    if (auto ec = Parse(&data_src, &obj); ec)
+      return ec;
+
+    LoadConfig config;
+    if (first_parse) {
+      first_parse = false;
+    } else {
+      config.append = true;
+    }
+    if (pending_read_.remaining > 0) {
+      config.streamed = true;
+    }
+    config.reserve = pending_read_.reserve;
+
+    if (auto ec = FromOpaque(obj, config, pv); ec) {
+      LOG(WARNING) << "error while trying to read data: " << ec;
+      return ec;
+    }
+  } while (pending_read_.remaining > 0);
+
+  return {};
+}
+
 // -------------- RdbLoader   ----------------------------
 
 struct RdbLoader::ObjSettings {
@@ -2015,6 +2107,11 @@ error_code RdbLoader::Load(io::Source* src) {
       continue;
     }
 
+    // Entries of lazy loads are inserted inline, so all entries before the read position were
+    // inserted. Compressed blobs are reported once they were consumed entirely.
+    if (lazy_fetcher_ && mem_buf_ == &origin_mem_buf_)
+      lazy_fetcher_->SetLoadedOffset(bytes_read_ - mem_buf_->InputLen());
+
     /* Read type. */
     SET_OR_RETURN(FetchType(), type);
 
@@ -2089,6 +2186,21 @@ error_code RdbLoader::Load(io::Source* src) {
       continue;
     }
 
+    if (type == RDB_OPCODE_DELETED_KEY) {
+      string key;
+      SET_OR_RETURN(ReadKey(), key);
+      DeleteKey(std::move(key));
+      continue;
+    }
+
+    if (type == RDB_OPCODE_COMPRESSION_DICT) {
+      string dict;
+      SET_OR_RETURN(FetchGenericString(), dict);
+      RETURN_ON_ERR(AllocateDecompressOnce(RDB_OPCODE_COMPRESSED_ZSTD_BLOB_START));
+      RETURN_ON_ERR(decompress_impl_->SetDict(dict));
+      continue;
+    }
+
     if (type == RDB_OPCODE_SELECTDB) {
       unsigned dbid = 0;
 
@@ -2126,9 +2238,10 @@ error_code RdbLoader::Load(io::Source* src) {
 
       VLOG(1) << "RESIZEDB: db_size=" << db_size << ", expires_size=" << expires_size;
 
-      // We do not use this information because it is not possible to easily preallocate
-      // dash tables based on this information. Moreover, number of shards can change
-      // between the original shard set and the loading server.
+      // Keys are spread evenly over the shards by hash, whatever the number of shards of the
+      // server that saved them.
+      if (!slot_filter_ && !delta_load_)
+        shard_set->ReserveKeys(cur_db_index_, db_size);
       continue; /* Read next opcode. */
     }
 
@@ -2195,6 +2308,77 @@ error_code RdbLoader::Load(io::Source* src) {
   return kOk;
 }
 
+error_code RdbLoader::LoadKey(string_view chain, size_t len, DbIndex db, string_view key,
+                              bool* found) {
+  InMemSource src(chain);
+  src_ = &src;
+  bytes_read_ = 0;
+  source_limit_ = SIZE_MAX;
+  mem_buf_ = &origin_mem_buf_;
+  mem_buf_->ConsumeInput(mem_buf_->InputLen());
+  pending_read_ = {};
+  rdb_version_ = RDB_SER_VERSION;
+
+  KeyFilter filter{db, key};
+  key_filter_ = &filter;
+  auto cleanup = absl::Cleanup([this] {
+    key_filter_ = nullptr;
+    src_ = nullptr;
+  });
+
+  ObjSettings settings;
+  settings.now = GetCurrentTimeMs();
+
+  // Compressed blobs are consumed as a whole, so the chain ends in the origin buffer.
+  while (mem_buf_ != &origin_mem_buf_ || bytes_read_ - mem_buf_->InputLen() < len) {
+    int type;
+    SET_OR_RETURN(FetchType(), type);
+
+    if (type == RDB_OPCODE_EXPIRETIME_MS) {
+      int64_t val;
+      SET_OR_RETURN(FetchInt<int64_t>(), val);
+      if (!rdb_ignore_expiry_)
+        settings.SetExpire(val);
+    } else if (type == RDB_OPCODE_DF_MASK) {
+      uint32_t mask;
+      SET_OR_RETURN(FetchInt<uint32_t>(), mask);
+      settings.is_sticky = mask & DF_MASK_FLAG_STICKY;
+      settings.has_mc_flags = mask & DF_MASK_FLAG_MC_FLAGS;
+      if (settings.has_mc_flags) {
+        SET_OR_RETURN(FetchInt<uint32_t>(), settings.mc_flags);
+      }
+    } else if (type == RDB_OPCODE_SELECTDB) {
+      unsigned dbid = 0;
+      SET_OR_RETURN(LoadLen(nullptr), dbid);
+      if (dbid > GetFlag(FLAGS_dbnum))
+        return RdbError(errc::bad_db_index);
+      cur_db_index_ = dbid;
+      GetCurrentDbSlice().ActivateDb(dbid);
+    } else if (type == RDB_OPCODE_DELETED_KEY) {
+      string deleted_key;
+      SET_OR_RETURN(ReadKey(), deleted_key);
+    } else if (type == RDB_OPCODE_COMPRESSION_DICT) {
+      string dict;
+      SET_OR_RETURN(FetchGenericString(), dict);
+      RETURN_ON_ERR(AllocateDecompressOnce(RDB_OPCODE_COMPRESSED_ZSTD_BLOB_START));
+      RETURN_ON_ERR(decompress_impl_->SetDict(dict));
+    } else if (type == RDB_OPCODE_COMPRESSED_ZSTD_BLOB_START ||
+               type == RDB_OPCODE_COMPRESSED_LZ4_BLOB_START) {
+      RETURN_ON_ERR(HandleCompressedBlob(type));
+    } else if (type == RDB_OPCODE_COMPRESSED_BLOB_END) {
+      RETURN_ON_ERR(HandleCompressedBlobFinish());
+    } else if (rdbIsObjectTypeDF(type)) {
+      RETURN_ON_ERR(LoadKeyValPair(type, &settings));
+      settings.Reset();
+    } else {
+      return RdbError(errc::invalid_rdb_type);
+    }
+  }
+
+  *found = filter.found;
+  return kOk;
+}
+
 void RdbLoader::FinishLoad(absl::Time start_time, size_t* keys_loaded) {
   BlockingCounter bc(shard_set->size());
   for (unsigned i = 0; i < shard_set->size(); ++i) {
@@ -2433,7 +2617,14 @@ error_code RdbLoader::HandleAux() {
   } else if (auxkey == "repl-stream-db") {
     // TODO
   } else if (auxkey == "repl-id") {
-    // TODO
+    repl_id_ = std::move(auxval);
+  } else if (auxkey == "repl-lsn") {
+    LSN lsn;
+    if (absl::SimpleAtoi(auxval, &lsn)) {
+      repl_lsn_ = lsn;
+    }
+  } else if (auxkey == "delta-chain") {
+    delta_chain_ = std::move(auxval);
   } else if (auxkey == "repl-offset") {
     // TODO
   } else if (auxkey == "lua") {
@@ -2487,6 +2678,25 @@ error_code RdbLoader::HandleAux() {
     if (absl::SimpleAtoi(auxval, &shard_id)) {
       shard_id_ = shard_id;
     }
+  } else if (auxkey == "search-graphs") {
+    // Graphs can be restored only if the documents are loaded into the same shard
+    if (shard_id_ < shard_set->size() && shard_count_ == shard_set->size()) {
+      shard_set->Await(shard_id_, [&] {
+        EngineShard::tlocal()->search_indices()->SetRestoredGraphs(std::move(auxval));
+      });
+    }
+  } else if (auxkey == "db-keys") {
+    // Dragonfly snapshots record the number of keys of each db in the summary, which is loaded
+    // before the shard files.
+    for (string_view db_keys : absl::StrSplit(auxval, ',', absl::SkipEmpty())) {
+      pair<string_view, string_view> db_and_keys = absl::StrSplit(db_keys, ':');
+      unsigned db_ind;
+      size_t keys;
+      if (!slot_filter_ && !delta_load_ && absl::SimpleAtoi(db_and_keys.first, &db_ind) &&
+          absl::SimpleAtoi(db_and_keys.second, &keys) && db_ind < GetFlag(FLAGS_dbnum)) {
+        shard_set->ReserveKeys(db_ind, keys);
+      }
+    }
   } else if (auxkey == "table-mem") {
     size_t mem;
     if (absl::SimpleAtoi(auxval, &mem)) {
@@ -2538,6 +2748,24 @@ void RdbLoader::FlushShardAsync(ShardId sid) {
   VLOG_IF(2, preempted) << "FlushShardAsync was throttled";
 }
 
+void RdbLoader::DeleteKey(string key) {
+  if (slot_filter_ && !slot_filter_->Contains(KeySlot(key)))
+    return;
+
+  ShardId sid = Shard(key, shard_set->size());
+  DbContext db_cntx{&namespaces->GetDefaultNamespace(), cur_db_index_, GetCurrentTimeMs()};
+  if (EngineShard* es = EngineShard::tlocal(); es && es->shard_id() == sid) {
+    DeleteOnShard(db_cntx, key, &db_cntx.GetDbSlice(sid));
+    return;
+  }
+
+  // Items of the shard that were read before the deletion must be loaded first.
+  FlushShardAsync(sid);
+  shard_set->Add(sid, [db_cntx, sid, key = std::move(key)] {
+    DeleteOnShard(db_cntx, key, &db_cntx.GetDbSlice(sid));
+  });
+}
+
 void RdbLoader::FlushAllShards() {
   for (ShardId i = 0; i < shard_set->size(); i++)
     FlushShardAsync(i);
@@ -2561,6 +2789,14 @@ void RdbLoader::CreateObjectOnShard(const DbContext& db_cntx, const Item* item,
   PrimeValue* pv_ptr = &pv;
   DbIndex db_ind = db_cntx.db_index;
 
+  // Keys that were fetched on demand during a lazy load might have changed since.
+  if (lazy_fetcher_ && !lazy_fetcher_->StartLoad(db_ind, item->key))
+    return;
+  auto end_load = absl::Cleanup([this] {
+    if (lazy_fetcher_)
+      lazy_fetcher_->EndLoad();
+  });
+
   auto error_msg = [](const auto* item, auto db_ind) {
     return absl::StrCat("Found empty key: ", item->key, " in DB ", db_ind, " rdb_type ",
                         item->val.rdb_type);
@@ -2601,6 +2837,8 @@ void RdbLoader::CreateObjectOnShard(const DbContext& db_cntx, const Item* item,
     if (ec.value() == errc::value_expired) {
       // hmap and sset values can expire and we ok with it,
       // so we don't set ec_ in this case
+      if (delta_load_ && !tmp_load_config.append)
+        DeleteOnShard(db_cntx, item->key, db_slice);
       return;
     }
     ec_ = ec;
@@ -2630,10 +2868,14 @@ void RdbLoader::CreateObjectOnShard(const DbContext& db_cntx, const Item* item,
 
   if (item->expire_ms > 0 && db_cntx.time_now_ms >= item->expire_ms) {
     VLOG(2) << "Expire key on load: " << item->key;
+    if (delta_load_)  // the key might be loaded from a previous snapshot of the chain
+      DeleteOnShard(db_cntx, item->key, db_slice);
     return;
   }
 
-  auto op_res = db_slice->AddOrUpdate(db_cntx, item->key, std::move(pv), item->expire_ms);
+  auto op_res = ingest_ && !override_existing_keys_
+                    ? db_slice->AddOrSkip(db_cntx, item->key, std::move(pv), item->expire_ms)
+                    : db_slice->AddOrUpdate(db_cntx, item->key, std::move(pv), item->expire_ms);
   if (!op_res) {
     LOG(ERROR) << "OOM failed to add key '" << item->key << "' in DB " << db_ind;
     ec_ = RdbError(errc::out_of_memory);
@@ -2642,6 +2884,9 @@ void RdbLoader::CreateObjectOnShard(const DbContext& db_cntx, const Item* item,
   }
 
   DbSlice::ItAndUpdater& res = *op_res;
+  if (ingest_ && !res.is_new && !override_existing_keys_)
+    return;
+
   res.it->first.SetSticky(item->is_sticky);
   if (item->has_mc_flags) {
     res.it->second.SetFlag(true);
@@ -2714,10 +2959,15 @@ error_code RdbLoader::LoadKeyValPair(int type, ObjSettings* settings) {
     // If the key can be discarded, we must still continue to read the
     // object from the RDB so we can read the next key.
     if (ShouldDiscardKey(key, *settings)) {
+      if (delta_load_ && !item->load_config.append)
+        DeleteKey(key);
       pending_read_.reserve = 0;
       continue;
     }
 
+    if (key_filter_)
+      key_filter_->found = true;
+
     if (pending_read_.remaining > 0) {
       item->key = key;
       streamed = true;
@@ -2765,6 +3015,12 @@ error_code RdbLoader::LoadKeyValPair(int type, ObjSettings* settings) {
 }
 
 bool RdbLoader::ShouldDiscardKey(std::string_view key, const ObjSettings& settings) const {
+  if (key_filter_ && (cur_db_index_ != key_filter_->db || key != key_filter_->key))
+    return true;
+
+  if (slot_filter_ && !slot_filter_->Contains(KeySlot(key)))
+    return true;
+
   if (!load_unowned_slots_ && IsClusterEnabled()) {
     const auto cluster_config = cluster::ClusterConfig::Current();
     if (cluster_config && !cluster_config->IsMySlot(key)) {
@@ -2836,6 +3092,8 @@ void RdbLoader::LoadSearchIndexDefFromAux(string&& def) {
 }
 
 void RdbLoader::PerformPostLoad(Service* service) {
+  service->script_mgr()->WarmUpInterpreters();
+
   const CommandId* cmd = service->FindCmd("FT.CREATE");
   if (cmd == nullptr)  // On MacOS we don't include search so FT.CREATE won't exist.
     return;
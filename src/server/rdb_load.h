@@ -26,6 +26,14 @@ class ScriptMgr;
 class CompactObj;
 class Service;
 
+namespace cluster {
+class SlotSet;
+}  // namespace cluster
+
+namespace detail {
+class LazyKeyFetcher;
+}  // namespace detail
+
 using RdbVersion = std::uint16_t;
 
 class RdbLoaderBase {
@@ -45,6 +53,7 @@ class RdbLoaderBase {
     double grow_factor, fp_prob;
     size_t prev_size, current_size;
     size_t max_capacity;
+    bool blocked = false;
 
     struct Filter {
       unsigned hash_cnt;
@@ -208,6 +217,22 @@ class RdbLoaderBase {
   PendingRead pending_read_;
 };
 
+// Decodes a single value serialized by SerializerBase::DumpObject, i.e. the type byte followed
+// by its rdb encoding. The trailing version/checksum footer, if present, is ignored.
+class RdbValueLoader : protected RdbLoaderBase {
+ public:
+  explicit RdbValueLoader(RdbVersion rdb_version) {
+    rdb_version_ = rdb_version;
+  }
+
+  std::error_code Load(std::string_view payload, CompactObj* pv);
+
+ private:
+  std::error_code Parse(::io::Source* source, OpaqueObj* dest);
+
+  int rdb_type_ = -1;
+};
+
 class RdbLoader : protected RdbLoaderBase {
  public:
   explicit RdbLoader(Service* service, std::string snapshot_id = {});
@@ -218,10 +243,27 @@ class RdbLoader : protected RdbLoaderBase {
     override_existing_keys_ = override;
   }
 
+  // Loads a delta snapshot on top of the data loaded from the previous snapshots of its chain.
+  // Must be used together with SetOverrideExistingKeys.
+  void SetDeltaLoad(bool delta) {
+    delta_load_ = delta;
+  }
+
+  // Loads into a live data store: keys that already exist are kept unless
+  // SetOverrideExistingKeys is set.
+  void SetIngest(bool ingest) {
+    ingest_ = ingest;
+  }
+
   void SetLoadUnownedSlots(bool load_unowned) {
     load_unowned_slots_ = load_unowned;
   }
 
+  // Loads only the keys of the slots, including the deletions of delta snapshots.
+  void SetSlotFilter(const cluster::SlotSet* slots) {
+    slot_filter_ = slots;
+  }
+
   // Sets shard count of the snapshot being loaded.
   // Does not necessarily match the shard count of the current instance.
   void SetShardCount(uint32_t shard_cnt) {
@@ -230,6 +272,18 @@ class RdbLoader : protected RdbLoaderBase {
 
   std::error_code Load(::io::Source* src);
 
+  // Inserts the entries of a lazily loaded file through the fetcher of its shard, which must be
+  // the shard of the loading thread.
+  void SetLazyFetcher(detail::LazyKeyFetcher* fetcher) {
+    lazy_fetcher_ = fetcher;
+  }
+
+  // Loads the key of db from a chain of entries of a DF shard file, which are followed by
+  // padding of at least 9 bytes. Other entries of the chain are skipped. Must be called from
+  // the shard thread of the key.
+  std::error_code LoadKey(std::string_view chain, size_t len, DbIndex db, std::string_view key,
+                          bool* found);
+
   void set_source_limit(size_t n) {
     source_limit_ = n;
   }
@@ -288,6 +342,20 @@ class RdbLoader : protected RdbLoaderBase {
     return shard_count_;
   }
 
+  // Replication id and journal lsn recorded by the master that saved the snapshot.
+  const std::string& repl_id() const {
+    return repl_id_;
+  }
+
+  std::optional<LSN> repl_lsn() const {
+    return repl_lsn_;
+  }
+
+  // Snapshots that a delta snapshot builds upon, as recorded in its summary.
+  const std::string& delta_chain() const {
+    return delta_chain_;
+  }
+
  private:
   struct Item {
     std::string key;
@@ -326,6 +394,9 @@ class RdbLoader : protected RdbLoaderBase {
   void FlushShardAsync(ShardId sid);
   void FlushAllShards();
 
+  // Deletes key of the current db in its shard, ordered after the items read before.
+  void DeleteKey(std::string key);
+
   void LoadItemsBuffer(DbIndex db_ind, const ItemsBuf& ib);
 
   void CreateObjectOnShard(const DbContext& db_cntx, const Item* item, DbSlice* db_slice);
@@ -338,8 +409,14 @@ class RdbLoader : protected RdbLoaderBase {
 
   Service* service_;
   std::string snapshot_id_;
+  std::string repl_id_;
+  std::optional<LSN> repl_lsn_;
+  std::string delta_chain_;
   bool override_existing_keys_ = false;
+  bool delta_load_ = false;
   bool load_unowned_slots_ = false;
+  bool ingest_ = false;
+  const cluster::SlotSet* slot_filter_ = nullptr;
   bool rdb_ignore_expiry_;
   uint32_t shard_id_ = UINT32_MAX;
   uint32_t shard_count_ = 0;
@@ -347,6 +424,15 @@ class RdbLoader : protected RdbLoaderBase {
   ScriptMgr* script_mgr_;
   std::vector<ItemsBuf> shard_buf_;
 
+  // Set while LoadKey runs, other keys are discarded.
+  struct KeyFilter {
+    DbIndex db;
+    std::string_view key;
+    bool found = false;
+  };
+  KeyFilter* key_filter_ = nullptr;
+  detail::LazyKeyFetcher* lazy_fetcher_ = nullptr;
+
   size_t keys_loaded_ = 0;
   double load_time_ = 0;
 
@@ -8,6 +8,7 @@
 #include <absl/strings/str_cat.h>
 #include <absl/strings/str_format.h>
 
+#include <ostream>
 #include <queue>
 
 extern "C" {
@@ -31,6 +32,7 @@ extern "C" {
 #include "core/string_set.h"
 #include "server/engine_shard_set.h"
 #include "server/error.h"
+#include "server/journal/journal.h"
 #include "server/main_service.h"
 #include "server/namespaces.h"
 #include "server/rdb_extensions.h"
@@ -46,6 +48,10 @@ ABSL_FLAG(dfly::CompressionMode, compression_mode, dfly::CompressionMode::MULTI_
           "set 2 for multi entry zstd compression on df snapshot and single entry on rdb snapshot,"
           "set 3 for multi entry lz4 compression on df snapshot and single entry on rdb snapshot");
 
+ABSL_FLAG(bool, snapshot_key_index, false,
+          "If true, saves in df format write an index of the keys of every shard file next to it, "
+          "which allows serving keys on demand while the snapshot is loaded lazily");
+
 ABSL_RETIRED_FLAG(bool, stream_rdb_encode_v2, true,
                   "Retired. Uses format, compatible with redis 7.2 and Dragonfly v1.26+");
 
@@ -113,6 +119,44 @@ constexpr size_t kBufLen = 64_KB;
 constexpr size_t kAmask = 4_KB - 1;
 constexpr uint32_t kChannelLen = 2;
 
+// Strings and documents above this size are written in chunks of this size, so that the
+// serializer can flush between them.
+constexpr size_t kStreamChunkSize = 64_KB;
+
+// Output buffer that passes whatever is written to it to a callback in chunks of fixed size.
+class ChunkedStreamBuf : public std::streambuf {
+ public:
+  ChunkedStreamBuf(size_t chunk_size, std::function<void(string_view)> cb)
+      : buf_(chunk_size), cb_(std::move(cb)) {
+    setp(buf_.data(), buf_.data() + buf_.size());
+  }
+
+  void Flush() {
+    if (pptr() > pbase())
+      cb_(string_view{pbase(), size_t(pptr() - pbase())});
+    setp(buf_.data(), buf_.data() + buf_.size());
+  }
+
+ protected:
+  int_type overflow(int_type ch) override {
+    Flush();
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(ch);
+      pbump(1);
+    }
+    return traits_type::not_eof(ch);
+  }
+
+  int sync() override {
+    Flush();
+    return 0;
+  }
+
+ private:
+  vector<char> buf_;
+  std::function<void(string_view)> cb_;
+};
+
 }  // namespace
 
 bool AbslParseFlag(std::string_view in, dfly::CompressionMode* flag, std::string* err) {
@@ -236,7 +280,7 @@ std::error_code RdbSerializer::SaveValue(const PrimeValue& pv) {
         }
         LOG(FATAL) << "External string not supported yet";
       } else {
-        ec = SaveString(pv.GetSlice(&tmp_str_));
+        ec = SaveStringChunked(pv.GetSlice(&tmp_str_));
       }
     }
   } else {
@@ -376,11 +420,11 @@ error_code RdbSerializer::SaveListObject(const PrimeValue& pv) {
       RETURN_ON_ERR(SaveLzfBlob(Bytes{reinterpret_cast<uint8_t*>(data), compress_len}, node->sz));
     } else {
       RETURN_ON_ERR(SaveString(node->entry, node->sz));
-      FlushState flush_state = FlushState::kFlushMidEntry;
-      if (node->next == nullptr)
-        flush_state = FlushState::kFlushEndEntry;
-      FlushIfNeeded(flush_state);
     }
+    FlushState flush_state = FlushState::kFlushMidEntry;
+    if (node->next == nullptr)
+      flush_state = FlushState::kFlushEndEntry;
+    FlushIfNeeded(flush_state);
     node = node->next;
   }
   return error_code{};
@@ -603,15 +647,46 @@ error_code RdbSerializer::SaveStreamObject(const PrimeValue& pv) {
 }
 
 error_code RdbSerializer::SaveJsonObject(const PrimeValue& pv) {
-  auto json_string = pv.GetJson()->to_string();
-  return SaveString(json_string);
+  const JsonType* json = pv.GetJson();
+  if (!flush_fun_ || pv.MallocUsed() <= kStreamChunkSize) {
+    auto json_string = json->to_string();
+    return SaveString(json_string);
+  }
+
+  // Large documents are rendered twice instead of being materialized as a single string:
+  // first to compute the length that precedes the data, then to write it in chunks.
+  size_t len = 0;
+  {
+    ChunkedStreamBuf counter(4_KB, [&](string_view chunk) { len += chunk.size(); });
+    std::ostream os(&counter);
+    json->dump(os);
+    counter.Flush();
+  }
+  RETURN_ON_ERR(SaveLen(len));
+
+  error_code ec;
+  size_t written = 0;
+  ChunkedStreamBuf writer(kStreamChunkSize, [&](string_view chunk) {
+    if (ec)
+      return;
+    ec = WriteRaw(io::Buffer(chunk));
+    written += chunk.size();
+    FlushIfNeeded(FlushState::kFlushMidEntry);
+  });
+  std::ostream os(&writer);
+  json->dump(os);
+  writer.Flush();
+
+  RETURN_ON_ERR(ec);
+  DCHECK_EQ(written, len);
+  return {};
 }
 
 std::error_code RdbSerializer::SaveSBFObject(const PrimeValue& pv) {
   SBF* sbf = pv.GetSBF();
 
   // options to allow format mutations in the future.
-  RETURN_ON_ERR(SaveLen(0));  // options - reserved
+  RETURN_ON_ERR(SaveLen(sbf->blocked() ? RDB_SBF_BLOCKED : 0));  // options
   RETURN_ON_ERR(SaveBinaryDouble(sbf->grow_factor()));
   RETURN_ON_ERR(SaveBinaryDouble(sbf->fp_probability()));
   RETURN_ON_ERR(SaveLen(sbf->prev_size()));
@@ -623,7 +698,7 @@ std::error_code RdbSerializer::SaveSBFObject(const PrimeValue& pv) {
     RETURN_ON_ERR(SaveLen(sbf->hashfunc_cnt(i)));
 
     string_view blob = sbf->data(i);
-    RETURN_ON_ERR(SaveString(blob));
+    RETURN_ON_ERR(SaveStringChunked(blob));
     FlushState flush_state = FlushState::kFlushMidEntry;
     if ((i + 1) == sbf->num_filters())
       flush_state = FlushState::kFlushEndEntry;
@@ -634,6 +709,19 @@ std::error_code RdbSerializer::SaveSBFObject(const PrimeValue& pv) {
   return {};
 }
 
+error_code RdbSerializer::SaveStringChunked(string_view val) {
+  if (!flush_fun_ || val.size() <= kStreamChunkSize)
+    return SaveString(val);
+
+  // Stored verbatim, same as SaveString does for strings that do not compress.
+  RETURN_ON_ERR(SaveLen(val.size()));
+  for (size_t pos = 0; pos < val.size(); pos += kStreamChunkSize) {
+    RETURN_ON_ERR(WriteRaw(io::Buffer(val.substr(pos, kStreamChunkSize))));
+    FlushIfNeeded(FlushState::kFlushMidEntry);
+  }
+  return {};
+}
+
 /* Save a long long value as either an encoded string or a string. */
 error_code RdbSerializer::SaveLongLongAsString(int64_t value) {
   uint8_t buf[32];
@@ -691,6 +779,7 @@ error_code RdbSerializer::SaveStreamPEL(rax* pel, bool nacks) {
        * for each consumer in the consumer PEL, and resolve the consumer
        * at loading time. */
     }
+    FlushIfNeeded(FlushState::kFlushMidEntry);
   }
 
   return error_code{};
@@ -729,6 +818,7 @@ error_code RdbSerializer::SaveStreamConsumers(bool save_active, streamCG* cg) {
      * consumer local PEL. */
 
     RETURN_ON_ERR(SaveStreamPEL(consumer->pel, false));
+    FlushIfNeeded(FlushState::kFlushMidEntry);
   }
 
   return error_code{};
@@ -756,6 +846,12 @@ error_code RdbSerializer::SendJournalOffset(uint64_t journal_offset) {
   return WriteRaw(buf);
 }
 
+error_code RdbSerializer::SaveDeletedKey(string_view key, DbIndex dbid) {
+  RETURN_ON_ERR(SelectDb(dbid));
+  RETURN_ON_ERR(WriteOpcode(RDB_OPCODE_DELETED_KEY));
+  return SaveString(key);
+}
+
 error_code SerializerBase::SendFullSyncCut() {
   VLOG(1) << "SendFullSyncCut";
   RETURN_ON_ERR(WriteOpcode(RDB_OPCODE_FULLSYNC_END));
@@ -768,6 +864,11 @@ error_code SerializerBase::SendFullSyncCut() {
   return WriteRaw(buf);
 }
 
+error_code SerializerBase::SaveCompressionDict(string_view dict) {
+  RETURN_ON_ERR(WriteOpcode(RDB_OPCODE_COMPRESSION_DICT));
+  return SaveString(dict);
+}
+
 std::error_code SerializerBase::WriteOpcode(uint8_t opcode) {
   return WriteRaw(::io::Bytes{&opcode, 1});
 }
@@ -887,10 +988,14 @@ io::Bytes SerializerBase::PrepareFlush(SerializerBase::FlushState flush_state) {
 
   bool is_last_chunk = flush_state == FlushState::kFlushEndEntry;
   VLOG(2) << "PrepareFlush:" << is_last_chunk << " " << number_of_chunks_;
+  last_flush_compressible_ = false;
   if (is_last_chunk && number_of_chunks_ == 0) {
     if (compression_mode_ == CompressionMode::MULTI_ENTRY_ZSTD ||
         compression_mode_ == CompressionMode::MULTI_ENTRY_LZ4) {
-      CompressBlob();
+      if (deferred_compression_)
+        last_flush_compressible_ = true;
+      else
+        CompressBlob();
     }
   }
 
@@ -1027,7 +1132,8 @@ class RdbSaver::Impl final : public SliceSnapshot::SnapshotDataConsumerInterface
 
   ~Impl();
 
-  void StartSnapshotting(bool stream_journal, ExecutionState* cntx, EngineShard* shard);
+  void StartSnapshotting(bool stream_journal, ExecutionState* cntx, EngineShard* shard,
+                         DeltaMode delta_mode = DeltaMode::NONE);
   void StartIncrementalSnapshotting(LSN start_lsn, ExecutionState* cntx, EngineShard* shard);
 
   void StopSnapshotting(EngineShard* shard);
@@ -1038,6 +1144,15 @@ class RdbSaver::Impl final : public SliceSnapshot::SnapshotDataConsumerInterface
   // Finalizes the snapshot writing. Called from SliceSnapshot
   void Finalize() override;
 
+  size_t BytesConsumed() const override {
+    return bytes_written_;
+  }
+
+  std::optional<detail::SnapshotKeyIndex> TakeKeyIndex(EngineShard* shard) {
+    auto& snapshot = GetSnapshot(shard);
+    return snapshot ? snapshot->TakeKeyIndex() : nullopt;
+  }
+
   // used only for legacy rdb save flows.
   error_code ConsumeChannel(const ExecutionState* cll);
 
@@ -1076,6 +1191,7 @@ class RdbSaver::Impl final : public SliceSnapshot::SnapshotDataConsumerInterface
 
   io::Sink* sink_;
   int64_t last_write_time_ns_ = -1;  // last write call.
+  size_t bytes_written_ = 0;         // bytes passed to sink_
   vector<unique_ptr<SliceSnapshot>> shard_snapshots_;
   // used for serializing non-body components in the calling fiber.
   RdbSerializer meta_serializer_;
@@ -1182,6 +1298,7 @@ error_code RdbSaver::Impl::WriteRecord(io::Bytes src) {
   // so we could be more responsive.
   error_code ec;
   size_t start_size = src.size();
+  bytes_written_ += start_size;
   last_write_time_ns_ = absl::GetCurrentTimeNanos();
   do {
     io::Bytes part = src.subspan(0, 8_MB);
@@ -1206,11 +1323,16 @@ error_code RdbSaver::Impl::WriteRecord(io::Bytes src) {
 }
 
 void RdbSaver::Impl::StartSnapshotting(bool stream_journal, ExecutionState* cntx,
-                                       EngineShard* shard) {
+                                       EngineShard* shard, DeltaMode delta_mode) {
   auto& s = GetSnapshot(shard);
   auto& db_slice = namespaces->GetDefaultNamespace().GetDbSlice(shard->shard_id());
 
   s = std::make_unique<SliceSnapshot>(compression_mode_, &db_slice, this, cntx);
+  s->SetDeltaMode(delta_mode);
+  if (!stream_journal && save_mode_ == SaveMode::SINGLE_SHARD &&
+      absl::GetFlag(FLAGS_snapshot_key_index)) {
+    s->EnableKeyIndex();
+  }
 
   const auto allow_flush = (save_mode_ != SaveMode::RDB) ? SliceSnapshot::SnapshotFlush::kAllow
                                                          : SliceSnapshot::SnapshotFlush::kDisallow;
@@ -1324,6 +1446,7 @@ RdbSaver::SnapshotStats RdbSaver::Impl::GetCurrentSnapshotProgress() const {
 }
 
 error_code RdbSaver::Impl::FlushSerializer() {
+  bytes_written_ += serializer()->SerializedLen();
   last_write_time_ns_ = absl::GetCurrentTimeNanos();
   auto ec = serializer()->FlushToSink(sink_, SerializerBase::FlushState::kFlushMidEntry);
   last_write_time_ns_ = -1;
@@ -1341,6 +1464,7 @@ RdbSaver::GlobalData RdbSaver::GetGlobalData(const Service* service) {
   }
 
   atomic<size_t> table_mem{0};
+  vector<vector<size_t>> shard_db_keys(shard_set->size());
   shard_set->RunBriefInParallel([&](EngineShard* shard) {
     if (shard->shard_id() == 0) {
       auto* indices = shard->search_indices();
@@ -1358,12 +1482,20 @@ RdbSaver::GlobalData RdbSaver::GetGlobalData(const Service* service) {
       if (db_table) {
         shard_table_mem += db_table->table_memory();
       }
+      shard_db_keys[shard->shard_id()].push_back(db_slice.DbSize(db_id));
     }
     table_mem.fetch_add(shard_table_mem, memory_order_relaxed);
   });
 
-  return RdbSaver::GlobalData{std::move(script_bodies), std::move(search_indices),
-                              table_mem.load(memory_order_relaxed)};
+  RdbSaver::GlobalData res{std::move(script_bodies), std::move(search_indices),
+                           table_mem.load(memory_order_relaxed)};
+  for (const auto& db_keys : shard_db_keys) {
+    if (res.db_keys.size() < db_keys.size())
+      res.db_keys.resize(db_keys.size());
+    for (size_t db_id = 0; db_id < db_keys.size(); ++db_id)
+      res.db_keys[db_id] += db_keys[db_id];
+  }
+  return res;
 }
 
 void RdbSaver::Impl::FillFreqMap(RdbTypeFreqMap* dest) const {
@@ -1423,7 +1555,12 @@ RdbSaver::~RdbSaver() {
 }
 
 void RdbSaver::StartSnapshotInShard(bool stream_journal, ExecutionState* cntx, EngineShard* shard) {
-  impl_->StartSnapshotting(stream_journal, cntx, shard);
+  // The snapshot version is taken without preemption, so no journal entries can be recorded
+  // between reading the lsn and the start of the snapshot.
+  if (!stream_journal && save_mode_ == SaveMode::SINGLE_SHARD && shard->journal())
+    journal_lsn_ = shard->journal()->GetLsn();
+
+  impl_->StartSnapshotting(stream_journal, cntx, shard, delta_mode_);
 }
 
 void RdbSaver::StartIncrementalSnapshotInShard(LSN start_lsn, ExecutionState* cntx,
@@ -1433,9 +1570,15 @@ void RdbSaver::StartIncrementalSnapshotInShard(LSN start_lsn, ExecutionState* cn
 
 error_code RdbSaver::WaitSnapshotInShard(EngineShard* shard) {
   impl_->WaitForSnapshottingFinish(shard);
+  if (journal_lsn_)
+    RETURN_ON_ERR(SaveAuxFieldStrInt("repl-lsn", *journal_lsn_));
   return SaveEpilog();
 }
 
+std::optional<detail::SnapshotKeyIndex> RdbSaver::TakeKeyIndex(EngineShard* shard) {
+  return impl_->TakeKeyIndex(shard);
+}
+
 error_code RdbSaver::StopFullSyncInShard(EngineShard* shard) {
   impl_->StopSnapshotting(shard);
   return SaveEpilog();
@@ -1500,6 +1643,18 @@ error_code RdbSaver::SaveAux(const GlobalData& glob_state) {
   for (const string& s : glob_state.lua_scripts)
     RETURN_ON_ERR(impl_->SaveAuxFieldStrStr("lua", s));
 
+  // Loaders pre-size their tables for the keys of the whole data store.
+  if (save_mode_ == SaveMode::RDB || save_mode_ == SaveMode::SUMMARY ||
+      save_mode_ == SaveMode::SINGLE_SHARD_WITH_SUMMARY) {
+    string db_keys;
+    for (size_t db_id = 0; db_id < glob_state.db_keys.size(); ++db_id) {
+      if (size_t keys = glob_state.db_keys[db_id]; keys > 0)
+        absl::StrAppend(&db_keys, db_keys.empty() ? "" : ",", db_id, ":", keys);
+    }
+    if (!db_keys.empty())
+      RETURN_ON_ERR(impl_->SaveAuxFieldStrStr("db-keys", db_keys));
+  }
+
   if (save_mode_ == SaveMode::RDB) {
     if (!glob_state.search_indices.empty())
       LOG(WARNING) << "Dragonfly search index data is incompatible with the RDB format";
@@ -1512,13 +1667,20 @@ error_code RdbSaver::SaveAux(const GlobalData& glob_state) {
       // We save the shard id in the summary file, so that we can restore it later.
       RETURN_ON_ERR(SaveAuxFieldStrInt("shard-count", shard_set->size()));
       RETURN_ON_ERR(SaveAuxFieldStrInt("table-mem", glob_state.table_used_memory));
+      if (!glob_state.repl_id.empty())
+        RETURN_ON_ERR(impl_->SaveAuxFieldStrStr("repl-id", glob_state.repl_id));
+      if (!glob_state.delta_chain.empty())
+        RETURN_ON_ERR(impl_->SaveAuxFieldStrStr("delta-chain", glob_state.delta_chain));
     }
     if (EngineShard* shard = EngineShard::tlocal(); shard) {
       RETURN_ON_ERR(SaveAuxFieldStrInt("shard-id", shard->shard_id()));
+      // Graphs refer to the documents of this shard and are saved after its id
+      for (const string& s : shard->search_indices()->SerializeGraphs())
+        RETURN_ON_ERR(impl_->SaveAuxFieldStrStr("search-graphs", s));
     }
   }
 
-  // TODO: "repl-stream-db", "repl-id", "repl-offset"
+  // TODO: "repl-stream-db", "repl-offset"
   return error_code{};
 }
 
@@ -1579,6 +1741,7 @@ void SerializerBase::CompressBlob() {
   }
 
   AllocateCompressorOnce();
+  compressor_impl_->set_dict(compression_dict_.get());
 
   // Compress the data. We copy compressed data once into the internal buffer of compressor_impl_
   // and then we copy it again into the mem_buf_.
@@ -1624,6 +1787,41 @@ void SerializerBase::CompressBlob() {
   ++stats.compressed_blobs;
 }
 
+bool SerializerBase::CompressFlushedBlob(CompressionMode mode, std::string* blob,
+                                         const detail::ZstdDict* dict) {
+  DCHECK(mode == CompressionMode::MULTI_ENTRY_ZSTD || mode == CompressionMode::MULTI_ENTRY_LZ4);
+  size_t blob_size = blob->size();
+  if (blob_size < kMinStrSizeToCompress || blob_size > kMaxStrSizeToCompress)
+    return false;
+
+  // The blob may be compressed by a thread that does not own the serializer, so we can not use
+  // compressor_impl_ here.
+  thread_local std::unique_ptr<detail::CompressorImpl> tl_zstd, tl_lz4;
+  bool zstd = mode == CompressionMode::MULTI_ENTRY_ZSTD;
+  auto& compressor = zstd ? tl_zstd : tl_lz4;
+  if (!compressor) {
+    compressor = zstd ? detail::CompressorImpl::CreateZstd() : detail::CompressorImpl::CreateLZ4();
+  }
+
+  compressor->set_dict(dict);
+  io::Result<io::Bytes> res = compressor->Compress(io::Buffer(*blob));
+  if (!res || res->length() > blob_size * kMinCompressionReductionPrecentage)
+    return false;
+
+  uint8_t buf[16];
+  buf[0] = zstd ? RDB_OPCODE_COMPRESSED_ZSTD_BLOB_START : RDB_OPCODE_COMPRESSED_LZ4_BLOB_START;
+  unsigned enclen = WritePackedUInt(res->length(), io::MutableBytes{buf}.subspan(1));
+
+  string compressed;
+  compressed.reserve(1 + enclen + res->length());
+  compressed.append(reinterpret_cast<const char*>(buf), 1 + enclen);
+  compressed.append(io::View(*res));
+  blob->swap(compressed);
+
+  ++ServerState::tlocal()->stats.compressed_blobs;
+  return true;
+}
+
 size_t RdbSerializer::GetTempBufferSize() const {
   return SerializerBase::GetTempBufferSize() + tmp_str_.size();
 }
@@ -16,6 +16,7 @@ extern "C" {
 #include "io/io_buf.h"
 #include "server/common.h"
 #include "server/detail/compressor.h"
+#include "server/detail/snapshot_key_index.h"
 #include "server/journal/serializer.h"
 #include "server/journal/types.h"
 #include "server/table.h"
@@ -69,6 +70,14 @@ enum class SaveMode {
 
 enum class CompressionMode : uint8_t { NONE, SINGLE_ENTRY, MULTI_ENTRY_ZSTD, MULTI_ENTRY_LZ4 };
 
+// Delta snapshots serialize only the buckets that changed since the previous snapshot that
+// tracked changes, and the keys that were deleted since.
+enum class DeltaMode : uint8_t {
+  NONE,   // full snapshot, changes are not tracked
+  TRACK,  // full snapshot that starts tracking changes for the next delta
+  DELTA,  // changes since the previous tracking snapshot, continues tracking
+};
+
 CompressionMode GetDefaultCompressionMode();
 
 class RdbSaver {
@@ -78,6 +87,9 @@ class RdbSaver {
     const StringVec lua_scripts;     // bodies of lua scripts
     const StringVec search_indices;  // ft.create commands to re-create search indices
     size_t table_used_memory = 0;    // total memory used by all tables in all shards
+    std::string repl_id;  // replication id the journal lsns recorded in shard files refer to
+    std::string delta_chain;  // snapshots a delta snapshot builds upon, see SaveStagesController
+    std::vector<size_t> db_keys;  // number of keys of each db in all shards
   };
 
   // single_shard - true means that we run RdbSaver on a single shard and we do not use
@@ -95,6 +107,11 @@ class RdbSaver {
   // cll allows breaking in the middle.
   void StartSnapshotInShard(bool stream_journal, ExecutionState* cntx, EngineShard* shard);
 
+  // Must be called before StartSnapshotInShard. Only used by single shard saves.
+  void SetDeltaMode(DeltaMode mode) {
+    delta_mode_ = mode;
+  }
+
   // Send only the incremental snapshot since start_lsn.
   void StartIncrementalSnapshotInShard(LSN start_lsn, ExecutionState* cntx, EngineShard* shard);
 
@@ -104,6 +121,9 @@ class RdbSaver {
   // Wait for snapshotting finish in shard thread. Called from save flows in shard thread.
   std::error_code WaitSnapshotInShard(EngineShard* shard);
 
+  // Returns the key index of a finished single shard save, if --snapshot_key_index is set.
+  std::optional<detail::SnapshotKeyIndex> TakeKeyIndex(EngineShard* shard);
+
   // Stores auxiliary (meta) values and header_info
   std::error_code SaveHeader(const GlobalData& header_info);
 
@@ -150,6 +170,11 @@ class RdbSaver {
   SaveMode save_mode_;
   CompressionMode compression_mode_;
   std::string snapshot_id_;
+
+  // Journal lsn at the point in time of a snapshot file, lets replicas that load the snapshot
+  // continue with a partial sync.
+  std::optional<LSN> journal_lsn_;
+  DeltaMode delta_mode_ = DeltaMode::NONE;
 };
 
 class SerializerBase {
@@ -191,6 +216,36 @@ class SerializerBase {
     return serialization_peak_bytes_;
   }
 
+  // When set, multi-entry blobs are flushed uncompressed and the caller is expected to compress
+  // them with CompressFlushedBlob, possibly on another thread.
+  void set_deferred_compression(bool deferred) {
+    deferred_compression_ = deferred;
+  }
+
+  // True if the last FlushToSink produced a complete blob that was left for the caller to compress.
+  bool last_flush_compressible() const {
+    return last_flush_compressible_;
+  }
+
+  // Replaces `blob` with its multi-entry compressed form if compression is effective.
+  // Uses a thread local compressor, so it is safe to call from any thread.
+  // Blobs are compressed with `dict` if it is set.
+  static bool CompressFlushedBlob(CompressionMode mode, std::string* blob,
+                                  const detail::ZstdDict* dict = nullptr);
+
+  // Write zstd dictionary to the stream. Loaders use it for the blobs that follow.
+  std::error_code SaveCompressionDict(std::string_view dict);
+
+  // Compress the following multi-entry blobs with `dict`. It must be written to the stream with
+  // SaveCompressionDict and flushed before.
+  void set_compression_dict(std::shared_ptr<const detail::ZstdDict> dict) {
+    compression_dict_ = std::move(dict);
+  }
+
+  const std::shared_ptr<const detail::ZstdDict>& compression_dict() const {
+    return compression_dict_;
+  }
+
  protected:
   // Prepare internal buffer for flush. Compress it.
   io::Bytes PrepareFlush(FlushState flush_state);
@@ -204,6 +259,7 @@ class SerializerBase {
   CompressionMode compression_mode_;
   io::IoBuf mem_buf_;
   std::unique_ptr<detail::CompressorImpl> compressor_impl_;
+  std::shared_ptr<const detail::ZstdDict> compression_dict_;
 
   static constexpr size_t kMinStrSizeToCompress = 256;
   static constexpr size_t kMaxStrSizeToCompress = 1 * 1024 * 1024;
@@ -220,6 +276,8 @@ class SerializerBase {
   size_t number_of_chunks_ = 0;
 
   uint64_t serialization_peak_bytes_ = 0;
+  bool deferred_compression_ = false;
+  bool last_flush_compressible_ = false;
 };
 
 class RdbSerializer : public SerializerBase {
@@ -248,6 +306,9 @@ class RdbSerializer : public SerializerBase {
 
   std::error_code SendJournalOffset(uint64_t journal_offset);
 
+  // Records a deletion of key in a delta snapshot.
+  std::error_code SaveDeletedKey(std::string_view key, DbIndex dbid);
+
   size_t GetTempBufferSize() const override;
   std::error_code SendEofAndChecksum();
 
@@ -262,6 +323,9 @@ class RdbSerializer : public SerializerBase {
   std::error_code SaveJsonObject(const PrimeValue& pv);
   std::error_code SaveSBFObject(const PrimeValue& pv);
 
+  // Like SaveString, but large strings are written in chunks with flushes in between.
+  std::error_code SaveStringChunked(std::string_view val);
+
   std::error_code SaveLongLongAsString(int64_t value);
   std::error_code SaveBinaryDouble(double val);
   std::error_code SaveStreamPEL(rax* pel, bool nacks);
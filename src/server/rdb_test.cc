@@ -11,13 +11,20 @@ extern "C" {
 }
 
 #include <absl/flags/reflection.h>
+#include <absl/strings/match.h>
+#include <absl/strings/str_replace.h>
 #include <mimalloc.h>
 
+#include <filesystem>
+#include <fstream>
+
 #include "base/flags.h"
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "facade/facade_test.h"  // needed to find operator== for RespExpr.
 #include "io/file.h"
+#include "server/cluster_support.h"
+#include "server/detail/snapshot_key_index.h"
 #include "server/engine_shard_set.h"
 #include "server/rdb_load.h"
 #include "server/rdb_save.h"
@@ -35,6 +42,14 @@ ABSL_DECLARE_FLAG(int32, list_max_listpack_size);
 ABSL_DECLARE_FLAG(dfly::CompressionMode, compression_mode);
 ABSL_DECLARE_FLAG(bool, rdb_ignore_expiry);
 ABSL_DECLARE_FLAG(uint32_t, num_shards);
+ABSL_DECLARE_FLAG(bool, snapshot_offload_compression);
+ABSL_DECLARE_FLAG(uint32_t, snapshot_pipeline_depth);
+ABSL_DECLARE_FLAG(uint64_t, snapshot_buffer_limit);
+ABSL_DECLARE_FLAG(bool, snapshot_copy_on_write);
+ABSL_DECLARE_FLAG(uint32_t, snapshot_delta_max_chain);
+ABSL_DECLARE_FLAG(uint32_t, snapshot_load_readahead_mb);
+ABSL_DECLARE_FLAG(uint32_t, compression_dict_size);
+ABSL_DECLARE_FLAG(bool, snapshot_key_index);
 
 namespace dfly {
 
@@ -214,6 +229,164 @@ TEST_F(RdbTest, ComressionModeSaveDragonflyAndReload) {
   }
 }
 
+TEST_F(RdbTest, OffloadedCompressionSaveAndReload) {
+  SetFlag(&FLAGS_snapshot_offload_compression, true);
+  Run({"debug", "populate", "50000"});
+
+  for (auto mode : {CompressionMode::MULTI_ENTRY_ZSTD, CompressionMode::MULTI_ENTRY_LZ4}) {
+    SetFlag(&FLAGS_compression_mode, mode);
+    RespExpr resp = Run({"save", "df"});
+    ASSERT_EQ(resp, "OK");
+    EXPECT_GE(GetMetrics().coordinator_stats.compressed_blobs, 1);
+
+    auto save_info = service_->server_family().GetLastSaveInfo();
+    resp = Run({"dfly", "load", save_info.file_name});
+    ASSERT_EQ(resp, "OK");
+    ASSERT_EQ(50000, CheckedInt({"dbsize"}));
+  }
+  SetFlag(&FLAGS_snapshot_offload_compression, false);
+}
+
+TEST_F(RdbTest, PipelinedSaveAndReload) {
+  SetFlag(&FLAGS_snapshot_pipeline_depth, 4);
+  Run({"debug", "populate", "50000"});
+
+  for (auto mode : {CompressionMode::NONE, CompressionMode::MULTI_ENTRY_LZ4}) {
+    SetFlag(&FLAGS_compression_mode, mode);
+    for (string_view format : {"df", "rdb"}) {
+      RespExpr resp = Run({"save", format});
+      ASSERT_EQ(resp, "OK");
+
+      auto save_info = service_->server_family().GetLastSaveInfo();
+      resp = Run({"dfly", "load", save_info.file_name});
+      ASSERT_EQ(resp, "OK");
+      ASSERT_EQ(50000, CheckedInt({"dbsize"}));
+    }
+  }
+  SetFlag(&FLAGS_snapshot_pipeline_depth, 1);
+}
+
+TEST_F(RdbTest, ReadAheadLoad) {
+  SetFlag(&FLAGS_snapshot_load_readahead_mb, 2);
+  Run({"debug", "populate", "20000", "key", "200"});
+
+  for (string_view format : {"df", "rdb"}) {
+    ASSERT_EQ(Run({"save", format}), "OK");
+
+    auto save_info = service_->server_family().GetLastSaveInfo();
+    Run({"flushall"});
+    ASSERT_EQ(Run({"dfly", "load", save_info.file_name}), "OK");
+    ASSERT_EQ(20000, CheckedInt({"dbsize"}));
+    EXPECT_GE(CheckedInt({"strlen", "key:7"}), 200);
+  }
+  SetFlag(&FLAGS_snapshot_load_readahead_mb, 0);
+}
+
+TEST_F(RdbTest, DeltaSaveAndReload) {
+  SetFlag(&FLAGS_snapshot_delta_max_chain, 2);
+  Run({"debug", "populate", "10000"});
+  ASSERT_EQ(Run({"save", "df"}), "OK");
+
+  Run({"del", "key:1", "key:2"});
+  Run({"set", "key:3", "updated"});
+  Run({"set", "new", "1"});
+  ASSERT_EQ(Run({"save", "df"}), "OK");
+  string delta_file = service_->server_family().GetLastSaveInfo().file_name;
+  EXPECT_TRUE(absl::StrContains(delta_file, "-delta1-summary.dfs")) << delta_file;
+
+  Run({"del", "new"});
+  ASSERT_EQ(Run({"save", "df"}), "OK");
+  delta_file = service_->server_family().GetLastSaveInfo().file_name;
+  EXPECT_TRUE(absl::StrContains(delta_file, "-delta2-summary.dfs")) << delta_file;
+
+  Run({"flushall"});
+  ASSERT_EQ(Run({"dfly", "load", delta_file}), "OK");
+  EXPECT_EQ(9998, CheckedInt({"dbsize"}));
+  EXPECT_EQ(0, CheckedInt({"exists", "key:1", "key:2", "new"}));
+  EXPECT_EQ(Run({"get", "key:3"}), "updated");
+  EXPECT_EQ(Run({"get", "key:4"}), "value:4");
+
+  // The chain is full and the flush invalidated it anyway, so the next save is a full one.
+  ASSERT_EQ(Run({"save", "df"}), "OK");
+  EXPECT_FALSE(absl::StrContains(service_->server_family().GetLastSaveInfo().file_name, "-delta"));
+  SetFlag(&FLAGS_snapshot_delta_max_chain, 0);
+}
+
+TEST_F(RdbTest, ChunkedHugeValues) {
+  ASSERT_EQ(Run({"config", "set", "serialization_max_chunk_size", "16384"}), "OK");
+  string big(1'000'000, 'x');
+  big[12345] = 'y';
+  Run({"set", "str", big});
+
+  string doc = "[";
+  for (int i = 0; i < 20000; ++i)
+    absl::StrAppend(&doc, i ? "," : "", "\"item", i, "\"");
+  absl::StrAppend(&doc, "]");
+  Run({"json.set", "doc", "$", doc});
+
+  ASSERT_EQ(Run({"save", "df"}), "OK");
+  EXPECT_GT(GetMetrics().coordinator_stats.big_value_preemptions, 10u);
+
+  auto save_info = service_->server_family().GetLastSaveInfo();
+  Run({"flushall"});
+  ASSERT_EQ(Run({"dfly", "load", save_info.file_name}), "OK");
+  EXPECT_EQ(Run({"get", "str"}), big);
+  EXPECT_EQ(Run({"json.get", "doc", "$[19999]"}), "[\"item19999\"]");
+  ASSERT_EQ(Run({"config", "set", "serialization_max_chunk_size", "65536"}), "OK");
+}
+
+TEST_F(RdbTest, CompressionDict) {
+  SetFlag(&FLAGS_compression_mode, CompressionMode::MULTI_ENTRY_ZSTD);
+  SetFlag(&FLAGS_compression_dict_size, 4096);
+  for (int i = 0; i < 5000; ++i) {
+    Run({"set", StrCat("user:", i), StrCat("{\"name\":\"user", i, "\",\"active\":true}")});
+  }
+
+  for (uint32_t depth : {1, 4}) {
+    SetFlag(&FLAGS_snapshot_pipeline_depth, depth);
+    ASSERT_EQ(Run({"save", "df"}), "OK");
+
+    auto save_info = service_->server_family().GetLastSaveInfo();
+    Run({"flushall"});
+    ASSERT_EQ(Run({"dfly", "load", save_info.file_name}), "OK");
+    ASSERT_EQ(5000, CheckedInt({"dbsize"}));
+    EXPECT_EQ(Run({"get", "user:42"}), "{\"name\":\"user42\",\"active\":true}");
+  }
+
+  SetFlag(&FLAGS_snapshot_pipeline_depth, 1);
+  SetFlag(&FLAGS_compression_dict_size, 0);
+  SetFlag(&FLAGS_compression_mode, CompressionMode::MULTI_ENTRY_LZ4);
+}
+
+TEST_F(RdbTest, LazyLoad) {
+  SetFlag(&FLAGS_snapshot_key_index, true);
+  Run({"debug", "populate", "20000", "key", "100"});
+  Run({"select", "1"});
+  Run({"set", "other", "db1"});
+  ASSERT_EQ(Run({"save", "df"}), "OK");
+
+  string summary = service_->server_family().GetLastSaveInfo().file_name;
+  string shard_file = absl::StrReplaceAll(summary, {{"summary", "0000"}});
+  EXPECT_TRUE(filesystem::exists(detail::SnapshotKeyIndex::IndexPath(shard_file))) << shard_file;
+
+  Run({"flushall"});
+  auto future =
+      service_->server_family().Load(summary, ServerFamily::LoadExistingKeys::kFail, true);
+  ASSERT_TRUE(future);
+
+  // Keys are served while the snapshot is loaded in the background.
+  EXPECT_EQ(Run({"get", "other"}), "db1");
+  Run({"select", "0"});
+  EXPECT_GE(CheckedInt({"strlen", "key:19999"}), 100);
+  EXPECT_EQ(Run({"set", "key:7", "updated"}), "OK");
+
+  ASSERT_FALSE(future->Get());
+  EXPECT_FALSE(service_->server_family().IsLazyLoading());
+  EXPECT_EQ(20000, CheckedInt({"dbsize"}));
+  EXPECT_EQ(Run({"get", "key:7"}), "updated");
+  SetFlag(&FLAGS_snapshot_key_index, false);
+}
+
 TEST_F(RdbTest, RdbLoaderOnReadCompressedDataShouldNotEnterEnsureReadFlow) {
   SetFlag(&FLAGS_compression_mode, CompressionMode::MULTI_ENTRY_ZSTD);
   for (int i = 0; i < 1000; ++i) {
@@ -534,6 +707,44 @@ TEST_F(RdbTest, SaveManyDbs) {
   }
 }
 
+TEST_F(RdbTest, SaveCopyOnWrite) {
+  absl::FlagSaver fs;
+  SetFlag(&FLAGS_snapshot_copy_on_write, true);
+  SetFlag(&FLAGS_snapshot_buffer_limit, 16384);
+  Run({"debug", "populate", "200000"});
+
+  auto save_fb = pp_->at(0)->LaunchFiber([&] {
+    RespExpr resp = Run({"save"});
+    ASSERT_EQ(resp, "OK");
+  });
+
+  do {
+    usleep(10);
+  } while (!service_->server_family().TEST_IsSaving());
+
+  pp_->at(1)->Await([&] {
+    for (unsigned i = 0; i < 5000; ++i) {
+      Run({"set", StrCat("key:", i * 40), "bar"});
+    }
+  });
+
+  save_fb.Join();
+  SetFlag(&FLAGS_snapshot_copy_on_write, false);
+  SetFlag(&FLAGS_snapshot_buffer_limit, 0);
+
+  auto save_info = service_->server_family().GetLastSaveInfo();
+  ASSERT_EQ(1, save_info.freq_map.size());
+  EXPECT_EQ(200000, save_info.freq_map.front().second);
+
+  // The snapshot holds the values from the moment it started.
+  auto resp = Run({"debug", "reload", "NOSAVE"});
+  EXPECT_EQ(resp, "OK");
+  EXPECT_EQ(200000, CheckedInt({"dbsize"}));
+  for (unsigned i = 0; i < 5000; i += 100) {
+    EXPECT_EQ(Run({"get", StrCat("key:", i * 40)}), StrCat("value:", i * 40));
+  }
+}
+
 TEST_F(RdbTest, HMapBugs) {
   // Force kEncodingStrMap2 encoding.
   server.max_map_field_len = 0;
@@ -668,6 +879,13 @@ TEST_F(RdbTest, SBF) {
   Run({"debug", "reload"});
   EXPECT_EQ(Run({"type", "k"}), "MBbloom--");
   EXPECT_THAT(Run({"BF.EXISTS", "k", "1"}), IntArg(1));
+
+  EXPECT_EQ(Run({"BF.RESERVE", "blocked", "0.01", "100", "BLOCKED"}), "OK");
+  for (unsigned i = 0; i < 300; ++i)
+    Run({"BF.ADD", "blocked", absl::StrCat(i)});
+  Run({"debug", "reload"});
+  for (unsigned i = 0; i < 300; ++i)
+    ASSERT_THAT(Run({"BF.EXISTS", "blocked", absl::StrCat(i)}), IntArg(1)) << i;
 }
 
 TEST_F(RdbTest, DflyLoadAppend) {
@@ -692,6 +910,56 @@ TEST_F(RdbTest, DflyLoadAppend) {
   EXPECT_EQ(Run({"get", "k2"}), "2");
 }
 
+TEST_F(RdbTest, DflyIngest) {
+  Run({"debug", "populate", "1000"});
+  EXPECT_EQ(Run({"set", "k1", "1"}), "OK");
+  ASSERT_EQ(Run({"save", "rdb", "ingest.rdb"}), "OK");
+  string filename = service_->server_family().GetLastSaveInfo().file_name;
+  ifstream ifs(filename, ios::binary);
+  string payload{istreambuf_iterator<char>(ifs), istreambuf_iterator<char>()};
+
+  // Existing keys are kept without REPLACE.
+  Run({"flushall"});
+  EXPECT_EQ(Run({"set", "k1", "kept"}), "OK");
+  EXPECT_THAT(Run({"dfly", "ingest", payload}), IntArg(1001));
+  EXPECT_EQ(1001, CheckedInt({"dbsize"}));
+  EXPECT_EQ(Run({"get", "k1"}), "kept");
+  EXPECT_EQ(Run({"get", "key:42"}), "value:42");
+
+  EXPECT_THAT(Run({"dfly", "ingest", payload, "replace"}), IntArg(1001));
+  EXPECT_EQ(Run({"get", "k1"}), "1");
+
+  EXPECT_THAT(Run({"dfly", "ingest", "garbage"}), ErrArg("Wrong signature"));
+  EXPECT_THAT(Run({"dfly", "ingest", payload, "nx"}), ErrArg("syntax error"));
+}
+
+TEST_F(RdbTest, DflyLoadSlots) {
+  Run({"debug", "populate", "10000"});
+  SlotId slot = KeySlot("key:42");
+  size_t slot_keys = 0;
+  for (unsigned i = 0; i < 10000; ++i)
+    slot_keys += KeySlot(StrCat("key:", i)) == slot;
+
+  // Files with a key index are read only partially.
+  for (bool key_index : {false, true}) {
+    SetFlag(&FLAGS_snapshot_key_index, key_index);
+    ASSERT_EQ(Run({"save", "df"}), "OK");
+    string filename = service_->server_family().GetLastSaveInfo().file_name;
+
+    Run({"flushall"});
+    Run({"set", "other", "kept"});
+    ASSERT_EQ(Run({"dfly", "load", filename, "slots", StrCat(slot), StrCat(slot)}), "OK");
+    EXPECT_EQ(slot_keys + 1, CheckedInt({"dbsize"}));
+    EXPECT_EQ(Run({"get", "key:42"}), "value:42");
+    EXPECT_EQ(Run({"get", "other"}), "kept");
+
+    ASSERT_EQ(Run({"dfly", "load", filename}), "OK");
+  }
+  SetFlag(&FLAGS_snapshot_key_index, false);
+
+  EXPECT_THAT(Run({"dfly", "load", "file", "slots", "1", "20000"}), ErrArg("syntax error"));
+}
+
 // Tests loading a huge set, where the set is loaded in multiple partial reads.
 TEST_F(RdbTest, LoadHugeSet) {
   // Add 2 sets with 100k elements each (note must have more than kMaxBlobLen
@@ -13,6 +13,7 @@ extern "C" {
 }
 
 #include <absl/cleanup/cleanup.h>
+#include <absl/container/inlined_vector.h>
 #include <absl/flags/flag.h>
 #include <absl/functional/bind_front.h>
 #include <absl/strings/escaping.h>
@@ -31,6 +32,7 @@ extern "C" {
 #include "server/journal/serializer.h"
 #include "server/main_service.h"
 #include "server/rdb_load.h"
+#include "server/transaction.h"
 #include "strings/human_readable.h"
 
 #define LOG_REPL_ERROR(msg)                                         \
@@ -56,6 +58,13 @@ ABSL_FLAG(bool, replica_partial_sync, true,
 ABSL_FLAG(bool, break_replication_on_master_restart, false,
           "When in replica mode, and master restarts, break replication from master to avoid "
           "flushing the replica's data.");
+ABSL_FLAG(uint32_t, replica_apply_lanes, 1,
+          "Number of fibers per replication flow that apply independent stable sync commands "
+          "concurrently. Commands are routed by key, so commands on the same key keep their order");
+ABSL_FLAG(bool, replica_squash_commands, false,
+          "Apply runs of queued stable sync commands with command squashing");
+ABSL_FLAG(std::string, replication_stream_compression, "none",
+          "Compression of the stable sync stream requested from the master: none, lz4 or zstd");
 ABSL_FLAG(std::string, replica_announce_ip, "",
           "IP address that Dragonfly announces to replication master");
 ABSL_DECLARE_FLAG(int32_t, port);
@@ -373,6 +382,16 @@ std::error_code Replica::HandleCapaDflyResp() {
     }
     last_journal_LSNs_.reset();
   }
+
+  // Try once to continue from the loaded snapshot, a failed partial sync falls back to full sync.
+  if (snapshot_sync_data_) {
+    if (snapshot_sync_data_->id == master_repl_id &&
+        snapshot_sync_data_->last_journal_LSNs.size() == size_t(param_num_flows)) {
+      LOG(INFO) << "Requesting partial sync from the loaded snapshot";
+      last_journal_LSNs_ = std::move(snapshot_sync_data_->last_journal_LSNs);
+    }
+    snapshot_sync_data_.reset();
+  }
   master_context_.master_repl_id = master_repl_id;
   master_context_.dfly_session_id = ToSV(LastResponseArgs()[1].GetBuf());
   master_context_.num_flows = param_num_flows;
@@ -402,6 +421,22 @@ std::error_code Replica::ConfigureDflyMaster() {
       SendCommandAndReadResponse(StrCat("REPLCONF CLIENT-VERSION ", DflyVersion::CURRENT_VER)));
   PC_RETURN_ON_BAD_RESPONSE(CheckRespIsSimpleReply("OK"));
 
+  master_context_.journal_compression = journal::StreamCompression::NONE;
+  string compression_name = absl::GetFlag(FLAGS_replication_stream_compression);
+  auto compression = journal::ParseStreamCompression(compression_name);
+  if (!compression) {
+    LOG(WARNING) << "Unknown replication_stream_compression " << compression_name;
+  } else if (*compression != journal::StreamCompression::NONE) {
+    // Older masters reply with an error, in which case the stream stays uncompressed.
+    RETURN_ON_ERR(SendCommandAndReadResponse(
+        StrCat("REPLCONF JOURNAL-COMPRESSION ", compression_name)));
+    if (CheckRespIsSimpleReply("OK")) {
+      master_context_.journal_compression = *compression;
+    } else {
+      LOG(WARNING) << "Master does not support journal compression, using uncompressed stream";
+    }
+  }
+
   return error_code{};
 }
 
@@ -451,6 +486,8 @@ error_code Replica::InitiatePSync() {
     if (slot_range_.has_value()) {
       JournalExecutor{&service_}.FlushSlots(slot_range_.value());
     } else {
+      // The loaded snapshot is not journaled, so relayed replicas must resync from us.
+      service_.server_family().GetDflyCmd()->CancelReplicas();
       JournalExecutor{&service_}.FlushAll();
     }
 
@@ -592,6 +629,7 @@ error_code Replica::InitiateDflySync(std::optional<LastMasterSyncData> last_mast
       if (slot_range_.has_value()) {
         JournalExecutor{&service_}.FlushSlots(slot_range_.value());
       } else {
+        service_.server_family().GetDflyCmd()->CancelReplicas();
         JournalExecutor{&service_}.FlushAll();
       }
       DVLOG(1) << "Flush on all slots ended " << this;
@@ -926,11 +964,20 @@ void DflyShardReplica::StableSyncDflyReadFb(ExecutionState* cntx) {
 
   io::PrefixSource ps{prefix, Sock()};
 
-  JournalReader reader{&ps, 0};
+  // Only the stable sync part of the stream is framed, the prefix holds its first bytes.
+  std::optional<JournalFrameSource> frame_source;
+  io::Source* source = &ps;
+  if (master_context_.journal_compression != journal::StreamCompression::NONE) {
+    frame_source.emplace(&ps, master_context_.journal_compression);
+    source = &*frame_source;
+  }
+
+  JournalReader reader{source, 0};
   DCHECK_GE(journal_rec_executed_, 1u);
   TransactionReader tx_reader{journal_rec_executed_.load(std::memory_order_relaxed) - 1};
 
   acks_fb_ = fb2::Fiber("shard_acks", &DflyShardReplica::StableSyncDflyAcksFb, this, cntx);
+  StartApplyLanes(cntx);
 
   std::optional<TransactionData> tx_data;
   while ((tx_data = tx_reader.NextTxData(&reader, cntx))) {
@@ -938,25 +985,184 @@ void DflyShardReplica::StableSyncDflyReadFb(ExecutionState* cntx) {
 
     last_io_time_ = Proactor()->GetMonotonicTimeNs();
     if (tx_data->opcode == journal::Op::LSN) {
-      //  Do nothing
-    } else if (tx_data->opcode == journal::Op::PING) {
+      master_lsn_.store(tx_data->lsn, std::memory_order_relaxed);
+      continue;
+    }
+
+    records_received_.fetch_add(1, std::memory_order_relaxed);
+    if (tx_data->opcode == journal::Op::PING) {
       force_ping_ = true;
-      journal_rec_executed_.fetch_add(1, std::memory_order_relaxed);
+      CompleteRecord(next_record_seq_++, true);
+    } else if (auto lane = SelectLane(*tx_data); lane) {
+      // Bound the number of queued commands, so the replica does not buffer the whole stream.
+      WaitApplyLanes(cntx, apply_lanes_.size() * 64);
+      ApplyLane& apply_lane = *apply_lanes_[*lane];
+      apply_lane.queue.emplace_back(next_record_seq_++, std::move(*tx_data));
+      apply_lanes_inflight_++;
+      apply_lane.waker.notify();
     } else {
+      WaitApplyLanes(cntx, 0);
+      // We only increment upon successful execution of the transaction.
+      // The reason for this is that during partial sync we sent this
+      // number as the lsn number to resume from. However, if for example
+      // we increment this when a command fails (because the context
+      // got cancelled, e.g, replication connection broke), we will get
+      // inconsistent data because the replica will resume from the next
+      // lsn of the master and this lsn entry will be lost.
+      uint64_t seq = next_record_seq_++;
       const bool is_successful = ExecuteTx(std::move(*tx_data), cntx);
-      if (is_successful) {
-        // We only increment upon successful execution of the transaction.
-        // The reason for this is that during partial sync we sent this
-        // number as the lsn number to resume from. However, if for example
-        // we increment this when a command fails (because the context
-        // got cancelled, e.g, replication connection broke), we will get
-        // inconsistent data because the replica will resume from the next
-        // lsn of the master and this lsn entry will be lost.
-        journal_rec_executed_.fetch_add(1, std::memory_order_relaxed);
-      }
+      CompleteRecord(seq, is_successful);
     }
     shard_replica_waker_.notifyAll();
   }
+
+  StopApplyLanes();
+}
+
+optional<unsigned> DflyShardReplica::SelectLane(const TransactionData& tx_data) const {
+  if (apply_lanes_.empty() || tx_data.command.cmd_args.empty() || tx_data.IsGlobalCmd())
+    return nullopt;
+
+  CmdArgList args{tx_data.command.cmd_args.data(), tx_data.command.cmd_args.size()};
+  const CommandId* cid = service_.FindCmd(absl::AsciiStrToUpper(facade::ToSV(args[0])));
+
+  // Scripts and transactions can touch keys that are not declared in their arguments.
+  if (cid == nullptr || !cid->IsTransactional() || cid->IsMultiTransactional())
+    return nullopt;
+
+  OpResult<KeyIndex> key_index = DetermineKeys(cid, args.subspan(1));
+  if (!key_index || key_index->NumArgs() == 0)
+    return nullopt;
+
+  optional<unsigned> lane;
+  for (string_view key : key_index->Range(args.subspan(1))) {
+    unsigned key_lane = std::hash<string_view>{}(key) % apply_lanes_.size();
+    if (lane && *lane != key_lane)
+      return nullopt;
+    lane = key_lane;
+  }
+  return lane;
+}
+
+void DflyShardReplica::StartApplyLanes(ExecutionState* cntx) {
+  unsigned num_lanes = absl::GetFlag(FLAGS_replica_apply_lanes);
+  next_record_seq_ = next_complete_seq_ = 0;
+  completed_records_.clear();
+  records_frozen_ = false;
+  apply_lanes_stopped_ = false;
+  squash_commands_ = absl::GetFlag(FLAGS_replica_squash_commands);
+
+  // A single lane still helps when squashing, as the lane applies the commands that were queued
+  // while it executed the previous run.
+  if (num_lanes <= 1 && !squash_commands_)
+    return;
+  num_lanes = max(num_lanes, 1u);
+
+  for (unsigned i = 0; i < num_lanes; i++) {
+    auto lane = make_unique<ApplyLane>();
+    lane->executor = make_unique<JournalExecutor>(&service_);
+    apply_lanes_.push_back(std::move(lane));
+    apply_lanes_.back()->fb = fb2::Fiber(StrCat("shard_apply_lane", i),
+                                         &DflyShardReplica::ApplyLaneFb, this, i, cntx);
+  }
+}
+
+void DflyShardReplica::StopApplyLanes() {
+  apply_lanes_stopped_ = true;
+  for (auto& lane : apply_lanes_) {
+    lane->waker.notify();
+    lane->fb.JoinIfNeeded();
+  }
+  apply_lanes_.clear();
+}
+
+void DflyShardReplica::WaitApplyLanes(ExecutionState* cntx, size_t max_inflight) {
+  apply_lanes_waker_.await(
+      [&] { return apply_lanes_inflight_ <= max_inflight || !cntx->IsRunning(); });
+}
+
+void DflyShardReplica::ApplyLaneFb(unsigned lane_id, ExecutionState* cntx) {
+  ApplyLane& lane = *apply_lanes_[lane_id];
+  while (true) {
+    lane.waker.await([&] { return !lane.queue.empty() || apply_lanes_stopped_; });
+    if (lane.queue.empty())
+      return;
+
+    // Apply the whole run of queued commands back to back.
+    while (!lane.queue.empty()) {
+      if (squash_commands_ && cntx->IsRunning())
+        ApplySquashed(&lane);
+      if (lane.queue.empty())
+        break;
+
+      auto [seq, tx_data] = std::move(lane.queue.front());
+      lane.queue.pop_front();
+
+      bool is_successful = cntx->IsRunning() &&
+                           lane.executor->Execute(tx_data.dbid, tx_data.command) ==
+                               DispatchResult::OK;
+      CompleteRecord(seq, is_successful);
+      apply_lanes_inflight_--;
+      apply_lanes_waker_.notifyAll();
+      shard_replica_waker_.notifyAll();
+    }
+  }
+}
+
+void DflyShardReplica::ApplySquashed(ApplyLane* lane) {
+  constexpr size_t kMaxSquashedRun = 64;
+
+  // Take the prefix of the queue with the same db, the commands are moved out so that the
+  // queue can grow while they are executed.
+  DbIndex dbid = lane->queue.front().second.dbid;
+  vector<pair<uint64_t, TransactionData>> run;
+  while (!lane->queue.empty() && run.size() < kMaxSquashedRun &&
+         lane->queue.front().second.dbid == dbid) {
+    run.push_back(std::move(lane->queue.front()));
+    lane->queue.pop_front();
+  }
+
+  absl::InlinedVector<journal::ParsedEntry::CmdData*, kMaxSquashedRun> cmds;
+  for (auto& [_, tx_data] : run)
+    cmds.push_back(&tx_data.command);
+
+  // Like Execute(), a dispatched command counts as executed even if it replied with an error.
+  size_t dispatched = 0;
+  if (run.size() > 1)
+    dispatched = lane->executor->ExecuteMany(dbid, absl::MakeSpan(cmds));
+  for (size_t i = 0; i < dispatched; i++)
+    CompleteRecord(run[i].first, true);
+
+  // Commands that were not dispatched, for example because of a pause, go back to the queue.
+  for (size_t i = run.size(); i > dispatched; i--)
+    lane->queue.push_front(std::move(run[i - 1]));
+
+  apply_lanes_inflight_ -= dispatched;
+  apply_lanes_waker_.notifyAll();
+  shard_replica_waker_.notifyAll();
+}
+
+void DflyShardReplica::CompleteRecord(uint64_t seq, bool executed) {
+  if (seq != next_complete_seq_) {
+    completed_records_.emplace(seq, executed);
+    return;
+  }
+
+  // Once a record was not executed, the offset must stay before it, as it is the lsn a partial
+  // sync resumes from. The records that follow are still consumed but no longer counted.
+  uint64_t executed_cnt = 0;
+  while (true) {
+    if (!executed)
+      records_frozen_ = true;
+    executed_cnt += !records_frozen_;
+    next_complete_seq_++;
+
+    if (completed_records_.empty() || completed_records_.begin()->first != next_complete_seq_)
+      break;
+    executed = completed_records_.begin()->second;
+    completed_records_.erase(completed_records_.begin());
+  }
+  journal_rec_executed_.fetch_add(executed_cnt, std::memory_order_relaxed);
 }
 
 void Replica::RedisStreamAcksFb() {
@@ -1005,6 +1211,7 @@ void DflyShardReplica::StableSyncDflyAcksFb(ExecutionState* cntx) {
       break;
     }
     ack_offs_ = current_offset;
+    acks_sent_.fetch_add(1, std::memory_order_relaxed);
 
     shard_replica_waker_.await_until(
         [&]() {
@@ -1033,11 +1240,34 @@ DflyShardReplica::~DflyShardReplica() {
   JoinFlow();
 }
 
+Replica::FlowStats DflyShardReplica::GetStats() const {
+  Replica::FlowStats stats;
+  stats.received = records_received_.load(std::memory_order_relaxed);
+  stats.executed = journal_rec_executed_.load(std::memory_order_relaxed);
+  stats.master_lsn = master_lsn_.load(std::memory_order_relaxed);
+  stats.apply_queued = apply_lanes_inflight_.load(std::memory_order_relaxed);
+  stats.acks_sent = acks_sent_.load(std::memory_order_relaxed);
+  return stats;
+}
+
 bool DflyShardReplica::ExecuteTx(TransactionData&& tx_data, ExecutionState* cntx) {
   if (!cntx->IsRunning()) {
     return false;
   }
 
+  // A batched entry is applied as a whole, it counts as executed only if all its commands were.
+  if (!tx_data.batch.empty()) {
+    absl::InlinedVector<journal::ParsedEntry::CmdData*, 16> cmds;
+    for (auto& cmd : tx_data.batch)
+      cmds.push_back(&cmd);
+
+    size_t dispatched = executor_->ExecuteMany(tx_data.dbid, absl::MakeSpan(cmds));
+    bool is_successful = true;
+    for (size_t i = dispatched; i < cmds.size(); i++)
+      is_successful &= executor_->Execute(tx_data.dbid, *cmds[i]) == facade::DispatchResult::OK;
+    return is_successful;
+  }
+
   if (!tx_data.IsGlobalCmd()) {
     VLOG(3) << "Execute cmd without sync between shards. txid: " << tx_data.txid;
     return executor_->Execute(tx_data.dbid, tx_data.command) == facade::DispatchResult::OK;
@@ -1231,6 +1461,41 @@ std::vector<uint64_t> Replica::GetReplicaOffset() const {
   return flow_rec_count;
 }
 
+std::vector<Replica::FlowStats> Replica::GetFlowStats() const {
+  std::vector<FlowStats> stats(shard_flows_.size());
+  for (const auto& flow : shard_flows_) {
+    DCHECK_LT(flow->FlowId(), stats.size());
+    stats[flow->FlowId()] = flow->GetStats();
+  }
+  return stats;
+}
+
+bool Replica::WaitForLsns(string_view master_id, absl::Span<const pair<uint32_t, LSN>> flow_lsns,
+                          std::chrono::steady_clock::time_point deadline) const {
+  auto reached = [&] {
+    if (GetCurrentPhase() != "STABLE_SYNC" || master_context_.master_repl_id != master_id)
+      return false;
+
+    vector<uint64_t> offsets = GetReplicaOffset();
+    for (auto [flow_id, lsn] : flow_lsns) {
+      if (flow_id >= offsets.size() || offsets[flow_id] < lsn)
+        return false;
+    }
+    return true;
+  };
+
+  // Flows notify only their own threads, so progress is polled with a growing interval.
+  auto interval = 50us;
+  while (true) {
+    if (Sock() && Proactor()->AwaitBrief(reached))
+      return true;
+    if (deadline - std::chrono::steady_clock::now() < interval)
+      return false;
+    ThisFiber::SleepFor(interval);
+    interval = std::min<std::chrono::microseconds>(interval * 2, 1ms);
+  }
+}
+
 std::string Replica::GetSyncId() const {
   return master_context_.dfly_session_id;
 }
@@ -1270,6 +1535,7 @@ void DflyShardReplica::Cancel() {
     rdb_loader_->stop();
   CloseSocket();
   shard_replica_waker_.notifyAll();
+  apply_lanes_waker_.notifyAll();
 }
 
 }  // namespace dfly
@@ -3,9 +3,11 @@
 //
 #pragma once
 
+#include <absl/container/btree_map.h>
 #include <absl/container/inlined_vector.h>
 
 #include <boost/fiber/barrier.hpp>
+#include <deque>
 #include <queue>
 #include <variant>
 
@@ -34,6 +36,7 @@ struct MasterContext {
   std::string dfly_session_id;  // Sync session id for dfly sync.
   unsigned num_flows = 0;
   DflyVersion version = DflyVersion::VER1;
+  journal::StreamCompression journal_compression = journal::StreamCompression::NONE;
 };
 
 // This class manages replication from both Dragonfly and Redis masters.
@@ -65,6 +68,12 @@ class Replica : ProtocolClient {
   };
   void StartMainReplicationFiber(std::optional<LastMasterSyncData> data);
 
+  // Journal lsns of a snapshot that was loaded before replication started. Used to request a
+  // partial sync if the master is the one that saved the snapshot.
+  void SetSnapshotSyncData(LastMasterSyncData data) {
+    snapshot_sync_data_ = std::move(data);
+  }
+
   // Sets the server state to have replication enabled.
   // It is like Start(), but does not attempt to establish
   // a connection right-away, but instead lets MainReplicationFb do the work.
@@ -142,6 +151,23 @@ class Replica : ProtocolClient {
   std::vector<uint64_t> GetReplicaOffset() const;
   std::string GetSyncId() const;
 
+  struct FlowStats {
+    uint64_t received = 0;      // journal records received in stable sync
+    uint64_t executed = 0;      // journal offset, see JournalExecutedCount
+    uint64_t master_lsn = 0;    // last lsn announced by the master
+    uint64_t apply_queued = 0;  // commands waiting on apply lanes
+    uint64_t acks_sent = 0;
+  };
+
+  // Thread-safe, indexed by flow id.
+  std::vector<FlowStats> GetFlowStats() const;
+
+  // Thread-safe. Waits until the replica is in stable sync with master_id and each listed flow
+  // executed the journal up to its lsn. Returns false on timeout.
+  bool WaitForLsns(std::string_view master_id,
+                   absl::Span<const std::pair<uint32_t, LSN>> flow_lsns,
+                   std::chrono::steady_clock::time_point deadline) const;
+
   // Get the current replication phase based on state_mask_
   std::string GetCurrentPhase() const;
 
@@ -176,6 +202,8 @@ class Replica : ProtocolClient {
 
   std::optional<cluster::SlotRange> slot_range_;
 
+  std::optional<LastMasterSyncData> snapshot_sync_data_;
+
   uint32_t reconnect_count_ = 0;
   size_t psync_attempts_ = 0;
   size_t psync_successes_ = 0;
@@ -215,16 +243,45 @@ class DflyShardReplica : public ProtocolClient {
   // or on context cancellation return false.
   bool ExecuteTx(TransactionData&& tx_data, ExecutionState* cntx);
 
+  // Apply lane fiber, executes commands routed to the lane in order.
+  void ApplyLaneFb(unsigned lane_id, ExecutionState* cntx);
+
   uint32_t FlowId() const;
 
   uint64_t JournalExecutedCount() const {
     return journal_rec_executed_.load(std::memory_order_relaxed);
   }
 
+  // Can be called from any thread.
+  Replica::FlowStats GetStats() const;
+
   // Can be called from any thread.
   void Pause(bool pause);
 
  private:
+  // Commands whose keys all hash to the same apply lane are executed by that lane concurrently
+  // with the other lanes. Everything else is a barrier that waits for all lanes to drain.
+  struct ApplyLane {
+    std::unique_ptr<JournalExecutor> executor;
+    std::deque<std::pair<uint64_t, TransactionData>> queue;  // record sequence and command
+    util::fb2::EventCount waker;
+    util::fb2::Fiber fb;
+  };
+
+  // Returns the lane of the command or nullopt if it must run as a barrier.
+  std::optional<unsigned> SelectLane(const TransactionData& tx_data) const;
+  void StartApplyLanes(ExecutionState* cntx);
+  void StopApplyLanes();
+  void WaitApplyLanes(ExecutionState* cntx, size_t max_inflight);
+
+  // Execute a run of commands from the front of the lane queue with command squashing.
+  void ApplySquashed(ApplyLane* lane);
+
+  // Marks a journal record as processed. journal_rec_executed_ only advances over the contiguous
+  // prefix of processed records, as records may complete out of order on different lanes, and
+  // stops at the first record that was not executed.
+  void CompleteRecord(uint64_t seq, bool executed);
+
   Service& service_;
   MasterContext master_context_;
 
@@ -245,6 +302,19 @@ class DflyShardReplica : public ProtocolClient {
   // Atomic, because JournalExecutedCount() can be called from any thread.
   std::atomic_uint64_t journal_rec_executed_ = 0;
 
+  std::vector<std::unique_ptr<ApplyLane>> apply_lanes_;
+  util::fb2::EventCount apply_lanes_waker_;  // notified when lane commands complete
+  std::atomic_size_t apply_lanes_inflight_ = 0;  // atomic for GetStats()
+  bool apply_lanes_stopped_ = false;
+  bool squash_commands_ = false;
+  uint64_t next_record_seq_ = 0, next_complete_seq_ = 0;
+  // Records completed after a gap in the sequence and whether they were executed.
+  absl::btree_map<uint64_t, bool> completed_records_;
+  bool records_frozen_ = false;  // a record was not executed, the offset no longer advances.
+
+  // Stable sync counters, atomic because GetStats() can be called from any thread.
+  std::atomic_uint64_t records_received_ = 0, master_lsn_ = 0, acks_sent_ = 0;
+
   util::fb2::Fiber sync_fb_, acks_fb_;
   size_t ack_offs_ = 0;
   int proactor_index_ = -1;
@@ -29,6 +29,9 @@ ABSL_FLAG(std::string, default_lua_flags, "",
           "separated by space, for example 'allow-undeclared-keys disable-atomicity' runs scripts "
           "non-atomically and allows accessing undeclared keys");
 
+ABSL_FLAG(bool, lua_share_bytecode, true,
+          "If true, a script is parsed once and the other interpreters load its compiled bytecode");
+
 ABSL_FLAG(
     bool, lua_auto_async, false,
     "If enabled, call/pcall with discarded values are automatically replaced with acall/apcall.");
@@ -292,8 +295,10 @@ io::Result<string, GenericError> ScriptMgr::Insert(string_view body, Interpreter
       body = *async_body;
   }
 
-  string result;
-  Interpreter::AddResult add_result = interpreter->AddFunction(sha, body, &result);
+  string result, bytecode;
+  bool share_bytecode = absl::GetFlag(FLAGS_lua_share_bytecode);
+  Interpreter::AddResult add_result =
+      interpreter->AddFunction(sha, body, &result, share_bytecode ? &bytecode : nullptr);
   if (add_result == Interpreter::COMPILE_ERR)
     return nonstd::make_unexpected(GenericError{std::move(result)});
 
@@ -303,6 +308,9 @@ io::Result<string, GenericError> ScriptMgr::Insert(string_view body, Interpreter
   if (!it->second.body) {
     it->second.body = CharBufFromSV(body);
   }
+  if (!it->second.bytecode && !bytecode.empty()) {
+    it->second.bytecode = make_shared<const string>(std::move(bytecode));
+  }
 
   UpdateScriptCaches(sha, it->second);
 
@@ -315,7 +323,7 @@ optional<ScriptMgr::ScriptData> ScriptMgr::Find(std::string_view sha) const {
 
   lock_guard lk{mu_};
   if (auto it = db_.find(sha); it != db_.end() && it->second.body)
-    return ScriptData{it->second, it->second.body.get()};
+    return ScriptData{it->second, it->second.body.get(), it->second.bytecode};
 
   return std::nullopt;
 }
@@ -361,12 +369,39 @@ vector<pair<string, ScriptMgr::ScriptData>> ScriptMgr::GetAll() const {
   res.reserve(db_.size());
   for (const auto& [sha, data] : db_) {
     string body = data.body ? string{data.body.get()} : string{};
-    res.emplace_back(string{sha.data(), sha.size()}, ScriptData{data, std::move(body)});
+    res.emplace_back(string{sha.data(), sha.size()},
+                     ScriptData{data, std::move(body), data.bytecode});
   }
 
   return res;
 }
 
+void ScriptMgr::WarmUpInterpreters() const {
+  auto scripts = make_shared<const vector<pair<string, ScriptData>>>(GetAll());
+  if (scripts->empty())
+    return;
+
+  auto warm_up = [scripts](Interpreter* ir) {
+    string error;
+    for (const auto& [sha, data] : *scripts) {
+      auto res = data.bytecode ? ir->AddFunctionBytecode(sha, *data.bytecode, &error)
+                               : ir->AddFunction(sha, data.body, &error);
+      LOG_IF(WARNING, res == Interpreter::COMPILE_ERR) << "Error adding " << sha << ": " << error;
+    }
+    ThisFiber::Yield();
+  };
+
+  for (unsigned i = 0; i < shard_set->pool()->size(); ++i) {
+    shard_set->pool()->at(i)->Dispatch([warm_up] {
+      ServerState* ss = ServerState::tlocal();
+
+      // Interpreters are created lazily, make sure that at least one exists.
+      ss->ReturnInterpreter(ss->BorrowInterpreter());
+      ss->AlterInterpreters(warm_up);
+    });
+  }
+}
+
 void ScriptMgr::UpdateScriptCaches(ScriptKey sha, ScriptParams params) const {
   shard_set->pool()->AwaitBrief([&sha, &params](auto index, auto* pb) {
     ServerState::tlocal()->SetScriptParams(sha, params);
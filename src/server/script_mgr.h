@@ -7,6 +7,7 @@
 #include <absl/container/flat_hash_map.h>
 
 #include <array>
+#include <memory>
 #include <optional>
 
 #include "server/conn_context.h"
@@ -36,6 +37,9 @@ class ScriptMgr {
 
   struct ScriptData : public ScriptParams {
     std::string body;  // script source code present in lua interpreter
+
+    // Compiled definition of the script, shared by the interpreters of all threads.
+    std::shared_ptr<const std::string> bytecode;
   };
 
   struct ScriptKey : public std::array<char, 40> {
@@ -61,6 +65,10 @@ class ScriptMgr {
 
   void FlushAllScript();
 
+  // Adds all scripts to the interpreters of every thread in the background, so that their first
+  // calls, for example after loading a snapshot, do not pay for the compilation.
+  void WarmUpInterpreters() const;
+
   // Returns if scripts run as global transactions by default
   bool AreGlobalByDefault() const;
 
@@ -82,6 +90,7 @@ class ScriptMgr {
   struct InternalScriptData : public ScriptParams {
     std::unique_ptr<char[]> body{};
     std::unique_ptr<char[]> orig_body{};
+    std::shared_ptr<const std::string> bytecode{};
   };
 
   ScriptParams default_params_;
@@ -4,6 +4,8 @@
 
 #include "server/search/aggregator.h"
 
+#include <numeric>
+
 #include "base/logging.h"
 #include "server/search/doc_index.h"
 
@@ -30,28 +32,118 @@ DocValues PackFields(ValuesList values, absl::Span<const std::string> fields) {
   return out;
 }
 
-const Value kEmptyValue = Value{};
+// Documents split into groups, with the values of the reducer source fields extracted into
+// columns. Columns are laid out group after group, so that reducers run over contiguous ranges.
+// Every source field is looked up only once per document.
+class GroupedColumns {
+ public:
+  // Moves the source field values out of the documents
+  GroupedColumns(std::vector<DocValues>* values, absl::Span<const std::string> fields,
+                 absl::Span<const Reducer> reducers) {
+    // Assign documents to groups
+    GroupIds group_ids;
+    std::vector<uint32_t> doc_groups(values->size());
+    std::vector<size_t> group_sizes;
+    for (size_t i = 0; i < values->size(); i++) {
+      auto [it, added] = group_ids.try_emplace(ExtractFieldsValues((*values)[i], fields),
+                                               group_sizes.size());
+      if (added)
+        group_sizes.push_back(0);
+      doc_groups[i] = it->second;
+      group_sizes[it->second]++;
+    }
+
+    offsets_.assign(group_sizes.size() + 1, 0);
+    for (size_t g = 0; g < group_sizes.size(); g++)
+      offsets_[g + 1] = offsets_[g] + group_sizes[g];
+
+    for (const auto& reducer : reducers) {
+      auto [it, added] = columns_.try_emplace(reducer.source_field);
+      if (!added)
+        continue;
+
+      auto& column = it->second;
+      column.resize(values->size());
+      std::vector<size_t> pos(offsets_.begin(), offsets_.end() - 1);
+      for (size_t i = 0; i < values->size(); i++) {
+        auto& doc = (*values)[i];
+        if (auto value_it = doc.find(reducer.source_field); value_it != doc.end())
+          column[pos[doc_groups[i]]] = std::move(value_it->second);
+        pos[doc_groups[i]]++;
+      }
+    }
+
+    keys_.resize(group_ids.size());
+    while (!group_ids.empty()) {
+      auto node = group_ids.extract(group_ids.begin());
+      uint32_t g = node.mapped();
+      keys_[g] = std::move(node);
+    }
+  }
+
+  size_t size() const {
+    return keys_.size();
+  }
+
+  ValuesList& key(size_t group) {
+    return keys_[group].key();
+  }
+
+  // Values of a reducer source field in the group
+  ValueIterator Values(size_t group, std::string_view field) const {
+    const auto& column = columns_.find(field)->second;
+    size_t size = offsets_[group + 1] - offsets_[group];
+    return ValueIterator{absl::MakeSpan(column).subspan(offsets_[group], size)};
+  }
+
+ private:
+  using GroupIds = absl::flat_hash_map<ValuesList, uint32_t>;
+
+  std::vector<GroupIds::node_type> keys_;
+  std::vector<size_t> offsets_;
+  absl::flat_hash_map<std::string_view, std::vector<Value>> columns_;
+};
+
+// Merges the state of a reducer computed on a part of the group into the accumulated one
+void MergeReducerState(ReducerFunc func, const Value* part, Value* acc) {
+  switch (func) {
+    case ReducerFunc::AVG:  // sum and count
+      std::get<double>(acc[1]) += std::get<double>(part[1]);
+      [[fallthrough]];
+    case ReducerFunc::COUNT:
+    case ReducerFunc::SUM:
+      std::get<double>(acc[0]) += std::get<double>(part[0]);
+      break;
+    case ReducerFunc::MAX:
+      acc[0] = std::max(acc[0], part[0]);
+      break;
+    case ReducerFunc::MIN:
+      acc[0] = std::min(acc[0], part[0]);
+      break;
+    case ReducerFunc::COUNT_DISTINCT:
+      LOG(DFATAL) << "COUNT_DISTINCT can't be merged";
+      break;
+  }
+}
+
+size_t ReducerStateSize(ReducerFunc func) {
+  return func == ReducerFunc::AVG ? 2 : 1;
+}
 
 }  // namespace
 
 void Aggregator::DoGroup(absl::Span<const std::string> fields, absl::Span<const Reducer> reducers) {
-  // Separate items into groups
-  absl::flat_hash_map<ValuesList, std::vector<DocValues>> groups;
-  for (auto& value : result.values) {
-    groups[ExtractFieldsValues(value, fields)].push_back(std::move(value));
-  }
+  GroupedColumns groups{&result.values, fields, reducers};
 
   // Restore DocValues and apply reducers
   auto& values = result.values;
   values.clear();
-  values.reserve(groups.size());
-  while (!groups.empty()) {
-    auto node = groups.extract(groups.begin());
-    DocValues doc = PackFields(std::move(node.key()), fields);
-    for (auto& reducer : reducers) {
-      doc[reducer.result_field] = reducer.func({reducer.source_field, node.mapped()});
-    }
-    values.push_back(std::move(doc));
+  values.resize(groups.size());
+  for (size_t g = 0; g < groups.size(); g++) {
+    DocValues& doc = values[g];
+    doc = PackFields(std::move(groups.key(g)), fields);
+    for (const auto& reducer : reducers)
+      doc[reducer.result_field] = reducer.func(groups.Values(g, reducer.source_field));
   }
 
   auto& fields_to_print = result.fields_to_print;
@@ -67,52 +159,71 @@ void Aggregator::DoGroup(absl::Span<const std::string> fields, absl::Span<const
 }
 
 void Aggregator::DoSort(const SortParams& sort_params) {
+  auto& values = result.values;
+  const size_t num_fields = sort_params.fields.size();
+
+  // Look up the sort fields once per document instead of on every comparison.
+  // Missing values are nullptr.
+  std::vector<const Value*> keys(values.size() * num_fields);
+  for (size_t i = 0; i < values.size(); i++) {
+    for (size_t f = 0; f < num_fields; f++) {
+      auto it = values[i].find(sort_params.fields[f].first);
+      keys[i * num_fields + f] = it != values[i].end() ? &it->second : nullptr;
+    }
+  }
+
   /*
     Comparator for sorting DocValues by fields.
     If some of the fields is not present in the DocValues, comparator returns:
-    1. l_it == l.end() && r_it != r.end()
+    1. l == nullptr && r != nullptr
       asc -> false
       desc -> false
-    2. l_it != l.end() && r_it == r.end()
+    2. l != nullptr && r == nullptr
       asc -> true
       desc -> true
-    3. l_it == l.end() && r_it == r.end()
+    3. l == nullptr && r == nullptr
       asc -> false
       desc -> false
   */
-  auto comparator = [&](const DocValues& l, const DocValues& r) {
-    for (const auto& [field, order] : sort_params.fields) {
-      auto l_it = l.find(field);
-      auto r_it = r.find(field);
+  auto comparator = [&](size_t l_idx, size_t r_idx) {
+    for (size_t f = 0; f < num_fields; f++) {
+      const Value* lv = keys[l_idx * num_fields + f];
+      const Value* rv = keys[r_idx * num_fields + f];
 
       // If some of the values is not present
-      if (l_it == l.end() || r_it == r.end()) {
-        if (l_it == l.end() && r_it == r.end()) {
+      if (!lv || !rv) {
+        if (!lv && !rv) {
           continue;
         }
-        return l_it != l.end();
+        return lv != nullptr;
       }
 
-      const auto& lv = l_it->second;
-      const auto& rv = r_it->second;
-      if (lv == rv) {
+      if (*lv == *rv) {
         continue;
       }
-      return order == SortOrder::ASC ? lv < rv : lv > rv;
+      return sort_params.fields[f].second == SortOrder::ASC ? *lv < *rv : *lv > *rv;
     }
     return false;
   };
 
-  auto& values = result.values;
+  std::vector<size_t> order(values.size());
+  std::iota(order.begin(), order.end(), 0);
+
+  size_t limit = values.size();
   if (sort_params.SortAll()) {
-    std::sort(values.begin(), values.end(), comparator);
+    std::sort(order.begin(), order.end(), comparator);
   } else {
     DCHECK_GE(sort_params.max, 0);
-    const size_t limit = std::min(values.size(), size_t(sort_params.max));
-    std::partial_sort(values.begin(), values.begin() + limit, values.end(), comparator);
-    values.resize(limit);
+    limit = std::min(values.size(), size_t(sort_params.max));
+    std::partial_sort(order.begin(), order.begin() + limit, order.end(), comparator);
   }
 
+  std::vector<DocValues> sorted;
+  sorted.reserve(limit);
+  for (size_t i = 0; i < limit; i++)
+    sorted.push_back(std::move(values[order[i]]));
+  values = std::move(sorted);
+
   for (auto& field : sort_params.fields) {
     result.fields_to_print.insert(field.first);
   }
@@ -124,16 +235,6 @@ void Aggregator::DoLimit(size_t offset, size_t num) {
   values.resize(std::min(num, values.size()));
 }
 
-const Value& ValueIterator::operator*() const {
-  auto it = values_.front().find(field_);
-  return it == values_.front().end() ? kEmptyValue : it->second;
-}
-
-ValueIterator& ValueIterator::operator++() {
-  values_.remove_prefix(1);
-  return *this;
-}
-
 Reducer::Func FindReducerFunc(ReducerFunc name) {
   const static auto kCountReducer = [](ValueIterator it) -> double {
     return std::distance(it, it.end());
@@ -180,10 +281,88 @@ AggregationStep MakeLimitStep(size_t offset, size_t num) {
   return [=](Aggregator* aggregator) { aggregator->DoLimit(offset, num); };
 }
 
+bool IsDecomposable(ReducerFunc func) {
+  return func != ReducerFunc::COUNT_DISTINCT;
+}
+
+PartialGroups GroupPartially(std::vector<DocValues> values, const GroupParams& params) {
+  DCHECK_EQ(params.reducers.size(), params.funcs.size());
+  GroupedColumns groups{&values, params.fields, params.reducers};
+
+  PartialGroups out(groups.size());
+  for (size_t g = 0; g < groups.size(); g++) {
+    auto& row = out[g];
+    auto& key = groups.key(g);
+    row.assign(std::make_move_iterator(key.begin()), std::make_move_iterator(key.end()));
+    for (size_t i = 0; i < params.reducers.size(); i++) {
+      const Reducer& reducer = params.reducers[i];
+      ValueIterator it = groups.Values(g, reducer.source_field);
+      if (params.funcs[i] == ReducerFunc::AVG) {
+        row.push_back(FindReducerFunc(ReducerFunc::SUM)(it));
+        row.push_back(FindReducerFunc(ReducerFunc::COUNT)(it));
+      } else {
+        row.push_back(reducer.func(it));
+      }
+    }
+  }
+  return out;
+}
+
+AggregationResult MergePartialGroups(absl::Span<PartialGroups> partials,
+                                     const GroupParams& params) {
+  const size_t num_fields = params.fields.size();
+  absl::flat_hash_map<ValuesList, std::vector<Value>> groups;
+  for (auto& partial : partials) {
+    for (auto& row : partial) {
+      auto states_begin = std::make_move_iterator(row.begin() + num_fields);
+      auto [it, added] = groups.try_emplace(
+          ValuesList(std::make_move_iterator(row.begin()), states_begin));
+      if (added) {
+        it->second.assign(states_begin, std::make_move_iterator(row.end()));
+        continue;
+      }
+
+      for (size_t i = 0, pos = num_fields; i < params.funcs.size(); i++) {
+        MergeReducerState(params.funcs[i], &row[pos], &it->second[pos - num_fields]);
+        pos += ReducerStateSize(params.funcs[i]);
+      }
+    }
+  }
+
+  AggregationResult result;
+  result.values.reserve(groups.size());
+  while (!groups.empty()) {
+    auto node = groups.extract(groups.begin());
+    DocValues doc = PackFields(std::move(node.key()), params.fields);
+    const auto& states = node.mapped();
+    for (size_t i = 0, pos = 0; i < params.funcs.size(); i++) {
+      Value& value = doc[params.reducers[i].result_field];
+      if (params.funcs[i] == ReducerFunc::AVG)
+        value = std::get<double>(states[pos]) / std::get<double>(states[pos + 1]);
+      else
+        value = states[pos];
+      pos += ReducerStateSize(params.funcs[i]);
+    }
+    result.values.push_back(std::move(doc));
+  }
+
+  for (auto& field : params.fields)
+    result.fields_to_print.insert(field);
+  for (auto& reducer : params.reducers)
+    result.fields_to_print.insert(reducer.result_field);
+  return result;
+}
+
 AggregationResult Process(std::vector<DocValues> values,
                           absl::Span<const std::string_view> fields_to_print,
                           absl::Span<const AggregationStep> steps) {
-  Aggregator aggregator{std::move(values), {fields_to_print.begin(), fields_to_print.end()}};
+  return Process(
+      AggregationResult{std::move(values), {fields_to_print.begin(), fields_to_print.end()}},
+      steps);
+}
+
+AggregationResult Process(AggregationResult initial, absl::Span<const AggregationStep> steps) {
+  Aggregator aggregator{std::move(initial)};
   for (auto& step : steps) {
     step(&aggregator);
   }
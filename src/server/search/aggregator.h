@@ -63,8 +63,9 @@ struct Aggregator {
 
 using AggregationStep = std::function<void(Aggregator*)>;  // Group, Sort, etc.
 
-// Iterator over Span<DocValues> that yields doc[field] or monostate if not present.
-// Extra clumsy for STL compatibility!
+// Iterator over the values of a field in a group of documents, monostate if not present.
+// The aggregator extracts them into a contiguous column first, so reducers don't look up
+// fields per document. Extra clumsy for STL compatibility!
 struct ValueIterator {
   using iterator_category = std::forward_iterator_tag;
   using difference_type = std::ptrdiff_t;
@@ -72,16 +73,20 @@ struct ValueIterator {
   using pointer = const Value*;
   using reference = const Value&;
 
-  ValueIterator(std::string_view field, absl::Span<const DocValues> values)
-      : field_{field}, values_{values} {
+  explicit ValueIterator(absl::Span<const Value> column) : column_{column} {
   }
 
-  const Value& operator*() const;
+  const Value& operator*() const {
+    return column_.front();
+  }
 
-  ValueIterator& operator++();
+  ValueIterator& operator++() {
+    column_.remove_prefix(1);
+    return *this;
+  }
 
   bool operator==(const ValueIterator& other) const {
-    return values_.size() == other.values_.size();
+    return column_.size() == other.column_.size();
   }
 
   bool operator!=(const ValueIterator& other) const {
@@ -95,8 +100,7 @@ struct ValueIterator {
  private:
   ValueIterator() = default;
 
-  std::string_view field_;
-  absl::Span<const DocValues> values_;
+  absl::Span<const Value> column_;
 };
 
 struct Reducer {
@@ -110,6 +114,27 @@ enum class ReducerFunc { COUNT, COUNT_DISTINCT, SUM, AVG, MAX, MIN };
 // Find reducer function by uppercase name (COUNT, MAX, etc...), empty functor if not found
 Reducer::Func FindReducerFunc(ReducerFunc name);
 
+// Returns true if the reducer result can be merged from results computed on parts of the group
+bool IsDecomposable(ReducerFunc func);
+
+// GROUPBY with decomposable reducers only, that can be computed separately on every shard
+struct GroupParams {
+  std::vector<std::string> fields;
+  std::vector<Reducer> reducers;
+  std::vector<ReducerFunc> funcs;  // functions of reducers
+};
+
+// Groups computed on a part of the documents. Every row holds the group values followed by the
+// reducer states: one value for each reducer, except AVG that keeps sum and count.
+using PartialGroups = std::vector<std::vector<Value>>;
+
+// Compute groups on a part of the documents, for example all documents of a single shard
+PartialGroups GroupPartially(std::vector<DocValues> values, const GroupParams& params);
+
+// Merge partial groups into the same result that the GROUPBY step would produce
+AggregationResult MergePartialGroups(absl::Span<PartialGroups> partials,
+                                     const GroupParams& params);
+
 // Make `GROUPBY [fields...]`  with REDUCE step
 AggregationStep MakeGroupStep(std::vector<std::string> fields, std::vector<Reducer> reducers);
 
@@ -124,4 +149,7 @@ AggregationResult Process(std::vector<DocValues> values,
                           absl::Span<const std::string_view> fields_to_print,
                           absl::Span<const AggregationStep> steps);
 
+// Process result of previous steps, for example merged partial groups
+AggregationResult Process(AggregationResult initial, absl::Span<const AggregationStep> steps);
+
 }  // namespace dfly::aggregate
@@ -4,6 +4,8 @@
 
 #include "server/search/aggregator.h"
 
+#include <absl/strings/str_cat.h>
+
 #include "base/gtest.h"
 #include "server/search/doc_index.h"
 
@@ -108,4 +110,100 @@ TEST(AggregatorTest, GroupWithReduce) {
   EXPECT_EQ(result.values[1].at("distinct-null"), Value{(double)1});
 }
 
+TEST(AggregatorTest, GroupSharedSourceField) {
+  std::vector<DocValues> values;
+  for (size_t i = 0; i < 12; i++) {
+    DocValues doc{{"group", double(i % 3)}};
+    if (i != 7)
+      doc["v"] = double(i);
+    values.push_back(std::move(doc));
+  }
+
+  std::vector<std::string> fields = {"group"};
+  std::vector<Reducer> reducers = {
+      Reducer{"v", "min", FindReducerFunc(ReducerFunc::MIN)},
+      Reducer{"v", "max", FindReducerFunc(ReducerFunc::MAX)},
+      Reducer{"v", "sum", FindReducerFunc(ReducerFunc::SUM)},
+      Reducer{"v", "avg", FindReducerFunc(ReducerFunc::AVG)}};
+
+  StepsList steps = {MakeGroupStep(std::move(fields), std::move(reducers))};
+
+  auto result = Process(values, {"group", "v"}, steps);
+  ASSERT_EQ(result.values.size(), 3);
+
+  std::sort(result.values.begin(), result.values.end(),
+            [](const DocValues& l, const DocValues& r) { return l.at("group") < r.at("group"); });
+
+  // Group 0: 0, 3, 6, 9
+  EXPECT_EQ(result.values[0].at("min"), Value{0.0});
+  EXPECT_EQ(result.values[0].at("max"), Value{9.0});
+  EXPECT_EQ(result.values[0].at("sum"), Value{18.0});
+  EXPECT_EQ(result.values[0].at("avg"), Value{4.5});
+
+  // Group 1: 1, 4, 10 (7 is missing)
+  EXPECT_EQ(result.values[1].at("max"), Value{10.0});
+  EXPECT_EQ(result.values[1].at("sum"), Value{15.0});
+
+  // Group 2: 2, 5, 8, 11
+  EXPECT_EQ(result.values[2].at("min"), Value{2.0});
+  EXPECT_EQ(result.values[2].at("max"), Value{11.0});
+  EXPECT_EQ(result.values[2].at("sum"), Value{26.0});
+  EXPECT_EQ(result.values[2].at("avg"), Value{6.5});
+}
+
+TEST(AggregatorTest, SortMissingFields) {
+  std::vector<DocValues> values = {
+      DocValues{{"a", 2.0}, {"b", 1.0}}, DocValues{{"b", 5.0}},
+      DocValues{{"a", 1.0}, {"b", 2.0}}, DocValues{{"a", 2.0}, {"b", 0.0}},
+  };
+
+  SortParams params;
+  params.fields.emplace_back("a", SortOrder::DESC);
+  params.fields.emplace_back("b", SortOrder::ASC);
+  params.max = 3;
+  StepsList steps = {MakeSortStep(std::move(params))};
+
+  auto result = Process(values, {"a", "b"}, steps);
+  ASSERT_EQ(result.values.size(), 3);
+
+  EXPECT_EQ(result.values[0]["b"], Value(0.0));
+  EXPECT_EQ(result.values[1]["b"], Value(1.0));
+  EXPECT_EQ(result.values[2]["b"], Value(2.0));
+}
+
+TEST(AggregatorTest, MergePartialGroups) {
+  std::vector<DocValues> values;
+  for (size_t i = 0; i < 20; i++) {
+    DocValues doc{{"tag", i % 3 == 0 ? "a" : "b"}};
+    if (i % 7 != 0)
+      doc["v"] = double(i);
+    values.push_back(std::move(doc));
+  }
+
+  GroupParams params;
+  params.fields = {"tag"};
+  for (auto func : {ReducerFunc::COUNT, ReducerFunc::SUM, ReducerFunc::AVG, ReducerFunc::MAX,
+                    ReducerFunc::MIN}) {
+    params.reducers.push_back(
+        Reducer{"v", absl::StrCat("r", params.funcs.size()), FindReducerFunc(func)});
+    params.funcs.push_back(func);
+  }
+
+  // Split documents between three "shards", the last one empty
+  std::vector<PartialGroups> partials;
+  partials.push_back(GroupPartially({values.begin(), values.begin() + 8}, params));
+  partials.push_back(GroupPartially({values.begin() + 8, values.end()}, params));
+  partials.push_back(GroupPartially({}, params));
+  auto merged = MergePartialGroups(absl::MakeSpan(partials), params);
+
+  StepsList steps = {MakeGroupStep(params.fields, params.reducers)};
+  auto expected = Process(values, {"tag", "v"}, steps);
+
+  auto by_tag = [](const DocValues& l, const DocValues& r) { return l.at("tag") < r.at("tag"); };
+  std::sort(merged.values.begin(), merged.values.end(), by_tag);
+  std::sort(expected.values.begin(), expected.values.end(), by_tag);
+  EXPECT_EQ(merged.values, expected.values);
+  EXPECT_EQ(merged.fields_to_print, expected.fields_to_print);
+}
+
 }  // namespace dfly::aggregate
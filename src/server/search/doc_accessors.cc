@@ -81,7 +81,7 @@ FieldValue ExtractSortableValueFromJson(const search::Schema& schema, string_vie
 }
 
 /* Returns true if json elements were successfully processed. */
-bool ProcessJsonElements(const std::vector<JsonType>& json_elements,
+bool ProcessJsonElements(absl::Span<const JsonType* const> json_elements,
                          absl::FunctionRef<bool(const JsonType&)> cb) {
   auto process = [&cb](const auto& json_range) -> bool {
     for (const auto& json : json_range) {
@@ -92,10 +92,14 @@ bool ProcessJsonElements(const std::vector<JsonType>& json_elements,
     return true;
   };
 
-  if (!json_elements[0].is_array()) {
-    return process(json_elements);
+  if (!json_elements[0]->is_array()) {
+    for (const JsonType* json : json_elements) {
+      if (!json->is_null() && !cb(*json))
+        return false;
+    }
+    return true;
   }
-  return json_elements.size() == 1 && process(json_elements[0].array_range());
+  return json_elements.size() == 1 && process(json_elements[0]->array_range());
 }
 
 }  // namespace
@@ -192,26 +196,87 @@ SearchDocData StringMapAccessor::Serialize(const search::Schema& schema) const {
 }
 
 struct JsonAccessor::JsonPathContainer {
-  vector<JsonType> Evaluate(const JsonType& json) const {
-    vector<JsonType> res;
+  void Evaluate(const JsonType& json, JsonPathValues* out) const {
+    out->values.clear();
+    out->owned.clear();
 
     visit(Overloaded{[&](const json::Path& path) {
-                       json::EvaluatePath(path, json,
-                                          [&](auto, const JsonType& v) { res.push_back(v); });
+                       // Functions return computed values that must be kept
+                       if (!path.empty() && path.front().type() == json::SegmentType::FUNCTION) {
+                         json::EvaluatePath(path, json, [&](auto, const JsonType& v) {
+                           out->owned.push_back(v);
+                         });
+                         return;
+                       }
+                       json::EvaluatePath(path, json, [&](auto, const JsonType& v) {
+                         out->values.push_back(&v);
+                       });
                      },
                      [&](const jsoncons::jsonpath::jsonpath_expression<JsonType>& path) {
                        auto json_arr = path.evaluate(json);
-                       for (const auto& v : json_arr.array_range())
-                         res.push_back(v);
+                       for (auto& v : json_arr.array_range())
+                         out->owned.push_back(std::move(v));
                      }},
           val);
 
-    return res;
+    for (const JsonType& v : out->owned)
+      out->values.push_back(&v);
   }
 
   variant<json::Path, jsoncons::jsonpath::jsonpath_expression<JsonType>> val;
 };
 
+const JsonPathValues* JsonAccessor::Evaluate(string_view field) const {
+  const auto& fields = snapshot_ ? snapshot_->fields : fields_.fields;
+  if (auto it = fields.find(field); it != fields.end())
+    return &it->second;
+  if (snapshot_)  // snapshots contain all schema fields
+    return nullptr;
+
+  auto* path = GetPath(field);
+  if (!path)
+    return nullptr;
+  path->Evaluate(*json_, &path_values_);
+  return &path_values_;
+}
+
+void JsonAccessor::EvaluateFields(const search::Schema& schema) {
+  DCHECK(json_);
+  fields_.fields.reserve(schema.fields.size());
+  for (const auto& [ident, _] : schema.fields) {
+    if (auto* path = GetPath(ident); path)
+      path->Evaluate(*json_, &fields_.fields[ident]);
+  }
+}
+
+JsonFieldsSnapshot JsonAccessor::TakeSnapshot() const {
+  JsonFieldsSnapshot snapshot;
+  snapshot.fields.reserve(fields_.fields.size());
+  for (const auto& [ident, path_values] : fields_.fields) {
+    auto& copy = snapshot.fields[ident];
+    copy.owned.reserve(path_values.values.size());
+    for (const JsonType* v : path_values.values)
+      copy.owned.push_back(*v);
+    for (const JsonType& v : copy.owned)
+      copy.values.push_back(&v);
+  }
+  return snapshot;
+}
+
+vector<string_view> JsonAccessor::ChangedFields(const JsonFieldsSnapshot& snapshot) const {
+  auto equal = [](const JsonType* l, const JsonType* r) { return *l == *r; };
+  vector<string_view> changed;
+  for (const auto& [ident, path_values] : fields_.fields) {
+    auto it = snapshot.fields.find(ident);
+    if (it == snapshot.fields.end() ||
+        !std::equal(path_values.values.begin(), path_values.values.end(),
+                    it->second.values.begin(), it->second.values.end(), equal)) {
+      changed.push_back(ident);
+    }
+  }
+  return changed;
+}
+
 std::optional<BaseAccessor::StringList> JsonAccessor::GetStrings(std::string_view field) const {
   return GetStrings(field, false);
 }
@@ -222,14 +287,11 @@ std::optional<BaseAccessor::StringList> JsonAccessor::GetTags(std::string_view a
 
 std::optional<BaseAccessor::StringList> JsonAccessor::GetStrings(std::string_view field,
                                                                  bool accept_boolean_values) const {
-  auto* path = GetPath(field);
-  if (!path)
-    return search::EmptyAccessResult<StringList>();
-
-  auto path_res = path->Evaluate(json_);
-  if (path_res.empty())
+  auto* path_values = Evaluate(field);
+  if (!path_values || path_values->values.empty())
     return search::EmptyAccessResult<StringList>();
 
+  const auto& path_res = path_values->values;
   auto is_convertible_to_string = [](bool accept_boolean_values) -> bool (*)(const JsonType& json) {
     if (accept_boolean_values) {
       return [](const JsonType& json) -> bool { return json.is_string() || json.is_bool(); };
@@ -238,13 +300,16 @@ std::optional<BaseAccessor::StringList> JsonAccessor::GetStrings(std::string_vie
     }
   }(accept_boolean_values);
 
-  if (path_res.size() == 1 && !path_res[0].is_array()) {
-    if (path_res[0].is_null())
+  if (path_res.size() == 1 && !path_res[0]->is_array()) {
+    if (path_res[0]->is_null())
       return StringList{};
-    if (!is_convertible_to_string(path_res[0]))
+    if (!is_convertible_to_string(*path_res[0]))
       return std::nullopt;
 
-    buf_ = path_res[0].as_string();
+    // Strings are referenced in place, the rest is converted
+    if (path_res[0]->is_string())
+      return StringList{path_res[0]->as_string_view()};
+    buf_ = path_res[0]->as_string();
     return StringList{buf_};
   }
 
@@ -282,22 +347,22 @@ std::optional<BaseAccessor::StringList> JsonAccessor::GetStrings(std::string_vie
 }
 
 std::optional<BaseAccessor::VectorInfo> JsonAccessor::GetVector(string_view active_field) const {
-  auto* path = GetPath(active_field);
-  if (!path)
+  auto* path_values = Evaluate(active_field);
+  if (!path_values)
     return VectorInfo{};
 
-  auto res = path->Evaluate(json_);
-  if (res.empty() || res[0].is_null())
+  const auto& res = path_values->values;
+  if (res.empty() || res[0]->is_null())
     return VectorInfo{};
 
-  if (!res[0].is_array())
+  if (!res[0]->is_array())
     return std::nullopt;
 
-  size_t size = res[0].size();
+  size_t size = res[0]->size();
   auto ptr = make_unique<float[]>(size);
 
   size_t i = 0;
-  for (const auto& v : res[0].array_range()) {
+  for (const auto& v : res[0]->array_range()) {
     if (!v.is_number()) {
       return std::nullopt;
     }
@@ -308,14 +373,11 @@ std::optional<BaseAccessor::VectorInfo> JsonAccessor::GetVector(string_view acti
 }
 
 std::optional<BaseAccessor::NumsList> JsonAccessor::GetNumbers(string_view active_field) const {
-  auto* path = GetPath(active_field);
-  if (!path)
-    return search::EmptyAccessResult<NumsList>();
-
-  auto path_res = path->Evaluate(json_);
-  if (path_res.empty())
+  auto* path_values = Evaluate(active_field);
+  if (!path_values || path_values->values.empty())
     return search::EmptyAccessResult<NumsList>();
 
+  const auto& path_res = path_values->values;
   NumsList nums_list;
   nums_list.reserve(path_res.size());
 
@@ -375,9 +437,9 @@ SearchDocData JsonAccessor::Serialize(const search::Schema& schema,
   SearchDocData out{};
   for (const auto& field : fields) {
     string_view ident = field.Identifier(schema, true);
-    if (auto* path = GetPath(ident); path) {
-      if (auto res = path->Evaluate(json_); !res.empty()) {
-        auto field_value = ExtractSortableValueFromJson(schema, ident, res[0]);
+    if (auto* path_values = Evaluate(ident); path_values) {
+      if (const auto& res = path_values->values; !res.empty()) {
+        auto field_value = ExtractSortableValueFromJson(schema, ident, *res[0]);
         if (field_value) {
           out[field.OutputName()] = std::move(field_value).value();
         }
@@ -388,7 +450,8 @@ SearchDocData JsonAccessor::Serialize(const search::Schema& schema,
 }
 
 SearchDocData JsonAccessor::Serialize(const search::Schema& schema) const {
-  return {{"$", json_.to_string()}};
+  DCHECK(json_);
+  return {{"$", json_->to_string()}};
 }
 
 void JsonAccessor::RemoveFieldFromCache(string_view field) {
@@ -9,6 +9,7 @@
 
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "core/json/json_object.h"
 #include "core/search/search.h"
@@ -65,11 +66,32 @@ struct StringMapAccessor : public BaseAccessor {
   StringMap* hset_;
 };
 
+// Values matched by a json path. They point into the document, except for values computed by
+// the path, like legacy jsonpath results or functions, and values of snapshots, kept in owned.
+struct JsonPathValues {
+  // Move only, a copy would point into the owned values of the original
+  JsonPathValues() = default;
+  JsonPathValues(JsonPathValues&&) = default;
+  JsonPathValues& operator=(JsonPathValues&&) = default;
+
+  std::vector<const JsonType*> values;
+  std::vector<JsonType> owned;
+};
+
+// Values of schema fields by identifier, copied out of a document before it's modified.
+struct JsonFieldsSnapshot {
+  absl::flat_hash_map<std::string, JsonPathValues> fields;
+};
+
 // Accessor for json values
 struct JsonAccessor : public BaseAccessor {
   struct JsonPathContainer;  // contains jsoncons::jsonpath::jsonpath_expression
 
-  explicit JsonAccessor(const JsonType* json) : json_{*json} {
+  explicit JsonAccessor(const JsonType* json) : json_{json} {
+  }
+
+  // Accessor over the values of a snapshot, which must outlive it.
+  explicit JsonAccessor(const JsonFieldsSnapshot* snapshot) : snapshot_{snapshot} {
   }
 
   std::optional<StringList> GetStrings(std::string_view field) const override;
@@ -82,6 +104,16 @@ struct JsonAccessor : public BaseAccessor {
                           absl::Span<const FieldReference> fields) const override;
   SearchDocData Serialize(const search::Schema& schema) const override;
 
+  // Evaluates the paths of all schema fields at once and keeps their values for the following
+  // accesses, so the index and sort index of a field don't evaluate its path again.
+  void EvaluateFields(const search::Schema& schema);
+
+  // Copies the values of the fields evaluated by EvaluateFields.
+  JsonFieldsSnapshot TakeSnapshot() const;
+
+  // Returns the identifiers of the evaluated fields whose values differ from the snapshot.
+  std::vector<std::string_view> ChangedFields(const JsonFieldsSnapshot& snapshot) const;
+
   static void RemoveFieldFromCache(std::string_view field);
 
  private:
@@ -91,7 +123,14 @@ struct JsonAccessor : public BaseAccessor {
   /// Parses `field` into a JSON path. Caches the results internally.
   JsonPathContainer* GetPath(std::string_view field) const;
 
-  const JsonType& json_;
+  // Returns the values of the field, nullptr if it's not a valid path. Values of fields that
+  // were not evaluated ahead are only valid until the next call.
+  const JsonPathValues* Evaluate(std::string_view field) const;
+
+  const JsonType* json_ = nullptr;
+  const JsonFieldsSnapshot* snapshot_ = nullptr;
+  JsonFieldsSnapshot fields_;  // see EvaluateFields
+  mutable JsonPathValues path_values_;
   mutable std::string buf_;
 
   // Contains built json paths to avoid parsing them repeatedly
@@ -4,12 +4,15 @@
 
 #include "server/search/doc_index.h"
 
+#include <absl/flags/flag.h>
 #include <absl/strings/str_join.h>
 
+#include <cstring>
 #include <memory>
 #include <queue>
 
 #include "absl/strings/str_cat.h"
+#include "base/cycle_clock.h"
 #include "base/logging.h"
 #include "core/overloaded.h"
 #include "core/search/indices.h"
@@ -18,22 +21,40 @@
 #include "server/search/doc_accessors.h"
 #include "server/server_state.h"
 
+ABSL_FLAG(bool, search_background_indexing, false,
+          "Index existing documents of new search indices in a background fiber instead of "
+          "blocking the shard until FT.CREATE finishes");
+ABSL_FLAG(uint32_t, search_index_build_slice_usec, 200,
+          "Maximal time a background index build runs before yielding to other work");
+ABSL_FLAG(uint64_t, search_result_cache_bytes, 0,
+          "Memory limit of the FT.SEARCH and FT.AGGREGATE result cache of every index on each "
+          "shard. 0 disables caching");
+ABSL_FLAG(bool, search_persist_hnsw, false,
+          "Save HNSW graphs of vector fields in DF snapshots, so that loading them with the same "
+          "number of shards doesn't insert all vectors again. Requires as much memory as the "
+          "graphs during saving");
+
 namespace dfly {
 
 using namespace std;
 using facade::ErrorReply;
 using nonstd::make_unexpected;
+using util::fb2::ThisFiber;
 
 namespace {
 
-template <typename F>
-void TraverseAllMatching(const DocIndex& index, const OpArgs& op_args, F&& f) {
+// Traverse the table buckets at cursor and call f for the matching documents, returns the
+// cursor of the next buckets. Calls visit for every entry, matching or not.
+template <typename F, typename V>
+PrimeTable::Cursor TraverseMatching(const DocIndex& index, const OpArgs& op_args,
+                                    PrimeTable::Cursor cursor, F&& f, V&& visit) {
   auto& db_slice = op_args.GetDbSlice();
   DCHECK(db_slice.IsDbValid(op_args.db_cntx.db_index));
   auto [prime_table, _] = db_slice.GetTables(op_args.db_cntx.db_index);
 
   string scratch;
   auto cb = [&](PrimeTable::iterator it) {
+    visit();
     const PrimeValue& pv = it->second;
     if (pv.ObjType() != index.GetObjCode())
       return;
@@ -46,12 +67,41 @@ void TraverseAllMatching(const DocIndex& index, const OpArgs& op_args, F&& f) {
     f(key, *accessor);
   };
 
+  return prime_table->Traverse(cursor, cb);
+}
+
+template <typename F>
+void TraverseAllMatching(const DocIndex& index, const OpArgs& op_args, F&& f) {
   PrimeTable::Cursor cursor;
   do {
-    cursor = prime_table->Traverse(cursor, cb);
+    cursor = TraverseMatching(index, op_args, cursor, f, [] {});
   } while (cursor);
 }
 
+size_t ResultBytes(const SearchDocData& doc) {
+  size_t bytes = sizeof(doc) + doc.capacity() * sizeof(SearchDocData::value_type);
+  for (const auto& [field, value] : doc) {
+    bytes += field.capacity();
+    if (const auto* str = get_if<string>(&value); str)
+      bytes += str->capacity();
+  }
+  return bytes;
+}
+
+size_t ResultBytes(const vector<SearchDocData>& docs) {
+  size_t bytes = sizeof(docs);
+  for (const auto& doc : docs)
+    bytes += ResultBytes(doc);
+  return bytes;
+}
+
+size_t ResultBytes(const SearchResult& result) {
+  size_t bytes = sizeof(result);
+  for (const auto& doc : result.docs)
+    bytes += sizeof(doc) + doc.key.capacity() + ResultBytes(doc.values);
+  return bytes;
+}
+
 bool IsSortableField(std::string_view field_identifier, const search::Schema& schema) {
   auto it = schema.fields.find(field_identifier);
   return it != schema.fields.end() && (it->second.flags & search::SchemaField::SORTABLE);
@@ -94,6 +144,43 @@ std::pair<std::vector<FieldReference>, SortIndiciesFieldsList> PreprocessAggrega
   return {std::move(fields), {sort_indicies_aliases.begin(), sort_indicies_aliases.end()}};
 }
 
+vector<pair<string_view, search::HnswVectorIndex*>> HnswIndices(
+    const DocIndex& base, const search::FieldIndices& indices) {
+  vector<pair<string_view, search::HnswVectorIndex*>> out;
+  for (const auto& [ident, _] : base.schema.fields) {
+    if (auto* hnsw = dynamic_cast<search::HnswVectorIndex*>(indices.GetIndex(ident)); hnsw)
+      out.emplace_back(ident, hnsw);
+  }
+  return out;
+}
+
+// Serialized graphs consist of sizes and size prefixed strings
+void AppendSize(uint64_t size, string* out) {
+  out->append(reinterpret_cast<const char*>(&size), sizeof(size));
+}
+
+void AppendString(string_view str, string* out) {
+  AppendSize(str.size(), out);
+  out->append(str);
+}
+
+bool ReadSize(string_view* in, uint64_t* size) {
+  if (in->size() < sizeof(*size))
+    return false;
+  memcpy(size, in->data(), sizeof(*size));
+  in->remove_prefix(sizeof(*size));
+  return true;
+}
+
+bool ReadString(string_view* in, string_view* str) {
+  uint64_t size;
+  if (!ReadSize(in, &size) || in->size() < size)
+    return false;
+  *str = in->substr(0, size);
+  in->remove_prefix(size);
+  return true;
+}
+
 }  // namespace
 
 bool FieldReference::IsJsonPath(std::string_view name) {
@@ -149,8 +236,15 @@ string DocIndexInfo::BuildRestoreCommand() const {
         [](monostate) {},
         [out = &out](const search::SchemaField::VectorParams& params) {
           auto sim = params.sim == search::VectorSimilarity::L2 ? "L2" : "COSINE";
-          absl::StrAppend(out, " ", params.use_hnsw ? "HNSW" : "FLAT", " 6 ", "DIM ", params.dim,
-                          " DISTANCE_METRIC ", sim, " INITIAL_CAP ", params.capacity);
+          bool quantized = params.quantization != search::VectorQuantization::NONE;
+          absl::StrAppend(out, " ", params.use_hnsw ? "HNSW" : "FLAT", quantized ? " 8 " : " 6 ",
+                          "DIM ", params.dim, " DISTANCE_METRIC ", sim, " INITIAL_CAP ",
+                          params.capacity);
+          if (quantized) {
+            auto type =
+                params.quantization == search::VectorQuantization::INT8 ? "INT8" : "FLOAT16";
+            absl::StrAppend(out, " QUANTIZATION ", type);
+          }
         },
         [out = &out](const search::SchemaField::TagParams& params) {
           absl::StrAppend(out, " ", "SEPARATOR", " ", string{params.separator});
@@ -216,6 +310,29 @@ string_view ShardDocIndex::DocKeyIndex::Get(DocId id) const {
   return keys_[id];
 }
 
+optional<ShardDocIndex::DocId> ShardDocIndex::DocKeyIndex::Find(string_view key) const {
+  auto it = ids_.find(key);
+  if (it == ids_.end())
+    return nullopt;
+  return it->second;
+}
+
+void ShardDocIndex::DocKeyIndex::Restore(vector<string> keys) {
+  DCHECK(ids_.empty());
+  keys_ = std::move(keys);
+  last_id_ = keys_.size();
+  for (DocId id = 0; id < keys_.size(); id++) {
+    if (keys_[id].empty())
+      free_ids_.push_back(id);
+    else
+      ids_[keys_[id]] = id;
+  }
+}
+
+bool ShardDocIndex::DocKeyIndex::Contains(string_view key) const {
+  return ids_.contains(key);
+}
+
 size_t ShardDocIndex::DocKeyIndex::Size() const {
   return ids_.size();
 }
@@ -228,31 +345,204 @@ bool DocIndex::Matches(string_view key, unsigned obj_code) const {
   return obj_code == GetObjCode() && key.rfind(prefix, 0) == 0;
 }
 
+const SearchResultCache::Value* SearchResultCache::Get(string_view key, uint64_t version) {
+  auto it = entries_.find(key);
+  if (it == entries_.end() || it->second->version != version) {
+    if (it != entries_.end())
+      Erase(it->second);
+    misses_++;
+    return nullptr;
+  }
+
+  hits_++;
+  lru_.splice(lru_.begin(), lru_, it->second);
+  return &lru_.front().value;
+}
+
+void SearchResultCache::Put(string_view key, uint64_t version, Value value, size_t limit) {
+  size_t bytes = key.size() + visit([](const auto& v) { return ResultBytes(v); }, value);
+  if (bytes > limit)
+    return;
+
+  if (auto it = entries_.find(key); it != entries_.end())
+    Erase(it->second);
+
+  lru_.push_front({string{key}, version, bytes, std::move(value)});
+  entries_.emplace(lru_.front().key, lru_.begin());
+  bytes_ += bytes;
+
+  while (bytes_ > limit)
+    Erase(prev(lru_.end()));
+}
+
+void SearchResultCache::Erase(list<Entry>::iterator it) {
+  bytes_ -= it->bytes;
+  entries_.erase(it->key);
+  lru_.erase(it);
+}
+
 ShardDocIndex::ShardDocIndex(shared_ptr<const DocIndex> index)
     : base_{std::move(index)}, key_index_{} {
 }
 
+ShardDocIndex::~ShardDocIndex() {
+  CancelBuild();
+}
+
 void ShardDocIndex::Rebuild(const OpArgs& op_args, PMR_NS::memory_resource* mr) {
+  CancelBuild();
+  version_++;
   key_index_ = DocKeyIndex{};
   indices_.emplace(base_->schema, base_->options, mr, &synonyms_);
 
-  auto cb = [this](string_view key, const BaseAccessor& doc) {
-    DocId id = key_index_.Add(key);
+  bool restored = false;
+  if (string data = std::exchange(restored_graphs_, {}); !data.empty()) {
+    restored = RestoreGraphs(data);
+    if (!restored) {
+      LOG(WARNING) << "Failed to restore HNSW graphs of " << base_->prefix << ", rebuilding";
+      key_index_ = DocKeyIndex{};
+      indices_.emplace(base_->schema, base_->options, mr, &synonyms_);
+    }
+  }
+
+  // Restored keys keep their ids, the ones that are not found again are removed afterwards
+  vector<bool> found(restored ? key_index_.Keys().size() : 0);
+  auto cb = [&](string_view key, const BaseAccessor& doc) {
+    optional<DocId> restored_id = restored ? key_index_.Find(key) : nullopt;
+    DocId id = restored_id ? *restored_id : key_index_.Add(key);
     if (!indices_->Add(id, doc)) {
       key_index_.Remove(key);
+    } else if (id < found.size()) {
+      found[id] = true;
     }
   };
 
   TraverseAllMatching(*base_, op_args, cb);
 
+  if (restored) {
+    for (DocId id = 0; id < found.size(); id++) {
+      if (!found[id] && !key_index_.Keys()[id].empty())
+        key_index_.Remove(string{key_index_.Keys()[id]});
+    }
+    for (auto [_, hnsw] : HnswIndices(*base_, *indices_))
+      hnsw->FinishRestore();
+  }
+
   VLOG(1) << "Indexed " << key_index_.Size() << " docs on " << base_->prefix;
 }
 
+// Layout: number of keys, keys by id, then pairs of field identifier and graph
+string ShardDocIndex::SerializeGraphs() const {
+  if (!indices_ || building_)
+    return {};
+
+  auto hnsw_indices = HnswIndices(*base_, *indices_);
+  if (hnsw_indices.empty())
+    return {};
+
+  string out;
+  AppendSize(key_index_.Keys().size(), &out);
+  for (const string& key : key_index_.Keys())
+    AppendString(key, &out);
+  for (auto [ident, hnsw] : hnsw_indices) {
+    AppendString(ident, &out);
+    AppendString(hnsw->Serialize(), &out);
+  }
+  return out;
+}
+
+bool ShardDocIndex::RestoreGraphs(string_view data) {
+  uint64_t num_keys;
+  if (!ReadSize(&data, &num_keys) || num_keys > data.size() / sizeof(uint64_t))
+    return false;
+
+  string_view str;
+  vector<string> keys(num_keys);
+  for (auto& key : keys) {
+    if (!ReadString(&data, &str))
+      return false;
+    key = str;
+  }
+
+  auto hnsw_indices = HnswIndices(*base_, *indices_);
+  size_t num_restored = 0;
+  string_view ident, graph;
+  while (ReadString(&data, &ident) && ReadString(&data, &graph)) {
+    auto it = find_if(hnsw_indices.begin(), hnsw_indices.end(),
+                      [ident](const auto& entry) { return entry.first == ident; });
+    if (it == hnsw_indices.end() || !it->second->Restore(graph))
+      return false;
+    num_restored++;
+  }
+
+  if (!data.empty() || num_restored != hnsw_indices.size())
+    return false;
+
+  key_index_.Restore(std::move(keys));
+  return true;
+}
+
+void ShardDocIndex::StartBuild(const OpArgs& op_args, PMR_NS::memory_resource* mr) {
+  CancelBuild();
+  version_++;
+  key_index_ = DocKeyIndex{};
+  indices_.emplace(base_->schema, base_->options, mr, &synonyms_);
+
+  auto [prime_table, _] = op_args.GetDbSlice().GetTables(op_args.db_cntx.db_index);
+  building_ = true;
+  build_cancelled_ = false;
+  build_traversed_ = 0;
+  build_total_ = prime_table->size();
+
+  auto cb = [this, shard = op_args.shard, db_cntx = op_args.db_cntx] { BuildFb(shard, db_cntx); };
+  build_fb_ = util::fb2::Fiber(absl::StrCat("index_build/", base_->prefix), std::move(cb));
+}
+
+void ShardDocIndex::BuildFb(EngineShard* shard, DbContext db_cntx) {
+  const uint64_t slice_cycles =
+      base::CycleClock::Frequency() * absl::GetFlag(FLAGS_search_index_build_slice_usec) / 1000000;
+
+  // Documents written after the build started were already indexed by AddDoc
+  auto cb = [this](string_view key, const BaseAccessor& doc) {
+    if (key_index_.Contains(key))
+      return;
+    DocId id = key_index_.Add(key);
+    if (!indices_->Add(id, doc))
+      key_index_.Remove(key);
+  };
+  auto visit = [this] { build_traversed_++; };
+
+  PrimeTable::Cursor cursor;
+  do {
+    // Flushes replace the table while we yield, their index drop cancels the build
+    db_cntx.time_now_ms = GetCurrentTimeMs();
+    OpArgs op_args{shard, nullptr, db_cntx};
+    if (!op_args.GetDbSlice().IsDbValid(db_cntx.db_index))
+      break;
+
+    do {
+      cursor = TraverseMatching(*base_, op_args, cursor, cb, visit);
+    } while (cursor && ThisFiber::GetRunningTimeCycles() < slice_cycles);
+
+    if (cursor)
+      ThisFiber::Yield();
+  } while (cursor && !build_cancelled_);
+
+  building_ = false;
+  VLOG(1) << "Indexed " << key_index_.Size() << " docs on " << base_->prefix << " in background";
+}
+
+void ShardDocIndex::CancelBuild() {
+  build_cancelled_ = true;
+  build_fb_.JoinIfNeeded();
+}
+
 void ShardDocIndex::RebuildForGroup(const OpArgs& op_args, const std::string_view& group_id,
                                     const std::vector<std::string_view>& terms) {
   if (!indices_)
     return;
 
+  version_++;
   absl::flat_hash_set<DocId> docs_to_rebuild;
   std::vector<search::TextIndex*> text_indices = indices_->GetAllTextIndices();
 
@@ -299,6 +589,7 @@ void ShardDocIndex::AddDoc(string_view key, const DbContext& db_cntx, const Prim
   if (!indices_)
     return;
 
+  version_++;
   auto accessor = GetAccessor(db_cntx, pv);
   DocId id = key_index_.Add(key);
   if (!indices_->Add(id, *accessor)) {
@@ -310,6 +601,7 @@ void ShardDocIndex::RemoveDoc(string_view key, const DbContext& db_cntx, const P
   if (!indices_)
     return;
 
+  version_++;
   auto accessor = GetAccessor(db_cntx, pv);
   auto id = key_index_.Remove(key);
   if (id) {
@@ -317,6 +609,36 @@ void ShardDocIndex::RemoveDoc(string_view key, const DbContext& db_cntx, const P
   }
 }
 
+bool ShardDocIndex::SnapshotDoc(string_view key, const PrimeValue& pv,
+                                JsonFieldsSnapshot* snapshot) const {
+  if (!indices_ || !key_index_.Contains(key))
+    return false;
+
+  JsonAccessor accessor{pv.GetJson()};
+  accessor.EvaluateFields(base_->schema);
+  *snapshot = accessor.TakeSnapshot();
+  return true;
+}
+
+void ShardDocIndex::UpdateDoc(string_view key, const PrimeValue& pv,
+                              const JsonFieldsSnapshot& snapshot) {
+  DCHECK(indices_);
+  auto id = key_index_.Find(key);
+  DCHECK(id);
+
+  // The document changed even if its indexed fields didn't, so cached results are dropped
+  version_++;
+  JsonAccessor accessor{pv.GetJson()};
+  accessor.EvaluateFields(base_->schema);
+  auto changed = accessor.ChangedFields(snapshot);
+  if (changed.empty())
+    return;
+
+  JsonAccessor old_accessor{&snapshot};
+  if (!indices_->Update(*id, old_accessor, accessor, changed))
+    key_index_.Remove(key);
+}
+
 bool ShardDocIndex::Matches(string_view key, unsigned obj_code) const {
   return base_->Matches(key, obj_code);
 }
@@ -329,6 +651,7 @@ optional<ShardDocIndex::LoadedEntry> ShardDocIndex::LoadEntry(DocId id,
   if (!it || !IsValid(*it))
     return std::nullopt;
 
+  loaded_expiring_ |= (*it)->second.HasExpire();
   return {{key, GetAccessor(op_args.db_cntx, (*it)->second)}};
 }
 
@@ -373,8 +696,32 @@ vector<search::SortableValue> ShardDocIndex::KeepTopKSorted(vector<DocId>* ids,
   return out;
 }
 
+SearchResultCache* ShardDocIndex::GetCache(string_view cache_key) const {
+  // Documents are added to the index without version changes during background builds
+  if (cache_key.empty() || building_ || absl::GetFlag(FLAGS_search_result_cache_bytes) == 0)
+    return nullptr;
+  loaded_expiring_ = false;
+  return &cache_;
+}
+
 SearchResult ShardDocIndex::Search(const OpArgs& op_args, const SearchParams& params,
-                                   search::SearchAlgorithm* search_algo) const {
+                                   search::SearchAlgorithm* search_algo,
+                                   string_view cache_key) const {
+  auto* cache = GetCache(cache_key);
+  if (!cache)
+    return DoSearch(op_args, params, search_algo);
+
+  if (auto* hit = cache->Get(cache_key, version_); hit)
+    return get<SearchResult>(*hit);
+
+  auto result = DoSearch(op_args, params, search_algo);
+  if (!result.error && !loaded_expiring_)
+    cache->Put(cache_key, version_, result, absl::GetFlag(FLAGS_search_result_cache_bytes));
+  return result;
+}
+
+SearchResult ShardDocIndex::DoSearch(const OpArgs& op_args, const SearchParams& params,
+                                     search::SearchAlgorithm* search_algo) const {
   size_t limit = params.limit_offset + params.limit_total;
   auto result = search_algo->Search(&*indices_);
   if (!result.error.empty())
@@ -435,28 +782,113 @@ SearchResult ShardDocIndex::Search(const OpArgs& op_args, const SearchParams& pa
       continue;
     }
 
-    auto entry = LoadEntry(result.ids[i], op_args);
-    if (!entry) {
+    auto doc = SerializeDoc(result.ids[i], op_args, params, return_fields, knn_score,
+                            std::move(sort_score));
+    if (!doc) {
       expired_count++;
       continue;
     }
+    out.push_back(std::move(*doc));
+  }
 
-    auto& [key, accessor] = *entry;
+  return {result.total - expired_count, std::move(out), std::move(result.profile)};
+}
 
-    // Load all specified fields from document
-    SearchDocData fields{};
-    if (params.ShouldReturnAllFields())
-      fields = accessor->Serialize(base_->schema);
+SearchResult ShardDocIndex::SearchKnnScores(const OpArgs& op_args, const SearchParams& params,
+                                            search::SearchAlgorithm* search_algo) const {
+  auto result = search_algo->Search(&*indices_);
+  if (!result.error.empty())
+    return {facade::ErrorReply(std::move(result.error))};
+
+  DCHECK_EQ(result.ids.size(), result.knn_scores.size());
+
+  // Matches are already ordered by knn score, only check that they haven't expired. Loading an
+  // entry is cheap compared to serializing it, which is left for the few global winners.
+  size_t limit = params.limit_offset + params.limit_total;
+  SearchResult out{result.total, {}, std::move(result.profile)};
+  out.knn_scores.reserve(min(limit, result.ids.size()));
 
-    auto more_fields = accessor->Serialize(base_->schema, return_fields);
-    fields.insert(make_move_iterator(more_fields.begin()), make_move_iterator(more_fields.end()));
-    out.push_back({string{key}, std::move(fields), knn_score, sort_score});
+  size_t expired_count = 0;
+  for (size_t i = 0; i < result.ids.size() && out.knn_scores.size() < limit; i++) {
+    if (!LoadEntry(result.ids[i], op_args)) {
+      expired_count++;
+      continue;
+    }
+    out.knn_scores.emplace_back(result.ids[i], result.knn_scores[i].second);
   }
 
-  return {result.total - expired_count, std::move(out), std::move(result.profile)};
+  out.total_hits -= expired_count;
+  return out;
+}
+
+vector<SerializedSearchDoc> ShardDocIndex::LoadKnnDocs(
+    const OpArgs& op_args, const SearchParams& params,
+    absl::Span<const pair<DocId, float>> docs) const {
+  auto return_fields = params.return_fields.value_or(vector<FieldReference>{});
+
+  vector<SerializedSearchDoc> out;
+  out.reserve(docs.size());
+  for (auto [id, score] : docs) {
+    if (auto doc = SerializeDoc(id, op_args, params, return_fields, score, std::monostate{}); doc)
+      out.push_back(std::move(*doc));
+  }
+  return out;
+}
+
+optional<SerializedSearchDoc> ShardDocIndex::SerializeDoc(
+    DocId id, const OpArgs& op_args, const SearchParams& params,
+    const vector<FieldReference>& return_fields, float knn_score,
+    search::SortableValue sort_score) const {
+  auto entry = LoadEntry(id, op_args);
+  if (!entry)
+    return nullopt;
+
+  auto& [key, accessor] = *entry;
+
+  // Load all specified fields from document
+  SearchDocData fields{};
+  if (params.ShouldReturnAllFields())
+    fields = accessor->Serialize(base_->schema);
+
+  auto more_fields = accessor->Serialize(base_->schema, return_fields);
+  fields.insert(make_move_iterator(more_fields.begin()), make_move_iterator(more_fields.end()));
+  return SerializedSearchDoc{string{key}, std::move(fields), knn_score, std::move(sort_score)};
+}
+
+vector<SearchDocData> ShardDocIndex::SearchForAggregator(const OpArgs& op_args,
+                                                         const AggregateParams& params,
+                                                         search::SearchAlgorithm* search_algo,
+                                                         string_view cache_key) const {
+  auto* cache = GetCache(cache_key);
+  if (!cache)
+    return DoSearchForAggregator(op_args, params, search_algo);
+
+  if (auto* hit = cache->Get(cache_key, version_); hit)
+    return get<vector<SearchDocData>>(*hit);
+
+  auto result = DoSearchForAggregator(op_args, params, search_algo);
+  if (!loaded_expiring_)
+    cache->Put(cache_key, version_, result, absl::GetFlag(FLAGS_search_result_cache_bytes));
+  return result;
+}
+
+aggregate::PartialGroups ShardDocIndex::GroupForAggregator(const OpArgs& op_args,
+                                                           const AggregateParams& params,
+                                                           search::SearchAlgorithm* search_algo,
+                                                           string_view cache_key) const {
+  DCHECK(params.shard_group);
+  auto docs = SearchForAggregator(op_args, params, search_algo, cache_key);
+
+  // Keys of values point to the keys of docs
+  vector<aggregate::DocValues> values(docs.size());
+  for (size_t i = 0; i < docs.size(); i++) {
+    for (auto& [field, value] : docs[i])
+      values[i][field] = std::move(value);
+  }
+  return aggregate::GroupPartially(std::move(values), *params.shard_group);
 }
 
-vector<SearchDocData> ShardDocIndex::SearchForAggregator(
+vector<SearchDocData> ShardDocIndex::DoSearchForAggregator(
     const OpArgs& op_args, const AggregateParams& params,
     search::SearchAlgorithm* search_algo) const {
   auto search_results = search_algo->Search(&*indices_);
@@ -491,7 +923,12 @@ vector<SearchDocData> ShardDocIndex::SearchForAggregator(
 }
 
 DocIndexInfo ShardDocIndex::GetInfo() const {
-  return {*base_, key_index_.Size()};
+  DocIndexInfo info{*base_, key_index_.Size()};
+  info.cache_hits = cache_.hits();
+  info.cache_misses = cache_.misses();
+  if (building_)
+    info.indexed_fraction = min(1.0, double(build_traversed_) / max<size_t>(build_total_, 1));
+  return info;
 }
 
 io::Result<StringVec, ErrorReply> ShardDocIndex::GetTagVals(string_view field) const {
@@ -523,8 +960,12 @@ void ShardDocIndices::InitIndex(const OpArgs& op_args, std::string_view name,
 
   // Don't build while loading, shutting down, etc.
   // After loading, indices are rebuilt separately
-  if (ServerState::tlocal()->gstate() == GlobalState::ACTIVE)
-    it->second->Rebuild(op_args, &local_mr_);
+  if (ServerState::tlocal()->gstate() == GlobalState::ACTIVE) {
+    if (absl::GetFlag(FLAGS_search_background_indexing))
+      it->second->StartBuild(op_args, &local_mr_);
+    else
+      it->second->Rebuild(op_args, &local_mr_);
+  }
 
   op_args.GetDbSlice().SetDocDeletionCallback(
       [this](string_view key, const DbContext& cntx, const PrimeValue& pv) {
@@ -561,6 +1002,32 @@ void ShardDocIndices::RebuildAllIndices(const OpArgs& op_args) {
     ptr->Rebuild(op_args, &local_mr_);
 }
 
+vector<string> ShardDocIndices::SerializeGraphs() const {
+  vector<string> out;
+  if (!absl::GetFlag(FLAGS_search_persist_hnsw))
+    return out;
+
+  for (const auto& [name, ptr] : indices_) {
+    if (string graphs = ptr->SerializeGraphs(); !graphs.empty()) {
+      out.emplace_back();
+      AppendString(name, &out.back());
+      out.back().append(graphs);
+    }
+  }
+  return out;
+}
+
+void ShardDocIndices::SetRestoredGraphs(string data) {
+  string_view rest = data, name;
+  if (!ReadString(&rest, &name)) {
+    LOG(ERROR) << "Malformed search graphs";
+    return;
+  }
+
+  if (auto it = indices_.find(name); it != indices_.end())
+    it->second->SetRestoredGraphs(string{rest});
+}
+
 vector<string> ShardDocIndices::GetIndexNames() const {
   vector<string> names{};
   names.reserve(indices_.size());
@@ -585,6 +1052,51 @@ void ShardDocIndices::RemoveDoc(string_view key, const DbContext& db_cntx, const
   }
 }
 
+DocSnapshot::DocSnapshot() = default;
+DocSnapshot::~DocSnapshot() = default;
+DocSnapshot::DocSnapshot(DocSnapshot&&) noexcept = default;
+DocSnapshot& DocSnapshot::operator=(DocSnapshot&&) noexcept = default;
+
+DocSnapshot ShardDocIndices::SnapshotDoc(string_view key, const PrimeValue& pv) const {
+  DCHECK_EQ(pv.ObjType(), OBJ_JSON);
+  DocSnapshot snapshot;
+  for (const auto& [_, index] : indices_) {
+    if (!index->Matches(key, pv.ObjType()))
+      continue;
+    auto fields = make_unique<JsonFieldsSnapshot>();
+    if (index->SnapshotDoc(key, pv, fields.get()))
+      snapshot.entries_.emplace_back(index.get(), std::move(fields));
+  }
+  return snapshot;
+}
+
+void ShardDocIndices::UpdateDoc(string_view key, const DbContext& db_cntx, const PrimeValue& pv,
+                                const DocSnapshot& snapshot) {
+  DCHECK_EQ(pv.ObjType(), OBJ_JSON);
+  for (auto& [_, index] : indices_) {
+    if (!index->Matches(key, pv.ObjType()))
+      continue;
+    auto it = find_if(snapshot.entries_.begin(), snapshot.entries_.end(),
+                      [&](const auto& entry) { return entry.first == index.get(); });
+    if (it != snapshot.entries_.end())
+      index->UpdateDoc(key, pv, *it->second);
+    else
+      index->AddDoc(key, db_cntx, pv);
+  }
+}
+
+void ShardDocIndices::OnExpireSet(const PrimeKey& key) {
+  if (indices_.empty())
+    return;
+
+  string scratch;
+  string_view key_view = key.GetSlice(&scratch);
+  for (auto& [_, index] : indices_) {
+    if (key_view.rfind(index->base_->prefix, 0) == 0)
+      index->version_++;
+  }
+}
+
 size_t ShardDocIndices::GetUsedMemory() const {
   return local_mr_.used();
 }
@@ -7,11 +7,14 @@
 #include <absl/container/flat_hash_map.h>
 #include <absl/container/flat_hash_set.h>
 #include <absl/strings/match.h>
+#include <absl/types/span.h>
 
+#include <list>
 #include <memory>
 #include <optional>
 #include <string>
 #include <utility>
+#include <variant>
 #include <vector>
 
 #include "base/pmr/memory_resource.h"
@@ -26,6 +29,7 @@
 namespace dfly {
 
 struct BaseAccessor;
+struct JsonFieldsSnapshot;
 
 using SearchDocData = absl::flat_hash_map<std::string /*field*/, search::SortableValue /*value*/>;
 using Synonyms = search::Synonyms;
@@ -54,6 +58,9 @@ struct SearchResult {
   std::vector<SerializedSearchDoc> docs;
   std::optional<search::AlgorithmProfile> profile;
 
+  // Ids and scores of the best knn matches, filled instead of docs by SearchKnnScores
+  std::vector<std::pair<search::DocId, float>> knn_scores;
+
   std::optional<facade::ErrorReply> error;
 };
 
@@ -128,6 +135,9 @@ struct AggregateParams {
 
   std::optional<std::vector<FieldReference>> load_fields;
   std::vector<aggregate::AggregationStep> steps;
+
+  // First GROUPBY if it can be computed on shards, it precedes all steps
+  std::optional<aggregate::GroupParams> shard_group;
 };
 
 // Stores basic info about a document index.
@@ -150,12 +160,55 @@ struct DocIndexInfo {
   DocIndex base_index;
   size_t num_docs = 0;
 
+  // Progress of a background build, 1 once all existing documents were indexed
+  double indexed_fraction = 1.0;
+
+  size_t cache_hits = 0;
+  size_t cache_misses = 0;
+
   // Build original ft.create command that can be used to re-create this index
   std::string BuildRestoreCommand() const;
 };
 
 class ShardDocIndices;
 
+// Cache of search results of a shard index keyed by the command arguments. Entries remember the
+// mutation version of the index they were computed on and are dropped on access once it changed.
+// The least recently used entries are evicted to stay within the byte limit.
+class SearchResultCache {
+ public:
+  using Value = std::variant<SearchResult, std::vector<SearchDocData>>;
+
+  // Returns nullptr on miss
+  const Value* Get(std::string_view key, uint64_t version);
+
+  void Put(std::string_view key, uint64_t version, Value value, size_t limit);
+
+  size_t hits() const {
+    return hits_;
+  }
+
+  size_t misses() const {
+    return misses_;
+  }
+
+ private:
+  struct Entry {
+    std::string key;
+    uint64_t version;
+    size_t bytes;
+    Value value;
+  };
+
+  void Erase(std::list<Entry>::iterator it);
+
+  std::list<Entry> lru_;  // most recently used first
+  absl::flat_hash_map<std::string_view, std::list<Entry>::iterator> entries_;
+  size_t bytes_ = 0;
+  size_t hits_ = 0;
+  size_t misses_ = 0;
+};
+
 // Stores internal search indices for documents of a document index on a specific shard.
 class ShardDocIndex {
   friend class ShardDocIndices;
@@ -167,8 +220,16 @@ class ShardDocIndex {
     std::optional<DocId> Remove(std::string_view key);
 
     std::string_view Get(DocId id) const;
+    std::optional<DocId> Find(std::string_view key) const;
+    bool Contains(std::string_view key) const;
     size_t Size() const;
 
+    // Keys by id, empty for free ids. Restoring them assigns the same ids to the same keys.
+    const std::vector<std::string>& Keys() const {
+      return keys_;
+    }
+    void Restore(std::vector<std::string> keys);
+
    private:
     absl::flat_hash_map<std::string, DocId> ids_;
     std::vector<std::string> keys_;
@@ -179,15 +240,34 @@ class ShardDocIndex {
  public:
   // Index must be rebuilt at least once after intialization
   ShardDocIndex(std::shared_ptr<const DocIndex> index);
+  ~ShardDocIndex();
 
-  // Perform search on all indexed documents and return results.
+  // Perform search on all indexed documents and return results. Results are cached under
+  // cache_key if it's not empty and the result cache is enabled.
   SearchResult Search(const OpArgs& op_args, const SearchParams& params,
-                      search::SearchAlgorithm* search_algo) const;
+                      search::SearchAlgorithm* search_algo, std::string_view cache_key = {}) const;
+
+  // First phase of a knn search ordered only by knn score: returns the ids and scores of the
+  // shard's best matches without loading them, so that the coordinator can merge the global
+  // top before any document is serialized with LoadKnnDocs.
+  SearchResult SearchKnnScores(const OpArgs& op_args, const SearchParams& params,
+                               search::SearchAlgorithm* search_algo) const;
+
+  // Second phase of a knn search: serializes the documents that made it into the global top.
+  std::vector<SerializedSearchDoc> LoadKnnDocs(
+      const OpArgs& op_args, const SearchParams& params,
+      absl::Span<const std::pair<search::DocId, float>> docs) const;
 
   // Perform search and load requested values - note params might be interpreted differently.
   std::vector<SearchDocData> SearchForAggregator(const OpArgs& op_args,
                                                  const AggregateParams& params,
-                                                 search::SearchAlgorithm* search_algo) const;
+                                                 search::SearchAlgorithm* search_algo,
+                                                 std::string_view cache_key = {}) const;
+
+  // Compute the GROUPBY of params.shard_group over the documents of this shard.
+  aggregate::PartialGroups GroupForAggregator(const OpArgs& op_args, const AggregateParams& params,
+                                              search::SearchAlgorithm* search_algo,
+                                              std::string_view cache_key = {}) const;
 
   // Return whether base index matches
   bool Matches(std::string_view key, unsigned obj_code) const;
@@ -195,6 +275,13 @@ class ShardDocIndex {
   void AddDoc(std::string_view key, const DbContext& db_cntx, const PrimeValue& pv);
   void RemoveDoc(std::string_view key, const DbContext& db_cntx, const PrimeValue& pv);
 
+  // Copies the indexed fields of a json document before it's modified in place. Returns false if
+  // the document is not indexed.
+  bool SnapshotDoc(std::string_view key, const PrimeValue& pv, JsonFieldsSnapshot* snapshot) const;
+
+  // Reindexes the fields of a json document whose values changed since SnapshotDoc.
+  void UpdateDoc(std::string_view key, const PrimeValue& pv, const JsonFieldsSnapshot& snapshot);
+
   DocIndexInfo GetInfo() const;
 
   io::Result<StringVec, facade::ErrorReply> GetTagVals(std::string_view field) const;
@@ -208,6 +295,16 @@ class ShardDocIndex {
     return synonyms_;
   }
 
+  // Serializes the HNSW graphs of vector fields together with the keys of their documents.
+  // Returns an empty string if the index has no HNSW fields or is being built.
+  std::string SerializeGraphs() const;
+
+  // Restore graphs serialized by SerializeGraphs on the next Rebuild instead of inserting all
+  // vectors again. Documents of the graphs that don't exist by then are removed from them.
+  void SetRestoredGraphs(std::string data) {
+    restored_graphs_ = std::move(data);
+  }
+
   // Rebuild indices only for documents containing terms from the updated synonym group
   void RebuildForGroup(const OpArgs& op_args, const std::string_view& group_id,
                        const std::vector<std::string_view>& terms);
@@ -216,9 +313,37 @@ class ShardDocIndex {
   // Clears internal data. Traverses all matching documents and assigns ids.
   void Rebuild(const OpArgs& op_args, PMR_NS::memory_resource* mr);
 
+  // Clears internal data and indexes the existing documents in a background fiber that yields
+  // after every slice of work. Documents written meanwhile are indexed by AddDoc as usual, so
+  // the index can be queried during the build and is complete once it finishes.
+  void StartBuild(const OpArgs& op_args, PMR_NS::memory_resource* mr);
+  void BuildFb(EngineShard* shard, DbContext db_cntx);
+
+  // Restores key ids and graphs into fresh indices. Returns false if the data doesn't match them.
+  bool RestoreGraphs(std::string_view data);
+
+  // Stop the background build if it's running and wait for its fiber to exit.
+  void CancelBuild();
+
+  SearchResult DoSearch(const OpArgs& op_args, const SearchParams& params,
+                        search::SearchAlgorithm* search_algo) const;
+  std::vector<SearchDocData> DoSearchForAggregator(const OpArgs& op_args,
+                                                   const AggregateParams& params,
+                                                   search::SearchAlgorithm* search_algo) const;
+
+  // Returns the result cache if results can be cached right now
+  SearchResultCache* GetCache(std::string_view cache_key) const;
+
   using LoadedEntry = std::pair<std::string_view, std::unique_ptr<BaseAccessor>>;
   std::optional<LoadedEntry> LoadEntry(search::DocId id, const OpArgs& op_args) const;
 
+  // Load the document and serialize the requested fields. Returns nullopt if it expired.
+  std::optional<SerializedSearchDoc> SerializeDoc(search::DocId id, const OpArgs& op_args,
+                                                  const SearchParams& params,
+                                                  const std::vector<FieldReference>& return_fields,
+                                                  float knn_score,
+                                                  search::SortableValue sort_score) const;
+
   // Behaviour identical to SortIndex::Sort for non-sortable fields that need to be fetched first
   std::vector<search::SortableValue> KeepTopKSorted(std::vector<DocId>* ids, size_t limit,
                                                     const SearchParams::SortOption& sort,
@@ -229,6 +354,36 @@ class ShardDocIndex {
   std::optional<search::FieldIndices> indices_;
   DocKeyIndex key_index_;
   Synonyms synonyms_;
+
+  // Incremented on every change of the indexed documents, invalidates cached results
+  uint64_t version_ = 0;
+  mutable SearchResultCache cache_;
+
+  // Set by LoadEntry when a loaded document has a ttl. Results with such documents are not
+  // cached, because they become stale when it expires before the document is deleted.
+  mutable bool loaded_expiring_ = false;
+
+  util::fb2::Fiber build_fb_;
+  bool building_ = false;
+  bool build_cancelled_ = false;
+  size_t build_traversed_ = 0;  // table entries visited by the background build
+  size_t build_total_ = 0;      // table size when the background build started
+
+  std::string restored_graphs_;  // see SetRestoredGraphs
+};
+
+// Indexed fields of a json document in all the indices that contain it, see
+// ShardDocIndices::SnapshotDoc.
+class DocSnapshot {
+ public:
+  DocSnapshot();
+  ~DocSnapshot();
+  DocSnapshot(DocSnapshot&&) noexcept;
+  DocSnapshot& operator=(DocSnapshot&&) noexcept;
+
+ private:
+  friend class ShardDocIndices;
+  std::vector<std::pair<const ShardDocIndex*, std::unique_ptr<JsonFieldsSnapshot>>> entries_;
 };
 
 // Stores shard doc indices by name on a specific shard.
@@ -253,12 +408,29 @@ class ShardDocIndices {
   // Rebuild all indices
   void RebuildAllIndices(const OpArgs& op_args);
 
+  // Serialize HNSW graphs of all indices, see ShardDocIndex::SerializeGraphs. Returns nothing
+  // unless --search_persist_hnsw is set.
+  std::vector<std::string> SerializeGraphs() const;
+
+  // Restore an entry of SerializeGraphs on the next rebuild
+  void SetRestoredGraphs(std::string data);
+
   std::vector<std::string> GetIndexNames() const;
 
   /* Use AddDoc and RemoveDoc only if pv object type is json or hset */
   void AddDoc(std::string_view key, const DbContext& db_cnt, const PrimeValue& pv);
   void RemoveDoc(std::string_view key, const DbContext& db_cnt, const PrimeValue& pv);
 
+  // Copies the indexed fields of a json document before it's modified in place, instead of
+  // removing it. UpdateDoc then reindexes only the fields whose values changed, and adds the
+  // document to the indices that didn't contain it.
+  DocSnapshot SnapshotDoc(std::string_view key, const PrimeValue& pv) const;
+  void UpdateDoc(std::string_view key, const DbContext& db_cntx, const PrimeValue& pv,
+                 const DocSnapshot& snapshot);
+
+  // Invalidate cached results of indices that might contain key, because it can expire now
+  void OnExpireSet(const PrimeKey& key);
+
   size_t GetUsedMemory() const;
   SearchStats GetStats() const;  // combines stats for all indices
  private:
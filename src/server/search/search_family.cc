@@ -81,6 +81,10 @@ search::SchemaField::VectorParams ParseVectorParams(CmdArgParser* parser) {
     } else if (parser->Check("DISTANCE_METRIC")) {
       params.sim = parser->MapNext("L2", search::VectorSimilarity::L2, "COSINE",
                                    search::VectorSimilarity::COSINE);
+    } else if (parser->Check("QUANTIZATION")) {
+      params.quantization = parser->MapNext("FLOAT32", search::VectorQuantization::NONE, "FLOAT16",
+                                            search::VectorQuantization::FLOAT16, "INT8",
+                                            search::VectorQuantization::INT8);
     } else if (parser->Check("INITIAL_CAP", &params.capacity)) {
     } else if (parser->Check("M", &params.hnsw_m)) {
     } else if (parser->Check("EF_CONSTRUCTION", &params.hnsw_ef_construction)) {
@@ -473,6 +477,7 @@ ParseResult<AggregateParams> ParseAggregatorParams(CmdArgParser* parser) {
       }
 
       vector<aggregate::Reducer> reducers;
+      vector<aggregate::ReducerFunc> funcs;
       while (parser->Check("REDUCE")) {
         using RF = aggregate::ReducerFunc;
         auto func_name =
@@ -496,6 +501,15 @@ ParseResult<AggregateParams> ParseAggregatorParams(CmdArgParser* parser) {
 
         reducers.push_back(
             aggregate::Reducer{std::move(source_field), std::move(result_field), func});
+        funcs.push_back(*func_name);
+      }
+
+      // The first GROUPBY is computed on shards if its reducers can be merged afterwards
+      if (params.steps.empty() && !params.shard_group &&
+          all_of(funcs.begin(), funcs.end(), aggregate::IsDecomposable)) {
+        params.shard_group =
+            aggregate::GroupParams{std::move(fields), std::move(reducers), std::move(funcs)};
+        continue;
       }
 
       params.steps.push_back(aggregate::MakeGroupStep(std::move(fields), std::move(reducers)));
@@ -619,6 +633,41 @@ void SearchReply(const SearchParams& params,
   }
 }
 
+// Key of the shard result caches. Arguments are prefixed with their lengths, so that binary
+// parameters can't make different argument lists collide.
+string ResultCacheKey(string_view cmd, CmdArgList args) {
+  string key{cmd};
+  for (string_view arg : args)
+    absl::StrAppend(&key, " ", arg.size(), ":", arg);
+  return key;
+}
+
+// Select the global top of the knn scores collected by ShardDocIndex::SearchKnnScores and group
+// the winners by shard, so that only they have to be loaded and serialized.
+vector<vector<pair<search::DocId, float>>> MergeKnnScores(absl::Span<const SearchResult> results,
+                                                          size_t limit) {
+  struct Candidate {
+    float score;
+    ShardId sid;
+    search::DocId id;
+  };
+
+  vector<Candidate> candidates;
+  for (ShardId sid = 0; sid < results.size(); sid++) {
+    for (auto [id, score] : results[sid].knn_scores)
+      candidates.push_back({score, sid, id});
+  }
+
+  limit = min(limit, candidates.size());
+  auto cmp = [](const Candidate& l, const Candidate& r) { return l.score < r.score; };
+  nth_element(candidates.begin(), candidates.begin() + limit, candidates.end(), cmp);
+
+  vector<vector<pair<search::DocId, float>>> winners(results.size());
+  for (size_t i = 0; i < limit; i++)
+    winners[candidates[i].sid].emplace_back(candidates[i].id, candidates[i].score);
+  return winners;
+}
+
 }  // namespace
 
 void SearchFamily::FtCreate(CmdArgList args, const CommandContext& cmd_cntx) {
@@ -762,14 +811,21 @@ void SearchFamily::FtInfo(CmdArgList args, const CommandContext& cmd_cntx) {
   DCHECK(infos.front().base_index.schema.fields.size() ==
          infos.back().base_index.schema.fields.size());
 
-  size_t total_num_docs = 0;
-  for (const auto& info : infos)
+  size_t total_num_docs = 0, cache_hits = 0, cache_misses = 0;
+  double indexed_fraction = 0;
+  for (const auto& info : infos) {
     total_num_docs += info.num_docs;
+    indexed_fraction += info.indexed_fraction / infos.size();
+    cache_hits += info.cache_hits;
+    cache_misses += info.cache_misses;
+  }
+  const bool indexing = any_of(infos.begin(), infos.end(),
+                               [](const auto& info) { return info.indexed_fraction < 1.0; });
 
   const auto& info = infos.front();
   const auto& schema = info.base_index.schema;
 
-  rb->StartCollection(4, RedisReplyBuilder::MAP);
+  rb->StartCollection(8, RedisReplyBuilder::MAP);
 
   rb->SendSimpleString("index_name");
   rb->SendSimpleString(idx_name);
@@ -811,6 +867,18 @@ void SearchFamily::FtInfo(CmdArgList args, const CommandContext& cmd_cntx) {
 
   rb->SendSimpleString("num_docs");
   rb->SendLong(total_num_docs);
+
+  rb->SendSimpleString("indexing");
+  rb->SendLong(indexing ? 1 : 0);
+
+  rb->SendSimpleString("percent_indexed");
+  rb->SendDouble(indexing ? indexed_fraction : 1.0);
+
+  rb->SendSimpleString("cache_hits");
+  rb->SendLong(cache_hits);
+
+  rb->SendSimpleString("cache_misses");
+  rb->SendLong(cache_misses);
 }
 
 void SearchFamily::FtList(CmdArgList args, const CommandContext& cmd_cntx) {
@@ -841,17 +909,38 @@ void SearchFamily::FtSearch(CmdArgList args, const CommandContext& cmd_cntx) {
   if (!search_algo.Init(query_str, &params->query_params))
     return builder->SendError("Query syntax error");
 
+  // Results ordered only by knn score are merged in two hops: first the shards return the ids
+  // and scores of their best matches, then only the documents of the global top are loaded.
+  auto knn_sort_option = search_algo.GetKnnScoreSortOption();
+  const bool two_phase = knn_sort_option && !params->IdsOnly() &&
+                         (!params->sort_option || params->sort_option->IsSame(*knn_sort_option));
+
   // Because our coordinator thread may not have a shard, we can't check ahead if the index exists.
   atomic<bool> index_not_found{false};
   vector<SearchResult> docs(shard_set->size());
 
-  cmd_cntx.tx->ScheduleSingleHop([&](Transaction* t, EngineShard* es) {
-    if (auto* index = es->search_indices()->GetIndex(index_name); index)
-      docs[es->shard_id()] = index->Search(t->GetOpArgs(es), *params, &search_algo);
-    else
+  const string cache_key = two_phase ? "" : ResultCacheKey("FT.SEARCH", args);
+
+  auto* tx = cmd_cntx.tx;
+  auto search_cb = [&](Transaction* t, EngineShard* es) {
+    if (auto* index = es->search_indices()->GetIndex(index_name); !index)
       index_not_found.store(true, memory_order_relaxed);
+    else if (two_phase)
+      docs[es->shard_id()] = index->SearchKnnScores(t->GetOpArgs(es), *params, &search_algo);
+    else
+      docs[es->shard_id()] = index->Search(t->GetOpArgs(es), *params, &search_algo, cache_key);
     return OpStatus::OK;
-  });
+  };
+  if (two_phase)
+    tx->Execute(search_cb, false);
+  else
+    tx->ScheduleSingleHop(search_cb);
+
+  auto has_error = [&docs] {
+    return any_of(docs.begin(), docs.end(), [](const auto& res) { return res.error.has_value(); });
+  };
+  if (two_phase && (index_not_found.load() || has_error()))
+    tx->Conclude();
 
   if (index_not_found.load())
     return builder->SendError(string{index_name} + ": no such index");
@@ -861,7 +950,22 @@ void SearchFamily::FtSearch(CmdArgList args, const CommandContext& cmd_cntx) {
       return builder->SendError(*res.error);
   }
 
-  SearchReply(*params, search_algo.GetKnnScoreSortOption(), absl::MakeSpan(docs), builder);
+  if (two_phase) {
+    size_t limit = min(knn_sort_option->limit, params->limit_offset + params->limit_total);
+    auto winners = MergeKnnScores(docs, limit);
+
+    auto load_cb = [&](Transaction* t, EngineShard* es) {
+      ShardId sid = es->shard_id();
+      auto* index = es->search_indices()->GetIndex(index_name);
+      if (index && !winners[sid].empty()) {
+        docs[sid].docs = index->LoadKnnDocs(t->GetOpArgs(es), *params, winners[sid]);
+      }
+      return OpStatus::OK;
+    };
+    tx->Execute(std::move(load_cb), true);
+  }
+
+  SearchReply(*params, knn_sort_option, absl::MakeSpan(docs), builder);
 }
 
 void SearchFamily::FtProfile(CmdArgList args, const CommandContext& cmd_cntx) {
@@ -1047,42 +1151,60 @@ void SearchFamily::FtAggregate(CmdArgList args, const CommandContext& cmd_cntx)
   if (!search_algo.Init(params->query, &params->params))
     return builder->SendError("Query syntax error");
 
-  using ResultContainer = decltype(declval<ShardDocIndex>().SearchForAggregator(
-      declval<OpArgs>(), params.value(), &search_algo));
+  const string cache_key = ResultCacheKey("FT.AGGREGATE", args);
+  aggregate::AggregationResult agg_results;
+  if (params->shard_group) {
+    // Shards send only their partial groups instead of all matching documents
+    vector<aggregate::PartialGroups> partials(shard_set->size());
+    cmd_cntx.tx->ScheduleSingleHop([&](Transaction* t, EngineShard* es) {
+      if (auto* index = es->search_indices()->GetIndex(params->index); index) {
+        partials[es->shard_id()] = index->GroupForAggregator(t->GetOpArgs(es), params.value(),
+                                                             &search_algo, cache_key);
+      }
+      return OpStatus::OK;
+    });
 
-  vector<ResultContainer> query_results(shard_set->size());
-  cmd_cntx.tx->ScheduleSingleHop([&](Transaction* t, EngineShard* es) {
-    if (auto* index = es->search_indices()->GetIndex(params->index); index) {
-      query_results[es->shard_id()] =
-          index->SearchForAggregator(t->GetOpArgs(es), params.value(), &search_algo);
+    agg_results = aggregate::Process(
+        aggregate::MergePartialGroups(absl::MakeSpan(partials), *params->shard_group),
+        params->steps);
+  } else {
+    using ResultContainer = decltype(declval<ShardDocIndex>().SearchForAggregator(
+        declval<OpArgs>(), params.value(), &search_algo));
+
+    vector<ResultContainer> query_results(shard_set->size());
+    cmd_cntx.tx->ScheduleSingleHop([&](Transaction* t, EngineShard* es) {
+      if (auto* index = es->search_indices()->GetIndex(params->index); index) {
+        query_results[es->shard_id()] =
+            index->SearchForAggregator(t->GetOpArgs(es), params.value(), &search_algo, cache_key);
+      }
+      return OpStatus::OK;
+    });
+
+    // ResultContainer is absl::flat_hash_map<std::string, search::SortableValue>
+    // DocValues is absl::flat_hash_map<std::string_view, SortableValue>
+    // Keys of values should point to the keys of the query_results
+    std::vector<aggregate::DocValues> values;
+    for (auto& sub_results : query_results) {
+      for (auto& docs : sub_results) {
+        aggregate::DocValues doc_value;
+        for (auto& doc : docs) {
+          doc_value[doc.first] = std::move(doc.second);
+        }
+        values.push_back(std::move(doc_value));
+      }
     }
-    return OpStatus::OK;
-  });
 
-  // ResultContainer is absl::flat_hash_map<std::string, search::SortableValue>
-  // DocValues is absl::flat_hash_map<std::string_view, SortableValue>
-  // Keys of values should point to the keys of the query_results
-  std::vector<aggregate::DocValues> values;
-  for (auto& sub_results : query_results) {
-    for (auto& docs : sub_results) {
-      aggregate::DocValues doc_value;
-      for (auto& doc : docs) {
-        doc_value[doc.first] = std::move(doc.second);
+    std::vector<std::string_view> load_fields;
+    if (params->load_fields) {
+      load_fields.reserve(params->load_fields->size());
+      for (const auto& field : params->load_fields.value()) {
+        load_fields.push_back(field.OutputName());
       }
-      values.push_back(std::move(doc_value));
     }
-  }
 
-  std::vector<std::string_view> load_fields;
-  if (params->load_fields) {
-    load_fields.reserve(params->load_fields->size());
-    for (const auto& field : params->load_fields.value()) {
-      load_fields.push_back(field.OutputName());
-    }
+    agg_results = aggregate::Process(std::move(values), load_fields, params->steps);
   }
 
-  auto agg_results = aggregate::Process(std::move(values), load_fields, params->steps);
-
   auto* rb = static_cast<RedisReplyBuilder*>(cmd_cntx.rb);
   auto sortable_value_sender = SortableValueSender(rb);
 
@@ -22,6 +22,10 @@ using namespace util;
 using namespace facade;
 
 ABSL_DECLARE_FLAG(bool, search_reject_legacy_field);
+ABSL_DECLARE_FLAG(bool, search_background_indexing);
+ABSL_DECLARE_FLAG(uint32_t, search_index_build_slice_usec);
+ABSL_DECLARE_FLAG(uint64_t, search_result_cache_bytes);
+ABSL_DECLARE_FLAG(bool, search_persist_hnsw);
 
 namespace dfly {
 
@@ -279,7 +283,85 @@ TEST_F(SearchFamilyTest, InfoIndex) {
   EXPECT_THAT(info,
               IsArray(_, _, _, IsArray("key_type", "HASH", "prefix", "doc-"), "attributes",
                       IsArray(IsArray("identifier", "name", "attribute", "name", "type", "TEXT")),
-                      "num_docs", IntArg(15)));
+                      "num_docs", IntArg(15), "indexing", IntArg(0), "percent_indexed", "1",
+                      "cache_hits", IntArg(0), "cache_misses", IntArg(0)));
+}
+
+TEST_F(SearchFamilyTest, BackgroundIndexing) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_search_background_indexing, true);
+  absl::SetFlag(&FLAGS_search_index_build_slice_usec, 1);
+
+  const size_t kNumDocs = 5000;
+  for (size_t i = 0; i < kNumDocs; i++)
+    Run({"hset", absl::StrCat("doc-", i), "name", "dragon", "num", absl::StrCat(i)});
+
+  EXPECT_EQ(Run({"ft.create", "i1", "ON", "HASH", "PREFIX", "1", "doc-", "SCHEMA", "name", "TEXT",
+                 "num", "NUMERIC"}),
+            "OK");
+
+  // Writes during the build are indexed right away and not duplicated once the build reaches them
+  Run({"hset", "doc-0", "name", "wyvern", "num", "0"});
+  Run({"hset", absl::StrCat("doc-", kNumDocs), "name", "dragon", "num", "-1"});
+  Run({"del", absl::StrCat("doc-", kNumDocs - 1)});
+
+  for (unsigned i = 0; i < 1000; i++) {
+    auto info = Run({"ft.info", "i1"});
+    if (info.GetVec()[9].GetInt() == 0)
+      break;
+    ThisFiber::SleepFor(1ms);
+  }
+
+  auto info = Run({"ft.info", "i1"});
+  EXPECT_THAT(info.GetVec()[7], IntArg(kNumDocs));
+  EXPECT_THAT(info.GetVec()[11], "1");
+
+  EXPECT_THAT(Run({"ft.search", "i1", "wyvern"}), AreDocIds("doc-0"));
+  EXPECT_THAT(Run({"ft.search", "i1", "dragon", "LIMIT", "0", "0"}), IntArg(kNumDocs - 1));
+  EXPECT_THAT(Run({"ft.search", "i1", "@num:[-1 -1]"}), AreDocIds(absl::StrCat("doc-", kNumDocs)));
+}
+
+TEST_F(SearchFamilyTest, ResultCache) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_search_result_cache_bytes, 1 << 20);
+
+  for (size_t i = 0; i < 20; i++)
+    Run({"hset", absl::StrCat("doc-", i), "group", i % 2 ? "odd" : "even", "num", "1"});
+  Run({"ft.create", "i1", "ON", "HASH", "PREFIX", "1", "doc-", "SCHEMA", "group", "TAG", "num",
+       "NUMERIC"});
+
+  auto cache_hits = [this] { return *Run({"ft.info", "i1"}).GetVec()[13].GetInt(); };
+  auto sum_even = [this] {
+    return Run({"ft.aggregate", "i1", "@group:{even}", "GROUPBY", "1", "@group", "REDUCE", "SUM",
+                "1", "@num", "AS", "total"});
+  };
+
+  EXPECT_THAT(sum_even(), IsUnordArrayWithSize(IsMap("group", "even", "total", "10")));
+  EXPECT_EQ(cache_hits(), 0);
+
+  // Repeated queries are answered from the cache of every shard
+  EXPECT_THAT(sum_even(), IsUnordArrayWithSize(IsMap("group", "even", "total", "10")));
+  size_t hits = cache_hits();
+  EXPECT_GT(hits, 0u);
+
+  // Changes of the indexed documents invalidate the cached results
+  Run({"hset", "doc-0", "num", "11"});
+  EXPECT_THAT(sum_even(), IsUnordArrayWithSize(IsMap("group", "even", "total", "20")));
+  Run({"del", "doc-2"});
+  EXPECT_THAT(sum_even(), IsUnordArrayWithSize(IsMap("group", "even", "total", "19")));
+
+  EXPECT_THAT(Run({"ft.search", "i1", "@group:{odd}", "NOCONTENT", "LIMIT", "0", "0"}), IntArg(10));
+  Run({"hset", "doc-21", "group", "odd"});
+  EXPECT_THAT(Run({"ft.search", "i1", "@group:{odd}", "NOCONTENT", "LIMIT", "0", "0"}), IntArg(11));
+
+  // Results with expiring documents are not cached
+  Run({"pexpire", "doc-4", "1"});
+  hits = cache_hits();
+  EXPECT_THAT(sum_even(), IsUnordArrayWithSize(IsMap("group", "even", "total", "19")));
+  EXPECT_THAT(sum_even(), IsUnordArrayWithSize(IsMap("group", "even", "total", "19")));
+  EXPECT_EQ(cache_hits(), hits);
+  AdvanceTime(10);
+  EXPECT_THAT(sum_even(), IsUnordArrayWithSize(IsMap("group", "even", "total", "18")));
 }
 
 TEST_F(SearchFamilyTest, Stats) {
@@ -376,6 +458,38 @@ TEST_F(SearchFamilyTest, Json) {
   EXPECT_THAT(Run({"ft.search", "i1", "@a:small @b:secret"}), kNoResults);
 }
 
+TEST_F(SearchFamilyTest, JsonUpdateChangedFields) {
+  EXPECT_EQ(Run({"ft.create", "i1", "on", "json", "schema", "$.a", "as", "a", "text", "$.n", "as",
+                 "n", "numeric", "sortable", "$.t", "as", "t", "tag"}),
+            "OK");
+
+  Run({"json.set", "k1", "$", R"({"a": "first text", "n": 1, "t": "red"})"});
+  Run({"json.set", "k2", "$", R"({"a": "second text", "n": 2, "t": "blue"})"});
+
+  // Update a single field in place, the others stay indexed
+  Run({"json.set", "k1", "$.a", R"("changed text")"});
+  EXPECT_THAT(Run({"ft.search", "i1", "@a:first"}), kNoResults);
+  EXPECT_THAT(Run({"ft.search", "i1", "@a:changed"}), AreDocIds("k1"));
+  EXPECT_THAT(Run({"ft.search", "i1", "@n:[1 1] @t:{red}"}), AreDocIds("k1"));
+
+  // Replace the whole document with only the numeric field changed
+  Run({"json.set", "k2", "$", R"({"a": "second text", "n": 5, "t": "blue"})"});
+  EXPECT_THAT(Run({"ft.search", "i1", "@n:[2 2]"}), kNoResults);
+  EXPECT_THAT(Run({"ft.search", "i1", "@n:[5 5] @a:second @t:{blue}"}), AreDocIds("k2"));
+
+  // Unchanged documents stay indexed
+  Run({"json.set", "k2", "$", R"({"a": "second text", "n": 5, "t": "blue"})"});
+  EXPECT_THAT(Run({"ft.search", "i1", "@n:[5 5] @a:second @t:{blue}"}), AreDocIds("k2"));
+
+  // Values that can't be indexed remove the document from all the fields
+  Run({"json.set", "k1", "$.n", R"("not a number")"});
+  EXPECT_THAT(Run({"ft.search", "i1", "@a:changed"}), kNoResults);
+  EXPECT_THAT(Run({"ft.search", "i1", "@t:{red}"}), kNoResults);
+
+  Run({"json.set", "k1", "$.n", "3"});
+  EXPECT_THAT(Run({"ft.search", "i1", "@a:changed @n:[3 3] @t:{red}"}), AreDocIds("k1"));
+}
+
 TEST_F(SearchFamilyTest, JsonAttributesPaths) {
   Run({"json.set", "k1", ".", R"(   {"nested": {"value": "no"}} )"});
   Run({"json.set", "k2", ".", R"(   {"nested": {"value": "yes"}} )"});
@@ -892,6 +1006,37 @@ TEST_P(SortTest, BasicSort) {
                 AreRange(10, 10 - i, 10 - i - 3, "d2:"));
 }
 
+TEST_P(SortTest, SortLargeMatchWithSmallLimit) {
+  vector<string_view> params{"ft.create", "i1", "prefix", "1", "d:", "schema", "ord", "numeric"};
+  if (GetParam())
+    params.emplace_back("sortable");
+  params.insert(params.end(), {"parity", "tag"});
+  Run(params);
+
+  for (size_t i = 0; i < 1000; i++)
+    Run({"hset", absl::StrCat("d:", i), "ord", absl::StrCat(1000 - i), "parity",
+         i % 2 ? "odd" : "even"});
+
+  auto search = [this](string_view query, bool desc) {
+    vector<string_view> args{"ft.search", "i1", query, "SORTBY", "ord"};
+    if (desc)
+      args.push_back("DESC");
+    args.insert(args.end(), {"LIMIT", "0", "3", "NOCONTENT"});
+    return Run(args);
+  };
+
+  EXPECT_THAT(search("*", false), IsArray(IntArg(1000), "d:999", "d:998", "d:997"));
+  EXPECT_THAT(search("*", true), IsArray(IntArg(1000), "d:0", "d:1", "d:2"));
+  EXPECT_THAT(search("@parity:{even}", false), IsArray(IntArg(500), "d:998", "d:996", "d:994"));
+  EXPECT_THAT(search("@parity:{odd}", true), IsArray(IntArg(500), "d:1", "d:3", "d:5"));
+
+  // Updated and deleted documents change their positions in the sort order
+  Run({"hset", "d:0", "ord", "-5"});
+  Run({"del", "d:998"});
+  EXPECT_THAT(search("@parity:{even}", false), IsArray(IntArg(499), "d:0", "d:996", "d:994"));
+  EXPECT_THAT(search("@parity:{even}", true), IsArray(IntArg(499), "d:2", "d:4", "d:6"));
+}
+
 INSTANTIATE_TEST_SUITE_P(Sortable, SortTest, testing::Values(true));
 INSTANTIATE_TEST_SUITE_P(NotSortable, SortTest, testing::Values(false));
 
@@ -976,6 +1121,29 @@ TEST_F(SearchFamilyTest, SimpleExpiry) {
   Run({"flushall"});
 }
 
+TEST_F(SearchFamilyTest, ReapedHashFields) {
+  absl::FlagSaver fs;
+  SetTestFlag("field_expire_reap_min_size", "4");
+  ResetService();
+
+  EXPECT_EQ(Run({"ft.create", "i1", "PREFIX", "1", "d:", "SCHEMA", "title", "TEXT", "k0", "TEXT"}),
+            "OK");
+  Run({"hset", "d:1", "title", "kept"});
+  for (int i = 0; i < 8; ++i)
+    Run({"hsetex", "d:1", "10", absl::StrCat("k", i), "gone"});
+  EXPECT_THAT(Run({"ft.search", "i1", "@k0:gone"}), AreDocIds("d:1"));
+
+  // The hash is not accessed, so only the background reaping removes the fields.
+  AdvanceTime(10'000);
+  shard_set->RunBlockingInParallel([](EngineShard* shard) {
+    DbContext cntx{&namespaces->GetDefaultNamespace(), 0, GetCurrentTimeMs()};
+    cntx.GetDbSlice(shard->shard_id()).ReapExpiredFields(cntx, 1024);
+  });
+
+  EXPECT_THAT(Run({"ft.search", "i1", "@k0:gone"}), kNoResults);
+  EXPECT_THAT(Run({"ft.search", "i1", "@title:kept"}), AreDocIds("d:1"));
+}
+
 TEST_F(SearchFamilyTest, DocsEditing) {
   auto resp = Run({"JSON.SET", "k1", ".", R"({"a":"1"})"});
   EXPECT_EQ(resp, "OK");
@@ -1845,6 +2013,68 @@ TEST_F(SearchFamilyTest, KnnWithSortBy) {
   }
 }
 
+TEST_F(SearchFamilyTest, KnnGlobalTopAcrossShards) {
+  vector<string> doc_ids(100);
+  for (size_t i = 0; i < doc_ids.size(); i++) {
+    doc_ids[i] = absl::StrCat("d:", i);
+    Run({"JSON.SET", doc_ids[i], ".", absl::StrFormat(R"({"v": [%d.0], "d": %d})", i, i)});
+  }
+
+  Run({"FT.CREATE", "i1",      "ON",     "JSON", "PREFIX",          "1",    "d:",
+       "SCHEMA",    "$.v",     "AS",     "v",    "VECTOR",          "FLAT", "6",
+       "TYPE",      "FLOAT32", "DIM",    "1",    "DISTANCE_METRIC", "L2",   "$.d",
+       "AS",        "d",       "NUMERIC"});
+
+  // Only the global top is loaded from the shards, every window of it must still be exact
+  const float qpoint = 0.0f;
+  for (size_t offset = 0; offset < 20; offset += 5) {
+    vector<string> expect_ids(doc_ids.begin() + offset, doc_ids.begin() + offset + 5);
+    auto resp = Run({"ft.search", "i1", "*=>[KNN 20 @v $query_vector]", "PARAMS", "2",
+                     "query_vector", FloatSV(&qpoint), "LIMIT", absl::StrCat(offset), "5",
+                     "RETURN", "1", "d"});
+    EXPECT_THAT(resp, DocIds(20, expect_ids)) << offset;
+  }
+
+  // Sorting by the knn score itself keeps the two phase merge
+  auto resp = Run({"ft.search", "i1", "*=>[KNN 3 @v $query_vector AS score]", "SORTBY", "score",
+                   "PARAMS", "2", "query_vector", FloatSV(&qpoint), "RETURN", "1", "score"});
+  EXPECT_THAT(resp, IsArray(IntArg(3), "d:0", IsMap("score", "0"), "d:1", IsMap("score", "1"),
+                            "d:2", IsMap("score", "2")));
+
+  // Offset past the knn limit returns nothing but the number of hits
+  resp = Run({"ft.search", "i1", "*=>[KNN 10 @v $query_vector]", "PARAMS", "2", "query_vector",
+              FloatSV(&qpoint), "LIMIT", "10", "5"});
+  EXPECT_THAT(resp, IntArg(10));
+}
+
+TEST_F(SearchFamilyTest, PersistHnswGraphs) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_search_persist_hnsw, true);
+  InitWithDbFilename();
+
+  EXPECT_EQ(Run({"FT.CREATE", "i1", "SCHEMA", "v", "VECTOR", "HNSW", "6", "TYPE", "FLOAT32", "DIM",
+                 "1", "DISTANCE_METRIC", "L2", "n", "NUMERIC"}),
+            "OK");
+  for (size_t i = 0; i < 100; i++) {
+    float value = i;
+    Run({"HSET", absl::StrCat("d:", i), "v", FloatSV(&value), "n", absl::StrCat(i)});
+  }
+  Run({"DEL", "d:50"});
+
+  EXPECT_EQ(Run({"DEBUG", "RELOAD"}), "OK");
+
+  const float qpoint = 50.2f;
+  auto query = [&] {
+    return Run({"FT.SEARCH", "i1", "*=>[KNN 3 @v $query_vector]", "PARAMS", "2", "query_vector",
+                FloatSV(&qpoint), "RETURN", "1", "n"});
+  };
+  EXPECT_THAT(query(), DocIds(3, vector<string>{"d:49", "d:51", "d:52"}));
+
+  // The restored graph accepts new documents
+  Run({"HSET", "d:new", "v", FloatSV(&qpoint), "n", "1000"});
+  EXPECT_THAT(query(), DocIds(3, vector<string>{"d:new", "d:49", "d:51"}));
+}
+
 TEST_F(SearchFamilyTest, InvalidAggregateOptions) {
   Run({"JSON.SET", "j1", ".", R"({"field1":"first","field2":"second"})"});
   Run({"FT.CREATE", "idx", "ON", "JSON", "SCHEMA", "$.field1", "AS", "field1", "TEXT", "$.field2",
@@ -2728,7 +2958,8 @@ TEST_F(SearchFamilyTest, BlockSizeOptionFtCreate) {
                                                  "type", "NUMERIC", "blocksize", "2"),
                                          IsArray("identifier", "number2", "attribute", "number2",
                                                  "type", "NUMERIC", "blocksize", "1024")),
-                            "num_docs", IntArg(0)));
+                            "num_docs", IntArg(0), "indexing", IntArg(0), "percent_indexed",
+                            "1", "cache_hits", IntArg(0), "cache_misses", IntArg(0)));
 
   // Add a document to the index
   for (int i = 1; i <= 5; ++i) {
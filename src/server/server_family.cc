@@ -5,10 +5,12 @@
 #include "server/server_family.h"
 
 #include <absl/cleanup/cleanup.h>
+#include <absl/container/btree_map.h>
 #include <absl/random/random.h>  // for master_replid_ generation.
 #include <absl/strings/match.h>
 #include <absl/strings/str_join.h>
 #include <absl/strings/str_replace.h>
+#include <absl/strings/str_split.h>
 #include <absl/strings/strip.h>
 #include <croncpp.h>  // cron::cronexpr
 #include <sys/resource.h>
@@ -29,9 +31,11 @@ extern "C" {
 #include "redis/redis_aux.h"
 }
 
+#include "base/cycle_clock.h"
 #include "base/flags.h"
 #include "base/logging.h"
 #include "core/compact_object.h"
+#include "core/task_queue.h"
 #include "facade/cmd_arg_parser.h"
 #include "facade/dragonfly_connection.h"
 #include "facade/reply_builder.h"
@@ -39,10 +43,14 @@ extern "C" {
 #include "io/proc_reader.h"
 #include "search/doc_index.h"
 #include "server/acl/acl_commands_def.h"
+#include "server/cluster/cluster_utility.h"
+#include "server/cluster/slot_set.h"
 #include "server/command_registry.h"
 #include "server/conn_context.h"
 #include "server/debugcmd.h"
+#include "server/detail/lazy_key_fetcher.h"
 #include "server/detail/save_stages_controller.h"
+#include "server/detail/snapshot_key_index.h"
 #include "server/detail/snapshot_storage.h"
 #include "server/dflycmd.h"
 #include "server/engine_shard_set.h"
@@ -113,6 +121,10 @@ ABSL_FLAG(int32_t, slowlog_log_slower_than, 10000,
           "microseconds and if it's negative - disables the slowlog.");
 ABSL_FLAG(uint32_t, slowlog_max_len, 20, "Slow log maximum length.");
 
+ABSL_FLAG(uint32_t, latency_monitor_threshold, 0,
+          "Internal events, like heartbeats and eviction steps, that take at least this many "
+          "milliseconds are recorded for the LATENCY command. 0 disables the monitor.");
+
 ABSL_FLAG(uint32_t, pause_wait_timeout, 1,
           "Timeout in seconds, to set up the pause for all connections for CLIENT PAUSE command "
           "and cluster slot migration finalization procedure.");
@@ -129,6 +141,16 @@ ABSL_FLAG(bool, s3_ec2_metadata, false,
 ABSL_FLAG(bool, s3_sign_payload, true,
           "whether to sign the s3 request payload when uploading snapshots");
 
+ABSL_FLAG(bool, lazy_load, false,
+          "Become active before the snapshot is loaded on startup and fetch accessed keys from it "
+          "on demand. Requires a DF snapshot saved with --snapshot_key_index and the same number of "
+          "shards. Until the load finishes, scans and key counts are partial, and saves and "
+          "replication are rejected.");
+ABSL_FLAG(bool, replica_partial_sync_from_snapshot, false,
+          "If the loaded snapshot was saved by the master, the replica requests a partial sync from "
+          "the journal lsns recorded in the snapshot instead of a full sync. With --replicaof, the "
+          "snapshot is loaded before replication starts. A master started with it without "
+          "--replicaof continues the replication id and journal lsns of the snapshot it loads");
 ABSL_FLAG(bool, info_replication_valkey_compatible, true,
           "when true - output valkey compatible values for info-replication");
 
@@ -138,8 +160,21 @@ ABSL_FLAG(bool, managed_service_info, false,
 ABSL_FLAG(string, availability_zone, "",
           "server availability zone, used by clients to read from local-zone replicas");
 
+ABSL_FLAG(uint32_t, metrics_busiest_slots, 0,
+          "In cluster mode, the number of slots with the highest operation rate whose stats are "
+          "exported as prometheus metrics. 0 disables the slot metrics.");
+
+ABSL_FLAG(uint32_t, metrics_hot_keys, 0,
+          "The number of keys with the most accesses, as sampled with --hotkeys_sample_rate, "
+          "that are exported as prometheus metrics. 0 disables the hot keys metrics.");
+
+ABSL_FLAG(bool, replica_relay, false,
+          "If true, a replica in stable sync accepts replicas of its own and relays the journal "
+          "of its master to them.");
+
 ABSL_DECLARE_FLAG(int32_t, port);
 ABSL_DECLARE_FLAG(bool, cache_mode);
+ABSL_DECLARE_FLAG(std::string, cache_eviction_policy);
 ABSL_DECLARE_FLAG(int32_t, hz);
 ABSL_DECLARE_FLAG(bool, tls);
 ABSL_DECLARE_FLAG(string, tls_ca_cert_file);
@@ -398,7 +433,7 @@ void ClientTracking(CmdArgList args, SinkReplyBuilder* builder, ConnectionContex
         "Client tracking is currently not supported for RESP2. Please use RESP3.");
 
   CmdArgParser parser{args};
-  if (!parser.HasAtLeast(1) || args.size() > 3)
+  if (!parser.HasAtLeast(1))
     return builder->SendError(kSyntaxErr);
 
   bool is_on = false;
@@ -411,34 +446,54 @@ void ClientTracking(CmdArgList args, SinkReplyBuilder* builder, ConnectionContex
   }
 
   bool noloop = false;
+  bool bcast = false;
+  vector<string> prefixes;
 
-  if (parser.HasNext()) {
-    if (parser.Check("OPTIN")) {
+  while (parser.HasNext()) {
+    if (option == Tracking::NONE && parser.Check("OPTIN")) {
       option = Tracking::OPTIN;
-    } else if (parser.Check("OPTOUT")) {
+    } else if (option == Tracking::NONE && parser.Check("OPTOUT")) {
       option = Tracking::OPTOUT;
-    } else if (parser.Check("NOLOOP")) {
+    } else if (!noloop && parser.Check("NOLOOP")) {
       noloop = true;
+    } else if (!bcast && parser.Check("BCAST")) {
+      bcast = true;
+    } else if (parser.Check("PREFIX")) {
+      if (!parser.HasNext())
+        return builder->SendError(kSyntaxErr);
+      prefixes.push_back(parser.Next<string>());
     } else {
       return builder->SendError(kSyntaxErr);
     }
   }
 
-  if (parser.HasNext()) {
-    if (!noloop && parser.Check("NOLOOP")) {
-      noloop = true;
-    } else {
-      return builder->SendError(kSyntaxErr);
-    }
-  }
+  if (bcast && option != Tracking::NONE)
+    return builder->SendError("ERR OPTIN and OPTOUT are not compatible with BCAST");
+
+  // Invalidations of BCAST connections are coalesced per thread, so they can not skip the
+  // connection that made the change.
+  if (bcast && noloop)
+    return builder->SendError("ERR NOLOOP is not supported with BCAST");
+
+  if (!bcast && !prefixes.empty())
+    return builder->SendError("ERR PREFIX option requires BCAST mode to be enabled");
+
+  if (bcast && prefixes.empty())
+    prefixes.emplace_back();  // the empty prefix matches all keys
 
   if (is_on) {
     ++cntx->subscriptions;
   }
 
-  cntx->conn_state.tracking_info_.SetClientTracking(is_on);
-  cntx->conn_state.tracking_info_.SetOption(option);
-  cntx->conn_state.tracking_info_.SetNoLoop(noloop);
+  // Drop the previous BCAST registration before applying the new mode.
+  auto& tracking_info = cntx->conn_state.tracking_info_;
+  cntx->ChangeBcastTracking(false);
+  tracking_info.SetBcastPrefixes(is_on ? std::move(prefixes) : vector<string>{});
+  cntx->ChangeBcastTracking(true);
+
+  tracking_info.SetClientTracking(is_on);
+  tracking_info.SetOption(option);
+  tracking_info.SetNoLoop(noloop);
   return builder->SendOk();
 }
 
@@ -679,6 +734,35 @@ bool ReadProcStats(io::StatusData* sdata) {
   return true;
 }
 
+// Returns the shard id of a DF shard file, that is named "<name>-NNNN.dfs".
+optional<ShardId> ShardOfDfsFile(string_view file) {
+  if (!absl::ConsumeSuffix(&file, ".dfs") || file.size() < 5 || file[file.size() - 5] != '-')
+    return nullopt;
+
+  ShardId sid;
+  if (!absl::SimpleAtoi(file.substr(file.size() - 4), &sid))
+    return nullopt;
+  return sid;
+}
+
+// Returns the hottest keys of all shards, in decreasing order of their accesses.
+vector<pair<string, uint64_t>> CollectHotKeys(Namespace* ns, size_t limit) {
+  vector<vector<pair<string, uint64_t>>> shard_keys(shard_set->size());
+  shard_set->RunBriefInParallel([&](EngineShard* shard) {
+    shard_keys[shard->shard_id()] = ns->GetDbSlice(shard->shard_id()).GetHotKeys();
+  });
+
+  vector<pair<string, uint64_t>> res;
+  for (auto& keys : shard_keys)
+    res.insert(res.end(), make_move_iterator(keys.begin()), make_move_iterator(keys.end()));
+
+  limit = min(limit, res.size());
+  partial_sort(res.begin(), res.begin() + limit, res.end(),
+               [](const auto& l, const auto& r) { return l.second > r.second; });
+  res.resize(limit);
+  return res;
+}
+
 }  // namespace
 
 void SlowLogGet(dfly::CmdArgList args, std::string_view sub_cmd, util::ProactorPool* pp,
@@ -864,6 +948,12 @@ void SetSlowLogThreshold(util::ProactorPool& pool, int32_t val) {
   });
 }
 
+void SetLatencyMonitorThreshold(util::ProactorPool& pool, uint32_t val) {
+  pool.AwaitFiberOnAll([val](auto index, auto* context) {
+    ServerState::tlocal()->latency_monitor().set_threshold_ms(val);
+  });
+}
+
 void ServerFamily::Init(util::AcceptServer* acceptor, std::vector<facade::Listener*> listeners) {
   CHECK(acceptor_ == nullptr);
   acceptor_ = acceptor;
@@ -887,6 +977,11 @@ void ServerFamily::Init(util::AcceptServer* acceptor, std::vector<facade::Listen
   SetSlowLogMaxLen(service_.proactor_pool(), absl::GetFlag(FLAGS_slowlog_max_len));
   config_registry.RegisterSetter<uint32_t>(
       "slowlog_max_len", [this](uint32_t val) { SetSlowLogMaxLen(service_.proactor_pool(), val); });
+  SetLatencyMonitorThreshold(service_.proactor_pool(),
+                             absl::GetFlag(FLAGS_latency_monitor_threshold));
+  config_registry.RegisterSetter<uint32_t>("latency_monitor_threshold", [this](uint32_t val) {
+    SetLatencyMonitorThreshold(service_.proactor_pool(), val);
+  });
 
   // We only reconfigure TLS when the 'tls' config key changes. Therefore to
   // update TLS certs, first update tls_cert_file, then set 'tls true'.
@@ -927,8 +1022,14 @@ void ServerFamily::Init(util::AcceptServer* acceptor, std::vector<facade::Listen
 
   // check for '--replicaof' before loading anything
   if (ReplicaOfFlag flag = GetFlag(FLAGS_replicaof); flag.has_value()) {
-    service_.proactor_pool().GetNextProactor()->Await(
-        [this, &flag]() { this->Replicate(flag.host, flag.port); });
+    if (GetFlag(FLAGS_replica_partial_sync_from_snapshot)) {
+      // Only the journal written after the snapshot needs to be replicated if the master
+      // still has it.
+      LoadFromSnapshot([this, flag] { Replicate(flag.host, flag.port); });
+    } else {
+      service_.proactor_pool().GetNextProactor()->Await(
+          [this, &flag]() { this->Replicate(flag.host, flag.port); });
+    }
   } else {  // load from snapshot only if --replicaof is empty
     LoadFromSnapshot();
   }
@@ -946,7 +1047,7 @@ void ServerFamily::Init(util::AcceptServer* acceptor, std::vector<facade::Listen
   create_snapshot_schedule_fb();
 }
 
-void ServerFamily::LoadFromSnapshot() {
+void ServerFamily::LoadFromSnapshot(std::function<void()> on_loaded) {
   {
     util::fb2::LockGuard lk{loading_stats_mu_};
     loading_stats_.restore_count++;
@@ -958,15 +1059,19 @@ void ServerFamily::LoadFromSnapshot() {
   if (load_path_result) {
     const std::string& load_path = *load_path_result;
     if (!load_path.empty()) {
-      auto future = Load(load_path, LoadExistingKeys::kFail);
-      load_fiber_ = service_.proactor_pool().GetNextProactor()->LaunchFiber([future]() mutable {
-        // Wait for load to finish in a dedicated fiber.
-        // Failure to load on start causes Dragonfly to exit with an error code.
-        if (!future.has_value() || future->Get()) {
-          // Error was already printed to log at this point.
-          exit(1);
-        }
-      });
+      auto future = Load(load_path, LoadExistingKeys::kFail, GetFlag(FLAGS_lazy_load));
+      load_fiber_ = service_.proactor_pool().GetNextProactor()->LaunchFiber(
+          [future, on_loaded = std::move(on_loaded)]() mutable {
+            // Wait for load to finish in a dedicated fiber.
+            // Failure to load on start causes Dragonfly to exit with an error code.
+            if (!future.has_value() || future->Get()) {
+              // Error was already printed to log at this point.
+              exit(1);
+            }
+            if (on_loaded)
+              on_loaded();
+          });
+      return;
     }
   } else {
     if (std::error_code(load_path_result.error()) == std::errc::no_such_file_or_directory) {
@@ -979,6 +1084,10 @@ void ServerFamily::LoadFromSnapshot() {
       exit(1);
     }
   }
+
+  // Nothing was loaded.
+  if (on_loaded)
+    service_.proactor_pool().GetNextProactor()->Await(std::move(on_loaded));
 }
 
 void ServerFamily::JoinSnapshotSchedule() {
@@ -1079,6 +1188,9 @@ void ServerFamily::UpdateMemoryGlobalStats() {
 struct AggregateLoadResult {
   AggregateError first_error;
   std::atomic<size_t> keys_read;
+
+  util::fb2::Mutex mu;
+  std::vector<std::pair<uint32_t, LSN>> repl_lsns;  // shard id and journal lsn of shard files
 };
 
 void ServerFamily::FlushAll(Namespace* ns) {
@@ -1095,8 +1207,9 @@ void ServerFamily::FlushAll(Namespace* ns) {
 // Load starts as many fibers as there are files to load each one separately.
 // It starts one more fiber that waits for all load fibers to finish and returns the first
 // error (if any occured) with a future.
-std::optional<fb2::Future<GenericError>> ServerFamily::Load(const std::string& path,
-                                                            LoadExistingKeys existing_keys) {
+std::optional<fb2::Future<GenericError>> ServerFamily::Load(
+    const std::string& path, LoadExistingKeys existing_keys, bool lazy,
+    std::shared_ptr<const cluster::SlotSet> slots) {
   DCHECK(!path.empty());
   DCHECK_GT(shard_count(), 0u);
 
@@ -1118,6 +1231,11 @@ std::optional<fb2::Future<GenericError>> ServerFamily::Load(const std::string& p
     return immediate(expand_result.error());
   }
 
+  if (IsLazyLoading()) {
+    LOG(WARNING) << "Lazy load in progress, ignored";
+    return {};
+  }
+
   auto new_state = service_.SwitchState(GlobalState::ACTIVE, GlobalState::LOADING);
   if (new_state != GlobalState::LOADING) {
     LOG(WARNING) << new_state << " in progress, ignored";
@@ -1142,40 +1260,108 @@ std::optional<fb2::Future<GenericError>> ServerFamily::Load(const std::string& p
       return immediate(load_ec);
   }
 
-  auto aggregated_result = std::make_shared<AggregateLoadResult>();
-
-  for (const auto& file : paths) {
-    // we have already read summary so we skip it now
-    if (absl::EndsWith(file, "summary.dfs"))
-      continue;
+  // A delta snapshot is loaded on top of the snapshots of its chain, starting with the full one.
+  // Each level is loaded only after the previous one has finished.
+  struct LoadLevel {
+    vector<string> files;
+    LoadOptions opts;
+  };
+  vector<LoadLevel> levels;
+  if (!load_opts.delta_chain.empty()) {
+    std::filesystem::path dir = std::filesystem::path{path}.parent_path();
+    for (string_view link : absl::StrSplit(load_opts.delta_chain, ',')) {
+      pair<string_view, string_view> name_and_id = absl::StrSplit(link, absl::MaxSplits(':', 1));
+      auto level_files = snapshot_storage_->ExpandSnapshot((dir / name_and_id.first).string());
+      if (!level_files) {
+        LOG(ERROR) << "Failed to load snapshot " << name_and_id.first
+                   << " of the delta chain: " << level_files.error().Format();
+        service_.SwitchState(GlobalState::LOADING, GlobalState::ACTIVE);
+        return immediate(level_files.error());
+      }
 
-    // For single file, choose thread that does not handle shards if possible.
-    // This will balance out the CPU during the load.
-    ProactorBase* proactor;
-    if (paths.size() == 1 && shard_count() < pool.size()) {
-      proactor = pool.at(shard_count());
-    } else {
-      proactor = pool.GetNextProactor();
+      LoadLevel& level = levels.emplace_back();
+      level.files = std::move(*level_files);
+      level.opts.snapshot_id = name_and_id.second;
+      level.opts.shard_count = load_opts.shard_count;
+      level.opts.delta = levels.size() > 1;
+      level.opts.require_snapshot_id = true;
+      level.opts.slots = slots;
     }
+  }
+
+  LoadLevel& last_level = levels.emplace_back();
+  last_level.files = paths;
+  last_level.opts = load_opts;
+  last_level.opts.delta = levels.size() > 1;
+  last_level.opts.require_snapshot_id = levels.size() > 1;
+  last_level.opts.slots = slots;
+
+  // Delta chains are loaded level by level, so only a single snapshot can be served lazily.
+  bool lazy_load = lazy && !slots && levels.size() == 1 && StartLazyLoad(paths, load_opts);
+  if (lazy_load) {
+    last_level.opts.lazy = true;
+    service_.SwitchState(GlobalState::LOADING, GlobalState::ACTIVE);
+    LOG(INFO) << "Loading lazily, the server is active";
+  }
 
-    auto load_func = [=]() mutable {
-      error_code load_ec = LoadRdb(file, existing_keys, &load_opts);
-      if (load_ec) {
-        aggregated_result->first_error = load_ec;
+  auto aggregated_result = std::make_shared<AggregateLoadResult>();
+
+  auto launch_level = [this, aggregated_result, existing_keys, pool = &pool](
+                          const LoadLevel& level, bool is_last) {
+    vector<fb2::Fiber> load_fibers;
+    load_fibers.reserve(level.files.size());
+    for (const auto& file : level.files) {
+      // we have already read summary so we skip it now
+      if (absl::EndsWith(file, "summary.dfs"))
+        continue;
+
+      // Shard files of a snapshot with the same number of shards hold only the keys of their
+      // shard, so they are loaded on its thread that inserts the entries without hops.
+      // Otherwise entries are redistributed to their shards by the loader.
+      optional<ShardId> file_shard;
+      if (level.opts.shard_count == shard_count())
+        file_shard = ShardOfDfsFile(file);
+
+      // For single file, choose thread that does not handle shards if possible.
+      // This will balance out the CPU during the load.
+      ProactorBase* proactor;
+      if (file_shard && *file_shard < shard_count()) {
+        proactor = pool->at(*file_shard);
+      } else if (level.files.size() == 1 && shard_count() < pool->size()) {
+        proactor = pool->at(shard_count());
       } else {
-        aggregated_result->keys_read.fetch_add(load_opts.num_loaded_keys, memory_order_relaxed);
+        proactor = pool->GetNextProactor();
       }
-    };
-    load_fibers.push_back(proactor->LaunchFiber(std::move(load_func)));
-  }
+
+      auto load_func = [=, load_opts = level.opts]() mutable {
+        error_code load_ec = LoadRdb(file, existing_keys, &load_opts);
+        if (load_ec) {
+          aggregated_result->first_error = load_ec;
+        } else {
+          aggregated_result->keys_read.fetch_add(load_opts.num_loaded_keys, memory_order_relaxed);
+          // Only the last snapshot of a chain holds the journal position of the loaded data.
+          if (load_opts.repl_lsn && is_last) {
+            lock_guard lk(aggregated_result->mu);
+            aggregated_result->repl_lsns.emplace_back(load_opts.shard_id, *load_opts.repl_lsn);
+          }
+        }
+      };
+      load_fibers.push_back(proactor->LaunchFiber(std::move(load_func)));
+    }
+    return load_fibers;
+  };
 
   fb2::Future<GenericError> future;
 
   // Run fiber that empties the channel and sets ec_promise.
-  auto load_join_func = [this, aggregated_result, load_fibers = std::move(load_fibers),
-                         future]() mutable {
-    for (auto& fiber : load_fibers) {
-      fiber.Join();
+  auto load_join_func = [this, aggregated_result, launch_level, levels = std::move(levels), future,
+                         repl_id = load_opts.repl_id, shard_count = load_opts.shard_count,
+                         lazy_load]() mutable {
+    for (size_t i = 0; i < levels.size() && !aggregated_result->first_error; ++i) {
+      vector<fb2::Fiber> load_fibers = launch_level(levels[i], i + 1 == levels.size());
+      for (auto& fiber : load_fibers) {
+        fiber.Join();
+      }
     }
 
     if (aggregated_result->first_error) {
@@ -1183,9 +1369,13 @@ std::optional<fb2::Future<GenericError>> ServerFamily::Load(const std::string& p
     } else {
       RdbLoader::PerformPostLoad(&service_);
       LOG(INFO) << "Load finished, num keys read: " << aggregated_result->keys_read;
+      SetSnapshotSyncData(repl_id, shard_count, std::move(aggregated_result->repl_lsns));
     }
 
-    service_.SwitchState(GlobalState::LOADING, GlobalState::ACTIVE);
+    if (lazy_load)
+      lazy_loading_.store(false, memory_order_relaxed);
+    else
+      service_.SwitchState(GlobalState::LOADING, GlobalState::ACTIVE);
     future.Resolve(*(aggregated_result->first_error));
   };
   pool.GetNextProactor()->Dispatch(std::move(load_join_func));
@@ -1193,6 +1383,75 @@ std::optional<fb2::Future<GenericError>> ServerFamily::Load(const std::string& p
   return future;
 }
 
+bool ServerFamily::StartLazyLoad(const vector<string>& paths, const LoadOptions& opts) {
+  if (snapshot_storage_->IsCloud() || opts.shard_count != shard_count()) {
+    LOG(INFO) << "Snapshot can not be loaded lazily, loading it fully";
+    return false;
+  }
+
+  // Every shard file must be loaded on the thread of its shard, that serves its keys.
+  vector<pair<ShardId, string>> shard_files;
+  for (const auto& file : paths) {
+    if (absl::EndsWith(file, "summary.dfs"))
+      continue;
+    optional<ShardId> sid = ShardOfDfsFile(file);
+    if (!sid || *sid >= shard_count()) {
+      LOG(INFO) << "Snapshot can not be loaded lazily, loading it fully";
+      return false;
+    }
+    shard_files.emplace_back(*sid, file);
+  }
+
+  auto& pool = service_.proactor_pool();
+  vector<shared_ptr<detail::LazyKeyFetcher>> fetchers(shard_files.size());
+  bool opened = true;
+  for (size_t i = 0; i < shard_files.size() && opened; ++i) {
+    const auto& [sid, file] = shard_files[i];
+    fetchers[i] = pool.at(sid)->Await([&] {
+      return detail::LazyKeyFetcher::Open(snapshot_storage_.get(), file, opts.snapshot_id);
+    });
+    opened = fetchers[i] != nullptr;
+  }
+
+  // Fetchers are used only on the threads of their shards, so they are released there as well.
+  for (size_t i = 0; i < shard_files.size(); ++i) {
+    ShardId sid = shard_files[i].first;
+    pool.at(sid)->Await([&] {
+      if (opened)
+        namespaces->GetDefaultNamespace().GetDbSlice(sid).SetLazyFetcher(std::move(fetchers[i]));
+      else
+        fetchers[i].reset();
+    });
+  }
+  if (!opened) {
+    LOG(INFO) << "Snapshot can not be loaded lazily, loading it fully";
+    return false;
+  }
+
+  lazy_loading_.store(true, memory_order_relaxed);
+  return true;
+}
+
+io::Result<unique_ptr<io::Source>> ServerFamily::OpenSlotsSource(const string& file,
+                                                                  const LoadOptions& opts) {
+  // Deletions of delta snapshots are not indexed, so their files are read entirely.
+  optional<detail::SnapshotKeyIndex> index;
+  if (!opts.delta && !opts.snapshot_id.empty() && !snapshot_storage_->IsCloud())
+    index = detail::SnapshotKeyIndex::Open(snapshot_storage_.get(), file);
+  if (!index || index->snapshot_id() != opts.snapshot_id)
+    return snapshot_storage_->OpenReadSource(file);
+
+  io::ReadonlyFileOrError res = snapshot_storage_->OpenReadFile(file);
+  if (!res)
+    return nonstd::make_unexpected(res.error());
+
+  unique_ptr<io::ReadonlyFile> shard_file{*res};
+  vector<detail::SnapshotKeyIndex::Chain> ranges =
+      index->RangesOfSlots(*opts.slots, shard_file->Size());
+  VLOG(1) << "Reading " << ranges.size() << " ranges of " << file << " for the requested slots";
+  return make_unique<detail::FileRangesSource>(std::move(shard_file), std::move(ranges));
+}
+
 void ServerFamily::SnapshotScheduling() {
   const std::optional<cron::cronexpr> cron_expr = InferSnapshotCronExpr();
   if (!cron_expr) {
@@ -1237,24 +1496,39 @@ std::error_code ServerFamily::LoadRdb(const std::string& rdb_file, LoadExistingK
   ProactorBase* proactor = fb2::ProactorBase::me();
   error_code result;
   auto fb = proactor->LaunchFiber([&] {
-    io::ReadonlyFileOrError res = snapshot_storage_->OpenReadFile(rdb_file);
+    auto res = load_opts->slots ? OpenSlotsSource(rdb_file, *load_opts)
+                                : snapshot_storage_->OpenReadSource(rdb_file);
     if (!res) {
       result = res.error();
       return;
     }
 
-    io::FileSource fs(*res);
-
     RdbLoader loader{&service_, filt_snapshot_id};
     loader.SetShardCount(load_opts->shard_count);
-    if (existing_keys == LoadExistingKeys::kOverride) {
+    if (existing_keys == LoadExistingKeys::kOverride || load_opts->delta) {
       loader.SetOverrideExistingKeys(true);
     }
+    loader.SetDeltaLoad(load_opts->delta);
+    loader.SetSlotFilter(load_opts->slots.get());
+
+    // Lazily loaded files are loaded on the threads of their shards.
+    shared_ptr<detail::LazyKeyFetcher> fetcher;
+    DbSlice* db_slice = nullptr;
+    if (load_opts->lazy) {
+      db_slice = &namespaces->GetDefaultNamespace().GetDbSlice(EngineShard::tlocal()->shard_id());
+      fetcher = db_slice->lazy_fetcher();
+      loader.SetLazyFetcher(fetcher.get());
+    }
 
-    auto ec = loader.Load(&fs);
+    auto ec = loader.Load(res->get());
+    if (fetcher) {
+      fetcher->Finish();
+      db_slice->SetLazyFetcher(nullptr);
+    }
     if (ec) {
       // We ignore incorrect_snapshot_id, it means we try to load file from incorrect snapshot.
-      if (ec.value() != rdb::errc::incorrect_snapshot_id)
+      // Snapshots of a delta chain must match, otherwise the chain was overwritten.
+      if (ec.value() != rdb::errc::incorrect_snapshot_id || load_opts->require_snapshot_id)
         result = ec;
     } else {
       VLOG(1) << "Done loading RDB from " << rdb_file << ", keys loaded: " << loader.keys_loaded();
@@ -1262,6 +1536,11 @@ std::error_code ServerFamily::LoadRdb(const std::string& rdb_file, LoadExistingK
       load_opts->num_loaded_keys = loader.keys_loaded();
       load_opts->snapshot_id = loader.GetSnapshotId();
       load_opts->shard_count = loader.shard_count();
+      load_opts->shard_id = loader.shard_id();
+      load_opts->repl_lsn = loader.repl_lsn();
+      load_opts->delta_chain = loader.delta_chain();
+      if (!loader.repl_id().empty())
+        load_opts->repl_id = loader.repl_id();
     }
   });
 
@@ -1475,6 +1754,14 @@ void PrintPrometheusMetrics(uint64_t uptime, const Metrics& m, DflyCmd* dfly_cmd
                             &resp->body());
   AppendMetricWithoutLabels("keyspace_misses_total", "", m.events.misses, MetricType::COUNTER,
                             &resp->body());
+  if (GetFlag(FLAGS_cache_mode)) {
+    // Labeled by the eviction policy, so that runs with different policies can be compared.
+    string policy = GetFlag(FLAGS_cache_eviction_policy);
+    AppendMetricHeader("cache_hits_total", "", MetricType::COUNTER, &resp->body());
+    AppendMetricValue("cache_hits_total", m.events.hits, {"policy"}, {policy}, &resp->body());
+    AppendMetricHeader("cache_misses_total", "", MetricType::COUNTER, &resp->body());
+    AppendMetricValue("cache_misses_total", m.events.misses, {"policy"}, {policy}, &resp->body());
+  }
   AppendMetricWithoutLabels("keyspace_mutations_total", "", m.events.mutations, MetricType::COUNTER,
                             &resp->body());
   AppendMetricWithoutLabels("lua_interpreter_cnt", "", m.lua_stats.interpreter_cnt,
@@ -1552,9 +1839,70 @@ void PrintPrometheusMetrics(uint64_t uptime, const Metrics& m, DflyCmd* dfly_cmd
                         &command_metrics);
     }
 
+    AppendMetricHeader("commands_input_bytes_total", "Argument bytes of the commands",
+                       MetricType::COUNTER, &command_metrics);
+    for (const auto& [name, stat] : m.cmd_resource_stats_map) {
+      AppendMetricValue("commands_input_bytes_total", stat.input_bytes, {"cmd"}, {name},
+                        &command_metrics);
+    }
+
+    AppendMetricHeader("commands_output_bytes_total", "Reply bytes of the commands",
+                       MetricType::COUNTER, &command_metrics);
+    for (const auto& [name, stat] : m.cmd_resource_stats_map) {
+      AppendMetricValue("commands_output_bytes_total", stat.output_bytes, {"cmd"}, {name},
+                        &command_metrics);
+    }
+
+    AppendMetricHeader("commands_shard_seconds_total",
+                       "Time the commands spent running in the shards", MetricType::COUNTER,
+                       &command_metrics);
+    for (const auto& [name, stat] : m.cmd_resource_stats_map) {
+      const double shard_seconds = double(stat.shard_cycles) / base::CycleClock::Frequency();
+      AppendMetricValue("commands_shard_seconds_total", shard_seconds, {"cmd"}, {name},
+                        &command_metrics);
+    }
+
     absl::StrAppend(&resp->body(), command_metrics);
   }
 
+  if (!m.tx_phase_stats_map.empty()) {
+    string tx_metrics;
+    auto append_hist = [&](string_view name, const TxPhaseStats::Hist& hist, double scale,
+                           absl::Span<const string_view> names, vector<string_view> values) {
+      vector<string_view> bucket_names(names.begin(), names.end());
+      bucket_names.push_back("le");
+      uint64_t cumulative = 0;
+      for (unsigned i = 0; i < TxPhaseStats::kNumBuckets; ++i) {
+        cumulative += hist.buckets[i];
+        string le = i + 1 == TxPhaseStats::kNumBuckets ? "+Inf" : absl::StrCat((1ULL << i) * scale);
+        values.push_back(le);
+        AppendMetricValue(StrCat(name, "_bucket"), cumulative, bucket_names, values, &tx_metrics);
+        values.pop_back();
+      }
+      AppendMetricValue(StrCat(name, "_sum"), hist.sum * scale, names, values, &tx_metrics);
+      AppendMetricValue(StrCat(name, "_count"), hist.count, names, values, &tx_metrics);
+    };
+
+    AppendMetricHeader("tx_phase_duration_seconds",
+                       "Duration of transaction phases per command: scheduling, waiting in the "
+                       "shard queue and executing a hop",
+                       MetricType::HISTOGRAM, &tx_metrics);
+    for (const auto& [name, tx_stats] : m.tx_phase_stats_map) {
+      for (auto phase : {TxPhaseStats::SCHEDULE, TxPhaseStats::QUEUE_WAIT, TxPhaseStats::EXECUTION}) {
+        append_hist("tx_phase_duration_seconds", tx_stats.phases[phase], 1e-6, {"cmd", "phase"},
+                    {name, TxPhaseStats::PhaseName(phase)});
+      }
+    }
+
+    AppendMetricHeader("tx_hops", "Number of hops per transaction per command",
+                       MetricType::HISTOGRAM, &tx_metrics);
+    for (const auto& [name, tx_stats] : m.tx_phase_stats_map) {
+      append_hist("tx_hops", tx_stats.phases[TxPhaseStats::HOPS], 1, {"cmd"}, {name});
+    }
+
+    absl::StrAppend(&resp->body(), tx_metrics);
+  }
+
   if (m.replica_side_info) {  // slave side
     auto& replica_info = *m.replica_side_info;
     AppendMetricWithoutLabels("replica_reconnect_count", "Number of replica reconnects",
@@ -1597,6 +1945,42 @@ void PrintPrometheusMetrics(uint64_t uptime, const Metrics& m, DflyCmd* dfly_cmd
                             &resp->body());
   AppendMetricWithoutLabels("tx_queue_len", "", m.tx_queue_len, MetricType::GAUGE, &resp->body());
 
+  if (!m.fiber_sched_per_thread.empty()) {
+    string sched_metrics;
+    AppendMetricHeader("fiber_sched_delay_seconds",
+                       "Delay of resuming a ready fiber per thread, sampled by a probe fiber",
+                       MetricType::SUMMARY, &sched_metrics);
+    for (size_t i = 0; i < m.fiber_sched_per_thread.size(); ++i) {
+      const auto& st = m.fiber_sched_per_thread[i];
+      string thread = absl::StrCat(i);
+      AppendMetricValue("fiber_sched_delay_seconds", st.delay_p50_usec * 1e-6,
+                        {"thread", "quantile"}, {thread, "0.5"}, &sched_metrics);
+      AppendMetricValue("fiber_sched_delay_seconds", st.delay_p99_usec * 1e-6,
+                        {"thread", "quantile"}, {thread, "0.99"}, &sched_metrics);
+      AppendMetricValue("fiber_sched_delay_seconds", st.delay_max_usec * 1e-6,
+                        {"thread", "quantile"}, {thread, "1"}, &sched_metrics);
+      AppendMetricValue("fiber_sched_delay_seconds_count", st.probe_cnt, {"thread"}, {thread},
+                        &sched_metrics);
+    }
+
+    AppendMetricHeader("fiber_longrun_thread_seconds",
+                       "Time of fiber runs longer than 1ms without yielding per thread",
+                       MetricType::COUNTER, &sched_metrics);
+    for (size_t i = 0; i < m.fiber_sched_per_thread.size(); ++i) {
+      AppendMetricValue("fiber_longrun_thread_seconds",
+                        m.fiber_sched_per_thread[i].longrun_usec * 1e-6, {"thread"},
+                        {absl::StrCat(i)}, &sched_metrics);
+    }
+    absl::StrAppend(&resp->body(), sched_metrics);
+  }
+
+  AppendMetricHeader("fiber_yields_total", "Yields of fibers that ran longer than their budget",
+                     MetricType::COUNTER, &resp->body());
+  AppendMetricValue("fiber_yields_total", m.facade_stats.conn_stats.busy_read_yields, {"reason"},
+                    {"busy_read"}, &resp->body());
+  AppendMetricValue("fiber_yields_total", m.coordinator_stats.busy_squash_yields, {"reason"},
+                    {"busy_squash"}, &resp->body());
+
   {
     bool added = false;
     string str;
@@ -1658,6 +2042,41 @@ void PrintPrometheusMetrics(uint64_t uptime, const Metrics& m, DflyCmd* dfly_cmd
   }
 
   absl::StrAppend(&resp->body(), db_key_metrics, db_key_expire_metrics, db_capacity_metrics);
+
+  if (!m.busiest_slots.empty()) {
+    string keys, memory, ops, bytes_in, bytes_out;
+    AppendMetricHeader("slot_keys", "Number of keys of the busiest slots", MetricType::GAUGE,
+                       &keys);
+    AppendMetricHeader("slot_memory_bytes", "Memory used by the busiest slots", MetricType::GAUGE,
+                       &memory);
+    AppendMetricHeader("slot_ops_per_sec", "Reads and writes per second of the busiest slots",
+                       MetricType::GAUGE, &ops);
+    AppendMetricHeader("slot_net_input_bytes", "Request bytes of the busiest slots",
+                       MetricType::COUNTER, &bytes_in);
+    AppendMetricHeader("slot_net_output_bytes", "Reply bytes of the busiest slots",
+                       MetricType::COUNTER, &bytes_out);
+
+    for (const auto& [sid, stats] : m.busiest_slots) {
+      string slot = absl::StrCat(sid);
+      AppendMetricValue("slot_keys", stats.key_count, {"slot"}, {slot}, &keys);
+      AppendMetricValue("slot_memory_bytes", cluster::SlotMemoryUsage(stats), {"slot"}, {slot},
+                        &memory);
+      AppendMetricValue("slot_ops_per_sec", stats.ops_per_sec, {"slot"}, {slot}, &ops);
+      AppendMetricValue("slot_net_input_bytes", stats.bytes_in, {"slot"}, {slot}, &bytes_in);
+      AppendMetricValue("slot_net_output_bytes", stats.bytes_out, {"slot"}, {slot}, &bytes_out);
+    }
+    absl::StrAppend(&resp->body(), keys, memory, ops, bytes_in, bytes_out);
+  }
+
+  if (!m.hot_keys.empty()) {
+    string accesses;
+    AppendMetricHeader("hot_key_accesses",
+                       "Estimated accesses of the hottest keys in the last decay periods",
+                       MetricType::GAUGE, &accesses);
+    for (const auto& [key, count] : m.hot_keys)
+      AppendMetricValue("hot_key_accesses", count, {"key"}, {key}, &accesses);
+    absl::StrAppend(&resp->body(), accesses);
+  }
 }
 
 void ServerFamily::ConfigureMetrics(util::HttpListenerBase* http_base) {
@@ -1668,8 +2087,12 @@ void ServerFamily::ConfigureMetrics(util::HttpListenerBase* http_base) {
     StringResponse resp = util::http::MakeStringResponse(boost::beast::http::status::ok);
     util::http::SetMime(util::http::kTextMime, &resp);
     uint64_t uptime = time(NULL) - start_time_;
-    PrintPrometheusMetrics(uptime, this->GetMetrics(&namespaces->GetDefaultNamespace()),
-                           this->dfly_cmd_.get(), &resp);
+    Metrics metrics = this->GetMetrics(&namespaces->GetDefaultNamespace());
+    if (uint32_t busiest = GetFlag(FLAGS_metrics_busiest_slots); busiest > 0 && IsClusterEnabled())
+      metrics.busiest_slots = cluster::GetBusiestSlots(busiest);
+    if (uint32_t hot_keys = GetFlag(FLAGS_metrics_hot_keys); hot_keys > 0)
+      metrics.hot_keys = CollectHotKeys(&namespaces->GetDefaultNamespace(), hot_keys);
+    PrintPrometheusMetrics(uptime, metrics, this->dfly_cmd_.get(), &resp);
 
     return send->Invoke(std::move(resp));
   };
@@ -1788,18 +2211,26 @@ GenericError ServerFamily::DoSaveCheckAndStart(const SaveCmdOptions& save_cmd_op
   auto [ignore_state, bg_save] = opts;
   auto state = ServerState::tlocal()->gstate();
 
+  // Keys that were not loaded yet would be missing from the snapshot.
+  if (IsLazyLoading()) {
+    return GenericError{make_error_code(errc::operation_in_progress),
+                        "LOADING - can not save database"};
+  }
+
   // In some cases we want to create a snapshot even if server is not active, f.e in takeover
   if (!ignore_state && (state != GlobalState::ACTIVE && state != GlobalState::SHUTTING_DOWN)) {
     return GenericError{make_error_code(errc::operation_in_progress),
                         StrCat(GlobalStateName(state), " - can not save database")};
   }
   // Check if save is already in progress
+  detail::DeltaChain delta_chain;
   {
     util::fb2::LockGuard lk(save_mu_);
     if (save_controller_) {
       return GenericError{make_error_code(errc::operation_in_progress),
                           "SAVING - can not save database"};
     }
+    delta_chain = delta_chain_;
   }
 
   // Create save controller outside of mutex to avoid blocking INFO commands
@@ -1809,7 +2240,7 @@ GenericError ServerFamily::DoSaveCheckAndStart(const SaveCmdOptions& save_cmd_op
 
   auto temp_save_controller = make_unique<SaveStagesController>(detail::SaveStagesInputs{
       save_cmd_opts.new_version, save_cmd_opts.cloud_uri, save_cmd_opts.basename, trans, &service_,
-      fq_threadpool_.get(), snapshot_storage, opts.bg_save});
+      fq_threadpool_.get(), snapshot_storage, opts.bg_save, std::move(delta_chain)});
 
   // Initialize resources outside of mutex (this may take time for S3 operations)
   auto res = temp_save_controller->InitResourcesAndStart();
@@ -1827,6 +2258,7 @@ GenericError ServerFamily::DoSaveCheckAndStart(const SaveCmdOptions& save_cmd_op
     if (res) {
       DCHECK_EQ(res->error, true);
       last_save_info_.SetLastSaveError(*res);
+      delta_chain_.clear();
       // Don't set save_controller_ since initialization failed
       if (bg_save) {
         last_save_info_.last_bgsave_status = false;
@@ -1863,6 +2295,7 @@ GenericError ServerFamily::WaitUntilSaveFinished(Transaction* trans, bool ignore
       last_save_info_.file_name = save_info.file_name;
       last_save_info_.freq_map = save_info.freq_map;
     }
+    delta_chain_ = std::move(save_info.delta_chain);
     save_controller_.reset();
   }
 
@@ -2001,6 +2434,7 @@ bool ServerFamily::DoAuth(ConnectionContext* cntx, std::string_view username,
     cntx->ns = &namespaces->GetOrInsert(cred.ns);
     cntx->authenticated = true;
     cntx->acl_db_idx = cred.db;
+    cntx->rate_limiter.SetRate(cred.rate_limit);
     if (cred.db == std::numeric_limits<size_t>::max()) {
       cntx->conn_state.db_index = 0;
     } else {
@@ -2092,7 +2526,7 @@ void ClientHelp(SinkReplyBuilder* builder) {
       "Set client meta attr. Options are:",
       "    * LIB-NAME: the client lib name.",
       "    * LIB-VER: the client lib version.",
-      "TRACKING (ON|OFF) [OPTIN] [OPTOUT] [NOLOOP]",
+      "TRACKING (ON|OFF) [BCAST] [PREFIX <prefix> ...] [OPTIN] [OPTOUT] [NOLOOP]",
       "    Control server assisted client side caching.",
       "HELP",
       "    Print this help."};
@@ -2324,6 +2758,7 @@ static void MergeDbSliceStats(const DbSlice::Stats& src, Metrics* dest) {
 
   dest->events += src.events;
   dest->small_string_bytes += src.small_string_bytes;
+  dest->async_free_pending_bytes += src.async_free_pending_bytes;
 }
 
 void ServerFamily::ResetStat(Namespace* ns) {
@@ -2349,6 +2784,9 @@ Metrics ServerFamily::GetMetrics(Namespace* ns) const {
 
   uint64_t start = absl::GetCurrentTimeNanos();
 
+  result.tx_shard_local_pct_per_thread.resize(shard_set->pool()->size());
+  result.fiber_sched_per_thread.resize(shard_set->pool()->size());
+
   auto cmd_stat_cb = [&dest = result.cmd_stats_map](string_view name, const CmdCallStats& stat) {
     auto& [calls, sum] = dest[absl::AsciiStrToLower(name)];
     calls += stat.first;
@@ -2369,7 +2807,11 @@ Metrics ServerFamily::GetMetrics(Namespace* ns) const {
     result.worker_fiber_count += fb2::WorkerFibersCount();
     result.blocked_tasks += TaskQueue::blocked_submitters();
 
+    result.fiber_sched_per_thread[index] = ss->GetSchedStats();
+
     result.coordinator_stats.Add(ss->stats);
+    if (uint64_t single = ss->stats.tx_shard_local_cnt + ss->stats.tx_shard_remote_cnt; single)
+      result.tx_shard_local_pct_per_thread[index] = ss->stats.tx_shard_local_cnt * 100 / single;
 
     result.qps += uint64_t(ss->MovingSum6());
     result.facade_stats += *tl_facade_stats;
@@ -2380,6 +2822,11 @@ Metrics ServerFamily::GetMetrics(Namespace* ns) const {
       MergeDbSliceStats(ns->GetDbSlice(shard->shard_id()).GetStats(), &result);
       result.shard_stats += shard->stats();
 
+      if (const auto* hp = shard->huge_page_resource(); hp) {
+        result.table_hugepage_bytes += hp->arena_bytes();
+        result.table_hugepage_used_bytes += hp->used();
+      }
+
       if (shard->tiered_storage()) {
         result.tiered_stats += shard->tiered_storage()->GetStats();
       }
@@ -2402,6 +2849,7 @@ Metrics ServerFamily::GetMetrics(Namespace* ns) const {
     if (ss->journal()) {
       result.lsn_buffer_size += ss->journal()->LsnBufferSize();
       result.lsn_buffer_bytes += ss->journal()->LsnBufferBytes();
+      result.lsn_disk_bytes += ss->journal()->LsnDiskBytes();
     }
 
     auto connections_lib_name_ver_map = facade::Connection::GetLibStatsTL();
@@ -2421,6 +2869,15 @@ Metrics ServerFamily::GetMetrics(Namespace* ns) const {
           min<uint64_t>(result.oldest_pending_send_ts, oldest_member.timestamp_ns);
     }
     service_.mutable_registry()->MergeCallStats(index, cmd_stat_cb);
+    service_.mutable_registry()->MergeResourceStats(
+        index,
+        [&dest = result.cmd_resource_stats_map](string_view name, const CmdResourceStats& stats) {
+          dest[absl::AsciiStrToLower(name)] += stats;
+        });
+    service_.mutable_registry()->MergeTxPhaseStats(
+        index, [&dest = result.tx_phase_stats_map](string_view name, const TxPhaseStats& stats) {
+          dest[absl::AsciiStrToLower(name)] += stats;
+        });
   };  // cb
 
   service_.proactor_pool().AwaitFiberOnAll(std::move(cb));
@@ -2582,11 +3039,18 @@ string ServerFamily::FormatInfoMetrics(const Metrics& m, std::string_view sectio
       }
     }
     append("table_used_memory", total.table_mem_usage);
+    if (total.expire_wheel_mem_usage > 0)
+      append("expire_wheel_used_memory", total.expire_wheel_mem_usage);
     append("prime_capacity", total.prime_capacity);
     append("expire_capacity", total.expire_capacity);
     append("num_entries", total.key_count);
     append("inline_keys", total.inline_keys);
     append("small_string_bytes", m.small_string_bytes);
+    append("async_free_pending_bytes", m.async_free_pending_bytes);
+    if (m.table_hugepage_bytes > 0) {
+      append("table_hugepage_bytes", m.table_hugepage_bytes);
+      append("table_hugepage_used_bytes", m.table_hugepage_used_bytes);
+    }
     append("pipeline_cache_bytes", m.facade_stats.conn_stats.pipeline_cmd_cache_bytes);
     append("dispatch_queue_bytes", m.facade_stats.conn_stats.dispatch_queue_bytes);
     append("dispatch_queue_subscriber_bytes",
@@ -2599,11 +3063,13 @@ string ServerFamily::FormatInfoMetrics(const Metrics& m, std::string_view sectio
            m.facade_stats.reply_stats.squashing_current_reply_size.load(memory_order_relaxed));
     append("psync_buffer_size", m.lsn_buffer_size);
     append("psync_buffer_bytes", m.lsn_buffer_bytes);
+    append("psync_disk_bytes", m.lsn_disk_bytes);
 
     if (GetFlag(FLAGS_cache_mode)) {
       append("cache_mode", "cache");
       // PHP Symphony needs this field to work.
       append("maxmemory_policy", "eviction");
+      append("cache_eviction_policy", GetFlag(FLAGS_cache_eviction_policy));
     } else {
       append("cache_mode", "store");
       // Compatible with redis based frameworks.
@@ -2636,15 +3102,36 @@ string ServerFamily::FormatInfoMetrics(const Metrics& m, std::string_view sectio
     append("instantaneous_ops_per_sec", m.qps);
     append("total_pipelined_commands", conn_stats.pipelined_cmd_cnt);
     append("pipeline_throttle_total", conn_stats.pipeline_throttle_count);
+    append("client_output_buffer_limit_disconnections",
+           conn_stats.output_buffer_limit_disconnects);
     append("pipelined_latency_usec", conn_stats.pipelined_cmd_latency);
     append("total_net_input_bytes", conn_stats.io_read_bytes);
     append("connection_migrations", conn_stats.num_migrations);
+    append("tx_shard_local_total", m.coordinator_stats.tx_shard_local_cnt);
+    append("tx_shard_remote_total", m.coordinator_stats.tx_shard_remote_cnt);
+    append("tx_shard_local_pct_per_thread", absl::StrJoin(m.tx_shard_local_pct_per_thread, ","));
+    auto join_sched = [&m](uint64_t ServerState::SchedStats::*field) {
+      return absl::StrJoin(m.fiber_sched_per_thread, ",",
+                           [field](string* out, const auto& st) { absl::StrAppend(out, st.*field); });
+    };
+    append("fiber_sched_delay_p50_usec_per_thread",
+           join_sched(&ServerState::SchedStats::delay_p50_usec));
+    append("fiber_sched_delay_p99_usec_per_thread",
+           join_sched(&ServerState::SchedStats::delay_p99_usec));
+    append("fiber_sched_delay_max_usec_per_thread",
+           join_sched(&ServerState::SchedStats::delay_max_usec));
+    append("fiber_longrun_usec_per_thread", join_sched(&ServerState::SchedStats::longrun_usec));
+    append("busy_read_yields", conn_stats.busy_read_yields);
+    append("busy_squash_yields", m.coordinator_stats.busy_squash_yields);
     append("connection_recv_provided_calls", conn_stats.num_recv_provided_calls);
     append("total_net_output_bytes", reply_stats.io_write_bytes);
     append("rdb_save_usec", m.coordinator_stats.rdb_save_usec);
     append("rdb_save_count", m.coordinator_stats.rdb_save_count);
     append("big_value_preemptions", m.coordinator_stats.big_value_preemptions);
     append("compressed_blobs", m.coordinator_stats.compressed_blobs);
+    append("offload_stolen_tasks", OffloadQueue::stolen_tasks());
+    append("json_path_cache_hits", m.coordinator_stats.json_path_cache_hits);
+    append("json_path_cache_misses", m.coordinator_stats.json_path_cache_misses);
     append("instantaneous_input_kbps", -1);
     append("instantaneous_output_kbps", -1);
     append("rejected_connections", -1);
@@ -2653,21 +3140,32 @@ string ServerFamily::FormatInfoMetrics(const Metrics& m, std::string_view sectio
     append("total_heartbeat_expired_keys", m.shard_stats.total_heartbeat_expired_keys);
     append("total_heartbeat_expired_bytes", m.shard_stats.total_heartbeat_expired_bytes);
     append("total_heartbeat_expired_calls", m.shard_stats.total_heartbeat_expired_calls);
+    append("active_expire_budget", m.shard_stats.active_expire_budget);
+    append("active_expire_throttled_total", m.shard_stats.active_expire_throttled_total);
     append("hard_evictions", m.events.hard_evictions);
     append("garbage_checked", m.events.garbage_checked);
     append("garbage_collected", m.events.garbage_collected);
     append("bump_ups", m.events.bumpups);
     append("stash_unloaded", m.events.stash_unloaded);
     append("oom_rejections", m.events.insertion_rejections + m.coordinator_stats.oom_error_cmd_cnt);
+    append("rate_limited_commands", m.coordinator_stats.rate_limited_cmd_cnt);
     append("traverse_ttl_sec", m.traverse_ttl_per_sec);
     append("delete_ttl_sec", m.delete_ttl_per_sec);
     append("keyspace_hits", m.events.hits);
     append("keyspace_misses", m.events.misses);
+    if (GetFlag(FLAGS_cache_mode)) {
+      // The eviction policy is fixed at startup, so these are the hits and misses under it.
+      string policy = GetFlag(FLAGS_cache_eviction_policy);
+      append(absl::StrCat("cache_", policy, "_hits"), m.events.hits);
+      append(absl::StrCat("cache_", policy, "_misses"), m.events.misses);
+    }
     append("keyspace_mutations", m.events.mutations);
     append("total_reads_processed", conn_stats.io_read_cnt);
     append("total_writes_processed", reply_stats.io_write_cnt);
     append("huffenc_attempt_total", m.events.huff_encode_total);
     append("huffenc_success_total", m.events.huff_encode_success);
+    append("zstdenc_attempt_total", m.events.zstd_encode_total);
+    append("zstdenc_success_total", m.events.zstd_encode_success);
     append("defrag_attempt_total", m.shard_stats.defrag_attempt_total);
     append("defrag_realloc_total", m.shard_stats.defrag_realloc_total);
     append("defrag_task_invocation_total", m.shard_stats.defrag_task_invocation_total);
@@ -2685,6 +3183,7 @@ string ServerFamily::FormatInfoMetrics(const Metrics& m, std::string_view sectio
     append("lua_force_gc_calls", m.lua_stats.force_gc_calls);
     append("lua_gc_freed_memory_total", m.lua_stats.gc_freed_memory);
     append("lua_gc_duration_total_sec", m.lua_stats.gc_duration_ns * 1e-9);
+    append("lua_script_memory_limit_errors_total", m.lua_stats.script_mem_limit_errors);
   };
 
   auto add_tiered_info = [&] {
@@ -2702,6 +3201,7 @@ string ServerFamily::FormatInfoMetrics(const Metrics& m, std::string_view sectio
 
     append("tiered_allocated_bytes", m.tiered_stats.allocated_bytes);
     append("tiered_capacity_bytes", m.tiered_stats.capacity_bytes);
+    append("tiered_punched_bytes", m.tiered_stats.punched_bytes);
 
     append("tiered_pending_read_cnt", m.tiered_stats.pending_read_cnt);
     append("tiered_pending_stash_cnt", m.tiered_stats.pending_stash_cnt);
@@ -2712,9 +3212,21 @@ string ServerFamily::FormatInfoMetrics(const Metrics& m, std::string_view sectio
     append("tiered_cold_storage_bytes", m.tiered_stats.cold_storage_bytes);
     append("tiered_offloading_steps", m.tiered_stats.total_offloading_steps);
     append("tiered_offloading_stashes", m.tiered_stats.total_offloading_stashes);
+    append("tiered_offloading_rereads", m.tiered_stats.total_offloading_rereads);
     append("tiered_ram_hits", m.events.ram_hits);
     append("tiered_ram_cool_hits", m.events.ram_cool_hits);
     append("tiered_ram_misses", m.events.ram_misses);
+
+    const auto& ts = m.tiered_stats;
+    size_t offloaded_hits = m.events.ram_cool_hits + m.events.ram_misses;
+    append("tiered_cool_entries", ts.cool_entries);
+    append("tiered_cool_protected_entries", ts.cool_protected_entries);
+    append("tiered_cool_hit_rate",
+           offloaded_hits ? double(m.events.ram_cool_hits) / offloaded_hits : 0.0);
+    append("tiered_cool_reclaims", ts.total_cool_reclaims);
+    append("tiered_cool_reclaimed_entries", ts.total_cool_reclaimed_entries);
+    append("tiered_cool_reclaim_avg_usec",
+           ts.total_cool_reclaims ? ts.cool_reclaim_usec / ts.total_cool_reclaims : 0);
   };
 
   auto add_persistence_info = [&] {
@@ -2774,7 +3286,10 @@ string ServerFamily::FormatInfoMetrics(const Metrics& m, std::string_view sectio
   auto add_tx_info = [&] {
     append("tx_shard_polls", m.shard_stats.poll_execution_total);
     append("tx_shard_optimistic_total", m.shard_stats.tx_optimistic_total);
+    append("tx_shard_optimistic_read_total", m.shard_stats.tx_optimistic_read_total);
+    append("tx_shard_optimistic_read_retries", m.shard_stats.tx_optimistic_read_retries);
     append("tx_shard_ooo_total", m.shard_stats.tx_ooo_total);
+    append("tx_shard_ooo_promoted_total", m.shard_stats.tx_ooo_promoted_total);
     append("tx_global_total", m.coordinator_stats.tx_global_cnt);
     append("tx_normal_total", m.coordinator_stats.tx_normal_cnt);
     append("tx_inline_runs_total", m.coordinator_stats.tx_inline_runs);
@@ -2783,6 +3298,8 @@ string ServerFamily::FormatInfoMetrics(const Metrics& m, std::string_view sectio
     append("tx_batch_schedule_calls_total", m.shard_stats.tx_batch_schedule_calls_total);
     append("tx_with_freq", absl::StrJoin(m.coordinator_stats.tx_width_freq_arr, ","));
     append("squash_with_freq", absl::StrJoin(m.coordinator_stats.squash_width_freq_arr, ","));
+    append("multi_snapshot_total", m.coordinator_stats.multi_snapshot_executions);
+    append("multi_snapshot_conflicts_total", m.coordinator_stats.multi_snapshot_conflicts);
     append("tx_queue_len", m.tx_queue_len);
 
     append("eval_io_coordination_total", m.coordinator_stats.eval_io_coordination_cnt);
@@ -2846,6 +3363,36 @@ string ServerFamily::FormatInfoMetrics(const Metrics& m, std::string_view sectio
     }
   };
 
+  // Per flow state of stable sync, to find lagging or throttled flows.
+  auto add_repl_flows_info = [&] {
+    fb2::LockGuard lk(replicaof_mu_);
+    if (!replica_) {
+      vector<vector<ReplicaFlowStats>> replicas = dfly_cmd_->GetReplicaFlowStats();
+      for (size_t i = 0; i < replicas.size(); i++) {
+        for (const ReplicaFlowStats& flow : replicas[i]) {
+          append(StrCat("slave", i, "_flow", flow.flow_id),
+                 StrCat("lag=", flow.lsn_lag, ",acked_lsn=", flow.acked_lsn,
+                        ",inflight_bytes=", flow.inflight_bytes,
+                        ",pending_bytes=", flow.pending_bytes, ",sent_bytes=", flow.sent_bytes,
+                        ",writes=", flow.writes, ",forced_writes=", flow.forced_writes,
+                        ",throttled=", flow.throttle_count, ",throttle_usec=", flow.throttle_usec,
+                        ",acks=", flow.acks, ",ack_latency_p50_usec=", flow.ack_latency_p50_usec,
+                        ",ack_latency_p99_usec=", flow.ack_latency_p99_usec));
+        }
+      }
+      return;
+    }
+
+    vector<Replica::FlowStats> flows = replica_->GetFlowStats();
+    for (size_t i = 0; i < flows.size(); i++) {
+      const Replica::FlowStats& flow = flows[i];
+      append(StrCat("flow", i),
+             StrCat("received=", flow.received, ",executed=", flow.executed,
+                    ",master_lsn=", flow.master_lsn, ",apply_queued=", flow.apply_queued,
+                    ",acks_sent=", flow.acks_sent));
+    }
+  };
+
   auto add_cmdstats = [&] {
     auto append_sorted = [&append](string_view prefix, auto display) {
       sort(display.begin(), display.end());
@@ -2857,10 +3404,18 @@ string ServerFamily::FormatInfoMetrics(const Metrics& m, std::string_view sectio
     vector<pair<string_view, string>> commands;
     for (const auto& [name, stats] : m.cmd_stats_map) {
       const auto calls = stats.first, sum = stats.second;
-      commands.push_back(
-          {name, absl::StrJoin({absl::StrCat("calls=", calls), absl::StrCat("usec=", sum),
-                                absl::StrCat("usec_per_call=", static_cast<double>(sum) / calls)},
-                               ",")});
+      string line =
+          absl::StrJoin({absl::StrCat("calls=", calls), absl::StrCat("usec=", sum),
+                         absl::StrCat("usec_per_call=", static_cast<double>(sum) / calls)},
+                        ",");
+      if (auto it = m.cmd_resource_stats_map.find(name); it != m.cmd_resource_stats_map.end()) {
+        const CmdResourceStats& res = it->second;
+        uint64_t shard_usec =
+            uint64_t(double(res.shard_cycles) * 1e6 / base::CycleClock::Frequency());
+        absl::StrAppend(&line, ",input_bytes=", res.input_bytes, ",output_bytes=", res.output_bytes,
+                        ",shard_usec=", shard_usec, ",hops=", res.hops);
+      }
+      commands.push_back({name, std::move(line)});
     }
 
     auto unknown_cmd = service_.UknownCmdMap();
@@ -2902,6 +3457,10 @@ string ServerFamily::FormatInfoMetrics(const Metrics& m, std::string_view sectio
     add_repl_info();
   }
 
+  if (should_enter("REPLICATION_FLOWS", true)) {
+    add_repl_flows_info();
+  }
+
   if (should_enter("COMMANDSTATS", true)) {
     add_cmdstats();
   }
@@ -2983,6 +3542,22 @@ string ServerFamily::FormatInfoMetrics(const Metrics& m, std::string_view sectio
 
       append(absl::StrFormat("latency_percentiles_usec_%s", cmd_name), absl::StrJoin(stats, ","));
     }
+
+    // Transaction phases are bucketed by powers of two, so the percentiles are upper bounds.
+    for (const auto& [cmd_name, tx_stats] : m.tx_phase_stats_map) {
+      for (unsigned i = 0; i < TxPhaseStats::NUM_PHASES; ++i) {
+        const auto& hist = tx_stats.phases[i];
+        if (hist.count == 0)
+          continue;
+
+        absl::InlinedVector<std::string, 4> stats;
+        for (const auto percentile : kLatencyPercentiles) {
+          stats.emplace_back(absl::StrFormat("p%g=%d", percentile, hist.Percentile(percentile)));
+        }
+        const char* phase = TxPhaseStats::PhaseName(TxPhaseStats::Phase(i));
+        append(absl::StrFormat("tx_%s_%s", phase, cmd_name), absl::StrJoin(stats, ","));
+      }
+    }
   }
 
   return info;
@@ -3002,7 +3577,7 @@ void ServerFamily::Info(CmdArgList args, const CommandContext& cmd_cntx) {
   Metrics metrics;
 
   // Save time by not calculating metrics if we don't need them.
-  if (!(section == "SERVER" || section == "REPLICATION")) {
+  if (!(section == "SERVER" || section == "REPLICATION" || section == "REPLICATION_FLOWS")) {
     metrics = GetMetrics(cmd_cntx.conn_cntx->ns);
   }
 
@@ -3143,7 +3718,7 @@ void ServerFamily::ReplicaOfInternal(CmdArgList args, Transaction* tx, SinkReply
 
     // We should not execute replica of command while loading from snapshot.
     ServerState* ss = ServerState::tlocal();
-    if (ss->is_master && ss->gstate() == GlobalState::LOADING) {
+    if (ss->is_master && (ss->gstate() == GlobalState::LOADING || IsLazyLoading())) {
       builder->SendError(kLoadingErr);
       return;
     }
@@ -3193,6 +3768,11 @@ void ServerFamily::ReplicaOfInternal(CmdArgList args, Transaction* tx, SinkReply
 
     replica_ = new_replica;
 
+    // The loaded snapshot can only be continued by the first replication after it was loaded.
+    if (snapshot_sync_data_ && GetFlag(FLAGS_replica_partial_sync_from_snapshot))
+      new_replica->SetSnapshotSyncData(std::move(*snapshot_sync_data_));
+    snapshot_sync_data_.reset();
+
     // TODO: disconnect pending blocked clients (pubsub, blocking commands)
     SetMasterFlagOnAllThreads(false);  // Flip flag after assiging replica
 
@@ -3250,6 +3830,53 @@ void ServerFamily::ReplicaOf(CmdArgList args, const CommandContext& cmd_cntx) {
   ReplicaOfInternal(args, cmd_cntx.tx, cmd_cntx.rb, ActionOnConnectionFail::kReturnOnError);
 }
 
+void ServerFamily::SetSnapshotSyncData(string repl_id, uint32_t shard_count,
+                                       vector<pair<uint32_t, LSN>> repl_lsns) {
+  util::fb2::LockGuard lk(replicaof_mu_);
+  snapshot_sync_data_.reset();
+
+  // All shard files must have been saved while the journal was active.
+  if (repl_id.empty() || shard_count == 0 || repl_lsns.size() != shard_count)
+    return;
+
+  Replica::LastMasterSyncData data{std::move(repl_id), vector<LSN>(shard_count)};
+  for (auto [sid, lsn] : repl_lsns) {
+    if (sid >= shard_count)
+      return;
+    data.last_journal_LSNs[sid] = lsn;
+  }
+
+  VLOG(1) << "Snapshot of master " << data.id
+          << " can be continued from lsns: " << absl::StrJoin(data.last_journal_LSNs, ",");
+
+  // A master restarted from its own snapshot continues the journal of the snapshot, so that the
+  // replicas started from the same snapshot only need a partial sync. This is possible only
+  // before the journal recorded anything.
+  bool is_master = !GetFlag(FLAGS_replicaof).has_value() && !replica_;
+  if (GetFlag(FLAGS_replica_partial_sync_from_snapshot) && is_master &&
+      shard_count == shard_set->size()) {
+    // All shards must continue the snapshot, otherwise the shards that did are moved back to the
+    // fresh journal start.
+    vector<char> continued(shard_count, 0);
+    shard_set->RunBriefInParallel([&](EngineShard* shard) {
+      ShardId sid = shard->shard_id();
+      continued[sid] = journal_->SetStartLsn(data.last_journal_LSNs[sid]);
+    });
+    if (all_of(continued.begin(), continued.end(), [](char c) { return c; })) {
+      LOG(INFO) << "Continuing replication id " << data.id << " of the loaded snapshot";
+      master_replid_ = data.id;
+    } else {
+      LOG(WARNING) << "Could not continue the journal of the loaded snapshot";
+      shard_set->RunBriefInParallel([&](EngineShard* shard) {
+        if (continued[shard->shard_id()])
+          journal_->SetStartLsn(1);
+      });
+    }
+  }
+
+  snapshot_sync_data_ = std::move(data);
+}
+
 void ServerFamily::Replicate(string_view host, string_view port) {
   StringVec replicaof_params{string(host), string(port)};
 
@@ -3315,7 +3942,13 @@ void ServerFamily::ReplConf(CmdArgList args, const CommandContext& cmd_cntx) {
   {
     util::fb2::LockGuard lk(replicaof_mu_);
     if (!ServerState::tlocal()->is_master) {
-      return builder->SendError("Replicating a replica is unsupported");
+      if (!GetFlag(FLAGS_replica_relay))
+        return builder->SendError("Replicating a replica is unsupported");
+
+      // The commands applied in stable sync are journaled, the snapshot of a full sync is not.
+      // Replicas attached before the full sync completes would miss its data.
+      if (!replica_ || !replica_->GetSummary().full_sync_done)
+        return builder->SendError("Replica is not in stable sync");
     }
   }
 
@@ -3378,6 +4011,12 @@ void ServerFamily::ReplConf(CmdArgList args, const CommandContext& cmd_cntx) {
         return builder->SendError(kInvalidIntErr);
       }
       dfly_cmd_->SetDflyClientVersion(&cntx->conn_state, DflyVersion(version));
+    } else if (cmd == "JOURNAL-COMPRESSION" && args.size() == 2) {
+      auto compression = journal::ParseStreamCompression(arg);
+      if (!compression) {
+        return builder->SendError(kSyntaxErr);
+      }
+      dfly_cmd_->SetJournalCompression(&cntx->conn_state, *compression);
     } else if (cmd == "ACK" && args.size() == 2) {
       // Don't send error/Ok back through the socket, because we don't want to interleave with
       // the journal writes that we write into the same socket.
@@ -3393,7 +4032,7 @@ void ServerFamily::ReplConf(CmdArgList args, const CommandContext& cmd_cntx) {
         return;
       }
       VLOG(2) << "Received client ACK=" << ack;
-      cntx->replication_flow->last_acked_lsn = ack;
+      cntx->replication_flow->OnAck(ack);
       return;
     } else {
       VLOG(1) << "Error " << cmd << " " << arg << " " << args.size();
@@ -3404,6 +4043,80 @@ void ServerFamily::ReplConf(CmdArgList args, const CommandContext& cmd_cntx) {
   return builder->SendOk();
 }
 
+// LSNTOKEN [key]
+// Returns a token of the journal position on the master, either of all shards or of the shard of
+// the key. It covers all writes that completed before the call, so a replica that reached it
+// (see WAITLSN) serves reads that observe them.
+// Token format: <master_replid>:<shard>=<lsn>[,<shard>=<lsn>...]
+void ServerFamily::LsnToken(CmdArgList args, const CommandContext& cmd_cntx) {
+  auto* rb = static_cast<RedisReplyBuilder*>(cmd_cntx.rb);
+  if (args.size() > 1)
+    return rb->SendError(kSyntaxErr);
+
+  {
+    util::fb2::LockGuard lk(replicaof_mu_);
+    if (replica_)
+      return rb->SendError("LSNTOKEN is only supported on a master");
+  }
+
+  vector<pair<ShardId, LSN>> lsns;
+  auto get_lsn = [](EngineShard* shard) -> LSN {
+    return shard->journal() ? shard->journal()->GetLsn() : 0;
+  };
+  if (args.empty()) {
+    lsns.resize(shard_set->size());
+    shard_set->RunBriefInParallel([&](EngineShard* shard) {
+      lsns[shard->shard_id()] = {shard->shard_id(), get_lsn(shard)};
+    });
+  } else {
+    ShardId sid = Shard(ArgS(args, 0), shard_set->size());
+    lsns.emplace_back(sid, shard_set->Await(sid, [&] { return get_lsn(EngineShard::tlocal()); }));
+  }
+
+  string token = StrCat(master_replid_, ":");
+  for (auto [sid, lsn] : lsns)
+    absl::StrAppend(&token, sid, "=", lsn, ",");
+  token.pop_back();
+  rb->SendBulkString(token);
+}
+
+// WAITLSN <token> <timeout_ms>
+// Blocks until this replica applied the master journal up to the token returned by LSNTOKEN.
+// Timeout 0 waits forever.
+void ServerFamily::WaitLsn(CmdArgList args, const CommandContext& cmd_cntx) {
+  auto* rb = static_cast<RedisReplyBuilder*>(cmd_cntx.rb);
+  CmdArgParser parser{args};
+  string_view token = parser.Next<string_view>();
+  uint64_t timeout_ms = parser.Next<uint64_t>();
+  if (auto err = parser.Error(); err)
+    return rb->SendError(err->MakeReply());
+
+  vector<pair<uint32_t, LSN>> flow_lsns;
+  pair<string_view, string_view> id_and_lsns = absl::StrSplit(token, absl::MaxSplits(':', 1));
+  for (string_view part : absl::StrSplit(id_and_lsns.second, ',')) {
+    pair<string_view, string_view> kv = absl::StrSplit(part, absl::MaxSplits('=', 1));
+    uint32_t flow_id;
+    LSN lsn;
+    if (!absl::SimpleAtoi(kv.first, &flow_id) || !absl::SimpleAtoi(kv.second, &lsn))
+      return rb->SendError("invalid lsn token");
+    flow_lsns.emplace_back(flow_id, lsn);
+  }
+
+  shared_ptr<Replica> replica;
+  {
+    util::fb2::LockGuard lk(replicaof_mu_);
+    replica = replica_;
+  }
+  if (!replica)
+    return rb->SendError("WAITLSN is only supported on a replica");
+
+  auto deadline = timeout_ms == 0 ? chrono::steady_clock::time_point::max()
+                                  : chrono::steady_clock::now() + timeout_ms * 1ms;
+  if (!replica->WaitForLsns(id_and_lsns.first, flow_lsns, deadline))
+    return rb->SendError("timed out waiting for lsn token");
+  rb->SendOk();
+}
+
 void ServerFamily::Role(CmdArgList args, const CommandContext& cmd_cntx) {
   auto* rb = static_cast<RedisReplyBuilder*>(cmd_cntx.rb);
   util::fb2::LockGuard lk(replicaof_mu_);
@@ -3464,9 +4177,136 @@ void ServerFamily::LastSave(CmdArgList args, const CommandContext& cmd_cntx) {
 void ServerFamily::Latency(CmdArgList args, const CommandContext& cmd_cntx) {
   auto* rb = static_cast<RedisReplyBuilder*>(cmd_cntx.rb);
   string sub_cmd = absl::AsciiStrToUpper(ArgS(args, 0));
+  args.remove_prefix(1);
 
-  if (sub_cmd == "LATEST") {
-    return rb->SendEmptyArray();
+  if (sub_cmd == "HELP") {
+    string_view help[] = {
+        "LATENCY <subcommand> [<arg> ...]. Subcommands are:",
+        "LATEST",
+        "    Return the latest latency samples of all events.",
+        "    Entries are made of: event, timestamp, latest latency in ms, max latency in ms.",
+        "HISTORY <event>",
+        "    Return the latency samples of the event, made of timestamp and latency in ms.",
+        "RESET [<event> ...]",
+        "    Reset the samples of the events, or of all events.",
+        "HISTOGRAM [<command> ...]",
+        "    Return the latency histograms of the commands, or of all commands.",
+        "    Requires --latency_tracking.",
+        "HELP",
+        "    Prints this help.",
+    };
+    return rb->SendSimpleStrArr(help);
+  }
+
+  // Events of all threads, the samples of the same second are merged into their maximum.
+  auto collect_events = [this] {
+    absl::flat_hash_map<string, pair<uint32_t, absl::btree_map<uint64_t, uint32_t>>> events;
+    util::fb2::Mutex mu;
+    service_.proactor_pool().AwaitFiberOnAll([&](auto index, auto* context) {
+      const auto& local = ServerState::tlocal()->latency_monitor().events();
+      lock_guard lk(mu);
+      for (const auto& [name, event] : local) {
+        auto& [max_ms, history] = events[name];
+        max_ms = max(max_ms, event.max_ms);
+        for (const LatencyMonitor::Sample& sample : event.history) {
+          uint32_t& ms = history[sample.unix_sec];
+          ms = max(ms, sample.latency_ms);
+        }
+      }
+    });
+    return events;
+  };
+
+  if (sub_cmd == "LATEST" && args.empty()) {
+    auto events = collect_events();
+    rb->StartArray(events.size());
+    for (const auto& [name, event] : events) {
+      const auto& [max_ms, history] = event;
+      rb->StartArray(4);
+      rb->SendBulkString(name);
+      rb->SendLong(history.rbegin()->first);
+      rb->SendLong(history.rbegin()->second);
+      rb->SendLong(max_ms);
+    }
+    return;
+  }
+
+  if (sub_cmd == "HISTORY" && args.size() == 1) {
+    auto events = collect_events();
+    auto it = events.find(ArgS(args, 0));
+    if (it == events.end())
+      return rb->SendEmptyArray();
+
+    const auto& history = it->second.second;
+    rb->StartArray(history.size());
+    for (const auto& [unix_sec, ms] : history) {
+      rb->StartArray(2);
+      rb->SendLong(unix_sec);
+      rb->SendLong(ms);
+    }
+    return;
+  }
+
+  if (sub_cmd == "RESET") {
+    absl::flat_hash_set<string> reset;
+    util::fb2::Mutex mu;
+    service_.proactor_pool().AwaitFiberOnAll([&](auto index, auto* context) {
+      LatencyMonitor& monitor = ServerState::tlocal()->latency_monitor();
+      lock_guard lk(mu);
+      if (args.empty()) {
+        for (const auto& [name, event] : monitor.events())
+          reset.insert(name);
+        monitor.ResetAll();
+        return;
+      }
+      for (string_view name : args) {
+        if (monitor.Reset(name))
+          reset.emplace(name);
+      }
+    });
+    return rb->SendLong(reset.size());
+  }
+
+  if (sub_cmd == "HISTOGRAM") {
+    absl::flat_hash_set<string> filter;
+    for (string_view name : args)
+      filter.insert(absl::AsciiStrToLower(name));
+
+    // Cumulative counts of power-of-two usec buckets, as Redis replies.
+    vector<pair<string, vector<pair<int64_t, int64_t>>>> histograms;
+    vector<int64_t> calls;
+    for (const auto& [name, hist] : service_.mutable_registry()->LatencyMap()) {
+      if (!hist || is_histogram_empty(hist) || (!filter.empty() && !filter.contains(name)))
+        continue;
+
+      vector<pair<int64_t, int64_t>> buckets;
+      hdr_iter iter;
+      hdr_iter_log_init(&iter, hist, 1, 2);
+      int64_t previous_count = 0;
+      while (hdr_iter_next(&iter)) {
+        if (iter.cumulative_count > previous_count)
+          buckets.emplace_back(iter.highest_equivalent_value, iter.cumulative_count);
+        previous_count = iter.cumulative_count;
+      }
+      calls.push_back(hist->total_count);
+      histograms.emplace_back(name, std::move(buckets));
+    }
+
+    rb->StartCollection(histograms.size(), RedisReplyBuilder::MAP);
+    for (size_t i = 0; i < histograms.size(); ++i) {
+      const auto& [name, buckets] = histograms[i];
+      rb->SendBulkString(name);
+      rb->StartCollection(2, RedisReplyBuilder::MAP);
+      rb->SendBulkString("calls");
+      rb->SendLong(calls[i]);
+      rb->SendBulkString("histogram_usec");
+      rb->StartCollection(buckets.size(), RedisReplyBuilder::MAP);
+      for (const auto& [bucket, count] : buckets) {
+        rb->SendLong(bucket);
+        rb->SendLong(count);
+      }
+    }
+    return;
   }
 
   return rb->SendError(UnknownSubCmd(sub_cmd, "LATENCY"), kSyntaxErrType);
@@ -3542,6 +4382,24 @@ void ServerFamily::SlowLog(CmdArgList args, const CommandContext& cmd_cntx) {
   rb->SendError(UnknownSubCmd(sub_cmd, "SLOWLOG"), kSyntaxErrType);
 }
 
+void ServerFamily::HotKeys(CmdArgList args, const CommandContext& cmd_cntx) {
+  auto* rb = static_cast<RedisReplyBuilder*>(cmd_cntx.rb);
+  CmdArgParser parser(args);
+  size_t count = parser.NextOrDefault<size_t>(10);
+  if (parser.HasNext())
+    return rb->SendError(kSyntaxErr);
+  if (auto err = parser.Error(); err)
+    return rb->SendError(err->MakeReply());
+
+  vector<pair<string, uint64_t>> hot_keys = CollectHotKeys(cmd_cntx.conn_cntx->ns, count);
+  rb->StartArray(hot_keys.size());
+  for (const auto& [key, accesses] : hot_keys) {
+    rb->StartArray(2);
+    rb->SendBulkString(key);
+    rb->SendLong(accesses);
+  }
+}
+
 void ServerFamily::Module(CmdArgList args, const CommandContext& cmd_cntx) {
   string sub_cmd = absl::AsciiStrToUpper(ArgS(args, 0));
   auto* rb = static_cast<RedisReplyBuilder*>(cmd_cntx.rb);
@@ -3626,7 +4484,10 @@ constexpr uint32_t kReplicaOf = ADMIN | SLOW | DANGEROUS;
 constexpr uint32_t kReplTakeOver = DANGEROUS;
 constexpr uint32_t kReplConf = ADMIN | SLOW | DANGEROUS;
 constexpr uint32_t kRole = ADMIN | FAST | DANGEROUS;
+constexpr uint32_t kLsnToken = SLOW | CONNECTION;
+constexpr uint32_t kWaitLsn = SLOW | CONNECTION;
 constexpr uint32_t kSlowLog = ADMIN | SLOW | DANGEROUS;
+constexpr uint32_t kHotKeys = ADMIN | SLOW | DANGEROUS;
 constexpr uint32_t kScript = SLOW | SCRIPTING;
 constexpr uint32_t kModule = ADMIN | SLOW | DANGEROUS;
 // TODO(check this)
@@ -3665,7 +4526,10 @@ void ServerFamily::Register(CommandRegistry* registry) {
              ReplTakeOver)
       << CI{"REPLCONF", CO::ADMIN | CO::LOADING, -1, 0, 0, acl::kReplConf}.HFUNC(ReplConf)
       << CI{"ROLE", CO::LOADING | CO::FAST | CO::NOSCRIPT, 1, 0, 0, acl::kRole}.HFUNC(Role)
+      << CI{"LSNTOKEN", CO::FAST | CO::NOSCRIPT, -1, 0, 0, acl::kLsnToken}.HFUNC(LsnToken)
+      << CI{"WAITLSN", CO::NOSCRIPT, 3, 0, 0, acl::kWaitLsn}.HFUNC(WaitLsn)
       << CI{"SLOWLOG", CO::ADMIN | CO::FAST, -2, 0, 0, acl::kSlowLog}.HFUNC(SlowLog)
+      << CI{"HOTKEYS", CO::ADMIN | CO::LOADING, -1, 0, 0, acl::kHotKeys}.HFUNC(HotKeys)
       << CI{"SCRIPT", CO::NOSCRIPT | CO::NO_KEY_TRANSACTIONAL, -2, 0, 0, acl::kScript}.HFUNC(Script)
       << CI{"DFLY", CO::ADMIN | CO::GLOBAL_TRANS | CO::HIDDEN, -2, 0, 0, acl::kDfly}.HFUNC(Dfly)
       << CI{"MODULE", CO::ADMIN, 2, 0, 0, acl::kModule}.HFUNC(Module);
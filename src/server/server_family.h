@@ -8,6 +8,7 @@
 #include <string>
 
 #include "facade/dragonfly_listener.h"
+#include "server/command_registry.h"
 #include "server/detail/save_stages_controller.h"
 #include "server/dflycmd.h"
 #include "server/engine_shard_set.h"
@@ -39,6 +40,10 @@ namespace journal {
 class Journal;
 }  // namespace journal
 
+namespace cluster {
+class SlotSet;
+}  // namespace cluster
+
 struct CommandContext;
 class CommandRegistry;
 class Service;
@@ -89,6 +94,9 @@ struct Metrics {
 
   size_t heap_used_bytes = 0;
   size_t small_string_bytes = 0;
+  size_t async_free_pending_bytes = 0;
+  size_t table_hugepage_bytes = 0;       // mapped by huge page arenas.
+  size_t table_hugepage_used_bytes = 0;  // used by table segments in huge page arenas.
   uint32_t traverse_ttl_per_sec = 0;
   uint32_t delete_ttl_per_sec = 0;
   uint64_t hoffman_encode_total = 0, hoffman_encode_success = 0;
@@ -102,6 +110,9 @@ struct Metrics {
   uint64_t fiber_longrun_cnt = 0;
   uint64_t fiber_longrun_usec = 0;
 
+  // Fiber scheduling stats per proactor thread.
+  std::vector<ServerState::SchedStats> fiber_sched_per_thread;
+
   // Max length of the all the tx shard-queues.
   uint32_t tx_queue_len = 0;
   uint32_t worker_fiber_count = 0;
@@ -110,6 +121,7 @@ struct Metrics {
 
   size_t lsn_buffer_size = 0;
   size_t lsn_buffer_bytes = 0;
+  size_t lsn_disk_bytes = 0;
 
   // monotonic timestamp (ProactorBase::GetMonotonicTimeNs) of the connection stuck on send
   // for longest time.
@@ -120,8 +132,15 @@ struct Metrics {
   // command call frequencies (count, aggregated latency in usec).
   std::map<std::string, std::pair<uint64_t, uint64_t>> cmd_stats_map;
 
+  // Bytes, shard time and hops per command.
+  std::map<std::string, CmdResourceStats> cmd_resource_stats_map;
+
   absl::flat_hash_map<std::string, uint64_t> connections_lib_name_ver_map;
 
+  // Percentage of single shard transactions coordinated from the thread owning the shard,
+  // indexed by thread.
+  std::vector<uint64_t> tx_shard_local_pct_per_thread;
+
   struct ReplicaInfo {
     uint32_t reconnect_count;
   };
@@ -134,6 +153,15 @@ struct Metrics {
   LoadingStats loading_stats;
 
   absl::flat_hash_map<std::string, hdr_histogram*> cmd_latency_map;
+
+  // Transaction phase histograms per command, filled with --latency_tracking.
+  std::map<std::string, TxPhaseStats> tx_phase_stats_map;
+
+  // Slots with the highest operation rate, filled for prometheus with --metrics_busiest_slots.
+  std::vector<std::pair<SlotId, SlotStats>> busiest_slots;
+
+  // Keys with the most accesses, filled for prometheus with --metrics_hot_keys.
+  std::vector<std::pair<std::string, uint64_t>> hot_keys;
 };
 
 struct LastSaveInfo {
@@ -227,10 +255,18 @@ class ServerFamily {
   void FlushAll(Namespace* ns);
 
   // Load snapshot from file (.rdb file or summary.dfs file) and return
-  // future with error_code.
+  // future with error_code. If lazy is set, the server may become active before the snapshot is
+  // loaded, see StartLazyLoad. If slots are set, only their keys are loaded, reading just their
+  // entries if the shard files have key indexes.
   enum class LoadExistingKeys : uint8_t { kFail, kOverride };
-  std::optional<util::fb2::Future<GenericError>> Load(const std::string& file_name,
-                                                      LoadExistingKeys existing_keys);
+  std::optional<util::fb2::Future<GenericError>> Load(
+      const std::string& file_name, LoadExistingKeys existing_keys, bool lazy = false,
+      std::shared_ptr<const cluster::SlotSet> slots = nullptr);
+
+  // True while a snapshot is loaded in the background of an active server.
+  bool IsLazyLoading() const {
+    return lazy_loading_.load(std::memory_order_relaxed);
+  }
 
   bool TEST_IsSaving() const;
 
@@ -294,7 +330,13 @@ class ServerFamily {
  private:
   bool HasPrivilegedInterface();
   void JoinSnapshotSchedule();
-  void LoadFromSnapshot() ABSL_LOCKS_EXCLUDED(loading_stats_mu_);
+  // Loads the snapshot from --dir and --dbfilename, then calls on_loaded if it's set.
+  void LoadFromSnapshot(std::function<void()> on_loaded = {}) ABSL_LOCKS_EXCLUDED(loading_stats_mu_);
+
+  // Remembers the journal lsns recorded in the loaded snapshot files, see snapshot_sync_data_.
+  void SetSnapshotSyncData(std::string repl_id, uint32_t shard_count,
+                           std::vector<std::pair<uint32_t, LSN>> repl_lsns)
+      ABSL_LOCKS_EXCLUDED(replicaof_mu_);
 
   uint32_t shard_count() const {
     return shard_set->size();
@@ -320,10 +362,14 @@ class ServerFamily {
       ABSL_LOCKS_EXCLUDED(replicaof_mu_);
   void ReplConf(CmdArgList args, const CommandContext& cmd_cntx);
   void Role(CmdArgList args, const CommandContext& cmd_cntx) ABSL_LOCKS_EXCLUDED(replicaof_mu_);
+  void LsnToken(CmdArgList args, const CommandContext& cmd_cntx)
+      ABSL_LOCKS_EXCLUDED(replicaof_mu_);
+  void WaitLsn(CmdArgList args, const CommandContext& cmd_cntx) ABSL_LOCKS_EXCLUDED(replicaof_mu_);
   void Save(CmdArgList args, const CommandContext& cmd_cntx);
   void BgSave(CmdArgList args, const CommandContext& cmd_cntx);
   void Script(CmdArgList args, const CommandContext& cmd_cntx);
   void SlowLog(CmdArgList args, const CommandContext& cmd_cntx);
+  void HotKeys(CmdArgList args, const CommandContext& cmd_cntx);
   void Module(CmdArgList args, const CommandContext& cmd_cntx);
 
   void SyncGeneric(std::string_view repl_master_id, uint64_t offs, ConnectionContext* cntx);
@@ -342,8 +388,25 @@ class ServerFamily {
     std::string snapshot_id;
     uint32_t shard_count = 0;      // Shard count of the snapshot being loaded.
     uint64_t num_loaded_keys = 0;  // Number of keys loaded.
+    std::string repl_id;           // Replication id of the master that saved the snapshot.
+    uint32_t shard_id = UINT32_MAX;
+    std::optional<LSN> repl_lsn;  // Journal lsn of the loaded shard file.
+    std::string delta_chain;      // Snapshots a delta snapshot builds upon, read from its summary.
+    bool delta = false;           // Load a delta snapshot on top of the existing data.
+    bool require_snapshot_id = false;  // Fail on files that don't belong to snapshot_id.
+    bool lazy = false;                 // Serve keys of the shard file before it is loaded.
+    std::shared_ptr<const cluster::SlotSet> slots;  // Load only the keys of these slots.
   };
 
+  // Opens the key indexes of the DF shard files and installs their fetchers on the shards.
+  // Returns false if the snapshot can not be loaded lazily.
+  bool StartLazyLoad(const std::vector<std::string>& paths, const LoadOptions& opts);
+
+  // Opens a source of the file that holds the keys of opts.slots. Reads only their entries if
+  // the file has a key index.
+  io::Result<std::unique_ptr<io::Source>> OpenSlotsSource(const std::string& file,
+                                                          const LoadOptions& opts);
+
   // Updates LoadOptions if successful. If snapshot_id and shard_count are passed in,
   // may use them for consistency checks.
   std::error_code LoadRdb(const std::string& rdb_file, LoadExistingKeys existing_keys,
@@ -396,10 +459,16 @@ class ServerFamily {
   std::string master_replid_;
   std::optional<Replica::LastMasterSyncData> last_master_data_;
 
+  // Journal lsns of the last loaded snapshot, used by the first replication to continue with a
+  // partial sync from the master that saved it.
+  std::optional<Replica::LastMasterSyncData> snapshot_sync_data_;
+
   time_t start_time_ = 0;  // in seconds, epoch time.
 
   LastSaveInfo last_save_info_ ABSL_GUARDED_BY(save_mu_);
   std::unique_ptr<detail::SaveStagesController> save_controller_ ABSL_GUARDED_BY(save_mu_);
+  // Snapshots the next delta snapshot builds upon, empty if the next one must be a full one.
+  detail::DeltaChain delta_chain_ ABSL_GUARDED_BY(save_mu_);
 
   // Used to override save on shutdown behavior that is usually set
   // be --dbfilename.
@@ -410,6 +479,7 @@ class ServerFamily {
   std::shared_ptr<detail::SnapshotStorage> snapshot_storage_;
 
   std::atomic<bool> is_c_pause_in_progress_ = false;
+  std::atomic<bool> lazy_loading_ = false;
   // We need this because if dragonfly shuts down during pause, ServerState will destruct
   // before the dettached fiber Pause() causing a seg fault.
   std::atomic<size_t> active_pauses_ = 0;
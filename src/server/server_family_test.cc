@@ -12,6 +12,7 @@
 #include "base/logging.h"
 #include "facade/facade_test.h"
 #include "facade/socket_utils.h"
+#include "server/server_state.h"
 #include "server/test_utils.h"
 
 using namespace testing;
@@ -103,6 +104,29 @@ TEST_F(ServerFamilyTest, GetTcpSocketInfoIPv6) {
 }
 #endif
 
+TEST_F(ServerFamilyTest, LatencyMonitor) {
+  EXPECT_EQ(Run({"config", "set", "latency_monitor_threshold", "10"}), "OK");
+  pp_->at(0)->Await([] {
+    LatencyMonitor& monitor = ServerState::tlocal()->latency_monitor();
+    monitor.Add("test-event", 5, 100);  // below the threshold
+    monitor.Add("test-event", 20, 100);
+    monitor.Add("test-event", 15, 100);  // merged into the sample of the same second
+    monitor.Add("test-event", 12, 101);
+  });
+
+  auto resp = Run({"latency", "latest"});
+  ASSERT_THAT(resp, ArrLen(4));
+  EXPECT_THAT(resp.GetVec(), ElementsAre("test-event", IntArg(101), IntArg(12), IntArg(20)));
+
+  resp = Run({"latency", "history", "test-event"});
+  ASSERT_THAT(resp, ArrLen(2));
+  EXPECT_THAT(resp.GetVec()[0].GetVec(), ElementsAre(IntArg(100), IntArg(20)));
+  EXPECT_THAT(resp.GetVec()[1].GetVec(), ElementsAre(IntArg(101), IntArg(12)));
+
+  EXPECT_THAT(Run({"latency", "reset"}), IntArg(1));
+  EXPECT_THAT(Run({"latency", "latest"}), ArrLen(0));
+}
+
 TEST_F(ServerFamilyTest, SlowLogArgsCountTruncation) {
   auto resp = Run({"config", "set", "slowlog_max_len", "3"});
   EXPECT_THAT(resp.GetString(), "OK");
@@ -499,7 +523,7 @@ TEST_F(ServerFamilyTest, ClientTrackingUpdateKey) {
   Run({"GET", "FOO"});
   Run({"SET", "FOO", "10"});
   const auto& msg = GetInvalidationMessage("IO0", 0);
-  EXPECT_EQ(msg.key, "FOO");
+  EXPECT_THAT(msg.keys, ElementsAre("FOO"));
 
   // make sure invalidation message only gets sent once.
   Run({"GET", "FOO"});
@@ -511,7 +535,7 @@ TEST_F(ServerFamilyTest, ClientTrackingUpdateKey) {
   pp_->at(1)->Await([&] { return Run({"SET", "FOO", "30"}); });
   pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
   const auto& msg2 = GetInvalidationMessage("IO0", 1);
-  EXPECT_EQ(msg2.key, "FOO");
+  EXPECT_THAT(msg2.keys, ElementsAre("FOO"));
 
   // case 4. test multi command
   Run({"MGET", "X1", "X2", "X3", "X4", "Y1", "Y2", "Y3", "Y4", "Z1", "Z2", "Z3", "Z4"});
@@ -520,7 +544,7 @@ TEST_F(ServerFamilyTest, ClientTrackingUpdateKey) {
   EXPECT_EQ(InvalidationMessagesLen("IO0"), 6);
   std::vector<std::string_view> keys_invalidated;
   for (unsigned int i = 2; i < 6; ++i)
-    keys_invalidated.push_back(GetInvalidationMessage("IO0", i).key);
+    keys_invalidated.push_back(GetInvalidationMessage("IO0", i).keys[0]);
   ASSERT_THAT(keys_invalidated, UnorderedElementsAre("X1", "Y3", "Z2", "Z4"));
 
   Run({"FLUSHDB"});
@@ -533,7 +557,7 @@ TEST_F(ServerFamilyTest, ClientTrackingDeleteKey) {
   Run({"GET", "FOO"});
   pp_->at(1)->Await([&] { return Run({"DEL", "FOO"}); });
   pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
-  EXPECT_EQ(GetInvalidationMessage("IO0", 0).key, "FOO");
+  EXPECT_THAT(GetInvalidationMessage("IO0", 0).keys, ElementsAre("FOO"));
 }
 
 TEST_F(ServerFamilyTest, ClientTrackingRenameKey) {
@@ -543,7 +567,7 @@ TEST_F(ServerFamilyTest, ClientTrackingRenameKey) {
   Run({"GET", "FOO"});
   pp_->at(1)->Await([&] { return Run({"RENAME", "FOO", "BAR"}); });
   pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
-  EXPECT_EQ(GetInvalidationMessage("IO0", 0).key, "FOO");
+  EXPECT_THAT(GetInvalidationMessage("IO0", 0).keys, ElementsAre("FOO"));
 }
 
 TEST_F(ServerFamilyTest, ClientTrackingExpireKey) {
@@ -556,7 +580,7 @@ TEST_F(ServerFamilyTest, ClientTrackingExpireKey) {
   auto resp = Run({"GET", "C"});
   EXPECT_THAT(resp, ArgType(RespExpr::NIL));
   EXPECT_EQ(InvalidationMessagesLen("IO0"), 1);
-  EXPECT_EQ(GetInvalidationMessage("IO0", 0).key, "C");
+  EXPECT_THAT(GetInvalidationMessage("IO0", 0).keys, ElementsAre("C"));
 }
 
 TEST_F(ServerFamilyTest, ClientTrackingSelectDB) {
@@ -568,7 +592,43 @@ TEST_F(ServerFamilyTest, ClientTrackingSelectDB) {
   pp_->at(1)->Await([&] { return Run({"SET", "C", "1000"}); });
   pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
   EXPECT_EQ(InvalidationMessagesLen("IO0"), 1);
-  EXPECT_EQ(GetInvalidationMessage("IO0", 0).key, "C");
+  EXPECT_THAT(GetInvalidationMessage("IO0", 0).keys, ElementsAre("C"));
+}
+
+TEST_F(ServerFamilyTest, ClientTrackingBcast) {
+  // Keeps keys with the same hashtag on one shard.
+  SetTestFlag("lock_on_hashtags", "true");
+  ResetService();
+
+  Run({"HELLO", "3"});
+  EXPECT_THAT(Run({"CLIENT", "TRACKING", "ON", "PREFIX", "user:"}),
+              ErrArg("PREFIX option requires BCAST mode"));
+  EXPECT_THAT(Run({"CLIENT", "TRACKING", "ON", "BCAST", "OPTIN"}),
+              ErrArg("not compatible with BCAST"));
+  EXPECT_THAT(Run({"CLIENT", "TRACKING", "ON", "BCAST", "NOLOOP"}),
+              ErrArg("NOLOOP is not supported with BCAST"));
+
+  Run({"CLIENT", "TRACKING", "ON", "BCAST", "PREFIX", "user:", "PREFIX", "session:"});
+
+  // Keys are reported without being read first and keep being reported on every change.
+  pp_->at(1)->Await([&] { return Run({"SET", "user:1", "a"}); });
+  pp_->at(1)->Await([&] { return Run({"SET", "user:1", "b"}); });
+  pp_->at(1)->Await([&] { return Run({"SET", "other", "c"}); });
+  pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
+  ASSERT_EQ(InvalidationMessagesLen("IO0"), 2);
+  EXPECT_THAT(GetInvalidationMessage("IO0", 1).keys, ElementsAre("user:1"));
+
+  // Keys changed by one command on the same shard are coalesced into a single push.
+  pp_->at(1)->Await([&] { return Run({"MSET", "session:{s}1", "1", "session:{s}2", "2"}); });
+  pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
+  ASSERT_EQ(InvalidationMessagesLen("IO0"), 3);
+  EXPECT_THAT(GetInvalidationMessage("IO0", 2).keys,
+              UnorderedElementsAre("session:{s}1", "session:{s}2"));
+
+  Run({"CLIENT", "TRACKING", "OFF"});
+  pp_->at(1)->Await([&] { return Run({"SET", "user:1", "c"}); });
+  pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
+  EXPECT_EQ(InvalidationMessagesLen("IO0"), 3);
 }
 
 TEST_F(ServerFamilyTest, ClientTrackingNonTransactionalBug) {
@@ -640,4 +700,48 @@ TEST_F(ServerFamilyTest, PubSubCommandErr) {
                      "PUBSUB HELP."));
 }
 
+TEST_F(ServerFamilyTest, ShardLocalityStats) {
+  for (unsigned i = 0; i < 50; ++i)
+    Run({"set", absl::StrCat("key", i), "val"});
+
+  auto metrics = GetMetrics();
+  const auto& stats = metrics.coordinator_stats;
+  EXPECT_GE(stats.tx_shard_local_cnt + stats.tx_shard_remote_cnt, 50u);
+  EXPECT_EQ(metrics.tx_shard_local_pct_per_thread.size(), pp_->size());
+
+  string info = Run({"info", "stats"}).GetString();
+  EXPECT_THAT(info, HasSubstr("tx_shard_local_total:"));
+  EXPECT_THAT(info, HasSubstr("tx_shard_local_pct_per_thread:"));
+}
+
+TEST_F(ServerFamilyTest, FiberSchedStats) {
+  // The probe runs every 10ms by default.
+  ThisFiber::SleepFor(50ms);
+
+  auto metrics = GetMetrics();
+  ASSERT_EQ(metrics.fiber_sched_per_thread.size(), pp_->size());
+  EXPECT_GT(metrics.fiber_sched_per_thread[0].probe_cnt, 0u);
+
+  string info = Run({"info", "stats"}).GetString();
+  EXPECT_THAT(info, HasSubstr("fiber_sched_delay_p99_usec_per_thread:"));
+  EXPECT_THAT(info, HasSubstr("busy_read_yields:"));
+}
+
+TEST_F(ServerFamilyTest, CacheHitsPerPolicy) {
+  absl::FlagSaver fs;
+  SetTestFlag("cache_mode", "true");
+  SetTestFlag("cache_eviction_policy", "lfu");
+  ResetService();
+
+  Run({"set", "key", "val"});
+  Run({"get", "key"});
+  Run({"get", "key"});
+  Run({"get", "missing"});
+
+  string info = Run({"info", "stats"}).GetString();
+  EXPECT_THAT(info, HasSubstr("cache_lfu_hits:2\r\n"));
+  EXPECT_THAT(info, HasSubstr("cache_lfu_misses:1\r\n"));
+  EXPECT_THAT(info, Not(HasSubstr("cache_dash_hits")));
+}
+
 }  // namespace dfly
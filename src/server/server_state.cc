@@ -17,7 +17,9 @@ extern "C" {
 #include "facade/conn_context.h"
 #include "facade/dragonfly_connection.h"
 #include "server/channel_store.h"
+#include "server/cluster/slot_set.h"
 #include "server/journal/journal.h"
+#include "util/fibers/proactor_base.h"
 #include "util/listener_interface.h"
 
 ABSL_FLAG(uint32_t, interpreter_per_thread, 10, "Lua interpreters per thread");
@@ -25,6 +27,8 @@ ABSL_FLAG(uint32_t, timeout, 0,
           "Close the connection after it is idle for N seconds (0 to disable)");
 ABSL_FLAG(uint32_t, send_timeout, 0,
           "Close the connection after it is stuck on send for N seconds (0 to disable)");
+ABSL_FLAG(uint32_t, fiber_sched_probe_usec, 10000,
+          "Interval of the per-thread probe that measures fiber scheduling delays (0 to disable)");
 
 namespace dfly {
 
@@ -38,7 +42,7 @@ ServerState::Stats::Stats(unsigned num_shards)
 }
 
 ServerState::Stats& ServerState::Stats::Add(const ServerState::Stats& other) {
-  static_assert(sizeof(Stats) == 23 * 8, "Stats size mismatch");
+  static_assert(sizeof(Stats) == 31 * 8, "Stats size mismatch");
 
 #define ADD(x) this->x += (other.x)
 
@@ -51,11 +55,15 @@ ServerState::Stats& ServerState::Stats::Add(const ServerState::Stats& other) {
   ADD(tx_normal_cnt);
   ADD(tx_inline_runs);
   ADD(tx_schedule_cancel_cnt);
+  ADD(tx_shard_local_cnt);
+  ADD(tx_shard_remote_cnt);
 
   ADD(multi_squash_executions);
   ADD(multi_squash_exec_hop_usec);
   ADD(multi_squash_exec_reply_usec);
   ADD(squashed_commands);
+  ADD(multi_snapshot_executions);
+  ADD(multi_snapshot_conflicts);
 
   ADD(blocked_on_interpreter);
   ADD(rdb_save_usec);
@@ -63,8 +71,12 @@ ServerState::Stats& ServerState::Stats::Add(const ServerState::Stats& other) {
 
   ADD(big_value_preemptions);
   ADD(compressed_blobs);
+  ADD(busy_squash_yields);
+  ADD(json_path_cache_hits);
+  ADD(json_path_cache_misses);
 
   ADD(oom_error_cmd_cnt);
+  ADD(rate_limited_cmd_cnt);
   ADD(conn_timeout_events);
   ADD(psync_requests_total);
 
@@ -122,6 +134,9 @@ ServerState::ServerState() : interpreter_mgr_{absl::GetFlag(FLAGS_interpreter_pe
 
 ServerState::~ServerState() {
   watcher_fiber_.JoinIfNeeded();
+  sched_probe_fiber_.JoinIfNeeded();
+  if (sched_delay_hist_)
+    hdr_close(sched_delay_hist_);
 }
 
 void ServerState::Init(uint32_t thread_index, uint32_t num_shards,
@@ -148,6 +163,32 @@ void ServerState::EnterLameDuck() {
   watcher_cv_.notify_all();
 }
 
+void ServerState::StartSchedProbe() {
+  uint32_t interval_usec = absl::GetFlag(FLAGS_fiber_sched_probe_usec);
+  if (interval_usec == 0 || sched_delay_hist_)
+    return;
+
+  // Delays up to 10s with 2 significant digits.
+  CHECK_EQ(0, hdr_init(1, 10'000'000, 2, &sched_delay_hist_));
+  sched_probe_fiber_ =
+      util::fb2::Fiber(util::fb2::Launch::post, "SchedProbe", [this, interval_usec] {
+        SchedProbeFb(chrono::microseconds(interval_usec));
+      });
+}
+
+ServerState::SchedStats ServerState::GetSchedStats() const {
+  SchedStats res;
+  if (sched_delay_hist_) {
+    res.probe_cnt = sched_delay_hist_->total_count;
+    res.delay_p50_usec = hdr_value_at_percentile(sched_delay_hist_, 50);
+    res.delay_p99_usec = hdr_value_at_percentile(sched_delay_hist_, 99);
+    res.delay_max_usec = sched_delay_max_usec_;
+  }
+  res.longrun_cnt = util::fb2::FiberLongRunCnt();
+  res.longrun_usec = util::fb2::FiberLongRunSumUsec();
+  return res;
+}
+
 ServerState::MemoryUsageStats ServerState::GetMemoryUsage(uint64_t now_ns) {
   static constexpr uint64_t kCacheEveryNs = 1000;
   if (now_ns > used_mem_last_update_ + kCacheEveryNs) {
@@ -190,6 +231,27 @@ void ServerState::AwaitPauseState(bool is_write) {
   });
 }
 
+void ServerState::StartSlotsFinalization(shared_ptr<const cluster::SlotSet> slots) {
+  finalizing_slots_.push_back(std::move(slots));
+}
+
+void ServerState::EndSlotsFinalization(const shared_ptr<const cluster::SlotSet>& slots) {
+  auto it = find(finalizing_slots_.begin(), finalizing_slots_.end(), slots);
+  DCHECK(it != finalizing_slots_.end());
+  if (it != finalizing_slots_.end())
+    finalizing_slots_.erase(it);
+  slots_finalization_ec_.notifyAll();
+}
+
+void ServerState::AwaitSlotsFinalization(optional<SlotId> slot) {
+  slots_finalization_ec_.await([slot, this] {
+    if (!slot)
+      return finalizing_slots_.empty();
+    return none_of(finalizing_slots_.begin(), finalizing_slots_.end(),
+                   [slot](const auto& slots) { return slots->Contains(*slot); });
+  });
+}
+
 void ServerState::DecommitMemory(uint8_t flags) {
   if (flags & kDataHeap) {
     mi_heap_collect(data_heap(), true);
@@ -240,6 +302,31 @@ bool ServerState::ShouldLogSlowCmd(unsigned latency_usec) const {
   return slow_log_shard_.IsEnabled() && latency_usec >= log_slower_than_usec;
 }
 
+void ServerState::RecordSlotTraffic(SlotId sid, uint64_t bytes_in, uint64_t bytes_out) {
+  DCHECK_LE(sid, kMaxSlotNum);
+  if (!slot_traffic_)
+    slot_traffic_.reset(new SlotTraffic[kMaxSlotNum + 1]);
+  slot_traffic_[sid].bytes_in += bytes_in;
+  slot_traffic_[sid].bytes_out += bytes_out;
+}
+
+void ServerState::SchedProbeFb(chrono::microseconds interval) {
+  const uint64_t interval_ns = chrono::nanoseconds(interval).count();
+  while (true) {
+    uint64_t start_ns = util::fb2::ProactorBase::GetMonotonicTimeNs();
+    util::fb2::NoOpLock noop;
+    if (watcher_cv_.wait_for(noop, interval,
+                             [this] { return gstate_ == GlobalState::SHUTTING_DOWN; })) {
+      break;
+    }
+
+    uint64_t slept_ns = util::fb2::ProactorBase::GetMonotonicTimeNs() - start_ns;
+    uint64_t delay_usec = slept_ns > interval_ns ? (slept_ns - interval_ns) / 1000 : 0;
+    hdr_record_value(sched_delay_hist_, delay_usec);
+    sched_delay_max_usec_ = max(sched_delay_max_usec_, delay_usec);
+  }
+}
+
 void ServerState::ConnectionsWatcherFb(util::ListenerInterface* main) {
   optional<facade::Connection::WeakRef> last_reference;
 
@@ -310,10 +397,4 @@ void ServerState::ConnectionsWatcherFb(util::ListenerInterface* main) {
   }
 }
 
-void ServerState::UnsubscribeSlotsAndUpdateChannelStore(const ChannelStore::ChannelsSubMap& sub_map,
-                                                        ChannelStore* replacement) {
-  channel_store_->UnsubscribeConnectionsFromDeletedSlots(sub_map, thread_index_);
-  channel_store_ = replacement;
-}
-
 }  // end of namespace dfly
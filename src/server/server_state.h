@@ -4,16 +4,22 @@
 
 #pragma once
 
+#include <hdr/hdr_histogram.h>
+
+#include <memory>
 #include <optional>
 #include <valarray>
 #include <vector>
 
 #include "base/histogram.h"
+#include "base/pmr/memory_resource.h"
 #include "core/interpreter.h"
 #include "server/acl/acl_log.h"
 #include "server/acl/user_registry.h"
 #include "server/channel_store.h"
+#include "server/cluster_support.h"
 #include "server/common.h"
+#include "server/latency_monitor.h"
 #include "server/script_mgr.h"
 #include "server/slowlog.h"
 #include "util/sliding_counter.h"
@@ -34,6 +40,10 @@ namespace journal {
 class Journal;
 }  // namespace journal
 
+namespace cluster {
+class SlotSet;
+}  // namespace cluster
+
 // This would be used as a thread local storage of sending
 // monitor messages.
 // Each thread will have its own list of all the connections that are
@@ -88,6 +98,31 @@ class MonitorsRepo {
 
 enum class ClientPause { WRITE, ALL };
 
+// Upstream of the scratch arena that tracks how much memory the arena holds.
+class ScratchUpstream final : public PMR_NS::memory_resource {
+ public:
+  size_t used() const {
+    return used_;
+  }
+
+ private:
+  void* do_allocate(std::size_t size, std::size_t align) final {
+    used_ += size;
+    return PMR_NS::get_default_resource()->allocate(size, align);
+  }
+
+  void do_deallocate(void* ptr, std::size_t size, std::size_t align) final {
+    used_ -= size;
+    PMR_NS::get_default_resource()->deallocate(ptr, size, align);
+  }
+
+  bool do_is_equal(const PMR_NS::memory_resource& o) const noexcept final {
+    return this == &o;
+  }
+
+  size_t used_ = 0;
+};
+
 // Present in every server thread. This class differs from EngineShard. The latter manages
 // state around engine shards while the former represents coordinator/connection state.
 // There may be threads that handle engine shards but not IO, there may be threads that handle IO
@@ -114,6 +149,10 @@ class ServerState {  // public struct - to allow initialization.
     uint64_t tx_inline_runs = 0;
     uint64_t tx_schedule_cancel_cnt = 0;
 
+    // Single shard transactions coordinated from the thread owning the shard and from others.
+    uint64_t tx_shard_local_cnt = 0;
+    uint64_t tx_shard_remote_cnt = 0;
+
     uint64_t eval_io_coordination_cnt = 0;
     uint64_t eval_shardlocal_coordination_cnt = 0;
     uint64_t eval_squashed_flushes = 0;
@@ -124,19 +163,46 @@ class ServerState {  // public struct - to allow initialization.
     uint64_t squashed_commands = 0;
     uint64_t blocked_on_interpreter = 0;
 
+    // Read-only EXEC bodies that ran without locking ahead, and the ones that had to fall back.
+    uint64_t multi_snapshot_executions = 0;
+    uint64_t multi_snapshot_conflicts = 0;
+
     uint64_t rdb_save_usec = 0;
     uint64_t rdb_save_count = 0;
 
     uint64_t big_value_preemptions = 0;
     uint64_t compressed_blobs = 0;
 
+    // Yields of command squashing after running for more than max_busy_squash_usec.
+    uint64_t busy_squash_yields = 0;
+
+    // Lookups of the parsed json path cache.
+    uint64_t json_path_cache_hits = 0;
+    uint64_t json_path_cache_misses = 0;
+
     // Number of times we rejected command dispatch due to OOM condition.
     uint64_t oom_error_cmd_cnt = 0;
+    // Number of commands rejected by the ACL rate limit of their user.
+    uint64_t rate_limited_cmd_cnt = 0;
     uint32_t conn_timeout_events = 0;
     uint64_t psync_requests_total = 0;
     std::valarray<uint64_t> tx_width_freq_arr, squash_width_freq_arr;
   };
 
+  // Fiber scheduling stats of the thread, sampled by a probe fiber that sleeps for
+  // --fiber_sched_probe_usec and measures how late it is resumed. The delay of the probe bounds
+  // the time other fibers ran without yielding plus the time it waited in the run queue.
+  struct SchedStats {
+    uint64_t probe_cnt = 0;
+    uint64_t delay_p50_usec = 0;
+    uint64_t delay_p99_usec = 0;
+    uint64_t delay_max_usec = 0;
+
+    // Fiber runs of the thread longer than 1ms, maintained by the fiber scheduler.
+    uint64_t longrun_cnt = 0;
+    uint64_t longrun_usec = 0;
+  };
+
   // Unsafe version.
   // Do not use after fiber migration because it can cause a data race.
   static ServerState* tlocal() {
@@ -162,6 +228,11 @@ class ServerState {  // public struct - to allow initialization.
 
   void EnterLameDuck();
 
+  // Starts the fiber scheduling probe of the thread, stopped by EnterLameDuck.
+  void StartSchedProbe();
+
+  SchedStats GetSchedStats() const;
+
   void TxCountInc() {
     ++live_transactions_;
   }
@@ -224,6 +295,24 @@ class ServerState {  // public struct - to allow initialization.
     return data_heap_;
   }
 
+  // The arena stops growing at about this size while scopes keep it alive.
+  static constexpr size_t kScratchMaxSize = 1 << 20;
+
+  // Monotonic arena for the temporary allocations of command hops, valid within a ScratchScope.
+  // It is backed by the default heap, so that short-lived buffers do not share pages with the
+  // data heap. Interleaved scopes may keep the arena from being released for a long time, so
+  // once it holds kScratchMaxSize bytes, the default heap serves the allocations until then.
+  PMR_NS::memory_resource* scratch_resource() {
+    if (scratch_upstream_.used() < kScratchMaxSize)
+      return &scratch_arena_;
+    return PMR_NS::get_default_resource();
+  }
+
+  // Bytes allocated by the scratch arena beyond its initial block.
+  size_t scratch_arena_bytes() const {
+    return scratch_upstream_.used();
+  }
+
   journal::Journal* journal() {
     return journal_;
   }
@@ -265,9 +354,6 @@ class ServerState {  // public struct - to allow initialization.
     channel_store_ = replacement;
   }
 
-  void UnsubscribeSlotsAndUpdateChannelStore(const ChannelStore::ChannelsSubMap& sub_map,
-                                             ChannelStore* replacement);
-
   bool ShouldLogSlowCmd(unsigned latency_usec) const;
 
   Stats stats;
@@ -293,10 +379,27 @@ class ServerState {  // public struct - to allow initialization.
     return (client_pauses_[0] + client_pauses_[1]) > 0;
   }
 
+  // Slots of outgoing migrations that are being finalized. Commands on them wait until their
+  // ownership is handed off to the target, instead of pausing all clients.
+  void StartSlotsFinalization(std::shared_ptr<const cluster::SlotSet> slots);
+  void EndSlotsFinalization(const std::shared_ptr<const cluster::SlotSet>& slots);
+
+  bool HasFinalizingSlots() const {
+    return !finalizing_slots_.empty();
+  }
+
+  // Awaits until the slot is not finalizing. Without a slot, awaits until no slots are
+  // finalizing.
+  void AwaitSlotsFinalization(std::optional<SlotId> slot);
+
   SlowLogShard& GetSlowLog() {
     return slow_log_shard_;
   };
 
+  LatencyMonitor& latency_monitor() {
+    return latency_monitor_;
+  }
+
   // Tries to returns as much RSS memory as possible to the OS.
   // Decommits 3 possible heaps according to the flags.
   // For decommit_glibcmalloc the heap is global for the process, for others it's specific only
@@ -309,6 +412,20 @@ class ServerState {  // public struct - to allow initialization.
   };
   void DecommitMemory(uint8_t flags);
 
+  // Network traffic of the single slot commands coordinated by this thread, counted in cluster
+  // mode.
+  struct SlotTraffic {
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+  };
+
+  void RecordSlotTraffic(SlotId sid, uint64_t bytes_in, uint64_t bytes_out);
+
+  // Null if no traffic was recorded, otherwise indexed by slot id.
+  const SlotTraffic* slot_traffic() const {
+    return slot_traffic_.get();
+  }
+
   // Exec descriptor frequency count for this thread.
   absl::flat_hash_map<std::string, unsigned> exec_freq_count;
   double rss_oom_deny_ratio;
@@ -317,9 +434,11 @@ class ServerState {  // public struct - to allow initialization.
  private:
   // A fiber constantly watching connections on the main listener.
   void ConnectionsWatcherFb(util::ListenerInterface* main);
+  void SchedProbeFb(std::chrono::microseconds interval);
 
   int64_t live_transactions_ = 0;
   SlowLogShard slow_log_shard_;
+  LatencyMonitor latency_monitor_;
   mi_heap_t* data_heap_;
   journal::Journal* journal_ = nullptr;
 
@@ -337,10 +456,17 @@ class ServerState {  // public struct - to allow initialization.
   int client_pauses_[2] = {};
   util::fb2::EventCount client_pause_ec_;
 
+  std::vector<std::shared_ptr<const cluster::SlotSet>> finalizing_slots_;
+  util::fb2::EventCount slots_finalization_ec_;
+
   // Monitors connections. Currently responsible for closing timed out connections.
   util::fb2::Fiber watcher_fiber_;
   util::fb2::CondVarAny watcher_cv_;
 
+  util::fb2::Fiber sched_probe_fiber_;
+  hdr_histogram* sched_delay_hist_ = nullptr;  // in usec
+  uint64_t sched_delay_max_usec_ = 0;
+
   using Counter = util::SlidingCounter<7>;
   Counter qps_;
 
@@ -352,7 +478,40 @@ class ServerState {  // public struct - to allow initialization.
   uint64_t used_mem_last_update_ = 0;
   MemoryUsageStats memory_stats_cached_;  // thread local cache of used and rss memory current
 
+  std::unique_ptr<SlotTraffic[]> slot_traffic_;  // allocated on first use
+
+  // The initial block is kept across releases, so that most hops do not allocate.
+  static constexpr size_t kScratchBlockSize = 16 * 1024;
+  std::unique_ptr<char[]> scratch_block_{new char[kScratchBlockSize]};
+  ScratchUpstream scratch_upstream_;
+  PMR_NS::monotonic_buffer_resource scratch_arena_{scratch_block_.get(), kScratchBlockSize,
+                                                   &scratch_upstream_};
+  unsigned scratch_scopes_ = 0;
+
+  friend class ScratchScope;
+
   static __thread ServerState* state_;
 };
 
+// Marks a region that may allocate from ServerState::scratch_resource(). Such memory must not
+// outlive the region. Regions may preempt and interleave on a thread, so the arena is released
+// only once none of them is active.
+class ScratchScope {
+ public:
+  ScratchScope() : ss_(ServerState::tlocal()) {
+    ++ss_->scratch_scopes_;
+  }
+
+  ~ScratchScope() {
+    if (--ss_->scratch_scopes_ == 0)
+      ss_->scratch_arena_.release();
+  }
+
+  ScratchScope(const ScratchScope&) = delete;
+  ScratchScope& operator=(const ScratchScope&) = delete;
+
+ private:
+  ServerState* ss_;
+};
+
 }  // namespace dfly
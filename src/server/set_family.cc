@@ -254,7 +254,9 @@ void DiffStrSet(const DbContext& db_context, const SetType& st,
     result->erase(entry);
 }
 
-void InterStrSet(const DbContext& db_context, const vector<SetType>& vec, StringVec* result) {
+// limit - stop after that many members if positive.
+void InterStrSet(const DbContext& db_context, const vector<SetType>& vec, unsigned limit,
+                 StringVec* result) {
   for (string_view str : StringSetWrapper{vec.front(), db_context}.Range()) {
     size_t j = 1;
     for (j = 1; j < vec.size(); ++j) {
@@ -265,6 +267,64 @@ void InterStrSet(const DbContext& db_context, const vector<SetType>& vec, String
 
     if (j == vec.size()) {
       result->emplace_back(str);
+      if (result->size() == limit)
+        return;
+    }
+  }
+}
+
+// Returns the position of the first member of is that is not less than val, or its length.
+// Starts at pos and doubles the step before binary searching, so that probing increasing
+// values costs O(log distance) instead of O(log length).
+uint32_t IntSetLowerBound(intset* is, uint32_t pos, int64_t val) {
+  uint32_t len = intsetLen(is);
+  uint32_t lo = pos, hi = pos, step = 1;
+  int64_t cur;
+  while (hi < len && intsetGet(is, hi, &cur) && cur < val) {
+    lo = hi + 1;
+    hi += step;
+    step *= 2;
+  }
+
+  hi = std::min(hi, len);
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    intsetGet(is, mid, &cur);
+    if (cur < val)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+// Intersects sorted intsets, the smallest one first, by leapfrogging: each set skips to the
+// first member that is not less than the current candidate, and a miss makes the member found
+// the next candidate.
+void InterIntSets(const vector<SetType>& vec, unsigned limit, StringVec* result) {
+  intset* smallest = (intset*)vec.front().first;
+  vector<uint32_t> pos(vec.size(), 0);
+  int64_t val;
+
+  while (intsetGet(smallest, pos[0], &val)) {
+    size_t j = 1;
+    int64_t cur = val;
+    for (; j < vec.size(); ++j) {
+      intset* is = (intset*)vec[j].first;
+      pos[j] = IntSetLowerBound(is, pos[j], val);
+      if (!intsetGet(is, pos[j], &cur))
+        return;  // no member of `is` is left to match.
+      if (cur != val)
+        break;
+    }
+
+    if (j == vec.size()) {
+      result->push_back(absl::StrCat(val));
+      if (result->size() == limit)
+        return;
+      ++pos[0];
+    } else {
+      pos[0] = IntSetLowerBound(smallest, pos[0] + 1, cur);
     }
   }
 }
@@ -538,7 +598,7 @@ OpResult<uint32_t> OpAdd(const OpArgs& op_args, std::string_view key, const NewE
       RecordJournal(op_args, "DEL"sv, ArgSlice{key});
     }
     size_t size = visit([](auto& c) { return c.size(); }, vals);
-    vector<string_view> mapped(size + 1);
+    auto mapped = MakeScratchVector<string_view>(size + 1);
     mapped[0] = key;
     std::copy(vals_it.begin(), vals_it.end(), mapped.begin() + 1);
     RecordJournal(op_args, "SADD"sv, mapped);
@@ -546,6 +606,37 @@ OpResult<uint32_t> OpAdd(const OpArgs& op_args, std::string_view key, const NewE
   return res;
 }
 
+// Stores the union of the per-shard results into key, adding them in batches and releasing
+// each of them once it is added, instead of collecting the union first.
+// Returns the size of the union.
+OpResult<uint32_t> OpStoreUnion(const OpArgs& op_args, string_view key,
+                                ResultStringVec* result_vec) {
+  constexpr size_t kBatchLen = 1024;
+  auto batch = MakeScratchVector<string_view>(0);
+  bool overwrite = true;
+  uint32_t total = 0;
+
+  for (auto& val : *result_vec) {
+    if (!val)
+      continue;  // SKIPPED or KEY_NOTFOUND, see UnionResultVec.
+
+    for (size_t i = 0; i < val->size(); i += batch.size()) {
+      size_t len = std::min(kBatchLen, val->size() - i);
+      batch.assign(val->begin() + i, val->begin() + i + len);
+      auto res = OpAdd(op_args, key, ArgSlice{batch}, overwrite, true);
+      RETURN_ON_BAD_STATUS(res);
+      total += *res;
+      overwrite = false;
+    }
+    StringVec{}.swap(*val);
+  }
+
+  // Empty union, delete the destination.
+  if (overwrite)
+    OpAdd(op_args, key, ArgSlice{}, true, true);
+  return total;
+}
+
 OpResult<uint32_t> OpAddEx(const OpArgs& op_args, string_view key, uint32_t ttl_sec,
                            const NewEntries& vals, bool keepttl) {
   auto& db_slice = op_args.GetDbSlice();
@@ -572,7 +663,11 @@ OpResult<uint32_t> OpAddEx(const OpArgs& op_args, string_view key, uint32_t ttl_
     CHECK(IsDenseEncoding(co));
   }
 
-  return StringSetWrapper{co, op_args.db_cntx}.Add(vals, ttl_sec, keepttl);
+  StringSetWrapper ss{co, op_args.db_cntx};
+  uint32_t res = ss.Add(vals, ttl_sec, keepttl);
+  db_slice.OnFieldExpiry(op_args.db_cntx.db_index, key, ss->UpperBoundSize(),
+                         MemberTimeSeconds(op_args.db_cntx.time_now_ms) + ttl_sec);
+  return res;
 }
 
 OpResult<uint32_t> OpRem(const OpArgs& op_args, string_view key, facade::ArgRange vals,
@@ -592,7 +687,7 @@ OpResult<uint32_t> OpRem(const OpArgs& op_args, string_view key, facade::ArgRang
     db_slice.Del(op_args.db_cntx, find_res->it);
   }
   if (journal_rewrite && op_args.shard->journal()) {
-    vector<string_view> mapped(vals.Size() + 1);
+    auto mapped = MakeScratchVector<string_view>(vals.Size() + 1);
     mapped[0] = key;
     std::copy(vals.begin(), vals.end(), mapped.begin() + 1);
     RecordJournal(op_args, "SREM"sv, mapped);
@@ -775,8 +870,21 @@ OpResult<StringVec> OpDiff(const OpArgs& op_args, ShardArgs::Iterator start,
   return ToVec(std::move(uniques));
 }
 
+// Returns the members of the set, at most limit if positive.
+StringVec ReadMembers(const PrimeValue& pv, unsigned limit = 0) {
+  StringVec result;
+  container_utils::IterateSet(pv, [&result, limit](container_utils::ContainerEntry ce) {
+    result.push_back(ce.ToString());
+    return result.size() != limit;
+  });
+  return result;
+}
+
 // Read-only OpInter op on sets.
-OpResult<StringVec> OpInter(const Transaction* t, EngineShard* es, bool remove_first) {
+// limit - stop after that many members if positive, valid only if the shard holds all the keys.
+// offload - if set, a single set may be pinned instead of read, see OffloadedRead.
+OpResult<StringVec> OpInter(const Transaction* t, EngineShard* es, bool remove_first,
+                            unsigned limit = 0, container_utils::OffloadedRead* offload = nullptr) {
   auto& db_slice = t->GetDbSlice(es->shard_id());
   ShardArgs args = t->GetShardArgs(es->shard_id());
   auto it = args.begin();
@@ -792,17 +900,15 @@ OpResult<StringVec> OpInter(const Transaction* t, EngineShard* es, bool remove_f
       return find_res.status();
 
     const PrimeValue& pv = find_res.value()->second;
+    if (offload && offload->TryPin(&db_slice, t->GetDbIndex(), *it, pv, pv.Size()))
+      return result;
+
     if (IsDenseEncoding(pv)) {
       StringSet* ss = (StringSet*)pv.RObjPtr();
       ss->set_time(MemberTimeSeconds(t->GetDbContext().time_now_ms));
     }
 
-    container_utils::IterateSet(find_res.value()->second,
-                                [&result](container_utils::ContainerEntry ce) {
-                                  result.push_back(ce.ToString());
-                                  return true;
-                                });
-    return result;
+    return ReadMembers(pv, limit);
   }
 
   vector<SetType> sets(args.Size() - int(remove_first));
@@ -833,8 +939,13 @@ OpResult<StringVec> OpInter(const Transaction* t, EngineShard* es, bool remove_f
 
   std::sort(sets.begin(), sets.end(), comp);
 
+  bool all_intsets = all_of(sets.begin(), sets.end(),
+                            [](const SetType& st) { return st.second == kEncodingIntSet; });
+
   int encoding = sets.front().second;
-  if (encoding == kEncodingIntSet) {
+  if (all_intsets) {
+    InterIntSets(sets, limit, &result);
+  } else if (encoding == kEncodingIntSet) {
     int ii = 0;
     intset* is = (intset*)sets.front().first;
     int64_t intele;
@@ -849,10 +960,12 @@ OpResult<StringVec> OpInter(const Transaction* t, EngineShard* es, bool remove_f
       /* Only take action when all sets contain the member */
       if (j == sets.size()) {
         result.push_back(absl::StrCat(intele));
+        if (result.size() == limit)
+          break;
       }
     }
   } else {
-    InterStrSet(t->GetDbContext(), sets, &result);
+    InterStrSet(t->GetDbContext(), sets, limit, &result);
   }
 
   return result;
@@ -939,7 +1052,7 @@ OpResult<StringVec> OpPop(const OpArgs& op_args, string_view key, unsigned count
 
   // Replicate as SREM with removed keys, because SPOP is not deterministic.
   if (op_args.shard->journal()) {
-    vector<string_view> mapped(result.size() + 1);
+    auto mapped = MakeScratchVector<string_view>(result.size() + 1);
     mapped[0] = key;
     copy(result.begin(), result.end(), mapped.begin() + 1);
     RecordJournal(op_args, "SREM"sv, mapped);
@@ -1229,9 +1342,12 @@ void SDiffStore(CmdArgList args, const CommandContext& cmd_cntx) {
 }
 
 void SMembers(CmdArgList args, const CommandContext& cmd_cntx) {
-  auto cb = [](Transaction* t, EngineShard* shard) { return OpInter(t, shard, false); };
-
-  OpResult<StringVec> result = cmd_cntx.tx->ScheduleSingleHopT(std::move(cb));
+  container_utils::OffloadedRead offload{cmd_cntx.tx};
+  OpResult<StringVec> result;
+  offload.Run(
+      cmd_cntx.tx,
+      [&](Transaction* t, EngineShard* shard) { result = OpInter(t, shard, false, 0, &offload); },
+      [&](const PrimeValue& pv) { result = ReadMembers(pv); });
 
   if (result || result.status() == OpStatus::KEY_NOTFOUND) {
     SetReplies{cmd_cntx.rb, bool(cmd_cntx.conn_cntx->conn_state.script_info)}.Send(&result.value());
@@ -1341,9 +1457,11 @@ void SInterCard(CmdArgList args, const CommandContext& cmd_cntx) {
   } else if (args.size() > (num_keys + 1))
     return cmd_cntx.rb->SendError(kSyntaxErr);
 
+  // A single shard computes the final intersection, so it can stop at the limit.
+  unsigned shard_limit = cmd_cntx.tx->GetUniqueShardCnt() == 1 ? limit : 0;
   ResultStringVec result_set(shard_set->size(), OpStatus::SKIPPED);
   auto cb = [&](Transaction* t, EngineShard* shard) {
-    result_set[shard->shard_id()] = OpInter(t, shard, false);
+    result_set[shard->shard_id()] = OpInter(t, shard, false, shard_limit);
     return OpStatus::OK;
   };
 
@@ -1391,24 +1509,30 @@ void SUnionStore(CmdArgList args, const CommandContext& cmd_cntx) {
 
   cmd_cntx.tx->Execute(std::move(union_cb), false);
 
-  ResultSetView unionset = UnionResultVec(result_set);
-  if (!unionset) {
-    cmd_cntx.tx->Conclude();
-    cmd_cntx.rb->SendError(unionset.status());
-    return;
+  for (const auto& val : result_set) {
+    if (!val && !base::_in(val.status(), {OpStatus::SKIPPED, OpStatus::KEY_NOTFOUND})) {
+      cmd_cntx.tx->Conclude();
+      cmd_cntx.rb->SendError(val.status());
+      return;
+    }
   }
 
-  size_t result_size = unionset.value().size();
+  // The destination shard merges the partial unions, so they are not collected here.
+  OpResult<uint32_t> result_size = 0u;
   auto store_cb = [&](Transaction* t, EngineShard* shard) {
     if (shard->shard_id() == dest_shard) {
-      OpAdd(t->GetOpArgs(shard), dest_key, std::move(unionset.value()), true, true);
+      result_size = OpStoreUnion(t->GetOpArgs(shard), dest_key, &result_set);
     }
 
     return OpStatus::OK;
   };
 
   cmd_cntx.tx->Execute(std::move(store_cb), true);
-  cmd_cntx.rb->SendLong(result_size);
+  if (result_size) {
+    cmd_cntx.rb->SendLong(*result_size);
+  } else {
+    cmd_cntx.rb->SendError(result_size.status());
+  }
 }
 
 void SScan(CmdArgList args, const CommandContext& cmd_cntx) {
@@ -1570,7 +1694,7 @@ int32_t SetFamily::FieldExpireTime(const DbContext& db_context, const PrimeValue
 }
 
 vector<long> SetFamily::SetFieldsExpireTime(const OpArgs& op_args, uint32_t ttl_sec,
-                                            CmdArgList values, PrimeValue* pv) {
+                                            string_view key, CmdArgList values, PrimeValue* pv) {
   DCHECK_EQ(OBJ_SET, pv->ObjType());
 
   if (pv->Encoding() == kEncodingIntSet) {
@@ -1585,8 +1709,12 @@ vector<long> SetFamily::SetFieldsExpireTime(const OpArgs& op_args, uint32_t ttl_
   }
 
   auto ss = static_cast<StringSet*>(pv->RObjPtr());
-  ss->set_time(MemberTimeSeconds(op_args.db_cntx.time_now_ms));
-  return ExpireElements(ss, values, ttl_sec);
+  uint32_t now = MemberTimeSeconds(op_args.db_cntx.time_now_ms);
+  ss->set_time(now);
+  vector<long> res = ExpireElements(ss, values, ttl_sec);
+  op_args.GetDbSlice().OnFieldExpiry(op_args.db_cntx.db_index, key, ss->UpperBoundSize(),
+                                     now + ttl_sec);
+  return res;
 }
 
 }  // namespace dfly
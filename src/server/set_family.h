@@ -32,7 +32,8 @@ class SetFamily {
                                  std::string_view field);
 
   static std::vector<long> SetFieldsExpireTime(const OpArgs& op_args, uint32_t ttl_sec,
-                                               CmdArgList values, PrimeValue* pv);
+                                               std::string_view key, CmdArgList values,
+                                               PrimeValue* pv);
 };
 
 }  // namespace dfly
@@ -79,6 +79,48 @@ TEST_F(SetFamilyTest, SUnionStore) {
   EXPECT_THAT(resp.GetVec(), UnorderedElementsAre("11", "10", "1", "2", "3"));
 }
 
+TEST_F(SetFamilyTest, SMembersOffload) {
+  absl::FlagSaver fs;
+  SetTestFlag("read_offload_min_len", "3");
+
+  Run({"sadd", "small", "a", "b"});
+  Run({"sadd", "ints", "1", "2", "3"});
+  Run({"sadd", "strs", "a", "b", "c", "d"});
+  EXPECT_THAT(Run({"smembers", "small"}).GetVec(), UnorderedElementsAre("a", "b"));
+  EXPECT_THAT(Run({"smembers", "ints"}).GetVec(), UnorderedElementsAre("1", "2", "3"));
+  EXPECT_THAT(Run({"smembers", "strs"}).GetVec(), UnorderedElementsAre("a", "b", "c", "d"));
+  EXPECT_THAT(Run({"smembers", "missing"}), ArrLen(0));
+
+  // Sets with expiring members are read in the shard thread.
+  Run({"saddex", "exp", "100", "x", "y", "z"});
+  EXPECT_THAT(Run({"smembers", "exp"}).GetVec(), UnorderedElementsAre("x", "y", "z"));
+
+  // The key is unlocked after the read.
+  EXPECT_THAT(Run({"srem", "strs", "a"}), IntArg(1));
+  EXPECT_THAT(Run({"smembers", "strs"}).GetVec(), UnorderedElementsAre("b", "c", "d"));
+}
+
+TEST_F(SetFamilyTest, SUnionStoreLarge) {
+  // The union is stored in batches, overlapping members are counted once.
+  vector<string> cmd1 = {"sadd", "s1"}, cmd2 = {"sadd", "s2"};
+  for (int i = 0; i < 3000; ++i) {
+    cmd1.push_back(absl::StrCat("m", i));
+    cmd2.push_back(absl::StrCat("m", i + 1500));
+  }
+  Run(absl::MakeSpan(cmd1));
+  Run(absl::MakeSpan(cmd2));
+
+  EXPECT_EQ(4500, CheckedInt({"sunionstore", "dest", "s1", "s2", "s1"}));
+  EXPECT_EQ(4500, CheckedInt({"scard", "dest"}));
+  EXPECT_EQ(1, CheckedInt({"sismember", "dest", "m4499"}));
+
+  EXPECT_EQ(0, CheckedInt({"sunionstore", "dest", "none1", "none2"}));
+  EXPECT_EQ(0, CheckedInt({"exists", "dest"}));
+
+  Run({"set", "str", "foo"});
+  EXPECT_THAT(Run({"sunionstore", "dest", "s1", "str"}), ErrArg("WRONGTYPE"));
+}
+
 TEST_F(SetFamilyTest, SDiff) {
   auto resp = Run({"sadd", "b", "1", "2", "3"});
   Run({"sadd", "c", "10", "11"});
@@ -144,6 +186,24 @@ TEST_F(SetFamilyTest, SInterCard) {
   EXPECT_THAT(resp, ErrArg("value is not an integer or out of range"));
 }
 
+TEST_F(SetFamilyTest, SInterIntSets) {
+  vector<string> evens = {"sadd", "evens"}, thirds = {"sadd", "thirds"};
+  for (int i = -240; i < 240; i += 2)
+    evens.push_back(absl::StrCat(i));
+  for (int i = -240; i < 240; i += 3)
+    thirds.push_back(absl::StrCat(i));
+  Run(absl::MakeSpan(evens));
+  Run(absl::MakeSpan(thirds));
+  Run({"sadd", "few", "-240", "-1", "6", "7", "100000", "234"});
+
+  EXPECT_EQ(80, CheckedInt({"sintercard", "2", "evens", "thirds"}));
+  EXPECT_EQ(10, CheckedInt({"sintercard", "2", "evens", "thirds", "LIMIT", "10"}));
+  EXPECT_THAT(Run({"sinter", "evens", "thirds", "few"}).GetVec(),
+              UnorderedElementsAre("-240", "6", "234"));
+  EXPECT_THAT(Run({"sinter", "few", "few"}).GetVec(),
+              UnorderedElementsAre("-240", "-1", "6", "7", "100000", "234"));
+}
+
 TEST_F(SetFamilyTest, SMove) {
   auto resp = Run({"sadd", "a", "1", "2", "3", "4"});
   Run({"sadd", "b", "3", "5", "6", "2"});
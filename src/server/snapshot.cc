@@ -7,20 +7,43 @@
 #include <absl/strings/match.h>
 #include <absl/strings/str_cat.h>
 
+#include <algorithm>
+
 #include "base/cycle_clock.h"
 #include "base/flags.h"
 #include "base/logging.h"
 #include "core/heap_size.h"
+#include "core/task_queue.h"
+#include "server/cluster_support.h"
 #include "server/db_slice.h"
 #include "server/engine_shard_set.h"
 #include "server/journal/journal.h"
 #include "server/rdb_extensions.h"
+#include "server/rdb_load.h"
 #include "server/rdb_save.h"
 #include "server/server_state.h"
 #include "server/tiered_storage.h"
 #include "util/fibers/synchronization.h"
 
 ABSL_FLAG(bool, point_in_time_snapshot, true, "If true replication uses point in time snapshoting");
+ABSL_FLAG(bool, snapshot_offload_compression, false,
+          "If true, multi-entry snapshot blobs are compressed through the offload queue so that "
+          "idle threads can take over the compression work");
+ABSL_FLAG(uint32_t, snapshot_pipeline_depth, 1,
+          "Max number of serialized blobs per shard that are compressed and written while the "
+          "snapshot fiber keeps serializing. Values above 1 pipeline saves; compression is then "
+          "offloaded to idle threads. Not used for replication");
+ABSL_FLAG(uint64_t, snapshot_buffer_limit, 0,
+          "If positive, caps the bytes a snapshot may buffer per shard. Writes to buckets that were "
+          "not serialized yet flush the buffer before proceeding once the cap is reached");
+ABSL_FLAG(bool, snapshot_copy_on_write, false,
+          "If true, writes during a point in time save copy the string entries of the affected "
+          "bucket instead of serializing them inline. The copies are serialized by the snapshot "
+          "fiber. Not used for replication");
+ABSL_FLAG(uint32_t, compression_dict_size, 0,
+          "If positive and zstd compression is used, every shard trains a zstd dictionary of up "
+          "to this many bytes on a sample of its entries and compresses its snapshot blobs with "
+          "it");
 
 namespace dfly {
 
@@ -37,6 +60,10 @@ thread_local absl::flat_hash_set<SliceSnapshot*> tl_slice_snapshots;
 // it may require (especially with compression), and less responsive the server may be.
 constexpr size_t kMinBlobSize = 8_KB;
 
+// Max bytes of offloaded values to collect before awaiting their reads. Larger batches allow
+// OpManager to merge reads of nearby pages into longer sequential ones.
+constexpr size_t kMaxDelayedBytes = 256_KB;
+
 }  // namespace
 
 SliceSnapshot::SliceSnapshot(CompressionMode compression_mode, DbSlice* slice,
@@ -51,6 +78,7 @@ SliceSnapshot::SliceSnapshot(CompressionMode compression_mode, DbSlice* slice,
 
 SliceSnapshot::~SliceSnapshot() {
   DCHECK(db_slice_->shard_owner()->IsMyThread());
+  DCHECK_EQ(pushes_inflight_, 0u);
   tl_slice_snapshots.erase(this);
 }
 
@@ -74,6 +102,17 @@ void SliceSnapshot::Start(bool stream_journal, SnapshotFlush allow_flush) {
   };
 
   snapshot_version_ = db_slice_->RegisterOnChange(std::move(db_cb));
+  if (delta_mode_ != DeltaMode::NONE) {
+    DCHECK(!stream_journal);
+    auto deleted = db_slice_->RestartDeltaTracking(snapshot_version_);
+    if (delta_mode_ == DeltaMode::DELTA) {
+      // The caller pinned the tracking, so it can not be incomplete.
+      CHECK(deleted);
+      delta_base_version_ = deleted->version;
+      deleted_keys_ = std::move(*deleted);
+    }
+  }
+  buffer_limit_ = absl::GetFlag(FLAGS_snapshot_buffer_limit);
 
   if (stream_journal) {
     use_snapshot_version_ = absl::GetFlag(FLAGS_point_in_time_snapshot);
@@ -86,6 +125,12 @@ void SliceSnapshot::Start(bool stream_journal, SnapshotFlush allow_flush) {
       };
       moved_cb_id_ = db_slice_->RegisterOnMove(std::move(moved_cb));
     }
+  } else {
+    // Journal changes must follow the values they modify, so copies that are serialized later
+    // can only be used when no journal is streamed.
+    copy_on_write_ = absl::GetFlag(FLAGS_snapshot_copy_on_write);
+    // The journal consumer relies on pushes to throttle, so only saves are pipelined.
+    pipeline_depth_ = max(absl::GetFlag(FLAGS_snapshot_pipeline_depth), 1u);
   }
 
   const auto flush_threshold = ServerState::tlocal()->serialization_max_chunk_size;
@@ -102,6 +147,8 @@ void SliceSnapshot::Start(bool stream_journal, SnapshotFlush allow_flush) {
     };
   }
   serializer_ = std::make_unique<RdbSerializer>(compression_mode_, flush_fun);
+  serializer_->set_deferred_compression(absl::GetFlag(FLAGS_snapshot_offload_compression) ||
+                                        pipeline_depth_ > 1);
 
   VLOG(1) << "DbSaver::Start - saving entries with version less than " << snapshot_version_;
 
@@ -112,11 +159,37 @@ void SliceSnapshot::Start(bool stream_journal, SnapshotFlush allow_flush) {
     if (!use_snapshot_version_) {
       db_slice_->UnregisterOnMoved(moved_cb_id_);
     }
+    WaitForPushes();
     consumer_->Finalize();
     VLOG(1) << "Serialization peak bytes: " << serializer_->GetSerializationPeakBytes();
   });
 }
 
+void SliceSnapshot::EnableKeyIndex() {
+  key_index_ = make_unique<KeyIndexState>();
+}
+
+optional<detail::SnapshotKeyIndex> SliceSnapshot::TakeKeyIndex() {
+  if (!key_index_ || !cntx_->IsRunning())
+    return nullopt;
+
+  // Records were consumed in id order, so record_bounds is indexed by id.
+  const auto& bounds = key_index_->record_bounds;
+  detail::SnapshotKeyIndex index;
+  for (const auto& chain : key_index_->chains) {
+    DCHECK_LE(chain.last_id, bounds.size());
+    uint32_t chain_id =
+        index.AddChain({bounds[chain.first_id - 1].first, bounds[chain.last_id - 1].second});
+    for (auto [hash, slot] : chain.keys)
+      index.AddKey(hash, slot, chain_id);
+  }
+  if (key_index_->dict_chain != detail::SnapshotKeyIndex::kNoChain)
+    index.SetDictChain(key_index_->dict_chain);
+
+  key_index_.reset();
+  return index;
+}
+
 void SliceSnapshot::StartIncremental(LSN start_lsn) {
   VLOG(1) << "StartIncremental: " << start_lsn;
   serializer_ = std::make_unique<RdbSerializer>(compression_mode_);
@@ -171,6 +244,11 @@ void SliceSnapshot::IterateBucketsFb(bool send_full_sync_cut) {
 
   const uint64_t kCyclesPerJiffy = base::CycleClock::Frequency() >> 16;  // ~15usec.
 
+  TrainCompressionDict();
+
+  if (delta_mode_ == DeltaMode::DELTA)
+    SerializeDeletedKeys();
+
   for (DbIndex snapshot_db_index_ = 0; snapshot_db_index_ < db_array_.size();
        ++snapshot_db_index_) {
     if (!cntx_->IsRunning())
@@ -192,6 +270,11 @@ void SliceSnapshot::IterateBucketsFb(bool send_full_sync_cut) {
           [this, &snapshot_db_index_](auto it) { return BucketSaveCb(snapshot_db_index_, it); });
       snapshot_cursor_ = next;
 
+      if (!copied_entries_.empty()) {
+        std::lock_guard guard(big_value_mu_);
+        SerializeCopiedEntries();
+      }
+
       // If we do not flush the data, and have not preempted,
       // we may need to yield to other fibers to avoid grabbing CPU for too long.
       if (!PushSerialized(false)) {
@@ -202,6 +285,10 @@ void SliceSnapshot::IterateBucketsFb(bool send_full_sync_cut) {
     } while (snapshot_cursor_);
 
     DVLOG(2) << "after loop " << ThisFiber::GetName();
+    {
+      std::lock_guard guard(big_value_mu_);
+      SerializeCopiedEntries();
+    }
     PushSerialized(true);
   }  // for (dbindex)
 
@@ -214,7 +301,9 @@ void SliceSnapshot::IterateBucketsFb(bool send_full_sync_cut) {
   // serialized + side_saved must be equal to the total saved.
   VLOG(1) << "Exit SnapshotSerializer loop_serialized: " << stats_.loop_serialized
           << ", side_saved " << stats_.side_saved << ", cbcalls " << stats_.savecb_calls
-          << ", journal_saved " << stats_.jounal_changes << ", moved_saved " << stats_.moved_saved;
+          << ", journal_saved " << stats_.jounal_changes << ", moved_saved " << stats_.moved_saved
+          << ", copied " << stats_.copied << ", throttled " << stats_.throttled
+          << ", delta_skipped " << stats_.delta_skipped;
 }
 
 void SliceSnapshot::SwitchIncrementalFb(LSN lsn) {
@@ -270,6 +359,12 @@ bool SliceSnapshot::BucketSaveCb(DbIndex db_index, PrimeTable::bucket_iterator i
       return false;
     }
 
+    // Did not change since the previous snapshot of the delta chain.
+    if (IsUnchangedSinceDelta(it.GetVersion())) {
+      ++stats_.delta_skipped;
+      return false;
+    }
+
     db_slice_->FlushChangeToEarlierCallbacks(db_index, DbSlice::Iterator::FromPrime(it),
                                              snapshot_version_);
   }
@@ -306,6 +401,121 @@ unsigned SliceSnapshot::SerializeBucket(DbIndex db_index, PrimeTable::bucket_ite
   return result;
 }
 
+unsigned SliceSnapshot::CopyBucket(DbIndex db_index, PrimeTable::bucket_iterator it) {
+  DCHECK_LT(it.GetVersion(), snapshot_version_);
+  it.SetVersion(snapshot_version_);
+
+  serialize_bucket_running_ = true;
+
+  unsigned result = 0;
+  for (it.AdvanceIfNotOccupied(); !it.is_done(); ++it) {
+    ++result;
+    const PrimeKey& pk = it->first;
+    const PrimeValue& pv = it->second;
+
+    // Containers and offloaded values have no cheap copy, so they are serialized as usual.
+    if (pv.ObjType() != OBJ_STRING || pv.IsExternal()) {
+      SerializeEntry(db_index, pk, pv);
+      continue;
+    }
+
+    CopiedEntry entry{db_index, pk.ToString(), pv.ToString(), 0, 0};
+    if (pv.HasExpire()) {
+      auto eit = db_array_[db_index]->expire.Find(pk);
+      entry.expire = db_slice_->ExpireTime(eit);
+    }
+    if (pv.HasFlag())
+      entry.mc_flags = db_slice_->GetMCFlag(db_index, pk);
+
+    copied_bytes_ += entry.key.size() + entry.value.size();
+    copied_entries_.push_back(std::move(entry));
+    ++stats_.copied;
+  }
+  serialize_bucket_running_ = false;
+  return result;
+}
+
+void SliceSnapshot::SerializeCopiedEntries() {
+  if (copied_entries_.empty())
+    return;
+
+  // SaveEntry might preempt while flushing, so new copies are collected into a fresh vector.
+  std::vector<CopiedEntry> entries = std::exchange(copied_entries_, {});
+  copied_bytes_ = 0;
+  for (const CopiedEntry& entry : entries) {
+    PrimeKey pk{entry.key};
+    IndexKey(pk);
+    io::Result<uint8_t> res = serializer_->SaveEntry(pk, PrimeValue{entry.value}, entry.expire,
+                                                     entry.mc_flags, entry.dbid);
+    CHECK(res);
+    ++type_freq_map_[*res];
+  }
+}
+
+void SliceSnapshot::SerializeDeletedKeys() {
+  std::lock_guard guard(big_value_mu_);
+  for (const auto& [dbid, key] : deleted_keys_.keys) {
+    CHECK(!serializer_->SaveDeletedKey(key, dbid));
+    PushSerialized(false);
+  }
+  deleted_keys_ = {};
+}
+
+void SliceSnapshot::TrainCompressionDict() {
+  size_t dict_size = absl::GetFlag(FLAGS_compression_dict_size);
+  if (dict_size == 0 || compression_mode_ != CompressionMode::MULTI_ENTRY_ZSTD)
+    return;
+
+  // Zstd recommends samples of about 100 times the dictionary size. Large values are skipped,
+  // they compress well enough on their own.
+  const size_t kMaxSamplesBytes = dict_size * 100;
+  constexpr size_t kMaxSampleValueSize = 4_KB;
+
+  string samples;
+  vector<size_t> sample_sizes;
+  RdbSerializer sample_serializer(CompressionMode::NONE);
+  for (DbIndex db_indx = 0; db_indx < db_array_.size(); ++db_indx) {
+    if (!db_array_[db_indx])
+      continue;
+
+    PrimeTable* pt = &db_array_[db_indx]->prime;
+    PrimeTable::Cursor cursor;
+    do {
+      cursor = pt->TraverseBuckets(cursor, [&](PrimeTable::bucket_iterator it) {
+        for (it.AdvanceIfNotOccupied(); !it.is_done(); ++it) {
+          if (it->second.IsExternal() || it->second.MallocUsed() > kMaxSampleValueSize)
+            continue;
+          CHECK(sample_serializer.SaveEntry(it->first, it->second, 0, 0, db_indx));
+
+          io::StringFile sfile;
+          CHECK(!sample_serializer.FlushToSink(&sfile, SerializerBase::FlushState::kFlushEndEntry));
+          sample_sizes.push_back(sfile.val.size());
+          samples.append(sfile.val);
+        }
+      });
+
+      // Sampling does not need a consistent view, so we let other fibers run in between.
+      ThisFiber::Yield();
+    } while (cursor && samples.size() < kMaxSamplesBytes && cntx_->IsRunning());
+  }
+
+  // Training takes a while, so it runs on an idle thread if there is one.
+  shared_ptr<const detail::ZstdDict> dict;
+  OffloadQueue::Run([&] { dict = detail::ZstdDict::Train(samples, sample_sizes, dict_size); });
+  if (!dict) {
+    VLOG(1) << "Could not train compression dictionary on " << sample_sizes.size() << " samples";
+    return;
+  }
+
+  // The blob with the dictionary itself is compressed without it.
+  std::lock_guard guard(big_value_mu_);
+  CHECK(!serializer_->SaveCompressionDict(dict->data()));
+  PushSerialized(true);
+  serializer_->set_compression_dict(std::move(dict));
+  if (key_index_ && !key_index_->chains.empty())
+    key_index_->dict_chain = key_index_->chains.size() - 1;
+}
+
 void SliceSnapshot::SerializeEntry(DbIndex db_indx, const PrimeKey& pk, const PrimeValue& pv) {
   if (pv.IsExternal() && pv.IsCool())
     return SerializeEntry(db_indx, pk, pv.GetCool().record->value);
@@ -321,6 +531,7 @@ void SliceSnapshot::SerializeEntry(DbIndex db_indx, const PrimeKey& pk, const Pr
     // TODO: we loose the stickiness attribute by cloning like this PrimeKey.
     SerializeExternal(db_indx, PrimeKey{pk.ToString()}, pv, expire_time, mc_flags);
   } else {
+    IndexKey(pk);
     io::Result<uint8_t> res = serializer_->SaveEntry(pk, pv, expire_time, mc_flags, db_indx);
     CHECK(res);
     ++type_freq_map_[*res];
@@ -333,14 +544,48 @@ size_t SliceSnapshot::FlushSerialized(SerializerBase::FlushState flush_state) {
   CHECK(!ec);  // always succeeds
 
   size_t serialized = sfile.val.size();
-  if (serialized == 0)
+  if (serialized == 0) {
+    // An entry may end right at a mid entry flush, which closes the chain without a new record.
+    if (key_index_ && key_index_->open_chain_id)
+      IndexRecord(0, flush_state);
     return 0;
+  }
 
   uint64_t id = rec_id_++;
   DVLOG(2) << "Pushing " << id;
 
+  if (key_index_)
+    IndexRecord(id, flush_state);
+
   uint64_t running_cycles = ThisFiber::GetRunningTimeCycles();
 
+  if (pipeline_depth_ > 1) {
+    PushAsync(id, std::move(sfile.val), serializer_->last_flush_compressible());
+  } else {
+    // The id is already reserved, so preempting here does not reorder the records.
+    if (serializer_->last_flush_compressible()) {
+      OffloadQueue::Run([&] {
+        SerializerBase::CompressFlushedBlob(compression_mode_, &sfile.val,
+                                            serializer_->compression_dict().get());
+      });
+      serialized = sfile.val.size();
+    }
+
+    ConsumeInOrder(id, std::move(sfile.val));
+  }
+
+  VLOG(2) << "Pushed with Serialize() " << serialized;
+
+  // FlushToSink can be quite slow for large values or due compression, therefore
+  // we counter-balance CPU over-usage by forcing sleep.
+  // We measure running_cycles before the preemption points, because they reset the counter.
+  uint64_t sleep_usec = (running_cycles * 1000'000 / base::CycleClock::Frequency()) / 2;
+  ThisFiber::SleepFor(chrono::microseconds(std::min<uint64_t>(sleep_usec, 2000ul)));
+
+  return serialized;
+}
+
+void SliceSnapshot::ConsumeInOrder(uint64_t id, std::string blob) {
   fb2::NoOpLock lk;
   // We create a critical section here that ensures that records are pushed in sequential order.
   // As a result, it is not possible for two fiber producers to push concurrently.
@@ -350,25 +595,73 @@ size_t SliceSnapshot::FlushSerialized(SerializerBase::FlushState flush_state) {
   seq_cond_.wait(lk, [&] { return id == this->last_pushed_id_ + 1; });
 
   // Blocking point.
-  consumer_->ConsumeData(std::move(sfile.val), cntx_);
+  size_t offset = consumer_->BytesConsumed();
+  consumer_->ConsumeData(std::move(blob), cntx_);
+  if (key_index_) {
+    DCHECK_EQ(key_index_->record_bounds.size() + 1, id);
+    key_index_->record_bounds.emplace_back(offset, consumer_->BytesConsumed());
+  }
 
   DCHECK_EQ(last_pushed_id_ + 1, id);
   last_pushed_id_ = id;
   seq_cond_.notify_all();
+}
 
-  VLOG(2) << "Pushed with Serialize() " << serialized;
+void SliceSnapshot::PushAsync(uint64_t id, std::string blob, bool compress) {
+  fb2::NoOpLock lk;
+  pipeline_cond_.wait(lk, [&] { return pushes_inflight_ < pipeline_depth_; });
+
+  ++pushes_inflight_;
+  size_t len = blob.size();
+  inflight_bytes_ += len;
+
+  // Compression runs on an idle thread if there is one and the write is ordered by id, so the
+  // snapshot fiber continues serializing the next buckets meanwhile.
+  fb2::Fiber("snapshot_push", [this, id, len, compress, dict = serializer_->compression_dict(),
+                               blob = std::move(blob)]() mutable {
+    if (compress) {
+      OffloadQueue::Run(
+          [&] { SerializerBase::CompressFlushedBlob(compression_mode_, &blob, dict.get()); });
+    }
+    ConsumeInOrder(id, std::move(blob));
 
-  // FlushToSink can be quite slow for large values or due compression, therefore
-  // we counter-balance CPU over-usage by forcing sleep.
-  // We measure running_cycles before the preemption points, because they reset the counter.
-  uint64_t sleep_usec = (running_cycles * 1000'000 / base::CycleClock::Frequency()) / 2;
-  ThisFiber::SleepFor(chrono::microseconds(std::min<uint64_t>(sleep_usec, 2000ul)));
+    inflight_bytes_ -= len;
+    --pushes_inflight_;
+    pipeline_cond_.notify_all();
+  }).Detach();
+}
 
-  return serialized;
+void SliceSnapshot::WaitForPushes() {
+  fb2::NoOpLock lk;
+  pipeline_cond_.wait(lk, [&] { return pushes_inflight_ == 0; });
+}
+
+void SliceSnapshot::IndexKey(const PrimeKey& pk) {
+  if (key_index_) {
+    string tmp;
+    key_index_->pending_keys.emplace_back(pk.HashCode(), KeySlot(pk.GetSlice(&tmp)));
+  }
+}
+
+void SliceSnapshot::IndexRecord(uint64_t id, FlushState flush_state) {
+  KeyIndexState& state = *key_index_;
+  if (!state.open_chain_id) {
+    DCHECK(id);
+    state.open_chain_id = id;
+  }
+
+  // Records flushed in the middle of an entry continue the chain.
+  if (flush_state != FlushState::kFlushEndEntry)
+    return;
+
+  uint64_t last_id = id ? id : rec_id_ - 1;
+  state.chains.push_back({state.open_chain_id, last_id, std::move(state.pending_keys)});
+  state.pending_keys.clear();
+  state.open_chain_id = 0;
 }
 
 bool SliceSnapshot::PushSerialized(bool force) {
-  if (!force && serializer_->SerializedLen() < kMinBlobSize && delayed_entries_.size() < 32)
+  if (!force && serializer_->SerializedLen() < kMinBlobSize && delayed_bytes_ < kMaxDelayedBytes)
     return false;
 
   // Flush any of the leftovers to avoid interleavings
@@ -376,22 +669,32 @@ bool SliceSnapshot::PushSerialized(bool force) {
 
   if (!delayed_entries_.empty()) {
     // Async bucket serialization might have accumulated some delayed values.
-    // Because we can finally block in this function, we'll await and serialize them
+    // Because we can finally block in this function, we'll await and serialize them.
+    // Reads are submitted in disk order, so we await them in the same order, starting from the
+    // back of the vector.
+    std::sort(delayed_entries_.begin(), delayed_entries_.end(),
+              [](const DelayedEntry& l, const DelayedEntry& r) { return l.offset > r.offset; });
+    delayed_bytes_ = 0;
     do {
       // We may call PushSerialized from multiple fibers concurrently, so we need to
       // ensure that we are not serializing the same entry concurrently.
       DelayedEntry entry = std::move(delayed_entries_.back());
       delayed_entries_.pop_back();
 
-      // TODO: https://github.com/dragonflydb/dragonfly/issues/4654
-      // there are a few problems with how we serialize external values.
-      // 1. We may block here too frequently, slowing down the process.
-      // 2. For small bin values, we issue multiple reads for the same page, creating
-      //    read factor amplification that can reach factor of ~60.
-      PrimeValue pv{entry.value.Get()};  // Might block until the future resolves.
+      PrimeValue pv;
+      if (entry.obj_type == OBJ_STRING) {
+        pv = PrimeValue{entry.value.Get()};  // Might block until the future resolves.
+      } else {
+        error_code ec = RdbValueLoader(RDB_VERSION).Load(entry.value.Get(), &pv);
+        CHECK(!ec) << "Failed to decode offloaded value: " << ec.message();
+      }
 
       // TODO: to introduce RdbSerializer::SaveString that can accept a string value directly.
-      serializer_->SaveEntry(entry.key, pv, entry.expire, entry.mc_flags, entry.dbid);
+      IndexKey(entry.key);
+      io::Result<uint8_t> res =
+          serializer_->SaveEntry(entry.key, pv, entry.expire, entry.mc_flags, entry.dbid);
+      if (res && entry.obj_type != OBJ_STRING)
+        ++type_freq_map_[*res];
     } while (!delayed_entries_.empty());
 
     // blocking point.
@@ -403,12 +706,18 @@ bool SliceSnapshot::PushSerialized(bool force) {
 void SliceSnapshot::SerializeExternal(DbIndex db_index, PrimeKey key, const PrimeValue& pv,
                                       time_t expire_time, uint32_t mc_flags) {
   // We prefer avoid blocking, so we just schedule a tiered read and append
-  // it to the delayed entries.
+  // it to the delayed entries. The read leaves the value offloaded.
   util::fb2::Future<string> future =
-      EngineShard::tlocal()->tiered_storage()->Read(db_index, key.ToString(), pv);
+      EngineShard::tlocal()->tiered_storage()->ReadForSnapshot(db_index, key.ToString(), pv);
+
+  auto segment = pv.GetExternalSlice();
+  delayed_bytes_ += segment.second;
+  delayed_entries_.push_back({db_index, std::move(key), std::move(future), expire_time, mc_flags,
+                              pv.ObjType(), segment.first});
 
-  delayed_entries_.push_back({db_index, std::move(key), std::move(future), expire_time, mc_flags});
-  ++type_freq_map_[RDB_TYPE_STRING];
+  // Offloaded containers are accounted once they are decoded in PushSerialized.
+  if (pv.ObjType() == OBJ_STRING)
+    ++type_freq_map_[RDB_TYPE_STRING];
 }
 
 void SliceSnapshot::OnDbChange(DbIndex db_index, const DbSlice::ChangeReq& req) {
@@ -421,20 +730,51 @@ void SliceSnapshot::OnDbChange(DbIndex db_index, const DbSlice::ChangeReq& req)
     const PrimeTable::bucket_iterator* bit = req.update();
 
     if (bit) {
-      if (!bit->is_done() && bit->GetVersion() < snapshot_version_) {
-        stats_.side_saved += SerializeBucket(db_index, *bit);
+      if (!bit->is_done() && bit->GetVersion() < snapshot_version_ &&
+          !IsUnchangedSinceDelta(bit->GetVersion())) {
+        ThrottleOnChange();
+        stats_.side_saved += SaveBucketOnChange(db_index, *bit);
       }
     } else {
       string_view key = get<string_view>(req.change);
+      bool throttled = false;
       table->CVCUponInsert(snapshot_version_, key,
-                           [this, db_index](PrimeTable::bucket_iterator it) {
+                           [this, db_index, &throttled](PrimeTable::bucket_iterator it) {
                              DCHECK_LT(it.GetVersion(), snapshot_version_);
-                             stats_.side_saved += SerializeBucket(db_index, it);
+                             if (IsUnchangedSinceDelta(it.GetVersion()))
+                               return;
+                             if (!std::exchange(throttled, true))
+                               ThrottleOnChange();
+                             stats_.side_saved += SaveBucketOnChange(db_index, it);
                            });
     }
   }
 }
 
+unsigned SliceSnapshot::SaveBucketOnChange(DbIndex db_index, PrimeTable::bucket_iterator it) {
+  if (copy_on_write_ && (buffer_limit_ == 0 || GetBufferedBytes() < buffer_limit_))
+    return CopyBucket(db_index, it);
+  return SerializeBucket(db_index, it);
+}
+
+void SliceSnapshot::ThrottleOnChange() {
+  if (buffer_limit_ == 0 || GetBufferedBytes() < buffer_limit_)
+    return;
+
+  // Called with big_value_mu_ held, so neither the snapshot fiber nor other writers touch
+  // the serializer or the table while we preempt. A writer flushes at most once, which bounds
+  // its delay by a single push to the consumer.
+  LatencyScope latency("snapshot-throttle");
+  ++stats_.throttled;
+  std::lock_guard latch_guard(*db_slice_->GetLatch());
+  SerializeCopiedEntries();
+  PushSerialized(true);
+}
+
+size_t SliceSnapshot::GetBufferedBytes() const {
+  return serializer_->SerializedLen() + copied_bytes_ + delayed_bytes_ + inflight_bytes_;
+}
+
 bool SliceSnapshot::IsPositionSerialized(DbIndex id, PrimeTable::Cursor cursor) {
   uint8_t depth = db_slice_->GetTables(id).first->depth();
 
@@ -490,7 +830,7 @@ size_t SliceSnapshot::GetTempBuffersSize() const {
     return 0;
   }
 
-  return serializer_->GetTempBufferSize();
+  return serializer_->GetTempBufferSize() + copied_bytes_ + inflight_bytes_;
 }
 
 RdbSaver::SnapshotStats SliceSnapshot::GetCurrentSnapshotProgress() const {
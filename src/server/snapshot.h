@@ -11,6 +11,7 @@
 #include "io/file.h"
 #include "server/common.h"
 #include "server/db_slice.h"
+#include "server/detail/snapshot_key_index.h"
 #include "server/rdb_save.h"
 #include "server/table.h"
 #include "util/fibers/future.h"
@@ -59,6 +60,11 @@ class SliceSnapshot : public journal::JournalConsumerInterface {
 
     // Finalizes the snapshot writing
     virtual void Finalize() = 0;
+
+    // Bytes written by the consumer so far, used for the offsets of the key index.
+    virtual size_t BytesConsumed() const {
+      return 0;
+    }
   };
 
   SliceSnapshot(CompressionMode compression_mode, DbSlice* slice,
@@ -74,6 +80,18 @@ class SliceSnapshot : public journal::JournalConsumerInterface {
 
   void Start(bool stream_journal, SnapshotFlush allow_flush = SnapshotFlush::kDisallow);
 
+  // Must be called before Start. Delta snapshots are only used for saves.
+  void SetDeltaMode(DeltaMode mode) {
+    delta_mode_ = mode;
+  }
+
+  // Collects an index of the serialized keys, see detail::SnapshotKeyIndex. Must be called
+  // before Start and only for saves of single shard files.
+  void EnableKeyIndex();
+
+  // Returns the key index once the snapshot finished, if it was enabled.
+  std::optional<detail::SnapshotKeyIndex> TakeKeyIndex();
+
   // Initialize a snapshot that sends only the missing journal updates
   // since start_lsn and then registers a callback switches into the
   // journal streaming mode until stopped.
@@ -120,12 +138,39 @@ class SliceSnapshot : public journal::JournalConsumerInterface {
   // Returns number of serialized entries, updates bucket version to snapshot version.
   unsigned SerializeBucket(DbIndex db_index, PrimeTable::bucket_iterator bucket_it);
 
+  // Copy string entries of a bucket into copied_entries_, serializing the rest inline.
+  // Updates bucket version to snapshot version like SerializeBucket.
+  unsigned CopyBucket(DbIndex db_index, PrimeTable::bucket_iterator bucket_it);
+
+  // Serialize entries collected by CopyBucket. Must be called with big_value_mu_ held.
+  void SerializeCopiedEntries();
+
+  bool IsUnchangedSinceDelta(uint64_t bucket_version) const {
+    return delta_mode_ == DeltaMode::DELTA && bucket_version <= delta_base_version_;
+  }
+
+  // Serialize keys deleted since the previous snapshot in delta mode.
+  void SerializeDeletedKeys();
+
+  // Train a zstd dictionary on a sample of the entries and write it to the stream, so that the
+  // following blobs are compressed with it. No-op unless compression_dict_size is set.
+  void TrainCompressionDict();
+
   // Serialize entry into passed serializer.
   void SerializeEntry(DbIndex db_index, const PrimeKey& pk, const PrimeValue& pv);
 
   // DbChange listener
   void OnDbChange(DbIndex db_index, const DbSlice::ChangeReq& req);
 
+  // Saves a bucket before it's mutated, either by copying or by serializing it.
+  unsigned SaveBucketOnChange(DbIndex db_index, PrimeTable::bucket_iterator bucket_it);
+
+  // Flushes buffered data if it exceeds buffer_limit_. Can block.
+  void ThrottleOnChange();
+
+  // Bytes serialized or copied but not pushed to the consumer yet.
+  size_t GetBufferedBytes() const;
+
   // DbSlice moved listener
   void OnMoved(DbIndex db_index, const DbSlice::MovedItemsVec& items);
   bool IsPositionSerialized(DbIndex db_index, PrimeTable::Cursor cursor);
@@ -145,6 +190,22 @@ class SliceSnapshot : public journal::JournalConsumerInterface {
   using FlushState = SerializerBase::FlushState;
   size_t FlushSerialized(FlushState flush_state);
 
+  // Passes blob with the given id to the consumer once all previous ids were consumed. Can block.
+  void ConsumeInOrder(uint64_t id, std::string blob);
+
+  // Compresses and consumes blob in a separate fiber. Blocks while pipeline_depth_ pushes are
+  // in flight.
+  void PushAsync(uint64_t id, std::string blob, bool compress);
+
+  // Blocks until all pushes started by PushAsync finish.
+  void WaitForPushes();
+
+  // Remembers the key of the entry that is serialized next for the key index.
+  void IndexKey(const PrimeKey& pk);
+
+  // Opens or closes a chain of the key index. Called with the id of every flushed record.
+  void IndexRecord(uint64_t id, FlushState flush_state);
+
   // An entry whose value must be awaited
   struct DelayedEntry {
     DbIndex dbid;
@@ -152,6 +213,17 @@ class SliceSnapshot : public journal::JournalConsumerInterface {
     util::fb2::Future<string> value;
     time_t expire;
     uint32_t mc_flags;
+    CompactObjType obj_type;  // containers are read in their serialized form
+    size_t offset;            // disk offset of the value
+  };
+
+  // An entry copied before its bucket was mutated, serialized later by the snapshot fiber
+  struct CopiedEntry {
+    DbIndex dbid;
+    std::string key;
+    std::string value;
+    time_t expire;
+    uint32_t mc_flags;
   };
 
   DbSlice* db_slice_;
@@ -161,11 +233,22 @@ class SliceSnapshot : public journal::JournalConsumerInterface {
 
   std::unique_ptr<RdbSerializer> serializer_;
   std::vector<DelayedEntry> delayed_entries_;  // collected during atomic bucket traversal
+  size_t delayed_bytes_ = 0;                   // disk bytes of delayed_entries_
+  std::vector<CopiedEntry> copied_entries_;    // collected by OnDbChange in copy on write mode
+  size_t copied_bytes_ = 0;                    // key and value bytes of copied_entries_
+
+  size_t buffer_limit_ = 0;  // 0 if unlimited
+  bool copy_on_write_ = false;
+
+  unsigned pipeline_depth_ = 1;  // 1 if blobs are pushed inline
+  unsigned pushes_inflight_ = 0;
+  size_t inflight_bytes_ = 0;  // uncompressed bytes of pushes in flight
 
   // Used for sanity checks.
   bool serialize_bucket_running_ = false;
   util::fb2::Fiber snapshot_fb_;  // IterateEntriesFb
   util::fb2::CondVarAny seq_cond_;
+  util::fb2::CondVarAny pipeline_cond_;
   const CompressionMode compression_mode_;
   RdbTypeFreqMap type_freq_map_;
 
@@ -177,8 +260,29 @@ class SliceSnapshot : public journal::JournalConsumerInterface {
 
   bool use_snapshot_version_ = true;
 
+  DeltaMode delta_mode_ = DeltaMode::NONE;
+  // In delta mode, buckets with version up to delta_base_version_ did not change since the
+  // previous snapshot and are skipped.
+  uint64_t delta_base_version_ = 0;
+  DbSlice::DeletedKeys deleted_keys_;
+
   uint64_t rec_id_ = 1, last_pushed_id_ = 0;
 
+  // State of the key index, set if it is enabled.
+  struct KeyIndexState {
+    struct Chain {
+      uint64_t first_id, last_id;
+      std::vector<std::pair<uint64_t, SlotId>> keys;  // hashes and slots
+    };
+
+    std::vector<Chain> chains;
+    std::vector<std::pair<uint64_t, SlotId>> pending_keys;  // serialized since the last chain
+    uint64_t open_chain_id = 0;  // first record of the open chain, 0 if none
+    std::vector<std::pair<size_t, size_t>> record_bounds;  // consumer offsets of every record
+    uint32_t dict_chain = detail::SnapshotKeyIndex::kNoChain;
+  };
+  std::unique_ptr<KeyIndexState> key_index_;
+
   struct Stats {
     size_t loop_serialized = 0;
     size_t skipped = 0;
@@ -187,6 +291,9 @@ class SliceSnapshot : public journal::JournalConsumerInterface {
     size_t keys_total = 0;
     size_t jounal_changes = 0;
     size_t moved_saved = 0;
+    size_t copied = 0;
+    size_t delta_skipped = 0;
+    size_t throttled = 0;
   } stats_;
 
   ThreadLocalMutex big_value_mu_;
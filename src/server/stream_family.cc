@@ -6,6 +6,8 @@
 
 #include <absl/strings/str_cat.h>
 
+#include <cmath>
+
 extern "C" {
 #include "redis/stream.h"
 #include "redis/zmalloc.h"
@@ -13,6 +15,7 @@ extern "C" {
 
 #include "base/logging.h"
 #include "facade/cmd_arg_parser.h"
+#include "facade/reply_capture.h"
 #include "server/acl/acl_commands_def.h"
 #include "server/blocking_controller.h"
 #include "server/command_registry.h"
@@ -840,13 +843,15 @@ OpResult<RecordVec> OpRange(const OpArgs& op_args, string_view key, const RangeO
 
         /* Update the consumer and NACK metadata. */
         nack->consumer = opts.consumer;
-        nack->delivery_time = now_ms;
+        streamNACKSetDeliveryTime(opts.group, buf, nack, now_ms);
         nack->delivery_count = 1;
         /* Add the entry in the new consumer local PEL. */
         raxInsert(opts.consumer->pel, buf, sizeof(buf), nack, NULL);
       } else if (group_inserted == 1 && consumer_inserted == 0) {
         LOG(DFATAL) << "Internal error";
         return OpStatus::SKIPPED;  // ("NACK half-created. Should not be possible.");
+      } else {
+        streamPelIndexAdd(opts.group, buf, nack);
       }
       opts.consumer->active_time = now_ms;
     }
@@ -892,7 +897,7 @@ OpResult<RecordVec> OpRangeFromConsumerPEL(const OpArgs& op_args, string_view ke
       result.push_back(Record{id, vector<pair<string, string>>()});
     } else {
       streamNACK* nack = static_cast<streamNACK*>(ri.data);
-      nack->delivery_time = op_args.db_cntx.time_now_ms;
+      streamNACKSetDeliveryTime(opts.group, ri.key, nack, op_args.db_cntx.time_now_ms);
       nack->delivery_count++;
       result.push_back(std::move(op_result.value()[0]));
     }
@@ -1357,6 +1362,7 @@ OpResult<ClaimInfo> OpClaim(const OpArgs& op_args, string_view key, const ClaimO
     if (!streamEntryExists(cgr_res->s, &id)) {
       if (nack != raxNotFound) {
         /* Release the NACK */
+        streamPelIndexRemove(cgr_res->cg, buf.begin(), nack);
         raxRemove(cgr_res->cg->pel, buf.begin(), sizeof(buf), nullptr);
         raxRemove(nack->consumer->pel, buf.begin(), sizeof(buf), nullptr);
         LOG_IF(DFATAL, nack->consumer->pel->numnodes == 0) << "Invalid rax state";
@@ -1371,6 +1377,7 @@ OpResult<ClaimInfo> OpClaim(const OpArgs& op_args, string_view key, const ClaimO
       /* Create the NACK. */
       nack = StreamCreateNACK(nullptr, now_ms);
       raxInsert(cgr_res->cg->pel, buf.begin(), sizeof(buf), nack, nullptr);
+      streamPelIndexAdd(cgr_res->cg, buf.begin(), nack);
     }
 
     // We found the nack, continue.
@@ -1395,7 +1402,7 @@ OpResult<ClaimInfo> OpClaim(const OpArgs& op_args, string_view key, const ClaimO
         }
       }
       // Set the delivery time for the entry.
-      nack->delivery_time = opts.delivery_time;
+      streamNACKSetDeliveryTime(cgr_res->cg, buf.begin(), nack, opts.delivery_time);
       /* Set the delivery attempts counter if given, otherwise
        * autoincrement unless JUSTID option provided */
       if (opts.retry >= 0) {
@@ -1596,6 +1603,45 @@ OpResult<uint32_t> OpDel(const OpArgs& op_args, string_view key, absl::Span<stre
   return deleted;
 }
 
+// Scanning the PEL in ID order for `count` idle entries visits about count * N / E entries when E
+// of its N entries are idle, while the delivery time index visits just the E idle entries.
+// Returns the number of idle entries up to which the index is cheaper.
+size_t IdleIndexLimit(size_t count, size_t pel_size) {
+  return count + size_t(sqrt(double(count) * double(pel_size)));
+}
+
+// Returns the IDs within [start, end] of the PEL entries of the group that were last delivered
+// at or before max_delivery_time, in ID order. Returns nullopt once more than limit entries
+// were delivered by then.
+optional<vector<streamID>> IdlePendingIds(streamCG* cg, mstime_t max_delivery_time,
+                                            streamID start, streamID end, size_t limit) {
+  vector<streamID> ids;
+  size_t visited = 0;
+  raxIterator ri;
+  raxStart(&ri, cg->pel_by_time);
+  raxSeek(&ri, "^", nullptr, 0);
+  while (raxNext(&ri)) {
+    DCHECK_EQ(ri.key_len, sizeof(uint64_t) + sizeof(streamID));
+    if (int64_t(absl::big_endian::Load64(ri.key)) > max_delivery_time)
+      break;
+
+    if (++visited > limit) {
+      raxStop(&ri);
+      return nullopt;
+    }
+
+    streamID id;
+    streamDecodeID(ri.key + sizeof(uint64_t), &id);
+    if (streamCompareID(&id, &start) >= 0 && streamCompareID(&id, &end) <= 0) {
+      ids.push_back(id);
+    }
+  }
+  raxStop(&ri);
+
+  sort(ids.begin(), ids.end(), [](streamID a, streamID b) { return streamCompareID(&a, &b) < 0; });
+  return ids;
+}
+
 // XACK key groupname id [id ...]
 OpResult<uint32_t> OpAck(const OpArgs& op_args, string_view key, string_view gname,
                          absl::Span<streamID> ids) {
@@ -1618,6 +1664,7 @@ OpResult<uint32_t> OpAck(const OpArgs& op_args, string_view key, string_view gna
     // we are able to remove the entry from both PELs.
     streamNACK* nack = (streamNACK*)raxFind(res->cg->pel, buf, sizeof(buf));
     if (nack != raxNotFound) {
+      streamPelIndexRemove(res->cg, buf, nack);
       raxRemove(res->cg->pel, buf, sizeof(buf), nullptr);
       raxRemove(nack->consumer->pel, buf, sizeof(buf), nullptr);
       streamFreeNACK(nack);
@@ -1647,13 +1694,6 @@ OpResult<ClaimInfo> OpAutoClaim(const OpArgs& op_args, string_view key, const Cl
   // multiplying <count>'s value by 10 (hard-coded).
   int64_t attempts = opts.count * 10;
 
-  unsigned char start_key[sizeof(streamID)];
-  streamID start_id = opts.start;
-  streamEncodeID(start_key, &start_id);
-  raxIterator ri;
-  raxStart(&ri, group->pel);
-  raxSeek(&ri, ">=", start_key, sizeof(start_key));
-
   ClaimInfo result;
   result.justid = (opts.flags & kClaimJustID);
 
@@ -1662,29 +1702,29 @@ OpResult<ClaimInfo> OpAutoClaim(const OpArgs& op_args, string_view key, const Cl
 
   streamConsumer* consumer = FindOrAddConsumer(opts.consumer, group, now_ms);
 
-  while (attempts-- && count && raxNext(&ri)) {
-    streamNACK* nack = (streamNACK*)ri.data;
-
+  // Claims the PEL entry with the encoded ID key if it is idle enough, or releases it if the
+  // entry was deleted from the stream.
+  auto claim_entry = [&](unsigned char* key, streamNACK* nack) {
     streamID id;
-    streamDecodeID(ri.key, &id);
+    streamDecodeID(key, &id);
 
     if (!streamEntryExists(stream, &id)) {
       // TODO: to propagate this change to replica as XCLAIM command
       // - since we delete it from NACK. See streamPropagateXCLAIM call.
-      raxRemove(group->pel, ri.key, ri.key_len, nullptr);
-      raxRemove(nack->consumer->pel, ri.key, ri.key_len, nullptr);
+      streamPelIndexRemove(group, key, nack);
+      raxRemove(group->pel, key, sizeof(streamID), nullptr);
+      raxRemove(nack->consumer->pel, key, sizeof(streamID), nullptr);
       streamFreeNACK(nack);
       result.deleted_ids.push_back(id);
-      raxSeek(&ri, ">=", ri.key, ri.key_len);
 
       count--; /* Count is a limit of the command response size. */
-      continue;
+      return;
     }
 
     if (opts.min_idle_time) {
       mstime_t this_idle = now_ms - nack->delivery_time;
       if (this_idle < opts.min_idle_time)
-        continue;
+        return;
     }
 
     if (nack->consumer != consumer) {
@@ -1692,34 +1732,69 @@ OpResult<ClaimInfo> OpAutoClaim(const OpArgs& op_args, string_view key, const Cl
        * Note that nack->consumer is NULL if we created the
        * NACK above because of the FORCE option. */
       if (nack->consumer) {
-        raxRemove(nack->consumer->pel, ri.key, ri.key_len, nullptr);
+        raxRemove(nack->consumer->pel, key, sizeof(streamID), nullptr);
       }
     }
 
-    nack->delivery_time = now_ms;
+    streamNACKSetDeliveryTime(group, key, nack, now_ms);
     if (!result.justid) {
       nack->delivery_count++;
     }
 
     if (nack->consumer != consumer) {
-      raxInsert(consumer->pel, ri.key, ri.key_len, nack, nullptr);
+      raxInsert(consumer->pel, key, sizeof(streamID), nack, nullptr);
       nack->consumer = consumer;
     }
     consumer->active_time = now_ms;
     AppendClaimResultItem(result, stream, id);
     count--;
     // TODO: propagate xclaim to replica
+  };
+
+  // When few entries are idle enough, visit only them. The entries in between would have been
+  // skipped by the scan anyway.
+  optional<vector<streamID>> idle_ids;
+  if (opts.min_idle_time > 0 && int64_t(now_ms) >= opts.min_idle_time) {
+    idle_ids = IdlePendingIds(group, now_ms - opts.min_idle_time, opts.start,
+                              streamID{UINT64_MAX, UINT64_MAX},
+                              IdleIndexLimit(count, raxSize(group->pel)));
   }
 
-  raxNext(&ri);
-  streamID end_id;
-  if (raxEOF(&ri)) {
-    end_id.ms = end_id.seq = 0;
+  if (idle_ids) {
+    size_t pos = 0;
+    for (; pos < idle_ids->size() && attempts && count; ++pos, --attempts) {
+      unsigned char buf[sizeof(streamID)];
+      streamEncodeID(buf, &(*idle_ids)[pos]);
+      streamNACK* nack = (streamNACK*)raxFind(group->pel, buf, sizeof(buf));
+      DCHECK(nack != raxNotFound);
+      claim_entry(buf, nack);
+    }
+    result.end_id = pos < idle_ids->size() ? (*idle_ids)[pos] : streamID{0, 0};
   } else {
-    streamDecodeID(ri.key, &end_id);
+    unsigned char start_key[sizeof(streamID)];
+    streamID start_id = opts.start;
+    streamEncodeID(start_key, &start_id);
+    raxIterator ri;
+    raxStart(&ri, group->pel);
+    raxSeek(&ri, ">=", start_key, sizeof(start_key));
+
+    while (attempts-- && count && raxNext(&ri)) {
+      size_t deleted = result.deleted_ids.size();
+      claim_entry(ri.key, (streamNACK*)ri.data);
+      if (result.deleted_ids.size() > deleted)
+        raxSeek(&ri, ">=", ri.key, ri.key_len);
+    }
+
+    raxNext(&ri);
+    streamID end_id;
+    if (raxEOF(&ri)) {
+      end_id.ms = end_id.seq = 0;
+    } else {
+      streamDecodeID(ri.key, &end_id);
+    }
+    raxStop(&ri);
+    result.end_id = end_id;
   }
-  raxStop(&ri);
-  result.end_id = end_id;
 
   mem_tracker.UpdateStreamSize(cgr_res->it->second);
 
@@ -1791,6 +1866,43 @@ PendingExtendedResultList GetPendingExtendedResult(uint64_t now_ms, streamCG* cg
                                                    streamConsumer* consumer,
                                                    const PendingOpts& opts) {
   PendingExtendedResultList result;
+  auto count = opts.count;
+
+  auto add_item = [&](streamID id, streamNACK* nack) {
+    count--;
+
+    /* Milliseconds elapsed since last delivery. */
+    mstime_t elapsed = now_ms - nack->delivery_time;
+    if (elapsed < 0) {
+      elapsed = 0;
+    }
+
+    PendingExtendedResult item = {.start = id,
+                                  .consumer_name = nack->consumer->name,
+                                  .delivery_count = nack->delivery_count,
+                                  .elapsed = elapsed};
+    result.push_back(item);
+  };
+
+  // When few entries are idle enough, look them up in the delivery time index.
+  if (opts.min_idle_time > 0 && count > 0 && int64_t(now_ms) >= opts.min_idle_time) {
+    auto ids = IdlePendingIds(cg, now_ms - opts.min_idle_time, opts.start.val, opts.end.val,
+                              IdleIndexLimit(count, raxSize(cg->pel)));
+    if (ids) {
+      for (streamID id : *ids) {
+        if (!count)
+          break;
+        unsigned char buf[sizeof(streamID)];
+        StreamEncodeID(buf, &id);
+        streamNACK* nack = static_cast<streamNACK*>(raxFind(cg->pel, buf, sizeof(buf)));
+        DCHECK(nack != raxNotFound);
+        if (!consumer || nack->consumer == consumer)
+          add_item(id, nack);
+      }
+      return result;
+    }
+  }
+
   rax* pel = consumer ? consumer->pel : cg->pel;
   streamID sstart = opts.start.val, send = opts.end.val;
   unsigned char start_key[sizeof(streamID)];
@@ -1802,7 +1914,6 @@ PendingExtendedResultList GetPendingExtendedResult(uint64_t now_ms, streamCG* cg
   raxStart(&ri, pel);
   raxSeek(&ri, ">=", start_key, sizeof(start_key));
 
-  auto count = opts.count;
   while (count && raxNext(&ri)) {
     if (memcmp(ri.key, end_key, ri.key_len) > 0) {
       break;
@@ -1816,23 +1927,10 @@ PendingExtendedResultList GetPendingExtendedResult(uint64_t now_ms, streamCG* cg
       }
     }
 
-    count--;
-
     /* Entry ID. */
     streamID id;
     streamDecodeID(ri.key, &id);
-
-    /* Milliseconds elapsed since last delivery. */
-    mstime_t elapsed = now_ms - nack->delivery_time;
-    if (elapsed < 0) {
-      elapsed = 0;
-    }
-
-    PendingExtendedResult item = {.start = id,
-                                  .consumer_name = nack->consumer->name,
-                                  .delivery_count = nack->delivery_count,
-                                  .elapsed = elapsed};
-    result.push_back(item);
+    add_item(id, nack);
   }
   raxStop(&ri);
   return result;
@@ -2363,6 +2461,64 @@ void XRangeGeneric(std::string_view key, std::string_view start, std::string_vie
   return builder->SendError(result.status());
 }
 
+// The records of the last woken XREAD on this shard, serialized once for all the readers that
+// were blocked at the same position of the stream. Any write on the shard invalidates them.
+struct XReadWakeCache {
+  bool Matches(uint64_t write_epoch, DbIndex db, string_view key, const streamID& start) const {
+    return records && write_epoch == write_epoch_ && db == db_ && key == key_ &&
+           start.ms == start_.ms && start.seq == start_.seq;
+  }
+
+  void Set(uint64_t write_epoch, DbIndex db, string_view key, const streamID& start,
+           shared_ptr<const string> serialized) {
+    write_epoch_ = write_epoch;
+    db_ = db;
+    key_ = key;
+    start_ = start;
+    records = std::move(serialized);
+  }
+
+  shared_ptr<const string> records;
+
+ private:
+  uint64_t write_epoch_ = 0;
+  DbIndex db_ = 0;
+  string key_;
+  streamID start_{};
+};
+
+thread_local XReadWakeCache xread_wake_cache;
+
+// Range read for readers without a group, which have no side effects on the stream. Returns the
+// records serialized as a RESP array, which is the same in RESP2 and RESP3.
+OpResult<shared_ptr<const string>> OpRangeSerialized(const OpArgs& op_args, string_view key,
+                                                     const RangeOpts& opts) {
+  DCHECK(opts.group == nullptr);
+  // Expiry and eviction are not writes, so the key is still looked up.
+  auto res_it = op_args.GetDbSlice().FindReadOnly(op_args.db_cntx, key, OBJ_STREAM);
+  if (!res_it)
+    return res_it.status();
+
+  auto& cache = xread_wake_cache;
+  const uint64_t write_epoch = op_args.shard->write_epoch();
+  if (cache.Matches(write_epoch, op_args.db_cntx.db_index, key, opts.start.val))
+    return cache.records;
+
+  auto records = OpRange(op_args, key, opts);
+  if (!records)
+    return records.status();
+
+  string serialized;
+  SerializingReplyBuilder srb;
+  srb.SetDestination(&serialized);
+  StreamReplies{&srb}.SendRecords(*records);
+  srb.Finish();
+
+  cache.Set(write_epoch, op_args.db_cntx.db_index, key, opts.start.val,
+            make_shared<const string>(std::move(serialized)));
+  return cache.records;
+}
+
 void XReadBlock(ReadOpts* opts, Transaction* tx, SinkReplyBuilder* builder,
                 ConnectionContext* cntx) {
   // If BLOCK is not set just return an empty array as there are no resolvable
@@ -2405,8 +2561,8 @@ void XReadBlock(ReadOpts* opts, Transaction* tx, SinkReplyBuilder* builder,
     return streamCompareID(&last_id, &sitem.group->last_id) > 0;
   };
 
-  if (auto status =
-          tx->WaitOnWatch(tp, Transaction::kShardArgs, key_checker, &cntx->blocked, &cntx->paused);
+  if (auto status = tx->WaitOnWatch(tp, Transaction::kShardArgs, key_checker, 0, &cntx->blocked,
+                                    &cntx->paused);
       status != OpStatus::OK)
     return rb->SendNullArray();
 
@@ -2414,6 +2570,7 @@ void XReadBlock(ReadOpts* opts, Transaction* tx, SinkReplyBuilder* builder,
   // only the shard that contains the woken key blocks for the awoken
   // transaction to proceed.
   OpResult<RecordVec> result;
+  shared_ptr<const string> serialized;  // replaces result for reads without a group
   std::string key;
   auto range_cb = [&](Transaction* t, EngineShard* shard) {
     if (auto wake_key = t->GetWakeKey(shard->shard_id()); wake_key) {
@@ -2457,7 +2614,14 @@ void XReadBlock(ReadOpts* opts, Transaction* tx, SinkReplyBuilder* builder,
 
       range_opts.noack = opts->noack;
 
-      result = OpRange(t->GetOpArgs(shard), *wake_key, range_opts);
+      if (opts->read_group) {
+        result = OpRange(t->GetOpArgs(shard), *wake_key, range_opts);
+      } else if (auto res = OpRangeSerialized(t->GetOpArgs(shard), *wake_key, range_opts); res) {
+        serialized = std::move(*res);
+        result = RecordVec{};
+      } else {
+        result = res.status();
+      }
       key = *wake_key;
     }
     return OpStatus::OK;
@@ -2472,6 +2636,10 @@ void XReadBlock(ReadOpts* opts, Transaction* tx, SinkReplyBuilder* builder,
       rb->StartArray(1);
       rb->StartArray(2);
     }
+    if (serialized) {
+      rb->SendBulkString(key);
+      return rb->SendRaw(*serialized);
+    }
     return StreamReplies{rb}.SendStreamRecords(key, *result);
   } else if (result.status() == OpStatus::INVALID_VALUE) {
     return rb->SendError("NOGROUP the consumer group this client was blocked on no longer exists");
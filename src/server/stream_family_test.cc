@@ -9,6 +9,7 @@
 #include "base/logging.h"
 #include "facade/facade_test.h"
 #include "server/command_registry.h"
+#include "server/engine_shard_set.h"
 #include "server/test_utils.h"
 
 using namespace testing;
@@ -329,6 +330,40 @@ TEST_F(StreamFamilyTest, XReadBlock) {
   EXPECT_THAT(resp1.GetVec(), ElementsAre("foo", ArrLen(1)));
 }
 
+TEST_F(StreamFamilyTest, XReadBlockSharedReply) {
+  Run({"xadd", "foo", "1-1", "k1", "v1"});
+
+  // The readers woken by the same append share the serialized records.
+  vector<RespExpr> resps(4);
+  vector<fb2::Fiber> fibers;
+  for (unsigned i = 0; i < resps.size(); ++i) {
+    fibers.push_back(pp_->at(i % 2)->LaunchFiber(Launch::dispatch, [&, i] {
+      resps[i] = Run(absl::StrCat("reader", i), {"xread", "block", "0", "streams", "foo", "1-1"});
+    }));
+  }
+  ThisFiber::SleepFor(50us);
+  pp_->at(1)->Await([&] { return Run("xadd", {"xadd", "foo", "1-2", "k2", "v2"}); });
+
+  for (unsigned i = 0; i < resps.size(); ++i) {
+    fibers[i].Join();
+    EXPECT_THAT(resps[i].GetVec(), ElementsAre("foo", ArrLen(1)));
+    EXPECT_THAT(resps[i].GetVec()[1].GetVec()[0].GetVec(),
+                ElementsAre("1-2", RespArray(ElementsAre("k2", "v2"))));
+  }
+
+  // A reader at the same position after the stream changed doesn't get the old records.
+  Run({"xdel", "foo", "1-2"});
+  RespExpr resp;
+  auto fb = pp_->at(0)->LaunchFiber(Launch::dispatch, [&] {
+    resp = Run({"xread", "block", "0", "streams", "foo", "1-1"});
+  });
+  ThisFiber::SleepFor(50us);
+  pp_->at(1)->Await([&] { return Run("xadd", {"xadd", "foo", "1-3", "k3", "v3"}); });
+  fb.Join();
+  EXPECT_THAT(resp.GetVec()[1].GetVec()[0].GetVec(),
+              ElementsAre("1-3", RespArray(ElementsAre("k3", "v3"))));
+}
+
 TEST_F(StreamFamilyTest, XReadGroupBlockwithoutBlock) {
   Run({"xadd", "foo", "1-*", "k1", "v1"});
   Run({"xadd", "foo", "1-*", "k2", "v2"});
@@ -1299,4 +1334,75 @@ TEST_F(StreamFamilyTest, XClaimWithNonExistentGroup) {
   EXPECT_THAT(resp, ArrLen(0));
 }
 
+TEST_F(StreamFamilyTest, CompactOnDefrag) {
+  for (unsigned i = 0; i < 1000; ++i) {
+    // Vary the fields so that some nodes have different master fields.
+    Run({"xadd", "s", absl::StrCat(i + 1, "-0"), absl::StrCat("f", i / 150), absl::StrCat("v", i)});
+  }
+
+  // Delete 3 out of every 5 entries, which leaves the nodes at 40% of their capacity.
+  for (unsigned i = 0; i < 1000; i += 5) {
+    Run({"xdel", "s", absl::StrCat(i + 1, "-0"), absl::StrCat(i + 2, "-0"),
+         absl::StrCat(i + 3, "-0")});
+  }
+  string before = PrintToString(Run({"xrange", "s", "-", "+"}));
+  string rev_before = PrintToString(Run({"xrevrange", "s", "+", "-"}));
+  int64_t usage_before = CheckedInt({"memory", "usage", "s"});
+
+  shard_set->RunBlockingInParallel([](EngineShard* shard) {
+    for (unsigned i = 0; i < 16; ++i)
+      shard->DoDefrag(0);
+  });
+
+  EXPECT_LT(CheckedInt({"memory", "usage", "s"}), usage_before * 3 / 4);
+  EXPECT_THAT(Run({"xlen", "s"}), IntArg(400));
+  EXPECT_EQ(before, PrintToString(Run({"xrange", "s", "-", "+"})));
+  EXPECT_EQ(rev_before, PrintToString(Run({"xrevrange", "s", "+", "-"})));
+
+  Run({"xadd", "s", "2000-0", "f6", "last"});
+  auto resp = Run({"xrevrange", "s", "+", "-", "count", "2"});
+  ASSERT_THAT(resp, ArrLen(2));
+  EXPECT_THAT(resp.GetVec()[0].GetVec(), ElementsAre("2000-0", ArrLen(2)));
+  EXPECT_THAT(resp.GetVec()[1].GetVec(), ElementsAre("1000-0", ArrLen(2)));
+}
+
+TEST_F(StreamFamilyTest, IdlePendingIndex) {
+  for (unsigned i = 0; i < 100; ++i) {
+    Run({"xadd", "s", absl::StrCat(i + 1, "-0"), "f", "v"});
+  }
+  Run({"xgroup", "create", "s", "g", "0"});
+
+  Run({"xreadgroup", "group", "g", "c1", "count", "10", "streams", "s", ">"});
+  AdvanceTime(1000);
+  Run({"xreadgroup", "group", "g", "c2", "count", "90", "streams", "s", ">"});
+  AdvanceTime(100);
+
+  // Only the entries read by c1 are idle for 500ms.
+  auto resp = Run({"xpending", "s", "g", "IDLE", "500", "-", "+", "100"});
+  ASSERT_THAT(resp, ArrLen(10));
+  EXPECT_THAT(resp.GetVec()[0], RespElementsAre("1-0", "c1", IntArg(1100), IntArg(1)));
+  EXPECT_THAT(resp.GetVec()[9], RespElementsAre("10-0", "c1", IntArg(1100), IntArg(1)));
+
+  resp = Run({"xpending", "s", "g", "IDLE", "500", "5-0", "+", "3"});
+  ASSERT_THAT(resp, ArrLen(3));
+  EXPECT_THAT(resp.GetVec()[0], RespElementsAre("5-0", "c1", IntArg(1100), IntArg(1)));
+  EXPECT_THAT(resp.GetVec()[2], RespElementsAre("7-0", "c1", IntArg(1100), IntArg(1)));
+
+  EXPECT_THAT(Run({"xpending", "s", "g", "IDLE", "500", "-", "+", "100", "c2"}), ArrLen(0));
+
+  // XAUTOCLAIM skips the entries that are not idle enough.
+  Run({"xack", "s", "g", "3-0"});
+  resp = Run({"xautoclaim", "s", "g", "c3", "500", "0-0", "count", "5", "justid"});
+  EXPECT_THAT(resp, RespElementsAre("7-0", RespElementsAre("1-0", "2-0", "4-0", "5-0", "6-0"),
+                                    ArrLen(0)));
+  resp = Run({"xautoclaim", "s", "g", "c3", "500", "7-0", "count", "5", "justid"});
+  EXPECT_THAT(resp,
+              RespElementsAre("0-0", RespElementsAre("7-0", "8-0", "9-0", "10-0"), ArrLen(0)));
+
+  // Claiming resets the delivery time.
+  EXPECT_THAT(Run({"xpending", "s", "g", "IDLE", "500", "-", "+", "100"}), ArrLen(0));
+  AdvanceTime(1000);
+  EXPECT_THAT(Run({"xpending", "s", "g", "IDLE", "500", "-", "+", "100"}), ArrLen(99));
+}
+
 }  // namespace dfly
@@ -4,6 +4,7 @@
 
 #include "server/string_family.h"
 
+#include <absl/container/flat_hash_map.h>
 #include <absl/container/inlined_vector.h>
 #include <absl/strings/match.h>
 
@@ -11,6 +12,7 @@
 #include <array>
 #include <chrono>
 #include <cstdint>
+#include <tuple>
 #include <variant>
 
 #include "absl/strings/str_cat.h"
@@ -23,6 +25,7 @@
 #include "facade/reply_builder.h"
 #include "redis/redis_aux.h"
 #include "server/acl/acl_commands_def.h"
+#include "server/cluster_support.h"
 #include "server/command_registry.h"
 #include "server/common.h"
 #include "server/conn_context.h"
@@ -38,6 +41,18 @@
 #include "util/fibers/future.h"
 
 ABSL_FLAG(bool, mget_dedup_keys, false, "If true, MGET will deduplicate keys");
+ABSL_FLAG(uint32_t, get_zero_copy_min_size, 0,
+          "If positive, GET writes string values of at least this size to the socket directly "
+          "from the shard memory, keeping the key read-locked until the write completes. "
+          "Costs an additional hop for every GET, so enable it only for large values workloads.");
+ABSL_FLAG(uint32_t, string_inplace_min_size, 0,
+          "If positive, APPEND and SETRANGE keep string values of at least this size unencoded "
+          "and modify them in place, growing the allocation geometrically, instead of encoding "
+          "a full copy of the value on every call.");
+ABSL_FLAG(bool, combine_incr, false,
+          "If true, INCR, INCRBY, DECR and DECRBY calls on a key that arrive while a call of the "
+          "same thread is running on it are applied together by a single INCRBY of their total. "
+          "Every call still replies with the value its own increment produced.");
 
 namespace dfly {
 
@@ -149,6 +164,12 @@ string GetString(const PrimeValue& pv) {
   return res;
 }
 
+// Returns true if a string value of the given size should be modified in place.
+bool ModifyInPlace(size_t size) {
+  uint32_t min_size = absl::GetFlag(FLAGS_string_inplace_min_size);
+  return min_size > 0 && size >= min_size;
+}
+
 size_t SetRange(std::string* value, size_t start, std::string_view range) {
   value->resize(max(value->size(), start + range.size()));
   memcpy(value->data() + start, range.data(), range.size());
@@ -206,6 +227,10 @@ OpResult<TResult<size_t>> OpSetRange(const OpArgs& op_args, string_view key, siz
         [start = start, range = string(range)](std::string* s) {
           return SetRange(s, start, range);
         })};
+  } else if (PrimeValue& pv = res.it->second;
+             ModifyInPlace(max(pv.Size(), start + range.size()))) {
+    pv.SetRangeRawString(start, range);
+    return {pv.Size()};
   } else {
     string value;
 
@@ -268,6 +293,11 @@ OpResult<StringValue> OpGetRange(const OpArgs& op_args, string_view key, int32_t
 };
 
 size_t ExtendExisting(DbSlice::Iterator it, string_view key, string_view val, bool prepend) {
+  if (PrimeValue& pv = it->second; !prepend && ModifyInPlace(pv.Size() + val.size())) {
+    pv.AppendRawString(val);
+    return pv.Size();
+  }
+
   string tmp, new_val;
   string_view slice = it->second.GetSlice(&tmp);
 
@@ -298,24 +328,25 @@ OpResult<double> OpIncrFloat(const OpArgs& op_args, string_view key, double val)
   RETURN_ON_BAD_STATUS(op_res);
   auto& add_res = *op_res;
 
-  char buf[128];
-
   if (add_res.is_new) {
-    char* str = RedisReplyBuilder::FormatDouble(val, buf, sizeof(buf));
-    add_res.it->second.SetString(str);
+    add_res.it->second.SetDouble(val);
 
     return val;
   }
 
-  if (add_res.it->second.Size() == 0)
-    return OpStatus::INVALID_FLOAT;
+  double base = 0;
+  if (auto dval = add_res.it->second.TryGetDouble(); dval) {
+    base = *dval;
+  } else {
+    if (add_res.it->second.Size() == 0)
+      return OpStatus::INVALID_FLOAT;
 
-  string tmp;
-  string_view slice = add_res.it->second.GetSlice(&tmp);
+    string tmp;
+    string_view slice = add_res.it->second.GetSlice(&tmp);
 
-  double base = 0;
-  if (!ParseDouble(slice, &base)) {
-    return OpStatus::INVALID_FLOAT;
+    if (!ParseDouble(slice, &base)) {
+      return OpStatus::INVALID_FLOAT;
+    }
   }
 
   base += val;
@@ -324,9 +355,7 @@ OpResult<double> OpIncrFloat(const OpArgs& op_args, string_view key, double val)
     return OpStatus::INVALID_FLOAT;
   }
 
-  char* str = RedisReplyBuilder::FormatDouble(base, buf, sizeof(buf));
-
-  add_res.it->second.SetString(str);
+  add_res.it->second.SetDouble(base);
 
   return base;
 }
@@ -495,7 +524,7 @@ OpResult<array<int64_t, 5>> OpThrottle(const OpArgs& op_args, const string_view
   if (!limited) {
     if (IsValid(res.it)) {
       if (IsValid(res.exp_it)) {
-        res.exp_it->second = db_slice.FromAbsoluteTime(new_tat_ms);
+        db_slice.SetExpireTime(op_args.db_cntx.db_index, res.it, res.exp_it, new_tat_ms);
       } else {
         db_slice.AddExpire(op_args.db_cntx.db_index, res.it, new_tat_ms);
       }
@@ -516,8 +545,8 @@ OpResult<array<int64_t, 5>> OpThrottle(const OpArgs& op_args, const string_view
 }
 
 struct GetResp {
-  string key;  // TODO: to use backing storage to optimize this as well.
-  string_view value;
+  string_view key;      // only set for memcache, points to the command arguments.
+  string_view value;    // points to MGetResponse::storage
   uint64_t mc_ver = 0;  // 0 means we do not output it (i.e has not been requested).
   uint32_t mc_flag = 0;
 };
@@ -534,7 +563,10 @@ struct MGetResponse {
 constexpr uint8_t FETCH_MCFLAG = 0x1;
 constexpr uint8_t FETCH_MCVER = 0x2;
 
-template <typename Iter> using SearchKey = std::function<OpResult<Iter>(string_view)>;
+// Looks up a batch of keys and calls on_found(index, result) for each one of them, in order.
+template <typename Iter>
+using SearchKey = std::function<void(absl::Span<const string_view> keys,
+                                     absl::FunctionRef<void(size_t, OpResult<Iter>)> on_found)>;
 
 // A find operation which can mutate, for commands which can write, eg GAT
 using SearchMut = SearchKey<DbSlice::Iterator>;
@@ -561,20 +593,25 @@ MGetResponse CollectKeys(BlockingCounter wait_bc, uint8_t fetch_mask, const Tran
 
   absl::InlinedVector<Item, 32> items(keys.Size());
 
-  // First, fetch all iterators and count total size ahead
-  size_t total_size = 0;
+  // Unique keys to look up and their indices in items.
+  absl::InlinedVector<string_view, 32> find_keys;
+  absl::InlinedVector<unsigned, 32> find_index;
+  find_keys.reserve(keys.Size());
+  find_index.reserve(keys.Size());
+
   unsigned index = 0;
   static bool mget_dedup_keys = absl::GetFlag(FLAGS_mget_dedup_keys);
 
   // We can not make it thread-local because we may preempt during the Find loop due to
   // replication of expiry events.
   absl::flat_hash_map<string_view, unsigned> key_index;
-  if (mget_dedup_keys) {
+  bool dedup = mget_dedup_keys && keys.Size() > 1;
+  if (dedup) {
     key_index.reserve(keys.Size());
   }
 
   for (string_view key : keys) {
-    if (mget_dedup_keys) {
+    if (dedup) {
       auto [it, inserted] = key_index.try_emplace(key, index);
       if (!inserted) {  // duplicate -> point to the first occurrence.
         items[index++].source_index = it->second;
@@ -582,13 +619,18 @@ MGetResponse CollectKeys(BlockingCounter wait_bc, uint8_t fetch_mask, const Tran
       }
     }
 
-    auto it_res = find_op(key);
-    auto& dest = items[index++];
+    find_keys.push_back(key);
+    find_index.push_back(index++);
+  }
+
+  // Fetch all iterators and count total size ahead
+  size_t total_size = 0;
+  find_op(find_keys, [&](size_t i, OpResult<Iter> it_res) {
     if (it_res) {
-      dest.it = *it_res;
+      items[find_index[i]].it = *it_res;
       total_size += (*it_res)->second.Size();
     }
-  }
+  });
 
   VLOG_IF(1, total_size > 10000000) << "OpMGet: allocating " << total_size << " bytes";
 
@@ -643,9 +685,9 @@ MGetResponse CollectKeys(BlockingCounter wait_bc, uint8_t fetch_mask, const Tran
 
 MGetResponse OpMGet(BlockingCounter wait_bc, uint8_t fetch_mask, const Transaction* t,
                     EngineShard* shard) {
-  SearchConst find_op = [&](string_view key) {
+  SearchConst find_op = [&](absl::Span<const string_view> keys, auto on_found) {
     const DbSlice& db_slice = t->GetDbSlice(shard->shard_id());
-    return db_slice.FindReadOnly(t->GetDbContext(), key, OBJ_STRING);
+    db_slice.FindReadOnlyBatch(t->GetDbContext(), keys, OBJ_STRING, on_found);
   };
   return CollectKeys(wait_bc, fetch_mask, t, shard, std::move(find_op));
 }
@@ -784,15 +826,109 @@ void SetExGeneric(bool seconds, CmdArgList args, const CommandId* cid, Transacti
   builder->SendError(SetGeneric(sparams, key, value, manual_journal, tx));
 }
 
-void IncrByGeneric(string_view key, int64_t val, Transaction* tx, SinkReplyBuilder* builder) {
-  bool skip_on_missing = (builder->GetProtocol() == Protocol::MEMCACHE);
-
+OpResult<int64_t> ScheduleIncrBy(string_view key, int64_t val, Transaction* tx,
+                                 bool skip_on_missing) {
   auto cb = [&](Transaction* t, EngineShard* shard) {
     OpResult<int64_t> res = OpIncrBy(t->GetOpArgs(shard), key, val, skip_on_missing);
     return res;
   };
 
-  OpResult<int64_t> result = tx->ScheduleSingleHopT(std::move(cb));
+  return tx->ScheduleSingleHopT(std::move(cb));
+}
+
+const CommandId* incrby_cid = nullptr;
+
+// Increments of a key that arrived while a hop of the same thread to the key was running.
+// All of them have the same sign, so that no partial sum overflows if the total does not.
+struct IncrBatch {
+  int64_t total = 0;
+  unsigned size = 0;
+  bool negative = false;
+
+  OpResult<int64_t> result = OpStatus::SKIPPED;  // the value after the whole batch
+  fb2::Done ready;  // notifies the first member that it can run the batch
+  fb2::Done done;   // notifies the other members that the batch ran
+};
+
+using IncrKey = tuple<const Namespace*, DbIndex, string>;
+
+// Keys with a running hop of this thread, mapped to the batch that waits for it, if any.
+thread_local absl::flat_hash_map<IncrKey, shared_ptr<IncrBatch>> tl_running_incrs;
+
+// Called by the fiber whose hop to the key finished. Passes the turn to the waiting batch.
+void HandOffIncrs(const IncrKey& ikey) {
+  auto it = tl_running_incrs.find(ikey);
+  DCHECK(it != tl_running_incrs.end());
+
+  if (shared_ptr<IncrBatch> next = std::move(it->second); next) {
+    next->ready.Notify();
+  } else {
+    tl_running_incrs.erase(it);
+  }
+}
+
+OpResult<int64_t> RunIncrBatch(string_view key, const IncrBatch& batch, const Transaction* tx) {
+  string total = absl::StrCat(batch.total);
+  string_view args[] = {key, total};
+
+  // The batch runs as a separate INCRBY so that the journal records its total.
+  boost::intrusive_ptr<Transaction> batch_tx(new Transaction{incrby_cid});
+  if (OpStatus st = batch_tx->InitByArgs(&tx->GetNamespace(), tx->GetDbIndex(), args);
+      st != OpStatus::OK) {
+    return st;
+  }
+  return ScheduleIncrBy(key, batch.total, batch_tx.get(), false);
+}
+
+OpResult<int64_t> CombinedIncrBy(string_view key, int64_t val, Transaction* tx) {
+  IncrKey ikey{&tx->GetNamespace(), tx->GetDbIndex(), string{key}};
+  auto [it, inserted] = tl_running_incrs.try_emplace(ikey);
+  if (inserted) {
+    OpResult<int64_t> res = ScheduleIncrBy(key, val, tx, false);
+    HandOffIncrs(ikey);
+    return res;
+  }
+
+  if (!it->second) {
+    it->second = make_shared<IncrBatch>();
+    it->second->negative = val < 0;
+  }
+
+  shared_ptr<IncrBatch> batch = it->second;
+  int64_t offset = batch->total;
+  if (batch->negative != (val < 0) || __builtin_add_overflow(offset, val, &batch->total)) {
+    batch->total = offset;
+    return ScheduleIncrBy(key, val, tx, false);
+  }
+
+  if (++batch->size == 1) {
+    batch->ready.Wait();
+    batch->result = RunIncrBatch(key, *batch, tx);
+    HandOffIncrs(ikey);
+    batch->done.Notify();
+  } else {
+    batch->done.Wait();
+  }
+
+  // The batch did not change the value, retry alone in case the total overflowed but our
+  // increment does not.
+  if (batch->result == OpStatus::OUT_OF_RANGE && batch->size > 1) {
+    return ScheduleIncrBy(key, val, tx, false);
+  }
+
+  RETURN_ON_BAD_STATUS(batch->result);
+  return batch->result.value() - batch->total + offset + val;
+}
+
+void IncrByGeneric(string_view key, int64_t val, Transaction* tx, SinkReplyBuilder* builder) {
+  bool skip_on_missing = (builder->GetProtocol() == Protocol::MEMCACHE);
+  // A batch runs on its own transaction after its members passed the slot checks, so slot
+  // migrations could move the key in between. Cluster mode keeps the direct path.
+  bool combine = absl::GetFlag(FLAGS_combine_incr) && !skip_on_missing && !tx->IsMulti() &&
+                 !IsClusterEnabled();
+
+  OpResult<int64_t> result = combine ? CombinedIncrBy(key, val, tx)
+                                     : ScheduleIncrBy(key, val, tx, skip_on_missing);
 
   DVLOG(2) << "IncrByGeneric " << key << "/" << result.value();
 
@@ -856,13 +992,15 @@ OpResult<DbSlice::Iterator> FindKeyAndSetExpiry(const GetAndTouchParams& params)
 
 MGetResponse OpGAT(BlockingCounter wait_bc, uint8_t fetch_mask, const Transaction* t,
                    EngineShard* shard, const DbSlice::ExpireParams& expire_params) {
-  SearchMut find_op = [&](string_view key) {
-    return FindKeyAndSetExpiry(GetAndTouchParams{
-        .t = t,
-        .shard = shard,
-        .expire_params = expire_params,
-        .key = key,
-    });
+  SearchMut find_op = [&](absl::Span<const string_view> keys, auto on_found) {
+    for (size_t i = 0; i < keys.size(); ++i) {
+      on_found(i, FindKeyAndSetExpiry(GetAndTouchParams{
+                      .t = t,
+                      .shard = shard,
+                      .expire_params = expire_params,
+                      .key = keys[i],
+                  }));
+    }
   };
   return CollectKeys(wait_bc, fetch_mask, t, shard, std::move(find_op));
 }
@@ -944,7 +1082,7 @@ OpStatus SetCmd::SetExisting(const SetParams& params, string_view value,
     if (at_ms) {  // Command has an expiry paramater.
       if (IsValid(it_upd->exp_it)) {
         // Updated existing expiry information.
-        it_upd->exp_it->second = db_slice.FromAbsoluteTime(at_ms);
+        db_slice.SetExpireTime(op_args_.db_cntx.db_index, it_upd->it, it_upd->exp_it, at_ms);
       } else {
         // Add new expiry information.
         db_slice.AddExpire(op_args_.db_cntx.db_index, it_upd->it, at_ms);
@@ -974,6 +1112,9 @@ OpStatus SetCmd::SetExisting(const SetParams& params, string_view value,
     shard->tiered_storage()->Delete(op_args_.db_cntx.db_index, &prime_value);
   }
 
+  // Large containers are released in the background instead of inside SetString.
+  db_slice.ReleaseIfLarge(&prime_value);
+
   // overwrite existing entry.
   prime_value.SetString(value);
 
@@ -1190,8 +1331,61 @@ void StringFamily::SetNx(CmdArgList args, const CommandContext& cmnd_cntx) {
   return builder->SendLong(0);  // value do exists, we need to report that we didn't change it
 }
 
+// Reads the value in a non-concluding hop. Large raw strings are not copied, instead they are
+// written from the shard memory while the transaction holds the key lock, which is released
+// by the second hop.
+void GetPinned(string_view key, size_t min_size, Transaction* tx, SinkReplyBuilder* builder) {
+  OpResult<StringValue> copied;
+  string_view pinned;
+
+  auto cb = [&](Transaction* t, EngineShard* es) {
+    auto& db_slice = t->GetDbSlice(es->shard_id());
+    auto it_res = db_slice.FindReadOnly(t->GetDbContext(), key, OBJ_STRING);
+    if (!it_res.ok()) {
+      copied = it_res.status();
+      return OpStatus::OK;
+    }
+
+    // Values with pending stashes are released by the stash completion, regardless of locks.
+    const PrimeValue& pv = (*it_res)->second;
+    if (pv.IsRawString() && !pv.HasStashPending() && pv.Size() >= min_size) {
+      string scratch;
+      pinned = pv.GetSlice(&scratch);
+      DCHECK(scratch.empty());
+      db_slice.PinRead(t->GetDbIndex(), key);
+    } else {
+      copied = StringValue::Read(t->GetDbIndex(), key, pv, es);
+    }
+    return OpStatus::OK;
+  };
+  tx->Execute(cb, false);
+
+  if (pinned.data() == nullptr) {
+    GetReplies{builder}.Send(std::move(copied));
+    return tx->Conclude();
+  }
+
+  static_cast<RedisReplyBuilder*>(builder)->SendBulkString(pinned);
+  tx->Execute(
+      [key](Transaction* t, EngineShard* es) {
+        t->GetDbSlice(es->shard_id()).UnpinRead(t->GetDbIndex(), key);
+        return OpStatus::OK;
+      },
+      true);
+}
+
 void StringFamily::Get(CmdArgList args, const CommandContext& cmnd_cntx) {
-  auto cb = [key = ArgS(args, 0)](Transaction* tx, EngineShard* es) -> OpResult<StringValue> {
+  string_view key = ArgS(args, 0);
+
+  // Squashed and multi transactions may execute in shard threads or capture replies, so they
+  // always copy.
+  uint32_t zero_copy_min_size = absl::GetFlag(FLAGS_get_zero_copy_min_size);
+  if (zero_copy_min_size > 0 && !cmnd_cntx.tx->IsMulti() &&
+      cmnd_cntx.rb->GetProtocol() == Protocol::REDIS) {
+    return GetPinned(key, zero_copy_min_size, cmnd_cntx.tx, cmnd_cntx.rb);
+  }
+
+  auto cb = [key](Transaction* tx, EngineShard* es) -> OpResult<StringValue> {
     auto it_res = tx->GetDbSlice(es->shard_id()).FindReadOnly(tx->GetDbContext(), key, OBJ_STRING);
     if (!it_res.ok())
       return it_res.status();
@@ -1202,6 +1396,19 @@ void StringFamily::Get(CmdArgList args, const CommandContext& cmnd_cntx) {
   GetReplies{cmnd_cntx.rb}.Send(cmnd_cntx.tx->ScheduleSingleHopT(cb));
 }
 
+void StringFamily::GetLocal(string_view key, const DbContext& db_cntx, EngineShard* es,
+                            SinkReplyBuilder* rb) {
+  OpResult<StringValue> res = [&]() -> OpResult<StringValue> {
+    auto it_res = db_cntx.GetDbSlice(es->shard_id()).FindReadOnly(db_cntx, key, OBJ_STRING);
+    if (!it_res.ok())
+      return it_res.status();
+
+    return StringValue::Read(db_cntx.db_index, key, (*it_res)->second, es);
+  }();
+
+  GetReplies{rb}.Send(std::move(res));
+}
+
 void StringFamily::GetDel(CmdArgList args, const CommandContext& cmnd_cntx) {
   auto cb = [key = ArgS(args, 0)](Transaction* tx, EngineShard* es) -> OpResult<StringValue> {
     auto& db_slice = tx->GetDbSlice(es->shard_id());
@@ -1371,9 +1578,11 @@ void StringFamily::DecrBy(CmdArgList args, const CommandContext& cmnd_cntx) {
   return IncrByGeneric(key, -val, cmnd_cntx.tx, cmnd_cntx.rb);
 }
 
-void ReorderShardResults(const std::vector<MGetResponse>& mget_resp, const Transaction* t,
+// Points the entries of dest, in argument order, to the values found by the shards. The values
+// stay in the shard responses, so nothing is copied. Missing keys are left as nullptr.
+void ReorderShardResults(std::vector<MGetResponse>& mget_resp, const Transaction* t,
                          const bool is_memcache_protocol,
-                         absl::FixedArray<optional<GetResp>, 8>* dest) {
+                         absl::FixedArray<const GetResp*, 8>* dest) {
   for (ShardId sid = 0; sid < mget_resp.size(); ++sid) {
     if (!t->IsActive(sid))
       continue;
@@ -1382,16 +1591,14 @@ void ReorderShardResults(const std::vector<MGetResponse>& mget_resp, const Trans
     ShardArgs shard_args = t->GetShardArgs(sid);
     unsigned src_indx = 0;
     for (auto it = shard_args.begin(); it != shard_args.end(); ++it, ++src_indx) {
-      if (!src.resp_arr[src_indx])
+      auto& item = src.resp_arr[src_indx];
+      if (!item)
         continue;
 
-      uint32_t indx = it.index();
-      auto& item = (*dest)[indx];
-
-      item = std::move(src.resp_arr[src_indx]);
       if (is_memcache_protocol) {
         item->key = *it;
       }
+      (*dest)[it.index()] = &*item;
     }
   }
 }
@@ -1424,7 +1631,7 @@ void StringFamily::MGet(CmdArgList args, const CommandContext& cmnd_cntx) {
   tiering_bc->Wait();
 
   // reorder shard results back according to argument order
-  absl::FixedArray<optional<GetResp>, 8> res(args.size());
+  absl::FixedArray<const GetResp*, 8> res(args.size(), nullptr);
   ReorderShardResults(mget_resp, cmnd_cntx.tx, is_memcache, &res);
 
   // The code below is safe in the context of squashing (uses CapturingReplyBuilder).
@@ -1727,7 +1934,7 @@ void StringFamily::GAT(CmdArgList args, const CommandContext& cmnd_cntx) {
   CHECK_EQ(OpStatus::OK, result);
   tiering_bc->Wait();
 
-  absl::FixedArray<optional<GetResp>, 8> ordered_by_shard{args.size()};
+  absl::FixedArray<const GetResp*, 8> ordered_by_shard(args.size(), nullptr);
   ReorderShardResults(mget_resp, cmnd_cntx.tx, true, &ordered_by_shard);
   for (const auto& entry : ordered_by_shard) {
     if (entry) {
@@ -1772,6 +1979,8 @@ void StringFamily::Register(CommandRegistry* registry) {
       << CI{"CL.THROTTLE", CO::WRITE | CO::DENYOOM | CO::FAST, -5, 1, 1, acl::THROTTLE}.HFUNC(
              ClThrottle)
       << CI{"GAT", CO::WRITE | CO::DENYOOM | CO::NO_AUTOJOURNAL | CO::HIDDEN, -3, 2, -1}.HFUNC(GAT);
+
+  incrby_cid = registry->Find("INCRBY");
 }
 
 }  // namespace dfly
@@ -13,12 +13,19 @@ class SinkReplyBuilder;
 namespace dfly {
 
 struct CommandContext;
+struct DbContext;
 class CommandRegistry;
+class EngineShard;
 
 class StringFamily {
  public:
   static void Register(CommandRegistry* registry);
 
+  // Replies to GET of the key directly from the shard. Must be called on the shard thread owning
+  // the key, while the calling transaction holds its lock.
+  static void GetLocal(std::string_view key, const DbContext& db_cntx, EngineShard* es,
+                       facade::SinkReplyBuilder* rb);
+
  private:
   using SinkReplyBuilder = facade::SinkReplyBuilder;
   using CmdArgList = facade::CmdArgList;
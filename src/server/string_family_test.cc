@@ -23,6 +23,15 @@ namespace dfly {
 
 class StringFamilyTest : public BaseFamilyTest {
  protected:
+  // Pins or unpins the key in all shards, like an in-flight zero copy GET does on its shard.
+  void SetPinned(string_view key, bool pinned) {
+    pp_->AwaitFiberOnAll([&](auto*) {
+      if (auto* shard = EngineShard::tlocal(); shard) {
+        auto& db_slice = namespaces->GetDefaultNamespace().GetDbSlice(shard->shard_id());
+        pinned ? db_slice.PinRead(0, key) : db_slice.UnpinRead(0, key);
+      }
+    });
+  }
 };
 
 vector<int64_t> ToIntArr(const RespExpr& e) {
@@ -55,6 +64,55 @@ TEST_F(StringFamilyTest, SetGet) {
   EXPECT_EQ(3, metrics.events.mutations);
 }
 
+TEST_F(StringFamilyTest, GetZeroCopy) {
+  absl::FlagSaver fs;
+  SetTestFlag("get_zero_copy_min_size", "64");
+
+  // Non-ascii, so that the value is kept as a raw string.
+  string large(1000, '\xff');
+  EXPECT_EQ(Run({"set", "large", large}), "OK");
+  EXPECT_EQ(Run({"set", "small", "val"}), "OK");
+  EXPECT_EQ(Run({"get", "large"}), large);
+  EXPECT_EQ(Run({"get", "small"}), "val");
+  EXPECT_THAT(Run({"get", "missing"}), ArgType(RespExpr::NIL));
+  EXPECT_THAT(Run({"lpush", "list", "a"}), IntArg(1));
+  EXPECT_THAT(Run({"get", "list"}), ErrArg("WRONGTYPE"));
+
+  // The key is unlocked once the reply is written.
+  EXPECT_EQ(Run({"set", "large", "val"}), "OK");
+  EXPECT_EQ(Run({"get", "large"}), "val");
+}
+
+// The value of a zero copy GET in flight can't expire, since its memory is still being written.
+// Other readers are served the value until the read completes.
+TEST_F(StringFamilyTest, PinnedReadExpiry) {
+  absl::FlagSaver fs;
+  SetTestFlag("get_zero_copy_min_size", "64");
+
+  string large(1000, '\xff');
+  Run({"set", "key", large, "PX", "10"});
+  SetPinned("key", true);
+
+  AdvanceTime(20);
+  EXPECT_EQ(Run({"get", "key"}), large);
+  EXPECT_THAT(Run({"strlen", "key"}), IntArg(1000));
+
+  SetPinned("key", false);
+  EXPECT_THAT(Run({"get", "key"}), ArgType(RespExpr::NIL));
+}
+
+// Lazy expiry skips only the pinned keys, not every locked key of the shard.
+TEST_F(StringFamilyTest, PinnedReadOtherKeysExpire) {
+  Run({"set", "pinned", "a"});
+  Run({"set", "other", "b", "PX", "10"});
+  SetPinned("pinned", true);
+
+  AdvanceTime(20);
+  EXPECT_THAT(Run({"get", "other"}), ArgType(RespExpr::NIL));
+  EXPECT_EQ(Run({"get", "pinned"}), "a");
+  SetPinned("pinned", false);
+}
+
 TEST_F(StringFamilyTest, Incr) {
   ASSERT_EQ(Run({"set", "key", "0"}), "OK");
   ASSERT_THAT(Run({"incr", "key"}), IntArg(1));
@@ -76,6 +134,88 @@ TEST_F(StringFamilyTest, Incr) {
   EXPECT_EQ(0, metrics.events.hits);
 }
 
+TEST_F(StringFamilyTest, IncrCombine) {
+  absl::FlagSaver fs;
+  SetTestFlag("combine_incr", "true");
+
+  constexpr unsigned kFibers = 10, kIncrs = 50;
+  vector<fb2::Fiber> fibers;
+  vector<vector<int64_t>> replies(num_threads_ * kFibers);
+  for (unsigned i = 0; i < num_threads_; ++i) {
+    for (unsigned j = 0; j < kFibers; ++j) {
+      fibers.emplace_back(pp_->at(i)->LaunchFiber(Launch::post, [&, i, j] {
+        for (unsigned n = 0; n < kIncrs; n++) {
+          auto resp = Run(StrCat("incr", i, "_", j), {"incr", "counter"});
+          ASSERT_THAT(resp, ArgType(RespExpr::INT64));
+          replies[i * kFibers + j].push_back(get<int64_t>(resp.u));
+        }
+      }));
+    }
+  }
+  for (auto& f : fibers) {
+    f.Join();
+  }
+
+  // Every increment produced a distinct value, and every connection saw its values grow.
+  const size_t total = num_threads_ * kFibers * kIncrs;
+  vector<int64_t> all;
+  for (const auto& vals : replies) {
+    EXPECT_TRUE(is_sorted(vals.begin(), vals.end()));
+    all.insert(all.end(), vals.begin(), vals.end());
+  }
+  sort(all.begin(), all.end());
+  ASSERT_EQ(all.size(), total);
+  for (size_t i = 0; i < total; ++i) {
+    EXPECT_EQ(all[i], int64_t(i + 1));
+  }
+  EXPECT_EQ(Run({"get", "counter"}), StrCat(total));
+
+  Run({"set", "counter", "a"});
+  EXPECT_THAT(Run({"incrby", "counter", "2"}), ErrArg("ERR value is not an integer"));
+}
+
+TEST_F(StringFamilyTest, IncrCombineErrors) {
+  absl::FlagSaver fs;
+  SetTestFlag("combine_incr", "true");
+
+  // Runs concurrent increments from a single thread, so that they are combined into batches.
+  constexpr unsigned kFibers = 20;
+  auto run_incrs = [&](string_view key) {
+    vector<RespExpr> replies(kFibers);
+    vector<fb2::Fiber> fibers;
+    for (unsigned i = 0; i < kFibers; ++i) {
+      fibers.emplace_back(pp_->at(0)->LaunchFiber(
+          Launch::post, [&, i] { replies[i] = Run(StrCat("incr", i), {"incr", key}); }));
+    }
+    for (auto& f : fibers)
+      f.Join();
+    return replies;
+  };
+
+  Run({"lpush", "list", "a"});
+  for (const auto& resp : run_incrs("list")) {
+    EXPECT_THAT(resp, ErrArg("WRONGTYPE"));
+  }
+
+  // Batches that overflow retry their members alone, so exactly 5 increments succeed.
+  Run({"set", "counter", StrCat(INT64_MAX - 5)});
+  vector<int64_t> values;
+  unsigned overflows = 0;
+  for (const auto& resp : run_incrs("counter")) {
+    if (resp.type == RespExpr::INT64) {
+      values.push_back(get<int64_t>(resp.u));
+    } else {
+      EXPECT_THAT(resp, ErrArg("increment or decrement would overflow"));
+      overflows++;
+    }
+  }
+  sort(values.begin(), values.end());
+  EXPECT_THAT(values, ElementsAre(INT64_MAX - 4, INT64_MAX - 3, INT64_MAX - 2, INT64_MAX - 1,
+                                  INT64_MAX));
+  EXPECT_EQ(kFibers - 5, overflows);
+  EXPECT_EQ(Run({"get", "counter"}), StrCat(INT64_MAX));
+}
+
 TEST_F(StringFamilyTest, Append) {
   Run({"setex", "key", "100", "val"});
   EXPECT_THAT(Run({"ttl", "key"}), IntArg(100));
@@ -253,6 +393,36 @@ TEST_F(StringFamilyTest, MGetSet) {
   set_fb.Join();
 }
 
+TEST_F(StringFamilyTest, MSetAtomicWithOptimisticReads) {
+  Run({"mset", "x", "0", "b", "0"});
+  ASSERT_EQ(2, GetDebugInfo("IO0").shards_count);
+
+  auto set_fb = pp_->at(1)->LaunchFiber([&] {
+    for (size_t i = 1; i < 2000; ++i) {
+      Run({"mset", "x", StrCat(i), "b", StrCat(i)});
+    }
+  });
+
+  // Fast single shard reads may run during scheduling, but never between the hops of a multi
+  // shard write: once x shows a value of an MSET, b must show it as well.
+  auto get_fb = pp_->at(0)->LaunchFiber([&] {
+    for (size_t i = 0; i < 1000; ++i) {
+      RespExpr resp = Run({"mget", "x", "b"});
+      ASSERT_EQ(RespExpr::ARRAY, resp.type);
+      auto ivec = ToIntArr(resp);
+      ASSERT_EQ(ivec[0], ivec[1]);
+
+      int64_t x_val = 0, b_val = 0;
+      ASSERT_TRUE(absl::SimpleAtoi(Run({"get", "x"}).GetString(), &x_val));
+      ASSERT_TRUE(absl::SimpleAtoi(Run({"get", "b"}).GetString(), &b_val));
+      ASSERT_GE(b_val, x_val);
+    }
+  });
+
+  set_fb.Join();
+  get_fb.Join();
+}
+
 TEST_F(StringFamilyTest, MGetCachingModeBug2276) {
   absl::FlagSaver fs;
   SetTestFlag("cache_mode", "true");
@@ -514,6 +684,32 @@ TEST_F(StringFamilyTest, Range) {
   // EXPECT_THAT(CheckedInt({"SETRANGE", "", "268435456", "0"}), 268435457);
 }
 
+TEST_F(StringFamilyTest, ModifyInPlace) {
+  absl::FlagSaver fs;
+  SetTestFlag("string_inplace_min_size", "16");
+
+  // Integer and ascii packed values are decoded when they cross the threshold.
+  Run({"set", "key", "12345"});
+  string expected = "12345";
+  for (unsigned i = 0; i < 100; ++i) {
+    string part = absl::StrCat("entry", i, ";");
+    expected += part;
+    EXPECT_THAT(Run({"append", "key", part}), IntArg(expected.size()));
+  }
+  EXPECT_EQ(Run({"get", "key"}), expected);
+  EXPECT_EQ(Run({"getrange", "key", "5", "11"}), "entry0;");
+
+  Run({"set", "ascii", string(32, 'a')});
+  EXPECT_THAT(Run({"setrange", "ascii", "30", "bcd"}), IntArg(33));
+  EXPECT_EQ(Run({"get", "ascii"}), string(30, 'a') + "bcd");
+
+  EXPECT_THAT(Run({"setrange", "new", "20", "x"}), IntArg(21));
+  EXPECT_EQ(Run({"get", "new"}), string(20, '\0') + "x");
+
+  EXPECT_THAT(Run({"prepend", "key", "head"}), IntArg(expected.size() + 4));
+  EXPECT_EQ(Run({"get", "key"}), "head" + expected);
+}
+
 TEST_F(StringFamilyTest, IncrByFloat) {
   Run({"SET", "nonum", "  11"});
   auto resp = Run({"INCRBYFLOAT", "nonum", "1.0"});
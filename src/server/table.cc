@@ -10,6 +10,10 @@
 #include "server/cluster_support.h"
 #include "server/server_state.h"
 
+ABSL_FLAG(bool, cluster_slot_index, false,
+          "In cluster mode, index the keys of every slot, so that slot migrations and slot "
+          "flushes visit only the keys of their slots. Costs about 20 bytes per key.");
+
 using namespace std;
 namespace dfly {
 #define ADD(x) (x) += o.x
@@ -45,29 +49,58 @@ DbTableStats& DbTableStats::operator+=(const DbTableStats& o) {
 }
 
 SlotStats& SlotStats::operator+=(const SlotStats& o) {
-  static_assert(sizeof(SlotStats) == 32);
+  static_assert(sizeof(SlotStats) == 56);
 
   ADD(key_count);
   ADD(total_reads);
   ADD(total_writes);
   ADD(memory_bytes);
+  ADD(ops_per_sec);
+  ADD(bytes_in);
+  ADD(bytes_out);
   return *this;
 }
 
 std::optional<const IntentLock> LockTable::Find(LockTag tag) const {
-  LockFp fp = tag.Fingerprint();
-  if (auto it = locks_.find(fp); it != locks_.end())
-    return it->second;
-  return std::nullopt;
+  return Find(tag.Fingerprint());
 }
 
 std::optional<const IntentLock> LockTable::Find(uint64_t fp) const {
+  if (const Stripe& stripe = StripeOf(fp); !stripe.lock.IsFree() && stripe.fp == fp)
+    return stripe.lock;
+
+  if (locks_.empty())
+    return std::nullopt;
+
   if (auto it = locks_.find(fp); it != locks_.end())
     return it->second;
   return std::nullopt;
 }
 
+bool LockTable::Acquire(uint64_t fp, IntentLock::Mode mode) {
+  Stripe& stripe = StripeOf(fp);
+  if (stripe.lock.IsFree()) {
+    // fp may have spilled to the map while the stripe was held by another fingerprint.
+    if (locks_.empty() || !locks_.contains(fp)) {
+      stripe.fp = fp;
+      ++stripes_used_;
+      return stripe.lock.Acquire(mode);
+    }
+  } else if (stripe.fp == fp) {
+    return stripe.lock.Acquire(mode);
+  }
+
+  return locks_[fp].Acquire(mode);
+}
+
 void LockTable::Release(uint64_t fp, IntentLock::Mode mode) {
+  if (Stripe& stripe = StripeOf(fp); !stripe.lock.IsFree() && stripe.fp == fp) {
+    stripe.lock.Release(mode);
+    if (stripe.lock.IsFree())
+      --stripes_used_;
+    return;
+  }
+
   auto it = locks_.find(fp);
   DCHECK(it != locks_.end()) << fp;
 
@@ -85,6 +118,8 @@ DbTable::DbTable(PMR_NS::memory_resource* mr, DbIndex db_index)
       index(db_index) {
   if (IsClusterEnabled()) {
     slots_stats.reset(new SlotStats[kMaxSlotNum + 1]);
+    if (absl::GetFlag(FLAGS_cluster_slot_index))
+      slot_key_index.reset(new absl::flat_hash_map<uint64_t, uint32_t>[kMaxSlotNum + 1]);
   }
   thread_index = ServerState::tlocal()->thread_index();
 }
@@ -95,11 +130,53 @@ DbTable::~DbTable() {
   delete[] dense_hll;
 }
 
+size_t FieldExpiryQueue::EntryMemory(string_view key) {
+  // Every key is stored twice, in due_ and in queue_.
+  return sizeof(decltype(due_)::value_type) + sizeof(decltype(queue_)::value_type) + 2 * key.size();
+}
+
+void FieldExpiryQueue::Add(string_view key, uint32_t expire_time) {
+  auto [it, inserted] = due_.try_emplace(key, expire_time);
+  if (!inserted) {
+    if (it->second <= expire_time)
+      return;
+    queue_.erase({it->second, it->first});
+    it->second = expire_time;
+  } else {
+    mem_usage_ += EntryMemory(key);
+  }
+  queue_.emplace(expire_time, it->first);
+}
+
+optional<string> FieldExpiryQueue::PopDue(uint32_t now) {
+  if (queue_.empty() || queue_.begin()->first > now)
+    return nullopt;
+
+  auto node = queue_.extract(queue_.begin());
+  due_.erase(node.value().second);
+  mem_usage_ -= EntryMemory(node.value().second);
+  return std::move(node.value().second);
+}
+
+void FieldExpiryQueue::Clear() {
+  due_.clear();
+  queue_.clear();
+  mem_usage_ = 0;
+}
+
 void DbTable::Clear() {
   prime.size();
   prime.Clear();
   expire.Clear();
   mcflag.Clear();
+  if (expire_wheel)
+    expire_wheel->Clear();
+  eviction_pool.clear();
+  eviction_cursor = {};
+  field_expiry_queue.Clear();
+  field_reap_key.clear();
+  field_reap_cursor = 0;
+  field_reap_min_expire = UINT32_MAX;
   stats = DbTableStats{};
 }
 
@@ -4,12 +4,15 @@
 
 #pragma once
 
+#include <absl/container/btree_set.h>
 #include <absl/container/flat_hash_map.h>
 
+#include <array>
 #include <boost/smart_ptr/intrusive_ptr.hpp>
 #include <boost/smart_ptr/intrusive_ref_counter.hpp>
 
 #include "core/expire_period.h"
+#include "core/expire_wheel.h"
 #include "core/intent_lock.h"
 #include "server/conn_context.h"
 #include "server/detail/table.h"
@@ -55,6 +58,15 @@ struct SlotStats {
   uint64_t total_reads = 0;
   uint64_t total_writes = 0;
   uint64_t memory_bytes = 0;
+
+  // Reads and writes per second, refreshed every second by DbSlice::UpdateSlotRates.
+  uint64_t ops_per_sec = 0;
+
+  // Request and reply bytes of the commands on the slot. Counted by the coordinator threads,
+  // so DbSlice leaves them empty.
+  uint64_t bytes_in = 0;
+  uint64_t bytes_out = 0;
+
   SlotStats& operator+=(const SlotStats& o);
 };
 
@@ -78,38 +90,86 @@ struct DbTableStats {
 };
 
 // Table for recording locks. Keys used with the lock table should be normalized with LockTag.
+// Most locks are held in a fixed array of stripes, indexed by the high bits of the fingerprint,
+// so that locking does not allocate. A fingerprint whose stripe is held by another one spills
+// to the exact map. A fingerprint is held either by its stripe or by the map, never by both.
 class LockTable {
  public:
   size_t Size() const {
-    return locks_.size();
+    return stripes_used_ + locks_.size();
   }
   std::optional<const IntentLock> Find(LockTag tag) const;
   std::optional<const IntentLock> Find(LockFp fp) const;
 
-  bool Acquire(LockFp fp, IntentLock::Mode mode) {
-    return locks_[fp].Acquire(mode);
+  bool Acquire(LockFp fp, IntentLock::Mode mode);
+  void Release(LockFp fp, IntentLock::Mode mode);
+
+  // Calls cb(fp, lock) for every held lock.
+  template <typename F> void ForEach(F&& cb) const {
+    for (const Stripe& stripe : stripes_) {
+      if (!stripe.lock.IsFree())
+        cb(stripe.fp, stripe.lock);
+    }
+    for (const auto& [fp, lock] : locks_)
+      cb(fp, lock);
   }
 
-  void Release(LockFp fp, IntentLock::Mode mode);
+ private:
+  static constexpr unsigned kStripeBits = 8;
 
-  auto begin() const {
-    return locks_.cbegin();
+  struct Stripe {
+    LockFp fp = 0;  // valid only if the lock is not free
+    IntentLock lock;
+  };
+
+  Stripe& StripeOf(LockFp fp) {
+    return stripes_[fp >> (64 - kStripeBits)];
   }
 
-  auto end() const {
-    return locks_.cend();
+  const Stripe& StripeOf(LockFp fp) const {
+    return stripes_[fp >> (64 - kStripeBits)];
   }
 
- private:
   // We use fingerprinting before accessing locks - no need to mix more.
   struct Hasher {
     size_t operator()(LockFp val) const {
       return val;
     }
   };
+
+  std::array<Stripe, 1u << kStripeBits> stripes_;
+  unsigned stripes_used_ = 0;
   absl::flat_hash_map<LockFp, IntentLock, Hasher> locks_;
 };
 
+// Keys of hashes and sets whose fields expire, ordered by the earliest expiry time of their
+// fields in MemberTimeSeconds units. A key is queued once, with the earliest time it was added.
+class FieldExpiryQueue {
+ public:
+  void Add(std::string_view key, uint32_t expire_time);
+
+  // Removes and returns the key with the earliest expiry time if it is not later than now.
+  std::optional<std::string> PopDue(uint32_t now);
+
+  size_t size() const {
+    return due_.size();
+  }
+
+  // Approximate memory usage of the queued keys.
+  size_t mem_usage() const {
+    return mem_usage_;
+  }
+
+  void Clear();
+
+ private:
+  static size_t EntryMemory(std::string_view key);
+
+  absl::flat_hash_map<std::string, uint32_t> due_;
+  absl::btree_set<std::pair<uint32_t, std::string>> queue_;
+  size_t mem_usage_ = 0;
+};
+
 // A single Db table that represents a table that can be chosen with "SELECT" command.
 struct DbTable : boost::intrusive_ref_counter<DbTable, boost::thread_unsafe_counter> {
   PrimeTable prime;
@@ -122,13 +182,30 @@ struct DbTable : boost::intrusive_ref_counter<DbTable, boost::thread_unsafe_coun
   // Stores a list of dependant connections for each watched key.
   absl::flat_hash_map<std::string, std::vector<ConnectionState::ExecInfo*>> watched_keys;
 
-  // Keyspace notifications: list of expired keys since last batch of messages was published.
-  mutable std::vector<std::string> expired_keys_events_;
-
   mutable DbTableStats stats;
   std::unique_ptr<SlotStats[]> slots_stats;
+
+  // Hashes of the keys of every slot with the number of keys having them, kept in cluster mode
+  // if --cluster_slot_index is set. Allows visiting the keys of some slots without traversing
+  // the whole table.
+  std::unique_ptr<absl::flat_hash_map<uint64_t, uint32_t>[]> slot_key_index;
   ExpireTable::Cursor expire_cursor;
 
+  // Cursors of the expire table buckets by their deadline, set if --expire_wheel is enabled.
+  std::unique_ptr<ExpireWheel> expire_wheel;
+
+  // Key hashes of the eviction candidates sampled by the heartbeat and the cursor of the next
+  // prime table bucket to sample. Used if --eviction_pool_size is set.
+  std::vector<uint64_t> eviction_pool;
+  PrimeTable::Cursor eviction_cursor;
+
+  // Large hashes and sets with field expiries, and the key and the bucket cursor of the one whose
+  // expired fields are being deleted. Used if --field_expire_reap_min_size is set.
+  FieldExpiryQueue field_expiry_queue;
+  std::string field_reap_key;
+  uint32_t field_reap_cursor = 0;
+  uint32_t field_reap_min_expire = UINT32_MAX;
+
   TopKeys* top_keys = nullptr;
   uint8_t* dense_hll = nullptr;
 
@@ -142,7 +219,7 @@ struct DbTable : boost::intrusive_ref_counter<DbTable, boost::thread_unsafe_coun
   PrimeIterator Launder(PrimeIterator it, std::string_view key);
 
   size_t table_memory() const {
-    return expire.mem_usage() + prime.mem_usage();
+    return expire.mem_usage() + prime.mem_usage() + field_expiry_queue.mem_usage();
   }
 };
 
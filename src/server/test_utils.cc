@@ -217,8 +217,9 @@ void BaseFamilyTest::TearDown() {
 
   ShutdownService();
 
+  // Benchmarks reuse the fixture outside of a test.
   const TestInfo* const test_info = UnitTest::GetInstance()->current_test_info();
-  LOG(INFO) << "Finishing " << test_info->name();
+  LOG_IF(INFO, test_info) << "Finishing " << test_info->name();
 }
 
 void BaseFamilyTest::ResetService() {
@@ -256,7 +257,7 @@ void BaseFamilyTest::ResetService() {
   shard_set->RunBriefInParallel(cb);
 
   const TestInfo* const test_info = UnitTest::GetInstance()->current_test_info();
-  LOG(INFO) << "Starting " << test_info->name();
+  LOG_IF(INFO, test_info) << "Starting " << test_info->name();
 
   watchdog_fiber_ = pp_->GetNextProactor()->LaunchFiber([this] {
     ThisFiber::SetName("Watchdog");
@@ -287,12 +288,12 @@ void BaseFamilyTest::ResetService() {
           }
 
           LOG(ERROR) << "TxLocks for shard " << es->shard_id();
-          for (const auto& k_v : namespaces->GetDefaultNamespace()
-                                     .GetDbSlice(es->shard_id())
-                                     .GetDBTable(0)
-                                     ->trans_locks) {
-            LOG(ERROR) << "Key " << k_v.first << " " << k_v.second;
-          }
+          namespaces->GetDefaultNamespace()
+              .GetDbSlice(es->shard_id())
+              .GetDBTable(0)
+              ->trans_locks.ForEach([](LockFp fp, const IntentLock& lock) {
+                LOG(ERROR) << "Key " << fp << " " << lock;
+              });
 
           LOG(ERROR) << "Transaction for shard " << es->shard_id();
           for (auto& conn : connections_) {
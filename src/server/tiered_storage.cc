@@ -13,11 +13,17 @@
 
 #include "absl/cleanup/cleanup.h"
 #include "absl/flags/internal/flag.h"
+#include "absl/strings/str_split.h"
+#include "absl/time/clock.h"
 #include "base/flags.h"
 #include "base/logging.h"
 #include "server/common.h"
 #include "server/db_slice.h"
+#include "server/detail/compressor.h"
+#include "server/detail/decompress.h"
 #include "server/engine_shard_set.h"
+#include "server/rdb_load.h"
+#include "server/rdb_save.h"
 #include "server/snapshot.h"
 #include "server/table.h"
 #include "server/tiering/common.h"
@@ -37,6 +43,26 @@ ABSL_FLAG(float, tiered_low_memory_factor, 0.1,
           "Determines the low limit per shard that "
           "tiered storage should not cross");
 
+ABSL_FLAG(uint32_t, tiered_offload_min_idle_ms, 100,
+          "Minimal duration of a background offloading sweep. A value is offloaded only if it "
+          "was not accessed during a whole sweep, so this is the minimal idle time of an "
+          "offloaded value");
+ABSL_FLAG(uint32_t, tiered_offload_max_frequency, 2,
+          "Values whose estimated access frequency is above this threshold are not offloaded. "
+          "Requires the lfu cache eviction policy that maintains the frequency sketch");
+
+ABSL_FLAG(float, tiered_cool_protected_ratio, 0.8,
+          "Max share of cool memory held by values that were warmed up before and cooled down "
+          "again. These values are reclaimed only after all other cool values");
+
+ABSL_FLAG(string, tiered_compression, "none",
+          "Compression of offloaded values: none, lz4 or zstd. Values that do not compress "
+          "well are stored as is");
+
+ABSL_FLAG(bool, tiered_offload_containers, false,
+          "If true, large hashes, lists, sets and sorted sets are offloaded in their "
+          "serialized form and loaded back on access");
+
 namespace dfly {
 
 using namespace std;
@@ -50,6 +76,15 @@ bool OccupiesWholePages(size_t size) {
   return size >= TieredStorage::kMinOccupancySize;
 }
 
+bool IsOffloadableContainer(CompactObjType type) {
+  return type == OBJ_HASH || type == OBJ_LIST || type == OBJ_SET || type == OBJ_ZSET;
+}
+
+// Containers are never packed into small bins.
+bool StashedOnOwnPages(const PrimeValue& pv) {
+  return pv.ObjType() != OBJ_STRING || OccupiesWholePages(pv.Size());
+}
+
 // Stashed bins no longer have bin ids, so this sentinel is used to differentiate from regular reads
 constexpr auto kFragmentedBin = tiering::SmallBins::kInvalidBin - 1;
 
@@ -60,6 +95,9 @@ void RecordDeleted(const PrimeValue& pv, size_t tiered_len, DbTableStats* stats)
   stats->tiered_used_bytes -= tiered_len;
 }
 
+// Prefix of stashed blobs when compression is enabled.
+enum BlobCodec : uint8_t { kRawBlob = 0, kLz4Blob = 1, kZstdBlob = 2 };
+
 tiering::DiskSegment FromCoolItem(const PrimeValue::CoolItem& item) {
   return {item.record->page_index * tiering::kPageSize + item.page_offset, item.serialized_size};
 }
@@ -119,6 +157,12 @@ class TieredStorage::ShardOpManager : public tiering::OpManager {
 
   bool NotifyDelete(tiering::DiskSegment segment) override;
 
+  void DecodeFetched(EntryId id, string* value) override {
+    // Whole pages are read only for defragmentation, their values are decoded by Defragment.
+    if (holds_alternative<OpManager::KeyRef>(id))
+      ts_->DecodeStashed(value);
+  }
+
   // If we are low on memory, remove entries from the ColdQueue,
   // and promote their PrimeValues to be fully external.
   void RetireColdEntries(size_t additional_memory);
@@ -147,7 +191,7 @@ class TieredStorage::ShardOpManager : public tiering::OpManager {
         ts_->CoolDown(key.first, key.second, segment, pv);
       } else {
         stats->AddTypeMemoryUsage(pv->ObjType(), -pv->MallocUsed());
-        pv->SetExternal(segment.offset, segment.length);
+        pv->SetExternal(segment.offset, segment.length, pv->ObjType());
       }
     } else {
       LOG(DFATAL) << "Should not reach here";
@@ -167,6 +211,10 @@ class TieredStorage::ShardOpManager : public tiering::OpManager {
   // being compared to db_slice_.memory_budget().
   size_t memory_low_limit_;
 
+  // Offsets of segments that are read only for serialization. Such reads bypass uploading,
+  // cooling and reread accounting unless a client read joins them.
+  absl::flat_hash_set<size_t> snapshot_reads_;
+
   struct {
     uint64_t total_stashes = 0, total_cancels = 0, total_fetches = 0;
     uint64_t total_defrags = 0;
@@ -202,7 +250,8 @@ void TieredStorage::ShardOpManager::Defragment(tiering::DiskSegment segment, str
       stats->tiered_used_bytes -= segment.length;
     } else {
       // Cut out relevant part of value and restore it to memory
-      string_view value = page.substr(item_segment.offset - segment.offset, item_segment.length);
+      string value{page.substr(item_segment.offset - segment.offset, item_segment.length)};
+      ts_->DecodeStashed(&value);
       Upload(dbid, value, true, item_segment.length, &pv);
     }
   }
@@ -217,20 +266,25 @@ bool TieredStorage::ShardOpManager::NotifyFetched(EntryId id, string_view value,
     return true;  // delete
   }
 
-  // 1. When modified is true we MUST upload the value back to memory.
-  // 2. On the other hand, if read is caused by snapshotting we do not want to fetch it.
-  //    Currently, our heuristic is not very smart, because we stop uploading any reads during
-  //    the snapshotting.
-  // TODO: to revisit this when we rewrite it with more efficient snapshotting algorithm.
+  // Reads issued by snapshots should not warm values up. A modification joining the read must
+  // still be uploaded.
+  if (snapshot_reads_.erase(segment.offset) && !modified)
+    return false;
+
+  ts_->RecordReread(CompactObj::HashCode(get<OpManager::KeyRef>(id).second));
+
+  auto key = get<OpManager::KeyRef>(id);
+  auto* pv = Find(key);
+
+  // Offloaded containers are decoded by LoadContainer, never materialized as strings.
+  if (pv && pv->IsExternal() && pv->ObjType() != OBJ_STRING)
+    return false;
 
-  bool should_upload =
-      modified || (HasEnoughMemoryMargin(value.size()) && !SliceSnapshot::IsSnaphotInProgress());
+  bool should_upload = modified || HasEnoughMemoryMargin(value.size());
 
   if (!should_upload)
     return false;
 
-  auto key = get<OpManager::KeyRef>(id);
-  auto* pv = Find(key);
   if (pv && pv->IsExternal() && segment == pv->GetExternalSlice()) {
     if (modified || pv->WasTouched()) {
       bool is_raw = !modified;
@@ -249,7 +303,8 @@ bool TieredStorage::ShardOpManager::NotifyFetched(EntryId id, string_view value,
 bool TieredStorage::ShardOpManager::NotifyDelete(tiering::DiskSegment segment) {
   DVLOG(2) << "NotifyDelete [" << segment.offset << "," << segment.length << "]";
 
-  if (OccupiesWholePages(segment.length))
+  // Compressed values can be shorter than kMinOccupancySize, even when they occupy own pages.
+  if (!ts_->bins_->IsStashedBin(segment.ContainingPages().offset))
     return true;
 
   auto bin = ts_->bins_->Delete(segment);
@@ -301,6 +356,19 @@ TieredStorage::TieredStorage(size_t max_size, DbSlice* db_slice)
     : op_manager_{make_unique<ShardOpManager>(this, db_slice, max_size)},
       bins_{make_unique<tiering::SmallBins>()} {
   write_depth_limit_ = absl::GetFlag(FLAGS_tiered_storage_write_depth);
+
+  string compression = absl::GetFlag(FLAGS_tiered_compression);
+  if (compression == "lz4") {
+    compressor_ = detail::CompressorImpl::CreateLZ4();
+    decompressor_ = detail::DecompressImpl::CreateLZ4();
+    compression_codec_ = kLz4Blob;
+  } else if (compression == "zstd") {
+    compressor_ = detail::CompressorImpl::CreateZstd();
+    decompressor_ = detail::DecompressImpl::CreateZstd();
+    compression_codec_ = kZstdBlob;
+  } else {
+    LOG_IF(ERROR, compression != "none") << "Unknown tiered_compression " << compression;
+  }
   size_t mem_per_shard = max_memory_limit / shard_set->size();
   SetMemoryLowWatermark(absl::GetFlag(FLAGS_tiered_low_memory_factor) * mem_per_shard);
 }
@@ -309,9 +377,15 @@ TieredStorage::~TieredStorage() {
 }
 
 error_code TieredStorage::Open(string_view base_path) {
+  // base_path can list several prefixes, usually on different devices. Shards are spread
+  // across them round robin, so that each device serves an equal share of the shards.
+  vector<string_view> prefixes = absl::StrSplit(base_path, ',', absl::SkipEmpty());
+  DCHECK(!prefixes.empty());
+  unsigned index = ProactorBase::me()->GetPoolIndex();
+
   // dts - dragonfly tiered storage.
-  string path = absl::StrCat(
-      base_path, "-", absl::Dec(ProactorBase::me()->GetPoolIndex(), absl::kZeroPad4), ".dts");
+  string path = absl::StrCat(prefixes[index % prefixes.size()], "-",
+                             absl::Dec(index, absl::kZeroPad4), ".dts");
   return op_manager_->Open(path);
 }
 
@@ -332,10 +406,22 @@ util::fb2::Future<string> TieredStorage::Read(DbIndex dbid, string_view key,
   return fut;
 }
 
+util::fb2::Future<string> TieredStorage::ReadForSnapshot(DbIndex dbid, string_view key,
+                                                         const PrimeValue& value) {
+  // If a client read of the segment is already pending, it keeps its regular handling.
+  tiering::DiskSegment segment = value.GetExternalSlice();
+  bool joins_read = op_manager_->HasPendingRead(segment);
+  auto fut = Read(dbid, key, value);
+  if (!joins_read)
+    op_manager_->snapshot_reads_.insert(segment.offset);
+  return fut;
+}
+
 void TieredStorage::Read(DbIndex dbid, std::string_view key, const PrimeValue& value,
                          std::function<void(const std::string&)> readf) {
   DCHECK(value.IsExternal());
   DCHECK(!value.IsCool());
+  op_manager_->snapshot_reads_.erase(value.GetExternalSlice().offset);
   auto cb = [readf = std::move(readf), enc = value.GetStrEncoding()](
                 bool is_raw, const string* raw_val) mutable {
     readf(is_raw ? enc.Decode(*raw_val).Take() : *raw_val);
@@ -349,6 +435,7 @@ util::fb2::Future<T> TieredStorage::Modify(DbIndex dbid, std::string_view key,
                                            const PrimeValue& value,
                                            std::function<T(std::string*)> modf) {
   DCHECK(value.IsExternal());
+  op_manager_->snapshot_reads_.erase(value.GetExternalSlice().offset);
 
   util::fb2::Future<T> future;
   auto cb = [future, modf = std::move(modf), enc = value.GetStrEncoding()](
@@ -383,12 +470,22 @@ bool TieredStorage::TryStash(DbIndex dbid, string_view key, PrimeValue* value) {
     return false;
   }
 
-  StringOrView raw_string = value->GetRawString();
+  StringOrView raw_string;
+  if (value->ObjType() == OBJ_STRING) {
+    raw_string = value->GetRawString();
+  } else {
+    // Containers are stashed in their DUMP form.
+    io::StringSink sink;
+    SerializerBase::DumpObject(*value, &sink);
+    raw_string = StringOrView::FromString(std::move(sink).str());
+  }
+  if (compressor_)
+    raw_string = StringOrView::FromString(EncodeStashed(raw_string.view()));
   value->SetStashPending(true);
 
   tiering::OpManager::EntryId id;
   error_code ec;
-  if (OccupiesWholePages(value->Size())) {  // large enough for own page
+  if (StashedOnOwnPages(*value)) {  // large enough for own page
     id = KeyRef(dbid, key);
     ec = op_manager_->Stash(id, raw_string.view());
   } else if (auto bin = bins_->Stash(dbid, key, raw_string.view()); bin) {
@@ -414,7 +511,7 @@ void TieredStorage::Delete(DbIndex dbid, PrimeValue* value) {
   tiering::DiskSegment segment = value->GetExternalSlice();
   if (value->IsCool()) {
     auto hot = DeleteCool(value->GetCool().record);
-    DCHECK_EQ(hot.ObjType(), OBJ_STRING);
+    DCHECK_EQ(hot.ObjType(), value->ObjType());
   }
 
   // In any case we delete the offloaded segment and reset the value.
@@ -424,7 +521,7 @@ void TieredStorage::Delete(DbIndex dbid, PrimeValue* value) {
 
 void TieredStorage::CancelStash(DbIndex dbid, std::string_view key, PrimeValue* value) {
   DCHECK(value->HasStashPending());
-  if (OccupiesWholePages(value->Size())) {
+  if (StashedOnOwnPages(*value)) {
     op_manager_->Delete(KeyRef(dbid, key));
   } else if (auto bin = bins_->Delete(dbid, key); bin) {
     op_manager_->Delete(*bin);
@@ -454,6 +551,7 @@ TieredStats TieredStorage::GetStats() const {
     stats.pending_stash_cnt = op_stats.pending_stash_cnt;
     stats.allocated_bytes = op_stats.disk_stats.allocated_bytes;
     stats.capacity_bytes = op_stats.disk_stats.capacity_bytes;
+    stats.punched_bytes = op_stats.disk_stats.punched_bytes;
     stats.total_heap_buf_allocs = op_stats.disk_stats.heap_buf_alloc_count;
     stats.total_registered_buf_allocs = op_stats.disk_stats.registered_buf_alloc_count;
   }
@@ -470,6 +568,12 @@ TieredStats TieredStorage::GetStats() const {
     stats.cold_storage_bytes = stats_.cool_memory_used;
     stats.total_offloading_steps = stats_.offloading_steps;
     stats.total_offloading_stashes = stats_.offloading_stashes;
+    stats.total_offloading_rereads = stats_.offloading_rereads;
+    stats.cool_entries = CoolEntries();
+    stats.cool_protected_entries = protected_cool_queue_.size();
+    stats.total_cool_reclaims = stats_.cool_reclaims;
+    stats.total_cool_reclaimed_entries = stats_.cool_reclaimed_entries;
+    stats.cool_reclaim_usec = stats_.cool_reclaim_ns / 1000;
   }
   return stats;
 }
@@ -480,22 +584,41 @@ void TieredStorage::RunOffloading(DbIndex dbid) {
   if (SliceSnapshot::IsSnaphotInProgress())
     return;
 
+  // Containers are only ever stashed by the offloading loop.
+  offload_containers_ = absl::GetFlag(FLAGS_tiered_offload_containers);
+
+  // Do not start a new sweep before the previous one is old enough, otherwise
+  // the touched bits do not tell apart hot values from cold ones.
+  uint64_t now_ms = GetCurrentTimeMs();
+  if (!offloading_cursor_ &&
+      now_ms < sweep_end_ms_ + absl::GetFlag(FLAGS_tiered_offload_min_idle_ms))
+    return;
+
   // Don't run offloading if there's only very little space left
   auto disk_stats = op_manager_->GetStats().disk_stats;
   if (disk_stats.allocated_bytes + kMaxIterations / 2 * tiering::kPageSize >
       disk_stats.max_file_size)
     return;
 
+  const FrequencySketch* freq_sketch = op_manager_->db_slice_.freq_sketch();
+  unsigned max_freq = absl::GetFlag(FLAGS_tiered_offload_max_frequency);
+
   string tmp;
-  auto cb = [this, dbid, &tmp](PrimeIterator it) mutable {
+  auto cb = [&](PrimeIterator it) mutable {
     stats_.offloading_steps++;
-    if (ShouldStash(it->second)) {
+    if (ShouldStash(it->second) && !op_manager_->db_slice_.IsPinned(dbid, it->first)) {
       if (it->first.WasTouched()) {
         it->first.SetTouched(false);
-      } else {
-        stats_.offloading_stashes++;
-        TryStash(dbid, it->first.GetSlice(&tmp), &it->second);
+        return;
       }
+
+      uint64_t key_hash = it->first.HashCode();
+      if (freq_sketch && freq_sketch->Estimate(key_hash) > max_freq)
+        return;
+
+      stats_.offloading_stashes++;
+      if (TryStash(dbid, it->first.GetSlice(&tmp), &it->second))
+        recent_stashes_[0].insert(key_hash);
     }
   };
 
@@ -509,9 +632,22 @@ void TieredStorage::RunOffloading(DbIndex dbid) {
       break;
     offloading_cursor_ = table.TraverseBySegmentOrder(offloading_cursor_, cb);
   } while (offloading_cursor_ && iterations++ < kMaxIterations);
+
+  if (!offloading_cursor_) {  // the sweep is complete
+    sweep_end_ms_ = now_ms;
+    recent_stashes_[1] = std::move(recent_stashes_[0]);
+    recent_stashes_[0].clear();
+    RotateWarmedKeys();
+  }
 }
 
 size_t TieredStorage::ReclaimMemory(size_t goal) {
+  uint64_t start_ns = absl::GetCurrentTimeNanos();
+  absl::Cleanup account = [this, start_ns] {
+    stats_.cool_reclaims++;
+    stats_.cool_reclaim_ns += absl::GetCurrentTimeNanos() - start_ns;
+  };
+
   size_t gained = 0;
   do {
     size_t memory_before = stats_.cool_memory_used;
@@ -533,11 +669,12 @@ size_t TieredStorage::ReclaimMemory(size_t goal) {
     tiering::DiskSegment segment = FromCoolItem(pv.GetCool());
 
     // Now the item is only in storage.
-    pv.SetExternal(segment.offset, segment.length);
+    pv.SetExternal(segment.offset, segment.length, record->value.ObjType());
 
     auto* stats = op_manager_->GetDbTableStats(record->db_index);
     stats->AddTypeMemoryUsage(record->value.ObjType(), -record->value.MallocUsed());
     CompactObj::DeleteMR<detail::TieredColdRecord>(record);
+    stats_.cool_reclaimed_entries++;
   } while (gained < goal);
 
   return gained;
@@ -545,57 +682,196 @@ size_t TieredStorage::ReclaimMemory(size_t goal) {
 
 bool TieredStorage::ShouldStash(const PrimeValue& pv) const {
   const auto& disk_stats = op_manager_->GetStats().disk_stats;
-  return !pv.IsExternal() && !pv.HasStashPending() && pv.ObjType() == OBJ_STRING &&
-         pv.Size() >= kMinValueSize &&
-         disk_stats.allocated_bytes + tiering::kPageSize + pv.Size() < disk_stats.max_file_size;
+  if (pv.IsExternal() || pv.HasStashPending())
+    return false;
+
+  size_t size = 0;
+  if (pv.ObjType() == OBJ_STRING) {
+    // Sparse bitmaps would be stashed as their plain string, which is much larger than their
+    // in-memory representation.
+    if (pv.IsSparseBitmap() || pv.Size() < kMinValueSize)
+      return false;
+    size = pv.Size();
+  } else if (offload_containers_ && IsOffloadableContainer(pv.ObjType())) {
+    // Only containers that fill at least half a page are worth a disk round trip on access.
+    size = pv.MallocUsed();
+    if (size < kMinOccupancySize)
+      return false;
+  } else {
+    return false;
+  }
+
+  return disk_stats.allocated_bytes + tiering::kPageSize + size < disk_stats.max_file_size;
 }
 
 void TieredStorage::CoolDown(DbIndex db_ind, std::string_view str,
                              const tiering::DiskSegment& segment, PrimeValue* pv) {
   detail::TieredColdRecord* record = CompactObj::AllocateMR<detail::TieredColdRecord>();
-  cool_queue_.push_front(*record);
-  stats_.cool_memory_used += (sizeof(detail::TieredColdRecord) + pv->MallocUsed());
+  size_t used = sizeof(detail::TieredColdRecord) + pv->MallocUsed();
+  stats_.cool_memory_used += used;
 
+  // Values that were already warmed up once proved to be re-accessed, so they are protected
+  // from reclaiming by values cooled down for the first time.
   record->key_hash = CompactObj::HashCode(str);
+  record->is_protected =
+      warmed_keys_[0].contains(record->key_hash) || warmed_keys_[1].contains(record->key_hash);
+  if (record->is_protected) {
+    protected_cool_queue_.push_front(*record);
+    stats_.cool_protected_memory += used;
+  } else {
+    cool_queue_.push_front(*record);
+  }
+
   record->db_index = db_ind;
   record->page_index = segment.offset / tiering::kPageSize;
   record->value = std::move(*pv);
 
   pv->SetCool(segment.offset, segment.length, record);
   DCHECK_EQ(pv->Size(), record->value.Size());
+
+  if (record->is_protected)
+    DemoteProtectedCool();
 }
 
 PrimeValue TieredStorage::Warmup(DbIndex dbid, PrimeValue::CoolItem item) {
   tiering::DiskSegment segment = FromCoolItem(item);
 
+  RecordReread(item.record->key_hash);
+
+  warmed_keys_[0].insert(item.record->key_hash);
+  if (warmed_keys_[0].size() > max<size_t>(kMinWarmedKeys, CoolEntries()))
+    RotateWarmedKeys();
+
   // We remove it from both cool storage and the offline storage.
   PrimeValue hot = DeleteCool(item.record);
   op_manager_->DeleteOffloaded(dbid, segment);
 
   // Bring it back to the PrimeTable.
-  DCHECK(hot.ObjType() == OBJ_STRING);
+  DCHECK(hot.ObjType() == OBJ_STRING || IsOffloadableContainer(hot.ObjType()));
 
   return hot;
 }
 
+void TieredStorage::LoadContainer(DbIndex dbid, string_view key, const PrimeValue& value) {
+  DCHECK(value.IsExternal() && !value.IsCool());
+  DCHECK_NE(value.ObjType(), OBJ_STRING);
+
+  tiering::DiskSegment segment = value.GetExternalSlice();
+  string blob = Read(dbid, key, value).Get();  // blocks until the read completes
+
+  // The entry might have been deleted, overwritten or loaded by another fiber in the meantime.
+  PrimeValue* pv = op_manager_->Find(KeyRef(dbid, key));
+  if (!pv || !pv->IsExternal() || pv->IsCool() || !(segment == pv->GetExternalSlice()))
+    return;
+
+  PrimeValue loaded;
+  error_code ec = RdbValueLoader(RDB_VERSION).Load(blob, &loaded);
+  CHECK(!ec) << "Failed to decode offloaded value: " << ec.message();
+
+  loaded.SetExpire(pv->HasExpire());
+  loaded.SetFlag(pv->HasFlag());
+  *pv = std::move(loaded);
+
+  op_manager_->DeleteOffloaded(dbid, segment);
+  op_manager_->GetDbTableStats(dbid)->AddTypeMemoryUsage(pv->ObjType(), pv->MallocUsed());
+  ++op_manager_->stats_.total_uploads;
+}
+
+string TieredStorage::EncodeStashed(string_view value) {
+  DCHECK(compressor_);
+  string out;
+
+  // Keep the value as is, unless compression saves at least 10% of it.
+  auto res = compressor_->Compress(io::Buffer(value));
+  if (res && res->size() < value.size() * 0.9) {
+    out.reserve(res->size() + 1);
+    out.push_back(char(compression_codec_));
+    out.append(reinterpret_cast<const char*>(res->data()), res->size());
+    return out;
+  }
+
+  out.reserve(value.size() + 1);
+  out.push_back(char(kRawBlob));
+  out.append(value);
+  return out;
+}
+
+void TieredStorage::DecodeStashed(string* value) {
+  if (!compressor_)
+    return;
+
+  DCHECK(!value->empty());
+  if (uint8_t(value->front()) == kRawBlob) {
+    value->erase(0, 1);
+    return;
+  }
+
+  DCHECK_EQ(uint8_t(value->front()), compression_codec_);
+  auto res = decompressor_->Decompress(string_view{*value}.substr(1));
+  CHECK(res) << "Failed to decompress offloaded value: " << res.error().message();
+
+  // The decompressor appends an rdb opcode after the value.
+  io::Bytes bytes = (*res)->InputBuffer();
+  value->assign(reinterpret_cast<const char*>(bytes.data()), bytes.size() - 1);
+  (*res)->ConsumeInput(bytes.size());
+}
+
+void TieredStorage::RecordReread(uint64_t key_hash) {
+  for (auto& stashes : recent_stashes_) {
+    if (stashes.erase(key_hash)) {
+      ++stats_.offloading_rereads;
+      return;
+    }
+  }
+}
+
 PrimeValue TieredStorage::DeleteCool(detail::TieredColdRecord* record) {
   auto it = CoolQueue::s_iterator_to(*record);
-  cool_queue_.erase(it);
+  size_t used = sizeof(detail::TieredColdRecord) + record->value.MallocUsed();
+  if (record->is_protected) {
+    protected_cool_queue_.erase(it);
+    stats_.cool_protected_memory -= used;
+  } else {
+    cool_queue_.erase(it);
+  }
 
   PrimeValue hot = std::move(record->value);
-  stats_.cool_memory_used -= (sizeof(detail::TieredColdRecord) + hot.MallocUsed());
+  stats_.cool_memory_used -= used;
   CompactObj::DeleteMR<detail::TieredColdRecord>(record);
   return hot;
 }
 
 detail::TieredColdRecord* TieredStorage::PopCool() {
-  if (cool_queue_.empty())
+  // Reclaim the probationary segment first.
+  CoolQueue* queue = cool_queue_.empty() ? &protected_cool_queue_ : &cool_queue_;
+  if (queue->empty())
     return nullptr;
 
-  detail::TieredColdRecord& res = cool_queue_.back();
-  cool_queue_.pop_back();
-  stats_.cool_memory_used -= (sizeof(detail::TieredColdRecord) + res.value.MallocUsed());
+  detail::TieredColdRecord& res = queue->back();
+  queue->pop_back();
+  size_t used = sizeof(detail::TieredColdRecord) + res.value.MallocUsed();
+  stats_.cool_memory_used -= used;
+  if (res.is_protected)
+    stats_.cool_protected_memory -= used;
   return &res;
 }
 
+void TieredStorage::DemoteProtectedCool() {
+  float ratio = absl::GetFlag(FLAGS_tiered_cool_protected_ratio);
+  while (!protected_cool_queue_.empty() &&
+         stats_.cool_protected_memory > stats_.cool_memory_used * ratio) {
+    detail::TieredColdRecord& record = protected_cool_queue_.back();
+    protected_cool_queue_.pop_back();
+    stats_.cool_protected_memory -= sizeof(detail::TieredColdRecord) + record.value.MallocUsed();
+
+    record.is_protected = false;
+    cool_queue_.push_front(record);
+  }
+}
+
+void TieredStorage::RotateWarmedKeys() {
+  warmed_keys_[1] = std::move(warmed_keys_[0]);
+  warmed_keys_[0].clear();
+}
+
 }  // namespace dfly
@@ -3,6 +3,7 @@
 //
 #pragma once
 
+#include <array>
 #include <boost/intrusive/list.hpp>
 #include <memory>
 #include <utility>
@@ -13,6 +14,7 @@
 #ifdef __linux__
 
 #include <absl/container/flat_hash_map.h>
+#include <absl/container/flat_hash_set.h>
 
 #include "server/common.h"
 #include "server/table.h"
@@ -25,6 +27,11 @@ namespace tiering {
 class SmallBins;
 };
 
+namespace detail {
+class CompressorImpl;
+class DecompressImpl;
+}  // namespace detail
+
 // Manages offloaded values
 class TieredStorage {
   class ShardOpManager;
@@ -53,6 +60,11 @@ class TieredStorage {
   void Read(DbIndex dbid, std::string_view key, const PrimeValue& value,
             std::function<void(const std::string&)> readf);
 
+  // Read offloaded value for serialization. Unlike Read, it leaves the value offloaded and
+  // doesn't affect its cooling or access statistics.
+  util::fb2::Future<std::string> ReadForSnapshot(DbIndex dbid, std::string_view key,
+                                                 const PrimeValue& value);
+
   // Apply modification to offloaded value, return generic result from callback.
   // Unlike immutable Reads - the modified value must be uploaded back to memory.
   // This is handled by OpManager when modf completes.
@@ -84,6 +96,10 @@ class TieredStorage {
   // Returns the primary value, and deletes the cool item as well as its offloaded storage.
   PrimeValue Warmup(DbIndex dbid, PrimeValue::CoolItem item);
 
+  // Loads an offloaded container back into memory and deletes its offloaded storage.
+  // Blocks until the read completes, so the caller must look up the entry again.
+  void LoadContainer(DbIndex dbid, std::string_view key, const PrimeValue& value);
+
   size_t CoolMemoryUsage() const {
     return stats_.cool_memory_used;
   }
@@ -97,23 +113,61 @@ class TieredStorage {
                 PrimeValue* pv);
 
   PrimeValue DeleteCool(detail::TieredColdRecord* record);
+
+  // Moves the oldest protected cool values to the probationary segment while the protected
+  // segment exceeds its share of cool memory.
+  void DemoteProtectedCool();
+
+  void RotateWarmedKeys();
+
+  size_t CoolEntries() const {
+    return cool_queue_.size() + protected_cool_queue_.size();
+  }
+
+  // Prefixes the value with its codec and compresses it, if compression is enabled.
+  std::string EncodeStashed(std::string_view value);
+
+  // Reverts EncodeStashed in place. No-op if compression is disabled.
+  void DecodeStashed(std::string* value);
+
+  // Accounts an access to an offloaded value if it was stashed by one of the recent sweeps.
+  void RecordReread(uint64_t key_hash);
   detail::TieredColdRecord* PopCool();
 
   PrimeTable::Cursor offloading_cursor_{};  // where RunOffloading left off
+  uint64_t sweep_end_ms_ = 0;                // when the last offloading sweep completed
+
+  // Key hashes of values stashed by the current and the previous offloading sweeps.
+  std::array<absl::flat_hash_set<uint64_t>, 2> recent_stashes_;
+
+  // Key hashes of recently warmed up cool values. Rotated with offloading sweeps or when
+  // the current set outgrows the cool queue.
+  static constexpr size_t kMinWarmedKeys = 1024;
+  std::array<absl::flat_hash_set<uint64_t>, 2> warmed_keys_;
 
   std::unique_ptr<ShardOpManager> op_manager_;
   std::unique_ptr<tiering::SmallBins> bins_;
+  std::unique_ptr<detail::CompressorImpl> compressor_;  // set if compression is enabled
+  std::unique_ptr<detail::DecompressImpl> decompressor_;
+  uint8_t compression_codec_ = 0;
   typedef ::boost::intrusive::list<detail::TieredColdRecord> CoolQueue;
 
+  // Segmented LRU: values cooled down for the first time enter cool_queue_ (probation) and are
+  // reclaimed before values in protected_cool_queue_, which were already warmed up once.
   CoolQueue cool_queue_;
+  CoolQueue protected_cool_queue_;
 
   unsigned write_depth_limit_ = 10;
+  bool offload_containers_ = false;
   struct {
     uint64_t stash_overflow_cnt = 0;
     uint64_t total_deletes = 0;
     uint64_t offloading_steps = 0;
     uint64_t offloading_stashes = 0;
+    uint64_t offloading_rereads = 0;
     size_t cool_memory_used = 0;
+    size_t cool_protected_memory = 0;
+    uint64_t cool_reclaims = 0, cool_reclaimed_entries = 0, cool_reclaim_ns = 0;
   } stats_;
 };
 
@@ -157,6 +211,11 @@ class TieredStorage {
             std::function<void(const std::string&)> readf) {
   }
 
+  util::fb2::Future<std::string> ReadForSnapshot(DbIndex dbid, std::string_view key,
+                                                 const PrimeValue& value) {
+    return {};
+  }
+
   template <typename T>
   util::fb2::Future<T> Modify(DbIndex dbid, std::string_view key, const PrimeValue& value,
                               std::function<T(std::string*)> modf) {
@@ -198,6 +257,9 @@ class TieredStorage {
   PrimeValue Warmup(DbIndex dbid, PrimeValue::CoolItem item) {
     return PrimeValue{};
   }
+
+  void LoadContainer(DbIndex dbid, std::string_view key, const PrimeValue& value) {
+  }
 };
 
 }  // namespace dfly
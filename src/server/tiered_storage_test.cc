@@ -27,6 +27,9 @@ ABSL_DECLARE_FLAG(string, tiered_prefix);
 ABSL_DECLARE_FLAG(float, tiered_offload_threshold);
 ABSL_DECLARE_FLAG(unsigned, tiered_storage_write_depth);
 ABSL_DECLARE_FLAG(bool, tiered_experimental_cooling);
+ABSL_DECLARE_FLAG(bool, tiered_offload_containers);
+ABSL_DECLARE_FLAG(uint32_t, tiered_offload_min_idle_ms);
+ABSL_DECLARE_FLAG(string, tiered_compression);
 
 namespace dfly {
 
@@ -377,4 +380,145 @@ TEST_F(TieredStorageTest, Dump) {
   EXPECT_EQ(resp, "OK");
 }
 
+TEST_F(TieredStorageTest, Containers) {
+  absl::FlagSaver saver;
+  SetFlag(&FLAGS_tiered_offload_threshold, 0.0f);  // offload all values
+  SetFlag(&FLAGS_tiered_offload_containers, true);
+
+  // we want to test without cooling to trigger disk I/O on reads.
+  SetFlag(&FLAGS_tiered_experimental_cooling, false);
+
+  const int kNum = 200;
+  for (size_t i = 0; i < kNum; i++) {
+    string field = absl::StrCat("f", i);
+    Run({"HSET", "hash", field, BuildString(64, 'a' + i % 26)});
+    Run({"RPUSH", "list", BuildString(64, 'a' + i % 26)});
+  }
+  Run({"PEXPIRE", "hash", "1000000"});
+
+  ExpectConditionWithinTimeout([&] { return GetMetrics().db_stats[0].tiered_entries == 2; });
+  EXPECT_EQ(Run({"TYPE", "hash"}), "hash");
+
+  // Accessing the values loads them back into memory.
+  EXPECT_THAT(Run({"HLEN", "hash"}), IntArg(kNum));
+  EXPECT_EQ(Run({"HGET", "hash", "f27"}), BuildString(64, 'b'));
+  EXPECT_THAT(Run({"LLEN", "list"}), IntArg(kNum));
+  EXPECT_EQ(Run({"LINDEX", "list", "-1"}), BuildString(64, 'a' + (kNum - 1) % 26));
+  EXPECT_GT(CheckedInt({"PTTL", "hash"}), 0);
+
+  EXPECT_GE(GetMetrics().tiered_stats.total_uploads, 2u);
+}
+
+TEST_F(TieredStorageTest, OffloadingRereads) {
+  absl::FlagSaver saver;
+  SetFlag(&FLAGS_tiered_offload_containers, true);
+  SetFlag(&FLAGS_tiered_experimental_cooling, false);
+
+  const unsigned kNum = 10;
+  vector<string> args = {"HSET", ""};
+  for (size_t i = 0; i < 100; i++) {
+    args.push_back(absl::StrCat("f", i));
+    args.push_back(BuildString(64));
+  }
+  for (size_t i = 0; i < kNum; i++) {
+    args[1] = absl::StrCat("k", i);
+    Run(absl::MakeSpan(args));
+  }
+
+  // Allow a single offloading sweep only.
+  SetFlag(&FLAGS_tiered_offload_min_idle_ms, 3600'000);
+  SetFlag(&FLAGS_tiered_offload_threshold, 0.0f);  // offload all values
+
+  ExpectConditionWithinTimeout([&] { return GetMetrics().db_stats[0].tiered_entries == kNum; });
+  EXPECT_EQ(GetMetrics().tiered_stats.total_offloading_rereads, 0u);
+
+  for (size_t i = 0; i < kNum / 2; i++) {
+    EXPECT_EQ(Run({"HGET", absl::StrCat("k", i), "f1"}), BuildString(64));
+  }
+  EXPECT_EQ(GetMetrics().tiered_stats.total_offloading_rereads, kNum / 2);
+}
+
+// Values warmed up from the cool queue are protected when they are cooled down again.
+TEST_F(TieredStorageTest, CoolQueueSegments) {
+  absl::FlagSaver saver;
+  SetFlag(&FLAGS_tiered_offload_min_idle_ms, 0);
+
+  const size_t kNum = 10;
+  for (size_t i = 0; i < kNum; i++) {
+    Run({"SET", absl::StrCat("k", i), BuildString(3000)});
+  }
+  ExpectConditionWithinTimeout([&] { return GetMetrics().tiered_stats.cool_entries == kNum; });
+  EXPECT_EQ(GetMetrics().tiered_stats.cool_protected_entries, 0u);
+
+  EXPECT_EQ(Run({"GET", "k0"}), BuildString(3000));
+  EXPECT_EQ(GetMetrics().tiered_stats.cool_entries, kNum - 1);
+  EXPECT_EQ(GetMetrics().events.ram_cool_hits, 1u);
+
+  SetFlag(&FLAGS_tiered_offload_threshold, 0.0f);  // offload all values
+  ExpectConditionWithinTimeout(
+      [&] { return GetMetrics().tiered_stats.cool_protected_entries == 1; });
+  EXPECT_EQ(GetMetrics().tiered_stats.cool_entries, kNum);
+}
+
+// Snapshots read offloaded values without loading them back into memory.
+TEST_F(TieredStorageTest, SaveKeepsOffloaded) {
+  absl::FlagSaver saver;
+  SetFlag(&FLAGS_tiered_offload_threshold, 0.0f);  // offload all values
+  SetFlag(&FLAGS_tiered_experimental_cooling, false);
+
+  const int kNum = 50;
+  for (size_t i = 0; i < kNum; i++) {
+    Run({"SET", absl::StrCat("k", i), BuildString(3000)});
+  }
+  ExpectConditionWithinTimeout([&] { return GetMetrics().db_stats[0].tiered_entries == kNum; });
+
+  EXPECT_EQ(Run({"save", "df", "tiered_save_test"}), "OK");
+
+  auto metrics = GetMetrics();
+  EXPECT_EQ(metrics.db_stats[0].tiered_entries, kNum);
+  EXPECT_EQ(metrics.tiered_stats.total_uploads, 0u);
+  EXPECT_GE(metrics.tiered_stats.total_fetches, kNum);
+
+  // Client reads still warm values up.
+  Run({"GET", "k0"});
+  Run({"GET", "k0"});
+  EXPECT_EQ(GetMetrics().tiered_stats.total_uploads, 1u);
+}
+
+class CompressedTieredStorageTest : public TieredStorageTest {
+ protected:
+  void SetUp() override {
+    SetFlag(&FLAGS_tiered_compression, "lz4");
+    TieredStorageTest::SetUp();
+  }
+
+  absl::FlagSaver saver_;
+};
+
+TEST_F(CompressedTieredStorageTest, Values) {
+  absl::FlagSaver saver;
+  SetFlag(&FLAGS_tiered_experimental_cooling, false);
+
+  // Large values compress well, small ones are random-ish and are stored as is in bins.
+  const size_t kNum = 100;
+  auto small_value = [](size_t i) {
+    string res;
+    for (size_t j = 0; res.size() < 1000; j++)
+      absl::StrAppend(&res, (i + 1) * 2654435761u * (j + 1));
+    return res;
+  };
+  for (size_t i = 0; i < kNum; i++) {
+    Run({"SET", absl::StrCat("large", i), BuildString(5000, 'a' + i % 26)});
+    Run({"SET", absl::StrCat("small", i), small_value(i)});
+  }
+
+  ExpectConditionWithinTimeout([&] { return GetMetrics().db_stats[0].tiered_entries >= kNum; });
+  EXPECT_LT(GetMetrics().db_stats[0].tiered_used_bytes, kNum * 5000);
+
+  for (size_t i = 0; i < kNum; i++) {
+    EXPECT_EQ(Run({"GET", absl::StrCat("large", i)}), BuildString(5000, 'a' + i % 26));
+    EXPECT_EQ(Run({"GET", absl::StrCat("small", i)}), small_value(i));
+  }
+}
+
 }  // namespace dfly
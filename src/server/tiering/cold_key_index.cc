@@ -0,0 +1,267 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/tiering/cold_key_index.h"
+
+#include <absl/numeric/bits.h>
+
+#include <algorithm>
+
+#include "absl/base/internal/endian.h"
+#include "base/logging.h"
+
+namespace dfly::tiering {
+using namespace std;
+
+namespace {
+
+// Page layout: number of entries (2 bytes) followed by entries.
+// Entry layout: dbid (2 bytes), hash (8 bytes), key size (2 bytes), value size (4 bytes), key and
+// value.
+constexpr size_t kPageHeaderSize = 2;
+constexpr size_t kEntryHeaderSize = 2 + 8 + 2 + 4;
+
+struct EntryView {
+  DbIndex dbid;
+  uint64_t hash;
+  string_view key, value;
+  size_t offset, size;  // location of the entry inside the page
+};
+
+// Calls cb for every entry of the page until it returns false.
+template <typename F> void ForEachEntry(string_view page, F&& cb) {
+  if (page.size() < kPageHeaderSize)
+    return;
+
+  const char* data = page.data();
+  unsigned num_entries = absl::little_endian::Load16(data);
+  size_t offset = kPageHeaderSize;
+  for (unsigned i = 0; i < num_entries; i++) {
+    DCHECK_LE(offset + kEntryHeaderSize, page.size());
+    const char* entry = data + offset;
+
+    EntryView ev;
+    ev.dbid = absl::little_endian::Load16(entry);
+    ev.hash = absl::little_endian::Load64(entry + 2);
+    size_t key_size = absl::little_endian::Load16(entry + 10);
+    size_t value_size = absl::little_endian::Load32(entry + 12);
+    ev.key = page.substr(offset + kEntryHeaderSize, key_size);
+    ev.value = page.substr(offset + kEntryHeaderSize + key_size, value_size);
+    ev.offset = offset;
+    ev.size = kEntryHeaderSize + key_size + value_size;
+
+    if (!cb(ev))
+      return;
+    offset += ev.size;
+  }
+}
+
+// Removes the entry from a serialized page. Returns true if it was found.
+bool RemoveFromPage(string* page, DbIndex dbid, uint64_t hash, string_view key) {
+  optional<pair<size_t, size_t>> found;
+  ForEachEntry(*page, [&](const EntryView& ev) {
+    if (ev.dbid == dbid && ev.hash == hash && ev.key == key)
+      found.emplace(ev.offset, ev.size);
+    return !found;
+  });
+
+  if (!found)
+    return false;
+
+  page->erase(found->first, found->second);
+  absl::little_endian::Store16(page->data(), absl::little_endian::Load16(page->data()) - 1);
+  return true;
+}
+
+}  // namespace
+
+ColdKeyIndex::ColdKeyIndex(size_t num_buckets) {
+  num_buckets = absl::bit_ceil(max<size_t>(num_buckets, 1));
+  bucket_mask_ = num_buckets - 1;
+  buckets_.resize(num_buckets);
+}
+
+size_t ColdKeyIndex::EntrySize(string_view key, string_view value) {
+  return kEntryHeaderSize + key.size() + value.size();
+}
+
+optional<ColdKeyIndex::FilledPage> ColdKeyIndex::Add(DbIndex dbid, uint64_t hash, string_view key,
+                                                     string_view value) {
+  size_t entry_size = EntrySize(key, value);
+  DCHECK_LE(kPageHeaderSize + entry_size, kPageSize);
+
+  optional<FilledPage> filled_page;
+  if (current_page_id_ != 0 && current_page_.size() + entry_size > kPageSize)
+    filled_page = FlushPage();
+
+  if (current_page_id_ == 0) {
+    current_page_id_ = ++last_page_id_;
+    current_page_.assign(kPageHeaderSize, '\0');
+  }
+
+  size_t offset = current_page_.size();
+  current_page_.resize(offset + entry_size);
+  char* entry = current_page_.data() + offset;
+  absl::little_endian::Store16(entry, dbid);
+  absl::little_endian::Store64(entry + 2, hash);
+  absl::little_endian::Store16(entry + 10, key.size());
+  absl::little_endian::Store32(entry + 12, value.size());
+  memcpy(entry + kEntryHeaderSize, key.data(), key.size());
+  memcpy(entry + kEntryHeaderSize + key.size(), value.data(), value.size());
+
+  char* header = current_page_.data();
+  absl::little_endian::Store16(header, absl::little_endian::Load16(header) + 1);
+
+  Bucket(hash).push_back({Tag(dbid, hash), current_page_id_});
+  pages_[current_page_id_].entries++;
+  entries_cnt_++;
+
+  return filled_page;
+}
+
+optional<ColdKeyIndex::FilledPage> ColdKeyIndex::Flush() {
+  if (current_page_id_ == 0)
+    return nullopt;
+  return FlushPage();
+}
+
+ColdKeyIndex::FilledPage ColdKeyIndex::FlushPage() {
+  DCHECK_NE(current_page_id_, 0u);
+
+  PageId id = exchange(current_page_id_, 0);
+  auto [it, inserted] = pending_pages_.emplace(id, std::move(current_page_));
+  DCHECK(inserted);
+  current_page_.clear();
+
+  return {id, it->second};
+}
+
+optional<DiskSegment> ColdKeyIndex::ReportStashed(PageId id, DiskSegment segment) {
+  DCHECK(pending_pages_.contains(id));
+  pending_pages_.erase(id);
+
+  auto it = pages_.find(id);
+  if (it == pages_.end())  // all entries were erased in the meantime
+    return segment;
+
+  it->second.segment = segment;
+  return nullopt;
+}
+
+string ColdKeyIndex::ReportStashAborted(PageId id) {
+  auto node = pending_pages_.extract(id);
+  DCHECK(!node.empty());
+  string page = std::move(node.mapped());
+
+  ForEachEntry(page, [&](const EntryView& ev) {
+    auto& bucket = Bucket(ev.hash);
+    auto it = find_if(bucket.begin(), bucket.end(), [&](const Fingerprint& fp) {
+      return fp.page == id && fp.tag == Tag(ev.dbid, ev.hash);
+    });
+    DCHECK(it != bucket.end());
+    *it = bucket.back();
+    bucket.pop_back();
+    entries_cnt_--;
+    return true;
+  });
+
+  pages_.erase(id);
+  return page;
+}
+
+vector<ColdKeyIndex::Location> ColdKeyIndex::Find(DbIndex dbid, uint64_t hash) const {
+  vector<Location> out;
+  uint32_t tag = Tag(dbid, hash);
+  for (const Fingerprint& fp : Bucket(hash)) {
+    if (fp.tag == tag)
+      out.push_back({fp.page, pages_.at(fp.page).segment});
+  }
+
+  // Pages ids grow monotonically, so newer pages are checked first.
+  sort(out.begin(), out.end(), [](const Location& l, const Location& r) { return l.id > r.id; });
+  return out;
+}
+
+optional<string_view> ColdKeyIndex::GetPendingPage(PageId id) const {
+  if (id == current_page_id_)
+    return current_page_;
+  if (auto it = pending_pages_.find(id); it != pending_pages_.end())
+    return it->second;
+  return nullopt;
+}
+
+optional<string_view> ColdKeyIndex::FindInPage(string_view page, DbIndex dbid, uint64_t hash,
+                                               string_view key) {
+  optional<string_view> value;
+  ForEachEntry(page, [&](const EntryView& ev) {
+    if (ev.dbid == dbid && ev.hash == hash && ev.key == key)
+      value = ev.value;
+    return !value;
+  });
+  return value;
+}
+
+optional<DiskSegment> ColdKeyIndex::Erase(PageId id, DbIndex dbid, uint64_t hash,
+                                          string_view key) {
+  auto& bucket = Bucket(hash);
+  auto fp_it = find_if(bucket.begin(), bucket.end(), [&](const Fingerprint& fp) {
+    return fp.page == id && fp.tag == Tag(dbid, hash);
+  });
+  DCHECK(fp_it != bucket.end());
+  if (fp_it == bucket.end())
+    return nullopt;
+
+  *fp_it = bucket.back();
+  bucket.pop_back();
+  entries_cnt_--;
+
+  // Pages in memory are edited directly, so they never contain erased entries.
+  if (id == current_page_id_) {
+    RemoveFromPage(&current_page_, dbid, hash, key);
+  } else if (auto it = pending_pages_.find(id); it != pending_pages_.end()) {
+    RemoveFromPage(&it->second, dbid, hash, key);
+  }
+
+  auto page_it = pages_.find(id);
+  DCHECK(page_it != pages_.end());
+  if (--page_it->second.entries > 0)
+    return nullopt;
+
+  optional<DiskSegment> segment = page_it->second.segment;
+  pages_.erase(page_it);
+  if (id == current_page_id_) {
+    current_page_id_ = 0;
+    current_page_.clear();
+  }
+  return segment;
+}
+
+ColdKeyIndex::Stats ColdKeyIndex::GetStats() const {
+  Stats stats;
+  stats.entries_cnt = entries_cnt_;
+  for (const auto& [_, info] : pages_)
+    stats.stashed_pages_cnt += info.segment.has_value();
+  stats.pending_bytes = current_page_.size();
+  for (const auto& [_, page] : pending_pages_)
+    stats.pending_bytes += page.size();
+  stats.filter_bytes = buckets_.capacity() * sizeof(buckets_[0]);
+  for (const auto& bucket : buckets_)
+    stats.filter_bytes += bucket.capacity() * sizeof(Fingerprint);
+  return stats;
+}
+
+uint32_t ColdKeyIndex::Tag(DbIndex dbid, uint64_t hash) {
+  // The low bits select the bucket, so the tag is taken from the high ones.
+  return uint32_t(hash >> 32) ^ (uint32_t(dbid) * 0x9E3779B1U);
+}
+
+vector<ColdKeyIndex::Fingerprint>& ColdKeyIndex::Bucket(uint64_t hash) {
+  return buckets_[hash & bucket_mask_];
+}
+
+const vector<ColdKeyIndex::Fingerprint>& ColdKeyIndex::Bucket(uint64_t hash) const {
+  return buckets_[hash & bucket_mask_];
+}
+
+}  // namespace dfly::tiering
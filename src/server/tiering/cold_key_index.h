@@ -0,0 +1,116 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/container/flat_hash_map.h>
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "server/tiering/common.h"
+
+namespace dfly::tiering {
+
+using DbIndex = uint16_t;
+
+// Directory of whole entries (key + serialized value) that were evicted from the prime table.
+// Like SmallBins, it only manages layout and bookkeeping: entries are packed into 4kb pages that
+// the caller stashes to disk and reports back.
+//
+// The only per-key state kept in memory is an 8 byte fingerprint in a bucket selected by the key
+// hash, which serves as a filter: lookups of absent keys are answered without disk probes and
+// lookups of present keys read a single page in the common case.
+class ColdKeyIndex {
+ public:
+  using PageId = uint32_t;
+
+  struct Stats {
+    size_t entries_cnt = 0;
+    size_t stashed_pages_cnt = 0;
+    size_t pending_bytes = 0;  // bytes of the current page and pages being stashed
+    size_t filter_bytes = 0;   // memory used by the fingerprint buckets
+  };
+
+  // Page filled with serialized entries
+  using FilledPage = std::pair<PageId, std::string>;
+
+  // Candidate location of a key
+  struct Location {
+    PageId id;
+    std::optional<DiskSegment> segment;  // unset if the page is still in memory
+  };
+
+  // Number of buckets is rounded up to a power of 2.
+  explicit ColdKeyIndex(size_t num_buckets = 1024);
+
+  // Returns the size of a serialized entry. Entries larger than a page can not be added.
+  static size_t EntrySize(std::string_view key, std::string_view value);
+
+  // Add entry to the current page. Returns page to be stashed if it filled up.
+  std::optional<FilledPage> Add(DbIndex dbid, uint64_t hash, std::string_view key,
+                                std::string_view value);
+
+  // Flush the current page even if it's not full, for example before shutdown.
+  std::optional<FilledPage> Flush();
+
+  // Report that a stash succeeded. Returns the segment back if all entries of the page were
+  // erased while the stash was pending, so it should be freed.
+  std::optional<DiskSegment> ReportStashed(PageId id, DiskSegment segment);
+
+  // Report that a stash was aborted. Returns the page so its entries can be restored.
+  std::string ReportStashAborted(PageId id);
+
+  // Returns pages that may contain the key, newest first. Empty if the key is not in the index.
+  std::vector<Location> Find(DbIndex dbid, uint64_t hash) const;
+
+  // Returns the in-memory contents of a page that was not stashed yet.
+  std::optional<std::string_view> GetPendingPage(PageId id) const;
+
+  // Returns value of the key if it's in the serialized page.
+  static std::optional<std::string_view> FindInPage(std::string_view page, DbIndex dbid,
+                                                    uint64_t hash, std::string_view key);
+
+  // Remove key from the page where it was found. Returns the page segment if it has no entries
+  // left and should be freed.
+  std::optional<DiskSegment> Erase(PageId id, DbIndex dbid, uint64_t hash, std::string_view key);
+
+  Stats GetStats() const;
+
+ private:
+  struct Fingerprint {
+    uint32_t tag;  // high bits of the key hash mixed with the db index
+    PageId page;
+  };
+
+  struct PageInfo {
+    std::optional<DiskSegment> segment;  // set once stashed
+    unsigned entries = 0;
+  };
+
+  static uint32_t Tag(DbIndex dbid, uint64_t hash);
+  std::vector<Fingerprint>& Bucket(uint64_t hash);
+  const std::vector<Fingerprint>& Bucket(uint64_t hash) const;
+
+  FilledPage FlushPage();
+
+  PageId last_page_id_ = 0;
+  PageId current_page_id_ = 0;  // 0 if no page is being filled
+  std::string current_page_;    // serialized entries of the page currently being filled
+
+  // Filled pages waiting for their stash to complete. Their contents stay in memory, so lookups
+  // and erases are served without reading them back.
+  absl::flat_hash_map<PageId, std::string> pending_pages_;
+
+  // All pages with entries, including the current and the pending ones.
+  absl::flat_hash_map<PageId, PageInfo> pages_;
+
+  uint64_t bucket_mask_;
+  std::vector<std::vector<Fingerprint>> buckets_;
+
+  size_t entries_cnt_ = 0;
+};
+
+};  // namespace dfly::tiering
@@ -0,0 +1,102 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/tiering/cold_key_index.h"
+
+#include <absl/strings/str_cat.h>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+namespace dfly::tiering {
+
+using namespace std;
+
+uint64_t Hash(unsigned i) {
+  return (i + 1) * 0x9E3779B97F4A7C15ULL;
+}
+
+class ColdKeyIndexTest : public ::testing::Test {
+ protected:
+  // Looks up the key as a caller would: through in-memory pages or the "disk".
+  optional<string> Lookup(DbIndex dbid, uint64_t hash, string_view key) {
+    for (const auto& loc : index_.Find(dbid, hash)) {
+      string_view page =
+          loc.segment ? string_view{disk_[loc.segment->offset]} : *index_.GetPendingPage(loc.id);
+      if (auto value = ColdKeyIndex::FindInPage(page, dbid, hash, key); value)
+        return string{*value};
+    }
+    return nullopt;
+  }
+
+  void Stash(const ColdKeyIndex::FilledPage& page) {
+    DiskSegment segment{disk_.size() * kPageSize, kPageSize};
+    disk_[segment.offset] = page.second;
+    EXPECT_FALSE(index_.ReportStashed(page.first, segment));
+  }
+
+  ColdKeyIndex index_{16};
+  absl::flat_hash_map<size_t, string> disk_;
+};
+
+TEST_F(ColdKeyIndexTest, AddFind) {
+  const unsigned kNum = 500;
+  for (unsigned i = 0; i < kNum; i++) {
+    if (auto page = index_.Add(0, Hash(i), absl::StrCat("k", i), absl::StrCat("v", i)); page)
+      Stash(*page);
+  }
+
+  auto stats = index_.GetStats();
+  EXPECT_EQ(stats.entries_cnt, kNum);
+  EXPECT_GT(stats.stashed_pages_cnt, 0u);
+
+  for (unsigned i = 0; i < kNum; i++)
+    EXPECT_EQ(Lookup(0, Hash(i), absl::StrCat("k", i)), absl::StrCat("v", i));
+
+  // Absent keys and other databases are filtered out without touching pages
+  EXPECT_TRUE(index_.Find(0, Hash(kNum)).empty());
+  EXPECT_TRUE(index_.Find(1, Hash(0)).empty());
+}
+
+TEST_F(ColdKeyIndexTest, Erase) {
+  vector<ColdKeyIndex::FilledPage> pending;
+  const unsigned kNum = 500;
+  for (unsigned i = 0; i < kNum; i++) {
+    if (auto page = index_.Add(0, Hash(i), absl::StrCat("k", i), string(64, 'a')); page)
+      pending.push_back(std::move(*page));
+  }
+  ASSERT_GE(pending.size(), 2u);
+
+  // Stash the first page and erase all of its entries, the page should be released
+  Stash(pending[0]);
+  size_t freed = 0;
+  for (unsigned i = 0; i < kNum; i++) {
+    auto locs = index_.Find(0, Hash(i));
+    ASSERT_EQ(locs.size(), 1u);
+    if (!locs[0].segment)
+      continue;
+    if (index_.Erase(locs[0].id, 0, Hash(i), absl::StrCat("k", i)))
+      freed++;
+  }
+  EXPECT_EQ(freed, 1u);
+
+  // Erase all entries of a pending page before its stash finishes
+  for (unsigned i = 0; i < kNum; i++) {
+    auto locs = index_.Find(0, Hash(i));
+    if (!locs.empty() && locs[0].id == pending[1].first)
+      EXPECT_FALSE(index_.Erase(locs[0].id, 0, Hash(i), absl::StrCat("k", i)));
+  }
+  EXPECT_TRUE(index_.ReportStashed(pending[1].first, DiskSegment{kPageSize, kPageSize}));
+
+  // Erased entries of the current page are removed from it
+  auto locs = index_.Find(0, Hash(kNum - 1));
+  ASSERT_EQ(locs.size(), 1u);
+  size_t pending_bytes = index_.GetStats().pending_bytes;
+  EXPECT_FALSE(index_.Erase(locs[0].id, 0, Hash(kNum - 1), absl::StrCat("k", kNum - 1)));
+  EXPECT_EQ(index_.GetStats().pending_bytes,
+            pending_bytes - ColdKeyIndex::EntrySize("k499", string(64, 'a')));
+  EXPECT_FALSE(Lookup(0, Hash(kNum - 1), absl::StrCat("k", kNum - 1)));
+}
+
+}  // namespace dfly::tiering
@@ -4,6 +4,9 @@
 
 #include "server/tiering/disk_storage.h"
 
+#include <fcntl.h>
+
+#include <algorithm>
 #include <system_error>
 
 #include "base/flags.h"
@@ -21,6 +24,13 @@ ABSL_FLAG(bool, backing_file_direct, true, "If true uses O_DIRECT to open backin
 ABSL_FLAG(uint64_t, registered_buffer_size, 512_KB,
           "Size of registered buffer for IoUring fixed read/writes");
 
+ABSL_FLAG(bool, backing_file_punch_holes, true,
+          "If true, releases the disk space of backing file ranges that became unused");
+
+ABSL_FLAG(bool, backing_file_coalesce_writes, true,
+          "If true, stashes issued before the caller yields are submitted together and the ones "
+          "with adjacent ranges are merged into a single write");
+
 namespace dfly::tiering {
 
 using namespace std;
@@ -53,6 +63,13 @@ void ReturnBuf(UringBuf buf) {
 
 constexpr off_t kInitialSize = 1UL << 28;  // 256MB
 
+// Max length of a write merged from adjacent stashes.
+constexpr size_t kMaxCoalescedWrite = 256_KB;
+
+size_t PageAlignedEnd(DiskSegment segment) {
+  return segment.offset + (segment.length + kPageSize - 1) / kPageSize * kPageSize;
+}
+
 template <typename... Ts> error_code DoFiberCall(void (SubmitEntry::*c)(Ts...), Ts... args) {
   auto* proactor = static_cast<UringProactor*>(ProactorBase::me());
   FiberCall fc(proactor);
@@ -64,6 +81,8 @@ template <typename... Ts> error_code DoFiberCall(void (SubmitEntry::*c)(Ts...),
 }  // anonymous namespace
 
 DiskStorage::DiskStorage(size_t max_size) : max_size_(max_size) {
+  punch_holes_ = absl::GetFlag(FLAGS_backing_file_punch_holes);
+  coalesce_writes_ = absl::GetFlag(FLAGS_backing_file_coalesce_writes);
 }
 
 error_code DiskStorage::Open(string_view path) {
@@ -101,9 +120,14 @@ void DiskStorage::Close() {
   using namespace chrono_literals;
 
   // TODO: to fix this polling.
-  while (pending_ops_ > 0 || grow_pending_)
+  while (pending_ops_ > 0 || grow_pending_ || punching_)
     util::ThisFiber::SleepFor(10ms);
 
+  if (write_fb_.IsJoinable())
+    write_fb_.Join();
+  if (punch_fb_.IsJoinable())
+    punch_fb_.Join();
+
   backing_file_->Close();
   backing_file_.reset();
 }
@@ -136,7 +160,61 @@ void DiskStorage::MarkAsFree(DiskSegment segment) {
   DCHECK_GT(segment.length, 0u);
   DCHECK_EQ(segment.offset % kPageSize, 0u);
 
-  alloc_.Free(segment.offset, segment.length);
+  DiskSegment unused = alloc_.Free(segment.offset, segment.length);
+  if (unused.length > 0 && punch_holes_)
+    PunchHole(unused);
+}
+
+void DiskStorage::PunchHole(DiskSegment segment) {
+  if (!backing_file_)
+    return;
+
+  // MarkAsFree is called from i/o completions, so the punch is issued from a separate fiber.
+  punches_.push_back(segment);
+  if (!std::exchange(punching_, true)) {
+    if (punch_fb_.IsJoinable())
+      punch_fb_.Join();  // it has already finished, because it resets punching_ last.
+    punch_fb_ = Fiber(Launch::post, "tiering_punch_holes", [this] { PunchHoles(); });
+  }
+}
+
+void DiskStorage::PunchHoles() {
+  while (!punches_.empty()) {
+    size_t batch_size = punches_.size();
+    vector<DiskSegment> batch(punches_.begin(), punches_.end());
+    sort(batch.begin(), batch.end(),
+         [](DiskSegment l, DiskSegment r) { return l.offset < r.offset; });
+
+    for (size_t i = 0; i < batch.size() && punch_holes_;) {
+      DiskSegment range = batch[i];
+      for (++i; i < batch.size() && batch[i].offset == range.offset + range.length; ++i)
+        range.length += batch[i].length;
+
+      auto ec = DoFiberCall(&SubmitEntry::PrepFallocate, backing_file_->fd(),
+                            FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, off_t(range.offset),
+                            off_t(range.length));
+      if (ec) {
+        LOG(WARNING) << "Could not punch a hole in the backing file, disabling: " << ec.message();
+        punch_holes_ = false;
+      } else {
+        punched_bytes_ += range.length;
+      }
+    }
+    punches_.erase(punches_.begin(), punches_.begin() + batch_size);
+
+    // Issue the writes that no longer overlap a pending punch.
+    vector<DeferredWrite> deferred = std::move(deferred_writes_);
+    deferred_writes_.clear();
+    for (auto& write : deferred)
+      IssueWrite(write.offset, write.data, write.buf, std::move(write.parts));
+  }
+  punching_ = false;
+}
+
+bool DiskStorage::OverlapsPunch(size_t offset, size_t length) const {
+  return any_of(punches_.begin(), punches_.end(), [offset, length](DiskSegment punch) {
+    return offset < punch.offset + punch.length && punch.offset < offset + length;
+  });
 }
 
 std::error_code DiskStorage::Stash(io::Bytes bytes, StashCb cb) {
@@ -162,22 +240,20 @@ std::error_code DiskStorage::Stash(io::Bytes bytes, StashCb cb) {
   UringBuf buf = PrepareBuf(len);
   memcpy(buf.bytes.data(), bytes.data(), bytes.length());
 
-  auto io_cb = [this, cb, offset, buf, len](int io_res) {
-    if (io_res < 0) {
-      MarkAsFree({size_t(offset), len});
-      cb(nonstd::make_unexpected(error_code{-io_res, std::system_category()}));
-    } else {
-      cb(DiskSegment{size_t(offset), len});
-    }
-    ReturnBuf(buf);
-    pending_ops_--;
-  };
-
   pending_ops_++;
-  if (buf.buf_idx)
-    backing_file_->WriteFixedAsync(buf.bytes, offset, *buf.buf_idx, std::move(io_cb));
-  else
-    backing_file_->WriteAsync(buf.bytes, offset, std::move(io_cb));
+  DiskSegment segment{size_t(offset), len};
+  if (coalesce_writes_) {
+    // Defer the write until the caller yields, so that stashes issued by the same flow
+    // (i.e. an offloading step) can be merged.
+    pending_writes_.push_back({segment, buf, std::move(cb)});
+    if (pending_writes_.size() == 1) {
+      if (write_fb_.IsJoinable())
+        write_fb_.Join();  // it has already finished, because it never preempts.
+      write_fb_ = Fiber(Launch::post, "tiering_submit_writes", [this] { SubmitWrites(); });
+    }
+  } else {
+    IssueWrite(segment.offset, buf.bytes, buf, {{segment, std::move(cb)}});
+  }
 
   // Grow in advance if needed and possible
   size_t capacity = alloc_.capacity();
@@ -190,10 +266,82 @@ std::error_code DiskStorage::Stash(io::Bytes bytes, StashCb cb) {
   return {};
 }
 
+void DiskStorage::SubmitWrites() {
+  std::vector<PendingWrite> writes = std::move(pending_writes_);
+  pending_writes_.clear();
+
+  std::sort(writes.begin(), writes.end(), [](const PendingWrite& l, const PendingWrite& r) {
+    return l.segment.offset < r.segment.offset;
+  });
+
+  for (size_t i = 0; i < writes.size();) {
+    size_t start = writes[i].segment.offset;
+    size_t end = PageAlignedEnd(writes[i].segment);
+    size_t j = i + 1;
+    for (; j < writes.size(); ++j) {
+      size_t next_end = PageAlignedEnd(writes[j].segment);
+      if (writes[j].segment.offset != end || next_end - start > kMaxCoalescedWrite)
+        break;
+      end = next_end;
+    }
+
+    std::vector<std::pair<DiskSegment, StashCb>> parts;
+    for (size_t k = i; k < j; ++k)
+      parts.emplace_back(writes[k].segment, std::move(writes[k].cb));
+
+    if (j == i + 1) {
+      IssueWrite(start, writes[i].buf.bytes, writes[i].buf, std::move(parts));
+    } else {
+      // Gather the adjacent stashes into a single buffer. Padding between them belongs to
+      // their own allocated blocks, so it's safe to overwrite.
+      UringBuf merged = PrepareBuf(end - start);
+      for (size_t k = i; k < j; ++k) {
+        memcpy(merged.bytes.data() + (writes[k].segment.offset - start), writes[k].buf.bytes.data(),
+               writes[k].segment.length);
+        ReturnBuf(writes[k].buf);
+      }
+      coalesced_writes_ += j - i - 1;
+      IssueWrite(start, {merged.bytes.data(), end - start}, merged, std::move(parts));
+    }
+    i = j;
+  }
+}
+
+void DiskStorage::IssueWrite(size_t offset, io::Bytes data, UringBuf buf,
+                             std::vector<std::pair<DiskSegment, StashCb>> parts) {
+  if (!punches_.empty() && OverlapsPunch(offset, data.size())) {
+    deferred_writes_.push_back({offset, data, buf, std::move(parts)});
+    return;
+  }
+
+  auto io_cb = [this, buf, parts = std::move(parts)](int io_res) {
+    for (const auto& [segment, cb] : parts) {
+      if (io_res < 0) {
+        MarkAsFree(segment);
+        cb(nonstd::make_unexpected(error_code{-io_res, std::system_category()}));
+      } else {
+        cb(segment);
+      }
+    }
+    ReturnBuf(buf);
+    pending_ops_ -= parts.size();
+  };
+
+  if (buf.buf_idx)
+    backing_file_->WriteFixedAsync(data, offset, *buf.buf_idx, std::move(io_cb));
+  else
+    backing_file_->WriteAsync(data, offset, std::move(io_cb));
+}
+
 DiskStorage::Stats DiskStorage::GetStats() const {
-  return {
-      alloc_.allocated_bytes(),       alloc_.capacity(), heap_buf_alloc_cnt_, reg_buf_alloc_cnt_,
-      static_cast<size_t>(max_size_), pending_ops_};
+  return {alloc_.allocated_bytes(),
+          alloc_.capacity(),
+          heap_buf_alloc_cnt_,
+          reg_buf_alloc_cnt_,
+          static_cast<size_t>(max_size_),
+          pending_ops_,
+          punched_bytes_,
+          coalesced_writes_};
 }
 
 bool DiskStorage::CanGrow() const {
@@ -5,10 +5,12 @@
 #pragma once
 
 #include <system_error>
+#include <vector>
 
 #include "io/io.h"
 #include "server/tiering/common.h"
 #include "server/tiering/external_alloc.h"
+#include "util/fibers/fibers.h"
 #include "util/fibers/uring_file.h"
 #include "util/fibers/uring_proactor.h"  // for UringBuf
 
@@ -26,6 +28,8 @@ class DiskStorage {
     uint64_t registered_buf_alloc_count = 0;
     size_t max_file_size = 0;
     size_t pending_ops = 0;
+    uint64_t punched_bytes = 0;  // disk space released back to the file system
+    uint64_t coalesced_writes = 0;  // stashes written as part of a preceding adjacent stash
   };
 
   using ReadCb = std::function<void(io::Result<std::string_view>)>;
@@ -39,7 +43,8 @@ class DiskStorage {
   // Request read for segment, cb will be called on completion with read value
   void Read(DiskSegment segment, ReadCb cb);
 
-  // Mark segment as free, performed immediately
+  // Mark segment as free, performed immediately. Disk space of allocator pages that became
+  // completely free is released later with a hole punch.
   void MarkAsFree(DiskSegment segment);
 
   // Request bytes to be stored, cb will be called with assigned segment on completion. Can block to
@@ -55,6 +60,33 @@ class DiskStorage {
 
   std::error_code Grow(off_t grow_size);
 
+  // Queues the range for releasing its disk space while keeping the file size.
+  void PunchHole(DiskSegment segment);
+
+  // Punches the queued ranges with asynchronous fallocate calls. Ranges queued while a batch is
+  // in flight are merged and punched together in the next one.
+  void PunchHoles();
+
+  // Whether the range overlaps a queued or an in-flight hole punch.
+  bool OverlapsPunch(size_t offset, size_t length) const;
+
+  // A stash whose data was copied to buf, but which was not written yet.
+  struct PendingWrite {
+    DiskSegment segment;
+    util::fb2::UringBuf buf;
+    StashCb cb;
+  };
+
+  // Write stashes issued since the last submission. Stashes of adjacent ranges are merged into a
+  // single write.
+  void SubmitWrites();
+
+  // Issue a single disk write of data at offset, that covers all segments of parts.
+  // buf is the buffer backing data and is returned once the write completes.
+  // Writes to ranges that are about to be punched are deferred until the punch completes.
+  void IssueWrite(size_t offset, io::Bytes data, util::fb2::UringBuf buf,
+                  std::vector<std::pair<DiskSegment, StashCb>> parts);
+
   // Returns a buffer with size greater or equal to len.
   util::fb2::UringBuf PrepareBuf(size_t len);
 
@@ -65,6 +97,28 @@ class DiskStorage {
   uint64_t heap_buf_alloc_cnt_ = 0, reg_buf_alloc_cnt_ = 0;
 
   bool grow_pending_ = false;
+  bool punch_holes_ = false;
+  bool punching_ = false;  // punch_fb_ is running
+  uint64_t punched_bytes_ = 0;
+
+  // A write deferred by a hole punch of its range.
+  struct DeferredWrite {
+    size_t offset;
+    io::Bytes data;
+    util::fb2::UringBuf buf;
+    std::vector<std::pair<DiskSegment, StashCb>> parts;
+  };
+
+  // Ranges to punch, the ones of the batch in flight first. The allocator may hand them out
+  // again before they are punched, so writes to them wait in deferred_writes_.
+  std::vector<DiskSegment> punches_;
+  std::vector<DeferredWrite> deferred_writes_;
+  util::fb2::Fiber punch_fb_;
+
+  bool coalesce_writes_ = false;
+  uint64_t coalesced_writes_ = 0;
+  std::vector<PendingWrite> pending_writes_;
+  util::fb2::Fiber write_fb_;  // submits pending_writes_ once the caller yields
   std::unique_ptr<util::fb2::LinuxFile> backing_file_;
 
   ExternalAllocator alloc_;
@@ -128,6 +128,49 @@ TEST_F(DiskStorageTest, ReUse) {
   });
 }
 
+TEST_F(DiskStorageTest, PunchHoles) {
+  pp_->at(0)->Await([this] {
+    Open();
+
+    Stash(0, string(3000, 'a'));
+    Wait();
+    Delete(0);  // the page became unused and is punched in the background
+
+    // The range is reused right away, so its write must wait for the punch to complete.
+    Stash(1, string(3000, 'b'));
+    Wait();
+    EXPECT_EQ(segments_[1]->offset, 0u);
+    EXPECT_GT(GetStats().punched_bytes, 0u);
+
+    Read(1);
+    Wait();
+    EXPECT_EQ(*last_reads_[1], string(3000, 'b'));
+
+    Close();
+  });
+}
+
+TEST_F(DiskStorageTest, CoalescedWrites) {
+  pp_->at(0)->Await([this] {
+    Open();
+
+    // Stashes issued without yielding occupy adjacent pages and are written together
+    const size_t kNum = 20;
+    for (size_t i = 0; i < kNum; i++)
+      Stash(i, string(3000, 'a' + i));
+    Wait();
+    EXPECT_GT(GetStats().coalesced_writes, 0u);
+
+    for (size_t i = 0; i < kNum; i++)
+      Read(i);
+    Wait();
+    for (size_t i = 0; i < kNum; i++)
+      EXPECT_EQ(*last_reads_[i], string(3000, 'a' + i));
+
+    Close();
+  });
+}
+
 TEST_F(DiskStorageTest, FlakyDevice) {
   if (!filesystem::exists("/mnt/tiering_flaky"))
     GTEST_SKIP() << "Flaky device not created, use tools/faulty_io.sh";
@@ -366,11 +366,11 @@ int64_t ExternalAllocator::Malloc(size_t sz) {
   return seg->BlockOffset(page, pos);
 }
 
-void ExternalAllocator::Free(size_t offset, size_t sz) {
+DiskSegment ExternalAllocator::Free(size_t offset, size_t sz) {
   if (sz > kMediumObjMaxSize) {
     size_t align_sz = alignup(sz, 4_KB);
     extent_tree_.Add(offset, align_sz);
-    return;
+    return {offset, align_sz};
   }
 
   size_t idx = offset / 256_MB;
@@ -397,16 +397,21 @@ void ExternalAllocator::Free(size_t offset, size_t sz) {
   ++page->available;
 
   DCHECK_EQ(page->available, page->free_blocks.count());
+  allocated_bytes_ -= block_size;
+
   // If page becomes fully free, return it to segment list, otherwise if it just became non-empty,
   // then return it to free pages list
   if (page->available == blocks_num) {
     FreePage(page, seg, block_size);
-  } else if (page->available == 1) {
+    return {offset - block_offs, page_size};
+  }
+
+  if (page->available == 1) {
     DCHECK_NE(page, free_pages_[page->bin_idx]);
     page->next_free = free_pages_[page->bin_idx];
     free_pages_[page->bin_idx] = page;
   }
-  allocated_bytes_ -= block_size;
+  return {};
 }
 
 void ExternalAllocator::AddStorage(size_t start, size_t size) {
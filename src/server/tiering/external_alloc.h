@@ -61,7 +61,9 @@ class ExternalAllocator {
   // size sz.
   int64_t Malloc(size_t sz);
 
-  void Free(size_t offset, size_t sz);
+  // Returns the range of the backing storage that became completely unused by this call,
+  // i.e. a whole page or a large extent, or an empty segment otherwise.
+  DiskSegment Free(size_t offset, size_t sz);
 
   /// Adds backing storage to the allocator. The range should not overlap with already
   /// added storage ranges.
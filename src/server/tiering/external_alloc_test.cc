@@ -66,6 +66,20 @@ TEST_F(ExternalAllocatorTest, Basic) {
   EXPECT_EQ(0, ext_alloc_.Malloc(kMinBlockSize * 2));  // page0
 }
 
+TEST_F(ExternalAllocatorTest, UnusedRanges) {
+  ext_alloc_.AddStorage(0, kSegSize);
+  EXPECT_EQ(0, ext_alloc_.Malloc(kMinBlockSize));              //  page0: 1
+  EXPECT_EQ(kMinBlockSize, ext_alloc_.Malloc(kMinBlockSize));  //  page0: 2
+
+  EXPECT_EQ(ext_alloc_.Free(0, kMinBlockSize).length, 0u);  // page0: 1
+  DiskSegment unused = ext_alloc_.Free(kMinBlockSize, kMinBlockSize);
+  EXPECT_EQ(unused, DiskSegment(0, 1_MB));  // page0 is completely free
+
+  int64_t large = ext_alloc_.Malloc(4_MB);
+  ASSERT_GE(large, 0);
+  EXPECT_EQ(ext_alloc_.Free(large, 4_MB), DiskSegment(large, 4_MB));
+}
+
 TEST_F(ExternalAllocatorTest, Invariants) {
   ext_alloc_.AddStorage(0, kSegSize);
 
@@ -4,18 +4,28 @@
 
 #include "server/tiering/op_manager.h"
 
+#include <algorithm>
 #include <variant>
 
+#include "base/flags.h"
 #include "base/logging.h"
 #include "core/overloaded.h"
 #include "io/io.h"
 #include "server/tiering/common.h"
 #include "server/tiering/disk_storage.h"
 #include "util/fibers/fibers.h"
+
+ABSL_FLAG(int32_t, tiered_read_coalesce_gap, 1,
+          "Reads of offloaded pages that are at most this many pages apart are merged into a "
+          "single disk read. Negative value disables read coalescing");
+
 namespace dfly::tiering {
 
 namespace {
 
+// Upper bound for the size of a merged read.
+constexpr size_t kMaxCoalescedRead = 64 * kPageSize;
+
 OpManager::OwnedEntryId ToOwned(OpManager::EntryId id) {
   Overloaded convert{[](unsigned i) -> OpManager::OwnedEntryId { return i; },
                      [](std::pair<DbIndex, std::string_view> p) -> OpManager::OwnedEntryId {
@@ -41,6 +51,7 @@ std::ostream& operator<<(std::ostream& os, const OpManager::EntryId& id) {
 }  // namespace
 
 OpManager::OpManager(size_t max_size) : storage_{max_size} {
+  read_coalesce_gap_ = absl::GetFlag(FLAGS_tiered_read_coalesce_gap);
 }
 
 OpManager::~OpManager() {
@@ -53,6 +64,8 @@ std::error_code OpManager::Open(std::string_view file) {
 }
 
 void OpManager::Close() {
+  if (submit_fb_.IsJoinable())
+    submit_fb_.Join();
   storage_.Close();
   DCHECK(pending_stash_ver_.empty());
   DCHECK(pending_reads_.empty());
@@ -65,6 +78,16 @@ void OpManager::Enqueue(EntryId id, DiskSegment segment, ReadCallback cb) {
       .callbacks.emplace_back(std::move(cb));
 }
 
+bool OpManager::HasPendingRead(DiskSegment segment) const {
+  auto it = pending_reads_.find(segment.ContainingPages().offset);
+  if (it == pending_reads_.end())
+    return false;
+  const auto& key_ops = it->second.key_ops;
+  return std::any_of(key_ops.begin(), key_ops.end(), [segment](const EntryOps& ops) {
+    return ops.segment.offset == segment.offset;
+  });
+}
+
 void OpManager::Delete(EntryId id) {
   // If the item isn't offloaded, it has io pending, so cancel it
   DCHECK(pending_stash_ver_.count(ToOwned(id)));
@@ -107,16 +130,60 @@ OpManager::ReadOp& OpManager::PrepareRead(DiskSegment aligned_segment) {
   DCHECK_EQ(aligned_segment.length % kPageSize, 0u);
 
   auto [it, inserted] = pending_reads_.try_emplace(aligned_segment.offset, aligned_segment);
-  if (inserted) {
-    auto io_cb = [this, aligned_segment](io::Result<std::string_view> result) {
-      CHECK(result) << result.error();  // TODO: to handle this gracefully.
-      ProcessRead(aligned_segment.offset, *result);
-    };
-    storage_.Read(aligned_segment, io_cb);
+  if (!inserted)
+    return it->second;
+
+  if (read_coalesce_gap_ < 0) {
+    IssueRead(aligned_segment, {aligned_segment});
+    return it->second;
+  }
+
+  // Defer the read until the caller yields, so that reads enqueued by the same batch
+  // (i.e. MGET or a snapshot bucket) can be merged.
+  unsubmitted_reads_.push_back(aligned_segment);
+  if (unsubmitted_reads_.size() == 1) {
+    if (submit_fb_.IsJoinable())
+      submit_fb_.Join();  // it has already finished, because it never preempts.
+    submit_fb_ = util::fb2::Fiber(util::fb2::Launch::post, "tiering_submit_reads",
+                                  [this] { SubmitReads(); });
   }
   return it->second;
 }
 
+void OpManager::SubmitReads() {
+  std::vector<DiskSegment> reads = std::move(unsubmitted_reads_);
+  unsubmitted_reads_.clear();
+
+  std::sort(reads.begin(), reads.end(),
+            [](const DiskSegment& l, const DiskSegment& r) { return l.offset < r.offset; });
+
+  const size_t max_gap = size_t(read_coalesce_gap_) * kPageSize;
+  for (size_t i = 0; i < reads.size();) {
+    DiskSegment span = reads[i];
+    size_t j = i + 1;
+    for (; j < reads.size(); ++j) {
+      size_t span_end = span.offset + span.length;
+      size_t next_end = reads[j].offset + reads[j].length;
+      DCHECK_GE(reads[j].offset, span_end);
+      if (reads[j].offset > span_end + max_gap || next_end - span.offset > kMaxCoalescedRead)
+        break;
+      span.length = next_end - span.offset;
+    }
+
+    IssueRead(span, std::vector<DiskSegment>(reads.begin() + i, reads.begin() + j));
+    i = j;
+  }
+}
+
+void OpManager::IssueRead(DiskSegment span, std::vector<DiskSegment> parts) {
+  auto io_cb = [this, span, parts = std::move(parts)](io::Result<std::string_view> result) {
+    CHECK(result) << result.error();  // TODO: to handle this gracefully.
+    for (const DiskSegment& part : parts)
+      ProcessRead(part.offset, result->substr(part.offset - span.offset, part.length));
+  };
+  storage_.Read(span, std::move(io_cb));
+}
+
 void OpManager::ProcessStashed(EntryId id, unsigned version,
                                const io::Result<DiskSegment>& segment) {
   if (auto it = pending_stash_ver_.find(ToOwned(id));
@@ -154,6 +221,7 @@ void OpManager::ProcessRead(size_t offset, std::string_view page) {
   for (size_t i = 0; i < info->key_ops.size(); i++) {
     auto& ko = info->key_ops[i];
     key_value = page.substr(ko.segment.offset - info->segment.offset, ko.segment.length);
+    DecodeFetched(Borrowed(ko.id), &key_value);
 
     bool modified = false;
     for (auto& cb : ko.callbacks)
@@ -12,13 +12,15 @@
 #include "server/tiering/common.h"
 #include "server/tiering/disk_storage.h"
 #include "server/tx_base.h"
+#include "util/fibers/fibers.h"
 #include "util/fibers/future.h"
 
 namespace dfly::tiering {
 
 // Manages READ/DELETE/STASH operations on top of a DiskStorage.
-// Implicitly combines reads with different offsets on the same 4kb page,
-// safely schedules deletes after reads and allows cancelling pending stashes
+// Implicitly combines reads with different offsets on the same 4kb page, merges reads of nearby
+// pages enqueued before the caller yields, safely schedules deletes after reads and allows
+// cancelling pending stashes
 class OpManager {
  public:
   struct Stats {
@@ -60,6 +62,9 @@ class OpManager {
   // will have it's own independent callback loop that can safely modify the underlying value
   void Enqueue(EntryId id, DiskSegment segment, ReadCallback cb);
 
+  // Returns true if a read of the segment is enqueued and not completed yet.
+  bool HasPendingRead(DiskSegment segment) const;
+
   // Delete entry with pending io
   void Delete(EntryId id);
 
@@ -84,6 +89,11 @@ class OpManager {
   // Notify delete. Return true if the filled segment needs to be marked as free.
   virtual bool NotifyDelete(DiskSegment segment) = 0;
 
+  // Restore the value read from disk to the form it was passed to Stash.
+  // Called before any read callbacks of the entry.
+  virtual void DecodeFetched(EntryId id, std::string* value) {
+  }
+
  protected:
   // Describes pending futures for a single entry
   struct EntryOps {
@@ -115,6 +125,13 @@ class OpManager {
   // Refernce is valid until any other read operations occur.
   ReadOp& PrepareRead(DiskSegment aligned_segment);
 
+  // Issue reads prepared since the last submission. Reads of pages that are at most
+  // read_coalesce_gap_ pages apart are merged into a single disk read.
+  void SubmitReads();
+
+  // Issue a single disk read for span, that covers the aligned segments of parts.
+  void IssueRead(DiskSegment span, std::vector<DiskSegment> parts);
+
   // Called once read finished
   void ProcessRead(size_t offset, std::string_view value);
 
@@ -126,6 +143,10 @@ class OpManager {
 
   absl::flat_hash_map<size_t /* offset */, ReadOp> pending_reads_;
 
+  int read_coalesce_gap_ = 0;                   // negative if coalescing is disabled
+  std::vector<DiskSegment> unsubmitted_reads_;  // prepared reads that were not issued yet
+  util::fb2::Fiber submit_fb_;                  // issues unsubmitted reads once the caller yields
+
   size_t pending_stash_counter_ = 0;
   // todo: allow heterogeneous lookups with non owned id
   absl::flat_hash_map<OwnedEntryId, unsigned /* version */> pending_stash_ver_;
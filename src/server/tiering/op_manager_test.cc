@@ -182,4 +182,36 @@ TEST_F(OpManagerTest, Modify) {
   });
 }
 
+TEST_F(OpManagerTest, CoalesceReads) {
+  pp_->at(0)->Await([this] {
+    Open();
+
+    const unsigned kNum = 10;
+    for (unsigned i = 0; i < kNum; i++)
+      EXPECT_FALSE(Stash(i, absl::StrCat("VALUE", i)));
+
+    while (stashed_.size() < kNum)
+      util::ThisFiber::SleepFor(1ms);
+
+    auto buf_allocs = [this] {
+      auto stats = GetStats().disk_stats;
+      return stats.heap_buf_alloc_count + stats.registered_buf_alloc_count;
+    };
+    size_t allocs_before = buf_allocs();
+
+    // Reads of adjacent pages enqueued without yielding are merged
+    std::vector<util::fb2::Future<std::string>> futures;
+    for (unsigned i = 0; i < kNum; i++)
+      futures.emplace_back(Read(i, stashed_[i]));
+
+    for (unsigned i = 0; i < kNum; i++)
+      EXPECT_EQ(futures[i].Get(), absl::StrCat("VALUE", i));
+
+    EXPECT_LT(buf_allocs() - allocs_before, kNum);
+    EXPECT_EQ(GetStats().pending_read_cnt, 0u);
+
+    Close();
+  });
+}
+
 }  // namespace dfly::tiering
@@ -28,7 +28,7 @@ size_t StashedValueSize(string_view value) {
 
 std::optional<SmallBins::FilledBin> SmallBins::Stash(DbIndex dbid, std::string_view key,
                                                      std::string_view value) {
-  DCHECK_LT(value.size(), 2_KB);
+  DCHECK_LE(value.size(), 2_KB);
 
   size_t value_bytes = StashedValueSize(value);
 
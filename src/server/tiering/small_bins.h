@@ -43,6 +43,11 @@ class SmallBins {
   // List of item key db indices and hashes
   using KeyHashDbList = std::vector<std::tuple<DbIndex, uint64_t /* hash */, DiskSegment>>;
 
+  // Returns true if a stashed bin occupies the page at the given offset.
+  bool IsStashedBin(size_t page_offset) const {
+    return stashed_bins_.contains(page_offset);
+  }
+
   // Returns true if the entry is pending inside SmallBins.
   bool IsPending(DbIndex dbid, std::string_view key) const {
     return current_bin_.count({dbid, std::string(key)}) > 0;
@@ -8,6 +8,7 @@
 
 #include <new>
 
+#include "base/cycle_clock.h"
 #include "base/flags.h"
 #include "base/logging.h"
 #include "facade/op_status.h"
@@ -15,6 +16,7 @@
 #include "server/blocking_controller.h"
 #include "server/command_registry.h"
 #include "server/common.h"
+#include "server/cpu_profiler.h"
 #include "server/db_slice.h"
 #include "server/engine_shard_set.h"
 #include "server/journal/journal.h"
@@ -22,6 +24,13 @@
 
 ABSL_FLAG(uint32_t, tx_queue_warning_len, 96,
           "Length threshold for warning about long transaction queue");
+ABSL_FLAG(bool, tx_optimistic_reads, true,
+          "If true, fast single shard reads run during scheduling even if their keys are "
+          "locked by writers that have not started yet");
+ABSL_FLAG(uint32_t, tx_schedule_coalesce_usec, 0,
+          "If positive, a single shard transaction that has to wake up a shard for scheduling "
+          "waits this long first, so that transactions of other connections for the same shard "
+          "are scheduled by the same cross-thread hop. 0 - disabled");
 
 namespace dfly {
 
@@ -67,6 +76,14 @@ void RecordTxScheduleStats(const Transaction* tx) {
   auto* ss = ServerState::tlocal();
   ++(tx->IsGlobal() ? ss->stats.tx_global_cnt : ss->stats.tx_normal_cnt);
   ++ss->stats.tx_width_freq_arr[tx->GetUniqueShardCnt() - 1];
+  if (tx->GetUniqueShardCnt() == 1) {
+    bool local = tx->GetUniqueShard() == ss->thread_index();
+    ++(local ? ss->stats.tx_shard_local_cnt : ss->stats.tx_shard_remote_cnt);
+  }
+}
+
+uint64_t CyclesToUsec(uint64_t cycles) {
+  return cycles * 1000'000 / base::CycleClock::Frequency();
 }
 
 std::ostream& operator<<(std::ostream& os, Transaction::time_point tp) {
@@ -82,13 +99,14 @@ uint16_t trans_id(const Transaction* ptr) {
 }
 
 struct ScheduleContext {
-  Transaction* trans;
+  Transaction* trans = nullptr;
   bool optimistic_execution = false;
 
   std::atomic<ScheduleContext*> next{nullptr};
 
   std::atomic_uint32_t fail_cnt{0};
 
+  ScheduleContext() = default;
   ScheduleContext(Transaction* t, bool optimistic) : trans(t), optimistic_execution(optimistic) {
   }
 };
@@ -97,6 +115,7 @@ constexpr size_t kAvoidFalseSharingSize = 64;
 struct ScheduleQ {
   alignas(kAvoidFalseSharingSize) base::MPSCIntrusiveQueue<ScheduleContext> queue;
   alignas(kAvoidFalseSharingSize) atomic_bool armed{false};
+  atomic_bool delayed{false};  // the coordinator that armed the queue delays the hop.
 };
 
 void MPSC_intrusive_store_next(ScheduleContext* dest, ScheduleContext* next_node) {
@@ -606,11 +625,22 @@ bool Transaction::RunInShard(EngineShard* shard, bool allow_q_removal) {
 
   DCHECK(IsGlobal() || (sd.local_mask & KEYLOCK_ACQUIRED) || (multi_ && multi_->mode == GLOBAL));
 
+  uint64_t start_cycles = base::CycleClock::Now();
+
   /*************************************************************************/
 
   RunCallback(shard);
 
   /*************************************************************************/
+
+  uint64_t run_cycles = base::CycleClock::Now() - start_cycles;
+  if (cid_)
+    cid_->RecordShardRun(run_cycles);
+  if (sd.armed_cycles) {
+    cid_->RecordTxPhase(TxPhaseStats::QUEUE_WAIT, CyclesToUsec(start_cycles - sd.armed_cycles));
+    cid_->RecordTxPhase(TxPhaseStats::EXECUTION, CyclesToUsec(run_cycles));
+    sd.armed_cycles = 0;
+  }
   // at least the coordinator thread owns the reference.
   DCHECK_GE(GetUseCount(), 1u);
 
@@ -645,6 +675,7 @@ bool Transaction::RunInShard(EngineShard* shard, bool allow_q_removal) {
       if (!became_suspended) {
         GetDbSlice(shard->shard_id()).Release(mode, largs);
         sd.local_mask &= ~KEYLOCK_ACQUIRED;
+        ClearDirtyLocks(shard, &sd);
       }
       sd.local_mask &= ~OUT_OF_ORDER;
     }
@@ -679,8 +710,25 @@ bool Transaction::RunInShard(EngineShard* shard, bool allow_q_removal) {
 void Transaction::RunCallback(EngineShard* shard) {
   DCHECK_EQ(shard, EngineShard::tlocal());
 
+  if (LockMode() == IntentLock::EXCLUSIVE ||
+      (multi_ && multi_->lock_mode == IntentLock::EXCLUSIVE)) {
+    bool first_hop = false;
+    if (!IsGlobal()) {
+      auto& sd = shard_data_[SidToId(shard->shard_id())];
+      first_hop = (sd.local_mask & (KEYLOCK_ACQUIRED | DIRTY_LOCKS)) == KEYLOCK_ACQUIRED;
+      if (first_hop)
+        sd.local_mask |= DIRTY_LOCKS;
+    }
+    shard->OnWriteStarted(first_hop);
+  }
+
+  auto& db_slice = GetDbSlice(shard->shard_id());
+  db_slice.SetKeyspaceEventCmd(cid_);
+
   RunnableResult result;
   try {
+    ScratchScope scratch;  // temporary allocations of the hop
+    CpuProfileCmdScope profile_scope{cid_};
     result = (*cb_ptr_)(this, shard);
 
     if (unique_shard_cnt_ == 1) {
@@ -703,7 +751,7 @@ void Transaction::RunCallback(EngineShard* shard) {
     LOG(FATAL) << "Unexpected exception " << e.what();
   }
 
-  auto& db_slice = GetDbSlice(shard->shard_id());
+  db_slice.SetKeyspaceEventCmd(nullptr);
   db_slice.OnCbFinishBlocking();
 
   // Handle result flags to alter behaviour.
@@ -742,6 +790,7 @@ void Transaction::ScheduleInternal() {
            << " optimistic_execution: " << optimistic_exec;
 
   auto is_active = [this](uint32_t i) { return IsActive(i); };
+  uint64_t start_cycles = cid_->TracksTxPhases() ? base::CycleClock::Now() : 0;
 
   // Loop until successfully scheduled in all shards.
   while (true) {
@@ -766,27 +815,47 @@ void Transaction::ScheduleInternal() {
       break;
     }
 
+    // Schedule contexts are pushed into the per-shard queues, and each shard pulls all pending
+    // contexts in a single ScheduleBatchInShard call. This way transactions scheduled
+    // concurrently by different coordinators share the cross-thread hop.
+    // Optionally, the transaction that arms the queue delays the hop for a short window, during
+    // which transactions of other connections only push their contexts to the armed queue.
+    // Transactions that must not be delayed post the hop themselves if they find the queue
+    // delayed, and the sleeping coordinator then skips it.
+    auto enqueue = [](ShardId sid, ScheduleContext* ctx, uint32_t coalesce_usec) {
+      ScheduleQ& sq = schedule_queues[sid];
+      sq.queue.Push(ctx);
+      bool current_val = false;
+      if (sq.armed.compare_exchange_strong(current_val, true, memory_order_acq_rel)) {
+        if (coalesce_usec > 0) {
+          sq.delayed.store(true, memory_order_release);
+          ThisFiber::SleepFor(chrono::microseconds(coalesce_usec));
+          if (!sq.delayed.exchange(false, memory_order_acq_rel))
+            return;
+        }
+        shard_set->Add(sid, &Transaction::ScheduleBatchInShard);
+      } else if (coalesce_usec == 0 && sq.delayed.load(memory_order_relaxed) &&
+                 sq.delayed.exchange(false, memory_order_acq_rel)) {
+        shard_set->Add(sid, &Transaction::ScheduleBatchInShard);
+      }
+    };
+
     ScheduleContext schedule_ctx{this, optimistic_exec};
+    unique_ptr<ScheduleContext[]> shard_ctxs;
 
     if (unique_shard_cnt_ == 1) {
-      // Single shard optimization. Note: we could apply the same optimization
-      // to multi-shard transactions as well by creating a vector of ScheduleContext.
-      schedule_queues[unique_shard_id_].queue.Push(&schedule_ctx);
-      bool current_val = false;
-      if (schedule_queues[unique_shard_id_].armed.compare_exchange_strong(current_val, true,
-                                                                          memory_order_acq_rel)) {
-        shard_set->Add(unique_shard_id_, &Transaction::ScheduleBatchInShard);
-      }
+      uint32_t coalesce_usec = multi_ ? 0 : absl::GetFlag(FLAGS_tx_schedule_coalesce_usec);
+      enqueue(unique_shard_id_, &schedule_ctx, coalesce_usec);
     } else {
-      auto cb = [&schedule_ctx]() {
-        if (!schedule_ctx.trans->ScheduleInShard(EngineShard::tlocal(),
-                                                 schedule_ctx.optimistic_execution)) {
-          schedule_ctx.fail_cnt.fetch_add(1, memory_order_relaxed);
-        }
-        schedule_ctx.trans->FinishHop();
-      };
-
-      IterateActiveShards([cb](const auto& sd, ShardId i) { shard_set->Add(i, cb); });
+      // A context is an intrusive queue node, so every active shard needs its own one.
+      shard_ctxs = make_unique<ScheduleContext[]>(unique_shard_cnt_);
+      unsigned ctx_idx = 0;
+      IterateActiveShards([&](const auto& sd, ShardId i) {
+        ScheduleContext* ctx = &shard_ctxs[ctx_idx++];
+        ctx->trans = this;
+        ctx->optimistic_execution = optimistic_exec;
+        enqueue(i, ctx, 0);
+      });
 
       // Add this debugging function to print more information when we experience deadlock
       // during tests.
@@ -797,7 +866,12 @@ void Transaction::ScheduleInternal() {
     }
     run_barrier_.Wait();
 
-    if (schedule_ctx.fail_cnt.load(memory_order_relaxed) == 0) {
+    uint32_t fail_cnt = schedule_ctx.fail_cnt.load(memory_order_relaxed);
+    for (unsigned j = 0; shard_ctxs && j < unique_shard_cnt_; ++j) {
+      fail_cnt += shard_ctxs[j].fail_cnt.load(memory_order_relaxed);
+    }
+
+    if (fail_cnt == 0) {
       break;
     }
 
@@ -831,6 +905,10 @@ void Transaction::ScheduleInternal() {
 
   coordinator_state_ |= COORD_SCHED;
   RecordTxScheduleStats(this);
+  if (start_cycles) {
+    cid_->RecordTxPhase(TxPhaseStats::SCHEDULE,
+                        CyclesToUsec(base::CycleClock::Now() - start_cycles));
+  }
 }
 
 // Runs in the coordinator fiber.
@@ -891,9 +969,17 @@ void Transaction::Execute(RunnableType cb, bool conclude) {
   DispatchHop();
   run_barrier_.Wait();
   cb_ptr_ = nullptr;
+  ++stats_.hops;
 
-  if (coordinator_state_ & COORD_CONCLUDING)
+  if (coordinator_state_ & COORD_CONCLUDING) {
     coordinator_state_ &= ~COORD_SCHED;
+    if (cid_) {
+      cid_->RecordHops(stats_.hops);
+      if (cid_->TracksTxPhases())
+        cid_->RecordTxPhase(TxPhaseStats::HOPS, stats_.hops);
+    }
+    stats_.hops = 0;
+  }
 }
 
 // Runs in coordinator thread.
@@ -923,6 +1009,11 @@ void Transaction::DispatchHop() {
 
   run_barrier_.Start(run_cnt);
 
+  if (cid_ && cid_->TracksTxPhases()) {
+    uint64_t now = base::CycleClock::Now();
+    IterateActiveShards([now](auto& sd, auto i) { sd.armed_cycles = now; });
+  }
+
   // Set armed flags on all active shards.
   std::atomic_thread_fence(memory_order_release);  // once fence to avoid flushing writes in loop
   IterateActiveShards([&poll_flags](auto& sd, auto i) {
@@ -1095,6 +1186,47 @@ OpArgs Transaction::GetOpArgs(EngineShard* shard) const {
   return OpArgs{shard, this, GetDbContext()};
 }
 
+bool Transaction::PromoteOutOfOrder(EngineShard* shard) {
+  if (unique_shard_cnt_ != 1 || multi_ || IsGlobal() ||
+      (cid_->opt_mask() & CO::NO_KEY_TRANSACTIONAL))
+    return false;
+
+  auto& sd = shard_data_[SidToId(shard->shard_id())];
+  constexpr uint16_t kSkipMask = OUT_OF_ORDER | WAS_SUSPENDED | AWAKED_Q;
+  if ((sd.local_mask & kSkipMask) || (sd.local_mask & KEYLOCK_ACQUIRED) == 0 ||
+      sd.pq_pos == TxQueue::kEnd)
+    return false;
+
+  // The coordinator state is stable only once the hop is armed.
+  if (!sd.is_armed.load(memory_order_acquire) || (coordinator_state_ & COORD_CONCLUDING) == 0)
+    return false;
+
+  IntentLock::Mode mode = LockMode();
+  if (!shard->shard_lock()->Check(mode) ||
+      !GetDbSlice(shard->shard_id()).IsLockGranted(mode, GetLockArgs(shard->shard_id())))
+    return false;
+
+  sd.local_mask |= OUT_OF_ORDER;
+  return true;
+}
+
+bool Transaction::CanRunOptimisticRead(EngineShard* shard) const {
+  return unique_shard_cnt_ == 1 && !multi_ && LockMode() == IntentLock::SHARED &&
+         (cid_->opt_mask() & CO::FAST) && shard->dirty_lock_holders() == 0 &&
+         shard->multi_shard_lock_holders() == 0 && absl::GetFlag(FLAGS_tx_optimistic_reads);
+}
+
+void Transaction::ClearDirtyLocks(EngineShard* shard, PerShardData* sd) {
+  if (sd->local_mask & DIRTY_LOCKS) {
+    sd->local_mask &= ~DIRTY_LOCKS;
+    shard->OnDirtyLocksReleased();
+  }
+  if (sd->local_mask & MULTI_SHARD_LOCKS) {
+    sd->local_mask &= ~MULTI_SHARD_LOCKS;
+    shard->OnMultiShardLocksReleased();
+  }
+}
+
 // This function should not block since it's run via RunBriefInParallel.
 bool Transaction::ScheduleInShard(EngineShard* shard, bool execute_optimistic) {
   ShardId sid = SidToId(shard->shard_id());
@@ -1116,6 +1248,7 @@ bool Transaction::ScheduleInShard(EngineShard* shard, bool execute_optimistic) {
   auto release_fp_locks = [&]() {
     GetDbSlice(shard->shard_id()).Release(mode, lock_args);
     sd.local_mask &= ~KEYLOCK_ACQUIRED;
+    ClearDirtyLocks(shard, &sd);
   };
 
   // Acquire intent locks. Intent locks are always acquired, even if already locked by others.
@@ -1129,6 +1262,11 @@ bool Transaction::ScheduleInShard(EngineShard* shard, bool execute_optimistic) {
     lock_granted = shard_unlocked && keys_unlocked;
 
     sd.local_mask |= KEYLOCK_ACQUIRED;
+    if ((unique_shard_cnt_ > 1 || multi_) &&
+        (mode == IntentLock::EXCLUSIVE || (multi_ && multi_->lock_mode == IntentLock::EXCLUSIVE))) {
+      sd.local_mask |= MULTI_SHARD_LOCKS;
+      shard->OnMultiShardLocksAcquired();
+    }
     if (lock_granted) {
       sd.local_mask |= OUT_OF_ORDER;
     }
@@ -1148,6 +1286,28 @@ bool Transaction::ScheduleInShard(EngineShard* shard, bool execute_optimistic) {
         release_fp_locks();
         return true;
       }
+    } else if (execute_optimistic && shard_unlocked && CanRunOptimisticRead(shard)) {
+      // The keys are contended only by writers that have not touched this shard yet, so reading
+      // now is equivalent to being ordered before them. The intents stay acquired to protect the
+      // keys from expiry and eviction. If a write managed to run while the callback preempted,
+      // the result is discarded and the read is scheduled via the queue like before.
+      auto* cb = cb_ptr_;
+      uint64_t write_epoch = shard->write_epoch();
+      sd.local_mask |= OPTIMISTIC_EXECUTION;
+
+      RunCallback(shard);
+
+      if (shard->write_epoch() == write_epoch) {
+        shard->stats().tx_optimistic_read_total++;
+        if (coordinator_state_ & COORD_CONCLUDING) {
+          release_fp_locks();
+          return true;
+        }
+      } else {
+        shard->stats().tx_optimistic_read_retries++;
+        cb_ptr_ = cb;
+        sd.local_mask &= ~OPTIMISTIC_EXECUTION;
+      }
     }
   }
 
@@ -1251,6 +1411,7 @@ bool Transaction::CancelShardCb(EngineShard* shard) {
     }
 
     sd.local_mask &= ~KEYLOCK_ACQUIRED;
+    ClearDirtyLocks(shard, &sd);
   }
 
   // Check if we need to poll the next head
@@ -1273,7 +1434,7 @@ ShardArgs Transaction::GetShardArgs(ShardId sid) const {
 }
 
 OpStatus Transaction::WaitOnWatch(const time_point& tp, WaitKeys wkeys, KeyReadyChecker krc,
-                                  bool* block_flag, bool* pause_flag) {
+                                  unsigned demand, bool* block_flag, bool* pause_flag) {
   if (blocking_barrier_.IsClaimed()) {  // Might have been cancelled ahead by a dropping connection
     Conclude();
     return OpStatus::CANCELLED;
@@ -1286,9 +1447,9 @@ OpStatus Transaction::WaitOnWatch(const time_point& tp, WaitKeys wkeys, KeyReady
     if (wkeys) {  // single string_view.
       IndexSlice is(0, 1);
       ShardArgs sa(absl::MakeSpan(&wkeys.value(), 1), absl::MakeSpan(&is, 1));
-      t->WatchInShard(&t->GetNamespace(), sa, shard, krc);
+      t->WatchInShard(&t->GetNamespace(), sa, shard, krc, demand);
     } else {
-      t->WatchInShard(&t->GetNamespace(), t->GetShardArgs(shard->shard_id()), shard, krc);
+      t->WatchInShard(&t->GetNamespace(), t->GetShardArgs(shard->shard_id()), shard, krc, demand);
     }
     return OpStatus::OK;
   };
@@ -1330,14 +1491,14 @@ OpStatus Transaction::WaitOnWatch(const time_point& tp, WaitKeys wkeys, KeyReady
 }
 
 void Transaction::WatchInShard(Namespace* ns, ShardArgs keys, EngineShard* shard,
-                               KeyReadyChecker krc) {
+                               KeyReadyChecker krc, unsigned demand) {
   auto& sd = shard_data_[SidToId(shard->shard_id())];
 
   CHECK_EQ(0, sd.local_mask & WAS_SUSPENDED);
   sd.local_mask |= WAS_SUSPENDED;
   sd.local_mask &= ~OUT_OF_ORDER;
 
-  ns->GetOrAddBlockingController(shard)->AddWatched(keys, std::move(krc), this);
+  ns->GetOrAddBlockingController(shard)->AddWatched(keys, std::move(krc), demand, this);
   DVLOG(2) << "WatchInShard " << DebugId();
 }
 
@@ -1348,6 +1509,7 @@ void Transaction::ExpireShardCb(ShardArgs keys, EngineShard* shard) {
 
   auto& sd = shard_data_[SidToId(shard->shard_id())];
   sd.local_mask &= ~KEYLOCK_ACQUIRED;
+  ClearDirtyLocks(shard, &sd);
 
   namespace_->GetBlockingController(shard->shard_id())->RemovedWatched(keys, this);
   DCHECK(!namespace_->GetBlockingController(shard->shard_id())
@@ -1373,7 +1535,9 @@ OpStatus Transaction::RunSquashedMultiCb(RunnableType cb) {
   auto* shard = EngineShard::tlocal();
   auto& db_slice = GetDbSlice(shard->shard_id());
 
+  db_slice.SetKeyspaceEventCmd(cid_);
   auto result = cb(this, shard);
+  db_slice.SetKeyspaceEventCmd(nullptr);
   db_slice.OnCbFinishBlocking();
 
   LogAutoJournalOnShard(shard, result);
@@ -1395,6 +1559,7 @@ void Transaction::UnlockMultiShardCb(absl::Span<const LockFp> fps, EngineShard*
   ShardId sid = shard->shard_id();
   auto& sd = shard_data_[SidToId(sid)];
   sd.local_mask |= UNLOCK_MULTI;
+  ClearDirtyLocks(shard, &sd);
 
   // It does not have to be that all shards in multi transaction execute this tx.
   // Hence it could stay in the tx queue. We perform the necessary cleanup and remove it from
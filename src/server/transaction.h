@@ -170,6 +170,12 @@ class Transaction {
     WAS_SUSPENDED = 1 << 4,
     AWAKED_Q = 1 << 5,      // Whether it was awakened (by NotifySuspended())
     UNLOCK_MULTI = 1 << 6,  // Whether this shard executed UnlockMultiShardCb
+    // Whether it holds exclusive key locks and already ran on this shard, see
+    // EngineShard::dirty_lock_holders()
+    DIRTY_LOCKS = 1 << 7,
+    // Whether it holds exclusive key locks as part of a multi shard or multi transaction, see
+    // EngineShard::multi_shard_lock_holders()
+    MULTI_SHARD_LOCKS = 1 << 8,
   };
 
   struct Guard {
@@ -216,8 +222,9 @@ class Transaction {
   // or b) tp is reached. If tp is time_point::max() then waits indefinitely.
   // Expects that the transaction had been scheduled before, and uses Execute(.., true) to register.
   // Returns false if timeout occurred, true if was notified by one of the keys.
+  // demand is the max number of elements consumed from the awakening key, 0 if unknown.
   facade::OpStatus WaitOnWatch(const time_point& tp, WaitKeys keys, KeyReadyChecker krc,
-                               bool* block_flag, bool* pause_flag);
+                               unsigned demand, bool* block_flag, bool* pause_flag);
 
   // Returns true if transaction is awaked, false if it's timed-out and can be removed from the
   // blocking queue.
@@ -426,8 +433,11 @@ class Transaction {
       unsigned total_runs = 0;  // total number of runs
     } stats;
 
+    // Cycle clock when the current hop was armed, set only for commands that track tx phases.
+    uint64_t armed_cycles = 0;
+
     // Prevent "false sharing" between cache lines: occupy a full cache line (64 bytes)
-    char pad[64 - 7 * sizeof(uint32_t) - sizeof(Stats)];
+    char pad[64 - 7 * sizeof(uint32_t) - sizeof(Stats) - sizeof(uint64_t)];
   };
 
   static_assert(sizeof(PerShardData) == 64);  // cacheline
@@ -526,8 +536,20 @@ class Transaction {
   // Run actual callback on shard, store result if single shard or OOM was catched
   void RunCallback(EngineShard* shard);
 
+  // Sets OUT_OF_ORDER for an armed single hop transaction waiting in the queue if its locks
+  // are no longer contended. Returns true if the flag was set.
+  bool PromoteOutOfOrder(EngineShard* shard);
+
+  // Whether a single shard read can run during scheduling even though its keys are contended.
+  // It's safe as long as no writer holding those locks has started running on the shard.
+  bool CanRunOptimisticRead(EngineShard* shard) const;
+
+  // Clears DIRTY_LOCKS and MULTI_SHARD_LOCKS when the key locks on the shard are released.
+  void ClearDirtyLocks(EngineShard* shard, PerShardData* sd);
+
   // Adds itself to watched queue in the shard. Must run in that shard thread.
-  void WatchInShard(Namespace* ns, ShardArgs keys, EngineShard* shard, KeyReadyChecker krc);
+  void WatchInShard(Namespace* ns, ShardArgs keys, EngineShard* shard, KeyReadyChecker krc,
+                    unsigned demand);
 
   // Expire blocking transaction, unlock keys and unregister it from the blocking controller
   void ExpireBlocking(WaitKeys keys);
@@ -647,6 +669,7 @@ class Transaction {
   struct Stats {
     size_t schedule_attempts = 0;
     ShardId coordinator_index = 0;
+    uint32_t hops = 0;  // hops since the transaction was scheduled
   } stats_;
 
   std::function<void(Transaction* trans)> tracking_cb_;
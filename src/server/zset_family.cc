@@ -134,6 +134,43 @@ std::optional<double> GetZsetScore(const detail::RobjWrapper* robj_wrapper,
   return 0;
 }
 
+struct RankResult {
+  unsigned rank;
+  double score = 0;
+};
+
+// Resolves the ranks and scores of many members with a single pass over the listpack instead of
+// a scan per member. Ranks are ascending, members that are not found are left untouched.
+void LpFindMany(uint8_t* zl, const facade::ArgRange& members,
+                vector<optional<RankResult>>* res) {
+  // Maps every member to its first position in the request, so duplicates are resolved once.
+  absl::flat_hash_map<string_view, unsigned> first_pos;
+  first_pos.reserve(members.Size());
+  unsigned i = 0;
+  for (string_view member : members.Range())
+    first_pos.emplace(member, i++);
+
+  uint8_t intbuf[LP_INTBUF_SIZE];
+  uint8_t* eptr = lpSeek(zl, 0);
+  uint8_t* sptr = eptr ? lpNext(zl, eptr) : nullptr;
+  size_t found = 0;
+  for (unsigned rank = 0; eptr && found < first_pos.size(); ++rank) {
+    auto it = first_pos.find(container_utils::LpGetView(eptr, intbuf));
+    if (it != first_pos.end()) {
+      (*res)[it->second] = RankResult{rank, detail::ZzlGetScore(sptr)};
+      ++found;
+    }
+    detail::ZzlNext(zl, &eptr, &sptr);
+  }
+
+  i = 0;
+  for (string_view member : members.Range()) {
+    if (unsigned pos = first_pos[member]; pos != i)
+      (*res)[i] = (*res)[pos];
+    ++i;
+  }
+}
+
 void OutputScoredArrayResult(const OpResult<ScoredArray>& result, SinkReplyBuilder* builder) {
   if (result.status() == OpStatus::WRONG_TYPE) {
     return builder->SendError(kWrongTypeErr);
@@ -1047,8 +1084,10 @@ void BZPopMinMax(CmdArgList args, Transaction* tx, SinkReplyBuilder* builder,
     popped_array = OpBZPop(t, shard, key, is_max);
   };
 
-  OpResult<string> popped_key = container_utils::RunCbOnFirstNonEmptyBlocking(
-      tx, OBJ_ZSET, std::move(cb), unsigned(timeout * 1000), &cntx->blocked, &cntx->paused, &dinfo);
+  OpResult<string> popped_key =
+      container_utils::RunCbOnFirstNonEmptyBlocking(tx, OBJ_ZSET, std::move(cb), 1,
+                                                    unsigned(timeout * 1000), &cntx->blocked,
+                                                    &cntx->paused, &dinfo);
 
   auto* rb = static_cast<RedisReplyBuilder*>(builder);
   if (popped_key) {
@@ -1179,11 +1218,6 @@ OpResult<unsigned> OpRemRange(const OpArgs& op_args, string_view key,
   return iv.removed();
 }
 
-struct RankResult {
-  unsigned rank;
-  double score = 0;
-};
-
 OpResult<RankResult> OpRank(const OpArgs& op_args, string_view key, string_view member,
                             bool reverse, bool with_score) {
   auto res_it = op_args.GetDbSlice().FindReadOnly(op_args.db_cntx, key, OBJ_ZSET);
@@ -1380,12 +1414,56 @@ OpResult<MScoreResponse> OpMScore(const OpArgs& op_args, string_view key,
   const detail::RobjWrapper* robj_wrapper = res_it.value()->second.GetRobjWrapper();
 
   size_t i = 0;
+  if (IsListPack(robj_wrapper) && members.Size() > 1) {
+    vector<optional<RankResult>> found(members.Size());
+    LpFindMany((uint8_t*)robj_wrapper->inner_obj(), members, &found);
+    for (const auto& r : found) {
+      if (r)
+        scores[i] = r->score;
+      ++i;
+    }
+    return scores;
+  }
+
   for (string_view member : members.Range())
     scores[i++] = GetZsetScore(robj_wrapper, member);
 
   return scores;
 }
 
+OpResult<vector<optional<unsigned>>> OpMRank(const OpArgs& op_args, string_view key,
+                                             const facade::ArgRange& members, bool reverse) {
+  auto res_it = op_args.GetDbSlice().FindReadOnly(op_args.db_cntx, key, OBJ_ZSET);
+  if (res_it.status() == OpStatus::KEY_NOTFOUND)
+    return vector<optional<unsigned>>(members.Size());
+
+  if (!res_it)
+    return res_it.status();
+
+  vector<optional<unsigned>> ranks(members.Size());
+  const detail::RobjWrapper* robj_wrapper = res_it.value()->second.GetRobjWrapper();
+  size_t i = 0;
+  if (IsListPack(robj_wrapper)) {
+    uint8_t* zl = (uint8_t*)robj_wrapper->inner_obj();
+    vector<optional<RankResult>> found(members.Size());
+    LpFindMany(zl, members, &found);
+    unsigned last = lpLength(zl) / 2 - 1;
+    for (const auto& r : found) {
+      if (r)
+        ranks[i] = reverse ? last - r->rank : r->rank;
+      ++i;
+    }
+    return ranks;
+  }
+
+  // Every lookup descends the score tree once, using its subtree counts.
+  DCHECK_EQ(robj_wrapper->encoding(), OBJ_ENCODING_SKIPLIST);
+  const detail::SortedMap* ss = (const detail::SortedMap*)robj_wrapper->inner_obj();
+  for (string_view member : members.Range())
+    ranks[i++] = ss->GetRank(member, reverse);
+  return ranks;
+}
+
 OpResult<StringVec> OpScan(const OpArgs& op_args, std::string_view key, uint64_t* cursor,
                            const ScanOpts& scan_op) {
   auto find_res = op_args.GetDbSlice().FindReadOnly(op_args.db_cntx, key, OBJ_ZSET);
@@ -1518,28 +1596,46 @@ void ZBooleanOperation(CmdArgList args, string_view cmd, bool is_union, bool sto
     else
       merge_func(&result, &op_res.value(), op_args->agg_type);
 
+    // Release the partial result before merging the next one.
+    ScoredMap{}.swap(op_res.value());
+
     if (result.empty() && !is_union)  // intersection only shrinks
       break;
   }
 
-  // Copy to vector for sorting
-  vector<ScoredMemberView> smvec(result.size());
-  size_t i = 0;
-  for (const auto& [str, score] : result)
-    smvec[i++] = {score, str};
-
   if (store) {
-    // TODO: Use variant collection to avoid smvec copy for store operation
+    // Adds the result in batches, so that only a batch of it is copied at a time.
     auto store_cb = [&, dest_shard = Shard(dest_key, maps.size())](Transaction* t,
                                                                    EngineShard* shard) {
-      if (shard->shard_id() == dest_shard)
-        ZSetFamily::OpAdd(t->GetOpArgs(shard), ZSetFamily::ZParams{.override = true}, dest_key,
-                          smvec);
+      if (shard->shard_id() != dest_shard)
+        return OpStatus::OK;
+
+      constexpr size_t kBatchLen = 1024;
+      vector<ScoredMemberView> batch;
+      batch.reserve(std::min(kBatchLen, result.size()));
+      ZSetFamily::ZParams zparams{.override = true};
+      for (auto it = result.begin(); it != result.end();) {
+        batch.clear();
+        for (; it != result.end() && batch.size() < kBatchLen; ++it)
+          batch.emplace_back(it->second, it->first);
+        ZSetFamily::OpAdd(t->GetOpArgs(shard), zparams, dest_key, batch);
+        zparams.override = false;
+      }
+
+      // Empty result, delete the destination.
+      if (zparams.override)
+        ZSetFamily::OpAdd(t->GetOpArgs(shard), zparams, dest_key, {});
       return OpStatus::OK;
     };
     tx->Execute(store_cb, true);
-    builder->SendLong(smvec.size());
+    builder->SendLong(result.size());
   } else {
+    // Copy to vector for sorting
+    vector<ScoredMemberView> smvec(result.size());
+    size_t i = 0;
+    for (const auto& [str, score] : result)
+      smvec[i++] = {score, str};
+
     std::sort(std::begin(smvec), std::end(smvec));
 
     // We can't use SendScoredArray because it expects strings, not string_views
@@ -1786,6 +1882,27 @@ void ZRankGeneric(CmdArgList args, bool reverse, Transaction* tx, SinkReplyBuild
   }
 }
 
+void ZMRankGeneric(CmdArgList args, bool reverse, Transaction* tx, SinkReplyBuilder* builder) {
+  string_view key = ArgS(args, 0);
+  auto members = args.subspan(1);
+  auto cb = [&](Transaction* t, EngineShard* shard) {
+    return OpMRank(t->GetOpArgs(shard), key, members, reverse);
+  };
+
+  auto result = tx->ScheduleSingleHopT(std::move(cb));
+  if (!result)
+    return builder->SendError(result.status());
+
+  auto* rb = static_cast<RedisReplyBuilder*>(builder);
+  rb->StartArray(result->size());
+  for (const auto& rank : *result) {
+    if (rank)
+      rb->SendLong(*rank);
+    else
+      rb->SendNull();
+  }
+}
+
 void ZRemRangeGeneric(string_view key, const ZSetFamily::ZRangeSpec& range_spec, Transaction* tx,
                       SinkReplyBuilder* builder) {
   auto cb = [&](Transaction* t, EngineShard* shard) {
@@ -2677,6 +2794,14 @@ void ZSetFamily::ZMScore(CmdArgList args, const CommandContext& cmd_cntx) {
   }
 }
 
+void ZSetFamily::ZMRank(CmdArgList args, const CommandContext& cmd_cntx) {
+  ZMRankGeneric(args, false, cmd_cntx.tx, cmd_cntx.rb);
+}
+
+void ZSetFamily::ZMRevRank(CmdArgList args, const CommandContext& cmd_cntx) {
+  ZMRankGeneric(args, true, cmd_cntx.tx, cmd_cntx.rb);
+}
+
 void ZSetFamily::ZScan(CmdArgList args, const CommandContext& cmd_cntx) {
   string_view key = ArgS(args, 0);
   string_view token = ArgS(args, 1);
@@ -2748,6 +2873,8 @@ constexpr uint32_t kZRangeByScore = READ | SORTEDSET | SLOW;
 constexpr uint32_t kZRangeStore = WRITE | SORTEDSET | SLOW;
 constexpr uint32_t kZScore = READ | SORTEDSET | FAST;
 constexpr uint32_t kZMScore = READ | SORTEDSET | FAST;
+constexpr uint32_t kZMRank = READ | SORTEDSET | FAST;
+constexpr uint32_t kZMRevRank = READ | SORTEDSET | FAST;
 constexpr uint32_t kZRemRangeByRank = WRITE | SORTEDSET | SLOW;
 constexpr uint32_t kZRemRangeByScore = WRITE | SORTEDSET | SLOW;
 constexpr uint32_t kZRemRangeByLex = WRITE | SORTEDSET | SLOW;
@@ -2795,6 +2922,8 @@ void ZSetFamily::Register(CommandRegistry* registry) {
       << CI{"ZRANGESTORE", CO::WRITE | CO::DENYOOM, -5, 1, 2, acl::kZRangeStore}.HFUNC(ZRangeStore)
       << CI{"ZSCORE", CO::READONLY | CO::FAST, 3, 1, 1, acl::kZScore}.HFUNC(ZScore)
       << CI{"ZMSCORE", CO::READONLY | CO::FAST, -3, 1, 1, acl::kZMScore}.HFUNC(ZMScore)
+      << CI{"ZMRANK", CO::READONLY | CO::FAST, -3, 1, 1, acl::kZMRank}.HFUNC(ZMRank)
+      << CI{"ZMREVRANK", CO::READONLY | CO::FAST, -3, 1, 1, acl::kZMRevRank}.HFUNC(ZMRevRank)
       << CI{"ZREMRANGEBYRANK", CO::WRITE, 4, 1, 1, acl::kZRemRangeByRank}.HFUNC(ZRemRangeByRank)
       << CI{"ZREMRANGEBYSCORE", CO::WRITE, 4, 1, 1, acl::kZRemRangeByScore}.HFUNC(ZRemRangeByScore)
       << CI{"ZREMRANGEBYLEX", CO::WRITE, 4, 1, 1, acl::kZRemRangeByLex}.HFUNC(ZRemRangeByLex)
@@ -121,6 +121,8 @@ class ZSetFamily {
   static void ZRandMember(CmdArgList args, const CommandContext& cmd_cntx);
   static void ZScore(CmdArgList args, const CommandContext& cmd_cntx);
   static void ZMScore(CmdArgList args, const CommandContext& cmd_cntx);
+  static void ZMRank(CmdArgList args, const CommandContext& cmd_cntx);
+  static void ZMRevRank(CmdArgList args, const CommandContext& cmd_cntx);
   static void ZRangeByLex(CmdArgList args, const CommandContext& cmd_cntx);
   static void ZRevRangeByLex(CmdArgList args, const CommandContext& cmd_cntx);
   static void ZRangeByScore(CmdArgList args, const CommandContext& cmd_cntx);
@@ -368,6 +368,29 @@ TEST_F(ZSetFamilyTest, ZRank) {
   ASSERT_THAT(resp, ErrArg("wrong number of arguments for 'zrevrank' command"));
 }
 
+TEST_F(ZSetFamilyTest, ZMRank) {
+  Run({"zadd", "x", "1", "a", "2", "b", "3", "10"});
+  auto resp = Run({"zmrank", "x", "10", "c", "a", "10"});
+  EXPECT_THAT(resp.GetVec(),
+              ElementsAre(IntArg(2), ArgType(RespExpr::NIL), IntArg(0), IntArg(2)));
+  resp = Run({"zmrevrank", "x", "a", "b"});
+  EXPECT_THAT(resp.GetVec(), ElementsAre(IntArg(2), IntArg(1)));
+  EXPECT_THAT(Run({"zmscore", "x", "b", "10", "c"}).GetVec(),
+              ElementsAre("2", "3", ArgType(RespExpr::NIL)));
+
+  for (int i = 0; i < 200; ++i)
+    Run({"zadd", "large", absl::StrCat(i), absl::StrCat("m", i)});
+  resp = Run({"zmrank", "large", "m150", "m0", "none"});
+  EXPECT_THAT(resp.GetVec(), ElementsAre(IntArg(150), IntArg(0), ArgType(RespExpr::NIL)));
+  resp = Run({"zmrevrank", "large", "m150", "m0"});
+  EXPECT_THAT(resp.GetVec(), ElementsAre(IntArg(49), IntArg(199)));
+
+  resp = Run({"zmrank", "nokey", "a", "b"});
+  EXPECT_THAT(resp.GetVec(), ElementsAre(ArgType(RespExpr::NIL), ArgType(RespExpr::NIL)));
+  Run({"set", "str", "v"});
+  EXPECT_THAT(Run({"zmrank", "str", "a"}), ErrArg("WRONGTYPE"));
+}
+
 TEST_F(ZSetFamilyTest, LargeSet) {
   for (int i = 0; i < 129; ++i) {
     auto resp = Run({"zadd", "key", absl::StrCat(i), absl::StrCat("element:", i)});
@@ -699,6 +722,27 @@ TEST_F(ZSetFamilyTest, ZUnionStore) {
   EXPECT_THAT(resp.GetVec(), ElementsAre("b", "2", "c", "3"));
 }
 
+TEST_F(ZSetFamilyTest, ZUnionStoreLarge) {
+  // The result is stored in batches.
+  vector<string> cmd1 = {"zadd", "z1"}, cmd2 = {"zadd", "z2"};
+  for (int i = 0; i < 2000; ++i) {
+    absl::StrAppend(&cmd1.emplace_back(), i);
+    cmd1.push_back(absl::StrCat("m", i));
+    absl::StrAppend(&cmd2.emplace_back(), i);
+    cmd2.push_back(absl::StrCat("m", i + 1000));
+  }
+  Run(absl::MakeSpan(cmd1));
+  Run(absl::MakeSpan(cmd2));
+
+  EXPECT_EQ(3000, CheckedInt({"zunionstore", "dest", "2", "z1", "z2"}));
+  EXPECT_EQ(3000, CheckedInt({"zcard", "dest"}));
+  EXPECT_EQ(Run({"zscore", "dest", "m1500"}), "2000");
+  EXPECT_EQ(Run({"zscore", "dest", "m2999"}), "1999");
+
+  EXPECT_EQ(0, CheckedInt({"zinterstore", "dest", "2", "z1", "none"}));
+  EXPECT_EQ(0, CheckedInt({"exists", "dest"}));
+}
+
 TEST_F(ZSetFamilyTest, ZUnionStoreOpts) {
   EXPECT_EQ(2, CheckedInt({"zadd", "z1", "1", "a", "2", "b"}));
   EXPECT_EQ(2, CheckedInt({"zadd", "z2", "3", "c", "2", "b"}));
@@ -1030,6 +1030,36 @@ async def test_blocking_commands_cancel(df_factory, df_seeder_factory):
     assert f"MOVED 7141 127.0.0.1:{instances[1].port}" == str(list_e_info.value)
 
 
+@dfly_args({"proactor_threads": 4, "cluster_mode": "yes", "cluster_proxy_multi_key": True})
+async def test_cluster_proxy_multi_key(df_factory):
+    instances = [
+        df_factory.create(port=next(next_port), admin_port=next(next_port)) for i in range(2)
+    ]
+    df_factory.start_all(instances)
+
+    nodes = [(await create_node_info(instance)) for instance in instances]
+    nodes[0].slots = [(0, 8000)]
+    nodes[1].slots = [(8001, 16383)]
+    await push_config(json.dumps(generate_config(nodes)), [node.admin_client for node in nodes])
+
+    # Slots of the keys: a - 15495, b - 3300, c - 7365, d - 11298
+    keys = ["a", "b", "c", "d"]
+    for node in nodes:
+        assert await node.client.mset({k: f"{k}-{node.id}" for k in keys})
+        assert await node.client.mget(keys + ["missing"]) == [f"{k}-{node.id}" for k in keys] + [
+            None
+        ]
+
+    # Every key was written to its owner only.
+    assert await nodes[0].client.execute_command("DBSIZE") == 2
+    assert await nodes[1].client.execute_command("DBSIZE") == 2
+
+    # Other multi-key commands are still rejected.
+    with pytest.raises(aioredis.ResponseError) as e_info:
+        await nodes[0].client.delete(*keys)
+    assert "CROSSSLOT" in str(e_info.value)
+
+
 @pytest.mark.parametrize("set_cluster_node_id", [True, False])
 @dfly_args({"proactor_threads": 4, "cluster_mode": "yes"})
 async def test_cluster_native_client(
@@ -1463,6 +1493,62 @@ async def test_migration_with_key_ttl(df_factory):
     assert await nodes[1].client.execute_command("stick k_sticky") == 0
 
 
+@dfly_args({"proactor_threads": 4, "cluster_mode": "yes"})
+async def test_pipelined_writes_during_migration_finalization(df_factory):
+    # Squashed pipelines must wait behind the slot fence like single commands, otherwise
+    # acknowledged writes could be lost during the handoff.
+    instances = [
+        df_factory.create(port=next(next_port), admin_port=next(next_port)) for i in range(2)
+    ]
+    df_factory.start_all(instances)
+
+    nodes = [(await create_node_info(instance)) for instance in instances]
+    nodes[0].slots = [(0, 16383)]
+    nodes[1].slots = []
+    await push_config(json.dumps(generate_config(nodes)), [node.admin_client for node in nodes])
+
+    acked = {}
+    stop = False
+
+    async def writer():
+        i = 0
+        while not stop:
+            pipe = nodes[0].client.pipeline(transaction=False)
+            batch = [f"key:{i + j}" for j in range(50)]
+            for key in batch:
+                pipe.set(key, i)
+            res = await pipe.execute(raise_on_error=False)
+            for key, r in zip(batch, res):
+                if r is True:
+                    acked[key] = str(i)
+                else:
+                    assert "MOVED" in str(r)
+            i += 50
+
+    writer_task = asyncio.create_task(writer())
+    await asyncio.sleep(0.2)
+
+    nodes[0].migrations.append(
+        MigrationInfo("127.0.0.1", instances[1].admin_port, [(0, 16383)], nodes[1].id)
+    )
+    await push_config(json.dumps(generate_config(nodes)), [node.admin_client for node in nodes])
+    await wait_for_status(nodes[0].admin_client, nodes[1].id, "FINISHED")
+
+    nodes[0].migrations = []
+    nodes[0].slots = []
+    nodes[1].slots = [(0, 16383)]
+    logging.debug("finalize migration")
+    await push_config(json.dumps(generate_config(nodes)), [node.admin_client for node in nodes])
+
+    await asyncio.sleep(0.2)
+    stop = True
+    await writer_task
+
+    assert len(acked) > 0
+    for key, value in acked.items():
+        assert await nodes[1].client.get(key) == value
+
+
 @pytest.mark.exclude_epoll
 @dfly_args({"proactor_threads": 4, "cluster_mode": "yes", "migration_finalization_timeout_ms": 5})
 async def test_network_disconnect_during_migration(df_factory):
@@ -2147,17 +2233,26 @@ async def test_cluster_migration_huge_container(df_factory: DflyInstanceFactory)
 @dfly_args(
     {"proactor_threads": 2, "cluster_mode": "yes", "migration_buckets_serialization_threshold": 1}
 )
-@pytest.mark.parametrize("chunk_size", [1_000_000, 30])
+@pytest.mark.parametrize(
+    "chunk_size, adaptive_pacing, slot_index",
+    [(1_000_000, False, False), (30, False, False), (1_000_000, True, True)],
+)
 @pytest.mark.asyncio
 @pytest.mark.exclude_epoll
 async def test_cluster_migration_while_seeding(
-    df_factory: DflyInstanceFactory, df_seeder_factory: DflySeederFactory, chunk_size
+    df_factory: DflyInstanceFactory,
+    df_seeder_factory: DflySeederFactory,
+    chunk_size,
+    adaptive_pacing,
+    slot_index,
 ):
     instances = [
         df_factory.create(
             port=next(next_port),
             admin_port=next(next_port),
             serialization_max_chunk_size=chunk_size,
+            migration_adaptive_pacing=adaptive_pacing,
+            cluster_slot_index=slot_index,
         )
         for _ in range(2)
     ]
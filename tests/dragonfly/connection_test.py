@@ -467,6 +467,23 @@ async def test_subscribers_with_active_publisher(df_server: DflyInstance, max_co
     await async_pool.disconnect()
 
 
+@dfly_args({"proactor_threads": "1", "subscriber_output_buffer_limit": "1mb"})
+async def test_subscriber_output_buffer_limit(df_server: DflyInstance, async_client: aioredis.Redis):
+    # A subscriber that never reads is disconnected once its queued messages cross the limit
+    reader, writer = await asyncio.open_connection("127.0.0.1", df_server.port, limit=10)
+    writer.write(b"SUBSCRIBE channel\r\n")
+    await writer.drain()
+
+    payload = "x" * 100_000
+    for _ in range(200):
+        await async_client.publish("channel", payload)
+
+    info = await async_client.info("stats")
+    assert info["client_output_buffer_limit_disconnections"] == 1
+
+    writer.close()
+
+
 # This test ensures that no messages are sent after a successful
 # acknowledgement of a unsubscribe.
 # Low publish_buffer_limit makes publishers block on memory backpressure
@@ -556,7 +573,7 @@ async def test_keyspace_events(async_client: aioredis.Redis):
 
 
 async def test_keyspace_events_config_set(async_client: aioredis.Redis):
-    # nonsense does not make sense as argument, we only accept ex or empty string
+    # nonsense has characters that are not keyspace event flags
     with pytest.raises(ResponseError):
         await async_client.config_set("notify_keyspace_events", "nonsense")
 
@@ -906,6 +923,20 @@ async def test_squashed_pipeline(async_client: aioredis.Redis):
         res = res[11:]
 
 
+@dfly_args({"proactor_threads": "4", "pipeline_squash": 10, "pipeline_squash_latency_usec": 1})
+async def test_squashed_pipeline_adaptive(async_client: aioredis.Redis):
+    p = async_client.pipeline(transaction=False)
+    for i in range(1000):
+        p.incr(f"k{i % 10}")
+
+    res = await p.execute()
+    for i in range(10):
+        assert res[-10 + i] == 100
+
+    await async_client.config_set("pipeline_squash_latency_usec", 0)
+    assert await async_client.incr("k0") == 101
+
+
 @dfly_args({"proactor_threads": "4", "pipeline_squash": 10})
 async def test_squashed_pipeline_seeder(df_server, df_seeder_factory):
     seeder = df_seeder_factory.create(port=df_server.port, keys=10_000)
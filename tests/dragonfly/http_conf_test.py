@@ -117,6 +117,41 @@ async def test_http_api(df_server: DflyInstance):
     assert await client.ttl("foo") > 0
 
 
+@dfly_args({"proactor_threads": "2", "expose_http_api": "true"})
+async def test_http_batch_api(df_server: DflyInstance):
+    url = f"http://localhost:{df_server.port}/api/batch"
+    async with get_http_session() as session:
+        body = [
+            ["set", "foo", "bar"],
+            ["get", "foo"],
+            ["mset", "a", "1", "b", "2"],
+            ["mget", "a", "b", "missing"],
+            ["hset", "h", "f", "v"],
+            ["hgetall", "h"],
+            ["lrange", "missing", "0", "-1"],
+            ["foo", "bar"],
+            ["incr", "foo"],
+            ["del", "foo", "a", "b", "h"],
+        ]
+        async with session.post(url, json=body) as resp:
+            assert resp.status == 200
+            assert await resp.json() == [
+                {"result": "OK"},
+                {"result": "bar"},
+                {"result": "OK"},
+                {"result": ["1", "2", None]},
+                {"result": 1},
+                {"result": ["f", "v"]},
+                {"result": []},
+                {"error": "unknown command `FOO`"},
+                {"error": "value is not an integer or out of range"},
+                {"result": 4},
+            ]
+
+        async with session.post(url, json=["get", "foo"]) as resp:
+            assert resp.status == 400
+
+
 @dfly_args({"proactor_threads": "1", "expose_http_api": "true", "requirepass": "XXX"})
 async def test_password_on_http_api(df_server: DflyInstance):
     async with get_http_session("default", "badpass") as session:
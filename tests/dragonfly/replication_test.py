@@ -178,6 +178,54 @@ async def check_all_replicas_finished(c_replicas, c_master, timeout=20):
     raise RuntimeError("Not all replicas finished in time!")
 
 
+async def stream_mixed_writes(client: aioredis.Redis, n_batches: int):
+    """Streams pipelines of single key, same key order dependent and multi-key writes"""
+    for i in range(n_batches):
+        pipe = client.pipeline(transaction=False)
+        for j in range(i * 20, (i + 1) * 20):
+            pipe.set(f"k{j % 50}", j)
+            pipe.incr(f"counter{j % 7}")
+            pipe.mset({f"a{j % 13}": j, f"b{j % 17}": j})
+            pipe.lpush(f"list{j % 5}", j)
+            pipe.set(f"r{j}", j)
+            pipe.rename(f"r{j}", f"rr{j % 20}")
+            pipe.delete(f"k{(j + 25) % 50}")
+        await pipe.execute(raise_on_error=False)
+
+
+@pytest.mark.parametrize(
+    "replica_args",
+    [
+        dict(replica_squash_commands="true"),
+        dict(replica_apply_lanes=4),
+        dict(replica_apply_lanes=4, replica_squash_commands="true"),
+    ],
+)
+async def test_replication_apply_lanes(df_factory: DflyInstanceFactory, replica_args):
+    master = df_factory.create(proactor_threads=4)
+    replica = df_factory.create(proactor_threads=4, **replica_args)
+    df_factory.start_all([master, replica])
+
+    c_master = master.client()
+    c_replica = replica.client()
+
+    seeder = SeederV2(key_target=2_000)
+    await seeder.run(c_master, target_deviation=0.01)
+
+    await c_replica.execute_command(f"REPLICAOF localhost {master.port}")
+    await wait_available_async(c_replica)
+
+    # Stream in stable sync, so that the commands are applied by the replica's apply lanes.
+    await asyncio.gather(seeder.run(c_master, target_ops=2_000), stream_mixed_writes(c_master, 50))
+
+    await check_all_replicas_finished([c_replica], c_master)
+    hashes = await asyncio.gather(*(SeederV2.capture(c) for c in [c_master, c_replica]))
+    assert hashes[0] == hashes[1]
+    for key in ["counter0", "counter6", "a0", "b16", "rr0", "rr19", "k0", "k49"]:
+        assert await c_master.get(key) == await c_replica.get(key)
+    assert await c_master.lrange("list0", 0, -1) == await c_replica.lrange("list0", 0, -1)
+
+
 """
 Test disconnecting replicas during different phases while constantly streaming changes to master.
 
@@ -1110,6 +1158,84 @@ async def test_replication_info(df_factory: DflyInstanceFactory, df_seeder_facto
     await c_replica.connection_pool.disconnect()
 
 
+async def test_replication_flows_info(df_factory: DflyInstanceFactory):
+    master = df_factory.create(proactor_threads=2)
+    replica = df_factory.create(proactor_threads=2, replication_acks_interval=100)
+    df_factory.start_all([master, replica])
+    c_master = master.client()
+    c_replica = replica.client()
+
+    await c_replica.execute_command(f"REPLICAOF localhost {master.port}")
+    await wait_available_async(c_replica)
+
+    for i in range(1000):
+        await c_master.set(f"key{i}", "value")
+    await check_all_replicas_finished([c_replica], c_master)
+
+    master_flows = await c_master.info("REPLICATION_FLOWS")
+    assert set(master_flows.keys()) == {"slave0_flow0", "slave0_flow1"}
+    assert sum(flow["sent_bytes"] for flow in master_flows.values()) > 0
+    assert all(flow["lag"] == 0 for flow in master_flows.values())
+
+    replica_flows = await c_replica.info("REPLICATION_FLOWS")
+    assert set(replica_flows.keys()) == {"flow0", "flow1"}
+    assert sum(flow["received"] for flow in replica_flows.values()) >= 1000
+    assert all(flow["acks_sent"] > 0 for flow in replica_flows.values())
+
+
+async def test_wait_lsn_token(df_factory: DflyInstanceFactory):
+    master = df_factory.create(proactor_threads=2)
+    replica = df_factory.create(proactor_threads=2)
+    df_factory.start_all([master, replica])
+    c_master = master.client()
+    c_replica = replica.client()
+
+    await c_replica.execute_command(f"REPLICAOF localhost {master.port}")
+    await wait_available_async(c_replica)
+
+    for i in range(100):
+        await c_master.set(f"key{i}", i)
+        token = await c_master.execute_command("LSNTOKEN", f"key{i}")
+        assert await c_replica.execute_command("WAITLSN", token, 5000) == "OK"
+        assert await c_replica.get(f"key{i}") == str(i)
+
+    # A token of another master is never reached.
+    token = await c_master.execute_command("LSNTOKEN")
+    with pytest.raises(redis.exceptions.ResponseError, match="timed out"):
+        await c_replica.execute_command("WAITLSN", "x" + token, 10)
+
+    with pytest.raises(redis.exceptions.ResponseError):
+        await c_master.execute_command("WAITLSN", token, 10)
+
+
+async def test_replica_relay(df_factory: DflyInstanceFactory):
+    master = df_factory.create(proactor_threads=2)
+    relay = df_factory.create(proactor_threads=2, replica_relay=True)
+    leaf = df_factory.create(proactor_threads=2)
+    df_factory.start_all([master, relay, leaf])
+    c_master = master.client()
+    c_relay = relay.client()
+    c_leaf = leaf.client()
+
+    await c_master.execute_command("DEBUG POPULATE 1000")
+    await c_relay.execute_command(f"REPLICAOF localhost {master.port}")
+    await wait_available_async(c_relay)
+
+    # The leaf does its full sync from the snapshot of the relay.
+    await c_leaf.execute_command(f"REPLICAOF localhost {relay.port}")
+    await wait_available_async(c_leaf)
+    assert await c_leaf.dbsize() == 1000
+
+    # Stable sync writes on the master reach the leaf through the journal of the relay.
+    for i in range(100):
+        await c_master.set(f"relayed{i}", i)
+
+    async with async_timeout.timeout(5):
+        while await c_leaf.get("relayed99") != "99":
+            await asyncio.sleep(0.05)
+    assert await c_leaf.dbsize() == 1100
+
+
 """
 Test flushall command that's invoked while in full sync mode.
 This can cause an issue because it will be executed on each shard independently.
@@ -3450,3 +3576,57 @@ async def test_big_strings(df_factory):
     line = lines[0]
     peak_bytes = extract_int_after_prefix("Serialization peak bytes: ", line)
     assert peak_bytes < value_size
+
+
+async def test_partial_sync_from_snapshot(df_factory: DflyInstanceFactory):
+    master = df_factory.create(proactor_threads=2)
+    replica = df_factory.create(proactor_threads=2)
+    df_factory.start_all([master, replica])
+    c_master = master.client()
+    c_replica = replica.client()
+
+    seeder = SeederV2(key_target=2_000)
+    await seeder.run(c_master, target_deviation=0.01)
+    await c_replica.execute_command(f"REPLICAOF localhost {master.port}")
+    await wait_for_replicas_state(c_replica)
+    await seeder.run(c_master, target_ops=500)
+    await check_all_replicas_finished([c_replica], c_master)
+
+    # The journal of the master is active, so its snapshot records the journal lsns.
+    file_name = tmp_file_name()
+    assert await c_master.execute_command(f"SAVE DF {file_name}") == "OK"
+    saved_hash = await SeederV2.capture(c_master)
+
+    replica.stop()
+    master.stop()
+
+    # Restart both sides from the snapshot of the master.
+    args = dict(
+        proactor_threads=2, dbfilename=file_name, replica_partial_sync_from_snapshot="true"
+    )
+    master = df_factory.create(port=master.port, **args)
+    master.start()
+    c_master = master.client()
+    await wait_available_async(c_master)
+    assert await SeederV2.capture(c_master) == saved_hash
+
+    replica = df_factory.create(replicaof=f"localhost:{master.port}", **args)
+    replica.start()
+    c_replica = replica.client()
+    await wait_for_replicas_state(c_replica)
+
+    await seeder.run(c_master, target_ops=500)
+    await check_all_replicas_finished([c_replica], c_master)
+
+    assert len(master.find_in_logs("Continuing replication id")) == 1
+    assert len(replica.find_in_logs("Started partial sync")) == 1
+    info = await c_replica.info("replication")
+    assert info["psync_attempts"] == 1
+    assert info["psync_successes"] == 1
+
+    hashes = await asyncio.gather(*(SeederV2.capture(c) for c in [c_master, c_replica]))
+    assert hashes[0] == hashes[1]
+
+    # Both save the snapshot on shutdown, one after the other.
+    replica.stop()
+    master.stop()